@@ -76,6 +76,11 @@ endmacro()
 # NOEMBED Whether the SAPI library should be embedded inside host code, so the
 #   SAPI Sandbox can be initialized with the
 #   ::sapi::Sandbox::Sandbox(FileToc*) constructor.
+# STATIC_PIE Links the sandboxee as a static-PIE binary, which needs neither
+#   the dynamic loader nor any shared library. Functions are found in a table
+#   generated from FUNCTIONS, which is required, instead of with dlsym(). All
+#   dependencies, libffi included, must be static and position-independent
+#   (see CMAKE_POSITION_INDEPENDENT_CODE).
 # LIBRARY The library target to sandbox and expose to the host code (required).
 # LIBRARY_NAME The name of the class which will proxy the library functions
 #   from the functions list (required). You will call functions from the
@@ -89,9 +94,18 @@ endmacro()
 #   specified.
 # API_VERSION Which version of the Sandboxed API to generate. Currently, only
 #   version "1" is defined.
+# MALLOC Allocator to link the sandboxee against: "system" (the default),
+#   "tcmalloc" or "scudo". The default policy of the generated sandbox class
+#   allows the syscalls it needs.
+# MALLOC_LIBRARY Allocator library to link the sandboxee against. Searched for
+#   if omitted.
+# ANNOTATIONS File with annotations of pointer parameters, which determine how
+#   the generated interface synchronizes them, and of pure functions whose
+#   results are memoized. Only used with SAPI_ENABLE_CLANG_TOOL.
 function(add_sapi_library)
-  set(_sapi_opts NOEMBED)
-  set(_sapi_one_value HEADER LIBRARY LIBRARY_NAME NAMESPACE API_VERSION)
+  set(_sapi_opts NOEMBED STATIC_PIE)
+  set(_sapi_one_value HEADER LIBRARY LIBRARY_NAME NAMESPACE API_VERSION
+                       ANNOTATIONS MALLOC MALLOC_LIBRARY)
   set(_sapi_multi_value SOURCES FUNCTIONS INPUTS)
   cmake_parse_arguments(PARSE_ARGV 0 _sapi "${_sapi_opts}"
                         "${_sapi_one_value}" "${_sapi_multi_value}")
@@ -109,21 +123,77 @@ function(add_sapi_library)
     set(_sapi_exported_funcs LINKER:--allow-multiple-definition)
   endif()
 
+  if(NOT _sapi_MALLOC)
+    set(_sapi_MALLOC system)
+  endif()
+  if(NOT _sapi_MALLOC MATCHES "^(system|tcmalloc|scudo)$")
+    message(FATAL_ERROR "MALLOC must be one of system, tcmalloc or scudo")
+  endif()
+  if(NOT _sapi_MALLOC STREQUAL "system" AND NOT _sapi_MALLOC_LIBRARY)
+    if(_sapi_MALLOC STREQUAL "tcmalloc")
+      find_library(SAPI_TCMALLOC_LIBRARY NAMES tcmalloc tcmalloc_minimal)
+      set(_sapi_MALLOC_LIBRARY "${SAPI_TCMALLOC_LIBRARY}")
+    else()
+      find_library(SAPI_SCUDO_LIBRARY NAMES scudo_standalone scudo)
+      set(_sapi_MALLOC_LIBRARY "${SAPI_SCUDO_LIBRARY}")
+    endif()
+    if(NOT _sapi_MALLOC_LIBRARY)
+      message(FATAL_ERROR "MALLOC ${_sapi_MALLOC} requires MALLOC_LIBRARY")
+    endif()
+  endif()
+
   # The sandboxed binary
   set(_sapi_bin "${_sapi_NAME}.bin")
+  if(_sapi_STATIC_PIE)
+    if(NOT _sapi_FUNCTIONS)
+      message(FATAL_ERROR "STATIC_PIE requires FUNCTIONS")
+    endif()
+    # Symbol table for the client, see sandboxed_api/static_symbols.h
+    set(_sapi_static_symbols
+      "${CMAKE_CURRENT_BINARY_DIR}/${_sapi_NAME}_static_symbols.c")
+    set(_sapi_static_decls "")
+    set(_sapi_static_entries "")
+    foreach(func IN LISTS _sapi_FUNCTIONS)
+      string(APPEND _sapi_static_decls "void ${func}(void);\n")
+      string(APPEND _sapi_static_entries "    {\"${func}\", (void*)&${func}},\n")
+    endforeach()
+    file(GENERATE OUTPUT "${_sapi_static_symbols}" CONTENT "\
+#include \"sandboxed_api/static_symbols.h\"
+
+${_sapi_static_decls}
+const struct SapiStaticSymbol sapi_static_symbols[] = {
+${_sapi_static_entries}    {0, 0},
+};
+")
+  endif()
   add_executable("${_sapi_bin}"
     "${SAPI_BINARY_DIR}/sapi_force_cxx_linkage.cc"
+    ${_sapi_static_symbols}
   )
-  target_link_libraries("${_sapi_bin}" PRIVATE
-    -fuse-ld=gold
-    -Wl,--whole-archive "${_sapi_LIBRARY}" -Wl,--no-whole-archive
-    sapi::client
-    ${CMAKE_DL_LIBS}
-  )
-  target_link_options("${_sapi_bin}" PRIVATE
-    LINKER:-E
-    ${_sapi_exported_funcs}
-  )
+  if(_sapi_STATIC_PIE)
+    set_target_properties("${_sapi_bin}" PROPERTIES
+      POSITION_INDEPENDENT_CODE ON
+    )
+    # Not using gold, which can't link static-PIE binaries.
+    target_link_libraries("${_sapi_bin}" PRIVATE
+      -Wl,--whole-archive "${_sapi_LIBRARY}" -Wl,--no-whole-archive
+      sapi::client
+      ${_sapi_MALLOC_LIBRARY}
+    )
+    target_link_options("${_sapi_bin}" PRIVATE -static-pie)
+  else()
+    target_link_libraries("${_sapi_bin}" PRIVATE
+      -fuse-ld=gold
+      -Wl,--whole-archive "${_sapi_LIBRARY}" -Wl,--no-whole-archive
+      sapi::client
+      ${_sapi_MALLOC_LIBRARY}
+      ${CMAKE_DL_LIBS}
+    )
+    target_link_options("${_sapi_bin}" PRIVATE
+      LINKER:-E
+      ${_sapi_exported_funcs}
+    )
+  endif()
 
   if(NOT _sapi_NOEMBED)
     set(_sapi_embed "${_sapi_NAME}_embed")
@@ -151,6 +221,7 @@ function(add_sapi_library)
     "--sapi_embed_name=${_sapi_embed_name}"
     "--sapi_functions=${_sapi_funcs}"
     "--sapi_ns=${_sapi_NAMESPACE}"
+    "--sapi_malloc=${_sapi_MALLOC}"
   )
   if(SAPI_ENABLE_CLANG_TOOL)
     set(_sapi_isystem_args ${CMAKE_CXX_IMPLICIT_INCLUDE_DIRECTORIES})
@@ -160,6 +231,12 @@ function(add_sapi_library)
     else()
       list(APPEND _sapi_generator_command sapi_generator_tool)
     endif()
+    if(_sapi_ANNOTATIONS)
+      get_filename_component(_sapi_ANNOTATIONS "${_sapi_ANNOTATIONS}" ABSOLUTE)
+      list(APPEND _sapi_generator_args
+        "--sapi_annotations=${_sapi_ANNOTATIONS}"
+      )
+    endif()
     list(APPEND _sapi_generator_command
       -p "${CMAKE_CURRENT_BINARY_DIR}"
       ${_sapi_generator_args}
@@ -170,7 +247,7 @@ function(add_sapi_library)
       OUTPUT "${_sapi_gen_header}"
       COMMAND ${_sapi_generator_command}
       COMMENT "Generating interface"
-      DEPENDS ${_sapi_INPUTS}
+      DEPENDS ${_sapi_INPUTS} ${_sapi_ANNOTATIONS}
       VERBATIM
     )
   else()
@@ -217,6 +294,19 @@ function(add_sapi_library)
       "${_sapi_embed}"
     )
   endif()
+
+  # Links the library into the host for the generated
+  # <Name>PassthroughSandbox class, see Sandbox::RunInProcess()
+  add_library("${_sapi_NAME}_passthrough" INTERFACE)
+  target_link_libraries("${_sapi_NAME}_passthrough" INTERFACE
+    "${_sapi_NAME}"
+    -Wl,--whole-archive "${_sapi_LIBRARY}" sapi::passthrough
+    -Wl,--no-whole-archive
+    ${CMAKE_DL_LIBS}
+  )
+  target_link_options("${_sapi_NAME}_passthrough" INTERFACE
+    LINKER:-E
+  )
 endfunction()
 
 # Wrapper for gtest_discover_tests to exclude tests discover when cross compiling.
@@ -0,0 +1,88 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "contrib/benchmark/native_workloads.h"
+#include "contrib/benchmark/overhead_benchmark.h"
+#include "contrib/c-blosc/sandboxed.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace {
+
+// Matches BLOSC_MAX_OVERHEAD from blosc.h.
+constexpr size_t kMaxOverhead = 16;
+
+CbloscApi& GetApi() {
+  static CbloscApi* api = [] {
+    auto* sandbox = new CbloscSapiSandbox();
+    CHECK_OK(sandbox->Init());
+    auto* api = new CbloscApi(sandbox);
+    CHECK_OK(api->blosc_init());
+    CHECK_OK(api->blosc_set_compressor(
+        sapi::v::ConstCStr("blosclz").PtrBefore()));
+    return api;
+  }();
+  return *api;
+}
+
+absl::Status SandboxedCompress(std::vector<uint8_t>& input) {
+  CbloscApi& api = GetApi();
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  sapi::v::Array<uint8_t> outbuf(input.size() + kMaxOverhead);
+  SAPI_ASSIGN_OR_RETURN(
+      int size, api.blosc_compress(kBloscLevel, /*doshuffle=*/1,
+                                   sizeof(uint8_t), inbuf.GetSize(),
+                                   inbuf.PtrBefore(), outbuf.PtrAfter(),
+                                   outbuf.GetSize()));
+  if (size <= 0) {
+    return absl::InternalError("blosc_compress() failed");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SandboxedDecompress(std::vector<uint8_t>& input) {
+  CbloscApi& api = GetApi();
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->Allocate(&inbuf, true));
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->TransferToSandboxee(&inbuf));
+  sapi::v::IntBase<size_t> nbytes;
+  sapi::v::IntBase<size_t> cbytes;
+  sapi::v::IntBase<size_t> blocksize;
+  SAPI_RETURN_IF_ERROR(
+      api.blosc_cbuffer_sizes(inbuf.PtrNone(), nbytes.PtrAfter(),
+                              cbytes.PtrAfter(), blocksize.PtrAfter()));
+  sapi::v::Array<uint8_t> outbuf(nbytes.GetValue());
+  SAPI_ASSIGN_OR_RETURN(int size,
+                        api.blosc_decompress(inbuf.PtrNone(), outbuf.PtrAfter(),
+                                             outbuf.GetSize()));
+  if (size <= 0) {
+    return absl::InternalError("blosc_decompress() failed");
+  }
+  return absl::OkStatus();
+}
+
+[[maybe_unused]] const bool registered = [] {
+  RegisterOverheadBenchmark({"c-blosc/compress", "c-blosc/files/text",
+                             NativeBloscCompress, SandboxedCompress});
+  RegisterOverheadBenchmark({"c-blosc/decompress",
+                             "c-blosc/files/text.blosclz",
+                             NativeBloscDecompress, SandboxedDecompress});
+  return true;
+}();
+
+}  // namespace
@@ -0,0 +1,91 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/benchmark/native_workloads.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "blosc.h"  // NOLINT(build/include)
+#include "zopfli/zopfli.h"
+#include "zstd.h"  // NOLINT(build/include)
+
+absl::Status NativeZstdCompress(std::vector<uint8_t>& input) {
+  std::vector<uint8_t> output(ZSTD_compressBound(input.size()));
+  size_t size = ZSTD_compress(output.data(), output.size(), input.data(),
+                              input.size(), kZstdLevel);
+  if (ZSTD_isError(size)) {
+    return absl::InternalError(ZSTD_getErrorName(size));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status NativeZstdDecompress(std::vector<uint8_t>& input) {
+  unsigned long long size =  // NOLINT(runtime/int)
+      ZSTD_getFrameContentSize(input.data(), input.size());
+  if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    return absl::InvalidArgumentError("Unknown frame content size");
+  }
+  std::vector<uint8_t> output(size);
+  size_t decompressed = ZSTD_decompress(output.data(), output.size(),
+                                        input.data(), input.size());
+  if (ZSTD_isError(decompressed)) {
+    return absl::InternalError(ZSTD_getErrorName(decompressed));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status NativeBloscCompress(std::vector<uint8_t>& input) {
+  static const bool initialized = [] {
+    blosc_init();
+    return blosc_set_compressor("blosclz") >= 0;
+  }();
+  if (!initialized) {
+    return absl::InternalError("blosc_set_compressor() failed");
+  }
+  std::vector<uint8_t> output(input.size() + BLOSC_MAX_OVERHEAD);
+  if (blosc_compress(kBloscLevel, /*doshuffle=*/1, sizeof(uint8_t),
+                     input.size(), input.data(), output.data(),
+                     output.size()) <= 0) {
+    return absl::InternalError("blosc_compress() failed");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status NativeBloscDecompress(std::vector<uint8_t>& input) {
+  size_t nbytes;
+  size_t cbytes;
+  size_t blocksize;
+  blosc_cbuffer_sizes(input.data(), &nbytes, &cbytes, &blocksize);
+  std::vector<uint8_t> output(nbytes);
+  if (blosc_decompress(input.data(), output.data(), output.size()) <= 0) {
+    return absl::InternalError("blosc_decompress() failed");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status NativeZopfliDeflate(std::vector<uint8_t>& input) {
+  ZopfliOptions options;
+  ZopfliInitOptions(&options);
+  options.numiterations = kZopfliIterations;
+  unsigned char* output = nullptr;
+  size_t output_size = 0;
+  ZopfliCompress(&options, ZOPFLI_FORMAT_DEFLATE, input.data(), input.size(),
+                 &output, &output_size);
+  free(output);
+  return output_size > 0 ? absl::OkStatus()
+                         : absl::InternalError("ZopfliCompress() failed");
+}
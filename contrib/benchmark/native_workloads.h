@@ -0,0 +1,39 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Unsandboxed counterparts of the sandboxed workloads. They live in their own
+// translation unit, as the library headers clash with the generated SAPI
+// headers.
+
+#ifndef CONTRIB_BENCHMARK_NATIVE_WORKLOADS_H_
+#define CONTRIB_BENCHMARK_NATIVE_WORKLOADS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/status.h"
+
+inline constexpr int kZstdLevel = 3;
+inline constexpr int kBloscLevel = 5;
+inline constexpr int kZopfliIterations = 1;
+
+absl::Status NativeZstdCompress(std::vector<uint8_t>& input);
+absl::Status NativeZstdDecompress(std::vector<uint8_t>& input);
+
+absl::Status NativeBloscCompress(std::vector<uint8_t>& input);
+absl::Status NativeBloscDecompress(std::vector<uint8_t>& input);
+
+absl::Status NativeZopfliDeflate(std::vector<uint8_t>& input);
+
+#endif  // CONTRIB_BENCHMARK_NATIVE_WORKLOADS_H_
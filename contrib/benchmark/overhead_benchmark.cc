@@ -0,0 +1,108 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/benchmark/overhead_benchmark.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/path.h"
+
+namespace {
+
+// How long the native workload is run to calibrate the overhead.
+constexpr absl::Duration kCalibrationTime = absl::Milliseconds(500);
+
+absl::Status LoadInput(const std::string& name, std::vector<uint8_t>* input) {
+  std::string contents;
+  if (absl::Status status = sapi::file::GetContents(
+          sapi::file::JoinPath(SAPI_CONTRIB_DIR, name), &contents,
+          sapi::file::Defaults());
+      !status.ok()) {
+    return status;
+  }
+  input->assign(contents.begin(), contents.end());
+  return absl::OkStatus();
+}
+
+// Returns the wall time of a single native run.
+absl::Duration CalibrateNative(const WorkloadFn& native,
+                               std::vector<uint8_t>& input) {
+  int64_t runs = 0;
+  const absl::Time start = absl::Now();
+  absl::Duration elapsed;
+  do {
+    native(input).IgnoreError();
+    ++runs;
+    elapsed = absl::Now() - start;
+  } while (elapsed < kCalibrationTime);
+  return elapsed / runs;
+}
+
+void RunWorkload(benchmark::State& state, const OverheadWorkload& workload,
+                 bool sandboxed) {
+  std::vector<uint8_t> input;
+  if (absl::Status status = LoadInput(workload.input, &input); !status.ok()) {
+    state.SkipWithError(status.ToString().c_str());
+    return;
+  }
+  const WorkloadFn& fn = sandboxed ? workload.sandboxed : workload.native;
+  // Also starts the sandbox.
+  if (absl::Status status = fn(input); !status.ok()) {
+    state.SkipWithError(status.ToString().c_str());
+    return;
+  }
+
+  const absl::Time start = absl::Now();
+  for (auto _ : state) {
+    if (absl::Status status = fn(input); !status.ok()) {
+      state.SkipWithError(status.ToString().c_str());
+      break;
+    }
+  }
+  if (state.error_occurred()) {
+    return;
+  }
+  const absl::Duration per_iteration =
+      (absl::Now() - start) / state.iterations();
+  state.SetBytesProcessed(state.iterations() * input.size());
+  if (sandboxed) {
+    state.counters["overhead"] =
+        absl::FDivDuration(per_iteration,
+                           CalibrateNative(workload.native, input));
+  }
+}
+
+}  // namespace
+
+void RegisterOverheadBenchmark(OverheadWorkload workload) {
+  auto shared = std::make_shared<const OverheadWorkload>(std::move(workload));
+  benchmark::RegisterBenchmark(
+      absl::StrCat(shared->name, "/native").c_str(),
+      [shared](benchmark::State& state) { RunWorkload(state, *shared, false); })
+      ->UseRealTime();
+  benchmark::RegisterBenchmark(
+      absl::StrCat(shared->name, "/sandboxed").c_str(),
+      [shared](benchmark::State& state) { RunWorkload(state, *shared, true); })
+      ->UseRealTime();
+}
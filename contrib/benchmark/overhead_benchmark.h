@@ -0,0 +1,47 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Harness comparing sandboxed with unsandboxed runs of the contrib libraries
+// on their bundled test data.
+
+#ifndef CONTRIB_BENCHMARK_OVERHEAD_BENCHMARK_H_
+#define CONTRIB_BENCHMARK_OVERHEAD_BENCHMARK_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+
+// Processes `input` once, e.g. compresses it.
+using WorkloadFn = std::function<absl::Status(std::vector<uint8_t>& input)>;
+
+struct OverheadWorkload {
+  // Benchmark name, e.g. "zstd/compress".
+  std::string name;
+  // Input file, relative to contrib/.
+  std::string input;
+  WorkloadFn native;
+  // Runs in a sandbox shared by all iterations, which is started before the
+  // measurement.
+  WorkloadFn sandboxed;
+};
+
+// Registers "<name>/native" and "<name>/sandboxed" benchmarks, which report
+// the input throughput. The latter also reports "overhead", its time per
+// iteration relative to the native one's.
+void RegisterOverheadBenchmark(OverheadWorkload workload);
+
+#endif  // CONTRIB_BENCHMARK_OVERHEAD_BENCHMARK_H_
@@ -0,0 +1,63 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "contrib/benchmark/native_workloads.h"
+#include "contrib/benchmark/overhead_benchmark.h"
+#include "contrib/zopfli/sandboxed.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace {
+
+ZopfliApi& GetApi() {
+  static ZopfliApi* api = [] {
+    auto* sandbox = new ZopfliSapiSandbox();
+    CHECK_OK(sandbox->Init());
+    return new ZopfliApi(sandbox);
+  }();
+  return *api;
+}
+
+absl::Status SandboxedDeflate(std::vector<uint8_t>& input) {
+  ZopfliApi& api = GetApi();
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  sapi::v::Struct<ZopfliOptions> options;
+  SAPI_RETURN_IF_ERROR(api.ZopfliInitOptions(options.PtrAfter()));
+  options.mutable_data()->numiterations = kZopfliIterations;
+
+  sapi::v::GenericPtr outptr;
+  sapi::v::IntBase<size_t> outsize(0);
+  SAPI_RETURN_IF_ERROR(api.ZopfliCompress(
+      options.PtrBefore(), ZOPFLI_FORMAT_DEFLATE, inbuf.PtrBefore(),
+      inbuf.GetSize(), outptr.PtrAfter(), outsize.PtrBoth()));
+  if (outsize.GetValue() == 0) {
+    return absl::InternalError("ZopfliCompress() failed");
+  }
+  // Also releases the output in the sandboxee.
+  sapi::v::Array<uint8_t> outbuf(outsize.GetValue());
+  outbuf.SetRemote(reinterpret_cast<void*>(outptr.GetValue()));
+  return api.GetSandbox()->TransferFromSandboxeeAndFree(&outbuf);
+}
+
+[[maybe_unused]] const bool registered = [] {
+  RegisterOverheadBenchmark({"zopfli/deflate", "zopfli/files/text",
+                             NativeZopfliDeflate, SandboxedDeflate});
+  return true;
+}();
+
+}  // namespace
@@ -0,0 +1,83 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "contrib/benchmark/native_workloads.h"
+#include "contrib/benchmark/overhead_benchmark.h"
+#include "contrib/zstd/sandboxed.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace {
+
+ZstdApi& GetApi() {
+  static ZstdApi* api = [] {
+    auto* sandbox = new ZstdSapiSandbox();
+    CHECK_OK(sandbox->Init());
+    return new ZstdApi(sandbox);
+  }();
+  return *api;
+}
+
+absl::Status SandboxedCompress(std::vector<uint8_t>& input) {
+  ZstdApi& api = GetApi();
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  SAPI_ASSIGN_OR_RETURN(size_t bound, api.ZSTD_compressBound(input.size()));
+  sapi::v::Array<uint8_t> outbuf(bound);
+  SAPI_ASSIGN_OR_RETURN(
+      size_t size, api.ZSTD_compress(outbuf.PtrAfter(), bound,
+                                     inbuf.PtrBefore(), inbuf.GetSize(),
+                                     kZstdLevel));
+  SAPI_ASSIGN_OR_RETURN(int error, api.ZSTD_isError(size));
+  if (error) {
+    return absl::InternalError("ZSTD_compress() failed");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SandboxedDecompress(std::vector<uint8_t>& input) {
+  ZstdApi& api = GetApi();
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->Allocate(&inbuf, true));
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->TransferToSandboxee(&inbuf));
+  SAPI_ASSIGN_OR_RETURN(
+      size_t size,
+      api.ZSTD_getFrameContentSize(inbuf.PtrNone(), inbuf.GetSize()));
+  SAPI_ASSIGN_OR_RETURN(int error, api.ZSTD_isError(size));
+  if (error) {
+    return absl::InvalidArgumentError("Unknown frame content size");
+  }
+  sapi::v::Array<uint8_t> outbuf(size);
+  SAPI_ASSIGN_OR_RETURN(size_t decompressed,
+                        api.ZSTD_decompress(outbuf.PtrAfter(), size,
+                                            inbuf.PtrNone(), inbuf.GetSize()));
+  SAPI_ASSIGN_OR_RETURN(error, api.ZSTD_isError(decompressed));
+  if (error) {
+    return absl::InternalError("ZSTD_decompress() failed");
+  }
+  return absl::OkStatus();
+}
+
+[[maybe_unused]] const bool registered = [] {
+  RegisterOverheadBenchmark({"zstd/compress", "zstd/files/text",
+                             NativeZstdCompress, SandboxedCompress});
+  RegisterOverheadBenchmark({"zstd/decompress", "zstd/files/text.blob.zstd",
+                             NativeZstdDecompress, SandboxedDecompress});
+  return true;
+}();
+
+}  // namespace
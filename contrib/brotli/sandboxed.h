@@ -34,6 +34,10 @@ class BrotliSapiSandbox : public BrotliSandbox {
         .AllowGetPIDs()
         .AllowExit()
         .BlockSyscallWithErrno(__NR_openat, ENOENT)
+        // Shared buffers of the streaming methods, whose file descriptors
+        // are received with recvmsg().
+        .AllowSyscall(__NR_recvmsg)
+        .AllowSharedMemoryMappings()
         .BuildOrDie();
   }
 };
@@ -15,6 +15,8 @@
 #include <fcntl.h>
 
 #include <fstream>
+#include <sstream>
+#include <string>
 
 #include "contrib/brotli/sandboxed.h"
 #include "contrib/brotli/utils/utils_brotli.h"
@@ -134,6 +136,33 @@ TEST_F(BrotliBase, CompressStreamDecompress) {
   ASSERT_EQ(buforig, bufout);
 }
 
+TEST_F(BrotliBase, CompressStreamShared) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint8_t> buforig,
+                            ReadFile(GetTestFilePath("text")));
+  // Larger than the shared buffers, so that they are refilled.
+  std::string orig;
+  while (orig.size() <= 2 * kStreamBufferSize) {
+    orig.append(buforig.begin(), buforig.end());
+  }
+
+  std::istringstream in(orig);
+  std::stringstream comp;
+  ASSERT_THAT(enc_.get()->CompressStream(in, comp), IsOk());
+  ASSERT_LT(comp.str().size(), orig.size());
+
+  std::ostringstream out;
+  ASSERT_THAT(dec_.get()->DecompressStream(comp, out), IsOk());
+  ASSERT_EQ(orig, out.str());
+}
+
+TEST_F(BrotliBase, DecompressStreamSharedTruncated) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint8_t> bufcomp,
+                            ReadFile(GetTestFilePath("text.full.brotli")));
+  std::istringstream in(std::string(bufcomp.begin(), bufcomp.end() - 4));
+  std::ostringstream out;
+  ASSERT_FALSE(dec_.get()->DecompressStream(in, out).ok());
+}
+
 TEST_P(BrotliMultiFile, Decompress) {
   SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint8_t> buforig,
                             ReadFile(GetTestFilePath("text")));
@@ -203,6 +232,17 @@ TEST_P(BrotliMultiFile, DecompressChunksStream) {
   ASSERT_EQ(buforig, bufout);
 }
 
+TEST_P(BrotliMultiFile, DecompressStreamShared) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint8_t> buforig,
+                            ReadFile(GetTestFilePath("text")));
+
+  std::ifstream in(GetTestFilePath(GetParam()), std::ios::binary);
+  ASSERT_TRUE(in.is_open());
+  std::ostringstream out;
+  ASSERT_THAT(dec_.get()->DecompressStream(in, out), IsOk());
+  ASSERT_EQ(std::string(buforig.begin(), buforig.end()), out.str());
+}
+
 INSTANTIATE_TEST_SUITE_P(BrotliBase, BrotliMultiFile,
                          testing::Values("text.full.brotli",
                                          "text.chunk.brotli"));
@@ -25,6 +25,9 @@
 #include "absl/status/statusor.h"
 
 constexpr size_t kFileMaxSize = size_t{1} << 30;  // 1GiB
+// Size of the shared buffers used by the CompressStream() and
+// DecompressStream() methods.
+constexpr size_t kStreamBufferSize = size_t{64} << 10;  // 64KiB
 
 std::streamsize GetStreamSize(std::ifstream& stream);
 
@@ -14,8 +14,11 @@
 
 #include "contrib/brotli/utils/utils_brotli_dec.h"
 
+#include <cstdint>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "contrib/brotli/sandboxed.h"
 #include "contrib/brotli/utils/utils_brotli.h"
@@ -122,3 +125,65 @@ absl::StatusOr<std::vector<uint8_t>> BrotliDecoder::TakeOutput() {
 
   return buf_out;
 }
+
+absl::Status BrotliDecoder::InitStreamBuffers() {
+  if (stream_in_ != nullptr) {
+    return absl::OkStatus();
+  }
+  auto stream_in =
+      std::make_unique<sapi::v::SharedArray<uint8_t>>(kStreamBufferSize);
+  auto stream_out =
+      std::make_unique<sapi::v::SharedArray<uint8_t>>(kStreamBufferSize);
+  SAPI_RETURN_IF_ERROR(sandbox_->Allocate(stream_in.get(), true));
+  SAPI_RETURN_IF_ERROR(sandbox_->Allocate(stream_out.get(), true));
+  stream_in_ = std::move(stream_in);
+  stream_out_ = std::move(stream_out);
+  return absl::OkStatus();
+}
+
+absl::Status BrotliDecoder::DecompressStream(std::istream& in,
+                                             std::ostream& out) {
+  SAPI_RETURN_IF_ERROR(CheckIsInit());
+  SAPI_RETURN_IF_ERROR(InitStreamBuffers());
+
+  BrotliDecoderResult result = BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT;
+  sapi::v::IntBase<size_t> sapi_avilable_in(0);
+  sapi::v::GenericPtr sapi_next_in(stream_in_->GetRemote());
+  while (result != BROTLI_DECODER_RESULT_SUCCESS) {
+    if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+      in.read(reinterpret_cast<char*>(stream_in_->GetData()),
+              stream_in_->GetSize());
+      if (in.bad()) {
+        return absl::UnavailableError("Error reading input");
+      }
+      if (in.gcount() == 0) {
+        return absl::UnavailableError("Premature end of input");
+      }
+      sapi_avilable_in.SetValue(in.gcount());
+      sapi_next_in.SetValue(
+          reinterpret_cast<uintptr_t>(stream_in_->GetRemote()));
+    }
+
+    sapi::v::IntBase<size_t> sapi_avilable_out(stream_out_->GetSize());
+    sapi::v::GenericPtr sapi_next_out(stream_out_->GetRemote());
+    SAPI_ASSIGN_OR_RETURN(
+        result, api_.BrotliDecoderDecompressStream(
+                    state_.PtrNone(), sapi_avilable_in.PtrBoth(),
+                    sapi_next_in.PtrBoth(), sapi_avilable_out.PtrBoth(),
+                    sapi_next_out.PtrBoth(), &null_ptr_));
+    if (result == BROTLI_DECODER_RESULT_ERROR) {
+      return absl::UnavailableError("Unable to decompress input");
+    }
+    if (sapi_avilable_out.GetValue() > stream_out_->GetSize()) {
+      return absl::UnavailableError("Invalid buffer state");
+    }
+
+    size_t produced = stream_out_->GetSize() - sapi_avilable_out.GetValue();
+    out.write(reinterpret_cast<const char*>(stream_out_->GetData()), produced);
+    if (!out.good()) {
+      return absl::UnavailableError("Error writting output");
+    }
+  }
+
+  return absl::OkStatus();
+}
@@ -15,11 +15,15 @@
 #ifndef CONTRIB_BROTLI_UTILS_UTILS_BROTLI_DEC_H_
 #define CONTRIB_BROTLI_UTILS_UTILS_BROTLI_DEC_H_
 
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <vector>
 
 #include "absl/log/die_if_null.h"
 #include "contrib/brotli/sandboxed.h"
 #include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_shared_array.h"
 
 class BrotliDecoder {
  public:
@@ -36,15 +40,22 @@ class BrotliDecoder {
 
   absl::StatusOr<std::vector<uint8_t>> TakeOutput();
 
+  // Decompresses a complete stream read from `in` into `out`, like
+  // BrotliEncoder::CompressStream() does for compression.
+  absl::Status DecompressStream(std::istream& in, std::ostream& out);
+
  protected:
   absl::Status InitStructs();
   absl::Status CheckIsInit();
+  absl::Status InitStreamBuffers();
 
   BrotliSandbox* sandbox_;
   BrotliApi api_;
   absl::Status status;
   sapi::v::GenericPtr state_;
   sapi::v::NullPtr null_ptr_;
+  std::unique_ptr<sapi::v::SharedArray<uint8_t>> stream_in_;
+  std::unique_ptr<sapi::v::SharedArray<uint8_t>> stream_out_;
 };
 
 #endif  // CONTRIB_BROTLI_UTILS_UTILS_BROTLI_DEC_H_
@@ -14,8 +14,11 @@
 
 #include "contrib/brotli/utils/utils_brotli_enc.h"
 
+#include <cstdint>
 #include <fstream>
+#include <memory>
 #include <string>
+#include <utility>
 
 #include "contrib/brotli/sandboxed.h"
 #include "contrib/brotli/utils/utils_brotli.h"
@@ -119,3 +122,73 @@ absl::StatusOr<std::vector<uint8_t>> BrotliEncoder::TakeOutput() {
 
   return buf_out;
 }
+
+absl::Status BrotliEncoder::InitStreamBuffers() {
+  if (stream_in_ != nullptr) {
+    return absl::OkStatus();
+  }
+  auto stream_in =
+      std::make_unique<sapi::v::SharedArray<uint8_t>>(kStreamBufferSize);
+  auto stream_out =
+      std::make_unique<sapi::v::SharedArray<uint8_t>>(kStreamBufferSize);
+  SAPI_RETURN_IF_ERROR(sandbox_->Allocate(stream_in.get(), true));
+  SAPI_RETURN_IF_ERROR(sandbox_->Allocate(stream_out.get(), true));
+  stream_in_ = std::move(stream_in);
+  stream_out_ = std::move(stream_out);
+  return absl::OkStatus();
+}
+
+absl::Status BrotliEncoder::CompressStream(std::istream& in,
+                                           std::ostream& out) {
+  SAPI_RETURN_IF_ERROR(CheckIsInit());
+  SAPI_RETURN_IF_ERROR(InitStreamBuffers());
+
+  BrotliEncoderOperation op = BROTLI_OPERATION_PROCESS;
+  sapi::v::IntBase<size_t> sapi_avilable_in(0);
+  sapi::v::GenericPtr sapi_next_in(stream_in_->GetRemote());
+  for (;;) {
+    if (sapi_avilable_in.GetValue() == 0 && op != BROTLI_OPERATION_FINISH) {
+      in.read(reinterpret_cast<char*>(stream_in_->GetData()),
+              stream_in_->GetSize());
+      if (in.bad()) {
+        return absl::UnavailableError("Error reading input");
+      }
+      sapi_avilable_in.SetValue(in.gcount());
+      sapi_next_in.SetValue(
+          reinterpret_cast<uintptr_t>(stream_in_->GetRemote()));
+      if (in.eof()) {
+        op = BROTLI_OPERATION_FINISH;
+      }
+    }
+
+    sapi::v::IntBase<size_t> sapi_avilable_out(stream_out_->GetSize());
+    sapi::v::GenericPtr sapi_next_out(stream_out_->GetRemote());
+    SAPI_ASSIGN_OR_RETURN(
+        bool ret,
+        api_.BrotliEncoderCompressStream(
+            state_.PtrNone(), op, sapi_avilable_in.PtrBoth(),
+            sapi_next_in.PtrBoth(), sapi_avilable_out.PtrBoth(),
+            sapi_next_out.PtrBoth(), &null_ptr_));
+    if (!ret) {
+      return absl::UnavailableError("Unable to compress input");
+    }
+    if (sapi_avilable_out.GetValue() > stream_out_->GetSize() ||
+        sapi_avilable_in.GetValue() > stream_in_->GetSize()) {
+      return absl::UnavailableError("Invalid buffer state");
+    }
+
+    size_t produced = stream_out_->GetSize() - sapi_avilable_out.GetValue();
+    out.write(reinterpret_cast<const char*>(stream_out_->GetData()), produced);
+    if (!out.good()) {
+      return absl::UnavailableError("Error writting output");
+    }
+
+    if (op == BROTLI_OPERATION_FINISH && sapi_avilable_in.GetValue() == 0) {
+      SAPI_ASSIGN_OR_RETURN(int finished,
+                            api_.BrotliEncoderIsFinished(state_.PtrNone()));
+      if (finished) {
+        return absl::OkStatus();
+      }
+    }
+  }
+}
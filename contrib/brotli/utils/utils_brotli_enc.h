@@ -15,11 +15,15 @@
 #ifndef CONTRIB_BROTLI_UTILS_UTILS_BROTLI_ENC_H_
 #define CONTRIB_BROTLI_UTILS_UTILS_BROTLI_ENC_H_
 
+#include <istream>
+#include <memory>
+#include <ostream>
 #include <vector>
 
 #include "absl/log/die_if_null.h"
 #include "contrib/brotli/sandboxed.h"
 #include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_shared_array.h"
 
 class BrotliEncoder {
  public:
@@ -37,15 +41,24 @@ class BrotliEncoder {
 
   absl::StatusOr<std::vector<uint8_t>> TakeOutput();
 
+  // Compresses all of `in` into `out`, finishing the stream. Data moves
+  // through buffers in memory shared with the sandboxee, which are allocated
+  // on first use and kept, so memory use is bounded regardless of the input
+  // size. The sandbox policy must allow shared mappings.
+  absl::Status CompressStream(std::istream& in, std::ostream& out);
+
  protected:
   absl::Status InitStructs();
   absl::Status CheckIsInit();
+  absl::Status InitStreamBuffers();
 
   BrotliSandbox* sandbox_;
   BrotliApi api_;
   absl::Status status;
   sapi::v::GenericPtr state_;
   sapi::v::NullPtr null_ptr_;
+  std::unique_ptr<sapi::v::SharedArray<uint8_t>> stream_in_;
+  std::unique_ptr<sapi::v::SharedArray<uint8_t>> stream_out_;
 };
 
 #endif  // CONTRIB_BROTLI_UTILS_UTILS_BROTLI_ENC_H_
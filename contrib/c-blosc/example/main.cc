@@ -63,7 +63,8 @@ int main(int argc, char* argv[]) {
     return EXIT_FAILURE;
   }
 
-  CbloscSapiSandbox sandbox;
+  CbloscSapiSandbox sandbox(
+      /*allow_threads=*/absl::GetFlag(FLAGS_nthreads) > 1);
   if (!sandbox.Init().ok()) {
     std::cerr << "Unable to start sandbox\n";
     return EXIT_FAILURE;
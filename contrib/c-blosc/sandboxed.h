@@ -16,27 +16,98 @@
 #define CONTRIB_CBLOSC_SANDBOXED_H_
 
 #include <libgen.h>
+#include <linux/filter.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/mman.h>
 #include <syscall.h>
 
+#include <cerrno>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
+#include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sapi_blosc.sapi.h"  // NOLINT(build/include)
 
 class CbloscSapiSandbox : public CbloscSandbox {
  public:
+  // With `allow_threads`, blosc may start worker threads, i.e. be used with
+  // blosc_set_nthreads() values above 1. Without, only one thread is available
+  // and larger values make the sandboxee violate the policy once blosc starts
+  // its threads.
+  explicit CbloscSapiSandbox(bool allow_threads = false)
+      : allow_threads_(allow_threads) {}
+
   std::unique_ptr<sandbox2::Policy> ModifyPolicy(
       sandbox2::PolicyBuilder*) override {
-    return sandbox2::PolicyBuilder()
-        .AllowStaticStartup()
+    sandbox2::PolicyBuilder builder;
+    builder.AllowStaticStartup()
         .AllowRead()
         .AllowWrite()
         .AllowExit()
         .AllowSystemMalloc()
         .AllowSyscalls({
             __NR_sysinfo,
+        });
+    if (allow_threads_) {
+      AllowWorkerThreads(builder);
+    }
+    return builder.BuildOrDie();
+  }
+
+ private:
+  // Allows creating threads, but not processes: clone() is only allowed with
+  // the flags of glibc's pthread_create(). clone3() takes its flags in memory,
+  // which seccomp cannot inspect, so it fails with ENOSYS and glibc falls
+  // back to clone().
+  static void AllowWorkerThreads(sandbox2::PolicyBuilder& builder) {
+    static constexpr uint32_t kPthreadCloneFlags =
+        CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SYSVSEM | CLONE_SIGHAND |
+        CLONE_THREAD | CLONE_SETTLS | CLONE_PARENT_SETTID |
+        CLONE_CHILD_CLEARTID;
+    builder
+        .AddPolicyOnSyscall(__NR_clone,
+                            {
+                                ARG_32(0),  // flags
+                                JEQ32(kPthreadCloneFlags, ALLOW),
+                            })
+#ifdef __NR_clone3
+        .BlockSyscallWithErrno(__NR_clone3, ENOSYS)
+#endif
+        // Thread stacks, with a guard page.
+        .AddPolicyOnMmap([](bpf_labels& labels) -> std::vector<sock_filter> {
+          return {
+              ARG_32(3),  // flags
+              JNE32(MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+                    JUMP(&labels, mmap_stack_end)),
+              ARG_32(2),  // prot
+              JEQ32(PROT_NONE, ALLOW),
+              LABEL(&labels, mmap_stack_end),
+          };
         })
-        .BuildOrDie();
+        .AddPolicyOnSyscall(__NR_mprotect,
+                            {
+                                ARG_32(2),  // prot
+                                JEQ32(PROT_READ | PROT_WRITE, ALLOW),
+                            })
+        // Releasing the stacks of threads that exited.
+        .AddPolicyOnSyscall(__NR_madvise,
+                            {
+                                ARG_32(2),  // advice
+                                JEQ32(MADV_DONTNEED, ALLOW),
+                            })
+        .AllowFutexOp(FUTEX_WAIT)
+        .AllowFutexOp(FUTEX_WAKE)
+#ifdef __NR_rseq
+        // glibc 2.35 and later register each new thread for restartable
+        // sequences.
+        .AllowSyscall(__NR_rseq)
+#endif
+        .AllowSyscalls({__NR_sched_yield, __NR_gettid});
   }
+
+  bool allow_threads_;
 };
 
 #endif  // CONTRIB_CBLOSC_SANDBOXED_
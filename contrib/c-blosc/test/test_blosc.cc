@@ -13,6 +13,8 @@
 // limitations under the License.
 
 #include <fstream>
+#include <iterator>
+#include <string>
 
 #include "contrib/c-blosc/sandboxed.h"
 #include "contrib/c-blosc/utils/utils_blosc.h"
@@ -79,6 +81,57 @@ std::streamsize GetStreamSize(std::ifstream& stream) {
 
 class TestText : public testing::TestWithParam<std::string> {};
 
+TEST(SandboxTest, CompressDecompressWithThreads) {
+  absl::Status status;
+  CbloscSapiSandbox sandbox(/*allow_threads=*/true);
+  ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
+  CbloscApi api = CbloscApi(&sandbox);
+  ASSERT_THAT(api.blosc_init(), IsOk());
+
+  // Large enough for blosc to split the work across its threads.
+  std::string infile_s = GetTemporaryFile("large");
+  ASSERT_FALSE(infile_s.empty());
+  {
+    std::ifstream text(GetTestFilePath("text"), std::ios::binary);
+    ASSERT_TRUE(text.is_open());
+    std::string contents((std::istreambuf_iterator<char>(text)),
+                         std::istreambuf_iterator<char>());
+    std::ofstream large(infile_s, std::ios::binary);
+    for (int i = 0; i < 64; ++i) {
+      large << contents;
+    }
+    ASSERT_TRUE(large.good());
+  }
+
+  std::string middlefile_s = GetTemporaryFile("middle");
+  ASSERT_FALSE(middlefile_s.empty());
+  std::string outfile_s = GetTemporaryFile("out");
+  ASSERT_FALSE(outfile_s.empty());
+
+  std::ifstream infile(infile_s, std::ios::binary);
+  ASSERT_TRUE(infile.is_open());
+  std::ofstream outmiddlefile(middlefile_s, std::ios::binary);
+  ASSERT_TRUE(outmiddlefile.is_open());
+
+  std::string compressor("blosclz");
+  status = Compress(api, infile, outmiddlefile, 5, compressor, 4);
+  ASSERT_THAT(status, IsOk()) << "Unable to compress file";
+  outmiddlefile.close();
+
+  std::ifstream inmiddlefile(middlefile_s, std::ios::binary);
+  ASSERT_TRUE(inmiddlefile.is_open());
+  std::ofstream outfile(outfile_s, std::ios::binary);
+  ASSERT_TRUE(outfile.is_open());
+
+  status = Decompress(api, inmiddlefile, outfile, 4);
+  ASSERT_THAT(status, IsOk()) << "Unable to decompress file";
+  outfile.close();
+
+  ASSERT_TRUE(CompareFiles(infile_s, outfile_s));
+  EXPECT_THAT(api.blosc_destroy(), IsOk());
+}
+
+
 TEST(SandboxTest, CheckInit) {
   CbloscSapiSandbox sandbox;
   ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
@@ -318,6 +371,45 @@ TEST_P(TestText, CompressDecompress) {
   ASSERT_TRUE(CompareFiles(infile_s, outfile_s));
 }
 
+TEST_P(TestText, CompressDecompressSharded) {
+  absl::Status status;
+  CbloscSandboxPool pool({.size = 2});
+
+  std::string compressor(GetParam());
+
+  std::string infile_s = GetTestFilePath("text");
+  std::string middlefile_s =
+      GetTemporaryFile(absl::StrCat("middle", compressor));
+  ASSERT_FALSE(middlefile_s.empty());
+
+  std::ifstream infile(infile_s, std::ios::binary);
+  ASSERT_TRUE(infile.is_open());
+
+  std::ofstream outmiddlefile(middlefile_s, std::ios::binary);
+  ASSERT_TRUE(outmiddlefile.is_open());
+
+  // Small shards, so that the file is split into several batches.
+  status = CompressSharded(pool, infile, outmiddlefile, 5, compressor,
+                           /*nshards=*/3, /*shard_size=*/4096);
+  ASSERT_THAT(status, IsOk()) << "Unable to compress file";
+  outmiddlefile.close();
+
+  std::string outfile_s = GetTemporaryFile(absl::StrCat("out", compressor));
+  ASSERT_FALSE(outfile_s.empty());
+
+  std::ifstream inmiddlefile(middlefile_s, std::ios::binary);
+  ASSERT_TRUE(inmiddlefile.is_open());
+
+  std::ofstream outfile(outfile_s, std::ios::binary);
+  ASSERT_TRUE(outfile.is_open());
+
+  status = DecompressSharded(pool, inmiddlefile, outfile, /*nshards=*/3);
+  ASSERT_THAT(status, IsOk()) << "Unable to decompress file";
+  outfile.close();
+
+  ASSERT_TRUE(CompareFiles(infile_s, outfile_s));
+}
+
 INSTANTIATE_TEST_SUITE_P(SandboxTest, TestText,
                          testing::Values("blosclz", "lz4", "lz4hc", "zlib",
                                          "zstd"));
@@ -14,9 +14,13 @@
 
 #include "contrib/c-blosc/utils/utils_blosc.h"
 
+#include <cstdint>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "contrib/c-blosc/sandboxed.h"
 
@@ -120,3 +124,197 @@ absl::Status Decompress(CbloscApi& api, std::ifstream& in_stream,
 
   return absl::OkStatus();
 }
+
+namespace {
+
+// See BLOSC_MIN_HEADER_LENGTH and BLOSC_MAX_OVERHEAD in blosc.h.
+constexpr size_t kBloscHeaderSize = 16;
+constexpr size_t kBloscMaxOverhead = 16;
+
+uint32_t ReadLE32(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) |
+         (static_cast<uint32_t>(data[3]) << 24);
+}
+
+// Runs fn(0), ..., fn(n - 1) concurrently and returns the first error.
+absl::Status RunParallel(size_t n,
+                         const std::function<absl::Status(size_t)>& fn) {
+  std::vector<absl::Status> statuses(n);
+  std::vector<std::thread> workers;
+  workers.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    workers.emplace_back([&fn, &statuses, i] { statuses[i] = fn(i); });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (absl::Status& status : statuses) {
+    SAPI_RETURN_IF_ERROR(status);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<uint8_t>> CompressShard(
+    CbloscSandboxPool& pool, std::vector<uint8_t>& input, int clevel,
+    const std::string& compressor) {
+  SAPI_ASSIGN_OR_RETURN(CbloscSandboxPool::Lease lease, pool.Acquire());
+  CbloscApi api(lease.get());
+
+  // Pooled sandboxes may have been used with other settings.
+  int ret;
+  SAPI_ASSIGN_OR_RETURN(
+      ret, api.blosc_set_compressor(
+               sapi::v::ConstCStr(compressor.c_str()).PtrBefore()));
+  if (ret < 0) {
+    return absl::UnavailableError("Unable to set compressor");
+  }
+  SAPI_ASSIGN_OR_RETURN(ret, api.blosc_set_nthreads(1));
+  if (ret < 0) {
+    return absl::UnavailableError("Unable to set nthreads");
+  }
+
+  std::vector<uint8_t> output(input.size() + kBloscMaxOverhead);
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  sapi::v::Array<uint8_t> outbuf(output.data(), output.size());
+  SAPI_ASSIGN_OR_RETURN(
+      ssize_t outsize, api.blosc_compress(clevel, 1, sizeof(uint8_t),
+                                          inbuf.GetSize(), inbuf.PtrBefore(),
+                                          outbuf.PtrAfter(), outbuf.GetSize()));
+  if (outsize <= 0 || outsize > output.size()) {
+    return absl::UnavailableError("Unable to compress shard");
+  }
+  output.resize(outsize);
+  return output;
+}
+
+absl::StatusOr<std::vector<uint8_t>> DecompressShard(
+    CbloscSandboxPool& pool, std::vector<uint8_t>& input) {
+  const size_t nbytes = ReadLE32(&input[4]);
+  if (nbytes > kFileMaxSize) {
+    return absl::UnavailableError("The shard is to large");
+  }
+  std::vector<uint8_t> output(nbytes);
+  if (nbytes == 0) {
+    return output;
+  }
+
+  SAPI_ASSIGN_OR_RETURN(CbloscSandboxPool::Lease lease, pool.Acquire());
+  CbloscApi api(lease.get());
+  int ret;
+  SAPI_ASSIGN_OR_RETURN(ret, api.blosc_set_nthreads(1));
+  if (ret < 0) {
+    return absl::UnavailableError("Unable to set nthreads");
+  }
+
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  sapi::v::Array<uint8_t> outbuf(output.data(), output.size());
+  SAPI_ASSIGN_OR_RETURN(ssize_t outsize,
+                        api.blosc_decompress(inbuf.PtrBefore(),
+                                             outbuf.PtrAfter(),
+                                             outbuf.GetSize()));
+  if (outsize != nbytes) {
+    return absl::UnavailableError("Unable to decompress shard");
+  }
+  return output;
+}
+
+}  // namespace
+
+absl::Status CompressSharded(CbloscSandboxPool& pool, std::ifstream& in_stream,
+                             std::ofstream& out_stream, int clevel,
+                             const std::string& compressor, int nshards,
+                             size_t shard_size) {
+  if (nshards < 1) {
+    return absl::InvalidArgumentError("nshards must be positive");
+  }
+  if (shard_size == 0 || shard_size > kFileMaxSize) {
+    return absl::InvalidArgumentError("Invalid shard size");
+  }
+
+  std::vector<std::vector<uint8_t>> inputs(nshards);
+  std::vector<std::vector<uint8_t>> outputs(nshards);
+  while (in_stream) {
+    size_t n = 0;
+    while (n < inputs.size() && in_stream) {
+      inputs[n].resize(shard_size);
+      in_stream.read(reinterpret_cast<char*>(inputs[n].data()), shard_size);
+      if (in_stream.bad()) {
+        return absl::UnavailableError("Unable to read file");
+      }
+      inputs[n].resize(in_stream.gcount());
+      if (!inputs[n].empty()) {
+        ++n;
+      }
+    }
+
+    SAPI_RETURN_IF_ERROR(RunParallel(n, [&](size_t i) -> absl::Status {
+      SAPI_ASSIGN_OR_RETURN(outputs[i],
+                            CompressShard(pool, inputs[i], clevel, compressor));
+      return absl::OkStatus();
+    }));
+
+    for (size_t i = 0; i < n; ++i) {
+      out_stream.write(reinterpret_cast<char*>(outputs[i].data()),
+                       outputs[i].size());
+      if (!out_stream.good()) {
+        return absl::UnavailableError("Unable to write file");
+      }
+    }
+  }
+
+  return absl::OkStatus();
+}
+
+absl::Status DecompressSharded(CbloscSandboxPool& pool,
+                               std::ifstream& in_stream,
+                               std::ofstream& out_stream, int nshards) {
+  if (nshards < 1) {
+    return absl::InvalidArgumentError("nshards must be positive");
+  }
+
+  std::vector<std::vector<uint8_t>> inputs(nshards);
+  std::vector<std::vector<uint8_t>> outputs(nshards);
+  bool done = false;
+  while (!done) {
+    // Each buffer's header says how long it is.
+    size_t n = 0;
+    for (; n < inputs.size(); ++n) {
+      uint8_t header[kBloscHeaderSize];
+      in_stream.read(reinterpret_cast<char*>(header), sizeof(header));
+      if (in_stream.gcount() == 0 && in_stream.eof()) {
+        done = true;
+        break;
+      }
+      if (in_stream.gcount() != sizeof(header)) {
+        return absl::UnavailableError("Truncated blosc header");
+      }
+      const size_t cbytes = ReadLE32(&header[12]);
+      if (cbytes < kBloscHeaderSize || cbytes > kFileMaxSize) {
+        return absl::UnavailableError("Invalid blosc header");
+      }
+      inputs[n].assign(header, header + sizeof(header));
+      inputs[n].resize(cbytes);
+      const size_t rest = cbytes - kBloscHeaderSize;
+      in_stream.read(reinterpret_cast<char*>(&inputs[n][kBloscHeaderSize]),
+                     rest);
+      if (in_stream.gcount() != rest) {
+        return absl::UnavailableError("Truncated blosc buffer");
+      }
+    }
+
+    SAPI_RETURN_IF_ERROR(RunParallel(n, [&](size_t i) -> absl::Status {
+      SAPI_ASSIGN_OR_RETURN(outputs[i], DecompressShard(pool, inputs[i]));
+      return absl::OkStatus();
+    }));
+
+    for (size_t i = 0; i < n; ++i) {
+      out_stream.write(reinterpret_cast<char*>(outputs[i].data()),
+                       outputs[i].size());
+      if (!out_stream.good()) {
+        return absl::UnavailableError("Unable to write file");
+      }
+    }
+  }
+
+  return absl::OkStatus();
+}
@@ -15,11 +15,17 @@
 #ifndef CONTRIB_CBLOSC_UTILS_UTILS_BLOSC_H_
 #define CONTRIB_CBLOSC_UTILS_UTILS_BLOSC_H_
 
+#include <cstddef>
 #include <fstream>
 #include <string>
 
 #include "absl/status/status.h"
 #include "contrib/c-blosc/sandboxed.h"
+#include "sandboxed_api/sandbox_pool.h"
+
+using CbloscSandboxPool = sapi::SandboxPool<CbloscSapiSandbox>;
+
+inline constexpr size_t kDefaultShardSize = 4 << 20;  // 4 MiB
 
 absl::Status Compress(CbloscApi& api, std::ifstream& in_stream,
                       std::ofstream& out_stream, int clevel,
@@ -27,4 +33,19 @@ absl::Status Compress(CbloscApi& api, std::ifstream& in_stream,
 absl::Status Decompress(CbloscApi& api, std::ifstream& in_stream,
                         std::ofstream& out_stream, int nthreads);
 
+// Alternative to blosc's own threads, which doesn't need them in the policy:
+// splits the input into shards of `shard_size` bytes and compresses up to
+// `nshards` of them at a time, each into its own blosc buffer in a
+// single-threaded sandbox from `pool`. The buffers are written one after
+// another.
+absl::Status CompressSharded(CbloscSandboxPool& pool, std::ifstream& in_stream,
+                             std::ofstream& out_stream, int clevel,
+                             const std::string& compressor, int nshards,
+                             size_t shard_size = kDefaultShardSize);
+// Decompresses a sequence of blosc buffers, e.g. as written by
+// CompressSharded() or Compress(), up to `nshards` of them at a time.
+absl::Status DecompressSharded(CbloscSandboxPool& pool,
+                               std::ifstream& in_stream,
+                               std::ofstream& out_stream, int nshards);
+
 #endif  // CONTRIB_CBLOSC_UTILS_UTILS_BLOSC_H_
@@ -18,16 +18,38 @@
 #include <libgen.h>
 #include <syscall.h>
 
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "contrib/hunspell/wrapper/preload.h"
 #include "sapi_hunspell.sapi.h"  // NOLINT(build/include)
 
 class HunspellSapiSandbox : public HunspellSandbox {
  public:
+  // With `preload_dictionary`, the dictionary is loaded once in a forkserver
+  // shared by all sandboxes for the same files, and sandboxees get it from
+  // Hunspell_get_preloaded() instead of calling Hunspell_create().
   explicit HunspellSapiSandbox(std::string affix_file_name,
-                               std::string dictionary_file_name)
+                               std::string dictionary_file_name,
+                               bool preload_dictionary = false)
       : affix_file_name_(std::move(affix_file_name)),
-        dictionary_file_name_(std::move(dictionary_file_name)) {}
+        dictionary_file_name_(std::move(dictionary_file_name)),
+        preload_dictionary_(preload_dictionary) {}
 
  private:
+  bool ShareForkServer() const override { return preload_dictionary_; }
+  bool RunZygoteInit() const override { return preload_dictionary_; }
+
+  void GetEnvs(std::vector<std::string>* envs) const override {
+    HunspellSandbox::GetEnvs(envs);
+    if (preload_dictionary_) {
+      envs->push_back(absl::StrCat(kHunspellAffixEnv, "=", affix_file_name_));
+      envs->push_back(
+          absl::StrCat(kHunspellDictionaryEnv, "=", dictionary_file_name_));
+    }
+  }
+
   std::unique_ptr<sandbox2::Policy> ModifyPolicy(
       sandbox2::PolicyBuilder*) override {
     return sandbox2::PolicyBuilder()
@@ -51,6 +73,7 @@ class HunspellSapiSandbox : public HunspellSandbox {
 
   std::string affix_file_name_;
   std::string dictionary_file_name_;
+  bool preload_dictionary_;
 };
 
 #endif  // CONTRIB_HUNSPELL_SANDBOXED_H_
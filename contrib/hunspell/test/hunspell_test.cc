@@ -13,8 +13,11 @@
 // limitations under the License.
 
 #include <fstream>
+#include <string>
+#include <vector>
 
 #include "../sandboxed.h"
+#include "../utils/utils_hunspell.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_matchers.h"
 #include "sandboxed_api/util/temp_file.h"
@@ -22,6 +25,9 @@
 namespace {
 
 using ::sapi::IsOk;
+using ::testing::IsEmpty;
+using ::testing::Not;
+using ::testing::NotNull;
 
 class HunspellTest : public ::testing::Test {
  protected:
@@ -64,6 +70,17 @@ class HunspellTest : public ::testing::Test {
     return sapi::file::JoinPath(test_files_dir_, filename);
   }
 
+  std::vector<std::string> ReadWords(const absl::string_view& filename) {
+    std::ifstream wtclst(GetTestFilePath(filename), std::ios_base::in);
+    EXPECT_TRUE(wtclst.is_open());
+    std::vector<std::string> words;
+    std::string buf;
+    while (std::getline(wtclst, buf)) {
+      words.push_back(buf);
+    }
+    return words;
+  }
+
   std::unique_ptr<HunspellSapiSandbox> sandbox_;
   std::unique_ptr<HunspellApi> api_;
   std::unique_ptr<sapi::v::RemotePtr> hunspellrp_;
@@ -150,4 +167,73 @@ TEST_F(HunspellTest, CheckSuggestion) {
   ASSERT_GT(nlist, 0);
 }
 
+TEST_F(HunspellTest, CheckBatch) {
+  std::vector<std::string> good = ReadWords(kGoodFileName);
+  std::vector<std::string> wrong = ReadWords(kWrongFileName);
+  ASSERT_THAT(good, Not(IsEmpty()));
+  ASSERT_THAT(wrong, Not(IsEmpty()));
+
+  std::vector<absl::string_view> words(good.begin(), good.end());
+  words.insert(words.end(), wrong.begin(), wrong.end());
+  words.push_back(kSuggestion);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<SpellResult> results,
+                            SpellCheckBatch(*api_, hunspellrp_.get(), words));
+  ASSERT_EQ(results.size(), words.size());
+  for (size_t i = 0; i < good.size(); ++i) {
+    EXPECT_TRUE(results[i].correct) << words[i];
+    EXPECT_THAT(results[i].suggestions, IsEmpty());
+  }
+  for (size_t i = good.size(); i < words.size(); ++i) {
+    EXPECT_FALSE(results[i].correct) << words[i];
+  }
+  EXPECT_THAT(results.back().suggestions, Not(IsEmpty()));
+
+  // The suggestions match those of Hunspell_suggest().
+  sapi::v::ConstCStr cbuf(kSuggestion.data());
+  sapi::v::GenericPtr outptr;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      int nlist, api_->Hunspell_suggest(&(*hunspellrp_), outptr.PtrAfter(),
+                                        cbuf.PtrBefore()));
+  EXPECT_EQ(results.back().suggestions.size(), nlist);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      results, SpellCheckBatch(*api_, hunspellrp_.get(), words,
+                               /*suggest=*/false));
+  ASSERT_EQ(results.size(), words.size());
+  EXPECT_TRUE(results.front().correct);
+  EXPECT_FALSE(results.back().correct);
+  EXPECT_THAT(results.back().suggestions, IsEmpty());
+}
+
+TEST_F(HunspellTest, CheckPreloadedDictionary) {
+  const std::string s_afn = GetTestFilePath(kAffixFileName);
+  const std::string s_dfn = GetTestFilePath(kDictionaryFileName);
+  std::vector<absl::string_view> words = {"foo", kSuggestion};
+
+  // Both sandboxes are forked from the forkserver that loaded the dictionary.
+  for (int i = 0; i < 2; ++i) {
+    HunspellSapiSandbox sandbox(s_afn, s_dfn, /*preload_dictionary=*/true);
+    ASSERT_THAT(sandbox.Init(), IsOk());
+    HunspellApi api(&sandbox);
+
+    SAPI_ASSERT_OK_AND_ASSIGN(Hunhandle * hunspell,
+                              api.Hunspell_get_preloaded());
+    ASSERT_THAT(hunspell, NotNull());
+    sapi::v::RemotePtr hunspellrp(hunspell);
+
+    SAPI_ASSERT_OK_AND_ASSIGN(std::vector<SpellResult> results,
+                              SpellCheckBatch(api, &hunspellrp, words));
+    ASSERT_EQ(results.size(), words.size());
+    EXPECT_TRUE(results[0].correct);
+    EXPECT_FALSE(results[1].correct);
+    EXPECT_THAT(results[1].suggestions, Not(IsEmpty()));
+  }
+
+  // Sandboxes without preloading don't get a handle.
+  SAPI_ASSERT_OK_AND_ASSIGN(Hunhandle * hunspell,
+                            api_->Hunspell_get_preloaded());
+  EXPECT_EQ(hunspell, nullptr);
+}
+
 }  // namespace
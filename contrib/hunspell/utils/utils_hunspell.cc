@@ -0,0 +1,130 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/hunspell/utils/utils_hunspell.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_array.h"
+#include "sandboxed_api/var_ptr.h"
+
+namespace {
+
+// Initial size of the suggestion buffer per word. If the suggestions do not
+// fit, the batch is checked once more with a buffer of the reported size.
+constexpr uint64_t kSuggestionBytesPerWord = 64;
+
+// Reads the suggestions stored by Hunspell_spell_batch(). They are checked to
+// stay inside of the buffer, as the sandboxee is not trusted.
+absl::Status ReadSuggestions(const char* data, uint64_t size,
+                             absl::Span<const uint32_t> counts,
+                             std::vector<SpellResult>& results) {
+  uint64_t pos = 0;
+  for (size_t i = 0; i < counts.size(); ++i) {
+    for (uint32_t j = 0; j < counts[i]; ++j) {
+      if (pos >= size) {
+        return absl::InternalError("Suggestions out of bounds");
+      }
+      const void* end = memchr(data + pos, '\0', size - pos);
+      if (end == nullptr) {
+        return absl::InternalError("Unterminated suggestion");
+      }
+      size_t length = static_cast<const char*>(end) - (data + pos);
+      results[i].suggestions.emplace_back(data + pos, length);
+      pos += length + 1;
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<SpellResult>> SpellCheckBatch(
+    HunspellApi& api, sapi::v::RemotePtr* handle,
+    absl::Span<const absl::string_view> words, bool suggest) {
+  std::vector<SpellResult> results(words.size());
+  if (words.empty()) {
+    return results;
+  }
+
+  std::string text;
+  std::vector<uint32_t> offsets;
+  offsets.reserve(words.size() + 1);
+  for (absl::string_view word : words) {
+    offsets.push_back(text.size());
+    text.append(word.data(), word.size());
+  }
+  if (text.size() > std::numeric_limits<uint32_t>::max()) {
+    return absl::InvalidArgumentError("Word batch too large");
+  }
+  offsets.push_back(text.size());
+
+  sapi::v::Array<char> text_array(text.data(), text.size());
+  sapi::v::Array<uint32_t> offsets_array(offsets.data(), offsets.size());
+  std::vector<int> correct(words.size());
+  sapi::v::Array<int> correct_array(correct.data(), correct.size());
+  std::vector<uint32_t> counts(words.size());
+  sapi::v::Array<uint32_t> counts_array(counts.data(), counts.size());
+
+  // Keep the words in the sandboxee in case the call needs to be repeated.
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->Allocate(&text_array, true));
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->TransferToSandboxee(&text_array));
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->Allocate(&offsets_array, true));
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->TransferToSandboxee(&offsets_array));
+
+  if (!suggest) {
+    sapi::v::NullPtr null_ptr;
+    SAPI_RETURN_IF_ERROR(
+        api.Hunspell_spell_batch(handle, text_array.PtrNone(),
+                                 offsets_array.PtrNone(), words.size(),
+                                 correct_array.PtrAfter(), &null_ptr, 0,
+                                 &null_ptr)
+            .status());
+  } else {
+    uint64_t size = std::max<uint64_t>(words.size() * kSuggestionBytesPerWord,
+                                       kSuggestionBytesPerWord);
+    for (int attempt = 0;; ++attempt) {
+      sapi::v::Array<char> suggestions(size);
+      SAPI_ASSIGN_OR_RETURN(
+          uint64_t needed,
+          api.Hunspell_spell_batch(
+              handle, text_array.PtrNone(), offsets_array.PtrNone(),
+              words.size(), correct_array.PtrAfter(), suggestions.PtrAfter(),
+              size, counts_array.PtrAfter()));
+      // Suggestions are not guaranteed to be the same on the second attempt,
+      // keep what was stored then.
+      if (needed <= size || attempt > 0) {
+        SAPI_RETURN_IF_ERROR(ReadSuggestions(suggestions.GetData(), size,
+                                             counts, results));
+        break;
+      }
+      size = needed;
+    }
+  }
+
+  for (size_t i = 0; i < words.size(); ++i) {
+    results[i].correct = correct[i] != 0;
+  }
+  return results;
+}
@@ -0,0 +1,42 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_HUNSPELL_UTILS_UTILS_HUNSPELL_H_
+#define CONTRIB_HUNSPELL_UTILS_UTILS_HUNSPELL_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "contrib/hunspell/sandboxed.h"
+#include "sandboxed_api/var_ptr.h"
+
+struct SpellResult {
+  bool correct = false;
+  // Empty for correct words, and if no suggestions were requested.
+  std::vector<std::string> suggestions;
+};
+
+// Spell-checks all of `words` with the Hunspell handle `handle` in a single
+// call, instead of one Hunspell_spell() and Hunspell_suggest() round trip, plus
+// the transfer of the list, per word. `handle` is either the result of
+// Hunspell_create() or, for sandboxes that preload the dictionary, of
+// Hunspell_get_preloaded().
+absl::StatusOr<std::vector<SpellResult>> SpellCheckBatch(
+    HunspellApi& api, sapi::v::RemotePtr* handle,
+    absl::Span<const absl::string_view> words, bool suggest = true);
+
+#endif  // CONTRIB_HUNSPELL_UTILS_UTILS_HUNSPELL_H_
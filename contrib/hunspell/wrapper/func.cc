@@ -0,0 +1,77 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/hunspell/wrapper/func.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "contrib/hunspell/wrapper/preload.h"
+#include "hunspell.h"  // NOLINT(build/include)
+
+namespace {
+
+Hunhandle* preloaded = nullptr;
+
+}  // namespace
+
+// Loads the dictionary once in the forkserver, so that sandboxees forked from
+// it start with it instead of parsing the files in Hunspell_create() again.
+extern "C" void sapi_zygote_init() {
+  const char* affix = getenv(kHunspellAffixEnv);
+  const char* dictionary = getenv(kHunspellDictionaryEnv);
+  if (affix != nullptr && dictionary != nullptr) {
+    preloaded = Hunspell_create(affix, dictionary);
+  }
+}
+
+Hunhandle* Hunspell_get_preloaded() { return preloaded; }
+
+uint64_t Hunspell_spell_batch(Hunhandle* handle, const char* words,
+                              const uint32_t* offsets, uint32_t count,
+                              int* results, char* suggestions,
+                              uint64_t suggestions_size,
+                              uint32_t* suggestion_counts) {
+  uint64_t needed = 0;
+  bool full = false;
+  std::string word;
+  for (uint32_t i = 0; i < count; ++i) {
+    // Hunspell expects NUL-terminated words.
+    word.assign(words + offsets[i], offsets[i + 1] - offsets[i]);
+    results[i] = Hunspell_spell(handle, word.c_str());
+    if (suggestions == nullptr) {
+      continue;
+    }
+    suggestion_counts[i] = 0;
+    if (results[i] != 0) {
+      continue;
+    }
+
+    char** list = nullptr;
+    int n = Hunspell_suggest(handle, &list, word.c_str());
+    for (int j = 0; j < n; ++j) {
+      size_t size = strlen(list[j]) + 1;
+      full = full || needed + size > suggestions_size;
+      if (!full) {
+        memcpy(suggestions + needed, list[j], size);
+        ++suggestion_counts[i];
+      }
+      needed += size;
+    }
+    Hunspell_free_list(handle, &list, n);
+  }
+  return needed;
+}
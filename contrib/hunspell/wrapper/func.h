@@ -0,0 +1,47 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_HUNSPELL_WRAPPER_FUNC_H_
+#define CONTRIB_HUNSPELL_WRAPPER_FUNC_H_
+
+#include <cstdint>
+
+#include "hunspell.h"  // NOLINT(build/include)
+
+extern "C" {
+
+// Spell-checks the `count` words packed into `words`, the i-th being the bytes
+// from offsets[i] to offsets[i + 1], and stores the Hunspell_spell() result in
+// results[i].
+//
+// Unless `suggestions` is NULL, the suggestions for each misspelled word are
+// stored as consecutive NUL-terminated strings into `suggestions`, word after
+// word, and their number into suggestion_counts[i]. Once a suggestion does not
+// fit into `suggestions_size` bytes, no further ones are stored.
+//
+// Returns the number of bytes needed to store all suggestions.
+uint64_t Hunspell_spell_batch(Hunhandle* handle, const char* words,
+                              const uint32_t* offsets, uint32_t count,
+                              int* results, char* suggestions,
+                              uint64_t suggestions_size,
+                              uint32_t* suggestion_counts);
+
+// Returns the handle that sapi_zygote_init() created in the forkserver from
+// the files named by kHunspellAffixEnv and kHunspellDictionaryEnv, or NULL if
+// they were not set. The handle must not be destroyed.
+Hunhandle* Hunspell_get_preloaded();
+
+}  // extern "C"
+
+#endif  // CONTRIB_HUNSPELL_WRAPPER_FUNC_H_
@@ -0,0 +1,25 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_HUNSPELL_WRAPPER_PRELOAD_H_
+#define CONTRIB_HUNSPELL_WRAPPER_PRELOAD_H_
+
+// Environment variables naming the affix and dictionary files that the
+// sandboxee loads in sapi_zygote_init(), see
+// HunspellSapiSandbox(..., preload_dictionary).
+inline constexpr char kHunspellAffixEnv[] = "SAPI_HUNSPELL_AFFIX_FILE";
+inline constexpr char kHunspellDictionaryEnv[] =
+    "SAPI_HUNSPELL_DICTIONARY_FILE";
+
+#endif  // CONTRIB_HUNSPELL_WRAPPER_PRELOAD_H_
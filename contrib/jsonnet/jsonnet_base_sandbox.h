@@ -44,6 +44,7 @@ class JsonnetBaseSandbox : public JsonnetSandbox {
         .AllowSyscalls({
             __NR_futex,
             __NR_close,
+            __NR_recvmsg,  // For EvaluateSnippetStreaming().
         })
         .AddDirectoryAt(dirname(&out_file_[0]), "/output", /*is_ro=*/false)
         .AddDirectoryAt(dirname(&in_file_[0]), "/input", true)
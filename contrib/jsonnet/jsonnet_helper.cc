@@ -14,7 +14,99 @@
 
 #include "contrib/jsonnet/jsonnet_helper.h"
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
 #include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// Import file contents by absolute path.
+std::unordered_map<std::string, std::string>& ImportCache() {
+  static auto* cache = new std::unordered_map<std::string, std::string>();
+  return *cache;
+}
+
+// Returns a NUL-terminated copy of `str` allocated by `vm`, which takes
+// ownership of the buffers an import callback returns.
+char* CopyToVm(struct JsonnetVm* vm, const std::string& str) {
+  char* copy = jsonnet_realloc(vm, nullptr, str.size() + 1);
+  memcpy(copy, str.c_str(), str.size() + 1);
+  return copy;
+}
+
+// Resolves `rel` against `base` like the default import callback, minus the
+// library search path, which the sandboxed VMs do not use.
+int CachedImport(void* ctx, const char* base, const char* rel,
+                 char** found_here, char** buf, size_t* buflen) {
+  auto* vm = static_cast<struct JsonnetVm*>(ctx);
+  std::string path = rel[0] == '/' ? rel : std::string(base) + rel;
+
+  auto& cache = ImportCache();
+  auto it = cache.find(path);
+  if (it == cache.end()) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      std::string error = "couldn't open import \"" + std::string(rel) + "\"";
+      *buf = CopyToVm(vm, error);
+      *buflen = error.size();
+      return 1;
+    }
+    it = cache
+             .emplace(path, std::string(std::istreambuf_iterator<char>(file),
+                                        std::istreambuf_iterator<char>()))
+             .first;
+  }
+  *found_here = CopyToVm(vm, path);
+  *buf = CopyToVm(vm, it->second);
+  *buflen = it->second.size();
+  return 0;
+}
+
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool WriteFrame(int fd, const char* name, const char* document) {
+  const uint64_t sizes[] = {strlen(name), strlen(document)};
+  return WriteAll(fd, reinterpret_cast<const char*>(sizes), sizeof(sizes)) &&
+         WriteAll(fd, name, sizes[0]) && WriteAll(fd, document, sizes[1]);
+}
+
+// Writes the NUL-separated, empty string terminated list of documents
+// `output`, preceded by their file names if `named`.
+bool WriteFrames(int fd, const char* output, bool named) {
+  while (*output != '\0') {
+    const char* name = "";
+    if (named) {
+      name = output;
+      output += strlen(output) + 1;
+    }
+    if (!WriteFrame(fd, name, output)) {
+      return false;
+    }
+    output += strlen(output) + 1;
+  }
+  return true;
+}
+
+}  // namespace
 
 struct JsonnetVm* c_jsonnet_make(void) {
   return jsonnet_make();
@@ -74,3 +166,40 @@ char* c_jsonnet_fmt_snippet(struct JsonnetVm* vm, const char* filename,
                             const char* snippet, int* error) {
   return jsonnet_fmt_snippet(vm, filename, snippet, error);
 }
+
+struct JsonnetVm* c_jsonnet_make_cached(void) {
+  struct JsonnetVm* vm = jsonnet_make();
+  jsonnet_import_callback(vm, CachedImport, vm);
+  return vm;
+}
+
+void c_jsonnet_cache_import(const char* path, const char* content,
+                            size_t size) {
+  ImportCache()[path].assign(content, size);
+}
+
+void c_jsonnet_clear_import_cache(void) { ImportCache().clear(); }
+
+char* c_jsonnet_evaluate_snippet_to_fd(struct JsonnetVm* vm,
+                                       const char* filename,
+                                       const char* snippet, int kind, int fd) {
+  int error = 0;
+  char* output =
+      kind == JSONNET_OUTPUT_MULTI
+          ? jsonnet_evaluate_snippet_multi(vm, filename, snippet, &error)
+          : jsonnet_evaluate_snippet_stream(vm, filename, snippet, &error);
+  if (error == 0 &&
+      !WriteFrames(fd, output, /*named=*/kind == JSONNET_OUTPUT_MULTI)) {
+    std::string message =
+        std::string("writing the output failed: ") + strerror(errno);
+    jsonnet_realloc(vm, output, 0);
+    output = CopyToVm(vm, message);
+    error = 1;
+  }
+  close(fd);
+  if (error == 0) {
+    jsonnet_realloc(vm, output, 0);
+    return nullptr;
+  }
+  return output;
+}
@@ -59,6 +59,33 @@ bool write_output_stream(char* output, const std::string& output_file);
 
 char* c_jsonnet_fmt_snippet(struct JsonnetVm* vm, const char* filename,
                             const char* snippet, int* error);
+
+// Like c_jsonnet_make(), but the VM resolves imports from an import cache that
+// is shared by all such VMs of the sandboxee and outlives evaluations. Files
+// read from disk are cached by path on first import.
+struct JsonnetVm* c_jsonnet_make_cached(void);
+
+// Stores `content` of `size` bytes in the import cache under the absolute
+// `path`, replacing what was cached before.
+void c_jsonnet_cache_import(const char* path, const char* content,
+                            size_t size);
+
+// Empties the import cache, so that files are read from disk again.
+void c_jsonnet_clear_import_cache(void);
+
+// Output kinds of c_jsonnet_evaluate_snippet_to_fd().
+#define JSONNET_OUTPUT_STREAM 0
+#define JSONNET_OUTPUT_MULTI 1
+
+// Evaluates `snippet` like c_jsonnet_evaluate_snippet_stream(), or like
+// c_jsonnet_evaluate_snippet_multi() for JSONNET_OUTPUT_MULTI, and writes the
+// resulting documents to `fd` one by one, each as a frame of two native 64 bit
+// sizes followed by the file name (empty for streams) and the document. Closes
+// `fd` in any case. Returns NULL on success and the error message, to be freed
+// with c_jsonnet_realloc(), if the evaluation or a write failed.
+char* c_jsonnet_evaluate_snippet_to_fd(struct JsonnetVm* vm,
+                                       const char* filename,
+                                       const char* snippet, int kind, int fd);
 }
 
 #endif  // CONTRIB_JSONNET_JSONNET_HELPER_H_
@@ -0,0 +1,131 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/jsonnet/jsonnet_service.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/hash/hash.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace {
+
+constexpr absl::string_view kInputDir = "/input";
+
+}  // namespace
+
+JsonnetService::JsonnetService(JsonnetServiceOptions options)
+    : pool_({.size = options.pool_size},
+            [input_dir = std::move(options.input_dir)] {
+              return std::make_unique<JsonnetServiceSandbox>(input_dir);
+            }) {}
+
+void JsonnetService::AddImport(absl::string_view path, std::string content) {
+  auto import = std::make_shared<Import>();
+  import->hash = absl::Hash<absl::string_view>()(content);
+  import->content = std::move(content);
+  absl::MutexLock lock(&mutex_);
+  imports_[sapi::file::JoinPath(kInputDir, path)] = std::move(import);
+}
+
+void JsonnetService::InvalidateFileCache() {
+  absl::MutexLock lock(&mutex_);
+  ++file_generation_;
+}
+
+absl::Status JsonnetService::Prepare(JsonnetServiceSandbox& sandbox,
+                                     JsonnetApi& api) {
+  if (sandbox.vm_ == nullptr) {
+    SAPI_ASSIGN_OR_RETURN(sandbox.vm_, api.c_jsonnet_make_cached());
+    if (sandbox.vm_ == nullptr) {
+      return absl::InternalError("c_jsonnet_make_cached() failed");
+    }
+  }
+
+  std::vector<std::pair<std::string, std::shared_ptr<const Import>>> imports;
+  uint64_t file_generation;
+  {
+    absl::MutexLock lock(&mutex_);
+    imports.assign(imports_.begin(), imports_.end());
+    file_generation = file_generation_;
+  }
+  if (sandbox.file_generation_ != file_generation) {
+    SAPI_RETURN_IF_ERROR(api.c_jsonnet_clear_import_cache());
+    sandbox.import_hashes_.clear();
+    sandbox.file_generation_ = file_generation;
+  }
+  for (const auto& [path, import] : imports) {
+    auto it = sandbox.import_hashes_.find(path);
+    if (it != sandbox.import_hashes_.end() && it->second == import->hash) {
+      continue;
+    }
+    sapi::v::ConstCStr path_var(path.c_str());
+    sapi::v::Array<const char> content_var(import->content.data(),
+                                           import->content.size());
+    SAPI_RETURN_IF_ERROR(api.c_jsonnet_cache_import(
+        path_var.PtrBefore(), content_var.PtrBefore(), import->content.size()));
+    sandbox.import_hashes_[path] = import->hash;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string> JsonnetService::Evaluate(
+    JsonnetServiceSandbox& sandbox, absl::string_view filename,
+    absl::string_view snippet) {
+  JsonnetApi api(&sandbox);
+  SAPI_RETURN_IF_ERROR(Prepare(sandbox, api));
+
+  std::string in_file = sapi::file::JoinPath(kInputDir, filename);
+  std::string code(snippet);
+  sapi::v::ConstCStr in_file_var(in_file.c_str());
+  sapi::v::ConstCStr code_var(code.c_str());
+  sapi::v::RemotePtr vm(sandbox.vm_);
+  sapi::v::Int error;
+  SAPI_ASSIGN_OR_RETURN(
+      char* output,
+      api.c_jsonnet_evaluate_snippet(&vm, in_file_var.PtrBefore(),
+                                     code_var.PtrBefore(), error.PtrAfter()));
+  if (output == nullptr) {
+    return absl::InternalError("c_jsonnet_evaluate_snippet() failed");
+  }
+  sapi::v::RemotePtr output_ptr(output);
+  absl::StatusOr<std::string> result = sandbox.GetCString(output_ptr);
+  SAPI_RETURN_IF_ERROR(api.c_jsonnet_realloc(&vm, &output_ptr, 0).status());
+  SAPI_RETURN_IF_ERROR(result.status());
+  if (error.GetValue() != 0) {
+    return absl::InvalidArgumentError(*result);
+  }
+  return result;
+}
+
+absl::StatusOr<std::string> JsonnetService::EvaluateSnippet(
+    absl::string_view filename, absl::string_view snippet) {
+  SAPI_ASSIGN_OR_RETURN(sapi::SandboxPool<JsonnetServiceSandbox>::Lease lease,
+                        pool_.Acquire());
+  absl::StatusOr<std::string> result = Evaluate(*lease, filename, snippet);
+  if (!result.ok() && !absl::IsInvalidArgument(result.status())) {
+    // The sandboxee state is unknown, start over with a fresh one.
+    lease.Discard();
+  }
+  return result;
+}
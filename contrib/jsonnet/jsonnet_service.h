@@ -0,0 +1,129 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_JSONNET_JSONNET_SERVICE_H_
+#define CONTRIB_JSONNET_JSONNET_SERVICE_H_
+
+#include <syscall.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "jsonnet_sapi.sapi.h"  // NOLINT(build/include)
+#include "sandboxed_api/sandbox_pool.h"
+
+// Evaluates snippets that may import files from `input_dir`, mapped read-only
+// to /input.
+class JsonnetServiceSandbox : public JsonnetSandbox {
+ public:
+  explicit JsonnetServiceSandbox(std::string input_dir)
+      : input_dir_(std::move(input_dir)) {}
+
+  std::unique_ptr<sandbox2::Policy> ModifyPolicy(
+      sandbox2::PolicyBuilder*) override {
+    return sandbox2::PolicyBuilder()
+        .AllowStaticStartup()
+        .AllowOpen()
+        .AllowRead()
+        .AllowWrite()
+        .AllowStat()
+        .AllowSystemMalloc()
+        .AllowExit()
+        .AllowSyscalls({
+            __NR_futex,
+            __NR_close,
+        })
+        .AddDirectoryAt(input_dir_, "/input", /*is_ro=*/true)
+        .BuildOrDie();
+  }
+
+ private:
+  friend class JsonnetService;
+
+  std::string input_dir_;
+
+  // State of the sandboxee, maintained by JsonnetService.
+  JsonnetVm* vm_ = nullptr;
+  // Hashes of the imports added to the sandboxee's import cache, by path.
+  absl::flat_hash_map<std::string, size_t> import_hashes_;
+  uint64_t file_generation_ = 0;
+};
+
+struct JsonnetServiceOptions {
+  // Directory the evaluated snippets import files from.
+  std::string input_dir;
+  // Number of sandboxes evaluating snippets concurrently.
+  size_t pool_size = 4;
+};
+
+// Evaluates jsonnet snippets concurrently in a pool of long-lived sandboxes.
+// Unlike a fresh sandbox per evaluation, every sandbox keeps its VM and an
+// import cache across evaluations, so that imported files are read, and
+// transferred, once per sandbox rather than once per evaluation. All methods
+// are thread-safe.
+//
+// Example:
+//   JsonnetService service({.input_dir = "/path/to/configs"});
+//   service.AddImport("lib/common.libsonnet", common);
+//   SAPI_ASSIGN_OR_RETURN(std::string json,
+//                         service.EvaluateSnippet("app.jsonnet", app));
+class JsonnetService {
+ public:
+  explicit JsonnetService(JsonnetServiceOptions options);
+
+  // Makes `content` importable as `path`, relative to the input directory,
+  // overriding a file there. Sandboxes receive it before their next evaluation,
+  // unless they already hold content with the same hash.
+  void AddImport(absl::string_view path, std::string content);
+
+  // Makes later evaluations see the current contents of the files in the input
+  // directory, instead of those cached from earlier evaluations.
+  void InvalidateFileCache();
+
+  // Evaluates `snippet` as if it was the file `filename` in the input
+  // directory and returns the resulting JSON. Jsonnet errors are returned as
+  // kInvalidArgument with the message of the VM.
+  absl::StatusOr<std::string> EvaluateSnippet(absl::string_view filename,
+                                              absl::string_view snippet);
+
+ private:
+  struct Import {
+    std::string content;
+    size_t hash;
+  };
+
+  // Brings the VM and the import cache of the leased `sandbox` up to date.
+  absl::Status Prepare(JsonnetServiceSandbox& sandbox, JsonnetApi& api);
+
+  absl::StatusOr<std::string> Evaluate(JsonnetServiceSandbox& sandbox,
+                                       absl::string_view filename,
+                                       absl::string_view snippet);
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, std::shared_ptr<const Import>> imports_
+      ABSL_GUARDED_BY(mutex_);
+  uint64_t file_generation_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  sapi::SandboxPool<JsonnetServiceSandbox> pool_;
+};
+
+#endif  // CONTRIB_JSONNET_JSONNET_SERVICE_H_
@@ -0,0 +1,160 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/jsonnet/jsonnet_stream.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace {
+
+// Mirrors c_jsonnet_evaluate_snippet_to_fd().
+constexpr int kOutputStream = 0;
+constexpr int kOutputMulti = 1;
+
+// Sanity limit for the sizes in the untrusted frame headers.
+constexpr uint64_t kMaxFrameSize = uint64_t{1} << 32;
+
+// Reads exactly `size` bytes. Returns false on EOF before the first byte.
+absl::StatusOr<bool> ReadFully(int fd, char* data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, data + done, size - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return absl::UnavailableError(
+          absl::StrCat("Reading the output failed: ", strerror(errno)));
+    }
+    if (n == 0) {
+      if (done == 0) {
+        return false;
+      }
+      return absl::DataLossError("Truncated output frame");
+    }
+    done += n;
+  }
+  return true;
+}
+
+absl::Status ReadFrames(int fd, const JsonnetDocumentCallback& callback) {
+  std::string name;
+  std::string document;
+  for (;;) {
+    uint64_t sizes[2];
+    SAPI_ASSIGN_OR_RETURN(
+        bool more, ReadFully(fd, reinterpret_cast<char*>(sizes), sizeof(sizes)));
+    if (!more) {
+      return absl::OkStatus();
+    }
+    if (sizes[0] > kMaxFrameSize || sizes[1] > kMaxFrameSize) {
+      return absl::DataLossError("Invalid output frame");
+    }
+    // Reusing the buffers keeps host memory at the largest document so far.
+    name.resize(sizes[0]);
+    document.resize(sizes[1]);
+    if (sizes[0] > 0) {
+      SAPI_ASSIGN_OR_RETURN(more, ReadFully(fd, name.data(), name.size()));
+    }
+    if (more && sizes[1] > 0) {
+      SAPI_ASSIGN_OR_RETURN(more,
+                            ReadFully(fd, document.data(), document.size()));
+    }
+    if (!more) {
+      return absl::DataLossError("Truncated output frame");
+    }
+    SAPI_RETURN_IF_ERROR(callback(name, document));
+  }
+}
+
+// Reads until EOF, so that the sandboxee does not block on a full socket.
+void Drain(int fd) {
+  char buffer[4096];
+  for (;;) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n == 0 || (n < 0 && errno != EINTR)) {
+      return;
+    }
+  }
+}
+
+}  // namespace
+
+absl::Status EvaluateSnippetStreaming(JsonnetApi& api, sapi::v::RemotePtr* vm,
+                                      absl::string_view filename,
+                                      absl::string_view snippet,
+                                      JsonnetOutputKind kind,
+                                      const JsonnetDocumentCallback& callback) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    return absl::InternalError(
+        absl::StrCat("socketpair() failed: ", strerror(errno)));
+  }
+  const int read_fd = fds[0];
+  absl::Cleanup close_read_fd = [read_fd] { close(read_fd); };
+
+  sapi::v::Fd write_fd(fds[1]);
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->TransferToSandboxee(&write_fd));
+  // Only the sandboxee may hold the write end, so that closing it ends the
+  // output. c_jsonnet_evaluate_snippet_to_fd() closes it.
+  write_fd.CloseLocalFd();
+  write_fd.OwnRemoteFd(false);
+
+  absl::Status read_status;
+  std::thread reader([&] {
+    read_status = ReadFrames(read_fd, callback);
+    if (!read_status.ok()) {
+      Drain(read_fd);
+    }
+  });
+
+  std::string filename_str(filename);
+  std::string snippet_str(snippet);
+  sapi::v::ConstCStr filename_var(filename_str.c_str());
+  sapi::v::ConstCStr snippet_var(snippet_str.c_str());
+  absl::StatusOr<char*> error = api.c_jsonnet_evaluate_snippet_to_fd(
+      vm, filename_var.PtrBefore(), snippet_var.PtrBefore(),
+      kind == JsonnetOutputKind::kMulti ? kOutputMulti : kOutputStream,
+      write_fd.GetRemoteFd());
+  if (!error.ok()) {
+    // The sandboxee may not have closed its end, unblock the reader.
+    shutdown(read_fd, SHUT_RDWR);
+  }
+  reader.join();
+  SAPI_RETURN_IF_ERROR(error.status());
+
+  if (*error != nullptr) {
+    sapi::v::RemotePtr message_ptr(*error);
+    absl::StatusOr<std::string> message =
+        api.GetSandbox()->GetCString(message_ptr);
+    SAPI_RETURN_IF_ERROR(api.c_jsonnet_realloc(vm, &message_ptr, 0).status());
+    SAPI_RETURN_IF_ERROR(message.status());
+    return absl::InvalidArgumentError(*message);
+  }
+  return read_status;
+}
@@ -0,0 +1,49 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_JSONNET_JSONNET_STREAM_H_
+#define CONTRIB_JSONNET_JSONNET_STREAM_H_
+
+#include <functional>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "jsonnet_sapi.sapi.h"  // NOLINT(build/include)
+#include "sandboxed_api/var_ptr.h"
+
+enum class JsonnetOutputKind {
+  // A YAML stream, as from c_jsonnet_evaluate_snippet_stream().
+  kStream,
+  // Named files, as from c_jsonnet_evaluate_snippet_multi().
+  kMulti,
+};
+
+// Receives one output document, with its file name for kMulti and an empty
+// one for kStream. `document` is only valid during the call.
+using JsonnetDocumentCallback = std::function<absl::Status(
+    absl::string_view name, absl::string_view document)>;
+
+// Evaluates `snippet` with `vm` and passes the output documents to
+// `callback` as they arrive over a socket from the sandboxee, instead of
+// reading back the whole output as one string. The host holds at most one
+// document at a time, and `callback` runs concurrently with the sandboxee
+// writing the next ones. The sandbox policy must allow recvmsg to receive the
+// socket. Jsonnet errors are returned as kInvalidArgument, otherwise the
+// first error of `callback` is returned.
+absl::Status EvaluateSnippetStreaming(JsonnetApi& api, sapi::v::RemotePtr* vm,
+                                      absl::string_view filename,
+                                      absl::string_view snippet,
+                                      JsonnetOutputKind kind,
+                                      const JsonnetDocumentCallback& callback);
+
+#endif  // CONTRIB_JSONNET_JSONNET_STREAM_H_
@@ -16,12 +16,21 @@
 
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <streambuf>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "contrib/jsonnet/jsonnet_base_sandbox.h"
+#include "contrib/jsonnet/jsonnet_service.h"
+#include "contrib/jsonnet/jsonnet_stream.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_matchers.h"
 
@@ -274,4 +283,160 @@ TEST_F(JsonnetTest, BadEvaluation) {
   EvaluateJsonnetCode(kBase, false);
 }
 
+std::string BinaryDir() {
+  char buffer[256];
+  ssize_t size = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+  EXPECT_GE(size, 0);
+  buffer[size < 0 ? 0 : size] = '\0';
+  return std::string(sapi::file::SplitPath(buffer).first);
+}
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream input_stream(path);
+  return std::string((std::istreambuf_iterator<char>(input_stream)),
+                     std::istreambuf_iterator<char>());
+}
+
+// The documents of a YAML stream arrive one by one.
+TEST_F(JsonnetTest, EvaluateSnippetStreaming) {
+  const std::string snippet = ReadFile(
+      sapi::file::JoinPath(BinaryDir(), "tests_input",
+                           "yaml_stream_example.jsonnet"));
+  std::string yaml;
+  int documents = 0;
+  ASSERT_THAT(EvaluateSnippetStreaming(
+                  *api_, vm_.get(), "/input/yaml_stream_example.jsonnet",
+                  snippet, JsonnetOutputKind::kStream,
+                  [&](absl::string_view name, absl::string_view document) {
+                    EXPECT_TRUE(name.empty());
+                    absl::StrAppend(&yaml, "---\n", document);
+                    ++documents;
+                    return absl::OkStatus();
+                  }),
+              sapi::IsOk());
+  absl::StrAppend(&yaml, "...\n");
+  EXPECT_EQ(documents, 2);
+  EXPECT_EQ(absl::StripTrailingAsciiWhitespace(yaml),
+            absl::StripTrailingAsciiWhitespace(
+                ReadOutput("tests_expected_output/yaml_stream_example.yaml")));
+}
+
+TEST_F(JsonnetTest, EvaluateSnippetStreamingMulti) {
+  const std::string snippet = ReadFile(
+      sapi::file::JoinPath(BinaryDir(), "tests_input",
+                           "multiple_files_example.jsonnet"));
+  std::map<std::string, std::string> files;
+  ASSERT_THAT(EvaluateSnippetStreaming(
+                  *api_, vm_.get(), "/input/multiple_files_example.jsonnet",
+                  snippet, JsonnetOutputKind::kMulti,
+                  [&](absl::string_view name, absl::string_view document) {
+                    files.emplace(name, document);
+                    return absl::OkStatus();
+                  }),
+              sapi::IsOk());
+  ASSERT_EQ(files.size(), 2);
+  for (const char* name : {"first_file.json", "second_file.json"}) {
+    EXPECT_EQ(absl::StripTrailingAsciiWhitespace(files[name]),
+              absl::StripTrailingAsciiWhitespace(ReadOutput(
+                  absl::StrCat("tests_expected_output/", name).c_str())))
+        << name;
+  }
+}
+
+TEST_F(JsonnetTest, EvaluateSnippetStreamingErrors) {
+  auto ignore = [](absl::string_view, absl::string_view) {
+    return absl::OkStatus();
+  };
+  EXPECT_THAT(EvaluateSnippetStreaming(*api_, vm_.get(), "/input/bad.jsonnet",
+                                       "[1, 2", JsonnetOutputKind::kStream,
+                                       ignore),
+              sapi::StatusIs(absl::StatusCode::kInvalidArgument));
+
+  // A failing callback stops the evaluation without blocking the sandboxee.
+  int calls = 0;
+  EXPECT_THAT(EvaluateSnippetStreaming(
+                  *api_, vm_.get(), "/input/stop.jsonnet", "[{}, {}, {}]",
+                  JsonnetOutputKind::kStream,
+                  [&](absl::string_view, absl::string_view) {
+                    ++calls;
+                    return absl::CancelledError("stop");
+                  }),
+              sapi::StatusIs(absl::StatusCode::kCancelled));
+  EXPECT_EQ(calls, 1);
+
+  // The VM stays usable.
+  EXPECT_THAT(EvaluateSnippetStreaming(*api_, vm_.get(), "/input/ok.jsonnet",
+                                       "[{}]", JsonnetOutputKind::kStream,
+                                       ignore),
+              sapi::IsOk());
+}
+
+class JsonnetServiceTest : public ::testing::Test {
+ protected:
+  std::string InputPath(const char* filename) {
+    return sapi::file::JoinPath(binary_dir_, "tests_input", filename);
+  }
+  std::string Expected(const char* filename) {
+    return std::string(absl::StripTrailingAsciiWhitespace(ReadFile(
+        sapi::file::JoinPath(binary_dir_, "tests_expected_output", filename))));
+  }
+
+  std::string binary_dir_ = BinaryDir();
+  JsonnetService service_{
+      {.input_dir = sapi::file::JoinPath(binary_dir_, "tests_input"),
+       .pool_size = 2}};
+};
+
+// Imports are resolved from the input directory and from the cache.
+TEST_F(JsonnetServiceTest, EvaluateSnippet) {
+  const std::string snippet = ReadFile(InputPath("negroni.jsonnet"));
+  for (int i = 0; i < 3; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(
+        std::string output,
+        service_.EvaluateSnippet("negroni.jsonnet", snippet));
+    EXPECT_EQ(absl::StripTrailingAsciiWhitespace(output),
+              Expected("negroni.golden"));
+  }
+}
+
+TEST_F(JsonnetServiceTest, AddImport) {
+  const std::string snippet = ReadFile(InputPath("imports.jsonnet"));
+  EXPECT_THAT(service_.EvaluateSnippet("imports.jsonnet", snippet),
+              sapi::StatusIs(absl::StatusCode::kInvalidArgument));
+
+  service_.AddImport("martinis.libsonnet",
+                     "{ 'Vodka Martini': { served: 'Straight Up' } }");
+  service_.AddImport("garnish.txt", "Olive");
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string output, service_.EvaluateSnippet("imports.jsonnet", snippet));
+  EXPECT_NE(output.find("\"garnish\": \"Olive\""), std::string::npos);
+
+  // Changed imports replace the cached ones.
+  service_.AddImport("garnish.txt", "Maraschino Cherry");
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      output, service_.EvaluateSnippet("imports.jsonnet", snippet));
+  EXPECT_NE(output.find("\"garnish\": \"Maraschino Cherry\""),
+            std::string::npos);
+}
+
+TEST_F(JsonnetServiceTest, ConcurrentEvaluations) {
+  const std::string snippet = ReadFile(InputPath("arith.jsonnet"));
+  const std::string expected = Expected("arith.golden");
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 4; ++j) {
+        absl::StatusOr<std::string> output =
+            service_.EvaluateSnippet("arith.jsonnet", snippet);
+        ASSERT_THAT(output, sapi::IsOk());
+        EXPECT_EQ(absl::StripTrailingAsciiWhitespace(*output), expected);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
 }  // namespace
@@ -14,28 +14,103 @@
 
 #include "libidn2_sapi.h"  // NOLINT(build/include)
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "contrib/libidn2/wrapper/func.h"
 #include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/var_array.h"
 
 static constexpr std::size_t kMaxDomainNameLength = 256;
 static constexpr int kMinPossibleKnownError = -10000;
+// Initial size of the output of a batch per input byte. If the converted
+// names do not fit, the batch is converted once more with the reported size.
+static constexpr uint64_t kOutputBytesPerInputByte = 2;
+
+static absl::Status ErrorFromResult(int res) {
+  if (res == IDN2_MALLOC) {
+    return absl::ResourceExhaustedError("malloc() failed in libidn2");
+  }
+  if (res > kMinPossibleKnownError) {
+    return absl::InvalidArgumentError(idn2_strerror(res));
+  }
+  return absl::InvalidArgumentError("Unexpected error");
+}
+
+// Returns the length of the UTF-8 sequence at the start of `s`, or 0 if it is
+// malformed, overlong, a surrogate or beyond U+10FFFF.
+static size_t Utf8SequenceLength(absl::string_view s) {
+  const auto byte = [&s](size_t i) { return static_cast<uint8_t>(s[i]); };
+  const auto is_continuation = [&](size_t i) {
+    return i < s.size() && (byte(i) & 0xC0) == 0x80;
+  };
+  uint8_t lead = byte(0);
+  if (lead < 0x80) {
+    return 1;
+  }
+  if (lead >= 0xC2 && lead <= 0xDF) {
+    return is_continuation(1) ? 2 : 0;
+  }
+  if (lead >= 0xE0 && lead <= 0xEF) {
+    if (!is_continuation(1) || !is_continuation(2) ||
+        (lead == 0xE0 && byte(1) < 0xA0) || (lead == 0xED && byte(1) > 0x9F)) {
+      return 0;
+    }
+    return 3;
+  }
+  if (lead >= 0xF0 && lead <= 0xF4) {
+    if (!is_continuation(1) || !is_continuation(2) || !is_continuation(3) ||
+        (lead == 0xF0 && byte(1) < 0x90) || (lead == 0xF4 && byte(1) > 0x8F)) {
+      return 0;
+    }
+    return 4;
+  }
+  return 0;
+}
+
+// Checks a name converted by the sandboxee: a-labels must be ASCII, u-labels
+// valid UTF-8, and neither may contain control characters.
+static absl::StatusOr<std::string> SanitizeName(absl::string_view untrusted,
+                                                bool ascii) {
+  if (untrusted.size() > kMaxDomainNameLength) {
+    return absl::InternalError("Converted name too long");
+  }
+  for (size_t i = 0; i < untrusted.size();) {
+    uint8_t c = static_cast<uint8_t>(untrusted[i]);
+    if (c < 0x20 || c == 0x7F) {
+      return absl::InternalError("Control character in converted name");
+    }
+    size_t length = ascii ? (c < 0x80 ? 1 : 0)
+                          : Utf8SequenceLength(untrusted.substr(i));
+    if (length == 0) {
+      return absl::InternalError(ascii ? "Converted name is not ASCII"
+                                       : "Converted name is not UTF-8");
+    }
+    i += length;
+  }
+  return std::string(untrusted);
+}
 
 absl::StatusOr<std::string> IDN2Lib::ProcessErrors(
-    const absl::StatusOr<int>& untrusted_res, sapi::v::GenericPtr& ptr) {
+    const absl::StatusOr<int>& untrusted_res, sapi::v::GenericPtr& ptr,
+    bool ascii) {
   SAPI_RETURN_IF_ERROR(untrusted_res.status());
   int res = untrusted_res.value();
   if (res < 0) {
-    if (res == IDN2_MALLOC) {
-      return absl::ResourceExhaustedError("malloc() failed in libidn2");
-    }
-    if (res > kMinPossibleKnownError) {
-      return absl::InvalidArgumentError(idn2_strerror(res));
-    }
-    return absl::InvalidArgumentError("Unexpected error");
+    return ErrorFromResult(res);
   }
   sapi::v::RemotePtr p(reinterpret_cast<void*>(ptr.GetValue()));
   auto maybe_untrusted_name = sandbox_->GetCString(p, kMaxDomainNameLength);
@@ -43,10 +118,7 @@ absl::StatusOr<std::string> IDN2Lib::ProcessErrors(
   if (!maybe_untrusted_name.ok()) {
     return maybe_untrusted_name.status();
   }
-  // FIXME: sanitize the result by checking that the return value is
-  // valid ASCII (for a-labels) or UTF-8 (for u-labels) and doesn't
-  // contain potentially malicious characters.
-  return *maybe_untrusted_name;
+  return SanitizeName(*maybe_untrusted_name, ascii);
 }
 
 absl::StatusOr<std::string> IDN2Lib::idn2_register_u8(const char* ulabel,
@@ -65,29 +137,160 @@ absl::StatusOr<std::string> IDN2Lib::idn2_register_u8(const char* ulabel,
       ulabel ? ulabel_ptr->PtrBefore() : &null_ptr,
       alabel ? alabel_ptr->PtrBefore() : &null_ptr, ptr.PtrAfter(),
       IDN2_NFC_INPUT | IDN2_NONTRANSITIONAL);
-  return this->ProcessErrors(untrusted_res, ptr);
+  return this->ProcessErrors(untrusted_res, ptr, /*ascii=*/true);
 }
 
 absl::StatusOr<std::string> IDN2Lib::SapiGeneric(
     const char* data,
     absl::StatusOr<int> (IDN2Api::*cb)(sapi::v::Ptr* input,
-                                       sapi::v::Ptr* output, int flags)) {
+                                       sapi::v::Ptr* output, int flags),
+    bool ascii) {
   sapi::v::ConstCStr src(data);
   sapi::v::GenericPtr ptr;
 
   absl::StatusOr<int> untrusted_res = ((api_).*(cb))(
       src.PtrBefore(), ptr.PtrAfter(), IDN2_NFC_INPUT | IDN2_NONTRANSITIONAL);
-  return this->ProcessErrors(untrusted_res, ptr);
+  return this->ProcessErrors(untrusted_res, ptr, ascii);
 }
 
 absl::StatusOr<std::string> IDN2Lib::idn2_to_unicode_8z8z(const char* data) {
-  return IDN2Lib::SapiGeneric(data, &IDN2Api::idn2_to_unicode_8z8z);
+  return IDN2Lib::SapiGeneric(data, &IDN2Api::idn2_to_unicode_8z8z,
+                              /*ascii=*/false);
 }
 
 absl::StatusOr<std::string> IDN2Lib::idn2_to_ascii_8z(const char* data) {
-  return IDN2Lib::SapiGeneric(data, &IDN2Api::idn2_to_ascii_8z);
+  return IDN2Lib::SapiGeneric(data, &IDN2Api::idn2_to_ascii_8z,
+                              /*ascii=*/true);
 }
 
 absl::StatusOr<std::string> IDN2Lib::idn2_lookup_u8(const char* data) {
-  return IDN2Lib::SapiGeneric(data, &IDN2Api::idn2_lookup_u8);
+  return IDN2Lib::SapiGeneric(data, &IDN2Api::idn2_lookup_u8,
+                              /*ascii=*/true);
+}
+
+absl::StatusOr<std::vector<absl::StatusOr<std::string>>>
+IDN2BatchConverter::ToAscii(absl::Span<const absl::string_view> names) {
+  return Convert(IDN2_BATCH_TO_ASCII, names);
+}
+
+absl::StatusOr<std::vector<absl::StatusOr<std::string>>>
+IDN2BatchConverter::ToUnicode(absl::Span<const absl::string_view> names) {
+  return Convert(IDN2_BATCH_TO_UNICODE, names);
+}
+
+absl::StatusOr<std::vector<absl::StatusOr<std::string>>>
+IDN2BatchConverter::Convert(int conversion,
+                            absl::Span<const absl::string_view> names) {
+  std::vector<absl::StatusOr<std::string>> results(names.size());
+  // Indexes into `results` of the names that are not cached, by name.
+  absl::flat_hash_map<absl::string_view, std::vector<size_t>> missing;
+  std::vector<absl::string_view> uncached;
+  {
+    absl::MutexLock lock(&mutex_);
+    const Cache& cache = caches_[conversion];
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (auto it = cache.find(names[i]); it != cache.end()) {
+        results[i] = it->second;
+        continue;
+      }
+      std::vector<size_t>& indexes = missing[names[i]];
+      if (indexes.empty()) {
+        uncached.push_back(names[i]);
+      }
+      indexes.push_back(i);
+    }
+  }
+
+  std::vector<absl::StatusOr<std::string>> converted(uncached.size());
+  for (size_t i = 0; i < uncached.size(); i += kMaxBatchSize) {
+    size_t count = std::min(kMaxBatchSize, uncached.size() - i);
+    SAPI_RETURN_IF_ERROR(ConvertUncached(
+        conversion, absl::MakeConstSpan(uncached).subspan(i, count),
+        absl::MakeSpan(converted).subspan(i, count)));
+  }
+
+  absl::MutexLock lock(&mutex_);
+  Cache& cache = caches_[conversion];
+  if (cache.size() + uncached.size() > cache_size_) {
+    cache.clear();
+  }
+  for (size_t i = 0; i < uncached.size(); ++i) {
+    for (size_t index : missing[uncached[i]]) {
+      results[index] = converted[i];
+    }
+    if (uncached.size() <= cache_size_) {
+      cache.emplace(uncached[i], std::move(converted[i]));
+    }
+  }
+  return results;
+}
+
+absl::Status IDN2BatchConverter::ConvertUncached(
+    int conversion, absl::Span<const absl::string_view> names,
+    absl::Span<absl::StatusOr<std::string>> out) {
+  std::string input;
+  std::vector<uint32_t> input_offsets;
+  input_offsets.reserve(names.size() + 1);
+  for (absl::string_view name : names) {
+    input_offsets.push_back(input.size());
+    input.append(name.data(), name.size());
+  }
+  if (input.size() > std::numeric_limits<uint32_t>::max()) {
+    return absl::InvalidArgumentError("Name batch too large");
+  }
+  input_offsets.push_back(input.size());
+
+  SAPI_ASSIGN_OR_RETURN(Idn2SandboxPool::Lease lease, pool_->Acquire());
+  IDN2Api api(lease.get());
+
+  sapi::v::Array<char> input_array(input.data(), input.size());
+  sapi::v::Array<uint32_t> input_offsets_array(input_offsets.data(),
+                                               input_offsets.size());
+  // Keep the names in the sandboxee in case the call needs to be repeated.
+  SAPI_RETURN_IF_ERROR(lease->Allocate(&input_array, true));
+  SAPI_RETURN_IF_ERROR(lease->TransferToSandboxee(&input_array));
+  SAPI_RETURN_IF_ERROR(lease->Allocate(&input_offsets_array, true));
+  SAPI_RETURN_IF_ERROR(lease->TransferToSandboxee(&input_offsets_array));
+
+  std::vector<int> codes(names.size());
+  sapi::v::Array<int> codes_array(codes.data(), codes.size());
+  std::vector<uint64_t> output_offsets(names.size() + 1);
+  sapi::v::Array<uint64_t> output_offsets_array(output_offsets.data(),
+                                                output_offsets.size());
+  uint64_t size = std::max<uint64_t>(input.size() * kOutputBytesPerInputByte,
+                                     kMaxDomainNameLength);
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    sapi::v::Array<char> output(size);
+    SAPI_ASSIGN_OR_RETURN(
+        uint64_t needed,
+        api.idn2_convert_batch(
+            conversion, IDN2_NFC_INPUT | IDN2_NONTRANSITIONAL,
+            input_array.PtrNone(), input_offsets_array.PtrNone(),
+            names.size(), codes_array.PtrAfter(), output.PtrAfter(), size,
+            output_offsets_array.PtrAfter()));
+    if (needed > size) {
+      size = needed;
+      continue;
+    }
+
+    // The offsets were written by the sandboxee, check them before use.
+    if (output_offsets[0] != 0 || output_offsets[names.size()] != needed) {
+      return absl::InternalError("Malformed batch output");
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (output_offsets[i] > output_offsets[i + 1]) {
+        return absl::InternalError("Malformed batch output");
+      }
+      if (codes[i] != IDN2_OK) {
+        out[i] = ErrorFromResult(codes[i]);
+        continue;
+      }
+      out[i] = SanitizeName(
+          absl::string_view(output.GetData() + output_offsets[i],
+                            output_offsets[i + 1] - output_offsets[i]),
+          /*ascii=*/conversion == IDN2_BATCH_TO_ASCII);
+    }
+    return absl::OkStatus();
+  }
+  return absl::InternalError("Batch output size changed");
 }
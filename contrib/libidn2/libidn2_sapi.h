@@ -18,10 +18,20 @@
 #include <idn2.h>
 #include <syscall.h>
 
+#include <cstddef>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include "libidn2_sapi.sapi.h"  // NOLINT(build/include)
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/log/die_if_null.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox_pool.h"
 #include "sandboxed_api/util/fileops.h"
 
 class Idn2SapiSandbox : public IDN2Sandbox {
@@ -59,11 +69,54 @@ class IDN2Lib {
   absl::StatusOr<std::string> SapiGeneric(
       const char* data,
       absl::StatusOr<int> (IDN2Api::*cb)(sapi::v::Ptr* input,
-                                         sapi::v::Ptr* output, int flags));
+                                         sapi::v::Ptr* output, int flags),
+      bool ascii);
+  // Returns the name converted by the sandboxee, which must be ASCII for
+  // a-labels (`ascii`) and UTF-8 otherwise.
   absl::StatusOr<std::string> ProcessErrors(const absl::StatusOr<int>& status,
-                                            sapi::v::GenericPtr& ptr);
+                                            sapi::v::GenericPtr& ptr,
+                                            bool ascii);
   Idn2SapiSandbox* sandbox_;
   IDN2Api api_;
 };
 
+using Idn2SandboxPool = sapi::SandboxPool<Idn2SapiSandbox>;
+
+// Converts batches of domain names, each batch in a single call into a sandbox
+// leased from a pool, with the same flags as IDN2Lib. Results are cached by
+// name, so names that repeat only need to be sent to the sandboxee once.
+// Thread-safe; concurrent batches run on different sandboxes of the pool.
+class IDN2BatchConverter {
+ public:
+  // Names cached per conversion, the cache is cleared when it is full.
+  static constexpr size_t kDefaultCacheSize = 1 << 16;
+  // Names sent to the sandboxee per call.
+  static constexpr size_t kMaxBatchSize = 1 << 12;
+
+  explicit IDN2BatchConverter(Idn2SandboxPool* pool,
+                              size_t cache_size = kDefaultCacheSize)
+      : pool_(ABSL_DIE_IF_NULL(pool)), cache_size_(cache_size) {}
+
+  // Returns the result of idn2_to_ascii_8z() (idn2_to_unicode_8z8z()) for each
+  // of `names`, or the error of the sandbox.
+  absl::StatusOr<std::vector<absl::StatusOr<std::string>>> ToAscii(
+      absl::Span<const absl::string_view> names);
+  absl::StatusOr<std::vector<absl::StatusOr<std::string>>> ToUnicode(
+      absl::Span<const absl::string_view> names);
+
+ private:
+  using Cache = absl::flat_hash_map<std::string, absl::StatusOr<std::string>>;
+
+  absl::StatusOr<std::vector<absl::StatusOr<std::string>>> Convert(
+      int conversion, absl::Span<const absl::string_view> names);
+  absl::Status ConvertUncached(int conversion,
+                               absl::Span<const absl::string_view> names,
+                               absl::Span<absl::StatusOr<std::string>> out);
+
+  Idn2SandboxPool* pool_;
+  size_t cache_size_;
+  absl::Mutex mutex_;
+  Cache caches_[2] ABSL_GUARDED_BY(mutex_);
+};
+
 #endif  // CONTRIB_LIBIDN2_LIBIDN2_SAPI_H_
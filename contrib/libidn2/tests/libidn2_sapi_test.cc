@@ -15,7 +15,11 @@
 #include "contrib/libidn2/libidn2_sapi.h"
 
 #include <optional>
+#include <string>
+#include <vector>
 
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "sandboxed_api/testing.h"
@@ -23,6 +27,7 @@
 
 using ::sapi::IsOk;
 using ::testing::Not;
+using ::testing::SizeIs;
 using ::testing::StrEq;
 
 class Idn2SapiSandboxTest : public testing::Test {
@@ -62,3 +67,55 @@ TEST_F(Idn2SapiSandboxTest, RegisterConversion) {
   EXPECT_THAT(lib_->idn2_register_u8("βgr", "xn--gr-e9"), Not(IsOk()));
   EXPECT_THAT(lib_->idn2_register_u8("β.gr", nullptr), Not(IsOk()));
 }
+
+// Returns the converted name, or the error for readable failures.
+std::string ValueOrStatus(const absl::StatusOr<std::string>& name) {
+  return name.ok() ? *name : name.status().ToString();
+}
+
+TEST(IDN2BatchConverterTest, ConvertsBatches) {
+  Idn2SandboxPool pool({.size = 2});
+  IDN2BatchConverter converter(&pool);
+
+  const std::vector<absl::string_view> names = {"straße.de", "β", "--- ",
+                                                "straße.de", "example.com"};
+  for (int i = 0; i < 2; ++i) {
+    // The second round is answered from the cache.
+    SAPI_ASSERT_OK_AND_ASSIGN(std::vector<absl::StatusOr<std::string>> ascii,
+                              converter.ToAscii(names));
+    ASSERT_THAT(ascii, SizeIs(names.size()));
+    EXPECT_THAT(ValueOrStatus(ascii[0]), StrEq("xn--strae-oqa.de"));
+    EXPECT_THAT(ValueOrStatus(ascii[1]), StrEq("xn--nxa"));
+    EXPECT_THAT(ascii[2], Not(IsOk()));
+    EXPECT_THAT(ValueOrStatus(ascii[3]), StrEq("xn--strae-oqa.de"));
+    EXPECT_THAT(ValueOrStatus(ascii[4]), StrEq("example.com"));
+  }
+
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::vector<absl::StatusOr<std::string>> unicode,
+      converter.ToUnicode({"xn--strae-oqa.de", "xn--nxa"}));
+  ASSERT_THAT(unicode, SizeIs(2));
+  EXPECT_THAT(ValueOrStatus(unicode[0]), StrEq("straße.de"));
+  EXPECT_THAT(ValueOrStatus(unicode[1]), StrEq("β"));
+}
+
+TEST(IDN2BatchConverterTest, SplitsLargeBatches) {
+  Idn2SandboxPool pool({.size = 1});
+  IDN2BatchConverter converter(&pool, /*cache_size=*/0);
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < IDN2BatchConverter::kMaxBatchSize + 10; ++i) {
+    names.push_back(absl::StrCat("straße", i, ".de"));
+  }
+  std::vector<absl::string_view> views(names.begin(), names.end());
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<absl::StatusOr<std::string>> ascii,
+                            converter.ToAscii(views));
+  ASSERT_THAT(ascii, SizeIs(names.size()));
+  ASSERT_THAT(ascii.front(), IsOk());
+  ASSERT_THAT(ascii.back(), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::vector<absl::StatusOr<std::string>> unicode,
+      converter.ToUnicode({*ascii.front(), *ascii.back()}));
+  EXPECT_THAT(ValueOrStatus(unicode[0]), StrEq(names.front()));
+  EXPECT_THAT(ValueOrStatus(unicode[1]), StrEq(names.back()));
+}
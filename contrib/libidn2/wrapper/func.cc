@@ -0,0 +1,58 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/libidn2/wrapper/func.h"
+
+#include <idn2.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+uint64_t idn2_convert_batch(int conversion, int flags, const char* input,
+                            const uint32_t* input_offsets, uint32_t count,
+                            int* results, char* output, uint64_t output_size,
+                            uint64_t* output_offsets) {
+  uint64_t needed = 0;
+  std::string name;
+  for (uint32_t i = 0; i < count; ++i) {
+    output_offsets[i] = needed;
+    // libidn2 expects NUL-terminated names.
+    name.assign(input + input_offsets[i],
+                input_offsets[i + 1] - input_offsets[i]);
+    char* converted = nullptr;
+    switch (conversion) {
+      case IDN2_BATCH_TO_ASCII:
+        results[i] = idn2_to_ascii_8z(name.c_str(), &converted, flags);
+        break;
+      case IDN2_BATCH_TO_UNICODE:
+        results[i] = idn2_to_unicode_8z8z(name.c_str(), &converted, flags);
+        break;
+      default:
+        results[i] = IDN2_INVALID_FLAGS;
+        break;
+    }
+    if (results[i] != IDN2_OK || converted == nullptr) {
+      idn2_free(converted);
+      continue;
+    }
+    size_t size = strlen(converted);
+    if (needed + size <= output_size) {
+      memcpy(output + needed, converted, size);
+    }
+    needed += size;
+    idn2_free(converted);
+  }
+  output_offsets[count] = needed;
+  return needed;
+}
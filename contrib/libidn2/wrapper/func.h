@@ -0,0 +1,42 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_LIBIDN2_WRAPPER_FUNC_H_
+#define CONTRIB_LIBIDN2_WRAPPER_FUNC_H_
+
+#include <cstdint>
+
+// Conversions of idn2_convert_batch().
+#define IDN2_BATCH_TO_ASCII 0    // idn2_to_ascii_8z()
+#define IDN2_BATCH_TO_UNICODE 1  // idn2_to_unicode_8z8z()
+
+extern "C" {
+
+// Converts the `count` names packed into `input`, the i-th being the bytes
+// from input_offsets[i] to input_offsets[i + 1], and stores the return code of
+// the conversion in results[i].
+//
+// The converted names are packed into `output` the same way, with
+// output_offsets[0..count]. Failed conversions are empty. Once the names do not
+// fit into `output_size` bytes, no further ones are stored, and the offsets are
+// not meaningful.
+//
+// Returns the number of bytes needed to store all converted names.
+uint64_t idn2_convert_batch(int conversion, int flags, const char* input,
+                            const uint32_t* input_offsets, uint32_t count,
+                            int* results, char* output, uint64_t output_size,
+                            uint64_t* output_offsets);
+
+}  // extern "C"
+
+#endif  // CONTRIB_LIBIDN2_WRAPPER_FUNC_H_
@@ -39,6 +39,8 @@ class LibRawSapiSandbox : public LibRawSandbox {
         .AllowSystemMalloc()
         .AllowExit()
         .AllowSyscalls({__NR_recvmsg})
+        // Shared buffers of LibRaw::UnpackAndExport().
+        .AllowSharedMemoryMappings()
         .AddFile(file_name_, /*is_ro=*/true)
         .BuildOrDie();
   }
@@ -181,6 +181,44 @@ TEST_P(LibRawTestFiles, TestSubtractBlack) {
   }
 }
 
+TEST_P(LibRawTestFiles, TestUnpackAndExport) {
+  const TestVariant& tv = GetParam();
+  std::string test_file_path = GetTestFilePath(tv.filename);
+
+  LibRawSapiSandbox sandbox(test_file_path);
+  SAPI_ASSERT_OK(sandbox.Init());
+
+  LibRaw lr(&sandbox, test_file_path);
+  SAPI_ASSERT_OK(lr.CheckIsInit());
+  SAPI_ASSERT_OK(lr.OpenFile());
+  SAPI_ASSERT_OK_AND_ASSIGN(LibRawExport exported,
+                            lr.UnpackAndExport(/*preview_shrink=*/2));
+
+  const libraw_export_t& info = exported.info;
+  EXPECT_EQ(info.raw_height, tv.raw_height);
+  EXPECT_EQ(info.raw_width, tv.raw_width);
+  ASSERT_EQ(exported.raw.size(), tv.raw_height * tv.raw_width);
+
+  for (int row = 0; row < 4; ++row) {
+    for (int col = 0; col < 4; ++col) {
+      unsigned black_level = info.cblack[tv.COLOR[row][col]];
+      uint16_t value = exported.raw[row * info.raw_width + col];
+      int color_value = value > black_level ? value - black_level : 0;
+      EXPECT_EQ(color_value, tv.color_values[row][col]);
+    }
+  }
+
+  EXPECT_EQ(info.preview_height, tv.raw_height / 2);
+  EXPECT_EQ(info.preview_width, tv.raw_width / 2);
+  ASSERT_EQ(exported.preview.size(),
+            info.preview_height * info.preview_width);
+  const absl::Span<const uint16_t> raw = exported.raw;
+  EXPECT_EQ(exported.preview[1],
+            (raw[2] + raw[3] + raw[info.raw_width + 2] +
+             raw[info.raw_width + 3]) /
+                4);
+}
+
 INSTANTIATE_TEST_SUITE_P(LibRawBase, LibRawTestFiles,
                          testing::ValuesIn(kTestData));
 
@@ -14,8 +14,14 @@
 
 #include "contrib/libraw/utils/utils_libraw.h"
 
+#include <cstdint>
+#include <memory>
+#include <utility>
+
 #include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
 #include "contrib/libraw/sandboxed.h"
+#include "sandboxed_api/var_shared_array.h"
 
 absl::Status LibRaw::InitLibRaw() {
   SAPI_ASSIGN_OR_RETURN(libraw_data_t * lr_data, api_.libraw_init(0));
@@ -68,6 +74,64 @@ absl::Status LibRaw::Unpack() {
   return absl::OkStatus();
 }
 
+absl::StatusOr<sapi::v::SharedArray<uint16_t>*> LibRaw::GetSharedBuffer(
+    size_t nelem, std::unique_ptr<sapi::v::SharedArray<uint16_t>>& buffer) {
+  if (buffer == nullptr || buffer->GetNElem() < nelem) {
+    buffer.reset();
+    auto new_buffer = std::make_unique<sapi::v::SharedArray<uint16_t>>(nelem);
+    SAPI_RETURN_IF_ERROR(sandbox_->Allocate(new_buffer.get(), true));
+    buffer = std::move(new_buffer);
+  }
+  return buffer.get();
+}
+
+absl::StatusOr<LibRawExport> LibRaw::UnpackAndExport(int preview_shrink) {
+  SAPI_RETURN_IF_ERROR(CheckIsInit());
+
+  // Known since OpenFile().
+  const libraw_image_sizes_t& sizes = sapi_libraw_data_t_.data().sizes;
+  size_t raw_size = static_cast<size_t>(sizes.raw_height) * sizes.raw_width;
+  if (raw_size == 0) {
+    return absl::FailedPreconditionError("No file opened");
+  }
+  SAPI_ASSIGN_OR_RETURN(sapi::v::SharedArray<uint16_t> * raw,
+                        GetSharedBuffer(raw_size, raw_buffer_));
+
+  size_t preview_size = 0;
+  sapi::v::SharedArray<uint16_t>* preview = nullptr;
+  sapi::v::NullPtr null_ptr;
+  if (preview_shrink > 0) {
+    preview_size = static_cast<size_t>(sizes.raw_height / preview_shrink) *
+                   (sizes.raw_width / preview_shrink);
+    SAPI_ASSIGN_OR_RETURN(preview,
+                          GetSharedBuffer(preview_size, preview_buffer_));
+  }
+
+  sapi::v::Struct<libraw_export_t> info;
+  SAPI_ASSIGN_OR_RETURN(
+      int error_code,
+      api_.libraw_unpack_export(
+          sapi_libraw_data_t_.PtrNone(), info.PtrAfter(), raw->PtrNone(),
+          raw_size, preview != nullptr ? preview->PtrNone() : &null_ptr,
+          preview_size, preview_shrink));
+  if (error_code != LIBRAW_SUCCESS) {
+    return absl::UnavailableError(
+        absl::string_view(std::to_string(error_code)));
+  }
+
+  LibRawExport result;
+  result.info = info.data();
+  result.raw = absl::MakeConstSpan(
+      raw->GetData(),
+      static_cast<size_t>(result.info.raw_height) * result.info.raw_width);
+  if (preview != nullptr) {
+    result.preview = absl::MakeConstSpan(
+        preview->GetData(), static_cast<size_t>(result.info.preview_height) *
+                                result.info.preview_width);
+  }
+  return result;
+}
+
 absl::Status LibRaw::SubtractBlack() {
   SAPI_RETURN_IF_ERROR(CheckIsInit());
 
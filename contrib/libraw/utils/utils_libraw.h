@@ -15,10 +15,14 @@
 #ifndef CONTRIB_LIBRAW_UTILS_UTILS_LIBRAW_H_
 #define CONTRIB_LIBRAW_UTILS_UTILS_LIBRAW_H_
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "absl/log/die_if_null.h"
+#include "absl/types/span.h"
 #include "contrib/libraw/sandboxed.h"
+#include "sandboxed_api/var_shared_array.h"
 
 enum LibRaw_errors {
   LIBRAW_SUCCESS = 0,
@@ -39,6 +43,16 @@ enum LibRaw_errors {
   LIBRAW_MEMPOOL_OVERFLOW = -100013
 };
 
+// Result of LibRaw::UnpackAndExport(). The spans point into memory shared
+// with the sandboxee and stay valid until the next UnpackAndExport() call.
+struct LibRawExport {
+  libraw_export_t info;
+  // info.raw_height rows of info.raw_width values.
+  absl::Span<const uint16_t> raw;
+  // info.preview_height rows of info.preview_width values, if requested.
+  absl::Span<const uint16_t> preview;
+};
+
 class LibRaw {
  public:
   LibRaw(LibRawSapiSandbox* sandbox, const std::string& file_name)
@@ -58,6 +72,11 @@ class LibRaw {
 
   absl::Status OpenFile();
   absl::Status Unpack();
+  // Unpacks the opened file and exports its dimensions, color data, raw image
+  // and, if `preview_shrink` is positive, a preview downscaled by that factor
+  // in a single call, without copying the image out of the sandboxee.
+  // GetImgData() is not updated by this.
+  absl::StatusOr<LibRawExport> UnpackAndExport(int preview_shrink = 0);
   absl::Status SubtractBlack();
   absl::StatusOr<std::vector<char*>> GetCameraList();
   absl::StatusOr<int> COLOR(int row, int col);
@@ -68,6 +87,8 @@ class LibRaw {
 
  private:
   absl::Status InitLibRaw();
+  absl::StatusOr<sapi::v::SharedArray<uint16_t>*> GetSharedBuffer(
+      size_t nelem, std::unique_ptr<sapi::v::SharedArray<uint16_t>>& buffer);
 
   LibRawSapiSandbox* sandbox_;
   LibRawApi api_;
@@ -76,6 +97,9 @@ class LibRaw {
   std::string file_name_;
 
   sapi::v::Struct<libraw_data_t> sapi_libraw_data_t_;
+
+  std::unique_ptr<sapi::v::SharedArray<uint16_t>> raw_buffer_;
+  std::unique_ptr<sapi::v::SharedArray<uint16_t>> preview_buffer_;
 };
 
 #endif  // CONTRIB_LIBRAW_UTILS_UTILS_LIBRAW_H_
@@ -0,0 +1,91 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/libraw/wrapper/func.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+void Downscale(const uint16_t* raw, size_t pitch, const libraw_export_t& info,
+               int shrink, uint16_t* preview) {
+  for (size_t y = 0; y < info.preview_height; ++y) {
+    for (size_t x = 0; x < info.preview_width; ++x) {
+      uint64_t sum = 0;
+      for (int dy = 0; dy < shrink; ++dy) {
+        const uint16_t* row = raw + (y * shrink + dy) * pitch + x * shrink;
+        for (int dx = 0; dx < shrink; ++dx) {
+          sum += row[dx];
+        }
+      }
+      preview[y * info.preview_width + x] = sum / (shrink * shrink);
+    }
+  }
+}
+
+}  // namespace
+
+int libraw_unpack_export(libraw_data_t* lr, libraw_export_t* info,
+                         uint16_t* raw, size_t raw_size, uint16_t* preview,
+                         size_t preview_size, int shrink) {
+  if (int error = libraw_unpack(lr); error != LIBRAW_SUCCESS) {
+    return error;
+  }
+
+  const libraw_image_sizes_t& sizes = lr->sizes;
+  memset(info, 0, sizeof(*info));
+  info->raw_height = sizes.raw_height;
+  info->raw_width = sizes.raw_width;
+  info->height = sizes.height;
+  info->width = sizes.width;
+  info->top_margin = sizes.top_margin;
+  info->left_margin = sizes.left_margin;
+  info->colors = lr->idata.colors;
+  info->filters = lr->idata.filters;
+  info->black = lr->color.black;
+  info->maximum = lr->color.maximum;
+  memcpy(info->cblack, lr->color.cblack, sizeof(info->cblack));
+
+  const uint16_t* raw_image = lr->rawdata.raw_image;
+  if (raw_image == nullptr) {
+    // Not a single-channel mosaic, e.g. a linear DNG.
+    return raw == nullptr && preview == nullptr
+               ? LIBRAW_SUCCESS
+               : LIBRAW_REQUEST_FOR_NONEXISTENT_IMAGE;
+  }
+  const size_t pitch = sizes.raw_pitch / sizeof(uint16_t);
+
+  if (raw != nullptr) {
+    if (raw_size < static_cast<size_t>(sizes.raw_height) * sizes.raw_width) {
+      return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+    for (size_t y = 0; y < sizes.raw_height; ++y) {
+      memcpy(raw + y * sizes.raw_width, raw_image + y * pitch,
+             sizes.raw_width * sizeof(uint16_t));
+    }
+  }
+
+  if (preview != nullptr && shrink > 0) {
+    info->preview_height = sizes.raw_height / shrink;
+    info->preview_width = sizes.raw_width / shrink;
+    if (preview_size <
+        static_cast<size_t>(info->preview_height) * info->preview_width) {
+      return LIBRAW_UNSUFFICIENT_MEMORY;
+    }
+    Downscale(raw_image, pitch, *info, shrink, preview);
+  }
+  return LIBRAW_SUCCESS;
+}
@@ -0,0 +1,55 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_LIBRAW_WRAPPER_FUNC_H_
+#define CONTRIB_LIBRAW_WRAPPER_FUNC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "libraw/libraw.h"  // NOLINT(build/include)
+
+extern "C" {
+
+// Everything needed to interpret an exported raw image.
+typedef struct {
+  uint16_t raw_height;
+  uint16_t raw_width;
+  uint16_t height;
+  uint16_t width;
+  uint16_t top_margin;
+  uint16_t left_margin;
+  int colors;
+  unsigned filters;
+  unsigned black;
+  unsigned maximum;
+  unsigned cblack[4];
+  // Zero if no preview was requested.
+  uint16_t preview_height;
+  uint16_t preview_width;
+} libraw_export_t;
+
+// Unpacks the opened image and fills `info` and, unless null:
+// - `raw` with raw_height rows of raw_width values,
+// - `preview` with the average of each `shrink` x `shrink` block of the raw
+//   values, a grayscale preview of the mosaic. An even `shrink` keeps every
+//   block aligned with the color filter pattern.
+// `raw_size` and `preview_size` are in values. Returns a LibRaw_errors code.
+int libraw_unpack_export(libraw_data_t* lr, libraw_export_t* info,
+                         uint16_t* raw, size_t raw_size, uint16_t* preview,
+                         size_t preview_size, int shrink);
+
+}  // extern "C"
+
+#endif  // CONTRIB_LIBRAW_WRAPPER_FUNC_H_
@@ -49,6 +49,8 @@ class TiffSapiSandbox : public TiffSandbox {
                            __NR_sysinfo,
                            __NR_mmap,
                            __NR_munmap,
+                           // File descriptors and shared buffers.
+                           __NR_recvmsg,
                        });
 
     if (!dir_.empty()) {
@@ -0,0 +1,155 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../wrapper/field_batch.h"  // NOLINT(build/include)
+#include "check_tag.h"               // NOLINT(build/include)
+#include "tiffio.h"                  // NOLINT(build/include)
+
+using ::sapi::IsOk;
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::NotNull;
+
+// sapi functions:
+// TIFFWriteScanline
+// TIFFOpen
+// TIFFClose
+// TIFFGetField (from check_tag.c)
+// TIFFSetFieldBatch
+// TIFFGetFieldBatch
+
+namespace {
+
+constexpr int kSamplePerPixel = 3;
+
+TIFFFieldBatchEntry UShortEntry(uint32_t tag, uint16_t value0,
+                                uint16_t value1 = 0) {
+  TIFFFieldBatchEntry entry = {};
+  entry.tag = tag;
+  entry.type = TIFFBATCH_USHORT;
+  entry.count = value1 == 0 ? 1 : 2;
+  entry.values[0].u = value0;
+  entry.values[1].u = value1;
+  return entry;
+}
+
+TIFFFieldBatchEntry ULongEntry(uint32_t tag, uint32_t value) {
+  TIFFFieldBatchEntry entry = {};
+  entry.tag = tag;
+  entry.type = TIFFBATCH_U;
+  entry.count = 1;
+  entry.values[0].u = value;
+  return entry;
+}
+
+TEST(SandboxTest, FieldBatch) {
+  absl::StatusOr<std::string> status_or_path =
+      sapi::CreateNamedTempFileAndClose("field_batch_test.tif");
+  ASSERT_THAT(status_or_path, IsOk()) << "Could not create temp file";
+
+  std::string srcfile =
+      sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), *status_or_path);
+
+  TiffSapiSandbox sandbox("", srcfile);
+  ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
+
+  TiffApi api(&sandbox);
+  sapi::v::ConstCStr srcfile_var(srcfile.c_str());
+  sapi::v::ConstCStr w_var("w");
+
+  absl::StatusOr<TIFF*> status_or_tif =
+      api.TIFFOpen(srcfile_var.PtrBefore(), w_var.PtrBefore());
+  ASSERT_THAT(status_or_tif, IsOk()) << "Could not open " << srcfile;
+  sapi::v::RemotePtr tif(status_or_tif.value());
+  ASSERT_THAT(tif.GetValue(), NotNull())
+      << "Can't create test TIFF file " << srcfile;
+
+  const std::vector<TIFFFieldBatchEntry> fields = {
+      ULongEntry(TIFFTAG_IMAGEWIDTH, 1),
+      ULongEntry(TIFFTAG_IMAGELENGTH, 1),
+      UShortEntry(TIFFTAG_BITSPERSAMPLE, 8),
+      UShortEntry(TIFFTAG_SAMPLESPERPIXEL, kSamplePerPixel),
+      ULongEntry(TIFFTAG_ROWSPERSTRIP, 1),
+      UShortEntry(TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG),
+      UShortEntry(TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB),
+      UShortEntry(TIFFTAG_COMPRESSION, COMPRESSION_NONE),
+      UShortEntry(TIFFTAG_ORIENTATION, ORIENTATION_BOTRIGHT),
+      UShortEntry(TIFFTAG_MINSAMPLEVALUE, 23),
+      UShortEntry(TIFFTAG_MAXSAMPLEVALUE, 241),
+      UShortEntry(TIFFTAG_PAGENUMBER, 1, 1),
+      UShortEntry(TIFFTAG_DOTRANGE, 8, 16),
+  };
+
+  std::vector<TIFFFieldBatchEntry> set_fields = fields;
+  sapi::v::Array<TIFFFieldBatchEntry> set_batch(set_fields.data(),
+                                                set_fields.size());
+  absl::StatusOr<uint32_t> status_or_count =
+      api.TIFFSetFieldBatch(&tif, set_batch.PtrBoth(), set_fields.size());
+  ASSERT_THAT(status_or_count, IsOk()) << "TIFFSetFieldBatch fatal error";
+  EXPECT_THAT(*status_or_count, Eq(fields.size()));
+  for (const TIFFFieldBatchEntry& entry : set_fields) {
+    EXPECT_THAT(entry.result, Ne(0)) << "Can't set tag " << entry.tag;
+  }
+
+  std::array<uint8_t, kSamplePerPixel> buffer = {0, 127, 255};
+  sapi::v::Array<uint8_t> buffer_(buffer.data(), kSamplePerPixel);
+  absl::StatusOr<int> status_or_int =
+      api.TIFFWriteScanline(&tif, buffer_.PtrBoth(), 0, 0);
+  ASSERT_THAT(status_or_int, IsOk()) << "TIFFWriteScanline fatal error";
+  ASSERT_THAT(status_or_int.value(), Ne(-1)) << "Can't write image data";
+  ASSERT_THAT(api.TIFFClose(&tif), IsOk()) << "TIFFClose fatal error";
+
+  sapi::v::ConstCStr r_var("r");
+  status_or_tif = api.TIFFOpen(srcfile_var.PtrBefore(), r_var.PtrBefore());
+  ASSERT_THAT(status_or_tif, IsOk()) << "Could not open " << srcfile;
+  sapi::v::RemotePtr tif2(status_or_tif.value());
+  ASSERT_THAT(tif2.GetValue(), NotNull())
+      << "Can't create test TIFF file " << srcfile;
+
+  std::vector<TIFFFieldBatchEntry> get_fields = fields;
+  for (TIFFFieldBatchEntry& entry : get_fields) {
+    entry.values[0].u = entry.values[1].u = 0;
+  }
+  // An unset tag fails on its own without affecting the others.
+  get_fields.push_back(UShortEntry(TIFFTAG_INKSET, 0));
+  sapi::v::Array<TIFFFieldBatchEntry> get_batch(get_fields.data(),
+                                                get_fields.size());
+  status_or_count =
+      api.TIFFGetFieldBatch(&tif2, get_batch.PtrBoth(), get_fields.size());
+  ASSERT_THAT(status_or_count, IsOk()) << "TIFFGetFieldBatch fatal error";
+  EXPECT_THAT(*status_or_count, Eq(fields.size()));
+  EXPECT_THAT(get_fields.back().result, Eq(0));
+
+  for (size_t i = 0; i < fields.size(); ++i) {
+    EXPECT_THAT(get_fields[i].result, Ne(0))
+        << "Problem fetching tag " << fields[i].tag;
+    for (uint32_t j = 0; j < fields[i].count; ++j) {
+      EXPECT_THAT(get_fields[i].values[j].u, Eq(fields[i].values[j].u))
+          << "Wrong value " << j << " fetched for tag " << fields[i].tag;
+    }
+  }
+
+  // The batch agrees with the single-field wrappers.
+  CheckLongField(api, tif2, TIFFTAG_IMAGEWIDTH, 1);
+  CheckShortPairedField(api, tif2, TIFFTAG_DOTRANGE, {8, 16});
+
+  ASSERT_THAT(api.TIFFClose(&tif2), IsOk()) << "TIFFClose fatal error";
+}
+
+}  // namespace
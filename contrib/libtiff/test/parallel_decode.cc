@@ -0,0 +1,125 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../utils/parallel_decode.h"  // NOLINT(build/include)
+#include "helper.h"                    // NOLINT(build/include)
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "gtest/gtest.h"
+#include "tiffio.h"  // NOLINT(build/include)
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::NotNull;
+
+// sapi functions:
+//    TIFFOpen
+//    TIFFFdOpen
+//    TIFFClose
+//    TIFFIsTiled
+//    TIFFNumberOfTiles
+//    TIFFTileSize
+//    TIFFReadEncodedTile
+//    TIFFReadEncodedTiles
+
+namespace {
+
+// Decodes every tile with TIFFReadEncodedTile() in a single sandbox.
+std::vector<std::vector<uint8_t>> DecodeSequential(const std::string& srcfile) {
+  TiffSapiSandbox sandbox("", srcfile);
+  EXPECT_THAT(sandbox.Init(), IsOk());
+  TiffApi api(&sandbox);
+
+  sapi::v::ConstCStr srcfile_var(srcfile.c_str());
+  sapi::v::ConstCStr r_var("r");
+  absl::StatusOr<TIFF*> status_or_tif =
+      api.TIFFOpen(srcfile_var.PtrBefore(), r_var.PtrBefore());
+  EXPECT_THAT(status_or_tif, IsOk());
+  sapi::v::RemotePtr tif(status_or_tif.value());
+  EXPECT_THAT(tif.GetValue(), NotNull());
+
+  absl::StatusOr<uint32_t> tiles = api.TIFFNumberOfTiles(&tif);
+  EXPECT_THAT(tiles, IsOk());
+  absl::StatusOr<tmsize_t> size = api.TIFFTileSize(&tif);
+  EXPECT_THAT(size, IsOk());
+
+  std::vector<std::vector<uint8_t>> result(*tiles);
+  for (uint32_t i = 0; i < *tiles; ++i) {
+    sapi::v::Array<uint8_t> buffer(*size);
+    absl::StatusOr<tmsize_t> read =
+        api.TIFFReadEncodedTile(&tif, i, buffer.PtrAfter(), *size);
+    EXPECT_THAT(read, IsOk());
+    EXPECT_THAT(*read, Eq(*size));
+    result[i].assign(buffer.GetData(), buffer.GetData() + *size);
+  }
+  EXPECT_THAT(api.TIFFClose(&tif), IsOk());
+  return result;
+}
+
+TEST(SandboxTest, DecodeTiffParallel) {
+  std::string srcfile = GetFilePath("test/images/quad-tile.jpg.tiff");
+  std::vector<std::vector<uint8_t>> expected = DecodeSequential(srcfile);
+  ASSERT_FALSE(expected.empty());
+
+  int fd = open(srcfile.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  TiffSandboxPool pool({.size = 3});
+
+  // Odd range sizes exercise a short last range.
+  for (uint32_t per_call : {1, 3, 64}) {
+    std::vector<std::vector<uint8_t>> decoded(expected.size());
+    absl::Mutex mutex;
+    ASSERT_THAT(
+        DecodeTiffParallel(
+            pool, fd, /*workers=*/3,
+            [&](uint32_t index, absl::Span<const uint8_t> data) {
+              absl::MutexLock lock(&mutex);
+              if (index >= decoded.size() || !decoded[index].empty()) {
+                return absl::InternalError("Unexpected tile");
+              }
+              decoded[index].assign(data.begin(), data.end());
+              return absl::OkStatus();
+            },
+            per_call),
+        IsOk());
+    EXPECT_THAT(decoded, Eq(expected)) << "chunks per call: " << per_call;
+  }
+  close(fd);
+}
+
+TEST(SandboxTest, DecodeTiffParallelPropagatesCallbackError) {
+  std::string srcfile = GetFilePath("test/images/quad-tile.jpg.tiff");
+  int fd = open(srcfile.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  TiffSandboxPool pool({.size = 2});
+
+  EXPECT_THAT(DecodeTiffParallel(
+                  pool, fd, /*workers=*/2,
+                  [](uint32_t, absl::Span<const uint8_t>) {
+                    return absl::CancelledError("stop");
+                  }),
+              StatusIs(absl::StatusCode::kCancelled));
+  close(fd);
+}
+
+}  // namespace
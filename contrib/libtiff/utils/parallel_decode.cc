@@ -0,0 +1,187 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel_decode.h"  // NOLINT(build/include)
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_shared_array.h"
+
+namespace {
+
+struct TiffLayout {
+  bool tiled;
+  uint32_t chunks;
+  tmsize_t chunk_size;
+};
+
+// A TIFF handle in a sandboxee on its own file description of the host's file.
+// libtiff seeks before every read, so sandboxes must not share the offset.
+class RemoteTiff {
+ public:
+  static absl::StatusOr<RemoteTiff> Open(TiffApi& api, int fd) {
+    sapi::v::Fd file(open(absl::StrCat("/proc/self/fd/", fd).c_str(),
+                          O_RDONLY | O_CLOEXEC));
+    if (file.GetValue() < 0) {
+      return absl::UnavailableError(absl::StrCat("Unable to reopen fd ", fd));
+    }
+    SAPI_RETURN_IF_ERROR(api.GetSandbox()->TransferToSandboxee(&file));
+
+    sapi::v::ConstCStr name("input");
+    sapi::v::ConstCStr mode("r");
+    SAPI_ASSIGN_OR_RETURN(TIFF * tif,
+                          api.TIFFFdOpen(file.GetRemoteFd(), name.PtrBefore(),
+                                         mode.PtrBefore()));
+    if (tif == nullptr) {
+      return absl::InvalidArgumentError("TIFFFdOpen() failed");
+    }
+    // TIFFClose() closes the remote fd.
+    file.OwnRemoteFd(false);
+    return RemoteTiff(api, tif);
+  }
+
+  RemoteTiff(RemoteTiff&& other)
+      : api_(other.api_), tif_(other.tif_.GetValue()) {
+    other.api_ = nullptr;
+  }
+  RemoteTiff& operator=(RemoteTiff&&) = delete;
+
+  ~RemoteTiff() {
+    if (api_ != nullptr) {
+      api_->TIFFClose(&tif_).IgnoreError();
+    }
+  }
+
+  sapi::v::RemotePtr* get() { return &tif_; }
+
+ private:
+  RemoteTiff(TiffApi& api, TIFF* tif) : api_(&api), tif_(tif) {}
+
+  TiffApi* api_;
+  sapi::v::RemotePtr tif_;
+};
+
+absl::StatusOr<TiffLayout> ReadLayout(TiffSandboxPool& pool, int fd) {
+  SAPI_ASSIGN_OR_RETURN(TiffSandboxPool::Lease lease, pool.Acquire());
+  TiffApi api(lease.get());
+  SAPI_ASSIGN_OR_RETURN(RemoteTiff tif, RemoteTiff::Open(api, fd));
+
+  TiffLayout layout;
+  SAPI_ASSIGN_OR_RETURN(int tiled, api.TIFFIsTiled(tif.get()));
+  layout.tiled = tiled != 0;
+  if (layout.tiled) {
+    SAPI_ASSIGN_OR_RETURN(layout.chunks, api.TIFFNumberOfTiles(tif.get()));
+    SAPI_ASSIGN_OR_RETURN(layout.chunk_size, api.TIFFTileSize(tif.get()));
+  } else {
+    SAPI_ASSIGN_OR_RETURN(layout.chunks, api.TIFFNumberOfStrips(tif.get()));
+    SAPI_ASSIGN_OR_RETURN(layout.chunk_size, api.TIFFStripSize(tif.get()));
+  }
+  if (layout.chunk_size <= 0) {
+    return absl::InvalidArgumentError("Invalid tile or strip size");
+  }
+  return layout;
+}
+
+// Decodes ranges of chunks claimed from `next` until none are left.
+absl::Status DecodeRanges(TiffSandboxPool& pool, int fd,
+                          const TiffLayout& layout, uint32_t per_call,
+                          std::atomic<uint32_t>& next,
+                          const TiffChunkCallback& callback) {
+  SAPI_ASSIGN_OR_RETURN(TiffSandboxPool::Lease lease, pool.Acquire());
+  TiffApi api(lease.get());
+  SAPI_ASSIGN_OR_RETURN(RemoteTiff tif, RemoteTiff::Open(api, fd));
+
+  const size_t chunk_size = layout.chunk_size;
+  sapi::v::SharedArray<uint8_t> buffer(per_call * chunk_size);
+  SAPI_RETURN_IF_ERROR(lease->Allocate(&buffer, true));
+
+  for (;;) {
+    uint32_t first = next.fetch_add(per_call);
+    if (first >= layout.chunks) {
+      return absl::OkStatus();
+    }
+    uint32_t count = std::min(per_call, layout.chunks - first);
+    absl::StatusOr<uint32_t> decoded =
+        layout.tiled
+            ? api.TIFFReadEncodedTiles(tif.get(), first, count,
+                                       buffer.PtrNone(), layout.chunk_size)
+            : api.TIFFReadEncodedStrips(tif.get(), first, count,
+                                        buffer.PtrNone(), layout.chunk_size);
+    SAPI_RETURN_IF_ERROR(decoded.status());
+    if (*decoded != count) {
+      // Let the other workers stop early.
+      next.store(layout.chunks);
+      return absl::DataLossError(absl::StrCat(
+          "Unable to decode ", layout.tiled ? "tile " : "strip ",
+          first + *decoded));
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+      absl::Status status = callback(
+          first + i, absl::MakeConstSpan(buffer.GetData() + i * chunk_size,
+                                         chunk_size));
+      if (!status.ok()) {
+        next.store(layout.chunks);
+        return status;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+absl::Status DecodeTiffParallel(TiffSandboxPool& pool, int fd, int workers,
+                                const TiffChunkCallback& callback,
+                                uint32_t chunks_per_call) {
+  if (workers < 1 || chunks_per_call < 1) {
+    return absl::InvalidArgumentError(
+        "workers and chunks_per_call must be positive");
+  }
+  SAPI_ASSIGN_OR_RETURN(TiffLayout layout, ReadLayout(pool, fd));
+  if (layout.chunks == 0) {
+    return absl::OkStatus();
+  }
+  // Do not start workers without a range to decode.
+  uint32_t ranges = (layout.chunks - 1) / chunks_per_call + 1;
+  size_t nworkers = std::min<uint32_t>(workers, ranges);
+
+  std::atomic<uint32_t> next = 0;
+  std::vector<absl::Status> statuses(nworkers);
+  std::vector<std::thread> threads;
+  threads.reserve(nworkers);
+  for (size_t i = 0; i < nworkers; ++i) {
+    threads.emplace_back([&, i] {
+      statuses[i] =
+          DecodeRanges(pool, fd, layout, chunks_per_call, next, callback);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (absl::Status& status : statuses) {
+    SAPI_RETURN_IF_ERROR(status);
+  }
+  return absl::OkStatus();
+}
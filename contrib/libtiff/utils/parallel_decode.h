@@ -0,0 +1,47 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_LIBTIFF_UTILS_PARALLEL_DECODE_H_
+#define CONTRIB_LIBTIFF_UTILS_PARALLEL_DECODE_H_
+
+#include <cstdint>
+#include <functional>
+
+#include "../sandboxed.h"  // NOLINT(build/include)
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox_pool.h"
+
+using TiffSandboxPool = sapi::SandboxPool<TiffSapiSandbox>;
+
+inline constexpr uint32_t kDefaultChunksPerCall = 16;
+
+// Receives the decoded tile or strip `index`. The span holds TIFFTileSize()
+// (TIFFStripSize()) bytes; for the last strip only the rows inside the image
+// are meaningful. Called concurrently from several threads, the span is only
+// valid during the call.
+using TiffChunkCallback =
+    std::function<absl::Status(uint32_t index, absl::Span<const uint8_t>)>;
+
+// Decodes all tiles (or strips, for untiled images) of the first directory of
+// the TIFF file open as `fd`. Up to `workers` sandboxes from `pool` each open
+// the file on their own file description and decode ranges of
+// `chunks_per_call` chunks per call into a buffer shared with the host.
+// Returns the first error of a worker or of `callback`.
+absl::Status DecodeTiffParallel(
+    TiffSandboxPool& pool, int fd, int workers,
+    const TiffChunkCallback& callback,
+    uint32_t chunks_per_call = kDefaultChunksPerCall);
+
+#endif  // CONTRIB_LIBTIFF_UTILS_PARALLEL_DECODE_H_
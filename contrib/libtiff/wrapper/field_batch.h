@@ -0,0 +1,52 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Entries of TIFFSetFieldBatch() and TIFFGetFieldBatch(). Shared by the host
+// and the sandboxee, so it must not depend on libtiff.
+
+#ifndef CONTRIB_LIBTIFF_WRAPPER_FIELD_BATCH_H_
+#define CONTRIB_LIBTIFF_WRAPPER_FIELD_BATCH_H_
+
+#include <cstdint>
+
+// Type of the values of an entry, named after the TIFFSetField* suffixes.
+enum TIFFFieldBatchType : uint32_t {
+  TIFFBATCH_UCHAR,
+  TIFFBATCH_SCHAR,
+  TIFFBATCH_USHORT,
+  TIFFBATCH_SSHORT,
+  TIFFBATCH_U,
+  TIFFBATCH_S,
+  TIFFBATCH_ULLONG,
+  TIFFBATCH_SLLONG,
+  TIFFBATCH_FLOAT,
+  TIFFBATCH_DOUBLE,
+};
+
+// Unsigned types use u, signed types s and floating point types d.
+union TIFFFieldBatchValue {
+  uint64_t u;
+  int64_t s;
+  double d;
+};
+
+struct TIFFFieldBatchEntry {
+  uint32_t tag;
+  uint32_t type;   // TIFFFieldBatchType
+  uint32_t count;  // Number of values, 1 to 3
+  int32_t result;  // Set to the return value of TIFFSetField()/TIFFGetField()
+  TIFFFieldBatchValue values[3];
+};
+
+#endif  // CONTRIB_LIBTIFF_WRAPPER_FIELD_BATCH_H_
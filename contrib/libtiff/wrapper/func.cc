@@ -15,6 +15,7 @@
 #include "contrib/libtiff/wrapper/func.h"
 
 #include <cstdint>
+#include <type_traits>
 
 // Work around the linker not including this symbol in the final sandboxee
 // binary.
@@ -168,3 +169,137 @@ int TIFFSetFieldDouble3(TIFF* tif, uint32_t tag, double param1, double param2,
                         double param3) {
   return TIFFSetField(tif, tag, param1, param2, param3);
 }
+
+uint32_t TIFFReadEncodedTiles(TIFF* tif, uint32_t first, uint32_t count,
+                              void* buf, tmsize_t size) {
+  auto* out = static_cast<uint8_t*>(buf);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (TIFFReadEncodedTile(tif, first + i, out + i * size, size) < 0) {
+      return i;
+    }
+  }
+  return count;
+}
+
+uint32_t TIFFReadEncodedStrips(TIFF* tif, uint32_t first, uint32_t count,
+                               void* buf, tmsize_t size) {
+  auto* out = static_cast<uint8_t*>(buf);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (TIFFReadEncodedStrip(tif, first + i, out + i * size, size) < 0) {
+      return i;
+    }
+  }
+  return count;
+}
+
+namespace {
+
+template <typename T>
+int SetField(TIFF* tif, uint32_t tag, uint32_t count, const T (&v)[3]) {
+  switch (count) {
+    case 1:
+      return TIFFSetField(tif, tag, v[0]);
+    case 2:
+      return TIFFSetField(tif, tag, v[0], v[1]);
+    case 3:
+      return TIFFSetField(tif, tag, v[0], v[1], v[2]);
+  }
+  return 0;
+}
+
+template <typename T>
+int GetField(TIFF* tif, uint32_t tag, uint32_t count, T (&v)[3]) {
+  switch (count) {
+    case 1:
+      return TIFFGetField(tif, tag, &v[0]);
+    case 2:
+      return TIFFGetField(tif, tag, &v[0], &v[1]);
+    case 3:
+      return TIFFGetField(tif, tag, &v[0], &v[1], &v[2]);
+  }
+  return 0;
+}
+
+// Converts the values of `entry` to T and calls TIFFSetField().
+template <typename T>
+int SetEntry(TIFF* tif, const TIFFFieldBatchEntry& entry) {
+  T v[3];
+  for (int i = 0; i < 3; ++i) {
+    if constexpr (std::is_floating_point_v<T>) {
+      v[i] = static_cast<T>(entry.values[i].d);
+    } else if constexpr (std::is_signed_v<T>) {
+      v[i] = static_cast<T>(entry.values[i].s);
+    } else {
+      v[i] = static_cast<T>(entry.values[i].u);
+    }
+  }
+  return SetField(tif, entry.tag, entry.count, v);
+}
+
+// Calls TIFFGetField() with values of type T and widens them into `entry`.
+template <typename T>
+int GetEntry(TIFF* tif, TIFFFieldBatchEntry& entry) {
+  T v[3] = {};
+  int result = GetField(tif, entry.tag, entry.count, v);
+  for (int i = 0; i < 3; ++i) {
+    if constexpr (std::is_floating_point_v<T>) {
+      entry.values[i].d = v[i];
+    } else if constexpr (std::is_signed_v<T>) {
+      entry.values[i].s = v[i];
+    } else {
+      entry.values[i].u = v[i];
+    }
+  }
+  return result;
+}
+
+template <typename T>
+int ApplyEntry(TIFF* tif, TIFFFieldBatchEntry& entry, bool set) {
+  return set ? SetEntry<T>(tif, entry) : GetEntry<T>(tif, entry);
+}
+
+int ApplyEntry(TIFF* tif, TIFFFieldBatchEntry& entry, bool set) {
+  switch (entry.type) {
+    case TIFFBATCH_UCHAR:
+      return ApplyEntry<uint8_t>(tif, entry, set);
+    case TIFFBATCH_SCHAR:
+      return ApplyEntry<int8_t>(tif, entry, set);
+    case TIFFBATCH_USHORT:
+      return ApplyEntry<uint16_t>(tif, entry, set);
+    case TIFFBATCH_SSHORT:
+      return ApplyEntry<int16_t>(tif, entry, set);
+    case TIFFBATCH_U:
+      return ApplyEntry<uint32_t>(tif, entry, set);
+    case TIFFBATCH_S:
+      return ApplyEntry<int>(tif, entry, set);
+    case TIFFBATCH_ULLONG:
+      return ApplyEntry<uint64_t>(tif, entry, set);
+    case TIFFBATCH_SLLONG:
+      return ApplyEntry<int64_t>(tif, entry, set);
+    case TIFFBATCH_FLOAT:
+      return ApplyEntry<float>(tif, entry, set);
+    case TIFFBATCH_DOUBLE:
+      return ApplyEntry<double>(tif, entry, set);
+  }
+  return 0;
+}
+
+uint32_t ApplyBatch(TIFF* tif, void* entries, uint32_t count, bool set) {
+  auto* batch = static_cast<TIFFFieldBatchEntry*>(entries);
+  uint32_t succeeded = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    batch[i].result = ApplyEntry(tif, batch[i], set);
+    succeeded += batch[i].result != 0;
+  }
+  return succeeded;
+}
+
+}  // namespace
+
+uint32_t TIFFSetFieldBatch(TIFF* tif, void* entries, uint32_t count) {
+  return ApplyBatch(tif, entries, count, /*set=*/true);
+}
+
+uint32_t TIFFGetFieldBatch(TIFF* tif, void* entries, uint32_t count) {
+  return ApplyBatch(tif, entries, count, /*set=*/false);
+}
@@ -17,6 +17,7 @@
 
 #include <cstdint>
 
+#include "contrib/libtiff/wrapper/field_batch.h"
 #include "tiffio.h"  // NOLINT(build/include)
 
 // s - signed
@@ -83,6 +84,22 @@ int TIFFSetFieldDouble2(TIFF* tif, uint32_t tag, double param1, double param2);
 int TIFFSetFieldDouble3(TIFF* tif, uint32_t tag, double param1, double param2,
                         double param3);
 
+// Decode `count` consecutive tiles (strips) starting at `first` with
+// TIFFReadEncodedTile() (TIFFReadEncodedStrip()) in a single call. Each is
+// stored `size` bytes after the previous one in `buf`, which must hold
+// count * size bytes. Return the number decoded before the first failure.
+uint32_t TIFFReadEncodedTiles(TIFF* tif, uint32_t first, uint32_t count,
+                              void* buf, tmsize_t size);
+uint32_t TIFFReadEncodedStrips(TIFF* tif, uint32_t first, uint32_t count,
+                               void* buf, tmsize_t size);
+
+// Apply (read) `count` fields in a single call. `entries` points to an array of
+// TIFFFieldBatchEntry; it is untyped so that the generated API does not
+// redeclare the struct. Every entry is processed and its `result` set. Return
+// the number of entries that succeeded.
+uint32_t TIFFSetFieldBatch(TIFF* tif, void* entries, uint32_t count);
+uint32_t TIFFGetFieldBatch(TIFF* tif, void* entries, uint32_t count);
+
 }  // extern "C"
 
 #endif  // CONTRIB_LIBTIFF_WRAPPER_FUNC_H_
@@ -37,6 +37,8 @@ class LibxlsSapiSandbox : public LibxlsSandbox {
         .AllowSystemMalloc()
         .AllowExit()
         .AllowSyscall(__NR_recvmsg)
+        // Shared buffer of LibXlsSheet::GetCells().
+        .AllowSharedMemoryMappings()
         .AddFile(filename_)
         .BuildOrDie();
   }
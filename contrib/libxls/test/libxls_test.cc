@@ -122,6 +122,29 @@ TEST_P(LibXlsTestFiles, TestValues) {
   }
 }
 
+TEST_P(LibXlsTestFiles, TestGetCells) {
+  const TestCase& tv = GetParam();
+  std::string test_file_path = GetTestFilePath(tv.filename);
+
+  LibxlsSapiSandbox sandbox(test_file_path);
+  SAPI_ASSERT_OK(sandbox.Init());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(LibXlsWorkbook wb,
+                            LibXlsWorkbook::Open(&sandbox, test_file_path));
+  for (int i = 0; i < tv.sheet_count; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(LibXlsSheet sheet, wb.OpenSheet(i));
+    SAPI_ASSERT_OK_AND_ASSIGN(std::vector<LibXlsCell> cells, sheet.GetCells());
+    ASSERT_EQ(cells.size(), tv.sheet[i].count_row * tv.sheet[i].count_col);
+    for (size_t row = 0; row < sheet.GetRowCount(); ++row) {
+      for (size_t col = 0; col < sheet.GetColCount(); ++col) {
+        const LibXlsCell& cell = cells[row * sheet.GetColCount() + col];
+        ASSERT_EQ(cell.type, XLS_RECORD_NUMBER);
+        ASSERT_EQ(std::get<double>(cell.value), tv.sheet[i].values[row][col]);
+      }
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(LibXlsBase, LibXlsTestFiles,
                          testing::ValuesIn(kTestData));
 
@@ -138,6 +161,11 @@ TEST_F(LibXlsBase, TestFormula) {
   SAPI_ASSERT_OK_AND_ASSIGN(LibXlsCell cell, sheet.GetCell(0, 0));
   ASSERT_EQ(cell.type, XLS_RECORD_STRING);
   ASSERT_EQ(std::get<std::string>(cell.value), "10.000000");
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<LibXlsCell> cells, sheet.GetCells());
+  ASSERT_FALSE(cells.empty());
+  ASSERT_EQ(cells[0].type, XLS_RECORD_STRING);
+  ASSERT_EQ(std::get<std::string>(cells[0].value), "10.000000");
 }
 
 }  // namespace
@@ -14,11 +14,50 @@
 
 #include "contrib/libxls/utils/utils_libxls.h"
 
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "contrib/libxls/sandboxed.h"
+#include "contrib/libxls/wrapper/export.h"
+#include "sandboxed_api/var_shared_array.h"
+
+namespace {
+
+// Size of the buffer for GetCells() per cell, in addition to the cells
+// themselves. Larger strings need a second call.
+constexpr uint64_t kStrPoolBytesPerCell = 16;
+
+absl::StatusOr<LibXlsCell> MakeCell(
+    int id, double d,
+    absl::FunctionRef<absl::StatusOr<std::string>()> get_str) {
+  switch (id) {
+    case XLS_RECORD_RK:
+    case XLS_RECORD_MULRK:
+    case XLS_RECORD_NUMBER:
+      return LibXlsCell{XLS_RECORD_NUMBER, d};
+    case XLS_RECORD_BLANK:
+      return LibXlsCell{XLS_RECORD_BLANK, 0.0};
+    case XLS_RECORD_FORMULA:
+      SAPI_ASSIGN_OR_RETURN(std::string cell_str, get_str());
+      if (cell_str == "bool") {
+        return LibXlsCell{XLS_RECORD_BOOL, d > 0};
+      } else if (cell_str == "error") {
+        return LibXlsCell{XLS_RECORD_ERROR, cell_str};
+      }
+      return LibXlsCell{XLS_RECORD_STRING, cell_str};
+  }
+
+  return absl::UnavailableError("Unknown type");
+}
+
+}  // namespace
 
 absl::Status GetError(LibxlsApi* api, xls_error_t error_code) {
   SAPI_ASSIGN_OR_RETURN(const char* c_errstr, api->xls_getError(error_code));
@@ -109,27 +148,8 @@ absl::StatusOr<std::string> LibXlsSheet::GetStr(
 
 absl::StatusOr<LibXlsCell> LibXlsSheet::GetNewCell(
     const sapi::v::Struct<xlsCell>& sapi_cell) {
-  int id = sapi_cell.data().id;
-  double d = sapi_cell.data().d;
-
-  switch (id) {
-    case XLS_RECORD_RK:
-    case XLS_RECORD_MULRK:
-    case XLS_RECORD_NUMBER:
-      return LibXlsCell{XLS_RECORD_NUMBER, d};
-    case XLS_RECORD_BLANK:
-      return LibXlsCell{XLS_RECORD_BLANK, 0.0};
-    case XLS_RECORD_FORMULA:
-      SAPI_ASSIGN_OR_RETURN(std::string cell_str, GetStr(sapi_cell));
-      if (cell_str == "bool") {
-        return LibXlsCell{XLS_RECORD_BOOL, d > 0};
-      } else if (cell_str == "error") {
-        return LibXlsCell{XLS_RECORD_ERROR, cell_str};
-      }
-      return LibXlsCell{XLS_RECORD_STRING, cell_str};
-  }
-
-  return absl::UnavailableError("Unknown type");
+  return MakeCell(sapi_cell.data().id, sapi_cell.data().d,
+                  [&] { return GetStr(sapi_cell); });
 }
 
 absl::StatusOr<LibXlsCell> LibXlsSheet::GetCell(uint32_t row, uint32_t col) {
@@ -153,6 +173,64 @@ absl::StatusOr<LibXlsCell> LibXlsSheet::GetCell(uint32_t row, uint32_t col) {
   return GetNewCell(sapi_cell);
 }
 
+absl::StatusOr<std::vector<LibXlsCell>> LibXlsSheet::GetCells() {
+  const uint64_t cell_count = static_cast<uint64_t>(row_) * col_;
+  uint64_t size = sizeof(xlsExportHeader) +
+                  cell_count * (sizeof(xlsExportCell) + kStrPoolBytesPerCell);
+
+  LibxlsApi api(sandbox_);
+  sapi::v::RemotePtr sapi_rws(rws_);
+  // A buffer that is too small is retried once with the reported size.
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    sapi::v::SharedArray<uint8_t> buffer(size);
+    SAPI_RETURN_IF_ERROR(sandbox_->Allocate(&buffer, true));
+    SAPI_ASSIGN_OR_RETURN(
+        uint64_t needed,
+        api.xls_exportWorkSheet(&sapi_rws, buffer.PtrNone(), size));
+    if (needed == 0) {
+      return absl::UnavailableError("Unable to export sheet");
+    }
+    if (needed > size) {
+      size = needed;
+      continue;
+    }
+
+    // The export is written by the sandboxee, check it before use.
+    const uint8_t* data = buffer.GetData();
+    xlsExportHeader header;
+    memcpy(&header, data, sizeof(header));
+    const uint64_t cells_size =
+        sizeof(header) + cell_count * sizeof(xlsExportCell);
+    if (header.rows != row_ || header.cols != col_ || needed < cells_size ||
+        header.str_pool_size != needed - cells_size) {
+      return absl::InternalError("Malformed sheet export");
+    }
+    const char* str_pool = reinterpret_cast<const char*>(data + cells_size);
+
+    std::vector<LibXlsCell> cells;
+    cells.reserve(cell_count);
+    for (uint64_t i = 0; i < cell_count; ++i) {
+      xlsExportCell cell;
+      memcpy(&cell, data + sizeof(header) + i * sizeof(cell), sizeof(cell));
+      SAPI_ASSIGN_OR_RETURN(
+          LibXlsCell new_cell,
+          MakeCell(cell.id, cell.d, [&]() -> absl::StatusOr<std::string> {
+            if (cell.str_offset == XLS_EXPORT_NO_STR) {
+              return "";
+            }
+            if (cell.str_offset > header.str_pool_size ||
+                cell.str_size > header.str_pool_size - cell.str_offset) {
+              return absl::InternalError("Cell string out of bounds");
+            }
+            return std::string(str_pool + cell.str_offset, cell.str_size);
+          }));
+      cells.push_back(std::move(new_cell));
+    }
+    return cells;
+  }
+  return absl::InternalError("Sheet export size changed");
+}
+
 LibXlsSheet::~LibXlsSheet() {
   if (rws_ != nullptr) {
     LibxlsApi api(sandbox_);
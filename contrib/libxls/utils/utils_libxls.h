@@ -17,6 +17,10 @@
 
 #include <fcntl.h>
 
+#include <string>
+#include <variant>
+#include <vector>
+
 #include "absl/log/die_if_null.h"
 #include "contrib/libxls/sandboxed.h"
 
@@ -39,6 +43,10 @@ class LibXlsSheet {
   size_t GetRowCount() const;
   size_t GetColCount() const;
   absl::StatusOr<LibXlsCell> GetCell(uint32_t row, uint32_t col);
+  // Returns all cells in row-major order. The sandboxee exports the whole
+  // sheet into memory shared with the host in a single call, instead of the
+  // call and transfer per cell of GetCell().
+  absl::StatusOr<std::vector<LibXlsCell>> GetCells();
 
   ~LibXlsSheet();
 
@@ -0,0 +1,41 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_LIBXLS_WRAPPER_EXPORT_H_
+#define CONTRIB_LIBXLS_WRAPPER_EXPORT_H_
+
+#include <stdint.h>
+
+// Layout of a worksheet exported by xls_exportWorkSheet(): an
+// xlsExportHeader, then rows * cols xlsExportCell in row-major order, then
+// str_pool_size bytes of cell strings.
+
+#define XLS_EXPORT_NO_STR UINT32_MAX
+
+typedef struct {
+  uint32_t rows;
+  uint32_t cols;
+  uint64_t str_pool_size;
+} xlsExportHeader;
+
+typedef struct {
+  double d;
+  // The string of the cell, relative to the start of the string pool, or
+  // XLS_EXPORT_NO_STR.
+  uint32_t str_offset;
+  uint32_t str_size;
+  uint32_t id;
+  uint32_t reserved;
+} xlsExportCell;
+
+#endif  // CONTRIB_LIBXLS_WRAPPER_EXPORT_H_
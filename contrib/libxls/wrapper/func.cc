@@ -0,0 +1,77 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/libxls/wrapper/func.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include "contrib/libxls/wrapper/export.h"
+#include "xls.gen.h"  // NOLINT(build/include)
+
+uint64_t xls_exportWorkSheet(xlsWorkSheet* ws, uint8_t* buffer,
+                             uint64_t size) {
+  if (ws == nullptr || ws->rows.row == nullptr) {
+    return 0;
+  }
+  xlsExportHeader header = {};
+  header.rows = ws->rows.lastrow + 1;
+  header.cols = ws->rows.lastcol + 1;
+  const uint64_t cells_size =
+      sizeof(xlsExportHeader) +
+      static_cast<uint64_t>(header.rows) * header.cols * sizeof(xlsExportCell);
+
+  for (uint32_t row = 0; row < header.rows; ++row) {
+    for (uint32_t col = 0; col < header.cols; ++col) {
+      xlsCell* cell = xls_cell(ws, row, col);
+      if (cell != nullptr && cell->str != nullptr) {
+        header.str_pool_size += strlen(cell->str);
+      }
+    }
+  }
+  if (header.str_pool_size >= XLS_EXPORT_NO_STR) {
+    return 0;
+  }
+  const uint64_t total = cells_size + header.str_pool_size;
+  if (total > size) {
+    return total;
+  }
+
+  memcpy(buffer, &header, sizeof(header));
+  auto* cells = reinterpret_cast<xlsExportCell*>(buffer + sizeof(header));
+  char* str_pool = reinterpret_cast<char*>(buffer + cells_size);
+  uint64_t str_offset = 0;
+  for (uint32_t row = 0; row < header.rows; ++row) {
+    for (uint32_t col = 0; col < header.cols; ++col) {
+      xlsExportCell& out = *cells++;
+      out = {};
+      out.str_offset = XLS_EXPORT_NO_STR;
+      xlsCell* cell = xls_cell(ws, row, col);
+      if (cell == nullptr) {
+        // Cells missing from short rows read as blank.
+        out.id = XLS_RECORD_BLANK;
+        continue;
+      }
+      out.id = cell->id;
+      out.d = cell->d;
+      if (cell->str != nullptr) {
+        size_t length = strlen(cell->str);
+        memcpy(str_pool + str_offset, cell->str, length);
+        out.str_offset = str_offset;
+        out.str_size = length;
+        str_offset += length;
+      }
+    }
+  }
+  return total;
+}
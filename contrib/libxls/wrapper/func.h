@@ -0,0 +1,30 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_LIBXLS_WRAPPER_FUNC_H_
+#define CONTRIB_LIBXLS_WRAPPER_FUNC_H_
+
+#include <cstdint>
+
+#include "xls.gen.h"  // NOLINT(build/include)
+
+extern "C" {
+
+// Serializes all cells of the parsed worksheet `ws` into `buffer` as laid out
+// in export.h. Writes nothing if the export does not fit into `size` bytes.
+// Returns the size of the export, or 0 if the worksheet cannot be exported.
+uint64_t xls_exportWorkSheet(xlsWorkSheet* ws, uint8_t* buffer, uint64_t size);
+
+}  // extern "C"
+
+#endif  // CONTRIB_LIBXLS_WRAPPER_FUNC_H_
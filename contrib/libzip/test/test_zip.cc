@@ -12,7 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "contrib/libzip/sandboxed.h"
 #include "contrib/libzip/utils/utils_zip.h"
@@ -386,6 +392,62 @@ TEST_P(ZipMultiFiles, DeleteFileStore) {
   }
 }
 
+TEST_P(ZipMultiFiles, ExtractFile) {
+  LibZip zip(sandbox_.get(), test_path_zip_, 0);
+  ASSERT_THAT(zip.IsOpen(), true);
+
+  uint64_t index = GetParam().first;
+  std::string name = GetParam().second;
+  SAPI_ASSERT_OK_AND_ASSIGN(auto origdata, ReadFile(GetTestFilePath(name)));
+
+  std::string by_index = GetTemporaryFile("extract_index");
+  std::string by_name = GetTemporaryFile("extract_name");
+  int index_fd = open(by_index.c_str(), O_WRONLY);
+  ASSERT_GE(index_fd, 0);
+  int name_fd = open(by_name.c_str(), O_WRONLY);
+  ASSERT_GE(name_fd, 0);
+
+  ASSERT_THAT(zip.ExtractFile(index, index_fd), IsOk());
+  ASSERT_THAT(zip.ExtractFile(name, name_fd), IsOk());
+  close(index_fd);
+  close(name_fd);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto data, ReadFile(by_index));
+  ASSERT_EQ(data, origdata);
+  SAPI_ASSERT_OK_AND_ASSIGN(data, ReadFile(by_name));
+  ASSERT_EQ(data, origdata);
+}
+
+TEST_F(ZipBase, ExtractFilesParallel) {
+  const std::vector<std::pair<uint64_t, std::string>> entries = {
+      {0, "binary"}, {1, "text"}, {0, "binary"}, {1, "text"}};
+  std::vector<std::string> paths;
+  std::vector<ZipExtractJob> jobs;
+  for (const auto& [index, name] : entries) {
+    paths.push_back(GetTemporaryFile("extract_parallel"));
+    int fd = open(paths.back().c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    jobs.push_back({index, fd});
+  }
+  // Out of range.
+  jobs.push_back({entries.size(), jobs.front().fd});
+
+  ZipSandboxPool pool({.size = 2});
+  std::vector<absl::Status> statuses =
+      ExtractFilesParallel(pool, test_path_zip_, jobs, /*workers=*/2);
+  ASSERT_EQ(statuses.size(), jobs.size());
+  EXPECT_FALSE(statuses.back().ok());
+
+  for (size_t i = 0; i < entries.size(); ++i) {
+    close(jobs[i].fd);
+    ASSERT_THAT(statuses[i], IsOk());
+    SAPI_ASSERT_OK_AND_ASSIGN(auto data, ReadFile(paths[i]));
+    SAPI_ASSERT_OK_AND_ASSIGN(auto origdata,
+                              ReadFile(GetTestFilePath(entries[i].second)));
+    ASSERT_EQ(data, origdata);
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(ZipBase, ZipMultiFiles,
                          testing::Values(std::make_pair(0, "binary"),
                                          std::make_pair(1, "text")));
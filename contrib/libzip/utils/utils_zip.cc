@@ -14,11 +14,18 @@
 
 #include "contrib/libzip/utils/utils_zip.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "contrib/libzip/sandboxed.h"
 
 constexpr uint64_t kFileMaxSize = 1024 * 1024 * 1024;  // 1GB
@@ -202,6 +209,52 @@ absl::StatusOr<std::vector<uint8_t>> LibZip::ReadFile(uint64_t index) {
   return ReadFile(rzipfile, zipstat.mutable_data()->size);
 }
 
+absl::Status LibZip::ExtractFile(sapi::v::RemotePtr& rzipfile, int fd) {
+  sapi::v::Fd rfd(fd);
+  rfd.OwnLocalFd(false);
+  SAPI_RETURN_IF_ERROR(sandbox_->TransferToSandboxee(&rfd));
+  absl::StatusOr<int64_t> ret =
+      api_.zip_fread_to_fd(&rzipfile, rfd.GetRemoteFd());
+  rfd.CloseRemoteFd(sandbox_->rpc_channel()).IgnoreError();
+  SAPI_RETURN_IF_ERROR(ret.status());
+  if (*ret < 0) {
+    return absl::UnavailableError("Unable to extract file");
+  }
+
+  return absl::OkStatus();
+}
+
+absl::Status LibZip::ExtractFile(uint64_t index, int fd) {
+  SAPI_RETURN_IF_ERROR(CheckOpen());
+  SAPI_ASSIGN_OR_RETURN(zip_file_t * zipfile,
+                        api_.zip_fopen_index(zip_.get(), index, 0));
+  if (zipfile == nullptr) {
+    return absl::UnavailableError("Unable to open file in archaive");
+  }
+  sapi::v::RemotePtr rzipfile(zipfile);
+  absl::Cleanup rzipfile_cleanup = [this, &rzipfile] {
+    api_.zip_fclose(&rzipfile).IgnoreError();
+  };
+
+  return ExtractFile(rzipfile, fd);
+}
+
+absl::Status LibZip::ExtractFile(const std::string& filename, int fd) {
+  SAPI_RETURN_IF_ERROR(CheckOpen());
+  sapi::v::ConstCStr cfilename(filename.c_str());
+  SAPI_ASSIGN_OR_RETURN(zip_file_t * zipfile,
+                        api_.zip_fopen(zip_.get(), cfilename.PtrBefore(), 0));
+  if (zipfile == nullptr) {
+    return absl::UnavailableError("Unable to open file in archaive");
+  }
+  sapi::v::RemotePtr rzipfile(zipfile);
+  absl::Cleanup rzipfile_cleanup = [this, &rzipfile] {
+    api_.zip_fclose(&rzipfile).IgnoreError();
+  };
+
+  return ExtractFile(rzipfile, fd);
+}
+
 absl::StatusOr<uint64_t> LibZip::AddFile(const std::string& filename,
                                          sapi::v::RemotePtr& rzipsource) {
   SAPI_RETURN_IF_ERROR(CheckOpen());
@@ -322,3 +375,42 @@ absl::StatusOr<std::string> LibZip::GetError() {
   }
   return sandbox_->GetCString(sapi::v::RemotePtr(const_cast<char*>(err)));
 }
+
+std::vector<absl::Status> ExtractFilesParallel(
+    ZipSandboxPool& pool, const std::string& filename,
+    absl::Span<const ZipExtractJob> jobs, int workers) {
+  std::vector<absl::Status> statuses(jobs.size());
+  std::atomic<size_t> next = 0;
+  auto worker = [&] {
+    size_t i = next.fetch_add(1);
+    if (i >= jobs.size()) {
+      return;
+    }
+    absl::StatusOr<ZipSandboxPool::Lease> lease = pool.Acquire();
+    if (!lease.ok()) {
+      for (; i < jobs.size(); i = next.fetch_add(1)) {
+        statuses[i] = lease.status();
+      }
+      return;
+    }
+    // Opening the archive is the expensive part, so each worker keeps it
+    // open for all of its jobs.
+    LibZip zip(lease->get(), filename, 0);
+    for (; i < jobs.size(); i = next.fetch_add(1)) {
+      statuses[i] = zip.IsOpen()
+                        ? zip.ExtractFile(jobs[i].index, jobs[i].fd)
+                        : absl::UnavailableError("Unable to open archive");
+    }
+  };
+
+  std::vector<std::thread> threads;
+  size_t nthreads = std::min<size_t>(std::max(workers, 1), jobs.size());
+  threads.reserve(nthreads);
+  for (size_t i = 0; i < nthreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return statuses;
+}
@@ -17,8 +17,15 @@
 
 #include <fcntl.h>
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "absl/log/die_if_null.h"
+#include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "contrib/libzip/sandboxed.h"
+#include "sandboxed_api/sandbox_pool.h"
 #include "sandboxed_api/util/status_macros.h"
 
 class LibZip {
@@ -40,8 +47,13 @@ class LibZip {
   absl::StatusOr<uint64_t> GetNumberEntries();
   absl::StatusOr<std::vector<uint8_t>> ReadFile(uint64_t index);
   absl::StatusOr<std::vector<uint8_t>> ReadFile(const std::string& filename);
+  // Decompress an entry straight into `fd`, which stays owned by the caller,
+  // without passing the data through the host.
+  absl::Status ExtractFile(uint64_t index, int fd);
+  absl::Status ExtractFile(const std::string& filename, int fd);
   absl::StatusOr<uint64_t> AddFile(const std::string& filename,
                                    std::vector<uint8_t>& buf);
+  // The sandboxee reads the data from `fd` when the archive is written.
   absl::StatusOr<uint64_t> AddFile(const std::string& filename, int fd);
   absl::Status ReplaceFile(uint64_t index, std::vector<uint8_t>& buf);
   absl::Status ReplaceFile(uint64_t index, int fd);
@@ -60,6 +72,7 @@ class LibZip {
   absl::Status OpenRemote();
   absl::StatusOr<std::vector<uint8_t>> ReadFile(sapi::v::RemotePtr& zipfile,
                                                 uint32_t size);
+  absl::Status ExtractFile(sapi::v::RemotePtr& rzipfile, int fd);
   absl::StatusOr<uint64_t> AddFile(const std::string& filename,
                                    sapi::v::RemotePtr& rzipsource);
   absl::Status ReplaceFile(uint64_t index, sapi::v::RemotePtr& rzipsource);
@@ -83,4 +96,19 @@ class LibZip {
   std::string filename_;
 };
 
+using ZipSandboxPool = sapi::SandboxPool<ZipSapiSandbox>;
+
+struct ZipExtractJob {
+  uint64_t index;
+  // Owned by the caller.
+  int fd;
+};
+
+// Extracts entries of the archive `filename` with LibZip::ExtractFile(),
+// spreading the jobs over up to `workers` sandboxes from `pool` that each
+// open the archive. Returns one status per job.
+std::vector<absl::Status> ExtractFilesParallel(
+    ZipSandboxPool& pool, const std::string& filename,
+    absl::Span<const ZipExtractJob> jobs, int workers);
+
 #endif  // CONTRIB_LIBZIP_UTILS_UTILS_ZIP_H_
@@ -17,6 +17,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <cerrno>
+
 #include <iostream>
 
 #include "absl/cleanup/cleanup.h"
@@ -118,3 +120,28 @@ bool zip_source_to_fd(zip_source_t* src, int fd) {
 
   return size == 0;
 }
+
+zip_int64_t zip_fread_to_fd(zip_file_t* file, int fd) {
+  int8_t buf[64 << 10];
+  zip_int64_t total = 0;
+  while (true) {
+    zip_int64_t size = zip_fread(file, buf, sizeof(buf));
+    if (size < 0) {
+      return -1;
+    }
+    if (size == 0) {
+      return total;
+    }
+    for (zip_int64_t written = 0; written < size;) {
+      ssize_t ret = write(fd, buf + written, size - written);
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      written += ret;
+    }
+    total += size;
+  }
+}
@@ -27,6 +27,9 @@ void* zip_source_filefd_create(int fd, const char* flags, zip_uint64_t start,
                                zip_int64_t len, zip_error_t* ze);
 void* zip_read_fd_to_source(int fd, zip_error_t* ze);
 bool zip_source_to_fd(zip_source_t* src, int fd);
+// Decompresses the rest of `file` to `fd` and returns the number of bytes
+// written, or -1 on error.
+zip_int64_t zip_fread_to_fd(zip_file_t* file, int fd);
 }
 
 #endif  // CONTRIB_ZIP_WRAPPER_WRAPPER_ZIP_H_
@@ -16,8 +16,9 @@
 #include <iostream>
 #include <vector>
 
-#include "helpers.h"  // NOLINT(build/include)
-#include "sandbox.h"  // NOLINT(build/include)
+#include "../utils/utils_lodepng.h"  // NOLINT(build/include)
+#include "helpers.h"                   // NOLINT(build/include)
+#include "sandbox.h"                   // NOLINT(build/include)
 #include "absl/flags/parse.h"
 #include "absl/log/check.h"
 #include "absl/log/globals.h"
@@ -176,6 +177,24 @@ void EncodeDecodeTwoSteps(SapiLodepngSandbox& sandbox, LodepngApi& api) {
       << "Could not free memory inside sandboxed process";
 }
 
+void EncodeDecodeInMemory(LodepngApi& api) {
+  // Generate the values.
+  std::vector<uint8_t> image = GenerateValues();
+
+  // Encode and decode through buffers shared with the sandboxee, without
+  // temporary files.
+  absl::StatusOr<std::vector<uint8_t>> png =
+      EncodePng32(api, image, kWidth, kHeight);
+  CHECK(png.ok()) << "EncodePng32 failed: " << png.status();
+
+  absl::StatusOr<PngImage> decoded = DecodePng32(api, *png);
+  CHECK(decoded.ok()) << "DecodePng32 failed: " << decoded.status();
+
+  CHECK(decoded->width == kWidth) << "Widths differ";
+  CHECK(decoded->height == kHeight) << "Heights differ";
+  CHECK(decoded->pixels == image) << "Values differ";
+}
+
 int main(int argc, char* argv[]) {
   absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
   absl::ParseCommandLine(argc, argv);
@@ -192,6 +211,7 @@ int main(int argc, char* argv[]) {
 
   EncodeDecodeOneStep(sandbox, api);
   EncodeDecodeTwoSteps(sandbox, api);
+  EncodeDecodeInMemory(api);
 
   if (sapi::file_util::fileops::DeleteRecursively(images_path)) {
     LOG(WARNING) << "Temporary folder could not be deleted";
@@ -12,12 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "helpers.h"  // NOLINT(build/include)
-#include "sandbox.h"  // NOLINT(build/include)
+#include "../utils/utils_lodepng.h"  // NOLINT(build/include)
+#include "helpers.h"                   // NOLINT(build/include)
+#include "sandbox.h"                   // NOLINT(build/include)
 #include "gtest/gtest.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 using ::sapi::IsOk;
+using ::sapi::StatusIs;
 using ::testing::Eq;
 using ::testing::IsTrue;
 using ::testing::NotNull;
@@ -206,4 +208,37 @@ TEST(LodePngTest, EncodeDecodeTwoSteps) {
       << "Temporary directory could not be deleted";
 }
 
+// Encodes and decodes in memory through buffers shared with the sandboxee,
+// without touching the disk.
+TEST(LodePngTest, EncodeDecodeInMemory) {
+  const std::string images_path = CreateTempDirAtCWD();
+  ASSERT_THAT(sapi::file_util::fileops::Exists(images_path, false), IsTrue())
+      << "Temporary directory does not exist";
+
+  SapiLodepngSandbox sandbox(images_path);
+  ASSERT_THAT(sandbox.Init(), IsOk()) << "Error during sandbox init";
+  LodepngApi api(&sandbox);
+
+  std::vector<uint8_t> image = GenerateValues();
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint8_t> png,
+                            EncodePng32(api, image, kWidth, kHeight));
+  ASSERT_THAT(png.empty(), Eq(false));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(PngImage decoded, DecodePng32(api, png));
+  EXPECT_THAT(decoded.width, Eq(kWidth)) << "Widths differ";
+  EXPECT_THAT(decoded.height, Eq(kHeight)) << "Heights differ";
+  EXPECT_THAT(decoded.pixels, Eq(image)) << "Values differ";
+
+  // Truncated or mismatching input is rejected.
+  EXPECT_THAT(DecodePng32(api, absl::MakeConstSpan(png).first(16)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(EncodePng32(api, image, kWidth, kHeight + 1),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+
+  EXPECT_THAT(sapi::file_util::fileops::DeleteRecursively(images_path),
+              IsTrue())
+      << "Temporary directory could not be deleted";
+}
+
 }  // namespace
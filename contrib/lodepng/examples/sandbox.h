@@ -40,7 +40,10 @@ class SapiLodepngSandbox : public LodepngSandbox {
             __NR_futex,
             __NR_lseek,
             __NR_close,
+            __NR_recvmsg,
         })
+        // Shared buffers of DecodePng32() and EncodePng32().
+        .AllowSharedMemoryMappings()
         .BuildOrDie();
   }
 
@@ -0,0 +1,138 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "utils_lodepng.h"  // NOLINT(build/include)
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_int.h"
+#include "sandboxed_api/var_shared_array.h"
+
+namespace {
+
+// Upper bound for decoded images, lodepng itself does not limit the size.
+constexpr uint64_t kMaxPixelBytes = uint64_t{1} << 30;
+
+absl::Status LodepngError(const char* function, unsigned error) {
+  return absl::InvalidArgumentError(
+      absl::StrCat(function, "() failed with lodepng error ", error));
+}
+
+absl::StatusOr<std::unique_ptr<sapi::v::SharedArray<uint8_t>>> ShareBuffer(
+    LodepngApi& api, size_t size) {
+  auto buffer = std::make_unique<sapi::v::SharedArray<uint8_t>>(size);
+  SAPI_RETURN_IF_ERROR(api.GetSandbox()->Allocate(buffer.get(), true));
+  return buffer;
+}
+
+absl::StatusOr<std::unique_ptr<sapi::v::SharedArray<uint8_t>>> ShareCopy(
+    LodepngApi& api, absl::Span<const uint8_t> data) {
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<sapi::v::SharedArray<uint8_t>> buffer,
+                        ShareBuffer(api, data.size()));
+  memcpy(buffer->GetData(), data.data(), data.size());
+  return buffer;
+}
+
+}  // namespace
+
+absl::StatusOr<PngImage> DecodePng32(LodepngApi& api,
+                                     absl::Span<const uint8_t> png) {
+  if (png.empty()) {
+    return absl::InvalidArgumentError("Empty PNG");
+  }
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<sapi::v::SharedArray<uint8_t>> input,
+                        ShareCopy(api, png));
+
+  sapi::v::UInt width;
+  sapi::v::UInt height;
+  SAPI_ASSIGN_OR_RETURN(
+      unsigned error,
+      api.lodepng_inspect_size(input->PtrNone(), png.size(), width.PtrAfter(),
+                               height.PtrAfter()));
+  if (error != 0) {
+    return LodepngError("lodepng_inspect_size", error);
+  }
+  const uint64_t size = uint64_t{width.GetValue()} * height.GetValue() * 4;
+  if (size == 0 || size > kMaxPixelBytes) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Invalid image size ", width.GetValue(), "x", height.GetValue()));
+  }
+
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<sapi::v::SharedArray<uint8_t>> output,
+                        ShareBuffer(api, size));
+  sapi::v::UInt decoded_width;
+  sapi::v::UInt decoded_height;
+  SAPI_ASSIGN_OR_RETURN(
+      error, api.lodepng_decode32_into(output->PtrNone(), size,
+                                       decoded_width.PtrAfter(),
+                                       decoded_height.PtrAfter(),
+                                       input->PtrNone(), png.size()));
+  if (error != 0) {
+    return LodepngError("lodepng_decode32_into", error);
+  }
+  if (decoded_width.GetValue() != width.GetValue() ||
+      decoded_height.GetValue() != height.GetValue()) {
+    return absl::InternalError("Decoded size differs from the PNG header");
+  }
+
+  PngImage image;
+  image.width = width.GetValue();
+  image.height = height.GetValue();
+  image.pixels.assign(output->GetData(), output->GetData() + size);
+  return image;
+}
+
+absl::StatusOr<std::vector<uint8_t>> EncodePng32(
+    LodepngApi& api, absl::Span<const uint8_t> pixels, unsigned width,
+    unsigned height) {
+  if (pixels.empty() || pixels.size() != uint64_t{width} * height * 4) {
+    return absl::InvalidArgumentError("Pixels do not match the image size");
+  }
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<sapi::v::SharedArray<uint8_t>> input,
+                        ShareCopy(api, pixels));
+
+  // PNGs rarely exceed the raw pixels by more than the chunk overhead. If one
+  // does, lodepng_encode32_into() reports the size and we retry once.
+  size_t capacity = pixels.size() + pixels.size() / 64 + 1024;
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    SAPI_ASSIGN_OR_RETURN(
+        std::unique_ptr<sapi::v::SharedArray<uint8_t>> output,
+        ShareBuffer(api, capacity));
+    sapi::v::ULLong size(capacity);
+    SAPI_ASSIGN_OR_RETURN(unsigned error,
+                          api.lodepng_encode32_into(output->PtrNone(),
+                                                    size.PtrBoth(),
+                                                    input->PtrNone(), width,
+                                                    height));
+    if (error == 0) {
+      if (size.GetValue() > capacity) {
+        return absl::InternalError("Invalid PNG size");
+      }
+      return std::vector<uint8_t>(output->GetData(),
+                                  output->GetData() + size.GetValue());
+    }
+    if (size.GetValue() <= capacity || size.GetValue() > kMaxPixelBytes * 2) {
+      return LodepngError("lodepng_encode32_into", error);
+    }
+    capacity = size.GetValue();
+  }
+  return absl::InternalError("PNG size changed between attempts");
+}
@@ -0,0 +1,42 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_LODEPNG_UTILS_UTILS_LODEPNG_H_
+#define CONTRIB_LODEPNG_UTILS_UTILS_LODEPNG_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "lodepng_sapi.sapi.h"  // NOLINT(build/include)
+
+struct PngImage {
+  unsigned width = 0;
+  unsigned height = 0;
+  // width * height RGBA pixels.
+  std::vector<uint8_t> pixels;
+};
+
+// Decodes the PNG image `png` to 32 bit RGBA, entirely in memory. The PNG is
+// passed in and the pixels are returned through buffers shared with the
+// sandboxee, sized from the PNG header read by a first, cheap call.
+absl::StatusOr<PngImage> DecodePng32(LodepngApi& api,
+                                     absl::Span<const uint8_t> png);
+
+// Encodes the width * height RGBA pixels `pixels` to PNG, entirely in memory.
+absl::StatusOr<std::vector<uint8_t>> EncodePng32(
+    LodepngApi& api, absl::Span<const uint8_t> pixels, unsigned width,
+    unsigned height);
+
+#endif  // CONTRIB_LODEPNG_UTILS_UTILS_LODEPNG_H_
@@ -0,0 +1,61 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/lodepng/wrapper/func.h"
+
+#include <cstdlib>
+#include <cstring>
+
+unsigned lodepng_inspect_size(const unsigned char* png, size_t png_size,
+                              unsigned* width, unsigned* height) {
+  LodePNGState state;
+  lodepng_state_init(&state);
+  unsigned error = lodepng_inspect(width, height, &state, png, png_size);
+  lodepng_state_cleanup(&state);
+  return error;
+}
+
+unsigned lodepng_decode32_into(unsigned char* out, size_t out_size,
+                               unsigned* width, unsigned* height,
+                               const unsigned char* png, size_t png_size) {
+  unsigned char* image = nullptr;
+  unsigned error = lodepng_decode32(&image, width, height, png, png_size);
+  if (error == 0) {
+    size_t size = static_cast<size_t>(*width) * *height * 4;
+    if (size > out_size) {
+      error = LODEPNG_ERROR_OUTPUT_TOO_SMALL;
+    } else {
+      memcpy(out, image, size);
+    }
+  }
+  free(image);
+  return error;
+}
+
+unsigned lodepng_encode32_into(unsigned char* out, size_t* out_size,
+                               const unsigned char* image, unsigned width,
+                               unsigned height) {
+  unsigned char* png = nullptr;
+  size_t png_size = 0;
+  unsigned error = lodepng_encode32(&png, &png_size, image, width, height);
+  if (error == 0) {
+    if (png_size > *out_size) {
+      error = LODEPNG_ERROR_OUTPUT_TOO_SMALL;
+    } else {
+      memcpy(out, png, png_size);
+    }
+    *out_size = png_size;
+  }
+  free(png);
+  return error;
+}
@@ -0,0 +1,46 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_LODEPNG_WRAPPER_FUNC_H_
+#define CONTRIB_LODEPNG_WRAPPER_FUNC_H_
+
+#include <stddef.h>
+
+#include "lodepng.gen.h"  // NOLINT(build/include)
+
+// Returned instead of a lodepng error code if the output buffer is too small.
+#define LODEPNG_ERROR_OUTPUT_TOO_SMALL 0xFFFFu
+
+extern "C" {
+
+// Reads the dimensions of the PNG image `png` from its header, without
+// decoding it. Returns a lodepng error code.
+unsigned lodepng_inspect_size(const unsigned char* png, size_t png_size,
+                              unsigned* width, unsigned* height);
+
+// Like lodepng_decode32(), but decodes into the caller's buffer `out` of
+// `out_size` bytes instead of a newly allocated one.
+unsigned lodepng_decode32_into(unsigned char* out, size_t out_size,
+                               unsigned* width, unsigned* height,
+                               const unsigned char* png, size_t png_size);
+
+// Like lodepng_encode32(), but encodes into the caller's buffer `out`.
+// `out_size` holds the size of the buffer on input and the size of the PNG
+// on output, also if that does not fit.
+unsigned lodepng_encode32_into(unsigned char* out, size_t* out_size,
+                               const unsigned char* image, unsigned width,
+                               unsigned height);
+
+}  // extern "C"
+
+#endif  // CONTRIB_LODEPNG_WRAPPER_FUNC_H_
@@ -0,0 +1,46 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_PFFFT_SANDBOXED_H_
+#define CONTRIB_PFFFT_SANDBOXED_H_
+
+#include <syscall.h>
+
+#include <memory>
+
+#include "pffft_sapi.sapi.h"  // NOLINT(build/include)
+
+class PffftSapiSandbox : public PffftSandbox {
+ public:
+  std::unique_ptr<sandbox2::Policy> ModifyPolicy(
+      sandbox2::PolicyBuilder*) override {
+    return sandbox2::PolicyBuilder()
+        .AllowStaticStartup()
+        .AllowOpen()
+        .AllowRead()
+        .AllowWrite()
+        .AllowSystemMalloc()
+        .AllowExit()
+        .AllowSyscalls({
+            __NR_futex,
+            __NR_close,
+            __NR_getrusage,
+            __NR_recvmsg,
+        })
+        // Shared frame buffers of PffftBatch.
+        .AllowSharedMemoryMappings()
+        .BuildOrDie();
+  }
+};
+
+#endif  // CONTRIB_PFFFT_SANDBOXED_H_
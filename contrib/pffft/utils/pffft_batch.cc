@@ -0,0 +1,95 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/pffft/utils/pffft_batch.h"
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/util/status_macros.h"
+
+absl::StatusOr<std::unique_ptr<PffftBatch>> PffftBatch::Create(
+    PffftSandbox* sandbox, int n, pffft_transform_t transform,
+    size_t max_frames) {
+  if (sandbox == nullptr) {
+    return absl::InvalidArgumentError("Sandbox has to be defined");
+  }
+  if (n <= 0 || max_frames == 0) {
+    return absl::InvalidArgumentError("Invalid batch size");
+  }
+  const size_t frame_size = transform == PFFFT_COMPLEX ? 2 * n : n;
+  if (frame_size > std::numeric_limits<int>::max() ||
+      max_frames > std::numeric_limits<int>::max() / frame_size) {
+    return absl::InvalidArgumentError("Batch too large");
+  }
+
+  auto batch =
+      absl::WrapUnique(new PffftBatch(sandbox, frame_size, max_frames));
+  SAPI_RETURN_IF_ERROR(sandbox->Allocate(&batch->input_, true));
+  SAPI_RETURN_IF_ERROR(sandbox->Allocate(&batch->output_, true));
+
+  SAPI_ASSIGN_OR_RETURN(PFFFT_Setup * setup,
+                        batch->api_.pffft_new_setup(n, transform));
+  if (setup == nullptr) {
+    // pffft only supports sizes with small prime factors.
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported transform size ", n));
+  }
+  batch->setup_ = setup;
+
+  // Without a work buffer, pffft would allocate one on the stack per frame.
+  SAPI_ASSIGN_OR_RETURN(
+      void* work, batch->api_.pffft_aligned_malloc(frame_size * sizeof(float)));
+  if (work == nullptr) {
+    return absl::ResourceExhaustedError("Unable to allocate work buffer");
+  }
+  batch->work_ = work;
+  return batch;
+}
+
+PffftBatch::~PffftBatch() {
+  if (work_ != nullptr) {
+    sapi::v::RemotePtr work(work_);
+    api_.pffft_aligned_free(&work).IgnoreError();
+  }
+  if (setup_ != nullptr) {
+    sapi::v::RemotePtr setup(setup_);
+    api_.pffft_destroy_setup(&setup).IgnoreError();
+  }
+}
+
+absl::Status PffftBatch::Transform(size_t frames, pffft_direction_t direction,
+                                   bool ordered) {
+  if (frames > max_frames_) {
+    return absl::OutOfRangeError("Too many frames");
+  }
+  if (frames == 0) {
+    return absl::OkStatus();
+  }
+  sapi::v::RemotePtr setup(setup_);
+  sapi::v::RemotePtr work(work_);
+  SAPI_ASSIGN_OR_RETURN(
+      int done, api_.pffft_transform_batch(
+                    &setup, input_.PtrNone(), output_.PtrNone(), &work,
+                    frame_size_, frames, direction, ordered ? 1 : 0));
+  if (done < 0 || static_cast<size_t>(done) != frames) {
+    return absl::InternalError(
+        absl::StrCat("Frame ", done, " is not SIMD aligned"));
+  }
+  return absl::OkStatus();
+}
@@ -0,0 +1,84 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_PFFFT_UTILS_PFFFT_BATCH_H_
+#define CONTRIB_PFFFT_UTILS_PFFFT_BATCH_H_
+
+#include <cstddef>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "pffft_sapi.sapi.h"  // NOLINT(build/include)
+#include "sandboxed_api/var_ptr.h"
+#include "sandboxed_api/var_shared_array.h"
+
+// Transforms batches of frames of one size with a PFFFT_Setup that is kept in
+// the sandboxee. The frames live in buffers shared with the host, so that a
+// single call transforms a whole batch without copying the frames in or out.
+// The sandbox policy must allow shared read-write mappings, as the one of
+// PffftSapiSandbox does.
+//
+// Example:
+//   SAPI_ASSIGN_OR_RETURN(auto batch, PffftBatch::Create(&sandbox, 512,
+//                                                        PFFFT_REAL, 64));
+//   FillFrames(batch->input());
+//   SAPI_RETURN_IF_ERROR(batch->Transform(64, PFFFT_FORWARD));
+//   UseSpectra(batch->output());
+class PffftBatch {
+ public:
+  // Sets up transforms of size `n` for up to `max_frames` frames per batch.
+  static absl::StatusOr<std::unique_ptr<PffftBatch>> Create(
+      PffftSandbox* sandbox, int n, pffft_transform_t transform,
+      size_t max_frames);
+
+  ~PffftBatch();
+
+  // Number of floats per frame, n for real and 2 * n for complex transforms.
+  size_t frame_size() const { return frame_size_; }
+  size_t max_frames() const { return max_frames_; }
+
+  // The frames, back to back. As the sandboxee can write to them at any time,
+  // the output is untrusted.
+  absl::Span<float> input() {
+    return absl::MakeSpan(input_.GetData(), input_.GetNElem());
+  }
+  absl::Span<const float> output() const {
+    return absl::MakeConstSpan(output_.GetData(), output_.GetNElem());
+  }
+
+  // Transforms the first `frames` frames of input() into output(), with
+  // pffft_transform_ordered() if `ordered`, pffft_transform() otherwise.
+  absl::Status Transform(size_t frames, pffft_direction_t direction,
+                         bool ordered = false);
+
+ private:
+  PffftBatch(PffftSandbox* sandbox, size_t frame_size, size_t max_frames)
+      : api_(sandbox),
+        frame_size_(frame_size),
+        max_frames_(max_frames),
+        input_(frame_size * max_frames),
+        output_(frame_size * max_frames) {}
+
+  PffftApi api_;
+  size_t frame_size_;
+  size_t max_frames_;
+  sapi::v::SharedArray<float> input_;
+  sapi::v::SharedArray<float> output_;
+  // Owned by the sandboxee.
+  PFFFT_Setup* setup_ = nullptr;
+  void* work_ = nullptr;
+};
+
+#endif  // CONTRIB_PFFFT_UTILS_PFFFT_BATCH_H_
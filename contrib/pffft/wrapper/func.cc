@@ -0,0 +1,49 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/pffft/wrapper/func.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "contrib/pffft/wrapper/func.h"
+
+namespace {
+
+bool IsAligned(const float* p) {
+  return reinterpret_cast<uintptr_t>(p) % (pffft_simd_size() * sizeof(float)) ==
+         0;
+}
+
+}  // namespace
+
+int pffft_transform_batch(PFFFT_Setup* setup, const float* input,
+                          float* output, float* work, int frame_size,
+                          int count, pffft_direction_t direction, int ordered) {
+  if (work != nullptr && !IsAligned(work)) {
+    return 0;
+  }
+  for (int i = 0; i < count; ++i) {
+    const float* in = input + static_cast<size_t>(i) * frame_size;
+    float* out = output + static_cast<size_t>(i) * frame_size;
+    if (!IsAligned(in) || !IsAligned(out)) {
+      return i;
+    }
+    if (ordered) {
+      pffft_transform_ordered(setup, in, out, work, direction);
+    } else {
+      pffft_transform(setup, in, out, work, direction);
+    }
+  }
+  return count;
+}
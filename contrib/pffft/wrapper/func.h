@@ -0,0 +1,33 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_PFFFT_WRAPPER_FUNC_H_
+#define CONTRIB_PFFFT_WRAPPER_FUNC_H_
+
+#include "pffft.h"  // NOLINT(build/include)
+
+extern "C" {
+
+// Runs pffft_transform(), or pffft_transform_ordered() if `ordered`, on the
+// `count` frames of `frame_size` floats stored back to back in `input`, and
+// stores the results at the same positions in `output`. `work` is scratch
+// space of `frame_size` floats, or NULL. All buffers must be SIMD aligned, as
+// pffft requires. Returns the number of frames transformed, which is less than
+// `count` if a frame is not aligned.
+int pffft_transform_batch(PFFFT_Setup* setup, const float* input,
+                          float* output, float* work, int frame_size,
+                          int count, pffft_direction_t direction, int ordered);
+
+}  // extern "C"
+
+#endif  // CONTRIB_PFFFT_WRAPPER_FUNC_H_
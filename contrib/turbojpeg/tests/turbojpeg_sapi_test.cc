@@ -17,10 +17,14 @@
 
 #include <turbojpeg.h>
 
+#include <fcntl.h>
+
+#include <algorithm>
 #include <cerrno>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -28,12 +32,14 @@
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/var_shared_array.h"
 #include "turbojpeg_sapi.sapi.h"  // NOLINT(build/include)
 
 namespace {
 
 using ::sapi::IsOk;
 using ::testing::Eq;
+using ::testing::ElementsAreArray;
 using ::testing::Gt;
 using ::testing::Not;
 using ::testing::NotNull;
@@ -170,4 +176,98 @@ TEST_F(TurboJpegSapiSandboxTest, Decompressor) {
   ASSERT_THAT(decompress_result, IsOk());
   ASSERT_THAT(decompress_result.value(), Eq(0));
 }
+TEST_F(TurboJpegSapiSandboxTest, SharedBuffers) {
+  absl::StatusOr<void*> handle_raw = api_->tjInitDecompress();
+  ASSERT_THAT(handle_raw, IsOk());
+  ASSERT_THAT(handle_raw.value(), NotNull());
+  sapi::v::RemotePtr handle{handle_raw.value()};
+
+  // The sandboxee reads the JPEG image from the file itself.
+  sapi::v::Fd fd(open(GetTestFilePath("sample.jpeg").c_str(), O_RDONLY));
+  ASSERT_THAT(fd.GetValue(), Gt(0));
+  ASSERT_THAT(sandbox_->TransferToSandboxee(&fd), IsOk());
+  sapi::v::ULong jpeg_size;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      unsigned char* jpeg_raw,
+      api_->tjLoadFd(fd.GetRemoteFd(), jpeg_size.PtrAfter()));
+  ASSERT_THAT(jpeg_raw, NotNull());
+  sapi::v::RemotePtr jpeg(jpeg_raw);
+
+  // Decompress into a buffer shared with the host, and compare with the
+  // result of the copying variant.
+  constexpr int kWidth = 67;
+  constexpr int kHeight = 12;
+  sapi::v::SharedArray<unsigned char> rgb(kWidth * kHeight * 3);
+  ASSERT_THAT(sandbox_->Allocate(&rgb, true), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      int result, api_->tjDecompress2(&handle, &jpeg, jpeg_size.GetValue(),
+                                      rgb.PtrNone(), kWidth, kWidth * 3,
+                                      kHeight, TJCS_RGB, 0));
+  ASSERT_THAT(result, Eq(0))
+      << "Error from sandboxee: " << GetTurboJpegErrorStr(&handle);
+  sapi::v::Array<unsigned char> expected_rgb(kWidth * kHeight * 3);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      result, api_->tjDecompress2(&handle, &jpeg, jpeg_size.GetValue(),
+                                  expected_rgb.PtrAfter(), kWidth, kWidth * 3,
+                                  kHeight, TJCS_RGB, 0));
+  ASSERT_THAT(result, Eq(0));
+  EXPECT_THAT(std::vector<unsigned char>(rgb.GetData(),
+                                         rgb.GetData() + rgb.GetNElem()),
+              ElementsAreArray(expected_rgb.GetData(),
+                               expected_rgb.GetNElem()));
+
+  // The grayscale image only has a Y plane, put it behind some padding.
+  constexpr unsigned long kPlaneOffset = 64;
+  sapi::v::SharedArray<unsigned char> yuv(kPlaneOffset + kWidth * kHeight);
+  ASSERT_THAT(sandbox_->Allocate(&yuv, true), IsOk());
+  unsigned long offsets[3] = {kPlaneOffset, 0, 0};
+  sapi::v::NullPtr null_ptr;
+  sapi::v::Array<unsigned long> offsets_array(offsets, 3);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      result, api_->tjDecompressToYUVPlanesAt(
+                  &handle, &jpeg, jpeg_size.GetValue(), yuv.PtrNone(),
+                  yuv.GetNElem(), offsets_array.PtrBefore(), kWidth,
+                  /*strides=*/&null_ptr, kHeight, 0));
+  ASSERT_THAT(result, Eq(0))
+      << "Error from sandboxee: " << GetTurboJpegErrorStr(&handle);
+  // Gray pixels have the same value in all channels.
+  for (int i = 0; i < kWidth * kHeight; ++i) {
+    ASSERT_THAT(yuv.GetData()[kPlaneOffset + i], Eq(rgb.GetData()[i * 3]));
+  }
+
+  // A plane that does not fit is rejected.
+  offsets[0] = kPlaneOffset + 1;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      result, api_->tjDecompressToYUVPlanesAt(
+                  &handle, &jpeg, jpeg_size.GetValue(), yuv.PtrNone(),
+                  yuv.GetNElem(), offsets_array.PtrBefore(), kWidth,
+                  /*strides=*/&null_ptr, kHeight, 0));
+  EXPECT_THAT(result, Eq(-1));
+
+  ASSERT_THAT(api_->tjFree(&jpeg), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api_->tjDestroy(&handle));
+  ASSERT_THAT(result, Eq(0));
+
+  // Compress the shared image into a shared buffer.
+  SAPI_ASSERT_OK_AND_ASSIGN(handle_raw, api_->tjInitCompress());
+  ASSERT_THAT(handle_raw.value(), NotNull());
+  sapi::v::RemotePtr compress_handle{handle_raw.value()};
+  SAPI_ASSERT_OK_AND_ASSIGN(unsigned long bound,
+                            api_->tjBufSize(kWidth, kHeight, TJSAMP_444));
+  sapi::v::SharedArray<unsigned char> out(bound);
+  ASSERT_THAT(sandbox_->Allocate(&out, true), IsOk());
+  sapi::v::ULong out_size(bound);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      result, api_->tjCompress2Into(&compress_handle, rgb.PtrNone(), kWidth,
+                                    kWidth * 3, kHeight, TJPF_RGB,
+                                    out.PtrNone(), out_size.PtrBoth(),
+                                    TJSAMP_444, 90, 0));
+  ASSERT_THAT(result, Eq(0))
+      << "Error from sandboxee: " << GetTurboJpegErrorStr(&compress_handle);
+  EXPECT_THAT(out_size.GetValue(), Gt(0));
+  EXPECT_THAT(out.GetData()[0], Eq(0xFF));  // SOI marker
+  EXPECT_THAT(out.GetData()[1], Eq(0xD8));
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api_->tjDestroy(&compress_handle));
+  ASSERT_THAT(result, Eq(0));
+}
 }  // namespace
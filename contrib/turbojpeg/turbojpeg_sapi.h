@@ -35,7 +35,10 @@ class TurboJpegSapiSandbox : public turbojpeg_sapi::TurboJPEGSandbox {
             __NR_lseek,
             __NR_getpid,
             __NR_clock_gettime,
+            __NR_recvmsg,
         })
+        // Shared image buffers, see wrapper/func.h.
+        .AllowSharedMemoryMappings()
         .AllowLlvmSanitizers()
         .BuildOrDie();
   }
@@ -0,0 +1,88 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "contrib/turbojpeg/wrapper/func.h"
+
+#include <sys/stat.h>
+#include <turbojpeg.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+unsigned char* tjLoadFd(int fd, unsigned long* size) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    return nullptr;
+  }
+  unsigned char* buf = tjAlloc(st.st_size);
+  if (buf == nullptr) {
+    return nullptr;
+  }
+  for (off_t done = 0; done < st.st_size;) {
+    ssize_t n = pread(fd, buf + done, st.st_size - done, done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      tjFree(buf);
+      return nullptr;
+    }
+    done += n;
+  }
+  *size = st.st_size;
+  return buf;
+}
+
+int tjCompress2Into(tjhandle handle, const unsigned char* src, int width,
+                    int pitch, int height, int pixel_format,
+                    unsigned char* dst, unsigned long* dst_size, int subsamp,
+                    int quality, int flags) {
+  if (dst == nullptr || dst_size == nullptr ||
+      *dst_size < tjBufSize(width, height, subsamp)) {
+    return -1;
+  }
+  return tjCompress2(handle, src, width, pitch, height, pixel_format, &dst,
+                     dst_size, subsamp, quality, flags | TJFLAG_NOREALLOC);
+}
+
+int tjDecompressToYUVPlanesAt(tjhandle handle, const unsigned char* jpeg_buf,
+                              unsigned long jpeg_size, unsigned char* dst,
+                              unsigned long dst_size,
+                              const unsigned long* plane_offsets, int width,
+                              int* strides, int height, int flags) {
+  int jpeg_width, jpeg_height, subsamp, colorspace;
+  if (tjDecompressHeader3(handle, jpeg_buf, jpeg_size, &jpeg_width,
+                          &jpeg_height, &subsamp, &colorspace) != 0) {
+    return -1;
+  }
+  // Scaling never makes the image larger than requested, so this bounds the
+  // planes of the scaled image.
+  int max_width = width != 0 ? width : jpeg_width;
+  int max_height = height != 0 ? height : jpeg_height;
+
+  unsigned char* planes[3] = {};
+  int num_planes = subsamp == TJSAMP_GRAY ? 1 : 3;
+  for (int i = 0; i < num_planes; ++i) {
+    unsigned long plane_size =
+        tjPlaneSizeYUV(i, max_width, strides != nullptr ? strides[i] : 0,
+                       max_height, subsamp);
+    if (plane_size == static_cast<unsigned long>(-1) ||
+        plane_offsets[i] > dst_size ||
+        plane_size > dst_size - plane_offsets[i]) {
+      return -1;
+    }
+    planes[i] = dst + plane_offsets[i];
+  }
+  return tjDecompressToYUVPlanes(handle, jpeg_buf, jpeg_size, planes, width,
+                                 strides, height, flags);
+}
@@ -0,0 +1,49 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef CONTRIB_TURBOJPEG_WRAPPER_FUNC_H_
+#define CONTRIB_TURBOJPEG_WRAPPER_FUNC_H_
+
+#include <turbojpeg.h>
+
+// Entry points for images in memory shared with the host, e.g.
+// sapi::v::SharedArray, or in files the sandboxee reads itself. They let the
+// host pass buffers by address instead of transferring them.
+
+extern "C" {
+
+// Reads the regular file `fd` into a buffer allocated with tjAlloc(), to be
+// released with tjFree(), and stores its size into `size`. Returns NULL on
+// error.
+unsigned char* tjLoadFd(int fd, unsigned long* size);
+
+// Like tjCompress2() with TJFLAG_NOREALLOC, into `dst` instead of a buffer
+// that turbojpeg allocates. `dst_size` is the size of `dst` on input, which
+// must be at least tjBufSize(), and the size of the JPEG image on output.
+int tjCompress2Into(tjhandle handle, const unsigned char* src, int width,
+                    int pitch, int height, int pixel_format,
+                    unsigned char* dst, unsigned long* dst_size, int subsamp,
+                    int quality, int flags);
+
+// Like tjDecompressToYUVPlanes(), with the planes at `plane_offsets` in
+// `dst`, which holds `dst_size` bytes. Grayscale images only have a Y
+// plane. Fails if a plane, as sized by tjPlaneSizeYUV(), does not fit.
+int tjDecompressToYUVPlanesAt(tjhandle handle, const unsigned char* jpeg_buf,
+                              unsigned long jpeg_size, unsigned char* dst,
+                              unsigned long dst_size,
+                              const unsigned long* plane_offsets, int width,
+                              int* strides, int height, int flags);
+
+}  // extern "C"
+
+#endif  // CONTRIB_TURBOJPEG_WRAPPER_FUNC_H_
@@ -13,7 +13,11 @@
 // limitations under the License.
 
 #include <fstream>
+#include <vector>
 
+#include "absl/strings/match.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
 #include "contrib/uriparser/sandboxed.h"
 #include "contrib/uriparser/utils/utils_uriparser.h"
 #include "sandboxed_api/util/path.h"
@@ -496,6 +500,33 @@ TEST_P(UriParserTestData, TestQueryElements) {
   }
 }
 
+TEST_F(UriParserBase, ParseBatch) {
+  std::vector<absl::string_view> uris;
+  for (const TestVariant& tv : TestData) {
+    uris.push_back(tv.test);
+  }
+  uris.push_back("http://[::1");  // Invalid, fails only its own entry.
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<UriComponents> components,
+                            ParseUriBatch(sandbox_.get(), uris));
+  ASSERT_EQ(components.size(), uris.size());
+  EXPECT_FALSE(components.back().status.ok());
+
+  for (size_t i = 0; i + 1 < uris.size(); ++i) {
+    const TestVariant& tv = TestData[i];
+    const UriComponents& c = components[i];
+    ASSERT_THAT(c.status, IsOk()) << tv.test;
+    EXPECT_EQ(c.scheme, tv.scheme);
+    EXPECT_EQ(c.user_info, tv.userinfo);
+    EXPECT_EQ(c.host_text, tv.hosttext);
+    EXPECT_EQ(c.port_text, tv.porttext);
+    EXPECT_EQ(c.query, tv.query);
+    EXPECT_EQ(c.fragment, tv.fragment);
+    EXPECT_TRUE(absl::StartsWith(c.path, absl::StrJoin(tv.path_elements, "/")))
+        << c.path;
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(UriParserBase, UriParserTestData,
                          testing::ValuesIn(TestData));
 
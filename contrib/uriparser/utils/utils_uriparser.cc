@@ -18,11 +18,18 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 
+#include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 UriParser::~UriParser() {
   if (GetStatus().ok()) {
@@ -284,3 +291,67 @@ UriParser::GetQueryElements() {
 
   return outquery;
 }
+
+namespace {
+
+// The ranges come from the sandboxee, so they are checked before use.
+absl::string_view ToView(absl::string_view uri, const UriBatchRangeA& range) {
+  if (range.offset < 0 || range.length < 0 || range.offset > uri.size() ||
+      range.length > uri.size() - range.offset) {
+    return absl::string_view();
+  }
+  return uri.substr(range.offset, range.length);
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<UriComponents>> ParseUriBatch(
+    UriparserSandbox* sandbox, absl::Span<const absl::string_view> uris) {
+  std::vector<UriComponents> components(uris.size());
+  if (uris.empty()) {
+    return components;
+  }
+
+  std::string text;
+  std::vector<uint32_t> offsets;
+  offsets.reserve(uris.size() + 1);
+  for (absl::string_view uri : uris) {
+    offsets.push_back(text.size());
+    text.append(uri.data(), uri.size());
+  }
+  if (text.size() > std::numeric_limits<int32_t>::max()) {
+    return absl::InvalidArgumentError("URI batch too large");
+  }
+  offsets.push_back(text.size());
+
+  sapi::v::Array<char> text_array(text.data(), text.size());
+  sapi::v::Array<uint32_t> offsets_array(offsets.data(), offsets.size());
+  std::vector<UriBatchEntryA> results(uris.size());
+  sapi::v::Array<UriBatchEntryA> results_array(results.data(), results.size());
+
+  UriparserApi api(sandbox);
+  SAPI_RETURN_IF_ERROR(
+      api.uriParseBatchA(text_array.PtrBefore(), offsets_array.PtrBefore(),
+                         uris.size(), results_array.PtrAfter())
+          .status());
+
+  for (size_t i = 0; i < uris.size(); ++i) {
+    const UriBatchEntryA& result = results[i];
+    UriComponents& out = components[i];
+    absl::string_view uri = uris[i];
+    if (result.error != 0) {
+      out.status = absl::InvalidArgumentError(
+          absl::StrCat("Unable to parse uri at ", result.errorPos));
+      continue;
+    }
+    out.scheme = ToView(uri, result.scheme);
+    out.user_info = ToView(uri, result.userInfo);
+    out.host_text = ToView(uri, result.hostText);
+    out.port_text = ToView(uri, result.portText);
+    out.path = ToView(uri, result.path);
+    out.query = ToView(uri, result.query);
+    out.fragment = ToView(uri, result.fragment);
+    out.absolute_path = result.absolutePath != 0;
+  }
+  return components;
+}
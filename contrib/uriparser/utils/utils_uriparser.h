@@ -15,10 +15,14 @@
 #ifndef CONTRIB_URIPARSER_UTILS_UTILS_ZIP_H_
 #define CONTRIB_URIPARSER_UTILS_UTILS_ZIP_H_
 
+#include <string>
 #include <vector>
 
 #include "absl/container/btree_map.h"
 #include "absl/log/die_if_null.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "contrib/uriparser/sandboxed.h"
 #include "sandboxed_api/util/status_macros.h"
 
@@ -66,4 +70,25 @@ class UriParser {
   absl::Status status_;
 };
 
+// Components of a URI parsed by ParseUriBatch(). The views point into the
+// caller's input and are empty for absent components.
+struct UriComponents {
+  absl::Status status;
+  absl::string_view scheme;
+  absl::string_view user_info;
+  absl::string_view host_text;
+  absl::string_view port_text;
+  // The path segments joined by '/', without the leading '/' of an
+  // absolute path.
+  absl::string_view path;
+  absl::string_view query;
+  absl::string_view fragment;
+  bool absolute_path = false;
+};
+
+// Parses all of `uris` in a single call, instead of the several round trips
+// of UriParser per URI. A URI that does not parse only fails its own entry.
+absl::StatusOr<std::vector<UriComponents>> ParseUriBatch(
+    UriparserSandbox* sandbox, absl::Span<const absl::string_view> uris);
+
 #endif  // CONTRIB_URIARSER_UTILS_UTILS_ZIP_H_
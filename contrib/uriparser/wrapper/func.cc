@@ -0,0 +1,105 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/uriparser/wrapper/func.h"
+
+#include <cstdint>
+
+#define URI_PASS_ANSI
+#define URI_ENABLE_ANSI
+#include "uriparser/Uri.h"  // NOLINT(build/include)
+
+namespace {
+
+constexpr UriBatchRangeA kAbsent = {-1, 0};
+
+// Empty ranges may point to a static string of uriparser instead of into the
+// URI, so ranges outside [first, after_last) are reported as empty.
+UriBatchRangeA ToBatchRange(const UriTextRangeA& range, const char* first,
+                            const char* after_last) {
+  if (range.first == nullptr) {
+    return kAbsent;
+  }
+  if (range.first < first || range.afterLast > after_last ||
+      range.afterLast < range.first) {
+    return {0, 0};
+  }
+  return {static_cast<int32_t>(range.first - first),
+          static_cast<int32_t>(range.afterLast - range.first)};
+}
+
+UriBatchRangeA PathRange(const UriUriA& uri, const char* first,
+                         const char* after_last) {
+  const char* path_first = nullptr;
+  const char* path_after_last = nullptr;
+  for (const UriPathSegmentA* segment = uri.pathHead; segment != nullptr;
+       segment = segment->next) {
+    const UriTextRangeA& text = segment->text;
+    if (text.first == nullptr || text.first < first ||
+        text.afterLast > after_last) {
+      continue;
+    }
+    if (path_first == nullptr) {
+      path_first = text.first;
+    }
+    path_after_last = text.afterLast;
+  }
+  if (path_first == nullptr) {
+    return uri.pathHead != nullptr ? UriBatchRangeA{0, 0} : kAbsent;
+  }
+  return {static_cast<int32_t>(path_first - first),
+          static_cast<int32_t>(path_after_last - path_first)};
+}
+
+bool ParseOne(const char* first, const char* after_last,
+              UriBatchEntryA* result) {
+  *result = {};
+  result->scheme = result->userInfo = result->hostText = result->portText =
+      result->path = result->query = result->fragment = kAbsent;
+
+  UriUriA uri;
+  UriParserStateA state;
+  state.uri = &uri;
+  result->error = uriParseUriExA(&state, first, after_last);
+  if (result->error != URI_SUCCESS) {
+    result->errorPos = state.errorPos != nullptr
+                           ? static_cast<int32_t>(state.errorPos - first)
+                           : -1;
+    // uriparser has already freed the members.
+    return false;
+  }
+
+  result->errorPos = -1;
+  result->scheme = ToBatchRange(uri.scheme, first, after_last);
+  result->userInfo = ToBatchRange(uri.userInfo, first, after_last);
+  result->hostText = ToBatchRange(uri.hostText, first, after_last);
+  result->portText = ToBatchRange(uri.portText, first, after_last);
+  result->path = PathRange(uri, first, after_last);
+  result->query = ToBatchRange(uri.query, first, after_last);
+  result->fragment = ToBatchRange(uri.fragment, first, after_last);
+  result->absolutePath = uri.absolutePath;
+  uriFreeUriMembersA(&uri);
+  return true;
+}
+
+}  // namespace
+
+uint32_t uriParseBatchA(const char* text, const uint32_t* offsets,
+                        uint32_t count, UriBatchEntryA* results) {
+  uint32_t parsed = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    parsed += ParseOne(text + offsets[i], text + offsets[i + 1], &results[i]);
+  }
+  return parsed;
+}
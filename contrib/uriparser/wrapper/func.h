@@ -0,0 +1,51 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_URIPARSER_WRAPPER_FUNC_H_
+#define CONTRIB_URIPARSER_WRAPPER_FUNC_H_
+
+#include <cstdint>
+
+extern "C" {
+
+// A component of a parsed URI in bytes relative to the start of the URI.
+typedef struct {
+  int32_t offset;  // -1 if the component is absent
+  int32_t length;
+} UriBatchRangeA;
+
+typedef struct {
+  int error;         // URI_SUCCESS or the error of uriParseUriExA()
+  int32_t errorPos;  // Offset of the syntax error, if any
+  UriBatchRangeA scheme;
+  UriBatchRangeA userInfo;
+  UriBatchRangeA hostText;
+  UriBatchRangeA portText;
+  // From the first to the last path segment, without the '/' that precedes
+  // an absolute path.
+  UriBatchRangeA path;
+  UriBatchRangeA query;
+  UriBatchRangeA fragment;
+  int absolutePath;
+} UriBatchEntryA;
+
+// Parses the `count` URIs packed into `text`, the i-th being the bytes from
+// offsets[i] to offsets[i + 1], and stores their components in results[i].
+// Returns the number of URIs that parsed.
+uint32_t uriParseBatchA(const char* text, const uint32_t* offsets,
+                        uint32_t count, UriBatchEntryA* results);
+
+}  // extern "C"
+
+#endif  // CONTRIB_URIPARSER_WRAPPER_FUNC_H_
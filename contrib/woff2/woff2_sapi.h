@@ -41,7 +41,10 @@ class Woff2SapiSandbox : public WOFF2Sandbox {
             __NR_getpid,
             __NR_clock_gettime,
             __NR_madvise,
+            __NR_recvmsg,
         })
+        // Shared buffers of the WOFF2_*Into() conversions.
+        .AllowSharedMemoryMappings()
         .BuildOrDie();
   }
 };
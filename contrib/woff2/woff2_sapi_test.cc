@@ -16,12 +16,14 @@
 
 #include <woff2/encode.h>
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <optional>
 
+#include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "contrib/woff2/woff2_wrapper.h"
@@ -29,13 +31,17 @@
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/var_shared_array.h"
 #include "woff2_sapi.sapi.h"  // NOLINT(build/include)
 
 namespace {
 
 using ::sapi::IsOk;
+using ::testing::ElementsAreArray;
 using ::testing::Eq;
+using ::testing::Gt;
 using ::testing::IsNull;
+using ::testing::Le;
 using ::testing::Not;
 using ::testing::StrEq;
 
@@ -56,6 +62,7 @@ class Woff2SapiSandboxTest : public testing::Test {
       const char* in_file, size_t expected_size = SIZE_MAX);
   static const char* test_data_dir_;
   static ::sapi_woff2::WOFF2Api* api_;
+  static ::sapi_woff2::Woff2SapiSandbox* sandbox() { return sandbox_; }
 
  private:
   static ::sapi_woff2::Woff2SapiSandbox* sandbox_;
@@ -126,4 +133,67 @@ TEST_F(Woff2SapiSandboxTest, Decompress) {
   ASSERT_THAT(api_->WOFF2_Free(&ptr), IsOk());
 }
 
+TEST_F(Woff2SapiSandboxTest, CompressIntoSharedBuffer) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint8_t> font,
+                            ReadFile("Roboto-Regular.ttf"));
+  sapi::v::SharedArray<uint8_t> input(font.size());
+  ASSERT_THAT(sandbox()->Allocate(&input, true), IsOk());
+  std::copy(font.begin(), font.end(), input.GetData());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      size_t max_size, api_->WOFF2_MaxWOFF2Size(input.PtrNone(), font.size()));
+  ASSERT_THAT(max_size, Gt(0));
+  sapi::v::SharedArray<uint8_t> output(max_size);
+  ASSERT_THAT(sandbox()->Allocate(&output, true), IsOk());
+  sapi::v::IntBase<size_t> out_length(max_size);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      bool converted,
+      api_->WOFF2_ConvertTTFToWOFF2Into(input.PtrNone(), font.size(),
+                                        output.PtrNone(),
+                                        out_length.PtrBoth()));
+  ASSERT_TRUE(converted);
+  EXPECT_THAT(out_length.GetValue(), Gt(0));
+  EXPECT_THAT(out_length.GetValue(), Le(max_size));
+}
+
+TEST_F(Woff2SapiSandboxTest, DecompressIntoSharedBuffer) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<uint8_t> font,
+                            ReadFile("Roboto-Regular.woff2"));
+  sapi::v::SharedArray<uint8_t> input(font.size());
+  ASSERT_THAT(sandbox()->Allocate(&input, true), IsOk());
+  std::copy(font.begin(), font.end(), input.GetData());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      size_t size, api_->WOFF2_ComputeTTFSize(input.PtrNone(), font.size()));
+  ASSERT_THAT(size, Gt(0));
+  sapi::v::SharedArray<uint8_t> output(size);
+  ASSERT_THAT(sandbox()->Allocate(&output, true), IsOk());
+  sapi::v::IntBase<size_t> out_length(size);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      bool converted,
+      api_->WOFF2_ConvertWOFF2ToTTFInto(input.PtrNone(), font.size(),
+                                        output.PtrNone(),
+                                        out_length.PtrBoth()));
+  ASSERT_TRUE(converted);
+  ASSERT_THAT(out_length.GetValue(), Le(size));
+
+  // Same as what the allocating variant returns.
+  sapi::v::GenericPtr p;
+  sapi::v::IntBase<size_t> expected_length;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      converted, api_->WOFF2_ConvertWOFF2ToTTF(
+                     input.PtrNone(), font.size(), p.PtrAfter(),
+                     expected_length.PtrAfter(), 1 << 25));
+  ASSERT_TRUE(converted);
+  ASSERT_THAT(expected_length.GetValue(), Le(size));
+  sapi::v::Array<uint8_t> expected(expected_length.GetValue());
+  expected.SetRemote(reinterpret_cast<void*>(p.GetValue()));
+  ASSERT_THAT(sandbox()->TransferFromSandboxee(&expected), IsOk());
+  EXPECT_THAT(absl::MakeConstSpan(output.GetData(), out_length.GetValue()),
+              ElementsAreArray(absl::MakeConstSpan(
+                  expected.GetData(), out_length.GetValue())));
+  auto ptr = sapi::v::RemotePtr{reinterpret_cast<void*>(p.GetValue())};
+  ASSERT_THAT(api_->WOFF2_Free(&ptr), IsOk());
+}
+
 }  // namespace
@@ -74,3 +74,45 @@ extern "C" bool WOFF2_ConvertTTFToWOFF2(const uint8_t* data, size_t length,
 extern "C" void WOFF2_Free(uint8_t* data) noexcept {
   std::unique_ptr<uint8_t[]> p{data};
 }
+
+extern "C" size_t WOFF2_ComputeTTFSize(const uint8_t* data, size_t length) {
+  if (!data || !length) {
+    return 0;
+  }
+  return ::woff2::ComputeWOFF2FinalSize(data, length);
+}
+
+extern "C" size_t WOFF2_MaxWOFF2Size(const uint8_t* data, size_t length) {
+  if (!data || !length) {
+    return 0;
+  }
+  return woff2::MaxWOFF2CompressedSize(data, length);
+}
+
+extern "C" bool WOFF2_ConvertWOFF2ToTTFInto(const uint8_t* data,
+                                            size_t length, uint8_t* result,
+                                            size_t* result_length) {
+  if (!data || !length || !result || !result_length) {
+    return false;
+  }
+  woff2::WOFF2MemoryOut output(result, *result_length);
+  *result_length = 0;
+  if (!::woff2::ConvertWOFF2ToTTF(data, length, &output)) {
+    return false;
+  }
+  *result_length = output.Size();
+  return true;
+}
+
+extern "C" bool WOFF2_ConvertTTFToWOFF2Into(const uint8_t* data,
+                                            size_t length, uint8_t* result,
+                                            size_t* result_length) {
+  if (!data || !length || !result || !result_length) {
+    return false;
+  }
+  if (!woff2::ConvertTTFToWOFF2(data, length, result, result_length)) {
+    *result_length = 0;
+    return false;
+  }
+  return true;
+}
@@ -27,6 +27,18 @@ bool WOFF2_ConvertWOFF2ToTTF(const uint8_t* data, size_t length,
 bool WOFF2_ConvertTTFToWOFF2(const uint8_t* data, size_t length,
                              uint8_t** result, size_t* result_length);
 void WOFF2_Free(uint8_t* data);
+
+// Variants of the above that write into a caller-provided buffer, e.g. one
+// shared with the host, instead of allocating the result. The result buffer
+// needs to hold WOFF2_ComputeTTFSize() (WOFF2_MaxWOFF2Size()) bytes.
+// `result_length` is the size of `result` on input and the size of the
+// converted font on output.
+size_t WOFF2_ComputeTTFSize(const uint8_t* data, size_t length);
+size_t WOFF2_MaxWOFF2Size(const uint8_t* data, size_t length);
+bool WOFF2_ConvertWOFF2ToTTFInto(const uint8_t* data, size_t length,
+                                 uint8_t* result, size_t* result_length);
+bool WOFF2_ConvertTTFToWOFF2Into(const uint8_t* data, size_t length,
+                                 uint8_t* result, size_t* result_length);
 }
 
 #endif  // CONTRIB_WOFF2_WOFF2_WRAPPER_H_
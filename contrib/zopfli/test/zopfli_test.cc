@@ -15,7 +15,10 @@
 #include <fcntl.h>
 
 #include <fstream>
+#include <string>
+#include <vector>
 
+#include "absl/strings/str_cat.h"
 #include "contrib/zopfli/sandboxed.h"
 #include "contrib/zopfli/utils/utils_zopfli.h"
 #include "sandboxed_api/util/path.h"
@@ -25,6 +28,7 @@
 namespace {
 
 using ::sapi::IsOk;
+using ::sapi::StatusIs;
 using ::testing::IsEmpty;
 using ::testing::Not;
 
@@ -162,4 +166,45 @@ INSTANTIATE_TEST_SUITE_P(SandboxTest, TestBinaryFD,
                          testing::Values(ZOPFLI_FORMAT_DEFLATE,
                                          ZOPFLI_FORMAT_GZIP,
                                          ZOPFLI_FORMAT_ZLIB));
+
+TEST(SandboxTest, CompressFiles) {
+  ZopfliSandboxPool pool({.size = 2});
+
+  std::vector<ZopfliFileJob> jobs;
+  for (const char* name : {"text", "binary", "text", "binary"}) {
+    std::string outfile_s = GetTemporaryFile(absl::StrCat(name, ".out"));
+    ASSERT_THAT(outfile_s, Not(IsEmpty()));
+    jobs.push_back({GetTestFilePath(name), outfile_s});
+  }
+  jobs.push_back({GetTestFilePath("does_not_exist"), GetTemporaryFile("out")});
+
+  std::vector<absl::Status> statuses =
+      CompressFiles(pool, jobs, ZOPFLI_FORMAT_GZIP, /*workers=*/3);
+  ASSERT_EQ(statuses.size(), jobs.size());
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_THAT(statuses[i], IsOk()) << jobs[i].input;
+    std::ifstream infile(jobs[i].input, std::ios::binary | std::ios::ate);
+    std::ifstream outfile(jobs[i].output, std::ios::binary | std::ios::ate);
+    EXPECT_GT(outfile.tellg(), 0);
+    EXPECT_LT(outfile.tellg(), infile.tellg());
+  }
+  EXPECT_THAT(statuses[4], StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(SandboxTest, CompressBuffers) {
+  ZopfliSandboxPool pool({.size = 2});
+
+  std::vector<std::string> inputs = {std::string(10000, 'a'), "",
+                                     std::string(5000, 'b')};
+  std::vector<absl::StatusOr<std::string>> outputs =
+      CompressBuffers(pool, inputs, ZOPFLI_FORMAT_DEFLATE, /*workers=*/2);
+  ASSERT_EQ(outputs.size(), inputs.size());
+  for (int i = 0; i < inputs.size(); ++i) {
+    ASSERT_THAT(outputs[i], IsOk());
+    EXPECT_THAT(*outputs[i], Not(IsEmpty()));
+  }
+  EXPECT_LT(outputs[0]->size(), inputs[0].size());
+  EXPECT_LT(outputs[2]->size(), inputs[2].size());
+}
+
 }  // namespace
@@ -14,9 +14,26 @@
 
 #include "contrib/zopfli/utils/utils_zopfli.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
 #include <fstream>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_macros.h"
 
 absl::Status Compress(ZopfliApi& api, std::ifstream& instream,
                       std::ofstream& outstream, ZopfliFormat format) {
@@ -76,3 +93,140 @@ absl::Status CompressFD(ZopfliApi& api, sapi::v::Fd& infd, sapi::v::Fd& outfd,
 
   return absl::OkStatus();
 }
+
+namespace {
+
+// Runs job(api, 0), ..., job(api, n - 1) on up to `workers` threads, each with
+// a sandbox leased from `pool` for as long as it stays alive.
+void RunJobs(ZopfliSandboxPool& pool, size_t n, int workers,
+             const std::function<absl::Status(ZopfliApi&, size_t)>& job,
+             std::vector<absl::Status>& statuses) {
+  statuses.assign(n, absl::OkStatus());
+  std::atomic<size_t> next_job(0);
+  auto worker = [&] {
+    std::optional<ZopfliSandboxPool::Lease> lease;
+    for (size_t i = next_job++; i < n; i = next_job++) {
+      if (lease && !(*lease)->is_active()) {
+        lease.reset();
+      }
+      if (!lease) {
+        absl::StatusOr<ZopfliSandboxPool::Lease> acquired = pool.Acquire();
+        if (!acquired.ok()) {
+          statuses[i] = acquired.status();
+          continue;
+        }
+        lease.emplace(*std::move(acquired));
+      }
+      ZopfliApi api(lease->get());
+      statuses[i] = job(api, i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  const size_t nthreads = std::min<size_t>(std::max(workers, 1), n);
+  threads.reserve(nthreads);
+  for (size_t i = 0; i < nthreads; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+absl::StatusOr<int> CreateMemfd(const std::string& contents) {
+  int fd = memfd_create("zopfli", MFD_CLOEXEC);
+  if (fd < 0) {
+    return absl::ErrnoToStatus(errno, "memfd_create() failed");
+  }
+  for (size_t written = 0; written < contents.size();) {
+    ssize_t ret =
+        write(fd, contents.data() + written, contents.size() - written);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      absl::Status status = absl::ErrnoToStatus(errno, "write() failed");
+      close(fd);
+      return status;
+    }
+    written += ret;
+  }
+  if (lseek(fd, 0, SEEK_SET) != 0) {
+    absl::Status status = absl::ErrnoToStatus(errno, "lseek() failed");
+    close(fd);
+    return status;
+  }
+  return fd;
+}
+
+absl::StatusOr<std::string> ReadAll(int fd) {
+  std::string contents;
+  char buf[64 << 10];
+  if (lseek(fd, 0, SEEK_SET) != 0) {
+    return absl::ErrnoToStatus(errno, "lseek() failed");
+  }
+  for (;;) {
+    ssize_t ret = read(fd, buf, sizeof(buf));
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return absl::ErrnoToStatus(errno, "read() failed");
+    }
+    if (ret == 0) {
+      return contents;
+    }
+    contents.append(buf, ret);
+  }
+}
+
+}  // namespace
+
+std::vector<absl::Status> CompressFiles(ZopfliSandboxPool& pool,
+                                        absl::Span<const ZopfliFileJob> jobs,
+                                        ZopfliFormat format, int workers) {
+  std::vector<absl::Status> statuses;
+  RunJobs(
+      pool, jobs.size(), workers,
+      [&jobs, format](ZopfliApi& api, size_t i) -> absl::Status {
+        sapi::v::Fd infd(open(jobs[i].input.c_str(), O_RDONLY | O_CLOEXEC));
+        if (infd.GetValue() < 0) {
+          return absl::ErrnoToStatus(errno, "Unable to open " + jobs[i].input);
+        }
+        sapi::v::Fd outfd(open(jobs[i].output.c_str(),
+                               O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                               0644));
+        if (outfd.GetValue() < 0) {
+          return absl::ErrnoToStatus(errno,
+                                     "Unable to open " + jobs[i].output);
+        }
+        return CompressFD(api, infd, outfd, format);
+      },
+      statuses);
+  return statuses;
+}
+
+std::vector<absl::StatusOr<std::string>> CompressBuffers(
+    ZopfliSandboxPool& pool, absl::Span<const std::string> inputs,
+    ZopfliFormat format, int workers) {
+  std::vector<absl::StatusOr<std::string>> outputs(inputs.size());
+  std::vector<absl::Status> statuses;
+  RunJobs(
+      pool, inputs.size(), workers,
+      [&inputs, &outputs, format](ZopfliApi& api, size_t i) -> absl::Status {
+        SAPI_ASSIGN_OR_RETURN(int in, CreateMemfd(inputs[i]));
+        sapi::v::Fd infd(in);
+        SAPI_ASSIGN_OR_RETURN(int out, CreateMemfd(""));
+        sapi::v::Fd outfd(out);
+        SAPI_RETURN_IF_ERROR(CompressFD(api, infd, outfd, format));
+        outputs[i] = ReadAll(outfd.GetValue());
+        return absl::OkStatus();
+      },
+      statuses);
+  for (size_t i = 0; i < statuses.size(); ++i) {
+    if (!statuses[i].ok()) {
+      outputs[i] = statuses[i];
+    }
+  }
+  return outputs;
+}
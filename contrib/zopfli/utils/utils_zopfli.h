@@ -16,9 +16,22 @@
 #define CONTRIB_ZOPFLI_UTILS_UTILS_ZOPFLI_H_
 
 #include <fstream>
+#include <string>
+#include <vector>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "contrib/zopfli/sandboxed.h"
+#include "sandboxed_api/sandbox_pool.h"
+
+using ZopfliSandboxPool = sapi::SandboxPool<ZopfliSapiSandbox>;
+
+struct ZopfliFileJob {
+  std::string input;
+  // Created or truncated.
+  std::string output;
+};
 
 absl::Status Compress(ZopfliApi& api, std::ifstream& instream,
                       std::ofstream& outstream, ZopfliFormat format);
@@ -26,4 +39,19 @@ absl::Status Compress(ZopfliApi& api, std::ifstream& instream,
 absl::Status CompressFD(ZopfliApi& api, sapi::v::Fd& infd, sapi::v::Fd& outfd,
                         ZopfliFormat format);
 
+// Compresses many files with up to `workers` sandboxes from `pool` at a time.
+// Each worker keeps its sandbox and takes the next job from a shared queue
+// as soon as it is done, so that large files don't hold up the others. Files
+// are passed to the sandboxees as file descriptors, see CompressFD(). Returns
+// the status of each job, in order.
+std::vector<absl::Status> CompressFiles(ZopfliSandboxPool& pool,
+                                        absl::Span<const ZopfliFileJob> jobs,
+                                        ZopfliFormat format, int workers);
+
+// Like CompressFiles(), but for buffers, which are passed to the sandboxees
+// through memfds.
+std::vector<absl::StatusOr<std::string>> CompressBuffers(
+    ZopfliSandboxPool& pool, absl::Span<const std::string> inputs,
+    ZopfliFormat format, int workers);
+
 #endif  // CONTRIB_ZOPFLI_UTILS_UTILS_ZOPFLI_H_
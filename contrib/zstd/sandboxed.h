@@ -33,6 +33,9 @@ class ZstdSapiSandbox : public ZstdSandbox {
         .AllowSystemMalloc()
         .AllowExit()
         .AllowSyscalls({__NR_recvmsg})
+        // Shared buffers of CompressStreamPipelined() and
+        // DecompressStreamPipelined().
+        .AllowSharedMemoryMappings()
         .BuildOrDie();
   }
 };
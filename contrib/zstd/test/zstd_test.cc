@@ -22,6 +22,7 @@
 #include "gtest/gtest.h"
 #include "contrib/zstd/sandboxed.h"
 #include "contrib/zstd/utils/utils_zstd.h"
+#include "contrib/zstd/utils/utils_zstd_parallel.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_matchers.h"
 #include "sandboxed_api/util/temp_file.h"
@@ -29,6 +30,7 @@
 namespace {
 
 using ::sapi::IsOk;
+using ::sapi::StatusIs;
 
 std::string GetTestFilePath(const std::string& filename) {
   return sapi::file::JoinPath(getenv("TEST_FILES_DIR"), filename);
@@ -280,6 +282,146 @@ TEST(SandboxTest, CheckCompressAndDecompressStream) {
   ASSERT_TRUE(CompareFiles(infile_s, outfile_s));
 }
 
+TEST(SandboxTest, CheckDecompressStreamPipelined) {
+  ZstdSapiSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
+  ZstdApi api = ZstdApi(&sandbox);
+
+  std::string infile_s = GetTestFilePath("text.stream.zstd");
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string path,
+                            sapi::CreateNamedTempFileAndClose("out"));
+  std::string outfile_s =
+      sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path);
+
+  std::ifstream infile(infile_s, std::ios::binary);
+  ASSERT_TRUE(infile.is_open());
+
+  std::ofstream outfile(outfile_s, std::ios::binary);
+  ASSERT_TRUE(outfile.is_open());
+
+  absl::Status status = DecompressStreamPipelined(api, infile, outfile);
+  ASSERT_THAT(status, IsOk()) << "Unable to decompress stream";
+  outfile.close();
+
+  ASSERT_TRUE(CompareFiles(GetTestFilePath("text"), outfile_s));
+}
+
+TEST(SandboxTest, CheckCompressAndDecompressStreamPipelined) {
+  ZstdSapiSandbox sandbox;
+  absl::Status status;
+  ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
+  ZstdApi api = ZstdApi(&sandbox);
+
+  std::string infile_s = GetTestFilePath("text");
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string path_middle,
+                            sapi::CreateNamedTempFileAndClose("middle.zstd"));
+  std::string middle_s =
+      sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path_middle);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string path,
+                            sapi::CreateNamedTempFileAndClose("out"));
+  std::string outfile_s =
+      sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path);
+
+  std::ifstream infile(infile_s, std::ios::binary);
+  ASSERT_TRUE(infile.is_open());
+
+  std::ofstream outmiddle(middle_s, std::ios::binary);
+  ASSERT_TRUE(outmiddle.is_open());
+
+  status = CompressStreamPipelined(api, infile, outmiddle, 0);
+  ASSERT_THAT(status, IsOk()) << "Unable to compress stream";
+
+  infile.clear();
+  ASSERT_LT(outmiddle.tellp(), infile.tellg());
+  outmiddle.close();
+
+  // The output is an ordinary zstd stream.
+  std::ifstream inmiddle(middle_s, std::ios::binary);
+  ASSERT_TRUE(inmiddle.is_open());
+
+  std::ofstream outfile(outfile_s, std::ios::binary);
+  ASSERT_TRUE(outfile.is_open());
+
+  status = DecompressStream(api, inmiddle, outfile);
+  ASSERT_THAT(status, IsOk()) << "Unable to decompress";
+  outfile.close();
+
+  ASSERT_TRUE(CompareFiles(infile_s, outfile_s));
+}
+
+TEST(SandboxTest, CheckCompressAndDecompressParallel) {
+  ZstdSandboxPool pool({.size = 2});
+  absl::Status status;
+
+  std::string infile_s = GetTestFilePath("text");
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string path_middle,
+                            sapi::CreateNamedTempFileAndClose("middle.zstd"));
+  std::string middle_s =
+      sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path_middle);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string path,
+                            sapi::CreateNamedTempFileAndClose("out"));
+  std::string outfile_s =
+      sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path);
+
+  std::ifstream infile(infile_s, std::ios::binary);
+  ASSERT_TRUE(infile.is_open());
+
+  std::ofstream outmiddle(middle_s, std::ios::binary);
+  ASSERT_TRUE(outmiddle.is_open());
+
+  // Small frames, so that the test file is split into several batches.
+  status = CompressParallel(pool, infile, outmiddle, 0, /*threads=*/3,
+                            /*frame_size=*/1024);
+  ASSERT_THAT(status, IsOk()) << "Unable to compress in parallel";
+  outmiddle.close();
+
+  std::ifstream inmiddle(middle_s, std::ios::binary);
+  ASSERT_TRUE(inmiddle.is_open());
+
+  std::ofstream outfile(outfile_s, std::ios::binary);
+  ASSERT_TRUE(outfile.is_open());
+
+  status = DecompressParallel(pool, inmiddle, outfile, /*threads=*/3);
+  ASSERT_THAT(status, IsOk()) << "Unable to decompress in parallel";
+  outfile.close();
+
+  ASSERT_TRUE(CompareFiles(infile_s, outfile_s));
+
+  // Ordinary decoders skip the seek table.
+  SAPI_ASSERT_OK_AND_ASSIGN(ZstdSandboxPool::Lease lease, pool.Acquire());
+  ZstdApi api(lease.get());
+  std::ifstream inmiddle2(middle_s, std::ios::binary);
+  ASSERT_TRUE(inmiddle2.is_open());
+  std::ofstream outfile2(outfile_s, std::ios::binary | std::ios::trunc);
+  ASSERT_TRUE(outfile2.is_open());
+  status = DecompressStream(api, inmiddle2, outfile2);
+  ASSERT_THAT(status, IsOk()) << "Unable to decompress stream";
+  outfile2.close();
+
+  ASSERT_TRUE(CompareFiles(infile_s, outfile_s));
+}
+
+TEST(SandboxTest, CheckDecompressParallelRejectsPlainArchive) {
+  ZstdSandboxPool pool({.size = 1});
+
+  std::ifstream infile(GetTestFilePath("text.stream.zstd"), std::ios::binary);
+  ASSERT_TRUE(infile.is_open());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string path,
+                            sapi::CreateNamedTempFileAndClose("out"));
+  std::ofstream outfile(
+      sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(), path),
+      std::ios::binary);
+  ASSERT_TRUE(outfile.is_open());
+
+  EXPECT_THAT(DecompressParallel(pool, infile, outfile, /*threads=*/2),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
 TEST(SandboxTest, CheckCompressInMemoryFD) {
   ZstdSapiSandbox sandbox;
   ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
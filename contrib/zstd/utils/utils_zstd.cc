@@ -12,11 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <string>
 
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "contrib/zstd/sandboxed.h"
+#include "sandboxed_api/var_shared_array.h"
 
 constexpr size_t kFileMaxSize = 1024 * 1024 * 1024;  // 1GB
 
@@ -333,3 +337,216 @@ absl::Status DecompressStreamFD(ZstdApi& api, sapi::v::Fd& infd,
 
   return absl::OkStatus();
 }
+
+namespace {
+
+// Pair of buffers in memory shared with the sandboxee, so that the host can
+// fill or drain one of them while a sandboxed call works on the other.
+class SharedBufferPair {
+ public:
+  explicit SharedBufferPair(size_t size)
+      : buffers_{sapi::v::SharedArray<uint8_t>(size),
+                 sapi::v::SharedArray<uint8_t>(size)} {}
+
+  absl::Status Allocate(sapi::Sandbox* sandbox) {
+    SAPI_RETURN_IF_ERROR(sandbox->Allocate(&buffers_[0], true));
+    return sandbox->Allocate(&buffers_[1], true);
+  }
+
+  sapi::v::SharedArray<uint8_t>& operator[](int i) { return buffers_[i]; }
+  size_t size() const { return buffers_[0].GetSize(); }
+
+ private:
+  sapi::v::SharedArray<uint8_t> buffers_[2];
+};
+
+// Reads the next chunk into `buf`, returns its size.
+absl::StatusOr<size_t> ReadChunk(std::ifstream& in_stream,
+                                 sapi::v::SharedArray<uint8_t>& buf) {
+  in_stream.read(reinterpret_cast<char*>(buf.GetData()), buf.GetSize());
+  if (in_stream.bad()) {
+    return absl::UnavailableError("Unable to read file");
+  }
+  return in_stream.gcount();
+}
+
+absl::Status WriteChunk(std::ofstream& out_stream,
+                        sapi::v::SharedArray<uint8_t>& buf, size_t size) {
+  out_stream.write(reinterpret_cast<char*>(buf.GetData()), size);
+  if (!out_stream.good()) {
+    return absl::UnavailableError("Unable to write file");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::Status CompressStreamPipelined(ZstdApi& api, std::ifstream& in_stream,
+                                     std::ofstream& out_stream, int level) {
+  int iserr;
+  sapi::Sandbox* sandbox = api.GetSandbox();
+
+  // Create necessary buffers.
+  SAPI_ASSIGN_OR_RETURN(size_t inbuf_size, api.ZSTD_CStreamInSize());
+  SAPI_ASSIGN_OR_RETURN(size_t outbuf_size, api.ZSTD_CStreamOutSize());
+  SharedBufferPair inbufs(inbuf_size);
+  SharedBufferPair outbufs(outbuf_size);
+  if (!inbufs.Allocate(sandbox).ok() || !outbufs.Allocate(sandbox).ok()) {
+    return absl::UnavailableError("Unable to allocate buffers");
+  }
+
+  // Create Zstd context.
+  SAPI_ASSIGN_OR_RETURN(ZSTD_CCtx * cctx, api.ZSTD_createCCtx());
+  sapi::v::RemotePtr rcctx(cctx);
+
+  SAPI_ASSIGN_OR_RETURN(iserr, api.ZSTD_CCtx_setParameter(
+                                   &rcctx, ZSTD_c_compressionLevel, level));
+  SAPI_ASSIGN_OR_RETURN(iserr, api.ZSTD_isError(iserr));
+  if (iserr) {
+    return absl::UnavailableError("Unable to set parameter");
+  }
+  SAPI_ASSIGN_OR_RETURN(
+      iserr, api.ZSTD_CCtx_setParameter(&rcctx, ZSTD_c_checksumFlag, 1));
+  SAPI_ASSIGN_OR_RETURN(iserr, api.ZSTD_isError(iserr));
+  if (iserr) {
+    return absl::UnavailableError("Unable to set parameter");
+  }
+
+  // Compress. While the sandboxee works on one input and one output buffer,
+  // the host reads the next chunk into the other input buffer and writes out
+  // what the previous call produced.
+  int in = 0;
+  int out = 0;
+  size_t pending = 0;  // Bytes in outbufs[out ^ 1] not written yet.
+  SAPI_ASSIGN_OR_RETURN(size_t insize, ReadChunk(in_stream, inbufs[in]));
+  for (;;) {
+    const bool last = insize < inbufs.size();
+    sapi::v::Struct<ZSTD_inBuffer_s> struct_in;
+    *struct_in.mutable_data() = {inbufs[in].GetRemote(), insize, 0};
+    sapi::v::IntBase<ZSTD_EndDirective> mode(last ? ZSTD_e_end
+                                                  : ZSTD_e_continue);
+
+    size_t next_insize = 0;
+    bool next_read = last;
+    bool isdone = false;
+    while (!isdone) {
+      sapi::v::Struct<ZSTD_outBuffer_s> struct_out;
+      *struct_out.mutable_data() = {outbufs[out].GetRemote(), outbufs.size(),
+                                    0};
+      sapi::v::ULong remaining;
+      SAPI_ASSIGN_OR_RETURN(
+          sapi::Sandbox::AsyncCall call,
+          sandbox->CallAsync("ZSTD_compressStream2", &remaining, &rcctx,
+                             struct_out.PtrBoth(), struct_in.PtrBoth(),
+                             &mode));
+      absl::Status io_status = absl::OkStatus();
+      if (!next_read) {
+        absl::StatusOr<size_t> size = ReadChunk(in_stream, inbufs[in ^ 1]);
+        io_status = size.status();
+        next_insize = size.value_or(0);
+        next_read = true;
+      }
+      if (io_status.ok() && pending > 0) {
+        io_status = WriteChunk(out_stream, outbufs[out ^ 1], pending);
+      }
+      SAPI_RETURN_IF_ERROR(call.Wait());
+      SAPI_RETURN_IF_ERROR(io_status);
+
+      SAPI_ASSIGN_OR_RETURN(iserr, api.ZSTD_isError(remaining.GetValue()));
+      if (iserr) {
+        return absl::UnavailableError("Unable to compress file");
+      }
+      pending = struct_out.data().pos;
+      out ^= 1;
+
+      if (last) {
+        isdone = (remaining.GetValue() == 0);
+      } else {
+        isdone = (struct_in.data().pos == insize);
+      }
+    }
+    if (last) {
+      break;
+    }
+    in ^= 1;
+    insize = next_insize;
+  }
+  SAPI_RETURN_IF_ERROR(WriteChunk(out_stream, outbufs[out ^ 1], pending));
+
+  api.ZSTD_freeCCtx(&rcctx).IgnoreError();
+
+  return absl::OkStatus();
+}
+
+absl::Status DecompressStreamPipelined(ZstdApi& api, std::ifstream& in_stream,
+                                       std::ofstream& out_stream) {
+  int iserr;
+  sapi::Sandbox* sandbox = api.GetSandbox();
+
+  // Create necessary buffers.
+  SAPI_ASSIGN_OR_RETURN(size_t inbuf_size, api.ZSTD_CStreamInSize());
+  SAPI_ASSIGN_OR_RETURN(size_t outbuf_size, api.ZSTD_CStreamOutSize());
+  SharedBufferPair inbufs(inbuf_size);
+  SharedBufferPair outbufs(outbuf_size);
+  if (!inbufs.Allocate(sandbox).ok() || !outbufs.Allocate(sandbox).ok()) {
+    return absl::UnavailableError("Unable to allocate buffers");
+  }
+
+  // Create Zstd context.
+  SAPI_ASSIGN_OR_RETURN(ZSTD_DCtx * dctx, api.ZSTD_createDCtx());
+  sapi::v::RemotePtr rdctx(dctx);
+
+  // Decompress, overlapping reads and writes with the sandboxed calls like
+  // CompressStreamPipelined() does.
+  int in = 0;
+  int out = 0;
+  size_t pending = 0;  // Bytes in outbufs[out ^ 1] not written yet.
+  SAPI_ASSIGN_OR_RETURN(size_t insize, ReadChunk(in_stream, inbufs[in]));
+  while (insize > 0) {
+    sapi::v::Struct<ZSTD_inBuffer_s> struct_in;
+    *struct_in.mutable_data() = {inbufs[in].GetRemote(), insize, 0};
+
+    size_t next_insize = 0;
+    bool next_read = false;
+    // A full output buffer may mean that zstd holds back more output, so keep
+    // calling until it doesn't fill it anymore.
+    bool flushed = false;
+    while (struct_in.data().pos < insize || !flushed) {
+      sapi::v::Struct<ZSTD_outBuffer_s> struct_out;
+      *struct_out.mutable_data() = {outbufs[out].GetRemote(), outbufs.size(),
+                                    0};
+      sapi::v::ULong ret;
+      SAPI_ASSIGN_OR_RETURN(
+          sapi::Sandbox::AsyncCall call,
+          sandbox->CallAsync("ZSTD_decompressStream", &ret, &rdctx,
+                             struct_out.PtrBoth(), struct_in.PtrBoth()));
+      absl::Status io_status = absl::OkStatus();
+      if (!next_read) {
+        absl::StatusOr<size_t> size = ReadChunk(in_stream, inbufs[in ^ 1]);
+        io_status = size.status();
+        next_insize = size.value_or(0);
+        next_read = true;
+      }
+      if (io_status.ok() && pending > 0) {
+        io_status = WriteChunk(out_stream, outbufs[out ^ 1], pending);
+      }
+      SAPI_RETURN_IF_ERROR(call.Wait());
+      SAPI_RETURN_IF_ERROR(io_status);
+
+      SAPI_ASSIGN_OR_RETURN(iserr, api.ZSTD_isError(ret.GetValue()));
+      if (iserr) {
+        return absl::UnavailableError("Unable to decompress file");
+      }
+      pending = struct_out.data().pos;
+      flushed = pending < outbufs.size();
+      out ^= 1;
+    }
+    in ^= 1;
+    insize = next_insize;
+  }
+  SAPI_RETURN_IF_ERROR(WriteChunk(out_stream, outbufs[out ^ 1], pending));
+
+  api.ZSTD_freeDCtx(&rdctx).IgnoreError();
+
+  return absl::OkStatus();
+}
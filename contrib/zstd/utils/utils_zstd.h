@@ -33,6 +33,16 @@ absl::Status CompressStream(ZstdApi& api, std::ifstream& in_stream,
                             std::ofstream& out_stream, int level);
 absl::Status DecompressStream(ZstdApi& api, std::ifstream& in_stream,
                               std::ofstream& out_stream);
+
+// Like CompressStream() and DecompressStream(), but with double buffers in
+// memory shared with the sandboxee: reading the next chunk and writing the
+// previous output overlap with the sandboxed (de)compression of the current
+// chunk. The sandbox policy must allow shared mappings, see ZstdSapiSandbox.
+absl::Status CompressStreamPipelined(ZstdApi& api, std::ifstream& in_stream,
+                                     std::ofstream& out_stream, int level);
+absl::Status DecompressStreamPipelined(ZstdApi& api, std::ifstream& in_stream,
+                                       std::ofstream& out_stream);
+
 absl::Status CompressStreamFD(ZstdApi& api, sapi::v::Fd& infd,
                               sapi::v::Fd& outfd, int level);
 absl::Status DecompressStreamFD(ZstdApi& api, sapi::v::Fd& infd,
@@ -0,0 +1,284 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "contrib/zstd/utils/utils_zstd_parallel.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "contrib/zstd/sandboxed.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace {
+
+// Constants of the seekable format, see
+// https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md
+constexpr uint32_t kSkippableFrameMagic = 0x184D2A5E;
+constexpr uint32_t kSeekableMagic = 0x8F92EAB1;
+constexpr size_t kSkippableFrameHeaderSize = 8;
+constexpr size_t kSeekTableFooterSize = 9;
+constexpr uint8_t kSeekTableChecksumFlag = 0x80;
+constexpr uint8_t kSeekTableReservedBits = 0x7C;
+
+struct SeekTableEntry {
+  uint32_t compressed_size;
+  uint32_t decompressed_size;
+};
+
+void AppendLE32(uint32_t value, std::string* out) {
+  for (int i = 0; i < 4; ++i) {
+    out->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+uint32_t ReadLE32(const uint8_t* data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) |
+         (static_cast<uint32_t>(data[3]) << 24);
+}
+
+absl::Status ReadExactly(std::ifstream& in_stream, std::vector<uint8_t>& buf) {
+  in_stream.read(reinterpret_cast<char*>(buf.data()), buf.size());
+  if (in_stream.gcount() != buf.size()) {
+    return absl::UnavailableError("Unable to read file");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Write(std::ofstream& out_stream, const void* data, size_t size) {
+  out_stream.write(reinterpret_cast<const char*>(data), size);
+  if (!out_stream.good()) {
+    return absl::UnavailableError("Unable to write file");
+  }
+  return absl::OkStatus();
+}
+
+// Runs fn(0), ..., fn(n - 1) concurrently and returns the first error.
+absl::Status RunParallel(size_t n,
+                         const std::function<absl::Status(size_t)>& fn) {
+  std::vector<absl::Status> statuses(n);
+  std::vector<std::thread> workers;
+  workers.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    workers.emplace_back([&fn, &statuses, i] { statuses[i] = fn(i); });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (absl::Status& status : statuses) {
+    SAPI_RETURN_IF_ERROR(status);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::vector<uint8_t>> CompressFrame(
+    ZstdSandboxPool& pool, std::vector<uint8_t>& input, int level) {
+  SAPI_ASSIGN_OR_RETURN(ZstdSandboxPool::Lease lease, pool.Acquire());
+  ZstdApi api(lease.get());
+
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  SAPI_ASSIGN_OR_RETURN(size_t bound, api.ZSTD_compressBound(input.size()));
+  std::vector<uint8_t> output(bound);
+  sapi::v::Array<uint8_t> outbuf(output.data(), output.size());
+
+  SAPI_ASSIGN_OR_RETURN(
+      size_t size, api.ZSTD_compress(outbuf.PtrAfter(), bound,
+                                     inbuf.PtrBefore(), inbuf.GetSize(), level));
+  SAPI_ASSIGN_OR_RETURN(int iserr, api.ZSTD_isError(size));
+  if (iserr || size > bound) {
+    return absl::UnavailableError("Unable to compress frame");
+  }
+  output.resize(size);
+  return output;
+}
+
+absl::StatusOr<std::vector<uint8_t>> DecompressFrame(
+    ZstdSandboxPool& pool, std::vector<uint8_t>& input, size_t size) {
+  std::vector<uint8_t> output(size);
+  if (size == 0) {
+    return output;
+  }
+  SAPI_ASSIGN_OR_RETURN(ZstdSandboxPool::Lease lease, pool.Acquire());
+  ZstdApi api(lease.get());
+
+  sapi::v::Array<uint8_t> inbuf(input.data(), input.size());
+  sapi::v::Array<uint8_t> outbuf(output.data(), output.size());
+
+  SAPI_ASSIGN_OR_RETURN(
+      size_t desize, api.ZSTD_decompress(outbuf.PtrAfter(), size,
+                                         inbuf.PtrBefore(), inbuf.GetSize()));
+  SAPI_ASSIGN_OR_RETURN(int iserr, api.ZSTD_isError(desize));
+  if (iserr) {
+    return absl::UnavailableError("Unable to decompress frame");
+  }
+  if (desize != size) {
+    return absl::DataLossError("Frame size does not match the seek table");
+  }
+  return output;
+}
+
+// Reads the seek table and leaves the stream at the first frame.
+absl::StatusOr<std::vector<SeekTableEntry>> ReadSeekTable(
+    std::ifstream& in_stream) {
+  in_stream.seekg(0, std::ios_base::end);
+  const size_t file_size = in_stream.tellg();
+  if (file_size < kSkippableFrameHeaderSize + kSeekTableFooterSize) {
+    return absl::InvalidArgumentError("Not a seekable archive");
+  }
+
+  std::vector<uint8_t> footer(kSeekTableFooterSize);
+  in_stream.seekg(file_size - footer.size());
+  SAPI_RETURN_IF_ERROR(ReadExactly(in_stream, footer));
+  const uint32_t num_frames = ReadLE32(&footer[0]);
+  const uint8_t descriptor = footer[4];
+  if (ReadLE32(&footer[5]) != kSeekableMagic ||
+      (descriptor & kSeekTableReservedBits) != 0) {
+    return absl::InvalidArgumentError("Not a seekable archive");
+  }
+
+  const size_t entry_size = descriptor & kSeekTableChecksumFlag ? 12 : 8;
+  const uint64_t table_size =
+      uint64_t{num_frames} * entry_size + kSeekTableFooterSize;
+  if (table_size + kSkippableFrameHeaderSize > file_size) {
+    return absl::InvalidArgumentError("Seek table exceeds the archive");
+  }
+  std::vector<uint8_t> table(kSkippableFrameHeaderSize + table_size);
+  in_stream.seekg(file_size - table.size());
+  SAPI_RETURN_IF_ERROR(ReadExactly(in_stream, table));
+  if (ReadLE32(&table[0]) != kSkippableFrameMagic ||
+      ReadLE32(&table[4]) != table_size) {
+    return absl::InvalidArgumentError("Corrupt seek table");
+  }
+
+  std::vector<SeekTableEntry> entries;
+  entries.reserve(num_frames);
+  uint64_t compressed_total = 0;
+  for (uint32_t i = 0; i < num_frames; ++i) {
+    const uint8_t* entry = &table[kSkippableFrameHeaderSize + i * entry_size];
+    entries.push_back({ReadLE32(entry), ReadLE32(entry + 4)});
+    compressed_total += entries.back().compressed_size;
+  }
+  const size_t data_size = file_size - table.size();
+  if (compressed_total != data_size) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Seek table covers ", compressed_total,
+                     " bytes, but the archive holds ", data_size));
+  }
+  in_stream.seekg(0);
+  return entries;
+}
+
+}  // namespace
+
+absl::Status CompressParallel(ZstdSandboxPool& pool, std::ifstream& in_stream,
+                              std::ofstream& out_stream, int level,
+                              int threads, size_t frame_size) {
+  if (threads < 1) {
+    return absl::InvalidArgumentError("threads must be positive");
+  }
+  if (frame_size == 0 || frame_size > std::numeric_limits<uint32_t>::max()) {
+    return absl::InvalidArgumentError("Invalid frame size");
+  }
+
+  // Frames are compressed in batches of `threads`, which bounds memory use.
+  std::vector<std::vector<uint8_t>> inputs(threads);
+  std::vector<std::vector<uint8_t>> outputs(threads);
+  std::vector<SeekTableEntry> entries;
+  while (in_stream) {
+    size_t n = 0;
+    while (n < inputs.size() && in_stream) {
+      inputs[n].resize(frame_size);
+      in_stream.read(reinterpret_cast<char*>(inputs[n].data()), frame_size);
+      if (in_stream.bad()) {
+        return absl::UnavailableError("Unable to read file");
+      }
+      inputs[n].resize(in_stream.gcount());
+      if (!inputs[n].empty()) {
+        ++n;
+      }
+    }
+
+    SAPI_RETURN_IF_ERROR(RunParallel(n, [&](size_t i) -> absl::Status {
+      SAPI_ASSIGN_OR_RETURN(outputs[i], CompressFrame(pool, inputs[i], level));
+      return absl::OkStatus();
+    }));
+
+    for (size_t i = 0; i < n; ++i) {
+      if (outputs[i].size() > std::numeric_limits<uint32_t>::max()) {
+        return absl::OutOfRangeError("Compressed frame too large");
+      }
+      SAPI_RETURN_IF_ERROR(
+          Write(out_stream, outputs[i].data(), outputs[i].size()));
+      entries.push_back({static_cast<uint32_t>(outputs[i].size()),
+                         static_cast<uint32_t>(inputs[i].size())});
+    }
+  }
+
+  // The seek table, without checksums.
+  std::string table;
+  AppendLE32(kSkippableFrameMagic, &table);
+  AppendLE32(entries.size() * 8 + kSeekTableFooterSize, &table);
+  for (const SeekTableEntry& entry : entries) {
+    AppendLE32(entry.compressed_size, &table);
+    AppendLE32(entry.decompressed_size, &table);
+  }
+  AppendLE32(entries.size(), &table);
+  table.push_back(0);  // Descriptor
+  AppendLE32(kSeekableMagic, &table);
+  return Write(out_stream, table.data(), table.size());
+}
+
+absl::Status DecompressParallel(ZstdSandboxPool& pool,
+                                std::ifstream& in_stream,
+                                std::ofstream& out_stream, int threads) {
+  if (threads < 1) {
+    return absl::InvalidArgumentError("threads must be positive");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(std::vector<SeekTableEntry> entries,
+                        ReadSeekTable(in_stream));
+
+  std::vector<std::vector<uint8_t>> inputs(threads);
+  std::vector<std::vector<uint8_t>> outputs(threads);
+  for (size_t first = 0; first < entries.size(); first += threads) {
+    const size_t n = std::min<size_t>(threads, entries.size() - first);
+    for (size_t i = 0; i < n; ++i) {
+      inputs[i].resize(entries[first + i].compressed_size);
+      SAPI_RETURN_IF_ERROR(ReadExactly(in_stream, inputs[i]));
+    }
+
+    SAPI_RETURN_IF_ERROR(RunParallel(n, [&](size_t i) -> absl::Status {
+      SAPI_ASSIGN_OR_RETURN(
+          outputs[i],
+          DecompressFrame(pool, inputs[i],
+                          entries[first + i].decompressed_size));
+      return absl::OkStatus();
+    }));
+
+    for (size_t i = 0; i < n; ++i) {
+      SAPI_RETURN_IF_ERROR(
+          Write(out_stream, outputs[i].data(), outputs[i].size()));
+    }
+  }
+  return absl::OkStatus();
+}
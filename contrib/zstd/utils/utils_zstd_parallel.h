@@ -0,0 +1,45 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CONTRIB_ZSTD_UTILS_UTILS_ZSTD_PARALLEL_H_
+#define CONTRIB_ZSTD_UTILS_UTILS_ZSTD_PARALLEL_H_
+
+#include <cstddef>
+#include <fstream>
+
+#include "absl/status/status.h"
+#include "contrib/zstd/sandboxed.h"
+#include "sandboxed_api/sandbox_pool.h"
+
+using ZstdSandboxPool = sapi::SandboxPool<ZstdSapiSandbox>;
+
+inline constexpr size_t kDefaultParallelFrameSize = 4 << 20;  // 4 MiB
+
+// Splits the input into independent frames of `frame_size` bytes, compresses
+// up to `threads` of them at a time, each in its own sandbox from `pool`, and
+// writes them in order. The output is in zstd's seekable format, i.e. the
+// frames are followed by a seek table in a skippable frame, so any zstd
+// decoder can read it.
+absl::Status CompressParallel(ZstdSandboxPool& pool, std::ifstream& in_stream,
+                              std::ofstream& out_stream, int level,
+                              int threads,
+                              size_t frame_size = kDefaultParallelFrameSize);
+
+// Decompresses a seekable archive, e.g. as written by CompressParallel(),
+// decompressing up to `threads` frames at a time in sandboxes from `pool`.
+absl::Status DecompressParallel(ZstdSandboxPool& pool,
+                                std::ifstream& in_stream,
+                                std::ofstream& out_stream, int threads);
+
+#endif  // CONTRIB_ZSTD_UTILS_UTILS_ZSTD_PARALLEL_H_
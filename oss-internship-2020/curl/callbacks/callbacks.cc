@@ -14,6 +14,10 @@
 
 #include "callbacks.h"  // NOLINT(build/include)
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 
@@ -35,3 +39,18 @@ size_t WriteToMemory(char* contents, size_t size, size_t num_bytes,
 
   return real_size;
 }
+
+size_t WriteToFd(char* contents, size_t size, size_t num_bytes, void* userp) {
+  size_t real_size = size * num_bytes;
+  int fd = static_cast<int>(reinterpret_cast<intptr_t>(userp));
+
+  size_t written = 0;
+  while (written < real_size) {
+    ssize_t ret = write(fd, contents + written, real_size - written);
+    if (ret < 0 && errno == EINTR) continue;
+    // Returning less than real_size makes curl abort the transfer
+    if (ret <= 0) return written;
+    written += ret;
+  }
+  return written;
+}
@@ -21,4 +21,9 @@
 extern "C" size_t WriteToMemory(char* contents, size_t size, size_t num_bytes,
                                 void* userp);
 
+// Write contents to the file descriptor stored in userp, e.g. the remote fd of
+// a sapi::OutputChannel, so that the host receives it while the transfer runs
+extern "C" size_t WriteToFd(char* contents, size_t size, size_t num_bytes,
+                            void* userp);
+
 #endif  // CALLBACKS_H_
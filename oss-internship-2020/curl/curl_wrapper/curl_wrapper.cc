@@ -14,6 +14,55 @@
 
 #include "curl_wrapper.h"  // NOLINT(build/include)
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <vector>
+
+struct curl_fetcher {
+  CURLM* multi;
+  std::vector<CURL*> idle;
+};
+
+namespace {
+
+struct FetcherTransfer {
+  int fd;
+  uint32_t index;
+};
+
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+size_t WriteFrame(char* data, size_t size, size_t num_bytes, void* userp) {
+  auto* transfer = static_cast<FetcherTransfer*>(userp);
+  size_t real_size = size * num_bytes;
+  // libcurl passes at most CURL_MAX_WRITE_SIZE bytes at once.
+  const uint32_t header[] = {transfer->index,
+                             static_cast<uint32_t>(real_size)};
+  if (!WriteAll(transfer->fd, reinterpret_cast<const char*>(header),
+                sizeof(header)) ||
+      !WriteAll(transfer->fd, data, real_size)) {
+    return 0;  // Fails the transfer
+  }
+  return real_size;
+}
+
+}  // namespace
+
 CURLcode curl_easy_setopt_ptr(CURL* handle, CURLoption option,
                               void* parameter) {
   return curl_easy_setopt(handle, option, parameter);
@@ -84,3 +133,88 @@ CURLSHcode curl_share_setopt_long(CURLSH* handle, CURLSHoption option,
                                   long parameter) {
   return curl_share_setopt(handle, option, parameter);
 }
+
+struct curl_fetcher* curl_fetcher_init(long max_total_connections,
+                                       long max_host_connections) {
+  CURLM* multi = curl_multi_init();
+  if (multi == nullptr) {
+    return nullptr;
+  }
+  curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+                    max_total_connections);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    max_host_connections);
+  return new curl_fetcher{multi, {}};
+}
+
+void curl_fetcher_cleanup(struct curl_fetcher* fetcher) {
+  for (CURL* easy : fetcher->idle) {
+    curl_easy_cleanup(easy);
+  }
+  curl_multi_cleanup(fetcher->multi);
+  delete fetcher;
+}
+
+CURLMcode curl_fetcher_perform(struct curl_fetcher* fetcher, const char* urls,
+                               const uint32_t* url_offsets, uint32_t count,
+                               long timeout_ms, int fd, int* results,
+                               long* response_codes) {
+  std::vector<FetcherTransfer> transfers(count);
+  std::vector<CURL*> handles;
+  handles.reserve(count);
+  CURLMcode code = CURLM_OK;
+  for (uint32_t i = 0; i < count; ++i) {
+    results[i] = CURLE_FAILED_INIT;
+    response_codes[i] = 0;
+    transfers[i] = {fd, i};
+
+    CURL* easy;
+    if (!fetcher->idle.empty()) {
+      easy = fetcher->idle.back();
+      fetcher->idle.pop_back();
+      curl_easy_reset(easy);
+    } else if ((easy = curl_easy_init()) == nullptr) {
+      continue;
+    }
+    curl_easy_setopt(easy, CURLOPT_URL, urls + url_offsets[i]);
+    curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteFrame);
+    curl_easy_setopt(easy, CURLOPT_WRITEDATA, &transfers[i]);
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, &transfers[i]);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, timeout_ms);
+    if ((code = curl_multi_add_handle(fetcher->multi, easy)) != CURLM_OK) {
+      fetcher->idle.push_back(easy);
+      break;
+    }
+    handles.push_back(easy);
+  }
+
+  int running = handles.size();
+  while (code == CURLM_OK && running > 0) {
+    code = curl_multi_perform(fetcher->multi, &running);
+    if (code == CURLM_OK && running > 0) {
+      code = curl_multi_poll(fetcher->multi, nullptr, 0, 1000, nullptr);
+    }
+  }
+
+  int queued;
+  while (CURLMsg* msg = curl_multi_info_read(fetcher->multi, &queued)) {
+    if (msg->msg != CURLMSG_DONE) {
+      continue;
+    }
+    char* transfer;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+    uint32_t index = reinterpret_cast<FetcherTransfer*>(transfer)->index;
+    results[index] = msg->data.result;
+    curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE,
+                      &response_codes[index]);
+  }
+
+  // Keep the handles, and with the multi handle their connections, for the next
+  // batch.
+  for (CURL* easy : handles) {
+    curl_multi_remove_handle(fetcher->multi, easy);
+    fetcher->idle.push_back(easy);
+  }
+  close(fd);
+  return code;
+}
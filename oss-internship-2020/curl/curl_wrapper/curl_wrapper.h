@@ -18,6 +18,7 @@
 #define CURL_WRAPPER_H_
 
 #include <curl/curl.h>
+#include <stdint.h>
 
 extern "C" {
 
@@ -78,6 +79,30 @@ CURLSHcode curl_share_setopt_ptr(CURLSH* handle, CURLSHoption option,
 CURLSHcode curl_share_setopt_long(CURLSH* handle, CURLSHoption option,
                                   long parameter);
 
+// State of the curl_fetcher_*() methods: a multi handle, whose connection
+// cache keeps connections alive across batches, and idle easy handles for
+// reuse.
+struct curl_fetcher;
+
+// Creates a fetcher using at most max_total_connections connections in total
+// and max_host_connections per host, 0 meaning no limit.
+struct curl_fetcher* curl_fetcher_init(long max_total_connections,
+                                       long max_host_connections);
+
+void curl_fetcher_cleanup(struct curl_fetcher* fetcher);
+
+// Fetches the count NUL-terminated URLs starting at urls + url_offsets[i]
+// concurrently, in a single call instead of several calls per transfer, and
+// reusing the connections of earlier batches. Each received piece of a
+// response body is written to fd as a frame of two native uint32_t, the URL
+// index and the size, followed by the data. Closes fd in any case. Stores the
+// CURLcode and the response code of every transfer in results and
+// response_codes.
+CURLMcode curl_fetcher_perform(struct curl_fetcher* fetcher, const char* urls,
+                               const uint32_t* url_offsets, uint32_t count,
+                               long timeout_ms, int fd, int* results,
+                               long* response_codes);
+
 }  // extern "C"
 
 #endif  // CURL_WRAPPER_H_
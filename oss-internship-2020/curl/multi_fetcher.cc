@@ -0,0 +1,184 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "multi_fetcher.h"  // NOLINT(build/include)
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace curl {
+namespace {
+
+// Larger than CURL_MAX_WRITE_SIZE, the most libcurl writes at once.
+constexpr uint32_t kMaxChunkSize = 1 << 20;
+
+// Reads exactly `size` bytes. Returns false on EOF before the first byte.
+absl::StatusOr<bool> ReadFully(int fd, char* data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, data + done, size - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return absl::UnavailableError(
+          absl::StrCat("Reading the bodies failed: ", strerror(errno)));
+    }
+    if (n == 0) {
+      if (done == 0) {
+        return false;
+      }
+      return absl::DataLossError("Truncated body frame");
+    }
+    done += n;
+  }
+  return true;
+}
+
+absl::Status ReadFrames(int fd, std::vector<FetchResult>& results) {
+  for (;;) {
+    uint32_t header[2];
+    SAPI_ASSIGN_OR_RETURN(
+        bool more,
+        ReadFully(fd, reinterpret_cast<char*>(header), sizeof(header)));
+    if (!more) {
+      return absl::OkStatus();
+    }
+    const uint32_t index = header[0];
+    const uint32_t size = header[1];
+    if (index >= results.size() || size > kMaxChunkSize) {
+      return absl::DataLossError("Invalid body frame");
+    }
+    std::string& body = results[index].body;
+    const size_t offset = body.size();
+    body.resize(offset + size);
+    SAPI_ASSIGN_OR_RETURN(more, ReadFully(fd, body.data() + offset, size));
+    if (!more && size > 0) {
+      return absl::DataLossError("Truncated body frame");
+    }
+  }
+}
+
+// Reads until EOF, so that the sandboxee does not block on a full socket.
+void Drain(int fd) {
+  char buffer[4096];
+  for (;;) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n == 0 || (n < 0 && errno != EINTR)) {
+      return;
+    }
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<MultiFetcher>> MultiFetcher::Create(
+    CurlApi* api, const MultiFetcherOptions& options) {
+  SAPI_ASSIGN_OR_RETURN(curl_fetcher * fetcher,
+                        api->curl_fetcher_init(options.max_total_connections,
+                                               options.max_host_connections));
+  if (fetcher == nullptr) {
+    return absl::UnavailableError("curl_fetcher_init failed");
+  }
+  return absl::WrapUnique(new MultiFetcher(api, fetcher, options.timeout_ms));
+}
+
+MultiFetcher::~MultiFetcher() {
+  sapi::v::RemotePtr fetcher(fetcher_);
+  api_->curl_fetcher_cleanup(&fetcher).IgnoreError();
+}
+
+absl::StatusOr<std::vector<FetchResult>> MultiFetcher::Fetch(
+    absl::Span<const std::string> urls) {
+  if (urls.empty()) {
+    return std::vector<FetchResult>();
+  }
+  std::string packed_urls;
+  std::vector<uint32_t> url_offsets;
+  url_offsets.reserve(urls.size());
+  for (const std::string& url : urls) {
+    url_offsets.push_back(packed_urls.size());
+    packed_urls.append(url.c_str(), url.size() + 1);
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    return absl::InternalError(
+        absl::StrCat("socketpair failed: ", strerror(errno)));
+  }
+  const int read_fd = fds[0];
+  absl::Cleanup close_read_fd = [read_fd] { close(read_fd); };
+
+  sapi::v::Fd write_fd(fds[1]);
+  SAPI_RETURN_IF_ERROR(api_->sandbox()->TransferToSandboxee(&write_fd));
+  // Only the sandboxee may hold the write end, so that closing it ends the
+  // bodies. curl_fetcher_perform closes it.
+  write_fd.CloseLocalFd();
+  write_fd.OwnRemoteFd(false);
+
+  std::vector<FetchResult> results(urls.size());
+  absl::Status read_status;
+  std::thread reader([&] {
+    read_status = ReadFrames(read_fd, results);
+    if (!read_status.ok()) {
+      Drain(read_fd);
+    }
+  });
+
+  sapi::v::RemotePtr fetcher(fetcher_);
+  sapi::v::Array<const char> urls_var(packed_urls.data(), packed_urls.size());
+  sapi::v::Array<const uint32_t> url_offsets_var(url_offsets.data(),
+                                                 url_offsets.size());
+  sapi::v::Array<int> curl_codes(urls.size());
+  sapi::v::Array<long> response_codes(urls.size());
+  absl::StatusOr<CURLMcode> multi_code = api_->curl_fetcher_perform(
+      &fetcher, urls_var.PtrBefore(), url_offsets_var.PtrBefore(), urls.size(),
+      timeout_ms_, write_fd.GetRemoteFd(), curl_codes.PtrAfter(),
+      response_codes.PtrAfter());
+  if (!multi_code.ok()) {
+    // The sandboxee may not have closed its end, unblock the reader.
+    shutdown(read_fd, SHUT_RDWR);
+  }
+  reader.join();
+  SAPI_RETURN_IF_ERROR(multi_code.status());
+  if (*multi_code != CURLM_OK) {
+    return absl::UnavailableError(absl::StrCat(
+        "curl_fetcher_perform returned with the error code ", *multi_code));
+  }
+  SAPI_RETURN_IF_ERROR(read_status);
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    results[i].curl_code = curl_codes[i];
+    results[i].response_code = response_codes[i];
+  }
+  return results;
+}
+
+}  // namespace curl
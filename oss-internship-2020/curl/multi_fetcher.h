@@ -0,0 +1,71 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef MULTI_FETCHER_H_
+#define MULTI_FETCHER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "curl_sapi.sapi.h"  // NOLINT(build/include)
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+namespace curl {
+
+struct MultiFetcherOptions {
+  // Connection limits of the multi handle, 0 meaning no limit. Transfers beyond
+  // them wait for a free connection.
+  long max_total_connections = 8;
+  long max_host_connections = 0;
+  // Timeout of every transfer, 0 meaning none.
+  long timeout_ms = 0;
+};
+
+struct FetchResult {
+  // Result of the transfer, the body is incomplete unless it's CURLE_OK.
+  int curl_code = 0;
+  long response_code = 0;
+  std::string body;
+};
+
+// Fetches batches of URLs with the multi interface in the sandboxee. All
+// transfers of a batch run concurrently within a single call, and the multi
+// handle, with its cache of keep-alive connections, as well as the easy handles
+// are reused by later batches. Response bodies are streamed to the host over a
+// socket as they arrive. The sandbox policy must allow recvmsg to receive the
+// socket, which CurlSapiSandbox does. Not thread-safe.
+class MultiFetcher {
+ public:
+  static absl::StatusOr<std::unique_ptr<MultiFetcher>> Create(
+      CurlApi* api, const MultiFetcherOptions& options = {});
+
+  ~MultiFetcher();
+
+  // Returns the results in the order of `urls`.
+  absl::StatusOr<std::vector<FetchResult>> Fetch(
+      absl::Span<const std::string> urls);
+
+ private:
+  MultiFetcher(CurlApi* api, curl_fetcher* fetcher, long timeout_ms)
+      : api_(api), fetcher_(fetcher), timeout_ms_(timeout_ms) {}
+
+  CurlApi* api_;
+  curl_fetcher* fetcher_;
+  long timeout_ms_;
+};
+
+}  // namespace curl
+
+#endif  // MULTI_FETCHER_H_
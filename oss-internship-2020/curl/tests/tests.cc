@@ -12,7 +12,17 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "test_utils.h"  // NOLINT(build/include)
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../multi_fetcher.h"  // NOLINT(build/include)
+#include "test_utils.h"        // NOLINT(build/include)
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/output_channel.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 namespace curl::tests {
@@ -148,5 +158,70 @@ TEST_F(CurlTest, PostResponse) {
   ASSERT_EQ(std::string(post_fields.GetData()), response);
 }
 
+TEST_F(CurlTest, StreamedResponse) {
+  std::string response;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<sapi::OutputChannel> channel,
+      sapi::OutputChannel::Create(
+          sandbox_.get(), [&](absl::Span<const uint8_t> data) {
+            response.append(data.begin(), data.end());
+            return absl::OkStatus();
+          }));
+
+  // Replace WriteToMemory, the body is no longer copied back after the call
+  void* function_ptr;
+  ASSERT_THAT(sandbox_->rpc_channel()->Symbol("WriteToFd", &function_ptr),
+              IsOk());
+  sapi::v::RemotePtr remote_function_ptr(function_ptr);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      int setopt_function,
+      api_->curl_easy_setopt_ptr(curl_.get(), curl::CURLOPT_WRITEFUNCTION,
+                                 &remote_function_ptr));
+  ASSERT_EQ(setopt_function, curl::CURLE_OK);
+  sapi::v::RemotePtr remote_fd(
+      reinterpret_cast<void*>(static_cast<intptr_t>(channel->remote_fd())));
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      int setopt_data, api_->curl_easy_setopt_ptr(
+                           curl_.get(), curl::CURLOPT_WRITEDATA, &remote_fd));
+  ASSERT_EQ(setopt_data, curl::CURLE_OK);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(int curl_code,
+                            api_->curl_easy_perform(curl_.get()));
+  ASSERT_EQ(curl_code, curl::CURLE_OK);
+  ASSERT_THAT(channel->Finish(), IsOk());
+
+  // Compare response with expected response
+  ASSERT_EQ(response, "OK");
+}
+
+TEST_F(CurlTest, MultiFetcher) {
+  // The mock server handles one connection at a time.
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<curl::MultiFetcher> fetcher,
+      curl::MultiFetcher::Create(api_.get(), {.max_total_connections = 1}));
+
+  const std::string url = absl::StrCat("http://127.0.0.1:", port_, "/");
+  const std::vector<std::string> urls(3, url);
+  // Batches reuse the fetcher's handles.
+  for (int batch = 0; batch < 2; ++batch) {
+    SAPI_ASSERT_OK_AND_ASSIGN(std::vector<curl::FetchResult> results,
+                              fetcher->Fetch(urls));
+    ASSERT_THAT(results.size(), Eq(urls.size()));
+    for (const curl::FetchResult& result : results) {
+      EXPECT_THAT(result.curl_code, Eq(curl::CURLE_OK));
+      EXPECT_THAT(result.response_code, Eq(200));
+      EXPECT_THAT(result.body, Eq("OK"));
+    }
+  }
+
+  // Failed transfers do not fail the batch.
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::vector<curl::FetchResult> results,
+      fetcher->Fetch({url, "unsupported://127.0.0.1/"}));
+  ASSERT_THAT(results.size(), Eq(2));
+  EXPECT_THAT(results[0].body, Eq("OK"));
+  EXPECT_THAT(results[1].curl_code, Eq(curl::CURLE_UNSUPPORTED_PROTOCOL));
+}
+
 }  // namespace
 }  // namespace curl::tests
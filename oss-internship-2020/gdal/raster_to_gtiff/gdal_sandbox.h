@@ -50,6 +50,9 @@ class GdalSapiSandbox : public GdalSandbox {
         .AllowSyscall(__NR_prlimit64)   // CPLGetUsablePhysicalRAM()
         .AllowSyscall(__NR_ftruncate)   // GTiffDataset::FillEmptyTiles()
         .AllowUnlink()                  // GDALDriver::Delete()
+        .AllowSyscall(__NR_recvmsg)     // SharedArray::Allocate()
+        // Shared block buffers of PipelinedRasterToGTiffProcessor
+        .AllowSharedMemoryMappings()
         .AddFile(proj_db_path_)  // proj.db is required for some projections
         .AddDirectory(out_directory_path_, /*is_ro=*/false)
         .BuildOrDie();
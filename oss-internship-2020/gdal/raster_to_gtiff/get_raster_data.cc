@@ -14,7 +14,12 @@
 
 #include "get_raster_data.h"  // NOLINT(build/include)
 
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "gdal.h"  // NOLINT(build/include)
 
@@ -24,13 +29,8 @@ namespace {
 
 inline constexpr int kGeoTransformSize = 6;
 
-}  // namespace
-
-RasterDataset GetRasterBandsFromFile(const std::string& filename) {
-  GDALAllRegister();
-  GDALDatasetH dataset = GDALOpen(filename.data(), GA_ReadOnly);
-  GDALDriverH driver = GDALGetDatasetDriver(dataset);
-
+// Reads the dataset and band properties, without the band data.
+RasterDataset GetRasterInfo(GDALDatasetH dataset) {
   RasterDataset result_dataset = {GDALGetRasterXSize(dataset),
                                   GDALGetRasterYSize(dataset)};
 
@@ -64,23 +64,63 @@ RasterDataset GetRasterBandsFromFile(const std::string& filename) {
     int data_type = static_cast<int>(GDALGetRasterDataType(band));
     int color_interp = static_cast<int>(GDALGetRasterColorInterpretation(band));
 
-    std::vector<int32_t> band_raster_data(width * height);
+    bands_data.push_back({width, height, {}, data_type, color_interp,
+                          std::move(no_data_value_holder)});
+  }
+
+  result_dataset.bands = std::move(bands_data);
+
+  return result_dataset;
+}
+
+}  // namespace
+
+RasterDataset GetRasterBandsFromFile(const std::string& filename) {
+  GDALAllRegister();
+  GDALDatasetH dataset = GDALOpen(filename.data(), GA_ReadOnly);
+
+  RasterDataset result_dataset = GetRasterInfo(dataset);
+
+  for (int i = 0; i < result_dataset.bands.size(); ++i) {
+    RasterBandData& band_data = result_dataset.bands[i];
+    GDALRasterBandH band = GDALGetRasterBand(dataset, i + 1);
+
+    std::vector<int32_t> band_raster_data(band_data.width * band_data.height);
 
     // GDALRasterIO with GF_Write should use the same type (GDT_Int32)
-    GDALRasterIO(band, GF_Read, 0, 0, width, height, band_raster_data.data(),
-                 width, height, GDT_Int32, 0, 0);
+    GDALRasterIO(band, GF_Read, 0, 0, band_data.width, band_data.height,
+                 band_raster_data.data(), band_data.width, band_data.height,
+                 GDT_Int32, 0, 0);
 
-    bands_data.push_back({width, height, std::move(band_raster_data), data_type,
-                          color_interp, std::move(no_data_value_holder)});
+    band_data.data = std::move(band_raster_data);
   }
 
-  result_dataset.bands = std::move(bands_data);
-
   GDALClose(dataset);
 
   return result_dataset;
 }
 
+std::unique_ptr<RasterBlockReader> RasterBlockReader::Open(
+    const std::string& filename) {
+  GDALAllRegister();
+  GDALDatasetH dataset = GDALOpen(filename.data(), GA_ReadOnly);
+  if (dataset == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<RasterBlockReader>(
+      new RasterBlockReader(dataset, GetRasterInfo(dataset)));
+}
+
+RasterBlockReader::~RasterBlockReader() { GDALClose(dataset_); }
+
+bool RasterBlockReader::ReadRows(int band, int row, int rows, int32_t* data) {
+  const RasterBandData& band_data = info_.bands[band];
+  GDALRasterBandH band_handle = GDALGetRasterBand(dataset_, band + 1);
+  return GDALRasterIO(band_handle, GF_Read, 0, row, band_data.width, rows,
+                      data, band_data.width, rows, GDT_Int32, 0,
+                      0) == CE_None;
+}
+
 bool operator==(const RasterBandData& lhs, const RasterBandData& rhs) {
   return lhs.width == rhs.width && lhs.height == rhs.height &&
          lhs.data == rhs.data && lhs.data_type == rhs.data_type &&
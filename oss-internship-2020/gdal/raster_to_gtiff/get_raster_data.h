@@ -15,8 +15,11 @@
 #ifndef RASTER_TO_GTIFF_GET_RASTER_DATA_H_
 #define RASTER_TO_GTIFF_GET_RASTER_DATA_H_
 
+#include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace gdal::sandbox::parser {
@@ -39,6 +42,32 @@ struct RasterDataset {
 };
 
 RasterDataset GetRasterBandsFromFile(const std::string& filename);
+
+// Reads the bands of a raster file block by block, instead of all at once as
+// GetRasterBandsFromFile() does. Blocks must not be read concurrently.
+class RasterBlockReader {
+ public:
+  // Returns nullptr if the file can't be opened.
+  static std::unique_ptr<RasterBlockReader> Open(const std::string& filename);
+
+  RasterBlockReader(const RasterBlockReader&) = delete;
+  RasterBlockReader& operator=(const RasterBlockReader&) = delete;
+  ~RasterBlockReader();
+
+  // The dataset, with bands that hold no data.
+  const RasterDataset& info() const { return info_; }
+
+  // Reads `rows` rows of band `band` (0-based) starting at `row` into `data`,
+  // which must hold rows * width values.
+  bool ReadRows(int band, int row, int rows, int32_t* data);
+
+ private:
+  RasterBlockReader(void* dataset, RasterDataset info)
+      : dataset_(dataset), info_(std::move(info)) {}
+
+  void* dataset_;  // GDALDatasetH
+  RasterDataset info_;
+};
 bool operator==(const RasterBandData& lhs, const RasterBandData& rhs);
 bool operator==(const RasterDataset& lhs, const RasterDataset& rhs);
 
@@ -14,7 +14,16 @@
 
 #include "gtiff_converter.h"  // NOLINT(build/include)
 
+#include <algorithm>
+#include <array>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/var_shared_array.h"
 
 namespace gdal::sandbox {
 
@@ -22,23 +31,10 @@ namespace {
 
 inline constexpr absl::string_view kDriverName = "GTiff";
 
-}  // namespace
-
-RasterToGTiffProcessor::RasterToGTiffProcessor(std::string out_file_full_path,
-                                               std::string proj_db_path,
-                                               parser::RasterDataset data,
-                                               int retry_count)
-    : sapi::Transaction(std::make_unique<GdalSapiSandbox>(
-          sandbox2::file_util::fileops::StripBasename(out_file_full_path),
-          std::move(proj_db_path))),
-      out_file_full_path_(std::move(out_file_full_path)),
-      data_(std::move(data)) {
-  set_retry_count(retry_count);
-  SetTimeLimit(absl::InfiniteDuration());
-}
-
-absl::Status RasterToGTiffProcessor::Main() {
-  GdalApi api(sandbox());
+// Creates an empty GTiff dataset with the size and bands of `data`.
+absl::StatusOr<GDALDatasetH> CreateDataset(GdalApi& api,
+                                           const std::string& out_file,
+                                           const parser::RasterDataset& data) {
   SAPI_RETURN_IF_ERROR(api.GDALAllRegister());
 
   sapi::v::CStr driver_name_ptr(kDriverName);
@@ -50,64 +46,59 @@ absl::Status RasterToGTiffProcessor::Main() {
                           "Error getting GTiff driver");
   sapi::v::RemotePtr driver_ptr(driver.value());
 
-  sapi::v::ConstCStr out_file_full_path_ptr(out_file_full_path_.c_str());
+  sapi::v::ConstCStr out_file_full_path_ptr(out_file.c_str());
   sapi::v::NullPtr create_options;
 
-  GDALDataType type = data_.bands.size() > 0
-                          ? static_cast<GDALDataType>(data_.bands[0].data_type)
+  GDALDataType type = data.bands.size() > 0
+                          ? static_cast<GDALDataType>(data.bands[0].data_type)
                           : GDALDataType::GDT_Unknown;
 
   SAPI_ASSIGN_OR_RETURN(
       absl::StatusOr<GDALDatasetH> dataset,
       api.GDALCreate(&driver_ptr, out_file_full_path_ptr.PtrBefore(),
-                     data_.width, data_.height, data_.bands.size(), type,
+                     data.width, data.height, data.bands.size(), type,
                      &create_options));
 
   TRANSACTION_FAIL_IF_NOT(dataset.value(), "Error creating dataset");
-  sapi::v::RemotePtr dataset_ptr(dataset.value());
-
-  int current_band = 1;
-  for (auto& band_data : data_.bands) {
-    SAPI_ASSIGN_OR_RETURN(absl::StatusOr<GDALRasterBandH> band,
-                          api.GDALGetRasterBand(&dataset_ptr, current_band));
-    TRANSACTION_FAIL_IF_NOT(band.value() != nullptr,
-                            "Error getting band from dataset");
-    sapi::v::RemotePtr band_ptr(band.value());
+  return dataset.value();
+}
 
-    sapi::v::Array<int> data_array(band_data.data.data(),
-                                   band_data.data.size());
+// Returns band `index` (1-based) of the dataset, with the properties of
+// `band_data` set.
+absl::StatusOr<GDALRasterBandH> GetBand(GdalApi& api,
+                                        sapi::v::RemotePtr& dataset_ptr,
+                                        int index,
+                                        const parser::RasterBandData& band_data) {
+  SAPI_ASSIGN_OR_RETURN(absl::StatusOr<GDALRasterBandH> band,
+                        api.GDALGetRasterBand(&dataset_ptr, index));
+  TRANSACTION_FAIL_IF_NOT(band.value() != nullptr,
+                          "Error getting band from dataset");
+  sapi::v::RemotePtr band_ptr(band.value());
 
-    SAPI_ASSIGN_OR_RETURN(
-        absl::StatusOr<CPLErr> result,
-        api.GDALRasterIO(&band_ptr, GF_Write, 0, 0, band_data.width,
-                         band_data.height, data_array.PtrBefore(),
-                         band_data.width, band_data.height, GDT_Int32, 0, 0));
+  SAPI_ASSIGN_OR_RETURN(
+      absl::StatusOr<CPLErr> result,
+      api.GDALSetRasterColorInterpretation(
+          &band_ptr, static_cast<GDALColorInterp>(band_data.color_interp)));
 
-    TRANSACTION_FAIL_IF_NOT(result.value() == CPLErr::CE_None,
-                            "Error writing band to dataset");
+  TRANSACTION_FAIL_IF_NOT(result.value() == CPLErr::CE_None,
+                          "Error setting color interpretation");
 
-    SAPI_ASSIGN_OR_RETURN(
-        result,
-        api.GDALSetRasterColorInterpretation(
-            &band_ptr, static_cast<GDALColorInterp>(band_data.color_interp)));
+  if (band_data.no_data_value.has_value()) {
+    SAPI_ASSIGN_OR_RETURN(result,
+                          api.GDALSetRasterNoDataValue(
+                              &band_ptr, band_data.no_data_value.value()));
 
     TRANSACTION_FAIL_IF_NOT(result.value() == CPLErr::CE_None,
-                            "Error setting color interpretation");
-
-    if (band_data.no_data_value.has_value()) {
-      SAPI_ASSIGN_OR_RETURN(result,
-                            api.GDALSetRasterNoDataValue(
-                                &band_ptr, band_data.no_data_value.value()));
-
-      TRANSACTION_FAIL_IF_NOT(result.value() == CPLErr::CE_None,
-                              "Error setting no data value for the band");
-    }
-
-    ++current_band;
+                            "Error setting no data value for the band");
   }
+  return band.value();
+}
 
-  if (data_.wkt_projection.length() > 0) {
-    sapi::v::ConstCStr wkt_projection_ptr(data_.wkt_projection.c_str());
+// Sets the projection and geo transform, then closes the dataset.
+absl::Status FinishDataset(GdalApi& api, sapi::v::RemotePtr& dataset_ptr,
+                           const parser::RasterDataset& data) {
+  if (data.wkt_projection.length() > 0) {
+    sapi::v::ConstCStr wkt_projection_ptr(data.wkt_projection.c_str());
     SAPI_ASSIGN_OR_RETURN(
         absl::StatusOr<CPLErr> result,
         api.GDALSetProjection(&dataset_ptr, wkt_projection_ptr.PtrBefore()));
@@ -115,9 +106,9 @@ absl::Status RasterToGTiffProcessor::Main() {
                             "Error setting wkt projection");
   }
 
-  if (data_.geo_transform.size() > 0) {
-    sapi::v::Array<double> geo_transform_ptr(data_.geo_transform.data(),
-                                             data_.geo_transform.size());
+  if (data.geo_transform.size() > 0) {
+    sapi::v::Array<const double> geo_transform_ptr(data.geo_transform.data(),
+                                                   data.geo_transform.size());
     SAPI_ASSIGN_OR_RETURN(
         absl::StatusOr<CPLErr> result,
         api.GDALSetGeoTransform(&dataset_ptr, geo_transform_ptr.PtrBefore()));
@@ -131,4 +122,138 @@ absl::Status RasterToGTiffProcessor::Main() {
   return absl::OkStatus();
 }
 
+}  // namespace
+
+RasterToGTiffProcessor::RasterToGTiffProcessor(std::string out_file_full_path,
+                                               std::string proj_db_path,
+                                               parser::RasterDataset data,
+                                               int retry_count)
+    : sapi::Transaction(std::make_unique<GdalSapiSandbox>(
+          sandbox2::file_util::fileops::StripBasename(out_file_full_path),
+          std::move(proj_db_path))),
+      out_file_full_path_(std::move(out_file_full_path)),
+      data_(std::move(data)) {
+  set_retry_count(retry_count);
+  SetTimeLimit(absl::InfiniteDuration());
+}
+
+absl::Status RasterToGTiffProcessor::Main() {
+  GdalApi api(sandbox());
+  SAPI_ASSIGN_OR_RETURN(GDALDatasetH dataset,
+                        CreateDataset(api, out_file_full_path_, data_));
+  sapi::v::RemotePtr dataset_ptr(dataset);
+
+  int current_band = 1;
+  for (auto& band_data : data_.bands) {
+    SAPI_ASSIGN_OR_RETURN(
+        GDALRasterBandH band,
+        GetBand(api, dataset_ptr, current_band, band_data));
+    sapi::v::RemotePtr band_ptr(band);
+
+    sapi::v::Array<int> data_array(band_data.data.data(),
+                                   band_data.data.size());
+
+    SAPI_ASSIGN_OR_RETURN(
+        absl::StatusOr<CPLErr> result,
+        api.GDALRasterIO(&band_ptr, GF_Write, 0, 0, band_data.width,
+                         band_data.height, data_array.PtrBefore(),
+                         band_data.width, band_data.height, GDT_Int32, 0, 0));
+
+    TRANSACTION_FAIL_IF_NOT(result.value() == CPLErr::CE_None,
+                            "Error writing band to dataset");
+
+    ++current_band;
+  }
+
+  return FinishDataset(api, dataset_ptr, data_);
+}
+
+PipelinedRasterToGTiffProcessor::PipelinedRasterToGTiffProcessor(
+    std::string in_file_path, std::string out_file_full_path,
+    std::string proj_db_path, int rows_per_block, int retry_count)
+    : sapi::Transaction(std::make_unique<GdalSapiSandbox>(
+          sandbox2::file_util::fileops::StripBasename(out_file_full_path),
+          std::move(proj_db_path))),
+      in_file_path_(std::move(in_file_path)),
+      out_file_full_path_(std::move(out_file_full_path)),
+      rows_per_block_(rows_per_block) {
+  set_retry_count(retry_count);
+  SetTimeLimit(absl::InfiniteDuration());
+}
+
+absl::Status PipelinedRasterToGTiffProcessor::Main() {
+  TRANSACTION_FAIL_IF_NOT(rows_per_block_ > 0,
+                          "rows_per_block must be positive");
+  std::unique_ptr<parser::RasterBlockReader> reader =
+      parser::RasterBlockReader::Open(in_file_path_);
+  TRANSACTION_FAIL_IF_NOT(reader != nullptr, "Error opening input dataset");
+  const parser::RasterDataset& info = reader->info();
+
+  GdalApi api(sandbox());
+  SAPI_ASSIGN_OR_RETURN(GDALDatasetH dataset,
+                        CreateDataset(api, out_file_full_path_, info));
+  sapi::v::RemotePtr dataset_ptr(dataset);
+
+  struct Block {
+    int band;
+    int row;
+    int rows;
+  };
+  std::vector<Block> blocks;
+  int max_width = 0;
+  for (int band = 0; band < info.bands.size(); ++band) {
+    const parser::RasterBandData& band_data = info.bands[band];
+    for (int row = 0; row < band_data.height; row += rows_per_block_) {
+      blocks.push_back(
+          {band, row, std::min(rows_per_block_, band_data.height - row)});
+    }
+    max_width = std::max(max_width, band_data.width);
+  }
+
+  if (!blocks.empty()) {
+    // One buffer is written by the sandbox while the next block is read into
+    // the other.
+    std::array<std::unique_ptr<sapi::v::SharedArray<int32_t>>, 2> buffers;
+    for (auto& buffer : buffers) {
+      buffer = std::make_unique<sapi::v::SharedArray<int32_t>>(
+          static_cast<size_t>(rows_per_block_) * max_width);
+      SAPI_RETURN_IF_ERROR(sandbox()->Allocate(buffer.get(), true));
+    }
+    auto read_block = [&reader, &blocks, &buffers](size_t i) {
+      return std::async(std::launch::async, [&reader, &blocks, &buffers, i] {
+        const Block& block = blocks[i];
+        return reader->ReadRows(block.band, block.row, block.rows,
+                                buffers[i % 2]->GetData());
+      });
+    };
+
+    GDALRasterBandH band = nullptr;
+    std::future<bool> next = read_block(0);
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      TRANSACTION_FAIL_IF_NOT(next.get(), "Error reading input band");
+      if (i + 1 < blocks.size()) {
+        next = read_block(i + 1);
+      }
+
+      const Block& block = blocks[i];
+      const parser::RasterBandData& band_data = info.bands[block.band];
+      if (block.row == 0) {
+        SAPI_ASSIGN_OR_RETURN(
+            band, GetBand(api, dataset_ptr, block.band + 1, band_data));
+      }
+      sapi::v::RemotePtr band_ptr(band);
+      SAPI_ASSIGN_OR_RETURN(
+          absl::StatusOr<CPLErr> result,
+          api.GDALRasterIO(&band_ptr, GF_Write, 0, block.row, band_data.width,
+                           block.rows, buffers[i % 2]->PtrNone(),
+                           band_data.width, block.rows, GDT_Int32, 0, 0));
+
+      TRANSACTION_FAIL_IF_NOT(result.value() == CPLErr::CE_None,
+                              "Error writing band to dataset");
+    }
+  }
+
+  return FinishDataset(api, dataset_ptr, info);
+}
+
 }  // namespace gdal::sandbox
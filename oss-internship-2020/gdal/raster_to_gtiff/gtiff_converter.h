@@ -15,6 +15,7 @@
 #ifndef RASTER_TO_GTIFF_GTIFF_CONVERTER_H_
 #define RASTER_TO_GTIFF_GTIFF_CONVERTER_H_
 
+#include <memory>
 #include <string>
 
 #include "gdal_sandbox.h"     // NOLINT(build/include)
@@ -36,6 +37,27 @@ class RasterToGTiffProcessor : public sapi::Transaction {
   parser::RasterDataset data_;
 };
 
+inline constexpr int kDefaultRowsPerBlock = 256;
+
+// Converts a raster file without reading it into memory first. Blocks of
+// `rows_per_block` rows are read on a host thread into memory shared with the
+// sandboxee, while the sandbox writes the previous block.
+class PipelinedRasterToGTiffProcessor : public sapi::Transaction {
+ public:
+  PipelinedRasterToGTiffProcessor(std::string in_file_path,
+                                  std::string out_file_full_path,
+                                  std::string proj_db_path,
+                                  int rows_per_block = kDefaultRowsPerBlock,
+                                  int retry_count = 0);
+
+ private:
+  absl::Status Main() final;
+
+  const std::string in_file_path_;
+  const std::string out_file_full_path_;
+  const int rows_per_block_;
+};
+
 }  // namespace gdal::sandbox
 
 #endif  // RASTER_TO_GTIFF_GTIFF_CONVERTER_H_
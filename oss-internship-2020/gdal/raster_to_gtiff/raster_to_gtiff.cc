@@ -17,7 +17,6 @@
 #include <optional>
 #include <string>
 
-#include "get_raster_data.h"  // NOLINT(build/include)
 #include "gtiff_converter.h"  // NOLINT(build/include)
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/path.h"
@@ -25,8 +24,7 @@
 
 namespace {
 
-absl::Status SaveToGTiff(gdal::sandbox::parser::RasterDataset bands_data,
-                         std::string out_file) {
+absl::Status SaveToGTiff(std::string in_file, std::string out_file) {
   std::optional<std::string> proj_db_path =
       gdal::sandbox::utils::FindProjDbPath();
 
@@ -34,9 +32,8 @@ absl::Status SaveToGTiff(gdal::sandbox::parser::RasterDataset bands_data,
     return absl::FailedPreconditionError("Specified proj.db does not exist");
   }
 
-  gdal::sandbox::RasterToGTiffProcessor processor(
-      std::move(out_file), std::move(proj_db_path.value()),
-      std::move(bands_data));
+  gdal::sandbox::PipelinedRasterToGTiffProcessor processor(
+      std::move(in_file), std::move(out_file), std::move(proj_db_path.value()));
 
   return processor.Run();
 }
@@ -61,9 +58,7 @@ int main(int argc, char* argv[]) {
   std::string output_data_path = std::string(argv[2]);
 
   if (absl::Status status = gdal::sandbox::SaveToGTiff(
-          gdal::sandbox::parser::GetRasterBandsFromFile(
-              std::move(input_data_path)),
-          std::move(output_data_path));
+          std::move(input_data_path), std::move(output_data_path));
       !status.ok()) {
     std::cerr << status.ToString() << std::endl;
     return EXIT_FAILURE;
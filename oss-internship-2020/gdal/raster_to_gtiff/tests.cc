@@ -69,6 +69,32 @@ TEST_P(TestGTiffProcessor, TestProcessorOnGTiffData) {
       << "New dataset doesn't match the original one";
 }
 
+TEST_P(TestGTiffProcessor, TestPipelinedProcessorOnGTiffData) {
+  std::string file_path = gdal::sandbox::utils::GetTestDataPath(GetParam());
+
+  ASSERT_TRUE(sandbox2::file_util::fileops::Exists(file_path, false))
+      << "Error finding input dataset";
+
+  ASSERT_TRUE(tempfile_.HasValue()) << "Error creating temporary output file";
+
+  std::optional<std::string> proj_db_path =
+      gdal::sandbox::utils::FindProjDbPath();
+  ASSERT_TRUE(proj_db_path != std::nullopt)
+      << "Specified proj.db does not exist";
+
+  // An odd block size leaves a short last block in each band
+  gdal::sandbox::PipelinedRasterToGTiffProcessor processor(
+      file_path, tempfile_.GetPath(), std::move(proj_db_path.value()),
+      /*rows_per_block=*/7);
+
+  ASSERT_EQ(processor.Run(), absl::OkStatus())
+      << "Error creating new GTiff dataset inside sandbox";
+
+  ASSERT_EQ(gdal::sandbox::parser::GetRasterBandsFromFile(file_path),
+            gdal::sandbox::parser::GetRasterBandsFromFile(tempfile_.GetPath()))
+      << "New dataset doesn't match the original one";
+}
+
 INSTANTIATE_TEST_CASE_P(GDALTests, TestGTiffProcessor,
                         ::testing::Values(kFirstTestDataPath,
                                           kSecondTestDataPath));
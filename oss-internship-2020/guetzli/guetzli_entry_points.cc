@@ -15,9 +15,14 @@
 #include "guetzli_entry_points.h"  // NOLINT(build/include)
 
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -61,10 +66,16 @@ absl::StatusOr<std::string> ReadFromFd(int fd) {
 
   std::string result;
   result.resize(file_data.st_size);
-  status = read(fd, result.data(), result.size());
-
-  if (status < 0) {
-    return absl::FailedPreconditionError("Error reading input from fd");
+  // Reads from the start, so that the same fd can be processed again
+  size_t offset = 0;
+  while (offset < result.size()) {
+    ssize_t read_bytes = pread(fd, result.data() + offset,
+                               result.size() - offset, offset);
+    if (read_bytes < 0 && errno == EINTR) continue;
+    if (read_bytes <= 0) {
+      return absl::FailedPreconditionError("Error reading input from fd");
+    }
+    offset += read_bytes;
   }
 
   return result;
@@ -212,6 +223,34 @@ absl::StatusOr<ImageData> ReadPNG(const std::string& data) {
   return ImageData{xsize, ysize, std::move(rgb)};
 }
 
+// Reads only the IHDR chunk of PNG data.
+absl::StatusOr<ImageData> ReadPNGSize(const std::string& data) {
+  static constexpr unsigned char kPNGSignature[] = {
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+  };
+  // Signature, chunk length, "IHDR", width, height
+  static constexpr size_t kIHDRPrefixSize = sizeof(kPNGSignature) + 16;
+  if (data.size() < kIHDRPrefixSize ||
+      memcmp(data.data(), kPNGSignature, sizeof(kPNGSignature)) != 0 ||
+      data.compare(sizeof(kPNGSignature) + 4, 4, "IHDR") != 0) {
+    return absl::FailedPreconditionError(
+        "Error reading PNG data from input file");
+  }
+  auto read_be32 = [&data](size_t offset) {
+    const auto* bytes = reinterpret_cast<const uint8_t*>(data.data()) + offset;
+    return static_cast<uint32_t>(bytes[0]) << 24 | bytes[1] << 16 |
+           bytes[2] << 8 | bytes[3];
+  };
+  uint32_t xsize = read_be32(sizeof(kPNGSignature) + 8);
+  uint32_t ysize = read_be32(sizeof(kPNGSignature) + 12);
+  // The PNG specification limits dimensions to 2^31 - 1
+  if (xsize > INT32_MAX || ysize > INT32_MAX) {
+    return absl::FailedPreconditionError(
+        "Error reading PNG data from input file");
+  }
+  return ImageData{static_cast<int>(xsize), static_cast<int>(ysize), {}};
+}
+
 bool CheckMemoryLimitExceeded(int memlimit_mb, int xsize, int ysize) {
   double pixels = static_cast<double>(xsize) * ysize;
   return memlimit_mb != -1 &&
@@ -291,3 +330,45 @@ extern "C" bool WriteDataToFd(int fd, sapi::LenValStruct* data) {
   return sandbox2::file_util::fileops::WriteToFD(
       fd, static_cast<const char*>(data->data), data->size);
 }
+
+extern "C" bool GetImageSize(const ProcessingParams* processing_params,
+                             bool is_png, int* xsize, int* ysize) {
+  absl::StatusOr<std::string> input =
+      ReadFromFd(processing_params->remote_fd);
+  if (!input.ok()) {
+    std::cerr << input.status().ToString() << std::endl;
+    return false;
+  }
+
+  if (is_png) {
+    absl::StatusOr<ImageData> png_size = ReadPNGSize(*input);
+    if (!png_size.ok()) {
+      std::cerr << png_size.status().ToString() << std::endl;
+      return false;
+    }
+    *xsize = png_size->xsize;
+    *ysize = png_size->ysize;
+    return true;
+  }
+
+  guetzli::JPEGData jpg_header;
+  if (!guetzli::ReadJpeg(*input, guetzli::JPEG_READ_HEADER, &jpg_header)) {
+    std::cerr << "Error reading JPG data from input file" << std::endl;
+    return false;
+  }
+  *xsize = jpg_header.width;
+  *ysize = jpg_header.height;
+  return true;
+}
+
+extern "C" bool ProcessImageToFd(const ProcessingParams* processing_params,
+                                 bool is_png, int out_fd) {
+  sapi::LenValStruct output = {0, nullptr};
+  bool result = is_png ? ProcessRgb(processing_params, &output)
+                       : ProcessJpeg(processing_params, &output);
+  if (result) {
+    result = WriteDataToFd(out_fd, &output);
+  }
+  free(output.data);
+  return result;
+}
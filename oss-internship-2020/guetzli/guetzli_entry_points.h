@@ -32,4 +32,14 @@ extern "C" bool ProcessRgb(const ProcessingParams* processing_params,
                            sapi::LenValStruct* output);
 extern "C" bool WriteDataToFd(int fd, sapi::LenValStruct* data);
 
+// Stores the dimensions of the JPEG (or, with is_png, PNG) image in
+// processing_params->remote_fd, so that callers can estimate the memory
+// processing it will take.
+extern "C" bool GetImageSize(const ProcessingParams* processing_params,
+                             bool is_png, int* xsize, int* ysize);
+// Processes the image like ProcessJpeg()/ProcessRgb(), but writes the result
+// to out_fd instead of returning it.
+extern "C" bool ProcessImageToFd(const ProcessingParams* processing_params,
+                                 bool is_png, int out_fd);
+
 #endif  // GUETZLI_SANDBOXED_GUETZLI_ENTRY_POINTS_H_
@@ -0,0 +1,155 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "guetzli_executor.h"  // NOLINT(build/include)
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <future>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace guetzli::sandbox {
+
+namespace {
+
+absl::StatusOr<bool> IsPng(int fd) {
+  static const unsigned char kPNGMagicBytes[] = {
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+  };
+  char read_buf[sizeof(kPNGMagicBytes)];
+
+  // pread() leaves the offset alone for the sandboxee
+  if (pread(fd, read_buf, sizeof(kPNGMagicBytes), 0) !=
+      sizeof(kPNGMagicBytes)) {
+    return absl::FailedPreconditionError(
+        "Error determining type of the input file");
+  }
+  return memcmp(read_buf, kPNGMagicBytes, sizeof(kPNGMagicBytes)) == 0;
+}
+
+// Empties the output of a previous try.
+absl::Status ResetOutput(int fd) {
+  struct stat file_data;
+  if (fstat(fd, &file_data) < 0) {
+    return absl::FailedPreconditionError("Error reading output fd");
+  }
+  if (S_ISREG(file_data.st_mode) &&
+      (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0)) {
+    return absl::FailedPreconditionError("Error truncating output file");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+GuetzliExecutor::GuetzliExecutor(GuetzliExecutorOptions options)
+    : options_(std::move(options)),
+      executor_({
+          .num_sandboxes = options_.num_sandboxes,
+          .retry_count = options_.retry_count,
+          .time_limit = absl::InfiniteDuration(),
+          .transactions_per_sandbox = options_.images_per_sandbox,
+      }) {}
+
+std::future<absl::Status> GuetzliExecutor::Submit(GuetzliJob job) {
+  return executor_.Submit([this, job](GuetzliSapiSandbox* sandbox) {
+    return Process(sandbox, job);
+  });
+}
+
+absl::Status GuetzliExecutor::Process(GuetzliSapiSandbox* sandbox,
+                                      const GuetzliJob& job) {
+  SAPI_ASSIGN_OR_RETURN(bool is_png, IsPng(job.in_fd));
+  SAPI_RETURN_IF_ERROR(ResetOutput(job.out_fd));
+
+  // The fds are the caller's, only their copies in the sandboxee are closed.
+  sapi::v::Fd in_fd(job.in_fd);
+  in_fd.OwnLocalFd(false);
+  SAPI_RETURN_IF_ERROR(sandbox->TransferToSandboxee(&in_fd));
+  sapi::v::Fd out_fd(job.out_fd);
+  out_fd.OwnLocalFd(false);
+  SAPI_RETURN_IF_ERROR(sandbox->TransferToSandboxee(&out_fd));
+
+  GuetzliApi api(sandbox);
+  sapi::v::Struct<ProcessingParams> processing_params;
+  *processing_params.mutable_data() = {in_fd.GetRemoteFd(), job.verbose,
+                                       job.quality, job.memlimit_mb};
+
+  sapi::v::Int xsize;
+  sapi::v::Int ysize;
+  SAPI_ASSIGN_OR_RETURN(
+      bool size_read,
+      api.GetImageSize(processing_params.PtrBefore(), is_png,
+                       xsize.PtrAfter(), ysize.PtrAfter()));
+  if (!size_read || xsize.GetValue() < 0 || ysize.GetValue() < 0) {
+    return absl::InvalidArgumentError("Error reading image size");
+  }
+
+  uint64_t pixels = static_cast<uint64_t>(xsize.GetValue()) * ysize.GetValue();
+  uint64_t needed_mb = (pixels * kBytesPerPixel >> 20) + 1;
+  if (job.memlimit_mb != -1 && needed_mb > static_cast<uint64_t>(job.memlimit_mb)) {
+    // Fails in the sandboxee anyway, don't wait for memory
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "Image needs about ", needed_mb, " MB, more than the limit of ",
+        job.memlimit_mb, " MB"));
+  }
+  if (options_.memory_budget_mb != 0) {
+    needed_mb = std::min(needed_mb, options_.memory_budget_mb);
+  }
+
+  AcquireMemory(needed_mb);
+  absl::StatusOr<bool> processed = api.ProcessImageToFd(
+      processing_params.PtrBefore(), is_png, out_fd.GetRemoteFd());
+  ReleaseMemory(needed_mb);
+
+  SAPI_RETURN_IF_ERROR(processed.status());
+  if (!*processed) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Error processing ", (is_png ? "rgb" : "jpeg"), " data"));
+  }
+  return absl::OkStatus();
+}
+
+void GuetzliExecutor::AcquireMemory(uint64_t mb) {
+  if (options_.memory_budget_mb == 0) {
+    return;
+  }
+  absl::MutexLock lock(&mutex_);
+  auto fits = [this, mb]() ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    return used_mb_ + mb <= options_.memory_budget_mb;
+  };
+  mutex_.Await(absl::Condition(&fits));
+  used_mb_ += mb;
+}
+
+void GuetzliExecutor::ReleaseMemory(uint64_t mb) {
+  if (options_.memory_budget_mb == 0) {
+    return;
+  }
+  absl::MutexLock lock(&mutex_);
+  used_mb_ -= mb;
+}
+
+}  // namespace guetzli::sandbox
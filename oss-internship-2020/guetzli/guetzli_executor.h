@@ -0,0 +1,96 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef GUETZLI_SANDBOXED_GUETZLI_EXECUTOR_H_
+#define GUETZLI_SANDBOXED_GUETZLI_EXECUTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+
+#include "guetzli_sandbox.h"  // NOLINT(build/include)
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/transaction_executor.h"
+
+namespace guetzli::sandbox {
+
+// Memory guetzli needs per pixel, the same estimate the sandboxed library uses
+// for memlimit_mb.
+inline constexpr uint64_t kBytesPerPixel = 350;
+
+struct GuetzliJob {
+  // The input image and the file the JPEG is written to. Both stay owned by
+  // the caller. If out_fd is a regular file, it is truncated before each try.
+  int in_fd = -1;
+  int out_fd = -1;
+  int verbose = 0;
+  int quality = 95;
+  // Processing fails for images that would need more, -1 means no limit.
+  int memlimit_mb = 6000;
+};
+
+struct GuetzliExecutorOptions {
+  // Number of sandboxes, i.e. images processed at the same time. Usually the
+  // number of cores.
+  size_t num_sandboxes = 1;
+  // Processing only starts while the estimated memory of all running images
+  // stays within this budget. Larger images run once nothing else does.
+  // 0 means no limit.
+  uint64_t memory_budget_mb = 0;
+  // Restarts a sandbox after this many images, 0 means never.
+  uint64_t images_per_sandbox = 0;
+  int retry_count = 1;
+};
+
+// Processes images on a fixed set of sandboxes that are kept running between
+// images, instead of starting one per image as GuetzliTransaction does. As
+// guetzli needs about kBytesPerPixel per pixel, the image sizes are read
+// first, and processing waits until they fit in the memory budget. Results
+// are written into the output fds inside the sandboxes.
+//
+// Example:
+//   GuetzliExecutor executor({.num_sandboxes = 8, .memory_budget_mb = 16000});
+//   std::future<absl::Status> done =
+//       executor.Submit({.in_fd = in_fd, .out_fd = out_fd});
+//   ...
+//   SAPI_RETURN_IF_ERROR(done.get());
+class GuetzliExecutor {
+ public:
+  explicit GuetzliExecutor(GuetzliExecutorOptions options);
+
+  // Queues a job. The fds must stay open until the returned future is ready.
+  std::future<absl::Status> Submit(GuetzliJob job);
+
+ private:
+  // Processes a job in a sandbox of executor_.
+  absl::Status Process(GuetzliSapiSandbox* sandbox, const GuetzliJob& job);
+
+  // Waits until mb more fit in the budget, then takes them.
+  void AcquireMemory(uint64_t mb);
+  void ReleaseMemory(uint64_t mb);
+
+  const GuetzliExecutorOptions options_;
+
+  absl::Mutex mutex_;
+  uint64_t used_mb_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  // Last, so that its workers are stopped before the above is destroyed.
+  sapi::TransactionExecutor<GuetzliSapiSandbox> executor_;
+};
+
+}  // namespace guetzli::sandbox
+
+#endif  // GUETZLI_SANDBOXED_GUETZLI_EXECUTOR_H_
@@ -0,0 +1,126 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "guetzli_executor.h"  // NOLINT(build/include)
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/str_cat.h"
+
+namespace guetzli::sandbox::tests {
+
+namespace {
+
+constexpr absl::string_view kInPngFilename = "bees.png";
+constexpr absl::string_view kInJpegFilename = "nature.jpg";
+constexpr absl::string_view kPngReferenceFilename = "bees_reference.jpg";
+constexpr absl::string_view kJpegReferenceFilename = "nature_reference.jpg";
+
+constexpr absl::string_view kRelativePathToTestdata =
+    "/guetzli_sandboxed/testdata/";
+
+std::string GetPathToFile(absl::string_view filename) {
+  return absl::StrCat(getenv("TEST_SRCDIR"), kRelativePathToTestdata, filename);
+}
+
+std::string ReadFromFile(const std::string& filename) {
+  std::ifstream stream(filename, std::ios::binary);
+
+  if (!stream.is_open()) {
+    return "";
+  }
+
+  std::stringstream result;
+  result << stream.rdbuf();
+  return result.str();
+}
+
+std::string ReadFromFd(int fd) {
+  std::string result(lseek(fd, 0, SEEK_END), '\0');
+  if (pread(fd, result.data(), result.size(), 0) !=
+      static_cast<ssize_t>(result.size())) {
+    return "";
+  }
+  return result;
+}
+
+// An input file and an anonymous output file
+class JobFiles {
+ public:
+  explicit JobFiles(absl::string_view filename)
+      : in_fd_(open(GetPathToFile(filename).c_str(), O_RDONLY)),
+        out_fd_(open(getenv("TEST_TMPDIR"), O_TMPFILE | O_RDWR,
+                     S_IRUSR | S_IWUSR)) {}
+
+  JobFiles(const JobFiles&) = delete;
+  JobFiles& operator=(const JobFiles&) = delete;
+
+  ~JobFiles() {
+    close(in_fd_);
+    close(out_fd_);
+  }
+
+  GuetzliJob job() const { return {.in_fd = in_fd_, .out_fd = out_fd_}; }
+  int out_fd() const { return out_fd_; }
+
+ private:
+  int in_fd_;
+  int out_fd_;
+};
+
+}  // namespace
+
+TEST(GuetzliExecutorTest, ProcessesJobsOnReusedSandboxes) {
+  // Less than the images need together, so some wait for others
+  GuetzliExecutor executor({.num_sandboxes = 2, .memory_budget_mb = 64});
+
+  std::vector<std::unique_ptr<JobFiles>> files;
+  std::vector<std::future<absl::Status>> results;
+  for (int i = 0; i < 2; ++i) {
+    for (absl::string_view filename : {kInJpegFilename, kInPngFilename}) {
+      files.push_back(std::make_unique<JobFiles>(filename));
+      results.push_back(executor.Submit(files.back()->job()));
+    }
+  }
+
+  for (size_t i = 0; i < results.size(); ++i) {
+    absl::Status result = results[i].get();
+    ASSERT_TRUE(result.ok()) << result.ToString();
+    std::string reference_data = ReadFromFile(GetPathToFile(
+        i % 2 == 0 ? kJpegReferenceFilename : kPngReferenceFilename));
+    ASSERT_EQ(ReadFromFd(files[i]->out_fd()), reference_data)
+        << "Returned data doesn't match reference";
+  }
+}
+
+TEST(GuetzliExecutorTest, RejectsImagesOverTheMemoryLimit) {
+  GuetzliExecutor executor({});
+  JobFiles files(kInPngFilename);
+  GuetzliJob job = files.job();
+  job.memlimit_mb = 1;
+  EXPECT_EQ(executor.Submit(job).get().code(),
+            absl::StatusCode::kResourceExhausted);
+}
+
+}  // namespace guetzli::sandbox::tests
@@ -229,9 +229,8 @@ absl::Status CreateArchive(const char* initial_filename, int compress,
             "Unexpected result from write_header call");
       }
 
-      // In the following section, the calls (read, archive_write_data) are done
-      // on the sandboxed process since we do not need to transfer the data in
-      // the client process.
+      // The sandboxee copies the file into the archive by itself, so the data
+      // never reaches the client process and the whole entry takes one call.
       if (rc > ARCHIVE_FAILED) {
         SAPI_ASSIGN_OR_RETURN(
             msg, CheckStatusAndGetString(api.archive_entry_sourcepath(&entry),
@@ -241,33 +240,20 @@ absl::Status CreateArchive(const char* initial_filename, int compress,
           return absl::FailedPreconditionError("Could not open file");
         }
 
-        sapi::v::Fd sapi_fd(fd);
-        sapi::v::Int read_ret;
-        sapi::v::Array<char> buff(kBuffSize);
-        sapi::v::UInt ssize(kBuffSize);
-
-        // We allocate the buffer remotely and then we can simply use the
-        // remote pointer(with PtrNone).
-        // This allows us to keep the data in the remote process without always
-        // transferring the memory.
-        SAPI_RETURN_IF_ERROR(sandbox.Allocate(&buff, true));
-
         // We can use sapi methods that help us with file descriptors.
+        sapi::v::Fd sapi_fd(fd);
         SAPI_RETURN_IF_ERROR(sandbox.TransferToSandboxee(&sapi_fd));
 
-        SAPI_RETURN_IF_ERROR(
-            sandbox.Call("read", &read_ret, &sapi_fd, buff.PtrNone(), &ssize));
-
-        while (read_ret.GetValue() > 0) {
-          SAPI_ASSIGN_OR_RETURN(
-              rc,
-              api.archive_write_data(&a, buff.PtrNone(), read_ret.GetValue()));
-
-          SAPI_RETURN_IF_ERROR(sandbox.Call("read", &read_ret, &sapi_fd,
-                                            buff.PtrNone(), &ssize));
+        // The remote file descriptor is closed by the sandboxee, the local one
+        // when sapi_fd goes out of scope.
+        sapi_fd.OwnRemoteFd(false);
+        SAPI_ASSIGN_OR_RETURN(rc, api.sapi_archive_write_data_from_fd(
+                                      &a, sapi_fd.GetRemoteFd()));
+        if (rc != ARCHIVE_OK) {
+          SAPI_ASSIGN_OR_RETURN(msg, CheckStatusAndGetString(
+                                         api.archive_error_string(&a), sandbox));
+          return absl::FailedPreconditionError(msg);
         }
-        // sapi_fd variable goes out of scope here so both the local and the
-        // remote file descriptors are closed.
       }
       SAPI_RETURN_IF_ERROR(api.archive_entry_free(&entry));
     }
@@ -483,41 +469,16 @@ absl::Status ExtractArchive(const char* filename, int do_extract, int flags,
 absl::StatusOr<int> CopyData(sapi::v::RemotePtr* ar, sapi::v::RemotePtr* aw,
                              LibarchiveApi& api,
                              SapiLibarchiveSandboxExtract& sandbox) {
-  int rc;
-  std::string msg;
-
-  sapi::v::IntBase<archive_entry*> buff_ptr_tmp(0);
-  sapi::v::ULLong size;
-  sapi::v::SLLong offset;
-
-  while (true) {
-    SAPI_ASSIGN_OR_RETURN(
-        rc, api.archive_read_data_block(ar, buff_ptr_tmp.PtrAfter(),
-                                        size.PtrAfter(), offset.PtrAfter()));
-
-    if (rc == ARCHIVE_EOF) {
-      return ARCHIVE_OK;
-    }
-    if (rc != ARCHIVE_OK) {
-      SAPI_ASSIGN_OR_RETURN(
-          msg, CheckStatusAndGetString(api.archive_error_string(ar), sandbox));
-      std::cout << msg << std::endl;
-      return rc;
-    }
-
-    sapi::v::RemotePtr buff(buff_ptr_tmp.GetValue());
-
+  // The read_data_block/write_data_block loop runs in the sandboxee, instead
+  // of two calls per block.
+  SAPI_ASSIGN_OR_RETURN(int rc, api.sapi_archive_copy_data(ar, aw));
+  if (rc != ARCHIVE_OK) {
     SAPI_ASSIGN_OR_RETURN(
-        rc, api.archive_write_data_block(aw, &buff, size.GetValue(),
-                                         offset.GetValue()));
-
-    if (rc != ARCHIVE_OK) {
-      SAPI_ASSIGN_OR_RETURN(
-          msg, CheckStatusAndGetString(api.archive_error_string(ar), sandbox));
-      std::cout << msg << std::endl;
-      return rc;
-    }
+        std::string msg,
+        CheckStatusAndGetString(api.archive_error_string(ar), sandbox));
+    std::cout << msg << std::endl;
   }
+  return rc;
 }
 
 std::string MakeAbsolutePathAtCWD(const std::string& path) {
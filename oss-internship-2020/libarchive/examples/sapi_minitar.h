@@ -42,7 +42,6 @@ absl::StatusOr<int> CopyData(sapi::v::RemotePtr* ar, sapi::v::RemotePtr* aw,
                              SapiLibarchiveSandboxExtract& sandbox);
 
 inline constexpr size_t kBlockSize = 10240;
-inline constexpr size_t kBuffSize = 16384;
 
 // Converts one string to an absolute path by prepending the current
 // working directory to the relative path.
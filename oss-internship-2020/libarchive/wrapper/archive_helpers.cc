@@ -0,0 +1,70 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "archive_helpers.h"  // NOLINT(build/include)
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <vector>
+
+namespace {
+
+constexpr size_t kCopyBufferSize = 64 * 1024;
+
+}  // namespace
+
+int sapi_archive_write_data_from_fd(struct archive* a, int fd) {
+  std::vector<char> buffer(kCopyBufferSize);
+  int rc = ARCHIVE_OK;
+  for (;;) {
+    ssize_t len = read(fd, buffer.data(), buffer.size());
+    if (len == 0) {
+      break;
+    }
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      rc = ARCHIVE_FATAL;
+      break;
+    }
+    if (archive_write_data(a, buffer.data(), len) < 0) {
+      rc = ARCHIVE_FATAL;
+      break;
+    }
+  }
+  close(fd);
+  return rc;
+}
+
+int sapi_archive_copy_data(struct archive* ar, struct archive* aw) {
+  for (;;) {
+    const void* buff;
+    size_t size;
+    la_int64_t offset;
+    int rc = archive_read_data_block(ar, &buff, &size, &offset);
+    if (rc == ARCHIVE_EOF) {
+      return ARCHIVE_OK;
+    }
+    if (rc != ARCHIVE_OK) {
+      return rc;
+    }
+    rc = archive_write_data_block(aw, buff, size, offset);
+    if (rc != ARCHIVE_OK) {
+      return rc;
+    }
+  }
+}
@@ -0,0 +1,36 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SAPI_LIBARCHIVE_WRAPPER_ARCHIVE_HELPERS_H
+#define SAPI_LIBARCHIVE_WRAPPER_ARCHIVE_HELPERS_H
+
+#include <archive.h>
+
+// Loops that would otherwise take one or two calls per data block from the
+// host. They run in the sandboxee so that a whole entry costs a single call.
+
+extern "C" {
+
+// Writes everything read from `fd` as the data of the current entry of `a`,
+// then closes `fd`. Returns ARCHIVE_OK or ARCHIVE_FATAL.
+int sapi_archive_write_data_from_fd(struct archive* a, int fd);
+
+// Copies the data of the current entry of `ar` to `aw` one block at a time,
+// like the copy_data() loop of the minitar example. Returns ARCHIVE_OK once
+// all data was copied, or the first failing libarchive result.
+int sapi_archive_copy_data(struct archive* ar, struct archive* aw);
+
+}  // extern "C"
+
+#endif  // SAPI_LIBARCHIVE_WRAPPER_ARCHIVE_HELPERS_H
@@ -0,0 +1,160 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../sandboxed.h"          // NOLINT(build/include)
+#include "../utils/row_stream.h"  // NOLINT(build/include)
+#include "helper.h"               // NOLINT(build/include)
+#include "libpng.h"               // NOLINT(build/include)
+#include "gtest/gtest.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/util/temp_file.h"
+
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::Gt;
+
+// Reads all rows of `fd` with ReadRows().
+std::vector<uint8_t> ReadRowByRow(LibPNGApi& api, int fd,
+                                  png_row_header& header) {
+  absl::StatusOr<std::unique_ptr<PngRowReader>> reader =
+      PngRowReader::Open(api, fd, /*rows_per_call=*/64);
+  EXPECT_THAT(reader, IsOk());
+  if (!reader.ok()) {
+    return {};
+  }
+  header = (*reader)->header();
+  std::vector<uint8_t> image;
+  for (;;) {
+    absl::StatusOr<absl::Span<const uint8_t>> rows = (*reader)->ReadRows();
+    EXPECT_THAT(rows, IsOk());
+    if (!rows.ok() || rows->empty()) {
+      break;
+    }
+    image.insert(image.end(), rows->begin(), rows->end());
+  }
+  return image;
+}
+
+class RowStreamTest : public ::testing::TestWithParam<const char*> {};
+
+TEST_P(RowStreamTest, ReadWriteStrips) {
+  std::string infile = GetFilePath(GetParam());
+  absl::StatusOr<std::string> status_or_path =
+      sapi::CreateNamedTempFileAndClose("row_stream.png");
+  ASSERT_THAT(status_or_path, IsOk()) << "Could not create temp output file";
+  std::string outfile = sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(),
+                                             status_or_path.value());
+
+  LibPNGSapiSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
+  LibPNGApi api(&sandbox);
+
+  int in_fd = open(infile.c_str(), O_RDONLY);
+  ASSERT_THAT(in_fd, Gt(-1)) << "Error opening " << infile;
+  // An odd strip height exercises a short last strip.
+  absl::StatusOr<std::unique_ptr<PngRowReader>> reader =
+      PngRowReader::Open(api, in_fd, /*rows_per_call=*/7);
+  close(in_fd);
+  ASSERT_THAT(reader, IsOk());
+  png_row_header header = (*reader)->header();
+  ASSERT_THAT(header.rowbytes, Gt(0));
+
+  int out_fd = open(outfile.c_str(), O_WRONLY | O_TRUNC);
+  ASSERT_THAT(out_fd, Gt(-1)) << "Error opening " << outfile;
+  absl::StatusOr<std::unique_ptr<PngRowWriter>> writer =
+      PngRowWriter::Open(api, out_fd, header, /*rows_per_call=*/7);
+  close(out_fd);
+  ASSERT_THAT(writer, IsOk());
+
+  std::vector<uint8_t> image;
+  uint32_t expected_row = 0;
+  ASSERT_THAT(
+      (*reader)->ReadAll([&](uint32_t row, absl::Span<const uint8_t> rows) {
+        EXPECT_THAT(row, Eq(expected_row));
+        uint32_t count = rows.size() / header.rowbytes;
+        expected_row += count;
+        image.insert(image.end(), rows.begin(), rows.end());
+        memcpy((*writer)->buffer().data(), rows.data(), rows.size());
+        return (*writer)->WriteRows(count);
+      }),
+      IsOk());
+  EXPECT_THAT(expected_row, Eq(header.height));
+  EXPECT_THAT(image.size(), Eq(header.height * header.rowbytes));
+  ASSERT_THAT((*writer)->Finish(), IsOk());
+
+  out_fd = open(outfile.c_str(), O_RDONLY);
+  ASSERT_THAT(out_fd, Gt(-1)) << "Error opening " << outfile;
+  png_row_header result_header;
+  std::vector<uint8_t> result = ReadRowByRow(api, out_fd, result_header);
+  close(out_fd);
+
+  EXPECT_THAT(result_header.width, Eq(header.width));
+  EXPECT_THAT(result_header.height, Eq(header.height));
+  EXPECT_THAT(result_header.rowbytes, Eq(header.rowbytes));
+  EXPECT_THAT(result_header.color_type, Eq(header.color_type));
+  EXPECT_THAT(result_header.interlace_type, Eq(PNG_INTERLACE_NONE));
+  EXPECT_THAT(result, Eq(image));
+}
+
+// pngtest.png is interlaced, red_ball.png is not.
+INSTANTIATE_TEST_SUITE_P(Images, RowStreamTest,
+                         ::testing::Values("pngtest.png", "red_ball.png"));
+
+TEST(RowStreamTest, FinishFailsOnIncompleteImage) {
+  absl::StatusOr<std::string> status_or_path =
+      sapi::CreateNamedTempFileAndClose("row_stream.png");
+  ASSERT_THAT(status_or_path, IsOk()) << "Could not create temp output file";
+  std::string outfile = sapi::file::JoinPath(sapi::file_util::fileops::GetCWD(),
+                                             status_or_path.value());
+
+  LibPNGSapiSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk()) << "Couldn't initialize Sandboxed API";
+  LibPNGApi api(&sandbox);
+
+  png_row_header header = {};
+  header.width = 4;
+  header.height = 4;
+  header.rowbytes = 3 * header.width;
+  header.bit_depth = 8;
+  header.color_type = PNG_COLOR_TYPE_RGB;
+
+  int out_fd = open(outfile.c_str(), O_WRONLY | O_TRUNC);
+  ASSERT_THAT(out_fd, Gt(-1)) << "Error opening " << outfile;
+  absl::StatusOr<std::unique_ptr<PngRowWriter>> writer =
+      PngRowWriter::Open(api, out_fd, header, /*rows_per_call=*/2);
+  close(out_fd);
+  ASSERT_THAT(writer, IsOk());
+
+  std::fill((*writer)->buffer().begin(), (*writer)->buffer().end(), 0x80);
+  ASSERT_THAT((*writer)->WriteRows(2), IsOk());
+  EXPECT_THAT((*writer)->WriteRows(3),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT((*writer)->Finish(),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+}  // namespace
@@ -0,0 +1,234 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "row_stream.h"  // NOLINT(build/include)
+
+#include <climits>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_shared_array.h"
+
+namespace {
+
+// Sends a copy of `fd` to the sandboxee, which takes ownership of it.
+absl::StatusOr<int> TransferFd(LibPNGApi& api, int fd) {
+  sapi::v::Fd file(fd);
+  file.OwnLocalFd(false);
+  SAPI_RETURN_IF_ERROR(api.sandbox()->TransferToSandboxee(&file));
+  file.OwnRemoteFd(false);
+  return file.GetRemoteFd();
+}
+
+absl::Status CheckRowsPerCall(uint32_t rows_per_call) {
+  if (rows_per_call == 0 || rows_per_call > INT_MAX) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid rows per call: ", rows_per_call));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status AllocateStrips(
+    LibPNGApi& api, size_t size,
+    std::unique_ptr<sapi::v::SharedArray<uint8_t>> (&buffers)[2]) {
+  for (auto& buffer : buffers) {
+    buffer = std::make_unique<sapi::v::SharedArray<uint8_t>>(size);
+    SAPI_RETURN_IF_ERROR(api.sandbox()->Allocate(buffer.get(), true));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<PngRowReader>> PngRowReader::Open(
+    LibPNGApi& api, int fd, uint32_t rows_per_call) {
+  SAPI_RETURN_IF_ERROR(CheckRowsPerCall(rows_per_call));
+  SAPI_ASSIGN_OR_RETURN(int remote_fd, TransferFd(api, fd));
+
+  sapi::v::Struct<png_row_header> header;
+  SAPI_ASSIGN_OR_RETURN(void* reader,
+                        api.png_row_reader_open(remote_fd, header.PtrAfter()));
+  if (reader == nullptr) {
+    return absl::InvalidArgumentError("Unable to read PNG header");
+  }
+  std::unique_ptr<PngRowReader> result(
+      new PngRowReader(api, reader, header.data(), rows_per_call));
+  SAPI_RETURN_IF_ERROR(AllocateStrips(
+      api, header.data().rowbytes * rows_per_call, result->buffers_));
+  return result;
+}
+
+PngRowReader::PngRowReader(LibPNGApi& api, void* reader,
+                           const png_row_header& header,
+                           uint32_t rows_per_call)
+    : api_(&api),
+      reader_(reader),
+      header_(header),
+      rows_per_call_(rows_per_call) {}
+
+PngRowReader::~PngRowReader() {
+  api_->png_row_reader_close(&reader_).IgnoreError();
+}
+
+absl::StatusOr<uint32_t> PngRowReader::Decode(
+    sapi::v::SharedArray<uint8_t>& buffer) {
+  SAPI_ASSIGN_OR_RETURN(
+      int rows,
+      api_->png_row_reader_read(&reader_, buffer.PtrNone(), rows_per_call_));
+  if (rows <= 0) {
+    return absl::DataLossError("Unable to decode PNG rows");
+  }
+  return rows;
+}
+
+absl::StatusOr<absl::Span<const uint8_t>> PngRowReader::ReadRows() {
+  if (next_row_ >= header_.height) {
+    return absl::Span<const uint8_t>();
+  }
+  SAPI_ASSIGN_OR_RETURN(uint32_t rows, Decode(*buffers_[0]));
+  next_row_ += rows;
+  return absl::MakeConstSpan(buffers_[0]->GetData(), rows * header_.rowbytes);
+}
+
+absl::Status PngRowReader::ReadAll(const PngRowCallback& callback) {
+  auto decode = [this](int index) {
+    return std::async(std::launch::async,
+                      [this, index] { return Decode(*buffers_[index]); });
+  };
+  if (next_row_ >= header_.height) {
+    return absl::OkStatus();
+  }
+  int current = 0;
+  std::future<absl::StatusOr<uint32_t>> pending = decode(current);
+  while (pending.valid()) {
+    absl::StatusOr<uint32_t> rows = pending.get();
+    SAPI_RETURN_IF_ERROR(rows.status());
+    uint32_t row = next_row_;
+    next_row_ += *rows;
+    if (next_row_ < header_.height) {
+      pending = decode(1 - current);
+    }
+    absl::Status status = callback(
+        row, absl::MakeConstSpan(buffers_[current]->GetData(),
+                                 *rows * header_.rowbytes));
+    if (!status.ok()) {
+      if (pending.valid()) {
+        pending.wait();
+      }
+      return status;
+    }
+    current = 1 - current;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::unique_ptr<PngRowWriter>> PngRowWriter::Open(
+    LibPNGApi& api, int fd, const png_row_header& header,
+    uint32_t rows_per_call) {
+  SAPI_RETURN_IF_ERROR(CheckRowsPerCall(rows_per_call));
+  SAPI_ASSIGN_OR_RETURN(int remote_fd, TransferFd(api, fd));
+
+  sapi::v::Struct<png_row_header> header_var;
+  *header_var.mutable_data() = header;
+  SAPI_ASSIGN_OR_RETURN(
+      void* writer,
+      api.png_row_writer_open(remote_fd, header_var.PtrBefore()));
+  if (writer == nullptr) {
+    return absl::InvalidArgumentError("Unable to write PNG header");
+  }
+  std::unique_ptr<PngRowWriter> result(
+      new PngRowWriter(api, writer, header, rows_per_call));
+  SAPI_RETURN_IF_ERROR(
+      AllocateStrips(api, header.rowbytes * rows_per_call, result->buffers_));
+  return result;
+}
+
+PngRowWriter::PngRowWriter(LibPNGApi& api, void* writer,
+                           const png_row_header& header,
+                           uint32_t rows_per_call)
+    : api_(&api),
+      writer_(writer),
+      header_(header),
+      rows_per_call_(rows_per_call) {}
+
+PngRowWriter::~PngRowWriter() {
+  if (!finished_) {
+    Finish().IgnoreError();
+  }
+}
+
+absl::Span<uint8_t> PngRowWriter::buffer() {
+  return absl::MakeSpan(buffers_[current_]->GetData(),
+                        buffers_[current_]->GetSize());
+}
+
+absl::Status PngRowWriter::Encode(sapi::v::SharedArray<uint8_t>& buffer,
+                                  uint32_t rows) {
+  SAPI_ASSIGN_OR_RETURN(
+      int written, api_->png_row_writer_write(&writer_, buffer.PtrNone(), rows));
+  if (written < 0 || static_cast<uint32_t>(written) != rows) {
+    return absl::DataLossError("Unable to encode PNG rows");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status PngRowWriter::WaitForPending() {
+  if (!pending_.valid()) {
+    return absl::OkStatus();
+  }
+  return pending_.get();
+}
+
+absl::Status PngRowWriter::WriteRows(uint32_t rows) {
+  if (finished_) {
+    return absl::FailedPreconditionError("Writer is finished");
+  }
+  if (rows == 0 || rows > rows_per_call_ ||
+      rows > header_.height - next_row_) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Cannot write ", rows, " rows at row ", next_row_, " of ",
+        header_.height));
+  }
+  SAPI_RETURN_IF_ERROR(WaitForPending());
+  sapi::v::SharedArray<uint8_t>* buffer = buffers_[current_].get();
+  pending_ = std::async(std::launch::async,
+                        [this, buffer, rows] { return Encode(*buffer, rows); });
+  next_row_ += rows;
+  current_ = 1 - current_;
+  return absl::OkStatus();
+}
+
+absl::Status PngRowWriter::Finish() {
+  if (finished_) {
+    return absl::FailedPreconditionError("Writer is finished");
+  }
+  finished_ = true;
+  absl::Status status = WaitForPending();
+  SAPI_ASSIGN_OR_RETURN(int result, api_->png_row_writer_close(&writer_));
+  SAPI_RETURN_IF_ERROR(status);
+  if (next_row_ != header_.height) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Only ", next_row_, " of ", header_.height, " rows were written"));
+  }
+  if (result != 0) {
+    return absl::DataLossError("Unable to finish PNG file");
+  }
+  return absl::OkStatus();
+}
@@ -0,0 +1,117 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LIBPNG_UTILS_ROW_STREAM_H_
+#define LIBPNG_UTILS_ROW_STREAM_H_
+
+#include <cstdint>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+
+#include "../sandboxed.h"  // NOLINT(build/include)
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/var_shared_array.h"
+
+inline constexpr uint32_t kDefaultRowsPerCall = 64;
+
+// Receives the decoded rows starting at `row`, header().rowbytes bytes each.
+// The span is only valid during the call.
+using PngRowCallback =
+    std::function<absl::Status(uint32_t row, absl::Span<const uint8_t> rows)>;
+
+// Decodes a PNG file in strips of `rows_per_call` rows, into buffers shared
+// with the sandboxee. Host memory stays bounded by two strips; interlaced
+// images are still decoded whole inside the sandboxee.
+class PngRowReader {
+ public:
+  // Does not take ownership of `fd`.
+  static absl::StatusOr<std::unique_ptr<PngRowReader>> Open(
+      LibPNGApi& api, int fd, uint32_t rows_per_call = kDefaultRowsPerCall);
+
+  PngRowReader(const PngRowReader&) = delete;
+  PngRowReader& operator=(const PngRowReader&) = delete;
+  ~PngRowReader();
+
+  const png_row_header& header() const { return header_; }
+  uint32_t next_row() const { return next_row_; }
+
+  // Decodes the next strip. Returns an empty span after the last row. The span
+  // is valid until the next call.
+  absl::StatusOr<absl::Span<const uint8_t>> ReadRows();
+
+  // Passes all remaining rows to `callback`, decoding the next strip while it
+  // processes the current one. Returns the first decoding or callback error.
+  absl::Status ReadAll(const PngRowCallback& callback);
+
+ private:
+  PngRowReader(LibPNGApi& api, void* reader, const png_row_header& header,
+               uint32_t rows_per_call);
+
+  absl::StatusOr<uint32_t> Decode(sapi::v::SharedArray<uint8_t>& buffer);
+
+  LibPNGApi* api_;
+  sapi::v::RemotePtr reader_;
+  png_row_header header_;
+  uint32_t rows_per_call_;
+  uint32_t next_row_ = 0;
+  std::unique_ptr<sapi::v::SharedArray<uint8_t>> buffers_[2];
+};
+
+// Encodes a non-interlaced PNG file from strips of up to `rows_per_call` rows.
+// Each strip is encoded while the caller fills the next one.
+class PngRowWriter {
+ public:
+  // Does not take ownership of `fd`. header.interlace_type is ignored.
+  static absl::StatusOr<std::unique_ptr<PngRowWriter>> Open(
+      LibPNGApi& api, int fd, const png_row_header& header,
+      uint32_t rows_per_call = kDefaultRowsPerCall);
+
+  PngRowWriter(const PngRowWriter&) = delete;
+  PngRowWriter& operator=(const PngRowWriter&) = delete;
+  // Calls Finish() if it wasn't, ignoring errors.
+  ~PngRowWriter();
+
+  // Memory for the rows of the next WriteRows() call.
+  absl::Span<uint8_t> buffer();
+
+  // Starts encoding the first `rows` rows of buffer(). Returns without waiting
+  // for them, encoding errors are reported by a later call.
+  absl::Status WriteRows(uint32_t rows);
+
+  // Waits for the pending rows and finishes the file. Fails unless all rows of
+  // the image were written.
+  absl::Status Finish();
+
+ private:
+  PngRowWriter(LibPNGApi& api, void* writer, const png_row_header& header,
+               uint32_t rows_per_call);
+
+  absl::Status Encode(sapi::v::SharedArray<uint8_t>& buffer, uint32_t rows);
+  absl::Status WaitForPending();
+
+  LibPNGApi* api_;
+  sapi::v::RemotePtr writer_;
+  png_row_header header_;
+  uint32_t rows_per_call_;
+  uint32_t next_row_ = 0;
+  bool finished_ = false;
+  int current_ = 0;
+  std::unique_ptr<sapi::v::SharedArray<uint8_t>> buffers_[2];
+  std::future<absl::Status> pending_;
+};
+
+#endif  // LIBPNG_UTILS_ROW_STREAM_H_
@@ -12,7 +12,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "func.h"  // NOLINT(build/include)
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <vector>
 
 void png_setjmp(png_structrp ptr) { setjmp(png_jmpbuf(ptr)); }
 
@@ -62,3 +71,205 @@ void png_write_image_wrapper(png_structrp png_ptr, png_bytep image,
   png_write_image(png_ptr, ptrs);
   free(ptrs);
 }
+
+namespace {
+
+struct PngRowReader {
+  FILE* file = nullptr;
+  png_structp png_ptr = nullptr;
+  png_infop info_ptr = nullptr;
+  png_uint_32 height = 0;
+  size_t rowbytes = 0;
+  png_uint_32 next_row = 0;
+  bool interlaced = false;
+  bool failed = false;
+  // Whole decoded image, only used for interlaced input.
+  std::vector<png_byte> image;
+  std::vector<png_bytep> row_ptrs;
+};
+
+struct PngRowWriter {
+  FILE* file = nullptr;
+  png_structp png_ptr = nullptr;
+  png_infop info_ptr = nullptr;
+  png_uint_32 height = 0;
+  size_t rowbytes = 0;
+  png_uint_32 next_row = 0;
+  bool failed = false;
+  std::vector<png_bytep> row_ptrs;
+};
+
+// Points `ptrs` at `count` consecutive rows of `rowbytes` bytes.
+void SetRowPointers(std::vector<png_bytep>& ptrs, png_bytep rows, size_t count,
+                    size_t rowbytes) {
+  ptrs.resize(count);
+  for (size_t i = 0; i != count; ++i) {
+    ptrs[i] = rows + i * rowbytes;
+  }
+}
+
+}  // namespace
+
+void* png_row_reader_open(int fd, png_row_header* header) {
+  FILE* file = fdopen(fd, "rb");
+  if (file == nullptr) {
+    close(fd);
+    return nullptr;
+  }
+  png_byte sig[8];
+  if (fread(sig, 1, sizeof(sig), file) != sizeof(sig) ||
+      png_sig_cmp(sig, 0, sizeof(sig)) != 0) {
+    fclose(file);
+    return nullptr;
+  }
+
+  auto* reader = new PngRowReader;
+  reader->file = file;
+  reader->png_ptr =
+      png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (reader->png_ptr != nullptr) {
+    reader->info_ptr = png_create_info_struct(reader->png_ptr);
+  }
+  if (reader->info_ptr == nullptr) {
+    png_row_reader_close(reader);
+    return nullptr;
+  }
+  if (setjmp(png_jmpbuf(reader->png_ptr))) {
+    png_row_reader_close(reader);
+    return nullptr;
+  }
+  png_init_io(reader->png_ptr, file);
+  png_set_sig_bytes(reader->png_ptr, sizeof(sig));
+  png_read_info(reader->png_ptr, reader->info_ptr);
+  reader->interlaced = png_set_interlace_handling(reader->png_ptr) > 1;
+  png_read_update_info(reader->png_ptr, reader->info_ptr);
+
+  header->width = png_get_image_width(reader->png_ptr, reader->info_ptr);
+  header->height = png_get_image_height(reader->png_ptr, reader->info_ptr);
+  header->rowbytes = png_get_rowbytes(reader->png_ptr, reader->info_ptr);
+  header->bit_depth = png_get_bit_depth(reader->png_ptr, reader->info_ptr);
+  header->color_type = png_get_color_type(reader->png_ptr, reader->info_ptr);
+  header->interlace_type =
+      png_get_interlace_type(reader->png_ptr, reader->info_ptr);
+  reader->height = header->height;
+  reader->rowbytes = header->rowbytes;
+  return reader;
+}
+
+int png_row_reader_read(void* ptr, png_bytep rows, int count) {
+  auto* reader = static_cast<PngRowReader*>(ptr);
+  if (reader->failed || count < 0) {
+    return -1;
+  }
+  count = std::min<png_uint_32>(count, reader->height - reader->next_row);
+  if (count == 0) {
+    return 0;
+  }
+
+  if (reader->interlaced) {
+    if (reader->image.empty()) {
+      reader->image.resize(reader->height * reader->rowbytes);
+      SetRowPointers(reader->row_ptrs, reader->image.data(), reader->height,
+                     reader->rowbytes);
+      if (setjmp(png_jmpbuf(reader->png_ptr))) {
+        reader->failed = true;
+        return -1;
+      }
+      png_read_image(reader->png_ptr, reader->row_ptrs.data());
+    }
+    memcpy(rows, reader->image.data() + reader->next_row * reader->rowbytes,
+           count * reader->rowbytes);
+  } else {
+    SetRowPointers(reader->row_ptrs, rows, count, reader->rowbytes);
+    if (setjmp(png_jmpbuf(reader->png_ptr))) {
+      reader->failed = true;
+      return -1;
+    }
+    png_read_rows(reader->png_ptr, reader->row_ptrs.data(), NULL, count);
+  }
+  reader->next_row += count;
+  return count;
+}
+
+void png_row_reader_close(void* ptr) {
+  auto* reader = static_cast<PngRowReader*>(ptr);
+  png_destroy_read_struct(&reader->png_ptr, &reader->info_ptr, NULL);
+  fclose(reader->file);
+  delete reader;
+}
+
+void* png_row_writer_open(int fd, const png_row_header* header) {
+  FILE* file = fdopen(fd, "wb");
+  if (file == nullptr) {
+    close(fd);
+    return nullptr;
+  }
+
+  auto* writer = new PngRowWriter;
+  writer->file = file;
+  writer->png_ptr =
+      png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (writer->png_ptr != nullptr) {
+    writer->info_ptr = png_create_info_struct(writer->png_ptr);
+  }
+  if (writer->info_ptr == nullptr) {
+    writer->failed = true;
+    png_row_writer_close(writer);
+    return nullptr;
+  }
+  if (setjmp(png_jmpbuf(writer->png_ptr))) {
+    writer->failed = true;
+    png_row_writer_close(writer);
+    return nullptr;
+  }
+  png_init_io(writer->png_ptr, file);
+  png_set_IHDR(writer->png_ptr, writer->info_ptr, header->width,
+               header->height, header->bit_depth, header->color_type,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
+               PNG_FILTER_TYPE_BASE);
+  if (png_get_rowbytes(writer->png_ptr, writer->info_ptr) !=
+      header->rowbytes) {
+    writer->failed = true;
+    png_row_writer_close(writer);
+    return nullptr;
+  }
+  png_write_info(writer->png_ptr, writer->info_ptr);
+  writer->height = header->height;
+  writer->rowbytes = header->rowbytes;
+  return writer;
+}
+
+int png_row_writer_write(void* ptr, png_bytep rows, int count) {
+  auto* writer = static_cast<PngRowWriter*>(ptr);
+  if (writer->failed || count < 0 ||
+      static_cast<png_uint_32>(count) > writer->height - writer->next_row) {
+    return -1;
+  }
+  SetRowPointers(writer->row_ptrs, rows, count, writer->rowbytes);
+  if (setjmp(png_jmpbuf(writer->png_ptr))) {
+    writer->failed = true;
+    return -1;
+  }
+  png_write_rows(writer->png_ptr, writer->row_ptrs.data(), count);
+  writer->next_row += count;
+  return count;
+}
+
+int png_row_writer_close(void* ptr) {
+  auto* writer = static_cast<PngRowWriter*>(ptr);
+  // An incomplete image is not finished, libpng would fail on it.
+  bool ok = !writer->failed && writer->next_row == writer->height;
+  if (ok) {
+    if (setjmp(png_jmpbuf(writer->png_ptr))) {
+      ok = false;
+    } else {
+      png_write_end(writer->png_ptr, NULL);
+    }
+  }
+  png_destroy_write_struct(&writer->png_ptr, &writer->info_ptr);
+  if (fclose(writer->file) != 0) {
+    ok = false;
+  }
+  delete writer;
+  return ok ? 0 : -1;
+}
@@ -15,10 +15,22 @@
 #ifndef LIBPNG_WRAPPER_FUNC_H_
 #define LIBPNG_WRAPPER_FUNC_H_
 
+#include <cstdint>
+
 #include "png.h"  // NOLINT(build/include)
 
 extern "C" {
 
+// Image properties shared by the row reader and writer.
+struct png_row_header {
+  uint32_t width;
+  uint32_t height;
+  size_t rowbytes;
+  int bit_depth;
+  int color_type;
+  int interlace_type;
+};
+
 void* png_fdopen(int fd, const char* mode);
 void png_rewind(void* f);
 void png_fread(void* buffer, size_t size, size_t count, void* stream);
@@ -34,6 +46,25 @@ void png_read_image_wrapper(png_structrp png_ptr, png_bytep image,
 void png_write_image_wrapper(png_structrp png_ptr, png_bytep image,
                              size_t height, size_t rowbytes);
 
+// Reads the PNG file `fd` a few rows at a time. Takes ownership of `fd` and
+// fills `header` with the properties of the decoded rows. Interlaced images
+// are decoded whole on the first read, as Adam7 passes cover all rows.
+// Returns nullptr on error.
+void* png_row_reader_open(int fd, struct png_row_header* header);
+// Decodes up to `count` of the next rows into `rows`. Returns the number of
+// rows decoded, 0 after the last row or -1 on error.
+int png_row_reader_read(void* reader, png_bytep rows, int count);
+void png_row_reader_close(void* reader);
+
+// Writes a non-interlaced PNG file to `fd` a few rows at a time. Takes
+// ownership of `fd`. Returns nullptr on error.
+void* png_row_writer_open(int fd, const struct png_row_header* header);
+// Encodes `count` rows from `rows`. Returns the number of rows encoded or -1
+// on error.
+int png_row_writer_write(void* writer, png_bytep rows, int count);
+// Finishes the file and frees `writer`. Returns 0 if all rows were written.
+int png_row_writer_close(void* writer);
+
 }  // extern "C"
 
 #endif  // LIBPNG_WRAPPER_FUNC_H_
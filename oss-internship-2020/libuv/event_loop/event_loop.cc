@@ -0,0 +1,205 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "event_loop.h"  // NOLINT(build/include)
+
+#include <unistd.h>
+#include <uv.h>
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+struct sapi_uv_event_loop {
+  uv_loop_t loop;
+  uv_async_t wakeup;
+  // Writes the events of an iteration after polling for I/O.
+  uv_check_t flush;
+  uv_thread_t thread;
+  int event_fd;
+  // Encoded events not written yet, only used by the loop thread.
+  std::string events;
+  uv_mutex_t mutex;
+  // Guarded by mutex.
+  std::vector<sapi_uv_request> submitted;
+  bool stopping;
+};
+
+namespace {
+
+// A running request, freed by its completion.
+struct Operation {
+  sapi_uv_event_loop* loop;
+  uint64_t id;
+  union {
+    uv_timer_t timer;
+    uv_fs_t fs;
+  };
+  std::vector<char> buffer;
+};
+
+void AddEvent(sapi_uv_event_loop* loop, uint64_t id, int64_t result,
+              const char* data, size_t size) {
+  sapi_uv_event event = {id, result, size};
+  loop->events.append(reinterpret_cast<const char*>(&event), sizeof(event));
+  loop->events.append(data, size);
+}
+
+void FlushEvents(sapi_uv_event_loop* loop) {
+  const char* data = loop->events.data();
+  size_t size = loop->events.size();
+  while (size > 0) {
+    ssize_t written = write(loop->event_fd, data, size);
+    if (written < 0 && errno == EINTR) continue;
+    // The host went away, nobody is waiting for the events
+    if (written <= 0) break;
+    data += written;
+    size -= written;
+  }
+  loop->events.clear();
+}
+
+void OnFlush(uv_check_t* handle) {
+  FlushEvents(static_cast<sapi_uv_event_loop*>(handle->data));
+}
+
+void OnTimerClosed(uv_handle_t* handle) {
+  delete static_cast<Operation*>(handle->data);
+}
+
+void OnTimer(uv_timer_t* handle) {
+  auto* op = static_cast<Operation*>(handle->data);
+  AddEvent(op->loop, op->id, 0, nullptr, 0);
+  uv_close(reinterpret_cast<uv_handle_t*>(handle), OnTimerClosed);
+}
+
+void OnRead(uv_fs_t* req) {
+  auto* op = static_cast<Operation*>(req->data);
+  size_t size = req->result > 0 ? static_cast<size_t>(req->result) : 0;
+  AddEvent(op->loop, op->id, req->result, op->buffer.data(), size);
+  uv_fs_req_cleanup(req);
+  delete op;
+}
+
+void Start(sapi_uv_event_loop* loop, const sapi_uv_request& request) {
+  auto* op = new Operation{loop, request.id};
+  int error = UV_EINVAL;
+  switch (request.type) {
+    case SAPI_UV_REQUEST_TIMER:
+      error = uv_timer_init(&loop->loop, &op->timer);
+      if (error != 0) break;
+      op->timer.data = op;
+      error = uv_timer_start(&op->timer, OnTimer, request.arg, 0);
+      if (error != 0) {
+        // The handle is initialized, closing it frees op
+        uv_close(reinterpret_cast<uv_handle_t*>(&op->timer), OnTimerClosed);
+        AddEvent(loop, request.id, error, nullptr, 0);
+      }
+      return;
+    case SAPI_UV_REQUEST_READ: {
+      op->buffer.resize(request.arg);
+      uv_buf_t buf = uv_buf_init(op->buffer.data(), op->buffer.size());
+      op->fs.data = op;
+      error = uv_fs_read(&loop->loop, &op->fs, request.fd, &buf, 1,
+                         request.offset, OnRead);
+      if (error == 0) return;
+      uv_fs_req_cleanup(&op->fs);
+      break;
+    }
+  }
+  AddEvent(loop, request.id, error, nullptr, 0);
+  delete op;
+}
+
+void CloseHandle(uv_handle_t* handle, void*) {
+  if (!uv_is_closing(handle)) {
+    // Only timers have Operation data, the loop's own handles point to it
+    uv_close(handle, handle->type == UV_TIMER ? OnTimerClosed : nullptr);
+  }
+}
+
+void OnWakeup(uv_async_t* handle) {
+  auto* loop = static_cast<sapi_uv_event_loop*>(handle->data);
+  std::vector<sapi_uv_request> requests;
+  uv_mutex_lock(&loop->mutex);
+  requests.swap(loop->submitted);
+  bool stopping = loop->stopping;
+  uv_mutex_unlock(&loop->mutex);
+
+  for (const sapi_uv_request& request : requests) {
+    Start(loop, request);
+  }
+  if (stopping) {
+    // Running reads can't be closed, uv_run() returns once they completed
+    uv_walk(&loop->loop, CloseHandle, nullptr);
+  }
+}
+
+void Run(void* arg) {
+  auto* loop = static_cast<sapi_uv_event_loop*>(arg);
+  uv_run(&loop->loop, UV_RUN_DEFAULT);
+  // Events of reads that completed after the flush handle was closed
+  FlushEvents(loop);
+}
+
+}  // namespace
+
+sapi_uv_event_loop* sapi_uv_event_loop_start(int event_fd) {
+  auto* loop = new sapi_uv_event_loop();
+  loop->event_fd = event_fd;
+  if (uv_loop_init(&loop->loop) != 0) {
+    delete loop;
+    return nullptr;
+  }
+  loop->wakeup.data = loop;
+  loop->flush.data = loop;
+  uv_mutex_init(&loop->mutex);
+  if (uv_async_init(&loop->loop, &loop->wakeup, OnWakeup) != 0 ||
+      uv_check_init(&loop->loop, &loop->flush) != 0 ||
+      uv_check_start(&loop->flush, OnFlush) != 0 ||
+      uv_thread_create(&loop->thread, Run, loop) != 0) {
+    uv_walk(&loop->loop, CloseHandle, nullptr);
+    uv_run(&loop->loop, UV_RUN_DEFAULT);
+    uv_loop_close(&loop->loop);
+    uv_mutex_destroy(&loop->mutex);
+    delete loop;
+    return nullptr;
+  }
+  return loop;
+}
+
+int sapi_uv_event_loop_submit(sapi_uv_event_loop* loop,
+                              const sapi_uv_request* requests, size_t count) {
+  uv_mutex_lock(&loop->mutex);
+  if (loop->stopping) {
+    uv_mutex_unlock(&loop->mutex);
+    return UV_ECANCELED;
+  }
+  loop->submitted.insert(loop->submitted.end(), requests, requests + count);
+  uv_mutex_unlock(&loop->mutex);
+  return uv_async_send(&loop->wakeup);
+}
+
+int sapi_uv_event_loop_stop(sapi_uv_event_loop* loop) {
+  uv_mutex_lock(&loop->mutex);
+  loop->stopping = true;
+  uv_mutex_unlock(&loop->mutex);
+  uv_async_send(&loop->wakeup);
+  uv_thread_join(&loop->thread);
+
+  int error = uv_loop_close(&loop->loop);
+  uv_mutex_destroy(&loop->mutex);
+  delete loop;
+  return error;
+}
@@ -0,0 +1,68 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// A libuv loop that runs on its own thread in the sandboxee. The host submits
+// requests in batches, and the loop writes the events of completed requests
+// to an fd (see uv_event_loop.h for the host side). The events of a loop
+// iteration are written at once.
+
+extern "C" {
+
+enum {
+  // Completes after arg milliseconds, with a result of 0.
+  SAPI_UV_REQUEST_TIMER = 0,
+  // Reads up to arg bytes of fd at offset (-1 for the current position). The
+  // result is the number of bytes read or a negative libuv error, the data
+  // follows the event.
+  SAPI_UV_REQUEST_READ = 1,
+};
+
+struct sapi_uv_request {
+  uint64_t id;
+  int32_t type;
+  int32_t fd;
+  int64_t offset;
+  uint64_t arg;
+};
+
+// Written to the event fd, followed by size bytes of data.
+struct sapi_uv_event {
+  uint64_t id;
+  int64_t result;
+  uint64_t size;
+};
+
+typedef struct sapi_uv_event_loop sapi_uv_event_loop;
+
+// Starts a loop writing events to event_fd, which stays owned by the caller.
+// Returns NULL on failure.
+sapi_uv_event_loop* sapi_uv_event_loop_start(int event_fd);
+
+// Queues count requests and wakes up the loop. Returns 0 or a libuv error.
+int sapi_uv_event_loop_submit(sapi_uv_event_loop* loop,
+                              const sapi_uv_request* requests, size_t count);
+
+// Cancels pending timers, waits for running reads and writes their events,
+// then frees the loop. Returns 0 or the libuv error of closing the loop.
+int sapi_uv_event_loop_stop(sapi_uv_event_loop* loop);
+
+}  // extern "C"
+
+#endif  // EVENT_LOOP_H_
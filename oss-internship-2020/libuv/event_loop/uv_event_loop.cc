@@ -0,0 +1,116 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "uv_event_loop.h"  // NOLINT(build/include)
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace uv {
+
+absl::StatusOr<std::unique_ptr<UVEventLoop>> UVEventLoop::Start(
+    UVApi* api, UVEventCallback callback) {
+  std::unique_ptr<UVEventLoop> loop(new UVEventLoop(api, std::move(callback)));
+  SAPI_ASSIGN_OR_RETURN(
+      loop->channel_,
+      sapi::OutputChannel::Create(
+          api->GetSandbox(), [loop = loop.get()](absl::Span<const uint8_t> data) {
+            return loop->OnData(data);
+          }));
+  SAPI_ASSIGN_OR_RETURN(
+      loop->loop_, api->sapi_uv_event_loop_start(loop->channel_->remote_fd()));
+  if (loop->loop_ == nullptr) {
+    return absl::UnavailableError("sapi_uv_event_loop_start failed");
+  }
+  return loop;
+}
+
+UVEventLoop::~UVEventLoop() {
+  if (loop_ != nullptr) {
+    Stop().IgnoreError();
+  }
+}
+
+absl::Status UVEventLoop::Submit(absl::Span<const sapi_uv_request> requests) {
+  if (loop_ == nullptr) {
+    return absl::FailedPreconditionError("The loop is stopped");
+  }
+  if (requests.empty()) {
+    return absl::OkStatus();
+  }
+  sapi::v::RemotePtr loop(loop_);
+  sapi::v::Array<const sapi_uv_request> requests_array(requests.data(),
+                                                       requests.size());
+  SAPI_ASSIGN_OR_RETURN(
+      int error, api_->sapi_uv_event_loop_submit(
+                     &loop, requests_array.PtrBefore(), requests.size()));
+  if (error != 0) {
+    return absl::UnavailableError(
+        absl::StrCat("sapi_uv_event_loop_submit returned error ", error));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status UVEventLoop::Stop() {
+  if (loop_ == nullptr) {
+    return absl::OkStatus();
+  }
+  sapi::v::RemotePtr loop(loop_);
+  loop_ = nullptr;
+  absl::StatusOr<int> error = api_->sapi_uv_event_loop_stop(&loop);
+  // Once stopped, all events were written, so the channel ends with them.
+  absl::Status status = channel_->Finish();
+  SAPI_RETURN_IF_ERROR(error.status());
+  if (*error != 0) {
+    return absl::InternalError(
+        absl::StrCat("sapi_uv_event_loop_stop returned error ", *error));
+  }
+  SAPI_RETURN_IF_ERROR(status);
+  if (!partial_.empty()) {
+    return absl::DataLossError("Truncated event");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status UVEventLoop::OnData(absl::Span<const uint8_t> data) {
+  partial_.append(data.begin(), data.end());
+  size_t offset = 0;
+  events_.clear();
+  while (partial_.size() - offset >= sizeof(sapi_uv_event)) {
+    sapi_uv_event header;
+    memcpy(&header, partial_.data() + offset, sizeof(header));
+    if (partial_.size() - offset - sizeof(header) < header.size) {
+      break;
+    }
+    offset += sizeof(header);
+    events_.push_back(
+        {header.id, header.result, partial_.substr(offset, header.size)});
+    offset += header.size;
+  }
+  partial_.erase(0, offset);
+  if (events_.empty()) {
+    return absl::OkStatus();
+  }
+  return callback_(events_);
+}
+
+}  // namespace uv
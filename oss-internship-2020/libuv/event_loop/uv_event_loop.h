@@ -0,0 +1,168 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef UV_EVENT_LOOP_H_
+#define UV_EVENT_LOOP_H_
+
+#include <linux/filter.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <syscall.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "event_loop.h"  // NOLINT(build/include)
+#include "sandboxed_api/output_channel.h"
+#include "sandboxed_api/sandbox2/util/bpf_helper.h"
+#include "uv_sapi.sapi.h"  // NOLINT(build/include)
+
+namespace uv {
+
+// A sandbox whose policy allows running a UVEventLoop: libuv's loop and thread
+// pool threads, and reading fds transferred to the sandboxee.
+class UVEventLoopSandbox : public UVSandbox {
+ private:
+  std::unique_ptr<sandbox2::Policy> ModifyPolicy(
+      sandbox2::PolicyBuilder*) override {
+    // As with pthread_create(), clone3() fails and glibc falls back to clone()
+    static constexpr uint32_t kPthreadCloneFlags =
+        CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SYSVSEM | CLONE_SIGHAND |
+        CLONE_THREAD | CLONE_SETTLS | CLONE_PARENT_SETTID |
+        CLONE_CHILD_CLEARTID;
+    return sandbox2::PolicyBuilder()
+        .AllowDynamicStartup()
+        .AllowExit()
+        .AllowRead()
+        .AllowWrite()
+        .AllowSystemMalloc()
+        .AllowHandleSignals()
+        .AllowTime()
+        .AllowEpoll()
+        .AllowEpollWait()
+        .AllowEventFd()
+        .AllowFutexOp(FUTEX_WAIT)
+        .AllowFutexOp(FUTEX_WAKE)
+        .AllowSyscalls({__NR_pipe2, __NR_recvmsg, __NR_close,
+                        __NR_sched_yield, __NR_gettid})
+        .AddPolicyOnSyscall(__NR_clone,
+                            {
+                                ARG_32(0),  // flags
+                                JEQ32(kPthreadCloneFlags, ALLOW),
+                            })
+#ifdef __NR_clone3
+        .BlockSyscallWithErrno(__NR_clone3, ENOSYS)
+#endif
+        // Thread stacks, with a guard page
+        .AddPolicyOnMmap([](bpf_labels& labels) -> std::vector<sock_filter> {
+          return {
+              ARG_32(3),  // flags
+              JNE32(MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK,
+                    JUMP(&labels, mmap_stack_end)),
+              ARG_32(2),  // prot
+              JEQ32(PROT_NONE, ALLOW),
+              LABEL(&labels, mmap_stack_end),
+          };
+        })
+        .AddPolicyOnSyscall(__NR_mprotect,
+                            {
+                                ARG_32(2),  // prot
+                                JEQ32(PROT_READ | PROT_WRITE, ALLOW),
+                            })
+        .AddPolicyOnSyscall(__NR_madvise,
+                            {
+                                ARG_32(2),  // advice
+                                JEQ32(MADV_DONTNEED, ALLOW),
+                            })
+        .BuildOrDie();
+  }
+};
+
+// A completed request. For reads, result is the number of bytes read, or a
+// negative libuv error.
+struct UVEvent {
+  uint64_t id;
+  int64_t result;
+  std::string data;
+};
+
+// Receives the events that arrived together, usually those of one iteration
+// of the sandboxed loop. Called on a thread of the UVEventLoop.
+using UVEventCallback =
+    std::function<absl::Status(absl::Span<const UVEvent> events)>;
+
+// Runs a libuv loop continuously in the sandboxee, instead of driving it with
+// one sapi_uv_run() call per step. Requests are submitted in batches, with one
+// call each, and their events are streamed back as they complete, without a
+// call per event.
+//
+// Example:
+//   UVEventLoopSandbox sandbox;
+//   SAPI_RETURN_IF_ERROR(sandbox.Init());
+//   UVApi api(&sandbox);
+//   SAPI_ASSIGN_OR_RETURN(std::unique_ptr<UVEventLoop> loop,
+//                         UVEventLoop::Start(&api, callback));
+//   SAPI_RETURN_IF_ERROR(loop->Submit({{.id = 1,
+//                                       .type = SAPI_UV_REQUEST_TIMER,
+//                                       .arg = 100}}));
+//   ...
+//   SAPI_RETURN_IF_ERROR(loop->Stop());
+class UVEventLoop {
+ public:
+  static absl::StatusOr<std::unique_ptr<UVEventLoop>> Start(
+      UVApi* api, UVEventCallback callback);
+
+  UVEventLoop(const UVEventLoop&) = delete;
+  UVEventLoop& operator=(const UVEventLoop&) = delete;
+
+  // Stops the loop if Stop() wasn't called.
+  ~UVEventLoop();
+
+  // Queues requests in the sandboxed loop. fds of reads are sandboxee fds, e.g.
+  // from sapi::v::Fd::GetRemoteFd().
+  absl::Status Submit(absl::Span<const sapi_uv_request> requests);
+
+  // Cancels pending timers, which deliver no event, and waits for the events
+  // of running reads. Returns the first error of stopping the loop or of the
+  // callback.
+  absl::Status Stop();
+
+ private:
+  UVEventLoop(UVApi* api, UVEventCallback callback)
+      : api_(api), callback_(std::move(callback)) {}
+
+  // Decodes the events in data, together with an incomplete one left from
+  // before, and passes them to callback_.
+  absl::Status OnData(absl::Span<const uint8_t> data);
+
+  UVApi* api_;
+  UVEventCallback callback_;
+  std::unique_ptr<sapi::OutputChannel> channel_;
+  sapi_uv_event_loop* loop_ = nullptr;
+  // Only used by the channel's thread.
+  std::string partial_;
+  std::vector<UVEvent> events_;
+};
+
+}  // namespace uv
+
+#endif  // UV_EVENT_LOOP_H_
@@ -0,0 +1,152 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <uv.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "uv_event_loop.h"  // NOLINT(build/include)
+
+namespace {
+
+class UVTestEventLoop : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    sandbox_ = std::make_unique<uv::UVEventLoopSandbox>();
+    ASSERT_THAT(sandbox_->Init(), sapi::IsOk());
+    api_ = std::make_unique<uv::UVApi>(sandbox_.get());
+  }
+
+  // Starts a loop collecting its events in events_
+  void StartLoop() {
+    SAPI_ASSERT_OK_AND_ASSIGN(
+        loop_, uv::UVEventLoop::Start(
+                   api_.get(), [this](absl::Span<const uv::UVEvent> events) {
+                     absl::MutexLock lock(&mutex_);
+                     events_.insert(events_.end(), events.begin(),
+                                    events.end());
+                     return absl::OkStatus();
+                   }));
+  }
+
+  // Waits until count events arrived
+  std::vector<uv::UVEvent> AwaitEvents(size_t count) {
+    absl::MutexLock lock(&mutex_);
+    auto arrived = [&]() { return events_.size() >= count; };
+    mutex_.Await(absl::Condition(&arrived));
+    return events_;
+  }
+
+  std::unique_ptr<uv::UVEventLoopSandbox> sandbox_;
+  std::unique_ptr<uv::UVApi> api_;
+  std::unique_ptr<uv::UVEventLoop> loop_;
+
+  absl::Mutex mutex_;
+  std::vector<uv::UVEvent> events_;
+};
+
+TEST_F(UVTestEventLoop, Timers) {
+  StartLoop();
+
+  // Timers complete in the order of their timeouts, not of the requests
+  ASSERT_THAT(loop_->Submit({
+                  {.id = 1, .type = SAPI_UV_REQUEST_TIMER, .arg = 50},
+                  {.id = 2, .type = SAPI_UV_REQUEST_TIMER, .arg = 0},
+              }),
+              sapi::IsOk());
+  std::vector<uv::UVEvent> events = AwaitEvents(2);
+  ASSERT_EQ(events.size(), 2);
+  EXPECT_EQ(events[0].id, 2);
+  EXPECT_EQ(events[1].id, 1);
+  EXPECT_EQ(events[1].result, 0);
+
+  // Pending timers are cancelled
+  ASSERT_THAT(loop_->Submit({{.id = 3,
+                              .type = SAPI_UV_REQUEST_TIMER,
+                              .arg = 60'000}}),
+              sapi::IsOk());
+  ASSERT_THAT(loop_->Stop(), sapi::IsOk());
+  EXPECT_EQ(AwaitEvents(2).size(), 2);
+  EXPECT_THAT(loop_->Submit({{.id = 4, .type = SAPI_UV_REQUEST_TIMER}}),
+              sapi::StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST_F(UVTestEventLoop, Reads) {
+  StartLoop();
+
+  sapi::v::Fd file(open("/proc/self/exe", O_RDONLY));
+  ASSERT_GE(file.GetValue(), 0);
+  ASSERT_THAT(sandbox_->TransferToSandboxee(&file), sapi::IsOk());
+
+  ASSERT_THAT(loop_->Submit({
+                  {.id = 1,
+                   .type = SAPI_UV_REQUEST_READ,
+                   .fd = file.GetRemoteFd(),
+                   .offset = 0,
+                   .arg = 4},
+                  {.id = 2,
+                   .type = SAPI_UV_REQUEST_READ,
+                   .fd = -1,
+                   .offset = 0,
+                   .arg = 4},
+                  {.id = 3, .type = -1},
+              }),
+              sapi::IsOk());
+  // Reads running on the thread pool complete before stopping
+  ASSERT_THAT(loop_->Stop(), sapi::IsOk());
+
+  std::vector<uv::UVEvent> events = AwaitEvents(3);
+  ASSERT_EQ(events.size(), 3);
+  for (const uv::UVEvent& event : events) {
+    switch (event.id) {
+      case 1:
+        EXPECT_EQ(event.result, 4);
+        EXPECT_EQ(event.data, "\x7f" "ELF");
+        break;
+      case 2:
+        EXPECT_EQ(event.result, UV_EBADF);
+        EXPECT_TRUE(event.data.empty());
+        break;
+      case 3:
+        EXPECT_EQ(event.result, UV_EINVAL);
+        break;
+      default:
+        ADD_FAILURE() << "Unexpected event " << event.id;
+    }
+  }
+}
+
+TEST_F(UVTestEventLoop, CallbackError) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      loop_, uv::UVEventLoop::Start(api_.get(),
+                                    [](absl::Span<const uv::UVEvent>) {
+                                      return absl::CancelledError("stop");
+                                    }));
+  // Unlike timers, reads deliver their event before stopping
+  ASSERT_THAT(loop_->Submit({{.id = 1, .type = SAPI_UV_REQUEST_READ, .fd = -1}}),
+              sapi::IsOk());
+  EXPECT_THAT(loop_->Stop(),
+              sapi::StatusIs(absl::StatusCode::kCancelled));
+}
+
+}  // namespace
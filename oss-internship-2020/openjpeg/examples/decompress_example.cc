@@ -19,11 +19,12 @@
 
 #include <cstdlib>
 #include <iostream>
-#include <vector>
 
 #include "gen_files/convert.h"  // NOLINT(build/include)
 #include "openjp2_sapi.sapi.h"  // NOLINT(build/include)
 #include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "sandboxed_api/var_shared_array.h"
 
 class Openjp2SapiSandbox : public Openjp2Sandbox {
  public:
@@ -44,7 +45,10 @@ class Openjp2SapiSandbox : public Openjp2Sandbox {
             __NR_futex,
             __NR_close,
             __NR_lseek,
+            __NR_recvmsg,  // SharedArray::Allocate()
         })
+        // Shared buffer receiving the decoded components
+        .AllowSharedMemoryMappings()
         .AddFile(in_file_)
         .BuildOrDie();
   }
@@ -57,9 +61,20 @@ int main(int argc, char* argv[]) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
   sapi::InitLogging(argv[0]);
 
-  if (argc != 3) {
+  // Optionally only decode the region [x0, x1) x [y0, y1) of the image, at
+  // 1 / 2^reduce of its resolution.
+  OPJ_INT32 area[4] = {0, 0, 0, 0};
+  OPJ_UINT32 reduce = 0;
+  bool valid_args = argc == 3 || argc == 7 || argc == 8;
+  for (int i = 3; valid_args && i < argc && i < 7; ++i) {
+    valid_args = absl::SimpleAtoi(argv[i], &area[i - 3]);
+  }
+  if (valid_args && argc == 8) {
+    valid_args = absl::SimpleAtoi(argv[7], &reduce);
+  }
+  if (!valid_args) {
     std::cerr << "Usage: " << basename(argv[0]) << " absolute/path/to/INPUT.jp2"
-              << " absolute/path/to/OUTPUT.pnm\n";
+              << " absolute/path/to/OUTPUT.pnm [x0 y0 x1 y1 [reduce]]\n";
     return EXIT_FAILURE;
   }
 
@@ -103,6 +118,21 @@ int main(int argc, char* argv[]) {
   CHECK(sandbox.TransferFromSandboxee(&image).ok())
       << "Transfer from sandboxee failed";
 
+  // The resolution factor has to be set before the decode area, which is given
+  // in full resolution coordinates.
+  if (reduce != 0) {
+    bool_status =
+        api.opj_set_decoded_resolution_factor(&codec_pointer, reduce);
+    CHECK(bool_status.ok() && bool_status.value())
+        << "Setting the resolution factor failed";
+  }
+  if (argc > 3) {
+    bool_status = api.opj_set_decode_area(&codec_pointer, image.PtrBoth(),
+                                          area[0], area[1], area[2], area[3]);
+    CHECK(bool_status.ok() && bool_status.value())
+        << "Setting the decode area failed";
+  }
+
   bool_status =
       api.opj_decode(&codec_pointer, &stream_pointer, image.PtrAfter());
   CHECK(bool_status.ok() && bool_status.value()) << "Decoding failed";
@@ -121,22 +151,25 @@ int main(int argc, char* argv[]) {
   image.mutable_data()->comps =
       static_cast<opj_image_comp_t*>(image_components.GetLocal());
 
-  unsigned int width = static_cast<unsigned int>(image.data().comps[0].w);
-  unsigned int height = static_cast<unsigned int>(image.data().comps[0].h);
-
-  std::vector<std::vector<OPJ_INT32>> data(components);
-  sapi::v::Array<OPJ_INT32> image_components_data(width * height);
+  // Only the decoded area is copied, into memory shared with the sandboxee.
+  size_t total_size = 0;
+  for (int i = 0; i < components; ++i) {
+    total_size += static_cast<size_t>(image_components[i].w) *
+                  image_components[i].h;
+  }
+  sapi::v::SharedArray<OPJ_INT32> image_data(total_size);
+  status = sandbox.Allocate(&image_data, true);
+  CHECK(status.ok()) << "Shared buffer allocation failed " << status;
+  bool_status = api.sapi_opj_copy_image_data(image.PtrNone(),
+                                             image_data.PtrNone(), total_size);
+  CHECK(bool_status.ok() && bool_status.value())
+      << "Copying the image data failed";
 
+  OPJ_INT32* component_data = image_data.GetData();
   for (int i = 0; i < components; ++i) {
-    image_components_data.SetRemote(image.data().comps[i].data);
-    CHECK(sandbox.TransferFromSandboxee(&image_components_data).ok())
-        << "Transfer from sandboxee failed";
-
-    std::vector<OPJ_INT32> component_data(
-        image_components_data.GetData(),
-        image_components_data.GetData() + (width * height));
-    data[i] = std::move(component_data);
-    image_components[i].data = &data[i][0];
+    image_components[i].data = component_data;
+    component_data += static_cast<size_t>(image_components[i].w) *
+                      image_components[i].h;
   }
 
   // Convert the image to the desired format and save it to the file.
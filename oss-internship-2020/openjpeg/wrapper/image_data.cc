@@ -0,0 +1,40 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "image_data.h"  // NOLINT(build/include)
+
+#include <cstring>
+
+OPJ_BOOL sapi_opj_copy_image_data(const opj_image_t* image, OPJ_INT32* out,
+                                  OPJ_SIZE_T out_size) {
+  OPJ_SIZE_T total = 0;
+  for (OPJ_UINT32 i = 0; i < image->numcomps; ++i) {
+    const opj_image_comp_t& comp = image->comps[i];
+    if (comp.data == nullptr) {
+      return OPJ_FALSE;
+    }
+    total += static_cast<OPJ_SIZE_T>(comp.w) * comp.h;
+  }
+  if (total > out_size) {
+    return OPJ_FALSE;
+  }
+  for (OPJ_UINT32 i = 0; i < image->numcomps; ++i) {
+    const opj_image_comp_t& comp = image->comps[i];
+    OPJ_SIZE_T size = static_cast<OPJ_SIZE_T>(comp.w) * comp.h;
+    memcpy(out, comp.data, size * sizeof(OPJ_INT32));
+    out += size;
+  }
+  return OPJ_TRUE;
+}
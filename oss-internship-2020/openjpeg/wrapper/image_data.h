@@ -0,0 +1,32 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef OPENJPEG_WRAPPER_IMAGE_DATA_H_
+#define OPENJPEG_WRAPPER_IMAGE_DATA_H_
+
+#include "openjpeg.h"  // NOLINT(build/include)
+
+extern "C" {
+
+// Copies the decoded data of all components of `image` into `out`, one
+// component after the other. Component `i` takes comps[i].w * comps[i].h
+// values. Returns OPJ_FALSE, copying nothing, if `out_size` values are not
+// enough or a component was not decoded.
+OPJ_BOOL sapi_opj_copy_image_data(const opj_image_t* image, OPJ_INT32* out,
+                                  OPJ_SIZE_T out_size);
+
+}  // extern "C"
+
+#endif  // OPENJPEG_WRAPPER_IMAGE_DATA_H_
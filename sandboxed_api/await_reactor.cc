@@ -0,0 +1,110 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/await_reactor.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/any_invocable.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sapi {
+
+PollAwaitReactor::PollAwaitReactor()
+    : wake_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  PCHECK(wake_fd_.get() != -1) << "eventfd() failed";
+  thread_ = std::thread(&PollAwaitReactor::Run, this);
+}
+
+PollAwaitReactor::~PollAwaitReactor() {
+  {
+    absl::MutexLock lock(&mutex_);
+    stop_ = true;
+  }
+  Wake();
+  thread_.join();
+}
+
+void PollAwaitReactor::WhenReadable(int fd,
+                                    absl::AnyInvocable<void() &&> callback) {
+  {
+    absl::MutexLock lock(&mutex_);
+    waiting_.emplace_back(fd, std::move(callback));
+  }
+  Wake();
+}
+
+void PollAwaitReactor::Wake() {
+  uint64_t value = 1;
+  if (TEMP_FAILURE_RETRY(write(wake_fd_.get(), &value, sizeof(value))) !=
+      sizeof(value)) {
+    PLOG(ERROR) << "Waking the reactor";
+  }
+}
+
+void PollAwaitReactor::Run() {
+  std::vector<pollfd> pfds;
+  std::vector<absl::AnyInvocable<void() &&>> ready;
+  for (;;) {
+    {
+      absl::MutexLock lock(&mutex_);
+      if (stop_) {
+        return;
+      }
+      pfds.assign(1, {.fd = wake_fd_.get(), .events = POLLIN});
+      for (const auto& [fd, callback] : waiting_) {
+        pfds.push_back({.fd = fd, .events = POLLIN});
+      }
+    }
+    if (TEMP_FAILURE_RETRY(poll(pfds.data(), pfds.size(), /*timeout=*/-1)) ==
+        -1) {
+      PLOG(ERROR) << "poll() failed";
+      continue;
+    }
+    if (pfds[0].revents != 0) {
+      uint64_t value;
+      TEMP_FAILURE_RETRY(read(wake_fd_.get(), &value, sizeof(value)));
+    }
+    {
+      absl::MutexLock lock(&mutex_);
+      // Only entries present when polling started are at the front, in order.
+      size_t kept = 0;
+      for (size_t i = 0; i < waiting_.size(); ++i) {
+        if (i + 1 < pfds.size() && pfds[i + 1].revents != 0) {
+          ready.push_back(std::move(waiting_[i].second));
+        } else {
+          waiting_[kept++] = std::move(waiting_[i]);
+        }
+      }
+      waiting_.erase(waiting_.begin() + kept, waiting_.end());
+    }
+    // Called without the lock, callbacks may wait for further descriptors.
+    for (auto& callback : ready) {
+      std::move(callback)();
+    }
+    ready.clear();
+  }
+}
+
+}  // namespace sapi
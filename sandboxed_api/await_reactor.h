@@ -0,0 +1,69 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_AWAIT_REACTOR_H_
+#define SANDBOXED_API_AWAIT_REACTOR_H_
+
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sapi {
+
+// Runs callbacks once file descriptors become readable, so that asynchronous
+// sandbox operations can be awaited without blocking a thread on each, see
+// Sandbox::AsyncCall::readiness_fd() and sandboxed_api/coroutine.h. Event
+// loops of RPC servers implement it on top of their own polling.
+class AwaitReactor {
+ public:
+  virtual ~AwaitReactor() = default;
+
+  // Calls `callback` once, on a thread of the reactor's choice, after `fd`
+  // became readable. May call it right away.
+  virtual void WhenReadable(int fd, absl::AnyInvocable<void() &&> callback) = 0;
+};
+
+// AwaitReactor polling on a thread of its own. Pending callbacks are dropped
+// when it is destroyed.
+class PollAwaitReactor final : public AwaitReactor {
+ public:
+  PollAwaitReactor();
+  ~PollAwaitReactor() override;
+
+  PollAwaitReactor(const PollAwaitReactor&) = delete;
+  PollAwaitReactor& operator=(const PollAwaitReactor&) = delete;
+
+  void WhenReadable(int fd, absl::AnyInvocable<void() &&> callback) override;
+
+ private:
+  void Run();
+  void Wake();
+
+  absl::Mutex mutex_;
+  std::vector<std::pair<int, absl::AnyInvocable<void() &&>>> waiting_
+      ABSL_GUARDED_BY(mutex_);
+  bool stop_ ABSL_GUARDED_BY(mutex_) = false;
+  // Eventfd interrupting poll() when waiting_ changed.
+  file_util::fileops::FDCloser wake_fd_;
+  std::thread thread_;
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_AWAIT_REACTOR_H_
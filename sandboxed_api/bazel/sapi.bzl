@@ -114,10 +114,18 @@ def _sapi_interface_impl(ctx):
     append_arg(args, "--sapi_embed_name", ctx.attr.embed_name)
     append_arg(args, "--sapi_functions", ",".join(ctx.attr.functions))
     append_arg(args, "--sapi_ns", ctx.attr.namespace)
+    if ctx.attr.sandboxee_malloc != "system":
+        append_arg(args, "--sapi_malloc", ctx.attr.sandboxee_malloc)
 
     if ctx.attr.limit_scan_depth:
         args.append("--sapi_limit_scan_depth")
 
+    if ctx.file.annotations:
+        if not use_clang_generator:
+            fail("annotations require generator_version = 2")
+        append_arg(args, "--sapi_annotations", ctx.file.annotations.path)
+        input_files.append(ctx.file.annotations)
+
     # Parse provided files.
 
     # The parser doesn't need the entire set of transitive headers
@@ -209,6 +217,11 @@ sapi_interface = rule(
         "lib_name": attr.string(mandatory = True),
         "namespace": attr.string(),
         "limit_scan_depth": attr.bool(default = False),
+        "sandboxee_malloc": attr.string(
+            default = "system",
+            values = ["system", "tcmalloc", "scudo"],
+        ),
+        "annotations": attr.label(allow_single_file = True),
         "api_version": attr.int(
             default = 1,
             values = [1],  # Only a single version is defined right now
@@ -232,6 +245,24 @@ sapi_interface = rule(
     toolchains = use_cpp_toolchain(),
 )
 
+# Default allocator libraries for the `malloc` option of sapi_library(). None
+# keeps the toolchain's default malloc.
+_SANDBOXEE_MALLOC_LIBS = {
+    "system": None,
+    "tcmalloc": "@com_google_tcmalloc//tcmalloc",
+    "scudo": None,
+}
+
+def _static_symbols_source(functions):
+    """Returns the C source of the symbol table of a static sandboxee."""
+    return "".join(
+        ['#include "sandboxed_api/static_symbols.h"\n\n'] +
+        ["void {}(void);\n".format(f) for f in functions] +
+        ["\nconst struct SapiStaticSymbol sapi_static_symbols[] = {\n"] +
+        ['    {{"{0}", (void*)&{0}}},\n'.format(f) for f in functions] +
+        ["    {0, 0},\n};\n"],
+    )
+
 def sapi_library(
         name,
         lib,
@@ -239,8 +270,11 @@ def sapi_library(
         namespace = "",
         api_version = 1,
         embed = True,
+        static_pie = False,
         add_default_deps = True,
         limit_scan_depth = False,
+        malloc = "system",
+        malloc_lib = None,
         srcs = [],
         data = [],
         hdrs = [],
@@ -249,6 +283,7 @@ def sapi_library(
         functions = [],
         header = "",
         input_files = [],
+        annotations = None,
         deps = [],
         tags = [],
         generator_version = 1,
@@ -261,9 +296,21 @@ def sapi_library(
       lib: Label of the library target to sandbox
       lib_name: Name of the class which will proxy the library functions from
         the functions list
-      malloc: Override the default dependency on malloc
+      malloc: Allocator to link the sandboxee against: "system", "tcmalloc" or
+        "scudo". The default policy of the generated sandbox class allows the
+        syscalls it needs.
+      malloc_lib: Label of the allocator library to link the sandboxee
+        against. Defaults to @com_google_tcmalloc//tcmalloc for "tcmalloc",
+        required for "scudo".
       namespace: A C++ namespace identifier to place the API class into
       embed: Whether the SAPI library should be embedded inside the host code
+      static_pie: Whether to link the sandboxee as a static-PIE binary. It
+        then needs neither the dynamic loader nor any shared library, which
+        makes starting its forkserver and forking sandboxees from it cheaper.
+        Functions are found in a table generated from `functions` instead of
+        with dlsym(), so only those can be called, and Sandbox::Symbol() only
+        finds them too. Requires static versions of all dependencies,
+        including libffi.
       add_default_deps: Add SAPI dependencies to target (deprecated)
       limit_scan_depth: Limit include depth for header generator (deprecated)
       api_version: Which version of the Sandboxed API to generate. Currently,
@@ -282,6 +329,9 @@ def sapi_library(
         (deprecated).
       input_files: List of source files which the SAPI interface generator
         should scan for function declarations
+      annotations: File with annotations of pointer parameters, which
+        determine how the generated header synchronizes them, and of pure
+        functions whose results are memoized. Requires generator_version = 2.
       deps: Extra dependencies to add to the SAPI library
       tags: Extra tags to associate with the target
       generator_version: Which version the the interface generator to use
@@ -342,13 +392,39 @@ def sapi_library(
         **common
     )
 
-    native.cc_binary(
-        name = name + ".bin",
-        linkopts = [
+    if malloc not in _SANDBOXEE_MALLOC_LIBS:
+        fail("malloc must be one of {}".format(_SANDBOXEE_MALLOC_LIBS.keys()))
+    if not malloc_lib:
+        malloc_lib = _SANDBOXEE_MALLOC_LIBS[malloc]
+    if malloc != "system" and not malloc_lib:
+        fail("malloc = \"{}\" requires malloc_lib".format(malloc))
+
+    static_srcs = []
+    if static_pie:
+        if not functions:
+            fail("static_pie = True requires the list of functions")
+        static_srcs = [name + "_static_symbols.c"]
+        native.genrule(
+            name = name + "_static_symbols",
+            outs = static_srcs,
+            cmd = "cat > $@ <<'EOF'\n{}EOF\n".format(
+                _static_symbols_source(functions),
+            ),
+            **common
+        )
+        bin_linkopts = ["-static-pie"]
+    else:
+        bin_linkopts = [
             "-ldl",  # For dlopen(), dlsym()
             # The sandboxing client must have access to all
             "-Wl,-E",  # symbols used in the sandboxed library, so these
-        ] + exported_funcs,  # must be both referenced, and exported
+        ]  # must be both referenced, and exported
+
+    native.cc_binary(
+        name = name + ".bin",
+        srcs = static_srcs,
+        malloc = malloc_lib,
+        linkopts = bin_linkopts + exported_funcs,
         deps = [
             ":" + name + ".lib",
             "//sandboxed_api:client",
@@ -365,6 +441,22 @@ def sapi_library(
         **common
     )
 
+    # Links the library into the host for the generated <Name>PassthroughSandbox
+    # class, see Sandbox::RunInProcess(). Add this as a dependency instead of
+    # the library to measure the overhead of sandboxing it. Other sandboxes
+    # of the binary are not affected.
+    native.cc_library(
+        name = name + "_passthrough",
+        linkopts = ["-ldl", "-Wl,-E"] + ["-Wl,-u," + f for f in functions],
+        deps = [
+            ":" + name,
+            ":" + name + ".lib",
+            "//sandboxed_api:passthrough",
+        ],
+        copts = default_copts,
+        **common
+    )
+
     embed_name = ""
     embed_dir = ""
     if embed:
@@ -384,6 +476,7 @@ def sapi_library(
         lib = lib,
         functions = functions,
         input_files = input_files,
+        annotations = annotations,
         out = generated_header,
         embed_name = embed_name,
         embed_dir = embed_dir,
@@ -391,5 +484,6 @@ def sapi_library(
         api_version = api_version,
         generator_version = generator_version,
         limit_scan_depth = limit_scan_depth,
+        sandboxee_malloc = malloc,
         **common
     )
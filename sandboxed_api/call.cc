@@ -0,0 +1,123 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/call.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace sapi {
+namespace {
+
+// Precedes the function name (if any) and the arguments of an encoded
+// CompactFuncCall.
+struct CompactFuncCallHeader {
+  uint32_t version;
+  uint32_t func_id;
+  uint32_t func_size;
+  v::Type ret_type;
+  uint64_t ret_size;
+  uint64_t argc;
+};
+
+void Append(const void* data, size_t size, std::vector<uint8_t>* out) {
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  out->insert(out->end(), bytes, bytes + size);
+}
+
+bool Consume(absl::Span<const uint8_t>* data, void* dst, size_t size) {
+  if (data->size() < size) {
+    return false;
+  }
+  memcpy(dst, data->data(), size);
+  data->remove_prefix(size);
+  return true;
+}
+
+}  // namespace
+
+void EncodeCompactFuncCall(const CompactFuncCall& call,
+                           std::vector<uint8_t>* out) {
+  // Structs are sent as raw bytes, so their padding is zeroed explicitly
+  // instead of leaking whatever the stack or heap held.
+  CompactFuncCallHeader header;
+  memset(&header, 0, sizeof(header));
+  header.version = CompactFuncCall::kVersion;
+  header.func_id = call.func_id;
+  // The name is only needed to resolve the function.
+  header.func_size = call.func_id == 0 ? call.func.size() : 0;
+  header.ret_type = call.ret_type;
+  header.ret_size = call.ret_size;
+  header.argc = call.args.size();
+  out->reserve(out->size() + sizeof(header) + header.func_size +
+               call.args.size() * sizeof(CompactFuncCall::Arg));
+  Append(&header, sizeof(header), out);
+  Append(call.func.data(), header.func_size, out);
+  for (const CompactFuncCall::Arg& arg : call.args) {
+    CompactFuncCall::Arg packed;
+    memset(&packed, 0, sizeof(packed));
+    packed.type = arg.type;
+    packed.aux_type = arg.aux_type;
+    packed.size = arg.size;
+    packed.aux_size = arg.aux_size;
+    memcpy(&packed.value, &arg.value, sizeof(packed.value));
+    Append(&packed, sizeof(packed), out);
+  }
+}
+
+bool DecodeCompactFuncCall(absl::Span<const uint8_t>* data,
+                           CompactFuncCall* call) {
+  CompactFuncCallHeader header;
+  if (!Consume(data, &header, sizeof(header)) ||
+      header.version != CompactFuncCall::kVersion ||
+      header.func_size > data->size() ||
+      header.argc > (data->size() - header.func_size) /
+                        sizeof(CompactFuncCall::Arg)) {
+    return false;
+  }
+  call->func.assign(reinterpret_cast<const char*>(data->data()),
+                    header.func_size);
+  data->remove_prefix(header.func_size);
+  call->func_id = header.func_id;
+  call->ret_type = header.ret_type;
+  call->ret_size = header.ret_size;
+  call->args.resize(header.argc);
+  return Consume(data, call->args.data(),
+                 header.argc * sizeof(CompactFuncCall::Arg));
+}
+
+std::string FuncCallTypeSignature(const CompactFuncCall& call) {
+  std::string signature;
+  signature.reserve(sizeof(call.ret_type) + sizeof(call.ret_size) +
+                    call.args.size() *
+                        (sizeof(CompactFuncCall::Arg::type) +
+                         sizeof(CompactFuncCall::Arg::size)));
+  const auto append = [&signature](const auto& value) {
+    signature.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+  append(call.ret_type);
+  append(call.ret_size);
+  for (const CompactFuncCall::Arg& arg : call.args) {
+    append(arg.type);
+    append(arg.size);
+  }
+  return signature;
+}
+
+}  // namespace sapi
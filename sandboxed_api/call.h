@@ -15,18 +15,47 @@
 #ifndef SANDBOXED_API_CALL_H_
 #define SANDBOXED_API_CALL_H_
 
+#include <csignal>
+#include <cstddef>
 #include <cstdint>
+#include <string>
+#include <vector>
 
+#include "absl/types/span.h"
 #include "sandboxed_api/var_type.h"
 
 namespace sapi {
 namespace comms {
 
+// Sent to the main thread of the sandboxee to interrupt a call that exceeded
+// its time limit, see Sandbox::SetCallTimeLimit(). Ignored by default, so
+// sandboxees not handling it are unaffected.
+inline constexpr int kCallCancelSignal = SIGURG;
+
+// Set in the environment of the forkserver if it is to call
+// sapi_zygote_init(), see Sandbox::RunZygoteInit().
+inline constexpr char kZygoteInitEnv[] = "SAPI_ZYGOTE_INIT";
+
 struct ReallocRequest {
   uintptr_t old_addr;
   size_t size;
 };
 
+struct ReadAndFreeRequest {
+  uintptr_t addr;
+  size_t size;
+};
+
+struct MemoryRequest {
+  uintptr_t addr;
+  size_t size;
+};
+
+struct UnmapBufferRequest {
+  uintptr_t addr;
+  size_t size;
+};
+
 // Types of TAGs used with Comms channel.
 // Call:
 constexpr uint32_t kMsgCall = 0x101;
@@ -39,11 +68,31 @@ constexpr uint32_t kMsgRecvFd = 0x107;
 constexpr uint32_t kMsgClose = 0x108;
 constexpr uint32_t kMsgReallocate = 0x109;
 constexpr uint32_t kMsgStrlen = 0x10A;
+constexpr uint32_t kMsgSharedMemory = 0x10B;
+constexpr uint32_t kMsgSendFds = 0x10C;
+constexpr uint32_t kMsgCallBatch = 0x10D;
+constexpr uint32_t kMsgCallCompact = 0x10E;
+constexpr uint32_t kMsgAllocateArena = 0x10F;
+constexpr uint32_t kMsgAllocateAndFill = 0x110;
+constexpr uint32_t kMsgReadAndFree = 0x111;
+// Not answered by the sandboxee.
+constexpr uint32_t kMsgFreeBatch = 0x112;
+constexpr uint32_t kMsgMapBuffer = 0x113;
+constexpr uint32_t kMsgUnmapBuffer = 0x114;
+constexpr uint32_t kMsgOpenCallChannel = 0x115;
+constexpr uint32_t kMsgMapFile = 0x116;
+constexpr uint32_t kMsgHeapUsage = 0x117;
+constexpr uint32_t kMsgStrlenBatch = 0x118;
+constexpr uint32_t kMsgWriteMemory = 0x119;
+constexpr uint32_t kMsgReadMemory = 0x11A;
+constexpr uint32_t kMsgMapLazyBuffer = 0x11B;
 // Return:
 constexpr uint32_t kMsgReturn = 0x201;
 
 }  // namespace comms
 
+// Fixed-size description of a call, sent with kMsgCall. Superseded by
+// CompactFuncCall, but still understood by the sandboxee.
 struct FuncCall {
   // Used with HandleCallMsg:
   enum {
@@ -86,8 +135,80 @@ struct FuncRet {
   };
   // Status of the operation: success/failure.
   bool success;
+  // Handle that can be used in CompactFuncCall::func_id for later calls of the
+  // same function, or 0.
+  uint32_t func_id;
 };
 
+// Variable-length description of a call, sent with kMsgCallCompact. Unlike
+// FuncCall, only the arguments actually passed are sent, the function name is
+// left out once the sandboxee returned a handle for it, and the number of
+// arguments is not limited.
+struct CompactFuncCall {
+  // Version of the encoding, stored in the header of every encoded call.
+  static constexpr uint32_t kVersion = 1;
+
+  struct Arg {
+    // Type of the argument.
+    v::Type type;
+    // Auxiliary type, see FuncCall::aux_type.
+    v::Type aux_type;
+    // Size (in bytes) of the argument.
+    uint64_t size;
+    // Size of the auxiliary data, see FuncCall::aux_size.
+    uint64_t aux_size;
+    // The argument value.
+    union {
+      uintptr_t arg_int;
+      long double arg_float;
+    } value;
+  };
+
+  // Function to be called. Only sent if func_id is 0.
+  std::string func;
+  // Handle of the function as returned in FuncRet::func_id by an earlier call
+  // with the same signature, or 0 to resolve the function by name.
+  uint32_t func_id = 0;
+  // Return type.
+  v::Type ret_type = v::Type::kVoid;
+  // Size of the return value (in bytes).
+  uint64_t ret_size = 0;
+  std::vector<Arg> args;
+};
+
+// Description of a function known when its Sandboxed API is generated. The
+// generator emits one per function, so that calls needn't look up the function
+// handle by name and type signature, see Sandbox::CallWithDescriptor().
+struct CallDescriptor {
+  struct Arg {
+    // Type of the value.
+    v::Type type;
+    // Size (in bytes) of the value.
+    size_t size;
+  };
+
+  // Name of the function.
+  const char* func;
+  // Return type, with size.
+  Arg ret;
+  // Argument types, with sizes.
+  absl::Span<const Arg> args;
+};
+
+// Appends the encoding of `call` to `out`.
+void EncodeCompactFuncCall(const CompactFuncCall& call,
+                           std::vector<uint8_t>* out);
+
+// Decodes a call encoded with EncodeCompactFuncCall() from the beginning of
+// `data` and advances `data` past it. Returns false if the data is malformed
+// or uses an unsupported version.
+bool DecodeCompactFuncCall(absl::Span<const uint8_t>* data,
+                           CompactFuncCall* call);
+
+// Returns a key identifying the return and argument types of `call`. Calls of
+// the same function with the same types can reuse the same function handle.
+std::string FuncCallTypeSignature(const CompactFuncCall& call);
+
 }  // namespace sapi
 
 #endif  // SANDBOXED_API_CALL_H_
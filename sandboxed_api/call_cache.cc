@@ -0,0 +1,197 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/call_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/call.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/util/metrics.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_type.h"
+#include "sandboxed_api/vars.h"
+
+namespace sapi {
+namespace {
+
+void AppendBytes(const void* data, size_t size, std::string* out) {
+  out->append(static_cast<const char*>(data), size);
+}
+
+void AppendSize(uint64_t size, std::string* out) {
+  AppendBytes(&size, sizeof(size), out);
+}
+
+// Returns whether the pointed to variable only holds plain bytes.
+bool IsPlainVar(const v::Var& var) {
+  switch (var.GetType()) {
+    case v::Type::kInt:
+    case v::Type::kFloat:
+    case v::Type::kPointer:
+    case v::Type::kStruct:
+    case v::Type::kArray:
+      return var.GetLocal() != nullptr || var.GetSize() == 0;
+    default:
+      return false;
+  }
+}
+
+// Appends the arguments of a call to `key`, and collects the variables it
+// writes. Returns false if the call cannot be memoized.
+bool BuildKey(const CallDescriptor& descriptor, v::Callable* ret,
+              std::initializer_list<v::Callable*> args, std::string* key,
+              std::vector<v::Var*>* outputs) {
+  if (ret->GetType() == v::Type::kFd) {
+    return false;
+  }
+  key->append(descriptor.func);
+  key->push_back('\0');
+  for (v::Callable* arg : args) {
+    if (dynamic_cast<v::NullPtr*>(arg) != nullptr) {
+      key->push_back('n');
+      continue;
+    }
+    auto* ptr = dynamic_cast<v::Ptr*>(arg);
+    if (ptr == nullptr) {
+      if (arg->GetType() == v::Type::kFd) {
+        return false;
+      }
+      key->push_back('v');
+      AppendSize(arg->GetSize(), key);
+      AppendBytes(arg->GetDataPtr(), arg->GetSize(), key);
+      continue;
+    }
+    v::Var* var = ptr->GetPointedVar();
+    const v::Var::SyncType sync = ptr->GetSyncType();
+    if (sync == v::Var::kSyncNone || !IsPlainVar(*var)) {
+      return false;
+    }
+    key->push_back('0' + sync);
+    AppendSize(var->GetSize(), key);
+    if (sync & v::Var::kSyncBefore) {
+      AppendBytes(var->GetLocal(), var->GetSize(), key);
+    }
+    if (sync & v::Var::kSyncAfter) {
+      outputs->push_back(var);
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::Status CallCache::Call(Sandbox* sandbox,
+                             const CallDescriptor& descriptor,
+                             v::Callable* ret,
+                             std::initializer_list<v::Callable*> args) {
+  std::string key;
+  std::vector<v::Var*> outputs;
+  if (!BuildKey(descriptor, ret, args, &key, &outputs)) {
+    {
+      absl::MutexLock lock(&mutex_);
+      ++stats_.uncacheable;
+    }
+    return sandbox->CallWithDescriptor(descriptor, ret, args);
+  }
+
+  bool hit = false;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      hit = true;
+      ++stats_.hits;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      // Written while holding the lock, the entry may be evicted otherwise.
+      absl::string_view results = it->second->results;
+      ret->SetDataFromPtr(results.data(), ret->GetSize());
+      results.remove_prefix(ret->GetSize());
+      for (v::Var* var : outputs) {
+        uint64_t length;
+        memcpy(&length, results.data(), sizeof(length));
+        results.remove_prefix(sizeof(length));
+        memcpy(var->GetLocal(), results.data(), length);
+        results.remove_prefix(length);
+        var->MarkModified();
+      }
+    } else {
+      ++stats_.misses;
+    }
+  }
+  metrics::IncrementCounter(
+      hit ? metrics::kCallCacheHits : metrics::kCallCacheMisses,
+      descriptor.func);
+  if (hit) {
+    return absl::OkStatus();
+  }
+
+  SAPI_RETURN_IF_ERROR(sandbox->CallWithDescriptor(descriptor, ret, args));
+  std::string results;
+  AppendBytes(ret->GetDataPtr(), ret->GetSize(), &results);
+  for (const v::Var* var : outputs) {
+    // Only what was copied back, the rest of the variable is not a result.
+    SAPI_ASSIGN_OR_RETURN(uint64_t length, Sandbox::GetValidLength(*var));
+    length = std::min<uint64_t>(length, var->GetSize());
+    AppendSize(length, &results);
+    AppendBytes(var->GetLocal(), length, &results);
+  }
+  absl::MutexLock lock(&mutex_);
+  Insert(std::move(key), std::move(results));
+  return absl::OkStatus();
+}
+
+void CallCache::Insert(std::string key, std::string results) {
+  const size_t size = key.size() + results.size();
+  if (size > options_.max_bytes || options_.max_entries == 0 ||
+      index_.contains(key)) {
+    return;
+  }
+  while (!entries_.empty() && (entries_.size() >= options_.max_entries ||
+                               stats_.bytes + size > options_.max_bytes)) {
+    const Entry& last = entries_.back();
+    stats_.bytes -= last.key.size() + last.results.size();
+    index_.erase(last.key);
+    entries_.pop_back();
+    ++stats_.evictions;
+  }
+  entries_.push_front({std::move(key), std::move(results)});
+  index_.emplace(entries_.front().key, entries_.begin());
+  stats_.bytes += size;
+}
+
+CallCacheStats CallCache::stats() const {
+  absl::MutexLock lock(&mutex_);
+  CallCacheStats stats = stats_;
+  stats.entries = entries_.size();
+  return stats;
+}
+
+void CallCache::Clear() {
+  absl::MutexLock lock(&mutex_);
+  index_.clear();
+  entries_.clear();
+  stats_.bytes = 0;
+}
+
+}  // namespace sapi
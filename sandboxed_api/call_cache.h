@@ -0,0 +1,107 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_CALL_CACHE_H_
+#define SANDBOXED_API_CALL_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <list>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/call.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/var_type.h"
+#include "sandboxed_api/vars.h"
+
+namespace sapi {
+
+struct CallCacheOptions {
+  // Least recently used results are dropped beyond this many.
+  size_t max_entries = 1024;
+  // Or once all of them, with their arguments, take up more bytes than this.
+  size_t max_bytes = 16 << 20;
+};
+
+struct CallCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  // Calls made without the cache, as their arguments cannot be compared, see
+  // CallCache::Call().
+  uint64_t uncacheable = 0;
+  uint64_t evictions = 0;
+  size_t entries = 0;
+  size_t bytes = 0;
+};
+
+// Memoizes the results of a sandboxed function that is pure, i.e. whose
+// results only depend on its arguments. Repeated calls with the same
+// arguments are answered on the host, without a round trip to the sandboxee.
+// The Sandboxed API generator emits one per function annotated with
+// "memoize". Thread-safe, and may be shared by sandboxes of the same library.
+//
+// Arguments are the same if their bytes are, for pointers synchronized before
+// the call those of the variables pointed to. Pointed to variables which are
+// only synchronized after the call are outputs, and only their sizes count.
+// Pointers inside of the variables are compared as addresses, not by what
+// they point to. Results are the return value and the outputs, which must not
+// refer to memory of the sandboxee.
+class CallCache {
+ public:
+  explicit CallCache(const CallCacheOptions& options = {})
+      : options_(options) {}
+
+  CallCache(const CallCache&) = delete;
+  CallCache& operator=(const CallCache&) = delete;
+
+  // Like Sandbox::CallWithDescriptor(), but returns the results of an earlier
+  // successful call with the same arguments if there was one, and keeps
+  // those of this call otherwise. Calls are made without the cache if they
+  // pass FDs, remote pointers or unsynchronized ones.
+  absl::Status Call(Sandbox* sandbox, const CallDescriptor& descriptor,
+                    v::Callable* ret, std::initializer_list<v::Callable*> args);
+
+  CallCacheStats stats() const;
+
+  // Drops all results, e.g. after the library was updated or reconfigured.
+  void Clear();
+
+ private:
+  struct Entry {
+    std::string key;
+    // The return value followed by the outputs, in the order of the args.
+    std::string results;
+  };
+
+  void Insert(std::string key, std::string results)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const CallCacheOptions options_;
+  mutable absl::Mutex mutex_;
+  // Most recently used first. The keys of index_ point into the entries.
+  std::list<Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<absl::string_view, std::list<Entry>::iterator> index_
+      ABSL_GUARDED_BY(mutex_);
+  CallCacheStats stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_CALL_CACHE_H_
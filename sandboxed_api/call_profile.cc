@@ -0,0 +1,83 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/call_profile.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace sapi {
+
+CallStats& CallStats::operator+=(const CallStats& other) {
+  samples += other.samples;
+  marshalling += other.marshalling;
+  transfer += other.transfer;
+  execution += other.execution;
+  unmarshalling += other.unmarshalling;
+  bytes_to_sandboxee += other.bytes_to_sandboxee;
+  bytes_from_sandboxee += other.bytes_from_sandboxee;
+  return *this;
+}
+
+void CallProfiler::Record(absl::string_view func, const CallStats& stats) {
+  absl::MutexLock lock(&mutex_);
+  stats_[func] += stats;
+}
+
+absl::flat_hash_map<std::string, CallStats> CallProfiler::GetStats() const {
+  absl::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+std::string CallProfiler::GetReport() const {
+  std::vector<std::pair<std::string, CallStats>> sorted;
+  {
+    absl::MutexLock lock(&mutex_);
+    sorted.assign(stats_.begin(), stats_.end());
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+    return a.second.total() > b.second.total();
+  });
+
+  auto share = [](absl::Duration part, absl::Duration total) {
+    return total > absl::ZeroDuration() ? 100.0 * absl::FDivDuration(part, total) : 0.0;
+  };
+  std::string report = absl::StrFormat(
+      "%-32s %10s %12s %8s %8s %8s %8s %14s %14s\n", "function", "calls",
+      "avg_us", "marsh%", "xfer%", "exec%", "ret%", "avg_bytes_to",
+      "avg_bytes_from");
+  for (const auto& [func, stats] : sorted) {
+    const absl::Duration total = stats.total();
+    absl::StrAppendFormat(
+        &report, "%-32s %10d %12.1f %8.1f %8.1f %8.1f %8.1f %14d %14d\n", func,
+        stats.samples * interval_,
+        absl::ToDoubleMicroseconds(total) / stats.samples,
+        share(stats.marshalling, total), share(stats.transfer, total),
+        share(stats.execution, total), share(stats.unmarshalling, total),
+        stats.bytes_to_sandboxee / stats.samples,
+        stats.bytes_from_sandboxee / stats.samples);
+  }
+  return report;
+}
+
+}  // namespace sapi
@@ -0,0 +1,103 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_CALL_PROFILE_H_
+#define SANDBOXED_API_CALL_PROFILE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace sapi {
+
+// Where the wall time of calls to the sandboxee went, summed over the
+// profiled calls of a function.
+struct CallStats {
+  uint64_t samples = 0;
+  // Filling in the call on the host.
+  absl::Duration marshalling;
+  // Allocating and copying the memory of pointers, and passing FDs, in both
+  // directions.
+  absl::Duration transfer;
+  // From sending the call until the sandboxee replied.
+  absl::Duration execution;
+  // Storing the return value.
+  absl::Duration unmarshalling;
+  uint64_t bytes_to_sandboxee = 0;
+  uint64_t bytes_from_sandboxee = 0;
+
+  absl::Duration total() const {
+    return marshalling + transfer + execution + unmarshalling;
+  }
+
+  CallStats& operator+=(const CallStats& other);
+};
+
+// Adds the time between construction and destruction to `*duration`, unless
+// that is nullptr.
+class ScopedCallTimer {
+ public:
+  explicit ScopedCallTimer(absl::Duration* duration)
+      : duration_(duration),
+        start_(duration ? absl::Now() : absl::InfinitePast()) {}
+  ScopedCallTimer(const ScopedCallTimer&) = delete;
+  ScopedCallTimer& operator=(const ScopedCallTimer&) = delete;
+  ~ScopedCallTimer() {
+    if (duration_) {
+      *duration_ += absl::Now() - start_;
+    }
+  }
+
+ private:
+  absl::Duration* duration_;
+  absl::Time start_;
+};
+
+// Samples calls to the sandboxee and accumulates their CallStats by function
+// name, see Sandbox::GetCallProfilingInterval(). Thread-safe.
+class CallProfiler {
+ public:
+  // Profiles every `interval`th call.
+  explicit CallProfiler(int interval) : interval_(interval) {}
+
+  // Returns whether the next call is to be profiled.
+  bool ShouldSample() {
+    return next_call_.fetch_add(1, std::memory_order_relaxed) % interval_ == 0;
+  }
+
+  void Record(absl::string_view func, const CallStats& stats);
+
+  absl::flat_hash_map<std::string, CallStats> GetStats() const;
+
+  // Returns a table of the profiled functions, most expensive first. Calls
+  // are estimated from the samples times the sampling interval.
+  std::string GetReport() const;
+
+ private:
+  const int interval_;
+  std::atomic<uint64_t> next_call_ = 0;
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, CallStats> stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_CALL_PROFILE_H_
@@ -0,0 +1,36 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SANDBOXED_API_CANCELLATION_H_
+#define SANDBOXED_API_CANCELLATION_H_
+
+// Can be included by sandboxed libraries, including C ones, to stop work
+// early when the host interrupts a call that exceeded the limit of
+// Sandbox::SetCallTimeLimit(). Blocking syscalls made by the call fail with
+// EINTR at that point, long-running loops should poll this periodically.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns non-zero if the host interrupted the current call. Only calls
+// served by the main thread of the sandboxee can be interrupted.
+int sapi_call_cancelled(void);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // SANDBOXED_API_CANCELLATION_H_
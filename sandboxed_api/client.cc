@@ -12,35 +12,64 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "sandboxed_api/sandbox2/client.h"
+#include "sandboxed_api/client.h"
 
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <linux/userfaultfd.h>
+#include <malloc.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <iterator>
 #include <list>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
 #include <vector>
 
+#include "google/protobuf/arena.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/message.h"
 #include "absl/base/dynamic_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/flags/parse.h"
 #include "absl/log/check.h"
 #include "absl/log/initialize.h"
 #include "absl/log/log.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/call.h"
+#include "sandboxed_api/cancellation.h"
+#include "sandboxed_api/config.h"
 #include "sandboxed_api/lenval_core.h"
 #include "sandboxed_api/proto_arg.pb.h"
 #include "sandboxed_api/proto_helper.h"
+#include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/forkingclient.h"
 #include "sandboxed_api/sandbox2/logsink.h"
+#include "sandboxed_api/static_symbols.h"
 #include "sandboxed_api/util/raw_logging.h"
 
 #include <ffi.h>
 
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+
 namespace sapi {
 namespace {
 
@@ -86,31 +115,102 @@ ffi_type* GetFFIType(size_t size, v::Type type) {
   }
 }
 
+// Calls with up to this many arguments can bypass libffi, see
+// CallWithRegisterArgs().
+constexpr size_t kMaxRegisterArgs = 6;
+
+// Returns whether values of the type are passed and returned in a single
+// general-purpose register.
+bool IsRegisterType(size_t size, v::Type type) {
+  return (type == v::Type::kInt || type == v::Type::kPointer ||
+          type == v::Type::kFd) &&
+         size <= sizeof(uintptr_t);
+}
+
+// Returns whether calls with the given types can use CallWithRegisterArgs().
+// The caller-side casts rely on integers and pointers being passed in the
+// first general-purpose registers regardless of their size, which only holds
+// for the ABIs checked here.
+bool IsRegisterOnlyCall(const CompactFuncCall& call) {
+  if (!host_cpu::IsX8664() && !host_cpu::IsArm64()) {
+    return false;
+  }
+  if (call.args.size() > kMaxRegisterArgs ||
+      (call.ret_type != v::Type::kVoid &&
+       !IsRegisterType(call.ret_size, call.ret_type))) {
+    return false;
+  }
+  for (const CompactFuncCall::Arg& arg : call.args) {
+    if (!IsRegisterType(arg.size, arg.type)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Widens a value to a full register the way libffi does for the ffi_type
+// that GetFFIType() returns: file descriptors are sign-extended, all other
+// integers zero-extended.
+uintptr_t WidenRegister(uintptr_t value, size_t size, v::Type type) {
+  if (type == v::Type::kFd) {
+    return static_cast<uintptr_t>(
+        static_cast<intptr_t>(static_cast<int>(value)));
+  }
+  if (size >= sizeof(uintptr_t)) {
+    return value;
+  }
+  return value & ((uintptr_t{1} << (size * 8)) - 1);
+}
+
+// Calls `f` with integer and pointer arguments only, through a function type
+// selected by the number of arguments. Saves preparing the argument arrays
+// and ffi_call() for the signatures of most generated APIs.
+uintptr_t CallWithRegisterArgs(void* f, const uintptr_t* args, size_t argc) {
+  using R = uintptr_t;
+  switch (argc) {
+    case 0:
+      return reinterpret_cast<R (*)()>(f)();
+    case 1:
+      return reinterpret_cast<R (*)(R)>(f)(args[0]);
+    case 2:
+      return reinterpret_cast<R (*)(R, R)>(f)(args[0], args[1]);
+    case 3:
+      return reinterpret_cast<R (*)(R, R, R)>(f)(args[0], args[1], args[2]);
+    case 4:
+      return reinterpret_cast<R (*)(R, R, R, R)>(f)(args[0], args[1], args[2],
+                                                     args[3]);
+    case 5:
+      return reinterpret_cast<R (*)(R, R, R, R, R)>(f)(args[0], args[1],
+                                                        args[2], args[3],
+                                                        args[4]);
+    case 6:
+      return reinterpret_cast<R (*)(R, R, R, R, R, R)>(f)(
+          args[0], args[1], args[2], args[3], args[4], args[5]);
+    default:
+      LOG(FATAL) << "Too many register arguments: " << argc;
+  }
+}
+
 // Provides an interface to prepare the arguments for a function call.
 // In case of protobuf arguments, the class allocates and manages
 // memory for the deserialized protobuf.
 class FunctionCallPreparer {
  public:
-  explicit FunctionCallPreparer(const FuncCall& call) {
-    CHECK(call.argc <= FuncCall::kArgsMax)
-        << "Number of arguments of a sandbox call exceeds limits.";
-    for (int i = 0; i < call.argc; ++i) {
-      arg_types_[i] = GetFFIType(call.arg_size[i], call.arg_type[i]);
-    }
-    ret_type_ = GetFFIType(call.ret_size, call.ret_type);
-    for (int i = 0; i < call.argc; ++i) {
-      if (call.arg_type[i] == v::Type::kPointer &&
-          call.aux_type[i] == v::Type::kProto) {
+  explicit FunctionCallPreparer(const CompactFuncCall& call)
+      : arg_values_(call.args.size()) {
+    for (size_t i = 0; i < call.args.size(); ++i) {
+      const CompactFuncCall::Arg& arg = call.args[i];
+      if (arg.type == v::Type::kPointer && arg.aux_type == v::Type::kProto) {
         // Deserialize protobuf stored in the LenValueStruct and keep a
         // reference to both. This way we are able to update the content of the
         // LenValueStruct (when the sandboxee modifies the protobuf).
         // This will also make sure that the protobuf is freed afterwards.
         arg_values_[i] = GetDeserializedProto(
-            reinterpret_cast<LenValStruct*>(call.args[i].arg_int));
-      } else if (call.arg_type[i] == v::Type::kFloat) {
-        arg_values_[i] = reinterpret_cast<const void*>(&call.args[i].arg_float);
+            reinterpret_cast<LenValStruct*>(arg.value.arg_int));
+      } else if (arg.type == v::Type::kFloat) {
+        arg_values_[i] = reinterpret_cast<const void*>(&arg.value.arg_float);
       } else {
-        arg_values_[i] = reinterpret_cast<const void*>(&call.args[i].arg_int);
+        arg_values_[i] = reinterpret_cast<const void*>(&arg.value.arg_int);
       }
     }
   }
@@ -134,49 +234,90 @@ class FunctionCallPreparer {
         lvs->data = newdata;
       }
       memcpy(lvs->data, serialized.data(), serialized.size());
-
-      delete proto;
     }
+    // The deserialized protobufs are owned by arena_.
   }
 
-  ffi_type* ret_type() const { return ret_type_; }
-  ffi_type** arg_types() const { return const_cast<ffi_type**>(arg_types_); }
-  void** arg_values() const { return const_cast<void**>(arg_values_); }
+  void** arg_values() const {
+    return const_cast<void**>(arg_values_.data());
+  }
 
  private:
   // Deserializes the protobuf argument.
   google::protobuf::MessageLite** GetDeserializedProto(LenValStruct* src) {
-    ProtoArg proto_arg;
-    if (!proto_arg.ParseFromArray(src->data, src->size)) {
+    auto* proto_arg = google::protobuf::Arena::CreateMessage<ProtoArg>(&arena_);
+    if (!proto_arg->ParseFromArray(src->data, src->size)) {
       LOG(FATAL) << "Unable to parse ProtoArg.";
     }
     const google::protobuf::Descriptor* desc =
         google::protobuf::DescriptorPool::generated_pool()->FindMessageTypeByName(
-            proto_arg.full_name());
+            proto_arg->full_name());
     LOG_IF(FATAL, desc == nullptr) << "Unable to find the descriptor for '"
-                                   << proto_arg.full_name() << "'" << desc;
+                                   << proto_arg->full_name() << "'" << desc;
     google::protobuf::MessageLite* deserialized_proto =
-        google::protobuf::MessageFactory::generated_factory()->GetPrototype(desc)->New();
+        google::protobuf::MessageFactory::generated_factory()->GetPrototype(desc)->New(
+            &arena_);
     LOG_IF(FATAL, deserialized_proto == nullptr)
-        << "Unable to create deserialized proto for " << proto_arg.full_name();
-    if (!deserialized_proto->ParseFromString(proto_arg.protobuf_data())) {
+        << "Unable to create deserialized proto for " << proto_arg->full_name();
+    if (!deserialized_proto->ParseFromString(proto_arg->protobuf_data())) {
       LOG(FATAL) << "Unable to deserialized proto for "
-                 << proto_arg.full_name();
+                 << proto_arg->full_name();
     }
     protos_to_be_destroyed_.push_back({src, deserialized_proto});
     return &protos_to_be_destroyed_.back().second;
   }
 
+  // Holds the envelopes and deserialized protobufs of all arguments of a call,
+  // so that they are released at once.
+  google::protobuf::Arena arena_;
   // Use list instead of vector to preserve references even with modifications.
   // Contains pairs of lenval message pointer -> deserialized message
   // so that we can serialize the argument again after the function call.
   std::list<std::pair<LenValStruct*, google::protobuf::MessageLite*>>
       protos_to_be_destroyed_;
-  ffi_type* ret_type_;
-  ffi_type* arg_types_[FuncCall::kArgsMax];
-  const void* arg_values_[FuncCall::kArgsMax];
+  std::vector<const void*> arg_values_;
+};
+
+// A resolved function together with its prepared call interface.
+struct CachedFunction {
+  uint32_t id;
+  // See FuncCallTypeSignature().
+  std::string type_signature;
+  void* f;
+  // Whether calls can use CallWithRegisterArgs() instead of libffi.
+  bool register_only;
+  ffi_cif cif;
+  ffi_type* ret_type;
+  std::vector<ffi_type*> arg_types;
+};
+
+// Functions called so far, so that neither dlsym() nor ffi_prep_cif() need to
+// run again for later calls. Function handles are indices into `functions`
+// plus one.
+struct FunctionCache {
+  // Calls can be served by several threads, see HandleOpenCallChannelMsg().
+  absl::Mutex mutex;
+  // Function handles by name and type signature.
+  absl::flat_hash_map<std::string, uint32_t> ids;
+  // Entries are never moved, as `cif` points to `arg_types`.
+  std::vector<std::unique_ptr<CachedFunction>> functions;
 };
 
+FunctionCache& GetFunctionCache() {
+  static auto* cache = new FunctionCache();
+  return *cache;
+}
+
+// Set by comms::kCallCancelSignal, which the host only sends to the main
+// thread, see sapi_call_cancelled().
+thread_local volatile sig_atomic_t call_cancelled = 0;
+
+void HandleCallCancelSignal(int) { call_cancelled = 1; }
+
+// Set once the stub serves a sandboxer of the same process, where exit
+// requests must not end the process, see ServeInProcess().
+std::atomic<bool> serving_in_process = false;
+
 }  // namespace
 
 namespace client {
@@ -189,51 +330,193 @@ enum class Error : uintptr_t {
   kCall,
 };
 
+// Sets `*address` to the address of the function or variable `name`, or to
+// nullptr if there is none. Returns false if the symbols can't be searched at
+// all.
+bool LookupSymbol(const char* name, void** address) {
+  if (sapi_static_symbols != nullptr) {
+    *address = nullptr;
+    for (const SapiStaticSymbol* symbol = sapi_static_symbols;
+         symbol->name != nullptr; ++symbol) {
+      if (strcmp(symbol->name, name) == 0) {
+        *address = symbol->address;
+        break;
+      }
+    }
+    return true;
+  }
+  void* handle = dlopen(nullptr, RTLD_NOW);
+  if (handle == nullptr) {
+    return false;
+  }
+  *address = dlsym(handle, name);
+  return true;
+}
+
+// Returns the function to be called by `call` with its call interface,
+// resolving and caching it on first use. Returns nullptr on error.
+CachedFunction* GetFunction(const CompactFuncCall& call, Error* error) {
+  FunctionCache& cache = GetFunctionCache();
+  absl::MutexLock lock(&cache.mutex);
+  std::string type_signature = FuncCallTypeSignature(call);
+  if (call.func_id != 0) {
+    // The name isn't sent along with a handle, so only the types can be
+    // checked.
+    if (call.func_id > cache.functions.size() ||
+        cache.functions[call.func_id - 1]->type_signature != type_signature) {
+      LOG(ERROR) << "Invalid function handle " << call.func_id;
+      *error = Error::kDlSym;
+      return nullptr;
+    }
+    return cache.functions[call.func_id - 1].get();
+  }
+  std::string key = absl::StrCat(call.func, absl::string_view("\0", 1),
+                                 type_signature);
+  if (auto it = cache.ids.find(key); it != cache.ids.end()) {
+    return cache.functions[it->second - 1].get();
+  }
+
+  auto func = std::make_unique<CachedFunction>();
+  if (!LookupSymbol(call.func.c_str(), &func->f)) {
+    LOG(ERROR) << "dlopen(nullptr, RTLD_NOW)";
+    *error = Error::kDlOpen;
+    return nullptr;
+  }
+  if (func->f == nullptr) {
+    LOG(ERROR) << "Function '" << call.func << "' not found";
+    *error = Error::kDlSym;
+    return nullptr;
+  }
+  func->register_only = IsRegisterOnlyCall(call);
+  func->arg_types.reserve(call.args.size());
+  for (const CompactFuncCall::Arg& arg : call.args) {
+    func->arg_types.push_back(GetFFIType(arg.size, arg.type));
+  }
+  func->ret_type = GetFFIType(call.ret_size, call.ret_type);
+  if (ffi_prep_cif(&func->cif, FFI_DEFAULT_ABI, func->arg_types.size(),
+                   func->ret_type, func->arg_types.data()) != FFI_OK) {
+    *error = Error::kCall;
+    return nullptr;
+  }
+  func->id = cache.functions.size() + 1;
+  func->type_signature = std::move(type_signature);
+  cache.ids.emplace(std::move(key), func->id);
+  cache.functions.push_back(std::move(func));
+  return cache.functions.back().get();
+}
+
+// Converts a call received in the fixed-size format.
+CompactFuncCall FromFuncCall(const FuncCall& call) {
+  CHECK(call.argc <= FuncCall::kArgsMax)
+      << "Number of arguments of a sandbox call exceeds limits.";
+  CompactFuncCall compact;
+  compact.func.assign(call.func, strnlen(call.func, sizeof(call.func)));
+  compact.ret_type = call.ret_type;
+  compact.ret_size = call.ret_size;
+  compact.args.resize(call.argc);
+  for (size_t i = 0; i < call.argc; ++i) {
+    CompactFuncCall::Arg& arg = compact.args[i];
+    arg.type = call.arg_type[i];
+    arg.aux_type = call.aux_type[i];
+    arg.size = call.arg_size[i];
+    arg.aux_size = call.aux_size[i];
+    memcpy(&arg.value, &call.args[i], sizeof(arg.value));
+  }
+  return compact;
+}
+
 // Handles requests to make function calls.
-void HandleCallMsg(const FuncCall& call, FuncRet* ret) {
-  VLOG(1) << "HandleMsgCall, func: '" << call.func
-          << "', # of args: " << call.argc;
+void HandleCallMsg(const CompactFuncCall& call, FuncRet* ret) {
+  VLOG(1) << "HandleMsgCall, func: '" << call.func << "' (" << call.func_id
+          << "), # of args: " << call.args.size();
 
   ret->ret_type = call.ret_type;
+  call_cancelled = 0;
 
-  void* handle = dlopen(nullptr, RTLD_NOW);
-  if (handle == nullptr) {
-    LOG(ERROR) << "dlopen(nullptr, RTLD_NOW)";
+  Error error = Error::kUnset;
+  CachedFunction* func = GetFunction(call, &error);
+  if (func == nullptr) {
     ret->success = false;
-    ret->int_val = static_cast<uintptr_t>(Error::kDlOpen);
+    ret->int_val = static_cast<uintptr_t>(error);
     return;
   }
+  ret->func_id = func->id;
 
-  auto f = dlsym(handle, call.func);
-  if (f == nullptr) {
-    LOG(ERROR) << "Function '" << call.func << "' not found";
-    ret->success = false;
-    ret->int_val = static_cast<uintptr_t>(Error::kDlSym);
+  // Protobuf arguments need to be deserialized by FunctionCallPreparer. Their
+  // type is not part of the type signature, so this is checked per call.
+  if (func->register_only &&
+      std::none_of(call.args.begin(), call.args.end(),
+                   [](const CompactFuncCall::Arg& arg) {
+                     return arg.aux_type == v::Type::kProto;
+                   })) {
+    uintptr_t args[kMaxRegisterArgs];
+    for (size_t i = 0; i < call.args.size(); ++i) {
+      const CompactFuncCall::Arg& arg = call.args[i];
+      args[i] = WidenRegister(arg.value.arg_int, arg.size, arg.type);
+    }
+    uintptr_t result = CallWithRegisterArgs(func->f, args, call.args.size());
+    if (ret->ret_type != v::Type::kVoid) {
+      ret->int_val = WidenRegister(result, call.ret_size, call.ret_type);
+    }
+    ret->success = true;
     return;
   }
+
   FunctionCallPreparer arg_prep(call);
-  ffi_cif cif;
-  if (ffi_prep_cif(&cif, FFI_DEFAULT_ABI, call.argc, arg_prep.ret_type(),
-                   arg_prep.arg_types()) != FFI_OK) {
+  if (ret->ret_type == v::Type::kFloat) {
+    ffi_call(&func->cif, FFI_FN(func->f), &ret->float_val,
+             arg_prep.arg_values());
+  } else {
+    ffi_call(&func->cif, FFI_FN(func->f), &ret->int_val,
+             arg_prep.arg_values());
+  }
+
+  ret->success = true;
+}
+
+// Handles requests to make function calls in the compact encoding.
+void HandleCallCompactMsg(absl::Span<const uint8_t> bytes, FuncRet* ret) {
+  CompactFuncCall call;
+  if (!DecodeCompactFuncCall(&bytes, &call) || !bytes.empty()) {
+    LOG(ERROR) << "Malformed or unsupported call encoding";
     ret->success = false;
     ret->int_val = static_cast<uintptr_t>(Error::kCall);
     return;
   }
+  HandleCallMsg(call, ret);
+}
 
-  if (ret->ret_type == v::Type::kFloat) {
-    ffi_call(&cif, FFI_FN(f), &ret->float_val, arg_prep.arg_values());
-  } else {
-    ffi_call(&cif, FFI_FN(f), &ret->int_val, arg_prep.arg_values());
+// Handles a batch of calls in the compact encoding, sending back the results
+// of all calls up to and including the first failing one. Returns false if
+// sending them failed, like the handlers below that send their own reply.
+bool HandleCallBatchMsg(sandbox2::Comms* comms,
+                        absl::Span<const uint8_t> bytes) {
+  std::vector<FuncRet> rets;
+  CompactFuncCall call;
+  while (!bytes.empty()) {
+    FuncRet& ret = rets.emplace_back();  // Value-init zeroes struct padding
+    if (!DecodeCompactFuncCall(&bytes, &call)) {
+      LOG(ERROR) << "Malformed or unsupported call encoding";
+      ret.success = false;
+      ret.int_val = static_cast<uintptr_t>(Error::kCall);
+      break;
+    }
+    HandleCallMsg(call, &ret);
+    if (!ret.success) {
+      break;
+    }
   }
-
-  ret->success = true;
+  VLOG(1) << "Executed " << rets.size() << " batched calls";
+  return comms->SendTLV(comms::kMsgReturn, rets.size() * sizeof(FuncRet),
+                        rets.data());
 }
 
 // Handles requests to allocate memory inside the sandboxee.
 void HandleAllocMsg(const size_t size, FuncRet* ret) {
   VLOG(1) << "HandleAllocMsg: size=" << size;
 
-  const void* allocated = malloc(size);
+  // malloc(0) may return nullptr, which the sandboxer takes for a failure.
+  const void* allocated = malloc(std::max<size_t>(size, 1));
   // Memory is copied to the pointer using an API that the memory sanitizer
   // is blind to (process_vm_writev). Mark the memory as initialized here, so
   // that the sandboxed code can still be tested using MSAN.
@@ -244,12 +527,61 @@ void HandleAllocMsg(const size_t size, FuncRet* ret) {
   ret->success = true;
 }
 
+// Region from which the sandboxer hands out memory without asking the
+// sandboxee, see HandleAllocArenaMsg().
+struct AllocationArena {
+  uintptr_t begin = 0;
+  size_t size = 0;
+
+  bool Contains(uintptr_t ptr) const {
+    return ptr >= begin && ptr - begin < size;
+  }
+};
+
+AllocationArena& GetAllocationArena() {
+  static auto* arena = new AllocationArena();
+  return *arena;
+}
+
+// Handles requests to reserve a region the sandboxer allocates memory from
+// by itself. Replaces any previous region.
+void HandleAllocArenaMsg(const size_t size, FuncRet* ret) {
+  VLOG(1) << "HandleAllocArenaMsg: size=" << size;
+
+  AllocationArena& arena = GetAllocationArena();
+  free(reinterpret_cast<void*>(arena.begin));
+  void* allocated = malloc(size);
+  // See HandleAllocMsg().
+  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(allocated, size);
+  arena.begin = reinterpret_cast<uintptr_t>(allocated);
+  arena.size = allocated != nullptr ? size : 0;
+
+  ret->ret_type = v::Type::kPointer;
+  ret->int_val = arena.begin;
+  ret->success = true;
+}
+
+// Moves memory allocated from the arena to the heap. The size of the original
+// allocation is unknown, so as much as fits is copied from the arena.
+void* ReallocFromArena(uintptr_t ptr, size_t size) {
+  const AllocationArena& arena = GetAllocationArena();
+  void* reallocated = malloc(size);
+  if (reallocated != nullptr) {
+    memcpy(reallocated, reinterpret_cast<const void*>(ptr),
+           std::min(size, arena.begin + arena.size - ptr));
+  }
+  return reallocated;
+}
+
 // Like HandleAllocMsg(), but handles requests to reallocate memory.
 void HandleReallocMsg(uintptr_t ptr, size_t size, FuncRet* ret) {
   VLOG(1) << "HandleReallocMsg(" << absl::StrCat(absl::Hex(ptr)) << ", " << size
           << ")";
 
-  const void* reallocated = realloc(reinterpret_cast<void*>(ptr), size);
+  const void* reallocated =
+      GetAllocationArena().Contains(ptr)
+          ? ReallocFromArena(ptr, size)
+          : realloc(reinterpret_cast<void*>(ptr), size);
   // Memory is copied to the pointer using an API that the memory sanitizer
   // is blind to (process_vm_writev). Mark the memory as initialized here, so
   // that the sandboxed code can still be tested using MSAN.
@@ -265,24 +597,97 @@ void HandleReallocMsg(uintptr_t ptr, size_t size, FuncRet* ret) {
 void HandleFreeMsg(uintptr_t ptr, FuncRet* ret) {
   VLOG(1) << "HandleFreeMsg: free(0x" << absl::StrCat(absl::Hex(ptr)) << ")";
 
-  free(reinterpret_cast<void*>(ptr));
+  // Memory from the arena is released in bulk.
+  if (!GetAllocationArena().Contains(ptr)) {
+    free(reinterpret_cast<void*>(ptr));
+  }
   ret->ret_type = v::Type::kVoid;
   ret->success = true;
   ret->int_val = 0ULL;
 }
 
+// Handles requests to allocate memory and fill it with the received data.
+void HandleAllocAndFillMsg(absl::Span<const uint8_t> bytes, FuncRet* ret) {
+  VLOG(1) << "HandleAllocAndFillMsg: size=" << bytes.size();
+
+  // See HandleAllocMsg().
+  void* allocated = malloc(std::max<size_t>(bytes.size(), 1));
+  if (allocated != nullptr) {
+    memcpy(allocated, bytes.data(), bytes.size());
+  }
+
+  ret->ret_type = v::Type::kPointer;
+  ret->int_val = reinterpret_cast<uintptr_t>(allocated);
+  ret->success = true;
+}
+
+// Handles requests to send back memory and free it afterwards.
+bool HandleReadAndFreeMsg(sandbox2::Comms* comms,
+                          const comms::ReadAndFreeRequest& req) {
+  VLOG(1) << "HandleReadAndFreeMsg(" << absl::StrCat(absl::Hex(req.addr))
+          << ", " << req.size << ")";
+
+  void* ptr = reinterpret_cast<void*>(req.addr);
+  if (!comms->SendTLV(comms::kMsgReadAndFree, req.size, ptr)) {
+    return false;
+  }
+  if (!GetAllocationArena().Contains(req.addr)) {
+    free(ptr);
+  }
+  return true;
+}
+
+// Handles requests to copy the received data to memory of this process.
+void HandleWriteMemoryMsg(absl::Span<const uint8_t> bytes, FuncRet* ret) {
+  uintptr_t addr;
+  CHECK_GE(bytes.size(), sizeof(addr));
+  memcpy(&addr, bytes.data(), sizeof(addr));
+  VLOG(1) << "HandleWriteMemoryMsg(" << absl::StrCat(absl::Hex(addr)) << ", "
+          << bytes.size() - sizeof(addr) << ")";
+  memcpy(reinterpret_cast<void*>(addr), bytes.data() + sizeof(addr),
+         bytes.size() - sizeof(addr));
+
+  ret->ret_type = v::Type::kVoid;
+  ret->success = true;
+}
+
+// Handles requests to send back memory of this process.
+bool HandleReadMemoryMsg(sandbox2::Comms* comms,
+                         const comms::MemoryRequest& req) {
+  VLOG(1) << "HandleReadMemoryMsg(" << absl::StrCat(absl::Hex(req.addr))
+          << ", " << req.size << ")";
+  return comms->SendTLV(comms::kMsgReadMemory, req.size,
+                        reinterpret_cast<void*>(req.addr));
+}
+
+// Handles deferred requests to free memory. These are not answered.
+void HandleFreeBatchMsg(absl::Span<const uint8_t> bytes) {
+  CHECK_EQ(bytes.size() % sizeof(uintptr_t), 0);
+  VLOG(1) << "HandleFreeBatchMsg: " << bytes.size() / sizeof(uintptr_t)
+          << " pointers";
+
+  const AllocationArena& arena = GetAllocationArena();
+  for (size_t i = 0; i < bytes.size(); i += sizeof(uintptr_t)) {
+    uintptr_t ptr;
+    memcpy(&ptr, &bytes[i], sizeof(ptr));
+    if (!arena.Contains(ptr)) {
+      free(reinterpret_cast<void*>(ptr));
+    }
+  }
+}
+
 // Handles requests to find a symbol value.
 void HandleSymbolMsg(const char* symname, FuncRet* ret) {
   ret->ret_type = v::Type::kPointer;
 
-  void* handle = dlopen(nullptr, RTLD_NOW);
-  if (handle == nullptr) {
+  void* address;
+  if (!LookupSymbol(symname, &address)) {
     ret->success = false;
     ret->int_val = static_cast<uintptr_t>(Error::kDlOpen);
     return;
   }
 
-  ret->int_val = reinterpret_cast<uintptr_t>(dlsym(handle, symname));
+  ret->int_val = reinterpret_cast<uintptr_t>(address);
   ret->success = true;
 }
 
@@ -300,6 +705,19 @@ void HandleSendFd(sandbox2::Comms* comms, FuncRet* ret) {
   ret->success = true;
 }
 
+// Handles requests to receive multiple file descriptors from sandboxer. Their
+// numbers are sent back before the return message.
+void HandleSendFds(sandbox2::Comms* comms, FuncRet* ret) {
+  ret->ret_type = v::Type::kInt;
+  std::vector<int> fds;
+  // Always reply with the (possibly empty) list, so the sandboxer stays in
+  // sync. If that fails, so does sending the return message.
+  ret->success = comms->RecvFDs(&fds) &&
+                 comms->SendTLV(comms::kMsgSendFds, fds.size() * sizeof(int),
+                                fds.data());
+  ret->int_val = fds.size();
+}
+
 // Handles requests to send a file descriptor back to sandboxer.
 void HandleRecvFd(sandbox2::Comms* comms, int fd_to_transfer, FuncRet* ret) {
   ret->ret_type = v::Type::kVoid;
@@ -327,8 +745,142 @@ void HandleStrlen(sandbox2::Comms* comms, const char* ptr, FuncRet* ret) {
   ret->success = true;
 }
 
+// Handles requests for the lengths of several strings, given as an array of
+// pointers. Sends its own reply, with the lengths in the same order.
+bool HandleStrlenBatchMsg(sandbox2::Comms* comms,
+                          absl::Span<const uint8_t> bytes) {
+  CHECK_EQ(bytes.size() % sizeof(uintptr_t), 0);
+  std::vector<uint64_t> lengths(bytes.size() / sizeof(uintptr_t));
+  for (size_t i = 0; i < lengths.size(); ++i) {
+    uintptr_t ptr;
+    memcpy(&ptr, &bytes[i * sizeof(ptr)], sizeof(ptr));
+    lengths[i] = strlen(reinterpret_cast<const char*>(ptr));
+  }
+  return comms->SendTLV(comms::kMsgStrlenBatch,
+                        lengths.size() * sizeof(uint64_t), lengths.data());
+}
+
+// Handles requests for the amount of memory in use by malloc(), including
+// chunks that it mapped separately.
+void HandleHeapUsage(FuncRet* ret) {
+  ret->ret_type = v::Type::kInt;
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 info = mallinfo2();
+  ret->int_val = info.uordblks + info.hblkhd;
+#else
+  struct mallinfo info = mallinfo();
+  // The fields are only ints and wrap around beyond 2 GiB.
+  ret->int_val = static_cast<unsigned int>(info.uordblks) +
+                 static_cast<unsigned int>(info.hblkhd);
+#endif
+  ret->success = true;
+}
+
+// Handles requests to switch the comms channel to shared memory. Replies are
+// sent through the shared memory already.
+void HandleSharedMemory(sandbox2::Comms* comms, FuncRet* ret) {
+  ret->ret_type = v::Type::kVoid;
+  ret->success = comms->AcceptSharedMemoryTransport();
+}
+
+// Handles requests to map a buffer shared with the sandboxer (read-write) or a
+// file (read-only). The file descriptor backing it follows the request.
+void HandleMapFdMsg(sandbox2::Comms* comms, size_t size, int prot,
+                    FuncRet* ret) {
+  VLOG(1) << "HandleMapFdMsg: size=" << size << ", prot=" << prot;
+  ret->ret_type = v::Type::kPointer;
+  ret->int_val = 0;
+  int fd = -1;
+  if (!comms->RecvFD(&fd)) {
+    ret->success = false;
+    return;
+  }
+  void* addr = mmap(nullptr, size, prot, MAP_SHARED, fd, /*offset=*/0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    PLOG(ERROR) << "mmap() of a shared fd failed";
+    ret->success = false;
+    return;
+  }
+  ret->int_val = reinterpret_cast<uintptr_t>(addr);
+  ret->success = true;
+}
+
+// Handles requests to map anonymous memory whose missing pages are filled in
+// by the sandboxer through a userfaultfd. Sends its own reply, followed by
+// the userfaultfd if it succeeded.
+bool HandleMapLazyBufferMsg(sandbox2::Comms* comms, size_t size) {
+  VLOG(1) << "HandleMapLazyBufferMsg: size=" << size;
+  FuncRet ret{};  // Brace-init zeroes struct padding
+  ret.ret_type = v::Type::kPointer;
+  void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, /*offset=*/0);
+  int uffd = -1;
+  if (addr == MAP_FAILED) {
+    PLOG(ERROR) << "mmap() of a lazy buffer failed";
+  } else {
+    // Only faults in user mode are handled, so that the sandboxee can't use
+    // the userfaultfd to stall the kernel.
+    uffd = syscall(__NR_userfaultfd,
+                   O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    uffdio_api api = {.api = UFFD_API, .features = 0, .ioctls = 0};
+    uffdio_register reg = {
+        .range = {.start = reinterpret_cast<uintptr_t>(addr), .len = size},
+        .mode = UFFDIO_REGISTER_MODE_MISSING,
+        .ioctls = 0,
+    };
+    if (uffd == -1 || ioctl(uffd, UFFDIO_API, &api) == -1 ||
+        ioctl(uffd, UFFDIO_REGISTER, &reg) == -1) {
+      // E.g. with kernels before 5.11, the sandboxer falls back to copying.
+      PLOG(WARNING) << "Setting up a userfaultfd failed";
+      if (uffd != -1) {
+        close(uffd);
+      }
+      munmap(addr, size);
+    } else {
+      ret.int_val = reinterpret_cast<uintptr_t>(addr);
+      ret.success = true;
+    }
+  }
+  bool sent = comms->SendTLV(comms::kMsgReturn, sizeof(ret),
+                             reinterpret_cast<uint8_t*>(&ret));
+  if (ret.success) {
+    sent = sent && comms->SendFD(uffd);
+    close(uffd);
+  }
+  return sent;
+}
+
+// Handles requests to unmap a buffer mapped by HandleMapFdMsg().
+void HandleUnmapBufferMsg(const comms::UnmapBufferRequest& req,
+                          FuncRet* ret) {
+  VLOG(1) << "HandleUnmapBufferMsg(" << absl::StrCat(absl::Hex(req.addr))
+          << ", " << req.size << ")";
+  ret->ret_type = v::Type::kVoid;
+  ret->success = munmap(reinterpret_cast<void*>(req.addr), req.size) == 0;
+}
+
+// Handles requests to serve another channel from a new thread, so that calls
+// on different channels run concurrently. The connected socket follows the
+// request.
+void HandleOpenCallChannelMsg(sandbox2::Comms* comms, FuncRet* ret) {
+  VLOG(1) << "HandleOpenCallChannelMsg";
+  ret->ret_type = v::Type::kVoid;
+  int fd = -1;
+  if (!comms->RecvFD(&fd)) {
+    ret->success = false;
+    return;
+  }
+  std::thread([fd] {
+    sandbox2::Comms channel(fd);
+    while (ServeRequest(&channel)) {
+    }
+  }).detach();
+  ret->success = true;
+}
+
 template <typename T>
-static T BytesAs(const std::vector<uint8_t>& bytes) {
+static T BytesAs(absl::Span<const uint8_t> bytes) {
   static_assert(std::is_trivial<T>(),
                 "only trivial types can be used with BytesAs");
   CHECK_EQ(bytes.size(), sizeof(T));
@@ -337,23 +889,61 @@ static T BytesAs(const std::vector<uint8_t>& bytes) {
   return rv;
 }
 
-void ServeRequest(sandbox2::Comms* comms) {
+bool ServeRequest(sandbox2::Comms* comms) {
   uint32_t tag;
-  std::vector<uint8_t> bytes;
+  absl::Span<const uint8_t> bytes;
 
-  CHECK(comms->RecvTLV(&tag, &bytes));
+  // The received bytes are only valid until the next receive operation.
+  if (!comms->RecvTLV(&tag, &bytes)) {
+    return false;
+  }
 
   FuncRet ret{};  // Brace-init zeroes struct padding
 
   switch (tag) {
     case comms::kMsgCall:
       VLOG(1) << "Client::kMsgCall";
-      HandleCallMsg(BytesAs<FuncCall>(bytes), &ret);
+      HandleCallMsg(FromFuncCall(BytesAs<FuncCall>(bytes)), &ret);
       break;
+    case comms::kMsgCallCompact:
+      VLOG(1) << "Client::kMsgCallCompact";
+      HandleCallCompactMsg(bytes, &ret);
+      break;
+    case comms::kMsgCallBatch:
+      VLOG(1) << "Client::kMsgCallBatch";
+      // Sends its own reply.
+      return HandleCallBatchMsg(comms, bytes);
     case comms::kMsgAllocate:
       VLOG(1) << "Client::kMsgAllocate";
       HandleAllocMsg(BytesAs<size_t>(bytes), &ret);
       break;
+    case comms::kMsgAllocateAndFill:
+      VLOG(1) << "Client::kMsgAllocateAndFill";
+      HandleAllocAndFillMsg(bytes, &ret);
+      break;
+    case comms::kMsgReadAndFree:
+      VLOG(1) << "Client::kMsgReadAndFree";
+      // Sends its own reply.
+      return HandleReadAndFreeMsg(comms,
+                                  BytesAs<comms::ReadAndFreeRequest>(bytes));
+    case comms::kMsgWriteMemory:
+      VLOG(1) << "Client::kMsgWriteMemory";
+      HandleWriteMemoryMsg(bytes, &ret);
+      break;
+    case comms::kMsgReadMemory:
+      VLOG(1) << "Client::kMsgReadMemory";
+      // Sends its own reply.
+      return HandleReadMemoryMsg(comms,
+                                 BytesAs<comms::MemoryRequest>(bytes));
+    case comms::kMsgFreeBatch:
+      VLOG(1) << "Client::kMsgFreeBatch";
+      // Not answered.
+      HandleFreeBatchMsg(bytes);
+      return true;
+    case comms::kMsgAllocateArena:
+      VLOG(1) << "Client::kMsgAllocateArena";
+      HandleAllocArenaMsg(BytesAs<size_t>(bytes), &ret);
+      break;
     case comms::kMsgReallocate:
       VLOG(1) << "Client::kMsgReallocate";
       {
@@ -374,12 +964,20 @@ void ServeRequest(sandbox2::Comms* comms) {
       break;
     case comms::kMsgExit:
       VLOG(1) << "Received Client::kMsgExit message";
+      if (serving_in_process.load(std::memory_order_relaxed)) {
+        // Only the serving thread ends, see ServeInProcess().
+        return false;
+      }
       syscall(__NR_exit_group, 0UL);
       break;
     case comms::kMsgSendFd:
       VLOG(1) << "Received Client::kMsgSendFd message";
       HandleSendFd(comms, &ret);
       break;
+    case comms::kMsgSendFds:
+      VLOG(1) << "Received Client::kMsgSendFds message";
+      HandleSendFds(comms, &ret);
+      break;
     case comms::kMsgRecvFd:
       VLOG(1) << "Received Client::kMsgRecvFd message";
       HandleRecvFd(comms, BytesAs<int>(bytes), &ret);
@@ -392,6 +990,38 @@ void ServeRequest(sandbox2::Comms* comms) {
       VLOG(1) << "Received Client::kMsgStrlen message";
       HandleStrlen(comms, BytesAs<const char*>(bytes), &ret);
       break;
+    case comms::kMsgStrlenBatch:
+      VLOG(1) << "Received Client::kMsgStrlenBatch message";
+      // Sends its own reply.
+      return HandleStrlenBatchMsg(comms, bytes);
+    case comms::kMsgHeapUsage:
+      VLOG(1) << "Received Client::kMsgHeapUsage message";
+      HandleHeapUsage(&ret);
+      break;
+    case comms::kMsgSharedMemory:
+      VLOG(1) << "Received Client::kMsgSharedMemory message";
+      HandleSharedMemory(comms, &ret);
+      break;
+    case comms::kMsgMapBuffer:
+      VLOG(1) << "Received Client::kMsgMapBuffer message";
+      HandleMapFdMsg(comms, BytesAs<size_t>(bytes), PROT_READ | PROT_WRITE,
+                     &ret);
+      break;
+    case comms::kMsgMapFile:
+      VLOG(1) << "Received Client::kMsgMapFile message";
+      HandleMapFdMsg(comms, BytesAs<size_t>(bytes), PROT_READ, &ret);
+      break;
+    case comms::kMsgMapLazyBuffer:
+      VLOG(1) << "Received Client::kMsgMapLazyBuffer message";
+      // Sends its own reply.
+      return HandleMapLazyBufferMsg(comms, BytesAs<size_t>(bytes));
+    case comms::kMsgUnmapBuffer:
+      VLOG(1) << "Received Client::kMsgUnmapBuffer message";
+      HandleUnmapBufferMsg(BytesAs<comms::UnmapBufferRequest>(bytes), &ret);
+      break;
+    case comms::kMsgOpenCallChannel:
+      VLOG(1) << "Received Client::kMsgOpenCallChannel message";
+      HandleOpenCallChannelMsg(comms, &ret);
       break;
     default:
       LOG(FATAL) << "Received unknown tag: " << tag;
@@ -409,13 +1039,35 @@ void ServeRequest(sandbox2::Comms* comms) {
             << "), Success: " << (ret.success ? "Yes" : "No");
   }
 
-  CHECK(comms->SendTLV(comms::kMsgReturn, sizeof(ret),
-                       reinterpret_cast<uint8_t*>(&ret)));
+  return comms->SendTLV(comms::kMsgReturn, sizeof(ret),
+                        reinterpret_cast<uint8_t*>(&ret));
+}
+
+void ServeInProcess(int fd) {
+  serving_in_process.store(true, std::memory_order_relaxed);
+  std::thread([fd] {
+    sandbox2::Comms comms(fd);
+    while (ServeRequest(&comms)) {
+    }
+  }).detach();
 }
 
 }  // namespace client
 }  // namespace sapi
 
+extern "C" int sapi_call_cancelled(void) { return sapi::call_cancelled; }
+
+// Can be defined by the sandboxed library to initialize state that all
+// sandboxees should start with, e.g. by loading data files or warming up
+// caches. It runs once in the forkserver, before any sandboxee is forked from
+// it, so the sandboxees share the memory it set up copy-on-write.
+// The forkserver is not sandboxed: this runs before any policy applies, with
+// the privileges of the host. It is therefore only called if the host opts in
+// with Sandbox::RunZygoteInit(), must only read trusted input (such as data
+// files named by the host), must not start threads, and must not depend on
+// any input from the RPC channel.
+extern "C" ABSL_ATTRIBUTE_WEAK void sapi_zygote_init();
+
 ABSL_ATTRIBUTE_WEAK int main(int argc, char* argv[]) {
   absl::ParseCommandLine(argc, argv);
   absl::InitializeLog();
@@ -427,6 +1079,13 @@ ABSL_ATTRIBUTE_WEAK int main(int argc, char* argv[]) {
   sandbox2::Comms comms(sandbox2::Comms::kDefaultConnection);
   sandbox2::ForkingClient s2client(&comms);
 
+  // Sandboxees must not see the variable.
+  const bool run_zygote_init = getenv(sapi::comms::kZygoteInitEnv) != nullptr;
+  unsetenv(sapi::comms::kZygoteInitEnv);
+  if (run_zygote_init && sapi_zygote_init != nullptr) {
+    sapi_zygote_init();
+  }
+
   // Forkserver loop.
   while (true) {
     pid_t pid = s2client.WaitAndFork();
@@ -438,17 +1097,25 @@ ABSL_ATTRIBUTE_WEAK int main(int argc, char* argv[]) {
     }
   }
 
+  // Without SA_RESTART, so that blocking syscalls of an interrupted call fail
+  // with EINTR.
+  struct sigaction action = {};
+  action.sa_handler = sapi::HandleCallCancelSignal;
+  sigemptyset(&action.sa_mask);
+  CHECK_EQ(sigaction(sapi::comms::kCallCancelSignal, &action, nullptr), 0);
+
   // Child thread.
   s2client.SandboxMeHere();
 
   // Enable log forwarding if enabled by the sandboxer.
+  // Messages are batched, but never held back beyond a request.
   if (s2client.HasMappedFD(sandbox2::LogSink::kLogFDName)) {
-    s2client.SendLogsToSupervisor();
+    s2client.SendLogsToSupervisor(/*batched=*/true);
   }
 
   // Run SAPI stub.
-  while (true) {
-    sapi::client::ServeRequest(&comms);
+  while (sapi::client::ServeRequest(&comms)) {
+    s2client.FlushLogs();
   }
-  LOG(FATAL) << "Unreachable";
+  LOG(FATAL) << "Connection to the sandboxer lost";
 }
@@ -0,0 +1,37 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_CLIENT_H_
+#define SANDBOXED_API_CLIENT_H_
+
+// The stub serving the requests of sapi::Sandbox, which is linked into every
+// sandboxee and runs its main loop.
+
+#include "sandboxed_api/sandbox2/comms.h"
+
+namespace sapi::client {
+
+// Serves a single request. Returns false if the connection to the sandboxer
+// is gone, or if it asked to exit while served in process.
+bool ServeRequest(sandbox2::Comms* comms);
+
+// Serves the requests on the connected socket `fd` from a new thread, for a
+// sandboxer in the same process, see Sandbox::RunInProcess(). Takes ownership
+// of `fd`. The thread ends when the sandboxer closes its end or asks the stub
+// to exit, which leaves the process running.
+void ServeInProcess(int fd);
+
+}  // namespace sapi::client
+
+#endif  // SANDBOXED_API_CLIENT_H_
@@ -0,0 +1,117 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// C++20 coroutine support for asynchronous sandbox calls. Calls are awaited
+// on an AwaitReactor, so that many calls, also on different sandboxes, can be
+// in flight on a handful of threads:
+//
+//   v::Int a(1), b(2), ret;
+//   absl::Status status =
+//       co_await sapi::Await(sandbox.CallAsync("sum", &ret, &a, &b), &reactor);
+//
+//   absl::StatusOr<int> sum =
+//       co_await sapi::Await(api.sumAsync(1, 2), &reactor);
+//
+// Awaiting coroutines resume on a reactor thread, unless the result is
+// already there. Memory transfers don't wait for the sandboxee and are made
+// directly. Only available in C++20 builds, the rest of the API doesn't need
+// coroutines.
+
+#ifndef SANDBOXED_API_COROUTINE_H_
+#define SANDBOXED_API_COROUTINE_H_
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>  // NOLINT(build/c++20)
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/await_reactor.h"
+#include "sandboxed_api/generated_calls.h"
+#include "sandboxed_api/sandbox.h"
+
+namespace sapi {
+namespace internal {
+
+// Awaits a Sandbox::AsyncCall or a CallFuture<>.
+template <typename Call, typename Result>
+class CallAwaiter {
+ public:
+  CallAwaiter(absl::StatusOr<Call> call, AwaitReactor* reactor)
+      : reactor_(reactor) {
+    if (call.ok()) {
+      call_.emplace(*std::move(call));
+    } else {
+      status_ = call.status();
+    }
+  }
+
+  bool await_ready() { return !call_ || call_->IsDone(); }
+
+  void await_suspend(std::coroutine_handle<> handle) { Arm(handle); }
+
+  Result await_resume() {
+    if (!call_) {
+      return status_;
+    }
+    if constexpr (std::is_same_v<Call, Sandbox::AsyncCall>) {
+      return call_->Wait();
+    } else {
+      return call_->Get();
+    }
+  }
+
+ private:
+  void Arm(std::coroutine_handle<> handle) {
+    reactor_->WhenReadable(call_->readiness_fd(), [this, handle] {
+      // Readable for other reasons, e.g. the result of an earlier call.
+      if (call_->IsDone()) {
+        handle.resume();
+      } else {
+        Arm(handle);
+      }
+    });
+  }
+
+  AwaitReactor* reactor_;
+  std::optional<Call> call_;
+  absl::Status status_;
+};
+
+}  // namespace internal
+
+// Awaits a call started with Sandbox::CallAsync(), returning the status that
+// AsyncCall::Wait() returns.
+inline internal::CallAwaiter<Sandbox::AsyncCall, absl::Status> Await(
+    absl::StatusOr<Sandbox::AsyncCall> call, AwaitReactor* reactor) {
+  return {std::move(call), reactor};
+}
+
+// Awaits a call started with a generated FooAsync() method, returning what
+// CallFuture::Get() returns.
+template <typename T>
+internal::CallAwaiter<CallFuture<T>, decltype(std::declval<CallFuture<T>>()
+                                                    .Get())>
+Await(absl::StatusOr<CallFuture<T>> future, AwaitReactor* reactor) {
+  return {std::move(future), reactor};
+}
+
+}  // namespace sapi
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // SANDBOXED_API_COROUTINE_H_
@@ -15,25 +15,129 @@
 #include "sandboxed_api/embed_file.h"
 
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/strerror.h"
 
+ABSL_FLAG(std::string, sapi_embed_file_cache_dir, "",
+          "If set, embedded files are shared with other processes of the same "
+          "user through this directory instead of being copied into a memfd "
+          "per process. The directory must be on a file system that permits "
+          "execution, e.g. not a noexec /dev/shm.");
+
 namespace sapi {
+namespace {
+
+// FNV-1a, which unlike absl::Hash is stable across processes.
+uint64_t ContentHash(const char* data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3;
+  }
+  return hash;
+}
+
+// Returns whether `fd` is a read-only file of the current user holding exactly
+// the contents of `toc`. Entries are compared in full, so neither a hash
+// collision nor a stale or foreign file is ever executed.
+bool MatchesFileToc(int fd, const FileToc* toc) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+      st.st_uid != geteuid() ||
+      (st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)) != 0 ||
+      static_cast<size_t>(st.st_size) != toc->size) {
+    return false;
+  }
+  if (toc->size == 0) {
+    return true;
+  }
+  void* addr = mmap(nullptr, toc->size, PROT_READ, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  bool equal = memcmp(addr, toc->data, toc->size) == 0;
+  munmap(addr, toc->size);
+  return equal;
+}
+
+}  // namespace
 
 EmbedFile* EmbedFile::instance() {
   static auto* embed_file_instance = new EmbedFile();
   return embed_file_instance;
 }
 
+int EmbedFile::OpenSharedFdForFileToc(const FileToc* toc,
+                                      const std::string& dir) {
+  const std::string path = file::JoinPath(
+      dir, absl::StrFormat("%s.%d.%016x", toc->name, toc->size,
+                           ContentHash(toc->data, toc->size)));
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+  if (fd != -1) {
+    file_util::fileops::FDCloser cached_fd(fd);
+    if (MatchesFileToc(cached_fd.get(), toc)) {
+      return cached_fd.Release();
+    }
+    SAPI_RAW_LOG(WARNING, "Replacing mismatching embed file cache entry '%s'",
+                 path.c_str());
+  }
+
+  // Publish a complete copy atomically, so that other processes never see a
+  // partially written file. Concurrent writers just replace each other's copy.
+  std::string tmp_path = absl::StrCat(path, ".XXXXXX");
+  file_util::fileops::FDCloser tmp_fd(mkostemp(tmp_path.data(), O_CLOEXEC));
+  if (tmp_fd.get() == -1) {
+    SAPI_RAW_PLOG(ERROR, "Couldn't create a file in '%s'", dir.c_str());
+    return -1;
+  }
+  if (!file_util::fileops::WriteToFD(tmp_fd.get(), toc->data, toc->size) ||
+      fchmod(tmp_fd.get(), S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH |
+                               S_IXOTH) == -1 ||
+      rename(tmp_path.c_str(), path.c_str()) == -1) {
+    SAPI_RAW_PLOG(ERROR, "Couldn't write embed file cache entry '%s'",
+                  path.c_str());
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+  // Executing a file that is open for writing fails with ETXTBSY, so reopen
+  // the same inode read-only.
+  fd = open(absl::StrCat("/proc/self/fd/", tmp_fd.get()).c_str(),
+            O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    SAPI_RAW_PLOG(ERROR, "Couldn't reopen embed file cache entry '%s'",
+                  path.c_str());
+  }
+  return fd;
+}
+
 int EmbedFile::CreateFdForFileToc(const FileToc* toc) {
+  if (std::string dir = absl::GetFlag(FLAGS_sapi_embed_file_cache_dir);
+      !dir.empty()) {
+    int fd = OpenSharedFdForFileToc(toc, dir);
+    if (fd != -1) {
+      return fd;
+    }
+    SAPI_RAW_LOG(WARNING, "Falling back to a private copy of '%s'", toc->name);
+  }
+
   // Create a memfd/temp file and write contents of the SAPI library to it.
   int fd = -1;
   if (!sandbox2::util::CreateMemFd(&fd, toc->name)) {
@@ -106,4 +210,14 @@ int EmbedFile::GetDupFdForFileToc(const FileToc* toc) {
   return fd;
 }
 
+void EmbedFile::MaterializeInBackground(const FileToc* toc) {
+  // The instance is never destroyed, so the thread can outlive main().
+  std::thread([this, toc] {
+    if (GetFdForFileToc(toc) == -1) {
+      SAPI_RAW_LOG(WARNING, "Background copy of embed file '%s' failed",
+                   toc->name);
+    }
+  }).detach();
+}
+
 }  // namespace sapi
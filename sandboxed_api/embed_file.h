@@ -15,6 +15,7 @@
 #ifndef SANDBOXED_API_EMBED_FILE_H_
 #define SANDBOXED_API_EMBED_FILE_H_
 
+#include <string>
 #include <vector>
 
 #include "sandboxed_api/file_toc.h"
@@ -39,11 +40,22 @@ class EmbedFile {
   // Returns a duplicated file-descriptor for a given FileToc.
   int GetDupFdForFileToc(const FileToc* toc);
 
+  // Creates the file for a given FileToc on a background thread and returns
+  // immediately. Meant to be called early, e.g. from main(), so that the first
+  // sandbox does not pay for copying a large embedded library. Callers of
+  // GetFdForFileToc() wait for a pending copy instead of starting another one.
+  void MaterializeInBackground(const FileToc* toc);
+
  private:
   // Creates an executable file for a given FileToc, and return its
   // file-descriptors (-1 in case of errors).
   static int CreateFdForFileToc(const FileToc* toc);
 
+  // Returns a file-descriptor for the copy of a given FileToc in the
+  // machine-wide cache directory `dir`, creating the copy if needed (-1 in case
+  // of errors).
+  static int OpenSharedFdForFileToc(const FileToc* toc, const std::string& dir);
+
   EmbedFile() = default;
 
   // List of File TOCs and corresponding file-descriptors.
@@ -0,0 +1,89 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/embed_file.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sandboxed_api/file_toc.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sapi {
+namespace {
+
+using ::testing::Each;
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::StrEq;
+
+constexpr char kData[] = "embedded file contents";
+
+// Returns the contents of `fd`, which stays open.
+std::string ReadContents(int fd) {
+  std::string contents(sizeof(kData), '\0');
+  ssize_t n = pread(fd, contents.data(), contents.size(), 0);
+  contents.resize(n > 0 ? n : 0);
+  return contents;
+}
+
+TEST(EmbedFileTest, GetDupFdForFileTocReturnsCopy) {
+  static const FileToc toc = {"embed_file_test_dup", kData, sizeof(kData) - 1};
+  int fd = EmbedFile::instance()->GetFdForFileToc(&toc);
+  ASSERT_THAT(fd, Ne(-1));
+  file_util::fileops::FDCloser dup_fd(
+      EmbedFile::instance()->GetDupFdForFileToc(&toc));
+  ASSERT_THAT(dup_fd.get(), Ne(-1));
+  EXPECT_THAT(dup_fd.get(), Ne(fd));
+  EXPECT_THAT(ReadContents(dup_fd.get()), StrEq(kData));
+
+  struct stat st;
+  ASSERT_THAT(fstat(fd, &st), Eq(0));
+  EXPECT_TRUE(st.st_mode & S_IXUSR);
+  EXPECT_FALSE(st.st_mode & S_IWUSR);
+}
+
+TEST(EmbedFileTest, MaterializeInBackgroundSharesFileWithCallers) {
+  static const FileToc toc = {"embed_file_test_background", kData,
+                              sizeof(kData) - 1};
+  EmbedFile::instance()->MaterializeInBackground(&toc);
+
+  // Callers racing with the background copy must all get the same file.
+  constexpr int kThreads = 8;
+  std::vector<int> fds(kThreads, -1);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back(
+        [&fds, i] { fds[i] = EmbedFile::instance()->GetFdForFileToc(&toc); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_THAT(fds[0], Ne(-1));
+  EXPECT_THAT(fds, Each(Eq(fds[0])));
+  EXPECT_THAT(ReadContents(fds[0]), StrEq(kData));
+
+  // Later calls, including another background copy, keep using the same file.
+  EmbedFile::instance()->MaterializeInBackground(&toc);
+  EXPECT_THAT(EmbedFile::instance()->GetFdForFileToc(&toc), Eq(fds[0]));
+}
+
+}  // namespace
+}  // namespace sapi
@@ -17,6 +17,8 @@
 #include <sys/types.h>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -33,6 +35,7 @@
 namespace {
 
 using ::sapi::IsOk;
+using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::Ne;
 using ::testing::SizeIs;
@@ -136,6 +139,34 @@ TEST(StringopTest, RawStringReversal) {
   }
 }
 
+TEST(StringopTest, RawStringTruncation) {
+  StringopSapiSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  StringopApi api(&sandbox);
+
+  sapi::v::LenVal param("0123456789", 10);
+  SAPI_ASSERT_OK_AND_ASSIGN(int return_value,
+                            api.reverse_string(param.PtrBoth()));
+  EXPECT_THAT(return_value, Eq(1));
+
+  // The data stays in place in the sandboxee, so it is read along with its
+  // new size.
+  SAPI_ASSERT_OK_AND_ASSIGN(return_value,
+                            api.truncate_string(param.PtrBoth(), 4));
+  EXPECT_THAT(return_value, Eq(1));
+  absl::string_view data(reinterpret_cast<const char*>(param.GetData()),
+                         param.GetDataSize());
+  EXPECT_THAT(std::string(data), StrEq("9876"));
+
+  // Growing it again works as well.
+  SAPI_ASSERT_OK_AND_ASSIGN(return_value,
+                            api.duplicate_string(param.PtrBoth()));
+  EXPECT_THAT(return_value, Eq(1));
+  data = absl::string_view(reinterpret_cast<const char*>(param.GetData()),
+                           param.GetDataSize());
+  EXPECT_THAT(std::string(data), StrEq("98769876"));
+}
+
 TEST(StringopTest, RawStringLength) {
   StringopSapiSandbox sandbox;
   ASSERT_THAT(sandbox.Init(), IsOk());
@@ -160,4 +191,25 @@ TEST(StringopTest, RawStringReading) {
   EXPECT_THAT(data, StrEq("Ten chars."));
 }
 
+TEST(StringopTest, RawStringsReading) {
+  StringopSapiSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  StringopApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(void* target_mem_ptr, api.get_raw_c_string());
+
+  // Longer than what is read before asking the sandboxee for the length.
+  std::string long_string(1000, 'x');
+  sapi::v::ConstCStr long_var(long_string.c_str());
+  ASSERT_THAT(sandbox.Allocate(&long_var), IsOk());
+  ASSERT_THAT(sandbox.TransferToSandboxee(&long_var), IsOk());
+
+  std::vector<void*> ptrs = {target_mem_ptr, long_var.GetRemote(),
+                             target_mem_ptr};
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<std::string> strings,
+                            sandbox.GetCStrings(ptrs));
+  EXPECT_THAT(strings, ElementsAre("Ten chars.", long_string, "Ten chars."));
+  EXPECT_THAT(sandbox.GetCStrings(ptrs, /*max_length=*/100).status().code(),
+              Eq(absl::StatusCode::kInvalidArgument));
+}
+
 }  // namespace
@@ -75,6 +75,15 @@ extern "C" int duplicate_string(sapi::LenValStruct* input) {
   return 1;
 }
 
+// Shortens the data in place, keeping the data pointer.
+extern "C" int truncate_string(sapi::LenValStruct* input, size_t size) {
+  if (size > input->size) {
+    return 0;
+  }
+  input->size = size;
+  return 1;
+}
+
 extern "C" const void* get_raw_c_string() { return "Ten chars."; }
 
 extern "C" void nop() {}
@@ -42,6 +42,13 @@ extern long double addf(float a, double b, long double c) {
   return a + b + c;
 }
 
+extern long sum16(int a0, int a1, int a2, int a3, int a4, int a5, int a6,
+                  int a7, int a8, int a9, int a10, int a11, int a12, int a13,
+                  int a14, long a15) {
+  return a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9 + a10 + a11 + a12 +
+         a13 + a14 + a15;
+}
+
 extern int sub(int a, int b) {
   return a - b;
 }
@@ -97,3 +104,23 @@ extern int read_int(int fd) {
 extern void sleep_for_sec(int sec) {
   sleep(sec);
 }
+
+extern int write_pattern(int fd, int size) {
+  char buf[1000];
+  int written = 0;
+  while (written < size) {
+    int n = size - written;
+    if (n > (int)sizeof(buf)) {
+      n = sizeof(buf);
+    }
+    for (int i = 0; i < n; i++) {
+      buf[i] = 'a' + (written + i) % 26;
+    }
+    n = write(fd, buf, n);
+    if (n <= 0) {
+      return -1;
+    }
+    written += n;
+  }
+  return written;
+}
@@ -0,0 +1,156 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// End-to-end latency of the basic SAPI operations, using the sum library.
+// Each benchmark reports the p50 and p99 of the per-iteration latency in
+// microseconds next to the mean. Run with `bazel run -c opt` before and after
+// changes to sandbox.cc, rpcchannel.cc or client.cc.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/examples/sum/sandbox.h"
+#include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#include "sandboxed_api/examples/sum/sum_params.pb.h"
+#include "sandboxed_api/vars.h"
+
+namespace {
+
+// Times each invocation of `fn` and reports the latency percentiles as
+// counters. `fn` must return an absl::Status. `untimed`, if given, runs after
+// each invocation without being measured.
+template <typename Fn, typename UntimedFn = void (*)()>
+void RunWithPercentiles(benchmark::State& state, Fn fn,
+                        UntimedFn untimed = [] {}) {
+  std::vector<double> samples;
+  for (auto _ : state) {
+    absl::Time start = absl::Now();
+    CHECK_OK(fn());
+    double elapsed = absl::ToDoubleSeconds(absl::Now() - start);
+    state.SetIterationTime(elapsed);
+    samples.push_back(elapsed);
+    untimed();
+  }
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&samples](double p) {
+    size_t index = std::min(samples.size() - 1,
+                            static_cast<size_t>(p * samples.size()));
+    return samples[index] * 1e6;
+  };
+  state.counters["p50_us"] = percentile(0.50);
+  state.counters["p99_us"] = percentile(0.99);
+}
+
+std::unique_ptr<SumSapiSandbox> CreateSandbox() {
+  auto sandbox = std::make_unique<SumSapiSandbox>();
+  CHECK_OK(sandbox->Init());
+  return sandbox;
+}
+
+void BM_ColdInit(benchmark::State& state) {
+  std::unique_ptr<SumSapiSandbox> sandbox;
+  RunWithPercentiles(
+      state,
+      [&sandbox] {
+        sandbox = std::make_unique<SumSapiSandbox>();
+        return sandbox->Init();
+      },
+      [&sandbox] { sandbox.reset(); });
+}
+BENCHMARK(BM_ColdInit)->UseManualTime();
+
+void BM_CallScalar(benchmark::State& state) {
+  auto sandbox = CreateSandbox();
+  SumApi api(sandbox.get());
+  RunWithPercentiles(state,
+                     [&api] { return api.sum(1000, 337).status(); });
+}
+BENCHMARK(BM_CallScalar)->UseManualTime();
+
+void BM_CallStructPtrBefore(benchmark::State& state) {
+  auto sandbox = CreateSandbox();
+  SumApi api(sandbox.get());
+  sapi::v::Struct<sum_params> params;
+  params.mutable_data()->a = 1111;
+  params.mutable_data()->b = 222;
+  RunWithPercentiles(state,
+                     [&api, &params] { return api.sums(params.PtrBefore()); });
+}
+BENCHMARK(BM_CallStructPtrBefore)->UseManualTime();
+
+void BM_CallStructPtrBoth(benchmark::State& state) {
+  auto sandbox = CreateSandbox();
+  SumApi api(sandbox.get());
+  sapi::v::Struct<sum_params> params;
+  params.mutable_data()->a = 1111;
+  params.mutable_data()->b = 222;
+  RunWithPercentiles(state,
+                     [&api, &params] { return api.sums(params.PtrBoth()); });
+}
+BENCHMARK(BM_CallStructPtrBoth)->UseManualTime();
+
+void BM_CallProto(benchmark::State& state) {
+  auto sandbox = CreateSandbox();
+  SumApi api(sandbox.get());
+  sumsapi::SumParamsProto proto;
+  proto.set_a(10);
+  proto.set_b(20);
+  proto.set_c(30);
+  auto pp = sapi::v::Proto<sumsapi::SumParamsProto>::FromMessage(proto);
+  CHECK_OK(pp.status());
+  RunWithPercentiles(
+      state, [&api, &pp] { return api.sumproto(pp->PtrBefore()).status(); });
+}
+BENCHMARK(BM_CallProto)->UseManualTime();
+
+void BM_AllocateFree(benchmark::State& state) {
+  auto sandbox = CreateSandbox();
+  std::vector<uint8_t> buffer(state.range(0));
+  sapi::v::Array<uint8_t> array(buffer.data(), buffer.size());
+  RunWithPercentiles(state, [&sandbox, &array]() -> absl::Status {
+    if (absl::Status status = sandbox->Allocate(&array); !status.ok()) {
+      return status;
+    }
+    return sandbox->Free(&array);
+  });
+}
+BENCHMARK(BM_AllocateFree)->Range(8, 1 << 20)->UseManualTime();
+
+void BM_Restart(benchmark::State& state) {
+  auto sandbox = CreateSandbox();
+  RunWithPercentiles(state, [&sandbox] {
+    return sandbox->Restart(/*attempt_graceful_exit=*/true);
+  });
+}
+BENCHMARK(BM_Restart)->UseManualTime();
+
+// Reset() is the cheap alternative to Restart() and should stay well below it.
+void BM_Reset(benchmark::State& state) {
+  auto sandbox = CreateSandbox();
+  RunWithPercentiles(state, [&sandbox] { return sandbox->Reset(); });
+}
+BENCHMARK(BM_Reset)->UseManualTime();
+
+}  // namespace
@@ -13,9 +13,22 @@
 // limitations under the License.
 
 #include "absl/log/log.h"
+#include "sandboxed_api/examples/sum/sum_flat_params.h"
 #include "sandboxed_api/examples/sum/sum_params.pb.h"
+#include "sandboxed_api/flat_message.h"
 
 extern "C" int sumproto(const sumsapi::SumParamsProto* params) {
   LOG(INFO) << "Param is " << params->DebugString();
   return params->a() + params->b() + params->c();
 }
+
+extern "C" int sumflat(sapi::FlatMessage<SumFlatParams>* message) {
+  sapi::FlatMessageView<SumFlatParams> params(message);
+  if (!params.ok()) {
+    return -1;
+  }
+  int sum = params.Get(&SumFlatParams::a) + params.Get(&SumFlatParams::b) +
+            params.Get(&SumFlatParams::c);
+  params.Set(&SumFlatParams::sum, sum);
+  return sum;
+}
@@ -0,0 +1,112 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Contains the layout of flat messages, shared by the host (see v::Flat) and
+// the sandboxee, which reads and writes them in place. Nothing is parsed or
+// allocated on either side.
+#ifndef SANDBOXED_API_FLAT_MESSAGE_H_
+#define SANDBOXED_API_FLAT_MESSAGE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace sapi {
+
+inline constexpr uint32_t kFlatMessageMagic = 0x54414c46;  // "FLAT"
+
+struct FlatMessageHeader {
+  uint32_t magic;
+  // sizeof() of the payload type of the writer.
+  uint32_t size;
+};
+
+// A header followed by a plain struct T. To keep messages compatible between
+// hosts and sandboxees built at different times, fields are only ever
+// appended to T, and readers check with FlatMessageView that the writer's T
+// had a field before using it.
+template <typename T>
+struct FlatMessage {
+  static_assert(std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T>,
+                "Flat messages must be plain structs");
+
+  FlatMessageHeader header;
+  T payload;
+};
+
+// Accesses a flat message in place, taking into account that its writer may
+// have had an older T with fewer fields.
+//
+// Example, in the sandboxee:
+//   extern "C" int process(sapi::FlatMessage<Params>* message) {
+//     sapi::FlatMessageView<Params> params(message);
+//     if (!params.ok()) return -1;
+//     int level = params.Get(&Params::level, /*default_value=*/6);
+//     params.Set(&Params::result, 42);
+//     ...
+template <typename T>
+class FlatMessageView {
+ public:
+  explicit FlatMessageView(FlatMessage<T>* message) : message_(message) {}
+
+  // Whether this looks like a flat message.
+  bool ok() const {
+    return message_ != nullptr && message_->header.magic == kFlatMessageMagic;
+  }
+
+  // Whether the writer's T has the field.
+  template <typename F>
+  bool Has(F T::*field) const {
+    return ok() && End(field) <= message_->header.size;
+  }
+
+  // Returns the field, or `default_value` if the writer's T did not have it.
+  template <typename F>
+  F Get(F T::*field, F default_value = F()) const {
+    return Has(field) ? message_->payload.*field : default_value;
+  }
+
+  // Sets the field if the writer's T has it, which guarantees that there is
+  // room for it. Returns false otherwise.
+  template <typename F>
+  bool Set(F T::*field, const F& value) {
+    if (!Has(field)) {
+      return false;
+    }
+    message_->payload.*field = value;
+    return true;
+  }
+
+  // The payload, only to be used as a whole if the writer's T is the same.
+  const T* payload() const {
+    return ok() && message_->header.size >= sizeof(T) ? &message_->payload
+                                                      : nullptr;
+  }
+
+ private:
+  // Returns the offset of the end of the field within T.
+  template <typename F>
+  size_t End(F T::*field) const {
+    const char* payload = reinterpret_cast<const char*>(&message_->payload);
+    const char* member =
+        reinterpret_cast<const char*>(&(message_->payload.*field));
+    return static_cast<size_t>(member - payload) + sizeof(F);
+  }
+
+  FlatMessage<T>* message_;
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_FLAT_MESSAGE_H_
@@ -0,0 +1,285 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Support classes for the asynchronous and batched calls in the headers
+// emitted by the Sandboxed API generator. Each generated Foo() method comes
+// with a FooAsync() method returning a CallFuture, and with a Foo() method on
+// the generated Batch class, which derives from BatchBuilder. Functions with
+// pointer parameters also get a Foo() overload taking the variables pointed
+// to, which uses SyncedPtr(), and, if sizes are annotated, one taking spans.
+// The synchronous methods describe their function with a CallDescriptor.
+
+#ifndef SANDBOXED_API_GENERATED_CALLS_H_
+#define SANDBOXED_API_GENERATED_CALLS_H_
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/call.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/vars.h"
+
+namespace sapi {
+namespace internal {
+
+// Owns the variables that must outlive a call made on behalf of generated
+// code.
+class CallVars {
+ public:
+  template <typename T>
+  T* Own(std::unique_ptr<T> var) {
+    T* ptr = var.get();
+    vars_.push_back(std::move(var));
+    return ptr;
+  }
+
+ private:
+  std::vector<std::unique_ptr<v::Var>> vars_;
+};
+
+// Returns a pointer to var, synchronized according to sync_type. Returns var
+// itself if it already is a pointer, so that callers can still pass
+// ::sapi::v::Ptr objects to the overloads taking variables.
+inline v::Ptr* SyncedPtr(v::Var* var, v::Var::SyncType sync_type) {
+  if (auto* ptr = dynamic_cast<v::Ptr*>(var); ptr != nullptr) {
+    return ptr;
+  }
+  switch (sync_type) {
+    case v::Var::kSyncBefore:
+      return var->PtrBefore();
+    case v::Var::kSyncAfter:
+      return var->PtrAfter();
+    case v::Var::kSyncBoth:
+      return var->PtrBoth();
+    default:
+      return var->PtrNone();
+  }
+}
+
+// Returns the integer variable var points to, or var itself if it is not a
+// pointer, for use with v::Var::SetValidLength(). Returns nullptr, making the
+// whole variable synchronized, if that variable is not an integer.
+inline v::Callable* PointedCallable(v::Var* var) {
+  if (auto* ptr = dynamic_cast<v::Ptr*>(var); ptr != nullptr) {
+    var = ptr->GetPointedVar();
+  }
+  return dynamic_cast<v::Callable*>(var);
+}
+
+// Describes a value of variable type T for a CallDescriptor, matching
+// T::GetType() and T::GetSize().
+template <typename T>
+constexpr CallDescriptor::Arg DescribeCallArg(const v::Reg<T>*) {
+  if constexpr (std::is_floating_point_v<T>) {
+    return {v::Type::kFloat, sizeof(T)};
+  } else if constexpr (std::is_pointer_v<T>) {
+    return {v::Type::kPointer, sizeof(T)};
+  } else {
+    return {v::Type::kInt, sizeof(T)};
+  }
+}
+constexpr CallDescriptor::Arg DescribeCallArg(const v::Void*) {
+  return {v::Type::kVoid, 0};
+}
+template <typename T>
+inline constexpr CallDescriptor::Arg kCallArg =
+    DescribeCallArg(static_cast<const T*>(nullptr));
+
+template <typename T, typename Ret>
+T GetReturnValue(const v::Callable* ret) {
+  return static_cast<T>(static_cast<const Ret*>(ret)->GetValue());
+}
+
+}  // namespace internal
+
+// Result of a call started with a generated FooAsync() method, which owns the
+// variables passed by value. Pointer arguments must stay alive until Get()
+// returned, see Sandbox::CallAsync(). Dropping a future that was not waited
+// for waits for its call, like Sandbox::AsyncCall does.
+template <typename T>
+class CallFuture {
+ public:
+  CallFuture() = default;
+  CallFuture(CallFuture&&) = default;
+  CallFuture& operator=(CallFuture&& other) {
+    if (this != &other) {
+      // Waits for a pending call while the variables it uses are still alive.
+      call_.reset();
+      vars_ = std::move(other.vars_);
+      call_ = std::move(other.call_);
+      ret_ = other.ret_;
+      get_ = other.get_;
+    }
+    return *this;
+  }
+
+  // Waits for the call to finish and returns its result. Can only be called
+  // once.
+  absl::StatusOr<T> Get() {
+    if (!call_) {
+      return absl::FailedPreconditionError("Call was not started");
+    }
+    SAPI_RETURN_IF_ERROR(call_->Wait());
+    return get_(ret_);
+  }
+
+  // Returns whether Get() returns without waiting for the sandboxee, see
+  // Sandbox::AsyncCall::IsDone().
+  bool IsDone() { return !call_ || call_->IsDone(); }
+  int readiness_fd() const { return call_ ? call_->readiness_fd() : -1; }
+
+  // Used by generated code.
+  template <typename U>
+  U* Own(std::unique_ptr<U> var) {
+    return vars_->Own(std::move(var));
+  }
+  template <typename Ret>
+  absl::Status Start(Sandbox* sandbox, const std::string& func, Ret* ret,
+                     std::initializer_list<v::Callable*> args) {
+    SAPI_ASSIGN_OR_RETURN(call_, sandbox->CallAsync(func, ret, args));
+    ret_ = ret;
+    get_ = &internal::GetReturnValue<T, Ret>;
+    return absl::OkStatus();
+  }
+
+ private:
+  // Behind a pointer so that the variables don't move along with the future.
+  // Declared before call_ so that a pending call is waited for first.
+  std::unique_ptr<internal::CallVars> vars_ =
+      std::make_unique<internal::CallVars>();
+  std::optional<Sandbox::AsyncCall> call_;
+  const v::Callable* ret_ = nullptr;
+  T (*get_)(const v::Callable*) = nullptr;
+};
+
+template <>
+class CallFuture<void> {
+ public:
+  CallFuture() = default;
+  CallFuture(CallFuture&&) = default;
+  CallFuture& operator=(CallFuture&& other) {
+    if (this != &other) {
+      // Waits for a pending call while the variables it uses are still alive.
+      call_.reset();
+      vars_ = std::move(other.vars_);
+      call_ = std::move(other.call_);
+    }
+    return *this;
+  }
+
+  // Waits for the call to finish. Can only be called once.
+  absl::Status Get() {
+    if (!call_) {
+      return absl::FailedPreconditionError("Call was not started");
+    }
+    return call_->Wait();
+  }
+
+  // Returns whether Get() returns without waiting for the sandboxee, see
+  // Sandbox::AsyncCall::IsDone().
+  bool IsDone() { return !call_ || call_->IsDone(); }
+  int readiness_fd() const { return call_ ? call_->readiness_fd() : -1; }
+
+  // Used by generated code.
+  template <typename U>
+  U* Own(std::unique_ptr<U> var) {
+    return vars_->Own(std::move(var));
+  }
+  absl::Status Start(Sandbox* sandbox, const std::string& func, v::Void* ret,
+                     std::initializer_list<v::Callable*> args) {
+    SAPI_ASSIGN_OR_RETURN(call_, sandbox->CallAsync(func, ret, args));
+    return absl::OkStatus();
+  }
+
+ private:
+  std::unique_ptr<internal::CallVars> vars_ =
+      std::make_unique<internal::CallVars>();
+  std::optional<Sandbox::AsyncCall> call_;
+};
+
+// Result of a call queued on a generated Batch. Only valid after the batch
+// ran successfully, and as long as the batch exists.
+template <typename T>
+class BatchResult {
+ public:
+  T value() const { return get_(ret_); }
+
+ private:
+  friend class BatchBuilder;
+
+  BatchResult(const v::Callable* ret, T (*get)(const v::Callable*))
+      : ret_(ret), get_(get) {}
+
+  const v::Callable* ret_;
+  T (*get_)(const v::Callable*);
+};
+
+// Base class of the generated Batch classes, which queue calls to be made in a
+// single round trip to the sandboxee, see Sandbox::CallBatch().
+class BatchBuilder {
+ public:
+  explicit BatchBuilder(Sandbox* sandbox) : sandbox_(sandbox) {}
+
+  BatchBuilder(BatchBuilder&&) = default;
+  BatchBuilder& operator=(BatchBuilder&&) = default;
+
+  // Makes the queued calls, stopping at the first one that fails. Pointer
+  // arguments must stay alive until Run() returned. Can only be called once.
+  absl::Status Run() {
+    if (ran_) {
+      return absl::FailedPreconditionError("Batch already ran");
+    }
+    ran_ = true;
+    return sandbox_->CallBatch(calls_);
+  }
+
+  // Returns the number of queued calls.
+  size_t size() const { return calls_.size(); }
+
+ protected:
+  template <typename U>
+  U* Own(std::unique_ptr<U> var) {
+    return vars_->Own(std::move(var));
+  }
+  template <typename T, typename Ret>
+  BatchResult<T> Add(std::string func, Ret* ret,
+                     std::initializer_list<v::Callable*> args) {
+    calls_.push_back({std::move(func), ret, args});
+    return BatchResult<T>(ret, &internal::GetReturnValue<T, Ret>);
+  }
+  void Add(std::string func, v::Void* ret,
+           std::initializer_list<v::Callable*> args) {
+    calls_.push_back({std::move(func), ret, args});
+  }
+
+ private:
+  Sandbox* sandbox_;
+  std::unique_ptr<internal::CallVars> vars_ =
+      std::make_unique<internal::CallVars>();
+  std::vector<Sandbox::BatchedCall> calls_;
+  bool ran_ = false;
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_GENERATED_CALLS_H_
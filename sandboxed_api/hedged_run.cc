@@ -0,0 +1,70 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "sandboxed_api/hedged_run.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace sapi {
+
+absl::Duration HedgePolicy::HedgeDelay() const {
+  std::vector<absl::Duration> run_times;
+  {
+    absl::MutexLock lock(&mutex_);
+    if (run_times_.empty() || run_times_.size() < options_.min_samples) {
+      return absl::InfiniteDuration();
+    }
+    run_times = run_times_;
+  }
+  const size_t rank =
+      static_cast<size_t>(std::ceil(options_.percentile * run_times.size()));
+  const size_t index = std::clamp<size_t>(rank, 1, run_times.size()) - 1;
+  std::nth_element(run_times.begin(), run_times.begin() + index,
+                   run_times.end());
+  return std::max(run_times[index], options_.min_delay);
+}
+
+void HedgePolicy::RecordRunTime(absl::Duration run_time) {
+  absl::MutexLock lock(&mutex_);
+  if (options_.window == 0) {
+    return;
+  }
+  if (run_times_.size() < options_.window) {
+    run_times_.push_back(run_time);
+    return;
+  }
+  run_times_[next_] = run_time;
+  next_ = (next_ + 1) % options_.window;
+}
+
+void HedgePolicy::RecordRun(bool hedged, bool hedge_won) {
+  absl::MutexLock lock(&mutex_);
+  ++stats_.runs;
+  stats_.hedges += hedged;
+  stats_.hedge_wins += hedge_won;
+}
+
+HedgeStats HedgePolicy::stats() const {
+  absl::MutexLock lock(&mutex_);
+  return stats_;
+}
+
+}  // namespace sapi
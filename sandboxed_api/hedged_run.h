@@ -0,0 +1,198 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef SANDBOXED_API_HEDGED_RUN_H_
+#define SANDBOXED_API_HEDGED_RUN_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>  // NOLINT(build/c++11)
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox_pool.h"
+
+namespace sapi {
+
+struct HedgeOptions {
+  // Percentile of the recent run times after which a second try is started.
+  double percentile = 0.95;
+  // Number of recent run times the percentile is computed from.
+  size_t window = 1024;
+  // No second tries are started before this many run times were recorded.
+  size_t min_samples = 32;
+  // Lower bound of the delay, so that fast functions are not hedged on noise.
+  absl::Duration min_delay = absl::Milliseconds(1);
+};
+
+struct HedgeStats {
+  // Number of calls to HedgedRun().
+  uint64_t runs = 0;
+  // Number of runs that started a second try.
+  uint64_t hedges = 0;
+  // Number of runs whose result came from the second try.
+  uint64_t hedge_wins = 0;
+
+  double hedge_rate() const {
+    return runs == 0 ? 0 : static_cast<double>(hedges) / runs;
+  }
+};
+
+// Decides when HedgedRun() starts a second try, from the run times of earlier
+// successful runs. Keep one per kind of function, so that fast ones are not
+// hedged based on the run times of slow ones. Thread-safe.
+class HedgePolicy {
+ public:
+  explicit HedgePolicy(HedgeOptions options = {}) : options_(options) {}
+
+  HedgePolicy(const HedgePolicy&) = delete;
+  HedgePolicy& operator=(const HedgePolicy&) = delete;
+
+  // Returns how long a try may run before a second one is started, or
+  // absl::InfiniteDuration() if not enough run times were recorded yet.
+  absl::Duration HedgeDelay() const;
+
+  // Adds the run time of a successful try.
+  void RecordRunTime(absl::Duration run_time);
+
+  // Counts a finished run.
+  void RecordRun(bool hedged, bool hedge_won);
+
+  HedgeStats stats() const;
+
+ private:
+  const HedgeOptions options_;
+
+  mutable absl::Mutex mutex_;
+  // Ring buffer of the most recent run times.
+  std::vector<absl::Duration> run_times_ ABSL_GUARDED_BY(mutex_);
+  size_t next_ ABSL_GUARDED_BY(mutex_) = 0;
+  HedgeStats stats_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Runs `function` on a sandbox leased from `pool`. If it is still running
+// after policy.HedgeDelay(), the same function is started on a second sandbox,
+// provided that the pool has one ready. The first try that succeeds provides
+// the result, the sandbox of the other one is terminated, which makes its
+// calls fail. The result type is that of `function`, which is called as
+// `function(T* sandbox)` and must return absl::Status or absl::StatusOr<>.
+// As it may run twice, concurrently, it must be idempotent and must not
+// touch state outside of the sandbox that the other try depends on.
+// This trades occasional extra work for shorter tail latency when run times
+// are dominated by rare slow tries, e.g. page faults in a fresh sandbox.
+//
+// Example:
+//   SandboxPool<SumSandbox> pool({.size = 4});
+//   HedgePolicy sum_policy;
+//   absl::StatusOr<int> sum = HedgedRun(
+//       pool,
+//       [](SumSandbox* sandbox) {
+//         SumApi api(sandbox);
+//         return api.sum(1, 2);
+//       },
+//       sum_policy);
+template <typename T, typename Function,
+          typename Result = std::invoke_result_t<Function&, T*>>
+Result HedgedRun(SandboxPool<T>& pool, Function function,
+                 HedgePolicy& policy) {
+  static_assert(std::is_constructible_v<Result, absl::Status>,
+                "Function must return absl::Status or absl::StatusOr<>");
+  using Lease = typename SandboxPool<T>::Lease;
+
+  absl::StatusOr<Lease> primary = pool.Acquire();
+  if (!primary.ok()) {
+    return Result(primary.status());
+  }
+  const absl::Duration delay = policy.HedgeDelay();
+
+  absl::Mutex mutex;
+  bool primary_done = false;
+  bool hedged = false;
+  // Index of the first try that succeeded, or -1.
+  int winner = -1;
+  // Sandboxes of the tries that are still running.
+  T* running[2] = {primary->get(), nullptr};
+
+  auto run = [&](int index, Lease& lease) {
+    const absl::Time start = absl::Now();
+    Result result = function(lease.get());
+    const absl::Duration run_time = absl::Now() - start;
+    if (!result.ok()) {
+      lease.Discard();
+    }
+    absl::MutexLock lock(&mutex);
+    running[index] = nullptr;
+    if (index == 0) {
+      primary_done = true;
+    }
+    if (result.ok() && winner == -1) {
+      winner = index;
+      policy.RecordRunTime(run_time);
+      // Terminated while holding the lock, so that the other try cannot
+      // return its sandbox to the pool meanwhile.
+      if (T* other = running[1 - index]; other != nullptr) {
+        other->Terminate(/*attempt_graceful_exit=*/false);
+      }
+    }
+    return result;
+  };
+
+  std::optional<Result> hedge_result;
+  std::thread hedge;
+  if (delay != absl::InfiniteDuration()) {
+    hedge = std::thread([&] {
+      {
+        absl::MutexLock lock(&mutex);
+        if (mutex.AwaitWithTimeout(absl::Condition(&primary_done), delay)) {
+          return;
+        }
+      }
+      // Waiting for a sandbox to be initialized would defeat the purpose.
+      absl::StatusOr<Lease> lease = pool.TryAcquire();
+      if (!lease.ok()) {
+        return;
+      }
+      {
+        absl::MutexLock lock(&mutex);
+        if (primary_done) {
+          return;
+        }
+        running[1] = lease->get();
+        hedged = true;
+      }
+      hedge_result.emplace(run(1, *lease));
+    });
+  }
+  Result result = run(0, *primary);
+  if (hedge.joinable()) {
+    hedge.join();
+  }
+  policy.RecordRun(hedged, winner == 1);
+  if (winner == 1) {
+    return *std::move(hedge_result);
+  }
+  return result;
+}
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_HEDGED_RUN_H_
@@ -0,0 +1,119 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/output_channel.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/util/strerror.h"
+#include "sandboxed_api/var_int.h"
+
+namespace sapi {
+
+absl::StatusOr<std::unique_ptr<OutputChannel>> OutputChannel::Create(
+    Sandbox* sandbox, Callback callback, size_t buffer_size) {
+  if (buffer_size == 0) {
+    return absl::InvalidArgumentError("buffer_size must be positive");
+  }
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    return absl::InternalError(
+        absl::StrCat("socketpair() failed: ", StrError(errno)));
+  }
+  int read_fd = fds[0];
+  // Closes the local write end, the sandboxee holds the only one left, so
+  // reading ends once it is closed there.
+  v::Fd write_fd(fds[1]);
+  if (absl::Status status = sandbox->TransferToSandboxee(&write_fd);
+      !status.ok()) {
+    close(read_fd);
+    return status;
+  }
+  write_fd.OwnRemoteFd(false);
+
+  std::unique_ptr<OutputChannel> channel(
+      new OutputChannel(sandbox, read_fd, write_fd.GetRemoteFd()));
+  channel->reader_ = std::thread(
+      [channel = channel.get(), callback = std::move(callback), buffer_size] {
+        channel->Read(callback, buffer_size);
+      });
+  return channel;
+}
+
+OutputChannel::~OutputChannel() {
+  if (!finished_) {
+    Finish().IgnoreError();
+  }
+}
+
+void OutputChannel::Read(const Callback& callback, size_t buffer_size) {
+  std::vector<uint8_t> buffer(buffer_size);
+  for (;;) {
+    ssize_t n = read(read_fd_, buffer.data(), buffer.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      if (status_.ok()) {
+        status_ = absl::InternalError(
+            absl::StrCat("Reading output failed: ", StrError(errno)));
+      }
+      return;
+    }
+    if (n == 0) {
+      return;
+    }
+    // After an error keep reading, so that writes in the sandboxee don't block.
+    if (status_.ok()) {
+      status_ = callback(absl::MakeConstSpan(buffer.data(), n));
+    }
+  }
+}
+
+absl::Status OutputChannel::Finish() {
+  if (finished_) {
+    return absl::FailedPreconditionError("OutputChannel already finished");
+  }
+  finished_ = true;
+
+  absl::Status close_status;
+  if (own_remote_fd_) {
+    close_status = sandbox_->rpc_channel()->Close(remote_fd_);
+    if (!close_status.ok()) {
+      // EOF will not come, e.g. because the sandboxee is gone.
+      shutdown(read_fd_, SHUT_RDWR);
+    }
+  }
+  reader_.join();
+  close(read_fd_);
+  SAPI_RETURN_IF_ERROR(close_status);
+  return status_;
+}
+
+}  // namespace sapi
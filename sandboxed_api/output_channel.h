@@ -0,0 +1,100 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_OUTPUT_CHANNEL_H_
+#define SANDBOXED_API_OUTPUT_CHANNEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox.h"
+
+namespace sapi {
+
+// Streams data from the sandboxee to the host while calls are in progress.
+// Sandboxed code, typically a write callback of the library, writes to
+// remote_fd() as data becomes available. A host thread reads it concurrently
+// and passes it to a callback, so that neither side has to buffer the whole
+// output and the host can process it before the call returns. The sandbox
+// policy must allow recvmsg, to receive the fd, and write.
+//
+// Example:
+//   std::string body;
+//   SAPI_ASSIGN_OR_RETURN(
+//       std::unique_ptr<OutputChannel> channel,
+//       OutputChannel::Create(&sandbox, [&](absl::Span<const uint8_t> data) {
+//         body.append(data.begin(), data.end());
+//         return absl::OkStatus();
+//       }));
+//   SAPI_RETURN_IF_ERROR(api.download(url.PtrBefore(), channel->remote_fd()));
+//   SAPI_RETURN_IF_ERROR(channel->Finish());
+class OutputChannel {
+ public:
+  // Receives the data in the order it was written. Called on the reader thread,
+  // the span is only valid during the call. Once it returns an error, the rest
+  // of the data is discarded.
+  using Callback = std::function<absl::Status(absl::Span<const uint8_t> data)>;
+
+  static constexpr size_t kDefaultBufferSize = 64 << 10;
+
+  // Creates a channel into the sandboxee of `sandbox`, reading up to
+  // `buffer_size` bytes at a time.
+  static absl::StatusOr<std::unique_ptr<OutputChannel>> Create(
+      Sandbox* sandbox, Callback callback,
+      size_t buffer_size = kDefaultBufferSize);
+
+  OutputChannel(const OutputChannel&) = delete;
+  OutputChannel& operator=(const OutputChannel&) = delete;
+
+  // Finishes the channel if Finish() wasn't called.
+  ~OutputChannel();
+
+  // The fd of the channel in the sandboxee.
+  int remote_fd() const { return remote_fd_; }
+
+  // Leaves closing remote_fd() to the sandboxed code, e.g. because the library
+  // closes a stream it was given. Finish() then waits for it to be closed.
+  void ReleaseRemoteFd() { own_remote_fd_ = false; }
+
+  // Closes remote_fd() in the sandboxee, unless released, and waits until all
+  // data written before was passed to the callback. Returns the first error of
+  // the callback or of reading.
+  absl::Status Finish();
+
+ private:
+  OutputChannel(Sandbox* sandbox, int read_fd, int remote_fd)
+      : sandbox_(sandbox), read_fd_(read_fd), remote_fd_(remote_fd) {}
+
+  // Runs on reader_ until EOF.
+  void Read(const Callback& callback, size_t buffer_size);
+
+  Sandbox* sandbox_;
+  int read_fd_;
+  int remote_fd_;
+  bool own_remote_fd_ = true;
+  std::thread reader_;
+  // Written by reader_, read after joining it.
+  absl::Status status_;
+  bool finished_ = false;
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_OUTPUT_CHANNEL_H_
@@ -0,0 +1,147 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_PARALLEL_MAP_H_
+#define SANDBOXED_API_PARALLEL_MAP_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>  // NOLINT(build/c++11)
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox_pool.h"
+
+namespace sapi {
+
+struct ParallelMapOptions {
+  // Maximum number of items processed at the same time, each on its own lease.
+  // Also bounds the number of threads started.
+  size_t concurrency = 1;
+  // Number of times a failed item is retried. Every retry runs on a different
+  // sandbox, the failed one is discarded.
+  int retry_count = 0;
+  // Wall-time limit for a single try of an item. Zero means no limit.
+  absl::Duration time_limit = absl::ZeroDuration();
+};
+
+struct ParallelMapItemStats {
+  // Number of times the function ran for the item.
+  int tries = 0;
+  // Time spent waiting for a sandbox from the pool, summed over all tries.
+  absl::Duration wait_time = absl::ZeroDuration();
+  // Time spent in the function, summed over all tries.
+  absl::Duration run_time = absl::ZeroDuration();
+};
+
+// Applies `function` to every element of `inputs`, running up to
+// options.concurrency items at once on sandboxes leased from `pool`. Returns
+// one result per input, in the order of `inputs`. The result type is that of
+// `function`, which is called as `function(T* sandbox, const Input& input)` and
+// must return absl::Status or absl::StatusOr<>. It is called concurrently from
+// several threads.
+// Items only wait for each other through the pool: a slow item delays no
+// other item unless the pool runs out of sandboxes. If `stats` is not null, it
+// receives the ParallelMapItemStats of every item, in the same order.
+//
+// Example:
+//   SandboxPool<SumSandbox> pool({.size = 4});
+//   std::vector<absl::StatusOr<int>> sums = ParallelMap(
+//       pool, absl::MakeConstSpan(inputs),
+//       [](SumSandbox* sandbox, const int& input) {
+//         SumApi api(sandbox);
+//         return api.sum(input, 1);
+//       },
+//       {.concurrency = 4, .retry_count = 1});
+template <typename T, typename Input, typename Function,
+          typename Result = std::invoke_result_t<Function&, T*, const Input&>>
+std::vector<Result> ParallelMap(
+    SandboxPool<T>& pool, absl::Span<const Input> inputs, Function function,
+    const ParallelMapOptions& options = {},
+    std::vector<ParallelMapItemStats>* stats = nullptr) {
+  static_assert(std::is_constructible_v<Result, absl::Status>,
+                "Function must return absl::Status or absl::StatusOr<>");
+  CHECK_GT(options.concurrency, 0);
+
+  std::vector<Result> results;
+  results.reserve(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    results.emplace_back(absl::UnknownError("Item was not processed"));
+  }
+  std::vector<ParallelMapItemStats> item_stats(inputs.size());
+
+  auto run_item = [&](size_t index) {
+    ParallelMapItemStats& item = item_stats[index];
+    while (true) {
+      absl::Time start = absl::Now();
+      absl::StatusOr<typename SandboxPool<T>::Lease> lease = pool.Acquire();
+      item.wait_time += absl::Now() - start;
+      if (!lease.ok()) {
+        results[index] = Result(lease.status());
+        return;
+      }
+      ++item.tries;
+      if (options.time_limit != absl::ZeroDuration()) {
+        absl::Status status = (*lease)->SetWallTimeLimit(options.time_limit);
+        if (!status.ok()) {
+          results[index] = Result(std::move(status));
+          lease->Discard();
+          return;
+        }
+      }
+      start = absl::Now();
+      Result result = function(lease->get(), inputs[index]);
+      item.run_time += absl::Now() - start;
+      if (options.time_limit != absl::ZeroDuration() && (*lease)->is_active()) {
+        (*lease)->SetWallTimeLimit(absl::ZeroDuration()).IgnoreError();
+      }
+      if (result.ok() || item.tries > options.retry_count) {
+        results[index] = std::move(result);
+        return;
+      }
+      // The failure may have left the sandbox in a bad state.
+      lease->Discard();
+    }
+  };
+
+  std::atomic<size_t> next = 0;
+  size_t nworkers = std::min(options.concurrency, inputs.size());
+  std::vector<std::thread> workers;
+  workers.reserve(nworkers);
+  for (size_t i = 0; i < nworkers; ++i) {
+    workers.emplace_back([&] {
+      for (size_t index = next++; index < inputs.size(); index = next++) {
+        run_item(index);
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  if (stats != nullptr) {
+    *stats = std::move(item_stats);
+  }
+  return results;
+}
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_PARALLEL_MAP_H_
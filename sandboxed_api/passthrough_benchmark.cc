@@ -0,0 +1,102 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the overhead of sandboxing a library by running the same calls
+// against a sandboxee and against the library in this process, see
+// Sandbox::RunInProcess(). Both variants share the generated code, so the
+// difference is what the process boundary, the transfers and starting the
+// sandboxee cost. Run with `bazel run -c opt`.
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/examples/stringop/stringop-sapi.sapi.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/var_lenval.h"
+
+namespace sapi {
+namespace {
+
+enum Mode : int64_t {
+  kSandboxed = 0,
+  kInProcess = 1,
+};
+
+std::unique_ptr<Sandbox> CreateSandbox(int64_t mode) {
+  if (mode == kInProcess) {
+    return std::make_unique<StringopPassthroughSandbox>();
+  }
+  return std::make_unique<StringopSandbox>();
+}
+
+Sandbox* InitSandbox(int64_t mode) {
+  Sandbox* sandbox = CreateSandbox(mode).release();
+  CHECK_OK(sandbox->Init());
+  return sandbox;
+}
+
+// Shared by all benchmarks, so that only the calls are measured.
+Sandbox* GetSandbox(int64_t mode) {
+  static Sandbox* sandboxed = InitSandbox(kSandboxed);
+  static Sandbox* in_process = InitSandbox(kInProcess);
+  return mode == kInProcess ? in_process : sandboxed;
+}
+
+// Args: mode.
+void BM_Init(benchmark::State& state) {
+  for (auto _ : state) {
+    std::unique_ptr<Sandbox> sandbox = CreateSandbox(state.range(0));
+    CHECK_OK(sandbox->Init());
+    state.PauseTiming();
+    sandbox.reset();
+    state.ResumeTiming();
+  }
+}
+
+// Args: mode.
+void BM_Call(benchmark::State& state) {
+  StringopApi api(GetSandbox(state.range(0)));
+  for (auto _ : state) {
+    CHECK_OK(api.nop());
+  }
+}
+
+// Args: size, mode.
+void BM_CallWithTransfers(benchmark::State& state) {
+  const size_t size = state.range(0);
+  StringopApi api(GetSandbox(state.range(1)));
+  const std::string input(size, 'x');
+  for (auto _ : state) {
+    v::LenVal value(input.data(), input.size());
+    absl::StatusOr<int> result = api.reverse_string(value.PtrBoth());
+    CHECK_OK(result.status());
+    CHECK(*result);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_Init)->ArgName("in_process")->DenseRange(kSandboxed, kInProcess);
+BENCHMARK(BM_Call)->ArgName("in_process")->DenseRange(kSandboxed, kInProcess);
+BENCHMARK(BM_CallWithTransfers)
+    ->ArgNames({"size", "in_process"})
+    ->ArgsProduct({benchmark::CreateRange(64, 16 << 20, /*multi=*/64),
+                   {kSandboxed, kInProcess}});
+
+}  // namespace
+}  // namespace sapi
@@ -14,6 +14,8 @@
 
 #include "sandboxed_api/proto_helper.h"
 
+#include <string>
+
 #include "absl/status/status.h"
 
 namespace sapi {
@@ -27,7 +29,7 @@ absl::Status DeserializeProto(const char* data, size_t len,
     return absl::InternalError("Unable to parse proto from array");
   }
 
-  auto pb_data = envelope.protobuf_data();
+  const std::string& pb_data = envelope.protobuf_data();
   if (!output.ParseFromArray(pb_data.data(), pb_data.size())) {
     return absl::InternalError("Unable to parse proto from envelope data");
   }
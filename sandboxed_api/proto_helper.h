@@ -21,6 +21,7 @@
 #include <type_traits>
 #include <vector>
 
+#include "google/protobuf/arena.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "sandboxed_api/proto_arg.pb.h"
@@ -48,6 +49,25 @@ absl::StatusOr<T> DeserializeProto(const char* data, size_t len) {
   return result;
 }
 
+// Deserializes a proto allocated on `arena`, avoiding a copy of the message
+// when returning it. If `arena` is nullptr, the caller takes ownership.
+template <typename T>
+absl::StatusOr<T*> DeserializeProto(const char* data, size_t len,
+                                    google::protobuf::Arena* arena) {
+  static_assert(std::is_base_of<google::protobuf::MessageLite, T>::value,
+                "Template argument must be a proto message");
+  T* result = google::protobuf::Arena::CreateMessage<T>(arena);
+  if (absl::Status status =
+          internal::DeserializeProto(data, len, /*output=*/*result);
+      !status.ok()) {
+    if (arena == nullptr) {
+      delete result;
+    }
+    return status;
+  }
+  return result;
+}
+
 }  // namespace sapi
 
 #endif  // SANDBOXED_API_PROTO_HELPER_H_
@@ -14,21 +14,84 @@
 
 #include "sandboxed_api/rpcchannel.h"
 
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/const_init.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/log/log.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/call.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
 
 namespace sapi {
+namespace {
+
+// Returns the key under which the handle of the function called by `call` is
+// stored.
+std::string FuncKey(const CompactFuncCall& call) {
+  return absl::StrCat(call.func, absl::string_view("\0", 1),
+                      FuncCallTypeSignature(call));
+}
+
+ABSL_CONST_INIT absl::Mutex live_channels_mutex(absl::kConstInit);
+
+// Generations of the channels that were not retired yet.
+absl::flat_hash_set<uint64_t>& LiveChannels()
+    ABSL_SHARED_LOCKS_REQUIRED(live_channels_mutex) {
+  static auto* live_channels = new absl::flat_hash_set<uint64_t>();
+  return *live_channels;
+}
+
+uint64_t NextGeneration() {
+  ABSL_CONST_INIT static std::atomic<uint64_t> next_generation = 1;
+  return next_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+RPCChannel::RPCChannel(sandbox2::Comms* comms)
+    : comms_(comms), generation_(NextGeneration()) {
+  absl::MutexLock lock(&live_channels_mutex);
+  LiveChannels().insert(generation_);
+}
+
+RPCChannel::~RPCChannel() { Retire(); }
+
+void RPCChannel::Retire() {
+  absl::MutexLock lock(&live_channels_mutex);
+  LiveChannels().erase(generation_);
+}
+
+bool RPCChannel::IsLive(uint64_t generation) {
+  absl::ReaderMutexLock lock(&live_channels_mutex);
+  return LiveChannels().contains(generation);
+}
 
 absl::Status RPCChannel::Call(const FuncCall& call, uint32_t tag, FuncRet* ret,
                               v::Type exp_type) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(tag, sizeof(call), &call)) {
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(tag, sizeof(call), &call)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
   SAPI_ASSIGN_OR_RETURN(auto fret, Return(exp_type));
@@ -36,6 +99,227 @@ absl::Status RPCChannel::Call(const FuncCall& call, uint32_t tag, FuncRet* ret,
   return absl::OkStatus();
 }
 
+absl::Status RPCChannel::Call(CompactFuncCall* call, FuncRet* ret) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  const std::string key = FuncKey(*call);
+  call->func_id = LookupFuncIdLocked(key);
+  send_buffer_.clear();
+  EncodeCompactFuncCall(*call, &send_buffer_);
+  if (!SendLocked(comms::kMsgCallCompact, send_buffer_.size(),
+                       send_buffer_.data())) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  SAPI_ASSIGN_OR_RETURN(auto fret,
+                        ReturnWithinTimeLimitLocked(call->ret_type));
+  RememberFuncIdLocked(key, fret);
+  *ret = fret;
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::Call(const CallDescriptor& descriptor,
+                              CompactFuncCall* call, FuncRet* ret) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  auto it = descriptor_func_ids_.find(&descriptor);
+  call->func_id = it != descriptor_func_ids_.end() ? it->second : 0;
+  if (call->func_id == 0) {
+    call->func = descriptor.func;
+  }
+  send_buffer_.clear();
+  EncodeCompactFuncCall(*call, &send_buffer_);
+  if (!SendLocked(comms::kMsgCallCompact, send_buffer_.size(),
+                       send_buffer_.data())) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  SAPI_ASSIGN_OR_RETURN(auto fret,
+                        ReturnWithinTimeLimitLocked(call->ret_type));
+  if (fret.func_id != 0) {
+    descriptor_func_ids_.insert_or_assign(&descriptor, fret.func_id);
+  }
+  *ret = fret;
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::CallBatch(absl::Span<CompactFuncCall> calls,
+                                   std::vector<FuncRet>* rets) {
+  rets->clear();
+  if (calls.empty()) {
+    return absl::OkStatus();
+  }
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  std::vector<std::string> keys;
+  keys.reserve(calls.size());
+  send_buffer_.clear();
+  for (CompactFuncCall& call : calls) {
+    call.func_id = LookupFuncIdLocked(keys.emplace_back(FuncKey(call)));
+    EncodeCompactFuncCall(call, &send_buffer_);
+  }
+  if (!SendLocked(comms::kMsgCallBatch, send_buffer_.size(),
+                       send_buffer_.data())) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  uint32_t tag;
+  std::vector<uint8_t> bytes;
+  if (!comms_->RecvTLV(&tag, &bytes)) {
+    return absl::UnavailableError("Receiving TLV value failed");
+  }
+  if (tag != comms::kMsgReturn) {
+    LOG(ERROR) << "tag != comms::kMsgReturn (" << absl::StrCat(absl::Hex(tag))
+               << " != " << absl::StrCat(absl::Hex(comms::kMsgReturn)) << ")";
+    return absl::UnavailableError("Received TLV has incorrect tag");
+  }
+  const size_t num_rets = bytes.size() / sizeof(FuncRet);
+  if (bytes.size() % sizeof(FuncRet) != 0 || num_rets == 0 ||
+      num_rets > calls.size()) {
+    LOG(ERROR) << "Unexpected length of batch results: " << bytes.size();
+    return absl::UnavailableError("Received TLV has incorrect length");
+  }
+  rets->resize(num_rets);
+  memcpy(rets->data(), bytes.data(), bytes.size());
+  for (size_t i = 0; i < num_rets; ++i) {
+    const FuncRet& ret = (*rets)[i];
+    if (ret.ret_type != calls[i].ret_type) {
+      LOG(ERROR) << "FuncRet->type != exp_type (" << ret.ret_type
+                 << " != " << calls[i].ret_type << ")";
+      return absl::UnavailableError("Received TLV has incorrect return type");
+    }
+    if (!ret.success) {
+      return absl::UnavailableError(
+          absl::StrCat("Function call ", i, " of the batch failed"));
+    }
+    RememberFuncIdLocked(keys[i], ret);
+  }
+  if (num_rets != calls.size()) {
+    return absl::UnavailableError("Batch was cut short by the sandboxee");
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<uint64_t> RPCChannel::CallAsync(CompactFuncCall* call) {
+  absl::MutexLock lock(&mutex_);
+  std::string key = FuncKey(*call);
+  call->func_id = LookupFuncIdLocked(key);
+  send_buffer_.clear();
+  EncodeCompactFuncCall(*call, &send_buffer_);
+  if (!SendLocked(comms::kMsgCallCompact, send_buffer_.size(),
+                       send_buffer_.data())) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  const uint64_t id = next_call_id_++;
+  outstanding_calls_.push_back({id, call->ret_type, std::move(key)});
+  return id;
+}
+
+absl::StatusOr<FuncRet> RPCChannel::AwaitCall(uint64_t id) {
+  absl::MutexLock lock(&mutex_);
+  // Results arrive in the order the calls were sent, so receive until the
+  // requested one shows up.
+  while (!finished_calls_.contains(id)) {
+    if (outstanding_calls_.empty()) {
+      return absl::NotFoundError(absl::StrCat("Unknown call id: ", id));
+    }
+    ReceiveOutstandingCallLocked();
+  }
+  auto node = finished_calls_.extract(id);
+  return std::move(node.mapped());
+}
+
+bool RPCChannel::IsCallDone(uint64_t id) {
+  absl::MutexLock lock(&mutex_);
+  while (!finished_calls_.contains(id)) {
+    // Unknown ids are reported by AwaitCall().
+    if (outstanding_calls_.empty()) {
+      return true;
+    }
+    // The sandboxee sends each result at once, so receiving it does not wait
+    // once its first bytes are there.
+    if (!comms_->HasPendingData()) {
+      return false;
+    }
+    ReceiveOutstandingCallLocked();
+  }
+  return true;
+}
+
+void RPCChannel::ReceiveOutstandingCallLocked() {
+  OutstandingCall call = std::move(outstanding_calls_.front());
+  outstanding_calls_.pop_front();
+  absl::StatusOr<FuncRet> fret = Return(call.ret_type);
+  if (fret.ok()) {
+    RememberFuncIdLocked(call.func_key, *fret);
+  }
+  finished_calls_.emplace(call.id, std::move(fret));
+}
+
+uint32_t RPCChannel::LookupFuncIdLocked(const std::string& key) const {
+  auto it = func_ids_.find(key);
+  return it != func_ids_.end() ? it->second : 0;
+}
+
+void RPCChannel::RememberFuncIdLocked(const std::string& key,
+                                      const FuncRet& ret) {
+  if (ret.func_id != 0) {
+    func_ids_.insert_or_assign(key, ret.func_id);
+  }
+}
+
+void RPCChannel::ReceiveOutstandingCallsLocked() {
+  while (!outstanding_calls_.empty()) {
+    ReceiveOutstandingCallLocked();
+  }
+}
+
+void RPCChannel::SetCallTimeLimit(absl::Duration limit,
+                                  absl::Duration grace_period,
+                                  absl::AnyInvocable<void()> interrupt) {
+  absl::MutexLock lock(&mutex_);
+  call_time_limit_ = limit;
+  call_grace_period_ = grace_period;
+  interrupt_call_ = std::move(interrupt);
+}
+
+namespace {
+
+// Waits until `comms` has data to receive, or `deadline` passed.
+bool WaitForData(sandbox2::Comms* comms, absl::Time deadline) {
+  while (!comms->HasPendingData()) {
+    const absl::Duration remaining = deadline - absl::Now();
+    if (remaining <= absl::ZeroDuration()) {
+      return false;
+    }
+    pollfd pfd = {.fd = comms->GetConnectionFD(), .events = POLLIN};
+    // Rounded up, so that the deadline has passed when poll() times out.
+    poll(&pfd, 1, absl::ToInt64Milliseconds(remaining + absl::Milliseconds(1)));
+  }
+  return true;
+}
+
+}  // namespace
+
+absl::StatusOr<FuncRet> RPCChannel::ReturnWithinTimeLimitLocked(
+    v::Type exp_type) {
+  if (call_time_limit_ == absl::ZeroDuration() ||
+      WaitForData(comms_, absl::Now() + call_time_limit_)) {
+    return Return(exp_type);
+  }
+  if (interrupt_call_) {
+    interrupt_call_();
+  }
+  if (!WaitForData(comms_, absl::Now() + call_grace_period_)) {
+    // The result could still arrive any time, and be taken for that of a later
+    // call.
+    comms_->Terminate();
+    return absl::DeadlineExceededError(
+        "Call exceeded its time limit and did not return when interrupted");
+  }
+  // Received so that later calls get their own results.
+  SAPI_RETURN_IF_ERROR(Return(exp_type).status());
+  return absl::DeadlineExceededError(
+      "Call exceeded its time limit and was interrupted");
+}
+
 absl::StatusOr<FuncRet> RPCChannel::Return(v::Type exp_type) {
   uint32_t tag;
   size_t len;
@@ -67,7 +351,15 @@ absl::StatusOr<FuncRet> RPCChannel::Return(v::Type exp_type) {
 
 absl::Status RPCChannel::Allocate(size_t size, void** addr) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgAllocate, sizeof(size), &size)) {
+  // Serve the allocation from the arena without a round trip if it fits.
+  if (const size_t aligned_size = AlignToArena(size);
+      aligned_size >= size && aligned_size <= arena_size_ - arena_used_) {
+    *addr = reinterpret_cast<void*>(arena_begin_ + arena_used_);
+    arena_used_ += aligned_size;
+    return absl::OkStatus();
+  }
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgAllocate, sizeof(size), &size)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
 
@@ -76,15 +368,172 @@ absl::Status RPCChannel::Allocate(size_t size, void** addr) {
   return absl::OkStatus();
 }
 
+absl::Status RPCChannel::AllocateAndFill(const void* data, size_t size,
+                                         void** addr) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgAllocateAndFill, size, data)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kPointer));
+  *addr = reinterpret_cast<void*>(fret.int_val);
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::ReadAndFree(void* addr, void* data, size_t size) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  comms::ReadAndFreeRequest req = {
+      .addr = reinterpret_cast<uintptr_t>(addr),
+      .size = size,
+  };
+  if (!SendLocked(comms::kMsgReadAndFree, sizeof(req), &req)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+
+  uint32_t tag;
+  size_t len;
+  if (!comms_->RecvTLV(&tag, &len, data, size)) {
+    return absl::UnavailableError("Receiving TLV value failed");
+  }
+  if (tag != comms::kMsgReadAndFree) {
+    LOG(ERROR) << "tag != comms::kMsgReadAndFree ("
+               << absl::StrCat(absl::Hex(tag))
+               << " != " << absl::StrCat(absl::Hex(comms::kMsgReadAndFree))
+               << ")";
+    return absl::UnavailableError("Received TLV has incorrect tag");
+  }
+  if (len != size) {
+    LOG(ERROR) << "len != size (" << len << " != " << size << ")";
+    return absl::UnavailableError("Received TLV has incorrect length");
+  }
+  return absl::OkStatus();
+}
+
+namespace {
+
+// Larger transfers through the channel are split, so that neither side has to
+// buffer all of it.
+constexpr size_t kMemoryTransferChunkSize = 1 << 20;
+
+}  // namespace
+
+absl::Status RPCChannel::WriteMemory(void* addr, const void* data,
+                                     size_t size) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  for (size_t done = 0; done < size; done += kMemoryTransferChunkSize) {
+    const size_t chunk = std::min(size - done, kMemoryTransferChunkSize);
+    const uintptr_t remote = reinterpret_cast<uintptr_t>(addr) + done;
+    send_buffer_.resize(sizeof(remote) + chunk);
+    memcpy(send_buffer_.data(), &remote, sizeof(remote));
+    memcpy(send_buffer_.data() + sizeof(remote),
+           static_cast<const uint8_t*>(data) + done, chunk);
+    if (!SendLocked(comms::kMsgWriteMemory, send_buffer_.size(),
+                    send_buffer_.data())) {
+      return absl::UnavailableError("Sending TLV value failed");
+    }
+    SAPI_RETURN_IF_ERROR(Return(v::Type::kVoid).status());
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::ReadMemory(void* addr, void* data, size_t size) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  for (size_t done = 0; done < size; done += kMemoryTransferChunkSize) {
+    const size_t chunk = std::min(size - done, kMemoryTransferChunkSize);
+    comms::MemoryRequest req = {
+        .addr = reinterpret_cast<uintptr_t>(addr) + done,
+        .size = chunk,
+    };
+    if (!SendLocked(comms::kMsgReadMemory, sizeof(req), &req)) {
+      return absl::UnavailableError("Sending TLV value failed");
+    }
+    uint32_t tag;
+    size_t len;
+    if (!comms_->RecvTLV(&tag, &len, static_cast<uint8_t*>(data) + done,
+                         chunk)) {
+      return absl::UnavailableError("Receiving TLV value failed");
+    }
+    if (tag != comms::kMsgReadMemory || len != chunk) {
+      LOG(ERROR) << "Unexpected reply to kMsgReadMemory, tag: "
+                 << absl::StrCat(absl::Hex(tag)) << ", length: " << len;
+      return absl::UnavailableError("Received TLV has incorrect tag or length");
+    }
+  }
+  return absl::OkStatus();
+}
+
+bool RPCChannel::CanAllocateLocally(size_t size) {
+  absl::MutexLock lock(&mutex_);
+  const size_t aligned_size = AlignToArena(size);
+  return aligned_size >= size && aligned_size <= arena_size_ - arena_used_;
+}
+
+absl::Status RPCChannel::EnableAllocationArena(size_t size) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgAllocateArena, sizeof(size), &size)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kPointer));
+  if (fret.int_val == 0) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("Could not reserve ", size, " bytes in the sandboxee"));
+  }
+  arena_begin_ = fret.int_val;
+  arena_size_ = size;
+  arena_used_ = 0;
+  return absl::OkStatus();
+}
+
+void RPCChannel::ResetAllocationArena() {
+  absl::MutexLock lock(&mutex_);
+  arena_used_ = 0;
+}
+
+bool RPCChannel::SendLocked(uint32_t tag, size_t length, const void* value) {
+  if (pending_frees_.empty()) {
+    return comms_->SendTLV(tag, length, value);
+  }
+  // The sandboxee doesn't answer kMsgFreeBatch, so both messages go out in a
+  // single write.
+  const sandbox2::Comms::TLV tlvs[] = {
+      {comms::kMsgFreeBatch, pending_frees_.size() * sizeof(uintptr_t),
+       pending_frees_.data()},
+      {tag, length, value},
+  };
+  const bool ok = comms_->SendTLVs(tlvs);
+  pending_frees_.clear();
+  return ok;
+}
+
+bool RPCChannel::FlushPendingFreesLocked() {
+  const bool ok =
+      comms_->SendTLV(comms::kMsgFreeBatch,
+                      pending_frees_.size() * sizeof(uintptr_t),
+                      pending_frees_.data());
+  pending_frees_.clear();
+  return ok;
+}
+
+bool RPCChannel::IsInArenaLocked(uintptr_t addr) const {
+  return addr >= arena_begin_ && addr - arena_begin_ < arena_size_;
+}
+
 absl::Status RPCChannel::Reallocate(void* old_addr, size_t size,
                                     void** new_addr) {
   absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
   comms::ReallocRequest req = {
       .old_addr = reinterpret_cast<uintptr_t>(old_addr),
       .size = size,
   };
 
-  if (!comms_->SendTLV(comms::kMsgReallocate, sizeof(comms::ReallocRequest),
+  if (!SendLocked(comms::kMsgReallocate, sizeof(comms::ReallocRequest),
                        &req)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
@@ -103,20 +552,22 @@ absl::Status RPCChannel::Reallocate(void* old_addr, size_t size,
 absl::Status RPCChannel::Free(void* addr) {
   absl::MutexLock lock(&mutex_);
   uintptr_t remote = reinterpret_cast<uintptr_t>(addr);
-  if (!comms_->SendTLV(comms::kMsgFree, sizeof(remote), &remote)) {
-    return absl::UnavailableError("Sending TLV value failed");
+  if (IsInArenaLocked(remote)) {
+    // Released in bulk by ResetAllocationArena().
+    return absl::OkStatus();
   }
-
-  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kVoid));
-  if (!fret.success) {
-    return absl::UnavailableError("Free() failed on the remote side");
+  // Frees are sent along with the next message, unless too many accumulate.
+  pending_frees_.push_back(remote);
+  if (pending_frees_.size() >= kMaxPendingFrees && !FlushPendingFreesLocked()) {
+    return absl::UnavailableError("Sending TLV value failed");
   }
   return absl::OkStatus();
 }
 
 absl::Status RPCChannel::Symbol(const char* symname, void** addr) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgSymbol, strlen(symname) + 1, symname)) {
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgSymbol, strlen(symname) + 1, symname)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
 
@@ -127,6 +578,7 @@ absl::Status RPCChannel::Symbol(const char* symname, void** addr) {
 
 absl::Status RPCChannel::Exit() {
   absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
   if (comms_->IsTerminated()) {
     VLOG(2) << "Comms channel already terminated";
     return absl::OkStatus();
@@ -134,7 +586,7 @@ absl::Status RPCChannel::Exit() {
 
   // Try the RPC exit sequence. But, the only thing that matters as a success
   // indicator is whether the Comms channel had been closed
-  comms_->SendTLV(comms::kMsgExit, 0, nullptr);
+  SendLocked(comms::kMsgExit, 0, nullptr);
   bool unused;
   comms_->RecvBool(&unused);
 
@@ -150,7 +602,8 @@ absl::Status RPCChannel::Exit() {
 
 absl::Status RPCChannel::SendFD(int local_fd, int* remote_fd) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgSendFd, 0, nullptr)) {
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgSendFd, 0, nullptr)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
   if (!comms_->SendFD(local_fd)) {
@@ -165,9 +618,45 @@ absl::Status RPCChannel::SendFD(int local_fd, int* remote_fd) {
   return absl::OkStatus();
 }
 
+absl::Status RPCChannel::SendFDs(absl::Span<const int> local_fds,
+                                 std::vector<int>* remote_fds) {
+  if (local_fds.size() > sandbox2::Comms::kMaxFDsPerMessage) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Too many fds: ", local_fds.size()));
+  }
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgSendFds, 0, nullptr)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  if (!comms_->SendFDs(local_fds)) {
+    return absl::UnavailableError("Sending FDs failed");
+  }
+
+  // The sandboxee replies with the fd numbers on its side, followed by the
+  // usual return message.
+  uint32_t tag;
+  std::vector<uint8_t> fds;
+  if (!comms_->RecvTLV(&tag, &fds)) {
+    return absl::UnavailableError("Receiving TLV value failed");
+  }
+  if (tag != comms::kMsgSendFds || fds.size() % sizeof(int) != 0) {
+    return absl::UnavailableError(
+        absl::StrCat("Unexpected reply to kMsgSendFds, tag: ", tag));
+  }
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kInt));
+  if (!fret.success || fds.size() != local_fds.size() * sizeof(int)) {
+    return absl::UnavailableError("SendFDs failed on the remote side");
+  }
+  remote_fds->resize(local_fds.size());
+  memcpy(remote_fds->data(), fds.data(), fds.size());
+  return absl::OkStatus();
+}
+
 absl::Status RPCChannel::RecvFD(int remote_fd, int* local_fd) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgRecvFd, sizeof(remote_fd), &remote_fd)) {
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgRecvFd, sizeof(remote_fd), &remote_fd)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
 
@@ -184,7 +673,8 @@ absl::Status RPCChannel::RecvFD(int remote_fd, int* local_fd) {
 
 absl::Status RPCChannel::Close(int remote_fd) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgClose, sizeof(remote_fd), &remote_fd)) {
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgClose, sizeof(remote_fd), &remote_fd)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
 
@@ -195,9 +685,98 @@ absl::Status RPCChannel::Close(int remote_fd) {
   return absl::OkStatus();
 }
 
+absl::Status RPCChannel::MapFdLocked(uint32_t tag, int local_fd, size_t size,
+                                     void** addr) {
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(tag, sizeof(size), &size)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  if (!comms_->SendFD(local_fd)) {
+    return absl::UnavailableError("Sending FD failed");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kPointer));
+  if (!fret.success) {
+    return absl::UnavailableError("Mapping failed on the remote side");
+  }
+  *addr = reinterpret_cast<void*>(fret.int_val);
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::MapBuffer(int local_fd, size_t size, void** addr) {
+  absl::MutexLock lock(&mutex_);
+  return MapFdLocked(comms::kMsgMapBuffer, local_fd, size, addr);
+}
+
+absl::Status RPCChannel::MapFile(int local_fd, size_t size, void** addr) {
+  absl::MutexLock lock(&mutex_);
+  return MapFdLocked(comms::kMsgMapFile, local_fd, size, addr);
+}
+
+absl::Status RPCChannel::MapLazyBuffer(size_t size, void** addr, int* uffd) {
+  // The policy would not allow the sandboxee to create the userfaultfd.
+  if (!lazy_buffers_) {
+    return absl::FailedPreconditionError("Lazy buffers are not enabled");
+  }
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgMapLazyBuffer, sizeof(size), &size)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+
+  // The userfaultfd follows a successful reply.
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kPointer));
+  if (!fret.success) {
+    return absl::UnavailableError(
+        "Setting up the userfaultfd failed on the remote side");
+  }
+  if (!comms_->RecvFD(uffd)) {
+    return absl::UnavailableError("Receiving FD failed");
+  }
+  *addr = reinterpret_cast<void*>(fret.int_val);
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::UnmapBuffer(void* addr, size_t size) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  comms::UnmapBufferRequest req = {
+      .addr = reinterpret_cast<uintptr_t>(addr),
+      .size = size,
+  };
+  if (!SendLocked(comms::kMsgUnmapBuffer, sizeof(req), &req)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kVoid));
+  if (!fret.success) {
+    return absl::UnavailableError("UnmapBuffer() failed on the remote side");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status RPCChannel::OpenCallChannel(int local_fd) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgOpenCallChannel, 0, nullptr)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  if (!comms_->SendFD(local_fd)) {
+    return absl::UnavailableError("Sending FD failed");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kVoid));
+  if (!fret.success) {
+    return absl::UnavailableError(
+        "OpenCallChannel() failed on the remote side");
+  }
+  return absl::OkStatus();
+}
+
 absl::StatusOr<size_t> RPCChannel::Strlen(void* str) {
   absl::MutexLock lock(&mutex_);
-  if (!comms_->SendTLV(comms::kMsgStrlen, sizeof(str), &str)) {
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgStrlen, sizeof(str), &str)) {
     return absl::UnavailableError("Sending TLV value failed");
   }
 
@@ -208,4 +787,72 @@ absl::StatusOr<size_t> RPCChannel::Strlen(void* str) {
   return fret.int_val;
 }
 
+absl::StatusOr<std::vector<size_t>> RPCChannel::Strlens(
+    absl::Span<void* const> strs) {
+  if (strs.empty()) {
+    return std::vector<size_t>();
+  }
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgStrlenBatch, strs.size() * sizeof(void*),
+                  strs.data())) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+
+  std::vector<uint64_t> lengths(strs.size());
+  const size_t size = lengths.size() * sizeof(uint64_t);
+  uint32_t tag;
+  size_t len;
+  if (!comms_->RecvTLV(&tag, &len, lengths.data(), size)) {
+    return absl::UnavailableError("Receiving TLV value failed");
+  }
+  if (tag != comms::kMsgStrlenBatch) {
+    LOG(ERROR) << "tag != comms::kMsgStrlenBatch ("
+               << absl::StrCat(absl::Hex(tag))
+               << " != " << absl::StrCat(absl::Hex(comms::kMsgStrlenBatch))
+               << ")";
+    return absl::UnavailableError("Received TLV has incorrect tag");
+  }
+  if (len != size) {
+    LOG(ERROR) << "len != size (" << len << " != " << size << ")";
+    return absl::UnavailableError("Received TLV has incorrect length");
+  }
+  return std::vector<size_t>(lengths.begin(), lengths.end());
+}
+
+absl::StatusOr<uint64_t> RPCChannel::HeapUsage() {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (!SendLocked(comms::kMsgHeapUsage, 0, nullptr)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kInt));
+  if (!fret.success) {
+    return absl::UnavailableError("HeapUsage() failed on the remote side");
+  }
+  return fret.int_val;
+}
+
+absl::Status RPCChannel::EnableSharedMemoryTransport(size_t ring_size) {
+  absl::MutexLock lock(&mutex_);
+  ReceiveOutstandingCallsLocked();
+  if (comms_->IsUsingSharedMemory()) {
+    return absl::OkStatus();
+  }
+  if (!SendLocked(comms::kMsgSharedMemory, 0, nullptr)) {
+    return absl::UnavailableError("Sending TLV value failed");
+  }
+  if (!comms_->InitSharedMemoryTransport(ring_size)) {
+    return absl::UnavailableError("Setting up shared memory failed");
+  }
+
+  SAPI_ASSIGN_OR_RETURN(auto fret, Return(v::Type::kVoid));
+  if (!fret.success) {
+    return absl::UnavailableError(
+        "Setting up shared memory failed on the remote side");
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace sapi
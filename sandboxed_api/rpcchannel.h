@@ -15,11 +15,20 @@
 #ifndef SANDBOXED_API_RPCCHANNEL_H_
 #define SANDBOXED_API_RPCCHANNEL_H_
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/call.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/var_type.h"
@@ -30,19 +39,125 @@ namespace sapi {
 // Comms channel.
 class RPCChannel {
  public:
-  explicit RPCChannel(sandbox2::Comms* comms) : comms_(comms) {}
+  explicit RPCChannel(sandbox2::Comms* comms);
+  ~RPCChannel();
 
-  // Calls a function.
+  RPCChannel(const RPCChannel&) = delete;
+  RPCChannel& operator=(const RPCChannel&) = delete;
+
+  // Identifies the channel among all channels of the process, also after it
+  // has been destroyed. Never 0.
+  uint64_t generation() const { return generation_; }
+
+  // Records that the sandboxee is gone, along with everything allocated in
+  // it. Variables then skip freeing their remote memory on destruction,
+  // instead of sending requests to a dead sandboxee one by one. Done by
+  // Sandbox when terminating the sandboxee, and on destruction.
+  void Retire();
+
+  // Returns whether the channel with `generation` exists and was not retired.
+  // Takes a global lock only briefly, so must not race with the destruction
+  // of that channel, like any other use of it.
+  static bool IsLive(uint64_t generation);
+
+  // Calls a function using the fixed-size FuncCall encoding.
   absl::Status Call(const FuncCall& call, uint32_t tag, FuncRet* ret,
                     v::Type exp_type);
 
-  // Allocates memory.
+  // Calls a function. Sets `call->func_id` if the sandboxee returned a handle
+  // for the function before, so that the name needn't be sent again.
+  absl::Status Call(CompactFuncCall* call, FuncRet* ret);
+
+  // Like Call(), but remembers the function handle by descriptor instead of by
+  // name and type signature. `call->func` is only filled in from the
+  // descriptor if no handle is known yet. The types of `call` must match the
+  // descriptor, which must outlive the channel.
+  absl::Status Call(const CallDescriptor& descriptor, CompactFuncCall* call,
+                    FuncRet* ret);
+
+  // Calls multiple functions in a single round trip. The sandboxee stops at
+  // the first call that fails. `rets` receives the results of all calls that
+  // were executed, including the failing one. Function handles are set as for
+  // Call().
+  absl::Status CallBatch(absl::Span<CompactFuncCall> calls,
+                         std::vector<FuncRet>* rets);
+
+  // Sends a call to the sandboxee without waiting for it to finish. Returns an
+  // id to be passed to AwaitCall(). The sandboxee executes calls in the order
+  // they were sent, so several calls can be outstanding at the same time.
+  // Any other operation on the channel first collects the results of all
+  // outstanding calls.
+  absl::StatusOr<uint64_t> CallAsync(CompactFuncCall* call);
+
+  // Waits for the result of a call started with CallAsync().
+  absl::StatusOr<FuncRet> AwaitCall(uint64_t id);
+
+  // Returns whether AwaitCall(id) would return without waiting for the
+  // sandboxee. Receives the results that arrived so far, never blocks on the
+  // sandboxee itself.
+  bool IsCallDone(uint64_t id);
+
+  // Allocates memory. Zero-length allocations get an address of their own too,
+  // which must be freed like any other.
   absl::Status Allocate(size_t size, void** addr);
 
+  // Allocations and reads up to this size are combined with the data transfer
+  // by AllocateAndFill() and ReadAndFree(). Larger ones are better served by
+  // process_vm_writev()/process_vm_readv().
+  static constexpr size_t kMaxFusedTransferSize = 64 << 10;
+
+  // Allocates `size` bytes in the sandboxee and fills them with `data`, in a
+  // single round trip.
+  absl::Status AllocateAndFill(const void* data, size_t size, void** addr);
+
+  // Copies `size` bytes at `addr` in the sandboxee to `data`, then frees
+  // `addr`, in a single round trip.
+  absl::Status ReadAndFree(void* addr, void* data, size_t size);
+
+  // Copies `size` bytes from `data` to `addr` in the sandboxee through the
+  // channel, for hosts that cannot use process_vm_writev().
+  absl::Status WriteMemory(void* addr, const void* data, size_t size);
+
+  // Copies `size` bytes at `addr` in the sandboxee to `data` through the
+  // channel, for hosts that cannot use process_vm_readv().
+  absl::Status ReadMemory(void* addr, void* data, size_t size);
+
+  // Makes transfers of variables use WriteMemory() and ReadMemory(), see
+  // Sandbox::TransferOverComms(). Must be set before the channel is used.
+  void set_transfer_over_comms(bool value) { transfer_over_comms_ = value; }
+  bool transfer_over_comms() const { return transfer_over_comms_; }
+
+  // Makes transfers of variables copy memory directly, for a stub serving the
+  // channel from this process, see Sandbox::RunInProcess(). Must be set
+  // before the channel is used.
+  void set_in_process(bool value) { in_process_ = value; }
+  bool in_process() const { return in_process_; }
+
+  // Lets MapLazyBuffer() ask the sandboxee for a userfaultfd, see
+  // Sandbox::UseLazyArrays(). Must be set before the channel is used.
+  void set_lazy_buffers(bool value) { lazy_buffers_ = value; }
+
+  // Returns whether Allocate() of `size` bytes would currently be served
+  // without a round trip to the sandboxee.
+  bool CanAllocateLocally(size_t size);
+
+  // Reserves a region of `size` bytes in the sandboxee. Later calls to
+  // Allocate() are served from it without a round trip, as long as they fit.
+  // Memory from the region is never freed individually; Free() is a no-op
+  // for it. Instead, ResetAllocationArena() releases all of it at once.
+  // Calling this again replaces the region, invalidating all memory allocated
+  // from the old one.
+  absl::Status EnableAllocationArena(size_t size);
+
+  // Makes the whole arena available again. Memory allocated from it before
+  // must not be used anymore.
+  void ResetAllocationArena();
+
   // Reallocates memory.
   absl::Status Reallocate(void* old_addr, size_t size, void** new_addr);
 
-  // Frees memory.
+  // Frees memory. To save round trips, the request is sent along with the
+  // next message to the sandboxee.
   absl::Status Free(void* addr);
 
   // Returns address of a symbol.
@@ -54,23 +169,158 @@ class RPCChannel {
   // Transfers fd to sandboxee.
   absl::Status SendFD(int local_fd, int* remote_fd);
 
+  // Transfers multiple fds to sandboxee in a single message and stores their
+  // numbers in the sandboxee in `remote_fds`. At most
+  // sandbox2::Comms::kMaxFDsPerMessage fds can be sent at once.
+  absl::Status SendFDs(absl::Span<const int> local_fds,
+                       std::vector<int>* remote_fds);
+
   // Retrieves fd from sandboxee.
   absl::Status RecvFD(int remote_fd, int* local_fd);
 
   // Closes fd in sandboxee.
   absl::Status Close(int remote_fd);
 
+  // Maps `size` bytes of the shared memory file `local_fd` into the sandboxee,
+  // read-write. The sandboxee closes its copy of the fd afterwards.
+  absl::Status MapBuffer(int local_fd, size_t size, void** addr);
+
+  // Unmaps memory mapped with MapBuffer() or MapFile().
+  absl::Status UnmapBuffer(void* addr, size_t size);
+
+  // Maps the first `size` bytes of the file `local_fd` into the sandboxee,
+  // read-only. The sandboxee closes its copy of the fd afterwards.
+  absl::Status MapFile(int local_fd, size_t size, void** addr);
+
+  // Maps `size` bytes of anonymous memory into the sandboxee, registered with
+  // a userfaultfd for missing pages, which is returned in `uffd`. Reading the
+  // memory blocks the sandboxee until the pages are filled in through the
+  // userfaultfd, see v::LazyArray. Unmap it with UnmapBuffer(). Fails without
+  // contacting the sandboxee unless enabled with set_lazy_buffers().
+  absl::Status MapLazyBuffer(size_t size, void** addr, int* uffd);
+
+  // Makes the sandboxee serve requests on the connected socket `local_fd`
+  // from a new thread, in addition to this channel.
+  absl::Status OpenCallChannel(int local_fd);
+
   // Returns length of a null-terminated c-style string (invokes strlen).
   absl::StatusOr<size_t> Strlen(void* str);
 
+  // Returns the lengths of several null-terminated strings, in one round trip.
+  absl::StatusOr<std::vector<size_t>> Strlens(absl::Span<void* const> strs);
+
+  // Returns the number of bytes allocated with malloc() in the sandboxee and
+  // not freed yet, as reported by mallinfo2().
+  absl::StatusOr<uint64_t> HeapUsage();
+
+  // Switches the underlying comms channel to a shared memory transport with
+  // the specified ring buffer size, see
+  // sandbox2::Comms::InitSharedMemoryTransport().
+  absl::Status EnableSharedMemoryTransport(size_t ring_size);
+
   sandbox2::Comms* comms() const { return comms_; }
 
+  // Bounds the time that Call() waits for the result of a single call.
+  // Once `limit` expired, `interrupt` is run and the sandboxee gets another
+  // `grace_period` to return, and Call() fails with DeadlineExceededError
+  // either way. A call that still did not return leaves the channel
+  // terminated. A zero `limit` disables the bound. Not enforced with the
+  // shared memory transport.
+  void SetCallTimeLimit(absl::Duration limit, absl::Duration grace_period,
+                        absl::AnyInvocable<void()> interrupt);
+
  private:
   // Receives the result after a call.
   absl::StatusOr<FuncRet> Return(v::Type exp_type);
 
+  // Like Return(), but within the limits set by SetCallTimeLimit().
+  absl::StatusOr<FuncRet> ReturnWithinTimeLimitLocked(v::Type exp_type)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Sends `tag` with `size` and then `local_fd`, returning the address the
+  // sandboxee mapped it at.
+  absl::Status MapFdLocked(uint32_t tag, int local_fd, size_t size,
+                           void** addr) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  static constexpr size_t kArenaAlignment = alignof(std::max_align_t);
+  // Number of deferred frees after which they are sent on their own.
+  static constexpr size_t kMaxPendingFrees = 256;
+
+  // Returns the space an allocation of `size` bytes takes up in the arena.
+  // Zero-length ones take up some too, so that their address is in the arena.
+  static constexpr size_t AlignToArena(size_t size) {
+    return (std::max<size_t>(size, 1) + kArenaAlignment - 1) &
+           ~(kArenaAlignment - 1);
+  }
+
+  // Sends a message, preceded by the frees deferred so far.
+  bool SendLocked(uint32_t tag, size_t length, const void* value)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Sends the deferred frees right away.
+  bool FlushPendingFreesLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns whether `addr` was allocated from the arena.
+  bool IsInArenaLocked(uintptr_t addr) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Returns the handle the sandboxee returned for an earlier call of the same
+  // function with the same types, or 0.
+  uint32_t LookupFuncIdLocked(const std::string& key) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_);
+
+  // Stores the function handle returned by the sandboxee, if any, so that
+  // later calls don't need to resolve the function again.
+  void RememberFuncIdLocked(const std::string& key, const FuncRet& ret)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Receives the result of the oldest outstanding asynchronous call.
+  void ReceiveOutstandingCallLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Receives the results of all calls sent with CallAsync() that haven't been
+  // received yet. Must be called before any other message is exchanged.
+  void ReceiveOutstandingCallsLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   sandbox2::Comms* comms_;  // Owned by sandbox2;
+  const uint64_t generation_;
   absl::Mutex mutex_;
+
+  struct OutstandingCall {
+    uint64_t id;
+    v::Type ret_type;
+    std::string func_key;
+  };
+
+  absl::Duration call_time_limit_ ABSL_GUARDED_BY(mutex_) =
+      absl::ZeroDuration();
+  absl::Duration call_grace_period_ ABSL_GUARDED_BY(mutex_);
+  absl::AnyInvocable<void()> interrupt_call_ ABSL_GUARDED_BY(mutex_);
+
+  uint64_t next_call_id_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Calls sent but not received yet, in order.
+  std::deque<OutstandingCall> outstanding_calls_ ABSL_GUARDED_BY(mutex_);
+  // Received results of asynchronous calls that weren't awaited yet.
+  absl::flat_hash_map<uint64_t, absl::StatusOr<FuncRet>> finished_calls_
+      ABSL_GUARDED_BY(mutex_);
+  // Function handles returned by the sandboxee, by function name and type
+  // signature. A restarted sandboxee gets a new channel, so these never
+  // outlive the sandboxee they came from.
+  absl::flat_hash_map<std::string, uint32_t> func_ids_ ABSL_GUARDED_BY(mutex_);
+  // Function handles of calls made with a CallDescriptor, by descriptor.
+  absl::flat_hash_map<const CallDescriptor*, uint32_t> descriptor_func_ids_
+      ABSL_GUARDED_BY(mutex_);
+  // Region reserved with EnableAllocationArena() and the number of bytes
+  // handed out from it.
+  uintptr_t arena_begin_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t arena_size_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t arena_used_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Addresses passed to Free() that weren't sent to the sandboxee yet.
+  std::vector<uintptr_t> pending_frees_ ABSL_GUARDED_BY(mutex_);
+  // Reused for encoding calls.
+  std::vector<uint8_t> send_buffer_ ABSL_GUARDED_BY(mutex_);
+  bool transfer_over_comms_ = false;
+  bool in_process_ = false;
+  bool lazy_buffers_ = false;
 };
 
 }  // namespace sapi
@@ -16,22 +16,39 @@
 
 #include <sys/ioctl.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cstdarg>
 #include <cstdio>
 #include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
 
+#include "absl/base/attributes.h"
 #include "absl/base/casts.h"
+#include "absl/base/const_init.h"
 #include "absl/base/dynamic_annotations.h"
 #include "absl/base/macros.h"
+#include "absl/cleanup/cleanup.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
-#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/call.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/embed_file.h"
 #include "sandboxed_api/rpcchannel.h"
@@ -41,10 +58,16 @@
 #include "sandboxed_api/sandbox2/sandbox2.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/metrics.h"
 #include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/process_memory.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/runfiles.h"
 #include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/util/strerror.h"
+
+// Defined by //sandboxed_api:passthrough, see Sandbox::RunInProcess().
+extern "C" ABSL_ATTRIBUTE_WEAK void sapi_serve_in_process(int fd);
 
 namespace sapi {
 
@@ -90,6 +113,11 @@ void InitDefaultPolicyBuilder(sandbox2::PolicyBuilder* builder) {
   builder->AllowSyscall(__NR_arch_prctl);
 #endif
 
+  // Read-only shared memory used by SAPI itself: large Comms payloads passed
+  // as sealed memfds and v::MappedFile. Writable shared mappings are only
+  // allowed on request, see UseSharedArrays().
+  builder->AllowReadOnlySharedMemoryMappings();
+
   if constexpr (sanitizers::IsAny()) {
     LOG(WARNING) << "Allowing additional calls to support the LLVM "
                  << "(ASAN/MSAN/TSAN) sanitizer";
@@ -100,24 +128,45 @@ void InitDefaultPolicyBuilder(sandbox2::PolicyBuilder* builder) {
 }
 
 void Sandbox::Terminate(bool attempt_graceful_exit) {
+  // Once the sandboxee is gone, vars still referring to it skip freeing their
+  // remote memory.
+  absl::Cleanup retire_channels = [this] {
+    if (rpc_channel_) {
+      rpc_channel_->Retire();
+    }
+    for (const auto& channel : call_channels_) {
+      channel->Retire();
+    }
+  };
   if (!is_active()) {
     return;
   }
 
-  if (attempt_graceful_exit) {
-    // Gracefully ask it to exit (with 1 second limit) first, then kill it.
-    Exit();
+  if (in_process_comms_) {
+    // Ends the serving thread, the library stays loaded in this process.
+    if (attempt_graceful_exit) {
+      Exit();
+    }
+    in_process_comms_->Terminate();
   } else {
-    // Kill it straight away
-    s2_->Kill();
-  }
+    if (attempt_graceful_exit) {
+      // Gracefully ask it to exit (with 1 second limit) first, then kill it.
+      Exit();
+    } else {
+      // Kill it straight away
+      s2_->Kill();
+    }
 
-  const auto& result = AwaitResult();
-  if (result.final_status() == sandbox2::Result::OK &&
-      result.reason_code() == 0) {
-    VLOG(2) << "Sandbox2 finished with: " << result.ToString();
-  } else {
-    LOG(WARNING) << "Sandbox2 finished with: " << result.ToString();
+    const auto& result = AwaitResult();
+    if (result.final_status() == sandbox2::Result::OK &&
+        result.reason_code() == 0) {
+      VLOG(2) << "Sandbox2 finished with: " << result.ToString();
+    } else {
+      LOG(WARNING) << "Sandbox2 finished with: " << result.ToString();
+    }
+  }
+  if (call_profiler_) {
+    LOG(INFO) << "Call profile:\n" << call_profiler_->GetReport();
   }
 }
 
@@ -126,59 +175,210 @@ static std::string PathToSAPILib(const std::string& lib_path) {
                                         : GetDataDependencyFilePath(lib_path);
 }
 
-absl::Status Sandbox::Init() {
-  // It's already initialized
-  if (is_active()) {
-    return absl::OkStatus();
+namespace {
+
+// Returns whether `ret` and `args` have the types described by `descriptor`.
+bool MatchesCallDescriptor(const CallDescriptor& descriptor,
+                           const v::Callable& ret,
+                           absl::Span<v::Callable* const> args) {
+  if (ret.GetType() != descriptor.ret.type ||
+      ret.GetSize() != descriptor.ret.size ||
+      args.size() != descriptor.args.size()) {
+    return false;
   }
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (args[i]->GetType() != descriptor.args[i].type ||
+        args[i]->GetSize() != descriptor.args[i].size) {
+      return false;
+    }
+  }
+  return true;
+}
 
-  // Initialize the forkserver if it is not already running.
-  if (!fork_client_) {
-    // If FileToc was specified, it will be used over any paths to the SAPI
-    // library.
-    std::string lib_path;
-    int embed_lib_fd = -1;
-    if (embed_lib_toc_ && !sapi::host_os::IsAndroid()) {
-      embed_lib_fd = EmbedFile::instance()->GetDupFdForFileToc(embed_lib_toc_);
-      if (embed_lib_fd == -1) {
-        PLOG(ERROR) << "Cannot create executable FD for TOC:'"
-                    << embed_lib_toc_->name << "'";
-        return absl::UnavailableError("Could not create executable FD");
-      }
-      lib_path = embed_lib_toc_->name;
-    } else {
-      lib_path = PathToSAPILib(GetLibPath());
-      if (lib_path.empty()) {
-        LOG(ERROR) << "SAPI library path is empty";
-        return absl::FailedPreconditionError("No SAPI library path given");
-      }
+// A forkserver used by all sandboxes that run the same library with the same
+// arguments and environment, see Sandbox::ShareForkServer().
+struct SharedForkServer {
+  // Held while the forkserver starts, so that sandboxes initialized
+  // concurrently wait for it instead of starting one forkserver each.
+  absl::Mutex mutex;
+  std::unique_ptr<sandbox2::Executor> executor ABSL_GUARDED_BY(mutex);
+  std::unique_ptr<sandbox2::ForkClient> client ABSL_GUARDED_BY(mutex);
+};
+
+ABSL_CONST_INIT absl::Mutex shared_fork_servers_mutex(absl::kConstInit);
+
+// Shared forkservers by library, arguments and environment. They are never
+// shut down.
+absl::flat_hash_map<std::string, std::unique_ptr<SharedForkServer>>&
+SharedForkServers() ABSL_EXCLUSIVE_LOCKS_REQUIRED(shared_fork_servers_mutex) {
+  static auto* fork_servers =
+      new absl::flat_hash_map<std::string,
+                              std::unique_ptr<SharedForkServer>>();
+  return *fork_servers;
+}
+
+// Returns fn(), recording the call of func and its outcome into the metrics.
+template <typename Fn>
+absl::Status WithCallMetrics(absl::string_view func, Fn fn) {
+  if (!metrics::Enabled()) {
+    return fn();
+  }
+  metrics::IncrementCounter(metrics::kRpcCalls, func);
+  absl::Status status;
+  {
+    metrics::ScopedLatency latency(metrics::kRpcLatency, func);
+    status = fn();
+  }
+  if (!status.ok()) {
+    metrics::IncrementCounter(metrics::kRpcErrors, func);
+  }
+  return status;
+}
+
+}  // namespace
+
+absl::Status Sandbox::CreateForkServer(
+    const std::string& lib_path, const std::vector<std::string>& args,
+    const std::vector<std::string>& envs,
+    std::unique_ptr<sandbox2::Executor>* executor,
+    std::unique_ptr<sandbox2::ForkClient>* fork_client) const {
+  int embed_lib_fd = -1;
+  if (UseEmbedLib()) {
+    embed_lib_fd = EmbedFile::instance()->GetDupFdForFileToc(embed_lib_toc_);
+    if (embed_lib_fd == -1) {
+      PLOG(ERROR) << "Cannot create executable FD for TOC:'"
+                  << embed_lib_toc_->name << "'";
+      return absl::UnavailableError("Could not create executable FD");
     }
-    std::vector<std::string> args = {lib_path};
-    // Additional arguments, if needed.
-    GetArgs(&args);
-    std::vector<std::string> envs{};
-    // Additional envvars, if needed.
-    GetEnvs(&envs);
+  }
 
-    forkserver_executor_ =
-        (embed_lib_fd >= 0)
-            ? std::make_unique<sandbox2::Executor>(embed_lib_fd, args, envs)
-            : std::make_unique<sandbox2::Executor>(lib_path, args, envs);
+  *executor = (embed_lib_fd >= 0)
+                  ? std::make_unique<sandbox2::Executor>(embed_lib_fd, args,
+                                                         envs)
+                  : std::make_unique<sandbox2::Executor>(lib_path, args, envs);
 
-    fork_client_ = forkserver_executor_->StartForkServer();
+  *fork_client = (*executor)->StartForkServer();
 
-    if (!fork_client_) {
-      LOG(ERROR) << "Could not start forkserver";
-      return absl::UnavailableError("Could not start the forkserver");
+  if (!*fork_client) {
+    LOG(ERROR) << "Could not start forkserver";
+    return absl::UnavailableError("Could not start the forkserver");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Sandbox::StartForkServer() {
+  // If FileToc was specified, it will be used over any paths to the SAPI
+  // library.
+  std::string lib_path;
+  if (UseEmbedLib()) {
+    lib_path = embed_lib_toc_->name;
+  } else {
+    lib_path = PathToSAPILib(GetLibPath());
+    if (lib_path.empty()) {
+      LOG(ERROR) << "SAPI library path is empty";
+      return absl::FailedPreconditionError("No SAPI library path given");
     }
   }
+  std::vector<std::string> args = {lib_path};
+  // Additional arguments, if needed.
+  GetArgs(&args);
+  std::vector<std::string> envs{};
+  // Additional envvars, if needed.
+  GetEnvs(&envs);
+  if (RunZygoteInit()) {
+    envs.push_back(absl::StrCat(comms::kZygoteInitEnv, "=1"));
+  }
 
+  if (!ShareForkServer()) {
+    return CreateForkServer(lib_path, args, envs, &forkserver_executor_,
+                            &fork_client_);
+  }
+
+  // Embedded libraries are identified by their TOC, as the name alone might
+  // not be unique.
+  std::string key = absl::StrCat(
+      UseEmbedLib() ? absl::StrCat("toc:", absl::Hex(embed_lib_toc_))
+                    : lib_path,
+      "\n", absl::StrJoin(args, "\n"), "\n", absl::StrJoin(envs, "\n"));
+  SharedForkServer* fork_server;
+  {
+    absl::MutexLock lock(&shared_fork_servers_mutex);
+    std::unique_ptr<SharedForkServer>& entry = SharedForkServers()[key];
+    if (!entry) {
+      entry = std::make_unique<SharedForkServer>();
+    }
+    fork_server = entry.get();
+  }
+  // Only sandboxes for the same key wait for the forkserver to start.
+  absl::MutexLock lock(&fork_server->mutex);
+  if (!fork_server->client) {
+    SAPI_RETURN_IF_ERROR(CreateForkServer(lib_path, args, envs,
+                                          &fork_server->executor,
+                                          &fork_server->client));
+  }
+  shared_fork_client_ = fork_server->client.get();
+  return absl::OkStatus();
+}
+
+absl::Status Sandbox::Init() {
+  // It's already initialized
+  if (is_active()) {
+    return absl::OkStatus();
+  }
+
+  if (!call_profiler_ && GetCallProfilingInterval() > 0) {
+    call_profiler_ = std::make_unique<CallProfiler>(GetCallProfilingInterval());
+  }
+
+  if (RunInProcess()) {
+    SAPI_RETURN_IF_ERROR(StartInProcess());
+    return FinishInit();
+  }
+
+  auto build_policy = [this] {
     sandbox2::PolicyBuilder policy_builder;
     InitDefaultPolicyBuilder(&policy_builder);
-  auto s2p = ModifyPolicy(&policy_builder);
+    // Writable shared memory, for the shared memory transport and
+    // v::SharedArray.
+    if (UseSharedArrays() || GetSharedMemoryRingSize() > 0) {
+      policy_builder.AllowSharedMemoryMappings();
+    }
+    // Missing pages of v::LazyArray are filled in by the sandboxer.
+    if (UseLazyArrays()) {
+      policy_builder.AllowUserfaultfd();
+    }
+    switch (GetSandboxeeMalloc()) {
+      case SandboxeeMalloc::kSystem:
+        break;
+      case SandboxeeMalloc::kTcMalloc:
+        policy_builder.AllowTcMalloc();
+        break;
+      case SandboxeeMalloc::kScudo:
+        policy_builder.AllowScudoMalloc();
+        break;
+    }
+    return ModifyPolicy(&policy_builder);
+  };
+
+  std::unique_ptr<sandbox2::Policy> s2p;
+  if (!fork_client_ && !shared_fork_client_) {
+    // Starting the forkserver and building the policy (mostly resolving the
+    // ELF dependencies of the mounts) are independent of each other, so the
+    // policy is built on a separate thread in the meantime. The forkserver
+    // is not tied to the thread that starts it (it exits once its comms
+    // channel is closed); it is started here only because StartForkServer()
+    // sets the forkserver members of this sandbox.
+    std::thread policy_thread([&s2p, &build_policy] { s2p = build_policy(); });
+    absl::Status status = StartForkServer();
+    policy_thread.join();
+    SAPI_RETURN_IF_ERROR(status);
+  } else {
+    s2p = build_policy();
+  }
 
   // Spawn new process from the forkserver.
-  auto executor = std::make_unique<sandbox2::Executor>(fork_client_.get());
+  auto executor = std::make_unique<sandbox2::Executor>(
+      shared_fork_client_ ? shared_fork_client_ : fork_client_.get());
 
   executor
       // The client.cc code is capable of enabling sandboxing on its own.
@@ -188,11 +388,13 @@ absl::Status Sandbox::Init() {
       .limits()
       // Disable time limits.
       ->set_walltime_limit(absl::ZeroDuration())
-      .set_rlimit_cpu(RLIM64_INFINITY);
+      .set_rlimit_cpu(RLIM64_INFINITY)
+      .set_placement(placement_);
 
   // Modify the executor, e.g. by setting custom limits and IPC.
   ModifyExecutor(executor.get());
 
+  in_process_comms_.reset();
   s2_ = std::make_unique<sandbox2::Sandbox2>(std::move(executor),
                                              std::move(s2p), CreateNotifier());
   s2_awaited_ = false;
@@ -201,16 +403,137 @@ absl::Status Sandbox::Init() {
   comms_ = s2_->comms();
   pid_ = s2_->pid();
 
+  call_channels_.clear();
+  call_comms_.clear();
   rpc_channel_ = std::make_unique<RPCChannel>(comms_);
+  rpc_channel_->set_transfer_over_comms(TransferOverComms());
+  rpc_channel_->set_lazy_buffers(UseLazyArrays());
+  ApplyCallTimeLimit();
 
   if (!res) {
     Terminate();
     return absl::UnavailableError("Could not start the sandbox");
   }
+  // The sandboxee setup is complete, from now on comms_ is only used for the
+  // RPC protocol. Receive function returns with as few syscalls as possible.
+  comms_->EnableReadAhead();
+  return FinishInit();
+}
+
+absl::Status Sandbox::StartInProcess() {
+  if (sapi_serve_in_process == nullptr) {
+    return absl::FailedPreconditionError(
+        "Running in process requires linking //sandboxed_api:passthrough");
+  }
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+    return absl::InternalError(
+        absl::StrCat("socketpair() failed: ", StrError(errno)));
+  }
+  auto comms = std::make_unique<sandbox2::Comms>(fds[0]);
+  sapi_serve_in_process(fds[1]);
+  LOG(WARNING) << "Running the library in process, without a sandbox";
+  comms_ = comms.get();
+  pid_ = getpid();
+  call_channels_.clear();
+  call_comms_.clear();
+  rpc_channel_ = std::make_unique<RPCChannel>(comms_);
+  rpc_channel_->set_in_process(true);
+  rpc_channel_->set_lazy_buffers(UseLazyArrays());
+  in_process_comms_ = std::move(comms);
+  ApplyCallTimeLimit();
+  comms_->EnableReadAhead();
   return absl::OkStatus();
 }
 
-bool Sandbox::is_active() const { return s2_ && !s2_->IsTerminated(); }
+absl::Status Sandbox::FinishInit() {
+  if (const size_t ring_size = GetSharedMemoryRingSize(); ring_size > 0) {
+    if (absl::Status status =
+            rpc_channel_->EnableSharedMemoryTransport(ring_size);
+        !status.ok()) {
+      Terminate();
+      return status;
+    }
+  }
+  if (const size_t arena_size = GetAllocationArenaSize(); arena_size > 0) {
+    if (absl::Status status = rpc_channel_->EnableAllocationArena(arena_size);
+        !status.ok()) {
+      Terminate();
+      return status;
+    }
+  }
+  if (absl::Status status = OpenCallChannels(GetNumCallChannels());
+      !status.ok()) {
+    Terminate();
+    return status;
+  }
+  if (is_in_process()) {
+    initial_memory_usage_ = {};
+    return absl::OkStatus();
+  }
+  absl::StatusOr<MemoryUsage> usage = GetMemoryUsage();
+  if (!usage.ok()) {
+    Terminate();
+    return usage.status();
+  }
+  initial_memory_usage_ = *usage;
+  return absl::OkStatus();
+}
+
+absl::Status Sandbox::OpenCallChannels(int num_channels) {
+  for (int i = 1; i < num_channels; ++i) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+      return absl::InternalError(
+          absl::StrCat("socketpair() failed: ", StrError(errno)));
+    }
+    auto comms = std::make_unique<sandbox2::Comms>(fds[0]);
+    file_util::fileops::FDCloser remote_fd(fds[1]);
+    SAPI_RETURN_IF_ERROR(rpc_channel_->OpenCallChannel(remote_fd.get()));
+    comms->EnableReadAhead();
+    call_channels_.push_back(std::make_unique<RPCChannel>(comms.get()));
+    call_channels_.back()->set_transfer_over_comms(TransferOverComms());
+    call_channels_.back()->set_lazy_buffers(UseLazyArrays());
+    call_comms_.push_back(std::move(comms));
+  }
+  absl::MutexLock lock(&idle_call_channels_mutex_);
+  idle_call_channels_.clear();
+  idle_call_channels_.push_back(rpc_channel_.get());
+  for (const auto& channel : call_channels_) {
+    idle_call_channels_.push_back(channel.get());
+  }
+  return absl::OkStatus();
+}
+
+RPCChannel* Sandbox::AcquireCallChannel() {
+  // Only the main thread of the sandboxee is interrupted when a call exceeds
+  // its time limit.
+  if (call_channels_.empty() || call_time_limit_ != absl::ZeroDuration()) {
+    return rpc_channel();
+  }
+  absl::MutexLock lock(&idle_call_channels_mutex_);
+  idle_call_channels_mutex_.Await(absl::Condition(
+      +[](std::vector<RPCChannel*>* idle) { return !idle->empty(); },
+      &idle_call_channels_));
+  RPCChannel* channel = idle_call_channels_.back();
+  idle_call_channels_.pop_back();
+  return channel;
+}
+
+void Sandbox::ReleaseCallChannel(RPCChannel* channel) {
+  if (call_channels_.empty() || call_time_limit_ != absl::ZeroDuration()) {
+    return;
+  }
+  absl::MutexLock lock(&idle_call_channels_mutex_);
+  idle_call_channels_.push_back(channel);
+}
+
+bool Sandbox::is_active() const {
+  if (in_process_comms_) {
+    return !in_process_comms_->IsTerminated();
+  }
+  return s2_ && !s2_->IsTerminated();
+}
 
 absl::Status Sandbox::Allocate(v::Var* var, bool automatic_free) {
   if (!is_active()) {
@@ -226,7 +549,114 @@ absl::Status Sandbox::Free(v::Var* var) {
   return var->Free(rpc_channel());
 }
 
+absl::Status Sandbox::Reset(uint64_t max_resident_bytes) {
+  if (!is_active()) {
+    return Init();
+  }
+  ResetAllocationArena();
+  absl::Status status = Reinitialize();
+  // The resident memory would be that of the host.
+  if (status.ok() && max_resident_bytes != 0 && !is_in_process()) {
+    absl::StatusOr<uint64_t> resident = GetResidentMemoryBytes(pid_);
+    if (!resident.ok()) {
+      status = resident.status();
+    } else if (*resident > max_resident_bytes) {
+      status = absl::ResourceExhaustedError(
+          absl::StrCat("Sandboxee uses ", *resident, " B of resident memory"));
+    }
+  }
+  if (!status.ok()) {
+    VLOG(1) << "Restarting the sandbox, it could not be reset: " << status;
+    return Restart(true);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<Sandbox::MemoryUsage> Sandbox::GetMemoryUsage() const {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  if (is_in_process()) {
+    return absl::FailedPreconditionError(
+        "Memory usage is not sampled for sandboxes running in process");
+  }
+  MemoryUsage usage;
+  SAPI_ASSIGN_OR_RETURN(usage.resident_bytes, GetResidentMemoryBytes(pid_));
+  SAPI_ASSIGN_OR_RETURN(usage.heap_bytes, rpc_channel()->HeapUsage());
+  return usage;
+}
+
+absl::StatusOr<bool> Sandbox::ExceedsMemoryGrowth(
+    const MemoryGrowthLimits& limits) const {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  if (is_in_process()) {
+    return false;
+  }
+  if (limits.resident_bytes != 0) {
+    SAPI_ASSIGN_OR_RETURN(uint64_t resident, GetResidentMemoryBytes(pid_));
+    if (resident >
+        initial_memory_usage_.resident_bytes + limits.resident_bytes) {
+      return true;
+    }
+  }
+  if (limits.heap_bytes != 0) {
+    SAPI_ASSIGN_OR_RETURN(uint64_t heap, rpc_channel()->HeapUsage());
+    if (heap > initial_memory_usage_.heap_bytes + limits.heap_bytes) {
+      return true;
+    }
+  }
+  return false;
+}
+
+absl::StatusOr<bool> Sandbox::RestartIfMemoryGrew(
+    const MemoryGrowthLimits& limits) {
+  absl::StatusOr<bool> exceeds = ExceedsMemoryGrowth(limits);
+  if (exceeds.ok() && !*exceeds) {
+    return false;
+  }
+  VLOG(1) << "Restarting the sandbox: "
+          << (exceeds.ok() ? "memory usage grew too much"
+                           : exceeds.status().ToString());
+  SAPI_RETURN_IF_ERROR(Restart(true));
+  return true;
+}
+
+absl::Status Sandbox::Freeze(bool page_out) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  if (in_process_comms_) {
+    return absl::OkStatus();
+  }
+  return s2_->Freeze(page_out);
+}
+
+absl::Status Sandbox::Thaw() {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  if (in_process_comms_) {
+    return absl::OkStatus();
+  }
+  return s2_->Thaw();
+}
+
+void Sandbox::ResetAllocationArena() {
+  if (is_active()) {
+    rpc_channel()->ResetAllocationArena();
+  }
+}
+
 absl::Status Sandbox::SynchronizePtrBefore(v::Callable* ptr) {
+  std::vector<v::Var*> pending_transfers;
+  SAPI_RETURN_IF_ERROR(SynchronizePtrBefore(ptr, &pending_transfers));
+  return TransferToSandboxee(pending_transfers);
+}
+
+absl::Status Sandbox::SynchronizePtrBefore(
+    v::Callable* ptr, std::vector<v::Var*>* pending_transfers) {
   if (!is_active()) {
     return absl::UnavailableError("Sandbox not active");
   }
@@ -240,27 +670,41 @@ absl::Status Sandbox::SynchronizePtrBefore(v::Callable* ptr) {
     return absl::OkStatus();
   }
 
+  // Allocation occurs during both before/after synchronization modes. But the
+  // memory is transferred to the sandboxee only if v::Pointable::kSyncBefore
+  // was requested.
+  // NOLINTNEXTLINE(clang-diagnostic-deprecated-declarations)
+  const bool sync_before = (p->GetSyncType() & v::Pointable::kSyncBefore) != 0;
   if (p->GetPointedVar()->GetRemote() == nullptr) {
     // Allocate the memory, and make it automatically free-able, upon this
     // object's (p->GetPointedVar()) end of life-time.
+    if (sync_before) {
+      VLOG(3) << "Allocation and synchronization (TO), ptr " << p
+              << " for var: " << p->GetPointedVar()->ToString();
+      return p->GetPointedVar()->AllocateAndTransferToSandboxee(rpc_channel(),
+                                                                pid());
+    }
     SAPI_RETURN_IF_ERROR(Allocate(p->GetPointedVar(), /*automatic_free=*/true));
   }
-
-  // Allocation occurs during both before/after synchronization modes. But the
-  // memory is transferred to the sandboxee only if v::Pointable::kSyncBefore
-  // was requested.
-  // NOLINTNEXTLINE(clang-diagnostic-deprecated-declarations)
-  if ((p->GetSyncType() & v::Pointable::kSyncBefore) == 0) {
+  if (!sync_before) {
     return absl::OkStatus();
   }
 
   VLOG(3) << "Synchronization (TO), ptr " << p << ", Type: " << p->GetSyncType()
           << " for var: " << p->GetPointedVar()->ToString();
 
-  return p->GetPointedVar()->TransferToSandboxee(rpc_channel(), pid());
+  pending_transfers->push_back(p->GetPointedVar());
+  return absl::OkStatus();
 }
 
 absl::Status Sandbox::SynchronizePtrAfter(v::Callable* ptr) const {
+  std::vector<v::Var*> pending_transfers;
+  SAPI_RETURN_IF_ERROR(SynchronizePtrAfter(ptr, &pending_transfers));
+  return TransferVars(pending_transfers, /*to_sandboxee=*/false);
+}
+
+absl::Status Sandbox::SynchronizePtrAfter(
+    v::Callable* ptr, std::vector<v::Var*>* pending_transfers) const {
   if (!is_active()) {
     return absl::UnavailableError("Sandbox not active");
   }
@@ -286,7 +730,8 @@ absl::Status Sandbox::SynchronizePtrAfter(v::Callable* ptr) const {
         p->ToString()));
   }
 
-  return p->GetPointedVar()->TransferFromSandboxee(rpc_channel(), pid());
+  pending_transfers->push_back(p->GetPointedVar());
+  return absl::OkStatus();
 }
 
 absl::Status Sandbox::Call(const std::string& func, v::Callable* ret,
@@ -294,63 +739,247 @@ absl::Status Sandbox::Call(const std::string& func, v::Callable* ret,
   if (!is_active()) {
     return absl::UnavailableError("Sandbox not active");
   }
-  // Send data.
-  FuncCall rfcall{};
-  rfcall.argc = args.size();
-  absl::SNPrintF(rfcall.func, ABSL_ARRAYSIZE(rfcall.func), "%s", func);
+  const absl::Span<v::Callable* const> arg_span(args.begin(), args.size());
+  return WithCallMetrics(func, [&]() -> absl::Status {
+    CallStats stats;
+    CallStats* profiled = SampleCall() ? &stats : nullptr;
+    // Send data.
+    CompactFuncCall rfcall;
+    rfcall.func = func;
+    SAPI_RETURN_IF_ERROR(PrepareCall(func, ret, arg_span, &rfcall, profiled));
+
+    // Call & receive data.
+    FuncRet fret;
+    RPCChannel* channel = AcquireCallChannel();
+    absl::Status status;
+    {
+      ScopedCallTimer timer(profiled ? &stats.execution : nullptr);
+      status = channel->Call(&rfcall, &fret);
+    }
+    ReleaseCallChannel(channel);
+    if (absl::IsDeadlineExceeded(status) && comms_->IsTerminated()) {
+      // The sandboxee ignored the interruption and is still running the call.
+      Terminate(/*attempt_graceful_exit=*/false);
+    }
+    SAPI_RETURN_IF_ERROR(status);
+    SAPI_RETURN_IF_ERROR(FinishCall(fret, ret, arg_span, profiled));
+    if (profiled) {
+      RecordCall(func, stats);
+    }
+    return absl::OkStatus();
+  });
+}
+
+absl::Status Sandbox::CallWithDescriptor(
+    const CallDescriptor& descriptor, v::Callable* ret,
+    std::initializer_list<v::Callable*> args) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  const absl::Span<v::Callable* const> arg_span(args.begin(), args.size());
+  return WithCallMetrics(descriptor.func, [&]() -> absl::Status {
+    // Checked before anything is transferred to the sandboxee.
+    if (!MatchesCallDescriptor(descriptor, *ret, arg_span)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Arguments of '", descriptor.func,
+                       "' don't match its call descriptor"));
+    }
+    CallStats stats;
+    CallStats* profiled = SampleCall() ? &stats : nullptr;
+    // The name is only needed until the sandboxee returned a function handle,
+    // the channel fills it in.
+    CompactFuncCall rfcall;
+    SAPI_RETURN_IF_ERROR(
+        PrepareCall(descriptor.func, ret, arg_span, &rfcall, profiled));
+
+    FuncRet fret;
+    RPCChannel* channel = AcquireCallChannel();
+    absl::Status status;
+    {
+      ScopedCallTimer timer(profiled ? &stats.execution : nullptr);
+      status = channel->Call(descriptor, &rfcall, &fret);
+    }
+    ReleaseCallChannel(channel);
+    if (absl::IsDeadlineExceeded(status) && comms_->IsTerminated()) {
+      // The sandboxee ignored the interruption and is still running the call.
+      Terminate(/*attempt_graceful_exit=*/false);
+    }
+    SAPI_RETURN_IF_ERROR(status);
+    SAPI_RETURN_IF_ERROR(FinishCall(fret, ret, arg_span, profiled));
+    if (profiled) {
+      RecordCall(descriptor.func, stats);
+    }
+    return absl::OkStatus();
+  });
+}
+
+absl::Status Sandbox::CallBatch(absl::Span<const BatchedCall> calls) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  std::vector<CompactFuncCall> rfcalls(calls.size());
+  for (size_t i = 0; i < calls.size(); ++i) {
+    rfcalls[i].func = calls[i].func;
+    SAPI_RETURN_IF_ERROR(
+        PrepareCall(calls[i].func, calls[i].ret, calls[i].args, &rfcalls[i]));
+  }
+
+  std::vector<FuncRet> frets;
+  RPCChannel* channel = AcquireCallChannel();
+  const absl::Status status =
+      channel->CallBatch(absl::MakeSpan(rfcalls), &frets);
+  ReleaseCallChannel(channel);
+  if (metrics::Enabled()) {
+    for (const BatchedCall& call : calls) {
+      metrics::IncrementCounter(metrics::kRpcCalls, call.func);
+    }
+    // The call that failed, if any, is the one after the last result.
+    if (!status.ok() && frets.size() < calls.size()) {
+      metrics::IncrementCounter(metrics::kRpcErrors, calls[frets.size()].func);
+    }
+  }
+  // Results of the calls that were executed are stored even if a later one
+  // failed.
+  for (size_t i = 0; i < frets.size(); ++i) {
+    if (!frets[i].success) {
+      break;
+    }
+    SAPI_RETURN_IF_ERROR(FinishCall(frets[i], calls[i].ret, calls[i].args));
+  }
+  return status;
+}
+
+absl::StatusOr<Sandbox::AsyncCall> Sandbox::CallAsync(
+    const std::string& func, v::Callable* ret,
+    std::initializer_list<v::Callable*> args) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  metrics::IncrementCounter(metrics::kRpcCalls, func);
+  AsyncCall call(this, ret, std::vector<v::Callable*>(args));
+  CompactFuncCall rfcall;
+  rfcall.func = func;
+  SAPI_RETURN_IF_ERROR(PrepareCall(func, ret, call.args_, &rfcall));
+  RPCChannel* channel = rpc_channel();
+  SAPI_ASSIGN_OR_RETURN(call.id_, channel->CallAsync(&rfcall));
+  call.rpc_channel_ = channel;
+  call.fd_ = comms_->GetConnectionFD();
+  return call;
+}
+
+absl::Status Sandbox::AsyncCall::Wait() {
+  Sandbox* sandbox = std::exchange(sandbox_, nullptr);
+  if (sandbox == nullptr) {
+    return absl::FailedPreconditionError("Call was already waited for");
+  }
+  // A restarted sandbox has a new channel that doesn't know about the call.
+  if (!sandbox->is_active() || sandbox->rpc_channel() != rpc_channel_) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  SAPI_ASSIGN_OR_RETURN(FuncRet fret, rpc_channel_->AwaitCall(id_));
+  return sandbox->FinishCall(fret, ret_, args_);
+}
+
+void Sandbox::AsyncCall::WaitIfPending() {
+  if (sandbox_ == nullptr || rpc_channel_ == nullptr) {
+    return;
+  }
+  if (absl::Status status = Wait(); !status.ok()) {
+    LOG(WARNING) << "Dropped asynchronous call failed: " << status;
+  }
+}
+
+bool Sandbox::AsyncCall::IsDone() {
+  if (sandbox_ == nullptr || !sandbox_->is_active() ||
+      sandbox_->rpc_channel() != rpc_channel_) {
+    return true;
+  }
+  return rpc_channel_->IsCallDone(id_);
+}
+
+absl::Status Sandbox::PrepareCall(absl::string_view func, v::Callable* ret,
+                                  absl::Span<v::Callable* const> args,
+                                  CompactFuncCall* call, CallStats* stats) {
+  const absl::Time start = stats ? absl::Now() : absl::InfinitePast();
+  absl::Duration* transfer = stats ? &stats->transfer : nullptr;
+  CompactFuncCall& rfcall = *call;
+  rfcall.args.assign(args.size(), {});  // Value-init zeroes struct padding
 
   VLOG(1) << "CALL ENTRY: '" << func << "' with " << args.size()
           << " argument(s)";
 
   // Copy all arguments into rfcall.
+  std::vector<v::Var*> pending_transfers;
   int i = 0;
   for (auto* arg : args) {
-    rfcall.arg_size[i] = arg->GetSize();
-    rfcall.arg_type[i] = arg->GetType();
+    CompactFuncCall::Arg& rfarg = rfcall.args[i];
+    rfarg.size = arg->GetSize();
+    rfarg.type = arg->GetType();
 
     // For pointers, set the auxiliary type and size.
-    if (rfcall.arg_type[i] == v::Type::kPointer) {
+    if (rfarg.type == v::Type::kPointer) {
       // Cast is safe, since type is v::Type::kPointer
       auto* p = static_cast<v::Ptr*>(arg);
-      rfcall.aux_type[i] = p->GetPointedVar()->GetType();
-      rfcall.aux_size[i] = p->GetPointedVar()->GetSize();
+      rfarg.aux_type = p->GetPointedVar()->GetType();
+      rfarg.aux_size = p->GetPointedVar()->GetSize();
+      // NOLINTNEXTLINE(clang-diagnostic-deprecated-declarations)
+      if (stats && (p->GetSyncType() & v::Pointable::kSyncBefore) &&
+          p->GetPointedVar()->NeedsTransferToSandboxee(pid())) {
+        stats->bytes_to_sandboxee += p->GetPointedVar()->GetSize();
+      }
     }
 
-    // Synchronize all pointers before the call if it's needed.
-    SAPI_RETURN_IF_ERROR(SynchronizePtrBefore(arg));
+    // Synchronize all pointers before the call if it's needed. The memory is
+    // allocated right away, but transferred for all arguments at once.
+    {
+      ScopedCallTimer timer(transfer);
+      SAPI_RETURN_IF_ERROR(SynchronizePtrBefore(arg, &pending_transfers));
+    }
 
     if (arg->GetType() == v::Type::kFloat) {
-      arg->GetDataFromPtr(&rfcall.args[i].arg_float,
-                          sizeof(rfcall.args[0].arg_float));
+      arg->GetDataFromPtr(&rfarg.value.arg_float,
+                          sizeof(rfarg.value.arg_float));
       // Make MSAN happy with long double.
-      ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(&rfcall.args[i].arg_float,
-                                          sizeof(rfcall.args[0].arg_float));
+      ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(&rfarg.value.arg_float,
+                                          sizeof(rfarg.value.arg_float));
     } else {
-      arg->GetDataFromPtr(&rfcall.args[i].arg_int,
-                          sizeof(rfcall.args[0].arg_int));
+      arg->GetDataFromPtr(&rfarg.value.arg_int, sizeof(rfarg.value.arg_int));
     }
 
-    if (rfcall.arg_type[i] == v::Type::kFd) {
+    if (rfarg.type == v::Type::kFd) {
       // Cast is safe, since type is v::Type::kFd
       auto* fd = static_cast<v::Fd*>(arg);
       if (fd->GetRemoteFd() < 0) {
+        ScopedCallTimer timer(transfer);
         SAPI_RETURN_IF_ERROR(TransferToSandboxee(fd));
       }
-      rfcall.args[i].arg_int = fd->GetRemoteFd();
+      rfarg.value.arg_int = fd->GetRemoteFd();
     }
 
     VLOG(1) << "CALL ARG: (" << i << "), Type: " << arg->GetTypeString()
             << ", Size: " << arg->GetSize() << ", Val: " << arg->ToString();
     ++i;
   }
+  {
+    ScopedCallTimer timer(transfer);
+    SAPI_RETURN_IF_ERROR(TransferToSandboxee(pending_transfers));
+  }
   rfcall.ret_type = ret->GetType();
   rfcall.ret_size = ret->GetSize();
+  if (stats) {
+    // Nothing was transferred before.
+    stats->marshalling += absl::Now() - start - stats->transfer;
+  }
+  return absl::OkStatus();
+}
 
-  // Call & receive data.
-  FuncRet fret;
-  SAPI_RETURN_IF_ERROR(
-      rpc_channel()->Call(rfcall, comms::kMsgCall, &fret, rfcall.ret_type));
-
+absl::Status Sandbox::FinishCall(const FuncRet& fret, v::Callable* ret,
+                                 absl::Span<v::Callable* const> args,
+                                 CallStats* stats) {
+  const absl::Time start = stats ? absl::Now() : absl::InfinitePast();
+  const absl::Duration transfer_before =
+      stats ? stats->transfer : absl::ZeroDuration();
+  absl::Duration* transfer = stats ? &stats->transfer : nullptr;
   if (fret.ret_type == v::Type::kFloat) {
     ret->SetDataFromPtr(&fret.float_val, sizeof(fret.float_val));
   } else {
@@ -358,20 +987,104 @@ absl::Status Sandbox::Call(const std::string& func, v::Callable* ret,
   }
 
   if (fret.ret_type == v::Type::kFd) {
+    ScopedCallTimer timer(transfer);
     SAPI_RETURN_IF_ERROR(TransferFromSandboxee(reinterpret_cast<v::Fd*>(ret)));
   }
 
   // Synchronize all pointers after the call if it's needed.
+  std::vector<v::Var*> pending_transfers;
   for (auto* arg : args) {
-    SAPI_RETURN_IF_ERROR(SynchronizePtrAfter(arg));
+    SAPI_RETURN_IF_ERROR(SynchronizePtrAfter(arg, &pending_transfers));
+  }
+  // Vars with a valid length are synchronized after the var holding it.
+  auto bound = std::stable_partition(
+      pending_transfers.begin(), pending_transfers.end(),
+      [](const v::Var* var) { return var->valid_length_ == nullptr; });
+  const std::vector<v::Var*> bound_transfers(bound, pending_transfers.end());
+  pending_transfers.erase(bound, pending_transfers.end());
+  {
+    ScopedCallTimer timer(transfer);
+    SAPI_RETURN_IF_ERROR(TransferFromSandboxee(pending_transfers));
+    for (v::Var* var : bound_transfers) {
+      SAPI_ASSIGN_OR_RETURN(uint64_t length, GetValidLength(*var));
+      length = std::min<uint64_t>(length, var->GetSize());
+      SAPI_RETURN_IF_ERROR(var->TransferRangeFromSandboxee(
+          rpc_channel(), pid(), /*offset=*/0, length));
+      if (stats) {
+        stats->bytes_from_sandboxee += length;
+      }
+    }
   }
 
   VLOG(1) << "CALL EXIT: Type: " << ret->GetTypeString()
           << ", Size: " << ret->GetSize() << ", Val: " << ret->ToString();
 
+  if (stats) {
+    for (const v::Var* var : pending_transfers) {
+      stats->bytes_from_sandboxee += var->GetSize();
+    }
+    stats->unmarshalling +=
+        absl::Now() - start - (stats->transfer - transfer_before);
+  }
   return absl::OkStatus();
 }
 
+void Sandbox::RecordCall(absl::string_view func, CallStats& stats) {
+  stats.samples = 1;
+  call_profiler_->Record(func, stats);
+}
+
+absl::flat_hash_map<std::string, CallStats> Sandbox::GetCallProfile() const {
+  return call_profiler_ ? call_profiler_->GetStats()
+                        : absl::flat_hash_map<std::string, CallStats>();
+}
+
+std::string Sandbox::GetCallProfileReport() const {
+  return call_profiler_ ? call_profiler_->GetReport() : "";
+}
+
+absl::StatusOr<uint64_t> Sandbox::GetValidLength(const v::Var& var) {
+  v::Callable* length = var.valid_length_;
+  if (length == nullptr) {
+    return var.GetSize();
+  }
+  if (length->GetType() != v::Type::kInt) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Valid length must be an integer, got ",
+                     length->GetTypeString()));
+  }
+  const void* data = length->GetDataPtr();
+  int64_t value;
+  switch (length->GetSize()) {
+    case 1:
+      value = length->IsSigned() ? *static_cast<const int8_t*>(data)
+                                 : *static_cast<const uint8_t*>(data);
+      break;
+    case 2:
+      value = length->IsSigned() ? *static_cast<const int16_t*>(data)
+                                 : *static_cast<const uint16_t*>(data);
+      break;
+    case 4:
+      value = length->IsSigned() ? *static_cast<const int32_t*>(data)
+                                 : *static_cast<const uint32_t*>(data);
+      break;
+    case 8:
+      if (!length->IsSigned()) {
+        return *static_cast<const uint64_t*>(data);
+      }
+      value = *static_cast<const int64_t*>(data);
+      break;
+    default:
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unsupported valid length size: ", length->GetSize()));
+  }
+  if (value < 0) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Valid length is negative: ", value));
+  }
+  return value;
+}
+
 absl::Status Sandbox::Symbol(const char* symname, void** addr) {
   if (!is_active()) {
     return absl::UnavailableError("Sandbox not active");
@@ -393,41 +1106,224 @@ absl::Status Sandbox::TransferFromSandboxee(v::Var* var) {
   return var->TransferFromSandboxee(rpc_channel(), pid());
 }
 
-absl::StatusOr<std::string> Sandbox::GetCString(const v::RemotePtr& str,
-                                                size_t max_length) {
+absl::Status Sandbox::TransferToSandboxee(v::Var* var, size_t offset,
+                                          size_t length) {
   if (!is_active()) {
     return absl::UnavailableError("Sandbox not active");
   }
+  return var->TransferRangeToSandboxee(rpc_channel(), pid(), offset, length);
+}
 
-  SAPI_ASSIGN_OR_RETURN(auto len, rpc_channel()->Strlen(str.GetValue()));
-  if (len > max_length) {
-    return absl::InvalidArgumentError(
-        absl::StrCat("Target string too large: ", len, " > ", max_length));
+absl::Status Sandbox::TransferFromSandboxee(v::Var* var, size_t offset,
+                                            size_t length) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
   }
-  std::string buffer(len, '\0');
-  struct iovec local = {
-      .iov_base = &buffer[0],
-      .iov_len = len,
-  };
-  struct iovec remote = {
-      .iov_base = str.GetValue(),
-      .iov_len = len,
+  return var->TransferRangeFromSandboxee(rpc_channel(), pid(), offset, length);
+}
+
+absl::Status Sandbox::TransferToSandboxee(absl::Span<v::Var* const> vars) {
+  return TransferVars(vars, /*to_sandboxee=*/true);
+}
+
+absl::Status Sandbox::TransferFromSandboxee(absl::Span<v::Var* const> vars) {
+  return TransferVars(vars, /*to_sandboxee=*/false);
+}
+
+absl::Status Sandbox::TransferVars(absl::Span<v::Var* const> vars,
+                                   bool to_sandboxee) const {
+  if (vars.empty()) {
+    return absl::OkStatus();
+  }
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  auto transfer_one = [this, to_sandboxee](v::Var* var) {
+    return to_sandboxee ? var->TransferToSandboxee(rpc_channel(), pid())
+                        : var->TransferFromSandboxee(rpc_channel(), pid());
   };
+  // Batching needs process_vm_writev()/process_vm_readv().
+  if (vars.size() == 1 || rpc_channel()->transfer_over_comms() ||
+      rpc_channel()->in_process()) {
+    for (v::Var* var : vars) {
+      SAPI_RETURN_IF_ERROR(transfer_one(var));
+    }
+    return absl::OkStatus();
+  }
+
+  std::vector<v::Var*> batched;
+  std::vector<struct iovec> local;
+  std::vector<struct iovec> remote;
+  batched.reserve(vars.size());
+  local.reserve(vars.size());
+  remote.reserve(vars.size());
+  for (v::Var* var : vars) {
+    struct iovec local_iov;
+    struct iovec remote_iov;
+    if (!var->GetTransferRegion(&local_iov, &remote_iov)) {
+      SAPI_RETURN_IF_ERROR(transfer_one(var));
+      continue;
+    }
+    if (to_sandboxee && !var->NeedsTransferToSandboxee(pid())) {
+      continue;
+    }
+    // Large vars are better served by a parallel transfer of their own.
+    if (local_iov.iov_len >= 2 * v::Var::kParallelTransferChunkSize) {
+      SAPI_RETURN_IF_ERROR(transfer_one(var));
+      continue;
+    }
+    batched.push_back(var);
+    local.push_back(local_iov);
+    remote.push_back(remote_iov);
+  }
+
+  for (size_t start = 0; start < batched.size(); start += IOV_MAX) {
+    const size_t count = std::min<size_t>(batched.size() - start, IOV_MAX);
+    ssize_t expected = 0;
+    for (size_t i = start; i < start + count; ++i) {
+      expected += local[i].iov_len;
+    }
+    const ssize_t ret =
+        to_sandboxee ? process_vm_writev(pid(), &local[start], count,
+                                         &remote[start], count, 0)
+                     : process_vm_readv(pid(), &local[start], count,
+                                        &remote[start], count, 0);
+    if (ret != expected) {
+      // Retry one by one, which reports the offending variable.
+      VLOG(1) << "Vectored transfer of " << count << " vars transferred "
+              << ret << " of " << expected << " bytes";
+      for (size_t i = start; i < start + count; ++i) {
+        SAPI_RETURN_IF_ERROR(transfer_one(batched[i]));
+      }
+      continue;
+    }
+    metrics::IncrementCounter(metrics::kBytesTransferred,
+                              to_sandboxee ? "to_sandboxee" : "from_sandboxee",
+                              ret);
+    for (size_t i = start; i < start + count; ++i) {
+      batched[i]->MarkSynchronized(pid());
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Sandbox::TransferFromSandboxeeAndFree(v::Var* var) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+  return var->TransferFromSandboxeeAndFree(rpc_channel(), pid());
+}
+
+absl::StatusOr<std::string> Sandbox::GetCString(const v::RemotePtr& str,
+                                                size_t max_length) {
+  void* ptr = str.GetValue();
+  SAPI_ASSIGN_OR_RETURN(std::vector<std::string> strings,
+                        GetCStrings(absl::MakeConstSpan(&ptr, 1), max_length));
+  return std::move(strings[0]);
+}
 
-  ssize_t ret = process_vm_readv(pid_, &local, 1, &remote, 1, 0);
-  if (ret == -1) {
-    PLOG(WARNING) << "reading c-string failed: process_vm_readv(pid: " << pid_
-                  << " raddr: " << str.GetValue() << " size: " << len << ")";
-    return absl::UnavailableError("process_vm_readv failed");
+std::vector<bool> Sandbox::ReadRemote(absl::Span<struct iovec> local,
+                                      absl::Span<struct iovec> remote) const {
+  std::vector<bool> read(local.size());
+  if (rpc_channel()->transfer_over_comms()) {
+    for (size_t i = 0; i < local.size(); ++i) {
+      read[i] = rpc_channel()
+                    ->ReadMemory(remote[i].iov_base, local[i].iov_base,
+                                 local[i].iov_len)
+                    .ok();
+    }
+    return read;
+  }
+  for (size_t start = 0; start < local.size(); start += IOV_MAX) {
+    const size_t count = std::min<size_t>(local.size() - start, IOV_MAX);
+    ssize_t expected = 0;
+    for (size_t i = start; i < start + count; ++i) {
+      expected += local[i].iov_len;
+    }
+    if (process_vm_readv(pid_, &local[start], count, &remote[start], count,
+                         0) == expected) {
+      std::fill(read.begin() + start, read.begin() + start + count, true);
+      continue;
+    }
+    // Find out which of the reads failed.
+    for (size_t i = start; i < start + count; ++i) {
+      read[i] = process_vm_readv(pid_, &local[i], 1, &remote[i], 1, 0) ==
+                static_cast<ssize_t>(local[i].iov_len);
+    }
+  }
+  return read;
+}
+
+absl::StatusOr<std::vector<std::string>> Sandbox::GetCStrings(
+    absl::Span<void* const> strs, size_t max_length) {
+  if (!is_active()) {
+    return absl::UnavailableError("Sandbox not active");
+  }
+
+  // Bytes read from each string before asking the sandboxee for its length.
+  // The prefix ends with the page, so that it cannot fault.
+  constexpr size_t kPrefixLength = 256;
+  const uintptr_t page_size = getpagesize();
+  std::vector<std::string> strings(strs.size());
+  std::vector<struct iovec> local(strs.size());
+  std::vector<struct iovec> remote(strs.size());
+  for (size_t i = 0; i < strs.size(); ++i) {
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(strs[i]);
+    const size_t len =
+        std::min<size_t>(kPrefixLength, page_size - addr % page_size);
+    strings[i].resize(len);
+    local[i] = {.iov_base = &strings[i][0], .iov_len = len};
+    remote[i] = {.iov_base = strs[i], .iov_len = len};
+  }
+  std::vector<bool> read = ReadRemote(absl::MakeSpan(local),
+                                      absl::MakeSpan(remote));
+
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < strs.size(); ++i) {
+    if (read[i]) {
+      if (size_t len = strings[i].find('\0'); len != std::string::npos) {
+        if (len > max_length) {
+          return absl::InvalidArgumentError(absl::StrCat(
+              "Target string too large: ", len, " > ", max_length));
+        }
+        strings[i].resize(len);
+        continue;
+      }
+    }
+    pending.push_back(i);
   }
-  if (ret != len) {
-    LOG(WARNING) << "partial read when reading c-string: process_vm_readv(pid: "
-                 << pid_ << " raddr: " << str.GetValue() << " size: " << len
-                 << ") transferred " << ret << " bytes";
-    return absl::UnavailableError("process_vm_readv succeeded partially");
+  if (pending.empty()) {
+    return strings;
   }
 
-  return buffer;
+  std::vector<void*> ptrs;
+  ptrs.reserve(pending.size());
+  for (size_t i : pending) {
+    ptrs.push_back(strs[i]);
+  }
+  SAPI_ASSIGN_OR_RETURN(std::vector<size_t> lens,
+                        rpc_channel()->Strlens(absl::MakeConstSpan(ptrs)));
+  local.resize(pending.size());
+  remote.resize(pending.size());
+  for (size_t j = 0; j < pending.size(); ++j) {
+    if (lens[j] > max_length) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Target string too large: ", lens[j], " > ", max_length));
+    }
+    std::string& string = strings[pending[j]];
+    string.resize(lens[j]);
+    local[j] = {.iov_base = &string[0], .iov_len = lens[j]};
+    remote[j] = {.iov_base = ptrs[j], .iov_len = lens[j]};
+  }
+  read = ReadRemote(absl::MakeSpan(local), absl::MakeSpan(remote));
+  for (size_t j = 0; j < pending.size(); ++j) {
+    if (!read[j]) {
+      LOG(WARNING) << "reading c-string failed: process_vm_readv(pid: " << pid_
+                   << " raddr: " << ptrs[j] << " size: " << lens[j] << ")";
+      return absl::UnavailableError("process_vm_readv failed");
+    }
+  }
+  return strings;
 }
 
 const sandbox2::Result& Sandbox::AwaitResult() {
@@ -442,14 +1338,43 @@ absl::Status Sandbox::SetWallTimeLimit(absl::Duration limit) const {
   if (!is_active()) {
     return absl::UnavailableError("Sandbox not active");
   }
+  if (in_process_comms_) {
+    return absl::OkStatus();
+  }
   s2_->set_walltime_limit(limit);
   return absl::OkStatus();
 }
 
+void Sandbox::SetCallTimeLimit(absl::Duration limit,
+                               absl::Duration grace_period) {
+  call_time_limit_ = limit;
+  call_grace_period_ = grace_period;
+  if (is_active()) {
+    ApplyCallTimeLimit();
+  }
+}
+
+void Sandbox::ApplyCallTimeLimit() {
+  if (rpc_channel_->in_process()) {
+    // The signal would hit the host instead.
+    rpc_channel_->SetCallTimeLimit(call_time_limit_, call_grace_period_,
+                                   [] {});
+    return;
+  }
+  rpc_channel_->SetCallTimeLimit(
+      call_time_limit_, call_grace_period_, [pid = pid_] {
+        syscall(__NR_tgkill, pid, pid, comms::kCallCancelSignal);
+      });
+}
+
 void Sandbox::Exit() const {
   if (!is_active()) {
     return;
   }
+  if (in_process_comms_) {
+    rpc_channel_->Exit().IgnoreError();
+    return;
+  }
   s2_->set_walltime_limit(absl::Seconds(1));
   if (!rpc_channel_->Exit().ok()) {
     LOG(WARNING) << "rpc_channel->Exit() failed, killing PID: " << pid();
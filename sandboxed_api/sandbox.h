@@ -15,24 +15,47 @@
 #ifndef SANDBOXED_API_SANDBOX_H_
 #define SANDBOXED_API_SANDBOX_H_
 
+#include <sys/uio.h>
+
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "sandboxed_api/file_toc.h"
 #include "absl/base/macros.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/call_profile.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/rpcchannel.h"
 #include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/limits.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/policybuilder.h"
 #include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/util/metrics.h"
 #include "sandboxed_api/vars.h"
 
 namespace sapi {
 
+// How much the memory usage of a sandboxee may grow over what it used right
+// after starting, see Sandbox::ExceedsMemoryGrowth(). 0 means no limit.
+struct MemoryGrowthLimits {
+  // Growth of the resident memory, which includes fragmentation.
+  uint64_t resident_bytes = 0;
+  // Growth of the memory in use by malloc(), i.e. leaked memory.
+  uint64_t heap_bytes = 0;
+
+  bool empty() const { return resident_bytes == 0 && heap_bytes == 0; }
+};
+
 // The Sandbox class represents the sandboxed library. It provides users with
 // means to communicate with it (make function calls, transfer memory).
 class Sandbox {
@@ -51,15 +74,64 @@ class Sandbox {
   // Returns whether the current sandboxing session is active.
   bool is_active() const;
 
+  // Returns whether the current session runs the library in the host process,
+  // see RunInProcess(). pid() is then the host's own.
+  bool is_in_process() const { return in_process_comms_ != nullptr; }
+
   // Terminates the current sandboxing session (if it exists).
   void Terminate(bool attempt_graceful_exit = true);
 
   // Restarts the sandbox.
   absl::Status Restart(bool attempt_graceful_exit) {
+    metrics::IncrementCounter(metrics::kRestarts);
     Terminate(attempt_graceful_exit);
     return Init();
   }
 
+  // Brings the sandboxee back to a clean state without restarting it, which
+  // is much cheaper: releases the allocation arena and calls Reinitialize().
+  // Falls back to Restart() if that fails, or if the sandboxee then uses more
+  // than `max_resident_bytes` of resident memory (0 means no limit). As with
+  // Restart(), vars and FDs referring to the sandboxee must not be used
+  // afterwards.
+  absl::Status Reset(uint64_t max_resident_bytes = 0);
+
+  // Memory used by the sandboxee.
+  struct MemoryUsage {
+    // Resident memory of the sandboxee's main process.
+    uint64_t resident_bytes = 0;
+    // Memory allocated with malloc() and not freed yet.
+    uint64_t heap_bytes = 0;
+  };
+
+  // Samples the memory currently used by the sandboxee. Getting `heap_bytes`
+  // takes a round trip to the sandboxee. Fails if is_in_process(), as that
+  // would sample the host.
+  absl::StatusOr<MemoryUsage> GetMemoryUsage() const;
+
+  // Returns the memory used right after the sandboxee started, so that
+  // GetMemoryUsage() can be compared against it.
+  const MemoryUsage& initial_memory_usage() const {
+    return initial_memory_usage_;
+  }
+
+  // Returns whether the memory usage grew by more than `limits` allow since
+  // the sandboxee started. Only samples what `limits` restrict. Always false
+  // if is_in_process().
+  absl::StatusOr<bool> ExceedsMemoryGrowth(
+      const MemoryGrowthLimits& limits) const;
+
+  // Restarts the sandbox if ExceedsMemoryGrowth(), or if memory usage cannot
+  // be sampled. Cheaper than restarting after a fixed number of calls, as
+  // sandboxees that don't leak are kept. Returns whether it restarted. The
+  // warning of Reset() applies.
+  absl::StatusOr<bool> RestartIfMemoryGrew(const MemoryGrowthLimits& limits);
+
+  // Stops the sandboxee while it is idle, see sandbox2::Sandbox2::Freeze().
+  // Calls and transfers block until Thaw().
+  absl::Status Freeze(bool page_out = false);
+  absl::Status Thaw();
+
   sandbox2::Comms* comms() const { return comms_; }
 
   RPCChannel* rpc_channel() const { return rpc_channel_.get(); }
@@ -72,16 +144,113 @@ class Sandbox {
   // Synchronizes the underlying memory for pointer after the call.
   absl::Status SynchronizePtrAfter(v::Callable* ptr) const;
 
+  // Returns the number of bytes of var that are synchronized after calls, the
+  // value of the var set with v::Var::SetValidLength() if there is one. Fails
+  // if that value is negative.
+  static absl::StatusOr<uint64_t> GetValidLength(const v::Var& var);
+
   // Makes a call to the sandboxee.
   template <typename... Args>
   absl::Status Call(const std::string& func, v::Callable* ret, Args&&... args) {
-    static_assert(sizeof...(Args) <= FuncCall::kArgsMax,
-                  "Too many arguments to sapi::Sandbox::Call()");
     return Call(func, ret, {std::forward<Args>(args)...});
   }
   absl::Status Call(const std::string& func, v::Callable* ret,
                     std::initializer_list<v::Callable*> args);
 
+  // Like Call(), but for a function described by `descriptor`, as emitted by
+  // the Sandboxed API generator. After the first call, the function handle is
+  // found by the descriptor's address, so `descriptor` must outlive the
+  // sandbox. Fails if `ret` and `args` don't have the described types.
+  template <typename... Args>
+  absl::Status CallWithDescriptor(const CallDescriptor& descriptor,
+                                  v::Callable* ret, Args&&... args) {
+    return CallWithDescriptor(descriptor, ret, {std::forward<Args>(args)...});
+  }
+  absl::Status CallWithDescriptor(const CallDescriptor& descriptor,
+                                  v::Callable* ret,
+                                  std::initializer_list<v::Callable*> args);
+
+  // A single call of a batch, see CallBatch().
+  struct BatchedCall {
+    std::string func;
+    v::Callable* ret;
+    std::vector<v::Callable*> args;
+  };
+
+  // Makes several calls to the sandboxee in a single round trip. The calls are
+  // executed in order, stopping at the first one that fails. Pointers are
+  // synchronized before the first call and after the last one, so a call
+  // cannot observe changes made by the host after the batch started.
+  absl::Status CallBatch(absl::Span<const BatchedCall> calls);
+
+  // Handle to a call started with CallAsync(). Destroying (or assigning to) a
+  // handle that was not waited for waits for the call, so that its result is
+  // consumed and pointers are synchronized. The handle must not outlive the
+  // sandbox.
+  class AsyncCall {
+   public:
+    AsyncCall(AsyncCall&& other) { *this = std::move(other); }
+    AsyncCall& operator=(AsyncCall&& other) {
+      if (this == &other) {
+        return *this;
+      }
+      WaitIfPending();
+      sandbox_ = std::exchange(other.sandbox_, nullptr);
+      rpc_channel_ = other.rpc_channel_;
+      id_ = other.id_;
+      fd_ = other.fd_;
+      ret_ = other.ret_;
+      args_ = std::move(other.args_);
+      return *this;
+    }
+    ~AsyncCall() { WaitIfPending(); }
+
+    // Waits for the call to finish, then stores its result in `ret` and
+    // synchronizes pointers, like Call() does. Can only be called once.
+    absl::Status Wait();
+
+    // Returns whether Wait() returns without waiting for the sandboxee. Also
+    // true if Wait() would fail right away.
+    bool IsDone();
+
+    // Returns a file descriptor that becomes readable when IsDone() may have
+    // changed, for event loops (see AwaitReactor). Another thread using the
+    // sandbox may receive the result without the descriptor becoming
+    // readable, so IsDone() should be checked before each wait.
+    int readiness_fd() const { return fd_; }
+
+   private:
+    friend class Sandbox;
+
+    AsyncCall(Sandbox* sandbox, v::Callable* ret,
+              std::vector<v::Callable*> args)
+        : sandbox_(sandbox), ret_(ret), args_(std::move(args)) {}
+
+    // Waits for a call that was started but not waited for, logging failures.
+    void WaitIfPending();
+
+    Sandbox* sandbox_ = nullptr;
+    RPCChannel* rpc_channel_ = nullptr;
+    uint64_t id_ = 0;
+    int fd_ = -1;
+    v::Callable* ret_ = nullptr;
+    std::vector<v::Callable*> args_;
+  };
+
+  // Starts a call without waiting for it to finish, so that the host can do
+  // other work, or start further calls, while the sandboxee computes. Calls
+  // are executed in order. `ret` and pointer arguments must not be accessed,
+  // nor go out of scope, until AsyncCall::Wait() returned. Other operations
+  // on the sandbox, e.g. allocating memory, wait for all started calls.
+  template <typename... Args>
+  absl::StatusOr<AsyncCall> CallAsync(const std::string& func,
+                                      v::Callable* ret, Args&&... args) {
+    return CallAsync(func, ret, {std::forward<Args>(args)...});
+  }
+  absl::StatusOr<AsyncCall> CallAsync(const std::string& func,
+                                      v::Callable* ret,
+                                      std::initializer_list<v::Callable*> args);
+
   // Allocates memory in the sandboxee, automatic_free indicates whether the
   // memory should be freed on the remote side when the 'var' goes out of scope.
   absl::Status Allocate(v::Var* var, bool automatic_free = false);
@@ -89,6 +258,11 @@ class Sandbox {
   // Frees memory in the sandboxee.
   absl::Status Free(v::Var* var);
 
+  // Releases all memory allocated from the arena reserved in the sandboxee,
+  // see GetAllocationArenaSize(). Variables allocated from it before must not
+  // be used anymore. Call this e.g. at the end of a transaction.
+  void ResetAllocationArena();
+
   // Finds the address of a symbol in the sandboxee.
   absl::Status Symbol(const char* symname, void** addr);
 
@@ -97,17 +271,73 @@ class Sandbox {
   absl::Status TransferToSandboxee(v::Var* var);
   absl::Status TransferFromSandboxee(v::Var* var);
 
+  // Transfers several vars, using a single vectored syscall for all those
+  // that are plain memory.
+  absl::Status TransferToSandboxee(absl::Span<v::Var* const> vars);
+  absl::Status TransferFromSandboxee(absl::Span<v::Var* const> vars);
+
+  // Transfers only the `length` bytes starting `offset` bytes into the var.
+  // For v::LenVal, the range refers to the data.
+  absl::Status TransferToSandboxee(v::Var* var, size_t offset, size_t length);
+  absl::Status TransferFromSandboxee(v::Var* var, size_t offset,
+                                     size_t length);
+
+  // Transfers memory from the sandboxee and frees it there afterwards. Small
+  // variables need only a single round trip for both.
+  absl::Status TransferFromSandboxeeAndFree(v::Var* var);
+
   absl::StatusOr<std::string> GetCString(const v::RemotePtr& str,
                                          size_t max_length = 10ULL
                                                              << 20 /* 10 MiB*/
   );
 
+  // Reads the null-terminated strings at the remote addresses `strs`. A
+  // prefix of each string is read first, without asking the sandboxee for the
+  // length, which is enough for short strings. The lengths of the others are
+  // then queried in a single round trip, and all reads are vectored. Fails if
+  // any string is longer than `max_length`. GetCString() reads a single one.
+  absl::StatusOr<std::vector<std::string>> GetCStrings(
+      absl::Span<void* const> strs, size_t max_length = 10ULL
+                                                        << 20 /* 10 MiB*/);
+
+  // Allocators a sandboxee can be linked against.
+  enum class SandboxeeMalloc {
+    kSystem,
+    kTcMalloc,
+    kScudo,
+  };
+
   // Waits until the sandbox terminated and returns the result.
   const sandbox2::Result& AwaitResult();
   const sandbox2::Result& result() const { return result_; }
 
   absl::Status SetWallTimeLimit(absl::Duration limit) const;
 
+  // Bounds the time each call made with Call() or CallWithDescriptor(), and
+  // thus with the generated functions, may take, zero to disable. A call that
+  // exceeds `limit` is interrupted with comms::kCallCancelSignal, which makes
+  // sapi_call_cancelled() return true and blocking syscalls fail with EINTR
+  // in the sandboxee, and fails with DeadlineExceededError. If it does not
+  // return within `grace_period` either, the sandbox is terminated. Calls
+  // with a time limit are served by the main thread of the sandboxee, not by
+  // the channels of SetNumCallChannels(). Kept across restarts.
+  void SetCallTimeLimit(absl::Duration limit,
+                        absl::Duration grace_period = absl::Seconds(1));
+
+  // Pins the sandboxee to CPUs and a NUMA node, and sets its scheduling
+  // policy, see sandbox2::Placement. Takes effect from the next Init() on, and
+  // can still be changed in ModifyExecutor().
+  void SetPlacement(sandbox2::Placement placement) {
+    placement_ = std::move(placement);
+  }
+
+  // Returns the stats of the calls profiled so far by function name, see
+  // GetCallProfilingInterval(). They are kept across restarts.
+  absl::flat_hash_map<std::string, CallStats> GetCallProfile() const;
+
+  // Returns GetCallProfile() as a table, which is also logged on Terminate().
+  std::string GetCallProfileReport() const;
+
  protected:
 
   // Gets extra arguments to be passed to the sandboxee.
@@ -115,14 +345,24 @@ class Sandbox {
     // Do nothing by default.
   }
 
- private:
-  // Gets the environment variables passed to the sandboxee.
+  // Gets the environment variables passed to the sandboxee. Overrides should
+  // call this to keep the defaults.
   virtual void GetEnvs(std::vector<std::string>* envs) const {
     envs->push_back("GOOGLE_LOGTOSTDERR=1");
   }
 
+ private:
+
+  // Returns the allocator the sandboxee is linked against, so that the default
+  // policy allows the syscalls it needs. The sandbox classes generated for
+  // sapi_library() targets override this according to their `malloc` option.
+  virtual SandboxeeMalloc GetSandboxeeMalloc() const {
+    return SandboxeeMalloc::kSystem;
+  }
+
   // Returns the sandbox policy. Subclasses can modify the default policy
-  // builder, or return a completely new policy.
+  // builder, or return a completely new policy. The first Init() calls it on
+  // a separate thread, while the forkserver is starting.
   virtual std::unique_ptr<sandbox2::Policy> ModifyPolicy(
       sandbox2::PolicyBuilder* builder);
 
@@ -140,12 +380,160 @@ class Sandbox {
   // Provides a custom notifier for sandboxee events. May return nullptr.
   virtual std::unique_ptr<sandbox2::Notify> CreateNotifier() { return nullptr; }
 
+  // Returns the size of the shared memory ring buffers to use for talking to
+  // the sandboxee. If non-zero, RPCs are sent through shared memory instead of
+  // the comms socket. This requires the sandboxee policy to allow futex() and
+  // shared read-write mappings, which the default policy then does.
+  virtual size_t GetSharedMemoryRingSize() const { return 0; }
+
+  // Returns whether the sandboxee uses v::SharedArray. If so, the default
+  // policy allows it to map shared memory read-write, which it does not
+  // otherwise. Custom policies need to allow this themselves.
+  virtual bool UseSharedArrays() const { return false; }
+
+  // Returns whether the sandboxee uses v::LazyArray. If so, the default policy
+  // allows it to create userfaultfds, and lazy arrays are only copied in full
+  // otherwise. Custom policies need PolicyBuilder::AllowUserfaultfd().
+  virtual bool UseLazyArrays() const { return false; }
+
+  // Returns the size of a region to reserve in the sandboxee on start-up. If
+  // non-zero, Allocate() hands out memory from this region without a round
+  // trip to the sandboxee, as long as it doesn't run out. Such memory is only
+  // released in bulk, with ResetAllocationArena() or on Restart().
+  virtual size_t GetAllocationArenaSize() const { return 0; }
+
+  // Returns the number of channels that calls to the sandboxee are spread
+  // across. With more than one, the sandboxee serves each channel from its own
+  // thread, so that Call() and CallBatch() from different host threads can run
+  // concurrently. Only use this with thread-safe libraries. The policy must
+  // allow the sandboxee to create threads.
+  virtual int GetNumCallChannels() const { return 1; }
+
+  // Returns how often calls made with Call() and CallWithDescriptor() are
+  // profiled, see GetCallProfile(). With N, every Nth call is. Zero disables
+  // profiling.
+  virtual int GetCallProfilingInterval() const { return 0; }
+
+  // Brings the sandboxed library back to its initial state for Reset(), e.g.
+  // by calling a library function that clears its global state. By default,
+  // this isn't possible and Reset() restarts the sandbox.
+  virtual absl::Status Reinitialize() {
+    return absl::UnimplementedError("Sandbox cannot be reinitialized");
+  }
+
+  // Returns whether this sandbox shares its forkserver with all others that
+  // run the same library with the same arguments and environment. The shared
+  // forkserver keeps running until the host process exits, so that Init()
+  // doesn't need to start the library again. Sandboxees are forked from it,
+  // so they start with whatever state the library set up in
+  // sapi_zygote_init(), see RunZygoteInit(). Each of them is still sandboxed
+  // and monitored separately.
+  virtual bool ShareForkServer() const { return false; }
+
+  // Returns whether the forkserver calls sapi_zygote_init() of the library
+  // before forking sandboxees from it, see client.cc. That code runs without
+  // the sandbox policy, with the privileges of the host, so only enable this
+  // for libraries whose zygote initialization is trusted and only reads input
+  // that the host controls, e.g. data files chosen by the host.
+  virtual bool RunZygoteInit() const { return false; }
+
+  // Returns whether variables are transferred through the RPC channel instead
+  // of with process_vm_writev()/process_vm_readv(). This is slower, as the
+  // data passes through the socket, but it doesn't need the host to be able
+  // to access the memory of the sandboxee directly, e.g. when the channel is
+  // relayed to a sandboxee on another machine.
+  virtual bool TransferOverComms() const { return false; }
+
+  // Returns whether the library is called in the host process instead of a
+  // sandboxee, without any isolation. The stub that serves the sandboxee's
+  // end of the RPC channel then runs on a thread of the host, and transfers
+  // are plain memcpy() calls, so that everything else behaves the same. This
+  // is meant for measuring the overhead of sandboxing a library with the same
+  // code, and for fast paths with trusted input only. Off by default; the
+  // <Name>PassthroughSandbox class generated next to <Name>Sandbox turns it
+  // on. Needs a binary linked with //sandboxed_api:passthrough, e.g. through
+  // the <name>_passthrough target of sapi_library(), which links the library
+  // in as well. Other sandboxes in the same binary still run sandboxed.
+  //
+  // Neither the policy nor limits apply, Freeze(), Thaw() and
+  // SetWallTimeLimit() do nothing, and calls that exceed SetCallTimeLimit()
+  // fail without being interrupted. Memory limits are not enforced either:
+  // Reset() ignores `max_resident_bytes`, and SandboxPool does not discard
+  // sandboxes for their memory usage. Memory and state the library leaves
+  // behind are not reclaimed by Terminate() or Restart().
+  virtual bool RunInProcess() const { return false; }
+
   // Exits the sandboxee.
   void Exit() const;
 
+  // Applies the limit of SetCallTimeLimit() to rpc_channel_.
+  void ApplyCallTimeLimit();
+
+  // Starts serving rpc_channel_ from this process, see RunInProcess().
+  absl::Status StartInProcess();
+
+  // Sets up what Init() enables on top of rpc_channel_.
+  absl::Status FinishInit();
+
+  // Opens the channels in addition to rpc_channel_, see GetNumCallChannels().
+  absl::Status OpenCallChannels(int num_channels);
+
+  // Returns an idle channel for calls, waiting for one if necessary. It must
+  // be given back with ReleaseCallChannel().
+  RPCChannel* AcquireCallChannel();
+  void ReleaseCallChannel(RPCChannel* channel);
+
+  // Starts the forkserver, or connects to the shared one.
+  absl::Status StartForkServer();
+  absl::Status CreateForkServer(
+      const std::string& lib_path, const std::vector<std::string>& args,
+      const std::vector<std::string>& envs,
+      std::unique_ptr<sandbox2::Executor>* executor,
+      std::unique_ptr<sandbox2::ForkClient>* fork_client) const;
+  bool UseEmbedLib() const {
+    return embed_lib_toc_ && !sapi::host_os::IsAndroid();
+  }
+
+  // Like SynchronizePtrBefore()/SynchronizePtrAfter(), but only appends the
+  // vars that need to be transferred to `pending_transfers`.
+  absl::Status SynchronizePtrBefore(v::Callable* ptr,
+                                    std::vector<v::Var*>* pending_transfers);
+  absl::Status SynchronizePtrAfter(
+      v::Callable* ptr, std::vector<v::Var*>* pending_transfers) const;
+
+  // Implements TransferToSandboxee() and TransferFromSandboxee() for multiple
+  // vars.
+  absl::Status TransferVars(absl::Span<v::Var* const> vars,
+                            bool to_sandboxee) const;
+
+  // Reads the remote regions into the local buffers with vectored reads.
+  // Returns which of them were read completely.
+  std::vector<bool> ReadRemote(absl::Span<struct iovec> local,
+                               absl::Span<struct iovec> remote) const;
+
+  // Fills `rfcall` for a call of `func`, except for the name that the caller
+  // sets, and synchronizes pointers before it. Adds to `stats` unless that is
+  // nullptr.
+  absl::Status PrepareCall(absl::string_view func, v::Callable* ret,
+                           absl::Span<v::Callable* const> args,
+                           CompactFuncCall* rfcall, CallStats* stats = nullptr);
+  // Stores the result of a call in `ret` and synchronizes pointers after it.
+  // Adds to `stats` unless that is nullptr.
+  absl::Status FinishCall(const FuncRet& fret, v::Callable* ret,
+                          absl::Span<v::Callable* const> args,
+                          CallStats* stats = nullptr);
+
+  // Returns whether the next call is to be profiled.
+  bool SampleCall() {
+    return call_profiler_ && call_profiler_->ShouldSample();
+  }
+  void RecordCall(absl::string_view func, CallStats& stats);
+
   // The client to the library forkserver.
   std::unique_ptr<sandbox2::ForkClient> fork_client_;
   std::unique_ptr<sandbox2::Executor> forkserver_executor_;
+  // The client to the shared forkserver, if used instead. Not owned.
+  sandbox2::ForkClient* shared_fork_client_ = nullptr;
 
   // The main sandbox2::Sandbox2 object.
   std::unique_ptr<sandbox2::Sandbox2> s2_;
@@ -159,10 +547,29 @@ class Sandbox {
 
   // Comms with the sandboxee.
   sandbox2::Comms* comms_ = nullptr;
+  // Owns comms_ if the sandbox runs in process, see RunInProcess().
+  std::unique_ptr<sandbox2::Comms> in_process_comms_;
   // RPCChannel object.
   std::unique_ptr<RPCChannel> rpc_channel_;
+  // Additional channels for calls, see GetNumCallChannels().
+  std::vector<std::unique_ptr<sandbox2::Comms>> call_comms_;
+  std::vector<std::unique_ptr<RPCChannel>> call_channels_;
+  absl::Mutex idle_call_channels_mutex_;
+  // Channels that calls can be made on, including rpc_channel_.
+  std::vector<RPCChannel*> idle_call_channels_
+      ABSL_GUARDED_BY(idle_call_channels_mutex_);
   // The main pid of the sandboxee.
   pid_t pid_ = 0;
+  // See SetCallTimeLimit().
+  absl::Duration call_time_limit_ = absl::ZeroDuration();
+  absl::Duration call_grace_period_ = absl::ZeroDuration();
+  // See SetPlacement().
+  sandbox2::Placement placement_;
+  // Sampled at the end of Init().
+  MemoryUsage initial_memory_usage_;
+
+  // Created by the first Init() if GetCallProfilingInterval() is non-zero.
+  std::unique_ptr<CallProfiler> call_profiler_;
 
   // FileTOC with the embedded library, takes precedence over GetLibPath if
   // present (not nullptr).
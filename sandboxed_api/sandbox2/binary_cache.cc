@@ -0,0 +1,190 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Implementation of the sandbox2::BinaryCache class.
+
+#include "sandboxed_api/sandbox2/binary_cache.h"
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/sandbox2/util.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::file_util::fileops::FDCloser;
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#endif
+#ifndef F_SEAL_SEAL
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+// Identifies a version of a binary, so that its copy is reused until it
+// changes.
+struct FileVersion {
+  dev_t dev;
+  ino_t ino;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  off_t size;
+
+  static FileVersion FromStat(const struct stat& st) {
+    return FileVersion{st.st_dev, st.st_ino, st.st_mtim.tv_sec,
+                       st.st_mtim.tv_nsec, st.st_size};
+  }
+
+  auto Tie() const { return std::tie(dev, ino, mtime_sec, mtime_nsec, size); }
+  bool operator==(const FileVersion& other) const {
+    return Tie() == other.Tie();
+  }
+};
+
+struct CachedBinary {
+  FileVersion version;
+  FDCloser fd;
+};
+
+ABSL_CONST_INIT absl::Mutex g_binary_cache_mutex(absl::kConstInit);
+
+absl::flat_hash_map<std::string, CachedBinary>& GetBinaryCache()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(g_binary_cache_mutex) {
+  static auto* cache = new absl::flat_hash_map<std::string, CachedBinary>();
+  return *cache;
+}
+
+absl::StatusOr<FDCloser> Dup(const FDCloser& fd) {
+  FDCloser dup_fd(dup(fd.get()));
+  if (dup_fd.get() == -1) {
+    return absl::ErrnoToStatus(errno, "dup() of a cached binary");
+  }
+  return dup_fd;
+}
+
+// Copies the binary at path into a new read-only memfd.
+absl::StatusOr<CachedBinary> LoadBinary(const std::string& path) {
+  FDCloser file(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (file.get() == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  struct stat st;
+  if (fstat(file.get(), &st) == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("fstat(", path, ")"));
+  }
+  if (!S_ISREG(st.st_mode)) {
+    return absl::FailedPreconditionError(
+        absl::StrCat(path, " is not a regular file"));
+  }
+
+  int fd;
+  const std::string name = sapi::file_util::fileops::Basename(path);
+  if (!util::CreateMemFd(&fd, name.c_str())) {
+    return absl::InternalError(
+        absl::StrCat("Could not create a memfd for ", path));
+  }
+  FDCloser memfd(fd);
+  off_t offset = 0;
+  while (offset < st.st_size) {
+    ssize_t n = sendfile(memfd.get(), file.get(), &offset, st.st_size - offset);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("Copying ", path, " to a memfd"));
+    }
+    if (n == 0) {
+      return absl::UnavailableError(
+          absl::StrCat(path, " was truncated while being copied"));
+    }
+  }
+
+  if (fchmod(memfd.get(), S_IRUSR | S_IXUSR | S_IRGRP | S_IXGRP | S_IROTH |
+                              S_IXOTH) == -1) {
+    return absl::ErrnoToStatus(errno, "fchmod() of a memfd");
+  }
+  // The memfd was only written with sendfile(), so unlike with EmbedFile there
+  // are no writable mappings that could make this fail with EBUSY. Still only
+  // best effort, as the fchmod() already keeps the sandboxee from writing.
+  if (fcntl(memfd.get(), F_ADD_SEALS,
+            F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) == -1) {
+    VLOG(1) << "Could not seal the memfd for " << path << ": "
+            << absl::ErrnoToStatus(errno, "fcntl()");
+  }
+  // The version is the one from before copying. Should the file have changed
+  // meanwhile, the copy is replaced the next time.
+  return CachedBinary{FileVersion::FromStat(st), std::move(memfd)};
+}
+
+}  // namespace
+
+absl::StatusOr<FDCloser> BinaryCache::GetFd(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("stat(", path, ")"));
+  }
+  const FileVersion version = FileVersion::FromStat(st);
+  {
+    absl::MutexLock lock(&g_binary_cache_mutex);
+    auto& cache = GetBinaryCache();
+    if (auto it = cache.find(path);
+        it != cache.end() && it->second.version == version) {
+      return Dup(it->second.fd);
+    }
+  }
+
+  // Loaded without holding the lock, as that can take long. Concurrent misses
+  // for the same binary may both load it, the last one stays cached.
+  SAPI_ASSIGN_OR_RETURN(CachedBinary binary, LoadBinary(path));
+  SAPI_ASSIGN_OR_RETURN(FDCloser fd, Dup(binary.fd));
+  VLOG(1) << "Cached " << path << " in a memfd";
+  absl::MutexLock lock(&g_binary_cache_mutex);
+  GetBinaryCache().insert_or_assign(path, std::move(binary));
+  return fd;
+}
+
+void BinaryCache::Clear() {
+  absl::flat_hash_map<std::string, CachedBinary> cache;
+  {
+    absl::MutexLock lock(&g_binary_cache_mutex);
+    cache.swap(GetBinaryCache());
+  }
+  // Closed without holding the lock.
+}
+
+}  // namespace sandbox2
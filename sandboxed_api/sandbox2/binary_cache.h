@@ -0,0 +1,47 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The sandbox2::BinaryCache class keeps copies of sandboxee binaries in
+// memory.
+
+#ifndef SANDBOXED_API_SANDBOX2_BINARY_CACHE_H_
+#define SANDBOXED_API_SANDBOX2_BINARY_CACHE_H_
+
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+
+// Loads each sandboxee binary into a sealed memfd once per process, like
+// EmbedFile does for embedded SAPI libraries, so that starting it again does
+// not read it from its filesystem. A cached copy is used as long as the file
+// at the path has the same inode, size and modification time. Used through
+// Executor::set_cache_binary().
+// Cached binaries stay in memory until they change or Clear() is called.
+class BinaryCache {
+ public:
+  // Returns a new fd for executing the binary at path, loading it into the
+  // cache first if needed.
+  static absl::StatusOr<sapi::file_util::fileops::FDCloser> GetFd(
+      const std::string& path);
+
+  // Drops all cached binaries.
+  static void Clear();
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_BINARY_CACHE_H_
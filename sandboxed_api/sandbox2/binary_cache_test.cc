@@ -0,0 +1,106 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/binary_cache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/util/temp_file.h"
+
+namespace sandbox2 {
+namespace {
+
+namespace file = ::sapi::file;
+using ::sapi::CreateTempDir;
+using ::sapi::GetTestTempPath;
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::sapi::file_util::fileops::FDCloser;
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::StrEq;
+
+std::string ReadAll(const FDCloser& fd) {
+  std::string contents(4096, '\0');
+  ssize_t n = pread(fd.get(), contents.data(), contents.size(), 0);
+  contents.resize(n > 0 ? n : 0);
+  return contents;
+}
+
+ino_t Inode(const FDCloser& fd) {
+  struct stat st;
+  return fstat(fd.get(), &st) == 0 ? st.st_ino : 0;
+}
+
+class BinaryCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    absl::StatusOr<std::string> dir = CreateTempDir(GetTestTempPath());
+    ASSERT_THAT(dir, IsOk());
+    path_ = file::JoinPath(*dir, "binary");
+  }
+  void TearDown() override { BinaryCache::Clear(); }
+
+  std::string path_;
+};
+
+TEST_F(BinaryCacheTest, SharesCopyUntilFileChanges) {
+  ASSERT_THAT(file::SetContents(path_, "first", file::Defaults()), IsOk());
+  absl::StatusOr<FDCloser> fd1 = BinaryCache::GetFd(path_);
+  ASSERT_THAT(fd1, IsOk());
+  EXPECT_THAT(ReadAll(*fd1), StrEq("first"));
+  absl::StatusOr<FDCloser> fd2 = BinaryCache::GetFd(path_);
+  ASSERT_THAT(fd2, IsOk());
+  EXPECT_THAT(fd2->get(), Ne(fd1->get()));
+  EXPECT_THAT(Inode(*fd2), Eq(Inode(*fd1)));
+
+  // A different size makes the change visible even with a coarse mtime.
+  ASSERT_THAT(file::SetContents(path_, "second!", file::Defaults()), IsOk());
+  absl::StatusOr<FDCloser> fd3 = BinaryCache::GetFd(path_);
+  ASSERT_THAT(fd3, IsOk());
+  EXPECT_THAT(ReadAll(*fd3), StrEq("second!"));
+  EXPECT_THAT(Inode(*fd3), Ne(Inode(*fd1)));
+  // Fds handed out before keep the old copy.
+  EXPECT_THAT(ReadAll(*fd1), StrEq("first"));
+}
+
+TEST_F(BinaryCacheTest, CopyIsReadOnly) {
+  ASSERT_THAT(file::SetContents(path_, "binary", file::Defaults()), IsOk());
+  absl::StatusOr<FDCloser> fd = BinaryCache::GetFd(path_);
+  ASSERT_THAT(fd, IsOk());
+  EXPECT_THAT(pwrite(fd->get(), "x", 1, 0), Eq(-1));
+  struct stat st;
+  ASSERT_THAT(fstat(fd->get(), &st), Eq(0));
+  EXPECT_THAT(st.st_mode & 0777, Eq(0555));
+}
+
+TEST_F(BinaryCacheTest, FailsForMissingFile) {
+  EXPECT_THAT(BinaryCache::GetFd(path_),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+}  // namespace
+}  // namespace sandbox2
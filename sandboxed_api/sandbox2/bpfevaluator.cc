@@ -0,0 +1,252 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/bpfevaluator.h"
+
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace sandbox2 {
+namespace bpf {
+namespace {
+
+bool UsesScratchMemory(const sock_filter& insn) {
+  switch (BPF_CLASS(insn.code)) {
+    case BPF_ST:
+    case BPF_STX:
+      return true;
+    case BPF_LD:
+    case BPF_LDX:
+      return BPF_MODE(insn.code) == BPF_MEM;
+    default:
+      return false;
+  }
+}
+
+absl::Status InvalidInstruction(size_t pc, absl::string_view reason) {
+  return absl::InvalidArgumentError(
+      absl::StrCat("Instruction ", pc, ": ", reason));
+}
+
+// Returns the targets of the instruction at `pc`, checking they are in range.
+absl::Status GetSuccessors(absl::Span<const sock_filter> prog, size_t pc,
+                           std::vector<size_t>& successors) {
+  successors.clear();
+  const sock_filter& insn = prog[pc];
+  switch (BPF_CLASS(insn.code)) {
+    case BPF_RET:
+      return absl::OkStatus();
+    case BPF_JMP:
+      if (BPF_OP(insn.code) == BPF_JA) {
+        successors.push_back(pc + 1 + insn.k);
+      } else {
+        successors.push_back(pc + 1 + insn.jt);
+        successors.push_back(pc + 1 + insn.jf);
+      }
+      break;
+    default:
+      successors.push_back(pc + 1);
+      break;
+  }
+  for (size_t next : successors) {
+    if (next >= prog.size()) {
+      return InvalidInstruction(pc, "Jumps or falls past the end");
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<Evaluation> Evaluate(absl::Span<const sock_filter> prog,
+                                    const seccomp_data& data) {
+  uint32_t a = 0;
+  uint32_t x = 0;
+  uint32_t mem[BPF_MEMWORDS] = {};
+  size_t instructions = 0;
+  for (size_t pc = 0; pc < prog.size();) {
+    const sock_filter& insn = prog[pc];
+    ++instructions;
+    if (BPF_CLASS(insn.code) == BPF_RET) {
+      if (BPF_RVAL(insn.code) == BPF_A) {
+        return Evaluation{a, instructions};
+      }
+      return Evaluation{insn.k, instructions};
+    }
+    if (UsesScratchMemory(insn) && insn.k >= BPF_MEMWORDS) {
+      return InvalidInstruction(pc, "Scratch memory index out of range");
+    }
+    uint32_t src = BPF_SRC(insn.code) == BPF_X ? x : insn.k;
+    switch (insn.code) {
+      case BPF_LD | BPF_W | BPF_ABS:
+        if (insn.k % sizeof(uint32_t) != 0 ||
+            insn.k >= sizeof(seccomp_data)) {
+          return InvalidInstruction(pc, "Invalid seccomp_data offset");
+        }
+        memcpy(&a, reinterpret_cast<const char*>(&data) + insn.k, sizeof(a));
+        break;
+      case BPF_LD | BPF_W | BPF_LEN:
+        a = sizeof(seccomp_data);
+        break;
+      case BPF_LDX | BPF_W | BPF_LEN:
+        x = sizeof(seccomp_data);
+        break;
+      case BPF_LD | BPF_IMM:
+        a = insn.k;
+        break;
+      case BPF_LDX | BPF_IMM:
+        x = insn.k;
+        break;
+      case BPF_LD | BPF_MEM:
+        a = mem[insn.k];
+        break;
+      case BPF_LDX | BPF_MEM:
+        x = mem[insn.k];
+        break;
+      case BPF_ST:
+        mem[insn.k] = a;
+        break;
+      case BPF_STX:
+        mem[insn.k] = x;
+        break;
+      case BPF_MISC | BPF_TAX:
+        x = a;
+        break;
+      case BPF_MISC | BPF_TXA:
+        a = x;
+        break;
+      case BPF_ALU | BPF_NEG:
+        a = -a;
+        break;
+      case BPF_ALU | BPF_ADD | BPF_K:
+      case BPF_ALU | BPF_ADD | BPF_X:
+        a += src;
+        break;
+      case BPF_ALU | BPF_SUB | BPF_K:
+      case BPF_ALU | BPF_SUB | BPF_X:
+        a -= src;
+        break;
+      case BPF_ALU | BPF_MUL | BPF_K:
+      case BPF_ALU | BPF_MUL | BPF_X:
+        a *= src;
+        break;
+      case BPF_ALU | BPF_DIV | BPF_K:
+      case BPF_ALU | BPF_DIV | BPF_X:
+      case BPF_ALU | BPF_MOD | BPF_K:
+      case BPF_ALU | BPF_MOD | BPF_X:
+        if (src == 0) {
+          // The kernel terminates the program, which kills the process.
+          return Evaluation{SECCOMP_RET_KILL, instructions};
+        }
+        a = BPF_OP(insn.code) == BPF_DIV ? a / src : a % src;
+        break;
+      case BPF_ALU | BPF_AND | BPF_K:
+      case BPF_ALU | BPF_AND | BPF_X:
+        a &= src;
+        break;
+      case BPF_ALU | BPF_OR | BPF_K:
+      case BPF_ALU | BPF_OR | BPF_X:
+        a |= src;
+        break;
+      case BPF_ALU | BPF_XOR | BPF_K:
+      case BPF_ALU | BPF_XOR | BPF_X:
+        a ^= src;
+        break;
+      case BPF_ALU | BPF_LSH | BPF_K:
+      case BPF_ALU | BPF_LSH | BPF_X:
+        a = src < 32 ? a << src : 0;
+        break;
+      case BPF_ALU | BPF_RSH | BPF_K:
+      case BPF_ALU | BPF_RSH | BPF_X:
+        a = src < 32 ? a >> src : 0;
+        break;
+      case BPF_JMP | BPF_JA:
+      case BPF_JMP | BPF_JEQ | BPF_K:
+      case BPF_JMP | BPF_JEQ | BPF_X:
+      case BPF_JMP | BPF_JGT | BPF_K:
+      case BPF_JMP | BPF_JGT | BPF_X:
+      case BPF_JMP | BPF_JGE | BPF_K:
+      case BPF_JMP | BPF_JGE | BPF_X:
+      case BPF_JMP | BPF_JSET | BPF_K:
+      case BPF_JMP | BPF_JSET | BPF_X:
+        break;
+      default:
+        return InvalidInstruction(pc, "Unsupported instruction");
+    }
+    if (BPF_CLASS(insn.code) != BPF_JMP) {
+      ++pc;
+      continue;
+    }
+    bool taken;
+    switch (BPF_OP(insn.code)) {
+      case BPF_JA:
+        taken = true;
+        break;
+      case BPF_JEQ:
+        taken = a == src;
+        break;
+      case BPF_JGT:
+        taken = a > src;
+        break;
+      case BPF_JGE:
+        taken = a >= src;
+        break;
+      default:  // BPF_JSET
+        taken = (a & src) != 0;
+        break;
+    }
+    if (BPF_OP(insn.code) == BPF_JA) {
+      pc += 1 + insn.k;
+    } else {
+      pc += 1 + (taken ? insn.jt : insn.jf);
+    }
+  }
+  return absl::InvalidArgumentError("Program falls past its end");
+}
+
+absl::StatusOr<size_t> MaxPathLength(absl::Span<const sock_filter> prog) {
+  if (prog.empty()) {
+    return absl::InvalidArgumentError("Empty program");
+  }
+  // Jumps only go forward, so paths from later instructions are known first.
+  std::vector<size_t> length(prog.size());
+  std::vector<size_t> successors;
+  for (size_t pc = prog.size(); pc-- > 0;) {
+    if (absl::Status status = GetSuccessors(prog, pc, successors);
+        !status.ok()) {
+      return status;
+    }
+    size_t longest = 0;
+    for (size_t next : successors) {
+      longest = std::max(longest, length[next]);
+    }
+    length[pc] = longest + 1;
+  }
+  return length[0];
+}
+
+}  // namespace bpf
+}  // namespace sandbox2
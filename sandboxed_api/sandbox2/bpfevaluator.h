@@ -0,0 +1,50 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_SANDBOX2_BPFEVALUATOR_H_
+#define SANDBOXED_API_SANDBOX2_BPFEVALUATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+
+struct sock_filter;
+struct seccomp_data;
+
+namespace sandbox2 {
+namespace bpf {
+
+struct Evaluation {
+  // Value of the return instruction that was reached.
+  uint32_t action;
+  // Number of instructions run, including the return.
+  size_t instructions;
+};
+
+// Runs a seccomp program on `data` in userspace, like the kernel would. Fails
+// for programs the kernel would reject while running them, e.g. ones that
+// fall through their end.
+absl::StatusOr<Evaluation> Evaluate(absl::Span<const sock_filter> prog,
+                                    const seccomp_data& data);
+
+// Returns the number of instructions on the longest path through `prog`,
+// which bounds what any syscall costs.
+absl::StatusOr<size_t> MaxPathLength(absl::Span<const sock_filter> prog);
+
+}  // namespace bpf
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_BPFEVALUATOR_H_
@@ -0,0 +1,115 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/bpfevaluator.h"
+
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <syscall.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "sandboxed_api/sandbox2/util/bpf_helper.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace bpf {
+namespace {
+
+using ::sapi::StatusIs;
+using ::testing::Eq;
+
+seccomp_data SyscallData(int nr, uint64_t arg0 = 0) {
+  seccomp_data data = {};
+  data.nr = nr;
+  data.args[0] = arg0;
+  return data;
+}
+
+TEST(EvaluateTest, CountsInstructionsOnThePathTaken) {
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR,
+      JEQ32(__NR_read, ALLOW),
+      JEQ32(__NR_write, ALLOW),
+      ERRNO(1),
+  };
+  SAPI_ASSERT_OK_AND_ASSIGN(Evaluation read,
+                            Evaluate(prog, SyscallData(__NR_read)));
+  EXPECT_THAT(read.action, Eq(SECCOMP_RET_ALLOW));
+  EXPECT_THAT(read.instructions, Eq(3));
+  SAPI_ASSERT_OK_AND_ASSIGN(Evaluation write,
+                            Evaluate(prog, SyscallData(__NR_write)));
+  EXPECT_THAT(write.instructions, Eq(4));
+  SAPI_ASSERT_OK_AND_ASSIGN(Evaluation other,
+                            Evaluate(prog, SyscallData(__NR_close)));
+  EXPECT_THAT(other.action, Eq(SECCOMP_RET_ERRNO | 1));
+  EXPECT_THAT(other.instructions, Eq(4));
+}
+
+TEST(EvaluateTest, ChecksArguments) {
+  std::vector<sock_filter> prog = {
+      ARG_32(0),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xf0),
+      BPF_STMT(BPF_MISC | BPF_TAX, 0),
+      BPF_STMT(BPF_LD | BPF_IMM, 0x30),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 0, 1),
+      ALLOW,
+      DENY,
+  };
+  SAPI_ASSERT_OK_AND_ASSIGN(Evaluation match,
+                            Evaluate(prog, SyscallData(__NR_read, 0x34)));
+  EXPECT_THAT(match.action, Eq(SECCOMP_RET_ALLOW));
+  SAPI_ASSERT_OK_AND_ASSIGN(Evaluation mismatch,
+                            Evaluate(prog, SyscallData(__NR_read, 0x44)));
+  EXPECT_THAT(mismatch.action, Eq(SECCOMP_RET_KILL));
+}
+
+TEST(EvaluateTest, RejectsInvalidPrograms) {
+  EXPECT_THAT(Evaluate({LOAD_SYSCALL_NR}, SyscallData(__NR_read)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(Evaluate({BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 2), ALLOW},
+                       SyscallData(__NR_read)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(Evaluate({BPF_STMT(BPF_ST, BPF_MEMWORDS), ALLOW},
+                       SyscallData(__NR_read)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(MaxPathLengthTest, TakesTheLongestBranch) {
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR,
+      JEQ32(__NR_read, ALLOW),
+      JEQ32(__NR_write, ALLOW),
+      ERRNO(1),
+  };
+  SAPI_ASSERT_OK_AND_ASSIGN(size_t length, MaxPathLength(prog));
+  EXPECT_THAT(length, Eq(4));
+  SAPI_ASSERT_OK_AND_ASSIGN(length, MaxPathLength({ALLOW}));
+  EXPECT_THAT(length, Eq(1));
+}
+
+TEST(MaxPathLengthTest, RejectsJumpsPastTheEnd) {
+  EXPECT_THAT(MaxPathLength({}), StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(MaxPathLength({LOAD_SYSCALL_NR, JEQ32(__NR_read, ALLOW)}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+}  // namespace
+}  // namespace bpf
+}  // namespace sandbox2
@@ -0,0 +1,263 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/bpfoptimizer.h"
+
+#include <linux/filter.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace sandbox2 {
+namespace bpf {
+namespace {
+
+constexpr size_t kMaxShortJump = 255;
+
+// An instruction with absolute jump targets, so that instructions can be moved
+// around freely.
+struct Node {
+  sock_filter insn;
+  size_t jt = 0;  // Target of BPF_JA and of true conditions.
+  size_t jf = 0;  // Target of false conditions.
+  bool removed = false;
+};
+
+bool IsJump(const sock_filter& insn) { return BPF_CLASS(insn.code) == BPF_JMP; }
+
+bool IsUnconditionalJump(const sock_filter& insn) {
+  return IsJump(insn) && BPF_OP(insn.code) == BPF_JA;
+}
+
+bool IsReturn(const sock_filter& insn) { return BPF_CLASS(insn.code) == BPF_RET; }
+
+bool IsAbsoluteLoad(const sock_filter& insn) {
+  return insn.code == (BPF_LD | BPF_W | BPF_ABS);
+}
+
+// Whether the instruction may change the accumulator.
+bool WritesAccumulator(const sock_filter& insn) {
+  switch (BPF_CLASS(insn.code)) {
+    case BPF_LD:
+    case BPF_ALU:
+      return true;
+    case BPF_MISC:
+      return BPF_MISCOP(insn.code) == BPF_TXA;
+    default:
+      return false;
+  }
+}
+
+std::vector<Node> ToNodes(absl::Span<const sock_filter> prog) {
+  std::vector<Node> nodes(prog.size());
+  for (size_t i = 0; i < prog.size(); ++i) {
+    nodes[i].insn = prog[i];
+    if (IsUnconditionalJump(prog[i])) {
+      nodes[i].jt = i + 1 + prog[i].k;
+    } else if (IsJump(prog[i])) {
+      nodes[i].jt = i + 1 + prog[i].jt;
+      nodes[i].jf = i + 1 + prog[i].jf;
+    }
+  }
+  return nodes;
+}
+
+// Drops removed nodes and converts the targets back to relative offsets.
+// Removed nodes must be unreachable or not do anything, as jumps to them go to
+// the next remaining node instead.
+std::vector<sock_filter> FromNodes(const std::vector<Node>& nodes) {
+  // New index of every node, and of one past the end.
+  std::vector<size_t> index(nodes.size() + 1);
+  size_t next = 0;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    index[i] = next;
+    if (!nodes[i].removed) {
+      ++next;
+    }
+  }
+  index[nodes.size()] = next;
+  std::vector<sock_filter> prog;
+  prog.reserve(next);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].removed) {
+      continue;
+    }
+    sock_filter insn = nodes[i].insn;
+    const size_t from = index[i] + 1;
+    if (IsUnconditionalJump(insn)) {
+      insn.k = index[nodes[i].jt] - from;
+    } else if (IsJump(insn)) {
+      insn.jt = index[nodes[i].jt] - from;
+      insn.jf = index[nodes[i].jf] - from;
+    }
+    prog.push_back(insn);
+  }
+  return prog;
+}
+
+// Removes loads of the seccomp_data word that is already in the accumulator on
+// all paths to them.
+void RemoveRedundantLoads(std::vector<Node>& nodes) {
+  enum class State { kUnreached, kKnown, kUnknown };
+  struct Accumulator {
+    State state = State::kUnreached;
+    uint32_t offset = 0;  // Of the loaded word, if known.
+  };
+  auto merge = [](Accumulator& into, const Accumulator& from) {
+    if (into.state == State::kUnreached) {
+      into = from;
+    } else if (into.state != from.state || into.offset != from.offset) {
+      into.state = State::kUnknown;
+    }
+  };
+  std::vector<Accumulator> in(nodes.size() + 1);
+  if (!nodes.empty()) {
+    in[0].state = State::kUnknown;
+  }
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (in[i].state == State::kUnreached) {
+      continue;
+    }
+    const sock_filter& insn = nodes[i].insn;
+    Accumulator out = in[i];
+    if (IsAbsoluteLoad(insn)) {
+      if (in[i].state == State::kKnown && in[i].offset == insn.k) {
+        nodes[i].removed = true;
+      }
+      out = {State::kKnown, insn.k};
+    } else if (WritesAccumulator(insn)) {
+      out = {State::kUnknown, 0};
+    }
+    if (IsReturn(insn)) {
+      continue;
+    }
+    if (IsUnconditionalJump(insn)) {
+      merge(in[nodes[i].jt], out);
+    } else if (IsJump(insn)) {
+      merge(in[nodes[i].jt], out);
+      merge(in[nodes[i].jf], out);
+    } else {
+      merge(in[i + 1], out);
+    }
+  }
+}
+
+// Makes jumps go to the last of all equivalent instructions, i.e. ones that
+// behave the same from there on.
+void MergeEquivalentTargets(std::vector<Node>& nodes) {
+  // Equivalence class of every node and of one past the end.
+  std::vector<size_t> cls(nodes.size() + 1);
+  // Last node of each class.
+  std::vector<size_t> last;
+  std::map<std::tuple<uint16_t, uint32_t, size_t, size_t>, size_t> classes;
+  cls[nodes.size()] = 0;
+  last.push_back(nodes.size());
+  for (size_t i = nodes.size(); i-- > 0;) {
+    const Node& node = nodes[i];
+    if (IsUnconditionalJump(node.insn)) {
+      // Behaves like its target.
+      cls[i] = cls[node.jt];
+      continue;
+    }
+    std::tuple<uint16_t, uint32_t, size_t, size_t> key;
+    if (IsReturn(node.insn)) {
+      key = {node.insn.code, node.insn.k, 0, 0};
+    } else if (IsJump(node.insn)) {
+      key = {node.insn.code, node.insn.k, cls[node.jt], cls[node.jf]};
+    } else {
+      key = {node.insn.code, node.insn.k, cls[i + 1], 0};
+    }
+    auto [it, inserted] = classes.try_emplace(key, last.size());
+    if (inserted) {
+      last.push_back(i);
+    }
+    cls[i] = it->second;
+  }
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    Node& node = nodes[i];
+    if (!IsJump(node.insn)) {
+      continue;
+    }
+    const size_t jt = last[cls[node.jt]];
+    if (IsUnconditionalJump(node.insn)) {
+      node.jt = jt;
+      continue;
+    }
+    // Conditional jumps only reach that far.
+    if (jt - i - 1 <= kMaxShortJump) {
+      node.jt = jt;
+    }
+    const size_t jf = last[cls[node.jf]];
+    if (jf - i - 1 <= kMaxShortJump) {
+      node.jf = jf;
+    }
+  }
+}
+
+void RemoveUnreachable(std::vector<Node>& nodes) {
+  std::vector<bool> reachable(nodes.size() + 1);
+  if (!nodes.empty()) {
+    reachable[0] = true;
+  }
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    const Node& node = nodes[i];
+    if (!reachable[i] || IsReturn(node.insn)) {
+      continue;
+    }
+    if (IsUnconditionalJump(node.insn)) {
+      reachable[node.jt] = true;
+    } else if (IsJump(node.insn)) {
+      reachable[node.jt] = true;
+      reachable[node.jf] = true;
+    } else {
+      reachable[i + 1] = true;
+    }
+  }
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (!reachable[i]) {
+      nodes[i].removed = true;
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<sock_filter> Optimize(absl::Span<const sock_filter> prog) {
+  std::vector<sock_filter> result(prog.begin(), prog.end());
+  // Each round can enable more merges, but they quickly stop paying off.
+  constexpr int kMaxRounds = 3;
+  for (int round = 0; round < kMaxRounds; ++round) {
+    std::vector<Node> nodes = ToNodes(result);
+    RemoveRedundantLoads(nodes);
+    nodes = ToNodes(FromNodes(nodes));
+    MergeEquivalentTargets(nodes);
+    RemoveUnreachable(nodes);
+    std::vector<sock_filter> optimized = FromNodes(nodes);
+    const bool shrunk = optimized.size() < result.size();
+    result = std::move(optimized);
+    if (!shrunk) {
+      break;
+    }
+  }
+  return result;
+}
+
+}  // namespace bpf
+}  // namespace sandbox2
@@ -0,0 +1,40 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_SANDBOX2_BPFOPTIMIZER_H_
+#define SANDBOXED_API_SANDBOX2_BPFOPTIMIZER_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+
+struct sock_filter;
+
+namespace sandbox2 {
+namespace bpf {
+
+// Returns a program that behaves like `prog`, in fewer instructions where
+// possible. It
+//   - removes loads of the seccomp_data word the accumulator already holds,
+//   - makes jumps go to the last copy of identical instruction sequences, and
+//     straight to the target of a jump they lead to,
+//   - drops instructions that cannot be reached anymore.
+// `prog` may also be a part of a program. Jumps to one past its end, and
+// falling through it, continue with whatever follows.
+std::vector<sock_filter> Optimize(absl::Span<const sock_filter> prog);
+
+}  // namespace bpf
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_BPFOPTIMIZER_H_
@@ -0,0 +1,228 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/bpfoptimizer.h"
+
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sandboxed_api/sandbox2/util/bpf_helper.h"
+
+namespace sandbox2 {
+namespace bpf {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Le;
+using ::testing::Lt;
+using ::testing::SizeIs;
+
+// Return value for falling through the program.
+constexpr uint32_t kFallThrough = 0xffffffff;
+
+// Runs the subset of classic BPF used in policies.
+uint32_t Run(const std::vector<sock_filter>& prog, const seccomp_data& data) {
+  uint32_t a = 0;
+  uint32_t x = 0;
+  uint32_t mem[BPF_MEMWORDS] = {};
+  for (size_t pc = 0; pc < prog.size(); ++pc) {
+    const sock_filter& insn = prog[pc];
+    switch (insn.code) {
+      case BPF_LD | BPF_W | BPF_ABS:
+        memcpy(&a, reinterpret_cast<const char*>(&data) + insn.k, sizeof(a));
+        break;
+      case BPF_LD | BPF_MEM:
+        a = mem[insn.k];
+        break;
+      case BPF_ST:
+        mem[insn.k] = a;
+        break;
+      case BPF_MISC | BPF_TAX:
+        x = a;
+        break;
+      case BPF_ALU | BPF_AND | BPF_K:
+        a &= insn.k;
+        break;
+      case BPF_RET | BPF_K:
+        return insn.k;
+      case BPF_JMP | BPF_JA:
+        pc += insn.k;
+        break;
+      case BPF_JMP | BPF_JEQ | BPF_K:
+        pc += a == insn.k ? insn.jt : insn.jf;
+        break;
+      case BPF_JMP | BPF_JGE | BPF_K:
+        pc += a >= insn.k ? insn.jt : insn.jf;
+        break;
+      case BPF_JMP | BPF_JSET | BPF_K:
+        pc += (a & insn.k) ? insn.jt : insn.jf;
+        break;
+      case BPF_JMP | BPF_JEQ | BPF_X:
+        pc += a == x ? insn.jt : insn.jf;
+        break;
+      default:
+        ADD_FAILURE() << "Unexpected instruction " << insn.code;
+        return 0;
+    }
+  }
+  return kFallThrough;
+}
+
+seccomp_data MakeData(int nr, uint64_t arg0, uint64_t arg1) {
+  seccomp_data data = {};
+  data.nr = nr;
+  data.args[0] = arg0;
+  data.args[1] = arg1;
+  return data;
+}
+
+void ExpectSameBehavior(const std::vector<sock_filter>& prog,
+                        const std::vector<sock_filter>& optimized) {
+  for (size_t pc = 0; pc < optimized.size(); ++pc) {
+    const sock_filter& insn = optimized[pc];
+    if (insn.code == (BPF_JMP | BPF_JA)) {
+      EXPECT_THAT(insn.k, Le(optimized.size() - pc - 1));
+    } else if (BPF_CLASS(insn.code) == BPF_JMP) {
+      EXPECT_THAT(std::max(insn.jt, insn.jf), Le(optimized.size() - pc - 1));
+    }
+  }
+  for (int nr = 0; nr < 8; ++nr) {
+    for (uint64_t arg0 = 0; arg0 < 4; ++arg0) {
+      for (uint64_t arg1 = 0; arg1 < 4; ++arg1) {
+        seccomp_data data = MakeData(nr, arg0, arg1);
+        EXPECT_THAT(Run(optimized, data), Eq(Run(prog, data)))
+            << "nr=" << nr << " arg0=" << arg0 << " arg1=" << arg1;
+      }
+    }
+  }
+}
+
+TEST(OptimizeTest, RemovesRedundantLoads) {
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR, SYSCALL(1, ALLOW), LOAD_SYSCALL_NR,
+      SYSCALL(2, ERRNO(1)), LOAD_SYSCALL_NR, KILL,
+  };
+  std::vector<sock_filter> optimized = Optimize(prog);
+  EXPECT_THAT(optimized, SizeIs(prog.size() - 2));
+  ExpectSameBehavior(prog, optimized);
+}
+
+TEST(OptimizeTest, KeepsLoadsAfterJoiningPaths) {
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR,
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, 1),
+      ARG_32(0),
+      // Reached with either the syscall number or arg 0 loaded.
+      LOAD_SYSCALL_NR,
+      SYSCALL(1, ALLOW),
+      KILL,
+  };
+  std::vector<sock_filter> optimized = Optimize(prog);
+  EXPECT_THAT(optimized, SizeIs(prog.size()));
+  ExpectSameBehavior(prog, optimized);
+}
+
+TEST(OptimizeTest, MergesIdenticalBodies) {
+  // Skips the body of 4 instructions for other syscalls.
+  constexpr sock_filter kSkipBody = BPF_STMT(BPF_JMP | BPF_JA, 4);
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR, JNE32(1, kSkipBody), ARG_32(0), JEQ32(1, ALLOW), KILL,
+      LOAD_SYSCALL_NR, JNE32(2, kSkipBody), ARG_32(0), JEQ32(1, ALLOW), KILL,
+      ERRNO(1),
+  };
+  std::vector<sock_filter> optimized = Optimize(prog);
+  EXPECT_THAT(optimized.size(), Lt(prog.size()));
+  ExpectSameBehavior(prog, optimized);
+}
+
+TEST(OptimizeTest, RemovesUnreachableCode) {
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR, SYSCALL(1, ALLOW), KILL, ERRNO(2), ERRNO(3),
+  };
+  std::vector<sock_filter> optimized = Optimize(prog);
+  EXPECT_THAT(optimized, SizeIs(prog.size() - 2));
+  ExpectSameBehavior(prog, optimized);
+}
+
+TEST(OptimizeTest, KeepsJumpsPastTheEnd) {
+  // A part of a policy that falls through for syscalls other than 1.
+  std::vector<sock_filter> prog = {
+      LOAD_SYSCALL_NR,
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 1, 0, 2),
+      ARG_32(0),
+      JEQ32(0, ALLOW),
+      LOAD_SYSCALL_NR,
+  };
+  std::vector<sock_filter> optimized = Optimize(prog);
+  ExpectSameBehavior(prog, optimized);
+}
+
+TEST(OptimizeTest, RandomProgramsBehaveTheSame) {
+  std::mt19937 rng(42);
+  const std::vector<sock_filter> statements = {
+      LOAD_SYSCALL_NR,
+      ARG_32(0),
+      ARG_32(1),
+      BPF_STMT(BPF_ST, 0),
+      BPF_STMT(BPF_LD | BPF_MEM, 0),
+      BPF_STMT(BPF_MISC | BPF_TAX, 0),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 1),
+      ALLOW,
+      KILL,
+      ERRNO(1),
+  };
+  for (int i = 0; i < 2000; ++i) {
+    const size_t size = 1 + rng() % 40;
+    std::vector<sock_filter> prog;
+    for (size_t pc = 0; pc < size; ++pc) {
+      const size_t left = size - pc;
+      switch (rng() % 4) {
+        case 0:
+          prog.push_back(BPF_STMT(BPF_JMP | BPF_JA,
+                                  static_cast<uint32_t>(rng() % left)));
+          break;
+        case 1: {
+          static constexpr uint16_t kConditions[] = {
+              BPF_JMP | BPF_JEQ | BPF_K, BPF_JMP | BPF_JGE | BPF_K,
+              BPF_JMP | BPF_JSET | BPF_K, BPF_JMP | BPF_JEQ | BPF_X};
+          prog.push_back(BPF_JUMP(kConditions[rng() % 4], rng() % 4,
+                                  static_cast<uint8_t>(rng() % left),
+                                  static_cast<uint8_t>(rng() % left)));
+          break;
+        }
+        default:
+          prog.push_back(statements[rng() % statements.size()]);
+          break;
+      }
+    }
+    std::vector<sock_filter> optimized = Optimize(prog);
+    EXPECT_THAT(optimized.size(), Le(prog.size()));
+    ExpectSameBehavior(prog, optimized);
+    if (testing::Test::HasFailure()) {
+      break;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace bpf
+}  // namespace sandbox2
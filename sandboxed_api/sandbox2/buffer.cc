@@ -14,54 +14,157 @@
 
 #include "sandboxed_api/sandbox2/buffer.h"
 
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "sandboxed_api/sandbox2/util.h"
+#include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
+namespace {
 
-// Creates a new Buffer that is backed by the specified file descriptor.
-absl::StatusOr<std::unique_ptr<Buffer>> Buffer::CreateFromFd(int fd) {
+namespace file = ::sapi::file;
+using ::sapi::file_util::fileops::FDCloser;
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#define MFD_HUGETLB 0x0004U
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+// Returns the size of the huge pages that MFD_HUGETLB uses without any of the
+// MFD_HUGE_* size flags.
+size_t GetDefaultHugePageSize() {
+  constexpr size_t kFallback = size_t{2} << 20;
+  std::string meminfo;
+  if (!file::GetContents("/proc/meminfo", &meminfo, file::Defaults()).ok()) {
+    return kFallback;
+  }
+  for (absl::string_view line : absl::StrSplit(meminfo, '\n')) {
+    size_t kib;
+    if (absl::ConsumePrefix(&line, "Hugepagesize:") &&
+        absl::ConsumeSuffix(&line, "kB") &&
+        absl::SimpleAtoi(absl::StripAsciiWhitespace(line), &kib)) {
+      return kib << 10;
+    }
+  }
+  return kFallback;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Buffer>> Buffer::Map(
+    int fd, size_t size, const BufferOptions& options) {
   // Using `new` to access a non-public constructor.
   auto buffer = absl::WrapUnique(new Buffer());
 
-  struct stat stat_buf;
-  if (fstat(fd, &stat_buf) != 0) {
-    return absl::ErrnoToStatus(errno, "Could not stat buffer fd");
-  }
-  size_t size = stat_buf.st_size;
   int prot = PROT_READ | PROT_WRITE;
   int flags = MAP_SHARED;
+  // Populating before the madvise() below would fault in small pages.
+  if (options.populate && !options.transparent_huge_pages) {
+    flags |= MAP_POPULATE;
+  }
   off_t offset = 0;
   buffer->buf_ =
       reinterpret_cast<uint8_t*>(mmap(nullptr, size, prot, flags, fd, offset));
   if (buffer->buf_ == MAP_FAILED) {
+    buffer->buf_ = nullptr;
     return absl::ErrnoToStatus(errno, "Could not map buffer fd");
   }
-  buffer->fd_ = fd;
   buffer->size_ = size;
+  if (options.transparent_huge_pages) {
+    // Only advisory, fails on kernels without THP support.
+    madvise(buffer->buf_, size, MADV_HUGEPAGE);
+    if (options.populate) {
+      // Needs Linux 5.14, otherwise the pages are faulted in on first access.
+      madvise(buffer->buf_, size, MADV_POPULATE_WRITE);
+    }
+  }
+  buffer->fd_ = fd;
   return std::move(buffer);  // GCC 7 needs the move (C++ DR #1579)
 }
 
+// Creates a new Buffer that is backed by the specified file descriptor.
+absl::StatusOr<std::unique_ptr<Buffer>> Buffer::CreateFromFd(int fd) {
+  struct stat stat_buf;
+  if (fstat(fd, &stat_buf) != 0) {
+    return absl::ErrnoToStatus(errno, "Could not stat buffer fd");
+  }
+  return Map(fd, stat_buf.st_size, BufferOptions());
+}
+
 // Creates a new Buffer of the specified size, backed by a temporary file that
 // will be immediately deleted.
-absl::StatusOr<std::unique_ptr<Buffer>> Buffer::CreateWithSize(size_t size) {
+absl::StatusOr<std::unique_ptr<Buffer>> Buffer::CreateWithSize(
+    size_t size, const BufferOptions& options) {
   int fd;
-  if (!util::CreateMemFd(&fd)) {
+  if (options.huge_pages) {
+    fd = util::Syscall(__NR_memfd_create,
+                       reinterpret_cast<uintptr_t>("buffer_file"),
+                       MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGETLB);
+    if (fd < 0) {
+      return absl::ErrnoToStatus(errno,
+                                 "Could not create huge page buffer file");
+    }
+  } else if (!util::CreateMemFd(&fd)) {
     return absl::InternalError("Could not create buffer temp file");
   }
+  FDCloser fd_closer(fd);
+  if (options.huge_pages) {
+    // The size of hugetlbfs files must be a multiple of the huge page size.
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) != 0) {
+      return absl::ErrnoToStatus(errno, "Could not stat buffer fd");
+    }
+    size_t huge_page_size = stat_buf.st_blksize;
+    size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+  }
   if (ftruncate(fd, size) != 0) {
     return absl::ErrnoToStatus(errno, "Could not extend buffer fd");
   }
-  return CreateFromFd(fd);
+  if (options.seal_size &&
+      fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+    return absl::ErrnoToStatus(errno, "Could not seal buffer fd");
+  }
+  absl::StatusOr<std::unique_ptr<Buffer>> buffer = Map(fd, size, options);
+  if (buffer.ok()) {
+    fd_closer.Release();
+  }
+  return buffer;
 }
 
 Buffer::~Buffer() {
@@ -73,4 +176,66 @@ Buffer::~Buffer() {
   }
 }
 
+namespace {
+
+BufferOptions WithSealedSize(BufferOptions options) {
+  options.seal_size = true;
+  return options;
+}
+
+}  // namespace
+
+BufferPool::BufferPool(BufferOptions options, size_t max_cached_bytes)
+    : options_(WithSealedSize(options)),
+      max_cached_bytes_(max_cached_bytes),
+      min_size_(options.huge_pages ? GetDefaultHugePageSize()
+                                   : static_cast<size_t>(getpagesize())) {}
+
+size_t BufferPool::SizeClass(size_t size) const {
+  return absl::bit_ceil(std::max(size, min_size_));
+}
+
+absl::StatusOr<std::unique_ptr<Buffer>> BufferPool::Acquire(size_t size) {
+  if (size > std::numeric_limits<size_t>::max() / 2 + 1) {
+    return absl::InvalidArgumentError("Buffer size too large");
+  }
+  size_t size_class = SizeClass(size);
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = free_.find(size_class);
+    if (it != free_.end() && !it->second.empty()) {
+      std::unique_ptr<Buffer> buffer = std::move(it->second.back());
+      it->second.pop_back();
+      cached_bytes_ -= size_class;
+      return std::move(buffer);  // GCC 7 needs the move (C++ DR #1579)
+    }
+  }
+  return Buffer::CreateWithSize(size_class, options_);
+}
+
+void BufferPool::Release(std::unique_ptr<Buffer> buffer) {
+  if (buffer == nullptr || SizeClass(buffer->size()) != buffer->size()) {
+    return;
+  }
+  size_t size = buffer->size();
+  // Buffers not created by the pool may have been resized by a sandboxee, the
+  // next user would get a SIGBUS accessing them.
+  struct stat stat_buf;
+  if (fstat(buffer->fd(), &stat_buf) != 0 ||
+      static_cast<size_t>(stat_buf.st_size) != size) {
+    return;
+  }
+  absl::MutexLock lock(&mutex_);
+  if (cached_bytes_ + size > max_cached_bytes_) {
+    return;
+  }
+  cached_bytes_ += size;
+  free_[size].push_back(std::move(buffer));
+}
+
+size_t BufferPool::cached_bytes() const {
+  absl::MutexLock lock(&mutex_);
+  return cached_bytes_;
+}
+
 }  // namespace sandbox2
@@ -18,11 +18,33 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 
 namespace sandbox2 {
 
+// How Buffer::CreateWithSize() and BufferPool allocate and map buffers.
+struct BufferOptions {
+  // Backs the buffer with explicit huge pages (MFD_HUGETLB), rounding its size
+  // up to the default huge page size. Fails unless the system has enough of
+  // them reserved (see /proc/sys/vm/nr_hugepages).
+  bool huge_pages = false;
+  // Asks for transparent huge pages (MADV_HUGEPAGE). Only has an effect if
+  // /sys/kernel/mm/transparent_hugepage/shmem_enabled allows it.
+  bool transparent_huge_pages = false;
+  // Pre-faults the whole mapping (MAP_POPULATE) instead of page by page on
+  // first access.
+  bool populate = false;
+  // Seals the size of the buffer (F_SEAL_SHRINK, F_SEAL_GROW), so that the
+  // sandboxee cannot truncate it under the executor, which would then get a
+  // SIGBUS when accessing it.
+  bool seal_size = false;
+};
+
 // Buffer provides a way for executor and sandboxee to share data.
 // It is useful to share large buffers instead of communicating and copying.
 // The executor must distrust the content of this buffer, like everything
@@ -41,7 +63,8 @@ class Buffer final {
 
   // Creates a new Buffer of the specified size, backed by a temporary file that
   // will be immediately deleted.
-  static absl::StatusOr<std::unique_ptr<Buffer>> CreateWithSize(size_t size);
+  static absl::StatusOr<std::unique_ptr<Buffer>> CreateWithSize(
+      size_t size, const BufferOptions& options = BufferOptions());
 
   // Returns a pointer to the buffer, which is read/write.
   uint8_t* data() const { return buf_; }
@@ -55,11 +78,56 @@ class Buffer final {
  private:
   Buffer() = default;
 
+  // Maps size bytes of fd, taking ownership of it on success.
+  static absl::StatusOr<std::unique_ptr<Buffer>> Map(
+      int fd, size_t size, const BufferOptions& options);
+
   uint8_t* buf_ = nullptr;
   int fd_ = -1;
   size_t size_ = 0;
 };
 
+// Recycles buffers by size class (powers of two), which saves creating,
+// sizing, mapping and faulting in a new memfd for each request.
+//
+// Recycled buffers keep their contents. Only release a buffer once no
+// sandboxee has it mapped anymore, as it could otherwise still read and
+// modify the data of the next user. The size of the buffers is always sealed
+// (see BufferOptions::seal_size), and buffers whose size changed are not
+// recycled. This class is thread-safe.
+class BufferPool final {
+ public:
+  // Keeps at most max_cached_bytes of released buffers around.
+  explicit BufferPool(BufferOptions options = BufferOptions(),
+                      size_t max_cached_bytes = size_t{256} << 20);
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  // Returns a buffer of at least the given size, which is rounded up to its
+  // size class.
+  absl::StatusOr<std::unique_ptr<Buffer>> Acquire(size_t size);
+
+  // Returns a buffer acquired from this pool, or frees it if the pool is full.
+  void Release(std::unique_ptr<Buffer> buffer);
+
+  // Gets the total size of the released buffers waiting for reuse.
+  size_t cached_bytes() const;
+
+ private:
+  size_t SizeClass(size_t size) const;
+
+  const BufferOptions options_;
+  const size_t max_cached_bytes_;
+  // Smallest size class, the page size or the huge page size.
+  const size_t min_size_;
+
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<size_t, std::vector<std::unique_ptr<Buffer>>> free_
+      ABSL_GUARDED_BY(mutex_);
+  size_t cached_bytes_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
 }  // namespace sandbox2
 
 #endif  // SANDBOXED_API_SANDBOX2_BUFFER_H_
@@ -42,6 +42,7 @@ namespace {
 using ::sapi::CreateDefaultPermissiveTestPolicy;
 using ::sapi::GetTestSourcePath;
 using ::testing::Eq;
+using ::testing::Ge;
 using ::testing::IsTrue;
 using ::testing::Ne;
 
@@ -61,6 +62,76 @@ TEST(BufferTest, TestImplementation) {
   }
 }
 
+TEST(BufferTest, CreateWithOptions) {
+  constexpr int kSize = 1 << 20;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      auto buffer,
+      Buffer::CreateWithSize(kSize, {.transparent_huge_pages = true,
+                                     .populate = true,
+                                     .seal_size = true}));
+  EXPECT_THAT(buffer->size(), Eq(kSize));
+  buffer->data()[kSize - 1] = 'X';
+  EXPECT_THAT(ftruncate(buffer->fd(), 0), Eq(-1));
+  EXPECT_THAT(errno, Eq(EPERM));
+}
+
+TEST(BufferTest, CreateWithHugePages) {
+  auto buffer = Buffer::CreateWithSize(1, {.huge_pages = true});
+  if (!buffer.ok()) {
+    GTEST_SKIP() << "No huge pages available: " << buffer.status();
+  }
+  EXPECT_THAT((*buffer)->size(), Ge(getpagesize()));
+  (*buffer)->data()[(*buffer)->size() - 1] = 'X';
+}
+
+TEST(BufferPoolTest, RecyclesBuffers) {
+  const size_t page_size = getpagesize();
+  BufferPool pool;
+  SAPI_ASSERT_OK_AND_ASSIGN(auto buffer, pool.Acquire(page_size - 1));
+  EXPECT_THAT(buffer->size(), Eq(page_size));
+  Buffer* raw_buffer = buffer.get();
+  pool.Release(std::move(buffer));
+  EXPECT_THAT(pool.cached_bytes(), Eq(page_size));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto larger, pool.Acquire(page_size + 1));
+  EXPECT_THAT(larger->size(), Eq(2 * page_size));
+  SAPI_ASSERT_OK_AND_ASSIGN(auto recycled, pool.Acquire(page_size));
+  EXPECT_THAT(recycled.get(), Eq(raw_buffer));
+  EXPECT_THAT(pool.cached_bytes(), Eq(0));
+}
+
+TEST(BufferPoolTest, LimitsCachedBytes) {
+  const size_t page_size = getpagesize();
+  BufferPool pool(BufferOptions(), /*max_cached_bytes=*/2 * page_size);
+  SAPI_ASSERT_OK_AND_ASSIGN(auto first, pool.Acquire(2 * page_size));
+  SAPI_ASSERT_OK_AND_ASSIGN(auto second, pool.Acquire(2 * page_size));
+  pool.Release(std::move(first));
+  pool.Release(std::move(second));
+  EXPECT_THAT(pool.cached_bytes(), Eq(2 * page_size));
+
+  // Not from a pool, as not of a size class.
+  SAPI_ASSERT_OK_AND_ASSIGN(auto other, Buffer::CreateWithSize(page_size + 1));
+  pool.Release(std::move(other));
+  EXPECT_THAT(pool.cached_bytes(), Eq(2 * page_size));
+}
+
+TEST(BufferPoolTest, DropsResizedBuffers) {
+  const size_t page_size = getpagesize();
+  BufferPool pool;
+  // The pool's own buffers cannot be truncated.
+  SAPI_ASSERT_OK_AND_ASSIGN(auto pooled, pool.Acquire(page_size));
+  EXPECT_THAT(ftruncate(pooled->fd(), 0), Eq(-1));
+  EXPECT_THAT(errno, Eq(EPERM));
+  pool.Release(std::move(pooled));
+  EXPECT_THAT(pool.cached_bytes(), Eq(page_size));
+
+  // Other buffers of a size class are not recycled if truncated.
+  SAPI_ASSERT_OK_AND_ASSIGN(auto other, Buffer::CreateWithSize(page_size));
+  ASSERT_THAT(ftruncate(other->fd(), 0), Eq(0));
+  pool.Release(std::move(other));
+  EXPECT_THAT(pool.cached_bytes(), Eq(page_size));
+}
+
 // Test sharing of buffer between executor/sandboxee using dup/MapFd.
 TEST(BufferTest, TestWithSandboxeeMapFd) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/buffer");
@@ -0,0 +1,137 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Turns a sandbox2::MountTree into a prebuilt root for
+// Mounts::SetPrebuiltRoot(), optionally packed into a filesystem image.
+//
+// Example usage:
+//   build_root_image
+//     --mount_tree=mounts.textproto
+//     --output_dir=/tmp/root
+//     --image=/tmp/root.erofs
+//
+// The mount tree is a MountTree text proto, e.g. one written from
+// Mounts::GetMountTree(). The mounts that cannot be part of the image are
+// printed as a MountTree text proto. An image is packed with mkfs.erofs or
+// mksquashfs, which must be in PATH, and has to be mounted by the system, e.g.
+//   mount -o loop,ro /tmp/root.erofs /srv/sandbox-root
+// Sandboxes then use the mount point as their prebuilt root, sharing its page
+// cache.
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/globals.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/sandbox2/mount_tree.pb.h"
+#include "sandboxed_api/sandbox2/mounts.h"
+#include "sandboxed_api/sandbox2/util.h"
+#include "sandboxed_api/util/status_macros.h"
+
+ABSL_FLAG(std::string, mount_tree, "",
+          "MountTree text proto describing the contents of the root");
+ABSL_FLAG(std::string, output_dir, "",
+          "Directory to create the root in");
+ABSL_FLAG(std::string, image, "",
+          "If set, the root is packed into this image file");
+ABSL_FLAG(std::string, image_type, "erofs",
+          "Type of the image, either erofs or squashfs");
+
+namespace {
+
+absl::StatusOr<sandbox2::MountTree> ReadMountTree(const std::string& path) {
+  std::ifstream input(path);
+  if (!input) {
+    return absl::NotFoundError(absl::StrCat("Cannot open ", path));
+  }
+  std::stringstream contents;
+  contents << input.rdbuf();
+  sandbox2::MountTree tree;
+  if (!google::protobuf::TextFormat::ParseFromString(contents.str(), &tree)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot parse mount tree in ", path));
+  }
+  return tree;
+}
+
+absl::Status PackImage(const std::string& dir, const std::string& image,
+                       const std::string& type) {
+  std::vector<std::string> argv;
+  if (type == "erofs") {
+    argv = {"mkfs.erofs", image, dir};
+  } else if (type == "squashfs") {
+    argv = {"mksquashfs", dir, image, "-noappend"};
+  } else {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unknown image type: ", type));
+  }
+  std::string output;
+  SAPI_ASSIGN_OR_RETURN(int exit_code,
+                        sandbox2::util::Communicate(argv, {}, &output));
+  if (exit_code != 0) {
+    return absl::InternalError(
+        absl::StrCat(argv[0], " failed with ", exit_code, ": ", output));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status BuildRootImage() {
+  const std::string dir = absl::GetFlag(FLAGS_output_dir);
+  if (absl::GetFlag(FLAGS_mount_tree).empty() || dir.empty()) {
+    return absl::InvalidArgumentError(
+        "--mount_tree and --output_dir are required");
+  }
+  SAPI_ASSIGN_OR_RETURN(sandbox2::MountTree tree,
+                        ReadMountTree(absl::GetFlag(FLAGS_mount_tree)));
+  SAPI_ASSIGN_OR_RETURN(sandbox2::Mounts remaining,
+                        sandbox2::Mounts(std::move(tree)).Materialize(dir));
+  if (const std::string image = absl::GetFlag(FLAGS_image); !image.empty()) {
+    SAPI_RETURN_IF_ERROR(
+        PackImage(dir, image, absl::GetFlag(FLAGS_image_type)));
+  }
+  std::string remaining_text;
+  google::protobuf::TextFormat::PrintToString(remaining.GetMountTree(),
+                                              &remaining_text);
+  std::cout << remaining_text;
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(
+      "Builds a prebuilt sandbox2 root from a mount tree");
+  absl::ParseCommandLine(argc, argv);
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+  absl::InitializeLog();
+
+  if (absl::Status status = BuildRootImage(); !status.ok()) {
+    LOG(ERROR) << status;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
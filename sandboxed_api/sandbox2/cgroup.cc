@@ -0,0 +1,264 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Implementation of the sandbox2::Cgroup class.
+
+#include "sandboxed_api/sandbox2/cgroup.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sandbox2 {
+namespace {
+
+namespace file = ::sapi::file;
+using ::sapi::file_util::fileops::FDCloser;
+
+// Writes to an existing control file. Unlike SetContents(), reports the error
+// of the write itself, which is where the kernel rejects invalid values.
+absl::Status WriteControl(const std::string& path, absl::string_view value) {
+  FDCloser fd(open(path.c_str(), O_WRONLY | O_CLOEXEC));
+  if (fd.get() == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  if (write(fd.get(), value.data(), value.size()) !=
+      static_cast<ssize_t>(value.size())) {
+    return absl::ErrnoToStatus(
+        errno, absl::StrCat("writing '", value, "' to ", path));
+  }
+  return absl::OkStatus();
+}
+
+// Reads a control file. Unlike GetContents(), accepts empty ones.
+absl::StatusOr<std::string> ReadControl(const std::string& path) {
+  FDCloser fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd.get() == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  std::string contents;
+  char buf[4096];
+  ssize_t n;
+  while ((n = TEMP_FAILURE_RETRY(read(fd.get(), buf, sizeof(buf)))) > 0) {
+    contents.append(buf, n);
+  }
+  if (n == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("reading ", path));
+  }
+  return contents;
+}
+
+// Enables the controllers for the children of parent, unless they already
+// are.
+absl::Status EnableControllers(const std::string& parent,
+                               const std::vector<absl::string_view>& needed) {
+  if (needed.empty()) {
+    return absl::OkStatus();
+  }
+  std::string subtree_control_path =
+      file::JoinPath(parent, "cgroup.subtree_control");
+  SAPI_ASSIGN_OR_RETURN(std::string enabled,
+                        ReadControl(subtree_control_path));
+  std::vector<absl::string_view> enabled_list =
+      absl::StrSplit(enabled, absl::ByAnyChar(" \n"), absl::SkipEmpty());
+  for (absl::string_view controller : needed) {
+    if (std::find(enabled_list.begin(), enabled_list.end(), controller) !=
+        enabled_list.end()) {
+      continue;
+    }
+    SAPI_RETURN_IF_ERROR(
+        WriteControl(subtree_control_path, absl::StrCat("+", controller)));
+  }
+  return absl::OkStatus();
+}
+
+// Reads "key value" lines into the matching fields.
+void ParseKeyValues(
+    absl::string_view contents,
+    std::initializer_list<std::pair<absl::string_view, uint64_t*>> fields) {
+  for (absl::string_view line : absl::StrSplit(contents, '\n')) {
+    std::pair<absl::string_view, absl::string_view> key_value =
+        absl::StrSplit(line, absl::MaxSplits(' ', 1));
+    for (const auto& [key, value] : fields) {
+      if (key_value.first == key &&
+          !absl::SimpleAtoi(key_value.second, value)) {
+        *value = 0;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Cgroup>> Cgroup::Create(
+    const CgroupLimits& limits) {
+  if (limits.parent.empty()) {
+    return absl::InvalidArgumentError("No parent cgroup given");
+  }
+  std::vector<std::pair<std::string, std::string>> controls;
+  std::vector<absl::string_view> controllers;
+  if (limits.memory_max || limits.memory_high) {
+    controllers.push_back("memory");
+  }
+  if (limits.memory_max) {
+    controls.push_back({"memory.max", absl::StrCat(*limits.memory_max)});
+  }
+  if (limits.memory_high) {
+    controls.push_back({"memory.high", absl::StrCat(*limits.memory_high)});
+  }
+  if (limits.cpu_quota || limits.cpu_weight) {
+    controllers.push_back("cpu");
+  }
+  if (limits.cpu_quota) {
+    controls.push_back(
+        {"cpu.max",
+         absl::StrCat(absl::ToInt64Microseconds(*limits.cpu_quota), " ",
+                      absl::ToInt64Microseconds(limits.cpu_period))});
+  }
+  if (limits.cpu_weight) {
+    controls.push_back({"cpu.weight", absl::StrCat(*limits.cpu_weight)});
+  }
+  if (limits.pids_max) {
+    controllers.push_back("pids");
+    controls.push_back({"pids.max", absl::StrCat(*limits.pids_max)});
+  }
+  if (!limits.io_max.empty()) {
+    controllers.push_back("io");
+  }
+  // The kernel only takes one device at a time.
+  for (const std::string& io_max : limits.io_max) {
+    controls.push_back({"io.max", io_max});
+  }
+  SAPI_RETURN_IF_ERROR(EnableControllers(limits.parent, controllers));
+
+  static std::atomic<uint64_t> next_id{0};
+  std::string path = file::JoinPath(
+      limits.parent, absl::StrCat("sandbox2-", getpid(), "-", next_id++));
+  if (mkdir(path.c_str(), 0755) != 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("mkdir(", path, ")"));
+  }
+  // Removes the cgroup again on errors.
+  std::unique_ptr<Cgroup> cgroup(new Cgroup(std::move(path)));
+  for (const auto& [name, value] : controls) {
+    SAPI_RETURN_IF_ERROR(
+        WriteControl(file::JoinPath(cgroup->path_, name), value));
+  }
+  return cgroup;
+}
+
+Cgroup::~Cgroup() {
+  if (absl::Status status = Destroy(); !status.ok()) {
+    LOG(ERROR) << "Removing cgroup: " << status;
+  }
+}
+
+absl::Status Cgroup::AddProcess(pid_t pid) {
+  return WriteControl(file::JoinPath(path_, "cgroup.procs"),
+                      absl::StrCat(pid));
+}
+
+absl::Status Cgroup::SetFrozen(bool frozen) {
+  return WriteControl(file::JoinPath(path_, "cgroup.freeze"),
+                      frozen ? "1" : "0");
+}
+
+absl::StatusOr<CgroupStats> Cgroup::ReadStats() const {
+  SAPI_ASSIGN_OR_RETURN(std::string cpu_stat,
+                        ReadControl(file::JoinPath(path_, "cpu.stat")));
+  // Only there with the memory controller enabled.
+  absl::StatusOr<std::string> memory_events =
+      ReadControl(file::JoinPath(path_, "memory.events"));
+  CgroupStats stats;
+  ParseStats(memory_events.ok() ? *memory_events : "", cpu_stat, &stats);
+  for (const auto& [name, value] :
+       {std::pair(absl::string_view("memory.current"), &stats.memory_current),
+        std::pair(absl::string_view("memory.peak"), &stats.memory_peak)}) {
+    absl::StatusOr<std::string> contents =
+        ReadControl(file::JoinPath(path_, name));
+    if (contents.ok() &&
+        !absl::SimpleAtoi(absl::StripAsciiWhitespace(*contents), value)) {
+      *value = 0;
+    }
+  }
+  return stats;
+}
+
+absl::Status Cgroup::Destroy() {
+  if (path_.empty()) {
+    return absl::OkStatus();
+  }
+  // Needs Linux 5.14. Without it, the sandbox already killed everything it
+  // knows about.
+  WriteControl(file::JoinPath(path_, "cgroup.kill"), "1").IgnoreError();
+  // Killed processes leave the cgroup asynchronously.
+  constexpr int kMaxTries = 100;
+  for (int i = 0; rmdir(path_.c_str()) != 0; ++i) {
+    if (errno != EBUSY || i == kMaxTries) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("rmdir(", path_, ")"));
+    }
+    absl::SleepFor(absl::Milliseconds(10));
+  }
+  path_.clear();
+  return absl::OkStatus();
+}
+
+void Cgroup::ParseStats(absl::string_view memory_events,
+                        absl::string_view cpu_stat, CgroupStats* stats) {
+  ParseKeyValues(memory_events,
+                 {{"low", &stats->memory_low_events},
+                  {"high", &stats->memory_high_events},
+                  {"max", &stats->memory_max_events},
+                  {"oom", &stats->memory_oom_events},
+                  {"oom_kill", &stats->memory_oom_kill_events}});
+  uint64_t usage_usec = 0;
+  uint64_t user_usec = 0;
+  uint64_t system_usec = 0;
+  uint64_t throttled_usec = 0;
+  ParseKeyValues(cpu_stat, {{"usage_usec", &usage_usec},
+                            {"user_usec", &user_usec},
+                            {"system_usec", &system_usec},
+                            {"nr_periods", &stats->cpu_periods},
+                            {"nr_throttled", &stats->cpu_throttled_periods},
+                            {"throttled_usec", &throttled_usec}});
+  stats->cpu_usage = absl::Microseconds(usage_usec);
+  stats->cpu_user = absl::Microseconds(user_usec);
+  stats->cpu_system = absl::Microseconds(system_usec);
+  stats->cpu_throttled = absl::Microseconds(throttled_usec);
+}
+
+}  // namespace sandbox2
@@ -0,0 +1,102 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The sandbox2::Cgroup class runs sandboxees in a cgroup (v2) of their own,
+// see Limits::set_cgroup().
+
+#ifndef SANDBOXED_API_SANDBOX2_CGROUP_H_
+#define SANDBOXED_API_SANDBOX2_CGROUP_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/limits.h"
+
+namespace sandbox2 {
+
+// Resource usage of a sandboxee's cgroup, from its memory.events,
+// memory.current, memory.peak and cpu.stat files. Values the kernel doesn't
+// provide are left at zero.
+struct CgroupStats {
+  // Number of times memory.low, memory.high and memory.max were reached.
+  uint64_t memory_low_events = 0;
+  uint64_t memory_high_events = 0;
+  uint64_t memory_max_events = 0;
+  // Number of times the OOM killer was invoked, and processes it killed.
+  uint64_t memory_oom_events = 0;
+  uint64_t memory_oom_kill_events = 0;
+  // Current and maximum memory usage in bytes, the latter needs Linux 5.19.
+  uint64_t memory_current = 0;
+  uint64_t memory_peak = 0;
+  absl::Duration cpu_usage = absl::ZeroDuration();
+  absl::Duration cpu_user = absl::ZeroDuration();
+  absl::Duration cpu_system = absl::ZeroDuration();
+  // Number of cpu.max periods, in how many of them the sandboxee was
+  // throttled, and for how long in total.
+  uint64_t cpu_periods = 0;
+  uint64_t cpu_throttled_periods = 0;
+  absl::Duration cpu_throttled = absl::ZeroDuration();
+};
+
+class Cgroup {
+ public:
+  // Creates a new cgroup below limits.parent, enables the controllers the
+  // limits need in the parent, and applies them.
+  static absl::StatusOr<std::unique_ptr<Cgroup>> Create(
+      const CgroupLimits& limits);
+
+  Cgroup(const Cgroup&) = delete;
+  Cgroup& operator=(const Cgroup&) = delete;
+
+  // Calls Destroy(), logging any error.
+  ~Cgroup();
+
+  // Moves a process into the cgroup. Processes and threads it creates
+  // afterwards are in the cgroup as well.
+  absl::Status AddProcess(pid_t pid);
+
+  // Freezes or thaws all processes in the cgroup through cgroup.freeze. Frozen
+  // processes don't run and cannot be killed by anything but SIGKILL. The
+  // kernel completes freezing asynchronously.
+  absl::Status SetFrozen(bool frozen);
+
+  absl::StatusOr<CgroupStats> ReadStats() const;
+
+  // Kills all processes left in the cgroup and removes it.
+  absl::Status Destroy();
+
+  const std::string& path() const { return path_; }
+
+  // Parses the contents of memory.events and cpu.stat into stats.
+  static void ParseStats(absl::string_view memory_events,
+                         absl::string_view cpu_stat, CgroupStats* stats);
+
+ private:
+  explicit Cgroup(std::string path) : path_(std::move(path)) {}
+
+  // Empty once destroyed.
+  std::string path_;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_CGROUP_H_
@@ -0,0 +1,142 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/cgroup.h"
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/limits.h"
+#include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+namespace file = ::sapi::file;
+using ::sapi::IsOk;
+using ::testing::Eq;
+using ::testing::Gt;
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+TEST(CgroupTest, ParsesStats) {
+  CgroupStats stats;
+  Cgroup::ParseStats("low 0\nhigh 3\nmax 2\noom 1\noom_kill 1\n",
+                     "usage_usec 1500\nuser_usec 1000\nsystem_usec 500\n"
+                     "nr_periods 10\nnr_throttled 4\nthrottled_usec 250\n",
+                     &stats);
+  EXPECT_THAT(stats.memory_low_events, Eq(0));
+  EXPECT_THAT(stats.memory_high_events, Eq(3));
+  EXPECT_THAT(stats.memory_max_events, Eq(2));
+  EXPECT_THAT(stats.memory_oom_events, Eq(1));
+  EXPECT_THAT(stats.memory_oom_kill_events, Eq(1));
+  EXPECT_THAT(stats.cpu_usage, Eq(absl::Microseconds(1500)));
+  EXPECT_THAT(stats.cpu_user, Eq(absl::Microseconds(1000)));
+  EXPECT_THAT(stats.cpu_system, Eq(absl::Microseconds(500)));
+  EXPECT_THAT(stats.cpu_periods, Eq(10));
+  EXPECT_THAT(stats.cpu_throttled_periods, Eq(4));
+  EXPECT_THAT(stats.cpu_throttled, Eq(absl::Microseconds(250)));
+}
+
+TEST(CgroupTest, RequiresParent) {
+  EXPECT_THAT(Cgroup::Create(CgroupLimits()).status(), Not(IsOk()));
+}
+
+// Returns the cgroup (v2) directory of this process, or an empty string.
+std::string GetOwnCgroup() {
+  std::string mount_point;
+  std::ifstream mounts("/proc/self/mounts");
+  for (std::string line; std::getline(mounts, line);) {
+    std::vector<absl::string_view> fields = absl::StrSplit(line, ' ');
+    if (fields.size() > 2 && fields[2] == "cgroup2") {
+      mount_point = std::string(fields[1]);
+      break;
+    }
+  }
+  std::string cgroups;
+  if (mount_point.empty() ||
+      !file::GetContents("/proc/self/cgroup", &cgroups, file::Defaults())
+           .ok()) {
+    return "";
+  }
+  for (absl::string_view line : absl::StrSplit(cgroups, '\n')) {
+    if (absl::ConsumePrefix(&line, "0::")) {
+      return file::JoinPath(mount_point, line);
+    }
+  }
+  return "";
+}
+
+TEST(CgroupTest, MovesProcessesIn) {
+  std::string parent =
+      file::JoinPath(GetOwnCgroup(), absl::StrCat("cgroup_test-", getpid()));
+  if (GetOwnCgroup().empty() || mkdir(parent.c_str(), 0755) != 0) {
+    GTEST_SKIP() << "No writable cgroup (v2) hierarchy";
+  }
+  {
+    CgroupLimits limits{.parent = parent};
+    absl::StatusOr<std::unique_ptr<Cgroup>> cgroup = Cgroup::Create(limits);
+    ASSERT_THAT(cgroup.status(), IsOk());
+    pid_t child = fork();
+    if (child == 0) {
+      pause();
+      _exit(0);
+    }
+    ASSERT_THAT(child, Gt(0));
+    ASSERT_THAT((*cgroup)->AddProcess(child), IsOk());
+    std::string procs;
+    ASSERT_THAT(file::GetContents(file::JoinPath((*cgroup)->path(),
+                                                 "cgroup.procs"),
+                                  &procs, file::Defaults()),
+                IsOk());
+    EXPECT_THAT(procs, HasSubstr(absl::StrCat(child)));
+    EXPECT_THAT((*cgroup)->ReadStats().status(), IsOk());
+
+    ASSERT_THAT((*cgroup)->SetFrozen(true), IsOk());
+    std::string freeze;
+    ASSERT_THAT(file::GetContents(file::JoinPath((*cgroup)->path(),
+                                                 "cgroup.freeze"),
+                                  &freeze, file::Defaults()),
+                IsOk());
+    EXPECT_THAT(freeze, Eq("1\n"));
+    EXPECT_THAT((*cgroup)->SetFrozen(false), IsOk());
+
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    std::string path = (*cgroup)->path();
+    EXPECT_THAT((*cgroup)->Destroy(), IsOk());
+    EXPECT_THAT(access(path.c_str(), F_OK), Eq(-1));
+  }
+  rmdir(parent.c_str());
+}
+
+}  // namespace
+}  // namespace sandbox2
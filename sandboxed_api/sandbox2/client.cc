@@ -18,11 +18,15 @@
 
 #include <fcntl.h>
 #include <linux/filter.h>
+#include <linux/mempolicy.h>
 #include <linux/seccomp.h>
+#include <sched.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cinttypes>
 #include <climits>
@@ -31,12 +35,16 @@
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <utility>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/base/macros.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
@@ -149,20 +157,64 @@ std::string Client::GetFdMapEnvVar() const {
 }
 
 void Client::PrepareEnvironment(std::vector<int>* preserve_fds) {
+  ReceiveSetup();
   SetUpIPC(preserve_fds);
   SetUpCwd();
 }
 
-void Client::EnableSandbox() {
-  ReceivePolicy();
-  ApplyPolicyAndBecomeTracee();
-}
+void Client::EnableSandbox() { ApplyPolicyAndBecomeTracee(); }
 
 void Client::SandboxMeHere() {
   PrepareEnvironment();
   EnableSandbox();
 }
 
+void Client::SandboxMeHere(absl::FunctionRef<void()> setup) {
+  PrepareEnvironment();
+  setup();
+  EnableSandbox();
+}
+
+void Client::ReceiveSetup() {
+  uint32_t num_of_fd_pairs;
+  SAPI_RAW_CHECK(comms_->RecvUint32(&num_of_fd_pairs),
+                 "receiving number of fd pairs");
+  SAPI_RAW_VLOG(1, "Will receive %d file descriptor pairs", num_of_fd_pairs);
+  requested_fds_.resize(num_of_fd_pairs);
+  fd_names_.resize(num_of_fd_pairs);
+  for (uint32_t i = 0; i < num_of_fd_pairs; ++i) {
+    SAPI_RAW_CHECK(comms_->RecvInt32(&requested_fds_[i]),
+                   "receiving requested fd");
+    SAPI_RAW_CHECK(comms_->RecvString(&fd_names_[i]), "receiving name string");
+  }
+  SAPI_RAW_CHECK(comms_->RecvString(&cwd_), "receiving working directory");
+  SAPI_RAW_CHECK(comms_->RecvBytes(&policy_), "receiving policy");
+  std::vector<uint8_t> limits;
+  SAPI_RAW_CHECK(comms_->RecvBytes(&limits), "receiving limits");
+  SAPI_RAW_CHECK(limits.size() % sizeof(ResourceLimit) == 0,
+                 "invalid size of limits");
+  limits_.resize(limits.size() / sizeof(ResourceLimit));
+  if (!limits.empty()) {
+    memcpy(limits_.data(), limits.data(), limits.size());
+  }
+  std::vector<uint8_t> placement;
+  SAPI_RAW_CHECK(comms_->RecvBytes(&placement), "receiving placement");
+  SAPI_RAW_CHECK(placement.size() == sizeof(placement_),
+                 "invalid size of placement");
+  memcpy(&placement_, placement.data(), sizeof(placement_));
+
+  // The file descriptors are sent in batches after everything else.
+  received_fds_.reserve(num_of_fd_pairs);
+  while (received_fds_.size() < num_of_fd_pairs) {
+    std::vector<int> batch;
+    SAPI_RAW_CHECK(comms_->RecvFDs(&batch), "receiving current fds");
+    SAPI_RAW_CHECK(!batch.empty(), "received an empty batch of fds");
+    received_fds_.insert(received_fds_.end(), batch.begin(), batch.end());
+  }
+  SAPI_RAW_CHECK(received_fds_.size() == num_of_fd_pairs,
+                 "received too many fds");
+}
+
 void Client::SetUpCwd() {
   {
     // Get the current working directory to check if we are in a mount
@@ -186,9 +238,8 @@ void Client::SetUpCwd() {
     }
   }
 
-  // Receive the user-supplied current working directory and change into it.
-  std::string cwd;
-  SAPI_RAW_CHECK(comms_->RecvString(&cwd), "receiving working directory");
+  // Change into the user-supplied current working directory.
+  std::string cwd = std::move(cwd_);
   if (!cwd.empty()) {
     // On the other hand this chdir can fail without a sandbox escape. It will
     // probably not have the intended behavior though.
@@ -203,12 +254,14 @@ void Client::SetUpCwd() {
 }
 
 void Client::SetUpIPC(std::vector<int>* preserve_fds) {
-  uint32_t num_of_fd_pairs;
-  SAPI_RAW_CHECK(comms_->RecvUint32(&num_of_fd_pairs),
-                 "receiving number of fd pairs");
   SAPI_RAW_CHECK(fd_map_.empty(), "fd map not empty");
-
-  SAPI_RAW_VLOG(1, "Will receive %d file descriptor pairs", num_of_fd_pairs);
+  const std::vector<int32_t> requested_fds = std::move(requested_fds_);
+  const std::vector<std::string> names = std::move(fd_names_);
+  std::vector<int> fds = std::move(received_fds_);
+  const uint32_t num_of_fd_pairs = requested_fds.size();
+  if (num_of_fd_pairs == 0) {
+    return;
+  }
 
   absl::flat_hash_map<int, int*> preserve_fds_map;
   if (preserve_fds) {
@@ -217,14 +270,25 @@ void Client::SetUpIPC(std::vector<int>* preserve_fds) {
     }
   }
 
+  // As all fds are received upfront, one of them might occupy a number which
+  // another entry is about to be cloned onto. Move those out of the way.
+  absl::flat_hash_set<int> requested_fd_set(requested_fds.begin(),
+                                            requested_fds.end());
+  const int max_requested_fd =
+      *std::max_element(requested_fds.begin(), requested_fds.end());
   for (uint32_t i = 0; i < num_of_fd_pairs; ++i) {
-    int32_t requested_fd;
-    int32_t fd;
-    std::string name;
+    if (fds[i] != requested_fds[i] && requested_fd_set.contains(fds[i])) {
+      int new_fd = fcntl(fds[i], F_DUPFD, max_requested_fd + 1);
+      SAPI_RAW_PCHECK(new_fd != -1, "Failed to move received fd=%d", fds[i]);
+      close(fds[i]);
+      fds[i] = new_fd;
+    }
+  }
 
-    SAPI_RAW_CHECK(comms_->RecvInt32(&requested_fd), "receiving requested fd");
-    SAPI_RAW_CHECK(comms_->RecvFD(&fd), "receiving current fd");
-    SAPI_RAW_CHECK(comms_->RecvString(&name), "receiving name string");
+  for (uint32_t i = 0; i < num_of_fd_pairs; ++i) {
+    const int32_t requested_fd = requested_fds[i];
+    int32_t fd = fds[i];
+    const std::string& name = names[i];
 
     if (auto it = preserve_fds_map.find(requested_fd);
         it != preserve_fds_map.end()) {
@@ -275,10 +339,82 @@ void Client::SetUpIPC(std::vector<int>* preserve_fds) {
   }
 }
 
-void Client::ReceivePolicy() {
-  std::vector<uint8_t> bytes;
-  SAPI_RAW_CHECK(comms_->RecvBytes(&bytes), "receive bytes");
-  policy_ = std::move(bytes);
+bool Client::ApplyLimits() {
+#if defined(__ANDROID__)
+  using RlimitResource = int;
+#else
+  using RlimitResource = __rlimit_resource;
+#endif
+
+  for (const ResourceLimit& limit : limits_) {
+    const auto resource = static_cast<RlimitResource>(limit.resource);
+    rlimit64 curr_limit;
+    if (getrlimit64(resource, &curr_limit) == -1) {
+      SAPI_RAW_PLOG(ERROR, "getrlimit64(%d)", limit.resource);
+    } else if (limit.cur > curr_limit.rlim_max) {
+      // In such case, don't update the limits, as it will fail. Just stick to
+      // the current ones (which are already lower than intended).
+      SAPI_RAW_LOG(ERROR,
+                   "rlimit %d: new.current > current.max (%" PRIu64
+                   " > %" PRIu64 "), skipping",
+                   limit.resource, limit.cur,
+                   static_cast<uint64_t>(curr_limit.rlim_max));
+      continue;
+    }
+    const rlimit64 rlim = {.rlim_cur = limit.cur, .rlim_max = limit.max};
+    if (setrlimit64(resource, &rlim) == -1) {
+      SAPI_RAW_PLOG(ERROR, "setrlimit64(%d, %" PRIu64 ")", limit.resource,
+                    limit.cur);
+      return false;
+    }
+  }
+  return ApplyPlacement();
+}
+
+bool Client::ApplyPlacement() {
+  // All of these apply to the calling thread, and are inherited by threads
+  // and processes started later.
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  for (int cpu = 0; cpu < PlacementSetup::kMaxCpus && cpu < CPU_SETSIZE;
+       ++cpu) {
+    if (placement_.cpus[cpu / 64] & (uint64_t{1} << (cpu % 64))) {
+      CPU_SET(cpu, &cpus);
+    }
+  }
+  if (CPU_COUNT(&cpus) > 0 && sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+    SAPI_RAW_PLOG(ERROR, "sched_setaffinity()");
+    return false;
+  }
+  if (placement_.numa_node >= 0) {
+    constexpr int kMaxNodes = 1024;
+    constexpr int kBitsPerWord = sizeof(unsigned long) * 8;  // NOLINT
+    unsigned long nodes[kMaxNodes / kBitsPerWord] = {};      // NOLINT
+    if (placement_.numa_node >= kMaxNodes) {
+      SAPI_RAW_LOG(ERROR, "NUMA node %d out of range", placement_.numa_node);
+      return false;
+    }
+    nodes[placement_.numa_node / kBitsPerWord] |=
+        1UL << (placement_.numa_node % kBitsPerWord);
+    const int mode = placement_.strict_numa ? MPOL_BIND : MPOL_PREFERRED;
+    if (syscall(__NR_set_mempolicy, mode, nodes, kMaxNodes + 1) == -1) {
+      SAPI_RAW_PLOG(ERROR, "set_mempolicy(node %d)", placement_.numa_node);
+      return false;
+    }
+  }
+  if (placement_.sched_policy >= 0) {
+    const sched_param param = {.sched_priority = 0};
+    if (sched_setscheduler(0, placement_.sched_policy, &param) == -1) {
+      SAPI_RAW_PLOG(ERROR, "sched_setscheduler(%d)", placement_.sched_policy);
+      return false;
+    }
+  }
+  if (placement_.has_nice &&
+      setpriority(PRIO_PROCESS, 0, placement_.nice) == -1) {
+    SAPI_RAW_PLOG(ERROR, "setpriority(%d)", placement_.nice);
+    return false;
+  }
+  return true;
 }
 
 void Client::ApplyPolicyAndBecomeTracee() {
@@ -318,11 +454,15 @@ void Client::ApplyPolicyAndBecomeTracee() {
                 " entries (%" PRIuPTR " bytes)",
                 syscall(__NR_gettid), prog.len, policy_.size());
 
-  // Signal executor we are ready to have limits applied on us and be ptraced.
-  // We want limits at the last moment to avoid triggering them too early and we
-  // want ptrace at the last moment to avoid synchronization deadlocks.
-  SAPI_RAW_CHECK(comms_->SendUint32(kClient2SandboxReady),
-                 "receiving ready signal from executor");
+  // Apply limits and signal executor we are ready to be ptraced. We want
+  // limits at the last moment to avoid triggering them too early and we want
+  // ptrace at the last moment to avoid synchronization deadlocks.
+  const bool limits_applied = ApplyLimits();
+  SAPI_RAW_CHECK(comms_->SendUint32(limits_applied
+                                        ? kClient2SandboxReady
+                                        : kClient2SandboxLimitsFailed),
+                 "sending ready signal to executor");
+  SAPI_RAW_CHECK(limits_applied, "applying resource limits");
   uint32_t ret;  // wait for confirmation
   SAPI_RAW_CHECK(comms_->RecvUint32(&ret),
                  "receving confirmation from executor");
@@ -348,10 +488,17 @@ bool Client::HasMappedFD(const std::string& name) {
   return fd_map_.find(name) != fd_map_.end();
 }
 
-void Client::SendLogsToSupervisor() {
+void Client::SendLogsToSupervisor(bool batched) {
   // This LogSink will register itself and send all logs to the executor until
   // the object is destroyed.
-  logsink_ = std::make_unique<LogSink>(GetMappedFD(LogSink::kLogFDName));
+  logsink_ =
+      std::make_unique<LogSink>(GetMappedFD(LogSink::kLogFDName), batched);
+}
+
+void Client::FlushLogs() {
+  if (logsink_) {
+    logsink_->Flush();
+  }
 }
 
 NetworkProxyClient* Client::GetNetworkProxyClient() {
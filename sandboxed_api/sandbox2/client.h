@@ -21,8 +21,10 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/logsink.h"
 #include "sandboxed_api/sandbox2/network_proxy/client.h"
@@ -37,6 +39,39 @@ class Client {
   static constexpr uint32_t kSandbox2ClientDone = 0x0A0B0C02;
   // Sandboxe should setup seccomp_unotify and send back the FD.
   static constexpr uint32_t kSandbox2ClientUnotify = 0x0A0B0C03;
+  // Sent instead of kClient2SandboxReady if the resource limits could not be
+  // applied.
+  static constexpr uint32_t kClient2SandboxLimitsFailed = 0x0A0B0C04;
+
+  // A resource limit that the client applies to itself right before enabling
+  // the sandbox. Sent by the monitor along with the rest of the setup.
+  // Sent as raw bytes, so there is no implicit padding which could leak
+  // uninitialized memory of the monitor.
+  struct ResourceLimit {
+    int32_t resource;
+    int32_t padding = 0;
+    uint64_t cur;
+    uint64_t max;
+  };
+  static_assert(sizeof(ResourceLimit) == 24);
+
+  // The Placement that the client applies to itself along with the resource
+  // limits, in a fixed layout without implicit padding.
+  struct PlacementSetup {
+    static constexpr int kMaxCpus = 1024;
+    // Bit i allows CPU i. If no bit is set, the affinity is left unchanged.
+    uint64_t cpus[kMaxCpus / 64];
+    // -1 leaves the memory policy unchanged.
+    int32_t numa_node;
+    int32_t strict_numa;
+    // -1 leaves the scheduling policy unchanged.
+    int32_t sched_policy;
+    int32_t has_nice;
+    int32_t nice;
+    int32_t padding = 0;
+  };
+  static_assert(sizeof(PlacementSetup) ==
+                PlacementSetup::kMaxCpus / 8 + 6 * sizeof(int32_t));
 
   explicit Client(Comms* comms);
 
@@ -48,13 +83,23 @@ class Client {
   // initialization first and then enable sandboxing for actual processing.
   void SandboxMeHere();
 
+  // Like SandboxMeHere(), but runs `setup` right before the policy is applied,
+  // once the mapped file descriptors were received. Lets the sandboxee set up
+  // resources on them that its policy doesn't allow creating, e.g.
+  // RestrictedIoUring instances.
+  void SandboxMeHere(absl::FunctionRef<void()> setup);
+
   // Returns the file descriptor that was mapped to the sandboxee using
   // IPC::ReceiveFd(name).
   int GetMappedFD(const std::string& name);
   bool HasMappedFD(const std::string& name);
 
-  // Registers a LogSink that forwards all logs to the supervisor.
-  void SendLogsToSupervisor();
+  // Registers a LogSink that forwards all logs to the supervisor. If batched,
+  // less severe messages may be held back, see LogSink.
+  void SendLogsToSupervisor(bool batched = false);
+
+  // Sends the log messages held back by a batched LogSink.
+  void FlushLogs();
 
   // Returns the network proxy client and starts it if this function is called
   // for the first time.
@@ -76,6 +121,15 @@ class Client {
   // Seccomp-bpf policy received from the monitor.
   std::vector<uint8_t> policy_;
 
+  // The rest of the setup received from the monitor, until it is used by
+  // SetUpIPC(), SetUpCwd() and ApplyPolicyAndBecomeTracee().
+  std::vector<int32_t> requested_fds_;
+  std::vector<std::string> fd_names_;
+  std::vector<int> received_fds_;
+  std::string cwd_;
+  std::vector<ResourceLimit> limits_;
+  PlacementSetup placement_ = {.numa_node = -1, .sched_policy = -1};
+
   // LogSink that forwards all log messages to the supervisor.
   std::unique_ptr<LogSink> logsink_;
 
@@ -90,6 +144,12 @@ class Client {
 
   std::string GetFdMapEnvVar() const;
 
+  // Receives everything needed to set up the sandboxee from the monitor: the fd
+  // mappings, the working directory, the policy and the resource limits,
+  // followed by the mapped fds. The monitor sends all of it at once, without
+  // waiting for replies.
+  void ReceiveSetup();
+
   // Sets up communication channels with the sandbox.
   // preserve_fds contains file descriptors that should be kept open and alive.
   // The FD numbers might be changed if needed and are updated in the vector.
@@ -99,10 +159,15 @@ class Client {
   // Sets up the current working directory.
   void SetUpCwd();
 
-  // Receives seccomp-bpf policy from the monitor.
-  void ReceivePolicy();
+  // Applies the resource limits to this process. Returns false if one of them
+  // could not be set.
+  bool ApplyLimits();
+
+  // Applies placement_ to this process. Returns false if part of it could not
+  // be applied.
+  bool ApplyPlacement();
 
-  // Applies sandbox-bpf policy, have limits applied on us, and become ptrace'd.
+  // Applies limits and the sandbox-bpf policy, and becomes ptrace'd.
   void ApplyPolicyAndBecomeTracee();
 
   void PrepareEnvironment(std::vector<int>* preserve_fds = nullptr);
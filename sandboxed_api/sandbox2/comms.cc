@@ -21,12 +21,18 @@
 
 #include "sandboxed_api/sandbox2/comms.h"
 
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/uio.h>
 #include <sys/un.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cinttypes>
@@ -39,12 +45,18 @@
 #include "google/protobuf/message.h"
 #include "absl/base/config.h"
 #include "absl/base/dynamic_annotations.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/die_if_null.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+#include "sandboxed_api/sandbox2/comms_stats.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status.h"
@@ -75,8 +87,275 @@ int GetDefaultCommsFd() {
   }
   return Comms::kSandbox2ClientCommsFD;
 }
+
+// Returns the number of file descriptors announced by an InternalTLV header,
+// or -1 if the tag doesn't announce any.
+int NumAnnouncedFds(uint32_t tag, uint32_t len) {
+  if (tag == Comms::kTagFd) {
+    return 1;
+  }
+  if (tag == Comms::kTagFds && len <= Comms::kMaxFDsPerMessage) {
+    return len;
+  }
+  return -1;
+}
+
 }  // namespace
 
+// Transport moving the data stream of a Comms object into shared memory. The
+// memory starts with a SharedHeader, followed by the data areas of both ring
+// buffers. Each ring has exactly one producer and one consumer. As the peer is
+// not trusted, positions read from shared memory are validated and only local
+// copies of our own positions are authoritative.
+class Comms::SharedMemoryTransport {
+ public:
+  static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                    std::atomic<uint32_t>::is_always_lock_free,
+                "Shared memory transport requires lock-free atomics");
+
+  static std::unique_ptr<SharedMemoryTransport> Create(size_t ring_size,
+                                                       int socket_fd) {
+    size_t size = 1;
+    while (size < ring_size) {
+      size <<= 1;
+    }
+    // The size is sealed so that the peer cannot truncate the memfd and make
+    // us fault on the rings.
+    auto buffer = Buffer::CreateWithSize(kDataOffset + 2 * size,
+                                         {.seal_size = true});
+    if (!buffer.ok()) {
+      SAPI_RAW_LOG(ERROR, "Could not create shared memory: %s",
+                   std::string(buffer.status().message()).c_str());
+      return nullptr;
+    }
+    auto* header = reinterpret_cast<SharedHeader*>((*buffer)->data());
+    header->magic = kMagic;
+    header->ring_size = size;
+    return std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport(
+        *std::move(buffer), size, /*creator=*/true, socket_fd));
+  }
+
+  static std::unique_ptr<SharedMemoryTransport> Attach(int fd) {
+    auto buffer = Buffer::CreateFromFd(fd);
+    if (!buffer.ok()) {
+      SAPI_RAW_LOG(ERROR, "Could not map shared memory: %s",
+                   std::string(buffer.status().message()).c_str());
+      close(fd);
+      return nullptr;
+    }
+    if ((*buffer)->size() < kDataOffset) {
+      SAPI_RAW_LOG(ERROR, "Shared memory too small: %zu", (*buffer)->size());
+      return nullptr;
+    }
+    auto* header = reinterpret_cast<SharedHeader*>((*buffer)->data());
+    const uint64_t size = header->ring_size;
+    if (header->magic != kMagic || size == 0 || (size & (size - 1)) != 0 ||
+        kDataOffset + 2 * size > (*buffer)->size()) {
+      SAPI_RAW_LOG(ERROR, "Invalid shared memory header");
+      return nullptr;
+    }
+    return std::unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport(
+        *std::move(buffer), size, /*creator=*/false, /*socket_fd=*/-1));
+  }
+
+  int fd() const { return buffer_->fd(); }
+
+  bool Write(const void* data, size_t len) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    while (len > 0) {
+      uint64_t tail;
+      if (!Wait(&tx_->tail_seq, &tx_->producer_waiting, [this, &tail]() {
+            tail = tx_->tail.load(std::memory_order_acquire);
+            const uint64_t used = tx_head_ - tail;
+            return tail > tx_head_ || used > ring_size_ ? kCorrupt
+                   : used < ring_size_                  ? kReady
+                                                        : kNotReady;
+          })) {
+        return false;
+      }
+      const size_t n = std::min<size_t>(len, ring_size_ - (tx_head_ - tail));
+      const size_t offset = tx_head_ & (ring_size_ - 1);
+      const size_t first = std::min(n, ring_size_ - offset);
+      memcpy(&tx_data_[offset], bytes, first);
+      memcpy(tx_data_, bytes + first, n - first);
+      tx_head_ += n;
+      tx_->head.store(tx_head_, std::memory_order_release);
+      Notify(&tx_->head_seq, &tx_->consumer_waiting);
+      bytes += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool Read(void* data, size_t len) {
+    uint8_t* bytes = reinterpret_cast<uint8_t*>(data);
+    while (len > 0) {
+      uint64_t head;
+      if (!Wait(&rx_->head_seq, &rx_->consumer_waiting, [this, &head]() {
+            head = rx_->head.load(std::memory_order_acquire);
+            const uint64_t available = head - rx_tail_;
+            return head < rx_tail_ || available > ring_size_ ? kCorrupt
+                   : available > 0                           ? kReady
+                                                             : kNotReady;
+          })) {
+        return false;
+      }
+      const size_t n = std::min<size_t>(len, head - rx_tail_);
+      const size_t offset = rx_tail_ & (ring_size_ - 1);
+      const size_t first = std::min(n, ring_size_ - offset);
+      memcpy(bytes, &rx_data_[offset], first);
+      memcpy(bytes + first, rx_data_, n - first);
+      rx_tail_ += n;
+      rx_->tail.store(rx_tail_, std::memory_order_release);
+      Notify(&rx_->tail_seq, &rx_->producer_waiting);
+      bytes += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  // Marks the transport as closed and wakes up all waiters on both ends.
+  void Close() {
+    header_->closed.store(1, std::memory_order_seq_cst);
+    for (SharedRing& ring : header_->rings) {
+      ring.head_seq.fetch_add(1, std::memory_order_seq_cst);
+      ring.tail_seq.fetch_add(1, std::memory_order_seq_cst);
+      FutexWake(&ring.head_seq);
+      FutexWake(&ring.tail_seq);
+    }
+  }
+
+ private:
+  static constexpr uint32_t kMagic = 0x73326d73;  // "s2ms"
+  static constexpr size_t kDataOffset = 4096;
+  // Number of times to check for progress before going to sleep.
+  static constexpr int kSpinIterations = 4096;
+  // How long to sleep before checking whether the peer is still alive.
+  static constexpr timespec kWaitTimeout = {.tv_sec = 0,
+                                            .tv_nsec = 100 * 1000 * 1000};
+
+  enum WaitResult { kNotReady, kReady, kCorrupt };
+
+  struct SharedRing {
+    // Total number of bytes produced and consumed, respectively.
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    // Futex words, incremented after each update of head and tail.
+    std::atomic<uint32_t> head_seq;
+    std::atomic<uint32_t> tail_seq;
+    // Non-zero while the consumer (producer) sleeps on head_seq (tail_seq).
+    std::atomic<uint32_t> consumer_waiting;
+    std::atomic<uint32_t> producer_waiting;
+  };
+
+  struct SharedHeader {
+    uint32_t magic;
+    uint32_t ring_size;
+    std::atomic<uint32_t> closed;
+    // rings[0] is written by the creator, rings[1] by the other end.
+    SharedRing rings[2];
+  };
+  static_assert(sizeof(SharedHeader) <= kDataOffset);
+
+  SharedMemoryTransport(std::unique_ptr<Buffer> buffer, size_t ring_size,
+                        bool creator, int socket_fd)
+      : buffer_(std::move(buffer)),
+        header_(reinterpret_cast<SharedHeader*>(buffer_->data())),
+        ring_size_(ring_size),
+        socket_fd_(socket_fd) {
+    uint8_t* first_data = buffer_->data() + kDataOffset;
+    uint8_t* second_data = first_data + ring_size_;
+    tx_ = &header_->rings[creator ? 0 : 1];
+    rx_ = &header_->rings[creator ? 1 : 0];
+    tx_data_ = creator ? first_data : second_data;
+    rx_data_ = creator ? second_data : first_data;
+  }
+
+  static void FutexWake(std::atomic<uint32_t>* word) {
+    util::Syscall(__NR_futex, reinterpret_cast<uintptr_t>(word), FUTEX_WAKE,
+                  1);
+  }
+
+  static void Notify(std::atomic<uint32_t>* seq,
+                     std::atomic<uint32_t>* waiting) {
+    seq->fetch_add(1, std::memory_order_seq_cst);
+    if (waiting->load(std::memory_order_seq_cst) != 0) {
+      FutexWake(seq);
+    }
+  }
+
+  // Returns whether the peer closed the transport or its socket.
+  bool PeerGone() {
+    if (header_->closed.load(std::memory_order_acquire) != 0) {
+      return true;
+    }
+    if (socket_fd_ == -1) {
+      return false;
+    }
+    pollfd pfd = {.fd = socket_fd_, .events = POLLRDHUP, .revents = 0};
+    return poll(&pfd, 1, 0) == 1 &&
+           (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR | POLLNVAL)) != 0;
+  }
+
+  // Waits until `ready` returns kReady. Spins for a while, then sleeps on
+  // `seq`, advertising this via `waiting`.
+  template <typename Pred>
+  bool Wait(std::atomic<uint32_t>* seq, std::atomic<uint32_t>* waiting,
+            Pred ready) {
+    for (int i = 0; i < kSpinIterations; ++i) {
+      switch (ready()) {
+        case kReady:
+          return true;
+        case kCorrupt:
+          SAPI_RAW_LOG(ERROR, "Shared memory transport corrupted");
+          return false;
+        case kNotReady:
+          break;
+      }
+      if (header_->closed.load(std::memory_order_relaxed) != 0) {
+        return false;
+      }
+    }
+    while (true) {
+      const uint32_t seq_value = seq->load(std::memory_order_seq_cst);
+      waiting->store(1, std::memory_order_seq_cst);
+      const WaitResult result = ready();
+      if (result != kNotReady) {
+        waiting->store(0, std::memory_order_relaxed);
+        if (result == kCorrupt) {
+          SAPI_RAW_LOG(ERROR, "Shared memory transport corrupted");
+          return false;
+        }
+        return true;
+      }
+      if (PeerGone()) {
+        waiting->store(0, std::memory_order_relaxed);
+        SAPI_RAW_VLOG(2, "Shared memory transport: peer went away");
+        return false;
+      }
+      {
+        PotentiallyBlockingRegion region;
+        util::Syscall(__NR_futex, reinterpret_cast<uintptr_t>(seq), FUTEX_WAIT,
+                      seq_value, reinterpret_cast<uintptr_t>(&kWaitTimeout));
+      }
+      waiting->store(0, std::memory_order_relaxed);
+    }
+  }
+
+  std::unique_ptr<Buffer> buffer_;
+  SharedHeader* header_;
+  size_t ring_size_;
+  // Socket to the peer, used to check for liveness. Might be -1.
+  int socket_fd_;
+  SharedRing* tx_;
+  SharedRing* rx_;
+  uint8_t* tx_data_;
+  uint8_t* rx_data_;
+  // Local copies of our own positions in the rings.
+  uint64_t tx_head_ = 0;
+  uint64_t rx_tail_ = 0;
+};
+
 Comms::Comms(const std::string& socket_name, bool abstract_uds)
     : socket_name_(socket_name), abstract_uds_(abstract_uds) {}
 
@@ -92,12 +371,96 @@ Comms::Comms(int fd) : connection_fd_(fd) {
 
 Comms::Comms(Comms::DefaultConnectionTag) : Comms(GetDefaultCommsFd()) {}
 
-Comms::~Comms() { Terminate(); }
+Comms::~Comms() {
+  Terminate();
+  for (int fd : read_ahead_fds_) {
+    close(fd);
+  }
+}
 
 int Comms::GetConnectionFD() const {
   return connection_fd_;
 }
 
+bool Comms::HasPendingData() {
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  if (shm_ || partial_message_ || read_ahead_begin_ != read_ahead_end_) {
+    return true;
+  }
+  pollfd pfd = {.fd = connection_fd_, .events = POLLIN};
+  // Errors are left for the receive to report.
+  return TEMP_FAILURE_RETRY(poll(&pfd, 1, /*timeout=*/0)) != 0;
+}
+
+bool Comms::InitSharedMemoryTransport(size_t ring_size) {
+  if (shm_) {
+    SAPI_RAW_LOG(ERROR, "Shared memory transport already enabled");
+    return false;
+  }
+  if (ring_size > kMaxRingSize) {
+    SAPI_RAW_LOG(ERROR, "Ring size too large: %zu (max %zu)", ring_size,
+                 kMaxRingSize);
+    return false;
+  }
+  auto shm = SharedMemoryTransport::Create(ring_size, connection_fd_);
+  if (!shm) {
+    return false;
+  }
+  // Hold the send lock so that no other message is sent over the socket after
+  // the shared memory.
+  absl::MutexLock send_lock(&tlv_send_transmission_mutex_);
+  if (!SendFDLocked(shm->fd())) {
+    return false;
+  }
+  absl::MutexLock recv_lock(&tlv_recv_transmission_mutex_);
+  shm_ = std::move(shm);
+  return true;
+}
+
+bool Comms::AcceptSharedMemoryTransport() {
+  if (shm_) {
+    SAPI_RAW_LOG(ERROR, "Shared memory transport already enabled");
+    return false;
+  }
+  int fd;
+  if (!RecvFD(&fd)) {
+    return false;
+  }
+  auto shm = SharedMemoryTransport::Attach(fd);
+  if (!shm) {
+    return false;
+  }
+  absl::MutexLock send_lock(&tlv_send_transmission_mutex_);
+  absl::MutexLock recv_lock(&tlv_recv_transmission_mutex_);
+  if (read_ahead_begin_ != read_ahead_end_) {
+    SAPI_RAW_LOG(ERROR, "Pending data while switching to shared memory");
+    return false;
+  }
+  shm_ = std::move(shm);
+  return true;
+}
+
+void Comms::EnableReadAhead() {
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  EnableReadAheadLocked();
+}
+
+void Comms::EnableSeqPacket() {
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  seqpacket_ = true;
+  EnableReadAheadLocked();
+}
+
+void Comms::EnableReadAheadLocked() {
+  if (read_ahead_) {
+    return;
+  }
+  read_ahead_ = true;
+  read_ahead_buffer_.resize(kReadAheadBufferSize);
+  read_ahead_begin_ = 0;
+  read_ahead_end_ = 0;
+}
+
 bool Comms::Listen() {
   if (IsConnected()) {
     return true;
@@ -211,6 +574,9 @@ void Comms::Terminate() {
 
     state_ = State::kTerminated;
 
+    if (shm_) {
+      shm_->Close();
+    }
     if (bind_fd_ != -1) {
       close(bind_fd_);
       bind_fd_ = -1;
@@ -223,38 +589,79 @@ void Comms::Terminate() {
 }
 
 bool Comms::SendTLV(uint32_t tag, size_t length, const void* value) {
-  if (length > GetMaxMsgSize()) {
-    SAPI_RAW_LOG(ERROR, "Maximum TLV message size exceeded: (%zu > %zu)",
-                 length, GetMaxMsgSize());
-    return false;
-  }
-  if (length > kWarnMsgSize) {
-    // TODO(cblichmann): Use LOG_FIRST_N once Abseil logging is released.
-    static std::atomic<int> times_warned = 0;
-    if (times_warned.fetch_add(1, std::memory_order_relaxed) < 10) {
-      SAPI_RAW_LOG(
-          WARNING,
-          "TLV message of size %zu detected. Please consider switching "
-          "to Buffer API instead.",
-          length);
+  return SendTLVs({TLV{tag, length, value}});
+}
+
+bool Comms::SendTLVs(absl::Span<const TLV> tlvs) {
+  for (const TLV& tlv : tlvs) {
+    if (tlv.length > GetMaxMsgSize()) {
+      SAPI_RAW_LOG(ERROR, "Maximum TLV message size exceeded: (%zu > %zu)",
+                   tlv.length, GetMaxMsgSize());
+      return false;
+    }
+    if (tlv.length > kWarnMsgSize) {
+      // TODO(cblichmann): Use LOG_FIRST_N once Abseil logging is released.
+      static std::atomic<int> times_warned = 0;
+      if (times_warned.fetch_add(1, std::memory_order_relaxed) < 10) {
+        SAPI_RAW_LOG(
+            WARNING,
+            "TLV message of size %zu detected. Please consider switching "
+            "to Buffer API instead.",
+            tlv.length);
+      }
     }
+    SAPI_RAW_VLOG(3, "Sending a TLV message, tag: 0x%08x, length: %zu",
+                  tlv.tag, tlv.length);
   }
 
-  SAPI_RAW_VLOG(3, "Sending a TLV message, tag: 0x%08x, length: %zu", tag,
-                length);
-  {
-    absl::MutexLock lock(&tlv_send_transmission_mutex_);
-    if (!Send(&tag, sizeof(tag))) {
-      return false;
+  absl::MutexLock lock(&tlv_send_transmission_mutex_);
+  return SendTLVsLocked(tlvs);
+}
+
+bool Comms::SendTLVsLocked(absl::Span<const TLV> tlvs) {
+  // Headers and small values are accumulated in this buffer, so that
+  // consecutive small messages are written out together.
+  uint8_t buffer[kSendTLVTempBufferSize];
+  size_t used = 0;
+  const auto flush = [this, &buffer, &used]() {
+    if (used == 0) {
+      return true;
     }
-    if (!Send(&length, sizeof(length))) {
+    const bool ok = Send(buffer, used);
+    used = 0;
+    return ok;
+  };
+  for (const TLV& tlv : tlvs) {
+    RecordMessage(tlv.tag, /*sent=*/true);
+    const TLHeader header = {tlv.tag, tlv.length};
+    const size_t total = sizeof(header) + tlv.length;
+    if (used + total > sizeof(buffer) && !flush()) {
       return false;
     }
-    if (length > 0 && !Send(value, length)) {
-      return false;
+    if (total > sizeof(buffer)) {
+      if (seqpacket_ && !shm_ && total <= kMaxSeqPacketSize) {
+        if (!SendDatagram(header, tlv.value, tlv.length)) {
+          return false;
+        }
+        continue;
+      }
+      // Too large to be coalesced, send header and value separately.
+      if (!Send(&header, sizeof(header))) {
+        return false;
+      }
+      if (!Send(tlv.value, tlv.length)) {
+        return false;
+      }
+      continue;
+    }
+    memcpy(&buffer[used], &header, sizeof(header));
+    used += sizeof(header);
+    if (tlv.length > 0) {
+      memcpy(&buffer[used], tlv.value, tlv.length);
+      used += tlv.length;
     }
   }
-  return true;
+  return flush();
 }
 
 bool Comms::RecvString(std::string* v) {
@@ -276,21 +683,132 @@ bool Comms::SendString(const std::string& v) {
 }
 
 bool Comms::RecvBytes(std::vector<uint8_t>* buffer) {
-  uint32_t tag;
-  if (!RecvTLV(&tag, buffer)) {
+  return RecvPayload([buffer](uint32_t tag, absl::Span<const uint8_t> value) {
+    if (tag != kTagBytes) {
+      buffer->clear();
+      SAPI_RAW_LOG(ERROR, "Expected (kTagBytes == 0x%x), got: 0x%u",
+                   kTagBytes, tag);
+      return false;
+    }
+    buffer->assign(value.begin(), value.end());
+    return true;
+  });
+}
+
+bool Comms::SendBytes(const uint8_t* v, size_t len) {
+  if (sealed_buffer_threshold_ > 0 && len >= sealed_buffer_threshold_) {
+    return SendSealedBuffer(kTagBytes, len, [v, len](uint8_t* data) {
+      memcpy(data, v, len);
+      return true;
+    });
+  }
+  return SendTLV(kTagBytes, len, v);
+}
+
+bool Comms::SendSealedBuffer(uint32_t tag, size_t length,
+                             absl::FunctionRef<bool(uint8_t*)> write) {
+  if (length > GetMaxMsgSize()) {
+    SAPI_RAW_LOG(ERROR, "Maximum TLV message size exceeded: (%zu > %zu)",
+                 length, GetMaxMsgSize());
     return false;
   }
-  if (tag != kTagBytes) {
-    buffer->clear();
-    SAPI_RAW_LOG(ERROR, "Expected (kTagBytes == 0x%x), got: 0x%u", kTagBytes,
-                 tag);
+  int fd;
+  {
+    auto buffer = Buffer::CreateWithSize(length);
+    if (!buffer.ok()) {
+      SAPI_RAW_LOG(ERROR, "Could not create sealed buffer: %s",
+                   std::string(buffer.status().message()).c_str());
+      return false;
+    }
+    if (!write((*buffer)->data())) {
+      return false;
+    }
+    // The mapping has to be gone before the memfd can be sealed against
+    // writes, keep only a duplicate of the descriptor.
+    fd = dup((*buffer)->fd());
+    if (fd == -1) {
+      SAPI_RAW_PLOG(ERROR, "dup()");
+      return false;
+    }
+  }
+  struct FdCloser {
+    ~FdCloser() { close(fd); }
+    int fd;
+  } closer = {fd};
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) == -1) {
+    SAPI_RAW_PLOG(ERROR, "fcntl(F_ADD_SEALS)");
     return false;
   }
-  return true;
+  // Zero-initialized so that no uninitialized padding reaches the peer.
+  SealedBufferHeader header{};
+  header.tag = tag;
+  header.length = length;
+  SAPI_RAW_VLOG(3, "Sending a sealed buffer, tag: 0x%08x, length: %zu", tag,
+                length);
+  absl::MutexLock lock(&tlv_send_transmission_mutex_);
+  return SendTLVsLocked({TLV{kTagSealedBuffer, sizeof(header), &header}}) &&
+         SendFDLocked(fd);
 }
 
-bool Comms::SendBytes(const uint8_t* v, size_t len) {
-  return SendTLV(kTagBytes, len, v);
+bool Comms::RecvPayload(
+    absl::FunctionRef<bool(uint32_t, absl::Span<const uint8_t>)> consume) {
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  uint32_t tag;
+  absl::Span<const uint8_t> value;
+  if (!RecvTLVLocked(&tag, &value)) {
+    return false;
+  }
+  if (tag != kTagSealedBuffer) {
+    return consume(tag, value);
+  }
+
+  SealedBufferHeader header;
+  if (value.size() != sizeof(header)) {
+    SAPI_RAW_LOG(ERROR, "Invalid sealed buffer header size: %zu",
+                 value.size());
+    return false;
+  }
+  memcpy(&header, value.data(), sizeof(header));
+  int fd;
+  if (!RecvFDLocked(&fd)) {
+    return false;
+  }
+  struct FdCloser {
+    ~FdCloser() { close(fd); }
+    int fd;
+  } closer = {fd};
+  // The sender must not be able to modify the contents while we are reading.
+  constexpr int kRequiredSeals = F_SEAL_SHRINK | F_SEAL_WRITE;
+  const int seals = fcntl(fd, F_GET_SEALS);
+  if (seals == -1 || (seals & kRequiredSeals) != kRequiredSeals) {
+    SAPI_RAW_LOG(ERROR, "Received buffer is not sealed (seals: 0x%x)", seals);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    SAPI_RAW_PLOG(ERROR, "fstat()");
+    return false;
+  }
+  if (header.length > GetMaxMsgSize() ||
+      header.length > static_cast<uint64_t>(st.st_size)) {
+    SAPI_RAW_LOG(ERROR, "Invalid sealed buffer length: %" PRIu64,
+                 header.length);
+    return false;
+  }
+  if (header.length == 0) {
+    return consume(header.tag, {});
+  }
+  void* data = mmap(nullptr, header.length, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    SAPI_RAW_PLOG(ERROR, "mmap()");
+    return false;
+  }
+  const bool ok = consume(
+      header.tag, absl::MakeConstSpan(reinterpret_cast<const uint8_t*>(data),
+                                      header.length));
+  munmap(data, header.length);
+  return ok;
 }
 
 bool Comms::SendBytes(const std::vector<uint8_t>& buffer) {
@@ -321,7 +839,61 @@ bool Comms::RecvCreds(pid_t* pid, uid_t* uid, gid_t* gid) {
 }
 
 bool Comms::RecvFD(int* fd) {
-  char fd_msg[8192];
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  return RecvFDLocked(fd);
+}
+
+bool Comms::RecvFDs(std::vector<int>* fds) {
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  return RecvFDsLocked(fds);
+}
+
+bool Comms::RecvFDLocked(int* fd) {
+  std::vector<int> fds;
+  if (!RecvFDsLocked(&fds)) {
+    return false;
+  }
+  if (fds.size() != 1) {
+    SAPI_RAW_LOG(ERROR, "Expected a single file descriptor, got %zu",
+                 fds.size());
+    for (int fd : fds) {
+      close(fd);
+    }
+    return false;
+  }
+  *fd = fds[0];
+  return true;
+}
+
+bool Comms::RecvFDsLocked(std::vector<int>* fds) {
+  fds->clear();
+  if (read_ahead_ && !shm_) {
+    // The SCM_RIGHTS message is collected while filling the read-ahead
+    // buffer, the descriptors themselves are queued in read_ahead_fds_.
+    InternalTLV tlv;
+    if (!RecvBuffered(&tlv, sizeof(tlv))) {
+      return false;
+    }
+    const int num_fds = NumAnnouncedFds(tlv.tag, tlv.len);
+    if (num_fds < 0) {
+      SAPI_RAW_LOG(ERROR, "Expected (kTagFD: 0x%x), got: 0x%x", kTagFd,
+                   tlv.tag);
+      return false;
+    }
+    if (read_ahead_fds_.size() < static_cast<size_t>(num_fds)) {
+      SAPI_RAW_LOG(ERROR,
+                   "Haven't received the SCM_RIGHTS message, process is "
+                   "probably out of free file descriptors");
+      return false;
+    }
+    RecordMessage(tlv.tag, /*sent=*/false);
+    fds->assign(read_ahead_fds_.begin(), read_ahead_fds_.begin() + num_fds);
+    read_ahead_fds_.erase(read_ahead_fds_.begin(),
+                          read_ahead_fds_.begin() + num_fds);
+    return true;
+  }
+
+  char fd_msg[CMSG_SPACE(sizeof(int) * kMaxFDsPerMessage)];
   cmsghdr* cmsg = reinterpret_cast<cmsghdr*>(fd_msg);
 
   InternalTLV tlv;
@@ -343,6 +915,7 @@ bool Comms::RecvFD(int* fd) {
     return TEMP_FAILURE_RETRY(
         util::Syscall(__NR_recvmsg, fd, reinterpret_cast<uintptr_t>(&msg), 0));
   };
+  const absl::Time start = RecvStartTime();
   ssize_t len;
   len = op(connection_fd_);
   if (len < 0) {
@@ -366,46 +939,67 @@ bool Comms::RecvFD(int* fd) {
   // syscall(__NR_recvmsg) semantics so we need to suppress the error (here and
   // everywhere below).
   ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(&tlv, sizeof(tlv));
+  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(fd_msg, msg.msg_controllen);
+  RecordRecv(len, start, /*syscall=*/true);
+  RecordMessage(tlv.tag, /*sent=*/false);
 
-  if (tlv.tag != kTagFd) {
-    SAPI_RAW_LOG(ERROR, "Expected (kTagFD: 0x%x), got: 0x%x", kTagFd, tlv.tag);
-    return false;
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      const int* received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+      const size_t num_received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      fds->insert(fds->end(), received, received + num_received);
+    }
   }
 
-  cmsg = CMSG_FIRSTHDR(&msg);
-  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(cmsg, sizeof(cmsghdr));
-  while (cmsg) {
-    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
-      if (cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
-        SAPI_RAW_VLOG(1,
-                      "recvmsg(SCM_RIGHTS): cmsg->cmsg_len != "
-                      "CMSG_LEN(sizeof(int)), skipping");
-        continue;
-      }
-      int* fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
-      *fd = fds[0];
-      ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(fd, sizeof(int));
-      return true;
+  const int num_fds = NumAnnouncedFds(tlv.tag, tlv.len);
+  if (num_fds < 0 || fds->size() != static_cast<size_t>(num_fds)) {
+    if (num_fds < 0) {
+      SAPI_RAW_LOG(ERROR, "Expected (kTagFD: 0x%x), got: 0x%x", kTagFd,
+                   tlv.tag);
+    } else {
+      SAPI_RAW_LOG(ERROR,
+                   "Haven't received the SCM_RIGHTS message, process is "
+                   "probably out of free file descriptors");
+    }
+    for (int fd : *fds) {
+      close(fd);
     }
-    cmsg = CMSG_NXTHDR(&msg, cmsg);
+    fds->clear();
+    return false;
   }
-  SAPI_RAW_LOG(ERROR,
-               "Haven't received the SCM_RIGHTS message, process is probably "
-               "out of free file descriptors");
-  return false;
+  return true;
 }
 
 bool Comms::SendFD(int fd) {
-  char fd_msg[CMSG_SPACE(sizeof(int))] = {0};
+  absl::MutexLock lock(&tlv_send_transmission_mutex_);
+  return SendFDLocked(fd);
+}
+
+bool Comms::SendFDs(absl::Span<const int> fds) {
+  absl::MutexLock lock(&tlv_send_transmission_mutex_);
+  return SendFDsLocked(fds);
+}
+
+bool Comms::SendFDLocked(int fd) { return SendFDsLocked({&fd, 1}); }
+
+bool Comms::SendFDsLocked(absl::Span<const int> fds) {
+  if (fds.size() > kMaxFDsPerMessage) {
+    SAPI_RAW_LOG(ERROR, "Too many file descriptors: (%zu > %zu)", fds.size(),
+                 kMaxFDsPerMessage);
+    return false;
+  }
+  char fd_msg[CMSG_SPACE(sizeof(int) * kMaxFDsPerMessage)] = {0};
   cmsghdr* cmsg = reinterpret_cast<cmsghdr*>(fd_msg);
   cmsg->cmsg_level = SOL_SOCKET;
   cmsg->cmsg_type = SCM_RIGHTS;
-  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
-
-  int* fds = reinterpret_cast<int*>(CMSG_DATA(cmsg));
-  fds[0] = fd;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
 
+  // A single descriptor keeps using the kTagFd message.
   InternalTLV tlv = {kTagFd, 0};
+  if (fds.size() != 1) {
+    tlv = {kTagFds, static_cast<uint32_t>(fds.size())};
+  }
 
   iovec iov;
   iov.iov_base = &tlv;
@@ -416,8 +1010,9 @@ bool Comms::SendFD(int fd) {
   msg.msg_namelen = 0;
   msg.msg_iov = &iov;
   msg.msg_iovlen = 1;
-  msg.msg_control = cmsg;
-  msg.msg_controllen = sizeof(fd_msg);
+  // SCM_RIGHTS without any descriptors is rejected by the kernel.
+  msg.msg_control = fds.empty() ? nullptr : cmsg;
+  msg.msg_controllen = fds.empty() ? 0 : CMSG_SPACE(sizeof(int) * fds.size());
   msg.msg_flags = 0;
 
   const auto op = [&msg](int fd) -> ssize_t {
@@ -445,13 +1040,25 @@ bool Comms::SendFD(int fd) {
                  len);
     return false;
   }
+  RecordSend(len, /*syscall=*/true);
+  RecordMessage(tlv.tag, /*sent=*/true);
   return true;
 }
 
 bool Comms::RecvProtoBuf(google::protobuf::MessageLite* message) {
-  uint32_t tag;
-  std::vector<uint8_t> bytes;
-  if (!RecvTLV(&tag, &bytes)) {
+  bool parsed = false;
+  const bool received =
+      RecvPayload([message, &parsed](uint32_t tag,
+                                     absl::Span<const uint8_t> value) {
+        if (tag != kTagProto2) {
+          SAPI_RAW_LOG(ERROR, "Expected tag: 0x%x, got: 0x%u", kTagProto2,
+                       tag);
+          return true;
+        }
+        parsed = message->ParseFromArray(value.data(), value.size());
+        return true;
+      });
+  if (!received) {
     if (IsConnected()) {
       SAPI_RAW_PLOG(ERROR, "RecvProtoBuf failed for (%s)", socket_name_);
     } else {
@@ -460,15 +1067,22 @@ bool Comms::RecvProtoBuf(google::protobuf::MessageLite* message) {
     }
     return false;
   }
-
-  if (tag != kTagProto2) {
-    SAPI_RAW_LOG(ERROR, "Expected tag: 0x%x, got: 0x%u", kTagProto2, tag);
-    return false;
-  }
-  return message->ParseFromArray(bytes.data(), bytes.size());
+  return parsed;
 }
 
 bool Comms::SendProtoBuf(const google::protobuf::MessageLite& message) {
+  const size_t size = message.ByteSizeLong();
+  if (sealed_buffer_threshold_ > 0 && size >= sealed_buffer_threshold_) {
+    // Serialize straight into the buffer.
+    return SendSealedBuffer(kTagProto2, size, [&message, size](uint8_t* data) {
+      if (!message.SerializeToArray(data, size)) {
+        SAPI_RAW_LOG(ERROR, "Couldn't serialize the ProtoBuf");
+        return false;
+      }
+      return true;
+    });
+  }
+
   std::string str;
   if (!message.SerializeToString(&str)) {
     SAPI_RAW_LOG(ERROR, "Couldn't serialize the ProtoBuf");
@@ -509,12 +1123,62 @@ socklen_t Comms::CreateSockaddrUn(sockaddr_un* sun) {
   return slen;
 }
 
+CommsStats Comms::GetStats() const {
+  absl::MutexLock lock(&stats_mutex_);
+  return stats_;
+}
+
+void Comms::RecordSend(size_t bytes, bool syscall) {
+  if (!IsStatsEnabled()) {
+    return;
+  }
+  absl::MutexLock lock(&stats_mutex_);
+  stats_.bytes_sent += bytes;
+  stats_.send_syscalls += syscall ? 1 : 0;
+}
+
+absl::Time Comms::RecvStartTime() const {
+  return IsStatsEnabled() ? absl::Now() : absl::InfinitePast();
+}
+
+void Comms::RecordRecv(size_t bytes, absl::Time start, bool syscall) {
+  // Also skip receives started before stats were enabled.
+  if (!IsStatsEnabled() || start == absl::InfinitePast()) {
+    return;
+  }
+  const absl::Duration duration = absl::Now() - start;
+  absl::MutexLock lock(&stats_mutex_);
+  stats_.bytes_received += bytes;
+  stats_.recv_syscalls += syscall ? 1 : 0;
+  stats_.recv_time += duration;
+  ++stats_.recv_latency_histogram[CommsStats::RecvLatencyBucket(duration)];
+}
+
+void Comms::RecordMessage(uint32_t tag, bool sent) {
+  if (!IsStatsEnabled()) {
+    return;
+  }
+  absl::MutexLock lock(&stats_mutex_);
+  ++(sent ? stats_.messages_sent : stats_.messages_received)[tag];
+}
+
 bool Comms::Send(const void* data, size_t len) {
+  if (shm_) {
+    if (IsTerminated() || !shm_->Write(data, len)) {
+      Terminate();
+      return false;
+    }
+    RecordSend(len, /*syscall=*/false);
+    return true;
+  }
   size_t total_sent = 0;
   const char* bytes = reinterpret_cast<const char*>(data);
-  const auto op = [bytes, len, &total_sent](int fd) -> ssize_t {
+  // Each write() is a datagram of its own in SOCK_SEQPACKET mode.
+  const size_t max_write = seqpacket_ ? kMaxSeqPacketSize : len;
+  const auto op = [bytes, len, max_write, &total_sent](int fd) -> ssize_t {
     PotentiallyBlockingRegion region;
-    return TEMP_FAILURE_RETRY(write(fd, &bytes[total_sent], len - total_sent));
+    return TEMP_FAILURE_RETRY(write(
+        fd, &bytes[total_sent], std::min(len - total_sent, max_write)));
   };
   while (total_sent < len) {
     ssize_t s;
@@ -538,12 +1202,57 @@ bool Comms::Send(const void* data, size_t len) {
                    total_sent, len);
       return false;
     }
+    RecordSend(s, /*syscall=*/true);
     total_sent += s;
   }
   return true;
 }
 
+bool Comms::SendDatagram(const TLHeader& header, const void* value,
+                         size_t length) {
+  iovec iov[] = {
+      {.iov_base = const_cast<TLHeader*>(&header), .iov_len = sizeof(header)},
+      {.iov_base = const_cast<void*>(value), .iov_len = length},
+  };
+  msghdr msg = {.msg_iov = iov, .msg_iovlen = length > 0 ? 2u : 1u};
+  ssize_t s;
+  {
+    PotentiallyBlockingRegion region;
+    // Use syscall, otherwise we would need to allow socketcall() on PPC.
+    s = TEMP_FAILURE_RETRY(util::Syscall(
+        __NR_sendmsg, connection_fd_, reinterpret_cast<uintptr_t>(&msg), 0));
+  }
+  if (s == -1 && errno == EPIPE) {
+    Terminate();
+    SAPI_RAW_LOG(ERROR, "sendmsg: Peer disconnected");
+    return false;
+  }
+  if (s == -1) {
+    SAPI_RAW_PLOG(ERROR, "sendmsg");
+    if (IsFatalError(errno)) {
+      Terminate();
+    }
+    return false;
+  }
+  if (static_cast<size_t>(s) != sizeof(header) + length) {
+    SAPI_RAW_LOG(ERROR, "Expected to send %zu bytes, sent %zd",
+                 sizeof(header) + length, s);
+    return false;
+  }
+  RecordSend(s, /*syscall=*/true);
+  return true;
+}
+
 bool Comms::Recv(void* data, size_t len) {
+  if (shm_) {
+    const absl::Time start = RecvStartTime();
+    if (IsTerminated() || !shm_->Read(data, len)) {
+      Terminate();
+      return false;
+    }
+    RecordRecv(len, start, /*syscall=*/false);
+    return true;
+  }
   size_t total_recv = 0;
   char* bytes = reinterpret_cast<char*>(data);
   const auto op = [bytes, len, &total_recv](int fd) -> ssize_t {
@@ -551,6 +1260,7 @@ bool Comms::Recv(void* data, size_t len) {
     return TEMP_FAILURE_RETRY(read(fd, &bytes[total_recv], len - total_recv));
   };
   while (total_recv < len) {
+    const absl::Time start = RecvStartTime();
     ssize_t s;
       s = op(connection_fd_);
     if (s == -1) {
@@ -566,21 +1276,144 @@ bool Comms::Recv(void* data, size_t len) {
       SAPI_RAW_VLOG(2, "Recv: end-point terminated the connection.");
       return false;
     }
+    RecordRecv(s, start, /*syscall=*/true);
     total_recv += s;
   }
   return true;
 }
 
+bool Comms::RecvBuffered(void* data, size_t len) {
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(data);
+  while (len > 0) {
+    if (read_ahead_begin_ == read_ahead_end_) {
+      if (len >= read_ahead_buffer_.size() && !seqpacket_) {
+        // Large reads bypass the buffer. Reading exactly the remaining bytes
+        // of the current message never consumes a subsequent SCM_RIGHTS
+        // message. Datagrams have to be read as a whole, though.
+        return Recv(bytes, len);
+      }
+      if (!FillReadAheadBuffer(1)) {
+        return false;
+      }
+    }
+    const size_t n = std::min(len, read_ahead_end_ - read_ahead_begin_);
+    memcpy(bytes, &read_ahead_buffer_[read_ahead_begin_], n);
+    read_ahead_begin_ += n;
+    bytes += n;
+    len -= n;
+  }
+  return true;
+}
+
+void Comms::CompactReadAheadBuffer(size_t len) {
+  if (read_ahead_begin_ == read_ahead_end_) {
+    read_ahead_begin_ = read_ahead_end_ = 0;
+  } else if (read_ahead_begin_ + len > read_ahead_buffer_.size()) {
+    // Not enough contiguous space left, move pending data to the front.
+    memmove(read_ahead_buffer_.data(), &read_ahead_buffer_[read_ahead_begin_],
+            read_ahead_end_ - read_ahead_begin_);
+    read_ahead_end_ -= read_ahead_begin_;
+    read_ahead_begin_ = 0;
+  }
+}
+
+bool Comms::FillReadAheadBuffer(size_t len) {
+  CompactReadAheadBuffer(len);
+  while (read_ahead_end_ - read_ahead_begin_ < len) {
+    if (ReadIntoReadAheadBuffer(/*dont_wait=*/false) != TryRecvResult::kOk) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Comms::TryRecvResult Comms::ReadIntoReadAheadBuffer(bool dont_wait) {
+  if (seqpacket_) {
+    // The rest of a datagram that does not fit would be discarded, make room
+    // for the largest one the peer sends.
+    CompactReadAheadBuffer(kMaxSeqPacketSize);
+    if (read_ahead_buffer_.size() - read_ahead_end_ < kMaxSeqPacketSize) {
+      read_ahead_buffer_.resize(read_ahead_end_ + kMaxSeqPacketSize);
+    }
+  }
+  char fd_msg[CMSG_SPACE(sizeof(int) * kMaxFDsPerMessage)];
+  iovec iov = {
+      .iov_base = &read_ahead_buffer_[read_ahead_end_],
+      .iov_len = read_ahead_buffer_.size() - read_ahead_end_,
+  };
+  msghdr msg = {
+      .msg_name = nullptr,
+      .msg_namelen = 0,
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = fd_msg,
+      .msg_controllen = sizeof(fd_msg),
+      .msg_flags = 0,
+  };
+  const absl::Time start = RecvStartTime();
+  ssize_t s;
+  {
+    PotentiallyBlockingRegion region;
+    // Use syscall, otherwise we would need to allow socketcall() on PPC.
+    s = TEMP_FAILURE_RETRY(
+        util::Syscall(__NR_recvmsg, connection_fd_,
+                      reinterpret_cast<uintptr_t>(&msg),
+                      dont_wait ? MSG_DONTWAIT : 0));
+  }
+  if (s == -1) {
+    if (dont_wait && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return TryRecvResult::kWouldBlock;
+    }
+    SAPI_RAW_PLOG(ERROR, "recvmsg");
+    if (IsFatalError(errno)) {
+      Terminate();
+    }
+    return TryRecvResult::kError;
+  }
+  if (s == 0) {
+    Terminate();
+    // The other end might have finished its work.
+    SAPI_RAW_VLOG(2, "Recv: end-point terminated the connection.");
+    return TryRecvResult::kError;
+  }
+  if (msg.msg_flags & MSG_TRUNC) {
+    Terminate();
+    SAPI_RAW_LOG(ERROR, "recvmsg: datagram truncated");
+    return TryRecvResult::kError;
+  }
+  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(iov.iov_base, s);
+  RecordRecv(s, start, /*syscall=*/true);
+  read_ahead_end_ += s;
+  ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(fd_msg, msg.msg_controllen);
+  if (msg.msg_flags & MSG_CTRUNC) {
+    SAPI_RAW_LOG(ERROR, "recvmsg(SCM_RIGHTS): control message truncated");
+  }
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    const int* fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+    const size_t num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    read_ahead_fds_.insert(read_ahead_fds_.end(), fds, fds + num_fds);
+  }
+  return TryRecvResult::kOk;
+}
+
+bool Comms::RecvLocked(void* data, size_t len) {
+  return read_ahead_ && !shm_ ? RecvBuffered(data, len) : Recv(data, len);
+}
+
 // Internal helper method (low level).
 bool Comms::RecvTL(uint32_t* tag, size_t* length) {
-  if (!Recv(reinterpret_cast<uint8_t*>(tag), sizeof(*tag))) {
-    SAPI_RAW_VLOG(2, "RecvTL: Can't read tag");
-    return false;
-  }
-  if (!Recv(reinterpret_cast<uint8_t*>(length), sizeof(*length))) {
-    SAPI_RAW_VLOG(2, "RecvTL: Can't read length for tag %u", *tag);
+  TLHeader header;
+  if (!RecvLocked(&header, sizeof(header))) {
+    SAPI_RAW_VLOG(2, "RecvTL: Can't read tag and length");
     return false;
   }
+  RecordMessage(header.tag, /*sent=*/false);
+  *tag = header.tag;
+  *length = header.length;
   if (*length > GetMaxMsgSize()) {
     SAPI_RAW_LOG(ERROR, "Maximum TLV message size exceeded: (%zu > %zd)",
                  *length, GetMaxMsgSize());
@@ -616,7 +1449,141 @@ bool Comms::RecvTLVGeneric(uint32_t* tag, T* value) {
   }
 
   value->resize(length);
-  return length == 0 || Recv(reinterpret_cast<uint8_t*>(value->data()), length);
+  return length == 0 ||
+         RecvLocked(reinterpret_cast<uint8_t*>(value->data()), length);
+}
+
+bool Comms::RecvTLV(uint32_t* tag, absl::Span<const uint8_t>* value) {
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  return RecvTLVLocked(tag, value);
+}
+
+bool Comms::RecvTLVLocked(uint32_t* tag, absl::Span<const uint8_t>* value) {
+  size_t length;
+  if (!RecvTL(tag, &length)) {
+    return false;
+  }
+  if (length == 0) {
+    *value = {};
+    return true;
+  }
+  if (read_ahead_ && !shm_ && length <= read_ahead_buffer_.size()) {
+    // Hand out the value straight from the read-ahead buffer.
+    if (!FillReadAheadBuffer(length)) {
+      return false;
+    }
+    *value = absl::MakeConstSpan(&read_ahead_buffer_[read_ahead_begin_],
+                                 length);
+    read_ahead_begin_ += length;
+    return true;
+  }
+  if (recv_value_buffer_.size() < length) {
+    recv_value_buffer_.resize(length);
+  }
+  if (!RecvLocked(recv_value_buffer_.data(), length)) {
+    return false;
+  }
+  *value = absl::MakeConstSpan(recv_value_buffer_.data(), length);
+  return true;
+}
+
+Comms::TryRecvResult Comms::TryRecvTLV(uint32_t* tag,
+                                    absl::Span<const uint8_t>* value) {
+  absl::MutexLock lock(&tlv_recv_transmission_mutex_);
+  if (IsTerminated()) {
+    return TryRecvResult::kError;
+  }
+  if (shm_) {
+    SAPI_RAW_LOG(ERROR, "TryRecvTLV() is not supported with shared memory");
+    return TryRecvResult::kError;
+  }
+  EnableReadAheadLocked();
+  for (;;) {
+    if (partial_message_) {
+      // Take what is buffered first, then read the rest of the value directly.
+      const size_t remaining =
+          partial_message_length_ - partial_message_received_;
+      const size_t buffered =
+          std::min(remaining, read_ahead_end_ - read_ahead_begin_);
+      memcpy(&recv_value_buffer_[partial_message_received_],
+             &read_ahead_buffer_[read_ahead_begin_], buffered);
+      read_ahead_begin_ += buffered;
+      partial_message_received_ += buffered;
+      if (partial_message_received_ == partial_message_length_) {
+        partial_message_ = false;
+        *tag = partial_message_tag_;
+        *value = absl::MakeConstSpan(recv_value_buffer_.data(),
+                                     partial_message_length_);
+        return TryRecvResult::kOk;
+      }
+      iovec iov = {
+          .iov_base = &recv_value_buffer_[partial_message_received_],
+          .iov_len = remaining - buffered,
+      };
+      msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1};
+      // Reading at most the remaining bytes of the value never consumes a
+      // subsequent SCM_RIGHTS message.
+      const absl::Time start = RecvStartTime();
+      const ssize_t s = TEMP_FAILURE_RETRY(
+          util::Syscall(__NR_recvmsg, connection_fd_,
+                        reinterpret_cast<uintptr_t>(&msg), MSG_DONTWAIT));
+      if (s == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return TryRecvResult::kWouldBlock;
+      }
+      if (s <= 0) {
+        if (s == -1) {
+          SAPI_RAW_PLOG(ERROR, "recvmsg");
+        }
+        if (s == 0 || IsFatalError(errno)) {
+          Terminate();
+        }
+        return TryRecvResult::kError;
+      }
+      ABSL_ANNOTATE_MEMORY_IS_INITIALIZED(iov.iov_base, s);
+      RecordRecv(s, start, /*syscall=*/true);
+      partial_message_received_ += s;
+      continue;
+    }
+
+    const size_t buffered = read_ahead_end_ - read_ahead_begin_;
+    size_t needed = sizeof(TLHeader);
+    if (buffered >= sizeof(TLHeader)) {
+      TLHeader header;
+      memcpy(&header, &read_ahead_buffer_[read_ahead_begin_], sizeof(header));
+      if (header.length > GetMaxMsgSize()) {
+        SAPI_RAW_LOG(ERROR, "Maximum TLV message size exceeded: (%zu > %zd)",
+                     header.length, GetMaxMsgSize());
+        return TryRecvResult::kError;
+      }
+      if (header.length > read_ahead_buffer_.size() - sizeof(header)) {
+        RecordMessage(header.tag, /*sent=*/false);
+        read_ahead_begin_ += sizeof(header);
+        if (recv_value_buffer_.size() < header.length) {
+          recv_value_buffer_.resize(header.length);
+        }
+        partial_message_ = true;
+        partial_message_tag_ = header.tag;
+        partial_message_length_ = header.length;
+        partial_message_received_ = 0;
+        continue;
+      }
+      needed += header.length;
+      if (buffered >= needed) {
+        RecordMessage(header.tag, /*sent=*/false);
+        read_ahead_begin_ += sizeof(header);
+        *tag = header.tag;
+        *value = absl::MakeConstSpan(&read_ahead_buffer_[read_ahead_begin_],
+                                     header.length);
+        read_ahead_begin_ += header.length;
+        return TryRecvResult::kOk;
+      }
+    }
+    CompactReadAheadBuffer(needed);
+    if (TryRecvResult status = ReadIntoReadAheadBuffer(/*dont_wait=*/true);
+        status != TryRecvResult::kOk) {
+      return status;
+    }
+  }
 }
 
 bool Comms::RecvTLV(uint32_t* tag, size_t* length, void* buffer,
@@ -636,7 +1603,7 @@ bool Comms::RecvTLV(uint32_t* tag, size_t* length, void* buffer,
     return false;
   }
 
-  return Recv(reinterpret_cast<uint8_t*>(buffer), *length);
+  return RecvLocked(reinterpret_cast<uint8_t*>(buffer), *length);
 }
 
 bool Comms::RecvInt(void* buffer, size_t len, uint32_t tag) {
@@ -26,15 +26,23 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <vector>
 
+#include "google/protobuf/arena.h"
 #include "absl/base/attributes.h"
+#include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/comms_stats.h"
 #include "sandboxed_api/util/status.pb.h"
 
 namespace proto2 {
@@ -63,10 +71,26 @@ class Comms {
   static constexpr uint32_t kTagBytes = 0x80000101;
   static constexpr uint32_t kTagProto2 = 0x80000102;
   static constexpr uint32_t kTagFd = 0X80000201;
+  // Announces a payload passed in a sealed memfd, see
+  // SetSealedBufferThreshold().
+  static constexpr uint32_t kTagSealedBuffer = 0x80000202;
+  // Announces a batch of file descriptors, see SendFDs().
+  static constexpr uint32_t kTagFds = 0x80000203;
 
   // Any payload size above this limit will LOG(WARNING).
   static constexpr size_t kWarnMsgSize = (256ULL << 20);
 
+  // Maximum size of a datagram sent in SOCK_SEQPACKET mode, see
+  // EnableSeqPacket().
+  static constexpr size_t kMaxSeqPacketSize = (64ULL << 10);
+
+  // Default size of each of the two ring buffers used by the shared memory
+  // transport.
+  static constexpr size_t kDefaultRingSize = (1ULL << 20);
+  // Largest ring size of the shared memory transport, it has to fit the 32-bit
+  // size field of the shared header once rounded up to a power of two.
+  static constexpr size_t kMaxRingSize = (1ULL << 31);
+
   // A high file descriptor number to be used with certain fork server request
   // modes to map the target executable. This is considered to be an
   // implementation detail.
@@ -80,6 +104,13 @@ class Comms {
 
   static constexpr DefaultConnectionTag kDefaultConnection = {};
 
+  // A single TLV message, used for sending several messages at once.
+  struct TLV {
+    uint32_t tag;
+    size_t length;
+    const void* value;
+  };
+
   static constexpr const char* kSandbox2CommsFDEnvVar = "SANDBOX2_COMMS_FD";
 
   // This object will have to be connected later on.
@@ -114,6 +145,73 @@ class Comms {
   // Returns the already connected FD.
   int GetConnectionFD() const;
 
+  // Returns whether a receive finds data without waiting for the other end:
+  // data buffered by read-ahead, or data on GetConnectionFD(). Always true
+  // with the shared memory transport, whose readiness cannot be checked.
+  bool HasPendingData();
+
+  // Moves the data stream of this channel onto a shared memory transport: a
+  // memfd-backed buffer holding one ring buffer per direction, so that
+  // messages no longer pass through the kernel. Waiting sides spin briefly and
+  // then sleep on a futex. The socket stays in use for passing file
+  // descriptors and credentials.
+  // Both ends need to switch at the same point in their protocol: one end
+  // calls InitSharedMemoryTransport(), which creates the shared memory and
+  // sends it over the socket, the other end calls
+  // AcceptSharedMemoryTransport(). All messages sent after that go through the
+  // shared memory.
+  // The end calling InitSharedMemoryTransport() detects a vanished peer by
+  // polling the socket and is meant to be the sandboxer. The accepting end
+  // (usually the sandboxee) needs the futex() syscall.
+  // `ring_size` is rounded up to a power of two, sizes above kMaxRingSize are
+  // rejected.
+  bool InitSharedMemoryTransport(size_t ring_size = kDefaultRingSize);
+  bool AcceptSharedMemoryTransport();
+
+  // Returns whether the shared memory transport is in use.
+  bool IsUsingSharedMemory() const { return shm_ != nullptr; }
+
+  // Payloads of SendBytes() and SendProtoBuf() of at least `threshold` bytes
+  // are written into a sealed memfd, which is then passed over the socket
+  // instead of the payload itself. The receiver maps the memfd read-only. Zero
+  // (the default) disables this.
+  // Receiving such payloads is always supported, but requires fstat(), fcntl()
+  // and mmap() on the receiving side. The sending side additionally needs
+  // memfd_create() and ftruncate().
+  void SetSealedBufferThreshold(size_t threshold) {
+    sealed_buffer_threshold_ = threshold;
+  }
+
+  // Enables read-ahead on the receiving side: instead of reading each part of
+  // a TLV message with a separate syscall, as much data as is available on the
+  // socket is pulled into an internal buffer, from which subsequent messages
+  // are parsed. File descriptors received along the way are queued for
+  // RecvFD() and RecvFDs().
+  // Note: Uses recvmsg() instead of read(), so the sandbox policy of the
+  // receiving side must allow that. Buffered data is lost if the underlying
+  // file descriptor is handed over to a different process or Comms object.
+  void EnableReadAhead();
+
+  // Switches to message-preserving mode for SOCK_SEQPACKET sockets, e.g. one
+  // end of socketpair(AF_UNIX, SOCK_SEQPACKET, ...). Every message, or batch
+  // of small messages, is sent as a single datagram and received with a single
+  // recvmsg(), file descriptors travel in the datagram of the message
+  // announcing them. Messages larger than kMaxSeqPacketSize are split across
+  // several datagrams.
+  // Both ends must enable this before the first message is sent. Implies
+  // EnableReadAhead(), and the sending side additionally needs sendmsg().
+  void EnableSeqPacket();
+  bool IsUsingSeqPacket() const { return seqpacket_; }
+
+  // Enables collection of traffic statistics for this channel. Adds a small
+  // cost to every send and receive operation.
+  void EnableStats() { stats_enabled_.store(true, std::memory_order_relaxed); }
+  bool IsStatsEnabled() const {
+    return stats_enabled_.load(std::memory_order_relaxed);
+  }
+  // Returns a snapshot of the statistics collected so far.
+  CommsStats GetStats() const;
+
   bool IsConnected() const { return state_ == State::kConnected; }
   bool IsTerminated() const { return state_ == State::kTerminated; }
 
@@ -125,6 +223,10 @@ class Comms {
   size_t GetMaxMsgSize() const { return std::numeric_limits<int32_t>::max(); }
 
   bool SendTLV(uint32_t tag, size_t length, const void* value);
+  // Sends a batch of TLV messages. The messages are sent back-to-back, without
+  // interleaving with messages from other threads. Small messages are coalesced
+  // so that a whole batch usually requires only a single syscall.
+  bool SendTLVs(absl::Span<const TLV> tlvs);
   // Receive a TLV structure, the memory for the value will be allocated
   // by std::vector.
   bool RecvTLV(uint32_t* tag, std::vector<uint8_t>* value);
@@ -133,6 +235,26 @@ class Comms {
   bool RecvTLV(uint32_t* tag, std::string* value);
   // Receives a TLV value into a specified buffer without allocating memory.
   bool RecvTLV(uint32_t* tag, size_t* length, void* buffer, size_t buffer_size);
+  // Receives a TLV structure into memory owned by this object. The returned
+  // span stays valid until the next receive operation. Memory is reused across
+  // calls, so that in steady state no allocations are made.
+  bool RecvTLV(uint32_t* tag, absl::Span<const uint8_t>* value);
+
+  enum class TryRecvResult {
+    kOk,          // A complete message was received.
+    kWouldBlock,  // No complete message is available yet.
+    kError,       // The connection failed or was terminated.
+  };
+  // Non-blocking variant of RecvTLV() for event loops watching
+  // GetConnectionFD() for readability (e.g. with epoll). Whatever data is
+  // available is consumed, and a partially received message is kept in this
+  // object until the next call completes it. Enables read-ahead, see
+  // EnableReadAhead(). As received data is buffered, callers must keep calling
+  // this until it returns kWouldBlock before waiting for the fd again.
+  // Messages carrying file descriptors must still be received with RecvFD() or
+  // RecvFDs(), and blocking receives must not be used while a message is only
+  // partially received. Sending remains blocking.
+  TryRecvResult TryRecvTLV(uint32_t* tag, absl::Span<const uint8_t>* value);
 
   // Sends/receives various types of data.
   bool RecvUint8(uint8_t* v) { return RecvIntGeneric(v, kTagUint8); }
@@ -167,10 +289,36 @@ class Comms {
   bool RecvFD(int* fd);
   bool SendFD(int fd);
 
+  // Maximum number of file descriptors passed in a single SendFDs() call
+  // (SCM_MAX_FD in the kernel).
+  static constexpr size_t kMaxFDsPerMessage = 253;
+
+  // Receives/sends a batch of file descriptors in a single message.
+  bool RecvFDs(std::vector<int>* fds);
+  bool SendFDs(absl::Span<const int> fds);
+
   // Receives/sends protobufs.
   bool RecvProtoBuf(google::protobuf::MessageLite* message);
   bool SendProtoBuf(const google::protobuf::MessageLite& message);
 
+  // Receives a protobuf allocated on `arena` (or on the heap if `arena` is
+  // nullptr, in which case the caller takes ownership). The message is parsed
+  // straight from the receive buffer.
+  template <typename T>
+  bool RecvProtoBuf(google::protobuf::Arena* arena, T** message) {
+    static_assert(std::is_base_of_v<google::protobuf::MessageLite, T>,
+                  "Template argument must be a proto message");
+    T* result = google::protobuf::Arena::CreateMessage<T>(arena);
+    if (!RecvProtoBuf(result)) {
+      if (arena == nullptr) {
+        delete result;
+      }
+      return false;
+    }
+    *message = result;
+    return true;
+  }
+
   // Receives/sends Status objects.
   bool RecvStatus(absl::Status* status);
   bool SendStatus(const absl::Status& status);
@@ -191,14 +339,60 @@ class Comms {
   int connection_fd_ = -1;
   int bind_fd_ = -1;
 
-  // Mutex making sure that we serialize TLV messages (which consist out of
-  // three different calls to send / receive).
+  // Mutex making sure that we serialize TLV messages (which may consist out of
+  // several different calls to send / receive).
   absl::Mutex tlv_send_transmission_mutex_;
   absl::Mutex tlv_recv_transmission_mutex_;
 
   // State of the channel (enum), socket will have to be connected later on.
   State state_ = State::kUnconnected;
 
+  class SharedMemoryTransport;
+
+  // Value of a kTagSealedBuffer message.
+  struct SealedBufferHeader {
+    uint32_t tag;
+    uint64_t length;
+  };
+
+  // Traffic statistics, see EnableStats().
+  std::atomic<bool> stats_enabled_ = false;
+  mutable absl::Mutex stats_mutex_;
+  CommsStats stats_ ABSL_GUARDED_BY(stats_mutex_);
+
+  // Minimum payload size for using a sealed buffer, zero if disabled.
+  size_t sealed_buffer_threshold_ = 0;
+
+  // Whether the socket is a SOCK_SEQPACKET socket, see EnableSeqPacket().
+  bool seqpacket_ = false;
+
+  // Shared memory transport, if enabled. Once set, it stays alive until the
+  // object is destroyed.
+  std::unique_ptr<SharedMemoryTransport> shm_;
+
+  // Read-ahead state, see EnableReadAhead(). Bytes in the range
+  // [read_ahead_begin_, read_ahead_end_) of read_ahead_buffer_ have been
+  // received but not yet consumed.
+  bool read_ahead_ ABSL_GUARDED_BY(tlv_recv_transmission_mutex_) = false;
+  std::vector<uint8_t> read_ahead_buffer_
+      ABSL_GUARDED_BY(tlv_recv_transmission_mutex_);
+  size_t read_ahead_begin_ ABSL_GUARDED_BY(tlv_recv_transmission_mutex_) = 0;
+  size_t read_ahead_end_ ABSL_GUARDED_BY(tlv_recv_transmission_mutex_) = 0;
+  // File descriptors received during read-ahead, in order of arrival.
+  std::vector<int> read_ahead_fds_
+      ABSL_GUARDED_BY(tlv_recv_transmission_mutex_);
+  // Backing memory for values returned as spans that could not be returned
+  // from the read-ahead buffer directly.
+  std::vector<uint8_t> recv_value_buffer_
+      ABSL_GUARDED_BY(tlv_recv_transmission_mutex_);
+  // State of a message too large for the read-ahead buffer that is partially
+  // received by TryRecvTLV(). The value is collected in recv_value_buffer_.
+  bool partial_message_ ABSL_GUARDED_BY(tlv_recv_transmission_mutex_) = false;
+  uint32_t partial_message_tag_ ABSL_GUARDED_BY(tlv_recv_transmission_mutex_);
+  size_t partial_message_length_ ABSL_GUARDED_BY(tlv_recv_transmission_mutex_);
+  size_t partial_message_received_
+      ABSL_GUARDED_BY(tlv_recv_transmission_mutex_);
+
   // Special struct for passing credentials or FDs. Different from the one above
   // as it inlines the value. This is important as the data is transmitted using
   // sendmsg/recvmsg instead of send/recv.
@@ -207,6 +401,27 @@ class Comms {
     uint32_t len;
   };
 
+  // Header of a TLV message as sent on the wire.
+  struct ABSL_ATTRIBUTE_PACKED TLHeader {
+    uint32_t tag;
+    size_t length;
+  };
+
+  // Messages whose header and value fit into this many bytes are coalesced
+  // into a single write.
+  static constexpr size_t kSendTLVTempBufferSize = 1024;
+
+  // Size of the read-ahead buffer. Values larger than this are received
+  // directly into the destination.
+  static constexpr size_t kReadAheadBufferSize = 64 << 10;
+
+  // Update the traffic statistics, if enabled. `start` is the value returned
+  // by RecvStartTime() before the receive operation.
+  void RecordSend(size_t bytes, bool syscall);
+  absl::Time RecvStartTime() const;
+  void RecordRecv(size_t bytes, absl::Time start, bool syscall);
+  void RecordMessage(uint32_t tag, bool sent);
+
   // Fills sockaddr_un struct with proper values.
   socklen_t CreateSockaddrUn(sockaddr_un* sun);
 
@@ -217,6 +432,62 @@ class Comms {
   bool Send(const void* data, size_t len);
   bool Recv(void* data, size_t len);
 
+  // Sends header and value of a message as a single datagram, in
+  // SOCK_SEQPACKET mode.
+  bool SendDatagram(const TLHeader& header, const void* value, size_t length);
+
+  // Like Recv(), but serves data from the read-ahead buffer (refilling it as
+  // needed).
+  bool RecvBuffered(void* data, size_t len)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+
+  // Makes sure that at least `len` bytes are available in the read-ahead
+  // buffer. `len` must not exceed kReadAheadBufferSize.
+  bool FillReadAheadBuffer(size_t len)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+
+  // Moves pending read-ahead data to the front of the buffer if less than
+  // `len` bytes of contiguous space are left after read_ahead_begin_.
+  void CompactReadAheadBuffer(size_t len)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+
+  // Performs a single recvmsg() into the free space of the read-ahead buffer.
+  // With `dont_wait`, returns kWouldBlock instead of waiting for data.
+  TryRecvResult ReadIntoReadAheadBuffer(bool dont_wait)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+
+  void EnableReadAheadLocked()
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+
+  // Receives exactly `len` bytes, taking read-ahead into account.
+  bool RecvLocked(void* data, size_t len)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+
+  // Variants of the public methods for callers already holding the respective
+  // transmission mutex.
+  bool SendTLVsLocked(absl::Span<const TLV> tlvs)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_send_transmission_mutex_);
+  bool SendFDLocked(int fd)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_send_transmission_mutex_);
+  bool SendFDsLocked(absl::Span<const int> fds)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_send_transmission_mutex_);
+  bool RecvFDLocked(int* fd)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+  bool RecvFDsLocked(std::vector<int>* fds)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+  bool RecvTLVLocked(uint32_t* tag, absl::Span<const uint8_t>* value)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(tlv_recv_transmission_mutex_);
+
+  // Sends `length` bytes as a sealed buffer with the given tag. The `write`
+  // callback fills the buffer.
+  bool SendSealedBuffer(uint32_t tag, size_t length,
+                        absl::FunctionRef<bool(uint8_t*)> write);
+
+  // Receives a TLV message, resolving sealed buffers, and passes tag and value
+  // to `consume`. The value is only valid during the callback.
+  bool RecvPayload(
+      absl::FunctionRef<bool(uint32_t, absl::Span<const uint8_t>)> consume);
+
   // Receives tag and length. Assumes that the `tlv_transmission_mutex_` mutex
   // is locked.
   bool RecvTL(uint32_t* tag, size_t* length)
@@ -0,0 +1,265 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures latency and throughput of the sandbox2::Comms transport.
+// Every benchmark runs over a socketpair (transport:0) and over an abstract
+// unix domain socket set up with Listen/Accept/Connect (transport:1).
+// Use --benchmark_format=json or --benchmark_out=<file> to record results for
+// regression tracking.
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/comms_test.pb.h"
+
+namespace sandbox2 {
+namespace {
+
+constexpr uint32_t kTagPayload = 0x100;
+constexpr uint32_t kTagAck = 0x101;
+
+constexpr int64_t kMinMessageSize = 8;
+constexpr int64_t kMaxMessageSize = 256 << 20;
+
+// Each sender thread in BM_ContendedSendTLV sends this many messages per
+// iteration, amortizing the thread start-up.
+constexpr int kMessagesPerSender = 256;
+
+enum Transport : int64_t {
+  kSocketPair = 0,
+  kAbstractUds = 1,
+};
+
+// A pair of connected Comms objects. The remote end is served by a separate
+// thread in each benchmark.
+struct Connection {
+  std::unique_ptr<Comms> local;
+  std::unique_ptr<Comms> remote;
+};
+
+Connection Connect(int64_t transport) {
+  Connection conn;
+  if (transport == kSocketPair) {
+    int sv[2];
+    CHECK_NE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), -1);
+    conn.local = std::make_unique<Comms>(sv[0]);
+    conn.remote = std::make_unique<Comms>(sv[1]);
+    return conn;
+  }
+  static std::atomic<int> counter = 0;
+  std::string name =
+      absl::StrCat("comms-benchmark-", getpid(), "-", counter++);
+  conn.local = std::make_unique<Comms>(name);
+  CHECK(conn.local->Listen());
+  std::thread connector([&conn, &name] {
+    conn.remote = std::make_unique<Comms>(name);
+    CHECK(conn.remote->Connect());
+  });
+  CHECK(conn.local->Accept());
+  connector.join();
+  return conn;
+}
+
+// Runs `serve` on the remote end until the local end is terminated.
+class Peer {
+ public:
+  template <typename ServeFn>
+  Peer(Connection* conn, ServeFn serve)
+      : conn_(conn), thread_([remote = conn->remote.get(), serve]() mutable {
+          while (serve(remote)) {
+          }
+        }) {}
+
+  ~Peer() {
+    conn_->local->Terminate();
+    thread_.join();
+  }
+
+ private:
+  Connection* conn_;
+  std::thread thread_;
+};
+
+// Message sizes from kMinMessageSize to kMaxMessageSize in steps of 8x.
+std::vector<int64_t> MessageSizes() {
+  std::vector<int64_t> sizes;
+  for (int64_t size = kMinMessageSize; size < kMaxMessageSize; size *= 8) {
+    sizes.push_back(size);
+  }
+  sizes.push_back(kMaxMessageSize);
+  return sizes;
+}
+
+void SetTransportLabel(benchmark::State& state, int64_t transport) {
+  state.SetLabel(transport == kSocketPair ? "socketpair" : "abstract_uds");
+}
+
+// Round trip of a TLV of the given size followed by an empty acknowledgement.
+void BM_TLVRoundTrip(benchmark::State& state) {
+  const size_t size = state.range(0);
+  Connection conn = Connect(state.range(1));
+  Peer peer(&conn, [](Comms* comms) {
+    uint32_t tag;
+    std::vector<uint8_t> value;
+    return comms->RecvTLV(&tag, &value) && comms->SendTLV(kTagAck, 0, nullptr);
+  });
+  std::vector<uint8_t> payload(size, 'x');
+  std::vector<uint8_t> ack;
+  for (auto _ : state) {
+    uint32_t tag;
+    CHECK(conn.local->SendTLV(kTagPayload, payload.size(), payload.data()));
+    CHECK(conn.local->RecvTLV(&tag, &ack));
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  SetTransportLabel(state, state.range(1));
+}
+BENCHMARK(BM_TLVRoundTrip)
+    ->ArgsProduct({MessageSizes(), {kSocketPair, kAbstractUds}})
+    ->ArgNames({"size", "transport"})
+    ->UseRealTime();
+
+// One-way stream of TLVs. The peer only drains, so socket buffering lets the
+// sender pipeline messages; the final buffered messages are not timed.
+void BM_TLVStream(benchmark::State& state) {
+  const size_t size = state.range(0);
+  Connection conn = Connect(state.range(1));
+  Peer peer(&conn, [value = std::vector<uint8_t>()](Comms* comms) mutable {
+    uint32_t tag;
+    return comms->RecvTLV(&tag, &value);
+  });
+  std::vector<uint8_t> payload(size, 'x');
+  for (auto _ : state) {
+    CHECK(conn.local->SendTLV(kTagPayload, payload.size(), payload.data()));
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  SetTransportLabel(state, state.range(1));
+}
+BENCHMARK(BM_TLVStream)
+    ->ArgsProduct({MessageSizes(), {kSocketPair, kAbstractUds}})
+    ->ArgNames({"size", "transport"})
+    ->UseRealTime();
+
+// Passes a file descriptor and waits for the peer to close it.
+void BM_SendFD(benchmark::State& state) {
+  Connection conn = Connect(state.range(0));
+  Peer peer(&conn, [](Comms* comms) {
+    int fd;
+    if (!comms->RecvFD(&fd)) {
+      return false;
+    }
+    close(fd);
+    return comms->SendTLV(kTagAck, 0, nullptr);
+  });
+  int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  CHECK_NE(fd, -1);
+  std::vector<uint8_t> ack;
+  for (auto _ : state) {
+    uint32_t tag;
+    CHECK(conn.local->SendFD(fd));
+    CHECK(conn.local->RecvTLV(&tag, &ack));
+  }
+  close(fd);
+  state.SetItemsProcessed(state.iterations());
+  SetTransportLabel(state, state.range(0));
+}
+BENCHMARK(BM_SendFD)
+    ->ArgsProduct({{kSocketPair, kAbstractUds}})
+    ->ArgNames({"transport"})
+    ->UseRealTime();
+
+// Serializes, sends and parses a message with the given number of fields.
+void BM_SendProtoBuf(benchmark::State& state) {
+  Connection conn = Connect(state.range(1));
+  Peer peer(&conn, [](Comms* comms) {
+    CommsTestMsg msg;
+    return comms->RecvProtoBuf(&msg) && comms->SendTLV(kTagAck, 0, nullptr);
+  });
+  CommsTestMsg msg;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    msg.add_value(absl::StrCat("value-", i));
+  }
+  std::vector<uint8_t> ack;
+  for (auto _ : state) {
+    uint32_t tag;
+    CHECK(conn.local->SendProtoBuf(msg));
+    CHECK(conn.local->RecvTLV(&tag, &ack));
+  }
+  state.SetBytesProcessed(state.iterations() * msg.ByteSizeLong());
+  SetTransportLabel(state, state.range(1));
+}
+BENCHMARK(BM_SendProtoBuf)
+    ->ArgsProduct({{1, 16, 256, 4 << 10, 64 << 10},
+                   {kSocketPair, kAbstractUds}})
+    ->ArgNames({"fields", "transport"})
+    ->UseRealTime();
+
+// Several threads sending on one Comms object while the peer drains.
+void BM_ContendedSendTLV(benchmark::State& state) {
+  const size_t size = state.range(0);
+  const int senders = state.range(1);
+  Connection conn = Connect(state.range(2));
+  Peer peer(&conn, [value = std::vector<uint8_t>()](Comms* comms) mutable {
+    uint32_t tag;
+    return comms->RecvTLV(&tag, &value) &&
+           (tag != kTagAck || comms->SendTLV(kTagAck, 0, nullptr));
+  });
+  std::vector<uint8_t> payload(size, 'x');
+  std::vector<uint8_t> ack;
+  for (auto _ : state) {
+    std::vector<std::thread> threads;
+    threads.reserve(senders);
+    for (int i = 0; i < senders; ++i) {
+      threads.emplace_back([&conn, &payload] {
+        for (int j = 0; j < kMessagesPerSender; ++j) {
+          CHECK(conn.local->SendTLV(kTagPayload, payload.size(),
+                                    payload.data()));
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    // Wait until the peer has drained everything.
+    uint32_t tag;
+    CHECK(conn.local->SendTLV(kTagAck, 0, nullptr));
+    CHECK(conn.local->RecvTLV(&tag, &ack));
+  }
+  const int64_t messages = state.iterations() * senders * kMessagesPerSender;
+  state.SetItemsProcessed(messages);
+  state.SetBytesProcessed(messages * size);
+  SetTransportLabel(state, state.range(2));
+}
+BENCHMARK(BM_ContendedSendTLV)
+    ->ArgsProduct({{64, 4 << 10, 256 << 10},
+                   {1, 2, 4, 8},
+                   {kSocketPair, kAbstractUds}})
+    ->ArgNames({"size", "senders", "transport"})
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace sandbox2
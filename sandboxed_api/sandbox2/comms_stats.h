@@ -0,0 +1,61 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Statistics about the traffic on a Comms channel, see Comms::EnableStats().
+
+#ifndef SANDBOXED_API_SANDBOX2_COMMS_STATS_H_
+#define SANDBOXED_API_SANDBOX2_COMMS_STATS_H_
+
+#include <array>
+#include <cstdint>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/time/time.h"
+
+namespace sandbox2 {
+
+struct CommsStats {
+  // Number of buckets of recv_latency_histogram.
+  static constexpr int kNumRecvLatencyBuckets = 24;
+
+  // Returns the histogram bucket for a receive that took `duration`.
+  static int RecvLatencyBucket(absl::Duration duration) {
+    int64_t us = absl::ToInt64Microseconds(duration);
+    int bucket = 0;
+    while (us > 0 && bucket < kNumRecvLatencyBuckets - 1) {
+      us >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+
+  uint64_t bytes_sent = 0;
+  uint64_t bytes_received = 0;
+  // Number of syscalls used for sending/receiving. Zero while the shared
+  // memory transport is in use, as it doesn't need any.
+  uint64_t send_syscalls = 0;
+  uint64_t recv_syscalls = 0;
+  // Time spent waiting for, and reading, incoming data.
+  absl::Duration recv_time = absl::ZeroDuration();
+  // Number of messages by tag.
+  absl::flat_hash_map<uint32_t, uint64_t> messages_sent;
+  absl::flat_hash_map<uint32_t, uint64_t> messages_received;
+  // Bucket i counts receive operations that took less than 2^i microseconds.
+  // The last bucket also counts all longer ones.
+  std::array<uint64_t, kNumRecvLatencyBuckets> recv_latency_histogram = {};
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_COMMS_STATS_H_
@@ -16,6 +16,7 @@
 #include "sandboxed_api/sandbox2/comms.h"
 
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 
@@ -25,7 +26,9 @@
 #include <sstream>
 #include <thread>  // NOLINT(build/c++11)
 #include <utility>
+#include <vector>
 
+#include "google/protobuf/arena.h"
 #include "google/protobuf/text_format.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -40,8 +43,10 @@
 using ::sapi::IsOk;
 using ::sapi::StatusIs;
 using ::testing::Eq;
+using ::testing::Ge;
 using ::testing::IsFalse;
 using ::testing::IsTrue;
+using ::testing::Ne;
 
 namespace sandbox2 {
 
@@ -314,6 +319,29 @@ TEST_P(CommsTest, TestSendRecvProto) {
   HandleCommunication(sockname_, use_abstract_socket_, a, b);
 }
 
+TEST_P(CommsTest, TestSendRecvProtoOnArena) {
+  auto a = [](Comms* comms) {
+    google::protobuf::Arena arena;
+    CommsTestMsg* comms_msg = nullptr;
+    ASSERT_THAT(comms->RecvProtoBuf(&arena, &comms_msg), IsTrue());
+    ASSERT_THAT(comms_msg, Ne(nullptr));
+    EXPECT_THAT(comms_msg->GetArena(), Eq(&arena));
+    ASSERT_THAT(comms_msg->value_size(), Eq(1));
+    EXPECT_THAT(comms_msg->value(0), Eq(kProtoStr));
+    // Without an arena, the message is heap-allocated.
+    ASSERT_THAT(comms->RecvProtoBuf(nullptr, &comms_msg), IsTrue());
+    std::unique_ptr<CommsTestMsg> owned(comms_msg);
+    EXPECT_THAT(owned->value_size(), Eq(1));
+  };
+  auto b = [](Comms* comms) {
+    CommsTestMsg comms_msg;
+    comms_msg.add_value(kProtoStr);
+    ASSERT_THAT(comms->SendProtoBuf(comms_msg), IsTrue());
+    ASSERT_THAT(comms->SendProtoBuf(comms_msg), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
 TEST_P(CommsTest, TestSendRecvStatusOK) {
   auto a = [](Comms* comms) {
     // Receive a good status.
@@ -371,6 +399,42 @@ TEST_P(CommsTest, TestUsesDistinctBuffers) {
   HandleCommunication(sockname_, use_abstract_socket_, a, b);
 }
 
+TEST_P(CommsTest, TestSendRecvFDs) {
+  auto a = [](Comms* comms) {
+    std::vector<int> fds;
+    ASSERT_THAT(comms->RecvFDs(&fds), IsTrue());
+    ASSERT_THAT(fds.size(), Eq(3));
+    for (int fd : fds) {
+      EXPECT_NE(fcntl(fd, F_GETFD), -1);
+      close(fd);
+    }
+    // An empty batch.
+    ASSERT_THAT(comms->RecvFDs(&fds), IsTrue());
+    EXPECT_THAT(fds.empty(), IsTrue());
+    // A single fd sent with SendFD() can be received as a batch and vice versa.
+    ASSERT_THAT(comms->RecvFDs(&fds), IsTrue());
+    ASSERT_THAT(fds.size(), Eq(1));
+    close(fds[0]);
+    int fd = -1;
+    ASSERT_THAT(comms->RecvFD(&fd), IsTrue());
+    EXPECT_NE(fcntl(fd, F_GETFD), -1);
+    close(fd);
+    // Batches of more than one fd can't be received with RecvFD().
+    EXPECT_THAT(comms->RecvFD(&fd), IsFalse());
+  };
+  auto b = [](Comms* comms) {
+    ASSERT_THAT(comms->SendFDs({STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO}),
+                IsTrue());
+    ASSERT_THAT(comms->SendFDs({}), IsTrue());
+    ASSERT_THAT(comms->SendFD(STDERR_FILENO), IsTrue());
+    ASSERT_THAT(comms->SendFDs({STDERR_FILENO}), IsTrue());
+    ASSERT_THAT(comms->SendFDs({STDOUT_FILENO, STDERR_FILENO}), IsTrue());
+    std::vector<int> too_many(Comms::kMaxFDsPerMessage + 1, STDERR_FILENO);
+    EXPECT_THAT(comms->SendFDs(too_many), IsFalse());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
 TEST_P(CommsTest, TestSendRecvCredentials) {
   auto a = [](Comms* comms) {
     // Check credentials.
@@ -417,6 +481,342 @@ TEST_P(CommsTest, TestSendRecvBytes) {
   HandleCommunication(sockname_, use_abstract_socket_, a, b);
 }
 
+TEST_P(CommsTest, TestSendRecvTLVs) {
+  const std::string large(Comms::kWarnMsgSize / (1 << 18), 'X');
+  auto a = [&large](Comms* comms) {
+    uint32_t tag;
+    std::string value;
+    ASSERT_THAT(comms->RecvTLV(&tag, &value), IsTrue());
+    EXPECT_THAT(tag, Eq(0x00000001));
+    EXPECT_THAT(value, Eq("first"));
+    ASSERT_THAT(comms->RecvTLV(&tag, &value), IsTrue());
+    EXPECT_THAT(tag, Eq(0x00000002));
+    EXPECT_THAT(value, Eq(""));
+    ASSERT_THAT(comms->RecvTLV(&tag, &value), IsTrue());
+    EXPECT_THAT(tag, Eq(0x00000003));
+    EXPECT_THAT(value, Eq(large));
+    uint32_t v;
+    ASSERT_THAT(comms->RecvUint32(&v), IsTrue());
+    EXPECT_THAT(v, Eq(42));
+  };
+  auto b = [&large](Comms* comms) {
+    const uint32_t v = 42;
+    const Comms::TLV tlvs[] = {
+        {0x00000001, 5, "first"},
+        {0x00000002, 0, nullptr},
+        {0x00000003, large.size(), large.data()},
+        {Comms::kTagUint32, sizeof(v), &v},
+    };
+    ASSERT_THAT(comms->SendTLVs(tlvs), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestSendTLVsTooMuchData) {
+  auto a = [](Comms* comms) {
+    // Nothing to do here.
+  };
+  auto b = [](Comms* comms) {
+    // Nothing is sent if any of the messages is too large.
+    const Comms::TLV tlvs[] = {
+        {0x00000001, 5, "first"},
+        {0x00000002, comms->GetMaxMsgSize() + 1, nullptr},
+    };
+    ASSERT_THAT(comms->SendTLVs(tlvs), IsFalse());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestRecvTLVSpan) {
+  auto a = [](Comms* comms) {
+    uint32_t tag;
+    absl::Span<const uint8_t> value;
+    ASSERT_THAT(comms->RecvTLV(&tag, &value), IsTrue());
+    EXPECT_THAT(tag, Eq(Comms::kTagString));
+    EXPECT_THAT(std::string(value.begin(), value.end()), Eq("Hello"));
+    ASSERT_THAT(comms->RecvTLV(&tag, &value), IsTrue());
+    EXPECT_THAT(tag, Eq(0x00DEADBE));
+    EXPECT_THAT(value.size(), Eq(0));
+  };
+  auto b = [](Comms* comms) {
+    ASSERT_THAT(comms->SendString("Hello"), IsTrue());
+    ASSERT_THAT(comms->SendTLV(0x00DEADBE, 0, nullptr), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestSealedBuffer) {
+  const std::vector<uint8_t> large(100 << 10, 0xAB);
+  const std::string large_string(100 << 10, 'x');
+  auto a = [&large, &large_string](Comms* comms) {
+    std::vector<uint8_t> bytes;
+    ASSERT_THAT(comms->RecvBytes(&bytes), IsTrue());
+    EXPECT_THAT(bytes, Eq(large));
+    // Payloads below the threshold are sent inline.
+    ASSERT_THAT(comms->RecvBytes(&bytes), IsTrue());
+    EXPECT_THAT(bytes, Eq(std::vector<uint8_t>{1, 2, 3}));
+    CommsTestMsg msg;
+    ASSERT_THAT(comms->RecvProtoBuf(&msg), IsTrue());
+    ASSERT_THAT(msg.value_size(), Eq(1));
+    EXPECT_THAT(msg.value(0), Eq(large_string));
+    // A sealed buffer with a different tag is rejected.
+    EXPECT_THAT(comms->RecvProtoBuf(&msg), IsFalse());
+  };
+  auto b = [&large, &large_string](Comms* comms) {
+    comms->SetSealedBufferThreshold(64 << 10);
+    ASSERT_THAT(comms->SendBytes(large), IsTrue());
+    ASSERT_THAT(comms->SendBytes({1, 2, 3}), IsTrue());
+    CommsTestMsg msg;
+    msg.add_value(large_string);
+    ASSERT_THAT(comms->SendProtoBuf(msg), IsTrue());
+    ASSERT_THAT(comms->SendBytes(large), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestReadAhead) {
+  auto a = [](Comms* comms) {
+    comms->EnableReadAhead();
+    ASSERT_THAT(comms->SendBool(true), IsTrue());
+
+    for (int i = 0; i < 100; ++i) {
+      uint32_t tag;
+      absl::Span<const uint8_t> value;
+      ASSERT_THAT(comms->RecvTLV(&tag, &value), IsTrue());
+      EXPECT_THAT(tag, Eq(Comms::kTagString));
+      EXPECT_THAT(std::string(value.begin(), value.end()),
+                  Eq(absl::StrCat("Message ", i)));
+    }
+    int fd = -1;
+    ASSERT_THAT(comms->RecvFD(&fd), IsTrue());
+    EXPECT_GE(fd, 0);
+    EXPECT_NE(fcntl(fd, F_GETFD), -1);
+    close(fd);
+    std::vector<int> fds;
+    ASSERT_THAT(comms->RecvFDs(&fds), IsTrue());
+    ASSERT_THAT(fds.size(), Eq(2));
+    for (int fd : fds) {
+      EXPECT_NE(fcntl(fd, F_GETFD), -1);
+      close(fd);
+    }
+
+    std::vector<uint8_t> buffer;
+    ASSERT_THAT(comms->RecvBytes(&buffer), IsTrue());
+    EXPECT_THAT(buffer.size(), Eq(1024 * 1024));
+    EXPECT_THAT(buffer[1024 * 1024 - 1], Eq(0x42));
+    int32_t v;
+    ASSERT_THAT(comms->RecvInt32(&v), IsTrue());
+    EXPECT_THAT(v, Eq(-1));
+  };
+  auto b = [](Comms* comms) {
+    // Wait for the receiver to enable read-ahead.
+    bool ready;
+    ASSERT_THAT(comms->RecvBool(&ready), IsTrue());
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_THAT(comms->SendString(absl::StrCat("Message ", i)), IsTrue());
+    }
+    ASSERT_THAT(comms->SendFD(STDERR_FILENO), IsTrue());
+    ASSERT_THAT(comms->SendFDs({STDOUT_FILENO, STDERR_FILENO}), IsTrue());
+    std::vector<uint8_t> buffer(1024 * 1024, 0x42);
+    ASSERT_THAT(comms->SendBytes(buffer), IsTrue());
+    ASSERT_THAT(comms->SendInt32(-1), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestTryRecvTLV) {
+  auto a = [](Comms* comms) {
+    uint32_t tag;
+    absl::Span<const uint8_t> value;
+    EXPECT_THAT(comms->TryRecvTLV(&tag, &value),
+                Eq(Comms::TryRecvResult::kWouldBlock));
+    ASSERT_THAT(comms->SendBool(true), IsTrue());
+
+    std::vector<std::string> received;
+    while (received.size() < 3) {
+      Comms::TryRecvResult status = comms->TryRecvTLV(&tag, &value);
+      ASSERT_THAT(status, Ne(Comms::TryRecvResult::kError));
+      if (status == Comms::TryRecvResult::kWouldBlock) {
+        pollfd pfd = {.fd = comms->GetConnectionFD(), .events = POLLIN};
+        ASSERT_THAT(poll(&pfd, 1, -1), Eq(1));
+        continue;
+      }
+      received.emplace_back(value.begin(), value.end());
+    }
+    EXPECT_THAT(received[0], Eq("Hello"));
+    EXPECT_THAT(received[1], Eq(std::string(1024 * 1024, 'x')));
+    EXPECT_THAT(received[2], Eq("Done"));
+    // Blocking receives can be mixed in between messages.
+    int32_t v;
+    ASSERT_THAT(comms->RecvInt32(&v), IsTrue());
+    EXPECT_THAT(v, Eq(-1));
+  };
+  auto b = [](Comms* comms) {
+    bool ready;
+    ASSERT_THAT(comms->RecvBool(&ready), IsTrue());
+    ASSERT_THAT(comms->SendString("Hello"), IsTrue());
+    ASSERT_THAT(comms->SendString(std::string(1024 * 1024, 'x')), IsTrue());
+    ASSERT_THAT(comms->SendString("Done"), IsTrue());
+    ASSERT_THAT(comms->SendInt32(-1), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST(CommsSeqPacketTest, TestSendRecv) {
+  int sv[2];
+  ASSERT_THAT(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), Ne(-1));
+  Comms sender(sv[0]);
+  Comms receiver(sv[1]);
+  sender.EnableSeqPacket();
+  receiver.EnableSeqPacket();
+
+  std::thread remote([&sender] {
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_THAT(sender.SendString(absl::StrCat("Message ", i)), IsTrue());
+    }
+    // Too large to be coalesced, but still a single datagram.
+    ASSERT_THAT(sender.SendString(std::string(32 << 10, 'x')), IsTrue());
+    ASSERT_THAT(sender.SendFDs({STDOUT_FILENO, STDERR_FILENO}), IsTrue());
+    // Split across several datagrams.
+    ASSERT_THAT(sender.SendBytes(std::vector<uint8_t>(1024 * 1024, 0x42)),
+                IsTrue());
+    ASSERT_THAT(sender.SendInt32(-1), IsTrue());
+  });
+
+  for (int i = 0; i < 100; ++i) {
+    std::string s;
+    ASSERT_THAT(receiver.RecvString(&s), IsTrue());
+    EXPECT_THAT(s, Eq(absl::StrCat("Message ", i)));
+  }
+  std::string s;
+  ASSERT_THAT(receiver.RecvString(&s), IsTrue());
+  EXPECT_THAT(s, Eq(std::string(32 << 10, 'x')));
+  std::vector<int> fds;
+  ASSERT_THAT(receiver.RecvFDs(&fds), IsTrue());
+  ASSERT_THAT(fds.size(), Eq(2));
+  for (int fd : fds) {
+    EXPECT_NE(fcntl(fd, F_GETFD), -1);
+    close(fd);
+  }
+  std::vector<uint8_t> buffer;
+  ASSERT_THAT(receiver.RecvBytes(&buffer), IsTrue());
+  EXPECT_THAT(buffer, Eq(std::vector<uint8_t>(1024 * 1024, 0x42)));
+  int32_t v;
+  ASSERT_THAT(receiver.RecvInt32(&v), IsTrue());
+  EXPECT_THAT(v, Eq(-1));
+  remote.join();
+}
+
+TEST_P(CommsTest, TestStats) {
+  auto a = [](Comms* comms) {
+    comms->EnableStats();
+    ASSERT_THAT(comms->SendBool(true), IsTrue());
+    std::string str;
+    ASSERT_THAT(comms->RecvString(&str), IsTrue());
+    ASSERT_THAT(comms->RecvString(&str), IsTrue());
+    int fd;
+    ASSERT_THAT(comms->RecvFD(&fd), IsTrue());
+    close(fd);
+
+    CommsStats stats = comms->GetStats();
+    EXPECT_THAT(stats.messages_sent[Comms::kTagBool], Eq(1));
+    EXPECT_THAT(stats.messages_received[Comms::kTagString], Eq(2));
+    EXPECT_THAT(stats.messages_received[Comms::kTagFd], Eq(1));
+    EXPECT_THAT(stats.send_syscalls, Eq(1));
+    EXPECT_THAT(stats.bytes_received, Ge(10));  // "Hello" and "World"
+    EXPECT_THAT(stats.recv_syscalls, Ge(3));
+    uint64_t num_recvs = 0;
+    for (uint64_t count : stats.recv_latency_histogram) {
+      num_recvs += count;
+    }
+    EXPECT_THAT(num_recvs, Eq(stats.recv_syscalls));
+  };
+  auto b = [](Comms* comms) {
+    bool ready;
+    ASSERT_THAT(comms->RecvBool(&ready), IsTrue());
+    ASSERT_THAT(comms->SendString("Hello"), IsTrue());
+    ASSERT_THAT(comms->SendString("World"), IsTrue());
+    ASSERT_THAT(comms->SendFD(STDERR_FILENO), IsTrue());
+    // Nothing is recorded unless enabled.
+    CommsStats stats = comms->GetStats();
+    EXPECT_THAT(stats.bytes_sent, Eq(0));
+    EXPECT_THAT(stats.messages_sent.empty(), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestSharedMemoryTransport) {
+  auto a = [](Comms* comms) {
+    ASSERT_THAT(comms->AcceptSharedMemoryTransport(), IsTrue());
+    EXPECT_THAT(comms->IsUsingSharedMemory(), IsTrue());
+    std::string str;
+    ASSERT_THAT(comms->RecvString(&str), IsTrue());
+    EXPECT_THAT(str, Eq("Hello"));
+    std::vector<uint8_t> buffer;
+    ASSERT_THAT(comms->RecvBytes(&buffer), IsTrue());
+    ASSERT_THAT(buffer.size(), Eq(1024 * 1024));
+    for (size_t i = 0; i < buffer.size(); ++i) {
+      ASSERT_THAT(buffer[i], Eq(static_cast<uint8_t>(i)));
+    }
+    // File descriptors still go through the socket.
+    int fd = -1;
+    ASSERT_THAT(comms->RecvFD(&fd), IsTrue());
+    EXPECT_NE(fcntl(fd, F_GETFD), -1);
+    close(fd);
+    ASSERT_THAT(comms->SendBytes(buffer), IsTrue());
+    // The peer terminates its end.
+    uint32_t v;
+    EXPECT_THAT(comms->RecvUint32(&v), IsFalse());
+    EXPECT_THAT(comms->IsTerminated(), IsTrue());
+  };
+  auto b = [](Comms* comms) {
+    ASSERT_THAT(comms->InitSharedMemoryTransport(64 << 10), IsTrue());
+    EXPECT_THAT(comms->IsUsingSharedMemory(), IsTrue());
+    ASSERT_THAT(comms->SendString("Hello"), IsTrue());
+    std::vector<uint8_t> buffer(1024 * 1024);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+      buffer[i] = static_cast<uint8_t>(i);
+    }
+    ASSERT_THAT(comms->SendBytes(buffer), IsTrue());
+    ASSERT_THAT(comms->SendFD(STDERR_FILENO), IsTrue());
+    std::vector<uint8_t> response;
+    ASSERT_THAT(comms->RecvBytes(&response), IsTrue());
+    EXPECT_THAT(response, Eq(buffer));
+    comms->Terminate();
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestSharedMemoryTransportDetectsPeerExit) {
+  auto a = [](Comms* comms) {
+    ASSERT_THAT(comms->AcceptSharedMemoryTransport(), IsTrue());
+    // This end does not terminate the shared memory explicitly, shutting down
+    // the socket must be enough.
+    shutdown(comms->GetConnectionFD(), SHUT_RDWR);
+  };
+  auto b = [](Comms* comms) {
+    ASSERT_THAT(comms->InitSharedMemoryTransport(), IsTrue());
+    uint32_t v;
+    EXPECT_THAT(comms->RecvUint32(&v), IsFalse());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
+TEST_P(CommsTest, TestSharedMemoryTransportRejectsOversizedRing) {
+  auto a = [](Comms* comms) {
+    uint32_t v;
+    ASSERT_THAT(comms->RecvUint32(&v), IsTrue());
+    EXPECT_THAT(v, Eq(42));
+  };
+  auto b = [](Comms* comms) {
+    EXPECT_THAT(comms->InitSharedMemoryTransport(Comms::kMaxRingSize + 1),
+                IsFalse());
+    EXPECT_THAT(comms->IsUsingSharedMemory(), IsFalse());
+    ASSERT_THAT(comms->SendUint32(42), IsTrue());
+  };
+  HandleCommunication(sockname_, use_abstract_socket_, a, b);
+}
+
 class SenderThread {
  public:
   SenderThread(Comms* comms, size_t rounds) : comms_(comms), rounds_(rounds) {}
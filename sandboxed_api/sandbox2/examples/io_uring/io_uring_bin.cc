@@ -0,0 +1,174 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This file is an example of an I/O-heavy binary which is intended to be
+// sandboxed by the sandbox2. It copies its input to its output twice, with
+// one pread() and pwrite() per block and with a RestrictedIoUring, and reports
+// how long each copy took.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/client.h"
+#include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/util/io_uring.h"
+
+ABSL_FLAG(uint32_t, block_size, 64 << 10, "Bytes read and written at once.");
+ABSL_FLAG(uint32_t, queue_depth, 32,
+          "Maximum number of blocks in flight with io_uring.");
+
+namespace {
+
+constexpr int kInput = 0;
+constexpr int kOutput = 1;
+
+bool CopyWithSyscalls(int in, int out, uint64_t size, uint32_t block_size) {
+  std::vector<char> buf(block_size);
+  for (uint64_t offset = 0; offset < size;) {
+    const ssize_t read =
+        pread(in, buf.data(), std::min<uint64_t>(block_size, size - offset),
+              offset);
+    if (read <= 0 || pwrite(out, buf.data(), read, offset) != read) {
+      return false;
+    }
+    offset += read;
+  }
+  return true;
+}
+
+// Keeps up to `queue_depth` blocks in flight, each of which is read and then
+// written back at the same offset, before its buffer is reused.
+absl::Status CopyWithIoUring(sandbox2::RestrictedIoUring& ring, uint64_t size,
+                             uint32_t block_size, uint32_t queue_depth) {
+  struct Block {
+    std::vector<char> buf;
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    // Bytes of the block read, but not written yet.
+    uint32_t pending = 0;
+  };
+  std::vector<Block> blocks(queue_depth);
+  uint64_t next_offset = 0;
+  int in_flight = 0;
+  // user_data is the index of the block, shifted left by one, with the lowest
+  // bit set for writes.
+  auto read_next = [&](uint64_t index) {
+    Block& block = blocks[index];
+    if (block.length == 0) {
+      if (next_offset == size) {
+        return;
+      }
+      block.offset = next_offset;
+      block.length = std::min<uint64_t>(block_size, size - next_offset);
+      next_offset += block.length;
+    }
+    ring.PrepareRead(kInput, block.buf.data(), block.length, block.offset,
+                     index << 1);
+    ++in_flight;
+  };
+  for (uint64_t i = 0; i < blocks.size(); ++i) {
+    blocks[i].buf.resize(block_size);
+    read_next(i);
+  }
+  while (in_flight > 0) {
+    if (absl::Status status = ring.Submit(1); !status.ok()) {
+      return status;
+    }
+    sandbox2::RestrictedIoUring::Completion completion;
+    while (ring.NextCompletion(&completion)) {
+      --in_flight;
+      const uint64_t index = completion.user_data >> 1;
+      const bool was_write = completion.user_data & 1;
+      Block& block = blocks[index];
+      if (completion.result <= 0) {
+        return absl::InternalError(
+            absl::StrCat(was_write ? "Write" : "Read", " at ", block.offset,
+                         " failed: ", completion.result));
+      }
+      if (!was_write) {
+        block.pending = completion.result;
+        ring.PrepareWrite(kOutput, block.buf.data(), block.pending,
+                          block.offset, index << 1 | 1);
+        ++in_flight;
+        continue;
+      }
+      if (static_cast<uint32_t>(completion.result) != block.pending) {
+        return absl::InternalError(
+            absl::StrCat("Short write at ", block.offset));
+      }
+      // Short reads leave the rest of the block to be read again.
+      block.offset += block.pending;
+      block.length -= block.pending;
+      read_next(index);
+    }
+  }
+  return ring.Submit();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  const uint32_t block_size = absl::GetFlag(FLAGS_block_size);
+  const uint32_t queue_depth = absl::GetFlag(FLAGS_queue_depth);
+
+  sandbox2::Comms comms(sandbox2::Comms::kDefaultConnection);
+  sandbox2::Client sandbox2_client(&comms);
+  int in = -1;
+  int out = -1;
+  absl::StatusOr<sandbox2::RestrictedIoUring> ring;
+  // The ring has to be set up before the policy is applied, which doesn't
+  // allow io_uring_setup().
+  sandbox2_client.SandboxMeHere([&] {
+    in = sandbox2_client.GetMappedFD("input");
+    out = sandbox2_client.GetMappedFD("output");
+    ring = sandbox2::RestrictedIoUring::Create(queue_depth, {in, out});
+  });
+
+  uint64_t size;
+  if (!comms.RecvUint64(&size)) {
+    return 1;
+  }
+  absl::Time start = absl::Now();
+  if (!CopyWithSyscalls(in, out, size, block_size)) {
+    return 2;
+  }
+  if (!comms.SendInt64(absl::ToInt64Nanoseconds(absl::Now() - start))) {
+    return 3;
+  }
+
+  // Reported as -1 if io_uring is not available, e.g. disabled on the host.
+  int64_t ring_ns = -1;
+  if (ring.ok()) {
+    start = absl::Now();
+    if (!CopyWithIoUring(*ring, size, block_size, queue_depth).ok()) {
+      return 4;
+    }
+    ring_ns = absl::ToInt64Nanoseconds(absl::Now() - start);
+  }
+  if (!comms.SendInt64(ring_ns)) {
+    return 5;
+  }
+  return 0;
+}
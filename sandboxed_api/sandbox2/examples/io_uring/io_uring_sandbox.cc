@@ -0,0 +1,159 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A demo sandbox for the io_uring_bin binary, comparing the throughput of
+// copying a file with read/write syscalls and with a restricted io_uring.
+
+#include <sys/mman.h>
+#include <syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/log_severity.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/globals.h"
+#include "absl/log/initialize.h"
+#include "absl/log/log.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/config.h"
+#include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/executor.h"
+#include "sandboxed_api/sandbox2/limits.h"
+#include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/policybuilder.h"
+#include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/util/runfiles.h"
+
+ABSL_FLAG(uint64_t, size_mib, 256, "Size of the copied file, in MiB.");
+ABSL_FLAG(uint32_t, block_size, 64 << 10, "Bytes read and written at once.");
+ABSL_FLAG(uint32_t, queue_depth, 32,
+          "Maximum number of blocks in flight with io_uring.");
+
+namespace {
+
+std::unique_ptr<sandbox2::Policy> GetPolicy() {
+  return sandbox2::PolicyBuilder()
+      // Safe, as we only allow I/O on existing FDs.
+      .DisableNamespaces()
+      .AllowRead()
+      .AllowWrite()
+      .AllowSyscalls({__NR_pread64, __NR_pwrite64, __NR_close})
+      // Only the ring set up by the sandboxee before the policy applied.
+      .AllowIoUring()
+      .AllowSystemMalloc()
+      .AllowTime()
+      .AllowExit()
+      .AllowLlvmSanitizers()  // Will be a no-op when not using sanitizers.
+      .BuildOrDie();
+}
+
+std::string Throughput(uint64_t size, int64_t ns) {
+  if (ns <= 0) {
+    return "not available";
+  }
+  const double seconds = absl::ToDoubleSeconds(absl::Nanoseconds(ns));
+  return absl::StrCat(static_cast<uint64_t>(size / seconds / (1 << 20)),
+                      " MiB/s");
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+
+  const uint64_t size = absl::GetFlag(FLAGS_size_mib) << 20;
+  int in = memfd_create("input", 0);
+  int out = memfd_create("output", 0);
+  if (in == -1 || out == -1 || ftruncate(out, size) == -1) {
+    PLOG(ERROR) << "Creating the files failed";
+    return 1;
+  }
+  std::vector<char> pattern(1 << 20);
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    pattern[i] = static_cast<char>(i * 131);
+  }
+  for (uint64_t offset = 0; offset < size; offset += pattern.size()) {
+    if (pwrite(in, pattern.data(), pattern.size(), offset) !=
+        static_cast<ssize_t>(pattern.size())) {
+      PLOG(ERROR) << "Writing the input failed";
+      return 1;
+    }
+  }
+
+  // Note: In your own code, use sapi::GetDataDependencyFilePath() instead.
+  const std::string path = sapi::internal::GetSapiDataDependencyFilePath(
+      "sandbox2/examples/io_uring/io_uring_bin");
+  std::vector<std::string> args = {
+      path,
+      absl::StrCat("--block_size=", absl::GetFlag(FLAGS_block_size)),
+      absl::StrCat("--queue_depth=", absl::GetFlag(FLAGS_queue_depth)),
+  };
+  auto executor = std::make_unique<sandbox2::Executor>(path, args);
+  executor
+      // The sandboxee enables sandboxing itself, after setting up its ring.
+      ->set_enable_sandbox_before_exec(false)
+      .limits()
+      ->set_rlimit_cpu(60)
+      .set_walltime_limit(absl::Seconds(60));
+  // Keep local copies to check the output, the mapped ones are closed.
+  executor->ipc()->MapFd(dup(in), "input");
+  executor->ipc()->MapFd(dup(out), "output");
+
+  sandbox2::Sandbox2 s2(std::move(executor), GetPolicy());
+  if (!s2.RunAsync()) {
+    LOG(ERROR) << "RunAsync failed: " << s2.AwaitResult().ToString();
+    return 2;
+  }
+  sandbox2::Comms* comms = s2.comms();
+  int64_t syscalls_ns;
+  int64_t ring_ns;
+  if (!comms->SendUint64(size) || !comms->RecvInt64(&syscalls_ns) ||
+      !comms->RecvInt64(&ring_ns)) {
+    LOG(ERROR) << "Communicating with the sandboxee failed";
+    s2.Kill();
+  }
+  sandbox2::Result result = s2.AwaitResult();
+  if (result.final_status() != sandbox2::Result::OK) {
+    LOG(ERROR) << "Sandbox error: " << result.ToString();
+    return 3;  // e.g. sandbox violation, signal (sigsegv)
+  }
+  if (result.reason_code() != 0) {
+    LOG(ERROR) << "Sandboxee exited with non-zero: " << result.reason_code();
+    return 4;
+  }
+
+  void* input = mmap(nullptr, size, PROT_READ, MAP_SHARED, in, 0);
+  void* output = mmap(nullptr, size, PROT_READ, MAP_SHARED, out, 0);
+  if (input == MAP_FAILED || output == MAP_FAILED ||
+      memcmp(input, output, size) != 0) {
+    LOG(ERROR) << "The output differs from the input";
+    return 5;
+  }
+  printf("read/write: %s\n", Throughput(size, syscalls_ns).c_str());
+  printf("io_uring:   %s\n", Throughput(size, ring_ns).c_str());
+  return EXIT_SUCCESS;
+}
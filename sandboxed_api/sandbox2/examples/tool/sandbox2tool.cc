@@ -21,16 +21,24 @@
 //     --sandbox2_danger_danger_permit_all
 //     --logtostderr
 //     /bin/ls
+//
+// To measure the sandboxing overhead for a binary, add e.g.
+//   --sandbox2tool_bench_iterations=100 --sandbox2tool_bench_parallel=4
 
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <csignal>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
 #include <utility>
 #include <vector>
 
@@ -40,8 +48,11 @@
 #include "absl/log/globals.h"
 #include "absl/log/initialize.h"
 #include "absl/log/log.h"
+#include "absl/status/status.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/allow_all_syscalls.h"
 #include "sandboxed_api/sandbox2/executor.h"
@@ -51,8 +62,10 @@
 #include "sandboxed_api/sandbox2/policybuilder.h"
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/sandbox2/trace.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
+#include "sandboxed_api/util/file_helpers.h"
 #include "sandboxed_api/util/fileops.h"
 
 ABSL_FLAG(bool, sandbox2tool_keep_env, false,
@@ -87,6 +100,15 @@ ABSL_FLAG(std::string, sandbox2tool_additional_bind_mounts, "",
           "bind mounts. Mounts are separated by comma and can optionally "
           "specify a target using \"=>\" "
           "(e.g. \"/usr,/bin,/lib,/tmp/foo=>/etc/passwd\")");
+ABSL_FLAG(uint64_t, sandbox2tool_bench_iterations, 0,
+          "If > 0, launch the command this many times and print a summary of "
+          "the per-phase timings instead of running it once");
+ABSL_FLAG(uint64_t, sandbox2tool_bench_parallel, 1,
+          "Number of sandboxees to run concurrently in benchmark mode");
+ABSL_FLAG(std::string, sandbox2tool_startup_trace, "",
+          "If set, write the timings of the sandbox startup phases to this "
+          "file, in the Chrome trace event format (load it in ui.perfetto.dev "
+          "or chrome://tracing)");
 
 namespace {
 
@@ -104,43 +126,14 @@ void OutputFD(int fd) {
   }
 }
 
-}  // namespace
-
-int main(int argc, char* argv[]) {
-  const std::string program_name = sapi::file_util::fileops::Basename(argv[0]);
-  absl::SetProgramUsageMessage(
-      absl::StrFormat("A sandbox testing tool.\n"
-                      "Usage: %1$s [OPTION] -- CMD [ARGS]...",
-                      program_name));
-
-  std::vector<std::string> args;
-  {
-    const std::vector<char*> parsed_argv = absl::ParseCommandLine(argc, argv);
-    args.assign(parsed_argv.begin() + 1, parsed_argv.end());
-  }
-  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
-  absl::InitializeLog();
-
-  if (args.empty()) {
-    absl::FPrintF(stderr, "Missing command to execute\n");
-    return EXIT_FAILURE;
-  }
-
-  const std::string& sandboxee = args[0];
-
+std::unique_ptr<sandbox2::Executor> CreateExecutor(
+    const std::vector<std::string>& args) {
   // Pass the current environ pointer, depending on the flag.
   std::vector<std::string> envp;
   if (absl::GetFlag(FLAGS_sandbox2tool_keep_env)) {
     envp = sandbox2::util::CharPtrArray(environ).ToStringVector();
   }
-  auto executor = std::make_unique<sandbox2::Executor>(sandboxee, args, envp);
-
-  sapi::file_util::fileops::FDCloser recv_fd1;
-  if (absl::GetFlag(FLAGS_sandbox2tool_redirect_fd1)) {
-    // Make the sandboxed process' fd be available as fd in the current process.
-    recv_fd1 = sapi::file_util::fileops::FDCloser(
-        executor->ipc()->ReceiveFd(STDOUT_FILENO));
-  }
+  auto executor = std::make_unique<sandbox2::Executor>(args[0], args, envp);
 
   executor
       ->limits()
@@ -158,6 +151,14 @@ int main(int argc, char* argv[]) {
         absl::GetFlag(FLAGS_sandbox2tool_cpu_timeout));
   }
 
+  // Current working directory.
+  if (!absl::GetFlag(FLAGS_sandbox2tool_cwd).empty()) {
+    executor->set_cwd(absl::GetFlag(FLAGS_sandbox2tool_cwd));
+  }
+  return executor;
+}
+
+std::unique_ptr<sandbox2::Policy> CreatePolicy(const std::string& sandboxee) {
   sandbox2::PolicyBuilder builder;
   builder.AddPolicyOnSyscall(__NR_tee, {KILL});
   builder.DefaultAction(sandbox2::AllowAllSyscalls());
@@ -194,12 +195,158 @@ int main(int argc, char* argv[]) {
     builder.AddLibrariesForBinary(sandboxee);
   }
 
-  auto policy = builder.BuildOrDie();
+  return builder.BuildOrDie();
+}
 
-  // Current working directory.
-  if (!absl::GetFlag(FLAGS_sandbox2tool_cwd).empty()) {
-    executor->set_cwd(absl::GetFlag(FLAGS_sandbox2tool_cwd));
+// Timings of a single launch in benchmark mode.
+struct BenchRun {
+  // PolicyBuilder::BuildOrDie().
+  absl::Duration policy;
+  // Sandbox2::RunAsync(): fork, namespace and mount setup, execve and
+  // attaching the monitor, until the sandboxee is ready.
+  absl::Duration launch;
+  // From then until the sandboxee exited and the result is available.
+  absl::Duration run;
+  absl::Duration total;
+  // Of the monitor thread.
+  absl::Duration monitor_cpu;
+  int64_t monitor_max_rss_kib = 0;
+  bool ok = false;
+};
+
+absl::Duration TimevalToDuration(const timeval& tv) {
+  return absl::Seconds(tv.tv_sec) + absl::Microseconds(tv.tv_usec);
+}
+
+BenchRun RunOnceTimed(const std::vector<std::string>& args) {
+  BenchRun run;
+  auto executor = CreateExecutor(args);
+  absl::Time start = absl::Now();
+  auto policy = CreatePolicy(args[0]);
+  absl::Time policy_built = absl::Now();
+  sandbox2::Sandbox2 s2(std::move(executor), std::move(policy));
+  bool launched = s2.RunAsync();
+  absl::Time ready = absl::Now();
+  sandbox2::Result result = s2.AwaitResult();
+  absl::Time done = absl::Now();
+
+  run.policy = policy_built - start;
+  run.launch = ready - policy_built;
+  run.run = done - ready;
+  run.total = done - start;
+  const rusage* usage = result.GetRUsageMonitor();
+  run.monitor_cpu =
+      TimevalToDuration(usage->ru_utime) + TimevalToDuration(usage->ru_stime);
+  run.monitor_max_rss_kib = usage->ru_maxrss;
+  run.ok = launched && result.final_status() == sandbox2::Result::OK &&
+           result.reason_code() == 0;
+  if (!run.ok) {
+    LOG(WARNING) << "Run failed: " << result.ToString();
   }
+  return run;
+}
+
+void PrintPhase(absl::string_view name, std::vector<absl::Duration> values) {
+  std::sort(values.begin(), values.end());
+  auto percentile = [&values](double p) {
+    return values[std::min(values.size() - 1,
+                           static_cast<size_t>(p * values.size()))];
+  };
+  absl::Duration sum;
+  for (const absl::Duration& value : values) {
+    sum += value;
+  }
+  auto ms = [](absl::Duration d) { return absl::ToDoubleMilliseconds(d); };
+  absl::PrintF("%-12s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name,
+               ms(values.front()), ms(percentile(0.5)), ms(percentile(0.9)),
+               ms(percentile(0.99)), ms(values.back()),
+               ms(sum / values.size()));
+}
+
+int RunBenchmark(const std::vector<std::string>& args, uint64_t iterations,
+                 uint64_t parallel) {
+  std::vector<BenchRun> runs(iterations);
+  std::atomic<uint64_t> next = 0;
+  absl::Time start = absl::Now();
+  std::vector<std::thread> threads;
+  for (uint64_t i = 0; i < std::max<uint64_t>(parallel, 1); ++i) {
+    threads.emplace_back([&args, &runs, &next, iterations] {
+      for (uint64_t j = next++; j < iterations; j = next++) {
+        runs[j] = RunOnceTimed(args);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  absl::Duration wall = absl::Now() - start;
+
+  std::vector<absl::Duration> policy, launch, run, total, monitor_cpu;
+  int64_t max_rss_kib = 0;
+  uint64_t failed = 0;
+  for (const BenchRun& r : runs) {
+    policy.push_back(r.policy);
+    launch.push_back(r.launch);
+    run.push_back(r.run);
+    total.push_back(r.total);
+    monitor_cpu.push_back(r.monitor_cpu);
+    max_rss_kib = std::max(max_rss_kib, r.monitor_max_rss_kib);
+    failed += r.ok ? 0 : 1;
+  }
+  absl::PrintF("%d runs, %d in parallel, %d failed, %.1f runs/s\n", iterations,
+               parallel, failed, iterations / absl::ToDoubleSeconds(wall));
+  absl::PrintF("%-12s %10s %10s %10s %10s %10s %10s\n", "phase (ms)", "min",
+               "p50", "p90", "p99", "max", "mean");
+  PrintPhase("policy", std::move(policy));
+  PrintPhase("launch", std::move(launch));
+  PrintPhase("run", std::move(run));
+  PrintPhase("total", std::move(total));
+  PrintPhase("monitor cpu", std::move(monitor_cpu));
+  absl::PrintF("monitor max rss: %d KiB\n", max_rss_kib);
+  return failed == 0 ? EXIT_SUCCESS : 1;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const std::string program_name = sapi::file_util::fileops::Basename(argv[0]);
+  absl::SetProgramUsageMessage(
+      absl::StrFormat("A sandbox testing tool.\n"
+                      "Usage: %1$s [OPTION] -- CMD [ARGS]...",
+                      program_name));
+
+  std::vector<std::string> args;
+  {
+    const std::vector<char*> parsed_argv = absl::ParseCommandLine(argc, argv);
+    args.assign(parsed_argv.begin() + 1, parsed_argv.end());
+  }
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+  absl::InitializeLog();
+
+  if (args.empty()) {
+    absl::FPrintF(stderr, "Missing command to execute\n");
+    return EXIT_FAILURE;
+  }
+
+  if (uint64_t iterations = absl::GetFlag(FLAGS_sandbox2tool_bench_iterations);
+      iterations > 0) {
+    return RunBenchmark(args, iterations,
+                        absl::GetFlag(FLAGS_sandbox2tool_bench_parallel));
+  }
+
+  auto executor = CreateExecutor(args);
+  const std::string startup_trace =
+      absl::GetFlag(FLAGS_sandbox2tool_startup_trace);
+  executor->set_trace_startup(!startup_trace.empty());
+
+  sapi::file_util::fileops::FDCloser recv_fd1;
+  if (absl::GetFlag(FLAGS_sandbox2tool_redirect_fd1)) {
+    // Make the sandboxed process' fd be available as fd in the current process.
+    recv_fd1 = sapi::file_util::fileops::FDCloser(
+        executor->ipc()->ReceiveFd(STDOUT_FILENO));
+  }
+
+  auto policy = CreatePolicy(args[0]);
 
   // Instantiate the Sandbox2 object with policies and executors.
   sandbox2::Sandbox2 s2(std::move(executor), std::move(policy));
@@ -235,6 +382,16 @@ int main(int argc, char* argv[]) {
 
   sandbox2::Result result = s2.AwaitResult();
 
+  if (!startup_trace.empty()) {
+    if (absl::Status status = sapi::file::SetContents(
+            startup_trace,
+            sandbox2::TraceSpansToChromeJson(result.GetStartupTrace()),
+            sapi::file::Defaults());
+        !status.ok()) {
+      LOG(ERROR) << "Writing the startup trace failed: " << status;
+    }
+  }
+
   if (result.final_status() != sandbox2::Result::OK) {
     LOG(ERROR) << "Sandbox error: " << result.ToString();
     return 2;  // sandbox violation
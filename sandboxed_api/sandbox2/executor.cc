@@ -18,19 +18,30 @@
 
 #include <fcntl.h>
 #include <libgen.h>
+#include <spawn.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <climits>
+#include <csignal>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "sandboxed_api/config.h"
+#include "sandboxed_api/sandbox2/binary_cache.h"
+#include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/fork_client.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
 #include "sandboxed_api/sandbox2/global_forkclient.h"
@@ -44,21 +55,20 @@ namespace sandbox2 {
 namespace file_util = ::sapi::file_util;
 
 namespace {
-void DisableCompressStackDepot(ForkRequest& request) {
-  auto disable_compress_stack_depot = [&request](absl::string_view sanitizer) {
+void DisableCompressStackDepot(std::vector<std::string>& envs) {
+  auto disable_compress_stack_depot = [&envs](absl::string_view sanitizer) {
     auto prefix = absl::StrCat(sanitizer, "_OPTIONS=");
-    auto it = std::find_if(request.mutable_envs()->begin(),
-                           request.mutable_envs()->end(),
+    auto it = std::find_if(envs.begin(), envs.end(),
                            [&prefix](const std::string& env) {
                              return absl::StartsWith(env, prefix);
                            });
     constexpr absl::string_view option = "compress_stack_depot=0";
-    if (it != request.mutable_envs()->end()) {
+    if (it != envs.end()) {
       // If it's already there, the last value will be used.
       absl::StrAppend(&*it, ":", option);
       return;
     }
-    request.add_envs(absl::StrCat(prefix, option));
+    envs.push_back(absl::StrCat(prefix, option));
   };
   if constexpr (sapi::sanitizers::IsASan()) {
     disable_compress_stack_depot("ASAN");
@@ -90,7 +100,17 @@ absl::StatusOr<SandboxeeProcess> Executor::StartSubProcess(int32_t clone_flags,
         "This executor has already been started");
   }
 
-  if (!path_.empty()) {
+  if (!path_.empty() && cache_binary_) {
+    absl::StatusOr<file_util::fileops::FDCloser> cached =
+        BinaryCache::GetFd(path_);
+    if (cached.ok()) {
+      exec_fd_ = *std::move(cached);
+    } else {
+      LOG(WARNING) << "Starting " << path_
+                   << " without caching it: " << cached.status();
+    }
+  }
+  if (!path_.empty() && exec_fd_.get() < 0) {
     exec_fd_ = file_util::fileops::FDCloser(open(path_.c_str(), O_PATH));
     if (exec_fd_.get() < 0) {
       if (errno == ENOENT) {
@@ -111,20 +131,26 @@ absl::StatusOr<SandboxeeProcess> Executor::StartSubProcess(int32_t clone_flags,
     VLOG(1) << "StartSubProcess, with fd " << exec_fd_.get();
   }
 
-  ForkRequest request;
-  *request.mutable_args() = {argv_.begin(), argv_.end()};
-  *request.mutable_envs() = {envp_.begin(), envp_.end()};
-
   // Add LD_ORIGIN_PATH to envs, as it'll make the amount of syscalls invoked by
   // ld.so smaller.
   if (!path_.empty()) {
-    request.add_envs(absl::StrCat("LD_ORIGIN_PATH=",
-                                  file_util::fileops::StripBasename(path_)));
+    envp_.push_back(absl::StrCat("LD_ORIGIN_PATH=",
+                                 file_util::fileops::StripBasename(path_)));
   }
 
   // Disable optimization to avoid related syscalls.
   if constexpr (sapi::sanitizers::IsAny()) {
-    DisableCompressStackDepot(request);
+    DisableCompressStackDepot(envp_);
+  }
+
+  ForkRequest request;
+  // Executors started with the same args and envs share them, so that they
+  // are neither copied into each request nor sent with it.
+  if (uint64_t id = RegisterExecArgs(argv_, envp_); id != 0) {
+    request.set_exec_args_id(id);
+  } else {
+    *request.mutable_args() = {argv_.begin(), argv_.end()};
+    *request.mutable_envs() = {envp_.begin(), envp_.end()};
   }
 
   // If neither the path, nor exec_fd is specified, just assume that we need to
@@ -151,10 +177,27 @@ absl::StatusOr<SandboxeeProcess> Executor::StartSubProcess(int32_t clone_flags,
 
   request.set_clone_flags(clone_flags);
   request.set_monitor_type(type);
+  request.set_prefork(prefork_);
+  if (prefork_ && prefork_count_ > 1) {
+    request.set_prefork_count(prefork_count_);
+  }
+  request.set_cache_mounts(cache_mounts_);
+  request.set_share_netns(share_netns_);
+  request.set_trace_startup(trace_startup_);
+  request.set_report_default_policy(true);
 
   SandboxeeProcess process;
 
-  if (fork_client_) {
+  if (spawn_directly_ && !fork_client_ && ns == nullptr &&
+      request.mode() != FORKSERVER_FORK &&
+      request.mode() != FORKSERVER_FORK_JOIN_SANDBOX_UNWIND &&
+      type == FORKSERVER_MONITOR_PTRACE && !prefork_) {
+    absl::StatusOr<SandboxeeProcess> spawned = SpawnDirectly(request);
+    if (!spawned.ok()) {
+      return spawned.status();
+    }
+    process = *std::move(spawned);
+  } else if (fork_client_) {
     process = fork_client_->SendRequest(request, exec_fd_.get(),
                                         client_comms_fd_.get());
   } else {
@@ -171,6 +214,66 @@ absl::StatusOr<SandboxeeProcess> Executor::StartSubProcess(int32_t clone_flags,
   return process;
 }
 
+absl::StatusOr<SandboxeeProcess> Executor::SpawnDirectly(
+    const ForkRequest& request) {
+  absl::StatusOr<file_util::fileops::FDCloser> launcher =
+      GetForkserverBinaryFd();
+  if (!launcher.ok()) {
+    return launcher.status();
+  }
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
+    return absl::ErrnoToStatus(errno, "socketpair()");
+  }
+  file_util::fileops::FDCloser local(sv[0]);
+  file_util::fileops::FDCloser remote(sv[1]);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  // The duplicate is not close-on-exec.
+  posix_spawn_file_actions_adddup2(&actions, remote.get(),
+                                   Comms::kSandbox2ClientCommsFD);
+  char name[] = "S2-LAUNCHER";
+  char serve_direct[] = "--sandbox2_forkserver_serve_direct";
+  char* argv[] = {name, serve_direct, nullptr};
+  // The kernel resolves the path before closing any close-on-exec fds.
+  std::string path = absl::StrCat("/proc/self/fd/", launcher->get());
+  // Like the forkserver, the sandboxee must not inherit the signal mask or the
+  // ignored signals of the calling thread.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t empty_mask;
+  sigemptyset(&empty_mask);
+  sigset_t all_signals;
+  sigfillset(&all_signals);
+  posix_spawnattr_setsigmask(&attr, &empty_mask);
+  posix_spawnattr_setsigdefault(&attr, &all_signals);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                                      POSIX_SPAWN_SETSIGDEF);
+  pid_t pid;
+  int error = posix_spawn(&pid, path.c_str(), &actions, &attr, argv, environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  if (error != 0) {
+    return absl::ErrnoToStatus(error, "posix_spawn() of the launcher");
+  }
+  remote.Close();
+
+  Comms comms(local.Release());
+  ForkClient client(pid, &comms);
+  SandboxeeProcess process =
+      client.SendRequest(request, exec_fd_.get(), client_comms_fd_.get());
+  if (process.main_pid != pid) {
+    // The launcher died before it got to the request, the monitor can't tell
+    // without a pid.
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return absl::InternalError("Launcher did not take the request");
+  }
+  process.main_pidfd = file_util::fileops::FDCloser(util::PidfdOpen(pid));
+  return process;
+}
+
 std::unique_ptr<ForkClient> Executor::StartForkServer() {
   // This flag is set explicitly to 'true' during object instantiation, and
   // custom fork-servers should never be sandboxed.
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <utility>
@@ -97,6 +98,95 @@ class Executor final {
     return *this;
   }
 
+  // Makes the forkserver keep a process ready for the next sandboxee started
+  // with the same settings and arguments, one that already went through
+  // namespace and mount setup. Speeds up starting many equal sandboxees, at
+  // the cost of one idle process per distinct configuration.
+  Executor& set_prefork(bool value) {
+    prefork_ = value;
+    return *this;
+  }
+
+  // Makes the forkserver keep `count` processes ready instead of one, for
+  // bursts of sandboxees with the same settings. Implies set_prefork(true).
+  // A custom forkserver reports how often a process was ready in
+  // ForkClient::prefork_stats().
+  Executor& set_prefork_count(int count) {
+    prefork_ = true;
+    prefork_count_ = count;
+    return *this;
+  }
+
+  // Makes the forkserver set up the policy's mount tree only once, and give
+  // later sandboxees with the same tree a copy of it. Speeds up starting
+  // sandboxees with many mounts. Mounted files that are replaced on the host
+  // afterwards are not picked up. Mount trees with tmpfs mounts, a writable
+  // root, or mounts of /proc or /sys are always set up for each sandboxee.
+  Executor& set_cache_mounts(bool value) {
+    cache_mounts_ = value;
+    return *this;
+  }
+
+  // Makes the forkserver put the sandboxee into a network namespace that it
+  // shares with all other sandboxees started this way, instead of creating a
+  // new one for it. Creating network namespaces is slow and serialized in the
+  // kernel, which limits how fast sandboxees start in parallel. The shared
+  // namespace only has a loopback interface, but the sandboxees can reach each
+  // other through it and through abstract unix sockets, so only use this if
+  // the policy does not allow sockets or the sandboxees trust each other. Has
+  // no effect with unrestricted networking.
+  Executor& set_share_network_namespace(bool value) {
+    share_netns_ = value;
+    return *this;
+  }
+
+  // Makes the sandboxee binary start from a copy in memory that is shared by
+  // all executors of the process, see BinaryCache. Speeds up starting binaries
+  // from slow (e.g. network) filesystems. The copy is refreshed when the file
+  // changes. Binaries that find their files through /proc/self/exe see a memfd
+  // there instead of their path. Only used with a path.
+  Executor& set_cache_binary(bool value) {
+    cache_binary_ = value;
+    return *this;
+  }
+
+  // Starts the sandboxee with posix_spawn() of a launcher, which becomes the
+  // sandboxee, instead of through a forkserver. Sandboxees started this way
+  // don't wait for each other in the forkserver, and spawning is safe from
+  // multi-threaded processes. Only applies to binaries started without
+  // namespaces and with the ptrace monitor, other sandboxees still use the
+  // forkserver. Each start costs an additional execve() of the launcher.
+  Executor& set_spawn_directly(bool value) {
+    spawn_directly_ = value;
+    return *this;
+  }
+
+  // Records how long each phase of starting the sandboxee takes, in the
+  // forkserver and in the monitor, see Result::GetStartupTrace().
+  Executor& set_trace_startup(bool value) {
+    trace_startup_ = value;
+    return *this;
+  }
+
+  // Connects the sandboxee's stdout to a pipe that the monitor drains into
+  // `fd` with splice(), see OutputSplicer. The output then reaches e.g. a file
+  // without being copied through the memory of the host, which matters for
+  // sandboxees that write a lot of it. The executor takes ownership of `fd`,
+  // which may be -1 to only keep the last `tail_size` bytes for
+  // Result::GetStdoutTail(). The pipe is drained on the threads of the reactor
+  // passed to Sandbox2::EnableUnotifyMonitor(), if any, and on a thread of its
+  // own otherwise. Not to be combined with ipc()->MapFd(..., STDOUT_FILENO).
+  Executor& set_stdout_sink(int fd, size_t tail_size = 0) {
+    stdout_sink_ = {true, sapi::file_util::fileops::FDCloser(fd), tail_size};
+    return *this;
+  }
+
+  // Like set_stdout_sink(), for stderr and Result::GetStderrTail().
+  Executor& set_stderr_sink(int fd, size_t tail_size = 0) {
+    stderr_sink_ = {true, sapi::file_util::fileops::FDCloser(fd), tail_size};
+    return *this;
+  }
+
  private:
   friend class MonitorBase;
   friend class PtraceMonitor;
@@ -118,6 +208,9 @@ class Executor final {
   // descriptor.
   void SetUpServerSideCommsFd();
 
+  // Serves `request` from a launcher of its own, see set_spawn_directly().
+  absl::StatusOr<SandboxeeProcess> SpawnDirectly(const ForkRequest& request);
+
   // Starts a new process which is connected with this Executor instance via a
   // Comms channel.
   // For clone_flags refer to Linux' 'man 2 clone'.
@@ -136,6 +229,30 @@ class Executor final {
   // do it by itself, using the Client object's methods
   bool enable_sandboxing_pre_execve_ = true;
 
+  // Whether the forkserver should keep a process ready, see set_prefork().
+  bool prefork_ = false;
+  int prefork_count_ = 1;
+  // Whether the forkserver should reuse mount trees, see set_cache_mounts().
+  bool cache_mounts_ = false;
+  // Whether the sandboxee joins a shared network namespace, see
+  // set_share_network_namespace().
+  bool share_netns_ = false;
+  // Whether the binary is started from BinaryCache, see set_cache_binary().
+  bool cache_binary_ = false;
+  // Whether to trace the startup, see set_trace_startup().
+  bool trace_startup_ = false;
+  // Whether to bypass the forkserver, see set_spawn_directly().
+  bool spawn_directly_ = false;
+
+  // Where the monitor drains stdout or stderr to, see set_stdout_sink().
+  struct OutputSink {
+    bool enabled = false;
+    sapi::file_util::fileops::FDCloser fd;
+    size_t tail_size = 0;
+  };
+  OutputSink stdout_sink_;
+  OutputSink stderr_sink_;
+
   // Alternate (path/fd)/argv/envp to be used the in the __NR_execve call.
   sapi::file_util::fileops::FDCloser exec_fd_;
   std::string path_;
@@ -14,11 +14,23 @@
 
 #include "sandboxed_api/sandbox2/fork_client.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
 #include "absl/flags/flag.h"
+#include "absl/hash/hash.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
+#include "absl/synchronization/mutex.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
+#include "sandboxed_api/util/metrics.h"
 
 // Make the forkserver use a signal handler for SIGCHLD instead of setting
 // `SA_NOCLDWAIT`. This is needed in certain cases where the process need
@@ -27,36 +39,155 @@ ABSL_FLAG(
     bool, sandbox2_forkserver_use_waitpid, false,
     "Use waitpid to reap child processes instead of relying on SA_NOCLDWAIT");
 
+// Fork namespaced sandboxees from a process that stays in the initial
+// namespaces, instead of from an intermediate process per sandboxee that joins
+// them first.
+ABSL_FLAG(bool, sandbox2_forkserver_namespace_helper, true,
+          "Fork namespaced sandboxees from a persistent helper process");
+
+// Install the part of the seccomp policy shared by all sandboxees once in the
+// forkserver, so that sandboxees only evaluate the rest in their own filter.
+ABSL_FLAG(bool, sandbox2_forkserver_default_policy, false,
+          "Install the shared default seccomp policy in the forkserver");
+
 namespace sandbox2 {
 
 using ::sapi::file_util::fileops::FDCloser;
 
+namespace {
+
+// Maximum number of different ExecArgs, each of which every forkserver keeps.
+constexpr size_t kMaxExecArgs = 64;
+
+struct RegisteredExecArgs {
+  size_t hash;
+  ExecArgs exec_args;
+};
+
+ABSL_CONST_INIT absl::Mutex g_exec_args_mutex(absl::kConstInit);
+
+// Indexed by id - 1. Entries are never changed or removed, so that they can
+// be used without holding the lock.
+std::deque<RegisteredExecArgs>& GetExecArgs()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(g_exec_args_mutex) {
+  static auto* exec_args = new std::deque<RegisteredExecArgs>();
+  return *exec_args;
+}
+
+bool Equals(const google::protobuf::RepeatedPtrField<std::string>& stored,
+            absl::Span<const std::string> values) {
+  return std::equal(stored.begin(), stored.end(), values.begin(),
+                    values.end());
+}
+
+}  // namespace
+
+uint64_t RegisterExecArgs(absl::Span<const std::string> args,
+                          absl::Span<const std::string> envs) {
+  size_t hash = absl::HashOf(args, envs);
+  absl::MutexLock lock(&g_exec_args_mutex);
+  std::deque<RegisteredExecArgs>& registered = GetExecArgs();
+  for (size_t i = 0; i < registered.size(); ++i) {
+    if (registered[i].hash == hash &&
+        Equals(registered[i].exec_args.args(), args) &&
+        Equals(registered[i].exec_args.envs(), envs)) {
+      return i + 1;
+    }
+  }
+  if (registered.size() >= kMaxExecArgs) {
+    return 0;
+  }
+  RegisteredExecArgs& added = registered.emplace_back();
+  added.hash = hash;
+  *added.exec_args.mutable_args() = {args.begin(), args.end()};
+  *added.exec_args.mutable_envs() = {envs.begin(), envs.end()};
+  return registered.size();
+}
+
 SandboxeeProcess ForkClient::SendRequest(const ForkRequest& request,
                                          int exec_fd, int comms_fd) {
-  SandboxeeProcess process;
+  sapi::metrics::IncrementCounter(sapi::metrics::kForkRequests);
+  sapi::metrics::ScopedLatency latency(sapi::metrics::kForkRequestLatency, "");
   // Acquire the channel ownership for this request (transaction).
   absl::MutexLock l(&comms_mutex_);
+  if (!SendRequestLocked({&request, exec_fd, comms_fd})) {
+    return SandboxeeProcess();
+  }
+  return ReceiveProcessLocked(request);
+}
 
-  if (!comms_->SendProtoBuf(request)) {
+std::vector<SandboxeeProcess> ForkClient::SendRequests(
+    absl::Span<const Request> requests) {
+  sapi::metrics::IncrementCounter(sapi::metrics::kForkRequests, "",
+                                  requests.size());
+  std::vector<SandboxeeProcess> processes(requests.size());
+  absl::MutexLock l(&comms_mutex_);
+  // The replies are small enough to not fill the socket buffer while the
+  // requests are still being sent.
+  size_t sent = 0;
+  while (sent < requests.size() && SendRequestLocked(requests[sent])) {
+    ++sent;
+  }
+  for (size_t i = 0; i < sent; ++i) {
+    processes[i] = ReceiveProcessLocked(*requests[i].request);
+  }
+  return processes;
+}
+
+bool ForkClient::SendRequestLocked(const Request& request) {
+  if (!comms_->SendProtoBuf(*request.request)) {
     LOG(ERROR) << "Sending PB to the ForkServer failed";
-    return process;
+    return false;
   }
-  CHECK(comms_fd != -1) << "comms_fd was not properly set up";
-  if (!comms_->SendFD(comms_fd)) {
-    LOG(ERROR) << "Sending Comms FD (" << comms_fd
+  CHECK(request.comms_fd != -1) << "comms_fd was not properly set up";
+  if (!comms_->SendFD(request.comms_fd)) {
+    LOG(ERROR) << "Sending Comms FD (" << request.comms_fd
                << ") to the ForkServer failed";
-    return process;
+    return false;
   }
-  if (request.mode() == FORKSERVER_FORK_EXECVE ||
-      request.mode() == FORKSERVER_FORK_EXECVE_SANDBOX) {
-    CHECK(exec_fd != -1) << "exec_fd cannot be -1 in execve mode";
-    if (!comms_->SendFD(exec_fd)) {
-      LOG(ERROR) << "Sending Exec FD (" << exec_fd
+  if (request.request->mode() == FORKSERVER_FORK_EXECVE ||
+      request.request->mode() == FORKSERVER_FORK_EXECVE_SANDBOX) {
+    CHECK(request.exec_fd != -1) << "exec_fd cannot be -1 in execve mode";
+    if (!comms_->SendFD(request.exec_fd)) {
+      LOG(ERROR) << "Sending Exec FD (" << request.exec_fd
                  << ") to the ForkServer failed";
-      return process;
+      return false;
     }
   }
+  if (request.request->has_exec_args_id()) {
+    uint64_t id = request.request->exec_args_id();
+    auto sent = std::find(sent_exec_args_.begin(), sent_exec_args_.end(), id);
+    bool send = sent == sent_exec_args_.end();
+    if (!comms_->SendBool(send)) {
+      LOG(ERROR) << "Sending ExecArgs presence to the ForkServer failed";
+      return false;
+    }
+    if (send) {
+      const ExecArgs* exec_args;
+      {
+        absl::MutexLock lock(&g_exec_args_mutex);
+        CHECK(id > 0 && id <= GetExecArgs().size())
+            << "Unregistered ExecArgs id " << id;
+        exec_args = &GetExecArgs()[id - 1].exec_args;
+      }
+      if (!comms_->SendProtoBuf(*exec_args)) {
+        LOG(ERROR) << "Sending ExecArgs to the ForkServer failed";
+        return false;
+      }
+    } else {
+      sent_exec_args_.erase(sent);
+    }
+    // Mirrors ForkServer::UseExecArgs().
+    sent_exec_args_.push_back(id);
+    if (sent_exec_args_.size() > kMaxForkServerExecArgs) {
+      sent_exec_args_.erase(sent_exec_args_.begin());
+    }
+  }
+  return true;
+}
 
+SandboxeeProcess ForkClient::ReceiveProcessLocked(const ForkRequest& request) {
+  SandboxeeProcess process;
   int32_t pid;
   // Receive init process ID.
   if (!comms_->RecvInt32(&pid)) {
@@ -79,6 +210,43 @@ SandboxeeProcess ForkClient::SendRequest(const ForkRequest& request,
     }
     process.status_fd = FDCloser(fd);
   }
+  bool has_pidfd;
+  if (!comms_->RecvBool(&has_pidfd)) {
+    LOG(ERROR) << "Receiving pidfd presence from the ForkServer failed";
+    return process;
+  }
+  if (has_pidfd) {
+    int fd = -1;
+    if (!comms_->RecvFD(&fd)) {
+      LOG(ERROR) << "Receiving pidfd from the ForkServer failed";
+      return process;
+    }
+    process.main_pidfd = FDCloser(fd);
+  }
+  if (request.prefork()) {
+    if (!comms_->RecvBool(&process.preforked)) {
+      LOG(ERROR) << "Receiving prefork state from the ForkServer failed";
+      return process;
+    }
+    ++(process.preforked ? prefork_stats_.hits : prefork_stats_.misses);
+  }
+  if (request.report_default_policy()) {
+    if (!comms_->RecvBool(&process.default_policy)) {
+      LOG(ERROR) << "Receiving default policy state from the ForkServer failed";
+      return process;
+    }
+  }
+  if (request.trace_startup()) {
+    ForkStartupTrace trace;
+    if (!comms_->RecvProtoBuf(&trace)) {
+      LOG(ERROR) << "Receiving startup trace from the ForkServer failed";
+      return process;
+    }
+    for (const ForkStartupTrace::Span& span : trace.spans()) {
+      process.trace.push_back(
+          {span.name(), span.start_ns(), span.end_ns(), span.pid()});
+    }
+  }
   return process;
 }
 
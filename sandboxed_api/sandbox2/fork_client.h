@@ -17,8 +17,15 @@
 
 #include <sys/types.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/trace.h"
 #include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
@@ -33,10 +40,41 @@ struct SandboxeeProcess {
   pid_t init_pid = -1;
   pid_t main_pid = -1;
   sapi::file_util::fileops::FDCloser status_fd;
+  // Refers to the main process independently of pid reuse. -1 on kernels
+  // without pidfd support (before 5.3).
+  sapi::file_util::fileops::FDCloser main_pidfd;
+  // Spans of the forkserver's work on the process, if the request asked for
+  // them with trace_startup.
+  std::vector<TraceSpan> trace;
+  // Whether the process was kept ready ahead of the request, for requests with
+  // prefork.
+  bool preforked = false;
+  // Whether the process runs under Policy::GetForkserverPolicy() already, for
+  // requests with report_default_policy.
+  bool default_policy = false;
 };
 
+// Returns the id that ForkRequest::exec_args_id refers to args and envs with.
+// Equal args and envs always get the same id, so that they are sent to a
+// forkserver only once, however many executors use them. Returns 0 if too
+// many different ones were registered, in which case the request must carry
+// them itself.
+uint64_t RegisterExecArgs(absl::Span<const std::string> args,
+                          absl::Span<const std::string> envs);
+
+// Number of ExecArgs that a forkserver keeps, the most recently used ones. The
+// ForkClient tracks which ones those are, and sends others along again.
+inline constexpr size_t kMaxForkServerExecArgs = 16;
+
 class ForkClient {
  public:
+  // A fork request and its fds, see SendRequest().
+  struct Request {
+    const ForkRequest* request;
+    int exec_fd;
+    int comms_fd;
+  };
+
   ForkClient(pid_t pid, Comms* comms) : pid_(pid), comms_(comms) {}
   ForkClient(const ForkClient&) = delete;
   ForkClient& operator=(const ForkClient&) = delete;
@@ -45,15 +83,44 @@ class ForkClient {
   SandboxeeProcess SendRequest(const ForkRequest& request, int exec_fd,
                                int comms_fd);
 
+  // Sends all requests before receiving any of the processes, so that the
+  // forkserver starts them back-to-back. Returns the processes in the order of
+  // the requests.
+  // The requests are pipelined with the same messages as SendRequest(), so no
+  // batch message is needed. The forkserver still has to speak the current
+  // protocol, e.g. the pidfd that follows each reply, so it must come from the
+  // same build as this client.
+  std::vector<SandboxeeProcess> SendRequests(
+      absl::Span<const Request> requests);
+
   pid_t pid() { return pid_; }
 
+  // Counts of the requests with prefork that were served by a process kept
+  // ready (hits), and of those that had to wait for a new one (misses).
+  struct PreforkStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+  PreforkStats prefork_stats() ABSL_LOCKS_EXCLUDED(comms_mutex_) {
+    absl::MutexLock lock(&comms_mutex_);
+    return prefork_stats_;
+  }
+
  private:
+  bool SendRequestLocked(const Request& request)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(comms_mutex_);
+  SandboxeeProcess ReceiveProcessLocked(const ForkRequest& request)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(comms_mutex_);
+
   // Pid of the ForkServer.
   pid_t pid_;
   // Comms channel connecting with the ForkServer. Not owned by the object.
   Comms* comms_ ABSL_GUARDED_BY(comms_mutex_);
   // Mutex locking transactions (requests) over the Comms channel.
   absl::Mutex comms_mutex_;
+  // Ids of the ExecArgs that the ForkServer keeps, least recently used first.
+  std::vector<uint64_t> sent_exec_args_ ABSL_GUARDED_BY(comms_mutex_);
+  PreforkStats prefork_stats_ ABSL_GUARDED_BY(comms_mutex_);
 };
 
 }  // namespace sandbox2
@@ -33,6 +33,9 @@ class ForkingClient : public Client {
   // current Client objects acts as a wrapper of ForkServer (and this process
   // was created to act as a ForkServer).
   // Return values specified as with 'fork' (incl. -1).
+  // With Executor::set_prefork() (or set_prefork_count()), children are forked
+  // ahead of the requests they serve, so this returns 0 in a child only once
+  // it has been handed out for a request.
   pid_t WaitAndFork();
 
  private:
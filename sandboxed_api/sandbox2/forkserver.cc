@@ -27,6 +27,7 @@
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <csignal>
 #include <cstdint>
@@ -36,7 +37,11 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/flags/declare.h"
@@ -47,15 +52,18 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
+#include "absl/types/span.h"
 #include "libcap/include/sys/capability.h"
 #include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/fork_client.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
+#include "sandboxed_api/sandbox2/mount_tree.pb.h"
 #include "sandboxed_api/sandbox2/namespace.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/sanitizer.h"
 #include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/trace.h"
 #include "sandboxed_api/sandbox2/unwind/unwind.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
@@ -64,6 +72,8 @@
 #include "sandboxed_api/util/strerror.h"
 
 ABSL_DECLARE_FLAG(bool, sandbox2_forkserver_use_waitpid);
+ABSL_DECLARE_FLAG(bool, sandbox2_forkserver_namespace_helper);
+ABSL_DECLARE_FLAG(bool, sandbox2_forkserver_default_policy);
 
 namespace sandbox2 {
 
@@ -193,44 +203,95 @@ void RunInitProcess(pid_t main_pid, int pipe_fd,
   }
 }
 
-absl::Status SendPid(int signaling_fd) {
+ForkStartupTrace TraceToProto(absl::Span<const TraceSpan> trace) {
+  ForkStartupTrace proto;
+  for (const TraceSpan& span : trace) {
+    ForkStartupTrace::Span* proto_span = proto.add_spans();
+    proto_span->set_name(span.name);
+    proto_span->set_start_ns(span.start_ns);
+    proto_span->set_end_ns(span.end_ns);
+    proto_span->set_pid(span.pid);
+  }
+  return proto;
+}
+
+// Sends the spans recorded by a child of the forkserver along with its pid,
+// if trace is not nullptr.
+absl::Status SendPid(int signaling_fd,
+                     const std::vector<TraceSpan>* trace = nullptr) {
   // Send our PID (the actual sandboxee process) via SCM_CREDENTIALS.
   // The ancillary message will be attached to the message as SO_PASSCRED is set
-  // on the socket.
-  char dummy = ' ';
-  if (TEMP_FAILURE_RETRY(send(signaling_fd, &dummy, 1, 0)) != 1) {
-    return absl::ErrnoToStatus(errno, "Sending PID: send()");
+  // on the socket. The spans follow their size.
+  std::string payload;
+  if (trace != nullptr) {
+    payload = TraceToProto(*trace).SerializeAsString();
+  }
+  uint32_t size = payload.size();
+  struct iovec iov[] = {{&size, sizeof(size)},
+                        {payload.data(), payload.size()}};
+  struct msghdr msgh {};
+  msgh.msg_iov = iov;
+  msgh.msg_iovlen = payload.empty() ? 1 : 2;
+  ssize_t expected = sizeof(size) + payload.size();
+  if (TEMP_FAILURE_RETRY(sendmsg(signaling_fd, &msgh, 0)) != expected) {
+    return absl::ErrnoToStatus(errno, "Sending PID: sendmsg()");
   }
   return absl::OkStatus();
 }
 
-absl::StatusOr<pid_t> ReceivePid(int signaling_fd) {
+// Appends the spans sent along with the pid to trace, unless it is nullptr.
+// They are attributed to the sender, as pids recorded inside a new PID
+// namespace mean nothing here.
+absl::StatusOr<pid_t> ReceivePid(int signaling_fd,
+                                 std::vector<TraceSpan>* trace = nullptr) {
   union {
     struct cmsghdr cmh;
     char ctrl[CMSG_SPACE(sizeof(struct ucred))];
   } ucred_msg{};
 
   struct msghdr msgh {};
-  struct iovec iov {};
-
-  msgh.msg_iov = &iov;
-  msgh.msg_iovlen = 1;
   msgh.msg_control = ucred_msg.ctrl;
   msgh.msg_controllen = sizeof(ucred_msg);
 
-  char dummy;
-  iov.iov_base = &dummy;
-  iov.iov_len = sizeof(char);
-
-  if (TEMP_FAILURE_RETRY(recvmsg(signaling_fd, &msgh, MSG_WAITALL)) != 1) {
+  // The signaling socket preserves message boundaries, so the size and the
+  // spans following it have to be received with a single recvmsg(). Peek at
+  // the size first.
+  uint32_t size;
+  struct iovec iov = {&size, sizeof(size)};
+  struct msghdr peek {};
+  peek.msg_iov = &iov;
+  peek.msg_iovlen = 1;
+  if (TEMP_FAILURE_RETRY(recvmsg(signaling_fd, &peek, MSG_PEEK)) !=
+      sizeof(size)) {
+    return absl::ErrnoToStatus(errno, "Receiving pid failed: recvmsg");
+  }
+  std::string payload(size, '\0');
+  struct iovec iovs[] = {{&size, sizeof(size)}, {payload.data(), size}};
+  msgh.msg_iov = iovs;
+  msgh.msg_iovlen = size > 0 ? 2 : 1;
+  const ssize_t expected = sizeof(size) + payload.size();
+  if (TEMP_FAILURE_RETRY(recvmsg(signaling_fd, &msgh, 0)) != expected ||
+      (msgh.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
     return absl::ErrnoToStatus(errno, "Receiving pid failed: recvmsg");
   }
   struct cmsghdr* cmsgp = CMSG_FIRSTHDR(&msgh);
-  if (cmsgp->cmsg_len != CMSG_LEN(sizeof(struct ucred)) ||
+  if (cmsgp == nullptr || cmsgp->cmsg_len != CMSG_LEN(sizeof(struct ucred)) ||
       cmsgp->cmsg_level != SOL_SOCKET || cmsgp->cmsg_type != SCM_CREDENTIALS) {
     return absl::InternalError("Receiving pid failed");
   }
   auto* ucredp = reinterpret_cast<struct ucred*>(CMSG_DATA(cmsgp));
+  if (size > 0) {
+    ForkStartupTrace proto;
+    if (!proto.ParseFromString(payload)) {
+      return absl::InternalError("Receiving trace failed: invalid proto");
+    }
+    if (trace != nullptr) {
+      for (const ForkStartupTrace::Span& span : proto.spans()) {
+        trace->push_back(
+            {span.name(), span.start_ns(), span.end_ns(), ucredp->pid});
+      }
+    }
+  }
   return ucredp->pid;
 }
 
@@ -262,18 +323,75 @@ bool IsLikelyChrooted() {
   return *self_root_id != *init_root_id;
 }
 
+// Serializes a message such that equal messages result in equal strings, which
+// includes sorting map entries.
+std::string SerializeDeterministically(
+    const google::protobuf::MessageLite& message) {
+  std::string serialized;
+  {
+    google::protobuf::io::StringOutputStream stream(&serialized);
+    google::protobuf::io::CodedOutputStream coded(&stream);
+    coded.SetSerializationDeterministic(true);
+    message.SerializeToCodedStream(&coded);
+  }
+  return serialized;
+}
+
+// Returns whether a mount tree can be set up once and then shared by
+// sandboxees. Excluded are trees with mounts that must be private to each
+// sandboxee: tmpfs ones (including a writable root), and ones that would
+// capture the per-sandboxee /proc or /sys.
+bool CanCacheMountTree(const MountTree& tree) {
+  if (tree.has_node()) {
+    const MountTree::Node& node = tree.node();
+    std::string outside;
+    if (node.has_tmpfs_node() ||
+        (node.has_root_node() && node.root_node().writable())) {
+      return false;
+    }
+    if (node.has_dir_node()) {
+      outside = node.dir_node().outside();
+    } else if (node.has_file_node()) {
+      outside = node.file_node().outside();
+    }
+    if (outside == "/" || outside == "/proc" || outside == "/sys" ||
+        absl::StartsWith(outside, "/proc/") ||
+        absl::StartsWith(outside, "/sys/")) {
+      return false;
+    }
+  }
+  for (const auto& [name, subtree] : tree.entries()) {
+    if (!CanCacheMountTree(subtree)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace
 
 void ForkServer::PrepareExecveArgs(const ForkRequest& request,
                                    std::vector<std::string>* args,
-                                   std::vector<std::string>* envp) {
+                                   std::vector<std::string>* envp) const {
+  const auto* request_args = &request.args();
+  const auto* request_envs = &request.envs();
+  if (request.has_exec_args_id()) {
+    // Checked to exist in ServeRequest().
+    const ExecArgs& exec_args = exec_args_.find(request.exec_args_id())->second;
+    request_args = &exec_args.args();
+    request_envs = &exec_args.envs();
+  }
+  // Leaves room for the envs added below, and by LaunchChild().
+  args->reserve(request_args->size());
+  envp->reserve(request_envs->size() + 4);
+
   // Prepare arguments for execve.
-  for (const auto& arg : request.args()) {
+  for (const auto& arg : *request_args) {
     args->push_back(arg);
   }
 
   // Prepare environment variables for execve.
-  for (const auto& env : request.envs()) {
+  for (const auto& env : *request_envs) {
     envp->push_back(env);
   }
 
@@ -294,7 +412,9 @@ void ForkServer::PrepareExecveArgs(const ForkRequest& request,
 void ForkServer::LaunchChild(const ForkRequest& request, int execve_fd,
                              int client_fd, uid_t uid, gid_t gid,
                              int signaling_fd, int status_fd,
-                             bool avoid_pivot_root) const {
+                             bool avoid_pivot_root, bool parked,
+                             bool mounts_prepared,
+                             std::vector<TraceSpan>* trace) const {
   SAPI_RAW_CHECK(request.mode() != FORKSERVER_FORK_UNSPECIFIED,
                  "Forkserver mode is unspecified");
 
@@ -313,7 +433,15 @@ void ForkServer::LaunchChild(const ForkRequest& request, int execve_fd,
            {&client_fd, Comms::kSandbox2ClientCommsFD}},
           {&signaling_fd});
 
+  ScopedTraceSpan sanitize_span(trace, "ForkServer::SanitizeEnvironment");
   SanitizeEnvironment();
+  if (direct_) {
+    // The parent is whichever thread spawned the process, which may well exit
+    // before the sandboxee does. The monitor's PTRACE_O_EXITKILL ties the
+    // sandboxee to the monitor instead.
+    SAPI_RAW_PCHECK(prctl(PR_SET_PDEATHSIG, 0, 0, 0, 0) == 0,
+                    "clearing the parent-death signal");
+  }
 
   absl::StatusOr<absl::flat_hash_set<int>> open_fds = sanitizer::GetListOfFDs();
   if (!open_fds.ok()) {
@@ -321,8 +449,12 @@ void ForkServer::LaunchChild(const ForkRequest& request, int execve_fd,
                  std::string(open_fds.status().message()).c_str());
     open_fds = absl::flat_hash_set<int>();
   }
+  sanitize_span.End();
 
-  InitializeNamespaces(request, uid, gid, avoid_pivot_root);
+  {
+    ScopedTraceSpan span(trace, "ForkServer::InitializeNamespaces");
+    InitializeNamespaces(request, uid, gid, avoid_pivot_root, mounts_prepared);
+  }
 
   auto caps = cap_init();
   SAPI_RAW_CHECK(cap_set_proc(caps) == 0, "while dropping capabilities");
@@ -330,6 +462,7 @@ void ForkServer::LaunchChild(const ForkRequest& request, int execve_fd,
 
   // A custom init process is only needed if a new PID NS is created.
   if (request.clone_flags() & CLONE_NEWPID) {
+    ScopedTraceSpan init_span(trace, "ForkServer::StartInit");
     // Spawn a child process
     pid_t child = fork();
     if (child < 0) {
@@ -344,12 +477,30 @@ void ForkServer::LaunchChild(const ForkRequest& request, int execve_fd,
     if (status_fd >= 0) {
       close(status_fd);
     }
-    // Send sandboxee pid
-    auto status = SendPid(signaling_fd);
+    init_span.End();
+    // Send sandboxee pid. Without a new PID namespace, nothing is sent after
+    // the namespace setup, so its spans are lost.
+    auto status = SendPid(signaling_fd, trace);
     SAPI_RAW_CHECK(status.ok(),
                    absl::StrCat("sending pid: ", status.message()).c_str());
   }
 
+  if (parked) {
+    // Wait until the forkserver hands this process out for a request, see
+    // ServeRequest(). Until then, client_fd is the parking socket.
+    {
+      Comms park_comms(Comms::kSandbox2ClientCommsFD);
+      if (!park_comms.RecvFD(&client_fd) ||
+          (will_execve && !park_comms.RecvFD(&execve_fd))) {
+        // The forkserver went away.
+        _exit(EXIT_FAILURE);
+      }
+    }
+    MoveFDs({{&execve_fd, Comms::kSandbox2TargetExecFD},
+             {&client_fd, Comms::kSandbox2ClientCommsFD}},
+            {&signaling_fd});
+  }
+
   if (request.mode() == FORKSERVER_FORK_EXECVE_SANDBOX ||
       request.mode() == FORKSERVER_FORK_JOIN_SANDBOX_UNWIND) {
     // Sandboxing can be enabled either here - just before execve, or somewhere
@@ -401,31 +552,233 @@ void ForkServer::LaunchChild(const ForkRequest& request, int execve_fd,
   }
 }
 
-pid_t ForkServer::ServeRequest() {
-  ForkRequest fork_request;
-  if (!comms_->RecvProtoBuf(&fork_request)) {
+bool ForkServer::ReceiveRequest(ForkRequest* fork_request, int* comms_fd,
+                                int* exec_fd) {
+  if (!comms_->RecvProtoBuf(fork_request)) {
     if (comms_->IsTerminated()) {
-      return -1;
+      return false;
     }
     SAPI_RAW_LOG(FATAL, "Failed to receive ForkServer request");
   }
-  int comms_fd;
-  SAPI_RAW_CHECK(comms_->RecvFD(&comms_fd), "Failed to receive Comms FD");
+  request_start_ns_ = MonotonicNowNs();
+  SAPI_RAW_CHECK(comms_->RecvFD(comms_fd), "Failed to receive Comms FD");
 
-  SAPI_RAW_CHECK(fork_request.mode() != FORKSERVER_FORK_UNSPECIFIED,
+  SAPI_RAW_CHECK(fork_request->mode() != FORKSERVER_FORK_UNSPECIFIED,
                  "Forkserver mode is unspecified");
 
-  int exec_fd = -1;
-  if (fork_request.mode() == FORKSERVER_FORK_EXECVE ||
-      fork_request.mode() == FORKSERVER_FORK_EXECVE_SANDBOX) {
-    SAPI_RAW_CHECK(comms_->RecvFD(&exec_fd), "Failed to receive Exec FD");
+  *exec_fd = -1;
+  if (fork_request->mode() == FORKSERVER_FORK_EXECVE ||
+      fork_request->mode() == FORKSERVER_FORK_EXECVE_SANDBOX) {
+    SAPI_RAW_CHECK(comms_->RecvFD(exec_fd), "Failed to receive Exec FD");
+  }
+
+  if (fork_request->has_exec_args_id()) {
+    uint64_t id = fork_request->exec_args_id();
+    bool included;
+    SAPI_RAW_CHECK(comms_->RecvBool(&included),
+                   "Failed to receive ExecArgs presence");
+    if (included) {
+      SAPI_RAW_CHECK(comms_->RecvProtoBuf(&exec_args_[id]),
+                     "Failed to receive ExecArgs");
+    }
+    SAPI_RAW_CHECK(exec_args_.contains(id), "Unknown ExecArgs id");
+    UseExecArgs(id);
+  }
+  return true;
+}
+
+void ForkServer::UseExecArgs(uint64_t id) {
+  auto it = std::find(exec_args_lru_.begin(), exec_args_lru_.end(), id);
+  if (it != exec_args_lru_.end()) {
+    exec_args_lru_.erase(it);
+  }
+  exec_args_lru_.push_back(id);
+  if (exec_args_lru_.size() > kMaxForkServerExecArgs) {
+    exec_args_.erase(exec_args_lru_.front());
+    exec_args_lru_.erase(exec_args_lru_.begin());
+  }
+}
+
+pid_t ForkServer::ServeRequest() {
+  ForkRequest fork_request;
+  int comms_fd;
+  int exec_fd;
+  if (!ReceiveRequest(&fork_request, &comms_fd, &exec_fd)) {
+    return -1;
+  }
+
+  if (fork_request.prefork()) {
+    return ServePreforked(fork_request, exec_fd, comms_fd);
   }
 
+  SandboxeeProcess process;
+  pid_t sandboxee_pid = SpawnChild(fork_request, exec_fd, comms_fd,
+                                   /*parked=*/false, &process);
+  if (sandboxee_pid == 0) {
+    return sandboxee_pid;
+  }
+  close(comms_fd);
+  if (exec_fd >= 0) {
+    close(exec_fd);
+  }
+  SendProcess(fork_request, std::move(process));
+  return sandboxee_pid;
+}
+
+void ForkServer::ServeDirectRequest(Comms* comms) {
+  ForkServer server(comms, DirectTag{});
+  ForkRequest request;
+  int comms_fd;
+  int exec_fd;
+  if (!server.ReceiveRequest(&request, &comms_fd, &exec_fd)) {
+    return;
+  }
+  constexpr int kNamespaceFlags = CLONE_NEWCGROUP | CLONE_NEWIPC | CLONE_NEWNET |
+                                  CLONE_NEWNS | CLONE_NEWPID | CLONE_NEWUSER |
+                                  CLONE_NEWUTS;
+  SAPI_RAW_CHECK(exec_fd >= 0 && !request.has_mount_tree() &&
+                     (request.clone_flags() & kNamespaceFlags) == 0 &&
+                     request.monitor_type() == FORKSERVER_MONITOR_PTRACE &&
+                     !request.prefork(),
+                 "Request cannot be served directly");
+
+  SandboxeeProcess process;
+  process.init_pid = 0;
+  process.main_pid = getpid();
+  server.SendProcess(request, std::move(process));
+  // The requester's end of the connection is closed when the sandboxee's
+  // comms fd takes over its number.
+  server.LaunchChild(request, exec_fd, comms_fd, getuid(), getgid(),
+                     /*signaling_fd=*/-1, /*status_fd=*/-1,
+                     /*avoid_pivot_root=*/false, /*parked=*/false,
+                     /*mounts_prepared=*/false, /*trace=*/nullptr);
+}
+
+pid_t ForkServer::ServePreforked(const ForkRequest& request, int exec_fd,
+                                 int comms_fd) {
+  // Requests are only interchangeable if they are equal in every field, apart
+  // from whether they are traced and how many processes they keep ready.
+  ForkRequest key_request = request;
+  key_request.clear_trace_startup();
+  key_request.clear_prefork_count();
+  std::string key = SerializeDeterministically(key_request);
+
+  SandboxeeProcess process;
+  pid_t sandboxee_pid = -1;
+  if (auto it = parked_.find(key); it != parked_.end()) {
+    std::vector<ParkedChild>& children = it->second;
+    while (sandboxee_pid == -1 && !children.empty()) {
+      ParkedChild child = std::move(children.back());
+      children.pop_back();
+      --num_parked_;
+      Comms park_comms(child.park_fd.Release());
+      if (park_comms.SendFD(comms_fd) &&
+          (exec_fd < 0 || park_comms.SendFD(exec_fd))) {
+        process = std::move(child.process);
+        // Its setup happened ahead of this request.
+        process.trace.clear();
+        process.preforked = true;
+        sandboxee_pid = process.main_pid;
+      } else {
+        SAPI_RAW_LOG(WARNING, "Parked child %d went away",
+                     child.process.main_pid);
+      }
+    }
+  }
+  if (sandboxee_pid == -1) {
+    sandboxee_pid = SpawnChild(request, exec_fd, comms_fd, /*parked=*/false,
+                               &process);
+    if (sandboxee_pid == 0) {
+      return sandboxee_pid;
+    }
+  }
+  close(comms_fd);
+  if (exec_fd >= 0) {
+    close(exec_fd);
+  }
+  SendProcess(request, std::move(process));
+
+  // Prepare processes for the next such requests, now that this one was
+  // answered. Usually this replaces just the one that was handed out.
+  const size_t wanted = std::clamp<uint32_t>(request.prefork_count(), 1,
+                                             kMaxParkedChildren);
+  std::vector<ParkedChild>& children = parked_[key];
+  while (children.size() < wanted && num_parked_ < kMaxParkedChildren) {
+    int park_fds[2];
+    SAPI_RAW_PCHECK(
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, park_fds) == 0,
+        "creating parking socketpair");
+    // Added before spawning, so that the child closes the forkserver's end.
+    ParkedChild& child = children.emplace_back();
+    child.park_fd = file_util::fileops::FDCloser(park_fds[0]);
+    if (SpawnChild(request, /*exec_fd=*/-1, park_fds[1], /*parked=*/true,
+                   &child.process) == 0) {
+      // Only returns here once handed out, in FORKSERVER_FORK mode.
+      return 0;
+    }
+    close(park_fds[1]);
+    if (child.process.main_pid == -1) {
+      children.pop_back();
+      break;
+    }
+    ++num_parked_;
+  }
+  if (children.empty()) {
+    parked_.erase(key);
+  }
+  return sandboxee_pid;
+}
+
+void ForkServer::SendProcess(const ForkRequest& request,
+                             SandboxeeProcess process) {
+  SAPI_RAW_CHECK(
+      comms_->SendInt32(process.init_pid),
+      absl::StrCat("Failed to send init PID: ", process.init_pid).c_str());
+  SAPI_RAW_CHECK(
+      comms_->SendInt32(process.main_pid),
+      absl::StrCat("Failed to send sandboxee PID: ", process.main_pid).c_str());
+
+  if (process.status_fd.get() >= 0) {
+    SAPI_RAW_CHECK(comms_->SendFD(process.status_fd.get()),
+                   "Failed to send status pipe");
+  }
+  bool has_pidfd = process.main_pidfd.get() >= 0;
+  SAPI_RAW_CHECK(comms_->SendBool(has_pidfd), "Failed to send pidfd presence");
+  if (has_pidfd) {
+    SAPI_RAW_CHECK(comms_->SendFD(process.main_pidfd.get()),
+                   "Failed to send pidfd");
+  }
+  if (request.prefork()) {
+    SAPI_RAW_CHECK(comms_->SendBool(process.preforked),
+                   "Failed to send whether the process was preforked");
+  }
+  if (request.report_default_policy()) {
+    SAPI_RAW_CHECK(comms_->SendBool(default_policy_installed_),
+                   "Failed to send whether the default policy is installed");
+  }
+  if (request.trace_startup()) {
+    process.trace.push_back({"ForkServer::ServeRequest", request_start_ns_,
+                             MonotonicNowNs(), getpid()});
+    SAPI_RAW_CHECK(comms_->SendProtoBuf(TraceToProto(process.trace)),
+                   "Failed to send startup trace");
+  }
+}
+
+pid_t ForkServer::SpawnChild(const ForkRequest& fork_request, int exec_fd,
+                             int comms_fd, bool parked,
+                             SandboxeeProcess* process) {
   // Make the kernel notify us with SIGCHLD when the process terminates.
   // We use sigaction(SIGCHLD, flags=SA_NOCLDWAIT) in combination with
   // this to make sure the zombie process is reaped immediately.
   int clone_flags = fork_request.clone_flags() | SIGCHLD;
 
+  std::vector<TraceSpan>* trace =
+      fork_request.trace_startup() ? &process->trace : nullptr;
+  // Recorded by the children, which send them along with their pids.
+  std::vector<TraceSpan> child_trace;
+  std::vector<TraceSpan>* child_trace_ptr =
+      fork_request.trace_startup() ? &child_trace : nullptr;
+
   // Store uid and gid since they will change if CLONE_NEWUSER is set.
   uid_t uid = getuid();
   uid_t gid = getgid();
@@ -437,7 +790,8 @@ pid_t ForkServer::ServeRequest() {
 
   int socketpair_fds[2];
   SAPI_RAW_PCHECK(
-      socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socketpair_fds) == 0,
+      socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, socketpair_fds) ==
+          0,
       "creating signaling socketpair");
   for (int i = 0; i < 2; i++) {
     int val = 1;
@@ -453,41 +807,90 @@ pid_t ForkServer::ServeRequest() {
   //       process was started or stays at 0 if that is not needed - no pidns.
   pid_t init_pid = 0;
   pid_t sandboxee_pid = -1;
+  // Only set if this process forks the sandboxee itself, otherwise opened
+  // once its pid is known.
+  int pidfd = -1;
   bool avoid_pivot_root = clone_flags & (CLONE_NEWUSER | CLONE_NEWNS);
+  int mntns_fd = -1;
+  // Until all pids are known, which covers the namespace setup in the child.
+  int64_t fork_start_ns = 0;
   if (avoid_pivot_root) {
     // Create initial namespaces only when they're first needed.
     // This allows sandbox2 to be still used without any namespaces support
     if (initial_mntns_fd_ == -1) {
-      CreateInitialNamespaces();
+      ScopedTraceSpan span(trace, "ForkServer::CreateInitialNamespaces");
+      CreateInitialNamespaces(/*optional=*/false);
+    }
+    {
+      ScopedTraceSpan span(trace, "ForkServer::GetMountTemplate");
+      mntns_fd = GetMountTemplate(fork_request);
     }
-    // We first just fork a child, which will join the initial namespaces
+    // Joined instead of creating a new one.
+    int netns_fd = -1;
+    if (fork_request.share_netns() && (clone_flags & CLONE_NEWNET)) {
+      ScopedTraceSpan span(trace, "ForkServer::GetSharedNetns");
+      netns_fd = GetSharedNetns();
+      if (netns_fd != -1) {
+        clone_flags &= ~CLONE_NEWNET;
+      }
+    }
+    fork_start_ns = MonotonicNowNs();
+    // Only sandboxees that execve() can be forked by the helper, the others
+    // would continue with its outdated copy of this process.
+    bool will_execve = fork_request.mode() == FORKSERVER_FORK_EXECVE ||
+                       fork_request.mode() == FORKSERVER_FORK_EXECVE_SANDBOX;
+    bool forked_by_helper =
+        will_execve &&
+        ForkInNamespaceHelper(fork_request, clone_flags, exec_fd, comms_fd,
+                              fd_closer1.get(), pfds[1], mntns_fd, netns_fd,
+                              uid, gid, parked, trace);
+    // Otherwise we first just fork a child, which will join the initial
+    // namespaces.
     // Note: Not a regular fork() as one really needs to be single-threaded to
     //       setns and this is not the case with TSAN.
-    pid_t pid = util::ForkWithFlags(SIGCHLD);
-    SAPI_RAW_PCHECK(pid != -1, "fork failed");
-    if (pid == 0) {
-      SAPI_RAW_PCHECK(setns(initial_userns_fd_, CLONE_NEWUSER) != -1,
-                      "joining initial user namespace");
-      SAPI_RAW_PCHECK(setns(initial_mntns_fd_, CLONE_NEWNS) != -1,
-                      "joining initial mnt namespace");
-      close(initial_userns_fd_);
-      close(initial_mntns_fd_);
-      // Do not create new userns it will be unshared later
-      sandboxee_pid =
-          util::ForkWithFlags((clone_flags & ~CLONE_NEWUSER) | CLONE_PARENT);
-      if (sandboxee_pid == -1) {
-        SAPI_RAW_LOG(ERROR, "util::ForkWithFlags(%x)", clone_flags);
-      }
-      if (sandboxee_pid != 0) {
-        _exit(0);
+    if (!forked_by_helper) {
+      pid_t pid = util::ForkWithFlags(SIGCHLD);
+      SAPI_RAW_PCHECK(pid != -1, "fork failed");
+      if (pid == 0) {
+        ScopedTraceSpan join_span(child_trace_ptr,
+                                  "ForkServer::JoinNamespaces");
+        SAPI_RAW_PCHECK(setns(initial_userns_fd_, CLONE_NEWUSER) != -1,
+                        "joining initial user namespace");
+        // A cached mount namespace is a copy of the initial one, with the
+        // sandboxee's mounts already in place.
+        int base_mntns_fd = mntns_fd != -1 ? mntns_fd : initial_mntns_fd_;
+        SAPI_RAW_PCHECK(setns(base_mntns_fd, CLONE_NEWNS) != -1,
+                        "joining initial mnt namespace");
+        if (netns_fd != -1) {
+          SAPI_RAW_PCHECK(setns(netns_fd, CLONE_NEWNET) != -1,
+                          "joining shared net namespace");
+        }
+        close(initial_userns_fd_);
+        close(initial_mntns_fd_);
+        for (auto& [key, fd] : mount_templates_) {
+          fd.Close();
+        }
+        shared_netns_fd_.Close();
+        join_span.End();
+        // Do not create new userns it will be unshared later
+        sandboxee_pid = util::ForkWithFlags((clone_flags & ~CLONE_NEWUSER) |
+                                            CLONE_PARENT);
+        if (sandboxee_pid == -1) {
+          SAPI_RAW_LOG(ERROR, "util::ForkWithFlags(%x)", clone_flags);
+        }
+        if (sandboxee_pid != 0) {
+          _exit(0);
+        }
+        // Send sandboxee pid
+        absl::Status status = SendPid(fd_closer1.get(), child_trace_ptr);
+        SAPI_RAW_CHECK(status.ok(),
+                       absl::StrCat("sending pid: ", status.message()).c_str());
+        child_trace.clear();
       }
-      // Send sandboxee pid
-      absl::Status status = SendPid(fd_closer1.get());
-      SAPI_RAW_CHECK(status.ok(),
-                     absl::StrCat("sending pid: ", status.message()).c_str());
     }
   } else {
-    sandboxee_pid = util::ForkWithFlags(clone_flags);
+    fork_start_ns = MonotonicNowNs();
+    sandboxee_pid = util::ForkWithFlags(clone_flags, &pidfd);
     if (sandboxee_pid == -1) {
       SAPI_RAW_LOG(ERROR, "util::ForkWithFlags(%x)", clone_flags);
     }
@@ -499,15 +902,26 @@ pid_t ForkServer::ServeRequest() {
 
   // Child.
   if (sandboxee_pid == 0) {
+    // Parked processes must notice when the forkserver goes away, so they must
+    // not keep each other's parking sockets open. Neither may sandboxees get
+    // hold of the other processes' status pipes and pidfds.
+    for (auto& [key, children] : parked_) {
+      for (ParkedChild& child : children) {
+        child.park_fd.Close();
+        child.process.status_fd.Close();
+        child.process.main_pidfd.Close();
+      }
+    }
     LaunchChild(fork_request, exec_fd, comms_fd, uid, gid, fd_closer1.get(),
-                pfds[1], avoid_pivot_root);
+                pfds[1], avoid_pivot_root, parked,
+                /*mounts_prepared=*/mntns_fd != -1, child_trace_ptr);
     return sandboxee_pid;
   }
 
   fd_closer1.Close();
 
   if (avoid_pivot_root) {
-    if (auto pid = ReceivePid(fd_closer0.get()); !pid.ok()) {
+    if (auto pid = ReceivePid(fd_closer0.get(), trace); !pid.ok()) {
       SAPI_RAW_LOG(ERROR, "%s", std::string(pid.status().message()).c_str());
     } else {
       sandboxee_pid = pid.value();
@@ -521,7 +935,7 @@ pid_t ForkServer::ServeRequest() {
     sandboxee_pid = -1;
     // And the actual sandboxee is forked from the init process, so we need to
     // receive the actual PID.
-    if (auto pid_or = ReceivePid(fd_closer0.get()); !pid_or.ok()) {
+    if (auto pid_or = ReceivePid(fd_closer0.get(), trace); !pid_or.ok()) {
       SAPI_RAW_LOG(ERROR, "%s", std::string(pid_or.status().message()).c_str());
       if (init_pid != -1) {
         kill(init_pid, SIGKILL);
@@ -532,27 +946,224 @@ pid_t ForkServer::ServeRequest() {
     }
   }
 
-  // Parent.
+  if (trace != nullptr) {
+    trace->push_back(
+        {"ForkServer::Fork", fork_start_ns, MonotonicNowNs(), getpid()});
+  }
+
   if (pfds[1] >= 0) {
     close(pfds[1]);
   }
-  close(comms_fd);
-  if (exec_fd >= 0) {
-    close(exec_fd);
+  process->main_pidfd = file_util::fileops::FDCloser(pidfd);
+  if (fork_request.clone_flags() & CLONE_NEWPID) {
+    // The pidfd from forking refers to the init process.
+    process->main_pidfd.Close();
+  }
+  if (process->main_pidfd.get() == -1 && sandboxee_pid > 0) {
+    // The sandboxee blocks until its monitor attached, so unless setting it
+    // up failed, the pid still refers to it.
+    process->main_pidfd =
+        file_util::fileops::FDCloser(util::PidfdOpen(sandboxee_pid));
+  }
+  process->init_pid = init_pid;
+  process->main_pid = sandboxee_pid;
+  process->status_fd = file_util::fileops::FDCloser(pfds[0]);
+  return sandboxee_pid;
+}
+
+bool ForkServer::ForkInNamespaceHelper(const ForkRequest& request,
+                                       int clone_flags, int exec_fd,
+                                       int comms_fd, int signaling_fd,
+                                       int status_fd, int mntns_fd,
+                                       int netns_fd, uid_t uid, gid_t gid,
+                                       bool parked,
+                                       std::vector<TraceSpan>* trace) {
+  if (ns_helper_failed_ ||
+      !absl::GetFlag(FLAGS_sandbox2_forkserver_namespace_helper)) {
+    return false;
+  }
+  if (ns_helper_comms_ == nullptr) {
+    ScopedTraceSpan span(trace, "ForkServer::StartNamespaceHelper");
+    StartNamespaceHelper();
+    if (ns_helper_comms_ == nullptr) {
+      return false;
+    }
+  }
+
+  // The helper only knows the ExecArgs received before it started.
+  const ForkRequest* helper_request = &request;
+  ForkRequest inlined_request;
+  if (request.has_exec_args_id()) {
+    const ExecArgs& exec_args = exec_args_.find(request.exec_args_id())->second;
+    inlined_request = request;
+    inlined_request.clear_exec_args_id();
+    *inlined_request.mutable_args() = exec_args.args();
+    *inlined_request.mutable_envs() = exec_args.envs();
+    helper_request = &inlined_request;
+  }
+  // Bit i is set if the i-th of the fds is sent.
+  uint32_t present_fds = 0;
+  std::vector<int> fds;
+  int i = 0;
+  for (int fd : {exec_fd, comms_fd, signaling_fd, status_fd, mntns_fd,
+                 netns_fd}) {
+    if (fd != -1) {
+      present_fds |= 1u << i;
+      fds.push_back(fd);
+    }
+    ++i;
+  }
+
+  // A helper that went away must not take the forkserver with it through
+  // SIGPIPE.
+  sigset_t sigpipe_set;
+  sigset_t old_set;
+  sigemptyset(&sigpipe_set);
+  sigaddset(&sigpipe_set, SIGPIPE);
+  SAPI_RAW_PCHECK(sigprocmask(SIG_BLOCK, &sigpipe_set, &old_set) == 0,
+                  "blocking SIGPIPE");
+  bool sent = ns_helper_comms_->SendProtoBuf(*helper_request) &&
+              ns_helper_comms_->SendInt32(clone_flags) &&
+              ns_helper_comms_->SendUint32(uid) &&
+              ns_helper_comms_->SendUint32(gid) &&
+              ns_helper_comms_->SendBool(parked) &&
+              ns_helper_comms_->SendUint32(present_fds) &&
+              ns_helper_comms_->SendFDs(fds);
+  if (!sent) {
+    struct timespec no_wait = {};
+    sigtimedwait(&sigpipe_set, nullptr, &no_wait);
+  }
+  SAPI_RAW_PCHECK(sigprocmask(SIG_SETMASK, &old_set, nullptr) == 0,
+                  "restoring signal mask");
+  if (!sent) {
+    SAPI_RAW_LOG(WARNING,
+                 "Namespace helper went away, forking sandboxees without it");
+    ns_helper_comms_.reset();
+    ns_helper_failed_ = true;
   }
-  SAPI_RAW_CHECK(comms_->SendInt32(init_pid),
-                 absl::StrCat("Failed to send init PID: ", init_pid).c_str());
+  return sent;
+}
+
+void ForkServer::StartNamespaceHelper() {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+    SAPI_RAW_PLOG(WARNING, "creating namespace helper socket");
+    ns_helper_failed_ = true;
+    return;
+  }
+  // Not a regular fork(), see SpawnChild().
+  pid_t pid = util::ForkWithFlags(SIGCHLD);
+  if (pid == -1) {
+    SAPI_RAW_PLOG(WARNING, "forking namespace helper");
+    close(fds[0]);
+    close(fds[1]);
+    ns_helper_failed_ = true;
+    return;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    RunNamespaceHelper(fds[1]);
+  }
+  close(fds[1]);
+  ns_helper_comms_ = std::make_unique<Comms>(fds[0]);
+}
+
+void ForkServer::RunNamespaceHelper(int fd) {
+  SAPI_RAW_PCHECK(setns(initial_userns_fd_, CLONE_NEWUSER) != -1,
+                  "joining initial user namespace");
+  SAPI_RAW_PCHECK(setns(initial_mntns_fd_, CLONE_NEWNS) != -1,
+                  "joining initial mnt namespace");
+  // Neither the client comms, nor parking sockets, status pipes and the like
+  // may be kept open by the helper.
+  absl::Status status = sanitizer::CloseAllFDsExcept(
+      {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, fd, initial_mntns_fd_});
   SAPI_RAW_CHECK(
-      comms_->SendInt32(sandboxee_pid),
-      absl::StrCat("Failed to send sandboxee PID: ", sandboxee_pid).c_str());
+      status.ok(),
+      absl::StrCat("closing fds in namespace helper: ", status.message())
+          .c_str());
 
-  if (pfds[0] >= 0) {
-    SAPI_RAW_CHECK(comms_->SendFD(pfds[0]), "Failed to send status pipe");
-    close(pfds[0]);
+  Comms comms(fd);
+  for (;;) {
+    ForkRequest request;
+    if (!comms.RecvProtoBuf(&request)) {
+      // The forkserver went away.
+      _exit(EXIT_SUCCESS);
+    }
+    int32_t clone_flags;
+    uint32_t uid;
+    uint32_t gid;
+    bool parked;
+    uint32_t present_fds;
+    std::vector<int> fds;
+    SAPI_RAW_CHECK(comms.RecvInt32(&clone_flags) && comms.RecvUint32(&uid) &&
+                       comms.RecvUint32(&gid) && comms.RecvBool(&parked) &&
+                       comms.RecvUint32(&present_fds) && comms.RecvFDs(&fds),
+                   "receiving namespace helper request");
+    // In the order of ForkInNamespaceHelper().
+    int exec_fd = -1;
+    int comms_fd = -1;
+    int signaling_fd = -1;
+    int status_fd = -1;
+    int mntns_fd = -1;
+    int netns_fd = -1;
+    size_t next = 0;
+    int i = 0;
+    for (int* slot : {&exec_fd, &comms_fd, &signaling_fd, &status_fd,
+                      &mntns_fd, &netns_fd}) {
+      if (present_fds & (1u << i)) {
+        SAPI_RAW_CHECK(next < fds.size(), "missing namespace helper fd");
+        *slot = fds[next++];
+      }
+      ++i;
+    }
+
+    // A cached mount namespace is a copy of the initial one, with the
+    // sandboxee's mounts already in place.
+    SAPI_RAW_PCHECK(
+        setns(mntns_fd != -1 ? mntns_fd : initial_mntns_fd_, CLONE_NEWNS) != -1,
+        "joining mnt namespace");
+    std::vector<TraceSpan> trace;
+    std::vector<TraceSpan>* trace_ptr =
+        request.trace_startup() ? &trace : nullptr;
+    // Do not create new userns it will be unshared later
+    pid_t pid =
+        util::ForkWithFlags((clone_flags & ~CLONE_NEWUSER) | CLONE_PARENT);
+    if (pid == -1) {
+      SAPI_RAW_LOG(ERROR, "util::ForkWithFlags(%x)", clone_flags);
+    }
+    if (pid == 0) {
+      close(fd);
+      close(initial_mntns_fd_);
+      if (mntns_fd != -1) {
+        close(mntns_fd);
+      }
+      // Joined by the sandboxee only, the helper could not return to its own
+      // net namespace, which belongs to the parent user namespace.
+      if (netns_fd != -1) {
+        SAPI_RAW_PCHECK(setns(netns_fd, CLONE_NEWNET) != -1,
+                        "joining shared net namespace");
+        close(netns_fd);
+      }
+      // Send sandboxee pid
+      status = SendPid(signaling_fd, trace_ptr);
+      SAPI_RAW_CHECK(status.ok(),
+                     absl::StrCat("sending pid: ", status.message()).c_str());
+      trace.clear();
+      LaunchChild(request, exec_fd, comms_fd, uid, gid, signaling_fd,
+                  status_fd, /*avoid_pivot_root=*/true, parked,
+                  /*mounts_prepared=*/mntns_fd != -1, trace_ptr);
+      SAPI_RAW_LOG(FATAL, "Sandboxee returned from LaunchChild()");
+    }
+    // The sandboxee holds the only copies now, so the forkserver notices if
+    // it could not be forked.
+    for (int received_fd : fds) {
+      close(received_fd);
+    }
   }
-  return sandboxee_pid;
 }
 
+ForkServer::~ForkServer() = default;
+
 bool ForkServer::IsTerminated() const { return comms_->IsTerminated(); }
 
 bool ForkServer::Initialize() {
@@ -584,10 +1195,38 @@ bool ForkServer::Initialize() {
     }
     return false;
   }
+
+  // Checks that do not depend on the sandboxee's policy are done once, by a
+  // filter that every forked process inherits. Sandboxees still install their
+  // own policy, and without ptrace tracing get all of it, see
+  // MonitorBase::InitSendSetup().
+  if (absl::GetFlag(FLAGS_sandbox2_forkserver_default_policy)) {
+    std::vector<sock_filter> code = Policy::GetForkserverPolicy();
+    struct sock_fprog prog {
+      .len = static_cast<uint16_t>(code.size()), .filter = code.data(),
+    };
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1 ||
+        syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, 0,
+                reinterpret_cast<uintptr_t>(&prog)) == -1) {
+      SAPI_RAW_PLOG(WARNING, "Installing the forkserver default policy");
+    } else {
+      default_policy_installed_ = true;
+    }
+  }
   return true;
 }
 
-void ForkServer::CreateInitialNamespaces() {
+void ForkServer::Prewarm() {
+  if (initial_mntns_fd_ == -1 && !CreateInitialNamespaces(/*optional=*/true)) {
+    return;
+  }
+  if (!ns_helper_failed_ && ns_helper_comms_ == nullptr &&
+      absl::GetFlag(FLAGS_sandbox2_forkserver_namespace_helper)) {
+    StartNamespaceHelper();
+  }
+}
+
+bool ForkServer::CreateInitialNamespaces(bool optional) {
   // Spawn a new process to create initial user and mount namespaces to be used
   // as a base for each namespaced sandboxee.
 
@@ -600,6 +1239,13 @@ void ForkServer::CreateInitialNamespaces() {
   SAPI_RAW_PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != -1,
                   "creating socket");
   pid_t pid = util::ForkWithFlags(CLONE_NEWUSER | CLONE_NEWNS | SIGCHLD);
+  if (pid == -1 && optional) {
+    SAPI_RAW_VLOG(1, "Not prewarming initial namespaces: %s [%d]",
+                  StrError(errno).c_str(), errno);
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
   if (pid == -1 && errno == EPERM && IsLikelyChrooted()) {
     SAPI_RAW_LOG(FATAL,
                  "failed to fork initial namespaces process: parent process is "
@@ -628,6 +1274,103 @@ void ForkServer::CreateInitialNamespaces() {
   SAPI_RAW_PCHECK(TEMP_FAILURE_RETRY(write(fds[1], &unused, 1)) == 1,
                   "synchronizing initial namespaces creation");
   close(fds[1]);
+  return true;
+}
+
+int ForkServer::GetMountTemplate(const ForkRequest& request) {
+  if (!request.cache_mounts() || !request.has_mount_tree() ||
+      !(request.clone_flags() & CLONE_NEWNS)) {
+    return -1;
+  }
+  std::string key = SerializeDeterministically(request.mount_tree());
+  if (auto it = mount_templates_.find(key); it != mount_templates_.end()) {
+    return it->second.get();
+  }
+  if (mount_templates_.size() >= kMaxMountTemplates ||
+      !CanCacheMountTree(request.mount_tree())) {
+    return -1;
+  }
+
+  // Like CreateInitialNamespaces(), a process sets up the mounts and waits
+  // until its namespace was opened. Its mounts are never visible elsewhere, as
+  // the initial mount namespace turned all of them into slave mounts.
+  int fds[2];
+  SAPI_RAW_PCHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != -1,
+                  "creating socket");
+  file_util::fileops::FDCloser parent_fd(fds[1]);
+  pid_t pid = util::ForkWithFlags(SIGCHLD);
+  SAPI_RAW_PCHECK(pid != -1, "failed to fork mount template process");
+  char unused = '\0';
+  if (pid == 0) {
+    parent_fd.Close();
+    SAPI_RAW_PCHECK(setns(initial_userns_fd_, CLONE_NEWUSER) != -1,
+                    "joining initial user namespace");
+    SAPI_RAW_PCHECK(setns(initial_mntns_fd_, CLONE_NEWNS) != -1,
+                    "joining initial mnt namespace");
+    SAPI_RAW_PCHECK(unshare(CLONE_NEWNS) != -1, "unshare(CLONE_NEWNS)");
+    Namespace::InitializeMountTemplate(Mounts(request.mount_tree()));
+    SAPI_RAW_PCHECK(TEMP_FAILURE_RETRY(write(fds[0], &unused, 1)) == 1,
+                    "synchronizing mount template creation");
+    SAPI_RAW_PCHECK(TEMP_FAILURE_RETRY(read(fds[0], &unused, 1)) == 1,
+                    "synchronizing mount template creation");
+    _exit(0);
+  }
+  close(fds[0]);
+  file_util::fileops::FDCloser mntns_fd;
+  if (TEMP_FAILURE_RETRY(read(parent_fd.get(), &unused, 1)) == 1) {
+    mntns_fd = file_util::fileops::FDCloser(
+        open(absl::StrCat("/proc/", pid, "/ns/mnt").c_str(),
+             O_RDONLY | O_CLOEXEC));
+    TEMP_FAILURE_RETRY(write(parent_fd.get(), &unused, 1));
+  }
+  if (mntns_fd.get() == -1) {
+    // Also remembered, so that the tree is not tried again.
+    SAPI_RAW_LOG(WARNING, "Could not create mount template, not caching it");
+  }
+  return mount_templates_.emplace(std::move(key), std::move(mntns_fd))
+      .first->second.get();
+}
+
+int ForkServer::GetSharedNetns() {
+  if (shared_netns_created_) {
+    return shared_netns_fd_.get();
+  }
+  // Also remembered on failure, so that it is not tried again.
+  shared_netns_created_ = true;
+
+  // Like GetMountTemplate(), but the namespace is owned by the initial user
+  // namespace, in which sandboxees then set up their mounts. The first one
+  // brings up the loopback interface.
+  int fds[2];
+  SAPI_RAW_PCHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != -1,
+                  "creating socket");
+  file_util::fileops::FDCloser parent_fd(fds[1]);
+  pid_t pid = util::ForkWithFlags(SIGCHLD);
+  SAPI_RAW_PCHECK(pid != -1, "failed to fork shared net namespace process");
+  char unused = '\0';
+  if (pid == 0) {
+    parent_fd.Close();
+    SAPI_RAW_PCHECK(setns(initial_userns_fd_, CLONE_NEWUSER) != -1,
+                    "joining initial user namespace");
+    SAPI_RAW_PCHECK(unshare(CLONE_NEWNET) != -1, "unshare(CLONE_NEWNET)");
+    SAPI_RAW_PCHECK(TEMP_FAILURE_RETRY(write(fds[0], &unused, 1)) == 1,
+                    "synchronizing shared net namespace creation");
+    SAPI_RAW_PCHECK(TEMP_FAILURE_RETRY(read(fds[0], &unused, 1)) == 1,
+                    "synchronizing shared net namespace creation");
+    _exit(0);
+  }
+  close(fds[0]);
+  if (TEMP_FAILURE_RETRY(read(parent_fd.get(), &unused, 1)) == 1) {
+    shared_netns_fd_ = file_util::fileops::FDCloser(
+        open(absl::StrCat("/proc/", pid, "/ns/net").c_str(),
+             O_RDONLY | O_CLOEXEC));
+    TEMP_FAILURE_RETRY(write(parent_fd.get(), &unused, 1));
+  }
+  if (shared_netns_fd_.get() == -1) {
+    SAPI_RAW_LOG(WARNING,
+                 "Could not create shared net namespace, not sharing it");
+  }
+  return shared_netns_fd_.get();
 }
 
 void ForkServer::SanitizeEnvironment() {
@@ -672,13 +1415,15 @@ void ForkServer::ExecuteProcess(int execve_fd, const char* const* argv,
 }
 
 void ForkServer::InitializeNamespaces(const ForkRequest& request, uid_t uid,
-                                      gid_t gid, bool avoid_pivot_root) {
+                                      gid_t gid, bool avoid_pivot_root,
+                                      bool mounts_prepared) {
   if (!request.has_mount_tree()) {
     return;
   }
   Namespace::InitializeNamespaces(
       uid, gid, request.clone_flags(), Mounts(request.mount_tree()),
-      request.hostname(), avoid_pivot_root, request.allow_mount_propagation());
+      request.hostname(), avoid_pivot_root, request.allow_mount_propagation(),
+      mounts_prepared);
 }
 
 }  // namespace sandbox2
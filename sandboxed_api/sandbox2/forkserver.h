@@ -20,16 +20,23 @@
 
 #include <sys/types.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "absl/base/attributes.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/log/log.h"
+#include "sandboxed_api/sandbox2/fork_client.h"
+#include "sandboxed_api/sandbox2/forkserver.pb.h"
+#include "sandboxed_api/sandbox2/trace.h"
+#include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
 
 class Comms;
-class ForkRequest;
 
 class ForkServer {
  public:
@@ -42,6 +49,8 @@ class ForkServer {
     }
   }
 
+  ~ForkServer();
+
   // Returns whether the connection with the forkserver was terminated.
   bool IsTerminated() const;
 
@@ -51,26 +60,110 @@ class ForkServer {
   // Returns values defined as with fork() (-1 means error).
   pid_t ServeRequest();
 
+  // Serves a single request by turning the calling process into the
+  // sandboxee instead of forking one, see Executor::set_spawn_directly().
+  // Only requests that execve() a binary without namespaces can be served
+  // this way. Returns only if the request could not be received.
+  static void ServeDirectRequest(Comms* comms);
+
+  // Does the setup that requests would otherwise do on first use: creates the
+  // initial namespaces and starts the namespace helper. Namespaces that are not
+  // available are left to fail the first request that needs them.
+  void Prewarm();
+
  private:
-  // Creates and launched the child process.
+  // Leaves the process as it is, for ServeDirectRequest().
+  struct DirectTag {};
+  ForkServer(Comms* comms, DirectTag) : comms_(comms), direct_(true) {}
+
+  // Receives a fork request and its fds. Returns false if the connection was
+  // terminated.
+  bool ReceiveRequest(ForkRequest* fork_request, int* comms_fd, int* exec_fd);
+
+  // Marks the ExecArgs of `id` as the most recently used ones, and drops the
+  // least recently used ones beyond kMaxForkServerExecArgs, as the ForkClient
+  // expects.
+  void UseExecArgs(uint64_t id);
+
+  // A process that went through namespace setup for a request with
+  // ForkRequest::prefork set, and waits to be handed out for a later equal
+  // request.
+  struct ParkedChild {
+    // Receives the comms and exec fds of the request.
+    sapi::file_util::fileops::FDCloser park_fd;
+    SandboxeeProcess process;
+  };
+
+  // Maximum number of parked processes, over all requests.
+  static constexpr size_t kMaxParkedChildren = 32;
+  // Maximum number of cached mount namespaces, each for a different tree.
+  static constexpr size_t kMaxMountTemplates = 8;
+
+  // Forks the process for a request. Returns 0 in the child, and the
+  // sandboxee pid (or -1) in the parent, which also fills in process. Parked
+  // processes wait for the fds of the request before they continue.
+  pid_t SpawnChild(const ForkRequest& fork_request, int exec_fd, int comms_fd,
+                   bool parked, SandboxeeProcess* process);
+
+  // Serves a request with ForkRequest::prefork set, handing out a parked
+  // process if there is one, and parking new ones afterwards until there are
+  // ForkRequest::prefork_count of them.
+  pid_t ServePreforked(const ForkRequest& request, int exec_fd, int comms_fd);
+
+  // Sends the pids (and the status pipe and pidfd, if any) of a new process to
+  // the requester, followed by its trace if the request has trace_startup.
+  void SendProcess(const ForkRequest& request, SandboxeeProcess process);
+
+  // Creates and launched the child process. Records its setup into trace,
+  // unless that is nullptr, which goes to the forkserver along with the pid.
   void LaunchChild(const ForkRequest& request, int execve_fd, int client_fd,
                    uid_t uid, gid_t gid, int signaling_fd, int status_fd,
-                   bool avoid_pivot_root) const;
+                   bool avoid_pivot_root, bool parked, bool mounts_prepared,
+                   std::vector<TraceSpan>* trace) const;
+
+  // Lets the namespace helper fork the sandboxee for SpawnChild(), with the
+  // same arguments as the intermediate process would use. The sandboxee sends
+  // its pid over `signaling_fd` itself. Starts the helper on first use.
+  // Returns false if the request must fork the intermediate process instead.
+  bool ForkInNamespaceHelper(const ForkRequest& request, int clone_flags,
+                             int exec_fd, int comms_fd, int signaling_fd,
+                             int status_fd, int mntns_fd, int netns_fd,
+                             uid_t uid, gid_t gid, bool parked,
+                             std::vector<TraceSpan>* trace);
+
+  // Forks the namespace helper, a process that joins the initial namespaces
+  // once and then forks the sandboxees sent to it by ForkInNamespaceHelper(),
+  // so that each of them costs a single fork of a small process.
+  void StartNamespaceHelper();
+
+  // Main loop of the namespace helper, serving requests received over `fd`.
+  void RunNamespaceHelper(int fd) ABSL_ATTRIBUTE_NORETURN;
+
+  // Returns a mount namespace with the request's mount tree already set up,
+  // for ForkRequest::cache_mounts. Creates it on first use. Returns -1 if the
+  // tree must be set up by each sandboxee instead.
+  int GetMountTemplate(const ForkRequest& request);
+
+  // Returns the network namespace for ForkRequest::share_netns, creating it on
+  // first use. Returns -1 if it could not be created.
+  int GetSharedNetns();
 
   // Prepares the Fork-Server (worker side, not the requester side) for work by
   // sanitizing the environment:
   // - go down if the parent goes down,
   // - become subreaper - PR_SET_CHILD_SUBREAPER (man prctl),
-  // - don't convert children processes into zombies if they terminate.
+  // - don't convert children processes into zombies if they terminate,
+  // - install Policy::GetForkserverPolicy() if requested by flag.
   bool Initialize();
 
-  // Creates initial namespaces used as a template for namespaced sandboxees
-  void CreateInitialNamespaces();
+  // Creates initial namespaces used as a template for namespaced sandboxees.
+  // Dies if that fails, unless `optional`, in which case it returns false.
+  bool CreateInitialNamespaces(bool optional);
 
   // Prepares arguments for the upcoming execve (if execve was requested).
-  static void PrepareExecveArgs(const ForkRequest& request,
-                                std::vector<std::string>* args,
-                                std::vector<std::string>* envp);
+  void PrepareExecveArgs(const ForkRequest& request,
+                         std::vector<std::string>* args,
+                         std::vector<std::string>* envp) const;
 
   // Ensures that no unnecessary file descriptors are lingering after execve().
   static void SanitizeEnvironment();
@@ -81,13 +174,40 @@ class ForkServer {
 
   // Runs namespace initializers for a sandboxee.
   static void InitializeNamespaces(const ForkRequest& request, uid_t uid,
-                                   gid_t gid, bool avoid_pivot_root);
+                                   gid_t gid, bool avoid_pivot_root,
+                                   bool mounts_prepared);
 
   // Comms channel which is used to send requests to this class. Not owned by
   // the object.
   Comms* comms_;
+  // Whether this is serving a single request from ServeDirectRequest().
+  bool direct_ = false;
   int initial_mntns_fd_ = -1;
   int initial_userns_fd_ = -1;
+  // Parked processes by serialized request.
+  absl::flat_hash_map<std::string, std::vector<ParkedChild>> parked_;
+  size_t num_parked_ = 0;
+  // Mount namespace fds by serialized mount tree, -1 for trees that cannot
+  // be cached.
+  absl::flat_hash_map<std::string, sapi::file_util::fileops::FDCloser>
+      mount_templates_;
+  // Network namespace for ForkRequest::share_netns, once created.
+  sapi::file_util::fileops::FDCloser shared_netns_fd_;
+  bool shared_netns_created_ = false;
+  // Connection to the namespace helper, once started.
+  std::unique_ptr<Comms> ns_helper_comms_;
+  // Set if the namespace helper could not be used, so that it is not tried
+  // again.
+  bool ns_helper_failed_ = false;
+  // Set if Policy::GetForkserverPolicy() applies to every process forked.
+  bool default_policy_installed_ = false;
+  // When the request being served was received, for its trace.
+  int64_t request_start_ns_ = 0;
+
+  // Args and envs received for ForkRequest::exec_args_id, by id.
+  absl::flat_hash_map<uint64_t, ExecArgs> exec_args_;
+  // Ids of `exec_args_`, least recently used first.
+  std::vector<uint64_t> exec_args_lru_;
 };
 
 }  // namespace sandbox2
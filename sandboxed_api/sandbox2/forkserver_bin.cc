@@ -19,6 +19,7 @@
 #include <csignal>
 #include <cstdlib>
 
+#include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/log/globals.h"
 #include "sandboxed_api/sandbox2/comms.h"
@@ -26,6 +27,14 @@
 #include "sandboxed_api/sandbox2/sanitizer.h"
 #include "sandboxed_api/util/raw_logging.h"
 
+ABSL_FLAG(bool, sandbox2_forkserver_serve_direct, false,
+          "Serve a single request by becoming the sandboxee, see "
+          "sandbox2::Executor::set_spawn_directly()");
+ABSL_FLAG(bool, sandbox2_forkserver_prewarm, false,
+          "Set up namespaces before serving requests, and signal readiness "
+          "over the comms channel, see "
+          "sandbox2::GlobalForkClient::StartAsync()");
+
 int main(int argc, char* argv[]) {
   // Make sure the logs go stderr.
   absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
@@ -41,6 +50,12 @@ int main(int argc, char* argv[]) {
     SAPI_RAW_LOG(WARNING, "Closing non-essential FDs failed");
   }
 
+  if (absl::GetFlag(FLAGS_sandbox2_forkserver_serve_direct)) {
+    sandbox2::Comms comms(sandbox2::Comms::kDefaultConnection);
+    sandbox2::ForkServer::ServeDirectRequest(&comms);
+    return EXIT_FAILURE;
+  }
+
   // Make the process' name easily recognizable with ps/pstree.
   if (prctl(PR_SET_NAME, "S2-FORK-SERV", 0, 0, 0) != 0) {
     SAPI_RAW_PLOG(WARNING, "prctl(PR_SET_NAME, 'S2-FORK-SERV')");
@@ -64,6 +79,12 @@ int main(int argc, char* argv[]) {
   sandbox2::Comms comms(sandbox2::Comms::kDefaultConnection);
   sandbox2::ForkServer fork_server(&comms);
   sandbox2::sanitizer::WaitForSanitizer();
+  if (absl::GetFlag(FLAGS_sandbox2_forkserver_prewarm)) {
+    fork_server.Prewarm();
+    if (!comms.SendBool(true)) {
+      return EXIT_FAILURE;
+    }
+  }
 
   while (!fork_server.IsTerminated()) {
     pid_t child_pid = fork_server.ServeRequest();
@@ -15,23 +15,39 @@
 #include "sandboxed_api/sandbox2/forkserver.h"
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <cstddef>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
 #include "absl/log/check.h"
+#include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
 #include "sandboxed_api/sandbox2/global_forkclient.h"
 #include "sandboxed_api/sandbox2/ipc.h"
+#include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/raw_logging.h"
 
 namespace sandbox2 {
 
+namespace file_util = ::sapi::file_util;
 using ::sapi::GetTestSourcePath;
 
 class IpcPeer {
@@ -44,12 +60,37 @@ class IpcPeer {
   IPC* ipc_;
 };
 
+class GlobalForkClientPeer {
+ public:
+  // Returns the pid of the forkserver that the next request goes to, or -1. If
+  // `keep_busy`, it counts as busy with that request until FinishRequests().
+  static pid_t PickInstance(bool keep_busy) {
+    absl::MutexLock lock(&GlobalForkClient::instance_mutex_);
+    std::shared_ptr<GlobalForkClient> instance =
+        GlobalForkClient::PickInstanceLocked();
+    if (!instance) {
+      return -1;
+    }
+    if (keep_busy) {
+      ++instance->pending_requests_;
+    }
+    return instance->fork_client_.pid();
+  }
+
+  static void FinishRequests() {
+    absl::MutexLock lock(&GlobalForkClient::instance_mutex_);
+    for (const auto& instance : *GlobalForkClient::instances_) {
+      instance->pending_requests_ = 0;
+    }
+  }
+};
+
 int GetMinimalTestcaseFd() {
   const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
   return open(path.c_str(), O_RDONLY);
 }
 
-pid_t TestSingleRequest(Mode mode, int exec_fd) {
+pid_t TestSingleRequest(Mode mode, int exec_fd, bool prefork = false) {
   ForkRequest fork_req;
   IPC ipc;
   int sv[2];
@@ -60,6 +101,7 @@ pid_t TestSingleRequest(Mode mode, int exec_fd) {
   fork_req.set_mode(mode);
   fork_req.add_args("/binary");
   fork_req.add_envs("FOO=1");
+  fork_req.set_prefork(prefork);
 
   SandboxeeProcess process =
       GlobalForkClient::SendRequest(fork_req, exec_fd, sv[0]);
@@ -77,6 +119,44 @@ TEST(ForkserverTest, SimpleFork) {
   ASSERT_NE(TestSingleRequest(FORKSERVER_FORK, -1), -1);
 }
 
+TEST(ForkserverTest, StartAsyncIsReadyForRequests) {
+  std::shared_future<absl::Status> started = GlobalForkClient::StartAsync();
+  const absl::Status& status = started.get();
+  ASSERT_TRUE(status.ok()) << status;
+  EXPECT_TRUE(GlobalForkClient::IsStarted());
+  // Already running, so ready right away.
+  EXPECT_TRUE(GlobalForkClient::StartAsync().get().ok());
+  ASSERT_NE(TestSingleRequest(FORKSERVER_FORK, -1), -1);
+}
+
+TEST(ForkserverTest, PoolGrowsWhileBusyAndTakesTurns) {
+  GlobalForkClient::Shutdown();
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_sandbox2_forkserver_pool_size, 2);
+
+  // Another forkserver is started while all are busy, up to the pool size.
+  pid_t first = GlobalForkClientPeer::PickInstance(/*keep_busy=*/true);
+  ASSERT_NE(first, -1);
+  pid_t second = GlobalForkClientPeer::PickInstance(/*keep_busy=*/true);
+  ASSERT_NE(second, -1);
+  EXPECT_NE(second, first);
+  pid_t third = GlobalForkClientPeer::PickInstance(/*keep_busy=*/true);
+  EXPECT_TRUE(third == first || third == second);
+  GlobalForkClientPeer::FinishRequests();
+
+  // Equally busy forkservers take turns.
+  pid_t next = GlobalForkClientPeer::PickInstance(/*keep_busy=*/false);
+  EXPECT_TRUE(next == first || next == second);
+  for (int i = 0; i < 4; ++i) {
+    pid_t other = next == first ? second : first;
+    next = GlobalForkClientPeer::PickInstance(/*keep_busy=*/false);
+    EXPECT_EQ(next, other);
+  }
+
+  GlobalForkClient::Shutdown();
+  ASSERT_NE(TestSingleRequest(FORKSERVER_FORK, -1), -1);
+}
+
 TEST(ForkserverTest, SimpleForkNoZombie) {
   // Make sure that we don't create zombies.
   pid_t child = TestSingleRequest(FORKSERVER_FORK, -1);
@@ -103,6 +183,181 @@ TEST(ForkserverTest, ForkExecveWorks) {
   ASSERT_NE(TestSingleRequest(FORKSERVER_FORK_EXECVE, exec_fd), -1);
 }
 
+TEST(ForkserverTest, PreforkedForkExecveWorks) {
+  // The first request parks a process, which serves the second one.
+  for (int i = 0; i < 2; ++i) {
+    int exec_fd = GetMinimalTestcaseFd();
+    PCHECK(exec_fd != -1) << "Could not open test binary";
+    ASSERT_NE(TestSingleRequest(FORKSERVER_FORK_EXECVE, exec_fd,
+                                /*prefork=*/true),
+              -1);
+  }
+}
+
+TEST(ForkserverTest, PreforkCountKeepsProcessesReady) {
+  ForkRequest fork_req;
+  fork_req.set_mode(FORKSERVER_FORK_EXECVE);
+  fork_req.add_args("/binary");
+  fork_req.add_envs("PREFORK_COUNT_TEST=1");
+  fork_req.set_prefork(true);
+  fork_req.set_prefork_count(2);
+
+  // The first request parks two processes, which serve the next two.
+  for (int i = 0; i < 3; ++i) {
+    int exec_fd = GetMinimalTestcaseFd();
+    PCHECK(exec_fd != -1) << "Could not open test binary";
+    IPC ipc;
+    int sv[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != -1);
+    IpcPeer{&ipc}.SetUpServerSideComms(sv[1]);
+    SandboxeeProcess process =
+        GlobalForkClient::SendRequest(fork_req, exec_fd, sv[0]);
+    ASSERT_NE(process.main_pid, -1);
+    EXPECT_EQ(process.preforked, i > 0);
+    waitpid(process.main_pid, nullptr, 0);
+    close(sv[0]);
+  }
+}
+
+TEST(ForkserverTest, ForkExecveReturnsPidfd) {
+  if (util::PidfdOpen(getpid()) == -1) {
+    GTEST_SKIP() << "pidfds are not supported";
+  }
+  int exec_fd = GetMinimalTestcaseFd();
+  PCHECK(exec_fd != -1) << "Could not open test binary";
+  IPC ipc;
+  int sv[2];
+  PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != -1);
+  IpcPeer{&ipc}.SetUpServerSideComms(sv[1]);
+  ForkRequest fork_req;
+  fork_req.set_mode(FORKSERVER_FORK_EXECVE);
+  fork_req.add_args("/binary");
+
+  SandboxeeProcess process =
+      GlobalForkClient::SendRequest(fork_req, exec_fd, sv[0]);
+  ASSERT_NE(process.main_pid, -1);
+  ASSERT_NE(process.main_pidfd.get(), -1);
+  // The pidfd becomes readable once the process exited.
+  pollfd pfd = {.fd = process.main_pidfd.get(), .events = POLLIN};
+  EXPECT_EQ(poll(&pfd, 1, /*timeout=*/10000), 1);
+  close(sv[0]);
+}
+
+TEST(ForkserverTest, BatchedRequestsWork) {
+  constexpr int kRequests = 4;
+  std::vector<IPC> ipcs(kRequests);
+  std::vector<file_util::fileops::FDCloser> exec_fds;
+  std::vector<file_util::fileops::FDCloser> comms_fds;
+  ForkRequest fork_req;
+  fork_req.set_mode(FORKSERVER_FORK_EXECVE);
+  fork_req.add_args("/binary");
+  std::vector<ForkClient::Request> requests;
+  for (IPC& ipc : ipcs) {
+    exec_fds.emplace_back(GetMinimalTestcaseFd());
+    PCHECK(exec_fds.back().get() != -1) << "Could not open test binary";
+    int sv[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != -1);
+    IpcPeer{&ipc}.SetUpServerSideComms(sv[1]);
+    comms_fds.emplace_back(sv[0]);
+    requests.push_back(
+        {&fork_req, exec_fds.back().get(), comms_fds.back().get()});
+  }
+
+  std::vector<SandboxeeProcess> processes =
+      GlobalForkClient::SendRequests(requests);
+  ASSERT_EQ(processes.size(), kRequests);
+  absl::flat_hash_set<pid_t> pids;
+  for (const SandboxeeProcess& process : processes) {
+    EXPECT_NE(process.main_pid, -1);
+    pids.insert(process.main_pid);
+  }
+  EXPECT_EQ(pids.size(), kRequests);
+}
+
+TEST(ForkserverTest, RegisteredExecArgsAreShared) {
+  std::vector<std::string> args = {"/binary", "--flag"};
+  std::vector<std::string> envs = {"FOO=1"};
+  uint64_t id = RegisterExecArgs(args, envs);
+  EXPECT_NE(id, 0);
+  EXPECT_EQ(RegisterExecArgs(args, envs), id);
+  envs.push_back("BAR=2");
+  EXPECT_NE(RegisterExecArgs(args, envs), id);
+}
+
+TEST(ForkserverTest, ForkExecveWithRegisteredExecArgs) {
+  std::vector<std::string> args = {"/binary"};
+  std::vector<std::string> envs = {"FOO=1"};
+  ForkRequest fork_req;
+  fork_req.set_mode(FORKSERVER_FORK_EXECVE);
+  fork_req.set_exec_args_id(RegisterExecArgs(args, envs));
+  // Only the first request sends the args and envs along.
+  for (int i = 0; i < 2; ++i) {
+    file_util::fileops::FDCloser exec_fd(GetMinimalTestcaseFd());
+    PCHECK(exec_fd.get() != -1) << "Could not open test binary";
+    IPC ipc;
+    int sv[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != -1);
+    IpcPeer{&ipc}.SetUpServerSideComms(sv[1]);
+    file_util::fileops::FDCloser comms_fd(sv[0]);
+    SandboxeeProcess process =
+        GlobalForkClient::SendRequest(fork_req, exec_fd.get(), comms_fd.get());
+    ASSERT_NE(process.main_pid, -1);
+    waitpid(process.main_pid, nullptr, 0);
+  }
+}
+
+TEST(ForkserverTest, ForkExecveResendsDroppedExecArgs) {
+  // The forkserver drops the args of the first request before the last one,
+  // which uses them again.
+  std::vector<uint64_t> ids;
+  for (size_t i = 0; i <= kMaxForkServerExecArgs; ++i) {
+    ids.push_back(RegisterExecArgs(
+        {"/binary"}, {absl::StrCat("DROPPED_EXEC_ARGS=", i)}));
+    ASSERT_NE(ids.back(), 0);
+  }
+  ids.push_back(ids.front());
+  for (uint64_t id : ids) {
+    ForkRequest fork_req;
+    fork_req.set_mode(FORKSERVER_FORK_EXECVE);
+    fork_req.set_exec_args_id(id);
+    file_util::fileops::FDCloser exec_fd(GetMinimalTestcaseFd());
+    PCHECK(exec_fd.get() != -1) << "Could not open test binary";
+    IPC ipc;
+    int sv[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != -1);
+    IpcPeer{&ipc}.SetUpServerSideComms(sv[1]);
+    file_util::fileops::FDCloser comms_fd(sv[0]);
+    SandboxeeProcess process =
+        GlobalForkClient::SendRequest(fork_req, exec_fd.get(), comms_fd.get());
+    ASSERT_NE(process.main_pid, -1);
+    waitpid(process.main_pid, nullptr, 0);
+  }
+}
+
+TEST(ForkserverTest, NamespacedForkExecveWorks) {
+  // After the first request, sandboxees are forked by the namespace helper.
+  // The args registered later must reach it as well.
+  for (int i = 0; i < 3; ++i) {
+    std::vector<std::string> args = {"/binary"};
+    std::vector<std::string> envs = {absl::StrCat("NAMESPACED_REQUEST=", i)};
+    ForkRequest fork_req;
+    fork_req.set_mode(FORKSERVER_FORK_EXECVE);
+    fork_req.set_clone_flags(CLONE_NEWUSER | CLONE_NEWNS);
+    fork_req.set_exec_args_id(RegisterExecArgs(args, envs));
+    file_util::fileops::FDCloser exec_fd(GetMinimalTestcaseFd());
+    PCHECK(exec_fd.get() != -1) << "Could not open test binary";
+    IPC ipc;
+    int sv[2];
+    PCHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != -1);
+    IpcPeer{&ipc}.SetUpServerSideComms(sv[1]);
+    file_util::fileops::FDCloser comms_fd(sv[0]);
+    SandboxeeProcess process =
+        GlobalForkClient::SendRequest(fork_req, exec_fd.get(), comms_fd.get());
+    ASSERT_NE(process.main_pid, -1);
+    waitpid(process.main_pid, nullptr, 0);
+  }
+}
+
 TEST(ForkserverTest, ForkExecveSandboxWithoutPolicy) {
   // Run a test binary through the FORKSERVER_FORK_EXECVE_SANDBOX request.
   int exec_fd = GetMinimalTestcaseFd();
@@ -26,11 +26,15 @@
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <climits>
 #include <csignal>
 #include <cstdlib>
+#include <future>  // NOLINT(build/c++11)
 #include <memory>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
 #include <vector>
 
 #include "absl/cleanup/cleanup.h"
@@ -52,9 +56,11 @@
 #include "sandboxed_api/sandbox2/forkserver_bin_embed.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/metrics.h"
 #include "sandboxed_api/util/raw_logging.h"
 
 ABSL_DECLARE_FLAG(bool, sandbox2_forkserver_use_waitpid);
+ABSL_DECLARE_FLAG(bool, sandbox2_forkserver_default_policy);
 
 namespace sandbox2 {
 
@@ -115,6 +121,9 @@ ABSL_FLAG(sandbox2::GlobalForkserverStartModeSet,
               sandbox2::GlobalForkserverStartMode::kOnDemand)
           ,
           "When Sandbox2 Forkserver process should be started");
+ABSL_FLAG(int, sandbox2_forkserver_pool_size, 1,
+          "Maximum number of global forkservers that requests are spread "
+          "across. More than one are only started while all others are busy.");
 
 namespace sandbox2 {
 
@@ -128,6 +137,8 @@ struct ForkserverArgs {
   int exec_fd;
   int comms_fd;
   bool use_waitpid;
+  bool default_policy;
+  bool prewarm;
 };
 
 int LaunchForkserver(void* vargs) {
@@ -147,17 +158,26 @@ int LaunchForkserver(void* vargs) {
 
   char proc_name[] = "S2-FORK-SERV";
   char use_waitpid[] = "--sandbox2_forkserver_use_waitpid";
-  char* argv[] = {proc_name, nullptr, nullptr};
+  char default_policy[] = "--sandbox2_forkserver_default_policy";
+  char prewarm[] = "--sandbox2_forkserver_prewarm";
+  char* argv[] = {proc_name, nullptr, nullptr, nullptr, nullptr};
+  int argc = 1;
   if (args->use_waitpid) {
-    argv[1] = use_waitpid;
+    argv[argc++] = use_waitpid;
+  }
+  if (args->default_policy) {
+    argv[argc++] = default_policy;
+  }
+  if (args->prewarm) {
+    argv[argc++] = prewarm;
   }
   util::Execveat(args->exec_fd, "", argv, environ, AT_EMPTY_PATH);
   SAPI_RAW_PLOG(FATAL, "Could not launch forkserver binary");
 }
 
-absl::StatusOr<std::unique_ptr<GlobalForkClient>> StartGlobalForkServer() {
-  SAPI_RAW_LOG(INFO, "Starting global forkserver");
+}  // namespace
 
+absl::StatusOr<file_util::fileops::FDCloser> GetForkserverBinaryFd() {
   // Allow passing of a spearate forkserver_bin via flag
   int exec_fd = -1;
   if (!absl::GetFlag(FLAGS_sandbox2_forkserver_binary_path).empty()) {
@@ -178,7 +198,41 @@ absl::StatusOr<std::unique_ptr<GlobalForkClient>> StartGlobalForkServer() {
   if (exec_fd < 0) {
     return absl::InternalError("Getting FD for init binary failed");
   }
-  file_util::fileops::FDCloser exec_fd_closer(exec_fd);
+  return file_util::fileops::FDCloser(exec_fd);
+}
+
+namespace {
+
+absl::Status CheckStartAllowed(GlobalForkserverStartMode mode) {
+  if (getenv(kForkServerDisableEnv)) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Start of the Global Fork-Server prevented by the ",
+                     kForkServerDisableEnv, " environment variable present"));
+  }
+  if (!GetForkserverStartMode().contains(mode)) {
+    return absl::FailedPreconditionError(
+        "Start of the Global Fork-Server prevented by commandline flag");
+  }
+  return absl::OkStatus();
+}
+
+// With `prewarm`, the forkserver sends a bool once it is ready, which the
+// caller has to receive before sending requests.
+absl::StatusOr<std::unique_ptr<GlobalForkClient>> StartGlobalForkServer(
+    bool prewarm) {
+  SAPI_RAW_LOG(INFO, "Starting global forkserver");
+
+  absl::StatusOr<file_util::fileops::FDCloser> exec_fd_closer =
+      GetForkserverBinaryFd();
+  if (!exec_fd_closer.ok()) {
+    return exec_fd_closer.status();
+  }
+  int exec_fd = exec_fd_closer->get();
+  if (prewarm) {
+    // A binary given with --sandbox2_forkserver_binary_path might not be in
+    // the page cache yet. Best effort, it's just slower otherwise.
+    posix_fadvise(exec_fd, 0, 0, POSIX_FADV_WILLNEED);
+  }
 
   int sv[2];
   if (socketpair(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1) {
@@ -205,6 +259,9 @@ absl::StatusOr<std::unique_ptr<GlobalForkClient>> StartGlobalForkServer() {
       .exec_fd = exec_fd,
       .comms_fd = sv[0],
       .use_waitpid = absl::GetFlag(FLAGS_sandbox2_forkserver_use_waitpid),
+      .default_policy =
+          absl::GetFlag(FLAGS_sandbox2_forkserver_default_policy),
+      .prewarm = prewarm,
   };
   pid_t pid = clone(LaunchForkserver, &stack[stack_size], clone_flags, &args,
                     nullptr, nullptr, nullptr);
@@ -213,6 +270,7 @@ absl::StatusOr<std::unique_ptr<GlobalForkClient>> StartGlobalForkServer() {
   }
 
   close(sv[0]);
+  sapi::metrics::IncrementCounter(sapi::metrics::kGlobalForkServerStarts);
   return std::make_unique<GlobalForkClient>(sv[1], pid);
 }
 
@@ -239,97 +297,225 @@ void WaitForForkserver(pid_t pid) {
 }  // namespace
 
 absl::Mutex GlobalForkClient::instance_mutex_(absl::kConstInit);
-GlobalForkClient* GlobalForkClient::instance_ = nullptr;
+std::vector<std::shared_ptr<GlobalForkClient>>* GlobalForkClient::instances_ =
+    nullptr;
+size_t GlobalForkClient::next_instance_ = 0;
+bool GlobalForkClient::async_starting_ = false;
+std::shared_future<absl::Status>* GlobalForkClient::async_start_ = nullptr;
 
 void GlobalForkClient::EnsureStarted(GlobalForkserverStartMode mode) {
   absl::MutexLock lock(&instance_mutex_);
   EnsureStartedLocked(mode);
 }
 
+void GlobalForkClient::AwaitAsyncStartLocked() {
+  instance_mutex_.Await(absl::Condition(
+      +[](bool* async_starting) { return !*async_starting; },
+      &async_starting_));
+}
+
 void GlobalForkClient::EnsureStartedLocked(GlobalForkserverStartMode mode) {
-  if (instance_) {
-    return;
-  }
-  if (getenv(kForkServerDisableEnv)) {
-    SAPI_RAW_LOG(ERROR,
-                 "Start of the Global Fork-Server prevented by the %s "
-                 "environment variable present",
-                 kForkServerDisableEnv);
+  AwaitAsyncStartLocked();
+  if (instances_ && !instances_->empty()) {
     return;
   }
-  if (!GetForkserverStartMode().contains(mode)) {
-    SAPI_RAW_LOG(
-        ERROR, "Start of the Global Fork-Server prevented by commandline flag");
-    return;
+  StartInstanceLocked(mode);
+}
+
+bool GlobalForkClient::StartInstanceLocked(GlobalForkserverStartMode mode) {
+  if (absl::Status status = CheckStartAllowed(mode); !status.ok()) {
+    SAPI_RAW_LOG(ERROR, "%s", std::string(status.message()).c_str());
+    return false;
   }
   absl::StatusOr<std::unique_ptr<GlobalForkClient>> forkserver =
-      StartGlobalForkServer();
+      StartGlobalForkServer(/*prewarm=*/false);
   if (!forkserver.ok()) {
     SAPI_RAW_LOG(ERROR, "Starting forkserver failed: %s",
                  forkserver.status().message().data());
+    return false;
   }
-  instance_ = forkserver->release();
+  AddInstanceLocked(*std::move(forkserver));
+  return true;
+}
+
+void GlobalForkClient::AddInstanceLocked(
+    std::unique_ptr<GlobalForkClient> instance) {
+  if (!instances_) {
+    instances_ = new std::vector<std::shared_ptr<GlobalForkClient>>();
+  }
+  instances_->push_back(std::move(instance));
+}
+
+std::shared_ptr<GlobalForkClient> GlobalForkClient::PickInstanceLocked() {
+  EnsureStartedLocked(GlobalForkserverStartMode::kOnDemand);
+  if (!instances_ || instances_->empty()) {
+    return nullptr;
+  }
+  const size_t num_instances = instances_->size();
+  size_t least_busy = next_instance_ % num_instances;
+  for (size_t i = 1; i < num_instances; ++i) {
+    size_t candidate = (next_instance_ + i) % num_instances;
+    if ((*instances_)[candidate]->pending_requests_ <
+        (*instances_)[least_busy]->pending_requests_) {
+      least_busy = candidate;
+    }
+  }
+  const int pool_size = absl::GetFlag(FLAGS_sandbox2_forkserver_pool_size);
+  if ((*instances_)[least_busy]->pending_requests_ > 0 &&
+      num_instances < static_cast<size_t>(pool_size) &&
+      StartInstanceLocked(GlobalForkserverStartMode::kOnDemand)) {
+    next_instance_ = 0;
+    return instances_->back();
+  }
+  next_instance_ = least_busy + 1;
+  return (*instances_)[least_busy];
 }
 
 void GlobalForkClient::ForceStart() {
   absl::MutexLock lock(&GlobalForkClient::instance_mutex_);
-  SAPI_RAW_CHECK(instance_ == nullptr,
+  // Otherwise, a forkserver that StartAsync() is still starting would end up
+  // running alongside the one started here.
+  AwaitAsyncStartLocked();
+  SAPI_RAW_CHECK(!instances_ || instances_->empty(),
                  "A force start requested when the Global Fork-Server was "
                  "already running");
   absl::StatusOr<std::unique_ptr<GlobalForkClient>> forkserver =
-      StartGlobalForkServer();
+      StartGlobalForkServer(/*prewarm=*/false);
   SAPI_RAW_CHECK(forkserver.ok(), forkserver.status().message().data());
-  instance_ = forkserver->release();
+  AddInstanceLocked(*std::move(forkserver));
+}
+
+std::shared_future<absl::Status> GlobalForkClient::StartAsync() {
+  absl::MutexLock lock(&instance_mutex_);
+  if (async_starting_) {
+    return *async_start_;
+  }
+  std::promise<absl::Status> promise;
+  std::shared_future<absl::Status> started = promise.get_future().share();
+  if (instances_ && !instances_->empty()) {
+    promise.set_value(absl::OkStatus());
+    return started;
+  }
+  if (absl::Status status =
+          CheckStartAllowed(GlobalForkserverStartMode::kOnDemand);
+      !status.ok()) {
+    promise.set_value(std::move(status));
+    return started;
+  }
+  delete async_start_;
+  async_start_ = new std::shared_future<absl::Status>(started);
+  async_starting_ = true;
+  // Neither the start nor the prewarming hold instance_mutex_.
+  std::thread([promise = std::move(promise)]() mutable {
+    absl::StatusOr<std::unique_ptr<GlobalForkClient>> forkserver =
+        StartGlobalForkServer(/*prewarm=*/true);
+    absl::Status status = forkserver.status();
+    bool ready = false;
+    if (forkserver.ok() && !(*forkserver)->comms_.RecvBool(&ready)) {
+      status = absl::UnavailableError(
+          "Global forkserver terminated while prewarming");
+      pid_t pid = (*forkserver)->fork_client_.pid();
+      forkserver->reset();
+      WaitForForkserver(pid);
+    }
+    {
+      absl::MutexLock lock(&instance_mutex_);
+      async_starting_ = false;
+      if (status.ok()) {
+        AddInstanceLocked(*std::move(forkserver));
+      }
+    }
+    if (!status.ok()) {
+      SAPI_RAW_LOG(ERROR, "Starting forkserver failed: %s",
+                   std::string(status.message()).c_str());
+    }
+    promise.set_value(std::move(status));
+  }).detach();
+  return started;
 }
 
 void GlobalForkClient::Shutdown() {
-  pid_t pid = -1;
+  std::vector<std::shared_ptr<GlobalForkClient>> instances;
   {
     absl::MutexLock lock(&GlobalForkClient::instance_mutex_);
-    if (instance_) {
-      pid = instance_->fork_client_.pid();
+    AwaitAsyncStartLocked();
+    if (instances_) {
+      instances.swap(*instances_);
     }
-    delete instance_;
-    instance_ = nullptr;
+    // Let requests that are still being sent finish.
+    instance_mutex_.Await(absl::Condition(
+        +[](std::vector<std::shared_ptr<GlobalForkClient>>* instances) {
+          instance_mutex_.AssertHeld();
+          return std::all_of(instances->begin(), instances->end(),
+                             [](const std::shared_ptr<GlobalForkClient>& i) {
+                               instance_mutex_.AssertHeld();
+                               return i->pending_requests_ == 0;
+                             });
+        },
+        &instances));
   }
-  if (pid != -1) {
+  std::vector<pid_t> pids;
+  for (const auto& instance : instances) {
+    pids.push_back(instance->fork_client_.pid());
+  }
+  instances.clear();
+  for (pid_t pid : pids) {
     WaitForForkserver(pid);
   }
 }
 
 SandboxeeProcess GlobalForkClient::SendRequest(const ForkRequest& request,
                                                int exec_fd, int comms_fd) {
-  absl::ReleasableMutexLock lock(&GlobalForkClient::instance_mutex_);
-  EnsureStartedLocked(GlobalForkserverStartMode::kOnDemand);
-  if (!instance_) {
-    return SandboxeeProcess();
+  std::vector<SandboxeeProcess> processes =
+      SendRequests({{&request, exec_fd, comms_fd}});
+  return std::move(processes.front());
+}
+
+std::vector<SandboxeeProcess> GlobalForkClient::SendRequests(
+    absl::Span<const ForkClient::Request> requests) {
+  std::shared_ptr<GlobalForkClient> instance;
+  {
+    absl::MutexLock lock(&GlobalForkClient::instance_mutex_);
+    instance = PickInstanceLocked();
+    if (!instance) {
+      return std::vector<SandboxeeProcess>(requests.size());
+    }
+    instance->pending_requests_ += requests.size();
   }
-  SandboxeeProcess process =
-      instance_->fork_client_.SendRequest(request, exec_fd, comms_fd);
-  if (instance_->comms_.IsTerminated()) {
+  std::vector<SandboxeeProcess> processes =
+      instance->fork_client_.SendRequests(requests);
+  bool removed = false;
+  {
+    absl::MutexLock lock(&GlobalForkClient::instance_mutex_);
+    instance->pending_requests_ -= requests.size();
+    if (instance->comms_.IsTerminated() && instances_) {
+      auto it = std::find(instances_->begin(), instances_->end(), instance);
+      if (it != instances_->end()) {
+        instances_->erase(it);
+        removed = true;
+      }
+    }
+  }
+  // Only one thread waits for a failed forkserver, and it doesn't hold the
+  // lock while doing so.
+  if (removed) {
     LOG(ERROR) << "Global forkserver connection terminated";
-    pid_t server_pid = instance_->fork_client_.pid();
-    delete instance_;
-    instance_ = nullptr;
-    // Don't wait for process exit while still holding the lock and potentially
-    // blocking other threads.
-    lock.Release();
-    WaitForForkserver(server_pid);
-  }
-  return process;
+    WaitForForkserver(instance->fork_client_.pid());
+  }
+  return processes;
 }
 
 pid_t GlobalForkClient::GetPid() {
   absl::MutexLock lock(&instance_mutex_);
   EnsureStartedLocked(GlobalForkserverStartMode::kOnDemand);
-  if (!instance_) {
+  if (!instances_ || instances_->empty()) {
     return -1;
   }
-  return instance_->fork_client_.pid();
+  return instances_->front()->fork_client_.pid();
 }
 
 bool GlobalForkClient::IsStarted() {
   absl::ReaderMutexLock lock(&instance_mutex_);
-  return instance_ != nullptr;
+  return instances_ && !instances_->empty();
 }
 }  // namespace sandbox2
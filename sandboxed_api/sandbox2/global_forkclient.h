@@ -21,15 +21,23 @@
 #include <sys/types.h>
 
 #include <bitset>
+#include <cstddef>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/flags/declare.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/fork_client.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
+#include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
 
@@ -44,33 +52,79 @@ class GlobalForkClient {
   GlobalForkClient(int fd, pid_t pid)
       : comms_(fd), fork_client_(pid, &comms_) {}
 
+  // Sends the request to the least busy of the global forkservers, starting
+  // another one if all are busy and --sandbox2_forkserver_pool_size allows.
+  // Requests to different forkservers are handled concurrently.
   static SandboxeeProcess SendRequest(const ForkRequest& request, int exec_fd,
                                       int comms_fd)
       ABSL_LOCKS_EXCLUDED(instance_mutex_);
+  // Sends all requests to the same forkserver at once, see
+  // ForkClient::SendRequests().
+  static std::vector<SandboxeeProcess> SendRequests(
+      absl::Span<const ForkClient::Request> requests)
+      ABSL_LOCKS_EXCLUDED(instance_mutex_);
+  // Returns the pid of the first global forkserver.
   static pid_t GetPid() ABSL_LOCKS_EXCLUDED(instance_mutex_);
 
   static void EnsureStarted() ABSL_LOCKS_EXCLUDED(instance_mutex_) {
     EnsureStarted(GlobalForkserverStartMode::kOnDemand);
   }
+  // Starts the global forkserver on a background thread, unless it is running
+  // or being started already, and lets it set up the namespaces the first
+  // request would otherwise wait for. The returned future becomes ready once
+  // the forkserver can serve requests. Requests sent meanwhile wait for it
+  // instead of starting another one. Meant to be called early, e.g. at the
+  // start of main(), so that the first sandbox doesn't pay for the start.
+  static std::shared_future<absl::Status> StartAsync()
+      ABSL_LOCKS_EXCLUDED(instance_mutex_);
   static void Shutdown() ABSL_LOCKS_EXCLUDED(instance_mutex_);
   static bool IsStarted() ABSL_LOCKS_EXCLUDED(instance_mutex_);
 
  private:
   friend void StartGlobalForkserverFromLibCtor();
+  friend class GlobalForkClientPeer;  // For testing
 
   static void ForceStart() ABSL_LOCKS_EXCLUDED(instance_mutex_);
   static void EnsureStarted(GlobalForkserverStartMode mode)
       ABSL_LOCKS_EXCLUDED(instance_mutex_);
   static void EnsureStartedLocked(GlobalForkserverStartMode mode)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(instance_mutex_);
+  // Waits for the forkserver that StartAsync() is starting, if any.
+  static void AwaitAsyncStartLocked()
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(instance_mutex_);
+  // Starts another forkserver. Returns false if that is not allowed or failed.
+  static bool StartInstanceLocked(GlobalForkserverStartMode mode)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(instance_mutex_);
+  // Adds a started forkserver to the ones requests are sent to.
+  static void AddInstanceLocked(std::unique_ptr<GlobalForkClient> instance)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(instance_mutex_);
+  // Returns the forkserver to send the next request to, or nullptr. Of equally
+  // busy ones, they take turns.
+  static std::shared_ptr<GlobalForkClient> PickInstanceLocked()
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(instance_mutex_);
 
   static absl::Mutex instance_mutex_;
-  static GlobalForkClient* instance_ ABSL_GUARDED_BY(instance_mutex_);
+  // The running forkservers. They are shared with the threads sending requests
+  // to them, so that instance_mutex_ needn't be held during a request.
+  static std::vector<std::shared_ptr<GlobalForkClient>>* instances_
+      ABSL_GUARDED_BY(instance_mutex_);
+  // Index in instances_ that PickInstanceLocked() looks at first.
+  static size_t next_instance_ ABSL_GUARDED_BY(instance_mutex_);
+  // Set while StartAsync() starts a forkserver, whose result is async_start_.
+  static bool async_starting_ ABSL_GUARDED_BY(instance_mutex_);
+  static std::shared_future<absl::Status>* async_start_
+      ABSL_GUARDED_BY(instance_mutex_);
 
   Comms comms_;
   ForkClient fork_client_;
+  // Number of requests currently sent to this forkserver.
+  size_t pending_requests_ ABSL_GUARDED_BY(instance_mutex_) = 0;
 };
 
+// Returns an fd of the forkserver binary, either the one given with
+// --sandbox2_forkserver_binary_path or the embedded one.
+absl::StatusOr<sapi::file_util::fileops::FDCloser> GetForkserverBinaryFd();
+
 class GlobalForkserverStartModeSet {
  public:
   static constexpr size_t kSize = static_cast<size_t>(
@@ -108,5 +162,6 @@ std::string AbslUnparseFlag(GlobalForkserverStartModeSet in);
 ABSL_DECLARE_FLAG(sandbox2::GlobalForkserverStartModeSet,
                   sandbox2_forkserver_start_mode);
 ABSL_DECLARE_FLAG(std::string, sandbox2_forkserver_binary_path);
+ABSL_DECLARE_FLAG(int, sandbox2_forkserver_pool_size);
 
 #endif  // SANDBOXED_API_SANDBOX2_GLOBAL_FORKCLIENT_H_
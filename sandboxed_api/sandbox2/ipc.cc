@@ -18,10 +18,13 @@
 
 #include <sys/socket.h>
 
+#include <cstdint>
 #include <memory>
 #include <thread>
+#include <vector>
 
 #include "absl/log/log.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/logserver.h"
 #include "sandboxed_api/sandbox2/logsink.h"
 #include "sandboxed_api/util/raw_logging.h"
@@ -36,6 +39,12 @@ void IPC::MapFd(int local_fd, int remote_fd) {
   fd_map_.push_back(std::make_tuple(local_fd, remote_fd, ""));
 }
 
+void IPC::MapFd(int local_fd, absl::string_view name) {
+  VLOG(3) << "Will send: " << local_fd << ", named: " << name;
+
+  fd_map_.push_back(std::make_tuple(local_fd, -1, std::string(name)));
+}
+
 int IPC::ReceiveFd(int remote_fd) { return ReceiveFd(remote_fd, ""); }
 
 int IPC::ReceiveFd(absl::string_view name) { return ReceiveFd(-1, name); }
@@ -54,27 +63,38 @@ int IPC::ReceiveFd(int remote_fd, absl::string_view name) {
   return sv[0];
 }
 
-bool IPC::SendFdsOverComms() {
-  if (!(comms_->SendUint32(fd_map_.size()))) {
-    LOG(ERROR) << "Couldn't send IPC fd size";
+bool IPC::SendFdsOverComms(absl::Span<const Comms::TLV> trailer) {
+  // The mapping entries and the trailer are written out together.
+  const uint32_t num_fds = fd_map_.size();
+  std::vector<Comms::TLV> tlvs;
+  tlvs.reserve(1 + 2 * fd_map_.size() + trailer.size());
+  tlvs.push_back({Comms::kTagUint32, sizeof(num_fds), &num_fds});
+  std::vector<int> local_fds;
+  local_fds.reserve(fd_map_.size());
+  for (const auto& [local_fd, remote_fd, name] : fd_map_) {
+    tlvs.push_back({Comms::kTagInt32, sizeof(remote_fd), &remote_fd});
+    tlvs.push_back({Comms::kTagString, name.size(), name.data()});
+    local_fds.push_back(local_fd);
+  }
+  tlvs.insert(tlvs.end(), trailer.begin(), trailer.end());
+  if (!comms_->SendTLVs(tlvs)) {
+    LOG(ERROR) << "Couldn't send the fd mappings";
     return false;
   }
 
-  for (const auto& fd_tuple : fd_map_) {
-    if (!(comms_->SendInt32(std::get<1>(fd_tuple)))) {
-      LOG(ERROR) << "SendInt32: Couldn't send " << std::get<1>(fd_tuple);
-      return false;
-    }
-    if (!(comms_->SendFD(std::get<0>(fd_tuple)))) {
-      LOG(ERROR) << "SendFd: Couldn't send " << std::get<0>(fd_tuple);
-      return false;
-    }
-
-    if (!(comms_->SendString(std::get<2>(fd_tuple)))) {
-      LOG(ERROR) << "SendString: Couldn't send " << std::get<2>(fd_tuple);
+  // The descriptors themselves follow in as few messages as possible.
+  absl::Span<const int> remaining(local_fds);
+  while (!remaining.empty()) {
+    absl::Span<const int> batch =
+        remaining.subspan(0, Comms::kMaxFDsPerMessage);
+    if (!(comms_->SendFDs(batch))) {
+      LOG(ERROR) << "SendFDs: Couldn't send " << batch.size() << " fds";
       return false;
     }
+    remaining.remove_prefix(batch.size());
+  }
 
+  for (const auto& fd_tuple : fd_map_) {
     VLOG(3) << "IPC: local_fd: " << std::get<0>(fd_tuple)
             << ", remote_fd: " << std::get<1>(fd_tuple) << " sent";
   }
@@ -91,12 +111,17 @@ void IPC::InternalCleanupFdMap() {
 
 void IPC::EnableLogServer() {
   int fd = ReceiveFd(LogSink::kLogFDName);
-  auto logger = [fd] {
-    LogServer log_server(fd);
-    log_server.Run();
-  };
-  std::thread log_thread{logger};
+  log_server_ = std::make_shared<LogServer>(fd, log_server_options_);
+  // The thread shares ownership, as it may outlive the IPC object.
+  std::thread log_thread{[log_server = log_server_] { log_server->Run(); }};
   log_thread.detach();
 }
 
+void IPC::SetLogServerOptions(const LogServerOptions& options) {
+  log_server_options_ = options;
+  if (log_server_) {
+    log_server_->SetOptions(options);
+  }
+}
+
 }  // namespace sandbox2
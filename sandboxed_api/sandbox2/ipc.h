@@ -24,7 +24,9 @@
 #include <vector>
 
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/logserver.h"
 
 namespace sandbox2 {
 
@@ -46,6 +48,10 @@ class IPC final {
   // it should not be used from that point on.
   void MapFd(int local_fd, int remote_fd);
 
+  // Like MapFd() above, but the sandboxee retrieves the descriptor by name with
+  // the Client::GetMappedFD() api instead.
+  void MapFd(int local_fd, absl::string_view name);
+
   // Creates and returns a socketpair endpoint. The other endpoint of the
   // socketpair is marked as to be sent to the remote process (sandboxee) with
   // SendFdsOverComms() as with MapFd().
@@ -60,6 +66,10 @@ class IPC final {
   // Client::SendLogsToSupervisor in the sandboxee.
   void EnableLogServer();
 
+  // Limits the messages logged by the log server, also if it is running
+  // already. Set from PolicyBuilder::AllowLogForwarding().
+  void SetLogServerOptions(const LogServerOptions& options);
+
  private:
   friend class Executor;
   friend class MonitorBase;
@@ -69,8 +79,9 @@ class IPC final {
   void SetUpServerSideComms(int fd);
 
   // Sends file descriptors to the sandboxee. Close the local FDs (e.g. passed
-  // in MapFd()) - they cannot be used anymore.
-  bool SendFdsOverComms();
+  // in MapFd()) - they cannot be used anymore. `trailer` is sent along with the
+  // fd mappings, before the descriptors themselves.
+  bool SendFdsOverComms(absl::Span<const Comms::TLV> trailer = {});
 
   void InternalCleanupFdMap();
 
@@ -81,6 +92,9 @@ class IPC final {
 
   // Comms channel used to exchange data with the sandboxee.
   std::unique_ptr<Comms> comms_;
+
+  LogServerOptions log_server_options_;
+  std::shared_ptr<LogServer> log_server_;
 };
 
 }  // namespace sandbox2
@@ -22,12 +22,59 @@
 
 #include <cstdint>
 #include <ctime>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/base/macros.h"
 #include "absl/time/time.h"
 
 namespace sandbox2 {
 
+// Resource controls of a cgroup (v2) that the sandboxee is moved into, see
+// Limits::set_cgroup(). Unset values keep the defaults of the kernel.
+struct CgroupLimits {
+  // Directory of a cgroup that was delegated to this process, e.g.
+  // "/sys/fs/cgroup/sandboxes". Every sandboxee gets a cgroup of its own below
+  // it, which is removed together with the sandbox.
+  std::string parent;
+  // memory.max: the sandboxee is OOM-killed above this many bytes.
+  std::optional<uint64_t> memory_max;
+  // memory.high: the sandboxee is throttled and reclaimed above this many
+  // bytes.
+  std::optional<uint64_t> memory_high;
+  // cpu.max: the sandboxee may use this much CPU time per cpu_period.
+  std::optional<absl::Duration> cpu_quota;
+  absl::Duration cpu_period = absl::Milliseconds(100);
+  // cpu.weight: share of CPU time relative to other cgroups below parent,
+  // from 1 to 10000. The kernel default is 100.
+  std::optional<uint32_t> cpu_weight;
+  // pids.max: maximum number of processes and threads.
+  std::optional<uint64_t> pids_max;
+  // io.max: one line per device, e.g. "8:0 rbps=1048576 wiops=120".
+  std::vector<std::string> io_max;
+};
+
+// Where and how the sandboxee is scheduled, see Limits::set_placement(). The
+// client applies it to itself before the sandbox is enabled, so that threads
+// started later inherit it. Unset values are inherited from the forkserver.
+struct Placement {
+  // CPUs the sandboxee may run on, see sched_setaffinity(2).
+  std::vector<int> cpus;
+  // NUMA node that the sandboxee allocates memory from, see
+  // set_mempolicy(2).
+  std::optional<int> numa_node;
+  // Only allocate from numa_node (MPOL_BIND) instead of preferring it
+  // (MPOL_PREFERRED), which falls back to other nodes once it is full.
+  bool strict_numa = false;
+  // Scheduling policy, e.g. SCHED_BATCH or SCHED_IDLE, see sched(7).
+  std::optional<int> sched_policy;
+  // Nice value from -20 to 19. Going below that of the forkserver requires
+  // CAP_SYS_NICE.
+  std::optional<int> nice;
+};
+
 class Limits final {
  public:
   Limits() = default;
@@ -101,6 +148,24 @@ class Limits final {
   }
   absl::Duration wall_time_limit() const { return wall_time_limit_; }
 
+  // Runs the sandboxee in a cgroup with the given limits. Unlike rlimits, they
+  // apply to all processes of the sandboxee together, and memory.max limits
+  // the memory actually used rather than the address space reserved.
+  Limits& set_cgroup(CgroupLimits value) {
+    cgroup_ = std::move(value);
+    return *this;
+  }
+  const std::optional<CgroupLimits>& cgroup() const { return cgroup_; }
+
+  // Pins the sandboxee to CPUs and a NUMA node, and sets its scheduling
+  // policy. Failing to apply it fails the start of the sandboxee, like with
+  // rlimits.
+  Limits& set_placement(Placement value) {
+    placement_ = std::move(value);
+    return *this;
+  }
+  const Placement& placement() const { return placement_; }
+
  private:
   constexpr rlimit64 MakeRlimit64(uint64_t value) {
     return {.rlim_cur = value, .rlim_max = value};
@@ -132,6 +197,10 @@ class Limits final {
   // one, or RLIMIT_CPU limit might be triggered faster (see
   // https://en.wikipedia.org/wiki/Time_(Unix)#Real_time_vs_CPU_time).
   absl::Duration wall_time_limit_ = absl::Seconds(120);
+
+  std::optional<CgroupLimits> cgroup_;
+
+  Placement placement_;
 };
 
 }  // namespace sandbox2
@@ -14,29 +14,100 @@
 
 #include "sandboxed_api/sandbox2/logserver.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <string>
+#include <utility>
 
 #include "absl/base/log_severity.h"
 #include "absl/log/log.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/logserver.pb.h"
 
 namespace sandbox2 {
 
-LogServer::LogServer(int fd) : comms_(fd) {}
+LogServer::LogServer(int fd, LogServerOptions options)
+    : comms_(fd), options_(std::move(options)), tokens_(options_.burst) {}
+
+void LogServer::SetOptions(const LogServerOptions& options) {
+  absl::MutexLock lock(&mutex_);
+  options_ = options;
+  tokens_ = std::min(tokens_, options_.burst);
+}
+
+bool LogServer::ShouldLog(const LogMessage& msg, absl::Time now) {
+  // Errors are always logged, they are rare and what is looked for.
+  if (absl::NormalizeLogSeverity(msg.severity()) >= absl::LogSeverity::kError) {
+    return true;
+  }
+  absl::MutexLock lock(&mutex_);
+  if (options_.sample_every_n > 1) {
+    if (call_sites_.size() >= kMaxSampledCallSites) {
+      call_sites_.clear();
+    }
+    uint64_t& count =
+        call_sites_[{msg.path().substr(0, kMaxCallSitePath), msg.line()}];
+    if (count++ % options_.sample_every_n != 0) {
+      ++suppressed_;
+      return false;
+    }
+  }
+  if (options_.messages_per_second > 0) {
+    if (last_refill_ != absl::InfinitePast()) {
+      tokens_ = std::min(
+          options_.burst,
+          tokens_ + absl::ToDoubleSeconds(now - last_refill_) *
+                        options_.messages_per_second);
+    }
+    last_refill_ = now;
+    if (tokens_ < 1) {
+      ++suppressed_;
+      return false;
+    }
+    tokens_ -= 1;
+  }
+  return true;
+}
+
+void LogServer::MaybeReportSuppressed(absl::Time now, bool force) {
+  absl::MutexLock lock(&mutex_);
+  if (suppressed_ == 0) {
+    return;
+  }
+  if (!force && last_report_ != absl::InfinitePast() &&
+      now - last_report_ < options_.report_interval) {
+    return;
+  }
+  LOG(WARNING) << "Suppressed " << suppressed_
+               << " log messages from the sandboxee";
+  suppressed_ = 0;
+  last_report_ = now;
+}
 
 void LogServer::Run() {
-  LogMessage msg;
-  while (comms_.RecvProtoBuf(&msg)) {
-    absl::LogSeverity severity = absl::NormalizeLogSeverity(msg.severity());
-    const char* fatal_string = "";
-    if (severity == absl::LogSeverity::kFatal) {
-      // We don't want to trigger an abort() in the executor for FATAL logs.
-      severity = absl::LogSeverity::kError;
-      fatal_string = " FATAL";
+  LogMessageBatch batch;
+  while (comms_.RecvProtoBuf(&batch)) {
+    const absl::Time now = absl::Now();
+    for (const LogMessage& msg : batch.messages()) {
+      if (!ShouldLog(msg, now)) {
+        continue;
+      }
+      absl::LogSeverity severity = absl::NormalizeLogSeverity(msg.severity());
+      const char* fatal_string = "";
+      if (severity == absl::LogSeverity::kFatal) {
+        // We don't want to trigger an abort() in the executor for FATAL logs.
+        severity = absl::LogSeverity::kError;
+        fatal_string = " FATAL";
+      }
+      LOG(LEVEL(severity)).AtLocation(msg.path().c_str(), msg.line())
+          << "(sandboxee " << msg.pid() << fatal_string
+          << "): " << msg.message();
     }
-    LOG(LEVEL(severity)).AtLocation(msg.path().c_str(), msg.line())
-        << "(sandboxee " << msg.pid() << fatal_string << "): " << msg.message();
+    MaybeReportSuppressed(now);
   }
+  MaybeReportSuppressed(absl::Now(), /*force=*/true);
 
   LOG(INFO) << "Receive failed, shutting down LogServer";
 }
@@ -15,15 +15,38 @@
 #ifndef SANDBOXED_API_SANDBOX2_LOGSERVER_H_
 #define SANDBOXED_API_SANDBOX2_LOGSERVER_H_
 
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/logserver.pb.h"
 
 namespace sandbox2 {
 
+// Limits how much a sandboxee can log through the LogServer, see
+// PolicyBuilder::AllowLogForwarding(). Messages of severity ERROR and above
+// are exempt. Suppressed messages are counted and their number is logged every
+// report_interval.
+struct LogServerOptions {
+  // Sustained number of messages logged per second, 0 means no limit.
+  double messages_per_second = 0;
+  // Number of messages that can be logged at once above that rate.
+  double burst = 100;
+  // If greater than 1, only every n-th message of each call site is logged.
+  int sample_every_n = 1;
+  absl::Duration report_interval = absl::Seconds(10);
+};
+
 // The LogServer waits for messages from the sandboxee on a given file
 // descriptor and logs them using the standard logging facilities.
 class LogServer {
  public:
-  explicit LogServer(int fd);
+  explicit LogServer(int fd, LogServerOptions options = {});
 
   LogServer(const LogServer&) = delete;
   LogServer& operator=(const LogServer&) = delete;
@@ -31,8 +54,32 @@ class LogServer {
   // Starts handling incoming log messages.
   void Run();
 
+  // Can be called while running.
+  void SetOptions(const LogServerOptions& options);
+
+  // Returns whether msg, received at now, is within the limits. Updates the
+  // rate limiting and sampling state.
+  bool ShouldLog(const LogMessage& msg, absl::Time now);
+
+  // Logs the number of suppressed messages if the report interval passed, or
+  // unconditionally if force is set.
+  void MaybeReportSuppressed(absl::Time now, bool force = false);
+
  private:
+  // Bound the memory a sandboxee can make the sampling state use.
+  static constexpr size_t kMaxSampledCallSites = 1024;
+  static constexpr size_t kMaxCallSitePath = 256;
+
   Comms comms_;
+
+  absl::Mutex mutex_;
+  LogServerOptions options_ ABSL_GUARDED_BY(mutex_);
+  double tokens_ ABSL_GUARDED_BY(mutex_);
+  absl::Time last_refill_ ABSL_GUARDED_BY(mutex_) = absl::InfinitePast();
+  absl::flat_hash_map<std::pair<std::string, int>, uint64_t> call_sites_
+      ABSL_GUARDED_BY(mutex_);
+  uint64_t suppressed_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::Time last_report_ ABSL_GUARDED_BY(mutex_) = absl::InfinitePast();
 };
 
 }  // namespace sandbox2
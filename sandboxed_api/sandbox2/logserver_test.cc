@@ -0,0 +1,111 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/logserver.h"
+
+#include <sys/socket.h>
+
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/base/log_severity.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/logserver.pb.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::file_util::fileops::FDCloser;
+using ::testing::Eq;
+
+class LogServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int sv[2];
+    ASSERT_THAT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), Eq(0));
+    server_fd_ = sv[0];
+    client_fd_ = FDCloser(sv[1]);
+  }
+
+  static LogMessage Message(
+      const std::string& path, int line,
+      absl::LogSeverity severity = absl::LogSeverity::kInfo) {
+    LogMessage msg;
+    msg.set_severity(static_cast<int>(severity));
+    msg.set_path(path);
+    msg.set_line(line);
+    return msg;
+  }
+
+  int server_fd_;
+  FDCloser client_fd_;
+};
+
+TEST_F(LogServerTest, LogsEverythingByDefault) {
+  LogServer server(server_fd_);
+  const absl::Time now = absl::Now();
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(server.ShouldLog(Message("a.cc", 1), now));
+  }
+}
+
+TEST_F(LogServerTest, RateLimits) {
+  LogServer server(server_fd_, {.messages_per_second = 10, .burst = 2});
+  const absl::Time now = absl::Now();
+  EXPECT_TRUE(server.ShouldLog(Message("a.cc", 1), now));
+  EXPECT_TRUE(server.ShouldLog(Message("a.cc", 1), now));
+  EXPECT_FALSE(server.ShouldLog(Message("a.cc", 1), now));
+  EXPECT_FALSE(server.ShouldLog(Message("b.cc", 1), now));
+  // Refills one message every 100ms, up to the burst.
+  EXPECT_TRUE(server.ShouldLog(Message("a.cc", 1), now + absl::Seconds(0.1)));
+  EXPECT_FALSE(server.ShouldLog(Message("a.cc", 1), now + absl::Seconds(0.1)));
+  EXPECT_TRUE(server.ShouldLog(Message("a.cc", 1), now + absl::Seconds(10)));
+  EXPECT_TRUE(server.ShouldLog(Message("a.cc", 1), now + absl::Seconds(10)));
+  EXPECT_FALSE(server.ShouldLog(Message("a.cc", 1), now + absl::Seconds(10)));
+}
+
+TEST_F(LogServerTest, SamplesPerCallSite) {
+  LogServer server(server_fd_, {.sample_every_n = 3});
+  const absl::Time now = absl::Now();
+  int logged_a = 0;
+  int logged_b = 0;
+  for (int i = 0; i < 6; ++i) {
+    logged_a += server.ShouldLog(Message("a.cc", 1), now);
+    logged_b += server.ShouldLog(Message("a.cc", 2), now);
+  }
+  EXPECT_THAT(logged_a, Eq(2));
+  EXPECT_THAT(logged_b, Eq(2));
+}
+
+TEST_F(LogServerTest, AlwaysLogsErrors) {
+  LogServer server(server_fd_, {.messages_per_second = 10,
+                                .burst = 1,
+                                .sample_every_n = 3});
+  const absl::Time now = absl::Now();
+  EXPECT_TRUE(server.ShouldLog(Message("a.cc", 1), now));
+  EXPECT_FALSE(server.ShouldLog(Message("a.cc", 1), now));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_TRUE(
+        server.ShouldLog(Message("a.cc", 2, absl::LogSeverity::kError), now));
+    EXPECT_TRUE(
+        server.ShouldLog(Message("a.cc", 3, absl::LogSeverity::kFatal), now));
+  }
+  EXPECT_FALSE(server.ShouldLog(Message("a.cc", 4, absl::LogSeverity::kWarning),
+                                now));
+}
+
+}  // namespace
+}  // namespace sandbox2
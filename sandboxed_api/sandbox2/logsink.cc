@@ -16,9 +16,16 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <csignal>
+#include <cstdlib>
 #include <string>
+#include <vector>
 
+#include "absl/base/const_init.h"
+#include "absl/base/log_severity.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/log/log_entry.h"
 #include "absl/log/log_sink_registry.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
@@ -27,25 +34,70 @@
 
 namespace sandbox2 {
 
+namespace {
+
+// Batched sinks, flushed if the process calls exit() without destroying them.
+ABSL_CONST_INIT absl::Mutex batched_sinks_mutex(absl::kConstInit);
+
+std::vector<LogSink*>& BatchedSinks()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(batched_sinks_mutex) {
+  static auto* sinks = new std::vector<LogSink*>();
+  return *sinks;
+}
+
+void FlushBatchedSinksAtExit() {
+  absl::MutexLock lock(&batched_sinks_mutex);
+  for (LogSink* sink : BatchedSinks()) {
+    sink->Flush();
+  }
+}
+
+}  // namespace
+
 constexpr char LogSink::kLogFDName[];
 
-LogSink::LogSink(int fd) : comms_(fd) { absl::AddLogSink(this); }
+LogSink::LogSink(int fd, bool batched) : comms_(fd), batched_(batched) {
+  if (batched_) {
+    static const bool registered = [] {
+      std::atexit(&FlushBatchedSinksAtExit);
+      return true;
+    }();
+    (void)registered;
+    absl::MutexLock lock(&batched_sinks_mutex);
+    BatchedSinks().push_back(this);
+  }
+  absl::AddLogSink(this);
+}
 
-LogSink::~LogSink() { absl::RemoveLogSink(this); }
+LogSink::~LogSink() {
+  absl::RemoveLogSink(this);
+  if (batched_) {
+    absl::MutexLock lock(&batched_sinks_mutex);
+    std::vector<LogSink*>& sinks = BatchedSinks();
+    sinks.erase(std::find(sinks.begin(), sinks.end(), this));
+  }
+  Flush();
+}
 
 void LogSink::Send(const absl::LogEntry& e) {
   absl::MutexLock l(&lock_);
 
-  LogMessage msg;
+  if (batch_.messages().empty()) {
+    batch_start_ = e.timestamp();
+  }
+  LogMessage& msg = *batch_.add_messages();
   msg.set_severity(static_cast<int>(e.log_severity()));
   msg.set_path(std::string(e.source_basename()));
   msg.set_line(e.source_line());
   msg.set_message(absl::StrCat(e.text_message(), "\n"));
   msg.set_pid(getpid());
+  batch_bytes_ += msg.ByteSizeLong();
 
-  if (!comms_.SendProtoBuf(msg)) {
-    absl::FPrintF(stderr, "sending log message to supervisor failed:\n%s\n",
-                  e.text_message_with_prefix());
+  if (!batched_ || e.log_severity() >= absl::LogSeverity::kWarning ||
+      static_cast<size_t>(batch_.messages_size()) >= kMaxBatchMessages ||
+      batch_bytes_ >= kMaxBatchBytes ||
+      e.timestamp() - batch_start_ >= kMaxBatchDelay) {
+    FlushLocked();
   }
 
   if (e.log_severity() == absl::LogSeverity::kFatal) {
@@ -55,4 +107,24 @@ void LogSink::Send(const absl::LogEntry& e) {
   }
 }
 
+void LogSink::Flush() {
+  absl::MutexLock l(&lock_);
+  FlushLocked();
+}
+
+void LogSink::FlushLocked() {
+  if (batch_.messages().empty()) {
+    return;
+  }
+  if (!comms_.SendProtoBuf(batch_)) {
+    absl::FPrintF(stderr, "sending log messages to supervisor failed:\n");
+    for (const LogMessage& msg : batch_.messages()) {
+      absl::FPrintF(stderr, "%s:%d] %s", msg.path(), msg.line(),
+                    msg.message());
+    }
+  }
+  batch_.clear_messages();
+  batch_bytes_ = 0;
+}
+
 }  // namespace sandbox2
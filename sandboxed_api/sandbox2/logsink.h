@@ -15,20 +15,39 @@
 #ifndef SANDBOXED_API_SANDBOX2_LOGSINK_H_
 #define SANDBOXED_API_SANDBOX2_LOGSINK_H_
 
+#include <cstddef>
+
+#include "absl/base/thread_annotations.h"
 #include "absl/log/log_entry.h"
 #include "absl/log/log_sink.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/logserver.pb.h"
 
 namespace sandbox2 {
 
 // The LogSink will register itself with the facilities and forward all log
 // messages to the executor on a given file descriptor.
+//
+// If batched, messages below WARNING are held back and sent together, once
+// there are too many of them, the oldest is too old when the next one is
+// logged, a more severe message is logged, or Flush() is called. They are
+// also sent when the sink is destroyed, when the process calls exit(), and
+// before LOG(FATAL) aborts. Held back messages are lost if the process is
+// killed by a signal, e.g. when it crashes or violates the policy, as sending
+// them from a signal handler is not safe. Log at WARNING or above if a message
+// must not be lost that way.
 class LogSink : public absl::LogSink {
  public:
   static constexpr char kLogFDName[] = "sb2_logsink";
 
-  explicit LogSink(int fd);
+  // Limits of the messages held back when batching.
+  static constexpr size_t kMaxBatchMessages = 64;
+  static constexpr size_t kMaxBatchBytes = 32 << 10;
+  static constexpr absl::Duration kMaxBatchDelay = absl::Milliseconds(100);
+
+  explicit LogSink(int fd, bool batched = false);
   ~LogSink() override;
 
   LogSink(const LogSink&) = delete;
@@ -36,11 +55,20 @@ class LogSink : public absl::LogSink {
 
   void Send(const absl::LogEntry& e) override;
 
+  // Sends all held back messages.
+  void Flush() override;
+
  private:
+  void FlushLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
   Comms comms_;
+  const bool batched_;
 
   // Needed to make the LogSink thread safe.
   absl::Mutex lock_;
+  LogMessageBatch batch_ ABSL_GUARDED_BY(lock_);
+  size_t batch_bytes_ ABSL_GUARDED_BY(lock_) = 0;
+  absl::Time batch_start_ ABSL_GUARDED_BY(lock_);
 };
 
 }  // namespace sandbox2
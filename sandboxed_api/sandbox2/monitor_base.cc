@@ -16,16 +16,25 @@
 
 #include "sandboxed_api/sandbox2/monitor_base.h"
 
+#include <fcntl.h>
 #include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 #include <syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstdint>
 #include <csignal>
 #include <cstdio>
 #include <deque>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/flags/declare.h"
@@ -34,21 +43,34 @@
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/cgroup.h"
 #include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/limits.h"
 #include "sandboxed_api/sandbox2/mounts.h"
 #include "sandboxed_api/sandbox2/namespace.h"
+#include "sandboxed_api/sandbox2/network_proxy/dns_cache.h"
 #include "sandboxed_api/sandbox2/network_proxy/server.h"
+#include "sandboxed_api/sandbox2/output_splicer.h"
+#include "sandboxed_api/sandbox2/perf_counters.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/stack_trace.h"
 #include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/trace.h"
 #include "sandboxed_api/sandbox2/util.h"
+#include "sandboxed_api/sandbox2/util/maps_parser.h"
 #include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/metrics.h"
+#include "sandboxed_api/sandbox2/usage.h"
 #include "sandboxed_api/util/raw_logging.h"
+#include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/util/strerror.h"
 #include "sandboxed_api/util/temp_file.h"
 
@@ -66,6 +88,39 @@ ABSL_DECLARE_FLAG(bool, sandbox_libunwind_crash_handler);
 namespace sandbox2 {
 namespace {
 
+using ::sapi::file_util::fileops::FDCloser;
+
+// Capacity of the pipes the sandboxee's output is drained from, see
+// Executor::set_stdout_sink().
+constexpr int kOutputPipeSize = 1 << 20;
+
+// Returns fn(), recording a span named name into trace unless that is nullptr.
+template <typename Fn>
+auto Traced(std::vector<TraceSpan>* trace, absl::string_view name, Fn fn) {
+  ScopedTraceSpan span(trace, name);
+  return fn();
+}
+
+// Label of the monitor in metrics.
+absl::string_view MonitorLabel(MonitorType type) {
+  return type == FORKSERVER_MONITOR_UNOTIFY ? "unotify" : "ptrace";
+}
+
+void RecordResultMetrics(const Result& result) {
+  sapi::metrics::IncrementCounter(
+      sapi::metrics::kSandboxResults,
+      Result::StatusEnumToString(result.final_status()));
+  if (result.final_status() != Result::VIOLATION) {
+    return;
+  }
+  if (result.reason_code() == Result::VIOLATION_NETWORK) {
+    sapi::metrics::IncrementCounter(sapi::metrics::kViolations, "network");
+  } else if (const Syscall* syscall = result.GetSyscall(); syscall != nullptr) {
+    sapi::metrics::IncrementCounter(sapi::metrics::kViolations,
+                                    syscall->GetName());
+  }
+}
+
 void MaybeEnableTomoyoLsmWorkaround(Mounts& mounts, std::string& comms_fd_dev) {
   static auto tomoyo_active = []() -> bool {
     std::string lsm_list;
@@ -106,6 +161,40 @@ void MaybeEnableTomoyoLsmWorkaround(Mounts& mounts, std::string& comms_fd_dev) {
   }
 }
 
+#ifndef __NR_process_madvise
+#define __NR_process_madvise 440
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+// Asks the kernel to reclaim the private memory of the process behind pidfd,
+// swapping out anonymous pages and dropping clean file pages. They are faulted
+// back in on access. Needs CAP_SYS_NICE and Linux 5.10.
+absl::Status PageOut(int pidfd, pid_t pid) {
+  std::vector<iovec> ranges;
+  SAPI_RETURN_IF_ERROR(
+      ForEachProcMapsEntry(pid, [&ranges](const MapsEntryView& entry) {
+        // Special mappings of the kernel cannot be paged out.
+        if (!entry.is_shared && entry.path != "[vdso]" &&
+            entry.path != "[vvar]" && entry.path != "[vsyscall]") {
+          ranges.push_back({reinterpret_cast<void*>(entry.start),
+                            static_cast<size_t>(entry.end - entry.start)});
+        }
+        return true;
+      }));
+  // At most UIO_MAXIOV ranges per call.
+  constexpr size_t kMaxRanges = 1024;
+  for (size_t i = 0; i < ranges.size(); i += kMaxRanges) {
+    size_t n = std::min(kMaxRanges, ranges.size() - i);
+    if (syscall(__NR_process_madvise, pidfd, &ranges[i], n, MADV_PAGEOUT, 0) ==
+        -1) {
+      return absl::ErrnoToStatus(errno, "process_madvise(MADV_PAGEOUT)");
+    }
+  }
+  return absl::OkStatus();
+}
+
 void LogContainer(const std::vector<std::string>& container) {
   for (size_t i = 0; i < container.size(); ++i) {
     LOG(INFO) << "[" << std::setfill('0') << std::setw(4) << i
@@ -132,6 +221,10 @@ MonitorBase::MonitorBase(Executor* executor, Policy* policy, Notify* notify)
     PCHECK(log_file_ != nullptr) << "Failed to open log file '" << path << "'";
   }
 
+  if (policy_->log_server_options_) {
+    ipc_->SetLogServerOptions(*policy_->log_server_options_);
+  }
+
   if (auto* ns = policy_->GetNamespace(); ns) {
     // Check for the Tomoyo LSM, which is active by default in several common
     // distribution kernels (esp. Debian).
@@ -146,9 +239,14 @@ MonitorBase::~MonitorBase() {
   if (log_file_) {
     std::fclose(log_file_);
   }
-  if (network_proxy_server_) {
+  if (network_proxy_thread_.joinable()) {
     network_proxy_thread_.join();
   }
+  if (network_proxy_done_.valid()) {
+    network_proxy_done_.wait();
+  }
+  StopOutputSplicers();
+  StopUsageSampling();
 }
 
 void MonitorBase::OnDone() {
@@ -156,18 +254,67 @@ void MonitorBase::OnDone() {
     return;
   }
 
+  if (comms_->IsStatsEnabled()) {
+    result_.SetCommsStats(comms_->GetStats());
+  }
+  StopUsageSampling();
+  StopOutputSplicers();
+  {
+    absl::MutexLock lock(&usage_mutex_);
+    result_.SetUsageSamples(
+        {usage_samples_.begin(), usage_samples_.end()});
+    usage_samples_.clear();
+    if (cgroup_) {
+      absl::StatusOr<CgroupStats> stats = cgroup_->ReadStats();
+      if (stats.ok()) {
+        result_.SetCgroupStats(*std::move(stats));
+      } else {
+        LOG(ERROR) << "Reading cgroup stats: " << stats.status();
+      }
+      // Also kills whatever the sandboxee left behind.
+      cgroup_.reset();
+    }
+    if (perf_counters_) {
+      absl::StatusOr<PerfCounterValues> values = perf_counters_->Read();
+      if (values.ok()) {
+        result_.SetPerfCounters(*values);
+      } else {
+        LOG(ERROR) << "Reading perf counters: " << values.status();
+      }
+      perf_counters_.reset();
+    }
+  }
+  result_.SetStartupTrace(std::move(startup_trace_));
+  sapi::metrics::AddToGauge(sapi::metrics::kActiveSandboxes,
+                            MonitorLabel(type_), -1);
+  if (sapi::metrics::Enabled()) {
+    RecordResultMetrics(result_);
+  }
   notify_->EventFinished(result_);
   ipc_->InternalCleanupFdMap();
+  // Signaled first, as the Sandbox2 object may be gone right after the
+  // notification. Waiting for the result right away only takes as long as
+  // this write.
+  if (done_fd_ >= 0) {
+    uint64_t value = 1;
+    if (TEMP_FAILURE_RETRY(write(done_fd_, &value, sizeof(value))) !=
+        sizeof(value)) {
+      PLOG(ERROR) << "Signaling the done eventfd";
+    }
+  }
   done_notification_.Notify();
 }
 
 void MonitorBase::Launch() {
+  sapi::metrics::AddToGauge(sapi::metrics::kActiveSandboxes,
+                            MonitorLabel(type_), 1);
+  absl::Time launch_start = absl::Now();
 
   absl::Cleanup process_cleanup = [this] {
     if (process_.init_pid > 0) {
       kill(process_.init_pid, SIGKILL);
     } else if (process_.main_pid > 0) {
-      kill(process_.main_pid, SIGKILL);
+      SignalSandboxee(SIGKILL);
     }
   };
   absl::Cleanup monitor_done = [this] { OnDone(); };
@@ -193,10 +340,23 @@ void MonitorBase::Launch() {
     EnableNetworkProxyServer();
   }
 
+  if (!InitOutputSplicers()) {
+    SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_IPC);
+    return;
+  }
+
+  std::vector<TraceSpan>* trace = startup_trace();
+  if (trace != nullptr) {
+    trace->push_back(policy_->build_span_);
+  }
+
   // Get PID of the sandboxee.
   bool should_have_init = ns && (ns->GetCloneFlags() & CLONE_NEWPID);
-  absl::StatusOr<SandboxeeProcess> process =
-      executor_->StartSubProcess(clone_flags, ns, type_);
+  // Closed by StartSubProcess().
+  bool will_execve = executor_->exec_fd_.get() != -1;
+  absl::StatusOr<SandboxeeProcess> process = Traced(
+      trace, "Executor::StartSubProcess",
+      [&] { return executor_->StartSubProcess(clone_flags, ns, type_); });
 
   if (!process.ok()) {
     LOG(ERROR) << "Starting sandboxed subprocess failed: " << process.status();
@@ -205,36 +365,47 @@ void MonitorBase::Launch() {
   }
 
   process_ = *std::move(process);
+  if (trace != nullptr) {
+    trace->insert(trace->end(), process_.trace.begin(), process_.trace.end());
+  }
 
   if (process_.main_pid <= 0 || (should_have_init && process_.init_pid <= 0)) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_SUBPROCESS);
     return;
   }
 
+  if (perf_counters_enabled_) {
+    InitOpenPerfCounters(will_execve);
+  }
+
   if (!notify_->EventStarted(process_.main_pid, comms_)) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_NOTIFY);
     return;
   }
-  if (!InitSendIPC()) {
+  if (!Traced(trace, "MonitorBase::InitSendSetup",
+              [this] { return InitSendSetup(); })) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_IPC);
     return;
   }
-  if (!InitSendCwd()) {
-    SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_CWD);
-    return;
-  }
-  if (!InitSendPolicy()) {
-    SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_POLICY);
-    return;
-  }
-  if (!WaitForSandboxReady()) {
-    SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_WAIT);
+  bool limits_failed = false;
+  if (!Traced(trace, "MonitorBase::WaitForSandboxReady",
+              [&] { return WaitForSandboxReady(&limits_failed); })) {
+    SetExitStatusCode(Result::SETUP_ERROR, limits_failed
+                                               ? Result::FAILED_LIMITS
+                                               : Result::FAILED_WAIT);
     return;
   }
-  if (!InitApplyLimits()) {
+  if (!Traced(trace, "MonitorBase::InitApplyLimits",
+              [this] { return InitApplyLimits(); })) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_LIMITS);
     return;
   }
+  sapi::metrics::RecordDistribution(
+      sapi::metrics::kSpawnLatency, MonitorLabel(type_),
+      absl::ToDoubleSeconds(absl::Now() - launch_start));
+  if (usage_sampling_interval_ > absl::ZeroDuration()) {
+    usage_sampling_thread_ = std::thread(&MonitorBase::SampleUsage, this);
+  }
   std::move(process_cleanup).Cancel();
 
   RunInternal();
@@ -258,75 +429,207 @@ void MonitorBase::SetExitStatusCode(Result::StatusEnum final_status,
   result_.SetExitStatusCode(final_status, reason_code);
 }
 
-bool MonitorBase::InitSendPolicy() {
-  if (!policy_->SendPolicy(comms_, type_ == FORKSERVER_MONITOR_UNOTIFY)) {
-    LOG(ERROR) << "Couldn't send policy";
+bool MonitorBase::InitSendSetup() {
+  // The client applies the limits to itself, see Client::ApplyLimits().
+  // Everything but the fds goes out in a single write, and the client only
+  // answers once it is ready to be sandboxed.
+  const Limits* limits = executor_->limits();
+  std::vector<Client::ResourceLimit> rlimits;
+  for (const auto& [resource, rlim] :
+       {std::pair{RLIMIT_AS, &limits->rlimit_as()},
+        std::pair{RLIMIT_CPU, &limits->rlimit_cpu()},
+        std::pair{RLIMIT_FSIZE, &limits->rlimit_fsize()},
+        std::pair{RLIMIT_NOFILE, &limits->rlimit_nofile()},
+        std::pair{RLIMIT_CORE, &limits->rlimit_core()}}) {
+    rlimits.push_back({.resource = static_cast<int32_t>(resource),
+                       .cur = rlim->rlim_cur,
+                       .max = rlim->rlim_max});
+  }
+  const Placement& placement = limits->placement();
+  Client::PlacementSetup placement_setup = {
+      .numa_node = placement.numa_node.value_or(-1),
+      .strict_numa = placement.strict_numa,
+      .sched_policy = placement.sched_policy.value_or(-1),
+      .has_nice = placement.nice.has_value(),
+      .nice = placement.nice.value_or(0),
+  };
+  for (int cpu : placement.cpus) {
+    if (cpu < 0 || cpu >= Client::PlacementSetup::kMaxCpus) {
+      LOG(ERROR) << "CPU " << cpu << " out of range";
+      return false;
+    }
+    placement_setup.cpus[cpu / 64] |= uint64_t{1} << (cpu % 64);
+  }
+  const std::vector<sock_filter> policy =
+      policy_->GetPolicy(type_ == FORKSERVER_MONITOR_UNOTIFY,
+                         /*layered=*/process_.default_policy);
+  const std::string& cwd = executor_->cwd_;
+  const Comms::TLV trailer[] = {
+      {Comms::kTagString, cwd.size(), cwd.data()},
+      {Comms::kTagBytes, policy.size() * sizeof(sock_filter), policy.data()},
+      {Comms::kTagBytes, rlimits.size() * sizeof(Client::ResourceLimit),
+       rlimits.data()},
+      {Comms::kTagBytes, sizeof(placement_setup), &placement_setup},
+  };
+  if (!ipc_->SendFdsOverComms(trailer)) {
+    LOG(ERROR) << "Couldn't send the sandbox setup";
     return false;
   }
+  return true;
+}
 
+bool MonitorBase::InitOutputSplicers() {
+  for (auto [remote_fd, sink, drain] :
+       {std::tuple{STDOUT_FILENO, &executor_->stdout_sink_, &stdout_drain_},
+        std::tuple{STDERR_FILENO, &executor_->stderr_sink_, &stderr_drain_}}) {
+    if (!sink->enabled) {
+      continue;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      PLOG(ERROR) << "Creating the pipe for fd " << remote_fd;
+      return false;
+    }
+    // Larger pipes mean fewer wakeups with a lot of output. Best effort, as
+    // unprivileged processes are limited by fs.pipe-max-size.
+    fcntl(fds[0], F_SETPIPE_SZ, kOutputPipeSize);
+    ipc_->MapFd(fds[1], remote_fd);
+    absl::StatusOr<std::unique_ptr<OutputSplicer>> splicer =
+        OutputSplicer::Create(fds[0], sink->fd.get(), sink->tail_size);
+    if (!splicer.ok()) {
+      LOG(ERROR) << "Draining fd " << remote_fd << ": " << splicer.status();
+      return false;
+    }
+    drain->splicer = *std::move(splicer);
+    if (output_reactor_ != nullptr) {
+      drain->done = drain->splicer->RunOnReactor(output_reactor_);
+    } else {
+      drain->thread = std::thread(&OutputSplicer::Run, drain->splicer.get());
+    }
+  }
   return true;
 }
 
-bool MonitorBase::InitSendCwd() {
-  if (!comms_->SendString(executor_->cwd_)) {
-    PLOG(ERROR) << "Couldn't send cwd";
-    return false;
+void MonitorBase::StopOutputSplicers() {
+  std::string tails[2];
+  for (auto [drain, tail] : {std::pair{&stdout_drain_, &tails[0]},
+                             std::pair{&stderr_drain_, &tails[1]}}) {
+    if (!drain->splicer) {
+      continue;
+    }
+    // Once the sandboxee is gone, everything it wrote is in the pipe.
+    drain->splicer->Stop();
+    if (drain->thread.joinable()) {
+      drain->thread.join();
+    }
+    if (drain->done.valid()) {
+      drain->done.wait();
+    }
+    *tail = drain->splicer->ReadTail();
+    drain->splicer.reset();
+  }
+  if (!tails[0].empty() || !tails[1].empty()) {
+    result_.SetOutputTails(std::move(tails[0]), std::move(tails[1]));
   }
+}
 
+bool MonitorBase::InitApplyCgroup(const CgroupLimits& limits) {
+  absl::StatusOr<std::unique_ptr<Cgroup>> cgroup = Cgroup::Create(limits);
+  if (!cgroup.ok()) {
+    LOG(ERROR) << "Creating cgroup: " << cgroup.status();
+    return false;
+  }
+  absl::MutexLock lock(&usage_mutex_);
+  cgroup_ = *std::move(cgroup);
+  // The init process first, so that anything it forks stays in the cgroup.
+  for (pid_t pid : {process_.init_pid, process_.main_pid}) {
+    if (pid <= 0) {
+      continue;
+    }
+    if (absl::Status status = cgroup_->AddProcess(pid); !status.ok()) {
+      LOG(ERROR) << "Moving " << pid << " into cgroup: " << status;
+      return false;
+    }
+  }
   return true;
 }
 
-bool MonitorBase::InitApplyLimit(pid_t pid, int resource,
-                                 const rlimit64& rlim) const {
-#if defined(__ANDROID__)
-  using RlimitResource = int;
-#else
-  using RlimitResource = __rlimit_resource;
-#endif
-
-  rlimit64 curr_limit;
-  if (prlimit64(pid, static_cast<RlimitResource>(resource), nullptr,
-                &curr_limit) == -1) {
-    PLOG(ERROR) << "prlimit64(" << pid << ", " << util::GetRlimitName(resource)
-                << ")";
-  } else if (rlim.rlim_cur > curr_limit.rlim_max) {
-    // In such case, don't update the limits, as it will fail. Just stick to the
-    // current ones (which are already lower than intended).
-    LOG(ERROR) << util::GetRlimitName(resource)
-               << ": new.current > current.max (" << rlim.rlim_cur << " > "
-               << curr_limit.rlim_max << "), skipping";
-    return true;
+absl::StatusOr<ResourceUsage> MonitorBase::GetCurrentUsage() {
+  if (IsDone() || process_.main_pid <= 0) {
+    return absl::FailedPreconditionError("Sandboxee is not running");
+  }
+  SAPI_ASSIGN_OR_RETURN(ResourceUsage usage,
+                        ReadResourceUsage(process_.main_pid));
+  // The pid was not reused while reading, if the sandboxee is still there.
+  if (SignalSandboxee(0) != 0) {
+    return absl::FailedPreconditionError("Sandboxee is not running");
+  }
+  absl::MutexLock lock(&usage_mutex_);
+  if (cgroup_) {
+    absl::StatusOr<CgroupStats> stats = cgroup_->ReadStats();
+    if (stats.ok()) {
+      usage.cgroup = *std::move(stats);
+    }
   }
+  if (perf_counters_) {
+    absl::StatusOr<PerfCounterValues> values = perf_counters_->Read();
+    if (values.ok()) {
+      usage.perf_counters = *values;
+    }
+  }
+  return usage;
+}
 
-  if (prlimit64(pid, static_cast<RlimitResource>(resource), &rlim, nullptr) ==
-      -1) {
-    PLOG(ERROR) << "prlimit64(" << pid << ", " << util::GetRlimitName(resource)
-                << ", " << rlim.rlim_cur << ")";
-    return false;
+void MonitorBase::SampleUsage() {
+  while (!usage_sampling_stop_.WaitForNotificationWithTimeout(
+      usage_sampling_interval_)) {
+    absl::StatusOr<ResourceUsage> usage = GetCurrentUsage();
+    if (!usage.ok()) {
+      continue;
+    }
+    absl::MutexLock lock(&usage_mutex_);
+    if (usage_samples_.size() == kMaxUsageSamples) {
+      usage_samples_.pop_front();
+    }
+    usage_samples_.push_back(*std::move(usage));
   }
+}
 
-  return true;
+void MonitorBase::StopUsageSampling() {
+  if (!usage_sampling_thread_.joinable()) {
+    return;
+  }
+  usage_sampling_stop_.Notify();
+  usage_sampling_thread_.join();
 }
 
 bool MonitorBase::InitApplyLimits() {
   Limits* limits = executor_->limits();
-  return InitApplyLimit(process_.main_pid, RLIMIT_AS, limits->rlimit_as()) &&
-         InitApplyLimit(process_.main_pid, RLIMIT_CPU, limits->rlimit_cpu()) &&
-         InitApplyLimit(process_.main_pid, RLIMIT_FSIZE,
-                        limits->rlimit_fsize()) &&
-         InitApplyLimit(process_.main_pid, RLIMIT_NOFILE,
-                        limits->rlimit_nofile()) &&
-         InitApplyLimit(process_.main_pid, RLIMIT_CORE, limits->rlimit_core());
+  return !limits->cgroup() || InitApplyCgroup(*limits->cgroup());
 }
 
-bool MonitorBase::InitSendIPC() { return ipc_->SendFdsOverComms(); }
+void MonitorBase::InitOpenPerfCounters(bool will_execve) {
+  absl::StatusOr<std::unique_ptr<PerfCounters>> counters =
+      PerfCounters::Open(process_.main_pid, /*enable_on_exec=*/will_execve);
+  if (!counters.ok()) {
+    LOG(WARNING) << "Running without perf counters: " << counters.status();
+    return;
+  }
+  absl::MutexLock lock(&usage_mutex_);
+  perf_counters_ = *std::move(counters);
+}
 
-bool MonitorBase::WaitForSandboxReady() {
+bool MonitorBase::WaitForSandboxReady(bool* limits_failed) {
   uint32_t tmp;
   if (!comms_->RecvUint32(&tmp)) {
     LOG(ERROR) << "Couldn't receive 'Client::kClient2SandboxReady' message";
     return false;
   }
+  if (tmp == Client::kClient2SandboxLimitsFailed) {
+    LOG(ERROR) << "Sandboxee couldn't apply its resource limits";
+    *limits_failed = true;
+    return false;
+  }
   if (tmp != Client::kClient2SandboxReady) {
     LOG(ERROR) << "Received " << tmp << " != Client::kClient2SandboxReady ("
                << Client::kClient2SandboxReady << ")";
@@ -387,6 +690,61 @@ void MonitorBase::LogSyscallViolationExplanation(const Syscall& syscall) const {
   }
 }
 
+absl::Status MonitorBase::Freeze(bool page_out) {
+  if (IsDone() || process_.main_pid <= 0) {
+    return absl::FailedPreconditionError("Sandboxee is not running");
+  }
+  absl::MutexLock lock(&usage_mutex_);
+  if (!frozen_) {
+    if (cgroup_) {
+      SAPI_RETURN_IF_ERROR(cgroup_->SetFrozen(true));
+    } else if (SignalSandboxee(SIGSTOP) != 0) {
+      return absl::ErrnoToStatus(errno, "Stopping the sandboxee");
+    }
+    frozen_ = true;
+  }
+  if (!page_out) {
+    return absl::OkStatus();
+  }
+  FDCloser pidfd;
+  int fd = process_.main_pidfd.get();
+  if (fd < 0) {
+    pidfd = FDCloser(util::PidfdOpen(process_.main_pid));
+    fd = pidfd.get();
+  }
+  // Paging out is an optimization, the sandboxee stays frozen without it.
+  absl::Status status = fd >= 0 ? PageOut(fd, process_.main_pid)
+                                : absl::ErrnoToStatus(errno, "pidfd_open()");
+  if (!status.ok()) {
+    VLOG(1) << "Not paging out the frozen sandboxee: " << status;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MonitorBase::Thaw() {
+  if (IsDone() || process_.main_pid <= 0) {
+    return absl::FailedPreconditionError("Sandboxee is not running");
+  }
+  absl::MutexLock lock(&usage_mutex_);
+  if (!frozen_) {
+    return absl::OkStatus();
+  }
+  if (cgroup_) {
+    SAPI_RETURN_IF_ERROR(cgroup_->SetFrozen(false));
+  } else if (SignalSandboxee(SIGCONT) != 0) {
+    return absl::ErrnoToStatus(errno, "Resuming the sandboxee");
+  }
+  frozen_ = false;
+  return absl::OkStatus();
+}
+
+int MonitorBase::SignalSandboxee(int signal) const {
+  if (process_.main_pidfd.get() >= 0) {
+    return util::PidfdSendSignal(process_.main_pidfd.get(), signal);
+  }
+  return kill(process_.main_pid, signal);
+}
+
 bool MonitorBase::StackTraceCollectionPossible() const {
   // Only get the stacktrace if we are not in the libunwind sandbox (avoid
   // recursion).
@@ -406,7 +764,19 @@ void MonitorBase::EnableNetworkProxyServer() {
 
   network_proxy_server_ = std::make_unique<NetworkProxyServer>(
       fd, &policy_->allowed_hosts_.value(), pthread_self());
+  if (policy_->network_proxy_pool_options_) {
+    network_proxy_server_->EnableConnectionPool(
+        *policy_->network_proxy_pool_options_);
+  }
+  if (policy_->network_proxy_dns_) {
+    network_proxy_server_->EnableDnsResolution(&DnsCache::Global());
+  }
 
+  if (network_proxy_reactor_ != nullptr) {
+    network_proxy_done_ =
+        network_proxy_server_->RunOnReactor(network_proxy_reactor_);
+    return;
+  }
   network_proxy_thread_ = std::thread(&NetworkProxyServer::Run,
   network_proxy_server_.get());
 }
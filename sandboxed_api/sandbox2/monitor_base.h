@@ -20,26 +20,38 @@
 
 #include <sys/resource.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <deque>
+#include <future>  // NOLINT(build/c++11)
 #include <memory>
 #include <thread>
 #include <string>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/cgroup.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/fork_client.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
 #include "sandboxed_api/sandbox2/ipc.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
 #include "sandboxed_api/sandbox2/network_proxy/server.h"
 #include "sandboxed_api/sandbox2/notify.h"
+#include "sandboxed_api/sandbox2/output_splicer.h"
+#include "sandboxed_api/sandbox2/perf_counters.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/regs.h"
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/trace.h"
+#include "sandboxed_api/sandbox2/usage.h"
 
 namespace sandbox2 {
 
@@ -63,6 +75,43 @@ class MonitorBase {
   // that waits for connection requests from the sandboxee.
   void EnableNetworkProxyServer();
 
+  // Makes the network proxy server run on the threads of the given reactor,
+  // which must outlive this object, instead of on a thread of its own.
+  void set_network_proxy_reactor(MonitorReactor* reactor) {
+    network_proxy_reactor_ = reactor;
+  }
+
+  // Makes the sandboxee's output drain on the threads of the given reactor,
+  // which must outlive this object, see Executor::set_stdout_sink().
+  void set_output_reactor(MonitorReactor* reactor) {
+    output_reactor_ = reactor;
+  }
+
+  // Samples the resource usage of the sandboxee every interval while it runs,
+  // for Result::GetUsageSamples(). Must be called before Launch().
+  void set_usage_sampling_interval(absl::Duration interval) {
+    usage_sampling_interval_ = interval;
+  }
+
+  // Counts the sandboxee's execution with perf_event_open(), for
+  // Result::GetPerfCounters(). Must be called before Launch().
+  void set_perf_counters_enabled(bool enabled) {
+    perf_counters_enabled_ = enabled;
+  }
+
+  // Makes OnDone() signal the given eventfd, which must stay open until the
+  // monitor is destroyed. Must be called before Launch().
+  void set_done_fd(int fd) { done_fd_ = fd; }
+
+  // Reads the current resource usage of the sandboxee.
+  absl::StatusOr<ResourceUsage> GetCurrentUsage();
+
+  // Stops the sandboxee until Thaw(), with the freezer of its cgroup if it has
+  // one and with SIGSTOP otherwise. With page_out, also has the kernel reclaim
+  // its private memory, if permitted. Limits on its wall time keep running.
+  absl::Status Freeze(bool page_out);
+  absl::Status Thaw();
+
   pid_t pid() const { return process_.main_pid; }
 
   const Result& result() const { return result_; }
@@ -82,6 +131,11 @@ class MonitorBase {
   // explanation for the reason of the violation.
   void LogSyscallViolation(const Syscall& syscall) const;
 
+  // Sends a signal to the main sandboxee process, through its pidfd if there
+  // is one so that it cannot hit a process that reused its pid. Return values
+  // as for kill().
+  int SignalSandboxee(int signal) const;
+
   // Tells if collecting stack trace is at all possible.
   bool StackTraceCollectionPossible() const;
 
@@ -95,6 +149,13 @@ class MonitorBase {
   absl::StatusOr<std::vector<std::string>> GetAndLogStackTrace(
       const Regs* regs);
 
+  // Returns where to record the startup phases, or nullptr if they are not
+  // traced (see Executor::set_trace_startup()). Put into the result by
+  // OnDone().
+  std::vector<TraceSpan>* startup_trace() {
+    return executor_->trace_startup_ ? &startup_trace_ : nullptr;
+  }
+
   // Internal objects, owned by the Sandbox2 object.
   Executor* executor_;
   Notify* notify_;
@@ -114,25 +175,39 @@ class MonitorBase {
   MonitorType type_ = FORKSERVER_MONITOR_PTRACE;
 
  private:
-  // Sends Policy to the Client.
+  // Sends the fds, the working directory, the policy and the resource limits
+  // to the Client, without waiting for replies.
   // Returns success/failure status.
-  bool InitSendPolicy();
+  bool InitSendSetup();
 
-  // Waits for the SandboxReady signal from the client.
+  // Waits for the SandboxReady signal from the client. Sets `limits_failed` if
+  // the client couldn't apply the resource limits instead.
   // Returns success/failure status.
-  bool WaitForSandboxReady();
+  bool WaitForSandboxReady(bool* limits_failed);
 
-  // Sends information about data exchange channels.
-  bool InitSendIPC();
+  // Applies the cgroup limits on the sandboxee. The rlimits are applied by the
+  // client itself.
+  bool InitApplyLimits();
 
-  // Sends information about the current working directory.
-  bool InitSendCwd();
+  // Moves the sandboxee into a new cgroup with the given limits.
+  bool InitApplyCgroup(const CgroupLimits& limits);
 
-  // Applies limits on the sandboxee.
-  bool InitApplyLimits();
+  // Starts draining the sandboxee's stdout and stderr into the sinks of the
+  // executor, see Executor::set_stdout_sink().
+  bool InitOutputSplicers();
+  // Drains what the sandboxee left in its output and puts the tails into the
+  // result.
+  void StopOutputSplicers();
+
+  // Opens the perf counters of the sandboxee, counting from its execve() on
+  // if it will execute a binary. Only logs failures, the sandboxee runs
+  // without counters then.
+  void InitOpenPerfCounters(bool will_execve);
 
-  // Applies individual limit on the sandboxee.
-  bool InitApplyLimit(pid_t pid, int resource, const rlimit64& rlim) const;
+  // Body of usage_sampling_thread_.
+  void SampleUsage();
+  // Stops usage_sampling_thread_, if running.
+  void StopUsageSampling();
 
   // Logs an additional explanation for the possible reason of the violation
   // based on the registers.
@@ -147,12 +222,46 @@ class MonitorBase {
   // The field indicates whether the sandboxing task has been completed (either
   // successfully or with error).
   absl::Notification done_notification_;
+  // Eventfd signaled along with done_notification_, see set_done_fd().
+  int done_fd_ = -1;
 
   // Empty temp file used for mapping the comms fd when the Tomoyo LSM is
   // active.
   std::string comms_fd_dev_;
 
   std::thread network_proxy_thread_;
+  MonitorReactor* network_proxy_reactor_ = nullptr;
+  // Ready once the reactor is done with network_proxy_server_.
+  std::future<void> network_proxy_done_;
+
+  // Drains stdout and stderr, on its thread or on output_reactor_ until done
+  // is ready.
+  struct OutputDrain {
+    std::unique_ptr<OutputSplicer> splicer;
+    std::thread thread;
+    std::future<void> done;
+  };
+  MonitorReactor* output_reactor_ = nullptr;
+  OutputDrain stdout_drain_;
+  OutputDrain stderr_drain_;
+
+  // Guards what users may read while the monitor runs.
+  absl::Mutex usage_mutex_;
+  // Cgroup of the sandboxee, see Limits::set_cgroup().
+  std::unique_ptr<Cgroup> cgroup_ ABSL_GUARDED_BY(usage_mutex_);
+  // Maximum number of usage samples kept, older ones are dropped.
+  static constexpr size_t kMaxUsageSamples = 4096;
+  std::deque<ResourceUsage> usage_samples_ ABSL_GUARDED_BY(usage_mutex_);
+  absl::Duration usage_sampling_interval_ = absl::ZeroDuration();
+  absl::Notification usage_sampling_stop_;
+  std::thread usage_sampling_thread_;
+  bool perf_counters_enabled_ = false;
+  std::unique_ptr<PerfCounters> perf_counters_ ABSL_GUARDED_BY(usage_mutex_);
+  // Whether Freeze() stopped the sandboxee.
+  bool frozen_ ABSL_GUARDED_BY(usage_mutex_) = false;
+
+  // Only written by the monitor thread, see startup_trace().
+  std::vector<TraceSpan> startup_trace_;
 
   // Is the sandboxee forked from a custom forkserver?
   bool uses_custom_forkserver_;
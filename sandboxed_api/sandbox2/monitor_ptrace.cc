@@ -16,20 +16,29 @@
 
 #include "sandboxed_api/sandbox2/monitor_ptrace.h"
 
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ptrace.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <deque>
 #include <fstream>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/container/flat_hash_set.h"
@@ -47,6 +56,7 @@
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/sanitizer.h"
 #include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/trace.h"
 #include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
@@ -176,7 +186,8 @@ void CompleteSyscall(pid_t pid, int signo) {
 
 PtraceMonitor::PtraceMonitor(Executor* executor, Policy* policy, Notify* notify)
     : MonitorBase(executor, policy, notify),
-      wait_for_execve_(executor->enable_sandboxing_pre_execve_) {
+      wait_for_execve_(executor->enable_sandboxing_pre_execve_),
+      wakeup_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
   if (executor_->limits()->wall_time_limit() != absl::ZeroDuration()) {
     auto deadline = absl::Now() + executor_->limits()->wall_time_limit();
     deadline_millis_.store(absl::ToUnixMillis(deadline),
@@ -197,7 +208,9 @@ void PtraceMonitor::SetAdditionalResultInfo(std::unique_ptr<Regs> regs) {
   pid_t pid = regs->pid();
   result_.SetRegs(std::move(regs));
   result_.SetProgName(util::GetProgName(pid));
-  result_.SetProcMaps(ReadProcMaps(pid));
+  if (policy_->collect_proc_maps_) {
+    result_.SetProcMaps(ReadProcMaps(pid));
+  }
   if (!ShouldCollectStackTrace(result_.final_status())) {
     VLOG(1) << "Stack traces have been disabled";
     return;
@@ -214,7 +227,7 @@ void PtraceMonitor::SetAdditionalResultInfo(std::unique_ptr<Regs> regs) {
 
 bool PtraceMonitor::KillSandboxee() {
   VLOG(1) << "Sending SIGKILL to the PID: " << process_.main_pid;
-  if (kill(process_.main_pid, SIGKILL) != 0) {
+  if (SignalSandboxee(SIGKILL) != 0) {
     PLOG(ERROR) << "Could not send SIGKILL to PID " << process_.main_pid;
     SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_KILL);
     return false;
@@ -234,10 +247,66 @@ bool PtraceMonitor::InterruptSandboxee() {
 // Not defined in glibc.
 #define __WPTRACEEVENT(x) ((x & 0xff0000) >> 16)
 
+#ifndef PTRACE_GET_SYSCALL_INFO
+#define PTRACE_GET_SYSCALL_INFO 0x420e
+#endif
+#ifndef PTRACE_SYSCALL_INFO_SECCOMP
+#define PTRACE_SYSCALL_INFO_SECCOMP 3
+#endif
+
+namespace {
+
+// struct ptrace_syscall_info from <linux/ptrace.h>, which conflicts with
+// <sys/ptrace.h>. Only the seccomp part is used.
+struct PtraceSyscallInfo {
+  uint8_t op;
+  uint8_t pad[3];
+  uint32_t arch;
+  uint64_t instruction_pointer;
+  uint64_t stack_pointer;
+  struct {
+    uint64_t nr;
+    uint64_t args[6];
+    uint32_t ret_data;
+  } seccomp;
+};
+
+}  // namespace
+
 void PtraceMonitor::NotifyMonitor() {
   absl::ReaderMutexLock lock(&notify_mutex_);
-  if (thread_ != nullptr) {
-    pthread_kill(thread_->native_handle(), SIGCHLD);
+  uint64_t value = 1;
+  write(wakeup_fd_.get(), &value, sizeof(value));
+}
+
+void PtraceMonitor::WaitForEvents(absl::Time deadline) {
+  absl::Time wakeup = std::min(deadline, absl::Now() + kWakeUpPeriod);
+  if (int64_t walltime = deadline_millis_.load(std::memory_order_relaxed);
+      walltime != 0) {
+    wakeup = std::min(wakeup, absl::FromUnixMillis(walltime));
+  }
+  absl::Duration timeout = absl::Ceil(
+      std::max(wakeup - absl::Now(), absl::ZeroDuration()),
+      absl::Milliseconds(1));
+  constexpr int kMaxEvents = 2;
+  epoll_event events[kMaxEvents];
+  int n = epoll_wait(epoll_fd_.get(), events, kMaxEvents,
+                     absl::ToInt64Milliseconds(timeout));
+  if (n == -1 && errno != EINTR) {
+    PLOG(ERROR) << "epoll_wait()";
+  }
+  for (int i = 0; i < n; ++i) {
+    // Both fds are non-blocking, only their readiness matters.
+    if (events[i].data.fd == signal_fd_.get()) {
+      signalfd_siginfo info;
+      while (read(signal_fd_.get(), &info, sizeof(info)) == sizeof(info)) {
+        LOG_IF(ERROR, info.ssi_signo != SIGCHLD)
+            << "Unknown signal received: " << info.ssi_signo;
+      }
+    } else {
+      uint64_t value;
+      read(wakeup_fd_.get(), &value, sizeof(value));
+    }
   }
 }
 
@@ -268,8 +337,6 @@ void PtraceMonitor::Run() {
   };
 
   absl::Cleanup setup_notify = [this] { setup_notification_.Notify(); };
-  // It'd be costly to initialize the sigset_t for each sigtimedwait()
-  // invocation, so do it once per Monitor.
   if (!InitSetupSignals()) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_SIGNALS);
     return;
@@ -277,10 +344,13 @@ void PtraceMonitor::Run() {
   // This call should be the last in the init sequence, because it can cause the
   // sandboxee to enter ptrace-stopped state, in which it will not be able to
   // send any messages over the Comms channel.
+  ScopedTraceSpan attach_span(startup_trace(),
+                              "PtraceMonitor::InitPtraceAttach");
   if (!InitPtraceAttach()) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_PTRACE);
     return;
   }
+  attach_span.End();
 
   // Tell the parent thread (Sandbox2 object) that we're done with the initial
   // set-up process of the sandboxee.
@@ -327,10 +397,7 @@ void PtraceMonitor::Run() {
 
     pid_t ret = pid_waiter.Wait(&status);
     if (ret == 0) {
-      constexpr timespec ts = {kWakeUpPeriodSec, kWakeUpPeriodNSec};
-      int signo = sigtimedwait(&sset_, nullptr, &ts);
-      LOG_IF(ERROR, signo != -1 && signo != SIGCHLD)
-          << "Unknown signal received: " << signo;
+      WaitForEvents(absl::InfiniteFuture());
       continue;
     }
 
@@ -398,7 +465,7 @@ void PtraceMonitor::Run() {
         absl::GetFlag(FLAGS_sandbox2_log_all_stack_traces);
     if (!log_stack_traces) {
       // Try to make sure main pid is killed and reaped
-      kill(process_.main_pid, SIGKILL);
+      SignalSandboxee(SIGKILL);
     }
     constexpr auto kGracefullExitTimeout = absl::Milliseconds(200);
     auto deadline = absl::Now() + kGracefullExitTimeout;
@@ -407,7 +474,6 @@ void PtraceMonitor::Run() {
                  absl::GetFlag(FLAGS_sandbox2_stack_traces_collection_timeout);
     }
     for (;;) {
-      auto left = deadline - absl::Now();
       if (absl::Now() >= deadline) {
         LOG(INFO) << "Waiting for sandboxee exit timed out";
         break;
@@ -425,8 +491,7 @@ void PtraceMonitor::Run() {
       }
 
       if (ret == 0) {
-        auto ts = absl::ToTimespec(left);
-        sigtimedwait(&sset_, nullptr, &ts);
+        WaitForEvents(deadline);
         continue;
       }
 
@@ -443,10 +508,48 @@ void PtraceMonitor::Run() {
       }
 
       if (!log_stack_traces) {
-        kill(process_.main_pid, SIGKILL);
+        SignalSandboxee(SIGKILL);
       }
     }
   }
+  if (policy_->profile_syscalls_) {
+    SetSyscallProfile();
+  }
+}
+
+void PtraceMonitor::ProfileSyscall(pid_t pid, uint64_t nr, bool measure_time) {
+  ++syscall_stats_[nr].count;
+  if (measure_time) {
+    profiled_syscalls_[pid] = {nr, absl::Now()};
+  }
+}
+
+void PtraceMonitor::FinishProfiledSyscall(pid_t pid) {
+  auto it = profiled_syscalls_.find(pid);
+  if (it == profiled_syscalls_.end()) {
+    return;
+  }
+  auto [nr, start] = it->second;
+  syscall_stats_[nr].time += absl::Now() - start;
+  profiled_syscalls_.erase(it);
+}
+
+void PtraceMonitor::SetSyscallProfile() {
+  std::vector<std::pair<uint64_t, SyscallStats>> stats(syscall_stats_.begin(),
+                                                       syscall_stats_.end());
+  std::sort(stats.begin(), stats.end(), [](const auto& a, const auto& b) {
+    return a.second.count != b.second.count ? a.second.count > b.second.count
+                                            : a.first < b.first;
+  });
+  SyscallProfile profile;
+  for (const auto& [nr, syscall_stats] : stats) {
+    SyscallProfile::Entry* entry = profile.add_entries();
+    entry->set_nr(nr);
+    entry->set_name(Syscall(Syscall::GetHostArch(), nr).GetName());
+    entry->set_count(syscall_stats.count);
+    entry->set_total_time_ns(absl::ToInt64Nanoseconds(syscall_stats.time));
+  }
+  result_.SetSyscallProfile(std::move(profile));
 }
 
 void PtraceMonitor::LogStackTraceOfPid(pid_t pid) {
@@ -472,7 +575,7 @@ bool PtraceMonitor::InitSetupSignals() {
     return false;
   }
 
-  // sigtimedwait will react (wake-up) to arrival of this signal.
+  // signal_fd_ becomes readable on arrival of this signal.
   if (sigaddset(&sset_, SIGCHLD) == -1) {
     PLOG(ERROR) << "sigaddset(SIGCHLD)";
     return false;
@@ -483,6 +586,28 @@ bool PtraceMonitor::InitSetupSignals() {
     return false;
   }
 
+  signal_fd_ = sapi::file_util::fileops::FDCloser(
+      signalfd(-1, &sset_, SFD_CLOEXEC | SFD_NONBLOCK));
+  if (signal_fd_.get() == -1) {
+    PLOG(ERROR) << "signalfd(SIGCHLD)";
+    return false;
+  }
+  if (wakeup_fd_.get() == -1) {
+    LOG(ERROR) << "eventfd() failed";
+    return false;
+  }
+  epoll_fd_ = sapi::file_util::fileops::FDCloser(epoll_create1(EPOLL_CLOEXEC));
+  if (epoll_fd_.get() == -1) {
+    PLOG(ERROR) << "epoll_create1()";
+    return false;
+  }
+  for (int fd : {signal_fd_.get(), wakeup_fd_.get()}) {
+    epoll_event event = {.events = EPOLLIN, .data = {.fd = fd}};
+    if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, fd, &event) == -1) {
+      PLOG(ERROR) << "epoll_ctl(EPOLL_CTL_ADD)";
+      return false;
+    }
+  }
   return true;
 }
 
@@ -615,14 +740,25 @@ bool PtraceMonitor::InitPtraceAttach() {
   return true;
 }
 
-void PtraceMonitor::ActionProcessSyscall(Regs* regs, const Syscall& syscall) {
+void PtraceMonitor::ActionProcessSyscall(pid_t pid, const Syscall& syscall) {
   // If the sandboxing is not enabled yet, allow the first __NR_execveat.
   if (syscall.nr() == __NR_execveat && !IsActivelyMonitoring()) {
     VLOG(1) << "[PERMITTED/BEFORE_EXECVEAT]: "
-            << "SYSCALL ::: PID: " << regs->pid() << ", PROG: '"
-            << util::GetProgName(regs->pid())
+            << "SYSCALL ::: PID: " << pid << ", PROG: '"
+            << util::GetProgName(pid)
             << "' : " << syscall.GetDescription();
-    ContinueProcess(regs->pid(), 0);
+    ContinueProcess(pid, 0);
+    return;
+  }
+
+  if (policy_->profile_syscalls_) {
+    ProfileSyscall(pid, syscall.nr(), /*measure_time=*/false);
+  }
+
+  auto cache_key =
+      std::make_tuple(syscall.arch(), syscall.nr(), syscall.args());
+  if (allowed_traced_syscalls_.contains(cache_key)) {
+    ContinueProcess(pid, 0);
     return;
   }
 
@@ -631,15 +767,19 @@ void PtraceMonitor::ActionProcessSyscall(Regs* regs, const Syscall& syscall) {
   // but nonetheless be allowed ('permissible syscalls' in sandbox v1).
   auto trace_response = notify_->EventSyscallTrace(syscall);
   if (trace_response == Notify::TraceAction::kAllow) {
-    ContinueProcess(regs->pid(), 0);
+    if (allowed_traced_syscalls_.size() < kMaxCachedTraceDecisions &&
+        notify_->IsSyscallTraceCacheable(syscall)) {
+      allowed_traced_syscalls_.insert(std::move(cache_key));
+    }
+    ContinueProcess(pid, 0);
     return;
   }
   if (trace_response == Notify::TraceAction::kInspectAfterReturn) {
     // Note that a process might die without an exit-stop before the syscall is
     // completed (eg. a thread calls execve() and the thread group leader dies),
     // so the entry is removed when the process exits.
-    syscalls_in_progress_[regs->pid()] = syscall;
-    CompleteSyscall(regs->pid(), 0);
+    syscalls_in_progress_[pid] = syscall;
+    CompleteSyscall(pid, 0);
     return;
   }
 
@@ -647,19 +787,34 @@ void PtraceMonitor::ActionProcessSyscall(Regs* regs, const Syscall& syscall) {
   // log_file_ not null iff FLAGS_sandbox2_danger_danger_permit_all_and_log is
   // set.
   if (log_file_) {
-    std::string syscall_description = syscall.GetDescription();
-    PCHECK(absl::FPrintF(log_file_, "PID: %d %s\n", regs->pid(),
-                         syscall_description) >= 0);
-    ContinueProcess(regs->pid(), 0);
+    log_line_.clear();
+    absl::StrAppend(&log_line_, "PID: ", pid, " ");
+    syscall.AppendDescription(&log_line_);
+    log_line_.push_back('\n');
+    PCHECK(std::fwrite(log_line_.data(), 1, log_line_.size(), log_file_) ==
+           log_line_.size());
+    ContinueProcess(pid, 0);
     return;
   }
 
   if (absl::GetFlag(FLAGS_sandbox2_danger_danger_permit_all)) {
-    ContinueProcess(regs->pid(), 0);
+    ContinueProcess(pid, 0);
     return;
   }
 
-  ActionProcessSyscallViolation(regs, syscall, kSyscallViolation);
+  ActionProcessSyscallViolation(pid, syscall, kSyscallViolation);
+}
+
+void PtraceMonitor::ActionProcessSyscallViolation(
+    pid_t pid, const Syscall& syscall, ViolationType violation_type) {
+  // Only needed for the result, so they are fetched this late.
+  Regs regs(pid);
+  if (auto status = regs.Fetch(); !status.ok()) {
+    LOG(ERROR) << "failed to fetch regs: " << status;
+    SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_FETCH);
+    return;
+  }
+  ActionProcessSyscallViolation(&regs, syscall, violation_type);
 }
 
 void PtraceMonitor::ActionProcessSyscallViolation(
@@ -678,6 +833,20 @@ void PtraceMonitor::ActionProcessSyscallViolation(
 }
 
 void PtraceMonitor::EventPtraceSeccomp(pid_t pid, int event_msg) {
+  if (policy_->profile_syscalls_ && event_msg == internal::kProfileTraceData) {
+    // An allowed syscall, only traced to profile it. Measured until its
+    // syscall-exit-stop.
+    absl::StatusOr<Syscall> syscall =
+        FetchSeccompSyscall(pid, Syscall::GetHostArch());
+    if (!syscall.ok()) {
+      LOG(WARNING) << "failed to fetch syscall: " << syscall.status();
+      ContinueProcess(pid, 0);
+      return;
+    }
+    ProfileSyscall(pid, syscall->nr(), /*measure_time=*/true);
+    CompleteSyscall(pid, 0);
+    return;
+  }
   if (event_msg < sapi::cpu::Architecture::kUnknown ||
       event_msg > sapi::cpu::Architecture::kMax) {
     // We've observed that, if the process has exited, the event_msg may contain
@@ -693,31 +862,76 @@ void PtraceMonitor::EventPtraceSeccomp(pid_t pid, int event_msg) {
   // If the seccomp-policy is using RET_TRACE, we request that it returns the
   // syscall architecture identifier in the SECCOMP_RET_DATA.
   const auto syscall_arch = static_cast<sapi::cpu::Architecture>(event_msg);
-  Regs regs(pid);
-  auto status = regs.Fetch();
-  if (!status.ok()) {
+  absl::StatusOr<Syscall> syscall = FetchSeccompSyscall(pid, syscall_arch);
+  if (!syscall.ok()) {
     // Ignore if process is killed in the meanwhile
-    if (absl::IsNotFound(status)) {
-      LOG(WARNING) << "failed to fetch regs: " << status;
+    if (absl::IsNotFound(syscall.status())) {
+      LOG(WARNING) << "failed to fetch syscall: " << syscall.status();
       return;
     }
-    LOG(ERROR) << "failed to fetch regs: " << status;
+    LOG(ERROR) << "failed to fetch syscall: " << syscall.status();
     SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_FETCH);
     return;
   }
 
-  Syscall syscall = regs.ToSyscall(syscall_arch);
   // If the architecture of the syscall used is different that the current host
   // architecture, report a violation.
   if (syscall_arch != Syscall::GetHostArch()) {
-    ActionProcessSyscallViolation(&regs, syscall, kArchitectureSwitchViolation);
+    ActionProcessSyscallViolation(pid, *syscall, kArchitectureSwitchViolation);
     return;
   }
 
-  ActionProcessSyscall(&regs, syscall);
+  ActionProcessSyscall(pid, *syscall);
+}
+
+absl::StatusOr<Syscall> PtraceMonitor::FetchSeccompSyscall(
+    pid_t pid, sapi::cpu::Architecture arch) {
+  if (syscall_info_supported_) {
+    // One call instead of fetching all registers.
+    PtraceSyscallInfo info = {};
+    const long size =  // NOLINT(runtime/int)
+        ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info);
+    // Saved right away, as anything below may change it.
+    const int saved_errno = errno;
+    if (size == -1) {
+      if (saved_errno == ESRCH) {
+        return absl::ErrnoToStatus(
+            saved_errno, absl::StrCat("ptrace(PTRACE_GET_SYSCALL_INFO, pid=",
+                                      pid, ") failed"));
+      }
+      // Not supported before Linux 5.3.
+      VLOG(1) << "PTRACE_GET_SYSCALL_INFO unavailable, fetching registers";
+      syscall_info_supported_ = false;
+    } else if (info.op == PTRACE_SYSCALL_INFO_SECCOMP) {
+      // Returns the size of the kernel's struct. If the arguments are not
+      // part of it, they were not written.
+      if (size < static_cast<long>(  // NOLINT(runtime/int)
+                     offsetof(PtraceSyscallInfo, seccomp.ret_data))) {
+        return absl::InternalError(
+            absl::StrCat("ptrace(PTRACE_GET_SYSCALL_INFO, pid=", pid,
+                         ") returned only ", size, " bytes"));
+      }
+      Syscall::Args args;
+      std::copy(std::begin(info.seccomp.args), std::end(info.seccomp.args),
+                args.begin());
+      return Syscall(arch, info.seccomp.nr, args, pid, info.stack_pointer,
+                     info.instruction_pointer);
+    } else {
+      VLOG(1) << "PTRACE_GET_SYSCALL_INFO returned op " << int{info.op}
+              << " for pid " << pid << ", fetching registers";
+    }
+  }
+  Regs regs(pid);
+  SAPI_RETURN_IF_ERROR(regs.Fetch());
+  return regs.ToSyscall(arch);
 }
 
 void PtraceMonitor::EventSyscallExit(pid_t pid) {
+  if (profiled_syscalls_.contains(pid)) {
+    FinishProfiledSyscall(pid);
+    ContinueProcess(pid, 0);
+    return;
+  }
   // Check that the monitor wants to inspect the current syscall's return value.
   auto index = syscalls_in_progress_.find(pid);
   if (index == syscalls_in_progress_.end()) {
@@ -744,6 +958,7 @@ void PtraceMonitor::EventSyscallExit(pid_t pid) {
 }
 
 void PtraceMonitor::EventPtraceNewProcess(pid_t pid, int event_msg) {
+  FinishProfiledSyscall(pid);
   // ptrace doesn't issue syscall-exit-stops for successful fork/vfork/clone
   // system calls. Check if the monitor wanted to inspect the syscall's return
   // value, and call EventSyscallReturn for the parent process if so.
@@ -773,6 +988,7 @@ void PtraceMonitor::EventPtraceNewProcess(pid_t pid, int event_msg) {
 }
 
 void PtraceMonitor::EventPtraceExec(pid_t pid, int event_msg) {
+  FinishProfiledSyscall(pid);
   if (!IsActivelyMonitoring()) {
     VLOG(1) << "PTRACE_EVENT_EXEC seen from PID: " << event_msg
             << ". SANDBOX ENABLED!";
@@ -800,6 +1016,7 @@ void PtraceMonitor::EventPtraceExec(pid_t pid, int event_msg) {
 void PtraceMonitor::EventPtraceExit(pid_t pid, int event_msg) {
   // Forget about any syscalls in progress for this PID.
   syscalls_in_progress_.erase(pid);
+  FinishProfiledSyscall(pid);
 
   // A regular exit, let it continue (fast-path).
   if (ABSL_PREDICT_TRUE(WIFEXITED(event_msg) &&
@@ -895,8 +1112,10 @@ void PtraceMonitor::StateProcessStopped(pid_t pid, int status) {
     return;
   }
 
-  unsigned long event_msg;  // NOLINT
-  if (ptrace(PTRACE_GETEVENTMSG, pid, 0, &event_msg) == -1) {
+  unsigned long event_msg = 0;  // NOLINT
+  // Syscall-exit-stops have no event message, skip the ptrace() call.
+  if (!is_syscall_exit &&
+      ptrace(PTRACE_GETEVENTMSG, pid, 0, &event_msg) == -1) {
     if (errno == ESRCH) {
       // This happens from time to time, the kernel does not guarantee us that
       // we get the event in time.
@@ -935,7 +1154,7 @@ void PtraceMonitor::StateProcessStopped(pid_t pid, int status) {
 #endif
 
   if (is_syscall_exit) {
-    VLOG(2) << "PID: " << pid << " syscall-exit-stop: " << event_msg;
+    VLOG(2) << "PID: " << pid << " syscall-exit-stop";
     EventSyscallExit(pid);
     return;
   }
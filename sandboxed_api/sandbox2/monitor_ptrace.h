@@ -22,17 +22,24 @@
 #include <csignal>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <thread>
+#include <tuple>
+#include <utility>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/monitor_base.h"
 #include "sandboxed_api/sandbox2/notify.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/regs.h"
 #include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/raw_logging.h"
 
 namespace sandbox2 {
@@ -61,13 +68,14 @@ class PtraceMonitor : public MonitorBase {
       absl::Time deadline = absl::Now() + limit;
       deadline_millis_.store(absl::ToUnixMillis(deadline),
                              std::memory_order_relaxed);
+      NotifyMonitor();
     }
   }
 
  private:
-  // Timeout used with sigtimedwait (0.5s).
-  static constexpr int kWakeUpPeriodSec = 0L;
-  static constexpr int kWakeUpPeriodNSec = (500L * 1000L * 1000L);
+  // Longest wait for events. SIGCHLD is sent to the whole process, so other
+  // threads can consume it before the monitor sees it.
+  static constexpr absl::Duration kWakeUpPeriod = absl::Milliseconds(500);
 
   // Waits for events from monitored clients and signals from the main process.
   void RunInternal() override;
@@ -77,8 +85,12 @@ class PtraceMonitor : public MonitorBase {
   // Notifies monitor about a state change
   void NotifyMonitor();
 
+  // Waits until a process changed its state, the monitor was notified, the
+  // walltime limit or the given deadline is reached.
+  void WaitForEvents(absl::Time deadline);
+
   // PID called a traced syscall, or was killed due to syscall.
-  void ActionProcessSyscall(Regs* regs, const Syscall& syscall);
+  void ActionProcessSyscall(pid_t pid, const Syscall& syscall);
 
   // Getter/Setter for wait_for_execve_.
   bool IsActivelyMonitoring();
@@ -92,14 +104,27 @@ class PtraceMonitor : public MonitorBase {
   void SetAdditionalResultInfo(std::unique_ptr<Regs> regs);
 
   // Logs the syscall violation and kills the process afterwards.
+  void ActionProcessSyscallViolation(pid_t pid, const Syscall& syscall,
+                                     ViolationType violation_type);
   void ActionProcessSyscallViolation(Regs* regs, const Syscall& syscall,
                                      ViolationType violation_type);
 
   void LogStackTraceOfPid(pid_t pid);
 
+  // Syscall profiling, see Sandbox2::EnableSyscallProfiling().
+  // Counts a syscall the PID is entering. Its time is measured until
+  // FinishProfiledSyscall() if measure_time is set.
+  void ProfileSyscall(pid_t pid, uint64_t nr, bool measure_time);
+  void FinishProfiledSyscall(pid_t pid);
+  // Stores the collected profile in the result.
+  void SetSyscallProfile();
+
   // Ptrace events:
   // Syscall violation processing path.
   void EventPtraceSeccomp(pid_t pid, int event_msg);
+  // Returns the syscall of a PID in a seccomp stop.
+  absl::StatusOr<Syscall> FetchSeccompSyscall(pid_t pid,
+                                              sapi::cpu::Architecture arch);
 
   // Processes exit path.
   void EventPtraceExit(pid_t pid, int event_msg);
@@ -124,7 +149,7 @@ class PtraceMonitor : public MonitorBase {
   // Returns false if an error occured and process could not be interrupted.
   bool InterruptSandboxee();
 
-  // Sets up required signal masks/handlers; prepare mask for sigtimedwait().
+  // Sets up required signal masks/handlers and the fds waited on for events.
   bool InitSetupSignals();
 
   // ptrace(PTRACE_SEIZE) to the Client.
@@ -153,7 +178,33 @@ class PtraceMonitor : public MonitorBase {
   bool wait_for_execve_;
   // Syscalls that are running, whose result values we want to inspect.
   absl::flat_hash_map<pid_t, Syscall> syscalls_in_progress_;
+  // Maximum number of entries in allowed_traced_syscalls_.
+  static constexpr size_t kMaxCachedTraceDecisions = 4096;
+  // Traced syscalls that Notify::IsSyscallTraceCacheable() allowed for good,
+  // by architecture, number and arguments.
+  absl::flat_hash_set<
+      std::tuple<sapi::cpu::Architecture, uint64_t, Syscall::Args>>
+      allowed_traced_syscalls_;
+  // Cleared if the kernel doesn't support PTRACE_GET_SYSCALL_INFO.
+  bool syscall_info_supported_ = true;
+  struct SyscallStats {
+    uint64_t count = 0;
+    absl::Duration time;
+  };
+  // Per syscall number, only used when profiling.
+  absl::flat_hash_map<uint64_t, SyscallStats> syscall_stats_;
+  // Syscalls whose time is being measured, with their start time.
+  absl::flat_hash_map<pid_t, std::pair<uint64_t, absl::Time>>
+      profiled_syscalls_;
+  // Reused for each line written to log_file_.
+  std::string log_line_;
   sigset_t sset_;
+  // Receives SIGCHLD.
+  sapi::file_util::fileops::FDCloser signal_fd_;
+  // Written to by NotifyMonitor().
+  sapi::file_util::fileops::FDCloser wakeup_fd_;
+  // Waits on both of the above.
+  sapi::file_util::fileops::FDCloser epoll_fd_;
 
   // Monitor thread object.
   std::unique_ptr<std::thread> thread_;
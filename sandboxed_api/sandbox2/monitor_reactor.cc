@@ -0,0 +1,108 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Implementation of the sandbox2::MonitorReactor class.
+
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <utility>
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+
+namespace sandbox2 {
+
+using ::sapi::file_util::fileops::FDCloser;
+
+struct MonitorReactor::Entry {
+  int fd;
+  Source* source;
+  // Outlives the source's last use, unlike anything the source owns.
+  std::promise<void> done;
+};
+
+MonitorReactor::MonitorReactor(int num_threads)
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      stop_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+  CHECK_GT(num_threads, 0);
+  PCHECK(epoll_fd_.get() != -1) << "epoll_create1()";
+  PCHECK(stop_fd_.get() != -1) << "eventfd()";
+  // Level-triggered, so that it wakes up all threads.
+  epoll_event event = {.events = EPOLLIN, .data = {.ptr = nullptr}};
+  PCHECK(epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, stop_fd_.get(), &event) ==
+         0);
+  threads_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&MonitorReactor::Loop, this);
+  }
+}
+
+MonitorReactor::~MonitorReactor() {
+  uint64_t value = 1;
+  PCHECK(write(stop_fd_.get(), &value, sizeof(value)) == sizeof(value));
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+std::future<void> MonitorReactor::Add(int fd, Source* source) {
+  auto* entry = new Entry{fd, source, std::promise<void>()};
+  std::future<void> done = entry->done.get_future();
+  // One-shot, so that only one thread handles the source at a time.
+  epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                       .data = {.ptr = entry}};
+  PCHECK(epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, fd, &event) == 0)
+      << "Adding fd " << fd << " to the monitor reactor";
+  return done;
+}
+
+void MonitorReactor::Loop() {
+  constexpr int kMaxEvents = 16;
+  epoll_event events[kMaxEvents];
+  bool stopping = false;
+  while (!stopping) {
+    int n = epoll_wait(epoll_fd_.get(), events, kMaxEvents, /*timeout=*/-1);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    PCHECK(n != -1) << "epoll_wait()";
+    for (int i = 0; i < n; ++i) {
+      auto* entry = static_cast<Entry*>(events[i].data.ptr);
+      if (entry == nullptr) {
+        stopping = true;
+        continue;
+      }
+      if (entry->source->HandleEvents()) {
+        epoll_event event = {.events = EPOLLIN | EPOLLONESHOT,
+                             .data = {.ptr = entry}};
+        PCHECK(epoll_ctl(epoll_fd_.get(), EPOLL_CTL_MOD, entry->fd, &event) ==
+               0);
+        continue;
+      }
+      PCHECK(epoll_ctl(epoll_fd_.get(), EPOLL_CTL_DEL, entry->fd, nullptr) ==
+             0);
+      entry->done.set_value();
+      delete entry;
+    }
+  }
+}
+
+}  // namespace sandbox2
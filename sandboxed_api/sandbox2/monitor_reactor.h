@@ -0,0 +1,77 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The sandbox2::MonitorReactor class runs the event loops of many monitors on
+// a few shared threads.
+
+#ifndef SANDBOXED_API_SANDBOX2_MONITOR_REACTOR_H_
+#define SANDBOXED_API_SANDBOX2_MONITOR_REACTOR_H_
+
+#include <future>  // NOLINT(build/c++11)
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+
+// Dispatches the events of many monitors on a fixed set of threads, instead of
+// every monitor waiting for its events on a thread of its own. Used through
+// Sandbox2::EnableUnotifyMonitor(MonitorReactor*).
+//
+// Example:
+//   MonitorReactor reactor(/*num_threads=*/2);
+//   Sandbox2 s2(std::move(executor), std::move(policy));
+//   SAPI_RETURN_IF_ERROR(s2.EnableUnotifyMonitor(&reactor));
+//   Result result = s2.Run();
+class MonitorReactor {
+ public:
+  // Something waiting for events on an fd, e.g. an epoll fd of its own.
+  class Source {
+   public:
+    virtual ~Source() = default;
+
+    // Called on one of the reactor's threads whenever the fd is readable, but
+    // never on two threads at once. Returns false once the source finished,
+    // after which it is no longer used.
+    virtual bool HandleEvents() = 0;
+  };
+
+  explicit MonitorReactor(int num_threads = 1);
+
+  MonitorReactor(const MonitorReactor&) = delete;
+  MonitorReactor& operator=(const MonitorReactor&) = delete;
+
+  // All sources must have finished.
+  ~MonitorReactor();
+
+  // Starts dispatching events on fd to source. The returned future becomes
+  // ready once the source finished and will not be used anymore. The fd must
+  // stay open until then.
+  std::future<void> Add(int fd, Source* source);
+
+ private:
+  struct Entry;
+
+  void Loop();
+
+  sapi::file_util::fileops::FDCloser epoll_fd_;
+  // Readable once the reactor is shutting down.
+  sapi::file_util::fileops::FDCloser stop_fd_;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_MONITOR_REACTOR_H_
@@ -5,19 +5,45 @@
 #include <linux/ioctl.h>
 #include <linux/seccomp.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 #include "absl/cleanup/cleanup.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/bpfevaluator.h"
 #include "sandboxed_api/sandbox2/client.h"
 #include "sandboxed_api/sandbox2/forkserver.pb.h"
 #include "sandboxed_api/sandbox2/monitor_base.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
+#include "sandboxed_api/sandbox2/open_broker.h"
+#include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/raw_logging.h"
 
@@ -40,6 +66,29 @@ struct seccomp_notif_sizes {
 
 /* Flags for seccomp notification fd ioctl. */
 #define SECCOMP_IOCTL_NOTIF_RECV SECCOMP_IOWR(0, struct seccomp_notif)
+#define SECCOMP_IOCTL_NOTIF_SEND SECCOMP_IOWR(1, struct seccomp_notif_resp)
+#define SECCOMP_IOCTL_NOTIF_ID_VALID _IOW(SECCOMP_IOC_MAGIC, 2, __u64)
+#endif
+
+#ifndef SECCOMP_IOCTL_NOTIF_ADDFD
+struct seccomp_notif_addfd {
+  __u64 id;
+  __u32 flags;
+  __u32 srcfd;
+  __u32 newfd;
+  __u32 newfd_flags;
+};
+
+#define SECCOMP_IOCTL_NOTIF_ADDFD \
+  _IOW(SECCOMP_IOC_MAGIC, 3, struct seccomp_notif_addfd)
+#endif
+
+#ifndef SECCOMP_USER_NOTIF_FLAG_CONTINUE
+#define SECCOMP_USER_NOTIF_FLAG_CONTINUE (1UL << 0)
+#endif
+
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
 #endif
 
 namespace sandbox2 {
@@ -67,13 +116,27 @@ sapi::cpu::Architecture AuditArchToCPUArch(uint32_t arch) {
   }
 }
 
+bool IsOpenSyscall(int nr) {
+#ifdef __NR_open
+  if (nr == __NR_open) {
+    return true;
+  }
+#endif
+  return nr == __NR_openat;
+}
+
+bool IsTrace(const sock_filter& filter) {
+  return filter.code == BPF_RET + BPF_K &&
+         (filter.k & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_TRACE;
+}
+
 using ::sapi::file_util::fileops::FDCloser;
 
 }  // namespace
 
 UnotifyMonitor::UnotifyMonitor(Executor* executor, Policy* policy,
-                               Notify* notify)
-    : MonitorBase(executor, policy, notify) {
+                               Notify* notify, MonitorReactor* reactor)
+    : MonitorBase(executor, policy, notify), reactor_(reactor) {
   type_ = FORKSERVER_MONITOR_UNOTIFY;
   if (executor_->limits()->wall_time_limit() != absl::ZeroDuration()) {
     auto deadline = absl::Now() + executor_->limits()->wall_time_limit();
@@ -82,9 +145,36 @@ UnotifyMonitor::UnotifyMonitor(Executor* executor, Policy* policy,
   }
   external_kill_request_flag_.test_and_set(std::memory_order_relaxed);
   dump_stack_request_flag_.test_and_set(std::memory_order_relaxed);
+  // Policy::GetPolicy() turns the TRACEs of the user policy, and the KILLs
+  // handed to the network proxy or the open broker, into notifications as
+  // well. They are told apart from the other KILLs by evaluating the whole
+  // policy with its original verdicts, so that the checks of the default
+  // policy and earlier user rules still win over a later verdict for the same
+  // syscall.
+  const std::vector<sock_filter>& user_policy = policy_->user_policy_;
+  if (policy_->network_proxy_unotify_ || policy_->open_broker_ ||
+      std::any_of(user_policy.begin(), user_policy.end(), IsTrace)) {
+    original_policy_ = policy_->GetPolicy(/*user_notif=*/false);
+  }
 }
 
 void UnotifyMonitor::RunInternal() {
+  if (reactor_ != nullptr) {
+    // Set up on the calling thread, which waits for it anyway.
+    if (!InitSetup()) {
+      OnDone();
+      return;
+    }
+    if (!InitSetupReactor()) {
+      SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_MONITOR);
+      KillSandboxee();
+      KillInit();
+      OnDone();
+      return;
+    }
+    reactor_done_ = reactor_->Add(event_fd_.get(), this);
+    return;
+  }
   thread_ = std::make_unique<std::thread>(&UnotifyMonitor::Run, this);
 
   // Wait for the Monitor to set-up the sandboxee correctly (or fail while
@@ -93,7 +183,7 @@ void UnotifyMonitor::RunInternal() {
   setup_notification_.WaitForNotification();
 }
 
-void UnotifyMonitor::HandleUnotify() {
+bool UnotifyMonitor::HandleUnotify() {
   memset(req_.get(), 0, req_size_);
   if (ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_RECV, req_.get()) !=
       0) {
@@ -102,22 +192,180 @@ void UnotifyMonitor::HandleUnotify() {
     } else {
       SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_NOTIFY);
     }
-    return;
+    return false;
+  }
+  const uint32_t verdict = GetOriginalVerdict();
+  if (verdict == (SECCOMP_RET_KILL | internal::kNetworkProxyKillData) &&
+      network_proxy_server_ && req_->data.nr == __NR_connect) {
+    ForwardConnectToNetworkProxy();
+    return true;
+  }
+  if (verdict == (SECCOMP_RET_KILL | internal::kOpenBrokerKillData) &&
+      policy_->open_broker_ && IsOpenSyscall(req_->data.nr)) {
+    BrokerOpen();
+    return true;
   }
   Syscall syscall(AuditArchToCPUArch(req_->data.arch), req_->data.nr,
                   {req_->data.args[0], req_->data.args[1], req_->data.args[2],
                    req_->data.args[3], req_->data.args[4], req_->data.args[5]},
                   req_->pid, 0, req_->data.instruction_pointer);
+  if ((verdict & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_TRACE) {
+    return HandleTracedSyscall(syscall);
+  }
   ViolationType violation_type = syscall.arch() == Syscall::GetHostArch()
                                      ? kSyscallViolation
                                      : kArchitectureSwitchViolation;
   LogSyscallViolation(syscall);
   notify_->EventSyscallViolation(syscall, violation_type);
-  MaybeGetStackTrace(req_->pid, Result::VIOLATION);
   SetExitStatusCode(Result::VIOLATION, syscall.nr());
   notify_->EventSyscallViolation(syscall, violation_type);
   result_.SetSyscall(std::make_unique<Syscall>(syscall));
-  KillSandboxee();
+  KillSandboxeeAfterStackTrace(req_->pid, Result::VIOLATION);
+  return false;
+}
+
+void UnotifyMonitor::ForwardConnectToNetworkProxy() {
+  const uint64_t id = req_->id;
+  const int sockfd = static_cast<int>(req_->data.args[0]);
+  sockaddr_storage addr;
+  const size_t addrlen =
+      std::min<uint64_t>(static_cast<socklen_t>(req_->data.args[2]),
+                         sizeof(addr));
+  iovec local = {.iov_base = &addr, .iov_len = addrlen};
+  iovec remote = {
+      .iov_base = reinterpret_cast<void*>(req_->data.args[1]),
+      .iov_len = addrlen,
+  };
+  if (process_vm_readv(req_->pid, &local, 1, &remote, 1, 0) !=
+      static_cast<ssize_t>(addrlen)) {
+    seccomp_notif_resp resp = {.id = id, .val = 0, .error = -EFAULT,
+                               .flags = 0};
+    ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_SEND, &resp);
+    return;
+  }
+  // The pid might have been reused if the sandboxee died before we read the
+  // address.
+  if (ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_ID_VALID, &id) !=
+      0) {
+    return;
+  }
+  network_proxy_server_->QueueNotifiedConnect(
+      id, sockfd,
+      absl::MakeConstSpan(reinterpret_cast<const uint8_t*>(&addr), addrlen));
+}
+
+void UnotifyMonitor::BrokerOpen() {
+  const uint64_t id = req_->id;
+  // open(path, flags, mode) has the arguments of openat(dirfd, path, flags,
+  // mode) without the dirfd, which doesn't matter for absolute paths.
+  const int first = req_->data.nr == __NR_openat ? 1 : 0;
+  const uintptr_t path_ptr = req_->data.args[first];
+  const int flags = static_cast<int>(req_->data.args[first + 1]);
+  const mode_t mode = static_cast<mode_t>(req_->data.args[first + 2]);
+  auto respond = [this, id](int64_t val, int error) {
+    seccomp_notif_resp resp = {.id = id, .val = val, .error = -error,
+                               .flags = 0};
+    if (ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_SEND, &resp) !=
+            0 &&
+        errno != ENOENT) {
+      PLOG(ERROR) << "Answering the open() notification";
+    }
+  };
+  absl::StatusOr<std::string> path = util::ReadCPathFromPid(req_->pid,
+                                                            path_ptr);
+  if (!path.ok()) {
+    respond(0, EFAULT);
+    return;
+  }
+  // The pid might have been reused if the sandboxee died before we read the
+  // path.
+  if (ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_ID_VALID, &id) !=
+      0) {
+    return;
+  }
+  // Relative paths are denied by the broker, as it can't resolve them like
+  // the sandboxee would. The broker only opens regular files and never
+  // blocks, so a FIFO can't stall the monitor.
+  const int fd = policy_->open_broker_->Open(*path, flags, mode);
+  if (fd < 0) {
+    VLOG(1) << "Brokered open of " << *path << " failed: " << -fd;
+    respond(0, -fd);
+    return;
+  }
+  FDCloser host_fd(fd);
+  seccomp_notif_addfd addfd = {
+      .id = id,
+      .flags = 0,
+      .srcfd = static_cast<__u32>(host_fd.get()),
+      .newfd = 0,
+      .newfd_flags = static_cast<__u32>(flags & O_CLOEXEC),
+  };
+  // Returns the number of the descriptor in the sandboxee.
+  const int newfd =
+      ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+  if (newfd < 0) {
+    // With ENOENT, the sandboxee was interrupted or killed meanwhile.
+    if (errno != ENOENT) {
+      respond(0, errno);
+    }
+    return;
+  }
+  respond(newfd, 0);
+}
+
+uint32_t UnotifyMonitor::GetOriginalVerdict() const {
+  // Other architectures are denied by the default policy.
+  if (original_policy_.empty() ||
+      AuditArchToCPUArch(req_->data.arch) != Syscall::GetHostArch()) {
+    return SECCOMP_RET_KILL;
+  }
+  absl::StatusOr<bpf::Evaluation> evaluation =
+      bpf::Evaluate(original_policy_, req_->data);
+  if (!evaluation.ok()) {
+    LOG(ERROR) << "Evaluating the policy: " << evaluation.status();
+    return SECCOMP_RET_KILL;
+  }
+  return evaluation->action;
+}
+
+bool UnotifyMonitor::HandleTracedSyscall(const Syscall& syscall) {
+  const uint64_t id = req_->id;
+  auto cache_key =
+      std::make_tuple(syscall.arch(), syscall.nr(), syscall.args());
+  if (!allowed_traced_syscalls_.contains(cache_key)) {
+    Notify::TraceAction action = notify_->EventSyscallTrace(syscall);
+    if (action == Notify::TraceAction::kInspectAfterReturn) {
+      // The monitor never sees the syscall return without ptrace.
+      LOG(WARNING) << "Allowing " << syscall.GetDescription()
+                   << " without inspecting its return value";
+    } else if (action == Notify::TraceAction::kAllow) {
+      if (allowed_traced_syscalls_.size() < kMaxCachedTraceDecisions &&
+          notify_->IsSyscallTraceCacheable(syscall)) {
+        allowed_traced_syscalls_.insert(std::move(cache_key));
+      }
+    } else {
+      LogSyscallViolation(syscall);
+      notify_->EventSyscallViolation(syscall, kSyscallViolation);
+      SetExitStatusCode(Result::VIOLATION, syscall.nr());
+      result_.SetSyscall(std::make_unique<Syscall>(syscall));
+      KillSandboxeeAfterStackTrace(req_->pid, Result::VIOLATION);
+      return false;
+    }
+  }
+  seccomp_notif_resp resp = {.id = id, .val = 0, .error = 0,
+                             .flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE};
+  if (ioctl(seccomp_notify_fd_.get(), SECCOMP_IOCTL_NOTIF_SEND, &resp) != 0) {
+    // With ENOENT, the sandboxee was interrupted or killed meanwhile. Kernels
+    // before 5.5 can't continue syscalls.
+    if (errno == ENOENT) {
+      return true;
+    }
+    PLOG(ERROR) << "Continuing the traced syscall";
+    SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_NOTIFY);
+    KillSandboxee();
+    return false;
+  }
+  return true;
 }
 
 void UnotifyMonitor::Run() {
@@ -126,104 +374,223 @@ void UnotifyMonitor::Run() {
     OnDone();
   };
 
+  if (!InitSetup()) {
+    return;
+  }
+  while (ProcessEvents(NextWakeupMsec())) {
+  }
+  KillInit();
+}
+
+bool UnotifyMonitor::InitSetup() {
   absl::Cleanup setup_notify = [this] { setup_notification_.Notify(); };
   if (!InitSetupUnotify()) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_NOTIFY);
-    return;
+    return false;
+  }
+  if (policy_->network_proxy_unotify_ && network_proxy_server_) {
+    FDCloser notify_fd(dup(seccomp_notify_fd_.get()));
+    if (notify_fd.get() == -1) {
+      PLOG(ERROR) << "dup() of the unotify fd for the network proxy";
+      SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_NOTIFY);
+      return false;
+    }
+    network_proxy_server_->EnableNotifications(std::move(notify_fd));
   }
   if (!InitSetupNotifyPipe()) {
     SetExitStatusCode(Result::SETUP_ERROR, Result::FAILED_NOTIFY);
-    return;
+    return false;
+  }
+  pfds_[0] = {.fd = process_.status_fd.get(), .events = POLLIN};
+  pfds_[1] = {.fd = seccomp_notify_fd_.get(), .events = POLLIN};
+  pfds_[2] = {.fd = monitor_notify_pipe_[0].get(), .events = POLLIN};
+  return true;
+}
+
+int UnotifyMonitor::NextWakeupMsec() const {
+  if (waiting_for_exit_) {
+    return static_cast<int>(std::max<int64_t>(
+        0, absl::ToInt64Milliseconds(exit_deadline_ - absl::Now())));
   }
+  int64_t deadline = deadline_millis_.load(std::memory_order_relaxed);
+  absl::Duration remaining = absl::FromUnixMillis(deadline) - absl::Now();
+  constexpr int64_t kMinWakeupMsec = 30000;
+  int timeout_msec = kMinWakeupMsec;
+  if (remaining > absl::ZeroDuration()) {
+    timeout_msec = static_cast<int>(
+        std::min(kMinWakeupMsec, absl::ToInt64Milliseconds(remaining)));
+  }
+  return timeout_msec;
+}
 
-  std::move(setup_notify).Invoke();
+bool UnotifyMonitor::ProcessEvents(int timeout_msec) {
+  if (stack_trace_thread_.joinable() && !FinishStackTrace()) {
+    return true;
+  }
+  if (waiting_for_exit_) {
+    return ProcessExitEvents(timeout_msec);
+  }
+  if (result_.final_status() != Result::UNSET) {
+    return StopProcessingEvents(wait_for_sandboxee_);
+  }
 
-  pollfd pfds[] = {
-      {.fd = process_.status_fd.get(), .events = POLLIN},
-      {.fd = seccomp_notify_fd_.get(), .events = POLLIN},
-      {.fd = monitor_notify_pipe_[0].get(), .events = POLLIN},
-  };
-  bool wait_for_sandboxee = true;
-  while (result_.final_status() == Result::UNSET) {
-    int64_t deadline = deadline_millis_.load(std::memory_order_relaxed);
-    absl::Duration remaining = absl::FromUnixMillis(deadline) - absl::Now();
-    if (deadline != 0 && remaining < absl::ZeroDuration()) {
-      VLOG(1) << "Sandbox process hit timeout due to the walltime timer";
-      timed_out_ = true;
-      MaybeGetStackTrace(process_.main_pid, Result::TIMEOUT);
-      KillSandboxee();
-      break;
-    }
+  int64_t deadline = deadline_millis_.load(std::memory_order_relaxed);
+  if (deadline != 0 && absl::FromUnixMillis(deadline) < absl::Now()) {
+    VLOG(1) << "Sandbox process hit timeout due to the walltime timer";
+    timed_out_ = true;
+    KillSandboxeeAfterStackTrace(process_.main_pid, Result::TIMEOUT);
+    return StopProcessingEvents(/*wait_for_sandboxee=*/true);
+  }
 
-    if (!external_kill_request_flag_.test_and_set(std::memory_order_relaxed)) {
-      external_kill_ = true;
-      MaybeGetStackTrace(process_.main_pid, Result::EXTERNAL_KILL);
-      KillSandboxee();
-      break;
-    }
+  if (!external_kill_request_flag_.test_and_set(std::memory_order_relaxed)) {
+    external_kill_ = true;
+    KillSandboxeeAfterStackTrace(process_.main_pid, Result::EXTERNAL_KILL);
+    return StopProcessingEvents(/*wait_for_sandboxee=*/true);
+  }
 
-    if (network_proxy_server_ &&
-        network_proxy_server_->violation_occurred_.load(
-            std::memory_order_acquire) &&
-        !network_violation_) {
-      network_violation_ = true;
-      MaybeGetStackTrace(process_.main_pid, Result::VIOLATION);
-      KillSandboxee();
-      break;
-    }
-    constexpr int64_t kMinWakeupMsec = 30000;
-    int timeout_msec = kMinWakeupMsec;
-    if (remaining > absl::ZeroDuration()) {
-      timeout_msec = static_cast<int>(
-          std::min(kMinWakeupMsec, absl::ToInt64Milliseconds(remaining)));
-    }
-    int ret = poll(pfds, ABSL_ARRAYSIZE(pfds), timeout_msec);
-    if (ret == 0 || (ret == -1 && errno == EINTR)) {
-      continue;
-    }
-    PCHECK(ret != -1);
-    if (pfds[2].revents & POLLIN) {
-      char c = ' ';
-      read(monitor_notify_pipe_[0].get(), &c, 1);
-      continue;
-    }
-    if (pfds[0].revents & POLLIN) {
-      SetExitStatusFromStatusPipe();
-      wait_for_sandboxee = false;
-      break;
-    }
-    if (pfds[0].revents & POLLHUP) {
-      SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_MONITOR);
-      wait_for_sandboxee = false;
-      break;
-    }
-    if (pfds[1].revents & POLLIN) {
-      HandleUnotify();
-      wait_for_sandboxee = false;
+  if (network_proxy_server_ &&
+      network_proxy_server_->violation_occurred_.load(
+          std::memory_order_acquire) &&
+      !network_violation_) {
+    network_violation_ = true;
+    KillSandboxeeAfterStackTrace(process_.main_pid, Result::VIOLATION);
+    return StopProcessingEvents(/*wait_for_sandboxee=*/true);
+  }
+
+  int ret = poll(pfds_, ABSL_ARRAYSIZE(pfds_), timeout_msec);
+  if (ret == 0 || (ret == -1 && errno == EINTR)) {
+    return true;
+  }
+  PCHECK(ret != -1);
+  if (pfds_[2].revents & POLLIN) {
+    char c = ' ';
+    read(monitor_notify_pipe_[0].get(), &c, 1);
+    return true;
+  }
+  if (pfds_[0].revents & POLLIN) {
+    SetExitStatusFromStatusPipe();
+    return StopProcessingEvents(/*wait_for_sandboxee=*/false);
+  }
+  if (pfds_[0].revents & POLLHUP) {
+    SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_MONITOR);
+    return StopProcessingEvents(/*wait_for_sandboxee=*/false);
+  }
+  if ((pfds_[1].revents & POLLIN) && !HandleUnotify()) {
+    wait_for_sandboxee_ = false;
+  }
+  return result_.final_status() == Result::UNSET ||
+         StopProcessingEvents(wait_for_sandboxee_);
+}
+
+bool UnotifyMonitor::StopProcessingEvents(bool wait_for_sandboxee) {
+  if (!wait_for_sandboxee) {
+    return false;
+  }
+  // Only the status pipe matters from now on.
+  waiting_for_exit_ = true;
+  exit_deadline_ = absl::Now() + absl::Seconds(1);
+  if (event_fd_.get() != -1) {
+    epoll_ctl(event_fd_.get(), EPOLL_CTL_DEL, seccomp_notify_fd_.get(),
+              nullptr);
+    epoll_ctl(event_fd_.get(), EPOLL_CTL_DEL, monitor_notify_pipe_[0].get(),
+              nullptr);
+  }
+  return true;
+}
+
+bool UnotifyMonitor::ProcessExitEvents(int timeout_msec) {
+  int ret = poll(pfds_, 1, timeout_msec);
+  if (ret == -1 && errno == EINTR) {
+    return true;
+  }
+  PCHECK(ret != -1);
+  if (ret == 0) {
+    if (absl::Now() < exit_deadline_) {
+      return true;
     }
+    LOG(WARNING) << "Waiting for sandboxee exit timed out";
+  } else if (pfds_[0].revents & POLLIN) {
+    SetExitStatusFromStatusPipe();
+  } else if (pfds_[0].revents & POLLHUP) {
+    SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_MONITOR);
   }
-  if (wait_for_sandboxee) {
-    absl::Time deadline = absl::Now() + absl::Seconds(1);
-    int ret = 0;
-    do {
-      absl::Duration remaining = deadline - absl::Now();
-      if (remaining <= absl::ZeroDuration()) {
-        ret = 0;
-        break;
-      }
-      ret =
-          poll(pfds, 1, static_cast<int>(absl::ToInt64Milliseconds(remaining)));
-    } while (ret == -1 && errno == EINTR);
-    PCHECK(ret != -1);
-    if (ret == 0) {
-      LOG(WARNING) << "Waiting for sandboxee exit timed out";
-    } else if (pfds[0].revents & POLLIN) {
-      SetExitStatusFromStatusPipe();
-    } else if (pfds[0].revents & POLLHUP) {
-      SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_MONITOR);
+  return false;
+}
+
+bool UnotifyMonitor::InitSetupReactor() {
+  event_fd_ = FDCloser(epoll_create1(EPOLL_CLOEXEC));
+  if (event_fd_.get() == -1) {
+    PLOG(ERROR) << "epoll_create1()";
+    return false;
+  }
+  timer_fd_ = FDCloser(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC));
+  if (timer_fd_.get() == -1) {
+    PLOG(ERROR) << "timerfd_create()";
+    return false;
+  }
+  stack_trace_done_fd_ = FDCloser(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  if (stack_trace_done_fd_.get() == -1) {
+    PLOG(ERROR) << "eventfd()";
+    return false;
+  }
+  epoll_event event = {.events = EPOLLIN,
+                       .data = {.fd = stack_trace_done_fd_.get()}};
+  if (epoll_ctl(event_fd_.get(), EPOLL_CTL_ADD, stack_trace_done_fd_.get(),
+                &event) != 0) {
+    PLOG(ERROR) << "Adding the stack trace eventfd to the monitor's epoll set";
+    return false;
+  }
+  return WatchEvents(/*watch=*/true) && ArmTimer();
+}
+
+bool UnotifyMonitor::WatchEvents(bool watch) {
+  // Once waiting for the exit, only the status pipe matters.
+  std::vector<int> fds = {pfds_[0].fd, timer_fd_.get()};
+  if (!waiting_for_exit_) {
+    fds.insert(fds.end(), {pfds_[1].fd, pfds_[2].fd});
+  }
+  for (int fd : fds) {
+    epoll_event event = {.events = EPOLLIN, .data = {.fd = fd}};
+    if (epoll_ctl(event_fd_.get(), watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd,
+                  &event) != 0) {
+      PLOG(ERROR) << (watch ? "Adding" : "Removing") << " fd " << fd
+                  << " in the monitor's epoll set";
+      return false;
     }
   }
+  return true;
+}
+
+bool UnotifyMonitor::ArmTimer() {
+  // At least 1ns, as 0 disarms the timer.
+  int64_t wakeup_nsec = std::max<int64_t>(
+      1, static_cast<int64_t>(NextWakeupMsec()) * 1000 * 1000);
+  itimerspec spec = {.it_value = absl::ToTimespec(absl::Nanoseconds(
+                         wakeup_nsec))};
+  if (timerfd_settime(timer_fd_.get(), 0, &spec, nullptr) != 0) {
+    PLOG(ERROR) << "timerfd_settime()";
+    return false;
+  }
+  return true;
+}
+
+bool UnotifyMonitor::HandleEvents() {
+  // Checks all conditions without waiting. Re-arming the timer also resets
+  // its expiration count, so it needs no read(). A pending stack trace keeps
+  // the monitor around until it is done.
+  bool running =
+      ProcessEvents(/*timeout_msec=*/0) || stack_trace_thread_.joinable();
+  if (running && !ArmTimer()) {
+    SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_MONITOR);
+    KillSandboxee();
+    running = false;
+  }
+  if (running) {
+    return true;
+  }
   KillInit();
+  OnDone();
+  return false;
 }
 
 void UnotifyMonitor::SetExitStatusFromStatusPipe() {
@@ -295,7 +662,7 @@ void UnotifyMonitor::NotifyMonitor() {
 
 bool UnotifyMonitor::KillSandboxee() {
   VLOG(1) << "Sending SIGKILL to the PID: " << process_.main_pid;
-  if (kill(process_.main_pid, SIGKILL) != 0) {
+  if (SignalSandboxee(SIGKILL) != 0) {
     PLOG(ERROR) << "Could not send SIGKILL to PID " << process_.main_pid;
     return false;
   }
@@ -311,6 +678,15 @@ void UnotifyMonitor::KillInit() {
 
 void UnotifyMonitor::Join() {
   absl::MutexLock lock(&notify_mutex_);
+  if (reactor_done_.valid()) {
+    reactor_done_.wait();
+    CHECK(IsDone()) << "Monitor did not terminate";
+    VLOG(1) << "Final execution status: " << result_.ToString();
+    CHECK(result_.final_status() != Result::UNSET);
+    reactor_done_ = std::future<void>();
+    monitor_notify_pipe_[0].Close();
+    monitor_notify_pipe_[1].Close();
+  }
   if (thread_) {
     thread_->join();
     CHECK(IsDone()) << "Monitor did not terminate";
@@ -322,6 +698,51 @@ void UnotifyMonitor::Join() {
   }
 }
 
+void UnotifyMonitor::KillSandboxeeAfterStackTrace(pid_t pid,
+                                                  Result::StatusEnum status) {
+  if (reactor_ == nullptr || !ShouldCollectStackTrace(status)) {
+    MaybeGetStackTrace(pid, status);
+    KillSandboxee();
+    return;
+  }
+  // Sharing the reactor's thread, other monitors would wait meanwhile.
+  if (!WatchEvents(/*watch=*/false)) {
+    KillSandboxee();
+    return;
+  }
+  stack_trace_thread_ = std::thread([this, pid] {
+    // The thread that attached must also detach.
+    stack_trace_ = GetStackTrace(pid);
+    KillSandboxee();
+    uint64_t value = 1;
+    SAPI_RAW_PCHECK(write(stack_trace_done_fd_.get(), &value,
+                          sizeof(value)) == sizeof(value),
+                    "signaling the stack trace");
+  });
+}
+
+bool UnotifyMonitor::FinishStackTrace() {
+  uint64_t value;
+  if (read(stack_trace_done_fd_.get(), &value, sizeof(value)) !=
+      sizeof(value)) {
+    return false;
+  }
+  stack_trace_thread_.join();
+  if (stack_trace_.ok()) {
+    result_.set_stack_trace(*stack_trace_);
+  } else {
+    LOG(ERROR) << "Getting stack trace: " << stack_trace_.status();
+  }
+  if (waiting_for_exit_) {
+    // The sandboxee was only killed now.
+    exit_deadline_ = absl::Now() + absl::Seconds(1);
+  }
+  if (!WatchEvents(/*watch=*/true) && result_.final_status() == Result::UNSET) {
+    SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_MONITOR);
+  }
+  return true;
+}
+
 void UnotifyMonitor::MaybeGetStackTrace(pid_t pid, Result::StatusEnum status) {
   if (ShouldCollectStackTrace(status)) {
     auto stack = GetStackTrace(pid);
@@ -355,13 +776,8 @@ absl::StatusOr<std::vector<std::string>> UnotifyMonitor::GetStackTrace(
     }
   };
   Regs regs(pid);
-  absl::Status status = regs.Fetch();
-  if (!status.ok()) {
-    if (absl::IsNotFound(status)) {
-      LOG(WARNING) << "failed to fetch regs: " << status;
-      return status;
-    }
-    SetExitStatusCode(Result::INTERNAL_ERROR, Result::FAILED_FETCH);
+  // Only returns the error, the caller decided on the result already.
+  if (absl::Status status = regs.Fetch(); !status.ok()) {
     return status;
   }
   return GetAndLogStackTrace(&regs);
@@ -1,20 +1,31 @@
 #ifndef SANDBOXED_API_SANDBOX2_MONITOR_UNOTIFY_H_
 #define SANDBOXED_API_SANDBOX2_MONITOR_UNOTIFY_H_
 
+#include <linux/filter.h>
 #include <linux/seccomp.h>
 
+#include <poll.h>
+
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
 #include <memory>
 #include <thread>
 #include <string>
+#include <tuple>
 #include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/monitor_base.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
 #include "sandboxed_api/sandbox2/notify.h"
 #include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/util/raw_logging.h"
 
 namespace sandbox2 {
@@ -26,11 +37,21 @@ struct seccomp_notif {
   __u32 flags;
   struct seccomp_data data;
 };
+
+struct seccomp_notif_resp {
+  __u64 id;
+  __s64 val;
+  __s32 error;
+  __u32 flags;
+};
 #endif
 
-class UnotifyMonitor : public MonitorBase {
+// With a reactor, the monitor's events are handled on the reactor's threads
+// instead of a thread of its own.
+class UnotifyMonitor : public MonitorBase, public MonitorReactor::Source {
  public:
-  UnotifyMonitor(Executor* executor, Policy* policy, Notify* notify);
+  UnotifyMonitor(Executor* executor, Policy* policy, Notify* notify,
+                 MonitorReactor* reactor = nullptr);
   ~UnotifyMonitor() { Join(); }
 
   void Kill() override {
@@ -61,19 +82,64 @@ class UnotifyMonitor : public MonitorBase {
   void RunInternal() override;
   void Join() override;
   void Run();
+  bool HandleEvents() override;
 
+  bool InitSetup();
   bool InitSetupUnotify();
   bool InitSetupNotifyPipe();
+  // Sets up event_fd_, timer_fd_ and stack_trace_done_fd_.
+  bool InitSetupReactor();
+  // Adds the fds of the monitor to event_fd_, or removes them.
+  bool WatchEvents(bool watch);
+  // Arms timer_fd_ for the next wakeup.
+  bool ArmTimer();
+  // Milliseconds until the next deadline needs to be checked.
+  int NextWakeupMsec() const;
+  // Handles pending events, waiting up to timeout_msec for one. Returns false
+  // once the sandboxee is done.
+  bool ProcessEvents(int timeout_msec);
+  // Like ProcessEvents(), after the sandboxee was killed.
+  bool ProcessExitEvents(int timeout_msec);
+  // Returns whether to keep waiting for the sandboxee to exit.
+  bool StopProcessingEvents(bool wait_for_sandboxee);
   // Kills the main traced PID with SIGKILL.
   // Returns false if an error occured and process could not be killed.
   bool KillSandboxee();
   void KillInit();
 
-  void HandleUnotify();
+  // Returns false if the notification ended the monitoring, e.g. because of
+  // a violation.
+  bool HandleUnotify();
+  // Hands the connect() held by the notification in req_ to the network
+  // proxy, see PolicyBuilder::AddNetworkProxyUnotifyPolicy().
+  void ForwardConnectToNetworkProxy();
+  // Opens the file of the open() or openat() held by the notification in req_
+  // with the policy's OpenBroker, and installs it in the sandboxee, see
+  // PolicyBuilder::AddBrokeredDirectory(). Runs on the monitor thread, the
+  // sandboxee waits meanwhile anyway.
+  void BrokerOpen();
+  // Returns the verdict of the policy, as it would be used with ptrace, for
+  // the syscall of the notification in req_. That is KILL if the policy isn't
+  // evaluated, as it doesn't TRACE or hand anything to the network proxy or
+  // the open broker.
+  uint32_t GetOriginalVerdict() const;
+  // Lets Notify::EventSyscallTrace() decide on a traced syscall, and lets the
+  // kernel continue it if allowed. Returns false if the syscall was denied.
+  // Only the syscall arguments are reliable: memory that they point to may
+  // still be changed by other threads of the sandboxee after the decision.
+  bool HandleTracedSyscall(const Syscall& syscall);
   void SetExitStatusFromStatusPipe();
 
   void MaybeGetStackTrace(pid_t pid, Result::StatusEnum status);
   absl::StatusOr<std::vector<std::string>> GetStackTrace(pid_t pid);
+  // Kills the sandboxee after getting the stack trace of pid, if one is
+  // wanted for status. With a reactor, the stack trace is collected on
+  // stack_trace_thread_ instead, as it can take long, and the monitor ignores
+  // all other events until it is done.
+  void KillSandboxeeAfterStackTrace(pid_t pid, Result::StatusEnum status);
+  // Takes the result of stack_trace_thread_ once it is done, and resumes
+  // handling events. Returns false if it is still running.
+  bool FinishStackTrace();
 
   // Notifies monitor about a state change
   void NotifyMonitor();
@@ -94,6 +160,24 @@ class UnotifyMonitor : public MonitorBase {
   bool network_violation_ = false;
   // Is the sandboxee timed out
   bool timed_out_ = false;
+  // Whether the exit of a killed sandboxee still needs to be collected
+  bool wait_for_sandboxee_ = true;
+  bool waiting_for_exit_ = false;
+  absl::Time exit_deadline_;
+  // Status pipe, unotify fd and notify pipe
+  pollfd pfds_[3] = {};
+
+  // Only used with a reactor: all fds of the monitor, and its wakeup timer.
+  MonitorReactor* reactor_;
+  sapi::file_util::fileops::FDCloser event_fd_;
+  sapi::file_util::fileops::FDCloser timer_fd_;
+  // Ready once the reactor is done with the monitor.
+  std::future<void> reactor_done_;
+  // Only used with a reactor: collects a stack trace off the reactor's
+  // threads, kills the sandboxee and then signals stack_trace_done_fd_.
+  std::thread stack_trace_thread_;
+  sapi::file_util::fileops::FDCloser stack_trace_done_fd_;
+  absl::StatusOr<std::vector<std::string>> stack_trace_;
 
   // Monitor thread object.
   std::unique_ptr<std::thread> thread_;
@@ -101,6 +185,18 @@ class UnotifyMonitor : public MonitorBase {
   // Synchronizes monitor thread deletion and notifying the monitor.
   absl::Mutex notify_mutex_;
 
+  // The policy as it would be used with ptrace, evaluated for notifications
+  // to tell TRACE and the KILLs of the network proxy and the open broker from
+  // other KILLs. Empty if the policy has none of them.
+  std::vector<sock_filter> original_policy_;
+  // Maximum number of entries in allowed_traced_syscalls_.
+  static constexpr size_t kMaxCachedTraceDecisions = 4096;
+  // Traced syscalls that Notify::IsSyscallTraceCacheable() allowed for good,
+  // by architecture, number and arguments.
+  absl::flat_hash_set<
+      std::tuple<sapi::cpu::Architecture, uint64_t, Syscall::Args>>
+      allowed_traced_syscalls_;
+
   size_t req_size_;
   std::unique_ptr<seccomp_notif, decltype(std::free)*> req_{nullptr, std::free};
 };
@@ -15,17 +15,33 @@
 #include "sandboxed_api/sandbox2/mounts.h"
 
 #include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <list>
 #include <memory>
+#include <optional>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <tuple>
 #include <utility>
+#include <vector>
 
 #include "google/protobuf/util/message_differencer.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -36,6 +52,7 @@
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/mount_tree.pb.h"
 #include "sandboxed_api/sandbox2/util/minielf.h"
@@ -45,6 +62,21 @@
 #include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/util/strerror.h"
 
+// The new mount API, from <linux/mount.h> which conflicts with <sys/mount.h>
+// on some systems. The syscall numbers are shared by all architectures.
+#ifndef __NR_open_tree
+#define __NR_open_tree 428
+#endif
+#ifndef __NR_move_mount
+#define __NR_move_mount 429
+#endif
+#ifndef __NR_mount_setattr
+#define __NR_mount_setattr 442
+#endif
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE 0x8000
+#endif
+
 namespace sandbox2 {
 namespace {
 
@@ -62,6 +94,8 @@ absl::string_view GetOutsidePath(const MountTree::Node& node) {
       return node.file_node().outside();
     case MountTree::Node::kDirNode:
       return node.dir_node().outside();
+    case MountTree::Node::kRootNode:
+      return node.root_node().outside();
     default:
       SAPI_RAW_LOG(FATAL, "Invalid node type");
   }
@@ -162,9 +196,12 @@ bool IsEquivalentNode(const MountTree::Node& n1, const MountTree::Node& n2) {
       return n1.dir_node().writable() == n2.dir_node().writable() &&
              IsSameFile(n1.dir_node().outside(), n2.dir_node().outside());
     case MountTree::Node::kTmpfsNode:
-      return n1.tmpfs_node().tmpfs_options() == n2.tmpfs_node().tmpfs_options();
+      return n1.tmpfs_node().tmpfs_options() ==
+                 n2.tmpfs_node().tmpfs_options() &&
+             n1.tmpfs_node().seed() == n2.tmpfs_node().seed();
     case MountTree::Node::kRootNode:
-      return n1.root_node().writable() == n2.root_node().writable();
+      return n1.root_node().writable() == n2.root_node().writable() &&
+             n1.root_node().outside() == n2.root_node().outside();
     default:
       return false;
   }
@@ -311,6 +348,20 @@ absl::Status Mounts::AddDirectoryAt(absl::string_view outside,
   return Insert(inside, node);
 }
 
+absl::Status Mounts::SetPrebuiltRoot(absl::string_view outside) {
+  if (!sapi::file::IsAbsolutePath(outside)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Prebuilt root has to be an absolute path: ", outside));
+  }
+  if (PathContainsNullByte(outside)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Prebuilt root contains a null byte: ", outside));
+  }
+  mount_tree_.mutable_node()->mutable_root_node()->set_outside(
+      sapi::file::CleanPath(outside));
+  return absl::OkStatus();
+}
+
 absl::StatusOr<std::string> Mounts::ResolvePath(absl::string_view path) const {
   if (!sapi::file::IsAbsolutePath(path)) {
     return absl::InvalidArgumentError("Path has to be absolute");
@@ -325,8 +376,9 @@ absl::StatusOr<std::string> Mounts::ResolvePath(absl::string_view path) const {
     const std::string cur(parts.first);
     const auto it = curtree->entries().find(cur);
     if (it == curtree->entries().end()) {
-      if (curtree->node().has_dir_node()) {
-        return sapi::file::JoinPath(curtree->node().dir_node().outside(), tail);
+      if (curtree->node().has_dir_node() ||
+          (curtree == &mount_tree_ && HasPrebuiltRoot())) {
+        return sapi::file::JoinPath(GetOutsidePath(curtree->node()), tail);
       }
       return absl::NotFoundError("Path could not be resolved in the mounts");
     }
@@ -338,6 +390,10 @@ absl::StatusOr<std::string> Mounts::ResolvePath(absl::string_view path) const {
     case MountTree::Node::kDirNode:
       return std::string(GetOutsidePath(curtree->node()));
     case MountTree::Node::kRootNode:
+      if (HasPrebuiltRoot()) {
+        return std::string(GetOutsidePath(curtree->node()));
+      }
+      break;
     case MountTree::Node::kTmpfsNode:
     case MountTree::Node::NODE_NOT_SET:
       break;
@@ -353,15 +409,170 @@ void LogContainer(const std::vector<std::string>& container) {
   }
 }
 
+// What mapping an ELF file into the sandbox depends on.
+struct ElfDependencies {
+  std::string interpreter;
+  std::vector<std::string> imported_libraries;
+};
+
+// Identifies a version of a file, so that cached data about it can be reused
+// until it changes.
+struct FileVersion {
+  dev_t dev;
+  ino_t ino;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  off_t size;
+
+  static absl::StatusOr<FileVersion> Of(int fd, const std::string& path) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("fstat(", path, ")"));
+    }
+    return FileVersion{st.st_dev, st.st_ino, st.st_mtim.tv_sec,
+                       st.st_mtim.tv_nsec, st.st_size};
+  }
+
+  auto Tie() const { return std::tie(dev, ino, mtime_sec, mtime_nsec, size); }
+  bool operator==(const FileVersion& other) const {
+    return Tie() == other.Tie();
+  }
+  template <typename H>
+  friend H AbslHashValue(H h, const FileVersion& version) {
+    return H::combine(std::move(h), version.Tie());
+  }
+};
+
+// Most sandboxes of a process map the same few binaries and libraries, so
+// their dependencies are only parsed once per process. The least recently used
+// entries are dropped, so that processes mapping many different files don't
+// grow without bounds.
+class ElfDependenciesCache {
+ public:
+  static constexpr size_t kMaxEntries = 512;
+
+  static ElfDependenciesCache& Get() {
+    static auto* cache = new ElfDependenciesCache();
+    return *cache;
+  }
+
+  std::optional<ElfDependencies> Find(const FileVersion& version) {
+    absl::MutexLock lock(&mutex_);
+    auto it = index_.find(version);
+    if (it == index_.end()) {
+      return std::nullopt;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+  }
+
+  void Insert(const FileVersion& version, ElfDependencies dependencies) {
+    absl::MutexLock lock(&mutex_);
+    if (auto it = index_.find(version); it != index_.end()) {
+      entries_.splice(entries_.begin(), entries_, it->second);
+      it->second->second = std::move(dependencies);
+      return;
+    }
+    entries_.emplace_front(version, std::move(dependencies));
+    index_.emplace(version, entries_.begin());
+    if (entries_.size() > kMaxEntries) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  using Entry = std::pair<FileVersion, ElfDependencies>;
+
+  absl::Mutex mutex_;
+  // Most recently used first.
+  std::list<Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<FileVersion, std::list<Entry>::iterator> index_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+absl::StatusOr<ElfDependencies> ParseElfDependencies(int fd) {
+  SAPI_ASSIGN_OR_RETURN(
+      ElfFile elf,
+      ElfFile::ParseFromFd(
+          fd, ElfFile::kGetInterpreter | ElfFile::kLoadImportedLibraries));
+  return ElfDependencies{elf.interpreter(), elf.imported_libraries()};
+}
+
+// Returns the dependencies of each of `paths`. Files that are not cached yet
+// are parsed in parallel.
+std::vector<absl::StatusOr<ElfDependencies>> GetElfDependencies(
+    const std::vector<std::string>& paths) {
+  ElfDependenciesCache& cache = ElfDependenciesCache::Get();
+  std::vector<absl::StatusOr<ElfDependencies>> results(paths.size());
+  // Files that are not cached are kept open, so that the version they are
+  // cached as is the one that was parsed.
+  struct ToParse {
+    size_t index;
+    FileVersion version;
+    file_util::fileops::FDCloser fd;
+  };
+  std::vector<ToParse> to_parse;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    file_util::fileops::FDCloser fd(
+        open(paths[i].c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() == -1) {
+      results[i] = absl::ErrnoToStatus(
+          errno, absl::StrCat("cannot open file: ", paths[i]));
+      continue;
+    }
+    absl::StatusOr<FileVersion> version = FileVersion::Of(fd.get(), paths[i]);
+    if (!version.ok()) {
+      results[i] = version.status();
+    } else if (std::optional<ElfDependencies> cached = cache.Find(*version);
+               cached.has_value()) {
+      results[i] = *std::move(cached);
+    } else {
+      to_parse.push_back({i, *version, std::move(fd)});
+    }
+  }
+  if (to_parse.empty()) {
+    return results;
+  }
+
+  // Parsing a library takes about as long as starting a thread, so each
+  // thread gets a few of them.
+  constexpr size_t kMaxParsingThreads = 8;
+  constexpr size_t kFilesPerThread = 4;
+  const size_t num_threads = std::min(
+      {kMaxParsingThreads,
+       size_t{std::max(std::thread::hardware_concurrency(), 1u)},
+       (to_parse.size() + kFilesPerThread - 1) / kFilesPerThread});
+  std::atomic<size_t> next = 0;
+  auto parse = [&] {
+    for (size_t i; (i = next.fetch_add(1)) < to_parse.size();) {
+      results[to_parse[i].index] = ParseElfDependencies(to_parse[i].fd.get());
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(parse);
+  }
+  parse();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (const ToParse& file : to_parse) {
+    if (results[file.index].ok()) {
+      cache.Insert(file.version, *results[file.index]);
+    }
+  }
+  return results;
+}
+
 }  // namespace
 
 absl::Status Mounts::AddMappingsForBinary(const std::string& path,
                                           absl::string_view ld_library_path) {
-  SAPI_ASSIGN_OR_RETURN(
-      auto elf,
-      ElfFile::ParseFromFile(
-          path, ElfFile::kGetInterpreter | ElfFile::kLoadImportedLibraries));
-  const std::string& interpreter = elf.interpreter();
+  SAPI_ASSIGN_OR_RETURN(ElfDependencies elf,
+                        std::move(GetElfDependencies({path})[0]));
+  const std::string& interpreter = elf.interpreter;
 
   if (interpreter.empty()) {
     SAPI_RAW_VLOG(1, "The file %s is not a dynamic executable", path.c_str());
@@ -415,85 +626,89 @@ absl::Status Mounts::AddMappingsForBinary(const std::string& path,
   constexpr int kMaxImportedLibraries = 100;
 
   absl::flat_hash_set<std::string> imported_libraries;
-  std::vector<std::pair<std::string, int>> to_resolve;
-  {
-    auto imported_libs = elf.imported_libraries();
-    if (imported_libs.size() > kMaxWorkQueueSize) {
-      return absl::FailedPreconditionError(
-          "Exceeded max entries pending resolving limit");
-    }
-    for (const auto& imported_lib : imported_libs) {
-      to_resolve.emplace_back(imported_lib, 1);
-    }
-
-    if (SAPI_VLOG_IS_ON(1)) {
-      SAPI_RAW_VLOG(
-          1, "Resolving dynamic library dependencies of %s using these dirs:",
-          path.c_str());
-      LogContainer(full_search_paths);
-    }
-    if (SAPI_VLOG_IS_ON(2)) {
-      SAPI_RAW_VLOG(2, "Direct dependencies of %s to resolve:", path.c_str());
-      LogContainer(imported_libs);
-    }
+  // Most libraries import the same few others, which only need to be looked
+  // up once.
+  absl::flat_hash_map<std::string, std::string> resolved_paths;
+  std::vector<std::string> to_resolve = std::move(elf.imported_libraries);
+  if (to_resolve.size() > kMaxWorkQueueSize) {
+    return absl::FailedPreconditionError(
+        "Exceeded max entries pending resolving limit");
+  }
+  if (SAPI_VLOG_IS_ON(1)) {
+    SAPI_RAW_VLOG(
+        1, "Resolving dynamic library dependencies of %s using these dirs:",
+        path.c_str());
+    LogContainer(full_search_paths);
+  }
+  if (SAPI_VLOG_IS_ON(2)) {
+    SAPI_RAW_VLOG(2, "Direct dependencies of %s to resolve:", path.c_str());
+    LogContainer(to_resolve);
   }
 
-  // This is DFS with an auxiliary stack
+  // This is BFS, so that the libraries of each level are parsed in parallel.
   int resolved = 0;
   int loaded = 0;
-  while (!to_resolve.empty()) {
-    int depth;
-    std::string lib;
-    std::tie(lib, depth) = to_resolve.back();
-    to_resolve.pop_back();
-    ++resolved;
-    if (resolved > kMaxResolvedEntries) {
-      return absl::FailedPreconditionError(
-          "Exceeded max resolved entries limit");
-    }
+  for (int depth = 1; !to_resolve.empty(); ++depth) {
     if (depth > kMaxResolvingDepth) {
       return absl::FailedPreconditionError(
           "Exceeded max resolving depth limit");
     }
-    std::string resolved_lib = ResolveLibraryPath(lib, full_search_paths);
-    if (resolved_lib.empty()) {
-      SAPI_RAW_LOG(ERROR, "Failed to resolve library: %s", lib.c_str());
-      continue;
-    }
-    if (imported_libraries.contains(resolved_lib)) {
-      continue;
-    }
+    std::vector<std::string> to_load;
+    for (const std::string& lib : to_resolve) {
+      ++resolved;
+      if (resolved > kMaxResolvedEntries) {
+        return absl::FailedPreconditionError(
+            "Exceeded max resolved entries limit");
+      }
+      auto [it, inserted] = resolved_paths.try_emplace(lib);
+      if (inserted) {
+        it->second = ResolveLibraryPath(lib, full_search_paths);
+        if (it->second.empty()) {
+          SAPI_RAW_LOG(ERROR, "Failed to resolve library: %s", lib.c_str());
+        }
+      }
+      const std::string& resolved_lib = it->second;
+      if (resolved_lib.empty() ||
+          !imported_libraries.insert(resolved_lib).second) {
+        continue;
+      }
 
-    SAPI_RAW_VLOG(1, "Resolved library: %s => %s", lib.c_str(),
-                  resolved_lib.c_str());
+      SAPI_RAW_VLOG(1, "Resolved library: %s => %s", lib.c_str(),
+                    resolved_lib.c_str());
 
-    imported_libraries.insert(resolved_lib);
-    if (imported_libraries.size() > kMaxImportedLibraries) {
-      return absl::FailedPreconditionError(
-          "Exceeded max imported libraries limit");
-    }
-    ++loaded;
-    if (loaded > kMaxLoadedEntries) {
-      return absl::FailedPreconditionError("Exceeded max loaded entries limit");
-    }
-    SAPI_ASSIGN_OR_RETURN(
-        auto lib_elf,
-        ElfFile::ParseFromFile(resolved_lib, ElfFile::kLoadImportedLibraries));
-    auto imported_libs = lib_elf.imported_libraries();
-    if (imported_libs.size() > kMaxWorkQueueSize - to_resolve.size()) {
-      return absl::FailedPreconditionError(
-          "Exceeded max entries pending resolving limit");
+      if (imported_libraries.size() > kMaxImportedLibraries) {
+        return absl::FailedPreconditionError(
+            "Exceeded max imported libraries limit");
+      }
+      ++loaded;
+      if (loaded > kMaxLoadedEntries) {
+        return absl::FailedPreconditionError(
+            "Exceeded max loaded entries limit");
+      }
+      to_load.push_back(resolved_lib);
     }
 
-    if (SAPI_VLOG_IS_ON(2)) {
-      SAPI_RAW_VLOG(2,
-                    "Transitive dependencies of %s to resolve (depth = %d): ",
-                    resolved_lib.c_str(), depth + 1);
-      LogContainer(imported_libs);
-    }
+    std::vector<absl::StatusOr<ElfDependencies>> lib_elfs =
+        GetElfDependencies(to_load);
+    to_resolve.clear();
+    for (size_t i = 0; i < to_load.size(); ++i) {
+      SAPI_RETURN_IF_ERROR(lib_elfs[i].status());
+      const std::vector<std::string>& imported_libs =
+          lib_elfs[i]->imported_libraries;
+      if (imported_libs.size() > kMaxWorkQueueSize - to_resolve.size()) {
+        return absl::FailedPreconditionError(
+            "Exceeded max entries pending resolving limit");
+      }
+
+      if (SAPI_VLOG_IS_ON(2)) {
+        SAPI_RAW_VLOG(
+            2, "Transitive dependencies of %s to resolve (depth = %d): ",
+            to_load[i].c_str(), depth + 1);
+        LogContainer(imported_libs);
+      }
 
-    for (const auto& imported_lib : imported_libs) {
-      to_resolve.emplace_back(imported_lib, depth + 1);
+      to_resolve.insert(to_resolve.end(), imported_libs.begin(),
+                        imported_libs.end());
     }
   }
 
@@ -505,15 +720,330 @@ absl::Status Mounts::AddMappingsForBinary(const std::string& path,
   return absl::OkStatus();
 }
 
-absl::Status Mounts::AddTmpfs(absl::string_view inside, size_t sz) {
+absl::Status Mounts::AddTmpfs(absl::string_view inside, size_t sz,
+                              absl::string_view seed) {
   MountTree::Node node;
   auto tmpfs_node = node.mutable_tmpfs_node();
   tmpfs_node->set_tmpfs_options(absl::StrCat("size=", sz));
+  if (!seed.empty()) {
+    if (!sapi::file::IsAbsolutePath(seed)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Tmpfs seed has to be an absolute path: ", seed));
+    }
+    // Would be taken apart as overlay mount options.
+    if (PathContainsNullByte(seed) ||
+        seed.find_first_of(",:\\") != absl::string_view::npos) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Tmpfs seed contains invalid characters: ", seed));
+    }
+    tmpfs_node->set_seed(sapi::file::CleanPath(seed));
+  }
   return Insert(inside, node);
 }
 
 namespace {
 
+// Returns whether all of the (at least two) entries of tree are read-only
+// file mounts.
+bool HasOnlyReadOnlyFiles(const MountTree& tree) {
+  if (tree.entries_size() < 2) {
+    return false;
+  }
+  for (const auto& [name, subtree] : tree.entries()) {
+    if (!subtree.node().has_file_node() ||
+        subtree.node().file_node().writable() || subtree.entries_size() != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the outside directory whose entries are exactly the file mounts of
+// tree, under the same names, or an empty string if there is none.
+std::string FindCoveredDirectory(const MountTree& tree) {
+  std::string dir;
+  for (const auto& [name, subtree] : tree.entries()) {
+    const auto [parent, basename] =
+        sapi::file::SplitPath(subtree.node().file_node().outside());
+    if (basename != name || (!dir.empty() && parent != dir)) {
+      return "";
+    }
+    dir = std::string(parent);
+  }
+  std::vector<std::string> listing;
+  std::string error;
+  if (!file_util::fileops::ListDirectoryEntries(dir, &listing, &error) ||
+      listing.size() != static_cast<size_t>(tree.entries_size())) {
+    return "";
+  }
+  for (const std::string& name : listing) {
+    if (tree.entries().find(name) == tree.entries().end()) {
+      return "";
+    }
+  }
+  return dir;
+}
+
+// Makes target refer to the same contents as source, preferably as a hardlink,
+// otherwise as a reflink on file systems supporting them. Like a bind mount of
+// source, target refers to the file a symlink at source points to.
+bool LinkFile(const std::string& source, const std::string& target) {
+  if (linkat(AT_FDCWD, source.c_str(), AT_FDCWD, target.c_str(),
+             AT_SYMLINK_FOLLOW) == 0) {
+    return true;
+  }
+  if (errno == EEXIST) {
+    // Left by an earlier call with the same staging directory.
+    return internal::IsSameFile(source, target);
+  }
+  file_util::fileops::FDCloser source_fd(
+      open(source.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if (source_fd.get() == -1 || fstat(source_fd.get(), &st) == -1) {
+    return false;
+  }
+  file_util::fileops::FDCloser target_fd(
+      open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+           st.st_mode & 07777));
+  if (target_fd.get() == -1) {
+    return false;
+  }
+  if (ioctl(target_fd.get(), FICLONE, source_fd.get()) == -1) {
+    unlink(target.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Links all file mounts of tree into dir. Returns false if any of them cannot
+// be linked.
+bool StageFiles(const MountTree& tree, const std::string& dir) {
+  if (!file_util::fileops::CreateDirectoryRecursively(dir, 0755)) {
+    return false;
+  }
+  for (const auto& [name, subtree] : tree.entries()) {
+    if (!LinkFile(subtree.node().file_node().outside(),
+                  sapi::file::JoinPath(dir, name))) {
+      SAPI_RAW_VLOG(1, "Cannot stage %s in %s",
+                    subtree.node().file_node().outside().c_str(),
+                    dir.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns a name for the set of file mounts of tree. Each set is staged in a
+// directory of its own, so that policies sharing a staging directory don't see
+// each other's files.
+std::string GetStagingName(const MountTree& tree) {
+  std::vector<std::pair<absl::string_view, absl::string_view>> files;
+  for (const auto& [name, subtree] : tree.entries()) {
+    files.emplace_back(name, subtree.node().file_node().outside());
+  }
+  std::sort(files.begin(), files.end());
+  // FNV-1a, which is stable across processes reusing the staging directory.
+  uint64_t hash = 0xcbf29ce484222325;
+  auto add = [&hash](absl::string_view data) {
+    for (char c : data) {
+      hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3;
+    }
+    // Separates the strings, which cannot contain null bytes.
+    hash *= 0x100000001b3;
+  };
+  for (const auto& [name, outside] : files) {
+    add(name);
+    add(outside);
+  }
+  return absl::StrCat(absl::Hex(hash, absl::kZeroPad16));
+}
+
+int CoalesceFileMounts(MountTree& tree, const std::string& path,
+                       absl::string_view staging_dir) {
+  // Mounted nodes are not created by the mount tree, so staging their contents
+  // would hide entries the sandboxee might expect.
+  if (tree.has_node() && !tree.node().has_root_node()) {
+    return 0;
+  }
+  int saved = 0;
+  for (auto& [name, subtree] : *tree.mutable_entries()) {
+    saved += CoalesceFileMounts(subtree, sapi::file::JoinPath(path, name),
+                                staging_dir);
+  }
+  if (tree.has_node() || !HasOnlyReadOnlyFiles(tree)) {
+    return saved;
+  }
+  std::string outside = FindCoveredDirectory(tree);
+  if (outside.empty() && !staging_dir.empty()) {
+    std::string staged =
+        sapi::file::JoinPath(staging_dir, GetStagingName(tree), path);
+    if (StageFiles(tree, staged)) {
+      outside = std::move(staged);
+    }
+  }
+  if (outside.empty()) {
+    return saved;
+  }
+  SAPI_RAW_VLOG(1, "Coalescing %d file mounts in %s into a mount of %s",
+                tree.entries_size(), path.c_str(), outside.c_str());
+  saved += tree.entries_size() - 1;
+  tree.clear_entries();
+  MountTree::DirNode* dir_node = tree.mutable_node()->mutable_dir_node();
+  dir_node->set_outside(outside);
+  dir_node->set_writable(false);
+  return saved;
+}
+
+}  // namespace
+
+int Mounts::CoalesceFileMounts(absl::string_view staging_dir) {
+  // With a writable root, the sandboxee may create files next to the mounted
+  // ones. The directories of a prebuilt root have contents of their own.
+  if (!IsRootReadOnly() || HasPrebuiltRoot()) {
+    return 0;
+  }
+  return sandbox2::CoalesceFileMounts(mount_tree_, "/", staging_dir);
+}
+
+namespace {
+
+absl::Status MaterializeFile(const std::string& source,
+                             const std::string& target) {
+  if (LinkFile(source, target)) {
+    return absl::OkStatus();
+  }
+  struct stat st;
+  if (stat(source.c_str(), &st) == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("stat() of ", source));
+  }
+  if (!file_util::fileops::CopyFile(source, target, st.st_mode & 07777)) {
+    return absl::InternalError(
+        absl::StrCat("Could not copy ", source, " to ", target));
+  }
+  return absl::OkStatus();
+}
+
+// Copies the directory tree at source to target, without following symlinks.
+absl::Status MaterializeDirectory(const std::string& source,
+                                  const std::string& target) {
+  struct stat st;
+  if (lstat(source.c_str(), &st) == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("lstat() of ", source));
+  }
+  if (S_ISREG(st.st_mode)) {
+    return MaterializeFile(source, target);
+  }
+  if (S_ISLNK(st.st_mode)) {
+    if (symlink(file_util::fileops::ReadLink(source).c_str(),
+                target.c_str()) == -1) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("symlink() at ", target));
+    }
+    return absl::OkStatus();
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    SAPI_RAW_VLOG(1, "Skipping special file %s", source.c_str());
+    return absl::OkStatus();
+  }
+  // Writable until all entries are in place.
+  if (mkdir(target.c_str(), 0700) == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("mkdir() of ", target));
+  }
+  std::vector<std::string> entries;
+  std::string error;
+  if (!file_util::fileops::ListDirectoryEntries(source, &entries, &error)) {
+    return absl::InternalError(error);
+  }
+  for (const std::string& entry : entries) {
+    SAPI_RETURN_IF_ERROR(
+        MaterializeDirectory(sapi::file::JoinPath(source, entry),
+                             sapi::file::JoinPath(target, entry)));
+  }
+  if (chmod(target.c_str(), st.st_mode & 07777) == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("chmod() of ", target));
+  }
+  return absl::OkStatus();
+}
+
+// Creates an empty file or directory to mount node on.
+absl::Status CreateMountPoint(const MountTree::Node& node,
+                              const std::string& path) {
+  if (node.has_file_node()) {
+    file_util::fileops::FDCloser fd(
+        open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644));
+    if (fd.get() == -1) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("open() of ", path));
+    }
+    return absl::OkStatus();
+  }
+  if (!file_util::fileops::CreateDirectoryRecursively(path, 0755)) {
+    return absl::InternalError(absl::StrCat("Could not create ", path));
+  }
+  return absl::OkStatus();
+}
+
+// Materializes tree at path, adding what cannot be materialized to remaining.
+absl::Status MaterializeTree(const MountTree& tree, const std::string& path,
+                             MountTree& remaining) {
+  const MountTree::Node& node = tree.node();
+  switch (node.node_case()) {
+    case MountTree::Node::kFileNode:
+    case MountTree::Node::kDirNode: {
+      // Mounts on top of a bind mount replace what is there.
+      if (!file_util::fileops::DeleteRecursively(path)) {
+        return absl::InternalError(absl::StrCat("Could not replace ", path));
+      }
+      const bool writable = node.has_file_node() ? node.file_node().writable()
+                                                 : node.dir_node().writable();
+      if (!writable) {
+        SAPI_RETURN_IF_ERROR(MaterializeDirectory(
+            std::string(GetOutsidePath(node)), path));
+        break;
+      }
+      SAPI_RETURN_IF_ERROR(CreateMountPoint(node, path));
+      // Everything below is mounted on top of it, and thus remains as well.
+      remaining = tree;
+      return absl::OkStatus();
+    }
+    case MountTree::Node::kTmpfsNode:
+      SAPI_RETURN_IF_ERROR(CreateMountPoint(node, path));
+      remaining = tree;
+      return absl::OkStatus();
+    case MountTree::Node::kRootNode:
+    case MountTree::Node::NODE_NOT_SET:
+      if (!file_util::fileops::CreateDirectoryRecursively(path, 0755)) {
+        return absl::InternalError(absl::StrCat("Could not create ", path));
+      }
+      break;
+  }
+  for (const auto& [name, subtree] : tree.entries()) {
+    MountTree& remaining_subtree = (*remaining.mutable_entries())[name];
+    SAPI_RETURN_IF_ERROR(MaterializeTree(
+        subtree, sapi::file::JoinPath(path, name), remaining_subtree));
+    if (!remaining_subtree.has_node() &&
+        remaining_subtree.entries().empty()) {
+      remaining.mutable_entries()->erase(name);
+    }
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<Mounts> Mounts::Materialize(const std::string& dir) const {
+  if (HasPrebuiltRoot()) {
+    return absl::FailedPreconditionError(
+        "Cannot materialize mounts with a prebuilt root");
+  }
+  MountTree remaining;
+  SAPI_RETURN_IF_ERROR(MaterializeTree(mount_tree_, dir, remaining));
+  *remaining.mutable_node() = mount_tree_.node();
+  Mounts mounts(std::move(remaining));
+  SAPI_RETURN_IF_ERROR(mounts.SetPrebuiltRoot(dir));
+  return mounts;
+}
+
+namespace {
+
 uint64_t GetMountFlagsFor(const std::string& path) {
   struct statvfs vfs;
   if (TEMP_FAILURE_RETRY(statvfs(path.c_str(), &vfs)) == -1) {
@@ -580,9 +1110,76 @@ std::string MountFlagsToString(uint64_t flags) {
   return absl::StrJoin(flags_list, "|");
 }
 
+// Whether open_tree(), mount_setattr() and move_mount() are available.
+std::atomic<bool> g_has_new_mount_api = true;
+
+// Bind mounts using open_tree(), mount_setattr() and move_mount(), which sets
+// the flags of the whole tree at once instead of remounting it. Returns false
+// if that failed before anything was mounted, e.g. because the kernel does not
+// support it, so that the caller falls back to mount() and reports errors.
+bool BindMountWithNewApi(const std::string& source, const std::string& target,
+                         uint64_t propagation, bool is_ro) {
+  constexpr unsigned int kOpenTreeClone = 1;
+  constexpr unsigned int kMoveMountFEmptyPath = 0x4;
+  constexpr uint64_t kMountAttrRdonly = 0x1;
+  constexpr uint64_t kMountAttrNosuid = 0x2;
+  // Same layout as struct mount_attr.
+  struct MountAttr {
+    uint64_t attr_set;
+    uint64_t attr_clr;
+    uint64_t propagation;
+    uint64_t userns_fd;
+  };
+
+  if (!g_has_new_mount_api) {
+    return false;
+  }
+  file_util::fileops::FDCloser tree_fd(
+      syscall(__NR_open_tree, AT_FDCWD, source.c_str(),
+              kOpenTreeClone | O_CLOEXEC | AT_RECURSIVE));
+  if (tree_fd.get() == -1) {
+    if (errno == ENOSYS) {
+      g_has_new_mount_api = false;
+    }
+    return false;
+  }
+  if (!is_ro) {
+    struct statvfs vfs;
+    if (fstatvfs(tree_fd.get(), &vfs) == -1 || (vfs.f_flag & ST_RDONLY)) {
+      return false;
+    }
+  }
+  MountAttr attr = {
+      .attr_set = kMountAttrNosuid | (is_ro ? kMountAttrRdonly : 0),
+      .propagation = propagation,
+  };
+  if (syscall(__NR_mount_setattr, tree_fd.get(), "",
+              AT_EMPTY_PATH | AT_RECURSIVE, &attr, sizeof(attr)) == -1) {
+    // Only supported since Linux 5.12, unlike open_tree() and move_mount().
+    if (errno == ENOSYS) {
+      g_has_new_mount_api = false;
+    }
+    return false;
+  }
+  SAPI_RAW_PCHECK(syscall(__NR_move_mount, tree_fd.get(), "", AT_FDCWD,
+                          target.c_str(), kMoveMountFEmptyPath) != -1,
+                  "moving mount of %s to %s failed", source.c_str(),
+                  target.c_str());
+  return true;
+}
+
 void MountWithDefaults(const std::string& source, const std::string& target,
                        const char* fs_type, uint64_t extra_flags,
                        const char* option_str, bool is_ro) {
+  if ((extra_flags & MS_BIND) != 0 &&
+      BindMountWithNewApi(
+          source, target,
+          extra_flags & (MS_SHARED | MS_PRIVATE | MS_SLAVE | MS_UNBINDABLE),
+          is_ro)) {
+    SAPI_RAW_VLOG(1, R"(bind mounted "%s" to "%s" (%s))", source.c_str(),
+                  target.c_str(), is_ro ? "read-only" : "read-write");
+    return;
+  }
   uint64_t flags = MS_REC | MS_NOSUID | extra_flags;
   if (is_ro) {
     flags |= MS_RDONLY;
@@ -630,6 +1227,43 @@ void MountWithDefaults(const std::string& source, const std::string& target,
   }
 }
 
+// Puts the contents of seed into the tmpfs mounted at path. The upper and work
+// directories of the overlay are on the tmpfs, hidden below the overlay.
+void SeedTmpfs(const std::string& seed, const std::string& path) {
+  const std::string upper = sapi::file::JoinPath(path, ".upper");
+  const std::string work = sapi::file::JoinPath(path, ".work");
+  // The upper directory becomes the root of the overlay, so it gets the mode
+  // of a tmpfs root.
+  SAPI_RAW_PCHECK(mkdir(upper.c_str(), 0700) == 0 &&
+                      chmod(upper.c_str(), 01777) == 0,
+                  "creating %s", upper);
+  SAPI_RAW_PCHECK(mkdir(work.c_str(), 0700) == 0, "creating %s", work);
+  const std::string options =
+      absl::StrCat("lowerdir=", seed, ",upperdir=", upper, ",workdir=", work);
+  if (mount("overlay", path.c_str(), "overlay", MS_NOSUID, options.c_str()) ==
+      0) {
+    SAPI_RAW_VLOG(1, R"(overlaid tmpfs "%s" on "%s")", path.c_str(),
+                  seed.c_str());
+    return;
+  }
+  SAPI_RAW_PLOG(WARNING, "overlay mount of %s on %s failed, copying it", seed,
+                path);
+  SAPI_RAW_CHECK(file_util::fileops::DeleteRecursively(upper) &&
+                     file_util::fileops::DeleteRecursively(work),
+                 "removing overlay directories");
+  std::vector<std::string> entries;
+  std::string error;
+  SAPI_RAW_CHECK(
+      file_util::fileops::ListDirectoryEntries(seed, &entries, &error),
+      error.c_str());
+  for (const std::string& entry : entries) {
+    absl::Status status =
+        MaterializeDirectory(sapi::file::JoinPath(seed, entry),
+                             sapi::file::JoinPath(path, entry));
+    SAPI_RAW_CHECK(status.ok(), std::string(status.message()).c_str());
+  }
+}
+
 // Traverses the MountTree to create all required files and perform the mounts.
 void CreateMounts(const MountTree& tree, const std::string& path,
                   bool create_backing_files) {
@@ -673,6 +1307,9 @@ void CreateMounts(const MountTree& tree, const std::string& path,
       auto node = tree.node().tmpfs_node();
       MountWithDefaults("", path, "tmpfs", 0, node.tmpfs_options().c_str(),
                         /* is_ro */ false);
+      if (!node.seed().empty()) {
+        SeedTmpfs(node.seed(), path);
+      }
       break;
     }
     case MountTree::Node::kFileNode: {
@@ -700,17 +1337,94 @@ void CreateMounts(const MountTree& tree, const std::string& path,
 }  // namespace
 
 void Mounts::CreateMounts(const std::string& root_path) const {
+  if (HasPrebuiltRoot()) {
+    // Made read-only right away, as the locked flags of the bind mount are
+    // only known here. It is shared by all sandboxees using it, so it is never
+    // writable.
+    MountWithDefaults(mount_tree_.node().root_node().outside(), root_path, "",
+                      MS_BIND, nullptr, /*is_ro=*/true);
+    // The mount points are part of the prebuilt root.
+    sandbox2::CreateMounts(mount_tree_, root_path, false);
+    return;
+  }
   sandbox2::CreateMounts(mount_tree_, root_path, true);
 }
 
 namespace {
 
+// Starts reading the regular file at path into the page cache. Returns its
+// size, or 0 if it is not a regular file.
+size_t PrewarmFile(const std::string& path) {
+  file_util::fileops::FDCloser fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if (fd.get() == -1 || fstat(fd.get(), &st) == -1 || !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+  // The readahead keeps going after the fd is closed.
+  if (posix_fadvise(fd.get(), 0, 0, POSIX_FADV_WILLNEED) != 0) {
+    return 0;
+  }
+  return st.st_size;
+}
+
+void PrewarmPath(const std::string& path, size_t max_bytes, size_t* bytes) {
+  if (*bytes >= max_bytes) {
+    return;
+  }
+  struct stat st;
+  if (stat(path.c_str(), &st) == -1) {
+    return;
+  }
+  if (S_ISREG(st.st_mode)) {
+    *bytes += PrewarmFile(path);
+    return;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    return;
+  }
+  std::vector<std::string> entries;
+  std::string error;
+  if (!file_util::fileops::ListDirectoryEntries(path, &entries, &error)) {
+    SAPI_RAW_VLOG(1, "Not prewarming %s: %s", path.c_str(), error.c_str());
+    return;
+  }
+  for (const std::string& entry : entries) {
+    // Only follow symlinks to files, a link to a parent would never end.
+    std::string entry_path = sapi::file::JoinPath(path, entry);
+    struct stat entry_st;
+    if (lstat(entry_path.c_str(), &entry_st) == -1 ||
+        (S_ISLNK(entry_st.st_mode) &&
+         (stat(entry_path.c_str(), &entry_st) == -1 ||
+          !S_ISREG(entry_st.st_mode)))) {
+      continue;
+    }
+    PrewarmPath(entry_path, max_bytes, bytes);
+  }
+}
+
+void PrewarmImpl(const MountTree& tree, size_t max_bytes, size_t* bytes) {
+  const MountTree::Node& node = tree.node();
+  if (node.has_file_node()) {
+    PrewarmPath(node.file_node().outside(), max_bytes, bytes);
+  } else if (node.has_dir_node()) {
+    PrewarmPath(node.dir_node().outside(), max_bytes, bytes);
+  }
+  for (const auto& [name, subtree] : tree.entries()) {
+    PrewarmImpl(subtree, max_bytes, bytes);
+  }
+}
+
 void RecursivelyListMountsImpl(const MountTree& tree,
                                const std::string& tree_path,
                                std::vector<std::string>* outside_entries,
                                std::vector<std::string>* inside_entries) {
   const MountTree::Node& node = tree.node();
-  if (node.has_dir_node()) {
+  if (node.has_root_node() && !node.root_node().outside().empty()) {
+    const char* rw_str = node.root_node().writable() ? "W " : "R ";
+    inside_entries->emplace_back(absl::StrCat(rw_str, "/"));
+    outside_entries->emplace_back(
+        absl::StrCat(node.root_node().outside(), "/"));
+  } else if (node.has_dir_node()) {
     const char* rw_str = node.dir_node().writable() ? "W " : "R ";
     inside_entries->emplace_back(absl::StrCat(rw_str, tree_path, "/"));
     outside_entries->emplace_back(absl::StrCat(node.dir_node().outside(), "/"));
@@ -722,6 +1436,10 @@ void RecursivelyListMountsImpl(const MountTree& tree,
     inside_entries->emplace_back(tree_path);
     outside_entries->emplace_back(
         absl::StrCat("tmpfs: ", node.tmpfs_node().tmpfs_options()));
+    if (!node.tmpfs_node().seed().empty()) {
+      absl::StrAppend(&outside_entries->back(), " seed: ",
+                      node.tmpfs_node().seed(), "/");
+    }
   }
 
   for (const auto& subentry : tree.entries()) {
@@ -733,6 +1451,12 @@ void RecursivelyListMountsImpl(const MountTree& tree,
 
 }  // namespace
 
+size_t Mounts::Prewarm(size_t max_bytes) const {
+  size_t bytes = 0;
+  PrewarmImpl(mount_tree_, max_bytes, &bytes);
+  return bytes;
+}
+
 void Mounts::RecursivelyListMounts(std::vector<std::string>* outside_entries,
                                    std::vector<std::string>* inside_entries) {
   RecursivelyListMountsImpl(GetMountTree(), "", outside_entries,
@@ -58,10 +58,30 @@ class Mounts {
   absl::Status AddMappingsForBinary(const std::string& path,
                                     absl::string_view ld_library_path = {});
 
-  absl::Status AddTmpfs(absl::string_view inside, size_t sz);
+  // Adds a tmpfs of at most sz bytes. With a seed directory, the tmpfs starts
+  // out with its contents, which are not copied but overlaid: writes only go
+  // to the tmpfs. The seed must not change while sandboxees use it. Falls back
+  // to copying the seed into the tmpfs if the kernel cannot mount overlays in
+  // user namespaces (before Linux 5.11).
+  absl::Status AddTmpfs(absl::string_view inside, size_t sz,
+                        absl::string_view seed = {});
 
   absl::Status Remove(absl::string_view path);
 
+  // Replaces the read-only file mounts in a directory by a single read-only
+  // mount of a directory holding just these files, which makes creating the
+  // mounts cheaper. If the files are all of the entries of one outside
+  // directory, under the same names, that directory is mounted instead. Files
+  // added to it later then become visible inside as well. Otherwise, if
+  // staging_dir is not empty, the files are hardlinked (or reflinked) into
+  // staging_dir/<name of the file set>/<inside directory>, which is mounted
+  // instead. Files that cannot be linked stay separate mounts. The caller owns
+  // staging_dir, which may be shared by policies and must outlive all
+  // sandboxes using the mounts.
+  // Only directories created by the mount tree itself are considered, and only
+  // if the root is read-only. Returns the number of mounts saved.
+  int CoalesceFileMounts(absl::string_view staging_dir = {});
+
   void CreateMounts(const std::string& root_path) const;
 
   MountTree GetMountTree() const { return mount_tree_; }
@@ -75,6 +95,36 @@ class Mounts {
            !mount_tree_.node().root_node().writable();
   }
 
+  // Uses a prebuilt tree as the root instead of a tmpfs holding all the mount
+  // points, e.g. a mounted EROFS or squashfs image created with Materialize()
+  // and build_root_image. It is bind mounted as a whole, so that setting up the
+  // root takes the same time regardless of the number of files in it.
+  // Entries added to the mounts are still mounted on top of it, their mount
+  // points must exist in the prebuilt root. The prebuilt root is shared by all
+  // sandboxees using it and always mounted read-only, even with
+  // SetRootWritable().
+  absl::Status SetPrebuiltRoot(absl::string_view outside);
+
+  bool HasPrebuiltRoot() const {
+    return mount_tree_.has_node() && mount_tree_.node().has_root_node() &&
+           !mount_tree_.node().root_node().outside().empty();
+  }
+
+  // Copies the read-only file and directory mounts to dir, hardlinking files
+  // where possible, so that dir can serve as a prebuilt root or be packed into
+  // an image. Writable bind mounts and tmpfs mounts cannot be part of such a
+  // tree, only their mount points are created. Returns the mounts that remain
+  // to be done, using dir as the prebuilt root.
+  absl::StatusOr<Mounts> Materialize(const std::string& dir) const;
+
+  // Asks the kernel to read the outside files of all file and directory
+  // mounts into the page cache, so that the first sandboxes using them don't
+  // wait for the disk. Directories are walked recursively. Only the reads are
+  // started (posix_fadvise(POSIX_FADV_WILLNEED)), they complete in the
+  // background. Stops once max_bytes have been requested. Returns the number
+  // of bytes requested.
+  size_t Prewarm(size_t max_bytes) const;
+
   // Lists the outside and inside entries of the input tree in the output
   // parameters, in an ls-like manner. Each entry is traversed in the
   // depth-first order. However, the entries on the same level of hierarchy are
@@ -14,15 +14,22 @@
 
 #include "sandboxed_api/sandbox2/mounts.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
 #include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_matchers.h"
 #include "sandboxed_api/util/temp_file.h"
@@ -37,12 +44,23 @@ using ::sapi::GetTestSourcePath;
 using ::sapi::GetTestTempPath;
 using ::sapi::IsOk;
 using ::sapi::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::EndsWith;
 using ::testing::Eq;
+using ::testing::Lt;
+using ::testing::Ne;
+using ::testing::StartsWith;
 using ::testing::StrEq;
 using ::testing::UnorderedElementsAreArray;
 
 constexpr size_t kTmpfsSize = 1024;
 
+void CreateEmptyFile(const std::string& path) {
+  int fd = open(path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+  ASSERT_THAT(fd, Ne(-1));
+  ASSERT_THAT(close(fd), Eq(0));
+}
+
 TEST(MountTreeTest, TestInvalidFilenames) {
   Mounts mounts;
 
@@ -197,6 +215,22 @@ TEST(MountTreeTest, TestMinimalDynamicBinary) {
   EXPECT_THAT(mounts.AddFile("/lib/x86_64-linux-gnu/libc.so.6"), IsOk());
 }
 
+TEST(MountTreeTest, TestDynamicBinaryMappingsAreStable) {
+  const std::string path =
+      GetTestSourcePath("sandbox2/testcases/minimal_dynamic");
+  // The second call uses the cached dependencies.
+  Mounts first;
+  Mounts second;
+  ASSERT_THAT(first.AddMappingsForBinary(path), IsOk());
+  ASSERT_THAT(second.AddMappingsForBinary(path), IsOk());
+  std::vector<std::string> first_outside, first_inside;
+  std::vector<std::string> second_outside, second_inside;
+  first.RecursivelyListMounts(&first_outside, &first_inside);
+  second.RecursivelyListMounts(&second_outside, &second_inside);
+  EXPECT_THAT(second_inside, UnorderedElementsAreArray(first_inside));
+  EXPECT_THAT(second_outside, UnorderedElementsAreArray(first_outside));
+}
+
 TEST(MountTreeTest, TestList) {
   struct TestCase {
     const char* path;
@@ -372,5 +406,224 @@ TEST(MountsResolvePathTest, Dirs) {
               StatusIs(absl::StatusCode::kNotFound));
 }
 
+TEST(MountTreeTest, TestCoalesceCoveredDirectory) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "testdir_")));
+  CreateEmptyFile(file::JoinPath(dir, "a"));
+  CreateEmptyFile(file::JoinPath(dir, "b"));
+
+  Mounts mounts;
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "a"), "/x/a"), IsOk());
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "b"), "/x/b"), IsOk());
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "b"), "/y/b"), IsOk());
+  EXPECT_THAT(mounts.CoalesceFileMounts(), Eq(1));
+
+  std::vector<std::string> inside_entries;
+  std::vector<std::string> outside_entries;
+  mounts.RecursivelyListMounts(&outside_entries, &inside_entries);
+  EXPECT_THAT(inside_entries, UnorderedElementsAreArray({"R /x/", "R /y/b"}));
+  EXPECT_THAT(outside_entries,
+              UnorderedElementsAreArray(
+                  {absl::StrCat(dir, "/"), file::JoinPath(dir, "b")}));
+}
+
+TEST(MountTreeTest, TestCoalesceStagesPartialDirectory) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "testdir_")));
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string staging_dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "staging_")));
+  for (const char* name : {"a", "b", "c"}) {
+    CreateEmptyFile(file::JoinPath(dir, name));
+  }
+
+  Mounts mounts;
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "a"), "/x/a"), IsOk());
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "b"), "/x/b"), IsOk());
+  // Without a staging directory, a partially covered directory stays as is.
+  EXPECT_THAT(Mounts(mounts).CoalesceFileMounts(), Eq(0));
+  EXPECT_THAT(mounts.CoalesceFileMounts(staging_dir), Eq(1));
+
+  std::vector<std::string> inside_entries;
+  std::vector<std::string> outside_entries;
+  mounts.RecursivelyListMounts(&outside_entries, &inside_entries);
+  EXPECT_THAT(inside_entries, ElementsAre("R /x/"));
+  ASSERT_THAT(outside_entries, ElementsAre(StartsWith(staging_dir)));
+  const std::string staged(absl::StripSuffix(outside_entries[0], "/"));
+  EXPECT_THAT(staged, EndsWith("/x"));
+  EXPECT_TRUE(internal::IsSameFile(file::JoinPath(dir, "a"),
+                                   file::JoinPath(staged, "a")));
+  EXPECT_TRUE(internal::IsSameFile(file::JoinPath(dir, "b"),
+                                   file::JoinPath(staged, "b")));
+  EXPECT_THAT(access(file::JoinPath(staged, "c").c_str(), F_OK), Eq(-1));
+}
+
+// Returns the outside directory that the file mounts of mounts were staged in.
+std::string GetStagedDirectory(Mounts& mounts, absl::string_view staging_dir) {
+  EXPECT_THAT(mounts.CoalesceFileMounts(staging_dir), Eq(1));
+  std::vector<std::string> inside_entries;
+  std::vector<std::string> outside_entries;
+  mounts.RecursivelyListMounts(&outside_entries, &inside_entries);
+  if (outside_entries.size() != 1) {
+    ADD_FAILURE() << "Expected a single mount";
+    return "";
+  }
+  return std::string(absl::StripSuffix(outside_entries[0], "/"));
+}
+
+TEST(MountTreeTest, TestCoalesceStagesFileSetsSeparately) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "testdir_")));
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string staging_dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "staging_")));
+  for (const char* name : {"a", "b", "c", "d"}) {
+    CreateEmptyFile(file::JoinPath(dir, name));
+  }
+
+  // Two policies sharing the staging directory, with different files in /x.
+  Mounts first;
+  ASSERT_THAT(first.AddFileAt(file::JoinPath(dir, "a"), "/x/a"), IsOk());
+  ASSERT_THAT(first.AddFileAt(file::JoinPath(dir, "b"), "/x/b"), IsOk());
+  Mounts second;
+  ASSERT_THAT(second.AddFileAt(file::JoinPath(dir, "a"), "/x/a"), IsOk());
+  ASSERT_THAT(second.AddFileAt(file::JoinPath(dir, "c"), "/x/c"), IsOk());
+  Mounts first_again(first);
+
+  const std::string first_staged = GetStagedDirectory(first, staging_dir);
+  const std::string second_staged = GetStagedDirectory(second, staging_dir);
+  EXPECT_THAT(first_staged, Ne(second_staged));
+  EXPECT_THAT(access(file::JoinPath(second_staged, "b").c_str(), F_OK),
+              Eq(-1));
+  EXPECT_THAT(access(file::JoinPath(first_staged, "c").c_str(), F_OK), Eq(-1));
+  // The same set of files reuses its staged directory.
+  EXPECT_THAT(GetStagedDirectory(first_again, staging_dir), Eq(first_staged));
+}
+
+TEST(MountTreeTest, TestCoalesceStagesSymlinkTargets) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "testdir_")));
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string staging_dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "staging_")));
+  const std::string target = file::JoinPath(dir, "target");
+  const std::string link = file::JoinPath(dir, "link");
+  CreateEmptyFile(target);
+  CreateEmptyFile(file::JoinPath(dir, "b"));
+  ASSERT_THAT(symlink(target.c_str(), link.c_str()), Eq(0));
+
+  Mounts mounts;
+  ASSERT_THAT(mounts.AddFileAt(link, "/x/a"), IsOk());
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "b"), "/x/b"), IsOk());
+  const std::string staged = GetStagedDirectory(mounts, staging_dir);
+
+  // Staged like a bind mount of the symlink, i.e. as the file it points to.
+  struct stat st;
+  ASSERT_THAT(lstat(file::JoinPath(staged, "a").c_str(), &st), Eq(0));
+  EXPECT_TRUE(S_ISREG(st.st_mode));
+  EXPECT_TRUE(internal::IsSameFile(target, file::JoinPath(staged, "a")));
+}
+
+TEST(MountTreeTest, TestCoalesceSkipsWritableRoot) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "testdir_")));
+  CreateEmptyFile(file::JoinPath(dir, "a"));
+  CreateEmptyFile(file::JoinPath(dir, "b"));
+
+  Mounts mounts;
+  mounts.SetRootWritable();
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "a"), "/x/a"), IsOk());
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "b"), "/x/b"), IsOk());
+  EXPECT_THAT(mounts.CoalesceFileMounts(), Eq(0));
+}
+
+TEST(MountTreeTest, TestPrewarm) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "testdir_")));
+  ASSERT_THAT(mkdir(file::JoinPath(dir, "sub").c_str(), 0700), Eq(0));
+  for (const auto& [name, size] :
+       {std::pair{"a", 100}, std::pair{"sub/b", 20}, std::pair{"c", 3}}) {
+    std::string path = file::JoinPath(dir, name);
+    CreateEmptyFile(path);
+    ASSERT_THAT(truncate(path.c_str(), size), Eq(0));
+  }
+  // A symlink to a directory is not followed.
+  ASSERT_THAT(symlink(".", file::JoinPath(dir, "self").c_str()), Eq(0));
+
+  Mounts mounts;
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "c"), "/c"), IsOk());
+  ASSERT_THAT(mounts.AddDirectoryAt(dir, "/d"), IsOk());
+  const size_t total = 3 + 100 + 20 + 3;
+  EXPECT_THAT(mounts.Prewarm(1 << 20), Eq(total));
+  // Stops after the first file, whichever that is.
+  EXPECT_THAT(mounts.Prewarm(1), Lt(total));
+}
+
+TEST(MountTreeTest, TestMaterialize) {
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::string dir,
+      CreateTempDir(file::JoinPath(GetTestTempPath(), "testdir_")));
+  ASSERT_THAT(mkdir(file::JoinPath(dir, "d").c_str(), 0755), Eq(0));
+  CreateEmptyFile(file::JoinPath(dir, "a"));
+  CreateEmptyFile(file::JoinPath(dir, "d", "f"));
+  ASSERT_THAT(symlink("f", file::JoinPath(dir, "d", "l").c_str()), Eq(0));
+  const std::string root = file::JoinPath(dir, "root");
+
+  Mounts mounts;
+  ASSERT_THAT(mounts.AddFileAt(file::JoinPath(dir, "a"), "/x/a"), IsOk());
+  ASSERT_THAT(mounts.AddDirectoryAt(file::JoinPath(dir, "d"), "/y"), IsOk());
+  ASSERT_THAT(mounts.AddDirectoryAt(dir, "/w", /*is_ro=*/false), IsOk());
+  ASSERT_THAT(mounts.AddTmpfs("/tmp", kTmpfsSize), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(Mounts remaining, mounts.Materialize(root));
+
+  EXPECT_TRUE(internal::IsSameFile(file::JoinPath(dir, "a"),
+                                   file::JoinPath(root, "x", "a")));
+  EXPECT_TRUE(internal::IsSameFile(file::JoinPath(dir, "d", "f"),
+                                   file::JoinPath(root, "y", "f")));
+  EXPECT_THAT(sapi::file_util::fileops::ReadLink(
+                  file::JoinPath(root, "y", "l")),
+              StrEq("f"));
+  EXPECT_THAT(access(file::JoinPath(root, "w").c_str(), F_OK), Eq(0));
+  EXPECT_THAT(access(file::JoinPath(root, "tmp").c_str(), F_OK), Eq(0));
+
+  EXPECT_TRUE(remaining.HasPrebuiltRoot());
+  std::vector<std::string> inside_entries;
+  std::vector<std::string> outside_entries;
+  remaining.RecursivelyListMounts(&outside_entries, &inside_entries);
+  EXPECT_THAT(inside_entries,
+              UnorderedElementsAreArray({"R /", "W /w/", "/tmp"}));
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string resolved,
+                            remaining.ResolvePath("/x/a"));
+  EXPECT_THAT(resolved, StrEq(file::JoinPath(root, "x", "a")));
+}
+
+TEST(MountTreeTest, TestTmpfsSeed) {
+  Mounts mounts;
+  EXPECT_THAT(mounts.AddTmpfs("/a", kTmpfsSize, "seed"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(mounts.AddTmpfs("/a", kTmpfsSize, "/seed,upperdir=/"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  ASSERT_THAT(mounts.AddTmpfs("/a", kTmpfsSize, "/seed/"), IsOk());
+  std::vector<std::string> outside_entries;
+  std::vector<std::string> inside_entries;
+  mounts.RecursivelyListMounts(&outside_entries, &inside_entries);
+  EXPECT_THAT(outside_entries,
+              ElementsAre(absl::StrCat("tmpfs: size=", kTmpfsSize,
+                                       " seed: /seed/")));
+}
+
+TEST(MountTreeTest, TestInvalidPrebuiltRoot) {
+  Mounts mounts;
+  EXPECT_THAT(mounts.SetPrebuiltRoot("root"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_FALSE(mounts.HasPrebuiltRoot());
+}
+
 }  // namespace
 }  // namespace sandbox2
@@ -62,17 +62,21 @@ int MountFallbackToReadOnly(const char* source, const char* target,
 }
 
 void PrepareChroot(const Mounts& mounts) {
-  // Create a tmpfs mount for the new rootfs.
   SAPI_RAW_CHECK(
       file_util::fileops::CreateDirectoryRecursively(kSandbox2ChrootPath, 0700),
       "could not create directory for rootfs");
-  SAPI_RAW_PCHECK(mount("none", kSandbox2ChrootPath, "tmpfs", 0, nullptr) == 0,
-                  "mounting rootfs failed");
+  // Create a tmpfs mount for the new rootfs, unless a prebuilt one is mounted
+  // by CreateMounts().
+  if (!mounts.HasPrebuiltRoot()) {
+    SAPI_RAW_PCHECK(
+        mount("none", kSandbox2ChrootPath, "tmpfs", 0, nullptr) == 0,
+        "mounting rootfs failed");
+  }
 
   // Walk the tree and perform all the mount operations.
   mounts.CreateMounts(kSandbox2ChrootPath);
 
-  if (mounts.IsRootReadOnly()) {
+  if (mounts.IsRootReadOnly() && !mounts.HasPrebuiltRoot()) {
     // Remount the chroot read-only
     SAPI_RAW_PCHECK(mount(kSandbox2ChrootPath, kSandbox2ChrootPath, "",
                           MS_BIND | MS_REMOUNT | MS_RDONLY, nullptr) == 0,
@@ -211,7 +215,8 @@ void Namespace::InitializeNamespaces(uid_t uid, gid_t gid, int32_t clone_flags,
                                      const Mounts& mounts,
                                      const std::string& hostname,
                                      bool avoid_pivot_root,
-                                     bool allow_mount_propagation) {
+                                     bool allow_mount_propagation,
+                                     bool mounts_prepared) {
   if (clone_flags & CLONE_NEWUSER && !avoid_pivot_root) {
     SetupIDMaps(uid, gid);
   }
@@ -254,7 +259,9 @@ void Namespace::InitializeNamespaces(uid_t uid, gid_t gid, int32_t clone_flags,
     ActivateLoopbackInterface();
   }
 
-  PrepareChroot(mounts);
+  if (!mounts_prepared) {
+    PrepareChroot(mounts);
+  }
 
   if (avoid_pivot_root) {
     // Keep a reference to /proc/self as it might not be mounted later
@@ -355,6 +362,13 @@ void Namespace::InitializeInitialNamespaces(uid_t uid, gid_t gid) {
       "remounting rootfs read-only failed");
 }
 
+void Namespace::InitializeMountTemplate(const Mounts& mounts) {
+  // Same as in InitializeNamespaces() with avoid_pivot_root.
+  SAPI_RAW_PCHECK(chroot("/realroot") != -1, "chrooting to real root");
+  SAPI_RAW_PCHECK(chdir("/") != -1, "chdir / after chrooting real root");
+  PrepareChroot(mounts);
+}
+
 void Namespace::GetNamespaceDescription(NamespaceDescription* pb_description) {
   pb_description->set_clone_flags(clone_flags_);
   *pb_description->mutable_mount_tree_mounts() = mounts_.GetMountTree();
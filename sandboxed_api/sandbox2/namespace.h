@@ -30,13 +30,19 @@ namespace sandbox2 {
 
 class Namespace final {
  public:
-  // Performs the namespace setup (mounts, write the uid_map, etc.).
+  // Performs the namespace setup (mounts, write the uid_map, etc.). With
+  // mounts_prepared, the current mount namespace is a copy of one set up by
+  // InitializeMountTemplate() for the same mounts.
   static void InitializeNamespaces(uid_t uid, gid_t gid, int32_t clone_flags,
                                    const Mounts& mounts,
                                    const std::string& hostname,
                                    bool avoid_pivot_root,
-                                   bool allow_mount_propagation);
+                                   bool allow_mount_propagation,
+                                   bool mounts_prepared = false);
   static void InitializeInitialNamespaces(uid_t uid, gid_t gid);
+  // Sets up the mounts in a copy of the initial mount namespace, so that
+  // copies of it can be passed to InitializeNamespaces() with mounts_prepared.
+  static void InitializeMountTemplate(const Mounts& mounts);
 
   Namespace() = delete;
   Namespace(const Namespace&) = delete;
@@ -47,6 +47,7 @@ namespace {
 namespace file_util = ::sapi::file_util;
 using ::sapi::CreateDefaultPermissiveTestPolicy;
 using ::sapi::CreateNamedTempFile;
+using ::sapi::CreateTempDir;
 using ::sapi::GetTestSourcePath;
 using ::sapi::GetTestTempPath;
 using ::testing::Contains;
@@ -66,12 +67,15 @@ std::string GetTestcaseBinPath(absl::string_view bin_name) {
 
 std::vector<std::string> RunSandboxeeWithArgsAndPolicy(
     const std::string& bin_path, std::initializer_list<std::string> args,
-    std::unique_ptr<Policy> policy = nullptr) {
+    std::unique_ptr<Policy> policy = nullptr, bool cache_mounts = false,
+    bool share_netns = false) {
   if (!policy) {
     policy = CreateDefaultPermissiveTestPolicy(bin_path).BuildOrDie();
   }
-  Sandbox2 sandbox(std::make_unique<Executor>(bin_path, args),
-                   std::move(policy));
+  auto executor = std::make_unique<Executor>(bin_path, args);
+  executor->set_cache_mounts(cache_mounts);
+  executor->set_share_network_namespace(share_netns);
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
 
   CHECK(sandbox.RunAsync());
   Comms* comms = sandbox.comms();
@@ -105,6 +109,21 @@ TEST(NamespaceTest, FileNamespaceWorks) {
   EXPECT_THAT(result, ElementsAre("/binary_path"));
 }
 
+TEST(NamespaceTest, CachedMountsWork) {
+  // The second sandboxee gets a copy of the mounts set up for the first one.
+  const std::string path = GetTestcaseBinPath("namespace");
+  for (int i = 0; i < 2; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                              CreateDefaultPermissiveTestPolicy(path)
+                                  .AddFileAt(path, "/binary_path")
+                                  .TryBuild());
+    std::vector<std::string> result = RunSandboxeeWithArgsAndPolicy(
+        path, {path, "0", "/binary_path", "/etc/passwd"}, std::move(policy),
+        /*cache_mounts=*/true);
+    EXPECT_THAT(result, ElementsAre("/binary_path"));
+  }
+}
+
 TEST(NamespaceTest, ReadOnlyIsRespected) {
   // Mount temporary file as RO and check that it actually is RO.
   auto [name, fd] = CreateNamedTempFile(GetTestTempPath("temp_file")).value();
@@ -191,6 +210,37 @@ TEST(NamespaceTest, RootReadOnly) {
   EXPECT_THAT(result, ElementsAre("/tmp/testfile"));
 }
 
+TEST(NamespaceTest, SeededTmpfs) {
+  // Each sandboxee sees the files of the seed, but not those written by the
+  // ones before it.
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string seed,
+                            CreateTempDir(GetTestTempPath("seed_")));
+  file_util::fileops::FDCloser fd(
+      open((seed + "/file").c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644));
+  ASSERT_THAT(fd.get(), Ne(-1));
+  const std::string path = GetTestcaseBinPath("namespace");
+  for (int i = 0; i < 2; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(
+        auto policy,
+        CreateDefaultPermissiveTestPolicy(path)
+            .AddTmpfs("/seeded", /*size=*/4ULL << 20 /* 4 MiB */, seed)
+            .TryBuild());
+    std::vector<std::string> result = RunSandboxeeWithArgsAndPolicy(
+        path, {path, "0", "/seeded/file", "/seeded/written"},
+        std::move(policy));
+    EXPECT_THAT(result, ElementsAre("/seeded/file"));
+
+    SAPI_ASSERT_OK_AND_ASSIGN(
+        policy, CreateDefaultPermissiveTestPolicy(path)
+                    .AddTmpfs("/seeded", /*size=*/4ULL << 20 /* 4 MiB */, seed)
+                    .TryBuild());
+    result = RunSandboxeeWithArgsAndPolicy(
+        path, {path, "4", "/seeded/written"}, std::move(policy));
+    EXPECT_THAT(result, ElementsAre("/seeded/written"));
+  }
+  EXPECT_THAT(access((seed + "/written").c_str(), F_OK), Eq(-1));
+}
+
 TEST(NamespaceTest, RootWritable) {
   // Mount root rw and check it
   const std::string path = GetTestcaseBinPath("namespace");
@@ -238,6 +288,17 @@ TEST(NamespaceTest, TestInterfacesNoNetwork) {
   EXPECT_THAT(result, ElementsAre("lo"));
 }
 
+TEST(NamespaceTest, TestInterfacesSharedNetwork) {
+  // The second sandboxee joins the namespace created for the first one.
+  const std::string path = GetTestcaseBinPath("namespace");
+  for (int i = 0; i < 2; ++i) {
+    std::vector<std::string> result = RunSandboxeeWithArgsAndPolicy(
+        path, {path, "5"}, /*policy=*/nullptr, /*cache_mounts=*/false,
+        /*share_netns=*/true);
+    EXPECT_THAT(result, ElementsAre("lo"));
+  }
+}
+
 TEST(NamespaceTest, TestInterfacesWithNetwork) {
   const std::string path = GetTestcaseBinPath("namespace");
   SAPI_ASSERT_OK_AND_ASSIGN(auto policy, CreateDefaultPermissiveTestPolicy(path)
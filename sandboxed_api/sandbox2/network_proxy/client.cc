@@ -14,17 +14,28 @@
 
 #include "sandboxed_api/sandbox2/network_proxy/client.h"
 
+#include <arpa/inet.h>
 #include <linux/net.h>
 #include <linux/seccomp.h>
+#include <netdb.h>
 #include <stdio.h>
 #include <syscall.h>
+#include <unistd.h>
 
 #include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 #include "sandboxed_api/sandbox2/util/syscall_trap.h"
 #include "sandboxed_api/util/status_macros.h"
 
@@ -43,8 +54,6 @@ int NetworkProxyClient::ConnectHandler(int sockfd, const struct sockaddr* addr,
 absl::Status NetworkProxyClient::Connect(int sockfd,
                                          const struct sockaddr* addr,
                                          socklen_t addrlen) {
-  absl::MutexLock lock(&mutex_);
-
   // Check if socket is SOCK_STREAM
   int type;
   socklen_t type_size = sizeof(int);
@@ -58,38 +67,187 @@ absl::Status NetworkProxyClient::Connect(int sockfd,
         "Invalid socket, only SOCK_STREAM is allowed");
   }
 
-  // Send sockaddr struct
-  if (!comms_.SendBytes(reinterpret_cast<const uint8_t*>(addr), addrlen)) {
+  absl::MutexLock lock(&mutex_);
+  uint64_t request_id = next_request_id_++;
+
+  // Send the request id and the sockaddr struct
+  if (!comms_.SendUint64(request_id) ||
+      !comms_.SendBytes(reinterpret_cast<const uint8_t*>(addr), addrlen)) {
     errno = EIO;
     return absl::InternalError("Sending data to network proxy failed");
   }
 
-  SAPI_RETURN_IF_ERROR(ReceiveRemoteResult());
-
   // Receive new socket
-  int s;
-  if (!comms_.RecvFD(&s)) {
-    errno = EIO;
-    return absl::InternalError("Receiving data from network proxy failed");
-  }
+  SAPI_ASSIGN_OR_RETURN(Reply reply, ReceiveRemoteResult(request_id));
+  int s = reply.fd;
   if (dup2(s, sockfd) == -1) {
     close(s);
     return absl::InternalError("Processing data from network proxy failed");
   }
+  close(s);
   return absl::OkStatus();
 }
 
-absl::Status NetworkProxyClient::ReceiveRemoteResult() {
-  int result;
-  if (!comms_.RecvInt32(&result)) {
+absl::StatusOr<std::vector<std::string>> NetworkProxyClient::Resolve(
+    const std::string& name, uint16_t port) {
+  absl::MutexLock lock(&mutex_);
+  uint64_t request_id = kResolveRequest | next_request_id_++;
+
+  // The port in network byte order, followed by the name.
+  std::vector<uint8_t> request(sizeof(port) + name.size());
+  uint16_t net_port = htons(port);
+  memcpy(request.data(), &net_port, sizeof(net_port));
+  memcpy(request.data() + sizeof(net_port), name.data(), name.size());
+  if (!comms_.SendUint64(request_id) || !comms_.SendBytes(request)) {
     errno = EIO;
-    return absl::InternalError("Receiving data from the network proxy failed");
+    return absl::InternalError("Sending data to network proxy failed");
   }
-  if (result != 0) {
-    errno = result;
-    return absl::ErrnoToStatus(errno, "Error in network proxy server");
+
+  SAPI_ASSIGN_OR_RETURN(Reply reply, ReceiveRemoteResult(request_id));
+  // Every address takes the space of a sockaddr_in6.
+  if (reply.addresses.empty() ||
+      reply.addresses.size() % sizeof(sockaddr_in6) != 0) {
+    errno = EIO;
+    return absl::InternalError("Invalid reply from the network proxy");
+  }
+  std::vector<std::string> addresses;
+  for (size_t i = 0; i < reply.addresses.size(); i += sizeof(sockaddr_in6)) {
+    const char* slot = reinterpret_cast<const char*>(&reply.addresses[i]);
+    sa_family_t family;
+    memcpy(&family, slot, sizeof(family));
+    addresses.emplace_back(slot, family == AF_INET ? sizeof(sockaddr_in)
+                                                   : sizeof(sockaddr_in6));
+  }
+  return addresses;
+}
+
+int NetworkProxyClient::GetAddrInfo(const char* node, const char* service,
+                                    const struct addrinfo* hints,
+                                    struct addrinfo** res) {
+  if (node == nullptr) {
+    return EAI_NONAME;
+  }
+  int family = hints != nullptr ? hints->ai_family : AF_UNSPEC;
+  int socktype = hints != nullptr ? hints->ai_socktype : 0;
+  if (family != AF_UNSPEC && family != AF_INET && family != AF_INET6) {
+    return EAI_FAMILY;
+  }
+  // Only TCP connections are proxied.
+  if (socktype != 0 && socktype != SOCK_STREAM) {
+    return EAI_SOCKTYPE;
+  }
+  uint16_t port = 0;
+  if (service != nullptr) {
+    char* end;
+    unsigned long value = strtoul(service, &end, 10);  // NOLINT
+    if (*service == '\0' || *end != '\0' || value > UINT16_MAX) {
+      return EAI_SERVICE;
+    }
+    port = static_cast<uint16_t>(value);
+  }
+
+  absl::StatusOr<std::vector<std::string>> addresses = Resolve(node, port);
+  if (!addresses.ok()) {
+    switch (errno) {
+      case ENOENT:
+      case EACCES:
+        return EAI_NONAME;
+      case EAGAIN:
+        return EAI_AGAIN;
+      default:
+        return EAI_FAIL;
+    }
+  }
+
+  addrinfo* head = nullptr;
+  addrinfo** tail = &head;
+  for (const std::string& address : *addresses) {
+    const auto* saddr = reinterpret_cast<const sockaddr*>(address.data());
+    if (family != AF_UNSPEC && saddr->sa_family != family) {
+      continue;
+    }
+    // The address lives in the same allocation, like with getaddrinfo().
+    auto* ai = static_cast<addrinfo*>(
+        calloc(1, sizeof(addrinfo) + address.size()));
+    if (ai == nullptr) {
+      FreeAddrInfo(head);
+      return EAI_MEMORY;
+    }
+    ai->ai_family = saddr->sa_family;
+    ai->ai_socktype = SOCK_STREAM;
+    ai->ai_protocol = IPPROTO_TCP;
+    ai->ai_addrlen = address.size();
+    ai->ai_addr = reinterpret_cast<sockaddr*>(ai + 1);
+    memcpy(ai->ai_addr, address.data(), address.size());
+    *tail = ai;
+    tail = &ai->ai_next;
+  }
+  if (head == nullptr) {
+    return EAI_NONAME;
+  }
+  *res = head;
+  return 0;
+}
+
+void NetworkProxyClient::FreeAddrInfo(struct addrinfo* res) {
+  while (res != nullptr) {
+    addrinfo* next = res->ai_next;
+    free(res);
+    res = next;
+  }
+}
+
+bool NetworkProxyClient::ReceiveReply(uint64_t* request_id, Reply* reply) {
+  if (!comms_.RecvUint64(request_id) || !comms_.RecvInt32(&reply->result)) {
+    return false;
+  }
+  reply->fd = -1;
+  if (reply->result != 0) {
+    return true;
+  }
+  if (*request_id & kResolveRequest) {
+    return comms_.RecvBytes(&reply->addresses);
+  }
+  return comms_.RecvFD(&reply->fd);
+}
+
+absl::StatusOr<NetworkProxyClient::Reply>
+NetworkProxyClient::ReceiveRemoteResult(uint64_t request_id) {
+  // Other requests may be in flight, so whichever thread is not waiting for
+  // another one to receive takes the next reply, until it got its own.
+  auto can_take_reply = [this, request_id]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(
+                            mutex_) {
+    return failed_ || !receiving_ || replies_.contains(request_id);
+  };
+  while (true) {
+    mutex_.Await(absl::Condition(&can_take_reply));
+    if (auto it = replies_.find(request_id); it != replies_.end()) {
+      Reply reply = std::move(it->second);
+      replies_.erase(it);
+      if (reply.result != 0) {
+        errno = reply.result;
+        return absl::ErrnoToStatus(errno, "Error in network proxy server");
+      }
+      return reply;
+    }
+    if (failed_) {
+      errno = EIO;
+      return absl::InternalError(
+          "Receiving data from the network proxy failed");
+    }
+    receiving_ = true;
+    mutex_.Unlock();
+    uint64_t reply_id;
+    Reply reply;
+    bool ok = ReceiveReply(&reply_id, &reply);
+    mutex_.Lock();
+    receiving_ = false;
+    if (!ok) {
+      failed_ = true;
+      continue;
+    }
+    replies_[reply_id] = std::move(reply);
   }
-  return absl::OkStatus();
 }
 
 NetworkProxyClient* NetworkProxyHandler::network_proxy_client_ = nullptr;
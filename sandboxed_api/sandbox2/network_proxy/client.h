@@ -15,9 +15,17 @@
 #ifndef SANDBOXED_API_SANDBOX2_NETWORK_PROXY_CLIENT_H_
 #define SANDBOXED_API_SANDBOX2_NETWORK_PROXY_CLIENT_H_
 
+#include <netdb.h>
 #include <netinet/in.h>
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/util/syscall_trap.h"
@@ -27,6 +35,9 @@ namespace sandbox2 {
 class NetworkProxyClient {
  public:
   static constexpr char kFDName[] = "sb2_networkproxy";
+  // Set in the ids of host name lookups, to tell their replies apart from
+  // those to connection requests.
+  static constexpr uint64_t kResolveRequest = uint64_t{1} << 63;
 
   explicit NetworkProxyClient(int fd) : comms_(fd) {}
 
@@ -35,19 +46,53 @@ class NetworkProxyClient {
 
   // Establishes a new network connection with semantics similar to a regular
   // connect() call. Arguments are sent to network proxy server, which sends
-  // back a connected socket.
+  // back a connected socket. Safe to call from several threads at once, the
+  // server then establishes the connections concurrently.
   absl::Status Connect(int sockfd, const struct sockaddr* addr,
                        socklen_t addrlen);
   // Same as Connect, but with same API as regular connect() call.
   int ConnectHandler(int sockfd, const struct sockaddr* addr,
                      socklen_t addrlen);
 
+  // Resolves a host name through the network proxy server, which only
+  // returns the addresses the sandboxee may connect to on `port` (given in
+  // host byte order), and caches lookups across sandboxes. Needs
+  // PolicyBuilder::AllowNetworkProxyDnsResolution(). Returns sockaddr_in and
+  // sockaddr_in6 bytes.
+  absl::StatusOr<std::vector<std::string>> Resolve(const std::string& name,
+                                                   uint16_t port);
+  // Same as Resolve, but with the same API as getaddrinfo(). Only numeric
+  // services are supported, and AI_CANONNAME is ignored. The result must be
+  // released with FreeAddrInfo().
+  int GetAddrInfo(const char* node, const char* service,
+                  const struct addrinfo* hints, struct addrinfo** res);
+  static void FreeAddrInfo(struct addrinfo* res);
+
  private:
+  struct Reply {
+    int result;
+    int fd;
+    // Results of host name lookups.
+    std::vector<uint8_t> addresses;
+  };
+
+  // Waits for the reply to the request with the given id. Replies to other
+  // requests are stored for their callers.
+  absl::StatusOr<Reply> ReceiveRemoteResult(uint64_t request_id)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Receives the next reply from the server.
+  bool ReceiveReply(uint64_t* request_id, Reply* reply);
+
   Comms comms_;
-  absl::Status ReceiveRemoteResult();
 
   // Needed to make the Proxy thread safe.
   absl::Mutex mutex_;
+  uint64_t next_request_id_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Whether a thread is receiving a reply from comms_.
+  bool receiving_ ABSL_GUARDED_BY(mutex_) = false;
+  // Set once receiving failed, after which all requests fail.
+  bool failed_ ABSL_GUARDED_BY(mutex_) = false;
+  absl::flat_hash_map<uint64_t, Reply> replies_ ABSL_GUARDED_BY(mutex_);
 };
 
 class NetworkProxyHandler {
@@ -0,0 +1,131 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/network_proxy/dns_cache.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace sandbox2 {
+
+DnsCache::DnsCache(const DnsCacheOptions& options, Resolver resolver)
+    : options_(options), resolver_(std::move(resolver)) {}
+
+DnsCache& DnsCache::Global() {
+  static DnsCache* cache = new DnsCache();
+  return *cache;
+}
+
+absl::StatusOr<std::vector<std::string>> DnsCache::ResolveWithGetAddrInfo(
+    const std::string& name) {
+  addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+  addrinfo* result;
+  int error = getaddrinfo(name.c_str(), nullptr, &hints, &result);
+  if (error != 0) {
+    std::string message =
+        absl::StrCat("Resolving '", name, "': ", gai_strerror(error));
+    switch (error) {
+      case EAI_NONAME:
+#ifdef EAI_NODATA
+      case EAI_NODATA:
+#endif
+        return absl::NotFoundError(message);
+      case EAI_AGAIN:
+        return absl::UnavailableError(message);
+      default:
+        return absl::InternalError(message);
+    }
+  }
+  std::vector<std::string> addresses;
+  for (const addrinfo* ai = result; ai != nullptr; ai = ai->ai_next) {
+    if ((ai->ai_family != AF_INET || ai->ai_addrlen != sizeof(sockaddr_in)) &&
+        (ai->ai_family != AF_INET6 ||
+         ai->ai_addrlen != sizeof(sockaddr_in6))) {
+      continue;
+    }
+    std::string address(reinterpret_cast<const char*>(ai->ai_addr),
+                        ai->ai_addrlen);
+    if (ai->ai_family == AF_INET) {
+      reinterpret_cast<sockaddr_in*>(address.data())->sin_port = 0;
+    } else {
+      reinterpret_cast<sockaddr_in6*>(address.data())->sin6_port = 0;
+    }
+    addresses.push_back(std::move(address));
+  }
+  freeaddrinfo(result);
+  if (addresses.empty()) {
+    return absl::NotFoundError(
+        absl::StrCat("No IP addresses for '", name, "'"));
+  }
+  return addresses;
+}
+
+absl::StatusOr<std::vector<std::string>> DnsCache::Lookup(
+    absl::string_view name) {
+  std::string key(name);
+  auto not_resolving = [this, &key]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    auto it = entries_.find(key);
+    return it == entries_.end() || !it->second.resolving;
+  };
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(&not_resolving));
+  if (auto it = entries_.find(key);
+      it != entries_.end() && absl::Now() < it->second.expires) {
+    return it->second.addresses;
+  }
+  MaybeEvict();
+  entries_[key].resolving = true;
+
+  mutex_.Unlock();
+  absl::StatusOr<std::vector<std::string>> addresses = resolver_(key);
+  absl::Time now = absl::Now();
+  mutex_.Lock();
+
+  Entry& entry = entries_[key];
+  entry.addresses = addresses;
+  entry.expires = now + (addresses.ok() ? options_.ttl : options_.negative_ttl);
+  entry.resolving = false;
+  return addresses;
+}
+
+void DnsCache::MaybeEvict() {
+  if (entries_.size() < options_.max_entries) {
+    return;
+  }
+  absl::Time now = absl::Now();
+  absl::erase_if(entries_, [now](const auto& item) {
+    return !item.second.resolving && item.second.expires <= now;
+  });
+  if (entries_.size() < options_.max_entries) {
+    return;
+  }
+  // Everything is fresh, start over rather than growing without bounds.
+  absl::erase_if(entries_,
+                 [](const auto& item) { return !item.second.resolving; });
+}
+
+}  // namespace sandbox2
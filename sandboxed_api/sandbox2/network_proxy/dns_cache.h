@@ -0,0 +1,90 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_SANDBOX2_NETWORK_PROXY_DNS_CACHE_H_
+#define SANDBOXED_API_SANDBOX2_NETWORK_PROXY_DNS_CACHE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace sandbox2 {
+
+struct DnsCacheOptions {
+  // How long resolved addresses are reused. getaddrinfo() does not report
+  // the TTLs of the records, so this caps them instead.
+  absl::Duration ttl = absl::Seconds(60);
+  // How long failed lookups are remembered.
+  absl::Duration negative_ttl = absl::Seconds(5);
+  // Expired entries are dropped once the cache grows beyond this.
+  size_t max_entries = 4096;
+};
+
+// Caches host name lookups for the network proxy servers of a process, so
+// that sandboxes resolving the same names share the results. Concurrent
+// lookups of a name that is not cached wait for a single resolution.
+class DnsCache {
+ public:
+  // Returns the IPv4 and IPv6 addresses of a name, as sockaddr_in and
+  // sockaddr_in6 bytes with port 0.
+  using Resolver = absl::AnyInvocable<absl::StatusOr<std::vector<std::string>>(
+      const std::string& name)>;
+
+  explicit DnsCache(const DnsCacheOptions& options = {},
+                    Resolver resolver = ResolveWithGetAddrInfo);
+
+  DnsCache(const DnsCache&) = delete;
+  DnsCache& operator=(const DnsCache&) = delete;
+
+  // The cache used by network proxy servers of sandboxes that allow DNS
+  // resolution, see PolicyBuilder::AllowNetworkProxyDnsResolution().
+  static DnsCache& Global();
+
+  // Resolves with getaddrinfo(). Fails with kNotFound for unknown names and
+  // with kUnavailable for temporary failures.
+  static absl::StatusOr<std::vector<std::string>> ResolveWithGetAddrInfo(
+      const std::string& name);
+
+  // Returns the addresses of name, from the cache if they did not expire.
+  // Otherwise resolves it on the calling thread.
+  absl::StatusOr<std::vector<std::string>> Lookup(absl::string_view name);
+
+ private:
+  struct Entry {
+    absl::StatusOr<std::vector<std::string>> addresses;
+    absl::Time expires;
+    // Set while a thread resolves the name.
+    bool resolving = false;
+  };
+
+  // Drops expired entries if the cache is full.
+  void MaybeEvict() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  const DnsCacheOptions options_;
+  Resolver resolver_;
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_NETWORK_PROXY_DNS_CACHE_H_
@@ -0,0 +1,125 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/network_proxy/dns_cache.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include <atomic>
+#include <future>  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::SizeIs;
+
+std::string IPv4Address(const char* ip) {
+  sockaddr_in addr = {.sin_family = AF_INET};
+  inet_pton(AF_INET, ip, &addr.sin_addr);
+  return std::string(reinterpret_cast<const char*>(&addr), sizeof(addr));
+}
+
+TEST(DnsCacheTest, CachesLookups) {
+  std::atomic<int> resolved = 0;
+  DnsCache cache({}, [&resolved](const std::string& name)
+                         -> absl::StatusOr<std::vector<std::string>> {
+    ++resolved;
+    return std::vector<std::string>{IPv4Address("10.0.0.1")};
+  });
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<std::string> first,
+                            cache.Lookup("example.com"));
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<std::string> second,
+                            cache.Lookup("example.com"));
+  EXPECT_THAT(first, SizeIs(1));
+  EXPECT_THAT(second, Eq(first));
+  EXPECT_THAT(resolved.load(), Eq(1));
+  ASSERT_THAT(cache.Lookup("example.org"), IsOk());
+  EXPECT_THAT(resolved.load(), Eq(2));
+}
+
+TEST(DnsCacheTest, ResolvesAgainAfterTtl) {
+  std::atomic<int> resolved = 0;
+  DnsCache cache({.ttl = absl::Milliseconds(10)},
+                 [&resolved](const std::string& name)
+                     -> absl::StatusOr<std::vector<std::string>> {
+                   ++resolved;
+                   return std::vector<std::string>{IPv4Address("10.0.0.1")};
+                 });
+  ASSERT_THAT(cache.Lookup("example.com"), IsOk());
+  absl::SleepFor(absl::Milliseconds(20));
+  ASSERT_THAT(cache.Lookup("example.com"), IsOk());
+  EXPECT_THAT(resolved.load(), Eq(2));
+}
+
+TEST(DnsCacheTest, CachesFailures) {
+  std::atomic<int> resolved = 0;
+  DnsCache cache({}, [&resolved](const std::string& name)
+                         -> absl::StatusOr<std::vector<std::string>> {
+    ++resolved;
+    return absl::NotFoundError("no such name");
+  });
+  EXPECT_THAT(cache.Lookup("invalid"), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(cache.Lookup("invalid"), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(resolved.load(), Eq(1));
+}
+
+TEST(DnsCacheTest, ConcurrentLookupsResolveOnce) {
+  std::atomic<int> resolved = 0;
+  DnsCache cache({}, [&resolved](const std::string& name)
+                         -> absl::StatusOr<std::vector<std::string>> {
+    ++resolved;
+    absl::SleepFor(absl::Milliseconds(50));
+    return std::vector<std::string>{IPv4Address("10.0.0.1")};
+  });
+  constexpr int kNumThreads = 8;
+  std::vector<std::future<absl::StatusOr<std::vector<std::string>>>> results;
+  for (int i = 0; i < kNumThreads; ++i) {
+    results.push_back(std::async(std::launch::async, [&cache] {
+      return cache.Lookup("example.com");
+    }));
+  }
+  for (auto& result : results) {
+    EXPECT_THAT(result.get(), IsOk());
+  }
+  EXPECT_THAT(resolved.load(), Eq(1));
+}
+
+TEST(DnsCacheTest, ResolvesLocalhost) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<std::string> addresses,
+                            DnsCache::ResolveWithGetAddrInfo("localhost"));
+  ASSERT_THAT(addresses.empty(), Eq(false));
+  for (const std::string& address : addresses) {
+    const auto* saddr = reinterpret_cast<const sockaddr*>(address.data());
+    EXPECT_THAT(address.size(), Eq(saddr->sa_family == AF_INET
+                                       ? sizeof(sockaddr_in)
+                                       : sizeof(sockaddr_in6)));
+  }
+}
+
+}  // namespace
+}  // namespace sandbox2
@@ -16,7 +16,11 @@
 
 #include <arpa/inet.h>
 
+#include <algorithm>
+#include <cstdint>
+
 #include "absl/log/log.h"
+#include "absl/numeric/bits.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/match.h"
@@ -27,6 +31,62 @@
 
 namespace sandbox2 {
 
+namespace internal {
+namespace {
+
+// Returns bit i of an address in network byte order.
+int AddrBit(const uint8_t* addr, int i) {
+  return (addr[i / 8] >> (7 - i % 8)) & 1;
+}
+
+}  // namespace
+
+void PrefixTrie::Insert(const uint8_t* addr, int prefix_len, uint16_t port) {
+  uint32_t node = 0;
+  for (int i = 0; i < prefix_len; ++i) {
+    int bit = AddrBit(addr, i);
+    if (nodes_[node].children[bit] == 0) {
+      nodes_[node].children[bit] = nodes_.size();
+      nodes_.emplace_back();
+    }
+    node = nodes_[node].children[bit];
+  }
+  Node& target = nodes_[node];
+  if (port == 0) {
+    target.all_ports = true;
+    target.ports.clear();
+    return;
+  }
+  if (target.all_ports) {
+    return;
+  }
+  auto it = std::lower_bound(target.ports.begin(), target.ports.end(), port);
+  if (it == target.ports.end() || *it != port) {
+    target.ports.insert(it, port);
+  }
+}
+
+bool PrefixTrie::Contains(const uint8_t* addr, int addr_len,
+                          uint16_t port) const {
+  uint32_t node = 0;
+  for (int i = 0;; ++i) {
+    const Node& current = nodes_[node];
+    if (current.all_ports ||
+        std::binary_search(current.ports.begin(), current.ports.end(), port)) {
+      return true;
+    }
+    if (i == addr_len) {
+      return false;
+    }
+    node = current.children[AddrBit(addr, i)];
+    if (node == 0) {
+      return false;
+    }
+  }
+}
+
+}  // namespace internal
+
 static absl::StatusOr<std::string> Addr6ToString(
     const struct sockaddr_in6* saddr) {
   char addr[INET6_ADDRSTRLEN];
@@ -112,30 +172,6 @@ static absl::Status ParseIpAndMask(const std::string& ip_and_mask,
   return absl::OkStatus();
 }
 
-static absl::Status CidrToIn6Addr(uint32_t cidr, in6_addr* addr) {
-  if (cidr > 128) {
-    return absl::InvalidArgumentError(
-        absl::StrCat(cidr, " is not a correct cidr"));
-  }
-
-  memset(addr, 0, sizeof(*addr));
-
-  int i = 0;
-  while (cidr >= 8) {
-    addr->s6_addr[i++] = 0xff;
-    cidr -= 8;
-  }
-  if (cidr) {
-    uint8_t tmp = 0x0;
-    while (cidr--) {
-      tmp >>= 1;
-      tmp |= 0x80;
-    }
-    addr->s6_addr[i] = tmp;
-  }
-  return absl::OkStatus();
-}
-
 static absl::Status CidrToInAddr(uint32_t cidr, in_addr* addr) {
   if (cidr > 32) {
     return absl::InvalidArgumentError(
@@ -208,7 +244,9 @@ absl::Status AllowedHosts::AllowIPv4(const std::string& ip,
   }
 
   SAPI_RETURN_IF_ERROR(IPStringToAddr(ip, AF_INET, &addr));
-  allowed_IPv4_.emplace_back(addr.s_addr, m.s_addr, htons(port));
+  // Masks are contiguous, so they are just a prefix length.
+  allowed_IPv4_.Insert(reinterpret_cast<const uint8_t*>(&addr.s_addr),
+                       absl::popcount(ntohl(m.s_addr)), htons(port));
 
   return absl::OkStatus();
 }
@@ -222,10 +260,12 @@ absl::Status AllowedHosts::AllowIPv6(const std::string& ip, uint32_t cidr,
   in6_addr addr{};
   SAPI_RETURN_IF_ERROR(IPStringToAddr(ip, AF_INET6, &addr));
 
-  in6_addr m;
-  SAPI_RETURN_IF_ERROR(CidrToIn6Addr(cidr, &m));
+  if (cidr > 128) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(cidr, " is not a correct cidr"));
+  }
 
-  allowed_IPv6_.emplace_back(addr, m, htons(port));
+  allowed_IPv6_.Insert(addr.s6_addr, cidr, htons(port));
   return absl::OkStatus();
 }
 
@@ -243,32 +283,14 @@ bool AllowedHosts::IsHostAllowed(const struct sockaddr* saddr) const {
 }
 
 bool AllowedHosts::IsIPv6Allowed(const struct sockaddr_in6* saddr) const {
-  auto result = std::find_if(
-      allowed_IPv6_.begin(), allowed_IPv6_.end(), [saddr](const IPv6& entry) {
-        for (int i = 0; i < 16; i++) {
-          if ((entry.ip.s6_addr[i] & entry.mask.s6_addr[i]) !=
-              (saddr->sin6_addr.s6_addr[i] & entry.mask.s6_addr[i])) {
-            return false;
-          }
-        }
-        if (!entry.port || (entry.port == saddr->sin6_port)) {
-          return true;
-        }
-        return false;
-      });
-
-  return result != allowed_IPv6_.end();
+  return allowed_IPv6_.Contains(saddr->sin6_addr.s6_addr, 128,
+                                saddr->sin6_port);
 }
 
 bool AllowedHosts::IsIPv4Allowed(const struct sockaddr_in* saddr) const {
-  auto result = std::find_if(
-      allowed_IPv4_.begin(), allowed_IPv4_.end(), [saddr](const IPv4& entry) {
-        return ((entry.ip & entry.mask) ==
-                (saddr->sin_addr.s_addr & entry.mask)) &&
-               (!entry.port || (entry.port == saddr->sin_port));
-      });
-
-  return result != allowed_IPv4_.end();
+  return allowed_IPv4_.Contains(
+      reinterpret_cast<const uint8_t*>(&saddr->sin_addr.s_addr), 32,
+      saddr->sin_port);
 }
 
 }  // namespace sandbox2
@@ -17,7 +17,10 @@
 
 #include <netinet/in.h>
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "sandboxed_api/sandbox2/comms.h"
@@ -28,23 +31,36 @@ namespace sandbox2 {
 // representation.
 absl::StatusOr<std::string> AddrToString(const struct sockaddr* saddr);
 
-struct IPv4 {
-  in_addr_t ip;
-  in_addr_t mask;
-  uint32_t port;
-  IPv4(in_addr_t IP, in_addr_t mask, uint32_t port)
-      : ip(IP), mask(mask), port(port) {}
-};
+namespace internal {
+
+// Binary trie over the bits of network addresses, holding the rules of
+// AllowedHosts. Each node records the ports allowed by the rules whose prefix
+// ends there, so a lookup checks all rules matching an address while walking
+// it once, in O(prefix length) regardless of the number of rules.
+class PrefixTrie {
+ public:
+  // Adds a rule for the first prefix_len bits of addr. Port is in network
+  // byte order, 0 allows all ports.
+  void Insert(const uint8_t* addr, int prefix_len, uint16_t port);
+
+  // Checks if any rule allows port for the address of addr_len bits.
+  bool Contains(const uint8_t* addr, int addr_len, uint16_t port) const;
 
-struct IPv6 {
-  in6_addr ip;
-  in6_addr mask;
-  uint32_t port;
-  IPv6(in6_addr IP, in6_addr mask, uint32_t port)
-      : ip(IP), mask(mask), port(port) {}
+ private:
+  struct Node {
+    // Indices into nodes_, 0 (the root) if there is no child.
+    uint32_t children[2] = {0, 0};
+    bool all_ports = false;
+    // Sorted, only used if not all_ports.
+    std::vector<uint16_t> ports;
+  };
+
+  std::vector<Node> nodes_ = std::vector<Node>(1);
 };
 
-// Keeps a list of allowed pairs of IP, mask and port. Port equal to 0 means
+}  // namespace internal
+
+// Keeps a set of allowed pairs of IP, mask and port. Port equal to 0 means
 // that all ports are allowed.
 class AllowedHosts {
  public:
@@ -62,8 +78,8 @@ class AllowedHosts {
   bool IsIPv4Allowed(const struct sockaddr_in* saddr) const;
   bool IsIPv6Allowed(const struct sockaddr_in6* saddr) const;
 
-  std::vector<IPv4> allowed_IPv4_;
-  std::vector<IPv6> allowed_IPv6_;
+  internal::PrefixTrie allowed_IPv4_;
+  internal::PrefixTrie allowed_IPv6_;
 };
 
 }  // namespace sandbox2
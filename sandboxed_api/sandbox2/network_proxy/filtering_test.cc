@@ -18,9 +18,15 @@
 #include <linux/unistd.h>
 #include <string.h>
 
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/log/check.h"
+#include "absl/strings/str_cat.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 namespace sandbox2 {
@@ -118,5 +124,70 @@ TEST(FilteringTest, Basic) {
       IsFalse());
 }
 
+TEST(FilteringTest, NestedPrefixesWithDifferentPorts) {
+  sandbox2::AllowedHosts allowed_hosts;
+  EXPECT_THAT(allowed_hosts.AllowIPv4("10.0.0.0/8", 80), IsOk());
+  EXPECT_THAT(allowed_hosts.AllowIPv4("10.1.0.0/16", 443), IsOk());
+  EXPECT_THAT(allowed_hosts.AllowIPv4("10.1.2.3", 22), IsOk());
+
+  EXPECT_THAT(allowed_hosts.IsHostAllowed(PrepareIpv4("10.1.2.3", 80)),
+              IsTrue());
+  EXPECT_THAT(allowed_hosts.IsHostAllowed(PrepareIpv4("10.1.2.3", 443)),
+              IsTrue());
+  EXPECT_THAT(allowed_hosts.IsHostAllowed(PrepareIpv4("10.1.2.3", 22)),
+              IsTrue());
+  EXPECT_THAT(allowed_hosts.IsHostAllowed(PrepareIpv4("10.1.2.4", 22)),
+              IsFalse());
+  EXPECT_THAT(allowed_hosts.IsHostAllowed(PrepareIpv4("10.2.0.1", 443)),
+              IsFalse());
+  EXPECT_THAT(allowed_hosts.IsHostAllowed(PrepareIpv4("10.2.0.1", 80)),
+              IsTrue());
+}
+
+TEST(FilteringTest, ManyRulesMatchLinearScan) {
+  struct Rule {
+    uint32_t ip;
+    uint32_t cidr;
+    uint32_t port;
+  };
+  std::mt19937 rng(42);
+  auto next = [&rng](uint32_t n) -> uint32_t { return rng() % n; };
+  // Few distinct values, so that rules overlap and addresses hit them.
+  auto random_ip = [&next] {
+    return (10u << 24) | (next(4) << 16) | (next(4) << 8) | next(8);
+  };
+  auto ip_to_string = [](uint32_t ip) {
+    return absl::StrCat(ip >> 24, ".", (ip >> 16) & 0xff, ".",
+                        (ip >> 8) & 0xff, ".", ip & 0xff);
+  };
+
+  sandbox2::AllowedHosts allowed_hosts;
+  std::vector<Rule> rules;
+  for (int i = 0; i < 2000; ++i) {
+    Rule rule = {random_ip(), 8 + next(25), next(2) == 0 ? 0 : next(4)};
+    rules.push_back(rule);
+    ASSERT_THAT(allowed_hosts.AllowIPv4(
+                    absl::StrCat(ip_to_string(rule.ip), "/", rule.cidr),
+                    rule.port),
+                IsOk());
+  }
+  for (int i = 0; i < 2000; ++i) {
+    uint32_t ip = random_ip();
+    uint32_t port = 1 + next(4);
+    bool expected = false;
+    for (const Rule& rule : rules) {
+      uint32_t mask = ~0u << (32 - rule.cidr);
+      if ((ip & mask) == (rule.ip & mask) &&
+          (rule.port == 0 || rule.port == port)) {
+        expected = true;
+        break;
+      }
+    }
+    EXPECT_EQ(allowed_hosts.IsHostAllowed(PrepareIpv4(ip_to_string(ip), port)),
+              expected)
+        << ip_to_string(ip) << ":" << port;
+  }
+}
+
 }  // namespace
 }  // namespace sandbox2
@@ -15,47 +15,293 @@
 #include "sandboxed_api/sandbox2/network_proxy/server.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <linux/seccomp.h>
 #include <netinet/in.h>
 #include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstdint>
 #include <cstring>
+#include <future>  // NOLINT(build/c++11)
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/log/log.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/network_proxy/client.h"
+#include "sandboxed_api/sandbox2/network_proxy/dns_cache.h"
 #include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/strerror.h"
+
+#ifndef SECCOMP_IOCTL_NOTIF_RECV
+#define SECCOMP_IOC_MAGIC '!'
+
+struct seccomp_notif_resp {
+  __u64 id;
+  __s64 val;
+  __s32 error;
+  __u32 flags;
+};
+
+#define SECCOMP_IOCTL_NOTIF_SEND \
+  _IOWR(SECCOMP_IOC_MAGIC, 1, struct seccomp_notif_resp)
+#endif
+
+#ifndef SECCOMP_IOCTL_NOTIF_ADDFD
+#define SECCOMP_ADDFD_FLAG_SETFD (1UL << 0)
+
+struct seccomp_notif_addfd {
+  __u64 id;
+  __u32 flags;
+  __u32 srcfd;
+  __u32 newfd;
+  __u32 newfd_flags;
+};
+
+#define SECCOMP_IOCTL_NOTIF_ADDFD \
+  _IOW(SECCOMP_IOC_MAGIC, 3, struct seccomp_notif_addfd)
+#endif
 
 namespace sandbox2 {
 
 namespace file_util = ::sapi::file_util;
 
+namespace {
+
+// Checks that the peer did not close a connected socket, without consuming
+// any data it sent.
+bool IsConnectionAlive(int socket) {
+  char c;
+  ssize_t n = recv(socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 || (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+}  // namespace
+
 NetworkProxyServer::NetworkProxyServer(int fd, AllowedHosts* allowed_hosts,
                                        pthread_t monitor_thread_id)
     : violation_occurred_(false),
       comms_(std::make_unique<Comms>(fd)),
       fatal_error_(false),
+      epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      notify_event_fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
       monitor_thread_id_(monitor_thread_id),
-      allowed_hosts_(allowed_hosts) {}
-
-void NetworkProxyServer::ProcessConnectRequest() {
-  std::vector<uint8_t> addr;
-  if (!comms_->RecvBytes(&addr)) {
+      allowed_hosts_(allowed_hosts) {
+  if (epoll_fd_.get() == -1) {
+    PLOG(ERROR) << "epoll_create1()";
     fatal_error_ = true;
     return;
   }
+  epoll_event event = {.events = EPOLLIN,
+                       .data = {.fd = comms_->GetConnectionFD()}};
+  if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, comms_->GetConnectionFD(),
+                &event) != 0) {
+    PLOG(ERROR) << "Adding the network proxy comms to the epoll set";
+    fatal_error_ = true;
+    return;
+  }
+  event = {.events = EPOLLIN, .data = {.fd = notify_event_fd_.get()}};
+  if (notify_event_fd_.get() == -1 ||
+      epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, notify_event_fd_.get(),
+                &event) != 0) {
+    PLOG(ERROR) << "Setting up the network proxy notification event";
+    fatal_error_ = true;
+    return;
+  }
+  connect_timer_fd_ = file_util::fileops::FDCloser(
+      timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
+  event = {.events = EPOLLIN, .data = {.fd = connect_timer_fd_.get()}};
+  if (connect_timer_fd_.get() == -1 ||
+      epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, connect_timer_fd_.get(),
+                &event) != 0) {
+    PLOG(ERROR) << "Setting up the network proxy connect timer";
+    fatal_error_ = true;
+  }
+}
 
+void NetworkProxyServer::SetConnectLimits(
+    const NetworkProxyConnectLimits& limits) {
+  connect_limits_ = limits;
+}
+
+void NetworkProxyServer::EnableNotifications(
+    file_util::fileops::FDCloser notify_fd) {
+  notify_fd_ = std::move(notify_fd);
+}
+
+void NetworkProxyServer::QueueNotifiedConnect(uint64_t id, int sockfd,
+                                              absl::Span<const uint8_t> addr) {
+  {
+    absl::MutexLock lock(&notified_connects_mutex_);
+    // Connections in progress are limited once they are started, this keeps
+    // the queue from growing while the server is busy.
+    if (notified_connects_.size() >=
+        static_cast<size_t>(connect_limits_.max_pending_connects)) {
+      RespondToNotification({id, sockfd}, EAGAIN, -1);
+      return;
+    }
+    notified_connects_.push_back(
+        {id, sockfd,
+         std::string(reinterpret_cast<const char*>(addr.data()), addr.size())});
+  }
+  uint64_t value = 1;
+  write(notify_event_fd_.get(), &value, sizeof(value));
+}
+
+void NetworkProxyServer::ProcessNotifiedConnects() {
+  uint64_t value;
+  read(notify_event_fd_.get(), &value, sizeof(value));
+  std::vector<NotifiedConnect> connects;
+  {
+    absl::MutexLock lock(&notified_connects_mutex_);
+    connects.swap(notified_connects_);
+  }
+  for (const NotifiedConnect& connect : connects) {
+    if (fatal_error_ || violation_occurred_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    ProcessConnectRequest(
+        {connect.id, connect.sockfd},
+        absl::Span<const uint8_t>(
+            reinterpret_cast<const uint8_t*>(connect.addr.data()),
+            connect.addr.size()));
+  }
+}
+
+void NetworkProxyServer::ProcessRequests() {
+  while (!fatal_error_ &&
+         !violation_occurred_.load(std::memory_order_relaxed)) {
+    uint32_t tag;
+    absl::Span<const uint8_t> value;
+    switch (comms_->TryRecvTLV(&tag, &value)) {
+      case Comms::TryRecvResult::kWouldBlock:
+        return;
+      case Comms::TryRecvResult::kError:
+        fatal_error_ = true;
+        return;
+      case Comms::TryRecvResult::kOk:
+        break;
+    }
+    // Each request is the id as a uint64, followed by the address as bytes.
+    if (!request_id_.has_value()) {
+      uint64_t request_id;
+      if (tag != Comms::kTagUint64 || value.size() != sizeof(request_id)) {
+        LOG(ERROR) << "Expected a request id from the network proxy client";
+        fatal_error_ = true;
+        return;
+      }
+      memcpy(&request_id, value.data(), sizeof(request_id));
+      request_id_ = request_id;
+      continue;
+    }
+    if (tag != Comms::kTagBytes) {
+      LOG(ERROR) << "Expected an address from the network proxy client";
+      fatal_error_ = true;
+      return;
+    }
+    uint64_t request_id = *std::exchange(request_id_, std::nullopt);
+    if (request_id & NetworkProxyClient::kResolveRequest) {
+      ProcessResolveRequest(request_id, value);
+    } else {
+      ProcessConnectRequest({request_id}, value);
+    }
+  }
+}
+
+void NetworkProxyServer::EnableDnsResolution(DnsCache* cache) {
+  dns_cache_ = cache;
+}
+
+void NetworkProxyServer::ProcessResolveRequest(
+    uint64_t request_id, absl::Span<const uint8_t> request) {
+  uint16_t port;
+  if (request.size() <= sizeof(port) ||
+      request.size() > sizeof(port) + NI_MAXHOST) {
+    SendError({request_id}, EINVAL);
+    return;
+  }
+  if (dns_cache_ == nullptr) {
+    SendError({request_id}, EPERM);
+    return;
+  }
+  memcpy(&port, request.data(), sizeof(port));
+  absl::string_view name(
+      reinterpret_cast<const char*>(request.data()) + sizeof(port),
+      request.size() - sizeof(port));
+  if (name.find('\0') != absl::string_view::npos) {
+    SendError({request_id}, EINVAL);
+    return;
+  }
+
+  absl::StatusOr<std::vector<std::string>> addresses =
+      dns_cache_->Lookup(name);
+  if (!addresses.ok()) {
+    switch (addresses.status().code()) {
+      case absl::StatusCode::kNotFound:
+        SendError({request_id}, ENOENT);
+        break;
+      case absl::StatusCode::kUnavailable:
+        SendError({request_id}, EAGAIN);
+        break;
+      default:
+        SendError({request_id}, EIO);
+        break;
+    }
+    return;
+  }
+  // Every address takes the space of a sockaddr_in6, the family tells them
+  // apart.
+  std::string reply;
+  for (const std::string& address : *addresses) {
+    sockaddr_in6 slot = {};
+    memcpy(&slot, address.data(), std::min(address.size(), sizeof(slot)));
+    // sin_port and sin6_port are at the same offset.
+    slot.sin6_port = port;
+    if (!allowed_hosts_->IsHostAllowed(reinterpret_cast<sockaddr*>(&slot))) {
+      continue;
+    }
+    reply.append(reinterpret_cast<const char*>(&slot), sizeof(slot));
+  }
+  if (reply.empty()) {
+    SendError({request_id}, EACCES);
+    return;
+  }
+  if (!comms_->SendUint64(request_id) || !comms_->SendInt32(0) ||
+      !comms_->SendBytes(reinterpret_cast<const uint8_t*>(reply.data()),
+                         reply.size())) {
+    fatal_error_ = true;
+  }
+}
+
+void NetworkProxyServer::ProcessConnectRequest(
+    const Requester& requester, absl::Span<const uint8_t> addr) {
   const struct sockaddr* saddr = reinterpret_cast<const sockaddr*>(addr.data());
 
   // Only IPv4 TCP and IPv6 TCP are supported.
   if (!((addr.size() == sizeof(sockaddr_in) && saddr->sa_family == AF_INET) ||
         (addr.size() == sizeof(sockaddr_in6) &&
          saddr->sa_family == AF_INET6))) {
-    SendError(EINVAL);
+    SendError(requester, EINVAL);
     return;
   }
 
@@ -64,49 +310,359 @@ void NetworkProxyServer::ProcessConnectRequest() {
     return;
   }
 
-  int new_socket = socket(saddr->sa_family, SOCK_STREAM, 0);
-  if (new_socket < 0) {
-    SendError(errno);
+  if (pool_options_.has_value() && ServeFromPool(requester, addr)) {
     return;
   }
 
-  file_util::fileops::FDCloser new_socket_closer(new_socket);
+  if (pending_requests_ >= connect_limits_.max_pending_connects) {
+    SendError(requester, EAGAIN);
+    return;
+  }
+  bool in_progress;
+  file_util::fileops::FDCloser new_socket(StartConnect(addr, &in_progress));
+  if (new_socket.get() == -1) {
+    SendError(requester, errno);
+    return;
+  }
+  if (!in_progress) {
+    NotifySuccess(requester, new_socket.get());
+    return;
+  }
+  AddPendingConnect({requester, std::move(new_socket), std::string()});
+}
 
-  int result = connect(
-      new_socket, reinterpret_cast<const sockaddr*>(addr.data()), addr.size());
+int NetworkProxyServer::StartConnect(absl::Span<const uint8_t> addr,
+                                     bool* in_progress) {
+  const struct sockaddr* saddr = reinterpret_cast<const sockaddr*>(addr.data());
+  file_util::fileops::FDCloser new_socket(
+      socket(saddr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  if (new_socket.get() < 0) {
+    return -1;
+  }
 
-  if (result == 0) {
-    NotifySuccess();
-    if (!fatal_error_) {
-      if (!comms_->SendFD(new_socket)) {
-        fatal_error_ = true;
-        return;
+  *in_progress = false;
+  if (connect(new_socket.get(), saddr, addr.size()) == 0) {
+    return new_socket.Release();
+  }
+  if (errno != EINPROGRESS) {
+    return -1;
+  }
+  epoll_event event = {.events = EPOLLOUT, .data = {.fd = new_socket.get()}};
+  if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, new_socket.get(), &event) !=
+      0) {
+    return -1;
+  }
+  *in_progress = true;
+  return new_socket.Release();
+}
+
+void NetworkProxyServer::EnableConnectionPool(
+    const NetworkProxyPoolOptions& options) {
+  if (fatal_error_) {
+    return;
+  }
+  pool_timer_fd_ = file_util::fileops::FDCloser(
+      timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
+  if (pool_timer_fd_.get() == -1) {
+    PLOG(ERROR) << "timerfd_create(), not pooling connections";
+    return;
+  }
+  // Expires sockets at most a quarter of the timeout late.
+  timespec interval = absl::ToTimespec(
+      std::max(options.idle_timeout / 4, absl::Milliseconds(10)));
+  itimerspec spec = {.it_interval = interval, .it_value = interval};
+  epoll_event event = {.events = EPOLLIN,
+                       .data = {.fd = pool_timer_fd_.get()}};
+  if (timerfd_settime(pool_timer_fd_.get(), 0, &spec, nullptr) != 0 ||
+      epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, pool_timer_fd_.get(),
+                &event) != 0) {
+    PLOG(ERROR) << "Setting up the pool timer, not pooling connections";
+    pool_timer_fd_.Close();
+    return;
+  }
+  pool_options_ = options;
+}
+
+bool NetworkProxyServer::ServeFromPool(const Requester& requester,
+                                       absl::Span<const uint8_t> addr) {
+  std::string key(reinterpret_cast<const char*>(addr.data()), addr.size());
+  auto it = pool_.find(key);
+  if (it == pool_.end()) {
+    if (pool_.size() >= static_cast<size_t>(pool_options_->max_destinations)) {
+      return false;
+    }
+    it = pool_.emplace(key, PoolDestination()).first;
+  }
+  PoolDestination& destination = it->second;
+  destination.last_request = absl::Now();
+  bool served = false;
+  // The most recently connected sockets are the least likely to be stale.
+  while (!destination.ready.empty() && !served) {
+    ReadySocket ready = std::move(destination.ready.back());
+    destination.ready.pop_back();
+    if (IsConnectionAlive(ready.socket.get())) {
+      NotifySuccess(requester, ready.socket.get());
+      served = true;
+    }
+  }
+  RefillPool(key, destination);
+  return served;
+}
+
+void NetworkProxyServer::RefillPool(const std::string& key,
+                                    PoolDestination& destination) {
+  absl::Span<const uint8_t> addr(reinterpret_cast<const uint8_t*>(key.data()),
+                                 key.size());
+  while (static_cast<int>(destination.ready.size()) + destination.connecting <
+         pool_options_->connections_per_destination) {
+    bool in_progress;
+    file_util::fileops::FDCloser socket(StartConnect(addr, &in_progress));
+    if (socket.get() == -1) {
+      // Retried with the next request or expiry.
+      VLOG(1) << "Connecting a socket for the pool failed: "
+              << sapi::StrError(errno);
+      return;
+    }
+    if (!in_progress) {
+      destination.ready.push_back({std::move(socket), absl::Now()});
+      continue;
+    }
+    ++destination.connecting;
+    AddPendingConnect({{0}, std::move(socket), key});
+  }
+}
+
+void NetworkProxyServer::AddPendingConnect(PendingConnect pending) {
+  pending.deadline = absl::Now() + connect_limits_.connect_timeout;
+  if (pending.pool_key.empty()) {
+    ++pending_requests_;
+  }
+  int fd = pending.socket.get();
+  pending_connects_.emplace(fd, std::move(pending));
+  if (connect_timer_armed_) {
+    return;
+  }
+  // Expires connections at most a quarter of the timeout late.
+  timespec interval = absl::ToTimespec(std::max(
+      connect_limits_.connect_timeout / 4, absl::Milliseconds(10)));
+  itimerspec spec = {.it_interval = interval, .it_value = interval};
+  if (timerfd_settime(connect_timer_fd_.get(), 0, &spec, nullptr) != 0) {
+    PLOG(ERROR) << "Arming the connect timer";
+    return;
+  }
+  connect_timer_armed_ = true;
+}
+
+void NetworkProxyServer::ExpirePendingConnects() {
+  absl::Time now = absl::Now();
+  std::vector<int> expired;
+  for (const auto& [socket, pending] : pending_connects_) {
+    if (now >= pending.deadline) {
+      expired.push_back(socket);
+    }
+  }
+  for (int socket : expired) {
+    auto it = pending_connects_.find(socket);
+    PendingConnect pending = std::move(it->second);
+    pending_connects_.erase(it);
+    epoll_ctl(epoll_fd_.get(), EPOLL_CTL_DEL, socket, nullptr);
+    if (!pending.pool_key.empty()) {
+      if (auto destination = pool_.find(pending.pool_key);
+          destination != pool_.end() && destination->second.connecting > 0) {
+        --destination->second.connecting;
       }
+      continue;
     }
+    --pending_requests_;
+    SendError(pending.requester, ETIMEDOUT);
+  }
+  if (pending_connects_.empty()) {
+    itimerspec spec = {};
+    timerfd_settime(connect_timer_fd_.get(), 0, &spec, nullptr);
+    connect_timer_armed_ = false;
+  }
+}
+
+void NetworkProxyServer::ExpireIdleConnections() {
+  absl::Time now = absl::Now();
+  for (auto it = pool_.begin(); it != pool_.end();) {
+    PoolDestination& destination = it->second;
+    if (now - destination.last_request > pool_options_->idle_timeout) {
+      pool_.erase(it++);
+      continue;
+    }
+    while (!destination.ready.empty() &&
+           now - destination.ready.front().connected >
+               pool_options_->idle_timeout) {
+      destination.ready.pop_front();
+    }
+    RefillPool(it->first, destination);
+    ++it;
   }
 }
 
+void NetworkProxyServer::FinishConnect(int socket) {
+  auto it = pending_connects_.find(socket);
+  if (it == pending_connects_.end()) {
+    return;
+  }
+  PendingConnect pending = std::move(it->second);
+  pending_connects_.erase(it);
+  epoll_ctl(epoll_fd_.get(), EPOLL_CTL_DEL, socket, nullptr);
+  if (pending.pool_key.empty()) {
+    --pending_requests_;
+  }
+
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &len) != 0) {
+    error = errno;
+  }
+  if (!pending.pool_key.empty()) {
+    // The destination may have expired in the meantime.
+    auto it = pool_.find(pending.pool_key);
+    if (it == pool_.end()) {
+      return;
+    }
+    PoolDestination& destination = it->second;
+    if (destination.connecting > 0) {
+      --destination.connecting;
+    }
+    if (error == 0) {
+      destination.ready.push_back({std::move(pending.socket), absl::Now()});
+    }
+    return;
+  }
+  if (error != 0) {
+    SendError(pending.requester, error);
+    return;
+  }
+  NotifySuccess(pending.requester, socket);
+}
+
+bool NetworkProxyServer::ProcessEvents(int timeout_msec) {
+  if (fatal_error_ || violation_occurred_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  constexpr int kMaxEvents = 16;
+  epoll_event events[kMaxEvents];
+  int n = epoll_wait(epoll_fd_.get(), events, kMaxEvents, timeout_msec);
+  if (n == -1) {
+    if (errno != EINTR) {
+      PLOG(ERROR) << "epoll_wait()";
+      fatal_error_ = true;
+    }
+    return !fatal_error_;
+  }
+  for (int i = 0; i < n; ++i) {
+    if (events[i].data.fd == comms_->GetConnectionFD()) {
+      ProcessRequests();
+    } else if (events[i].data.fd == notify_event_fd_.get()) {
+      ProcessNotifiedConnects();
+    } else if (events[i].data.fd == connect_timer_fd_.get()) {
+      uint64_t expirations;
+      read(connect_timer_fd_.get(), &expirations, sizeof(expirations));
+      ExpirePendingConnects();
+    } else if (events[i].data.fd == pool_timer_fd_.get()) {
+      uint64_t expirations;
+      read(pool_timer_fd_.get(), &expirations, sizeof(expirations));
+      ExpireIdleConnections();
+    } else {
+      FinishConnect(events[i].data.fd);
+    }
+  }
+  return !fatal_error_ && !violation_occurred_.load(std::memory_order_relaxed);
+}
+
 void NetworkProxyServer::Run() {
-  while (!fatal_error_ &&
-         !violation_occurred_.load(std::memory_order_relaxed)) {
-    ProcessConnectRequest();
+  while (ProcessEvents(/*timeout_msec=*/-1)) {
+  }
+  LOG(INFO)
+      << "Clean shutdown or error occurred, shutting down NetworkProxyServer";
+}
+
+std::future<void> NetworkProxyServer::RunOnReactor(MonitorReactor* reactor) {
+  if (fatal_error_) {
+    std::promise<void> done;
+    done.set_value();
+    return done.get_future();
+  }
+  return reactor->Add(epoll_fd_.get(), this);
+}
+
+bool NetworkProxyServer::HandleEvents() {
+  // The reactor watches epoll_fd_, which stays readable while events are left.
+  if (ProcessEvents(/*timeout_msec=*/0)) {
+    return true;
   }
   LOG(INFO)
       << "Clean shutdown or error occurred, shutting down NetworkProxyServer";
+  return false;
 }
 
-void NetworkProxyServer::SendError(int saved_errno) {
-  if (!comms_->SendInt32(saved_errno)) {
+void NetworkProxyServer::SendError(const Requester& requester,
+                                   int saved_errno) {
+  if (requester.sockfd.has_value()) {
+    RespondToNotification(requester, saved_errno, -1);
+    return;
+  }
+  if (!comms_->SendUint64(requester.id) || !comms_->SendInt32(saved_errno)) {
     fatal_error_ = true;
   }
 }
 
-void NetworkProxyServer::NotifySuccess() {
-  if (!comms_->SendInt32(0)) {
+void NetworkProxyServer::NotifySuccess(const Requester& requester,
+                                       int socket) {
+  // Sockets are connected without blocking, but handed out as blocking ones
+  // like connect() would leave them.
+  int flags = fcntl(socket, F_GETFL);
+  if (flags == -1 || fcntl(socket, F_SETFL, flags & ~O_NONBLOCK) == -1) {
+    SendError(requester, errno);
+    return;
+  }
+  if (requester.sockfd.has_value()) {
+    RespondToNotification(requester, 0, socket);
+    return;
+  }
+  if (!comms_->SendUint64(requester.id) || !comms_->SendInt32(0) ||
+      !comms_->SendFD(socket)) {
     fatal_error_ = true;
   }
 }
 
+void NetworkProxyServer::RespondToNotification(const Requester& requester,
+                                               int saved_errno, int socket) {
+  if (saved_errno == 0) {
+    // Replaces the sandboxee's socket, so that from its point of view the
+    // connect() succeeded on it.
+    seccomp_notif_addfd addfd = {
+        .id = requester.id,
+        .flags = SECCOMP_ADDFD_FLAG_SETFD,
+        .srcfd = static_cast<__u32>(socket),
+        .newfd = static_cast<__u32>(*requester.sockfd),
+        .newfd_flags = 0,
+    };
+    if (ioctl(notify_fd_.get(), SECCOMP_IOCTL_NOTIF_ADDFD, &addfd) < 0) {
+      if (errno == ENOENT) {
+        // The sandboxee was interrupted or killed meanwhile.
+        return;
+      }
+      saved_errno = errno;
+      PLOG(WARNING) << "Installing the connected socket in the sandboxee";
+    }
+  }
+  seccomp_notif_resp resp = {
+      .id = requester.id,
+      .val = 0,
+      .error = -saved_errno,
+      .flags = 0,
+  };
+  if (ioctl(notify_fd_.get(), SECCOMP_IOCTL_NOTIF_SEND, &resp) != 0 &&
+      errno != ENOENT) {
+    PLOG(ERROR) << "Answering the connect() notification";
+  }
+}
+
 void NetworkProxyServer::NotifyViolation(const struct sockaddr* saddr) {
   if (absl::StatusOr<std::string> result = AddrToString(saddr); result.ok()) {
     violation_msg_ = std::move(result).value();
@@ -15,18 +15,61 @@
 #ifndef SANDBOXED_API_SANDBOX2_NETWORK_PROXY_SERVER_H_
 #define SANDBOXED_API_SANDBOX2_NETWORK_PROXY_SERVER_H_
 
+#include <pthread.h>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <future>  // NOLINT(build/c++11)
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
+#include "sandboxed_api/sandbox2/network_proxy/dns_cache.h"
 #include "sandboxed_api/sandbox2/network_proxy/filtering.h"
+#include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
 
+// Configures the pool of connected sockets kept by a NetworkProxyServer, see
+// NetworkProxyServer::EnableConnectionPool().
+struct NetworkProxyPoolOptions {
+  // Number of connected sockets kept ready for each destination.
+  int connections_per_destination = 1;
+  // Maximum number of destinations for which sockets are kept ready.
+  int max_destinations = 16;
+  // Ready sockets are closed after this long, and destinations that were not
+  // requested for this long are no longer kept ready.
+  absl::Duration idle_timeout = absl::Seconds(30);
+};
+
+// Bounds the connections a NetworkProxyServer has in progress, see
+// NetworkProxyServer::SetConnectLimits().
+struct NetworkProxyConnectLimits {
+  // Maximum number of requested connections in progress. Further requests
+  // fail with EAGAIN until some of them completed.
+  int max_pending_connects = 64;
+  // Connections that did not complete after this long fail with ETIMEDOUT.
+  absl::Duration connect_timeout = absl::Seconds(30);
+};
+
 // This is a proxy server that spawns connected sockets on requests.
 // Then it sends the file descriptor to the requestor. It is used to get around
 // limitations created by network namespaces. It also contains a set of rules
 // of allowed hosts.
-class NetworkProxyServer {
+// Connections are established with non-blocking connect() calls from an event
+// loop, so that a slow host does not hold up other requests. The client tags
+// each request with an id, and results are sent back in the order the
+// connections complete.
+class NetworkProxyServer : public MonitorReactor::Source {
  public:
   NetworkProxyServer(int fd, AllowedHosts* allowed_hosts,
                      pthread_t monitor_thread_id);
@@ -34,29 +77,185 @@ class NetworkProxyServer {
   NetworkProxyServer(const NetworkProxyServer&) = delete;
   NetworkProxyServer& operator=(const NetworkProxyServer&) = delete;
 
-  // Starts handling incoming connection requests.
+  // Starts handling incoming connection requests on the calling thread.
   void Run();
 
+  // Like Run(), but handles the requests on the threads of the given reactor,
+  // so that many servers can share them. The returned future becomes ready
+  // once the server finished and is no longer used.
+  std::future<void> RunOnReactor(MonitorReactor* reactor);
+
+  bool HandleEvents() override;
+
+  // Keeps connected sockets ready for destinations that were requested
+  // before, so that later requests for them don't wait for a TCP handshake.
+  // Sockets are checked for having been closed by the peer before they are
+  // handed out. Must be called before the server runs.
+  // This makes connections the sandboxee did not ask for (yet), so it only
+  // suits destinations that tolerate idle connections.
+  void EnableConnectionPool(const NetworkProxyPoolOptions& options);
+
+  // Replaces the default limits on connections in progress. Must be called
+  // before the server runs.
+  void SetConnectLimits(const NetworkProxyConnectLimits& limits);
+
+  // Answers host name lookups of the network proxy client from `cache`, see
+  // NetworkProxyClient::GetAddrInfo(). Only the addresses that allowed hosts
+  // have are returned. Without it, lookups fail with EPERM. Must be called
+  // before the server runs. Names that are not cached are resolved on the
+  // server's thread, holding up its other requests meanwhile.
+  void EnableDnsResolution(DnsCache* cache);
+
+  // Serves connect() calls of the sandboxee that arrive as seccomp user
+  // notifications on `notify_fd`, see
+  // PolicyBuilder::AddNetworkProxyUnotifyPolicy(). Results are reported by
+  // answering the notification, with the connected socket installed in place
+  // of the sandboxee's one. Can be called while the server runs, but before
+  // QueueNotifiedConnect().
+  void EnableNotifications(sapi::file_util::fileops::FDCloser notify_fd);
+
+  // Queues the connect() to `addr` held by the notification `id`, in which
+  // the sandboxee passed `sockfd`. Can be called from any thread. Fails the
+  // connect() with EAGAIN if the connect limits are reached.
+  void QueueNotifiedConnect(uint64_t id, int sockfd,
+                            absl::Span<const uint8_t> addr);
+
   // When the network rules were violated violation_occurred_ is set and
   // violation_msg_ contains details about the host.
   std::atomic<bool> violation_occurred_;
   std::string violation_msg_;
 
  private:
-  // Notifies the network proxy client about the error and sends its code.
-  void SendError(int saved_errno);
+  // Receives the result of a connection request: the network proxy client,
+  // or a sandboxee whose connect() is held by a seccomp user notification.
+  struct Requester {
+    // The client's request id, or the notification id.
+    uint64_t id;
+    // Set for notifications, the sandboxee's socket to replace with the
+    // connected one.
+    std::optional<int> sockfd;
+  };
+
+  // A connect() of the sandboxee received as a notification, see
+  // QueueNotifiedConnect().
+  struct NotifiedConnect {
+    uint64_t id;
+    int sockfd;
+    std::string addr;
+  };
+
+  // A connect() that is still in progress.
+  struct PendingConnect {
+    Requester requester;
+    sapi::file_util::fileops::FDCloser socket;
+    // Set for connections made for the pool, which have no request.
+    std::string pool_key;
+    absl::Time deadline;
+  };
+
+  // A connected socket waiting in the pool.
+  struct ReadySocket {
+    sapi::file_util::fileops::FDCloser socket;
+    absl::Time connected;
+  };
+
+  // A destination for which sockets are kept ready.
+  struct PoolDestination {
+    std::deque<ReadySocket> ready;
+    // Number of connections for the pool in pending_connects_.
+    int connecting = 0;
+    absl::Time last_request;
+  };
+
+  // Handles ready events, waiting for up to timeout_msec for them. Returns
+  // false once the server finished.
+  bool ProcessEvents(int timeout_msec);
+
+  // Receives all requests available from the network proxy client.
+  void ProcessRequests();
+
+  // Serves the connect() calls queued by QueueNotifiedConnect().
+  void ProcessNotifiedConnects();
+
+  // Notifies the requester about the error and sends its code.
+  void SendError(const Requester& requester, int saved_errno);
+
+  // Notifies the requester that no error occurred and sends the connected
+  // socket.
+  void NotifySuccess(const Requester& requester, int socket);
+
+  // Answers the notification held by requester, with the connected socket
+  // installed in the sandboxee if saved_errno is 0.
+  void RespondToNotification(const Requester& requester, int saved_errno,
+                             int socket);
+
+  // Serves a host name lookup from the network proxy client. The request is
+  // the port in network byte order followed by the name.
+  void ProcessResolveRequest(uint64_t request_id,
+                             absl::Span<const uint8_t> request);
+
+  // Serves a connection request.
+  void ProcessConnectRequest(const Requester& requester,
+                             absl::Span<const uint8_t> addr);
+
+  // Reports the result of a pending connect() that completed.
+  void FinishConnect(int socket);
+
+  // Starts a non-blocking connect(). Returns the socket, or -1 with errno set.
+  // Sets *in_progress if the connection is not established yet.
+  int StartConnect(absl::Span<const uint8_t> addr, bool* in_progress);
+
+  // Adds a connection in progress to pending_connects_, to be expired after
+  // the connect timeout.
+  void AddPendingConnect(PendingConnect pending);
+
+  // Fails the connections in progress that exceeded the connect timeout.
+  void ExpirePendingConnects();
+
+  // Hands out a ready socket for addr from the pool if there is one, and
+  // starts connecting replacements. Returns false if a connection must be
+  // made for the request.
+  bool ServeFromPool(const Requester& requester,
+                     absl::Span<const uint8_t> addr);
 
-  // Notifies the network proxy client that no error occurred.
-  void NotifySuccess();
+  // Connects sockets for the pool until it has enough for the destination.
+  void RefillPool(const std::string& key, PoolDestination& destination);
 
-  // Serves connection requests from the network proxy client.
-  void ProcessConnectRequest();
+  // Closes ready sockets and forgets destinations after the idle timeout.
+  void ExpireIdleConnections();
 
   // Throw a violation when the network rules are subverted.
   void NotifyViolation(const struct sockaddr* saddr);
 
   std::unique_ptr<Comms> comms_;
   bool fatal_error_;
+  // Watches comms_, notify_event_fd_ and the sockets in pending_connects_.
+  sapi::file_util::fileops::FDCloser epoll_fd_;
+  // Id of a request whose address was not received yet.
+  std::optional<uint64_t> request_id_;
+  // Keyed by socket.
+  absl::flat_hash_map<int, PendingConnect> pending_connects_;
+  // Number of entries of pending_connects_ that have a requester.
+  int pending_requests_ = 0;
+  // Set before the server runs, read by QueueNotifiedConnect() as well.
+  NetworkProxyConnectLimits connect_limits_;
+  // Fires periodically while connections are in progress, to expire them.
+  sapi::file_util::fileops::FDCloser connect_timer_fd_;
+  bool connect_timer_armed_ = false;
+  std::optional<NetworkProxyPoolOptions> pool_options_;
+  DnsCache* dns_cache_ = nullptr;
+  // Fires periodically while the pool is enabled, to expire idle sockets.
+  sapi::file_util::fileops::FDCloser pool_timer_fd_;
+  // Keyed by the destination's sockaddr.
+  absl::flat_hash_map<std::string, PoolDestination> pool_;
+  // Seccomp notification fd of the sandboxee, see EnableNotifications(). Set
+  // before the first notified connect() is queued, and only used afterwards.
+  sapi::file_util::fileops::FDCloser notify_fd_;
+  // Signaled by QueueNotifiedConnect(), watched by epoll_fd_.
+  sapi::file_util::fileops::FDCloser notify_event_fd_;
+  absl::Mutex notified_connects_mutex_;
+  std::vector<NotifiedConnect> notified_connects_
+      ABSL_GUARDED_BY(notified_connects_mutex_);
   pthread_t monitor_thread_id_;
 
   // Contains list of allowed to connect hosts.
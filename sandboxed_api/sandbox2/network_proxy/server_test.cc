@@ -0,0 +1,266 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/network_proxy/server.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
+#include "sandboxed_api/sandbox2/network_proxy/client.h"
+#include "sandboxed_api/sandbox2/network_proxy/dns_cache.h"
+#include "sandboxed_api/sandbox2/network_proxy/filtering.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::sapi::file_util::fileops::FDCloser;
+using ::testing::Eq;
+using ::testing::IsFalse;
+using ::testing::Ne;
+using ::testing::SizeIs;
+
+// Returns a socket bound to a free port on 127.0.0.1, and its address.
+FDCloser BindLoopback(sockaddr_in* addr) {
+  FDCloser s(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  *addr = {.sin_family = AF_INET};
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(*addr);
+  if (s.get() == -1 ||
+      bind(s.get(), reinterpret_cast<sockaddr*>(addr), len) != 0 ||
+      getsockname(s.get(), reinterpret_cast<sockaddr*>(addr), &len) != 0) {
+    return FDCloser();
+  }
+  return s;
+}
+
+absl::Status ConnectThroughProxy(NetworkProxyClient* client,
+                                 const sockaddr_in& addr,
+                                 FDCloser* connected = nullptr) {
+  FDCloser s(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  absl::Status status = client->Connect(
+      s.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+  if (connected != nullptr) {
+    *connected = std::move(s);
+  }
+  return status;
+}
+
+// Checks whether data arrives on either socket.
+bool IsEitherReadable(const FDCloser (&sockets)[2]) {
+  pollfd pfds[2] = {{.fd = sockets[0].get(), .events = POLLIN},
+                    {.fd = sockets[1].get(), .events = POLLIN}};
+  return poll(pfds, 2, /*timeout=*/1000) > 0;
+}
+
+class NetworkProxyServerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int sv[2];
+    ASSERT_THAT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv), Eq(0));
+    ASSERT_THAT(allowed_hosts_.AllowIPv4("127.0.0.1"), IsOk());
+    client_ = std::make_unique<NetworkProxyClient>(sv[0]);
+    server_ = std::make_unique<NetworkProxyServer>(sv[1], &allowed_hosts_,
+                                                   pthread_self());
+    listener_ = BindLoopback(&addr_);
+    ASSERT_THAT(listener_.get(), Ne(-1));
+    ASSERT_THAT(listen(listener_.get(), 16), Eq(0));
+  }
+
+  AllowedHosts allowed_hosts_;
+  std::unique_ptr<NetworkProxyClient> client_;
+  std::unique_ptr<NetworkProxyServer> server_;
+  FDCloser listener_;
+  sockaddr_in addr_;
+};
+
+TEST_F(NetworkProxyServerTest, ConcurrentConnects) {
+  std::thread server_thread(&NetworkProxyServer::Run, server_.get());
+  constexpr int kNumThreads = 8;
+  std::vector<std::future<absl::Status>> results;
+  for (int i = 0; i < kNumThreads; ++i) {
+    results.push_back(std::async(std::launch::async, [this] {
+      return ConnectThroughProxy(client_.get(), addr_);
+    }));
+  }
+  for (std::future<absl::Status>& result : results) {
+    EXPECT_THAT(result.get(), IsOk());
+  }
+  // The client closing its end shuts the server down.
+  client_.reset();
+  server_thread.join();
+  EXPECT_THAT(server_->violation_occurred_.load(), IsFalse());
+}
+
+TEST_F(NetworkProxyServerTest, ReportsFailedConnect) {
+  sockaddr_in closed_addr;
+  // Bound, but not listening.
+  FDCloser closed = BindLoopback(&closed_addr);
+  ASSERT_THAT(closed.get(), Ne(-1));
+  std::thread server_thread(&NetworkProxyServer::Run, server_.get());
+  absl::Status status = ConnectThroughProxy(client_.get(), closed_addr);
+  EXPECT_THAT(status.ok(), IsFalse());
+  EXPECT_THAT(errno, Eq(ECONNREFUSED));
+  // The proxy keeps serving requests afterwards.
+  EXPECT_THAT(ConnectThroughProxy(client_.get(), addr_), IsOk());
+  client_.reset();
+  server_thread.join();
+}
+
+TEST_F(NetworkProxyServerTest, LimitsPendingConnects) {
+  server_->SetConnectLimits({.max_pending_connects = 1,
+                             .connect_timeout = absl::Milliseconds(200)});
+  // A listener that never accepts drops connection attempts once its backlog
+  // is full, so that they stay in progress.
+  sockaddr_in full_addr;
+  FDCloser full = BindLoopback(&full_addr);
+  ASSERT_THAT(full.get(), Ne(-1));
+  ASSERT_THAT(listen(full.get(), 0), Eq(0));
+  std::vector<FDCloser> fillers;
+  for (int i = 0; i < 4; ++i) {
+    fillers.emplace_back(
+        socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    connect(fillers.back().get(), reinterpret_cast<sockaddr*>(&full_addr),
+            sizeof(full_addr));
+  }
+  std::thread server_thread(&NetworkProxyServer::Run, server_.get());
+  std::future<absl::Status> pending = std::async(std::launch::async, [&] {
+    return ConnectThroughProxy(client_.get(), full_addr);
+  });
+  absl::SleepFor(absl::Milliseconds(50));
+  // The only slot is taken.
+  EXPECT_THAT(ConnectThroughProxy(client_.get(), addr_),
+              StatusIs(absl::ErrnoToStatusCode(EAGAIN)));
+  // And freed once the connection times out.
+  EXPECT_THAT(pending.get(), StatusIs(absl::ErrnoToStatusCode(ETIMEDOUT)));
+  EXPECT_THAT(ConnectThroughProxy(client_.get(), addr_), IsOk());
+  client_.reset();
+  server_thread.join();
+}
+
+TEST_F(NetworkProxyServerTest, RunsOnReactor) {
+  MonitorReactor reactor;
+  std::future<void> done = server_->RunOnReactor(&reactor);
+  EXPECT_THAT(ConnectThroughProxy(client_.get(), addr_), IsOk());
+  EXPECT_THAT(ConnectThroughProxy(client_.get(), addr_), IsOk());
+  client_.reset();
+  done.wait();
+}
+
+TEST_F(NetworkProxyServerTest, ServesFromConnectionPool) {
+  server_->EnableConnectionPool({.connections_per_destination = 1});
+  std::thread server_thread(&NetworkProxyServer::Run, server_.get());
+  FDCloser first;
+  ASSERT_THAT(ConnectThroughProxy(client_.get(), addr_, &first), IsOk());
+  // The connection for the request, and the one kept ready.
+  FDCloser peers[2] = {FDCloser(accept(listener_.get(), nullptr, nullptr)),
+                       FDCloser(accept(listener_.get(), nullptr, nullptr))};
+  // Lets the server see that the ready one is connected.
+  absl::SleepFor(absl::Milliseconds(100));
+
+  FDCloser second;
+  ASSERT_THAT(ConnectThroughProxy(client_.get(), addr_, &second), IsOk());
+  ASSERT_THAT(write(second.get(), "x", 1), Eq(1));
+  // The data arrives on the ready connection, not on a new one.
+  EXPECT_TRUE(IsEitherReadable(peers));
+  client_.reset();
+  server_thread.join();
+}
+
+TEST_F(NetworkProxyServerTest, SkipsClosedPooledConnections) {
+  server_->EnableConnectionPool({.connections_per_destination = 1});
+  std::thread server_thread(&NetworkProxyServer::Run, server_.get());
+  ASSERT_THAT(ConnectThroughProxy(client_.get(), addr_), IsOk());
+  // The peer closes both connections, including the one kept ready.
+  close(accept(listener_.get(), nullptr, nullptr));
+  close(accept(listener_.get(), nullptr, nullptr));
+  absl::SleepFor(absl::Milliseconds(100));
+
+  FDCloser second;
+  ASSERT_THAT(ConnectThroughProxy(client_.get(), addr_, &second), IsOk());
+  // A new connection for the request, and its replacement in the pool.
+  FDCloser peers[2] = {FDCloser(accept(listener_.get(), nullptr, nullptr)),
+                       FDCloser(accept(listener_.get(), nullptr, nullptr))};
+  ASSERT_THAT(write(second.get(), "x", 1), Eq(1));
+  EXPECT_TRUE(IsEitherReadable(peers));
+  client_.reset();
+  server_thread.join();
+}
+
+TEST_F(NetworkProxyServerTest, ResolvesAllowedAddresses) {
+  DnsCache cache({}, [](const std::string& name)
+                         -> absl::StatusOr<std::vector<std::string>> {
+    std::vector<std::string> addresses;
+    for (const char* ip : {"10.0.0.1", "127.0.0.1"}) {
+      sockaddr_in addr = {.sin_family = AF_INET};
+      inet_pton(AF_INET, ip, &addr.sin_addr);
+      addresses.emplace_back(reinterpret_cast<const char*>(&addr),
+                             sizeof(addr));
+    }
+    return addresses;
+  });
+  server_->EnableDnsResolution(&cache);
+  std::thread server_thread(&NetworkProxyServer::Run, server_.get());
+
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<std::string> addresses,
+                            client_->Resolve("example.com", 443));
+  // Only the allowed address.
+  ASSERT_THAT(addresses, SizeIs(1));
+  const auto* addr = reinterpret_cast<const sockaddr_in*>(addresses[0].data());
+  EXPECT_THAT(addr->sin_addr.s_addr, Eq(htonl(INADDR_LOOPBACK)));
+  EXPECT_THAT(addr->sin_port, Eq(htons(443)));
+
+  addrinfo* res;
+  ASSERT_THAT(client_->GetAddrInfo("example.com", "443", nullptr, &res), Eq(0));
+  EXPECT_THAT(res->ai_family, Eq(AF_INET));
+  EXPECT_THAT(res->ai_next, Eq(nullptr));
+  NetworkProxyClient::FreeAddrInfo(res);
+  client_.reset();
+  server_thread.join();
+}
+
+TEST_F(NetworkProxyServerTest, RefusesResolutionUnlessEnabled) {
+  std::thread server_thread(&NetworkProxyServer::Run, server_.get());
+  EXPECT_THAT(client_->Resolve("localhost", 80),
+              StatusIs(absl::StatusCode::kPermissionDenied));
+  // Connection requests are still served.
+  EXPECT_THAT(ConnectThroughProxy(client_.get(), addr_), IsOk());
+  client_.reset();
+  server_thread.join();
+}
+
+}  // namespace
+}  // namespace sandbox2
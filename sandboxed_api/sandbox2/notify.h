@@ -84,6 +84,15 @@ class Notify {
     return TraceAction::kDeny;
   }
 
+  // Returns whether EventSyscallTrace() decided to allow `syscall` based on its
+  // architecture, number and arguments alone. If so, the monitor allows later
+  // syscalls that are equal in these without calling EventSyscallTrace() for
+  // them, which saves the decision (and any logging in it) for syscalls that
+  // the sandboxee makes over and over. Only called for kAllow decisions.
+  virtual bool IsSyscallTraceCacheable(const Syscall& syscall) {
+    return false;
+  }
+
   // Called when a policy called TRACE and EventSyscallTrace returned
   // kInspectAfterReturn.
   virtual void EventSyscallReturn(const Syscall& syscall,
@@ -34,12 +34,14 @@
 #include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/status_matchers.h"
 
 namespace sandbox2 {
 namespace {
 
 using ::sapi::CreateDefaultPermissiveTestPolicy;
 using ::sapi::GetTestSourcePath;
+using ::sapi::IsOk;
 using ::testing::Eq;
 
 // Allow typical syscalls and call SECCOMP_RET_TRACE for personality syscall,
@@ -75,6 +77,24 @@ class PersonalityNotify : public Notify {
   bool allow_;
 };
 
+// Allows all traced syscalls, and marks that decision as cacheable.
+class CachingNotify : public Notify {
+ public:
+  TraceAction EventSyscallTrace(const Syscall& syscall) override {
+    ++calls_;
+    return TraceAction::kAllow;
+  }
+
+  bool IsSyscallTraceCacheable(const Syscall& syscall) override {
+    return true;
+  }
+
+  int calls() const { return calls_; }
+
+ private:
+  int calls_ = 0;
+};
+
 // Print the newly created PID, and exchange data over Comms before sandboxing.
 class PidCommsNotify : public Notify {
  public:
@@ -111,6 +131,65 @@ TEST(NotifyTest, DisallowPersonality) {
   EXPECT_THAT(result.reason_code(), Eq(__NR_personality));
 }
 
+// Test that repeated equal syscalls are decided once if cacheable.
+TEST(NotifyTest, CachesTraceDecisions) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/personality");
+  std::vector<std::string> args = {path, "5"};
+  auto notify = std::make_unique<CachingNotify>();
+  CachingNotify* notify_ptr = notify.get();
+  Sandbox2 s2(std::make_unique<Executor>(path, args),
+              NotifyTestcasePolicy(path), std::move(notify));
+  auto result = s2.Run();
+
+  ASSERT_THAT(result.final_status(), Eq(Result::OK));
+  EXPECT_THAT(result.reason_code(), Eq(22));
+  EXPECT_THAT(notify_ptr->calls(), Eq(1));
+}
+
+// Test that the unotify monitor lets EventSyscallTrap allow traced syscalls.
+TEST(NotifyTest, AllowPersonalityWithUnotify) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/personality");
+  std::vector<std::string> args = {path};
+  Sandbox2 s2(std::make_unique<Executor>(path, args),
+              NotifyTestcasePolicy(path),
+              std::make_unique<PersonalityNotify>(/*allow=*/true));
+  ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  auto result = s2.Run();
+
+  ASSERT_THAT(result.final_status(), Eq(Result::OK));
+  EXPECT_THAT(result.reason_code(), Eq(22));
+}
+
+// Test that the unotify monitor lets EventSyscallTrap deny traced syscalls.
+TEST(NotifyTest, DisallowPersonalityWithUnotify) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/personality");
+  std::vector<std::string> args = {path};
+  Sandbox2 s2(std::make_unique<Executor>(path, args),
+              NotifyTestcasePolicy(path),
+              std::make_unique<PersonalityNotify>(/*allow=*/false));
+  ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  auto result = s2.Run();
+
+  ASSERT_THAT(result.final_status(), Eq(Result::VIOLATION));
+  EXPECT_THAT(result.reason_code(), Eq(__NR_personality));
+}
+
+// Test that the unotify monitor caches trace decisions as well.
+TEST(NotifyTest, CachesTraceDecisionsWithUnotify) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/personality");
+  std::vector<std::string> args = {path, "5"};
+  auto notify = std::make_unique<CachingNotify>();
+  CachingNotify* notify_ptr = notify.get();
+  Sandbox2 s2(std::make_unique<Executor>(path, args),
+              NotifyTestcasePolicy(path), std::move(notify));
+  ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  auto result = s2.Run();
+
+  ASSERT_THAT(result.final_status(), Eq(Result::OK));
+  EXPECT_THAT(result.reason_code(), Eq(22));
+  EXPECT_THAT(notify_ptr->calls(), Eq(1));
+}
+
 // Test EventStarted by exchanging data after started but before sandboxed.
 TEST(NotifyTest, PrintPidAndComms) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/pidcomms");
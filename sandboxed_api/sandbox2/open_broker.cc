@@ -0,0 +1,224 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/open_broker.h"
+
+#include <fcntl.h>
+#include <linux/openat2.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/path.h"
+
+#ifndef __NR_openat2
+#define __NR_openat2 437
+#endif
+
+namespace sandbox2 {
+namespace {
+
+namespace file = ::sapi::file;
+using ::sapi::file_util::fileops::FDCloser;
+
+std::vector<absl::string_view> SplitComponents(absl::string_view path) {
+  return absl::StrSplit(path, '/', absl::SkipEmpty());
+}
+
+bool ModifiesFile(int flags) {
+  return (flags & O_ACCMODE) != O_RDONLY ||
+         (flags & (O_CREAT | O_TRUNC | O_APPEND)) != 0;
+}
+
+// Returns `fd` if it is a regular file, with O_NONBLOCK cleared unless it was
+// requested in `flags`. Otherwise closes it and returns -errno. Directories are
+// rejected, as the sandboxee could use them with the *at() syscalls to get
+// around the allowlist.
+int CheckRegularFile(int fd, int flags) {
+  if (fd == -1) {
+    return -errno;
+  }
+  FDCloser file_fd(fd);
+  struct stat st;
+  if (fstat(file_fd.get(), &st) == -1) {
+    return -errno;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    return -EACCES;
+  }
+  if ((flags & O_NONBLOCK) == 0) {
+    const int fl = fcntl(file_fd.get(), F_GETFL);
+    if (fl == -1 || fcntl(file_fd.get(), F_SETFL, fl & ~O_NONBLOCK) == -1) {
+      return -errno;
+    }
+  }
+  return file_fd.Release();
+}
+
+// Opens the file that `path_fd`, an O_PATH descriptor or -1 with errno set,
+// refers to with `flags`, if it is a regular file. Closes `path_fd`, and
+// returns the new file descriptor or -errno. As the path was resolved without
+// opening it, FIFOs and devices are rejected before an open could have side
+// effects.
+int ReopenRegularFile(int path_fd, int flags) {
+  if (path_fd == -1) {
+    return -errno;
+  }
+  FDCloser file_fd(path_fd);
+  struct stat st;
+  if (fstat(file_fd.get(), &st) == -1) {
+    return -errno;
+  }
+  if (S_ISLNK(st.st_mode)) {
+    // Only resolved to the symlink itself with O_NOFOLLOW.
+    return -ELOOP;
+  }
+  if (!S_ISREG(st.st_mode)) {
+    return -EACCES;
+  }
+  if ((flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL)) {
+    return -EEXIST;
+  }
+  // Opens the very file resolved above. The magic link must be followed.
+  const std::string proc_path = absl::StrCat("/proc/self/fd/", file_fd.get());
+  const int fd = open(proc_path.c_str(),
+                      (flags & ~(O_CREAT | O_EXCL | O_NOFOLLOW)) | O_CLOEXEC |
+                          O_NOCTTY);
+  return fd == -1 ? -errno : fd;
+}
+
+}  // namespace
+
+absl::Status OpenBroker::Allow(absl::string_view path, bool is_dir,
+                               bool is_ro) {
+  if (!file::IsAbsolutePath(path)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Brokered paths must be absolute: ", path));
+  }
+  const std::string clean = file::CleanPath(path);
+  Node* node = &root_;
+  for (absl::string_view component : SplitComponents(clean)) {
+    std::unique_ptr<Node>& child = node->children[component];
+    if (child == nullptr) {
+      child = std::make_unique<Node>();
+    }
+    node = child.get();
+  }
+  if (node->rule.has_value()) {
+    return absl::AlreadyExistsError(
+        absl::StrCat("Brokered path added twice: ", clean));
+  }
+  node->rule = Rule{.is_dir = is_dir, .is_ro = is_ro};
+  node->path = clean;
+  return absl::OkStatus();
+}
+
+int OpenBroker::GetDirFd(const Node& node) const {
+  absl::MutexLock lock(&dir_fds_mutex_);
+  if (node.dir_fd.get() == -1) {
+    node.dir_fd = FDCloser(
+        open(node.path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC));
+    if (node.dir_fd.get() == -1) {
+      // Not kept, the directory might be created later.
+      return -errno;
+    }
+  }
+  return node.dir_fd.get();
+}
+
+int OpenBroker::Open(absl::string_view path, int flags, mode_t mode) const {
+  if (!file::IsAbsolutePath(path)) {
+    return -EACCES;
+  }
+  const std::string clean = file::CleanPath(path);
+  const std::vector<absl::string_view> components = SplitComponents(clean);
+  // The node with the rule for the path, and the number of components it
+  // covers.
+  const Node* match = root_.rule.has_value() ? &root_ : nullptr;
+  size_t matched = 0;
+  const Node* node = &root_;
+  for (size_t i = 0; i < components.size(); ++i) {
+    auto it = node->children.find(components[i]);
+    if (it == node->children.end()) {
+      break;
+    }
+    node = it->second.get();
+    if (node->rule.has_value() &&
+        (node->rule->is_dir || i + 1 == components.size())) {
+      match = node;
+      matched = i + 1;
+    }
+  }
+  // O_PATH descriptors are only good for the *at() syscalls.
+  if (match == nullptr || (match->rule->is_ro && ModifiesFile(flags)) ||
+      (flags & O_PATH) != 0) {
+    return -EACCES;
+  }
+
+  int dir_fd = -1;
+  std::string relative = ".";
+  if (match->rule->is_dir) {
+    dir_fd = GetDirFd(*match);
+    if (dir_fd < 0) {
+      return dir_fd;
+    }
+    if (matched < components.size()) {
+      relative = absl::StrJoin(components.begin() + matched, components.end(),
+                               "/");
+    }
+  }
+  // Returns the new file descriptor, or -1 with errno set.
+  auto open_path = [&](int open_flags) -> int {
+    if (!match->rule->is_dir) {
+      return open(clean.c_str(), open_flags, mode);
+    }
+    open_how how = {
+        .flags = static_cast<uint64_t>(open_flags),
+        // Must be zero unless a file may be created. O_TMPFILE includes
+        // O_DIRECTORY, so it has to be compared in full.
+        .mode = (open_flags & O_CREAT) != 0 ||
+                        (open_flags & O_TMPFILE) == O_TMPFILE
+                    ? mode
+                    : 0u,
+        .resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS,
+    };
+    return syscall(__NR_openat2, dir_fd, relative.c_str(), &how, sizeof(how));
+  };
+
+  // Existing files are only resolved first, and opened if they are regular.
+  if ((flags & O_TMPFILE) != O_TMPFILE) {
+    const int path_fd = open_path(O_PATH | O_CLOEXEC | (flags & O_NOFOLLOW));
+    if (path_fd != -1 || errno != ENOENT || (flags & O_CREAT) == 0) {
+      return ReopenRegularFile(path_fd, flags);
+    }
+  }
+  // Creates the file. Something else might have been created meanwhile, and
+  // opening a FIFO without a writer would block the caller.
+  return CheckRegularFile(
+      open_path(flags | O_CLOEXEC | O_NOCTTY | O_NONBLOCK), flags);
+}
+
+}  // namespace sandbox2
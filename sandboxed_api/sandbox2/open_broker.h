@@ -0,0 +1,84 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_SANDBOX2_OPEN_BROKER_H_
+#define SANDBOXED_API_SANDBOX2_OPEN_BROKER_H_
+
+#include <sys/types.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+
+// Opens files on the host on behalf of a sandboxee, if they are in an
+// allowlist of files and directories. Used by the unotify monitor to serve
+// open() and openat() of the sandboxee, see PolicyBuilder::AddBrokeredFile()
+// and PolicyBuilder::AddBrokeredDirectory(), instead of mounting what it may
+// open.
+//
+// Paths are those of the host, and must be absolute. They are normalized
+// before they are checked, and files in allowed directories are opened
+// relative to the directory with RESOLVE_BENEATH, so neither ".." nor
+// symlinks lead out of it. The directories are opened once and kept open.
+// Thread-safe.
+class OpenBroker {
+ public:
+  // Allows opening `path`, or if `is_dir`, everything below it. The rule for
+  // the longest matching path applies. If `is_ro`, files can only be opened
+  // for reading.
+  absl::Status Allow(absl::string_view path, bool is_dir, bool is_ro);
+
+  // Like open(path, flags, mode), and returns the file descriptor or -errno.
+  // Fails with EACCES if the path is not allowed, or only for reading and
+  // `flags` would modify the file. Only regular files are opened, so O_PATH
+  // and anything that is not a regular file, e.g. a directory, fail with
+  // EACCES as well. Existing files are resolved with O_PATH and only opened if
+  // they are regular, so FIFOs and devices are never opened and nothing
+  // blocks.
+  int Open(absl::string_view path, int flags, mode_t mode) const;
+
+ private:
+  struct Rule {
+    bool is_dir;
+    bool is_ro;
+  };
+
+  struct Node {
+    absl::flat_hash_map<std::string, std::unique_ptr<Node>> children;
+    std::optional<Rule> rule;
+    // The path of this node, set if it has a rule.
+    std::string path;
+    // For directories, an O_PATH descriptor opened on first use.
+    mutable sapi::file_util::fileops::FDCloser dir_fd;
+  };
+
+  // Returns the O_PATH descriptor of the directory of `node`, or -errno.
+  int GetDirFd(const Node& node) const;
+
+  Node root_;
+  mutable absl::Mutex dir_fds_mutex_;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_OPEN_BROKER_H_
@@ -0,0 +1,203 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/open_broker.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/path.h"
+#include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/util/temp_file.h"
+
+namespace sandbox2 {
+namespace {
+
+namespace file = ::sapi::file;
+namespace fileops = ::sapi::file_util::fileops;
+using ::sapi::CreateTempDir;
+using ::sapi::GetTestTempPath;
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::Ge;
+
+class OpenBrokerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    absl::StatusOr<std::string> dir = CreateTempDir(GetTestTempPath());
+    ASSERT_THAT(dir, IsOk());
+    // The broker only takes absolute paths.
+    root_ = fileops::MakeAbsolute(*dir, fileops::GetCWD());
+    ASSERT_TRUE(fileops::CreateDirectoryRecursively(
+        file::JoinPath(root_, "dir/sub"), 0700));
+    CreateFile("file");
+    CreateFile("secret");
+    CreateFile("dir/sub/file");
+  }
+
+  void TearDown() override { fileops::DeleteRecursively(root_); }
+
+  void CreateFile(const std::string& relative) {
+    fileops::FDCloser fd(open(file::JoinPath(root_, relative).c_str(),
+                              O_WRONLY | O_CREAT | O_CLOEXEC, 0600));
+    ASSERT_THAT(fd.get(), Ge(0));
+  }
+
+  // Returns the result of opening `relative`, closing any file opened.
+  int OpenAndClose(const OpenBroker& broker, const std::string& relative,
+                   int flags) {
+    const int fd =
+        broker.Open(file::JoinPath(root_, relative), flags, 0600);
+    if (fd >= 0) {
+      close(fd);
+      return 0;
+    }
+    return fd;
+  }
+
+  std::string root_;
+};
+
+TEST_F(OpenBrokerTest, OpensOnlyAllowedFiles) {
+  OpenBroker broker;
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "file"), /*is_dir=*/false,
+                           /*is_ro=*/true),
+              IsOk());
+  EXPECT_THAT(OpenAndClose(broker, "file", O_RDONLY), Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "./dir/../file", O_RDONLY), Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "secret", O_RDONLY), Eq(-EACCES));
+  // File rules don't cover anything below the file.
+  EXPECT_THAT(OpenAndClose(broker, "file/x", O_RDONLY), Eq(-EACCES));
+  EXPECT_THAT(broker.Open("file", O_RDONLY, 0), Eq(-EACCES));
+}
+
+TEST_F(OpenBrokerTest, RejectsWritesToReadOnlyPaths) {
+  OpenBroker broker;
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "dir"), /*is_dir=*/true,
+                           /*is_ro=*/true),
+              IsOk());
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "dir/sub"), /*is_dir=*/true,
+                           /*is_ro=*/false),
+              IsOk());
+  EXPECT_THAT(OpenAndClose(broker, "dir/sub/file", O_RDONLY), Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "dir/sub/new", O_WRONLY | O_CREAT), Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "dir/new", O_WRONLY | O_CREAT),
+              Eq(-EACCES));
+  EXPECT_THAT(OpenAndClose(broker, "dir", O_RDWR), Eq(-EACCES));
+}
+
+TEST_F(OpenBrokerTest, StaysBeneathAllowedDirectories) {
+  OpenBroker broker;
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "dir"), /*is_dir=*/true,
+                           /*is_ro=*/true),
+              IsOk());
+  ASSERT_THAT(symlink(file::JoinPath(root_, "secret").c_str(),
+                      file::JoinPath(root_, "dir/escape").c_str()),
+              Eq(0));
+  ASSERT_THAT(symlink("sub/file", file::JoinPath(root_, "dir/inside").c_str()),
+              Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "dir/escape", O_RDONLY), Eq(-EXDEV));
+  EXPECT_THAT(OpenAndClose(broker, "dir/inside", O_RDONLY), Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "dir/../secret", O_RDONLY), Eq(-EACCES));
+}
+
+TEST_F(OpenBrokerTest, OpensOnlyRegularFiles) {
+  OpenBroker broker;
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "dir"), /*is_dir=*/true,
+                           /*is_ro=*/true),
+              IsOk());
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "file"), /*is_dir=*/false,
+                           /*is_ro=*/true),
+              IsOk());
+  // Directory descriptors would give access to everything below them.
+  EXPECT_THAT(OpenAndClose(broker, "dir", O_RDONLY), Eq(-EACCES));
+  EXPECT_THAT(OpenAndClose(broker, "dir/sub", O_RDONLY | O_DIRECTORY),
+              Eq(-EACCES));
+  EXPECT_THAT(OpenAndClose(broker, "dir/sub/file", O_PATH), Eq(-EACCES));
+  EXPECT_THAT(OpenAndClose(broker, "file", O_PATH), Eq(-EACCES));
+  // Would block without a writer.
+  ASSERT_THAT(mkfifo(file::JoinPath(root_, "dir/fifo").c_str(), 0600), Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "dir/fifo", O_RDONLY), Eq(-EACCES));
+
+  // O_NONBLOCK is only kept if it was asked for.
+  fileops::FDCloser fd(
+      broker.Open(file::JoinPath(root_, "dir/sub/file"), O_RDONLY, 0));
+  ASSERT_THAT(fd.get(), Ge(0));
+  EXPECT_THAT(fcntl(fd.get(), F_GETFL) & O_NONBLOCK, Eq(0));
+  fileops::FDCloser nonblock_fd(
+      broker.Open(file::JoinPath(root_, "file"), O_RDONLY | O_NONBLOCK, 0));
+  ASSERT_THAT(nonblock_fd.get(), Ge(0));
+  EXPECT_THAT(fcntl(nonblock_fd.get(), F_GETFL) & O_NONBLOCK, Eq(O_NONBLOCK));
+}
+
+TEST_F(OpenBrokerTest, DoesNotOpenFifos) {
+  OpenBroker broker;
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "dir"), /*is_dir=*/true,
+                           /*is_ro=*/false),
+              IsOk());
+  const std::string fifo = file::JoinPath(root_, "dir/fifo");
+  ASSERT_THAT(mkfifo(fifo.c_str(), 0600), Eq(0));
+  fileops::FDCloser inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+  ASSERT_THAT(inotify_fd.get(), Ge(0));
+  ASSERT_THAT(inotify_add_watch(inotify_fd.get(), fifo.c_str(), IN_OPEN),
+              Ge(0));
+
+  // A reader of the FIFO would see the writer come and go.
+  EXPECT_THAT(OpenAndClose(broker, "dir/fifo", O_WRONLY), Eq(-EACCES));
+  EXPECT_THAT(OpenAndClose(broker, "dir/fifo", O_RDONLY | O_NONBLOCK),
+              Eq(-EACCES));
+  EXPECT_THAT(OpenAndClose(broker, "dir/fifo", O_WRONLY | O_CREAT),
+              Eq(-EACCES));
+  char event[sizeof(inotify_event) + NAME_MAX + 1];
+  EXPECT_THAT(read(inotify_fd.get(), event, sizeof(event)), Eq(-1));
+  EXPECT_THAT(errno, Eq(EAGAIN));
+}
+
+TEST_F(OpenBrokerTest, CreatesFiles) {
+  OpenBroker broker;
+  ASSERT_THAT(broker.Allow(file::JoinPath(root_, "dir"), /*is_dir=*/true,
+                           /*is_ro=*/false),
+              IsOk());
+  EXPECT_THAT(OpenAndClose(broker, "dir/new", O_WRONLY | O_CREAT | O_EXCL),
+              Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "dir/new", O_WRONLY | O_CREAT | O_EXCL),
+              Eq(-EEXIST));
+  EXPECT_THAT(OpenAndClose(broker, "dir/new", O_WRONLY | O_CREAT), Eq(0));
+  EXPECT_THAT(OpenAndClose(broker, "dir/missing", O_RDONLY), Eq(-ENOENT));
+}
+
+TEST_F(OpenBrokerTest, RejectsInvalidRules) {
+  OpenBroker broker;
+  EXPECT_THAT(broker.Allow("relative", /*is_dir=*/true, /*is_ro=*/true),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  ASSERT_THAT(broker.Allow(root_, /*is_dir=*/true, /*is_ro=*/true), IsOk());
+  EXPECT_THAT(broker.Allow(root_ + "/", /*is_dir=*/false, /*is_ro=*/true),
+              StatusIs(absl::StatusCode::kAlreadyExists));
+}
+
+}  // namespace
+}  // namespace sandbox2
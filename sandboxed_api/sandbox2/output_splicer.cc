@@ -0,0 +1,444 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/output_splicer.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <string>
+
+#include "absl/log/log.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::file_util::fileops::FDCloser;
+
+// Granularity in which the pages before the tail are released.
+constexpr uint64_t kTrimSize = 1 << 20;
+// Buffer size when copying to destinations that can't be spliced to.
+constexpr size_t kCopyBufferSize = 64 << 10;
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<OutputSplicer>> OutputSplicer::Create(
+    int pipe_fd, int dest_fd, size_t tail_size) {
+  auto splicer =
+      absl::WrapUnique(new OutputSplicer(pipe_fd, dest_fd, tail_size));
+  if (dest_fd == -1 && tail_size == 0) {
+    return absl::InvalidArgumentError("Neither a destination nor a tail");
+  }
+  splicer->epoll_fd_ = FDCloser(epoll_create1(EPOLL_CLOEXEC));
+  if (splicer->epoll_fd_.get() == -1) {
+    return absl::ErrnoToStatus(errno, "epoll_create1()");
+  }
+  splicer->stop_fd_ = FDCloser(eventfd(0, EFD_CLOEXEC));
+  if (splicer->stop_fd_.get() == -1) {
+    return absl::ErrnoToStatus(errno, "eventfd()");
+  }
+  for (int fd : {pipe_fd, splicer->stop_fd_.get()}) {
+    epoll_event event = {.events = EPOLLIN, .data = {.fd = fd}};
+    if (epoll_ctl(splicer->epoll_fd_.get(), EPOLL_CTL_ADD, fd, &event) != 0) {
+      return absl::ErrnoToStatus(errno, "epoll_ctl()");
+    }
+  }
+  if (dest_fd != -1) {
+    struct stat st;
+    const int flags = fcntl(dest_fd, F_GETFL);
+    if (flags == -1 || fstat(dest_fd, &st) != 0) {
+      return absl::ErrnoToStatus(errno, "Inspecting the destination");
+    }
+    if (S_ISSOCK(st.st_mode)) {
+      splicer->dest_copy_ = true;
+      splicer->dest_send_ = true;
+    } else if ((S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode)) &&
+               (flags & O_NONBLOCK) == 0) {
+      // A file description of its own, as the flags of dest_fd are shared
+      // with whoever else has it open.
+      splicer->own_dest_fd_ =
+          FDCloser(open(absl::StrCat("/proc/self/fd/", dest_fd).c_str(),
+                        O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC |
+                            (flags & O_APPEND)));
+      if (splicer->own_dest_fd_.get() != -1) {
+        splicer->dest_fd_ = splicer->own_dest_fd_.get();
+      } else {
+        VLOG(1) << "Writing the sandboxee output may block: "
+                << absl::ErrnoToStatus(errno, "open()");
+      }
+    }
+  }
+  if (tail_size == 0) {
+    return splicer;
+  }
+  splicer->tail_fd_ = FDCloser(memfd_create("sandbox2_output", MFD_CLOEXEC));
+  if (splicer->tail_fd_.get() == -1) {
+    return absl::ErrnoToStatus(errno, "memfd_create()");
+  }
+  if (dest_fd != -1) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      return absl::ErrnoToStatus(errno, "pipe2()");
+    }
+    splicer->tee_read_fd_ = FDCloser(fds[0]);
+    splicer->tee_write_fd_ = FDCloser(fds[1]);
+    // tee() moves no more than fits, so match the capacity of the source.
+    if (int size = fcntl(pipe_fd, F_GETPIPE_SZ); size > 0) {
+      fcntl(fds[1], F_SETPIPE_SZ, size);
+    }
+  }
+  return splicer;
+}
+
+void OutputSplicer::Run() {
+  while (true) {
+    epoll_event event;
+    if (epoll_wait(epoll_fd_.get(), &event, 1, /*timeout=*/-1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(ERROR) << "epoll_wait() on the sandboxee output";
+      return;
+    }
+    if (!HandleEvents()) {
+      return;
+    }
+  }
+}
+
+std::future<void> OutputSplicer::RunOnReactor(MonitorReactor* reactor) {
+  return reactor->Add(epoll_fd_.get(), this);
+}
+
+void OutputSplicer::Stop() {
+  const uint64_t value = 1;
+  if (TEMP_FAILURE_RETRY(write(stop_fd_.get(), &value, sizeof(value))) !=
+      sizeof(value)) {
+    PLOG(ERROR) << "Stopping the output splicer";
+  }
+}
+
+bool OutputSplicer::HandleEvents() {
+  if (ProcessEvents()) {
+    return true;
+  }
+  // Readers of the destination see its end once the splicer is done, as if
+  // it had not been opened again.
+  own_dest_fd_.Close();
+  dest_fd_ = -1;
+  return false;
+}
+
+bool OutputSplicer::ProcessEvents() {
+  pollfd pfd = {.fd = stop_fd_.get(), .events = POLLIN, .revents = 0};
+  if (poll(&pfd, 1, /*timeout=*/0) <= 0 || (pfd.revents & POLLIN) == 0) {
+    return Drain();
+  }
+  // Whatever is still written after this is lost. So is what the destination
+  // doesn't take right away, which then only goes to the tail.
+  if (!Flush()) {
+    return false;
+  }
+  int available = 0;
+  while (ioctl(pipe_fd_.get(), FIONREAD, &available) == 0 && available > 0) {
+    if (blocked_) {
+      DropDest();
+      if (tail_fd_.get() == -1) {
+        break;
+      }
+    }
+    if (!SpliceOut(available)) {
+      break;
+    }
+  }
+  return false;
+}
+
+bool OutputSplicer::Drain() {
+  if (blocked_) {
+    if (!Flush()) {
+      return false;
+    }
+    if (blocked_) {
+      return true;
+    }
+    if (!WatchDest(false)) {
+      return false;
+    }
+  }
+  int available = 0;
+  if (ioctl(pipe_fd_.get(), FIONREAD, &available) != 0) {
+    PLOG(ERROR) << "FIONREAD on the sandboxee output";
+    return false;
+  }
+  if (available == 0) {
+    // Readable but empty once all writers closed the pipe.
+    pollfd pfd = {.fd = pipe_fd_.get(), .events = POLLIN, .revents = 0};
+    return poll(&pfd, 1, /*timeout=*/0) == 0 ||
+           (pfd.revents & (POLLHUP | POLLERR)) == 0;
+  }
+  if (!SpliceOut(available)) {
+    return false;
+  }
+  TrimTail();
+  return !blocked_ || WatchDest(true);
+}
+
+bool OutputSplicer::SpliceOut(size_t size) {
+  while (size > 0 && !blocked_) {
+    if (dest_fd_ == -1) {
+      return SpliceToTail(size);
+    }
+    if (dest_copy_) {
+      const size_t before = copy_buffer_.size();
+      if (!CopyOut(size)) {
+        return false;
+      }
+      size -= copy_buffer_.size() - before;
+    } else if (tail_fd_.get() != -1) {
+      // Copies the output for the destination, which is only taken from the
+      // pipe to the tail once the destination took it.
+      const ssize_t teed =
+          tee(pipe_fd_.get(), tee_write_fd_.get(), size, /*flags=*/0);
+      if (teed == -1 && errno == EINTR) {
+        continue;
+      }
+      if (teed <= 0) {
+        PLOG(ERROR) << "tee() of the sandboxee output";
+        return false;
+      }
+      tee_pending_ = teed;
+      size -= teed;
+    } else {
+      const ssize_t n = splice(pipe_fd_.get(), nullptr, dest_fd_, nullptr,
+                               size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (n > 0) {
+        offset_ += n;
+        size -= n;
+      } else if (n == -1 && errno == EAGAIN) {
+        blocked_ = true;
+      } else if (n == -1 && errno == EINVAL) {
+        VLOG(1) << "Copying the sandboxee output, splice() is not supported";
+        dest_copy_ = true;
+      } else if (n != -1 || errno != EINTR) {
+        PLOG(ERROR) << "splice() of the sandboxee output";
+        return false;
+      }
+      continue;
+    }
+    if (!Flush()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool OutputSplicer::SpliceToTail(size_t size) {
+  loff_t tail_offset = offset_;
+  while (size > 0) {
+    const ssize_t n = splice(pipe_fd_.get(), nullptr, tail_fd_.get(),
+                             &tail_offset, size, SPLICE_F_MOVE);
+    if (n > 0) {
+      offset_ += n;
+      size -= n;
+      continue;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    PLOG(ERROR) << "splice() of the sandboxee output";
+    return false;
+  }
+  return true;
+}
+
+bool OutputSplicer::Flush() {
+  while (tee_pending_ > 0) {
+    const ssize_t n =
+        splice(tee_read_fd_.get(), nullptr, dest_fd_, nullptr, tee_pending_,
+               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n > 0) {
+      if (!SpliceToTail(n)) {
+        return false;
+      }
+      tee_pending_ -= n;
+      continue;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && errno == EAGAIN) {
+      blocked_ = true;
+      return true;
+    }
+    if (n == -1 && errno == EINVAL) {
+      VLOG(1) << "Copying the sandboxee output, splice() is not supported";
+      dest_copy_ = true;
+      // The copies move on through copy_buffer_, the output itself to the
+      // tail.
+      copy_buffer_.resize(tee_pending_);
+      for (size_t done = 0; done < tee_pending_;) {
+        const ssize_t read_bytes = TEMP_FAILURE_RETRY(read(
+            tee_read_fd_.get(), copy_buffer_.data() + done,
+            tee_pending_ - done));
+        if (read_bytes <= 0) {
+          PLOG(ERROR) << "Reading the sandboxee output";
+          return false;
+        }
+        done += read_bytes;
+      }
+      if (!SpliceToTail(tee_pending_)) {
+        return false;
+      }
+      tee_pending_ = 0;
+      break;
+    }
+    PLOG(ERROR) << "splice() of the sandboxee output";
+    return false;
+  }
+  while (copy_done_ < copy_buffer_.size()) {
+    const ssize_t n = WriteDest(copy_buffer_.data() + copy_done_,
+                                copy_buffer_.size() - copy_done_);
+    if (n > 0) {
+      copy_done_ += n;
+      continue;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      blocked_ = true;
+      return true;
+    }
+    PLOG(ERROR) << "Writing the sandboxee output";
+    return false;
+  }
+  copy_buffer_.clear();
+  copy_done_ = 0;
+  blocked_ = false;
+  return true;
+}
+
+bool OutputSplicer::CopyOut(size_t size) {
+  const size_t before = copy_buffer_.size();
+  copy_buffer_.resize(before + std::min(size, kCopyBufferSize));
+  char* data = copy_buffer_.data() + before;
+  const ssize_t n = TEMP_FAILURE_RETRY(
+      read(pipe_fd_.get(), data, copy_buffer_.size() - before));
+  if (n <= 0) {
+    PLOG(ERROR) << "Reading the sandboxee output";
+    return false;
+  }
+  for (ssize_t done = 0; tail_fd_.get() != -1 && done < n;) {
+    const ssize_t written = TEMP_FAILURE_RETRY(
+        pwrite(tail_fd_.get(), data + done, n - done, offset_ + done));
+    if (written <= 0) {
+      PLOG(ERROR) << "Writing the tail of the sandboxee output";
+      return false;
+    }
+    done += written;
+  }
+  copy_buffer_.resize(before + n);
+  offset_ += n;
+  return true;
+}
+
+ssize_t OutputSplicer::WriteDest(const char* data, size_t size) {
+  if (dest_send_) {
+    return send(dest_fd_, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+  return write(dest_fd_, data, size);
+}
+
+bool OutputSplicer::WatchDest(bool watch) {
+  // The pipe, including its hangup, only matters again once the destination
+  // takes more.
+  const int remove = watch ? pipe_fd_.get() : dest_fd_;
+  const int add = watch ? dest_fd_ : pipe_fd_.get();
+  epoll_event event = {.events = watch ? EPOLLOUT : EPOLLIN,
+                       .data = {.fd = add}};
+  if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_DEL, remove, nullptr) != 0 ||
+      epoll_ctl(epoll_fd_.get(), EPOLL_CTL_ADD, add, &event) != 0) {
+    PLOG(ERROR) << "Waiting for the destination of the sandboxee output";
+    return false;
+  }
+  return true;
+}
+
+void OutputSplicer::DropDest() {
+  LOG(WARNING) << "Dropping sandboxee output its destination does not take";
+  // The output waiting in tee_read_fd_ is still in the pipe, the one in
+  // copy_buffer_ already in the tail.
+  tee_pending_ = 0;
+  copy_buffer_.clear();
+  copy_done_ = 0;
+  dest_fd_ = -1;
+  blocked_ = false;
+}
+
+void OutputSplicer::TrimTail() {
+  if (tail_fd_.get() == -1 || offset_ - trimmed_ < tail_size_ + kTrimSize) {
+    return;
+  }
+  const uint64_t end = (offset_ - tail_size_) & ~(kTrimSize - 1);
+  if (end <= trimmed_) {
+    return;
+  }
+  if (fallocate(tail_fd_.get(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                trimmed_, end - trimmed_) != 0) {
+    PLOG(WARNING) << "Releasing the sandboxee output before the tail";
+  }
+  // Not retried, the tail is still correct.
+  trimmed_ = end;
+}
+
+std::string OutputSplicer::ReadTail() const {
+  if (tail_fd_.get() == -1) {
+    return "";
+  }
+  const size_t size = std::min<uint64_t>(offset_, tail_size_);
+  const uint64_t start = offset_ - size;
+  std::string tail(size, '\0');
+  for (size_t done = 0; done < size;) {
+    const ssize_t n = TEMP_FAILURE_RETRY(
+        pread(tail_fd_.get(), tail.data() + done, size - done, start + done));
+    if (n <= 0) {
+      PLOG(ERROR) << "Reading the tail of the sandboxee output";
+      tail.resize(done);
+      break;
+    }
+    done += n;
+  }
+  return tail;
+}
+
+}  // namespace sandbox2
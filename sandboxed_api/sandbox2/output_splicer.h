@@ -0,0 +1,149 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_SANDBOX2_OUTPUT_SPLICER_H_
+#define SANDBOXED_API_SANDBOX2_OUTPUT_SPLICER_H_
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+
+// Drains the read end of a pipe that the sandboxee writes its stdout or stderr
+// to, see Executor::set_stdout_sink(). The output is moved to the destination
+// with splice(), without being copied through the memory of the host, and the
+// last bytes are kept in a memfd whose older pages are released as it grows.
+// Falls back to read() and write() for destinations splice() does not support,
+// e.g. files opened with O_APPEND.
+//
+// Runs either on a thread of its own or on the threads of a MonitorReactor,
+// until the writers close the pipe or Stop() is called. Writes to the
+// destination don't block: while it doesn't take more, the output stays in
+// the pipe, and the splicer waits for the destination to become writable.
+class OutputSplicer : public MonitorReactor::Source {
+ public:
+  // Takes ownership of `pipe_fd`, but not of `dest_fd`, which may be -1 to
+  // only keep the last `tail_size` bytes. Pipes and terminals are opened again
+  // to write to them without blocking, and sockets are written to with
+  // MSG_DONTWAIT, so that the file status flags of `dest_fd` stay as they are.
+  // Other destinations that might block, e.g. FIFOs without readers, may
+  // still hold up other sources of the reactor.
+  static absl::StatusOr<std::unique_ptr<OutputSplicer>> Create(
+      int pipe_fd, int dest_fd, size_t tail_size);
+
+  // Drains the pipe on the calling thread until it is done.
+  void Run();
+
+  // Drains the pipe on the threads of `reactor`, which must outlive this
+  // object. The returned future becomes ready once it is done.
+  std::future<void> RunOnReactor(MonitorReactor* reactor);
+
+  // Moves what is left in the pipe and ends draining it, e.g. once the
+  // sandboxee exited but a process it started still holds the pipe open.
+  // Output that the destination doesn't take right away only goes to the
+  // tail.
+  void Stop();
+
+  // The number of bytes drained. Only valid once done.
+  uint64_t bytes() const { return offset_; }
+
+  // Returns the last bytes drained, at most the tail size. Only valid once
+  // done.
+  std::string ReadTail() const;
+
+  bool HandleEvents() override;
+
+ private:
+  OutputSplicer(int pipe_fd, int dest_fd, size_t tail_size)
+      : pipe_fd_(pipe_fd), dest_fd_(dest_fd), tail_size_(tail_size) {}
+
+  // Handles the events of HandleEvents(), which then ends.
+  bool ProcessEvents();
+
+  // Moves what is readable from the pipe, as far as the destination takes
+  // it. Returns false once the writers closed the pipe or on errors.
+  bool Drain();
+
+  // Moves up to `size` bytes from the pipe. Returns false on errors.
+  bool SpliceOut(size_t size);
+
+  // Moves `size` bytes from the pipe to tail_fd_.
+  bool SpliceToTail(size_t size);
+
+  // Writes what the destination takes of the output waiting for it in
+  // tee_read_fd_ or copy_buffer_. Returns false on errors.
+  bool Flush();
+
+  // Reads up to `size` bytes from the pipe into copy_buffer_ and the tail.
+  bool CopyOut(size_t size);
+
+  // Writes to dest_fd_ without blocking.
+  ssize_t WriteDest(const char* data, size_t size);
+
+  // Switches between waiting for the pipe to become readable and for the
+  // destination to become writable, as set in blocked_.
+  bool WatchDest(bool watch);
+
+  // Gives up on the destination, e.g. when stopped while it doesn't take
+  // more output.
+  void DropDest();
+
+  // Releases the pages of tail_fd_ before the tail.
+  void TrimTail();
+
+  sapi::file_util::fileops::FDCloser pipe_fd_;
+  int dest_fd_;
+  // dest_fd_ if it was opened again to write to it without blocking.
+  sapi::file_util::fileops::FDCloser own_dest_fd_;
+  size_t tail_size_;
+  // An epoll fd watching pipe_fd_ and stop_fd_.
+  sapi::file_util::fileops::FDCloser epoll_fd_;
+  // An eventfd readable once Stop() was called.
+  sapi::file_util::fileops::FDCloser stop_fd_;
+  // A memfd holding the tail at tail_offset_, and the pipe that copies of
+  // the output go through on their way to it if there also is a destination.
+  sapi::file_util::fileops::FDCloser tail_fd_;
+  sapi::file_util::fileops::FDCloser tee_read_fd_;
+  sapi::file_util::fileops::FDCloser tee_write_fd_;
+  // The end of what was written to tail_fd_, and the start of what was not
+  // released yet.
+  uint64_t offset_ = 0;
+  uint64_t trimmed_ = 0;
+  // Whether dest_fd_ does not support splice(), and whether it is a socket
+  // written to with send().
+  bool dest_copy_ = false;
+  bool dest_send_ = false;
+  // Whether the splicer waits for dest_fd_ to become writable.
+  bool blocked_ = false;
+  // The number of bytes at the start of the pipe that were copied to
+  // tee_read_fd_, but not written to the destination yet.
+  size_t tee_pending_ = 0;
+  // Output read from the pipe for a destination that splice() doesn't
+  // support, and how much of it was written to the destination.
+  std::string copy_buffer_;
+  size_t copy_done_ = 0;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_OUTPUT_SPLICER_H_
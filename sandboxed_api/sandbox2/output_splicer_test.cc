@@ -0,0 +1,281 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/output_splicer.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT(build/c++11)
+#include <cstddef>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::sapi::file_util::fileops::FDCloser;
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::Gt;
+using ::testing::IsEmpty;
+
+// Returns `size` bytes that differ between offsets.
+std::string MakeOutput(size_t size) {
+  std::string output;
+  output.reserve(size + 16);
+  for (int i = 0; output.size() < size; ++i) {
+    absl::StrAppend(&output, i, "\n");
+  }
+  output.resize(size);
+  return output;
+}
+
+// Writes `output` to `fd` and closes it.
+void WriteAndClose(int fd, std::string output) {
+  for (size_t done = 0; done < output.size();) {
+    ssize_t n = write(fd, output.data() + done, output.size() - done);
+    ASSERT_THAT(n, Ge(0));
+    done += n;
+  }
+  close(fd);
+}
+
+std::string ReadAll(int fd) {
+  std::string contents(lseek(fd, 0, SEEK_END), '\0');
+  EXPECT_THAT(pread(fd, contents.data(), contents.size(), 0),
+              Eq(contents.size()));
+  return contents;
+}
+
+class OutputSplicerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    int fds[2];
+    ASSERT_THAT(pipe2(fds, O_CLOEXEC), Eq(0));
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+    dest_ = FDCloser(memfd_create("dest", MFD_CLOEXEC));
+    ASSERT_THAT(dest_.get(), Ge(0));
+  }
+
+  // Drains what the sandboxee writes into the splicer with the given
+  // destination and tail.
+  std::unique_ptr<OutputSplicer> Drain(int dest_fd, size_t tail_size,
+                                       const std::string& output) {
+    absl::StatusOr<std::unique_ptr<OutputSplicer>> splicer =
+        OutputSplicer::Create(read_fd_, dest_fd, tail_size);
+    EXPECT_THAT(splicer, IsOk());
+    if (!splicer.ok()) {
+      return nullptr;
+    }
+    std::thread writer(WriteAndClose, write_fd_, output);
+    (*splicer)->Run();
+    writer.join();
+    return *std::move(splicer);
+  }
+
+  int read_fd_ = -1;
+  int write_fd_ = -1;
+  FDCloser dest_;
+};
+
+TEST_F(OutputSplicerTest, RequiresDestinationOrTail) {
+  close(write_fd_);
+  EXPECT_THAT(OutputSplicer::Create(read_fd_, /*dest_fd=*/-1,
+                                    /*tail_size=*/0),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST_F(OutputSplicerTest, SplicesToDestination) {
+  const std::string output = MakeOutput(3 << 20);
+  std::unique_ptr<OutputSplicer> splicer =
+      Drain(dest_.get(), /*tail_size=*/0, output);
+  ASSERT_NE(splicer, nullptr);
+  EXPECT_THAT(splicer->bytes(), Eq(output.size()));
+  EXPECT_THAT(splicer->ReadTail(), IsEmpty());
+  EXPECT_THAT(ReadAll(dest_.get()), Eq(output));
+}
+
+TEST_F(OutputSplicerTest, KeepsTail) {
+  // Large enough for the pages before the tail to be released.
+  const std::string output = MakeOutput(5 << 20);
+  std::unique_ptr<OutputSplicer> splicer =
+      Drain(/*dest_fd=*/-1, /*tail_size=*/1000, output);
+  ASSERT_NE(splicer, nullptr);
+  EXPECT_THAT(splicer->bytes(), Eq(output.size()));
+  EXPECT_THAT(splicer->ReadTail(), Eq(output.substr(output.size() - 1000)));
+}
+
+TEST_F(OutputSplicerTest, KeepsShortOutputAsTail) {
+  std::unique_ptr<OutputSplicer> splicer =
+      Drain(/*dest_fd=*/-1, /*tail_size=*/1000, "short");
+  ASSERT_NE(splicer, nullptr);
+  EXPECT_THAT(splicer->ReadTail(), Eq("short"));
+}
+
+TEST_F(OutputSplicerTest, SplicesToDestinationAndKeepsTail) {
+  const std::string output = MakeOutput(3 << 20);
+  std::unique_ptr<OutputSplicer> splicer =
+      Drain(dest_.get(), /*tail_size=*/4096, output);
+  ASSERT_NE(splicer, nullptr);
+  EXPECT_THAT(ReadAll(dest_.get()), Eq(output));
+  EXPECT_THAT(splicer->ReadTail(), Eq(output.substr(output.size() - 4096)));
+}
+
+TEST_F(OutputSplicerTest, CopiesToAppendOnlyDestination) {
+  // splice() does not support files opened with O_APPEND.
+  FDCloser append(open(absl::StrCat("/proc/self/fd/", dest_.get()).c_str(),
+                       O_WRONLY | O_APPEND | O_CLOEXEC));
+  ASSERT_THAT(append.get(), Ge(0));
+  const std::string output = MakeOutput(1 << 20);
+  std::unique_ptr<OutputSplicer> splicer =
+      Drain(append.get(), /*tail_size=*/100, output);
+  ASSERT_NE(splicer, nullptr);
+  EXPECT_THAT(ReadAll(dest_.get()), Eq(output));
+  EXPECT_THAT(splicer->ReadTail(), Eq(output.substr(output.size() - 100)));
+}
+
+TEST_F(OutputSplicerTest, StopMovesWhatIsLeft) {
+  // A process the sandboxee started may keep the pipe open.
+  FDCloser writer(write_fd_);
+  ASSERT_THAT(write(writer.get(), "left", 4), Eq(4));
+  absl::StatusOr<std::unique_ptr<OutputSplicer>> splicer =
+      OutputSplicer::Create(read_fd_, dest_.get(), /*tail_size=*/0);
+  ASSERT_THAT(splicer, IsOk());
+  (*splicer)->Stop();
+  (*splicer)->Run();
+  EXPECT_THAT(ReadAll(dest_.get()), Eq("left"));
+}
+
+TEST_F(OutputSplicerTest, RunsOnReactor) {
+  MonitorReactor reactor;
+  absl::StatusOr<std::unique_ptr<OutputSplicer>> splicer =
+      OutputSplicer::Create(read_fd_, dest_.get(), /*tail_size=*/10);
+  ASSERT_THAT(splicer, IsOk());
+  std::future<void> done = (*splicer)->RunOnReactor(&reactor);
+  const std::string output = MakeOutput(1 << 20);
+  WriteAndClose(write_fd_, output);
+  done.wait();
+  EXPECT_THAT(ReadAll(dest_.get()), Eq(output));
+  EXPECT_THAT((*splicer)->ReadTail(), Eq(output.substr(output.size() - 10)));
+}
+
+TEST_F(OutputSplicerTest, DoesNotBlockOnDestinationThatIsNotRead) {
+  int dest_fds[2];
+  ASSERT_THAT(pipe2(dest_fds, O_CLOEXEC), Eq(0));
+  FDCloser dest_read(dest_fds[0]);
+  FDCloser dest_write(dest_fds[1]);
+  // More than the destination holds, but all of it fits into the pipe of the
+  // sandboxee.
+  const std::string output = MakeOutput(512 << 10);
+  if (fcntl(write_fd_, F_SETPIPE_SZ, output.size()) <
+      static_cast<int>(output.size())) {
+    GTEST_SKIP() << "Cannot grow the pipe";
+  }
+  WriteAndClose(write_fd_, output);
+
+  MonitorReactor reactor;
+  absl::StatusOr<std::unique_ptr<OutputSplicer>> stuck =
+      OutputSplicer::Create(read_fd_, dest_write.get(), /*tail_size=*/100);
+  ASSERT_THAT(stuck, IsOk());
+  std::future<void> stuck_done = (*stuck)->RunOnReactor(&reactor);
+
+  // Other sources of the reactor are still served.
+  int fds[2];
+  ASSERT_THAT(pipe2(fds, O_CLOEXEC), Eq(0));
+  absl::StatusOr<std::unique_ptr<OutputSplicer>> other =
+      OutputSplicer::Create(fds[0], dest_.get(), /*tail_size=*/0);
+  ASSERT_THAT(other, IsOk());
+  std::future<void> other_done = (*other)->RunOnReactor(&reactor);
+  WriteAndClose(fds[1], "other");
+  other_done.wait();
+  EXPECT_THAT(ReadAll(dest_.get()), Eq("other"));
+  EXPECT_THAT(stuck_done.wait_for(std::chrono::milliseconds(100)),
+              Eq(std::future_status::timeout));
+
+  // The rest of the output only goes to the tail.
+  (*stuck)->Stop();
+  stuck_done.wait();
+  EXPECT_THAT((*stuck)->bytes(), Eq(output.size()));
+  EXPECT_THAT((*stuck)->ReadTail(), Eq(output.substr(output.size() - 100)));
+  std::string taken(output.size(), '\0');
+  const ssize_t n = read(dest_read.get(), taken.data(), taken.size());
+  ASSERT_THAT(n, Gt(0));
+  EXPECT_THAT(taken.substr(0, n), Eq(output.substr(0, n)));
+}
+
+// Reads `fd` until its end, slower than the sandboxee writes, so that the
+// splicer has to wait for it.
+void ReadSlowly(int fd, std::string* received) {
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+    received->append(buffer, n);
+    usleep(100);
+  }
+}
+
+TEST_F(OutputSplicerTest, WaitsForDestinationToTakeMore) {
+  int dest_fds[2];
+  ASSERT_THAT(pipe2(dest_fds, O_CLOEXEC), Eq(0));
+  FDCloser dest_read(dest_fds[0]);
+  FDCloser dest_write(dest_fds[1]);
+  const std::string output = MakeOutput(1 << 20);
+  std::string received;
+  std::thread reader(ReadSlowly, dest_read.get(), &received);
+  std::unique_ptr<OutputSplicer> splicer =
+      Drain(dest_write.get(), /*tail_size=*/10, output);
+  dest_write.Close();
+  reader.join();
+  ASSERT_NE(splicer, nullptr);
+  EXPECT_THAT(received, Eq(output));
+  EXPECT_THAT(splicer->ReadTail(), Eq(output.substr(output.size() - 10)));
+}
+
+TEST_F(OutputSplicerTest, WaitsForSocketToTakeMore) {
+  int dest_fds[2];
+  ASSERT_THAT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, dest_fds),
+              Eq(0));
+  FDCloser dest_read(dest_fds[0]);
+  FDCloser dest_write(dest_fds[1]);
+  const std::string output = MakeOutput(1 << 20);
+  std::string received;
+  std::thread reader(ReadSlowly, dest_read.get(), &received);
+  std::unique_ptr<OutputSplicer> splicer =
+      Drain(dest_write.get(), /*tail_size=*/10, output);
+  dest_write.Close();
+  reader.join();
+  ASSERT_NE(splicer, nullptr);
+  EXPECT_THAT(received, Eq(output));
+  EXPECT_THAT(splicer->ReadTail(), Eq(output.substr(output.size() - 10)));
+}
+
+}  // namespace
+}  // namespace sandbox2
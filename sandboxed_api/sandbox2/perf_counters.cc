@@ -0,0 +1,125 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+namespace {
+
+struct CounterConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+// Indexed by PerfCounters::Counter.
+constexpr CounterConfig kCounterConfigs[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+int PerfEventOpen(const perf_event_attr& attr, pid_t pid) {
+  return syscall(__NR_perf_event_open, &attr, pid, /*cpu=*/-1,
+                 /*group_fd=*/-1, PERF_FLAG_FD_CLOEXEC);
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<PerfCounters>> PerfCounters::Open(
+    pid_t pid, bool enable_on_exec) {
+  // Using `new` to access a non-public constructor.
+  auto counters = absl::WrapUnique(new PerfCounters());
+  int open_errno = 0;
+  bool any_open = false;
+  for (int i = 0; i < kNumCounters; ++i) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = kCounterConfigs[i].type;
+    attr.config = kCounterConfigs[i].config;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    attr.disabled = enable_on_exec ? 1 : 0;
+    attr.enable_on_exec = enable_on_exec ? 1 : 0;
+    // Allowed with the default kernel.perf_event_paranoid of 2.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = PerfEventOpen(attr, pid);
+    if (fd == -1) {
+      // Typically ENOENT or EOPNOTSUPP for hardware counters the CPU lacks.
+      open_errno = errno;
+      continue;
+    }
+    counters->fds_[i] = sapi::file_util::fileops::FDCloser(fd);
+    any_open = true;
+  }
+  if (!any_open) {
+    return absl::ErrnoToStatus(
+        open_errno, absl::StrCat("perf_event_open() for pid ", pid));
+  }
+  return counters;
+}
+
+absl::StatusOr<PerfCounterValues> PerfCounters::Read() const {
+  uint64_t counts[kNumCounters] = {};
+  for (int i = 0; i < kNumCounters; ++i) {
+    if (fds_[i].get() == -1) {
+      continue;
+    }
+    // value, time_enabled, time_running
+    uint64_t buf[3];
+    if (TEMP_FAILURE_RETRY(read(fds_[i].get(), buf, sizeof(buf))) !=
+        sizeof(buf)) {
+      return absl::ErrnoToStatus(errno, "Reading perf counter");
+    }
+    counts[i] = Scale(buf[0], buf[1], buf[2]);
+  }
+  PerfCounterValues values;
+  values.cycles = counts[kCycles];
+  values.instructions = counts[kInstructions];
+  values.cache_misses = counts[kCacheMisses];
+  values.page_faults = counts[kPageFaults];
+  return values;
+}
+
+uint64_t PerfCounters::Scale(uint64_t value, uint64_t time_enabled,
+                             uint64_t time_running) {
+  if (time_running == 0) {
+    // Never scheduled on the PMU, or not enabled yet.
+    return 0;
+  }
+  if (time_running >= time_enabled) {
+    return value;
+  }
+  return static_cast<uint64_t>(static_cast<double>(value) * time_enabled /
+                               time_running);
+}
+
+}  // namespace sandbox2
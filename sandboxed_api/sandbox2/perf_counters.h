@@ -0,0 +1,79 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hardware and software performance counters of a sandboxee, see
+// Sandbox2::EnablePerfCounters().
+
+#ifndef SANDBOXED_API_SANDBOX2_PERF_COUNTERS_H_
+#define SANDBOXED_API_SANDBOX2_PERF_COUNTERS_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/statusor.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+
+// Counts of the sandboxee's user space execution. Counters the kernel or the
+// CPU doesn't provide (e.g. hardware counters in many VMs) are left at zero.
+// Counts are scaled up if the kernel had to multiplex the hardware counters.
+struct PerfCounterValues {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cache_misses = 0;
+  uint64_t page_faults = 0;
+};
+
+class PerfCounters {
+ public:
+  // Opens the counters for a process, including the processes and threads it
+  // creates afterwards. With enable_on_exec, counting starts with the next
+  // execve() of the process. Fails if none of the counters could be opened,
+  // e.g. because of kernel.perf_event_paranoid.
+  static absl::StatusOr<std::unique_ptr<PerfCounters>> Open(
+      pid_t pid, bool enable_on_exec);
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // Reads the current counts. Children and threads of the process only add to
+  // them once they have exited.
+  absl::StatusOr<PerfCounterValues> Read() const;
+
+  // Returns a count scaled to the time the counter was enabled, for counters
+  // that only ran part of the time.
+  static uint64_t Scale(uint64_t value, uint64_t time_enabled,
+                        uint64_t time_running);
+
+ private:
+  enum Counter {
+    kCycles,
+    kInstructions,
+    kCacheMisses,
+    kPageFaults,
+    kNumCounters,
+  };
+
+  PerfCounters() = default;
+
+  // -1 for counters that could not be opened.
+  sapi::file_util::fileops::FDCloser fds_[kNumCounters];
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_PERF_COUNTERS_H_
@@ -0,0 +1,131 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/perf_counters.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+
+namespace sandbox2 {
+namespace {
+
+constexpr size_t kTouchedBytes = 16 << 20;
+
+// A child process that touches kTouchedBytes of fresh memory once told to,
+// and then either exits or waits to be told again.
+class Child {
+ public:
+  Child() {
+    EXPECT_EQ(pipe(go_), 0);
+    EXPECT_EQ(pipe(done_), 0);
+    pid_ = fork();
+    if (pid_ == 0) {
+      close(go_[1]);
+      close(done_[0]);
+      char c;
+      for (;;) {
+        if (read(go_[0], &c, 1) != 1) {
+          _exit(0);
+        }
+        void* mem = mmap(nullptr, kTouchedBytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        memset(mem, 1, kTouchedBytes);
+        munmap(mem, kTouchedBytes);
+        if (write(done_[1], &c, 1) != 1) {
+          _exit(1);
+        }
+      }
+    }
+    close(go_[0]);
+    close(done_[1]);
+  }
+
+  ~Child() {
+    close(done_[0]);
+    if (pid_ != -1) {
+      Exit();
+    }
+  }
+
+  pid_t pid() const { return pid_; }
+
+  void TouchMemory() {
+    char c = ' ';
+    ASSERT_EQ(write(go_[1], &c, 1), 1);
+    ASSERT_EQ(read(done_[0], &c, 1), 1);
+  }
+
+  // Lets the child exit and waits for it.
+  void Exit() {
+    close(go_[1]);
+    int status;
+    ASSERT_EQ(waitpid(pid_, &status, 0), pid_);
+    go_[1] = -1;
+    pid_ = -1;
+  }
+
+ private:
+  pid_t pid_;
+  int go_[2];
+  int done_[2];
+};
+
+TEST(PerfCountersTest, ScalesMultiplexedCounts) {
+  EXPECT_EQ(PerfCounters::Scale(100, 10, 10), 100);
+  EXPECT_EQ(PerfCounters::Scale(100, 20, 10), 200);
+  EXPECT_EQ(PerfCounters::Scale(100, 10, 0), 0);
+}
+
+TEST(PerfCountersTest, CountsPageFaults) {
+  Child child;
+  absl::StatusOr<std::unique_ptr<PerfCounters>> counters =
+      PerfCounters::Open(child.pid(), /*enable_on_exec=*/false);
+  if (!counters.ok()) {
+    GTEST_SKIP() << "perf_event_open() not available: " << counters.status();
+  }
+  child.TouchMemory();
+  absl::StatusOr<PerfCounterValues> values = (*counters)->Read();
+  ASSERT_TRUE(values.ok()) << values.status();
+  EXPECT_GT(values->page_faults, 0);
+
+  // Still readable once the process is gone.
+  child.Exit();
+  absl::StatusOr<PerfCounterValues> final_values = (*counters)->Read();
+  ASSERT_TRUE(final_values.ok()) << final_values.status();
+  EXPECT_GE(final_values->page_faults, values->page_faults);
+}
+
+TEST(PerfCountersTest, WaitsForExec) {
+  Child child;
+  absl::StatusOr<std::unique_ptr<PerfCounters>> counters =
+      PerfCounters::Open(child.pid(), /*enable_on_exec=*/true);
+  if (!counters.ok()) {
+    GTEST_SKIP() << "perf_event_open() not available: " << counters.status();
+  }
+  child.TouchMemory();
+  absl::StatusOr<PerfCounterValues> values = (*counters)->Read();
+  ASSERT_TRUE(values.ok()) << values.status();
+  EXPECT_EQ(values->page_faults, 0);
+}
+
+}  // namespace
+}  // namespace sandbox2
@@ -22,13 +22,23 @@
 #include <sched.h>
 #include <syscall.h>
 
+#include <cstddef>
 #include <cstring>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
+#include "absl/base/attributes.h"
+#include "absl/base/const_init.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
 #include "absl/log/log.h"
+#include "absl/synchronization/mutex.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/bpfdisassembler.h"
+#include "sandboxed_api/sandbox2/bpfoptimizer.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
@@ -42,6 +52,10 @@
 #define SECCOMP_RET_USER_NOTIF 0x7fc00000U /* notifies userspace */
 #endif
 
+#ifndef SECCOMP_RET_ACTION_FULL
+#define SECCOMP_RET_ACTION_FULL 0xffff0000U
+#endif
+
 #define DO_USER_NOTIF BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_USER_NOTIF)
 
 ABSL_FLAG(bool, sandbox2_danger_danger_permit_all, false,
@@ -50,20 +64,94 @@ ABSL_FLAG(std::string, sandbox2_danger_danger_permit_all_and_log, "",
           "Allow all syscalls and log them into specified file");
 
 namespace sandbox2 {
+namespace {
 
-// The final policy is the concatenation of:
-//   1. default policy (GetDefaultPolicy, private),
-//   2. user policy (user_policy_, public),
-//   3. default KILL action (avoid failing open if user policy did not do it).
-std::vector<sock_filter> Policy::GetPolicy(bool user_notif) const {
+// Everything a compiled policy depends on, apart from the flags checked first.
+struct CompiledPolicyKey {
+  std::string user_policy;  // Raw instructions
+  bool user_notif;
+  bool layered;
+  bool profile_syscalls;
+  bool user_policy_handles_bpf;
+  bool user_policy_handles_ptrace;
+
+  auto Tie() const {
+    return std::tie(user_policy, user_notif, layered, profile_syscalls,
+                    user_policy_handles_bpf, user_policy_handles_ptrace);
+  }
+  bool operator==(const CompiledPolicyKey& other) const {
+    return Tie() == other.Tie();
+  }
+  template <typename H>
+  friend H AbslHashValue(H h, const CompiledPolicyKey& key) {
+    return H::combine(std::move(h), key.Tie());
+  }
+};
+
+// Services tend to create many sandboxes with identical policies, so compiled
+// policies are shared process-wide. Dropped all at once when full, as policies
+// rarely vary much within a process.
+constexpr size_t kMaxCachedPolicies = 64;
+
+ABSL_CONST_INIT absl::Mutex g_policy_cache_mutex(absl::kConstInit);
+
+absl::flat_hash_map<CompiledPolicyKey, std::vector<sock_filter>>&
+GetPolicyCache() ABSL_EXCLUSIVE_LOCKS_REQUIRED(g_policy_cache_mutex) {
+  static auto* cache =
+      new absl::flat_hash_map<CompiledPolicyKey, std::vector<sock_filter>>();
+  return *cache;
+}
+
+// Whether to leave out the checks of GetForkserverPolicy(). Sandboxees not
+// traced with ptrace get all of the default policy, as that reports other
+// archs through ptrace.
+bool UsesLayeredPolicy(bool user_notif, bool layered) {
+  return layered && !user_notif;
+}
+
+}  // namespace
+
+std::vector<sock_filter> Policy::GetPolicy(bool user_notif,
+                                           bool layered) const {
   if (absl::GetFlag(FLAGS_sandbox2_danger_danger_permit_all) ||
       !absl::GetFlag(FLAGS_sandbox2_danger_danger_permit_all_and_log).empty()) {
     return GetTrackingPolicy();
   }
+  layered = UsesLayeredPolicy(user_notif, layered);
 
+  CompiledPolicyKey key{
+      std::string(reinterpret_cast<const char*>(user_policy_.data()),
+                  user_policy_.size() * sizeof(sock_filter)),
+      user_notif, layered, profile_syscalls_, user_policy_handles_bpf_,
+      user_policy_handles_ptrace_};
+  {
+    absl::MutexLock lock(&g_policy_cache_mutex);
+    auto& cache = GetPolicyCache();
+    if (auto it = cache.find(key); it != cache.end()) {
+      return it->second;
+    }
+  }
+  // Compiled without holding the lock, concurrent misses just race to insert.
+  std::vector<sock_filter> policy = CompilePolicy(user_notif, layered);
+  absl::MutexLock lock(&g_policy_cache_mutex);
+  auto& cache = GetPolicyCache();
+  if (cache.size() >= kMaxCachedPolicies) {
+    cache.clear();
+  }
+  cache.emplace(std::move(key), policy);
+  return policy;
+}
+
+// The final policy is the concatenation of:
+//   1. default policy (GetDefaultPolicy, private),
+//   2. user policy (user_policy_, public),
+//   3. default KILL action (avoid failing open if user policy did not do it).
+std::vector<sock_filter> Policy::CompilePolicy(bool user_notif,
+                                               bool layered) const {
   // Now we can start building the policy.
   // 1. Start with the default policy (e.g. syscall architecture checks).
-  auto policy = GetDefaultPolicy(user_notif);
+  auto policy =
+      GetDefaultPolicy(user_notif, UsesLayeredPolicy(user_notif, layered));
   VLOG(3) << "Default policy:\n" << bpf::Disasm(policy);
 
   // 2. Append user policy.
@@ -75,15 +163,38 @@ std::vector<sock_filter> Policy::GetPolicy(bool user_notif) const {
   // 3. Finish with default KILL action.
   policy.push_back(KILL);
 
-  // In seccomp_unotify mode replace all KILLS with unotify
+  // When profiling, trace the syscalls allowed by the user policy, so that the
+  // monitor sees them.
+  if (profile_syscalls_ && !user_notif) {
+    for (auto it = policy.end() - user_policy_.size() - 1; it != policy.end();
+         ++it) {
+      if (it->code == BPF_RET + BPF_K && it->k == SECCOMP_RET_ALLOW) {
+        *it = TRACE(internal::kProfileTraceData);
+      }
+    }
+  }
+
+  // In seccomp_unotify mode replace all KILLS with unotify. So are the TRACEs of
+  // the user policy, which the monitor then tells apart by evaluating it.
   if (user_notif) {
     for (sock_filter& filter : policy) {
-      if (filter.code == BPF_RET + BPF_K && filter.k == SECCOMP_RET_KILL) {
+      if (filter.code != BPF_RET + BPF_K) {
+        continue;
+      }
+      if ((filter.k & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_KILL ||
+          (filter.k & SECCOMP_RET_ACTION_FULL) == SECCOMP_RET_TRACE) {
         filter = DO_USER_NOTIF;
       }
     }
   }
 
+  // Policies put together from many builder calls repeat loads and verdicts,
+  // which costs the kernel on every syscall.
+  const size_t unoptimized_size = policy.size();
+  policy = bpf::Optimize(policy);
+  VLOG(1) << "Optimized policy from " << unoptimized_size << " to "
+          << policy.size() << " instructions";
+
   VLOG(2) << "Final policy:\n" << bpf::Disasm(policy);
   return policy;
 }
@@ -95,7 +206,8 @@ std::vector<sock_filter> Policy::GetPolicy(bool user_notif) const {
 // for the __NR_execve syscall, so the tracer can make a decision to allow or
 // disallow it depending on which occurrence of __NR_execve it was.
 // LINT.IfChange
-std::vector<sock_filter> Policy::GetDefaultPolicy(bool user_notif) const {
+std::vector<sock_filter> Policy::GetDefaultPolicy(bool user_notif,
+                                                  bool layered) const {
   bpf_labels l = {0};
 
   std::vector<sock_filter> policy;
@@ -121,6 +233,27 @@ std::vector<sock_filter> Policy::GetDefaultPolicy(bool user_notif) const {
         ALLOW,
         LABEL(&l, past_execveat_l),
 
+        LOAD_SYSCALL_NR,
+    };
+  } else if (layered) {
+    policy = {
+        // GetForkserverPolicy() informs the Monitor of other archs. Allowing
+        // them here means that the forkserver policy decides, and that the
+        // data of a TRACE below cannot stand in for its report.
+        LOAD_ARCH,
+        JEQ32(Syscall::GetHostAuditArch(), JUMP(&l, past_arch_check_l)),
+        ALLOW,
+        LABEL(&l, past_arch_check_l),
+
+        LOAD_SYSCALL_NR,
+        JNE32(__NR_execveat, JUMP(&l, past_execveat_l)),
+        ARG_32(4),
+        JNE32(AT_EMPTY_PATH, JUMP(&l, past_execveat_l)),
+        ARG_32(5),
+        JNE32(internal::kExecveMagic, JUMP(&l, past_execveat_l)),
+        SANDBOX2_TRACE,
+        LABEL(&l, past_execveat_l),
+
         LOAD_SYSCALL_NR,
     };
   } else {
@@ -165,19 +298,24 @@ std::vector<sock_filter> Policy::GetDefaultPolicy(bool user_notif) const {
   if (!user_policy_handles_bpf_) {
     policy.insert(policy.end(), {JEQ32(__NR_bpf, DENY)});
   }
+  // Disallow clone with CLONE_UNTRACED flag, unless the forkserver policy
+  // does. This uses LOAD_SYSCALL_NR from above.
+  if (!layered) {
+    policy.insert(policy.end(),
+                  {
+                      JNE32(__NR_clone, JUMP(&l, past_clone_untraced_l)),
+                      // Regardless of arch, we only care about the lower
+                      // 32-bits of the flags.
+                      ARG_32(0),
+                      JA32(CLONE_UNTRACED, DENY),
+                      LABEL(&l, past_clone_untraced_l),
+                      LOAD_SYSCALL_NR,
+                  });
+  }
   policy.insert(policy.end(),
                 {
-                    // Disallow clone with CLONE_UNTRACED flag.  This uses
-                    // LOAD_SYSCALL_NR from above.
-                    JNE32(__NR_clone, JUMP(&l, past_clone_untraced_l)),
-                    // Regardless of arch, we only care about the lower 32-bits
-                    // of the flags.
-                    ARG_32(0),
-                    JA32(CLONE_UNTRACED, DENY),
-                    LABEL(&l, past_clone_untraced_l),
                     // Disallow seccomp with SECCOMP_FILTER_FLAG_NEW_LISTENER
-                    // flag.
-                    LOAD_SYSCALL_NR,
+                    // flag.  This uses LOAD_SYSCALL_NR from above.
                     JNE32(__NR_seccomp, JUMP(&l, past_seccomp_new_listener)),
                     // Regardless of arch, we only care about the lower 32-bits
                     // of the flags.
@@ -194,6 +332,35 @@ std::vector<sock_filter> Policy::GetDefaultPolicy(bool user_notif) const {
 }
 // LINT.ThenChange(monitor_ptrace.cc)
 
+std::vector<sock_filter> Policy::GetForkserverPolicy() {
+  bpf_labels l = {0};
+
+  std::vector<sock_filter> policy = {
+    // If compiled arch is different from the runtime one, inform the Monitor.
+    LOAD_ARCH,
+    JEQ32(Syscall::GetHostAuditArch(), JUMP(&l, past_arch_check_l)),
+#if defined(SAPI_X86_64)
+    JEQ32(AUDIT_ARCH_I386, TRACE(sapi::cpu::kX86)),  // 32-bit sandboxee
+#endif
+    TRACE(sapi::cpu::kUnknown),
+    LABEL(&l, past_arch_check_l),
+
+    // Disallow clone with CLONE_UNTRACED flag.
+    LOAD_SYSCALL_NR,
+    JNE32(__NR_clone, JUMP(&l, past_clone_untraced_l)),
+    // Regardless of arch, we only care about the lower 32-bits of the flags.
+    ARG_32(0),
+    JA32(CLONE_UNTRACED, DENY),
+    LABEL(&l, past_clone_untraced_l),
+    ALLOW,
+  };
+
+  if (bpf_resolve_jumps(&l, policy.data(), policy.size()) != 0) {
+    LOG(FATAL) << "Cannot resolve bpf jumps";
+  }
+  return policy;
+}
+
 std::vector<sock_filter> Policy::GetTrackingPolicy() const {
   return {
     LOAD_ARCH,
@@ -211,18 +378,6 @@ std::vector<sock_filter> Policy::GetTrackingPolicy() const {
   };
 }
 
-bool Policy::SendPolicy(Comms* comms, bool user_notif) const {
-  auto policy = GetPolicy(user_notif);
-  if (!comms->SendBytes(
-          reinterpret_cast<uint8_t*>(policy.data()),
-          static_cast<uint64_t>(policy.size()) * sizeof(sock_filter))) {
-    LOG(ERROR) << "Couldn't send policy";
-    return false;
-  }
-
-  return true;
-}
-
 void Policy::GetPolicyDescription(PolicyDescription* policy) const {
   policy->set_user_bpf_policy(user_policy_.data(),
                               user_policy_.size() * sizeof(sock_filter));
@@ -30,9 +30,13 @@
 #include "absl/base/macros.h"
 #include "absl/types/optional.h"
 #include "sandboxed_api/config.h"
+#include "sandboxed_api/sandbox2/logserver.h"
 #include "sandboxed_api/sandbox2/namespace.h"
 #include "sandboxed_api/sandbox2/network_proxy/filtering.h"
+#include "sandboxed_api/sandbox2/network_proxy/server.h"
+#include "sandboxed_api/sandbox2/open_broker.h"
 #include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/trace.h"
 #include "sandboxed_api/sandbox2/violation.pb.h"
 
 #define SANDBOX2_TRACE TRACE(::sandbox2::Syscall::GetHostArch())
@@ -43,10 +47,16 @@ namespace internal {
 // Magic values of registers when executing sys_execveat, so we can recognize
 // the pre-sandboxing state and notify the Monitor
 inline constexpr uintptr_t kExecveMagic = 0x921c2c34;
+// SECCOMP_RET_DATA of syscalls that are only traced to profile them. Outside of
+// the range of sapi::cpu::Architecture, which is used for other traced ones.
+inline constexpr uint16_t kProfileTraceData = 0xfffe;
+// SECCOMP_RET_DATA of the KILLs that the unotify monitor hands to the network
+// proxy and to the open broker. The kernel ignores it for kills, so outside of
+// the unotify monitor these stay violations.
+inline constexpr uint16_t kNetworkProxyKillData = 0xfffd;
+inline constexpr uint16_t kOpenBrokerKillData = 0xfffc;
 }  // namespace internal
 
-class Comms;
-
 class Policy final {
  public:
   // Stores information about the policy (and the policy builder if existing)
@@ -55,21 +65,28 @@ class Policy final {
 
  private:
   friend class Sandbox2;
+  friend class ForkServer;
   friend class MonitorBase;
   friend class PtraceMonitor;
   friend class UnotifyMonitor;
   friend class PolicyBuilder;
+  friend class PolicyPeer;  // For testing
   friend class StackTracePeer;
 
   // Private constructor only called by the PolicyBuilder.
   Policy() = default;
 
-  // Sends the policy over the IPC channel.
-  bool SendPolicy(Comms* comms, bool user_notif) const;
-
   // Returns the policy, but modifies it according to FLAGS and internal
   // requirements (message passing via Comms, Executor::WaitForExecve etc.).
-  std::vector<sock_filter> GetPolicy(bool user_notif) const;
+  // Compiled policies are cached process-wide, so that identical policies are
+  // only compiled once.
+  // If `layered`, the sandboxee already runs under GetForkserverPolicy(),
+  // and the checks done there are left out.
+  std::vector<sock_filter> GetPolicy(bool user_notif,
+                                     bool layered = false) const;
+  // Compiles the policy returned by GetPolicy(), bypassing the cache.
+  std::vector<sock_filter> CompilePolicy(bool user_notif,
+                                         bool layered = false) const;
 
   Namespace* GetNamespace() { return namespace_.get(); }
   void SetNamespace(std::unique_ptr<Namespace> ns) {
@@ -78,7 +95,13 @@ class Policy final {
 
   // Returns the default policy, which blocks certain dangerous syscalls and
   // mismatched syscall tables.
-  std::vector<sock_filter> GetDefaultPolicy(bool user_notif) const;
+  std::vector<sock_filter> GetDefaultPolicy(bool user_notif,
+                                            bool layered) const;
+  // Returns the part of the default policy that is the same for all
+  // sandboxees traced with ptrace. Installed once by the forkserver with
+  // --sandbox2_forkserver_default_policy, and inherited by every process it
+  // forks, so that their own policies can be shorter.
+  static std::vector<sock_filter> GetForkserverPolicy();
   // Returns a policy allowing the Monitor module to track all syscalls.
   std::vector<sock_filter> GetTrackingPolicy() const;
 
@@ -92,6 +115,11 @@ class Policy final {
   bool collect_stacktrace_on_timeout_ = true;
   bool collect_stacktrace_on_kill_ = true;
   bool collect_stacktrace_on_exit_ = false;
+  // Copy /proc/pid/maps of the main process into the Result.
+  bool collect_proc_maps_ = true;
+
+  // Trace allowed syscalls too, see Sandbox2::EnableSyscallProfiling().
+  bool profile_syscalls_ = false;
 
   // Optional pointer to a PolicyBuilder description pb object.
   std::unique_ptr<PolicyBuilderDescription> policy_builder_description_;
@@ -103,6 +131,21 @@ class Policy final {
 
   // Contains a list of hosts the sandboxee is allowed to connect to.
   absl::optional<AllowedHosts> allowed_hosts_;
+  // Set if the network proxy serves connect() through user notifications.
+  bool network_proxy_unotify_ = false;
+  // Set if the network proxy answers host name lookups.
+  bool network_proxy_dns_ = false;
+  // Set if the network proxy keeps connected sockets ready.
+  absl::optional<NetworkProxyPoolOptions> network_proxy_pool_options_;
+  // Set if the unotify monitor brokers open() and openat(). Shared by the
+  // sandboxes using the policy, so the directories are opened only once.
+  std::shared_ptr<OpenBroker> open_broker_;
+
+  // Limits of the messages forwarded from the sandboxee.
+  absl::optional<LogServerOptions> log_server_options_;
+
+  // Time spent in PolicyBuilder::TryBuild(), for Executor::set_trace_startup().
+  TraceSpan build_span_;
 };
 
 }  // namespace sandbox2
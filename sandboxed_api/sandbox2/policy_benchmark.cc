@@ -0,0 +1,108 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how many BPF instructions a typical policy costs per syscall.
+// Run with --benchmark_counters_tabular=true for a readable table.
+
+#include <linux/seccomp.h>
+#include <syscall.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/log/check.h"
+#include "sandboxed_api/sandbox2/policybuilder.h"
+#include "sandboxed_api/sandbox2/syscall.h"
+
+namespace sandbox2 {
+namespace {
+
+PolicyBuilder CreateTypicalPolicy() {
+  PolicyBuilder builder;
+  builder.AllowDynamicStartup()
+      .AllowSystemMalloc()
+      .AllowRead()
+      .AllowWrite()
+      .AllowOpen()
+      .AllowStat()
+      .AllowSafeFcntl()
+      .AllowEpoll()
+      .AllowEventFd()
+      .AllowTime()
+      .AllowSleep()
+      .AllowGetPIDs()
+      .AllowGetRandom()
+      .AllowHandleSignals()
+      .AllowExit();
+  return builder;
+}
+
+seccomp_data SyscallData(int nr) {
+  seccomp_data data = {};
+  data.nr = nr;
+  data.arch = Syscall::GetHostAuditArch();
+  return data;
+}
+
+// Roughly the syscall mix of an I/O bound sandboxee.
+std::vector<seccomp_data> CreateTypicalTrace() {
+  std::vector<seccomp_data> trace;
+  auto add = [&trace](int nr, int count) {
+    trace.insert(trace.end(), count, SyscallData(nr));
+  };
+  add(__NR_read, 400);
+  add(__NR_write, 300);
+  add(__NR_futex, 100);
+  add(__NR_epoll_pwait, 80);
+  add(__NR_clock_nanosleep, 40);
+  add(__NR_mmap, 30);
+  add(__NR_munmap, 30);
+  add(__NR_close, 20);
+  add(__NR_getpid, 10);
+  return trace;
+}
+
+void ReportCost(benchmark::State& state, const PolicyBuilder& builder,
+                const std::vector<seccomp_data>& trace) {
+  PolicyBuilder::PolicyCost cost;
+  for (auto _ : state) {
+    auto estimate = builder.EstimateCost(trace);
+    CHECK_OK(estimate.status());
+    cost = *estimate;
+  }
+  state.SetItemsProcessed(state.iterations() * trace.size());
+  state.counters["mean_insns"] = cost.mean_instructions;
+  state.counters["p99_insns"] = cost.p99_instructions;
+  state.counters["max_insns"] = cost.max_instructions;
+}
+
+void BM_TypicalTrace(benchmark::State& state) {
+  ReportCost(state, CreateTypicalPolicy(), CreateTypicalTrace());
+}
+BENCHMARK(BM_TypicalTrace);
+
+// Every syscall number once, so that denied syscalls count as much as
+// allowed ones.
+void BM_AllSyscalls(benchmark::State& state) {
+  std::vector<seccomp_data> trace;
+  for (int nr = 0; nr < state.range(0); ++nr) {
+    trace.push_back(SyscallData(nr));
+  }
+  ReportCost(state, CreateTypicalPolicy(), trace);
+}
+BENCHMARK(BM_AllSyscalls)->Arg(450);
+
+}  // namespace
+}  // namespace sandbox2
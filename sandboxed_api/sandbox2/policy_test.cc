@@ -14,7 +14,10 @@
 
 #include "sandboxed_api/sandbox2/policy.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <syscall.h>
 #include <unistd.h>
 
@@ -23,26 +26,51 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/limits.h"
+#include "sandboxed_api/sandbox2/notify.h"
 #include "sandboxed_api/sandbox2/policybuilder.h"
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/sandbox2/syscall.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 namespace sandbox2 {
+
+class PolicyPeer {
+ public:
+  static std::vector<sock_filter> CompilePolicy(const Policy& policy,
+                                                bool layered) {
+    return policy.CompilePolicy(/*user_notif=*/false, layered);
+  }
+  static std::vector<sock_filter> GetForkserverPolicy() {
+    return Policy::GetForkserverPolicy();
+  }
+};
+
 namespace {
 
+namespace fileops = ::sapi::file_util::fileops;
 using ::sapi::CreateDefaultPermissiveTestPolicy;
 using ::sapi::GetTestSourcePath;
+using ::sapi::IsOk;
 using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Lt;
+using ::testing::Ne;
+using ::testing::Not;
 
 #ifdef SAPI_X86_64
 // Test that 32-bit syscalls from 64-bit are disallowed.
@@ -122,6 +150,32 @@ TEST(PolicyTest, CloneUntracedDisallowed) {
   EXPECT_THAT(result.reason_code(), Eq(__NR_clone));
 }
 
+// Allows all traced syscalls.
+class AllowTracedNotify : public Notify {
+ public:
+  TraceAction EventSyscallTrace(const Syscall& syscall) override {
+    return TraceAction::kAllow;
+  }
+};
+
+// Test that tracing clone(2) doesn't allow CLONE_UNTRACED with unotify, where
+// both end up as notifications.
+TEST(PolicyTest, CloneUntracedDisallowedWhenTracedWithUnotify) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
+  std::vector<std::string> args = {path, "4"};
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      auto policy, CreateDefaultPermissiveTestPolicy(path)
+                       .AddPolicyOnSyscall(__NR_clone, {SANDBOX2_TRACE})
+                       .TryBuild());
+  Sandbox2 s2(std::make_unique<Executor>(path, args), std::move(policy),
+              std::make_unique<AllowTracedNotify>());
+  ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  auto result = s2.Run();
+
+  ASSERT_THAT(result.final_status(), Eq(Result::VIOLATION));
+  EXPECT_THAT(result.reason_code(), Eq(__NR_clone));
+}
+
 // Test that bpf(2) is disallowed.
 TEST(PolicyTest, BpfDisallowed) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
@@ -172,6 +226,145 @@ TEST(PolicyTest, IsattyAllowed) {
   ASSERT_THAT(result.final_status(), Eq(Result::OK));
 }
 
+TEST(PolicyTest, BrokeredOpenAllowsOnlyAddedFiles) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
+  // The broker only takes absolute paths.
+  const std::string allowed = fileops::MakeAbsolute(path, fileops::GetCWD());
+  std::vector<std::string> args = {path, "9", allowed};
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            sandbox2::PolicyBuilder()
+                                .AllowStaticStartup()
+                                .AllowExit()
+                                .AllowRead()
+                                .AllowWrite()
+                                .AllowSyscall(__NR_close)
+                                .AddBrokeredFile(allowed)
+                                .TryBuild());
+  Sandbox2 s2(std::make_unique<Executor>(path, args), std::move(policy));
+  ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  auto result = s2.Run();
+
+  ASSERT_THAT(result.final_status(), Eq(Result::OK));
+  EXPECT_THAT(result.reason_code(), Eq(0));
+}
+
+// Test that a KILL of openat(2) added before the broker's isn't taken for it.
+TEST(PolicyTest, BrokeredOpenKeepsEarlierKill) {
+  SKIP_SANITIZERS_AND_COVERAGE;
+  const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
+  const std::string allowed = fileops::MakeAbsolute(path, fileops::GetCWD());
+  std::vector<std::string> args = {path, "9", allowed};
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            sandbox2::PolicyBuilder()
+                                .AllowStaticStartup()
+                                .AllowExit()
+                                .AllowRead()
+                                .AllowWrite()
+                                .AllowSyscall(__NR_close)
+                                .AddPolicyOnSyscall(__NR_openat, {KILL})
+                                .AddBrokeredFile(allowed)
+                                .TryBuild());
+  Sandbox2 s2(std::make_unique<Executor>(path, args), std::move(policy));
+  ASSERT_THAT(s2.EnableUnotifyMonitor(), IsOk());
+  auto result = s2.Run();
+
+  ASSERT_THAT(result.final_status(), Eq(Result::VIOLATION));
+  EXPECT_THAT(result.reason_code(), Eq(__NR_openat));
+}
+
+// Returns a socket listening on a free port of 127.0.0.1, and the port.
+fileops::FDCloser ListenOnLoopback(int* port) {
+  fileops::FDCloser s(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  sockaddr_in addr = {.sin_family = AF_INET};
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (s.get() == -1 ||
+      bind(s.get(), reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+      getsockname(s.get(), reinterpret_cast<sockaddr*>(&addr), &len) != 0 ||
+      listen(s.get(), 1) != 0) {
+    return fileops::FDCloser();
+  }
+  *port = ntohs(addr.sin_port);
+  return s;
+}
+
+// Runs the testcase connecting to ip:port with the unotify monitor.
+absl::StatusOr<Result> RunConnect(PolicyBuilder& builder, absl::string_view ip,
+                                  int port) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
+  std::vector<std::string> args = {path, "10", std::string(ip),
+                                   absl::StrCat(port)};
+  SAPI_ASSIGN_OR_RETURN(std::unique_ptr<Policy> policy, builder.TryBuild());
+  Sandbox2 s2(std::make_unique<Executor>(path, args), std::move(policy));
+  SAPI_RETURN_IF_ERROR(s2.EnableUnotifyMonitor());
+  return s2.Run();
+}
+
+TEST(PolicyTest, NetworkProxyUnotifyConnectsToAllowedHost) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
+  int port;
+  fileops::FDCloser listener = ListenOnLoopback(&port);
+  ASSERT_THAT(listener.get(), Ne(-1));
+  PolicyBuilder builder = CreateDefaultPermissiveTestPolicy(path);
+  builder.AddNetworkProxyUnotifyPolicy().AllowIPv4("127.0.0.1");
+  SAPI_ASSERT_OK_AND_ASSIGN(Result result,
+                            RunConnect(builder, "127.0.0.1", port));
+
+  ASSERT_THAT(result.final_status(), Eq(Result::OK));
+  EXPECT_THAT(result.reason_code(), Eq(0));
+}
+
+TEST(PolicyTest, NetworkProxyUnotifyDisallowedHostIsViolation) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
+  int port;
+  fileops::FDCloser listener = ListenOnLoopback(&port);
+  ASSERT_THAT(listener.get(), Ne(-1));
+  PolicyBuilder builder = CreateDefaultPermissiveTestPolicy(path);
+  builder.AddNetworkProxyUnotifyPolicy().AllowIPv4("127.0.0.2");
+  SAPI_ASSERT_OK_AND_ASSIGN(Result result,
+                            RunConnect(builder, "127.0.0.1", port));
+
+  ASSERT_THAT(result.final_status(), Eq(Result::VIOLATION));
+  EXPECT_THAT(result.reason_code(), Eq(Result::VIOLATION_NETWORK));
+}
+
+// Test that a KILL of connect(2) added before the network proxy's isn't
+// taken for it.
+TEST(PolicyTest, NetworkProxyUnotifyKeepsEarlierKill) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/policy");
+  int port;
+  fileops::FDCloser listener = ListenOnLoopback(&port);
+  ASSERT_THAT(listener.get(), Ne(-1));
+  PolicyBuilder builder = CreateDefaultPermissiveTestPolicy(path);
+  builder.AddPolicyOnSyscall(__NR_connect, {KILL})
+      .AddNetworkProxyUnotifyPolicy()
+      .AllowIPv4("127.0.0.1");
+  SAPI_ASSERT_OK_AND_ASSIGN(Result result,
+                            RunConnect(builder, "127.0.0.1", port));
+
+  ASSERT_THAT(result.final_status(), Eq(Result::VIOLATION));
+  EXPECT_THAT(result.reason_code(), Eq(__NR_connect));
+}
+
+// Test that the checks done by the forkserver policy are left out of layered
+// policies.
+TEST(PolicyTest, LayeredPolicyIsShorter) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            PolicyBuilder().AllowExit().TryBuild());
+  std::vector<sock_filter> full =
+      PolicyPeer::CompilePolicy(*policy, /*layered=*/false);
+  std::vector<sock_filter> layered =
+      PolicyPeer::CompilePolicy(*policy, /*layered=*/true);
+  EXPECT_THAT(layered.size(), Lt(full.size()));
+
+  // Everything not denied by the forkserver policy is up to the sandboxee's.
+  std::vector<sock_filter> forkserver = PolicyPeer::GetForkserverPolicy();
+  ASSERT_THAT(forkserver, Not(IsEmpty()));
+  EXPECT_THAT(forkserver.back().code, Eq(BPF_RET | BPF_K));
+  EXPECT_THAT(forkserver.back().k, Eq(SECCOMP_RET_ALLOW));
+}
+
 std::unique_ptr<Policy> MinimalTestcasePolicy() {
   sandbox2::PolicyBuilder builder;
 
@@ -18,6 +18,7 @@
 #include <fcntl.h>       // For the fcntl flags
 #include <linux/filter.h>
 #include <linux/futex.h>
+#include <linux/userfaultfd.h>  // For UFFDIO_API and UFFDIO_REGISTER
 #include <linux/net.h>     // For SYS_CONNECT
 #include <linux/random.h>  // For GRND_NONBLOCK
 #include <sys/mman.h>      // For mmap arguments
@@ -29,12 +30,18 @@
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <csignal>
+#include <cstddef>
 #include <cstdint>
 #include <deque>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <numeric>
 #include <utility>
+#include <vector>
 
 #include "absl/log/log.h"
 #include "absl/memory/memory.h"
@@ -43,11 +50,15 @@
 #include "absl/strings/escaping.h"
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/allow_all_syscalls.h"
 #include "sandboxed_api/sandbox2/allow_unrestricted_networking.h"
+#include "sandboxed_api/sandbox2/bpfevaluator.h"
 #include "sandboxed_api/sandbox2/namespace.h"
 #include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/trace.h"
+#include "sandboxed_api/sandbox2/util/bpf_constexpr.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/status_macros.h"
@@ -58,6 +69,12 @@
 #include <asm/termbits.h>  // On PPC, TCGETS macro needs termios
 #endif
 
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
 #ifndef PR_SET_VMA
 #define PR_SET_VMA 0x53564d41
 #endif
@@ -79,6 +96,9 @@ constexpr std::array<uint32_t, 2> kMmapSyscalls = {
 #endif
 };
 
+// Labels of the mmap policies of the allocators.
+enum MmapPolicyLabel : uint32_t { kProtNone, kMmapEnd };
+
 bool CheckBpfBounds(const sock_filter& filter, size_t max_jmp) {
   if (BPF_CLASS(filter.code) == BPF_JMP) {
     if (BPF_OP(filter.code) == BPF_JA) {
@@ -89,6 +109,77 @@ bool CheckBpfBounds(const sock_filter& filter, size_t max_jmp) {
   return true;
 }
 
+struct SyscallRule {
+  uint32_t nr;
+  uint32_t action;
+  // Relative frequency of the syscall.
+  uint64_t weight;
+};
+
+// Emits a binary search over the syscall number in the A register, for rules
+// sorted by syscall number. Returns the action of the matching syscall, or
+// falls through if there is none. Splitting at the weighted median puts
+// frequent syscalls closer to the root.
+std::vector<sock_filter> BuildSyscallSearchTree(
+    absl::Span<const SyscallRule> rules) {
+  // Up to this many syscalls are compared one by one.
+  constexpr size_t kMaxLinearChain = 4;
+  constexpr size_t kMaxShortJump = 255;
+  std::vector<sock_filter> out;
+  if (rules.size() <= kMaxLinearChain) {
+    std::vector<SyscallRule> chain(rules.begin(), rules.end());
+    std::stable_sort(chain.begin(), chain.end(),
+                     [](const SyscallRule& a, const SyscallRule& b) {
+                       return a.weight > b.weight;
+                     });
+    for (const SyscallRule& rule : chain) {
+      out.push_back(BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, rule.nr, 0, 1));
+      out.push_back(BPF_STMT(BPF_RET + BPF_K, rule.action));
+    }
+    return out;
+  }
+  uint64_t total_weight = 0;
+  const SyscallRule* heaviest = &rules[0];
+  for (const SyscallRule& rule : rules) {
+    total_weight += rule.weight;
+    if (rule.weight > heaviest->weight) {
+      heaviest = &rule;
+    }
+  }
+  // A syscall making up most of the calls is best checked on its own first.
+  if (2 * heaviest->weight > total_weight) {
+    out.push_back(BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, heaviest->nr, 0, 1));
+    out.push_back(BPF_STMT(BPF_RET + BPF_K, heaviest->action));
+    std::vector<SyscallRule> rest(rules.begin(), heaviest);
+    rest.insert(rest.end(), heaviest + 1, rules.end());
+    std::vector<sock_filter> tree = BuildSyscallSearchTree(rest);
+    out.insert(out.end(), tree.begin(), tree.end());
+    return out;
+  }
+  size_t mid = 1;
+  for (uint64_t lower_weight = rules[0].weight;
+       mid < rules.size() - 1 && 2 * lower_weight < total_weight; ++mid) {
+    lower_weight += rules[mid].weight;
+  }
+  std::vector<sock_filter> lower = BuildSyscallSearchTree(rules.first(mid));
+  std::vector<sock_filter> upper =
+      BuildSyscallSearchTree(rules.subspan(mid));
+  // Falling through the lower half skips the upper one.
+  lower.push_back(
+      BPF_STMT(BPF_JMP + BPF_JA, static_cast<uint32_t>(upper.size())));
+  if (lower.size() <= kMaxShortJump) {
+    out.push_back(BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, rules[mid].nr,
+                           static_cast<uint8_t>(lower.size()), 0));
+  } else {
+    out.push_back(BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, rules[mid].nr, 0, 1));
+    out.push_back(
+        BPF_STMT(BPF_JMP + BPF_JA, static_cast<uint32_t>(lower.size())));
+  }
+  out.insert(out.end(), lower.begin(), lower.end());
+  out.insert(out.end(), upper.begin(), upper.end());
+  return out;
+}
+
 bool IsOnReadOnlyDev(const std::string& path) {
   struct statvfs vfs;
   if (TEMP_FAILURE_RETRY(statvfs(path.c_str(), &vfs)) == -1) {
@@ -108,11 +199,34 @@ PolicyBuilder& PolicyBuilder::Allow(UnrestrictedNetworking tag) {
 
 PolicyBuilder& PolicyBuilder::AllowSyscall(uint32_t num) {
   if (handled_syscalls_.insert(num).second) {
-    user_policy_.insert(user_policy_.end(), {SYSCALL(num, ALLOW)});
+    AddSyscallAction(num, SECCOMP_RET_ALLOW);
+    if (num == __NR_openat) {
+      allows_open_ = true;
+    }
+#ifdef __NR_open
+    if (num == __NR_open) {
+      allows_open_ = true;
+    }
+#endif
+#ifdef __NR_creat
+    if (num == __NR_creat) {
+      allows_open_ = true;
+    }
+#endif
   }
   return *this;
 }
 
+void PolicyBuilder::AddSyscallAction(uint32_t num, uint32_t action) {
+  // Rules can only be moved in front of the ones that don't cover the syscall.
+  if (policy_on_all_syscalls_ || syscalls_with_policy_.contains(num)) {
+    user_policy_.insert(user_policy_.end(),
+                        {SYSCALL(num, BPF_STMT(BPF_RET + BPF_K, action))});
+  } else {
+    syscall_actions_[num] = action;
+  }
+}
+
 PolicyBuilder& PolicyBuilder::AllowSyscalls(absl::Span<const uint32_t> nums) {
   for (auto num : nums) {
     AllowSyscall(num);
@@ -130,7 +244,7 @@ PolicyBuilder& PolicyBuilder::BlockSyscallsWithErrno(
 
 PolicyBuilder& PolicyBuilder::BlockSyscallWithErrno(uint32_t num, int error) {
   if (handled_syscalls_.insert(num).second) {
-    user_policy_.insert(user_policy_.end(), {SYSCALL(num, ERRNO(error))});
+    AddSyscallAction(num, SECCOMP_RET_ERRNO | (error & SECCOMP_RET_DATA));
     if (num == __NR_bpf) {
       user_policy_handles_bpf_ = true;
     }
@@ -212,27 +326,49 @@ PolicyBuilder& PolicyBuilder::AllowScudoMalloc() {
   AllowGetRandom();
   AllowWipeOnFork();
 
-  return AddPolicyOnMmap([](bpf_labels& labels) -> std::vector<sock_filter> {
-    return {
-        ARG_32(2),  // prot
-        JEQ32(PROT_NONE, JUMP(&labels, prot_none)),
-        JNE32(PROT_READ | PROT_WRITE, JUMP(&labels, mmap_end)),
+  static constexpr auto kMmapPolicy = bpf::ResolveJumps({
+      ARG_32(2),  // prot
+      JEQ32(PROT_NONE, bpf::Jump(kProtNone)),
+      JNE32(PROT_READ | PROT_WRITE, bpf::Jump(kMmapEnd)),
 
-        // PROT_READ | PROT_WRITE
-        ARG_32(3),  // flags
-        BPF_STMT(BPF_ALU | BPF_AND | BPF_K,
-                 ~uint32_t{MAP_FIXED | MAP_NORESERVE}),
-        JEQ32(MAP_PRIVATE | MAP_ANONYMOUS, ALLOW),
-        JUMP(&labels, mmap_end),
+      // PROT_READ | PROT_WRITE
+      ARG_32(3),  // flags
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K,
+               ~uint32_t{MAP_FIXED | MAP_NORESERVE}),
+      JEQ32(MAP_PRIVATE | MAP_ANONYMOUS, ALLOW),
+      bpf::Jump(kMmapEnd),
 
-        // PROT_NONE
-        LABEL(&labels, prot_none),
-        ARG_32(3),  // flags
-        JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
+      // PROT_NONE
+      bpf::Label(kProtNone),
+      ARG_32(3),  // flags
+      JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
 
-        LABEL(&labels, mmap_end),
-    };
+      bpf::Label(kMmapEnd),
+  });
+  return AddPolicyOnMmap(kMmapPolicy);
+}
+
+PolicyBuilder& PolicyBuilder::AllowSharedMemoryMappings() {
+  static constexpr auto kMmapPolicy = bpf::ResolveJumps({
+      ARG_32(3),  // flags
+      JNE32(MAP_SHARED, bpf::Jump(kMmapEnd)),
+      ARG_32(2),  // prot
+      JEQ32(PROT_READ, ALLOW),
+      JEQ32(PROT_READ | PROT_WRITE, ALLOW),
+      bpf::Label(kMmapEnd),
+  });
+  return AddPolicyOnMmap(kMmapPolicy);
+}
+
+PolicyBuilder& PolicyBuilder::AllowReadOnlySharedMemoryMappings() {
+  static constexpr auto kMmapPolicy = bpf::ResolveJumps({
+      ARG_32(3),  // flags
+      JNE32(MAP_SHARED, bpf::Jump(kMmapEnd)),
+      ARG_32(2),  // prot
+      JEQ32(PROT_READ, ALLOW),
+      bpf::Label(kMmapEnd),
   });
+  return AddPolicyOnMmap(kMmapPolicy);
 }
 
 PolicyBuilder& PolicyBuilder::AllowTcMalloc() {
@@ -248,26 +384,25 @@ PolicyBuilder& PolicyBuilder::AllowTcMalloc() {
                                         JEQ32(PROT_NONE, ALLOW),
                                     });
 
-  return AddPolicyOnMmap([](bpf_labels& labels) -> std::vector<sock_filter> {
-    return {
-        ARG_32(2),  // prot
-        JEQ32(PROT_NONE, JUMP(&labels, prot_none)),
-        JNE32(PROT_READ | PROT_WRITE, JUMP(&labels, mmap_end)),
+  static constexpr auto kMmapPolicy = bpf::ResolveJumps({
+      ARG_32(2),  // prot
+      JEQ32(PROT_NONE, bpf::Jump(kProtNone)),
+      JNE32(PROT_READ | PROT_WRITE, bpf::Jump(kMmapEnd)),
 
-        // PROT_READ | PROT_WRITE
-        ARG_32(3),  // flags
-        JNE32(MAP_ANONYMOUS | MAP_PRIVATE, JUMP(&labels, mmap_end)),
-        ALLOW,
+      // PROT_READ | PROT_WRITE
+      ARG_32(3),  // flags
+      JNE32(MAP_ANONYMOUS | MAP_PRIVATE, bpf::Jump(kMmapEnd)),
+      ALLOW,
 
-        // PROT_NONE
-        LABEL(&labels, prot_none),
-        ARG_32(3),  // flags
-        JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
-        JEQ32(MAP_ANONYMOUS | MAP_PRIVATE, ALLOW),
+      // PROT_NONE
+      bpf::Label(kProtNone),
+      ARG_32(3),  // flags
+      JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
+      JEQ32(MAP_ANONYMOUS | MAP_PRIVATE, ALLOW),
 
-        LABEL(&labels, mmap_end),
-    };
+      bpf::Label(kMmapEnd),
   });
+  return AddPolicyOnMmap(kMmapPolicy);
 }
 
 PolicyBuilder& PolicyBuilder::AllowSystemMalloc() {
@@ -277,24 +412,23 @@ PolicyBuilder& PolicyBuilder::AllowSystemMalloc() {
                                       ARG_32(3),
                                       JEQ32(MREMAP_MAYMOVE, ALLOW),
                                   });
-  return AddPolicyOnMmap([](bpf_labels& labels) -> std::vector<sock_filter> {
-    return {
-        ARG_32(2),  // prot
-        JEQ32(PROT_NONE, JUMP(&labels, prot_none)),
-        JNE32(PROT_READ | PROT_WRITE, JUMP(&labels, mmap_end)),
+  static constexpr auto kMmapPolicy = bpf::ResolveJumps({
+      ARG_32(2),  // prot
+      JEQ32(PROT_NONE, bpf::Jump(kProtNone)),
+      JNE32(PROT_READ | PROT_WRITE, bpf::Jump(kMmapEnd)),
 
-        // PROT_READ | PROT_WRITE
-        ARG_32(3),  // flags
-        JEQ32(MAP_ANONYMOUS | MAP_PRIVATE, ALLOW),
+      // PROT_READ | PROT_WRITE
+      ARG_32(3),  // flags
+      JEQ32(MAP_ANONYMOUS | MAP_PRIVATE, ALLOW),
 
-        // PROT_NONE
-        LABEL(&labels, prot_none),
-        ARG_32(3),  // flags
-        JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
+      // PROT_NONE
+      bpf::Label(kProtNone),
+      ARG_32(3),  // flags
+      JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
 
-        LABEL(&labels, mmap_end),
-    };
+      bpf::Label(kMmapEnd),
   });
+  return AddPolicyOnMmap(kMmapPolicy);
 
   return *this;
 }
@@ -783,6 +917,12 @@ PolicyBuilder& PolicyBuilder::AllowWipeOnFork() {
                             });
 }
 
+PolicyBuilder& PolicyBuilder::AllowLogForwarding(
+    const LogServerOptions& options) {
+  log_server_options_ = options;
+  return AllowLogForwarding();
+}
+
 PolicyBuilder& PolicyBuilder::AllowLogForwarding() {
   AllowWrite();
   AllowSystemMalloc();
@@ -838,6 +978,24 @@ PolicyBuilder& PolicyBuilder::AllowPoll() {
   return *this;
 }
 
+PolicyBuilder& PolicyBuilder::AllowIoUring() {
+  return AllowSyscall(__NR_io_uring_enter);
+}
+
+PolicyBuilder& PolicyBuilder::AllowUserfaultfd() {
+  AddPolicyOnSyscall(__NR_userfaultfd,
+                     {
+                         ARG_32(0),
+                         JEQ32(O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY,
+                               ALLOW),
+                     });
+  return AddPolicyOnSyscall(__NR_ioctl, {
+                                            ARG_32(1),
+                                            JEQ32(UFFDIO_API, ALLOW),
+                                            JEQ32(UFFDIO_REGISTER, ALLOW),
+                                        });
+}
+
 PolicyBuilder& PolicyBuilder::AllowRename() {
   AllowSyscalls({
 #ifdef __NR_rename
@@ -1115,6 +1273,10 @@ PolicyBuilder& PolicyBuilder::AddPolicyOnSyscalls(
     out.push_front(BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, *it, jt, jf));
   }
   user_policy_.insert(user_policy_.end(), out.begin(), out.end());
+  syscalls_with_policy_.insert(nums.begin(), nums.end());
+  if (nums.empty()) {
+    policy_on_all_syscalls_ = true;
+  }
   return *this;
 }
 
@@ -1132,6 +1294,15 @@ PolicyBuilder& PolicyBuilder::AddPolicyOnMmap(BpfFunc f) {
   return AddPolicyOnSyscalls(kMmapSyscalls, f);
 }
 
+PolicyBuilder& PolicyBuilder::SetSyscallProfile(
+    const SyscallProfile& profile) {
+  syscall_counts_.clear();
+  for (const SyscallProfile::Entry& entry : profile.entries()) {
+    syscall_counts_[entry.nr()] += entry.count();
+  }
+  return *this;
+}
+
 PolicyBuilder& PolicyBuilder::DangerDefaultAllowAll() {
   return DefaultAction(AllowAllSyscalls());
 }
@@ -1171,13 +1342,70 @@ std::vector<sock_filter> PolicyBuilder::ResolveBpfFunc(BpfFunc f) {
   return policy;
 }
 
+std::vector<sock_filter> PolicyBuilder::BuildUserPolicy() const {
+  // Syscalls that are decided by their number alone are looked up with a
+  // binary search first, instead of being compared one after the other.
+  std::vector<SyscallRule> rules;
+  rules.reserve(syscall_actions_.size());
+  for (const auto& [nr, action] : syscall_actions_) {
+    auto it = syscall_counts_.find(nr);
+    // Unprofiled syscalls still count, for a balanced tree without a profile.
+    rules.push_back({nr, action,
+                     (it != syscall_counts_.end() ? it->second : 0) + 1});
+  }
+  std::vector<sock_filter> user_policy = BuildSyscallSearchTree(rules);
+  user_policy.insert(user_policy.end(), user_policy_.begin(),
+                     user_policy_.end());
+  if (default_action_) {
+    user_policy.push_back(*default_action_);
+  }
+  user_policy.insert(user_policy.end(), overridable_policy_.begin(),
+                     overridable_policy_.end());
+  return user_policy;
+}
+
+absl::StatusOr<PolicyBuilder::PolicyCost> PolicyBuilder::EstimateCost(
+    absl::Span<const seccomp_data> trace) const {
+  if (!last_status_.ok()) {
+    return last_status_;
+  }
+  Policy policy;
+  policy.user_policy_ = BuildUserPolicy();
+  policy.user_policy_handles_bpf_ = user_policy_handles_bpf_;
+  policy.user_policy_handles_ptrace_ = user_policy_handles_ptrace_;
+  std::vector<sock_filter> prog = policy.CompilePolicy(/*user_notif=*/false);
+
+  PolicyCost cost;
+  SAPI_ASSIGN_OR_RETURN(cost.max_instructions, bpf::MaxPathLength(prog));
+  if (trace.empty()) {
+    return cost;
+  }
+  std::vector<size_t> instructions;
+  instructions.reserve(trace.size());
+  for (const seccomp_data& data : trace) {
+    SAPI_ASSIGN_OR_RETURN(bpf::Evaluation evaluation,
+                          bpf::Evaluate(prog, data));
+    instructions.push_back(evaluation.instructions);
+  }
+  cost.mean_instructions =
+      static_cast<double>(std::accumulate(instructions.begin(),
+                                          instructions.end(), size_t{0})) /
+      instructions.size();
+  auto p99 = instructions.begin() + instructions.size() * 99 / 100;
+  std::nth_element(instructions.begin(), p99, instructions.end());
+  cost.p99_instructions = *p99;
+  return cost;
+}
+
 absl::StatusOr<std::unique_ptr<Policy>> PolicyBuilder::TryBuild() {
+  const int64_t start_ns = MonotonicNowNs();
   // Using `new` to access a non-public constructor.
   auto output = absl::WrapUnique(new Policy());
 
-  if (user_policy_.size() > kMaxUserPolicyLength) {
+  std::vector<sock_filter> user_policy = BuildUserPolicy();
+  if (user_policy.size() > kMaxUserPolicyLength) {
     return absl::FailedPreconditionError(
-        absl::StrCat("User syscall policy is to long (", user_policy_.size(),
+        absl::StrCat("User syscall policy is to long (", user_policy.size(),
                      " > ", kMaxUserPolicyLength, ")."));
   }
 
@@ -1189,11 +1417,33 @@ absl::StatusOr<std::unique_ptr<Policy>> PolicyBuilder::TryBuild() {
     return absl::FailedPreconditionError("Can only build policy once.");
   }
 
+  // The sandboxee could bypass the broker and open any file of its mount
+  // namespace directly.
+  if (open_broker_ != nullptr && allows_open_) {
+    return absl::FailedPreconditionError(
+        "AddBrokeredFile() and AddBrokeredDirectory() cannot be combined with "
+        "AllowOpen()");
+  }
+
+  // Sandboxees would modify the tree they share with each other.
+  if (mounts_.HasPrebuiltRoot() && !mounts_.IsRootReadOnly()) {
+    return absl::FailedPreconditionError(
+        "SetPrebuiltRoot() cannot be combined with SetRootWritable()");
+  }
+
   if (use_namespaces_) {
     if (allow_unrestricted_networking_ && hostname_ != kDefaultHostname) {
       return absl::FailedPreconditionError(
           "Cannot set hostname without network namespaces.");
     }
+    if (coalesce_mounts_) {
+      int saved = mounts_.CoalesceFileMounts(mounts_staging_dir_);
+      VLOG(1) << "Coalescing saved " << saved << " mounts";
+    }
+    if (prewarm_max_bytes_ > 0) {
+      size_t bytes = mounts_.Prewarm(prewarm_max_bytes_);
+      VLOG(1) << "Prewarming " << bytes << " bytes of mounted files";
+    }
     output->SetNamespace(std::make_unique<Namespace>(
         allow_unrestricted_networking_, std::move(mounts_), hostname_,
         allow_mount_propagation_));
@@ -1209,13 +1459,8 @@ absl::StatusOr<std::unique_ptr<Policy>> PolicyBuilder::TryBuild() {
   output->collect_stacktrace_on_timeout_ = collect_stacktrace_on_timeout_;
   output->collect_stacktrace_on_kill_ = collect_stacktrace_on_kill_;
   output->collect_stacktrace_on_exit_ = collect_stacktrace_on_exit_;
-  output->user_policy_ = std::move(user_policy_);
-  if (default_action_) {
-    output->user_policy_.push_back(*default_action_);
-  }
-  output->user_policy_.insert(output->user_policy_.end(),
-                              overridable_policy_.begin(),
-                              overridable_policy_.end());
+  output->collect_proc_maps_ = collect_proc_maps_;
+  output->user_policy_ = std::move(user_policy);
   output->user_policy_handles_bpf_ = user_policy_handles_bpf_;
   output->user_policy_handles_ptrace_ = user_policy_handles_ptrace_;
 
@@ -1224,6 +1469,13 @@ absl::StatusOr<std::unique_ptr<Policy>> PolicyBuilder::TryBuild() {
   StoreDescription(pb_description.get());
   output->policy_builder_description_ = std::move(pb_description);
   output->allowed_hosts_ = std::move(allowed_hosts_);
+  output->network_proxy_unotify_ = network_proxy_unotify_;
+  output->network_proxy_dns_ = network_proxy_dns_;
+  output->network_proxy_pool_options_ = network_proxy_pool_options_;
+  output->open_broker_ = std::move(open_broker_);
+  output->log_server_options_ = log_server_options_;
+  output->build_span_ = {"PolicyBuilder::TryBuild", start_ns, MonotonicNowNs(),
+                         getpid()};
   already_built_ = true;
   return std::move(output);
 }
@@ -1332,16 +1584,80 @@ PolicyBuilder& PolicyBuilder::AddDirectoryAt(absl::string_view outside,
   return *this;
 }
 
-PolicyBuilder& PolicyBuilder::AddTmpfs(absl::string_view inside, size_t size) {
+PolicyBuilder& PolicyBuilder::AddBrokeredFile(absl::string_view path,
+                                              bool is_ro) {
+  return AddBrokeredPath(path, /*is_dir=*/false, is_ro);
+}
+
+PolicyBuilder& PolicyBuilder::AddBrokeredDirectory(absl::string_view path,
+                                                   bool is_ro) {
+  return AddBrokeredPath(path, /*is_dir=*/true, is_ro);
+}
+
+PolicyBuilder& PolicyBuilder::AddBrokeredPath(absl::string_view path,
+                                              bool is_dir, bool is_ro) {
+  auto valid_path = ValidateAbsolutePath(path);
+  if (!valid_path.ok()) {
+    SetError(valid_path.status());
+    return *this;
+  }
+  if (open_broker_ == nullptr) {
+    open_broker_ = std::make_shared<OpenBroker>();
+    // The unotify monitor turns KILL into a user notification, which it hands
+    // to the broker if the whole policy ends up at this very KILL.
+    const sock_filter broker_kill =
+        BPF_STMT(BPF_RET + BPF_K,
+                 SECCOMP_RET_KILL | internal::kOpenBrokerKillData);
+#ifdef __NR_open
+    AddPolicyOnSyscall(__NR_open, {broker_kill});
+#endif
+    AddPolicyOnSyscall(__NR_openat, {broker_kill});
+  }
+  if (absl::Status status = open_broker_->Allow(*valid_path, is_dir, is_ro);
+      !status.ok()) {
+    SetError(status);
+  }
+  return *this;
+}
+
+PolicyBuilder& PolicyBuilder::AddTmpfs(absl::string_view inside, size_t size,
+                                       absl::string_view seed) {
   EnableNamespaces();  // NOLINT(clang-diagnostic-deprecated-declarations)
 
-  if (auto status = mounts_.AddTmpfs(inside, size); !status.ok()) {
+  if (auto status = mounts_.AddTmpfs(inside, size, seed); !status.ok()) {
     SetError(absl::InternalError(absl::StrCat("Could not mount tmpfs ", inside,
                                               ": ", status.message())));
   }
   return *this;
 }
 
+PolicyBuilder& PolicyBuilder::CoalesceMounts(absl::string_view staging_dir) {
+  if (!staging_dir.empty()) {
+    auto valid_dir = ValidateAbsolutePath(staging_dir);
+    if (!valid_dir.ok()) {
+      SetError(valid_dir.status());
+      return *this;
+    }
+    mounts_staging_dir_ = *std::move(valid_dir);
+  }
+  coalesce_mounts_ = true;
+  return *this;
+}
+
+PolicyBuilder& PolicyBuilder::PrewarmMounts(size_t max_bytes) {
+  prewarm_max_bytes_ = max_bytes;
+  return *this;
+}
+
+PolicyBuilder& PolicyBuilder::SetPrebuiltRoot(absl::string_view outside) {
+  EnableNamespaces();  // NOLINT(clang-diagnostic-deprecated-declarations)
+
+  if (auto status = mounts_.SetPrebuiltRoot(outside); !status.ok()) {
+    SetError(status);
+  }
+  return *this;
+}
+
 // Use Allow(UnrestrictedNetworking()) instead.
 PolicyBuilder& PolicyBuilder::AllowUnrestrictedNetworking() {
   return Allow(UnrestrictedNetworking());
@@ -1379,11 +1695,16 @@ PolicyBuilder& PolicyBuilder::CollectStacktracesOnExit(bool enable) {
   return *this;
 }
 
+PolicyBuilder& PolicyBuilder::CollectProcMaps(bool enable) {
+  collect_proc_maps_ = enable;
+  return *this;
+}
+
 PolicyBuilder& PolicyBuilder::AddNetworkProxyPolicy() {
   if (allowed_hosts_) {
     SetError(absl::FailedPreconditionError(
-        "AddNetworkProxyPolicy or AddNetworkProxyHandlerPolicy can be called "
-        "at most once"));
+        "AddNetworkProxyPolicy, AddNetworkProxyHandlerPolicy or "
+        "AddNetworkProxyUnotifyPolicy can be called at most once"));
     return *this;
   }
 
@@ -1448,6 +1769,31 @@ PolicyBuilder& PolicyBuilder::AddNetworkProxyHandlerPolicy() {
   return *this;
 }
 
+PolicyBuilder& PolicyBuilder::AddNetworkProxyUnotifyPolicy() {
+  if (allowed_hosts_) {
+    SetError(absl::FailedPreconditionError(
+        "AddNetworkProxyPolicy, AddNetworkProxyHandlerPolicy or "
+        "AddNetworkProxyUnotifyPolicy can be called at most once"));
+    return *this;
+  }
+
+  allowed_hosts_ = AllowedHosts();
+  network_proxy_unotify_ = true;
+
+  AddPolicyOnSyscall(__NR_socket, {
+                                      ARG_32(0),
+                                      JEQ32(AF_INET, ALLOW),
+                                      JEQ32(AF_INET6, ALLOW),
+                                  });
+  // The unotify monitor turns KILL into a user notification, which it hands
+  // to the network proxy if the whole policy ends up at this very KILL.
+  AddPolicyOnSyscall(
+      __NR_connect,
+      {BPF_STMT(BPF_RET + BPF_K,
+                SECCOMP_RET_KILL | internal::kNetworkProxyKillData)});
+  return *this;
+}
+
 PolicyBuilder& PolicyBuilder::TrapPtrace() {
   AddPolicyOnSyscall(__NR_ptrace, {TRAP(0)});
   user_policy_handles_ptrace_ = true;
@@ -1499,6 +1845,36 @@ PolicyBuilder& PolicyBuilder::AllowIPv6(const std::string& ip_and_mask,
   return *this;
 }
 
+PolicyBuilder& PolicyBuilder::EnableNetworkProxyConnectionPool(
+    const NetworkProxyPoolOptions& options) {
+  if (!allowed_hosts_) {
+    SetError(absl::FailedPreconditionError(
+        "AddNetworkProxyPolicy or AddNetworkProxyHandlerPolicy must be called "
+        "before enabling the connection pool"));
+    return *this;
+  }
+  if (options.connections_per_destination <= 0 ||
+      options.max_destinations <= 0 ||
+      options.idle_timeout <= absl::ZeroDuration()) {
+    SetError(absl::InvalidArgumentError(
+        "Connection pool options must be positive"));
+    return *this;
+  }
+  network_proxy_pool_options_ = options;
+  return *this;
+}
+
+PolicyBuilder& PolicyBuilder::AllowNetworkProxyDnsResolution() {
+  if (!allowed_hosts_) {
+    SetError(absl::FailedPreconditionError(
+        "AddNetworkProxyPolicy or AddNetworkProxyHandlerPolicy must be called "
+        "before allowing DNS resolution"));
+    return *this;
+  }
+  network_proxy_dns_ = true;
+  return *this;
+}
+
 PolicyBuilder& PolicyBuilder::SetError(const absl::Status& status) {
   LOG(ERROR) << status;
   last_status_ = status;
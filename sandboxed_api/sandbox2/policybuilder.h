@@ -16,10 +16,12 @@
 #define SANDBOXED_API_SANDBOX2_POLICYBUILDER_H_
 
 #include <linux/filter.h>
+#include <linux/seccomp.h>
 
 #include <cstddef>
 #include <functional>
 #include <initializer_list>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -27,6 +29,7 @@
 #include <vector>
 
 #include "absl/base/macros.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
 #include "absl/status/statusor.h"
@@ -34,7 +37,9 @@
 #include "absl/types/span.h"
 #include "sandboxed_api/sandbox2/mounts.h"
 #include "sandboxed_api/sandbox2/network_proxy/filtering.h"
+#include "sandboxed_api/sandbox2/open_broker.h"
 #include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/syscall_profile.pb.h"
 
 struct bpf_labels;
 
@@ -246,6 +251,18 @@ class PolicyBuilder final {
   // on architectures where this syscalls exist.
   PolicyBuilder& AllowMmap();
 
+  // Appends code to allow mapping shared memory for reading and writing, e.g.
+  // the memfds of sandbox2::Buffer or sapi::v::SharedArray. Executable shared
+  // mappings are still not allowed.
+  // Allows these syscalls:
+  // - mmap, mmap2 (only MAP_SHARED with PROT_READ or PROT_READ | PROT_WRITE)
+  PolicyBuilder& AllowSharedMemoryMappings();
+
+  // Like AllowSharedMemoryMappings(), but only allows read-only mappings.
+  // Allows these syscalls:
+  // - mmap, mmap2 (only MAP_SHARED with PROT_READ)
+  PolicyBuilder& AllowReadOnlySharedMemoryMappings();
+
   // Appends code to allow calling futex with the given operation.
   PolicyBuilder& AllowFutexOp(int op);
 
@@ -480,6 +497,13 @@ class PolicyBuilder final {
   // - gettid
   // - close
   PolicyBuilder& AllowLogForwarding();
+  // Like above, but also limits how much the sandboxee can log through the log
+  // server enabled with IPC::EnableLogServer().
+  //
+  // Example:
+  //   builder.AllowLogForwarding({.messages_per_second = 100,
+  //                               .sample_every_n = 10});
+  PolicyBuilder& AllowLogForwarding(const LogServerOptions& options);
 
   // Appends code to allow deleting files and directories.
   // Allows these syscalls:
@@ -507,6 +531,26 @@ class PolicyBuilder final {
   // - ppoll
   PolicyBuilder& AllowPoll();
 
+  // Appends code to allow using io_uring instances that were set up before
+  // the policy was applied, see sandbox2::RestrictedIoUring, which also
+  // discusses the risks. Operations on these rings bypass the policy.
+  // Allows these syscalls:
+  // - io_uring_enter
+  // New rings cannot be created (io_uring_setup) nor existing ones changed
+  // (io_uring_register), so only use this with rings that restrict what they
+  // can do.
+  PolicyBuilder& AllowIoUring();
+
+  // Appends code to allow userfaultfds which only handle faults in user mode,
+  // and registering memory with them for missing pages, as sapi::v::LazyArray
+  // needs. Faults in the kernel, e.g. while a syscall copies from the memory,
+  // fail with EFAULT instead of waiting for the userfaultfd, so the sandboxee
+  // can't stall kernel code with it.
+  // Allows these syscalls:
+  // - userfaultfd (only with UFFD_USER_MODE_ONLY)
+  // - ioctl (only UFFDIO_API and UFFDIO_REGISTER)
+  PolicyBuilder& AllowUserfaultfd();
+
   // Appends code to allow setting the name of a thread
   // Allows the following
   // - prctl(PR_SET_NAME, ...)
@@ -542,7 +586,8 @@ class PolicyBuilder final {
   // Appends a policy, which will be run on the specified syscall.
   // This policy must be written without labels. If you need labels, use
   // the overloaded function passing a BpfFunc object instead of the
-  // sock_filter.
+  // sock_filter, or resolve them at compile time with bpf::ResolveJumps() from
+  // util/bpf_constexpr.h.
   PolicyBuilder& AddPolicyOnSyscall(uint32_t num,
                                     absl::Span<const sock_filter> policy);
 
@@ -593,6 +638,22 @@ class PolicyBuilder final {
   // called once.
   absl::StatusOr<std::unique_ptr<Policy>> TryBuild();
 
+  // Number of BPF instructions the kernel runs per syscall for the policy
+  // built so far, default policy included.
+  struct PolicyCost {
+    // Over all paths through the policy, i.e. the worst case.
+    size_t max_instructions = 0;
+    // Over the syscalls passed to EstimateCost(), if any.
+    double mean_instructions = 0;
+    size_t p99_instructions = 0;
+  };
+
+  // Estimates the cost of the policy, by running it in a userspace BPF
+  // interpreter on `trace`, e.g. syscalls recorded from a sandboxee. Can be
+  // called any time before TryBuild(), e.g. to catch cost regressions in tests.
+  absl::StatusOr<PolicyCost> EstimateCost(
+      absl::Span<const seccomp_data> trace = {}) const;
+
   // Builds the policy returning a unique_ptr to it. This should only be
   // called once. This function will abort if an error happened in any of the
   // PolicyBuilder methods.
@@ -635,11 +696,49 @@ class PolicyBuilder final {
   PolicyBuilder& AddDirectoryAt(absl::string_view outside,
                                 absl::string_view inside, bool is_ro = true);
 
+  // Lets the sandboxee open() a file, or anything below a directory, of the
+  // host without mounting it. Calls of open() and openat() are held by a
+  // seccomp user notification while the monitor opens the file with an
+  // OpenBroker and installs the descriptor in the sandboxee. The sandboxee
+  // uses the host's paths, which must be absolute, and opens of all other
+  // paths fail with EACCES, as do relative paths and opens for writing when
+  // `is_ro`. Only regular files can be opened. Needs
+  // Sandbox2::EnableUnotifyMonitor(), and TryBuild() fails if combined with
+  // AllowOpen(). With other monitors, open() is a violation.
+  PolicyBuilder& AddBrokeredFile(absl::string_view path, bool is_ro = true);
+  PolicyBuilder& AddBrokeredDirectory(absl::string_view path,
+                                      bool is_ro = true);
+
   // Adds a tmpfs inside the namespace. This will also create parent
-  // directories inside the namespace if needed.
+  // directories inside the namespace if needed. With a seed directory (an
+  // absolute path), the tmpfs starts out with its contents without copying
+  // them for each sandboxee, see Mounts::AddTmpfs().
+  //
+  // Calling this function will enable use of namespaces.
+  PolicyBuilder& AddTmpfs(absl::string_view inside, size_t size,
+                          absl::string_view seed = {});
+
+  // Replaces the read-only file mounts of a directory by a single read-only
+  // directory mount where possible, so that sandboxes start faster. With a
+  // staging_dir (an absolute path), files from different outside directories
+  // are linked into it, see Mounts::CoalesceFileMounts(). Has no effect if the
+  // root is writable.
+  PolicyBuilder& CoalesceMounts(absl::string_view staging_dir = {});
+
+  // Starts reading the files and directories mounted so far into the page
+  // cache when the policy is built, up to max_bytes in total, so that the
+  // first sandboxes after a deployment don't wait for a cold disk. The reads
+  // complete in the background, see Mounts::Prewarm().
+  PolicyBuilder& PrewarmMounts(size_t max_bytes = size_t{1} << 30);
+
+  // Uses a prebuilt tree, e.g. a mounted image created with build_root_image,
+  // as the root of the sandboxee instead of assembling it from individual
+  // mounts. Files and directories added to the policy are still mounted on
+  // top, see Mounts::SetPrebuiltRoot(). Cannot be combined with
+  // SetRootWritable(), as the tree is shared by all sandboxees using it.
   //
   // Calling this function will enable use of namespaces.
-  PolicyBuilder& AddTmpfs(absl::string_view inside, size_t size);
+  PolicyBuilder& SetPrebuiltRoot(absl::string_view outside);
 
   // Allows unrestricted access to the network by *not* creating a network
   // namespace. Note that this only disables the network namespace. To
@@ -695,6 +794,12 @@ class PolicyBuilder final {
   // Enables/disables stack trace collection on normal process exit.
   PolicyBuilder& CollectStacktracesOnExit(bool enable);
 
+  // Enables/disables copying the memory mappings of the sandboxee into the
+  // result (see Result::GetProcMaps()). They are read whenever the result gets
+  // registers, including on normal exits, so disabling them saves reading
+  // /proc/pid/maps for every sandboxee that nobody inspects.
+  PolicyBuilder& CollectProcMaps(bool enable);
+
   // Changes the default action to ALLOW.
   // All syscalls not handled explicitly by the policy will thus be allowed.
   // Do not use in environment with untrusted code and/or data, ask
@@ -704,6 +809,12 @@ class PolicyBuilder final {
   ABSL_DEPRECATED("Use DefaultAction(sandbox2::AllowAllSyscalls()) instead")
   PolicyBuilder& DangerDefaultAllowAll();
 
+  // Orders the checks of syscalls allowed or blocked by AllowSyscall() and
+  // BlockSyscallWithErrno() so that the ones made most often according to
+  // `profile` take the fewest instructions, e.g. using the profile from
+  // Sandbox2::EnableSyscallProfiling(). Does not change what the policy does.
+  PolicyBuilder& SetSyscallProfile(const SyscallProfile& profile);
+
   // Allows syscalls that are necessary for the NetworkProxyClient
   PolicyBuilder& AddNetworkProxyPolicy();
 
@@ -711,6 +822,16 @@ class PolicyBuilder final {
   // the NetworkProxyHandler
   PolicyBuilder& AddNetworkProxyHandlerPolicy();
 
+  // Lets the sandboxee call connect() on its own AF_INET and AF_INET6 sockets,
+  // to the hosts allowed with AllowIPv4() and AllowIPv6(). Instead of trapping
+  // into a signal handler in the sandboxee, the call is held by a seccomp user
+  // notification while the network proxy connects on its behalf, and the
+  // sandboxee's socket is then replaced by the connected one. Requires neither
+  // the NetworkProxyClient nor a handler in the sandboxee, but needs
+  // Sandbox2::EnableUnotifyMonitor(). With other monitors, connect() is a
+  // violation.
+  PolicyBuilder& AddNetworkProxyUnotifyPolicy();
+
   // Makes root of the filesystem writeable
   // Not recommended
   PolicyBuilder& SetRootWritable();
@@ -725,6 +846,25 @@ class PolicyBuilder final {
   PolicyBuilder& AllowIPv4(const std::string& ip_and_mask, uint32_t port = 0);
   PolicyBuilder& AllowIPv6(const std::string& ip_and_mask, uint32_t port = 0);
 
+  // Makes the network proxy keep connected sockets ready for destinations the
+  // sandboxee connected to before, see
+  // NetworkProxyServer::EnableConnectionPool(). Saves a round trip for every
+  // repeated connect().
+  //
+  // Example:
+  //   builder.AddNetworkProxyHandlerPolicy()
+  //       .AllowIPv4("10.0.0.1", 443)
+  //       .EnableNetworkProxyConnectionPool({.max_destinations = 4});
+  PolicyBuilder& EnableNetworkProxyConnectionPool(
+      const NetworkProxyPoolOptions& options = {});
+
+  // Lets the sandboxee resolve host names with
+  // NetworkProxyClient::GetAddrInfo(). The network proxy resolves them on the
+  // host and only returns addresses allowed by AllowIPv4() and AllowIPv6().
+  // Lookups are cached by DnsCache::Global() for all sandboxes of the process.
+  // Note that the names the sandboxee asks for reach the host's DNS servers.
+  PolicyBuilder& AllowNetworkProxyDnsResolution();
+
  private:
   friend class PolicyBuilderPeer;  // For testing
   friend class StackTracePeer;
@@ -739,6 +879,10 @@ class PolicyBuilder final {
   // Traps instead of denying ptrace.
   PolicyBuilder& TrapPtrace();
 
+  // Adds `path` to open_broker_, creating it on first use.
+  PolicyBuilder& AddBrokeredPath(absl::string_view path, bool is_dir,
+                                 bool is_ro);
+
   // Appends code to block a specific syscall and setting errno at the end of
   // the policy - decision taken by user policy take precedence.
   PolicyBuilder& OverridableBlockSyscallWithErrno(uint32_t num, int error);
@@ -750,6 +894,13 @@ class PolicyBuilder final {
 
   std::vector<sock_filter> ResolveBpfFunc(BpfFunc f);
 
+  // Returns the BPF program of the user policy, as TryBuild() puts it into the
+  // policy.
+  std::vector<sock_filter> BuildUserPolicy() const;
+
+  // Makes syscall `num` return the seccomp `action`.
+  void AddSyscallAction(uint32_t num, uint32_t action);
+
   void StoreDescription(PolicyBuilderDescription* pb_description);
 
   // This function returns a PolicyBuilder so that we can use it in the status
@@ -761,6 +912,9 @@ class PolicyBuilder final {
   bool requires_namespaces_ = false;
   bool allow_unrestricted_networking_ = false;
   bool allow_mount_propagation_ = false;
+  bool coalesce_mounts_ = false;
+  std::string mounts_staging_dir_;
+  size_t prewarm_max_bytes_ = 0;
   std::string hostname_ = std::string(kDefaultHostname);
 
   bool collect_stacktrace_on_violation_ = true;
@@ -768,6 +922,7 @@ class PolicyBuilder final {
   bool collect_stacktrace_on_timeout_ = true;
   bool collect_stacktrace_on_kill_ = false;
   bool collect_stacktrace_on_exit_ = false;
+  bool collect_proc_maps_ = true;
 
   // Seccomp fields
   std::vector<sock_filter> user_policy_;
@@ -775,7 +930,18 @@ class PolicyBuilder final {
   std::optional<sock_filter> default_action_;
   bool user_policy_handles_bpf_ = false;
   bool user_policy_handles_ptrace_ = false;
+  // Whether open(), openat() or creat() are allowed outright.
+  bool allows_open_ = false;
   absl::flat_hash_set<uint32_t> handled_syscalls_;
+  // Actions of the syscalls that are only matched by number, placed in front
+  // of user_policy_ as a binary search tree.
+  std::map<uint32_t, uint32_t> syscall_actions_;
+  // Syscalls covered by AddPolicyOnSyscalls() so far. Later rules for them
+  // have to stay behind those in user_policy_.
+  absl::flat_hash_set<uint32_t> syscalls_with_policy_;
+  bool policy_on_all_syscalls_ = false;
+  // Number of calls per syscall, see SetSyscallProfile().
+  absl::flat_hash_map<uint64_t, uint64_t> syscall_counts_;
 
   // Error handling
   absl::Status last_status_;
@@ -783,6 +949,12 @@ class PolicyBuilder final {
 
   // Contains list of allowed hosts.
   absl::optional<AllowedHosts> allowed_hosts_;
+  bool network_proxy_unotify_ = false;
+  bool network_proxy_dns_ = false;
+  absl::optional<NetworkProxyPoolOptions> network_proxy_pool_options_;
+  absl::optional<LogServerOptions> log_server_options_;
+  // Opens the paths allowed with AddBrokeredFile() and AddBrokeredDirectory().
+  std::shared_ptr<OpenBroker> open_broker_;
 };
 
 }  // namespace sandbox2
@@ -14,19 +14,30 @@
 
 #include "sandboxed_api/sandbox2/policybuilder.h"
 
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/syscall_profile.pb.h"
 #include "sandboxed_api/sandbox2/util/bpf_helper.h"
+#include "sandboxed_api/sandbox2/violation.pb.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 namespace sandbox2 {
@@ -35,7 +46,9 @@ class PolicyBuilderPeer {
  public:
   explicit PolicyBuilderPeer(PolicyBuilder* builder) : builder_{builder} {}
 
-  int policy_size() const { return builder_->user_policy_.size(); }
+  int policy_size() const {
+    return builder_->user_policy_.size() + builder_->syscall_actions_.size();
+  }
 
   static absl::StatusOr<std::string> ValidateAbsolutePath(
       absl::string_view path) {
@@ -49,12 +62,58 @@ class PolicyBuilderPeer {
 namespace {
 
 using ::testing::Eq;
+using ::testing::Le;
 using ::testing::Lt;
 using ::testing::StartsWith;
 using ::testing::StrEq;
 using ::sapi::IsOk;
 using ::sapi::StatusIs;
 
+std::vector<sock_filter> GetUserPolicy(const Policy& policy) {
+  PolicyDescription description;
+  policy.GetPolicyDescription(&description);
+  const std::string& bytes = description.user_bpf_policy();
+  std::vector<sock_filter> user_policy(bytes.size() / sizeof(sock_filter));
+  memcpy(user_policy.data(), bytes.data(), bytes.size());
+  return user_policy;
+}
+
+// Runs a user policy consisting of syscall number checks only. Returns the
+// action taken for syscall `nr`, or nullopt if the policy falls through.
+// Counts the instructions run in `executed`.
+std::optional<uint32_t> RunSyscallNrPolicy(
+    const std::vector<sock_filter>& policy, uint32_t nr,
+    int* executed = nullptr) {
+  uint32_t a = nr;
+  for (size_t pc = 0; pc < policy.size(); ++pc) {
+    if (executed) {
+      ++*executed;
+    }
+    const sock_filter& insn = policy[pc];
+    switch (insn.code) {
+      case BPF_LD | BPF_W | BPF_ABS:
+        EXPECT_THAT(insn.k, Eq(offsetof(seccomp_data, nr)));
+        a = nr;
+        break;
+      case BPF_RET | BPF_K:
+        return insn.k;
+      case BPF_JMP | BPF_JA:
+        pc += insn.k;
+        break;
+      case BPF_JMP | BPF_JEQ | BPF_K:
+        pc += a == insn.k ? insn.jt : insn.jf;
+        break;
+      case BPF_JMP | BPF_JGE | BPF_K:
+        pc += a >= insn.k ? insn.jt : insn.jf;
+        break;
+      default:
+        ADD_FAILURE() << "Unexpected instruction " << insn.code;
+        return std::nullopt;
+    }
+  }
+  return std::nullopt;
+}
+
 TEST(PolicyBuilderTest, Testpolicy_size) {
   ssize_t last_size = 0;
   PolicyBuilder builder;
@@ -153,5 +212,144 @@ TEST(PolicyBuilderTest, TestIsCopyable) {
   EXPECT_THAT(builder.TryBuild(), IsOk());
   EXPECT_THAT(copy.TryBuild(), IsOk());
 }
+
+TEST(PolicyBuilderTest, NetworkProxyPoliciesAreExclusive) {
+  EXPECT_THAT(PolicyBuilder().AddNetworkProxyUnotifyPolicy().TryBuild(),
+              IsOk());
+  EXPECT_THAT(PolicyBuilder()
+                  .AddNetworkProxyHandlerPolicy()
+                  .AddNetworkProxyUnotifyPolicy()
+                  .TryBuild(),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(PolicyBuilderTest, BrokeredPathsExcludeAllowOpen) {
+  EXPECT_THAT(PolicyBuilder().AddBrokeredFile("/etc/hosts").TryBuild(),
+              IsOk());
+  EXPECT_THAT(
+      PolicyBuilder().AddBrokeredFile("/etc/hosts").AllowOpen().TryBuild(),
+      StatusIs(absl::StatusCode::kFailedPrecondition));
+  EXPECT_THAT(
+      PolicyBuilder().AllowOpen().AddBrokeredDirectory("/etc").TryBuild(),
+      StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(PolicyBuilderTest, PrebuiltRootExcludesWritableRoot) {
+  EXPECT_THAT(PolicyBuilder().SetPrebuiltRoot("/prebuilt").TryBuild(), IsOk());
+  EXPECT_THAT(
+      PolicyBuilder().SetPrebuiltRoot("/prebuilt").SetRootWritable().TryBuild(),
+      StatusIs(absl::StatusCode::kFailedPrecondition));
+  EXPECT_THAT(
+      PolicyBuilder().SetRootWritable().SetPrebuiltRoot("/prebuilt").TryBuild(),
+      StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(PolicyBuilderTest, SyscallActionsKeepTheirOrder) {
+  PolicyBuilder builder;
+  std::map<uint32_t, uint32_t> expected;
+  // Handled by AddPolicyOnSyscall() first, so that must stay in effect.
+  builder.AddPolicyOnSyscall(7, {ERRNO(ENOENT)});
+  expected[7] = SECCOMP_RET_ERRNO | ENOENT;
+  for (uint32_t nr = 0; nr < 1000; nr += 3) {
+    builder.AllowSyscall(nr);
+    expected.emplace(nr, SECCOMP_RET_ALLOW);
+  }
+  for (uint32_t nr = 0; nr < 1000; nr += 5) {
+    builder.BlockSyscallWithErrno(nr, EPERM);
+    expected.emplace(nr, SECCOMP_RET_ERRNO | EPERM);
+  }
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<Policy> policy, builder.TryBuild());
+
+  std::vector<sock_filter> user_policy = GetUserPolicy(*policy);
+  for (uint32_t nr = 0; nr < 1100; ++nr) {
+    auto it = expected.find(nr);
+    std::optional<uint32_t> action = RunSyscallNrPolicy(user_policy, nr);
+    if (it == expected.end()) {
+      EXPECT_THAT(action, Eq(std::nullopt)) << "syscall " << nr;
+    } else {
+      EXPECT_THAT(action, Eq(it->second)) << "syscall " << nr;
+    }
+  }
+}
+
+TEST(PolicyBuilderTest, SyscallProfileOnlyChangesOrder) {
+  PolicyBuilder plain;
+  PolicyBuilder profiled;
+  for (PolicyBuilder* builder : {&plain, &profiled}) {
+    for (uint32_t nr = 0; nr < 300; ++nr) {
+      if (nr % 7 == 0) {
+        builder->BlockSyscallWithErrno(nr, EPERM);
+      } else {
+        builder->AllowSyscall(nr);
+      }
+    }
+  }
+  SyscallProfile profile;
+  SyscallProfile::Entry* hot = profile.add_entries();
+  hot->set_nr(250);
+  hot->set_count(1000000);
+  SyscallProfile::Entry* warm = profile.add_entries();
+  warm->set_nr(3);
+  warm->set_count(100000);
+  profiled.SetSyscallProfile(profile);
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<Policy> plain_policy,
+                            plain.TryBuild());
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<Policy> profiled_policy,
+                            profiled.TryBuild());
+  std::vector<sock_filter> plain_bpf = GetUserPolicy(*plain_policy);
+  std::vector<sock_filter> profiled_bpf = GetUserPolicy(*profiled_policy);
+
+  for (uint32_t nr = 0; nr < 400; ++nr) {
+    EXPECT_THAT(RunSyscallNrPolicy(profiled_bpf, nr),
+                Eq(RunSyscallNrPolicy(plain_bpf, nr)))
+        << "syscall " << nr;
+  }
+  int plain_executed = 0;
+  int profiled_executed = 0;
+  RunSyscallNrPolicy(plain_bpf, 250, &plain_executed);
+  RunSyscallNrPolicy(profiled_bpf, 250, &profiled_executed);
+  EXPECT_THAT(profiled_executed, Lt(plain_executed));
+  EXPECT_THAT(profiled_executed, Lt(5));
+}
+
+TEST(PolicyBuilderTest, EstimateCost) {
+  PolicyBuilder plain;
+  PolicyBuilder profiled;
+  SyscallProfile profile;
+  SyscallProfile::Entry* hot = profile.add_entries();
+  hot->set_nr(250);
+  hot->set_count(1000000);
+  profiled.SetSyscallProfile(profile);
+  std::vector<seccomp_data> trace;
+  for (PolicyBuilder* builder : {&plain, &profiled}) {
+    for (uint32_t nr = 0; nr < 300; ++nr) {
+      builder->AllowSyscall(nr);
+    }
+  }
+  for (int i = 0; i < 100; ++i) {
+    seccomp_data data = {};
+    data.nr = i < 90 ? 250 : i;
+    data.arch = Syscall::GetHostAuditArch();
+    trace.push_back(data);
+  }
+  SAPI_ASSERT_OK_AND_ASSIGN(PolicyBuilder::PolicyCost plain_cost,
+                            plain.EstimateCost(trace));
+  SAPI_ASSERT_OK_AND_ASSIGN(PolicyBuilder::PolicyCost profiled_cost,
+                            profiled.EstimateCost(trace));
+  EXPECT_THAT(plain_cost.p99_instructions,
+              Le(plain_cost.max_instructions));
+  EXPECT_THAT(plain_cost.mean_instructions, Le(plain_cost.p99_instructions));
+  // The binary search keeps the cost low for many syscalls.
+  EXPECT_THAT(plain_cost.max_instructions, Lt(60));
+  EXPECT_THAT(profiled_cost.mean_instructions,
+              Lt(plain_cost.mean_instructions));
+  // The worst case does not depend on the trace.
+  SAPI_ASSERT_OK_AND_ASSIGN(PolicyBuilder::PolicyCost no_trace_cost,
+                            plain.EstimateCost());
+  EXPECT_THAT(no_trace_cost.max_instructions,
+              Eq(plain_cost.max_instructions));
+  SAPI_ASSERT_OK(plain.TryBuild());
+}
+
 }  // namespace
 }  // namespace sandbox2
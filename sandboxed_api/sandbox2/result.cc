@@ -41,6 +41,14 @@ Result& Result::operator=(const Result& other) {
   prog_name_ = other.prog_name_;
   proc_maps_ = other.proc_maps_;
   rusage_monitor_ = other.rusage_monitor_;
+  comms_stats_ = other.comms_stats_;
+  cgroup_stats_ = other.cgroup_stats_;
+  perf_counters_ = other.perf_counters_;
+  usage_samples_ = other.usage_samples_;
+  syscall_profile_ = other.syscall_profile_;
+  startup_trace_ = other.startup_trace_;
+  stdout_tail_ = other.stdout_tail_;
+  stderr_tail_ = other.stderr_tail_;
   return *this;
 }
 
@@ -23,13 +23,20 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 
 #include "absl/status/status.h"
 #include "sandboxed_api/config.h"
+#include "sandboxed_api/sandbox2/cgroup.h"
+#include "sandboxed_api/sandbox2/comms_stats.h"
+#include "sandboxed_api/sandbox2/perf_counters.h"
 #include "sandboxed_api/sandbox2/regs.h"
 #include "sandboxed_api/sandbox2/syscall.h"
+#include "sandboxed_api/sandbox2/syscall_profile.pb.h"
+#include "sandboxed_api/sandbox2/trace.h"
+#include "sandboxed_api/sandbox2/usage.h"
 
 namespace sandbox2 {
 
@@ -69,6 +76,9 @@ class Result {
     FAILED_PTRACE,
     FAILED_IPC,
     FAILED_LIMITS,
+    // No longer reported: the working directory and the policy are sent along
+    // with the rest of the setup, which fails with FAILED_IPC. Kept so that
+    // the other codes keep their values.
     FAILED_CWD,
     FAILED_POLICY,
 
@@ -127,6 +137,29 @@ class Result {
     network_violation_ = std::move(network_violation);
   }
 
+  void SetCommsStats(CommsStats stats) { comms_stats_ = std::move(stats); }
+
+  void SetCgroupStats(CgroupStats stats) { cgroup_stats_ = std::move(stats); }
+
+  void SetPerfCounters(PerfCounterValues values) { perf_counters_ = values; }
+
+  void SetUsageSamples(std::vector<ResourceUsage> samples) {
+    usage_samples_ = std::move(samples);
+  }
+
+  void SetSyscallProfile(SyscallProfile profile) {
+    syscall_profile_ = std::move(profile);
+  }
+
+  void SetStartupTrace(std::vector<TraceSpan> trace) {
+    startup_trace_ = std::move(trace);
+  }
+
+  void SetOutputTails(std::string stdout_tail, std::string stderr_tail) {
+    stdout_tail_ = std::move(stdout_tail);
+    stderr_tail_ = std::move(stderr_tail);
+  }
+
   StatusEnum final_status() const { return final_status_; }
   uintptr_t reason_code() const { return reason_code_; }
 
@@ -154,11 +187,57 @@ class Result {
 
   const std::string& GetNetworkViolation() const { return network_violation_; }
 
+  // Returns the traffic statistics of the comms channel to the sandboxee, or
+  // nullptr if they weren't collected (see Comms::EnableStats()).
+  const CommsStats* GetCommsStats() const {
+    return comms_stats_ ? &*comms_stats_ : nullptr;
+  }
+
+  // Returns the resource usage of the sandboxee's cgroup, or nullptr if it
+  // didn't run in one (see Limits::set_cgroup()).
+  const CgroupStats* GetCgroupStats() const {
+    return cgroup_stats_ ? &*cgroup_stats_ : nullptr;
+  }
+
+  // Returns the final counts of the sandboxee's execution, or nullptr if they
+  // weren't collected (see Sandbox2::EnablePerfCounters()).
+  const PerfCounterValues* GetPerfCounters() const {
+    return perf_counters_ ? &*perf_counters_ : nullptr;
+  }
+
+  // Returns the resource usage of the sandboxee over time, oldest first (see
+  // Sandbox2::EnableUsageSampling()).
+  const std::vector<ResourceUsage>& GetUsageSamples() const {
+    return usage_samples_;
+  }
+
+  // Returns the syscalls made by the sandboxee, or nullptr if they weren't
+  // collected (see Sandbox2::EnableSyscallProfiling()).
+  const SyscallProfile* GetSyscallProfile() const {
+    return syscall_profile_ ? &*syscall_profile_ : nullptr;
+  }
+
+  // Returns the phases of the sandboxee's startup, in the order they ended
+  // (see Executor::set_trace_startup()). TraceSpansToChromeJson() formats them
+  // for chrome://tracing and the Perfetto UI.
+  const std::vector<TraceSpan>& GetStartupTrace() const {
+    return startup_trace_;
+  }
+
+  // Returns the last bytes the sandboxee wrote to stdout, or an empty string
+  // if they were not kept (see Executor::set_stdout_sink()).
+  const std::string& GetStdoutTail() const { return stdout_tail_; }
+
+  // Like GetStdoutTail(), for stderr (see Executor::set_stderr_sink()).
+  const std::string& GetStderrTail() const { return stderr_tail_; }
+
   void SetProgName(const std::string& name) { prog_name_ = name; }
 
+  // Returns /proc/pid/maps of the main process, or an empty string if it was
+  // not collected (see PolicyBuilder::CollectProcMaps()).
   const std::string& GetProcMaps() const { return proc_maps_; }
 
-  void SetProcMaps(const std::string& proc_maps) { proc_maps_ = proc_maps; }
+  void SetProcMaps(std::string proc_maps) { proc_maps_ = std::move(proc_maps); }
 
   // Converts this result to a absl::Status object.  The status will only be
   // OK if the sandbox process exited normally with an exit code of 0.
@@ -198,6 +277,15 @@ class Result {
   std::string proc_maps_;
   // IP and port if network violation occurred
   std::string network_violation_;
+  std::optional<CommsStats> comms_stats_;
+  std::optional<CgroupStats> cgroup_stats_;
+  std::optional<PerfCounterValues> perf_counters_;
+  std::vector<ResourceUsage> usage_samples_;
+  std::optional<SyscallProfile> syscall_profile_;
+  std::vector<TraceSpan> startup_trace_;
+  // The end of the sandboxee's output, see Executor::set_stdout_sink().
+  std::string stdout_tail_;
+  std::string stderr_tail_;
   // Final resource usage as defined in <sys/resource.h> (man getrusage), for
   // the Monitor thread.
   rusage rusage_monitor_;
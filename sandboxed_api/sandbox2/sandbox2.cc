@@ -16,6 +16,9 @@
 
 #include "sandboxed_api/sandbox2/sandbox2.h"
 
+#include <sys/eventfd.h>
+
+#include <cerrno>
 #include <csignal>
 #include <memory>
 #include <string>
@@ -28,6 +31,7 @@
 #include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/monitor_base.h"
 #include "sandboxed_api/sandbox2/monitor_ptrace.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
 #include "sandboxed_api/sandbox2/monitor_unotify.h"
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/stack_trace.h"
@@ -108,15 +112,37 @@ void Sandbox2::Launch() {
   });
 
   monitor_ = CreateMonitor();
+  monitor_->set_output_reactor(monitor_reactor_);
+  monitor_->set_network_proxy_reactor(network_proxy_reactor_ != nullptr
+                                          ? network_proxy_reactor_
+                                          : monitor_reactor_);
+  monitor_->set_usage_sampling_interval(usage_sampling_interval_);
+  monitor_->set_perf_counters_enabled(perf_counters_);
+  monitor_->set_done_fd(done_fd_.get());
   monitor_->Launch();
 }
 
+absl::StatusOr<int> Sandbox2::CreateDoneEventFd() {
+  if (monitor_ != nullptr) {
+    return absl::FailedPreconditionError("Sandbox was already launched");
+  }
+  if (done_fd_.get() < 0) {
+    int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd == -1) {
+      return absl::ErrnoToStatus(errno, "eventfd() failed");
+    }
+    done_fd_ = sapi::file_util::fileops::FDCloser(fd);
+  }
+  return done_fd_.get();
+}
+
 absl::Status Sandbox2::EnableUnotifyMonitor() {
   if (notify_) {
     LOG(WARNING) << "Running UnotifyMonitor with sandbox2::Notify is not fully "
-                    "supported. Runtime syscall decisions via "
-                    "EventSyscallTrap/EventSyscallTrace, notifications about "
-                    "signals via EventSignal will not work";
+                    "supported. EventSyscallTrace only sees the syscall "
+                    "arguments, not the memory they point to, and can't "
+                    "inspect return values. Notifications about signals via "
+                    "EventSignal will not work";
   }
   if (policy_->GetNamespace() == nullptr) {
     return absl::FailedPreconditionError(
@@ -131,17 +157,59 @@ absl::Status Sandbox2::EnableUnotifyMonitor() {
     return absl::FailedPreconditionError(
         "Unotify monitor cannot collect stack traces on normal exit");
   }
+  if (policy_->profile_syscalls_) {
+    return absl::FailedPreconditionError(
+        "Unotify monitor cannot profile syscalls");
+  }
   use_unotify_monitor_ = true;
   return absl::OkStatus();
 }
 
+absl::Status Sandbox2::EnableUnotifyMonitor(MonitorReactor* reactor) {
+  absl::Status status = EnableUnotifyMonitor();
+  if (status.ok()) {
+    monitor_reactor_ = reactor;
+  }
+  return status;
+}
+
+absl::Status Sandbox2::EnableSyscallProfiling() {
+  if (use_unotify_monitor_) {
+    return absl::FailedPreconditionError(
+        "Unotify monitor cannot profile syscalls");
+  }
+  policy_->profile_syscalls_ = true;
+  return absl::OkStatus();
+}
+
+absl::StatusOr<ResourceUsage> Sandbox2::GetCurrentUsage() const {
+  if (monitor_ == nullptr) {
+    return absl::FailedPreconditionError("Sandbox was not launched yet");
+  }
+  return monitor_->GetCurrentUsage();
+}
+
+absl::Status Sandbox2::Freeze(bool page_out) {
+  if (monitor_ == nullptr) {
+    return absl::FailedPreconditionError("Sandbox was not launched yet");
+  }
+  return monitor_->Freeze(page_out);
+}
+
+absl::Status Sandbox2::Thaw() {
+  if (monitor_ == nullptr) {
+    return absl::FailedPreconditionError("Sandbox was not launched yet");
+  }
+  return monitor_->Thaw();
+}
+
 std::unique_ptr<MonitorBase> Sandbox2::CreateMonitor() {
   if (!notify_) {
     notify_ = std::make_unique<Notify>();
   }
   if (use_unotify_monitor_) {
     return std::make_unique<UnotifyMonitor>(executor_.get(), policy_.get(),
-                                            notify_.get());
+                                            notify_.get(), monitor_reactor_);
   }
   return std::make_unique<PtraceMonitor>(executor_.get(), policy_.get(),
                                          notify_.get());
@@ -24,13 +24,17 @@
 
 #include "absl/base/macros.h"
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/ipc.h"
 #include "sandboxed_api/sandbox2/monitor_base.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
 #include "sandboxed_api/sandbox2/notify.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/usage.h"
+#include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
 
@@ -106,6 +110,57 @@ class Sandbox2 final {
   }
 
   absl::Status EnableUnotifyMonitor();
+  // Like EnableUnotifyMonitor(), but the monitor runs on the threads of the
+  // given reactor, which must outlive this object. So does the network proxy
+  // server, unless set_network_proxy_reactor() chose another reactor, and the
+  // draining of output for Executor::set_stdout_sink().
+  absl::Status EnableUnotifyMonitor(MonitorReactor* reactor);
+
+  // Serves the connect() requests of the sandboxee on the threads of the given
+  // reactor, which must outlive this object, instead of on a thread of its
+  // own. Only used with PolicyBuilder::AddNetworkProxy*().
+  void set_network_proxy_reactor(MonitorReactor* reactor) {
+    network_proxy_reactor_ = reactor;
+  }
+
+  // Collects the syscalls made by the sandboxee in Result::GetSyscallProfile(),
+  // with the time they took. All syscalls allowed by the policy are traced
+  // for that, which slows the sandboxee down considerably. Only supported by
+  // the ptrace monitor.
+  absl::Status EnableSyscallProfiling();
+
+  // Samples the resource usage of the sandboxee every interval while it runs,
+  // see Result::GetUsageSamples(). Each sample costs a few reads from /proc
+  // (and from the cgroup, if any) on a thread of its own.
+  void EnableUsageSampling(absl::Duration interval) {
+    usage_sampling_interval_ = interval;
+  }
+
+  // Counts cycles, instructions, cache misses and page faults of the
+  // sandboxee with perf_event_open(), from its execve() on. The counts are
+  // part of GetCurrentUsage() while it runs, and Result::GetPerfCounters()
+  // once it is done. Hardware counters are often unavailable in VMs, and all of
+  // them with a restrictive kernel.perf_event_paranoid, which only logs a
+  // warning.
+  void EnablePerfCounters() { perf_counters_ = true; }
+
+  // Returns the current resource usage of the running sandboxee.
+  absl::StatusOr<ResourceUsage> GetCurrentUsage() const;
+
+  // Stops the running sandboxee until Thaw(), e.g. while it waits for work,
+  // through cgroup.freeze if it has a cgroup (see Limits::set_cgroup()) and
+  // with SIGSTOP otherwise. With page_out, also has the kernel reclaim its private
+  // memory for other uses, which is faulted back in once it runs again. That
+  // needs CAP_SYS_NICE and is skipped otherwise.
+  absl::Status Freeze(bool page_out = false);
+  absl::Status Thaw();
+
+  // Returns an eventfd that becomes readable once the sandboxee is done, so
+  // that an event loop can wait for many sandboxes without a thread blocked
+  // in AwaitResult() for each. AwaitResult() returns without blocking for
+  // long once it is readable. The fd stays owned by this object. Must be
+  // called before RunAsync().
+  absl::StatusOr<int> CreateDoneEventFd();
 
  private:
   // Launches the Monitor.
@@ -122,10 +177,17 @@ class Sandbox2 final {
   // Notify object - owned by Sandbox2.
   std::unique_ptr<Notify> notify_;
 
+  // See CreateDoneEventFd(), closed only after the monitor is gone.
+  sapi::file_util::fileops::FDCloser done_fd_;
+
   // Monitor object - owned by Sandbox2.
   std::unique_ptr<MonitorBase> monitor_;
 
   bool use_unotify_monitor_ = false;
+  MonitorReactor* monitor_reactor_ = nullptr;
+  MonitorReactor* network_proxy_reactor_ = nullptr;
+  absl::Duration usage_sampling_interval_ = absl::ZeroDuration();
+  bool perf_counters_ = false;
 };
 
 }  // namespace sandbox2
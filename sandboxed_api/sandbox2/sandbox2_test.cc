@@ -15,6 +15,11 @@
 #include "sandboxed_api/sandbox2/sandbox2.h"
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <syscall.h>
 
 #include <csignal>
@@ -25,13 +30,24 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/config.h"
+#include "sandboxed_api/sandbox2/allow_all_syscalls.h"
 #include "sandboxed_api/sandbox2/executor.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
+#include "sandboxed_api/sandbox2/perf_counters.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/policybuilder.h"
 #include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/syscall_profile.pb.h"
+#include "sandboxed_api/sandbox2/trace.h"
+#include "sandboxed_api/sandbox2/usage.h"
+#include "sandboxed_api/sandbox2/util.h"
 #include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 namespace sandbox2 {
@@ -40,10 +56,14 @@ namespace {
 using ::sapi::CreateDefaultPermissiveTestPolicy;
 using ::sapi::GetTestSourcePath;
 using ::sapi::IsOk;
+using ::sapi::file_util::fileops::FDCloser;
 using ::testing::Eq;
 using ::testing::IsEmpty;
+using ::testing::IsSupersetOf;
 using ::testing::IsTrue;
 using ::testing::Lt;
+using ::testing::Not;
+using ::testing::NotNull;
 
 class Sandbox2Test : public ::testing::TestWithParam<bool> {
  public:
@@ -115,6 +135,45 @@ TEST(ExecutorTest, ExecutorFdConstructor) {
   ASSERT_EQ(result.final_status(), Result::OK);
 }
 
+TEST(ExecutorTest, SpawnsDirectlyWithoutNamespaces) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
+  std::vector<std::string> args = {path};
+  auto executor = std::make_unique<Executor>(path, args);
+  executor->set_spawn_directly(true);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            PolicyBuilder()
+                                .DisableNamespaces()
+                                .DefaultAction(AllowAllSyscalls())
+                                .TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  auto result = sandbox.Run();
+
+  ASSERT_EQ(result.final_status(), Result::OK);
+}
+
+// Tests that a directly spawned sandboxee outlives the thread that started it.
+TEST(ExecutorTest, SpawnsDirectlyFromShortLivedThread) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/sleep");
+  std::vector<std::string> args = {path, "1"};
+  auto executor = std::make_unique<Executor>(path, args);
+  executor->set_spawn_directly(true);
+
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            PolicyBuilder()
+                                .DisableNamespaces()
+                                .DefaultAction(AllowAllSyscalls())
+                                .TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  bool started = false;
+  std::thread starter([&sandbox, &started] { started = sandbox.RunAsync(); });
+  starter.join();
+  ASSERT_TRUE(started);
+  auto result = sandbox.AwaitResult();
+
+  ASSERT_EQ(result.final_status(), Result::OK);
+}
+
 // Tests that we return the correct state when the sandboxee was killed by an
 // external signal. Also make sure that we do not have the stack trace.
 TEST_P(Sandbox2Test, SandboxeeExternalKill) {
@@ -135,6 +194,25 @@ TEST_P(Sandbox2Test, SandboxeeExternalKill) {
   EXPECT_THAT(result.stack_trace(), IsEmpty());
 }
 
+// Tests that the done eventfd becomes readable once the sandboxee is killed.
+TEST_P(Sandbox2Test, DoneEventFdSignalsCompletion) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/sleep");
+  std::vector<std::string> args = {path};
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::make_unique<Executor>(path, args), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(int done_fd, sandbox.CreateDoneEventFd());
+  ASSERT_TRUE(sandbox.RunAsync());
+  EXPECT_THAT(sandbox.CreateDoneEventFd(), Not(IsOk()));
+
+  pollfd pfd = {.fd = done_fd, .events = POLLIN};
+  EXPECT_THAT(poll(&pfd, 1, /*timeout=*/100), Eq(0));
+  sandbox.Kill();
+  ASSERT_THAT(poll(&pfd, 1, /*timeout=*/-1), Eq(1));
+  EXPECT_EQ(sandbox.AwaitResult().final_status(), Result::EXTERNAL_KILL);
+}
+
 // Tests that we do not collect stack traces if it was disabled (signaled).
 TEST_P(Sandbox2Test, SandboxeeTimeoutDisabledStacktraces) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/sleep");
@@ -173,6 +251,26 @@ TEST(Sandbox2Test, SandboxeeViolationDisabledStacktraces) {
   EXPECT_THAT(result.stack_trace(), IsEmpty());
 }
 
+// Tests that the memory mappings are only read if enabled (violation).
+TEST(Sandbox2Test, SandboxeeViolationDisabledProcMaps) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/sleep");
+
+  for (bool collect : {true, false}) {
+    std::vector<std::string> args = {path};
+    auto executor = std::make_unique<Executor>(path, args);
+    SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                              PolicyBuilder()
+                                  .CollectStacktracesOnViolation(false)
+                                  .CollectProcMaps(collect)
+                                  .TryBuild());
+    Sandbox2 sandbox(std::move(executor), std::move(policy));
+    ASSERT_TRUE(sandbox.RunAsync());
+    auto result = sandbox.AwaitResult();
+    EXPECT_EQ(result.final_status(), Result::VIOLATION);
+    EXPECT_EQ(result.GetProcMaps().empty(), !collect);
+  }
+}
+
 TEST_P(Sandbox2Test, SandboxeeNotKilledWhenStartingThreadFinishes) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
   std::vector<std::string> args = {path};
@@ -188,6 +286,194 @@ TEST_P(Sandbox2Test, SandboxeeNotKilledWhenStartingThreadFinishes) {
   EXPECT_EQ(result.final_status(), Result::OK);
 }
 
+TEST_P(Sandbox2Test, SamplesUsageWhileRunning) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/sleep");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  sandbox.EnableUsageSampling(absl::Milliseconds(10));
+  ASSERT_TRUE(sandbox.RunAsync());
+  absl::SleepFor(absl::Milliseconds(200));
+  absl::StatusOr<ResourceUsage> usage = sandbox.GetCurrentUsage();
+  ASSERT_THAT(usage.status(), IsOk());
+  EXPECT_GT(usage->rss_bytes, 0);
+  sandbox.Kill();
+  Result result = sandbox.AwaitResult();
+  EXPECT_EQ(result.final_status(), Result::EXTERNAL_KILL);
+  EXPECT_THAT(result.GetUsageSamples(), Not(IsEmpty()));
+  EXPECT_THAT(sandbox.GetCurrentUsage().status(), Not(IsOk()));
+}
+
+TEST_P(Sandbox2Test, AppliesPlacement) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/sleep");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+  executor->limits()->set_placement(
+      {.cpus = {0}, .sched_policy = SCHED_BATCH, .nice = 19});
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  ASSERT_TRUE(sandbox.RunAsync());
+  absl::SleepFor(absl::Milliseconds(200));
+  EXPECT_THAT(util::GetProcStatusLine(sandbox.pid(), "Cpus_allowed_list"),
+              Eq("0"));
+  EXPECT_THAT(sched_getscheduler(sandbox.pid()), Eq(SCHED_BATCH));
+  EXPECT_THAT(getpriority(PRIO_PROCESS, sandbox.pid()), Eq(19));
+  sandbox.Kill();
+  EXPECT_EQ(sandbox.AwaitResult().final_status(), Result::EXTERNAL_KILL);
+}
+
+TEST_P(Sandbox2Test, StartupTraceCoversPhases) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+  executor->set_trace_startup(true);
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  Result result = sandbox.Run();
+  ASSERT_EQ(result.final_status(), Result::OK);
+
+  std::vector<std::string> names;
+  for (const TraceSpan& span : result.GetStartupTrace()) {
+    EXPECT_LE(span.start_ns, span.end_ns);
+    EXPECT_GT(span.pid, 0);
+    names.push_back(span.name);
+  }
+  EXPECT_THAT(names, IsSupersetOf({"PolicyBuilder::TryBuild",
+                                   "Executor::StartSubProcess",
+                                   "ForkServer::ServeRequest",
+                                   "ForkServer::InitializeNamespaces",
+                                   "MonitorBase::InitSendSetup",
+                                   "MonitorBase::WaitForSandboxReady"}));
+}
+
+TEST(Sandbox2Test, StartupIsNotTracedByDefault) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultPermissiveTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  Result result = sandbox.Run();
+  ASSERT_EQ(result.final_status(), Result::OK);
+  EXPECT_THAT(result.GetStartupTrace(), IsEmpty());
+}
+
+TEST_P(Sandbox2Test, CountsWithPerfCounters) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  sandbox.EnablePerfCounters();
+  Result result = sandbox.Run();
+  ASSERT_EQ(result.final_status(), Result::OK);
+  const PerfCounterValues* counters = result.GetPerfCounters();
+  if (counters == nullptr) {
+    GTEST_SKIP() << "perf_event_open() not available";
+  }
+  EXPECT_GT(counters->page_faults, 0);
+}
+
+TEST_P(Sandbox2Test, SplicesOutputToSinks) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/output");
+  auto executor = std::make_unique<Executor>(
+      path, std::vector<std::string>{path, "8"});
+  const int out = memfd_create("stdout", MFD_CLOEXEC);
+  ASSERT_NE(out, -1);
+  const FDCloser contents(dup(out));
+  executor->set_stdout_sink(out, /*tail_size=*/8);
+  executor->set_stderr_sink(-1, /*tail_size=*/64);
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(SetUpSandbox(&sandbox), IsOk());
+  Result result = sandbox.Run();
+  ASSERT_EQ(result.final_status(), Result::OK);
+
+  struct stat st;
+  ASSERT_EQ(fstat(contents.get(), &st), 0);
+  EXPECT_EQ(st.st_size, 8 << 20);
+  std::string tail(8, '\0');
+  ASSERT_EQ(pread(contents.get(), tail.data(), tail.size(),
+                  st.st_size - tail.size()),
+            tail.size());
+  EXPECT_EQ(result.GetStdoutTail(), tail);
+  EXPECT_EQ(result.GetStderrTail(), "done\n");
+}
+
+TEST(MonitorReactorTest, DrainsOutputOnReactor) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/output");
+  MonitorReactor reactor;
+  auto executor = std::make_unique<Executor>(
+      path, std::vector<std::string>{path, "1"});
+  executor->set_stdout_sink(-1, /*tail_size=*/16);
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultPermissiveTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(sandbox.EnableUnotifyMonitor(&reactor), IsOk());
+  Result result = sandbox.Run();
+  ASSERT_EQ(result.final_status(), Result::OK);
+  EXPECT_EQ(result.GetStdoutTail().size(), 16);
+  EXPECT_THAT(result.GetStderrTail(), IsEmpty());
+}
+
+TEST(SyscallProfilingTest, ProfileContainsSyscalls) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/minimal");
+  auto executor =
+      std::make_unique<Executor>(path, std::vector<std::string>{path});
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultPermissiveTestPolicy(path).TryBuild());
+  Sandbox2 sandbox(std::move(executor), std::move(policy));
+  ASSERT_THAT(sandbox.EnableSyscallProfiling(), IsOk());
+  Result result = sandbox.Run();
+  ASSERT_EQ(result.final_status(), Result::OK);
+
+  const SyscallProfile* profile = result.GetSyscallProfile();
+  ASSERT_THAT(profile, NotNull());
+  bool has_exit_group = false;
+  for (const SyscallProfile::Entry& entry : profile->entries()) {
+    EXPECT_GT(entry.count(), 0u);
+    has_exit_group = has_exit_group || entry.name() == "exit_group";
+  }
+  EXPECT_TRUE(has_exit_group);
+}
+
+TEST(MonitorReactorTest, SandboxesShareMonitorThread) {
+  const std::string minimal = GetTestSourcePath("sandbox2/testcases/minimal");
+  const std::string sleeper = GetTestSourcePath("sandbox2/testcases/sleep");
+  MonitorReactor reactor;
+
+  std::vector<std::unique_ptr<Sandbox2>> sandboxes;
+  for (int i = 0; i < 4; ++i) {
+    const std::string& path = i == 0 ? sleeper : minimal;
+    auto executor =
+        std::make_unique<Executor>(path, std::vector<std::string>{path});
+    SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                              CreateDefaultPermissiveTestPolicy(path)
+                                  .CollectStacktracesOnSignal(false)
+                                  .TryBuild());
+    sandboxes.push_back(
+        std::make_unique<Sandbox2>(std::move(executor), std::move(policy)));
+    ASSERT_THAT(sandboxes.back()->EnableUnotifyMonitor(&reactor), IsOk());
+    ASSERT_TRUE(sandboxes.back()->RunAsync());
+  }
+  sandboxes[0]->set_walltime_limit(absl::Seconds(1));
+  EXPECT_EQ(sandboxes[0]->AwaitResult().final_status(), Result::TIMEOUT);
+  for (size_t i = 1; i < sandboxes.size(); ++i) {
+    EXPECT_EQ(sandboxes[i]->AwaitResult().final_status(), Result::OK);
+  }
+  sandboxes.clear();
+}
+
 TEST(StarvationTest, MonitorIsNotStarvedByTheSandboxee) {
   const std::string path = GetTestSourcePath("sandbox2/testcases/starve");
 
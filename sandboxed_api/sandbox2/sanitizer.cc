@@ -31,8 +31,10 @@
 #include <syscall.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <csignal>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <sstream>
@@ -41,15 +43,24 @@
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_split.h"
-#include "sandboxed_api/sandbox2/util.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/util/file_helpers.h"
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
 
+#ifndef __NR_close_range
+#define __NR_close_range 436
+#endif
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
 namespace sandbox2::sanitizer {
 namespace {
 
@@ -57,97 +68,163 @@ namespace file_util = ::sapi::file_util;
 
 constexpr char kProcSelfFd[] = "/proc/self/fd";
 
+// Applies close_range() with the given flags to the gaps between the
+// exceptions, which takes a syscall per exception instead of one per open file
+// descriptor. Returns false if close_range() is not supported, which is only
+// ever reported by the first syscall (Linux 5.9, CLOSE_RANGE_CLOEXEC since
+// 5.11).
+bool CloseRangeExcept(const absl::flat_hash_set<int>& fd_exceptions,
+                      unsigned int flags) {
+  std::vector<int> exceptions(fd_exceptions.begin(), fd_exceptions.end());
+  std::sort(exceptions.begin(), exceptions.end());
+  unsigned int first = 0;
+  for (int fd : exceptions) {
+    if (fd < 0) {
+      continue;
+    }
+    if (static_cast<unsigned int>(fd) > first &&
+        syscall(__NR_close_range, first, static_cast<unsigned int>(fd) - 1,
+                flags) == -1) {
+      return false;
+    }
+    first = fd + 1;
+  }
+  return syscall(__NR_close_range, first, ~0U, flags) == 0;
+}
+
+// Calls callback with the filenames inside the directory converted to
+// numerical values, without allocating for each of them. The descriptor used
+// to read the directory is skipped, so that listing /proc/self/fd does not
+// report it.
+absl::Status ForEachNumericalDirectoryEntry(
+    const char* directory, absl::FunctionRef<bool(int)> callback) {
+  file_util::fileops::FDCloser dirfd(
+      open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+  if (dirfd.get() == -1) {
+    return absl::ErrnoToStatus(errno,
+                               absl::StrCat("open(", directory, ") failed"));
+  }
+  std::string bad_entry;
+  if (!file_util::fileops::ForEachDirectoryEntry(
+          dirfd.get(), [&](const char* name) {
+            int num;
+            if (!absl::SimpleAtoi(name, &num)) {
+              bad_entry = name;
+              return false;
+            }
+            return num == dirfd.get() || callback(num);
+          })) {
+    return absl::ErrnoToStatus(
+        errno, absl::StrCat("List directory entries for '", directory,
+                            "' failed"));
+  }
+  if (!bad_entry.empty()) {
+    return absl::InternalError(
+        absl::StrCat("Cannot convert ", bad_entry, " to a number"));
+  }
+  return absl::OkStatus();
+}
+
 // Reads filenames inside the directory and converts them to numerical values.
 absl::StatusOr<absl::flat_hash_set<int>> ListNumericalDirectoryEntries(
-    const std::string& directory) {
+    const char* directory) {
   absl::flat_hash_set<int> result;
-  std::vector<std::string> entries;
-  std::string error;
-  if (!file_util::fileops::ListDirectoryEntries(directory, &entries, &error)) {
-    return absl::InternalError(absl::StrCat("List directory entries for '",
-                                            directory, "' failed: ", error));
-  }
-  result.reserve(entries.size());
-  for (const auto& entry : entries) {
-    int num;
-    if (!absl::SimpleAtoi(entry, &num)) {
-      return absl::InternalError(
-          absl::StrCat("Cannot convert ", entry, " to a number"));
-    }
+  SAPI_RETURN_IF_ERROR(ForEachNumericalDirectoryEntry(directory, [&](int num) {
     result.insert(num);
-  }
+    return true;
+  }));
   return result;
 }
 
 }  // namespace
 
 absl::StatusOr<absl::flat_hash_set<int>> GetListOfFDs() {
-  SAPI_ASSIGN_OR_RETURN(absl::flat_hash_set<int> fds,
-                        ListNumericalDirectoryEntries(kProcSelfFd));
-
-  //  Exclude the dirfd which was opened in ListDirectoryEntries.
-  for (auto it = fds.begin(), end = fds.end(); it != end; ++it) {
-    if (access(absl::StrCat(kProcSelfFd, "/", *it).c_str(), F_OK) != 0) {
-      fds.erase(it);
-      break;
-    }
-  }
-  return fds;
+  return ListNumericalDirectoryEntries(kProcSelfFd);
 }
 
 absl::StatusOr<absl::flat_hash_set<int>> GetListOfTasks(int pid) {
   const std::string task_dir = absl::StrCat("/proc/", pid, "/task");
-  return ListNumericalDirectoryEntries(task_dir);
+  return ListNumericalDirectoryEntries(task_dir.c_str());
 }
 
 absl::Status CloseAllFDsExcept(const absl::flat_hash_set<int>& fd_exceptions) {
-  SAPI_ASSIGN_OR_RETURN(absl::flat_hash_set<int> fds, GetListOfFDs());
-
-  for (const auto& fd : fds) {
-    if (fd_exceptions.find(fd) != fd_exceptions.end()) {
-      continue;
-    }
-    SAPI_RAW_VLOG(2, "Closing FD:%d", fd);
-    close(fd);
+  if (CloseRangeExcept(fd_exceptions, /*flags=*/0)) {
+    return absl::OkStatus();
   }
-  return absl::OkStatus();
+  // Closing the entries already read does not disturb the listing.
+  return ForEachNumericalDirectoryEntry(kProcSelfFd, [&](int fd) {
+    if (!fd_exceptions.contains(fd)) {
+      SAPI_RAW_VLOG(2, "Closing FD:%d", fd);
+      close(fd);
+    }
+    return true;
+  });
 }
 
 absl::Status MarkAllFDsAsCOEExcept(
     const absl::flat_hash_set<int>& fd_exceptions) {
-  SAPI_ASSIGN_OR_RETURN(absl::flat_hash_set<int> fds, GetListOfFDs());
-
-  for (const auto& fd : fds) {
-    if (fd_exceptions.find(fd) != fd_exceptions.end()) {
-      continue;
-    }
-
-    SAPI_RAW_VLOG(2, "Marking FD:%d as close-on-exec", fd);
-
-    int flags = fcntl(fd, F_GETFD);
-    if (flags == -1) {
-      return absl::ErrnoToStatus(
-          errno, absl::StrCat("fcntl(", fd, ", F_GETFD) failed"));
-    }
-    if (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
-      return absl::ErrnoToStatus(
-          errno, absl::StrCat("fcntl(", fd, ", F_SETFD, ", flags,
-                              " | FD_CLOEXEC) failed"));
-    }
+  if (CloseRangeExcept(fd_exceptions, CLOSE_RANGE_CLOEXEC)) {
+    return absl::OkStatus();
   }
+  absl::Status status;
+  SAPI_RETURN_IF_ERROR(
+      ForEachNumericalDirectoryEntry(kProcSelfFd, [&](int fd) {
+        if (fd_exceptions.contains(fd)) {
+          return true;
+        }
 
-  return absl::OkStatus();
+        SAPI_RAW_VLOG(2, "Marking FD:%d as close-on-exec", fd);
+
+        int flags = fcntl(fd, F_GETFD);
+        if (flags == -1) {
+          status = absl::ErrnoToStatus(
+              errno, absl::StrCat("fcntl(", fd, ", F_GETFD) failed"));
+          return false;
+        }
+        if (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1) {
+          status = absl::ErrnoToStatus(
+              errno, absl::StrCat("fcntl(", fd, ", F_SETFD, ", flags,
+                                  " | FD_CLOEXEC) failed"));
+          return false;
+        }
+        return true;
+      }));
+  return status;
 }
 
 int GetNumberOfThreads(int pid) {
-  std::string thread_str = util::GetProcStatusLine(pid, "Threads");
-  if (thread_str.empty()) {
+  // num_threads is the 20th field of /proc/<pid>/stat. The second one is the
+  // command name in parentheses, which may contain spaces itself, so fields
+  // are counted from the last parenthesis.
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+  file_util::fileops::FDCloser fd(open(path, O_RDONLY | O_CLOEXEC));
+  if (fd.get() == -1) {
+    return -1;
+  }
+  char stat[1024];
+  ssize_t n = TEMP_FAILURE_RETRY(read(fd.get(), stat, sizeof(stat) - 1));
+  if (n <= 0) {
     return -1;
   }
-  int threads;
-  if (!absl::SimpleAtoi(thread_str, &threads)) {
-    SAPI_RAW_LOG(ERROR, "Couldn't convert '%s' to a number",
-                 thread_str.c_str());
+  stat[n] = '\0';
+  const char* p = strrchr(stat, ')');
+  if (p == nullptr) {
+    return -1;
+  }
+  constexpr int kFieldsAfterCommand = 18;
+  for (int spaces = 0; spaces < kFieldsAfterCommand && *p != '\0'; ++p) {
+    if (*p == ' ') {
+      ++spaces;
+    }
+  }
+  int threads = 0;
+  const char* digits = p;
+  for (; *p >= '0' && *p <= '9'; ++p) {
+    threads = threads * 10 + (*p - '0');
+  }
+  if (p == digits) {
+    SAPI_RAW_LOG(ERROR, "Couldn't find the number of threads in %s", path);
     return -1;
   }
   SAPI_RAW_VLOG(1, "Found %d threads in pid: %d", threads, pid);
@@ -164,13 +241,16 @@ void WaitForSanitizer() {
     return true;
   }();
   const pid_t pid = getpid();
-  int threads;
-  for (int retry = 0; retry < 10; ++retry) {
-    threads = GetNumberOfThreads(pid);
+  // The sanitizer threads usually exit right away, so poll often at first,
+  // while still giving up after about a second.
+  absl::Duration delay = absl::Milliseconds(1);
+  for (absl::Duration waited; waited < absl::Seconds(1); waited += delay) {
+    int threads = GetNumberOfThreads(pid);
     if (threads == -1 || threads == 1) {
       break;
     }
-    absl::SleepFor(absl::Milliseconds(100));
+    absl::SleepFor(delay);
+    delay = std::min(delay * 2, absl::Milliseconds(100));
   }
 #endif
 }
@@ -30,7 +30,8 @@ namespace sanitizer {
 absl::StatusOr<absl::flat_hash_set<int>> GetListOfFDs();
 
 // Closes all file descriptors in the current process except the ones in
-// fd_exceptions.
+// fd_exceptions. Uses close_range() where available, and otherwise lists
+// /proc/self/fd.
 absl::Status CloseAllFDsExcept(const absl::flat_hash_set<int>& fd_exceptions);
 
 // Marks all file descriptors as close-on-exec, except the ones in
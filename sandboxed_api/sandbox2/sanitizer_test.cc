@@ -146,6 +146,33 @@ TEST(SanitizerTest, TestCloseFDs) {
   EXPECT_THAT(RunTestcase(path, args), Eq(0));
 }
 
+// Test that the exceptions are kept regardless of gaps between them.
+TEST(SanitizerTest, TestCloseFDsWithGaps) {
+  pid_t pid = fork();
+  ASSERT_THAT(pid, Ne(-1));
+  if (pid == 0) {
+    for (int fd : {100, 101, 200, 300}) {
+      if (dup2(STDERR_FILENO, fd) == -1) {
+        _exit(1);
+      }
+    }
+    if (!sanitizer::MarkAllFDsAsCOEExcept({STDERR_FILENO, 101}).ok() ||
+        fcntl(101, F_GETFD) != 0 || fcntl(100, F_GETFD) != FD_CLOEXEC) {
+      _exit(2);
+    }
+    if (!sanitizer::CloseAllFDsExcept({STDERR_FILENO, 101, 300}).ok() ||
+        fcntl(100, F_GETFD) != -1 || fcntl(200, F_GETFD) != -1 ||
+        fcntl(101, F_GETFD) == -1 || fcntl(300, F_GETFD) == -1) {
+      _exit(3);
+    }
+    _exit(0);
+  }
+  int status;
+  ASSERT_THAT(waitpid(pid, &status, 0), Eq(pid));
+  EXPECT_TRUE(WIFEXITED(status));
+  EXPECT_THAT(WEXITSTATUS(status), Eq(0));
+}
+
 TEST(SanitizerTest, TestGetProcStatusLine) {
   // Test indirectly, GetNumberOfThreads() looks for the "Threads" value.
   EXPECT_THAT(sanitizer::GetNumberOfThreads(getpid()), Gt(0));
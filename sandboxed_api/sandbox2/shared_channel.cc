@@ -0,0 +1,254 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/shared_channel.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sandbox2::internal {
+namespace {
+
+using ::sapi::file_util::fileops::FDCloser;
+
+#ifndef F_GET_SEALS
+#define F_GET_SEALS 1034
+#endif
+#ifndef F_SEAL_SHRINK
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+constexpr uint64_t kMagic = 0x6c656e6e61686373;  // "schannel"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "Atomics must work across processes");
+
+absl::Status CorruptError() {
+  return absl::DataLossError("Shared channel corrupted by the other side");
+}
+
+struct Header {
+  uint64_t magic;
+  uint64_t element_size;
+  uint64_t capacity;
+  // Written by the producer only.
+  alignas(64) std::atomic<uint64_t> head;
+  // Written by the consumer only.
+  alignas(64) std::atomic<uint64_t> tail;
+  alignas(64) std::atomic<uint32_t> consumer_waiting;
+  alignas(64) std::atomic<uint32_t> producer_waiting;
+};
+
+// The elements start on their own cache line.
+constexpr size_t kDataOffset = (sizeof(Header) + 63) / 64 * 64;
+
+Header* GetHeader(const Buffer& buffer) {
+  return reinterpret_cast<Header*>(buffer.data());
+}
+
+// Waits for the other side to ring fd, unless done() already holds after
+// announcing the wait in waiting.
+template <typename Done>
+absl::Status Wait(std::atomic<uint32_t>& waiting, int fd, Done done,
+                  absl::Time deadline) {
+  waiting.store(1, std::memory_order_seq_cst);
+  if (done()) {
+    waiting.store(0, std::memory_order_relaxed);
+    return absl::OkStatus();
+  }
+  int timeout_ms = -1;
+  if (deadline != absl::InfiniteFuture()) {
+    timeout_ms = std::max<int64_t>(
+        0, absl::ToInt64Milliseconds(absl::Ceil(deadline - absl::Now(),
+                                                absl::Milliseconds(1))));
+  }
+  pollfd pfd = {.fd = fd, .events = POLLIN};
+  int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_ms));
+  waiting.store(0, std::memory_order_relaxed);
+  if (ret == -1) {
+    return absl::ErrnoToStatus(errno, "poll() on a shared channel");
+  }
+  if (ret == 0) {
+    return absl::DeadlineExceededError(
+        "Timed out waiting for the other side of the shared channel");
+  }
+  // Resets the counter. Stale rings only cause another round of checking.
+  uint64_t count;
+  if (read(fd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+    return absl::ErrnoToStatus(errno, "read() from a shared channel eventfd");
+  }
+  return absl::OkStatus();
+}
+
+// Wakes up the other side if it waits.
+void Ring(std::atomic<uint32_t>& waiting, int fd) {
+  if (waiting.exchange(0, std::memory_order_seq_cst) != 0) {
+    uint64_t one = 1;
+    // Can only fail with EAGAIN if the counter is about to overflow, in which
+    // case the other side gets woken up anyway.
+    (void)write(fd, &one, sizeof(one));
+  }
+}
+
+}  // namespace
+
+absl::StatusOr<SharedRing> SharedRing::Create(size_t element_size,
+                                              size_t capacity) {
+  if (element_size == 0 || capacity == 0 ||
+      capacity > (std::numeric_limits<size_t>::max() - kDataOffset) /
+                     element_size) {
+    return absl::InvalidArgumentError("Invalid shared channel capacity");
+  }
+  SharedRing ring;
+  SAPI_ASSIGN_OR_RETURN(
+      ring.buffer_,
+      Buffer::CreateWithSize(kDataOffset + capacity * element_size,
+                             {.seal_size = true}));
+  // memfds start out zeroed, which is also the initial state of the atomics.
+  Header* header = new (ring.buffer_->data()) Header();
+  header->magic = kMagic;
+  header->element_size = element_size;
+  header->capacity = capacity;
+  ring.ready_fd_ = FDCloser(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  ring.free_fd_ = FDCloser(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  if (ring.ready_fd_.get() == -1 || ring.free_fd_.get() == -1) {
+    return absl::ErrnoToStatus(errno, "eventfd() for a shared channel");
+  }
+  ring.element_size_ = element_size;
+  ring.capacity_ = capacity;
+  return ring;
+}
+
+absl::StatusOr<SharedRing> SharedRing::Attach(FDCloser memfd,
+                                              FDCloser ready_fd,
+                                              FDCloser free_fd,
+                                              size_t element_size) {
+  // The size must not change once mapped, as accesses would fault otherwise.
+  int seals = fcntl(memfd.get(), F_GET_SEALS);
+  if (seals == -1 || (seals & F_SEAL_SHRINK) == 0) {
+    return absl::FailedPreconditionError("Shared channel memfd not sealed");
+  }
+  SharedRing ring;
+  SAPI_ASSIGN_OR_RETURN(ring.buffer_, Buffer::CreateFromFd(memfd.get()));
+  memfd.Release();
+  if (ring.buffer_->size() < kDataOffset) {
+    return absl::InvalidArgumentError("Shared channel memfd too small");
+  }
+  const Header* header = GetHeader(*ring.buffer_);
+  if (header->magic != kMagic || header->element_size != element_size ||
+      header->capacity == 0 ||
+      header->capacity > (ring.buffer_->size() - kDataOffset) / element_size) {
+    return absl::InvalidArgumentError("Not a shared channel of this type");
+  }
+  ring.ready_fd_ = std::move(ready_fd);
+  ring.free_fd_ = std::move(free_fd);
+  ring.element_size_ = element_size;
+  ring.capacity_ = header->capacity;
+  ring.head_ = header->head.load(std::memory_order_acquire);
+  ring.tail_ = header->tail.load(std::memory_order_acquire);
+  return ring;
+}
+
+uint8_t* SharedRing::slot(uint64_t index) const {
+  return buffer_->data() + kDataOffset + (index % capacity_) * element_size_;
+}
+
+absl::Status SharedRing::Push(const void* elements, size_t count,
+                              absl::Duration timeout) {
+  const absl::Time deadline = absl::Now() + timeout;
+  const uint8_t* src = static_cast<const uint8_t*>(elements);
+  Header* h = GetHeader(*buffer_);
+  while (count > 0) {
+    uint64_t used = head_ - h->tail.load(std::memory_order_seq_cst);
+    if (used > capacity_) {
+      return CorruptError();
+    }
+    size_t n = std::min<uint64_t>(count, capacity_ - used);
+    if (n == 0) {
+      SAPI_RETURN_IF_ERROR(Wait(
+          h->producer_waiting, free_fd_.get(),
+          [&] {
+            return head_ - h->tail.load(std::memory_order_seq_cst) !=
+                   capacity_;
+          },
+          deadline));
+      continue;
+    }
+    // May wrap around the end of the ring.
+    size_t first = std::min<uint64_t>(n, capacity_ - head_ % capacity_);
+    memcpy(slot(head_), src, first * element_size_);
+    memcpy(slot(0), src + first * element_size_, (n - first) * element_size_);
+    head_ += n;
+    h->head.store(head_, std::memory_order_seq_cst);
+    Ring(h->consumer_waiting, ready_fd_.get());
+    src += n * element_size_;
+    count -= n;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<size_t> SharedRing::Pop(void* elements, size_t max_count,
+                                       absl::Duration timeout) {
+  if (max_count == 0) {
+    return 0;
+  }
+  const absl::Time deadline = absl::Now() + timeout;
+  uint8_t* dst = static_cast<uint8_t*>(elements);
+  Header* h = GetHeader(*buffer_);
+  for (;;) {
+    uint64_t available = h->head.load(std::memory_order_seq_cst) - tail_;
+    if (available > capacity_) {
+      return CorruptError();
+    }
+    if (available != 0) {
+      size_t n = std::min<uint64_t>(max_count, available);
+      size_t first = std::min<uint64_t>(n, capacity_ - tail_ % capacity_);
+      memcpy(dst, slot(tail_), first * element_size_);
+      memcpy(dst + first * element_size_, slot(0),
+             (n - first) * element_size_);
+      tail_ += n;
+      h->tail.store(tail_, std::memory_order_seq_cst);
+      Ring(h->producer_waiting, free_fd_.get());
+      return n;
+    }
+    SAPI_RETURN_IF_ERROR(Wait(
+        h->consumer_waiting, ready_fd_.get(),
+        [&] { return h->head.load(std::memory_order_seq_cst) != tail_; },
+        deadline));
+  }
+}
+
+}  // namespace sandbox2::internal
@@ -0,0 +1,194 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The sandbox2::SharedChannel class streams elements between the executor and
+// the sandboxee through shared memory, instead of copying each of them over
+// Comms.
+
+#ifndef SANDBOXED_API_SANDBOX2_SHARED_CHANNEL_H_
+#define SANDBOXED_API_SANDBOX2_SHARED_CHANNEL_H_
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+#include "sandboxed_api/sandbox2/ipc.h"
+#include "sandboxed_api/util/fileops.h"
+
+namespace sandbox2 {
+namespace internal {
+
+// Untyped implementation of SharedChannel: a single-producer single-consumer
+// ring buffer in a sealed memfd, with an eventfd to wake up each side.
+class SharedRing {
+ public:
+  static absl::StatusOr<SharedRing> Create(size_t element_size,
+                                           size_t capacity);
+  static absl::StatusOr<SharedRing> Attach(
+      sapi::file_util::fileops::FDCloser memfd,
+      sapi::file_util::fileops::FDCloser ready_fd,
+      sapi::file_util::fileops::FDCloser free_fd, size_t element_size);
+
+  SharedRing(SharedRing&&) = default;
+  SharedRing& operator=(SharedRing&&) = default;
+
+  absl::Status Push(const void* elements, size_t count,
+                    absl::Duration timeout);
+  absl::StatusOr<size_t> Pop(void* elements, size_t max_count,
+                             absl::Duration timeout);
+
+  int memfd() const { return buffer_->fd(); }
+  int ready_fd() const { return ready_fd_.get(); }
+  int free_fd() const { return free_fd_.get(); }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  SharedRing() = default;
+
+  uint8_t* slot(uint64_t index) const;
+
+  std::unique_ptr<Buffer> buffer_;
+  // Rung by the producer after adding elements.
+  sapi::file_util::fileops::FDCloser ready_fd_;
+  // Rung by the consumer after removing elements.
+  sapi::file_util::fileops::FDCloser free_fd_;
+  size_t element_size_ = 0;
+  // Never read back from the shared memory, which the other side can modify.
+  size_t capacity_ = 0;
+  uint64_t head_ = 0;
+  uint64_t tail_ = 0;
+};
+
+}  // namespace internal
+
+// SharedChannel streams elements of type T in one direction between two
+// processes, usually the executor and the sandboxee. One side creates the
+// channel and maps it into the other one before launch, which then attaches to
+// it:
+//
+//   // Executor:
+//   SAPI_ASSIGN_OR_RETURN(auto channel, SharedChannel<Block>::Create(64));
+//   channel->MapTo(executor->ipc(), "blocks");
+//   ...
+//   SAPI_RETURN_IF_ERROR(channel->Push(block));
+//
+//   // Sandboxee:
+//   SAPI_ASSIGN_OR_RETURN(auto channel,
+//                         SharedChannel<Block>::Attach(
+//                             client.GetMappedFD("blocks"),
+//                             client.GetMappedFD("blocks.ready"),
+//                             client.GetMappedFD("blocks.free")));
+//   SAPI_ASSIGN_OR_RETURN(Block block, channel->Pop());
+//
+// Only one side may push and only the other one may pop. Either side must
+// distrust the elements it pops, and the channel fails with a DataLoss error if
+// the other side corrupts it. Pushing and popping only make a system call if
+// the other side waits for the channel to fill or drain.
+template <typename T>
+class SharedChannel final {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>,
+                "SharedChannel elements are copied as bytes");
+
+  SharedChannel(const SharedChannel&) = delete;
+  SharedChannel& operator=(const SharedChannel&) = delete;
+
+  // Creates a channel with room for capacity elements.
+  static absl::StatusOr<std::unique_ptr<SharedChannel>> Create(
+      size_t capacity) {
+    auto ring = internal::SharedRing::Create(sizeof(T), capacity);
+    if (!ring.ok()) {
+      return ring.status();
+    }
+    return absl::WrapUnique(new SharedChannel(*std::move(ring)));
+  }
+
+  // Attaches to a channel created by the other side, taking ownership of the
+  // file descriptors.
+  static absl::StatusOr<std::unique_ptr<SharedChannel>> Attach(int memfd,
+                                                               int ready_fd,
+                                                               int free_fd) {
+    using sapi::file_util::fileops::FDCloser;
+    auto ring = internal::SharedRing::Attach(
+        FDCloser(memfd), FDCloser(ready_fd), FDCloser(free_fd), sizeof(T));
+    if (!ring.ok()) {
+      return ring.status();
+    }
+    return absl::WrapUnique(new SharedChannel(*std::move(ring)));
+  }
+
+  // Marks duplicates of the file descriptors of the channel to be sent to the
+  // sandboxee, which retrieves them with Client::GetMappedFD() as name,
+  // name.ready and name.free.
+  void MapTo(IPC* ipc, absl::string_view name) const {
+    ipc->MapFd(dup(ring_.memfd()), name);
+    ipc->MapFd(dup(ring_.ready_fd()), absl::StrCat(name, ".ready"));
+    ipc->MapFd(dup(ring_.free_fd()), absl::StrCat(name, ".free"));
+  }
+
+  // Pushes all values, waiting for room as needed.
+  absl::Status Push(absl::Span<const T> values,
+                    absl::Duration timeout = absl::InfiniteDuration()) {
+    return ring_.Push(values.data(), values.size(), timeout);
+  }
+  absl::Status Push(const T& value,
+                    absl::Duration timeout = absl::InfiniteDuration()) {
+    return ring_.Push(&value, 1, timeout);
+  }
+
+  // Pops at least one and at most values.size() values, waiting for the first
+  // one as needed. Returns the number of values popped.
+  absl::StatusOr<size_t> Pop(
+      absl::Span<T> values, absl::Duration timeout = absl::InfiniteDuration()) {
+    return ring_.Pop(values.data(), values.size(), timeout);
+  }
+  absl::StatusOr<T> Pop(absl::Duration timeout = absl::InfiniteDuration()) {
+    T value;
+    absl::StatusOr<size_t> popped = ring_.Pop(&value, 1, timeout);
+    if (!popped.ok()) {
+      return popped.status();
+    }
+    return value;
+  }
+
+  size_t capacity() const { return ring_.capacity(); }
+
+  // Gets the file descriptors of the channel, e.g. to send them over Comms
+  // instead of mapping them with MapTo().
+  int memfd() const { return ring_.memfd(); }
+  int ready_fd() const { return ring_.ready_fd(); }
+  int free_fd() const { return ring_.free_fd(); }
+
+ private:
+  explicit SharedChannel(internal::SharedRing ring) : ring_(std::move(ring)) {}
+
+  internal::SharedRing ring_;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_SHARED_CHANNEL_H_
@@ -0,0 +1,127 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/shared_channel.h"
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
+using ::testing::Eq;
+using ::testing::Not;
+
+struct Block {
+  uint64_t sequence;
+  char data[60];
+};
+
+TEST(SharedChannelTest, PushesAndPopsInProcess) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, SharedChannel<int>::Create(4));
+  EXPECT_THAT(channel->capacity(), Eq(4));
+  EXPECT_THAT(channel->Push(std::vector<int>{1, 2, 3}), IsOk());
+  std::vector<int> values(8);
+  SAPI_ASSERT_OK_AND_ASSIGN(size_t popped,
+                            channel->Pop(absl::MakeSpan(values)));
+  EXPECT_THAT(popped, Eq(3));
+  EXPECT_THAT(values[2], Eq(3));
+  // Wraps around the end of the ring.
+  EXPECT_THAT(channel->Push(std::vector<int>{4, 5, 6, 7}), IsOk());
+  EXPECT_THAT(channel->Push(8, absl::Milliseconds(10)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  SAPI_ASSERT_OK_AND_ASSIGN(int value, channel->Pop());
+  EXPECT_THAT(value, Eq(4));
+}
+
+TEST(SharedChannelTest, TimesOutWhenEmpty) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, SharedChannel<int>::Create(1));
+  EXPECT_THAT(channel->Pop(absl::Milliseconds(10)).status(),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+}
+
+TEST(SharedChannelTest, StreamsAcrossProcesses) {
+  constexpr int kBlocks = 10000;
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, SharedChannel<Block>::Create(16));
+  // Stands in for the sandboxee, which gets the descriptors through IPC.
+  int memfd = dup(channel->memfd());
+  int ready_fd = dup(channel->ready_fd());
+  int free_fd = dup(channel->free_fd());
+  pid_t child = fork();
+  ASSERT_THAT(child, Not(Eq(-1)));
+  if (child == 0) {
+    auto attached = SharedChannel<Block>::Attach(memfd, ready_fd, free_fd);
+    if (!attached.ok()) {
+      _exit(1);
+    }
+    for (int i = 0; i < kBlocks; ++i) {
+      auto block = (*attached)->Pop(absl::Seconds(10));
+      if (!block.ok() || block->sequence != static_cast<uint64_t>(i)) {
+        _exit(2);
+      }
+    }
+    _exit(0);
+  }
+  close(memfd);
+  close(ready_fd);
+  close(free_fd);
+  for (int i = 0; i < kBlocks; ++i) {
+    ASSERT_THAT(channel->Push(Block{.sequence = static_cast<uint64_t>(i)}),
+                IsOk());
+  }
+  int status;
+  ASSERT_THAT(waitpid(child, &status, 0), Eq(child));
+  EXPECT_THAT(WIFEXITED(status) ? WEXITSTATUS(status) : -1, Eq(0));
+}
+
+TEST(SharedChannelTest, DetectsCorruption) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, SharedChannel<int>::Create(4));
+  void* shared = mmap(nullptr, getpagesize(), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, channel->memfd(), 0);
+  ASSERT_THAT(shared, Not(Eq(MAP_FAILED)));
+  // Advances the head of the ring far beyond its capacity, as a malicious
+  // producer could.
+  reinterpret_cast<std::atomic<uint64_t>*>(static_cast<char*>(shared) + 64)
+      ->store(100);
+  EXPECT_THAT(channel->Pop().status(), StatusIs(absl::StatusCode::kDataLoss));
+  munmap(shared, getpagesize());
+}
+
+TEST(SharedChannelTest, RejectsOtherTypes) {
+  SAPI_ASSERT_OK_AND_ASSIGN(auto channel, SharedChannel<int>::Create(4));
+  EXPECT_THAT(SharedChannel<Block>::Attach(dup(channel->memfd()),
+                                           dup(channel->ready_fd()),
+                                           dup(channel->free_fd()))
+                  .status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(SharedChannel<int>::Create(0).status(), Not(IsOk()));
+}
+
+}  // namespace
+}  // namespace sandbox2
@@ -0,0 +1,148 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how many short-lived sandboxees can be started per second.
+// items_per_second is the spawn rate summed over all threads, p50_us/p99_us
+// are the spawn-to-exit latency percentiles averaged over the threads.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/executor.h"
+#include "sandboxed_api/sandbox2/fork_client.h"
+#include "sandboxed_api/sandbox2/policy.h"
+#include "sandboxed_api/sandbox2/policybuilder.h"
+#include "sandboxed_api/sandbox2/result.h"
+#include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/testing.h"
+#include "sandboxed_api/util/runfiles.h"
+
+namespace sandbox2 {
+namespace {
+
+enum Monitor : int64_t {
+  kPtrace = 0,
+  kUnotify = 1,
+};
+
+enum ForkServer : int64_t {
+  kGlobalForkServer = 0,
+  kCustomForkServer = 1,
+};
+
+// Shared by all threads. Started on first use and never shut down.
+ForkClient* GetCustomForkClient() {
+  static ForkClient* fork_client = [] {
+    const std::string path = sapi::internal::GetSapiDataDependencyFilePath(
+        "sandbox2/testcases/custom_forkserver");
+    auto* executor = new Executor(path, std::vector<std::string>{path},
+                                  std::vector<std::string>{});
+    std::unique_ptr<ForkClient> client = executor->StartForkServer();
+    CHECK(client != nullptr) << "Starting the custom forkserver failed";
+    return client.release();
+  }();
+  return fork_client;
+}
+
+absl::StatusOr<std::unique_ptr<Policy>> CreatePolicy(
+    const std::string& bin_path, bool namespaces, int mounts) {
+  PolicyBuilder builder = sapi::CreateDefaultPermissiveTestPolicy(bin_path);
+  if (!namespaces) {
+    builder.DisableNamespaces();
+  }
+  for (int i = 0; i < mounts; ++i) {
+    builder.AddFileAt(bin_path, absl::StrCat("/mounts/", i));
+  }
+  return builder.TryBuild();
+}
+
+// Args: namespaces (0/1), monitor, forkserver, number of extra mounts.
+void BM_Spawn(benchmark::State& state) {
+  const bool namespaces = state.range(0);
+  const bool unotify = state.range(1) == kUnotify;
+  const bool custom_forkserver = state.range(2) == kCustomForkServer;
+  const int mounts = state.range(3);
+  if (!namespaces && mounts > 0) {
+    state.SkipWithError("Mounts require namespaces");
+    return;
+  }
+
+  const std::string path = sapi::internal::GetSapiDataDependencyFilePath(
+      custom_forkserver ? "sandbox2/testcases/custom_forkserver"
+                        : "sandbox2/testcases/minimal");
+  ForkClient* fork_client = custom_forkserver ? GetCustomForkClient() : nullptr;
+  std::vector<double> samples;
+  for (auto _ : state) {
+    absl::Time start = absl::Now();
+    auto executor = fork_client != nullptr
+                        ? std::make_unique<Executor>(fork_client)
+                        : std::make_unique<Executor>(
+                              path, std::vector<std::string>{path});
+    absl::StatusOr<std::unique_ptr<Policy>> policy =
+        CreatePolicy(path, namespaces, mounts);
+    if (!policy.ok()) {
+      state.SkipWithError(std::string(policy.status().message()).c_str());
+      break;
+    }
+    Sandbox2 sandbox(std::move(executor), *std::move(policy));
+    if (unotify) {
+      if (absl::Status status = sandbox.EnableUnotifyMonitor(); !status.ok()) {
+        state.SkipWithError(std::string(status.message()).c_str());
+        break;
+      }
+    }
+    Result result = sandbox.Run();
+    if (result.final_status() != Result::OK) {
+      state.SkipWithError(result.ToString().c_str());
+      break;
+    }
+    samples.push_back(absl::ToDoubleSeconds(absl::Now() - start));
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (samples.empty()) {
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  auto percentile = [&samples](double p) {
+    size_t index = std::min(samples.size() - 1,
+                            static_cast<size_t>(p * samples.size()));
+    return benchmark::Counter(samples[index] * 1e6,
+                              benchmark::Counter::kAvgThreads);
+  };
+  state.counters["p50_us"] = percentile(0.50);
+  state.counters["p99_us"] = percentile(0.99);
+}
+BENCHMARK(BM_Spawn)
+    ->ArgsProduct({{0, 1},
+                   {kPtrace, kUnotify},
+                   {kGlobalForkServer, kCustomForkServer},
+                   {0, 16, 256}})
+    ->ArgNames({"namespaces", "monitor", "forkserver", "mounts"})
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace sandbox2
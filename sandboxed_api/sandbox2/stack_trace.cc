@@ -20,10 +20,12 @@
 #include <sys/resource.h>
 #include <syscall.h>
 
+#include <cstdint>
 #include <memory>
 #include <utility>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/cleanup/cleanup.h"
 #include "absl/flags/flag.h"
 #include "absl/log/log.h"
@@ -31,6 +33,8 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/comms.h"
 #include "sandboxed_api/sandbox2/executor.h"
@@ -52,12 +56,53 @@ ABSL_FLAG(bool, sandbox_disable_all_stack_traces, false,
 ABSL_FLAG(bool, sandbox_libunwind_crash_handler, true,
           "Sandbox libunwind when handling violations (preferred)");
 
+ABSL_FLAG(int32_t, sandbox_max_concurrent_stack_traces, 4,
+          "Maximum number of libunwind sandboxes run at the same time by all "
+          "monitors of the process");
+
+ABSL_FLAG(absl::Duration, sandbox_stack_trace_queue_timeout, absl::Seconds(1),
+          "How long a monitor waits for one of the "
+          "--sandbox_max_concurrent_stack_traces to become free before giving "
+          "up on the stack trace");
+
 namespace sandbox2 {
 namespace {
 
 namespace file = ::sapi::file;
 namespace file_util = ::sapi::file_util;
 
+// Limits the number of libunwind sandboxes running at the same time. Without
+// that, a crash storm across many sandboxes starts as many libunwind sandboxes,
+// which then all run into their walltime limit.
+class LibunwindSandboxSlots {
+ public:
+  static LibunwindSandboxSlots& Get() {
+    static auto* slots = new LibunwindSandboxSlots();
+    return *slots;
+  }
+
+  // Returns false if no slot became free within the timeout.
+  bool Acquire(int max_slots, absl::Duration timeout) {
+    absl::MutexLock lock(&mutex_);
+    auto has_free_slot = [this, max_slots]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(
+                             mutex_) { return used_ < max_slots; };
+    if (!mutex_.AwaitWithTimeout(absl::Condition(&has_free_slot), timeout)) {
+      return false;
+    }
+    ++used_;
+    return true;
+  }
+
+  void Release() {
+    absl::MutexLock lock(&mutex_);
+    --used_;
+  }
+
+ private:
+  absl::Mutex mutex_;
+  int used_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
 // Similar to GetStackTrace() but without using the sandbox to isolate
 // libunwind.
 absl::StatusOr<std::vector<std::string>> UnsafeGetStackTrace(pid_t pid) {
@@ -283,8 +328,7 @@ absl::StatusOr<std::vector<std::string>> StackTracePeer::LaunchLibunwindSandbox(
                      sandbox_result.ToString()));
   }
 
-  return std::vector<std::string>(result.stacktrace().begin(),
-                                  result.stacktrace().end());
+  return StackTraceFromUnwindResult(result);
 }
 
 absl::StatusOr<std::vector<std::string>> GetStackTrace(
@@ -314,6 +358,13 @@ absl::StatusOr<std::vector<std::string>> GetStackTrace(
     return UnsafeGetStackTrace(regs->pid());
   }
 
+  LibunwindSandboxSlots& slots = LibunwindSandboxSlots::Get();
+  if (!slots.Acquire(absl::GetFlag(FLAGS_sandbox_max_concurrent_stack_traces),
+                     absl::GetFlag(FLAGS_sandbox_stack_trace_queue_timeout))) {
+    return absl::ResourceExhaustedError(
+        "Too many stack traces are being collected");
+  }
+  absl::Cleanup release_slot = [&slots] { slots.Release(); };
   return StackTracePeer::LaunchLibunwindSandbox(regs, ns,
                                                 uses_custom_forkserver);
 }
@@ -16,30 +16,38 @@
 
 #include <dirent.h>
 
+#include <cstdint>
 #include <cstdio>
 #include <functional>
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/flags/declare.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/reflection.h"
+#include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/time/time.h"
 #include "sandboxed_api/sandbox2/executor.h"
 #include "sandboxed_api/sandbox2/global_forkclient.h"
+#include "sandboxed_api/sandbox2/monitor_reactor.h"
 #include "sandboxed_api/sandbox2/policy.h"
 #include "sandboxed_api/sandbox2/policybuilder.h"
 #include "sandboxed_api/sandbox2/result.h"
 #include "sandboxed_api/sandbox2/sandbox2.h"
+#include "sandboxed_api/sandbox2/unwind/unwind.h"
+#include "sandboxed_api/sandbox2/unwind/unwind.pb.h"
 #include "sandboxed_api/testing.h"
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 ABSL_DECLARE_FLAG(bool, sandbox_libunwind_crash_handler);
+ABSL_DECLARE_FLAG(int32_t, sandbox_max_concurrent_stack_traces);
+ABSL_DECLARE_FLAG(absl::Duration, sandbox_stack_trace_queue_timeout);
 
 namespace sandbox2 {
 namespace {
@@ -47,6 +55,8 @@ namespace {
 namespace file_util = ::sapi::file_util;
 using ::sapi::CreateDefaultPermissiveTestPolicy;
 using ::sapi::GetTestSourcePath;
+using ::sapi::IsOk;
+using ::sapi::StatusIs;
 using ::testing::Contains;
 using ::testing::ElementsAre;
 using ::testing::Eq;
@@ -186,6 +196,41 @@ TEST(StackTraceTest, ForkEnterNsLibunwindDoesNotLeakFDs) {
   EXPECT_THAT(filecount_before, Eq(FileCountInDirectory(forkserver_fd_path)));
 }
 
+TEST(StackTraceTest, NoStackTraceWithoutFreeLibunwindSandbox) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_sandbox_libunwind_crash_handler, true);
+  absl::SetFlag(&FLAGS_sandbox_max_concurrent_stack_traces, 0);
+  absl::SetFlag(&FLAGS_sandbox_stack_trace_queue_timeout,
+                absl::ZeroDuration());
+
+  const std::string path = GetTestSourcePath("sandbox2/testcases/symbolize");
+  std::vector<std::string> args = {path, "1", "1"};
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultPermissiveTestPolicy(path).TryBuild());
+  Sandbox2 s2(std::make_unique<Executor>(path, args), std::move(policy));
+  auto result = s2.Run();
+
+  EXPECT_THAT(result.final_status(), Eq(Result::SIGNALED));
+  EXPECT_THAT(result.stack_trace(), IsEmpty());
+}
+
+// Test that the unotify monitor still gets stack traces when it runs on a
+// reactor, where they are collected on a thread of their own.
+TEST(StackTraceTest, SymbolizationWorksWithUnotifyMonitorOnReactor) {
+  const std::string path = GetTestSourcePath("sandbox2/testcases/symbolize");
+  std::vector<std::string> args = {path, "2", "1"};
+  SAPI_ASSERT_OK_AND_ASSIGN(auto policy,
+                            CreateDefaultPermissiveTestPolicy(path).TryBuild());
+  MonitorReactor reactor;
+  Sandbox2 s2(std::make_unique<Executor>(path, args), std::move(policy));
+  ASSERT_THAT(s2.EnableUnotifyMonitor(&reactor), IsOk());
+  auto result = s2.Run();
+
+  EXPECT_THAT(result.final_status(), Eq(Result::VIOLATION));
+  EXPECT_THAT(result.stack_trace(), Contains(StartsWith("ViolatePolicy")));
+  EXPECT_THAT(result.stack_trace(), Contains(StartsWith("main")));
+}
+
 TEST(StackTraceTest, CompactStackTrace) {
   EXPECT_THAT(CompactStackTrace({}), IsEmpty());
   EXPECT_THAT(CompactStackTrace({"_start"}), ElementsAre("_start"));
@@ -211,6 +256,24 @@ TEST(StackTraceTest, CompactStackTrace) {
                           "(previous frame repeated 3 times)"));
 }
 
+TEST(StackTraceTest, StackTraceFromUnwindResult) {
+  UnwindResult result;
+  result.add_symbols("recursive_call(0x1234)");
+  result.add_symbols("main(0x5678)");
+  for (uint32_t frame : {0, 0, 0, 1}) {
+    result.add_frames(frame);
+  }
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<std::string> stack_trace,
+                            StackTraceFromUnwindResult(result));
+  EXPECT_THAT(stack_trace,
+              ElementsAre("recursive_call(0x1234)", "recursive_call(0x1234)",
+                          "recursive_call(0x1234)", "main(0x5678)"));
+
+  result.add_frames(2);
+  EXPECT_THAT(StackTraceFromUnwindResult(result),
+              StatusIs(absl::StatusCode::kInternal));
+}
+
 INSTANTIATE_TEST_SUITE_P(
     Instantiation, StackTraceTest,
     ::testing::Values(
@@ -22,8 +22,8 @@
 #include <cstring>
 #include <string>
 
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
-#include "absl/strings/str_join.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/syscall_defs.h"
 
@@ -81,10 +81,17 @@ std::vector<std::string> Syscall::GetArgumentsDescription() const {
 }
 
 std::string Syscall::GetDescription() const {
-  const std::string arch = GetArchDescription(arch_);
-  const std::string args = absl::StrJoin(GetArgumentsDescription(), ", ");
-  return absl::StrFormat("%s %s [%d](%s) IP: %#x, STACK: %#x", arch, GetName(),
-                         nr_, args, ip_, sp_);
+  std::string description;
+  AppendDescription(&description);
+  return description;
+}
+
+void Syscall::AppendDescription(std::string* out) const {
+  absl::StrAppend(out, GetArchDescription(arch_), " ", GetName(), " [", nr_,
+                  "](");
+  SyscallTable::get(arch_).AppendArgumentsDescription(nr_, args_.data(), pid_,
+                                                      out);
+  absl::StrAppendFormat(out, ") IP: %#x, STACK: %#x", ip_, sp_);
 }
 
 }  // namespace sandbox2
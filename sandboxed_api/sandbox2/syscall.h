@@ -62,8 +62,12 @@ class Syscall {
 
   std::vector<std::string> GetArgumentsDescription() const;
   std::string GetDescription() const;
+  // Same as GetDescription(), but appends to out, which can be reused across
+  // syscalls to avoid allocations.
+  void AppendDescription(std::string* out) const;
 
  private:
+  friend class PtraceMonitor;
   friend class Regs;
   friend class UnotifyMonitor;
 
@@ -1,13 +1,17 @@
 #include "sandboxed_api/sandbox2/syscall_defs.h"
 
 #include <cstdint>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/log/log.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
+#include "absl/types/span.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/util.h"
 
@@ -40,8 +44,11 @@ struct SyscallTable::Entry {
     return num_args;
   }
 
-  static std::string GetArgumentDescription(uint64_t value, ArgType type,
-                                            pid_t pid);
+  // Appends the description of an argument to out. path is the string the
+  // argument points to for kPath arguments.
+  static void AppendArgumentDescription(
+      uint64_t value, ArgType type, const absl::StatusOr<std::string>* path,
+      std::string* out);
 
   static constexpr bool BySyscallNr(const SyscallTable::Entry& a,
                                     const SyscallTable::Entry& b) {
@@ -54,29 +61,27 @@ struct SyscallTable::Entry {
   std::array<ArgType, syscalls::kMaxArgs> arg_types;
 };
 
-std::string SyscallTable::Entry::GetArgumentDescription(uint64_t value,
-                                                        ArgType type,
-                                                        pid_t pid) {
-  std::string ret = absl::StrFormat("%#x", value);
+void SyscallTable::Entry::AppendArgumentDescription(
+    uint64_t value, ArgType type, const absl::StatusOr<std::string>* path,
+    std::string* out) {
+  absl::StrAppendFormat(out, "%#x", value);
   switch (type) {
     case kOct:
-      absl::StrAppendFormat(&ret, " [\\0%o]", value);
+      absl::StrAppendFormat(out, " [\\0%o]", value);
       break;
     case kPath:
-      if (auto path_or = util::ReadCPathFromPid(pid, value); path_or.ok()) {
-        absl::StrAppendFormat(&ret, " ['%s']",
-                              absl::CHexEscape(path_or.value()));
+      if (path != nullptr && path->ok()) {
+        absl::StrAppend(out, " ['", absl::CHexEscape(**path), "']");
       } else {
-        absl::StrAppend(&ret, " [unreadable path]");
+        absl::StrAppend(out, " [unreadable path]");
       }
       break;
     case kInt:
-      absl::StrAppendFormat(&ret, " [%d]", value);
+      absl::StrAppendFormat(out, " [%d]", value);
       break;
     default:
       break;
   }
-  return ret;
 }
 
 absl::string_view SyscallTable::GetName(int syscall) const {
@@ -108,27 +113,73 @@ constexpr SyscallTable::Entry MakeEntry(int nr, absl::string_view name,
 
 }  // namespace
 
-std::vector<std::string> SyscallTable::GetArgumentsDescription(
-    int syscall, const uint64_t values[], pid_t pid) const {
+const SyscallTable::Entry& SyscallTable::GetEntry(int syscall) const {
   static SyscallTable::Entry kInvalidEntry =
       MakeEntry(-1, "", UnknownArguments());
   auto it = absl::c_lower_bound(
       data_, syscall, [](const SyscallTable::Entry& entry, int syscall) {
         return entry.nr < syscall;
       });
-  const auto& entry =
-      it != data_.end() && it->nr == syscall ? *it : kInvalidEntry;
+  return it != data_.end() && it->nr == syscall ? *it : kInvalidEntry;
+}
+
+namespace {
 
+// Calls callback(index, value, type, path) for each argument of the syscall.
+template <typename Callback>
+void ForEachArgument(const SyscallTable::Entry& entry, const uint64_t values[],
+                     pid_t pid, Callback callback) {
   int num_args = entry.GetNumArgs();
-  std::vector<std::string> rv;
-  rv.reserve(num_args);
+  // Reads all path arguments from the sandboxee at once.
+  uintptr_t path_ptrs[syscalls::kMaxArgs];
+  int num_paths = 0;
   for (int i = 0; i < num_args; ++i) {
-    rv.push_back(SyscallTable::Entry::GetArgumentDescription(
-        values[i], entry.arg_types[i], pid));
+    if (entry.arg_types[i] == kPath) {
+      path_ptrs[num_paths++] = values[i];
+    }
+  }
+  std::vector<absl::StatusOr<std::string>> paths;
+  if (num_paths > 0) {
+    paths = util::ReadCPathsFromPid(
+        pid, absl::MakeConstSpan(path_ptrs, num_paths));
   }
+  for (int i = 0, path = 0; i < num_args; ++i) {
+    callback(i, values[i], entry.arg_types[i],
+             entry.arg_types[i] == kPath ? &paths[path++] : nullptr);
+  }
+}
+
+}  // namespace
+
+std::vector<std::string> SyscallTable::GetArgumentsDescription(
+    int syscall, const uint64_t values[], pid_t pid) const {
+  std::vector<std::string> rv;
+  rv.reserve(syscalls::kMaxArgs);
+  ForEachArgument(
+      GetEntry(syscall), values, pid,
+      [&rv](int, uint64_t value, ArgType type,
+            const absl::StatusOr<std::string>* path) {
+        SyscallTable::Entry::AppendArgumentDescription(value, type, path,
+                                                       &rv.emplace_back());
+      });
   return rv;
 }
 
+void SyscallTable::AppendArgumentsDescription(int syscall,
+                                              const uint64_t values[],
+                                              pid_t pid,
+                                              std::string* out) const {
+  ForEachArgument(
+      GetEntry(syscall), values, pid,
+      [out](int i, uint64_t value, ArgType type,
+            const absl::StatusOr<std::string>* path) {
+        if (i > 0) {
+          out->append(", ");
+        }
+        SyscallTable::Entry::AppendArgumentDescription(value, type, path, out);
+      });
+}
+
 namespace {
 
 // TODO(C++20) Use std::is_sorted
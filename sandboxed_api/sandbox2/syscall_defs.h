@@ -34,7 +34,14 @@ class SyscallTable {
                                                    const uint64_t values[],
                                                    pid_t pid) const;
 
+  // Appends the comma-separated descriptions of the arguments to out, which
+  // can be reused across calls to avoid allocations.
+  void AppendArgumentsDescription(int syscall, const uint64_t values[],
+                                  pid_t pid, std::string* out) const;
+
  private:
+  const Entry& GetEntry(int syscall) const;
+
   constexpr SyscallTable() = default;
   explicit constexpr SyscallTable(absl::Span<const Entry> data) : data_(data) {}
 
@@ -16,12 +16,17 @@
 
 #include <linux/unistd.h>
 
+#include <string>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "sandboxed_api/config.h"
 
 using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::HasSubstr;
 using ::testing::StartsWith;
 
 namespace sandbox2 {
@@ -51,6 +56,20 @@ TEST(SyscallTest, Basic) {
                   "](0x1 [1], 0xbadbeef, 0x5 [5]) IP: 0, STACK: 0")));
 }
 
+TEST(SyscallTest, AppendsDescription) {
+  Syscall::Args args{0x10, 0x20, 0x30, 0644};
+  Syscall syscall(Syscall::GetHostArch(), __NR_openat, args);
+  auto arg_desc = syscall.GetArgumentsDescription();
+  ASSERT_THAT(arg_desc.size(), Ge(2));
+  // There is no process to read the path from.
+  EXPECT_THAT(arg_desc[1], Eq("0x20 [unreadable path]"));
+  std::string description = "prefix ";
+  syscall.AppendDescription(&description);
+  EXPECT_THAT(description,
+              Eq(absl::StrCat("prefix ", syscall.GetDescription())));
+  EXPECT_THAT(description, HasSubstr(absl::StrJoin(arg_desc, ", ")));
+}
+
 TEST(SyscallTest, Empty) {
   Syscall syscall;
 
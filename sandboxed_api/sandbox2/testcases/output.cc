@@ -0,0 +1,37 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes the number of mebibytes given as its argument to stdout in numbered
+// lines, and "done" to stderr.
+
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char* argv[]) {
+  const long size = argc > 1 ? strtol(argv[1], nullptr, 10) << 20 : 0;
+  for (long line = 0, written = 0; written < size; ++line) {
+    char buffer[32];
+    int n = snprintf(buffer, sizeof(buffer), "%ld\n", line);
+    if (n > size - written) {
+      n = size - written;
+    }
+    if (fwrite(buffer, 1, n, stdout) != static_cast<size_t>(n)) {
+      return 1;
+    }
+    written += n;
+  }
+  fflush(stdout);
+  fputs("done\n", stderr);
+  return 0;
+}
@@ -14,8 +14,12 @@
 
 // A binary that tries x86_64 compat syscalls, ptrace and clone untraced.
 
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
 #include <sched.h>
 #include <sys/ptrace.h>
+#include <sys/socket.h>
 #include <syscall.h>
 #include <unistd.h>
 
@@ -93,6 +97,39 @@ void TestBpfError() {
   exit(syscall(__NR_bpf, 0, nullptr, 0) == -1 ? errno : 0);
 }
 
+void TestBrokeredOpen(const char* allowed) {
+  int fd = open(allowed, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    printf("Opening the brokered file failed: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  if (open("/etc/passwd", O_RDONLY) != -1 || errno != EACCES) {
+    printf("Opening a file which is not brokered should have failed\n");
+    exit(EXIT_FAILURE);
+  }
+  if (open(allowed, O_WRONLY) != -1 || errno != EACCES) {
+    printf("Opening a read-only file for writing should have failed\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void TestConnect(const char* ip, const char* port) {
+  sockaddr_in addr = {.sin_family = AF_INET,
+                      .sin_port = htons(atoi(port))};  // NOLINT
+  if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) {
+    printf("Invalid address: %s\n", ip);
+    exit(EXIT_FAILURE);
+  }
+  int s = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (s == -1 ||
+      connect(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    printf("Connecting failed: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  close(s);
+}
+
 void TestIsatty() {
   isatty(0);
 }
@@ -136,6 +173,20 @@ int main(int argc, char* argv[]) {
     case 8:
       TestPtraceBlocked();
       break;
+    case 9:
+      if (argc < 3) {
+        printf("argc < 3\n");
+        return EXIT_FAILURE;
+      }
+      TestBrokeredOpen(argv[2]);
+      break;
+    case 10:
+      if (argc < 4) {
+        printf("argc < 4\n");
+        return EXIT_FAILURE;
+      }
+      TestConnect(argv[2], argv[3]);
+      break;
     default:
       printf("Unknown test: %d\n", testno);
       return EXIT_FAILURE;
@@ -14,7 +14,10 @@
 
 #include <unistd.h>
 
+#include <cstdlib>
+
+// Sleeps for the number of seconds given as the first argument, or for 10.
 int main(int argc, char* argv[]) {
-  sleep(10);
+  sleep(argc > 1 ? atoi(argv[1]) : 10);
   return 0;
 }
@@ -0,0 +1,78 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/trace.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace sandbox2 {
+namespace {
+
+std::string JsonEscape(absl::string_view str) {
+  std::string escaped;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      absl::StrAppendFormat(&escaped, "\\u%04x", c);
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+}  // namespace
+
+int64_t MonotonicNowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t{ts.tv_sec} * 1000000000 + ts.tv_nsec;
+}
+
+void ScopedTraceSpan::End() {
+  if (trace_ == nullptr) {
+    return;
+  }
+  trace_->push_back({std::string(name_), start_ns_, MonotonicNowNs(), getpid()});
+  trace_ = nullptr;
+}
+
+std::string TraceSpansToChromeJson(absl::Span<const TraceSpan> spans) {
+  std::string json = "{\"traceEvents\":[";
+  for (size_t i = 0; i < spans.size(); ++i) {
+    const TraceSpan& span = spans[i];
+    // Complete events, with timestamps in microseconds.
+    absl::StrAppendFormat(
+        &json,
+        "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+        "\"pid\":%d,\"tid\":%d}",
+        i == 0 ? "" : ",", JsonEscape(span.name), span.start_ns / 1e3,
+        (span.end_ns - span.start_ns) / 1e3, span.pid, span.pid);
+  }
+  absl::StrAppend(&json, "],\"displayTimeUnit\":\"ns\"}");
+  return json;
+}
+
+}  // namespace sandbox2
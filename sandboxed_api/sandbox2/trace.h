@@ -0,0 +1,69 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Timestamps of the sandbox startup phases, see Executor::set_trace_startup().
+
+#ifndef SANDBOXED_API_SANDBOX2_TRACE_H_
+#define SANDBOXED_API_SANDBOX2_TRACE_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace sandbox2 {
+
+struct TraceSpan {
+  std::string name;
+  // CLOCK_MONOTONIC timestamps, which are comparable between processes.
+  int64_t start_ns = 0;
+  int64_t end_ns = 0;
+  // The process that recorded the span.
+  pid_t pid = 0;
+};
+
+// Returns the current CLOCK_MONOTONIC time in nanoseconds.
+int64_t MonotonicNowNs();
+
+// Appends a span covering its lifetime to `trace`, unless that is nullptr.
+class ScopedTraceSpan {
+ public:
+  ScopedTraceSpan(std::vector<TraceSpan>* trace, absl::string_view name)
+      : trace_(trace),
+        name_(name),
+        start_ns_(trace != nullptr ? MonotonicNowNs() : 0) {}
+  ScopedTraceSpan(const ScopedTraceSpan&) = delete;
+  ScopedTraceSpan& operator=(const ScopedTraceSpan&) = delete;
+  ~ScopedTraceSpan() { End(); }
+
+  // Ends the span before it goes out of scope.
+  void End();
+
+ private:
+  std::vector<TraceSpan>* trace_;
+  absl::string_view name_;
+  int64_t start_ns_;
+};
+
+// Formats the spans in the Chrome trace event format, which both
+// chrome://tracing and the Perfetto UI load.
+std::string TraceSpansToChromeJson(absl::Span<const TraceSpan> spans);
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_TRACE_H_
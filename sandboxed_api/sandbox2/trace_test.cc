@@ -0,0 +1,76 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/trace.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::SizeIs;
+
+TEST(TraceTest, ScopedSpanRecordsInterval) {
+  std::vector<TraceSpan> trace;
+  int64_t before = MonotonicNowNs();
+  {
+    ScopedTraceSpan span(&trace, "phase");
+  }
+  ASSERT_THAT(trace, SizeIs(1));
+  EXPECT_THAT(trace[0].name, Eq("phase"));
+  EXPECT_THAT(trace[0].start_ns, Ge(before));
+  EXPECT_THAT(trace[0].end_ns, Ge(trace[0].start_ns));
+  EXPECT_THAT(trace[0].pid, Eq(getpid()));
+}
+
+TEST(TraceTest, EndIsIdempotent) {
+  std::vector<TraceSpan> trace;
+  {
+    ScopedTraceSpan span(&trace, "phase");
+    span.End();
+    span.End();
+  }
+  EXPECT_THAT(trace, SizeIs(1));
+}
+
+TEST(TraceTest, NullTraceIsNoOp) {
+  ScopedTraceSpan span(nullptr, "phase");
+  span.End();
+}
+
+TEST(TraceTest, FormatsChromeJson) {
+  EXPECT_THAT(TraceSpansToChromeJson({}),
+              Eq(R"({"traceEvents":[],"displayTimeUnit":"ns"})"));
+  std::vector<TraceSpan> trace = {
+      {"a\"b", 1000, 3500, 7},
+      {"c", 4000, 4000, 8},
+  };
+  EXPECT_THAT(TraceSpansToChromeJson(trace),
+              Eq(R"({"traceEvents":[)"
+                 R"({"name":"a\"b","ph":"X","ts":1.000,"dur":2.500,)"
+                 R"("pid":7,"tid":7},)"
+                 R"({"name":"c","ph":"X","ts":4.000,"dur":0.000,)"
+                 R"("pid":8,"tid":8}],"displayTimeUnit":"ns"})"));
+}
+
+}  // namespace
+}  // namespace sandbox2
@@ -17,6 +17,7 @@
 #include <cxxabi.h>
 #include <sys/ptrace.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
@@ -28,6 +29,7 @@
 #include <vector>
 
 #include "absl/cleanup/cleanup.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/match.h"
@@ -39,7 +41,6 @@
 #include "sandboxed_api/sandbox2/unwind/unwind.pb.h"
 #include "sandboxed_api/sandbox2/util/maps_parser.h"
 #include "sandboxed_api/sandbox2/util/minielf.h"
-#include "sandboxed_api/util/file_helpers.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
 
@@ -152,18 +153,32 @@ absl::StatusOr<std::vector<uintptr_t>> RunLibUnwind(pid_t pid, int max_frames) {
   return ips;
 }
 
-absl::StatusOr<std::vector<std::string>> SymbolizeStacktrace(
+absl::StatusOr<UnwindResult> SymbolizeStacktrace(
     pid_t pid, const std::vector<uintptr_t>& ips) {
-  SAPI_ASSIGN_OR_RETURN(auto addr_to_symbol, LoadSymbolsMap(pid));
-  std::vector<std::string> stack_trace;
-  stack_trace.reserve(ips.size());
-  // Symbolize stacktrace
+  // Only the files the stack trace goes through are worth parsing.
+  SAPI_ASSIGN_OR_RETURN(auto addr_to_symbol, LoadSymbolsMap(pid, ips));
+  UnwindResult result;
+  result.mutable_frames()->Reserve(ips.size());
+  // Symbolize stacktrace. Deep recursion repeats the same few addresses, each
+  // of them is only looked up and demangled once.
+  absl::flat_hash_map<uintptr_t, uint32_t> symbol_index;
   for (uintptr_t ip : ips) {
-    const std::string symbol =
-        GetSymbolAt(addr_to_symbol, static_cast<uint64_t>(ip));
-    stack_trace.push_back(absl::StrCat(symbol, "(0x", absl::Hex(ip), ")"));
+    auto [it, inserted] = symbol_index.try_emplace(ip, result.symbols_size());
+    if (inserted) {
+      const std::string symbol =
+          GetSymbolAt(addr_to_symbol, static_cast<uint64_t>(ip));
+      result.add_symbols(absl::StrCat(symbol, "(0x", absl::Hex(ip), ")"));
+    }
+    result.add_frames(it->second);
   }
-  return stack_trace;
+  return result;
+}
+
+absl::StatusOr<UnwindResult> RunLibUnwindAndSymbolizerImpl(pid_t pid,
+                                                           int max_frames) {
+  SAPI_ASSIGN_OR_RETURN(std::vector<uintptr_t> ips,
+                        RunLibUnwind(pid, max_frames));
+  return SymbolizeStacktrace(pid, ips);
 }
 
 }  // namespace
@@ -188,27 +203,37 @@ std::string GetSymbolAt(const SymbolMap& addr_to_symbol, uint64_t addr) {
   return "";
 }
 
-absl::StatusOr<SymbolMap> LoadSymbolsMap(pid_t pid) {
-  const std::string maps_filename = absl::StrCat("/proc/", pid, "/maps");
-  std::string maps_content;
-  SAPI_RETURN_IF_ERROR(sapi::file::GetContents(maps_filename, &maps_content,
-                                               sapi::file::Defaults()));
-
-  SAPI_ASSIGN_OR_RETURN(std::vector<MapsEntry> maps,
-                        ParseProcMaps(maps_content));
+namespace {
 
-  // Get symbols for each file entry in the maps entry.
-  // This is not a very efficient way, so we might want to optimize it.
-  SymbolMap addr_to_symbol;
-  for (const MapsEntry& entry : maps) {
+absl::StatusOr<SymbolMap> LoadSymbolsMapImpl(
+    pid_t pid, const std::vector<uintptr_t>& sorted_addrs, bool filter) {
+  // Only keep the entries that are worth loading symbols for.
+  std::vector<MapsEntry> maps;
+  auto keep_entry = [&](const MapsEntryView& entry) {
     if (!entry.is_executable ||
         entry.inode == 0 ||  // Only parse file-backed entries
         entry.path.empty() ||
         absl::EndsWith(entry.path, " (deleted)")  // Skip deleted files
     ) {
-      continue;
+      return true;
     }
+    if (filter) {
+      auto addr = std::lower_bound(sorted_addrs.begin(), sorted_addrs.end(),
+                                   entry.start);
+      if (addr == sorted_addrs.end() || *addr >= entry.end) {
+        return true;
+      }
+    }
+    maps.push_back(ToMapsEntry(entry));
+    return true;
+  };
+  SAPI_RETURN_IF_ERROR(ForEachProcMapsEntry(pid, keep_entry));
 
+  // Get symbols for each file entry in the maps entry. Files with several
+  // executable mappings are only parsed once.
+  SymbolMap addr_to_symbol;
+  std::map<std::string, absl::StatusOr<ElfFile>> elf_files;
+  for (const MapsEntry& entry : maps) {
     // Store details about start + end of this map.
     // The maps entries are ordered and thus sorted with increasing adresses.
     // This means if there is a symbol @ entry.end, it will be overwritten in
@@ -220,12 +245,20 @@ absl::StatusOr<SymbolMap> LoadSymbolsMap(pid_t pid) {
     addr_to_symbol[entry.start] = map;
     addr_to_symbol[entry.end] = "";
 
-    absl::StatusOr<ElfFile> elf =
-        ElfFile::ParseFromFile(entry.path, ElfFile::kLoadSymbols);
+    auto it = elf_files.find(entry.path);
+    if (it == elf_files.end()) {
+      it = elf_files
+               .emplace(entry.path, ElfFile::ParseFromFile(
+                                        entry.path, ElfFile::kLoadSymbols))
+               .first;
+      if (!it->second.ok()) {
+        SAPI_RAW_LOG(WARNING, "Could not load symbols for %s: %s",
+                     entry.path.c_str(),
+                     std::string(it->second.status().message()).c_str());
+      }
+    }
+    const absl::StatusOr<ElfFile>& elf = it->second;
     if (!elf.ok()) {
-      SAPI_RAW_LOG(WARNING, "Could not load symbols for %s: %s",
-                   entry.path.c_str(),
-                   std::string(elf.status().message()).c_str());
       continue;
     }
 
@@ -259,6 +292,19 @@ absl::StatusOr<SymbolMap> LoadSymbolsMap(pid_t pid) {
   return addr_to_symbol;
 }
 
+}  // namespace
+
+absl::StatusOr<SymbolMap> LoadSymbolsMap(pid_t pid) {
+  return LoadSymbolsMapImpl(pid, {}, /*filter=*/false);
+}
+
+absl::StatusOr<SymbolMap> LoadSymbolsMap(pid_t pid,
+                                         const std::vector<uintptr_t>& addrs) {
+  std::vector<uintptr_t> sorted_addrs = addrs;
+  std::sort(sorted_addrs.begin(), sorted_addrs.end());
+  return LoadSymbolsMapImpl(pid, sorted_addrs, /*filter=*/true);
+}
+
 bool RunLibUnwindAndSymbolizer(Comms* comms) {
   UnwindSetup setup;
   if (!comms->RecvProtoBuf(&setup)) {
@@ -271,27 +317,39 @@ bool RunLibUnwindAndSymbolizer(Comms* comms) {
 
   EnablePtraceEmulationWithUserRegs(setup.pid(), setup.regs(), mem_fd);
 
-  absl::StatusOr<std::vector<std::string>> stack_trace =
-      RunLibUnwindAndSymbolizer(setup.pid(), setup.default_max_frames());
+  absl::StatusOr<UnwindResult> result = RunLibUnwindAndSymbolizerImpl(
+      setup.pid(), setup.default_max_frames());
 
-  if (!comms->SendStatus(stack_trace.status())) {
+  if (!comms->SendStatus(result.status())) {
     return false;
   }
 
-  if (!stack_trace.ok()) {
+  if (!result.ok()) {
     return true;
   }
 
-  UnwindResult msg;
-  *msg.mutable_stacktrace() = {stack_trace->begin(), stack_trace->end()};
-  return comms->SendProtoBuf(msg);
+  return comms->SendProtoBuf(*result);
 }
 
 absl::StatusOr<std::vector<std::string>> RunLibUnwindAndSymbolizer(
     pid_t pid, int max_frames) {
-  SAPI_ASSIGN_OR_RETURN(std::vector<uintptr_t> ips,
-                        RunLibUnwind(pid, max_frames));
-  return SymbolizeStacktrace(pid, ips);
+  SAPI_ASSIGN_OR_RETURN(UnwindResult result,
+                        RunLibUnwindAndSymbolizerImpl(pid, max_frames));
+  return StackTraceFromUnwindResult(result);
+}
+
+absl::StatusOr<std::vector<std::string>> StackTraceFromUnwindResult(
+    const UnwindResult& result) {
+  std::vector<std::string> stack_trace;
+  stack_trace.reserve(result.frames_size());
+  for (uint32_t frame : result.frames()) {
+    if (frame >= static_cast<uint32_t>(result.symbols_size())) {
+      return absl::InternalError(
+          absl::StrCat("Invalid frame in stacktrace: ", frame));
+    }
+    stack_trace.push_back(result.symbols(frame));
+  }
+  return stack_trace;
 }
 
 }  // namespace sandbox2
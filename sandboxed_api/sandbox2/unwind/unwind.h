@@ -23,6 +23,7 @@
 
 #include "absl/status/statusor.h"
 #include "sandboxed_api/sandbox2/comms.h"
+#include "sandboxed_api/sandbox2/unwind/unwind.pb.h"
 
 namespace sandbox2 {
 
@@ -35,12 +36,22 @@ std::string GetSymbolAt(const SymbolMap& addr_to_symbol, uint64_t addr);
 // Loads and returns a symbol map for a process with the provided `pid`.
 absl::StatusOr<SymbolMap> LoadSymbolsMap(pid_t pid);
 
+// Like above, but skips the files that are not mapped at any of `addrs`, which
+// is much cheaper when only a few addresses need to be symbolized.
+absl::StatusOr<SymbolMap> LoadSymbolsMap(pid_t pid,
+                                         const std::vector<uintptr_t>& addrs);
+
 // Runs libunwind and the symbolizer and sends the results via comms.
 bool RunLibUnwindAndSymbolizer(Comms* comms);
 
 absl::StatusOr<std::vector<std::string>> RunLibUnwindAndSymbolizer(
     pid_t pid, int max_frames);
 
+// Returns the readable stacktrace, one frame per line, from a result sent by
+// RunLibUnwindAndSymbolizer(). Fails if the result is inconsistent.
+absl::StatusOr<std::vector<std::string>> StackTraceFromUnwindResult(
+    const UnwindResult& result);
+
 }  // namespace sandbox2
 
 #endif  // SANDBOXED_API_SANDBOX2_UNWIND_UNWIND_H_
@@ -0,0 +1,102 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/usage.h"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sandbox2 {
+
+namespace file = ::sapi::file;
+
+absl::StatusOr<ResourceUsage> ReadResourceUsage(pid_t pid) {
+  std::string stat;
+  std::string status;
+  SAPI_RETURN_IF_ERROR(file::GetContents(absl::StrCat("/proc/", pid, "/stat"),
+                                         &stat, file::Defaults()));
+  SAPI_RETURN_IF_ERROR(file::GetContents(
+      absl::StrCat("/proc/", pid, "/status"), &status, file::Defaults()));
+  ResourceUsage usage;
+  usage.time = absl::Now();
+  if (!internal::ParseProcUsage(stat, status, &usage)) {
+    return absl::InternalError(
+        absl::StrCat("Could not parse /proc/", pid, "/stat"));
+  }
+  return usage;
+}
+
+namespace internal {
+
+bool ParseProcUsage(absl::string_view stat, absl::string_view status,
+                    ResourceUsage* usage) {
+  // The command name may contain anything, including spaces and parentheses.
+  size_t comm_end = stat.rfind(')');
+  if (comm_end == absl::string_view::npos) {
+    return false;
+  }
+  // Starting with field 3 (state), see proc(5).
+  std::vector<absl::string_view> fields = absl::StrSplit(
+      stat.substr(comm_end + 1), absl::ByAnyChar(" \n"), absl::SkipEmpty());
+  auto field = [&fields](int number, uint64_t* value) {
+    return static_cast<size_t>(number - 3) < fields.size() &&
+           absl::SimpleAtoi(fields[number - 3], value);
+  };
+  uint64_t utime;
+  uint64_t stime;
+  uint64_t rss_pages;
+  if (!field(10, &usage->minor_faults) || !field(12, &usage->major_faults) ||
+      !field(14, &utime) || !field(15, &stime) || !field(24, &rss_pages)) {
+    return false;
+  }
+  static const int64_t ticks_per_second = sysconf(_SC_CLK_TCK);
+  static const int64_t page_size = sysconf(_SC_PAGESIZE);
+  usage->cpu_user = absl::Seconds(utime) / ticks_per_second;
+  usage->cpu_system = absl::Seconds(stime) / ticks_per_second;
+  usage->rss_bytes = rss_pages * page_size;
+
+  for (absl::string_view line : absl::StrSplit(status, '\n')) {
+    uint64_t* value = nullptr;
+    if (absl::ConsumePrefix(&line, "voluntary_ctxt_switches:")) {
+      value = &usage->voluntary_context_switches;
+    } else if (absl::ConsumePrefix(&line, "nonvoluntary_ctxt_switches:")) {
+      value = &usage->involuntary_context_switches;
+    }
+    if (value != nullptr &&
+        !absl::SimpleAtoi(absl::StripAsciiWhitespace(line), value)) {
+      *value = 0;
+    }
+  }
+  return true;
+}
+
+}  // namespace internal
+}  // namespace sandbox2
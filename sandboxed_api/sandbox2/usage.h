@@ -0,0 +1,67 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Resource usage of a running sandboxee, see Sandbox2::GetCurrentUsage() and
+// Sandbox2::EnableUsageSampling().
+
+#ifndef SANDBOXED_API_SANDBOX2_USAGE_H_
+#define SANDBOXED_API_SANDBOX2_USAGE_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <optional>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox2/cgroup.h"
+#include "sandboxed_api/sandbox2/perf_counters.h"
+
+namespace sandbox2 {
+
+struct ResourceUsage {
+  // When the sample was taken.
+  absl::Time time = absl::InfinitePast();
+  // Of the main sandboxee process, including all of its threads.
+  uint64_t rss_bytes = 0;
+  uint64_t minor_faults = 0;
+  uint64_t major_faults = 0;
+  absl::Duration cpu_user = absl::ZeroDuration();
+  absl::Duration cpu_system = absl::ZeroDuration();
+  // Of the main thread of the main sandboxee process.
+  uint64_t voluntary_context_switches = 0;
+  uint64_t involuntary_context_switches = 0;
+  // Of all sandboxee processes, if they run in a cgroup (see
+  // Limits::set_cgroup()).
+  std::optional<CgroupStats> cgroup;
+  // Of all sandboxee processes and threads, if enabled (see
+  // Sandbox2::EnablePerfCounters()).
+  std::optional<PerfCounterValues> perf_counters;
+};
+
+// Reads the usage of a process from /proc/<pid>/stat and /proc/<pid>/status.
+absl::StatusOr<ResourceUsage> ReadResourceUsage(pid_t pid);
+
+namespace internal {
+
+// Parses the contents of /proc/<pid>/stat and /proc/<pid>/status into usage.
+bool ParseProcUsage(absl::string_view stat, absl::string_view status,
+                    ResourceUsage* usage);
+
+}  // namespace internal
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_USAGE_H_
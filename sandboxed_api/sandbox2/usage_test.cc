@@ -0,0 +1,67 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/usage.h"
+
+#include <unistd.h>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::IsOk;
+using ::testing::Eq;
+using ::testing::Gt;
+using ::testing::IsFalse;
+using ::testing::IsTrue;
+
+TEST(UsageTest, ParsesProcFiles) {
+  // The command name contains the separators of the other fields.
+  constexpr char kStat[] =
+      "42 (a) b (c) S 1 42 42 0 -1 4194560 100 0 7 0 250 50 0 0 20 0 1 0 "
+      "12345 10485760 300 18446744073709551615\n";
+  constexpr char kStatus[] =
+      "Name:\tsleep\nvoluntary_ctxt_switches:\t11\n"
+      "nonvoluntary_ctxt_switches:\t3\n";
+  ResourceUsage usage;
+  ASSERT_THAT(internal::ParseProcUsage(kStat, kStatus, &usage), IsTrue());
+  EXPECT_THAT(usage.minor_faults, Eq(100));
+  EXPECT_THAT(usage.major_faults, Eq(7));
+  EXPECT_THAT(usage.cpu_user, Eq(absl::Seconds(250) / sysconf(_SC_CLK_TCK)));
+  EXPECT_THAT(usage.cpu_system, Eq(absl::Seconds(50) / sysconf(_SC_CLK_TCK)));
+  EXPECT_THAT(usage.rss_bytes, Eq(300 * sysconf(_SC_PAGESIZE)));
+  EXPECT_THAT(usage.voluntary_context_switches, Eq(11));
+  EXPECT_THAT(usage.involuntary_context_switches, Eq(3));
+}
+
+TEST(UsageTest, RejectsTruncatedStat) {
+  ResourceUsage usage;
+  EXPECT_THAT(internal::ParseProcUsage("42 (a) S 1 42", "", &usage),
+              IsFalse());
+}
+
+TEST(UsageTest, ReadsOwnUsage) {
+  absl::StatusOr<ResourceUsage> usage = ReadResourceUsage(getpid());
+  ASSERT_THAT(usage.status(), IsOk());
+  EXPECT_THAT(usage->rss_bytes, Gt(0));
+  EXPECT_THAT(usage->minor_faults, Gt(0));
+}
+
+}  // namespace
+}  // namespace sandbox2
@@ -23,6 +23,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
 #include <climits>
@@ -32,6 +33,8 @@
 #include <cstring>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/base/attributes.h"
@@ -52,6 +55,19 @@
 #include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/path.h"
 #include "sandboxed_api/util/raw_logging.h"
+#include "sandboxed_api/util/status_macros.h"
+
+// Not defined in older kernel headers. The numbers are the same on all
+// supported architectures.
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+#ifndef __NR_pidfd_send_signal
+#define __NR_pidfd_send_signal 424
+#endif
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
 
 namespace sandbox2::util {
 
@@ -189,6 +205,46 @@ std::string GetProcStatusLine(int pid, const std::string& value) {
   return "";
 }
 
+absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view list) {
+  std::vector<int> cpus;
+  for (absl::string_view range :
+       absl::StrSplit(absl::StripAsciiWhitespace(list), ',',
+                      absl::SkipEmpty())) {
+    std::pair<absl::string_view, absl::string_view> bounds =
+        absl::StrSplit(range, absl::MaxSplits('-', 1));
+    int first;
+    int last;
+    if (!absl::SimpleAtoi(bounds.first, &first) ||
+        !absl::SimpleAtoi(bounds.second.empty() ? bounds.first : bounds.second,
+                          &last) ||
+        first < 0 || last < first) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid CPU list: '", list, "'"));
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+absl::StatusOr<std::vector<int>> GetNumaNodeCpus(int node) {
+  std::string list;
+  SAPI_RETURN_IF_ERROR(sapi::file::GetContents(
+      absl::StrCat("/sys/devices/system/node/node", node, "/cpulist"), &list,
+      sapi::file::Defaults()));
+  return ParseCpuList(list);
+}
+
+absl::StatusOr<int> GetCurrentNumaNode() {
+  unsigned int cpu;
+  unsigned int node;
+  if (syscall(__NR_getcpu, &cpu, &node, nullptr) == -1) {
+    return absl::ErrnoToStatus(errno, "getcpu()");
+  }
+  return node;
+}
+
 long Syscall(long sys_no,  // NOLINT
              uintptr_t a1, uintptr_t a2, uintptr_t a3, uintptr_t a4,
              uintptr_t a5, uintptr_t a6) {
@@ -214,14 +270,21 @@ int ChildFunc(void* arg) {
 // - Make sure that the buffer is aligned to whatever is required by the CPU.
 ABSL_ATTRIBUTE_NO_SANITIZE_ADDRESS
 ABSL_ATTRIBUTE_NOINLINE
-pid_t CloneAndJump(int flags, jmp_buf* env_ptr) {
+pid_t CloneAndJump(int flags, jmp_buf* env_ptr, int* pidfd) {
   uint8_t stack_buf[PTHREAD_STACK_MIN] ABSL_CACHELINE_ALIGNED;
   static_assert(sapi::host_cpu::IsX8664() || sapi::host_cpu::IsPPC64LE() ||
                     sapi::host_cpu::IsArm64() || sapi::host_cpu::IsArm(),
                 "Host CPU architecture not supported, see config.h");
   // Stack grows down.
   void* stack = stack_buf + sizeof(stack_buf);
-  int r = clone(&ChildFunc, stack, flags, env_ptr, nullptr, nullptr, nullptr);
+  // With CLONE_PIDFD, the kernel stores the pidfd in place of the parent TID.
+  int r = clone(&ChildFunc, stack, flags, env_ptr, pidfd, nullptr, nullptr);
+  if (r == -1 && (flags & CLONE_PIDFD) && errno == EINVAL) {
+    // Kernels before 5.2 don't support CLONE_PIDFD.
+    *pidfd = -1;
+    r = clone(&ChildFunc, stack, flags & ~CLONE_PIDFD, env_ptr, nullptr,
+              nullptr, nullptr);
+  }
   if (r == -1) {
     SAPI_RAW_PLOG(ERROR, "clone()");
   }
@@ -230,7 +293,7 @@ pid_t CloneAndJump(int flags, jmp_buf* env_ptr) {
 
 }  // namespace
 
-pid_t ForkWithFlags(int flags) {
+pid_t ForkWithFlags(int flags, int* pidfd) {
   const int unsupported_flags = CLONE_CHILD_CLEARTID | CLONE_CHILD_SETTID |
                                 CLONE_PARENT_SETTID | CLONE_SETTLS | CLONE_VM;
   if (flags & unsupported_flags) {
@@ -238,15 +301,27 @@ pid_t ForkWithFlags(int flags) {
     return -1;
   }
 
+  if (pidfd != nullptr) {
+    flags |= CLONE_PIDFD;
+    *pidfd = -1;
+  }
   jmp_buf env;
   if (setjmp(env) == 0) {
-    return CloneAndJump(flags, &env);
+    return CloneAndJump(flags, &env, pidfd);
   }
 
   // Child.
   return 0;
 }
 
+int PidfdOpen(pid_t pid) {
+  return Syscall(__NR_pidfd_open, pid, 0);
+}
+
+int PidfdSendSignal(int pidfd, int signal) {
+  return Syscall(__NR_pidfd_send_signal, pidfd, signal, 0, 0);
+}
+
 bool CreateMemFd(int* fd, const char* name) {
   // Usually defined in linux/memfd.h. Define it here to avoid dependency on
   // UAPI headers.
@@ -386,45 +461,71 @@ std::string GetPtraceEventName(int event) {
 }
 
 absl::StatusOr<std::string> ReadCPathFromPid(pid_t pid, uintptr_t ptr) {
-  std::string path(PATH_MAX, '\0');
-  iovec local_iov[] = {{&path[0], path.size()}};
+  return std::move(ReadCPathsFromPid(pid, {ptr}).front());
+}
 
+std::vector<absl::StatusOr<std::string>> ReadCPathsFromPid(
+    pid_t pid, absl::Span<const uintptr_t> ptrs) {
   static const uintptr_t page_size = getpagesize();
   static const uintptr_t page_mask = ~(page_size - 1);
-  // See 'man process_vm_readv' for details on how to read NUL-terminated
-  // strings with this syscall.
-  size_t len1 = ((ptr + page_size) & page_mask) - ptr;
-  len1 = (len1 > path.size()) ? path.size() : len1;
-  size_t len2 = (path.size() <= len1) ? 0UL : path.size() - len1;
-  // Second iov is wrapping around to NULL ptr.
-  if ((ptr + len1) < ptr) {
-    len2 = 0UL;
-  }
-
-  iovec remote_iov[] = {
-      {reinterpret_cast<void*>(ptr), len1},
-      {reinterpret_cast<void*>(ptr + len1), len2},
-  };
-
-  SAPI_RAW_VLOG(4, "ReadCPathFromPid (iovec): len1: %zu, len2: %zu", len1,
-                len2);
-  if (process_vm_readv(pid, local_iov, ABSL_ARRAYSIZE(local_iov), remote_iov,
-                       ABSL_ARRAYSIZE(remote_iov), 0) < 0) {
-    return absl::ErrnoToStatus(
-        errno,
-        absl::StrFormat("process_vm_readv() failed for PID: %d at address: %#x",
-                        pid, reinterpret_cast<uintptr_t>(ptr)));
-  }
-
-  // Check for whether there's a NUL byte in the buffer. If not, it's an
-  // incorrect path (or >PATH_MAX).
-  auto pos = path.find('\0');
-  if (pos == std::string::npos) {
-    return absl::FailedPreconditionError(absl::StrCat(
-        "No NUL-byte inside the C string '", absl::CHexEscape(path), "'"));
+  std::vector<absl::StatusOr<std::string>> paths(
+      ptrs.size(), absl::InternalError("Path not read"));
+  // Not initialized, only the bytes read are looked at.
+  std::unique_ptr<char[]> buffer(new char[ptrs.size() * PATH_MAX]);
+  std::vector<iovec> remote_iov;
+  remote_iov.reserve(2 * ptrs.size());
+  for (size_t first = 0; first < ptrs.size();) {
+    // See 'man process_vm_readv' for details on how to read NUL-terminated
+    // strings with this syscall. The first iov of each path ends at a page
+    // boundary, so that the path is still read if the page after it is
+    // unmapped.
+    remote_iov.clear();
+    for (size_t i = first; i < ptrs.size(); ++i) {
+      uintptr_t ptr = ptrs[i];
+      size_t len1 = ((ptr + page_size) & page_mask) - ptr;
+      len1 = (len1 > PATH_MAX) ? PATH_MAX : len1;
+      size_t len2 = (PATH_MAX <= len1) ? 0UL : PATH_MAX - len1;
+      // Second iov is wrapping around to NULL ptr.
+      if ((ptr + len1) < ptr) {
+        len2 = 0UL;
+      }
+      remote_iov.push_back({reinterpret_cast<void*>(ptr), len1});
+      remote_iov.push_back({reinterpret_cast<void*>(ptr + len1), len2});
+    }
+    iovec local_iov[] = {
+        {&buffer[first * PATH_MAX], (ptrs.size() - first) * PATH_MAX}};
+    SAPI_RAW_VLOG(4, "ReadCPathsFromPid: %zu paths", ptrs.size() - first);
+    ssize_t read = process_vm_readv(pid, local_iov, ABSL_ARRAYSIZE(local_iov),
+                                    remote_iov.data(), remote_iov.size(), 0);
+    if (read <= 0) {
+      paths[first] = absl::ErrnoToStatus(
+          read < 0 ? errno : EFAULT,
+          absl::StrFormat("process_vm_readv() failed for PID: %d at address: "
+                          "%#x",
+                          pid, ptrs[first]));
+      ++first;
+      continue;
+    }
+    // Paths are read in order, and the read stops at the first unreadable
+    // address. The paths after that one are read again by the next call.
+    size_t i = first;
+    for (; i < ptrs.size() && read > 0; ++i) {
+      size_t len = std::min<size_t>(read, PATH_MAX);
+      read -= len;
+      absl::string_view path(&buffer[i * PATH_MAX], len);
+      // Check for whether there's a NUL byte in the buffer. If not, it's an
+      // incorrect path (or >PATH_MAX).
+      auto pos = path.find('\0');
+      if (pos == absl::string_view::npos) {
+        paths[i] = absl::FailedPreconditionError(absl::StrCat(
+            "No NUL-byte inside the C string '", absl::CHexEscape(path), "'"));
+      } else {
+        paths[i] = std::string(path.substr(0, pos));
+      }
+    }
+    first = i;
   }
-  path.resize(pos);
-  return path;
+  return paths;
 }
 
 int Execveat(int dirfd, const char* pathname, const char* const argv[],
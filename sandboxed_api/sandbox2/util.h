@@ -27,6 +27,8 @@
 #include "absl/base/attributes.h"
 #include "absl/base/macros.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
 
 namespace sandbox2::util {
 
@@ -72,6 +74,15 @@ std::string GetCmdLine(pid_t pid);
 // is a field name like "Threads" or "Tgid".
 std::string GetProcStatusLine(int pid, const std::string& value);
 
+// Parses a list of CPUs in the kernel's format, e.g. "0-3,8,10-11".
+absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view list);
+
+// Returns the CPUs of a NUMA node, from /sys/devices/system/node.
+absl::StatusOr<std::vector<int>> GetNumaNodeCpus(int node);
+
+// Returns the NUMA node of the CPU that the calling thread currently runs on.
+absl::StatusOr<int> GetCurrentNumaNode();
+
 // Invokes a syscall, avoiding on-stack argument promotion, as it might happen
 // with vararg syscall() function.
 long Syscall(long sys_no,  // NOLINT
@@ -81,8 +92,16 @@ long Syscall(long sys_no,  // NOLINT
 // Fork based on clone() which updates glibc's PID/TID caches - Based on:
 // https://chromium.googlesource.com/chromium/src/+/9eb564175dbd452196f782da2b28e3e8e79c49a5%5E!/
 //
-// Return values as for 'man 2 fork'.
-pid_t ForkWithFlags(int flags);
+// Return values as for 'man 2 fork'. If pidfd is not null, the parent gets a
+// pidfd for the child there (CLONE_PIDFD), or -1 where that is not supported.
+pid_t ForkWithFlags(int flags, int* pidfd = nullptr);
+
+// Returns a pidfd for the process with the given PID, or -1 with errno set.
+int PidfdOpen(pid_t pid);
+
+// Sends a signal to the process referred to by a pidfd. Return values as for
+// kill().
+int PidfdSendSignal(int pidfd, int signal);
 
 // Creates a new memfd.
 bool CreateMemFd(int* fd, const char* name = "buffer_file");
@@ -106,6 +125,11 @@ std::string GetPtraceEventName(int event);
 // process memory
 absl::StatusOr<std::string> ReadCPathFromPid(pid_t pid, uintptr_t ptr);
 
+// Like ReadCPathFromPid(), but reads all paths with a single
+// process_vm_readv() call unless one of them is unreadable.
+std::vector<absl::StatusOr<std::string>> ReadCPathsFromPid(
+    pid_t pid, absl::Span<const uintptr_t> ptrs);
+
 // Wrapper for execveat(2).
 int Execveat(int dirfd, const char* pathname, const char* const argv[],
              const char* const envp[], int flags, uintptr_t extra_arg = 0);
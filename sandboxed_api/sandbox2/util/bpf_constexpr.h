@@ -0,0 +1,111 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Seccomp programs with labels that are resolved at compile time, for policy
+// blocks that never change. Builds on the macros of bpf_helper.h.
+//
+// Example:
+//   enum SocketLabel : uint32_t { kAfUnix };
+//   constexpr auto kSocketPolicy = sandbox2::bpf::ResolveJumps({
+//       ARG_32(0),
+//       JEQ32(AF_UNIX, sandbox2::bpf::Jump(kAfUnix)),
+//       KILL,
+//       sandbox2::bpf::Label(kAfUnix),
+//       ARG_32(1),
+//       JEQ32(SOCK_STREAM, ALLOW),
+//   });
+//   builder.AddPolicyOnSyscall(__NR_socket, kSocketPolicy);
+
+#ifndef SANDBOXED_API_SANDBOX2_UTIL_BPF_CONSTEXPR_H_
+#define SANDBOXED_API_SANDBOX2_UTIL_BPF_CONSTEXPR_H_
+
+#include <linux/filter.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "sandboxed_api/sandbox2/util/bpf_helper.h"
+
+namespace sandbox2 {
+namespace bpf {
+
+// Labels are numbers below this, e.g. from an enum.
+inline constexpr uint32_t kMaxConstexprLabels = BPF_LABELS_MAX;
+
+// Jumps to `label`, like JUMP() from bpf_helper.h.
+constexpr sock_filter Jump(uint32_t label) {
+  return BPF_JUMP(BPF_JMP + BPF_JA, label, JUMP_JT, JUMP_JF);
+}
+
+// Marks the location of `label`, like LABEL() from bpf_helper.h.
+constexpr sock_filter Label(uint32_t label) {
+  return BPF_JUMP(BPF_JMP + BPF_JA, label, LABEL_JT, LABEL_JF);
+}
+
+namespace internal {
+
+// Not constexpr, so that reaching it during constant evaluation fails the
+// compilation.
+inline void InvalidConstexprProgram(const char* reason) {
+  fprintf(stderr, "Invalid BPF program: %s\n", reason);
+  abort();
+}
+
+}  // namespace internal
+
+// Returns `prog` with the jumps to labels resolved, like bpf_resolve_jumps().
+// Used in a constant expression, mistakes like unknown or duplicate labels
+// fail the compilation.
+template <size_t N>
+constexpr std::array<sock_filter, N> ResolveJumps(
+    const sock_filter (&prog)[N]) {
+  static_assert(N <= BPF_MAXINSNS, "BPF program is too long");
+  std::array<sock_filter, N> out = {};
+  // One past the location of each label, 0 while not seen yet.
+  std::array<uint32_t, kMaxConstexprLabels> locations = {};
+  // Jumps only go forward, so labels are seen before the jumps to them.
+  for (size_t i = N; i-- > 0;) {
+    sock_filter insn = prog[i];
+    const bool is_jump = insn.jt == JUMP_JT && insn.jf == JUMP_JF;
+    const bool is_label = insn.jt == LABEL_JT && insn.jf == LABEL_JF;
+    if (insn.code == BPF_JMP + BPF_JA && (is_jump || is_label)) {
+      if (insn.k >= kMaxConstexprLabels) {
+        internal::InvalidConstexprProgram("Label out of range");
+      } else if (is_jump) {
+        if (locations[insn.k] == 0) {
+          internal::InvalidConstexprProgram("Unresolved label");
+        }
+        insn.k = locations[insn.k] - 1 - (i + 1);
+      } else {
+        if (locations[insn.k] != 0) {
+          internal::InvalidConstexprProgram("Duplicate label use");
+        }
+        locations[insn.k] = i + 1;
+        insn.k = 0;  // Falls through
+      }
+      insn.jt = 0;
+      insn.jf = 0;
+    }
+    out[i] = insn;
+  }
+  return out;
+}
+
+}  // namespace bpf
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_UTIL_BPF_CONSTEXPR_H_
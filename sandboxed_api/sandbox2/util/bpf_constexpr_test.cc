@@ -0,0 +1,94 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/util/bpf_constexpr.h"
+
+#include <linux/filter.h>
+#include <sys/mman.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sandboxed_api/sandbox2/util/bpf_helper.h"
+
+namespace sandbox2 {
+namespace bpf {
+namespace {
+
+using ::testing::Eq;
+
+enum MmapLabel : uint32_t { kProtNone, kMmapEnd };
+
+constexpr auto kMmapPolicy = ResolveJumps({
+    ARG_32(2),
+    JEQ32(PROT_NONE, Jump(kProtNone)),
+    JNE32(PROT_READ | PROT_WRITE, Jump(kMmapEnd)),
+    ARG_32(3),
+    JEQ32(MAP_ANONYMOUS | MAP_PRIVATE, ALLOW),
+    Label(kProtNone),
+    ARG_32(3),
+    JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
+    Label(kMmapEnd),
+});
+
+// Resolved at compile time.
+static_assert(kMmapPolicy[2].k == 5 && kMmapPolicy[4].k == 7);
+static_assert(kMmapPolicy[12].jt == 0 && kMmapPolicy[12].jf == 0);
+
+bool operator==(const sock_filter& a, const sock_filter& b) {
+  return a.code == b.code && a.jt == b.jt && a.jf == b.jf && a.k == b.k;
+}
+
+TEST(ResolveJumpsTest, MatchesBpfResolveJumps) {
+  bpf_labels l = {0};
+  std::vector<sock_filter> expected = {
+      ARG_32(2),
+      JEQ32(PROT_NONE, JUMP(&l, prot_none)),
+      JNE32(PROT_READ | PROT_WRITE, JUMP(&l, mmap_end)),
+      ARG_32(3),
+      JEQ32(MAP_ANONYMOUS | MAP_PRIVATE, ALLOW),
+      LABEL(&l, prot_none),
+      ARG_32(3),
+      JEQ32(MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, ALLOW),
+      LABEL(&l, mmap_end),
+  };
+  ASSERT_THAT(bpf_resolve_jumps(&l, expected.data(), expected.size()), Eq(0));
+  ASSERT_THAT(kMmapPolicy.size(), Eq(expected.size()));
+  for (size_t i = 0; i < expected.size(); ++i) {
+    EXPECT_TRUE(kMmapPolicy[i] == expected[i]) << "instruction " << i;
+  }
+}
+
+TEST(ResolveJumpsTest, LeavesProgramsWithoutLabelsAlone) {
+  constexpr auto kPolicy = ResolveJumps({
+      ARG_32(0),
+      JEQ32(1, ALLOW),
+      KILL,
+  });
+  sock_filter expected[] = {ARG_32(0), JEQ32(1, ALLOW), KILL};
+  for (size_t i = 0; i < kPolicy.size(); ++i) {
+    EXPECT_TRUE(kPolicy[i] == expected[i]) << "instruction " << i;
+  }
+}
+
+TEST(ResolveJumpsDeathTest, DiesOnUnresolvedLabels) {
+  sock_filter prog[] = {Jump(kMmapEnd), ALLOW};
+  EXPECT_DEATH(ResolveJumps(prog), "Unresolved label");
+}
+
+}  // namespace
+}  // namespace bpf
+}  // namespace sandbox2
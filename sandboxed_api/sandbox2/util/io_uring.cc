@@ -0,0 +1,247 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/util/io_uring.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/fileops.h"
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register 427
+#endif
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::file_util::fileops::FDCloser;
+
+// The only operations allowed on a RestrictedIoUring.
+constexpr uint8_t kAllowedOps[] = {
+    IORING_OP_READ,   IORING_OP_WRITE,  IORING_OP_READV,
+    IORING_OP_WRITEV, IORING_OP_FSYNC,
+};
+
+int IoUringRegister(int fd, unsigned opcode, const void* arg,
+                    unsigned nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// The ring indices are shared with the kernel, which updates them
+// concurrently.
+uint32_t LoadAcquire(const uint32_t* index) {
+  return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(uint32_t* index, uint32_t value) {
+  __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+template <typename T>
+T* At(void* base, uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+}  // namespace
+
+RestrictedIoUring::Mapping::~Mapping() { munmap(addr, size); }
+
+absl::StatusOr<RestrictedIoUring> RestrictedIoUring::Create(
+    uint32_t entries, absl::Span<const int> fds) {
+  if (fds.empty()) {
+    return absl::InvalidArgumentError("No file descriptors to register");
+  }
+  io_uring_params params = {};
+  // Restrictions can only be registered while the ring is disabled.
+  params.flags = IORING_SETUP_R_DISABLED;
+  RestrictedIoUring ring;
+  ring.fd_ = FDCloser(syscall(__NR_io_uring_setup, entries, &params));
+  if (ring.fd_.get() == -1) {
+    return absl::ErrnoToStatus(errno, "io_uring_setup()");
+  }
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    return absl::FailedPreconditionError(
+        "io_uring without IORING_FEAT_SINGLE_MMAP");
+  }
+
+  const size_t rings_size =
+      std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(__u32),
+                       params.cq_off.cqes +
+                           params.cq_entries * sizeof(io_uring_cqe));
+  void* rings = mmap(nullptr, rings_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd_.get(),
+                     IORING_OFF_SQ_RING);
+  if (rings == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap() of the io_uring rings");
+  }
+  ring.rings_ = std::make_unique<Mapping>(rings, rings_size);
+  const size_t sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring.fd_.get(),
+                    IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap() of the io_uring sqes");
+  }
+  ring.sqes_mapping_ = std::make_unique<Mapping>(sqes, sqes_size);
+
+  ring.sq_head_ = At<uint32_t>(rings, params.sq_off.head);
+  ring.sq_tail_ = At<uint32_t>(rings, params.sq_off.tail);
+  ring.sq_array_ = At<uint32_t>(rings, params.sq_off.array);
+  ring.sq_mask_ = *At<uint32_t>(rings, params.sq_off.ring_mask);
+  ring.sq_entries_ = params.sq_entries;
+  ring.sqes_ = static_cast<io_uring_sqe*>(sqes);
+  ring.cq_head_ = At<uint32_t>(rings, params.cq_off.head);
+  ring.cq_tail_ = At<uint32_t>(rings, params.cq_off.tail);
+  ring.cq_mask_ = *At<uint32_t>(rings, params.cq_off.ring_mask);
+  ring.cqes_ = At<io_uring_cqe>(rings, params.cq_off.cqes);
+
+  if (IoUringRegister(ring.fd_.get(), IORING_REGISTER_FILES, fds.data(),
+                      fds.size()) == -1) {
+    return absl::ErrnoToStatus(errno, "io_uring_register(FILES)");
+  }
+  // No IORING_RESTRICTION_REGISTER_OP, so that nothing can be registered
+  // once the ring is enabled.
+  std::vector<io_uring_restriction> restrictions;
+  for (uint8_t op : kAllowedOps) {
+    io_uring_restriction& restriction = restrictions.emplace_back();
+    restriction.opcode = IORING_RESTRICTION_SQE_OP;
+    restriction.sqe_op = op;
+  }
+  io_uring_restriction& required = restrictions.emplace_back();
+  required.opcode = IORING_RESTRICTION_SQE_FLAGS_REQUIRED;
+  required.sqe_flags = IOSQE_FIXED_FILE;
+  io_uring_restriction& allowed = restrictions.emplace_back();
+  allowed.opcode = IORING_RESTRICTION_SQE_FLAGS_ALLOWED;
+  allowed.sqe_flags = IOSQE_FIXED_FILE;
+  if (IoUringRegister(ring.fd_.get(), IORING_REGISTER_RESTRICTIONS,
+                      restrictions.data(), restrictions.size()) == -1) {
+    return absl::ErrnoToStatus(errno, "io_uring_register(RESTRICTIONS)");
+  }
+  if (IoUringRegister(ring.fd_.get(), IORING_REGISTER_ENABLE_RINGS, nullptr,
+                      0) == -1) {
+    return absl::ErrnoToStatus(errno, "io_uring_register(ENABLE_RINGS)");
+  }
+  return ring;
+}
+
+io_uring_sqe* RestrictedIoUring::NextSqe() {
+  const uint32_t tail = *sq_tail_;
+  if (tail - LoadAcquire(sq_head_) >= sq_entries_) {
+    return nullptr;
+  }
+  const uint32_t index = tail & sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->flags = IOSQE_FIXED_FILE;
+  sq_array_[index] = index;
+  return sqe;
+}
+
+bool RestrictedIoUring::PrepareRead(int index, void* buf, uint32_t len,
+                                    uint64_t offset, uint64_t user_data) {
+  io_uring_sqe* sqe = NextSqe();
+  if (sqe == nullptr) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = index;
+  sqe->addr = reinterpret_cast<uintptr_t>(buf);
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  ++queued_;
+  // Published last, so that the kernel only sees complete entries.
+  StoreRelease(sq_tail_, *sq_tail_ + 1);
+  return true;
+}
+
+bool RestrictedIoUring::PrepareWrite(int index, const void* buf, uint32_t len,
+                                     uint64_t offset, uint64_t user_data) {
+  io_uring_sqe* sqe = NextSqe();
+  if (sqe == nullptr) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = index;
+  sqe->addr = reinterpret_cast<uintptr_t>(buf);
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  ++queued_;
+  StoreRelease(sq_tail_, *sq_tail_ + 1);
+  return true;
+}
+
+bool RestrictedIoUring::PrepareFsync(int index, uint64_t user_data) {
+  io_uring_sqe* sqe = NextSqe();
+  if (sqe == nullptr) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_FSYNC;
+  sqe->fd = index;
+  sqe->user_data = user_data;
+  ++queued_;
+  StoreRelease(sq_tail_, *sq_tail_ + 1);
+  return true;
+}
+
+absl::Status RestrictedIoUring::Submit(uint32_t wait_for) {
+  const unsigned flags = wait_for > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (true) {
+    const int submitted = syscall(__NR_io_uring_enter, fd_.get(), queued_,
+                                  wait_for, flags, nullptr, 0);
+    if (submitted >= 0) {
+      queued_ -= std::min<uint32_t>(submitted, queued_);
+      return absl::OkStatus();
+    }
+    if (errno != EINTR) {
+      return absl::ErrnoToStatus(errno, "io_uring_enter()");
+    }
+  }
+}
+
+bool RestrictedIoUring::NextCompletion(Completion* completion) {
+  const uint32_t head = *cq_head_;
+  if (head == LoadAcquire(cq_tail_)) {
+    return false;
+  }
+  const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+  completion->user_data = cqe.user_data;
+  completion->result = cqe.res;
+  StoreRelease(cq_head_, head + 1);
+  return true;
+}
+
+}  // namespace sandbox2
@@ -0,0 +1,142 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// An io_uring for sandboxees that can only read, write and fsync a fixed set
+// of file descriptors.
+//
+// Operations submitted to an io_uring are not syscalls, so seccomp never sees
+// them. A sandboxee with an unrestricted ring could open files, connect
+// sockets and so on, whatever its policy says. RestrictedIoUring therefore
+// registers the file descriptors and io_uring restrictions while setting up
+// the ring, before enabling it. From then on the kernel rejects with EACCES:
+// - any opcode other than read, write, readv, writev and fsync, in particular
+//   openat, connect, accept and the like;
+// - operations on file descriptors that were not registered, as every
+//   operation has to refer to one of them by index (IOSQE_FIXED_FILE);
+// - all io_uring_register() calls, so no descriptors, buffers or
+//   restrictions can be changed.
+// PolicyBuilder::AllowIoUring() allows io_uring_enter(), but not
+// io_uring_setup() or io_uring_register(). So a sandboxee cannot create
+// rings of its own once the policy is applied. It can only use the rings it
+// created before that. See Client::SandboxMeHere(setup) to create them in
+// time.
+//
+// Remaining risks to weigh before using this:
+// - io_uring is a large part of the kernel with a history of exploitable bugs.
+//   The restrictions shrink, but don't remove, what a compromised sandboxee
+//   can reach through io_uring_enter(). Some hosts disable it entirely (see
+//   the kernel.io_uring_disabled sysctl), in which case Create() fails.
+// - Registered file descriptors may be read and written at any offset, even
+//   if the policy only allows read() or write() on some descriptors. Only
+//   register descriptors that the sandboxee may fully access.
+// - Operations may be run by kernel worker threads of the sandboxee (io-wq).
+//   They are accounted to its cgroup and resource limits, but are not subject
+//   to its seccomp policy, and the ptrace monitor doesn't see them.
+//
+// Requires Linux 5.10 or later.
+
+#ifndef SANDBOXED_API_SANDBOX2_UTIL_IO_URING_H_
+#define SANDBOXED_API_SANDBOX2_UTIL_IO_URING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/util/fileops.h"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace sandbox2 {
+
+class RestrictedIoUring {
+ public:
+  struct Completion {
+    uint64_t user_data;
+    // The result of the operation, e.g. the number of bytes read, or -errno.
+    int32_t result;
+  };
+
+  // Creates a ring with room for `entries` queued operations, on the given
+  // file descriptors. Operations refer to them by their index in `fds`. The
+  // file descriptors can be closed afterwards, the ring keeps references.
+  static absl::StatusOr<RestrictedIoUring> Create(uint32_t entries,
+                                                  absl::Span<const int> fds);
+
+  RestrictedIoUring(RestrictedIoUring&&) = default;
+  RestrictedIoUring& operator=(RestrictedIoUring&&) = default;
+
+  // Queue an operation on the file descriptor with the given index, see
+  // Create(). `buf` must stay valid until the operation completed. Return
+  // false if the submission queue is full, in which case Submit() first.
+  bool PrepareRead(int index, void* buf, uint32_t len, uint64_t offset,
+                   uint64_t user_data);
+  bool PrepareWrite(int index, const void* buf, uint32_t len, uint64_t offset,
+                    uint64_t user_data);
+  bool PrepareFsync(int index, uint64_t user_data);
+
+  // Hands the queued operations to the kernel, and waits until at least
+  // `wait_for` operations completed.
+  absl::Status Submit(uint32_t wait_for = 0);
+
+  // Returns the next completed operation in `completion`, or false if there
+  // currently is none.
+  bool NextCompletion(Completion* completion);
+
+  // Number of operations that can be queued at most.
+  uint32_t entries() const { return sq_entries_; }
+
+ private:
+  struct Mapping {
+    Mapping(void* addr, size_t size) : addr(addr), size(size) {}
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    ~Mapping();
+
+    void* const addr;
+    const size_t size;
+  };
+
+  RestrictedIoUring() = default;
+
+  io_uring_sqe* NextSqe();
+
+  sapi::file_util::fileops::FDCloser fd_;
+  // The submission and completion rings are in one mapping on all kernels
+  // that support restrictions.
+  std::unique_ptr<Mapping> rings_;
+  std::unique_ptr<Mapping> sqes_mapping_;
+
+  // Pointers into the rings.
+  uint32_t* sq_head_ = nullptr;
+  uint32_t* sq_tail_ = nullptr;
+  uint32_t* sq_array_ = nullptr;
+  uint32_t sq_mask_ = 0;
+  uint32_t sq_entries_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  uint32_t* cq_head_ = nullptr;
+  uint32_t* cq_tail_ = nullptr;
+  uint32_t cq_mask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+
+  // Operations queued since the last Submit().
+  uint32_t queued_ = 0;
+};
+
+}  // namespace sandbox2
+
+#endif  // SANDBOXED_API_SANDBOX2_UTIL_IO_URING_H_
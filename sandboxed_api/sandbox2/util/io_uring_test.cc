@@ -0,0 +1,91 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/sandbox2/util/io_uring.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/util/fileops.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sandbox2 {
+namespace {
+
+using ::sapi::IsOk;
+using ::sapi::file_util::fileops::FDCloser;
+using ::testing::Eq;
+using ::testing::Lt;
+using ::testing::Ne;
+
+TEST(RestrictedIoUringTest, ReadsAndWritesRegisteredFds) {
+  FDCloser in(memfd_create("in", 0));
+  FDCloser out(memfd_create("out", 0));
+  ASSERT_THAT(in.get(), Ne(-1));
+  ASSERT_THAT(out.get(), Ne(-1));
+  const std::string data = "io_uring in a sandbox";
+  ASSERT_THAT(write(in.get(), data.data(), data.size()), Eq(data.size()));
+
+  absl::StatusOr<RestrictedIoUring> ring =
+      RestrictedIoUring::Create(4, {in.get(), out.get()});
+  if (!ring.ok()) {
+    GTEST_SKIP() << "io_uring not available: " << ring.status();
+  }
+  std::string buf(data.size(), '\0');
+  ASSERT_TRUE(ring->PrepareRead(0, buf.data(), buf.size(), 0, 1));
+  ASSERT_THAT(ring->Submit(1), IsOk());
+  RestrictedIoUring::Completion completion;
+  ASSERT_TRUE(ring->NextCompletion(&completion));
+  EXPECT_THAT(completion.user_data, Eq(1));
+  EXPECT_THAT(completion.result, Eq(data.size()));
+  EXPECT_THAT(buf, Eq(data));
+
+  ASSERT_TRUE(ring->PrepareWrite(1, buf.data(), buf.size(), 0, 2));
+  ASSERT_TRUE(ring->PrepareFsync(1, 3));
+  ASSERT_THAT(ring->Submit(2), IsOk());
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(ring->NextCompletion(&completion));
+    EXPECT_THAT(completion.result, Eq(completion.user_data == 2 ? buf.size()
+                                                                : 0));
+  }
+  EXPECT_FALSE(ring->NextCompletion(&completion));
+  std::string written(data.size(), '\0');
+  ASSERT_THAT(pread(out.get(), written.data(), written.size(), 0),
+              Eq(data.size()));
+  EXPECT_THAT(written, Eq(data));
+}
+
+TEST(RestrictedIoUringTest, RejectsUnregisteredFds) {
+  FDCloser in(memfd_create("in", 0));
+  absl::StatusOr<RestrictedIoUring> ring =
+      RestrictedIoUring::Create(2, {in.get()});
+  if (!ring.ok()) {
+    GTEST_SKIP() << "io_uring not available: " << ring.status();
+  }
+  char buf[16];
+  ASSERT_TRUE(ring->PrepareRead(1, buf, sizeof(buf), 0, 1));
+  ASSERT_THAT(ring->Submit(1), IsOk());
+  RestrictedIoUring::Completion completion;
+  ASSERT_TRUE(ring->NextCompletion(&completion));
+  EXPECT_THAT(completion.result, Lt(0));
+}
+
+}  // namespace
+}  // namespace sandbox2
@@ -14,48 +14,181 @@
 
 #include "sandboxed_api/sandbox2/util/maps_parser.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
-#include "absl/strings/str_split.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "sandboxed_api/util/fileops.h"
 
 namespace sandbox2 {
+namespace {
+
+// Large enough for any line, as paths are limited to PATH_MAX.
+constexpr size_t kReadBufferSize = 16 << 10;
+
+// Removes the next field, which ends at `delim` or at the end of `line`, from
+// `line` and returns it.
+absl::string_view ConsumeField(absl::string_view* line, char delim) {
+  size_t pos = line->find(delim);
+  absl::string_view field = line->substr(0, pos);
+  line->remove_prefix(pos == absl::string_view::npos ? line->size() : pos + 1);
+  return field;
+}
+
+template <typename T>
+bool ConsumeHex(absl::string_view* line, char delim, T* value) {
+  absl::string_view field = ConsumeField(line, delim);
+  return !field.empty() && absl::SimpleHexAtoi(field, value);
+}
+
+// Parses a line in the format of show_vma_header_prefix() in
+// https://github.com/torvalds/linux/blob/v6.1/fs/proc/task_mmu.c, followed by
+// an optional path.
+bool ParseLine(absl::string_view line, MapsEntryView* entry) {
+  if (!ConsumeHex(&line, '-', &entry->start) ||
+      !ConsumeHex(&line, ' ', &entry->end)) {
+    return false;
+  }
+  absl::string_view perms = ConsumeField(&line, ' ');
+  if (perms.size() != 4) {
+    return false;
+  }
+  entry->is_readable = perms[0] == 'r';
+  entry->is_writable = perms[1] == 'w';
+  entry->is_executable = perms[2] == 'x';
+  entry->is_shared = perms[3] == 's';
+  if (!ConsumeHex(&line, ' ', &entry->pgoff) ||
+      !ConsumeHex(&line, ':', &entry->major) ||
+      !ConsumeHex(&line, ' ', &entry->minor)) {
+    return false;
+  }
+  absl::string_view inode = ConsumeField(&line, ' ');
+  if (inode.empty() || !absl::SimpleAtoi(inode, &entry->inode)) {
+    return false;
+  }
+  // The path is padded to a fixed column with spaces.
+  line.remove_prefix(std::min(line.find_first_not_of(' '), line.size()));
+  entry->path = line;
+  return true;
+}
+
+// Parses the complete lines of `contents`, and a last line without a newline
+// if `final` is set. Returns the number of bytes consumed. Sets `*stopped` if
+// the callback asked to stop.
+absl::StatusOr<size_t> ParseLines(absl::string_view contents, bool final,
+                                  MapsEntryCallback callback, bool* stopped) {
+  size_t parsed = 0;
+  while (parsed < contents.size()) {
+    absl::string_view rest = contents.substr(parsed);
+    size_t eol = rest.find('\n');
+    if (eol == absl::string_view::npos && !final) {
+      break;
+    }
+    absl::string_view line = rest.substr(0, eol);
+    parsed += eol == absl::string_view::npos ? rest.size() : eol + 1;
+    if (line.empty()) {
+      continue;
+    }
+    MapsEntryView entry{};
+    if (!ParseLine(line, &entry)) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Invalid format: ", line));
+    }
+    if (!callback(entry)) {
+      *stopped = true;
+      break;
+    }
+  }
+  return parsed;
+}
+
+}  // namespace
+
+MapsEntry ToMapsEntry(const MapsEntryView& view) {
+  return {view.start,
+          view.end,
+          view.is_readable,
+          view.is_writable,
+          view.is_executable,
+          view.is_shared,
+          view.pgoff,
+          view.major,
+          view.minor,
+          view.inode,
+          std::string(view.path)};
+}
+
+absl::Status ForEachProcMapsEntry(absl::string_view contents,
+                                  MapsEntryCallback callback) {
+  bool stopped = false;
+  return ParseLines(contents, /*final=*/true, callback, &stopped).status();
+}
+
+absl::Status ForEachProcMapsEntry(pid_t pid, MapsEntryCallback callback) {
+  const std::string filename = absl::StrCat("/proc/", pid, "/maps");
+  sapi::file_util::fileops::FDCloser fd(
+      open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd.get() == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", filename, ")"));
+  }
+  char buffer[kReadBufferSize];
+  size_t size = 0;
+  while (true) {
+    ssize_t n = TEMP_FAILURE_RETRY(
+        read(fd.get(), buffer + size, sizeof(buffer) - size));
+    if (n == -1) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("read(", filename, ")"));
+    }
+    size += n;
+    bool stopped = false;
+    absl::StatusOr<size_t> parsed = ParseLines(
+        absl::string_view(buffer, size), /*final=*/n == 0, callback, &stopped);
+    if (!parsed.ok() || stopped || n == 0) {
+      return parsed.status();
+    }
+    if (*parsed == 0 && size == sizeof(buffer)) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Line too long in ", filename));
+    }
+    size -= *parsed;
+    memmove(buffer, buffer + *parsed, size);
+  }
+}
 
 absl::StatusOr<std::vector<MapsEntry>> ParseProcMaps(
     const std::string& contents) {
-  // Note: The format string
-  //       https://github.com/torvalds/linux/blob/v4.14/fs/proc/task_mmu.c#L289
-  //       changed to a non-format string implementation
-  //       (show_vma_header_prefix()).
-  static constexpr char kFormatString[] =
-      "%lx-%lx %c%c%c%c %lx %x:%x %lu %1023s";
-  static constexpr size_t kFilepathLength = 1023;
-
-  std::vector<std::string> lines =
-      absl::StrSplit(contents, '\n', absl::SkipEmpty());
   std::vector<MapsEntry> entries;
-  for (const auto& line : lines) {
-    MapsEntry entry{};
-    char r, w, x, s;
-    entry.path.resize(kFilepathLength + 1, '\0');
-    int n_matches = sscanf(
-        line.c_str(), kFormatString, &entry.start, &entry.end, &r, &w, &x, &s,
-        &entry.pgoff, &entry.major, &entry.minor, &entry.inode, &entry.path[0]);
-
-    // Some lines do not have a filename.
-    if (n_matches == 10) {
-      entry.path.clear();
-    } else if (n_matches == 11) {
-      entry.path.resize(strlen(entry.path.c_str()));
-    } else {
-      return absl::FailedPreconditionError("Invalid format");
-    }
-    entry.is_readable = r == 'r';
-    entry.is_writable = w == 'w';
-    entry.is_executable = x == 'x';
-    entry.is_shared = s == 's';
-    entries.push_back(entry);
+  absl::Status status =
+      ForEachProcMapsEntry(contents, [&entries](const MapsEntryView& view) {
+        entries.push_back(ToMapsEntry(view));
+        return true;
+      });
+  if (!status.ok()) {
+    return status;
   }
   return entries;
 }
 
+const MapsEntry* FindMapsEntry(const std::vector<MapsEntry>& entries,
+                               uint64_t addr) {
+  auto it = std::upper_bound(
+      entries.begin(), entries.end(), addr,
+      [](uint64_t addr, const MapsEntry& entry) { return addr < entry.end; });
+  if (it == entries.end() || addr < it->start) {
+    return nullptr;
+  }
+  return &*it;
+}
+
 }  // namespace sandbox2
@@ -15,11 +15,16 @@
 #ifndef SANDBOXED_API_SANDBOX2_UTIL_MAPS_PARSER_H_
 #define SANDBOXED_API_SANDBOX2_UTIL_MAPS_PARSER_H_
 
+#include <sys/types.h>
+
 #include <cstdint>
 #include <string>
 #include <vector>
 
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 
 namespace sandbox2 {
 
@@ -37,9 +42,43 @@ struct MapsEntry {
   std::string path;
 };
 
+// Like MapsEntry, but the path points into the parsed data and is only valid
+// until the callback it is passed to returns.
+struct MapsEntryView {
+  uint64_t start;
+  uint64_t end;
+  bool is_readable;
+  bool is_writable;
+  bool is_executable;
+  bool is_shared;
+  uint64_t pgoff;
+  int major;
+  int minor;
+  uint64_t inode;
+  absl::string_view path;
+};
+
+MapsEntry ToMapsEntry(const MapsEntryView& view);
+
+using MapsEntryCallback = absl::FunctionRef<bool(const MapsEntryView&)>;
+
+// Calls `callback` on each entry of the maps file `contents`, in order,
+// without allocating. Stops early once the callback returns false.
+absl::Status ForEachProcMapsEntry(absl::string_view contents,
+                                  MapsEntryCallback callback);
+
+// Like above, but reads /proc/<pid>/maps incrementally through a fixed-size
+// buffer instead of loading all of it first.
+absl::Status ForEachProcMapsEntry(pid_t pid, MapsEntryCallback callback);
+
 absl::StatusOr<std::vector<MapsEntry>> ParseProcMaps(
     const std::string& contents);
 
+// Returns the entry that contains `addr`, or nullptr. Uses a binary search, as
+// the entries of a maps file are sorted by address.
+const MapsEntry* FindMapsEntry(const std::vector<MapsEntry>& entries,
+                               uint64_t addr);
+
 }  // namespace sandbox2
 
 #endif  // SANDBOXED_API_SANDBOX2_UTIL_MAPS_PARSER_H_
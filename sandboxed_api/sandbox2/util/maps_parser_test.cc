@@ -14,6 +14,12 @@
 
 #include "sandboxed_api/sandbox2/util/maps_parser.h"
 
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "sandboxed_api/util/status_matchers.h"
@@ -23,7 +29,9 @@ namespace {
 
 using ::sapi::IsOk;
 using ::testing::Eq;
+using ::testing::IsNull;
 using ::testing::Not;
+using ::testing::NotNull;
 using ::testing::Test;
 
 TEST(MapsParserTest, ParsesValidFileCorrectly) {
@@ -85,5 +93,48 @@ TEST(MapsParserTest, FailsOnInvalidFile) {
   ASSERT_THAT(status_or.status(), Not(IsOk()));
 }
 
+TEST(MapsParserTest, KeepsSpacesInPaths) {
+  static constexpr char kMapsFile[] =
+      "7ffff7a3a000-7ffff7bcf000 r-xp 00000000 fd:01 916748     "
+      "/tmp/my lib.so (deleted)\n";
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<MapsEntry> entries,
+                            ParseProcMaps(kMapsFile));
+  ASSERT_THAT(entries.size(), Eq(1));
+  EXPECT_THAT(entries[0].path, Eq("/tmp/my lib.so (deleted)"));
+  EXPECT_THAT(entries[0].major, Eq(0xfd));
+  EXPECT_THAT(entries[0].minor, Eq(1));
+}
+
+TEST(MapsParserTest, StopsWhenCallbackReturnsFalse) {
+  static constexpr char kMapsFile[] =
+      "555555554000-55555555c000 r-xp 00000000 fd:01 3277961    /bin/cat\n"
+      "55555575b000-55555575c000 r--p 00007000 fd:01 3277961    /bin/cat\n"
+      "this is not a maps entry\n";
+  int calls = 0;
+  EXPECT_THAT(ForEachProcMapsEntry(kMapsFile,
+                                   [&calls](const MapsEntryView& entry) {
+                                     ++calls;
+                                     return entry.is_executable;
+                                   }),
+              IsOk());
+  EXPECT_THAT(calls, Eq(2));
+}
+
+TEST(MapsParserTest, ReadsMapsOfProcess) {
+  const uint64_t function_address =
+      reinterpret_cast<uint64_t>(&ToMapsEntry);
+  std::vector<MapsEntry> entries;
+  ASSERT_THAT(ForEachProcMapsEntry(getpid(),
+                                   [&entries](const MapsEntryView& entry) {
+                                     entries.push_back(ToMapsEntry(entry));
+                                     return true;
+                                   }),
+              IsOk());
+  const MapsEntry* entry = FindMapsEntry(entries, function_address);
+  ASSERT_THAT(entry, NotNull());
+  EXPECT_THAT(entry->is_executable, Eq(true));
+  EXPECT_THAT(FindMapsEntry(entries, 0), IsNull());
+}
+
 }  // namespace
 }  // namespace sandbox2
@@ -15,9 +15,15 @@
 #include "sandboxed_api/sandbox2/util/minielf.h"
 
 #include <elf.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <cerrno>
 #include <cstddef>
+#include <deque>
 #include <memory>
+#include <string>
 #include <type_traits>
 
 #include "absl/base/internal/endian.h"
@@ -27,6 +33,7 @@
 #include "absl/strings/str_cat.h"
 #include "sandboxed_api/config.h"
 #include "sandboxed_api/sandbox2/util.h"
+#include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
 
@@ -58,25 +65,6 @@ constexpr int kEvCurrent = 1;  // ELF version
 
 namespace {
 
-// NOLINTNEXTLINE
-absl::Status CheckedFSeek(FILE* f, long offset, int whence) {
-  if (fseek(f, offset, whence)) {
-    return absl::ErrnoToStatus(errno, "Fseek on ELF failed");
-  }
-  return absl::OkStatus();
-}
-
-absl::Status CheckedFRead(void* dst, size_t size, size_t nmemb, FILE* f) {
-  if (std::fread(dst, size, nmemb, f) == nmemb) {
-    return absl::OkStatus();
-  }
-  return absl::ErrnoToStatus(errno, "Reading ELF data failed");
-}
-
-absl::Status CheckedRead(std::string* s, FILE* f) {
-  return CheckedFRead(&(*s)[0], 1, s->size(), f);
-}
-
 absl::string_view ReadName(uint32_t offset, absl::string_view strtab) {
   auto name = strtab.substr(offset);
   return name.substr(0, name.find('\0'));
@@ -101,14 +89,7 @@ class ElfParser {
   static constexpr int kMaxDynamicEntries = 10000;
   static constexpr size_t kMaxInterpreterSize = 1000;
 
-  static absl::StatusOr<ElfFile> Parse(const std::string& filename,
-                                       uint32_t features);
-
-  ~ElfParser() {
-    if (elf_) {
-      std::fclose(elf_);
-    }
-  }
+  static absl::StatusOr<ElfFile> Parse(int fd, uint32_t features);
 
  private:
   ElfParser() = default;
@@ -151,8 +132,11 @@ class ElfParser {
     }
   }
 
-  // Reads ELF file size.
-  absl::Status ReadFileSize();
+  // Starts reading the ELF file open as `fd`.
+  absl::Status SetFile(int fd);
+  // Returns a view of `size` bytes read at `offset` from the file, which stays
+  // valid as long as the parser.
+  absl::StatusOr<absl::string_view> ReadData(uint64_t offset, uint64_t size);
   // Reads ELF header.
   absl::Status ReadFileHeader();
   // Reads a single ELF program header.
@@ -164,8 +148,8 @@ class ElfParser {
   // Reads all ELF section headers.
   absl::Status ReadSectionHeaders();
   // Reads contents of an ELF section.
-  absl::StatusOr<std::string> ReadSectionContents(int idx);
-  absl::StatusOr<std::string> ReadSectionContents(
+  absl::StatusOr<absl::string_view> ReadSectionContents(int idx);
+  absl::StatusOr<absl::string_view> ReadSectionContents(
       const ElfShdr& section_header);
   // Reads all symbols from symtab section.
   absl::Status ReadSymbolsFromSymtab(const ElfShdr& symtab);
@@ -173,8 +157,12 @@ class ElfParser {
   absl::Status ReadImportedLibrariesFromDynamic(const ElfShdr& dynamic);
 
   ElfFile result_;
-  FILE* elf_ = nullptr;
+  // Only the parts that are needed are read, with pread(). Unlike a mapping of
+  // the file, that fails cleanly if the file is truncated meanwhile.
+  int fd_ = -1;
   size_t file_size_ = 0;
+  // Everything read by ReadData(). A deque, so that views stay valid.
+  std::deque<std::string> reads_;
   bool elf_little_ = false;
   ElfEhdr file_header_;
   std::vector<ElfPhdr> program_headers_;
@@ -184,9 +172,13 @@ class ElfParser {
   int dynamic_entries_read = 0;
 };
 
-absl::Status ElfParser::ReadFileSize() {
-  std::fseek(elf_, 0, SEEK_END);
-  file_size_ = std::ftell(elf_);
+absl::Status ElfParser::SetFile(int fd) {
+  fd_ = fd;
+  struct stat st;
+  if (fstat(fd_, &st) == -1) {
+    return absl::ErrnoToStatus(errno, "cannot stat file");
+  }
+  file_size_ = st.st_size;
   if (file_size_ < kElfHeaderSize) {
     return absl::FailedPreconditionError(
         absl::StrCat("file too small: ", file_size_, " bytes, at least ",
@@ -195,10 +187,33 @@ absl::Status ElfParser::ReadFileSize() {
   return absl::OkStatus();
 }
 
+absl::StatusOr<absl::string_view> ElfParser::ReadData(uint64_t offset,
+                                                      uint64_t size) {
+  if (offset > file_size_ || size > file_size_ - offset) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("reading past the end of the ELF: ", size,
+                     " bytes at offset ", offset));
+  }
+  std::string& data = reads_.emplace_back(size, '\0');
+  for (size_t done = 0; done < size;) {
+    ssize_t n = TEMP_FAILURE_RETRY(
+        pread(fd_, &data[done], size - done, offset + done));
+    if (n == -1) {
+      return absl::ErrnoToStatus(errno, "reading the ELF");
+    }
+    if (n == 0) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("ELF truncated while reading ", size,
+                       " bytes at offset ", offset));
+    }
+    done += n;
+  }
+  return data;
+}
+
 absl::Status ElfParser::ReadFileHeader() {
-  std::string header(kElfHeaderSize, '\0');
-  SAPI_RETURN_IF_ERROR(CheckedFSeek(elf_, 0, SEEK_SET));
-  SAPI_RETURN_IF_ERROR(CheckedRead(&header, elf_));
+  SAPI_ASSIGN_OR_RETURN(absl::string_view header,
+                        ReadData(0, kElfHeaderSize));
 
   if (!absl::StartsWith(header, kElfMagic)) {
     return absl::FailedPreconditionError("magic not found, not an ELF");
@@ -268,11 +283,11 @@ absl::Status ElfParser::ReadSectionHeaders() {
         absl::StrCat("too many section header entries: ", file_header_.e_shnum,
                      " limit: ", kMaxSectionHeaderEntries));
   }
-  std::string headers(file_header_.e_shentsize * file_header_.e_shnum, '\0');
-  SAPI_RETURN_IF_ERROR(CheckedFSeek(elf_, file_header_.e_shoff, SEEK_SET));
-  SAPI_RETURN_IF_ERROR(CheckedRead(&headers, elf_));
+  SAPI_ASSIGN_OR_RETURN(
+      absl::string_view src,
+      ReadData(file_header_.e_shoff,
+               file_header_.e_shentsize * file_header_.e_shnum));
   section_headers_.resize(file_header_.e_shnum);
-  absl::string_view src = headers;
   for (int i = 0; i < file_header_.e_shnum; ++i) {
     SAPI_ASSIGN_OR_RETURN(section_headers_[i], ReadSectionHeader(src));
     src = src.substr(file_header_.e_shentsize);
@@ -280,7 +295,7 @@ absl::Status ElfParser::ReadSectionHeaders() {
   return absl::OkStatus();
 }
 
-absl::StatusOr<std::string> ElfParser::ReadSectionContents(int idx) {
+absl::StatusOr<absl::string_view> ElfParser::ReadSectionContents(int idx) {
   if (idx < 0 || idx >= section_headers_.size()) {
     return absl::FailedPreconditionError(
         absl::StrCat("invalid section header index: ", idx));
@@ -288,7 +303,7 @@ absl::StatusOr<std::string> ElfParser::ReadSectionContents(int idx) {
   return ReadSectionContents(section_headers_.at(idx));
 }
 
-absl::StatusOr<std::string> ElfParser::ReadSectionContents(
+absl::StatusOr<absl::string_view> ElfParser::ReadSectionContents(
     const ElfShdr& section_header) {
   auto offset = section_header.sh_offset;
   if (offset > file_size_) {
@@ -300,10 +315,7 @@ absl::StatusOr<std::string> ElfParser::ReadSectionContents(
     return absl::FailedPreconditionError(
         absl::StrCat("section too big: ", size, " limit: ", kMaxSectionSize));
   }
-  std::string rv(size, '\0');
-  SAPI_RETURN_IF_ERROR(CheckedFSeek(elf_, offset, SEEK_SET));
-  SAPI_RETURN_IF_ERROR(CheckedRead(&rv, elf_));
-  return rv;
+  return ReadData(offset, size);
 }
 
 absl::StatusOr<ElfPhdr> ElfParser::ReadProgramHeader(absl::string_view src) {
@@ -339,11 +351,11 @@ absl::Status ElfParser::ReadProgramHeaders() {
         absl::StrCat("too many program header entries: ", file_header_.e_phnum,
                      " limit: ", kMaxProgramHeaderEntries));
   }
-  std::string headers(file_header_.e_phentsize * file_header_.e_phnum, '\0');
-  SAPI_RETURN_IF_ERROR(CheckedFSeek(elf_, file_header_.e_phoff, SEEK_SET));
-  SAPI_RETURN_IF_ERROR(CheckedRead(&headers, elf_));
+  SAPI_ASSIGN_OR_RETURN(
+      absl::string_view src,
+      ReadData(file_header_.e_phoff,
+               file_header_.e_phentsize * file_header_.e_phnum));
   program_headers_.resize(file_header_.e_phnum);
-  absl::string_view src = headers;
   for (int i = 0; i < file_header_.e_phnum; ++i) {
     SAPI_ASSIGN_OR_RETURN(program_headers_[i], ReadProgramHeader(src));
     src = src.substr(file_header_.e_phentsize);
@@ -374,9 +386,10 @@ absl::Status ElfParser::ReadSymbolsFromSymtab(const ElfShdr& symtab) {
         absl::StrCat("invalid symtab's strtab reference: ", symtab.sh_link));
   }
   SAPI_RAW_VLOG(1, "Symbol table with %zu entries found", symbol_entries);
-  SAPI_ASSIGN_OR_RETURN(std::string strtab,
+  SAPI_ASSIGN_OR_RETURN(absl::string_view strtab,
                         ReadSectionContents(symtab.sh_link));
-  SAPI_ASSIGN_OR_RETURN(std::string symbols, ReadSectionContents(symtab));
+  SAPI_ASSIGN_OR_RETURN(absl::string_view symbols,
+                        ReadSectionContents(symtab));
   result_.symbols_.reserve(result_.symbols_.size() + symbol_entries);
   for (absl::string_view src = symbols; !src.empty();
        src = src.substr(symtab.sh_entsize)) {
@@ -446,7 +459,7 @@ absl::Status ElfParser::ReadImportedLibrariesFromDynamic(
         absl::StrCat("symtab's strtab too big: ", strtab_section.sh_size));
   }
   auto strtab_end = strtab_section.sh_offset + strtab_section.sh_size;
-  SAPI_ASSIGN_OR_RETURN(std::string dynamic_entries,
+  SAPI_ASSIGN_OR_RETURN(absl::string_view dynamic_entries,
                         ReadSectionContents(dynamic));
   for (absl::string_view src = dynamic_entries; !src.empty();
        src = src.substr(dynamic.sh_entsize)) {
@@ -461,30 +474,22 @@ absl::Status ElfParser::ReadImportedLibrariesFromDynamic(
           absl::StrCat("invalid name reference"));
     }
     auto offset = strtab_section.sh_offset + dyn.d_un.d_val;
-    SAPI_RETURN_IF_ERROR(CheckedFSeek(elf_, offset, SEEK_SET));
-    std::string path(
-        std::min(kMaxLibPathSize, static_cast<size_t>(strtab_end - offset)),
-        '\0');
-    size_t size = std::fread(&path[0], 1, path.size(), elf_);
-    path.resize(size);
-    result_.imported_libraries_.push_back(path.substr(0, path.find('\0')));
+    SAPI_ASSIGN_OR_RETURN(
+        absl::string_view path,
+        ReadData(offset, std::min(kMaxLibPathSize,
+                                  static_cast<size_t>(strtab_end - offset))));
+    result_.imported_libraries_.emplace_back(path.substr(0, path.find('\0')));
   }
   return absl::OkStatus();
 }
 
-absl::StatusOr<ElfFile> ElfParser::Parse(const std::string& filename,
-                                         uint32_t features) {
-  ElfParser parser;
-  if (parser.elf_ = std::fopen(filename.c_str(), "r"); !parser.elf_) {
-    return absl::ErrnoToStatus(errno,
-                               absl::StrCat("cannot open file: ", filename));
-  }
-
+absl::StatusOr<ElfFile> ElfParser::Parse(int fd, uint32_t features) {
   // Basic sanity check.
   if (features & ~(ElfFile::kAll)) {
     return absl::InvalidArgumentError("Unknown feature flags specified");
   }
-  SAPI_RETURN_IF_ERROR(parser.ReadFileSize());
+  ElfParser parser;
+  SAPI_RETURN_IF_ERROR(parser.SetFile(fd));
   SAPI_RETURN_IF_ERROR(parser.ReadFileHeader());
   switch (parser.file_header_.e_type) {
     case ET_EXEC:
@@ -508,9 +513,9 @@ absl::StatusOr<ElfFile> ElfParser::Parse(const std::string& filename,
         return absl::FailedPreconditionError(
             absl::StrCat("program interpeter path too long: ", it->p_filesz));
       }
-      SAPI_RETURN_IF_ERROR(CheckedFSeek(parser.elf_, it->p_offset, SEEK_SET));
-      interpreter.resize(it->p_filesz, '\0');
-      SAPI_RETURN_IF_ERROR(CheckedRead(&interpreter, parser.elf_));
+      SAPI_ASSIGN_OR_RETURN(absl::string_view data,
+                            parser.ReadData(it->p_offset, it->p_filesz));
+      interpreter = std::string(data);
       auto first_nul = interpreter.find_first_of('\0');
       if (first_nul != std::string::npos) {
         interpreter.erase(first_nul);
@@ -537,7 +542,17 @@ absl::StatusOr<ElfFile> ElfParser::Parse(const std::string& filename,
 
 absl::StatusOr<ElfFile> ElfFile::ParseFromFile(const std::string& filename,
                                                uint32_t features) {
-  return ElfParser::Parse(filename, features);
+  sapi::file_util::fileops::FDCloser fd(
+      open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+  if (fd.get() == -1) {
+    return absl::ErrnoToStatus(errno,
+                               absl::StrCat("cannot open file: ", filename));
+  }
+  return ParseFromFd(fd.get(), features);
+}
+
+absl::StatusOr<ElfFile> ElfFile::ParseFromFd(int fd, uint32_t features) {
+  return ElfParser::Parse(fd, features);
 }
 
 }  // namespace sandbox2
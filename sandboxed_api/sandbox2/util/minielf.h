@@ -41,6 +41,9 @@ class ElfFile {
 
   static absl::StatusOr<ElfFile> ParseFromFile(const std::string& filename,
                                                uint32_t features);
+  // Like ParseFromFile(), for a file that is already open. `fd` stays owned by
+  // the caller.
+  static absl::StatusOr<ElfFile> ParseFromFd(int fd, uint32_t features);
 
   int64_t file_size() const { return file_size_; }
   const std::string& interpreter() const { return interpreter_; }
@@ -14,6 +14,8 @@
 
 #include "sandboxed_api/sandbox2/util/minielf.h"
 
+#include <fcntl.h>
+
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -21,9 +23,11 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/algorithm/container.h"
+#include "absl/status/status.h"
 #include "sandboxed_api/sandbox2/util/maps_parser.h"
 #include "sandboxed_api/testing.h"
 #include "sandboxed_api/util/file_helpers.h"
+#include "sandboxed_api/util/fileops.h"
 #include "sandboxed_api/util/status_matchers.h"
 
 extern "C" void ExportedFunction() {
@@ -32,7 +36,9 @@ extern "C" void ExportedFunction() {
 
 namespace file = ::sapi::file;
 using ::sapi::GetTestSourcePath;
+using ::sapi::GetTestTempPath;
 using ::sapi::IsOk;
+using ::sapi::StatusIs;
 using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::IsTrue;
@@ -91,5 +97,31 @@ TEST(MinielfTest, ImportedLibraries) {
   EXPECT_THAT(elf.imported_libraries(), ElementsAre("libc.so.6"));
 }
 
+TEST(MinielfTest, ParsesOpenFile) {
+  sapi::file_util::fileops::FDCloser fd(
+      open(GetTestSourcePath("sandbox2/util/testdata/hello_world").c_str(),
+           O_RDONLY | O_CLOEXEC));
+  ASSERT_THAT(fd.get(), Ne(-1));
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      ElfFile elf,
+      ElfFile::ParseFromFd(fd.get(), ElfFile::kLoadImportedLibraries));
+  EXPECT_THAT(elf.imported_libraries(), ElementsAre("libc.so.6"));
+}
+
+TEST(MinielfTest, TruncatedFileFails) {
+  std::string contents;
+  ASSERT_THAT(
+      file::GetContents(GetTestSourcePath("sandbox2/util/testdata/hello_world"),
+                        &contents, file::Defaults()),
+      IsOk());
+  // Keeps the headers, but not what they point to.
+  const std::string truncated = GetTestTempPath("minielf_truncated");
+  ASSERT_THAT(file::SetContents(truncated, contents.substr(0, 1024),
+                                file::Defaults()),
+              IsOk());
+  EXPECT_THAT(ElfFile::ParseFromFile(truncated, ElfFile::kAll),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
 }  // namespace
 }  // namespace sandbox2
@@ -19,10 +19,14 @@
 
 #include <cstddef>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
 #include "sandboxed_api/util/status_matchers.h"
 
@@ -82,6 +86,26 @@ TEST(GetProcStatusLineTest, NonExisting) {
   EXPECT_THAT(line, IsEmpty());
 }
 
+TEST(ParseCpuListTest, Ranges) {
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<int> cpus,
+                            ParseCpuList("0-3,8,10-11\n"));
+  EXPECT_THAT(cpus, ElementsAre(0, 1, 2, 3, 8, 10, 11));
+  SAPI_ASSERT_OK_AND_ASSIGN(cpus, ParseCpuList(""));
+  EXPECT_THAT(cpus, IsEmpty());
+  EXPECT_THAT(ParseCpuList("3-1"), Not(IsOk()));
+  EXPECT_THAT(ParseCpuList("a"), Not(IsOk()));
+}
+
+TEST(GetNumaNodeCpusTest, CurrentNodeHasCpus) {
+  SAPI_ASSERT_OK_AND_ASSIGN(int node, GetCurrentNumaNode());
+  absl::StatusOr<std::vector<int>> cpus = GetNumaNodeCpus(node);
+  if (absl::IsNotFound(cpus.status())) {
+    GTEST_SKIP() << "No NUMA information in sysfs";
+  }
+  ASSERT_THAT(cpus, IsOk());
+  EXPECT_THAT(*cpus, Not(IsEmpty()));
+}
+
 TEST(ForkWithFlagsTest, DoesForkNormally) {
   int pfds[2];
   ASSERT_THAT(pipe(pfds), Eq(0));
@@ -159,5 +183,34 @@ TEST(ReadCPathFromPidSplitPageTest, NearUnreadableMemory) {
   EXPECT_THAT(*read, Eq(kTestString));
 }
 
+TEST(ReadCPathsFromPidTest, ReadsAroundUnreadablePath) {
+  const uintptr_t page_size = getpagesize();
+  char* res = reinterpret_cast<char*>(mmap(nullptr, 2 * page_size,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_ANONYMOUS | MAP_PRIVATE, 0, 0));
+  ASSERT_THAT(res, Ne(MAP_FAILED));
+  absl::Cleanup cleanup = [res, page_size]() {
+    ASSERT_THAT(munmap(res, 2 * page_size), Eq(0));
+  };
+  ASSERT_THAT(mprotect(&res[page_size], page_size, PROT_NONE), Eq(0));
+  // Right before the unreadable page, which stops the first read.
+  char* str = &res[page_size - kTestString.size() - 1];
+  memcpy(str, kTestString.data(), kTestString.size());
+  std::string other = "other";
+  std::vector<absl::StatusOr<std::string>> read = ReadCPathsFromPid(
+      getpid(), {reinterpret_cast<uintptr_t>(other.data()),
+                 reinterpret_cast<uintptr_t>(str),
+                 reinterpret_cast<uintptr_t>(&res[page_size]),
+                 reinterpret_cast<uintptr_t>(other.data())});
+  ASSERT_THAT(read.size(), Eq(4));
+  ASSERT_THAT(read[0], IsOk());
+  EXPECT_THAT(*read[0], StrEq("other"));
+  ASSERT_THAT(read[1], IsOk());
+  EXPECT_THAT(*read[1], StrEq(kTestString));
+  EXPECT_THAT(read[2], Not(IsOk()));
+  ASSERT_THAT(read[3], IsOk());
+  EXPECT_THAT(*read[3], StrEq("other"));
+}
+
 }  // namespace
 }  // namespace sandbox2::util
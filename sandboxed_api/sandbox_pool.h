@@ -0,0 +1,417 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_SANDBOX_POOL_H_
+#define SANDBOXED_API_SANDBOX_POOL_H_
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>  // NOLINT(build/c++11)
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/sandbox2/limits.h"
+#include "sandboxed_api/sandbox2/util.h"
+#include "sandboxed_api/util/metrics.h"
+#include "sandboxed_api/util/process_memory.h"
+
+namespace sapi {
+
+struct SandboxPoolOptions {
+  // Number of initialized sandboxes kept ready.
+  size_t size = 1;
+  // A sandbox is discarded instead of being reused once it was leased this many
+  // times. 1 hands out a fresh sandbox for every lease. 0 means no limit.
+  uint64_t max_leases = 0;
+  // A returned sandbox is discarded if its sandboxee uses more resident memory
+  // than this. 0 means no limit.
+  uint64_t max_resident_bytes = 0;
+  // A returned sandbox is discarded if its memory usage grew by more than this
+  // since it started, see Sandbox::ExceedsMemoryGrowth(). Unlike max_leases,
+  // this keeps sandboxes that don't leak for as long as possible.
+  MemoryGrowthLimits max_memory_growth;
+  // Delay before retrying after a sandbox failed to initialize.
+  absl::Duration init_retry_delay = absl::Milliseconds(100);
+  // Runs the sandboxes on the CPUs of this NUMA node, and allocates their
+  // memory from it. On hosts with several nodes, keep one pool per node and
+  // lease from the one for sandbox2::util::GetCurrentNumaNode(), so that the
+  // buffers shared with a sandboxee are local to the thread using it.
+  std::optional<int> numa_node;
+  // Ready sandboxes that were not leased for this long are frozen, see
+  // Sandbox::Freeze(), and thawed again when they are leased. Keeps idle pools
+  // from using CPU and, with page_out_frozen, most of their resident memory,
+  // for a little latency on the first lease. 0 never freezes them.
+  absl::Duration freeze_after_idle = absl::ZeroDuration();
+  // Whether frozen sandboxes are also paged out.
+  bool page_out_frozen = true;
+};
+
+// Keeps initialized sandboxes of type T ready, so that callers don't have to
+// wait for Sandbox::Init(). Sandboxes are handed out with leases, which return
+// them to the pool when they go out of scope. Used ones are replaced in the
+// background.
+// A returned sandbox is kept for later leases if the pool isn't full, unless
+// it is terminated or the limits in SandboxPoolOptions say otherwise. Reused
+// sandboxes keep the state their previous users left in the sandboxed
+// library, so set max_leases to 1 if that is a concern.
+// Leases prefer the sandboxes returned last, so that with freeze_after_idle,
+// pools that are larger than needed keep their surplus frozen.
+//
+// Example:
+//   SandboxPool<SumSandbox> pool({.size = 4});
+//   SAPI_ASSIGN_OR_RETURN(auto lease, pool.Acquire());
+//   SumApi api(lease.get());
+//   SAPI_ASSIGN_OR_RETURN(int result, api.sum(1, 2));
+template <typename T>
+class SandboxPool {
+ public:
+  static_assert(std::is_base_of_v<Sandbox, T>,
+                "Template argument must be a sapi::Sandbox");
+
+  using Factory = std::function<std::unique_ptr<T>()>;
+
+  // Gives exclusive access to a sandbox of the pool, until it goes out of
+  // scope. Must not outlive the pool.
+  class Lease {
+   public:
+    Lease(Lease&& other) { *this = std::move(other); }
+    Lease& operator=(Lease&& other) {
+      Return();
+      pool_ = std::exchange(other.pool_, nullptr);
+      sandbox_ = std::move(other.sandbox_);
+      leases_ = other.leases_;
+      discard_ = other.discard_;
+      return *this;
+    }
+
+    ~Lease() { Return(); }
+
+    T* get() const { return sandbox_.get(); }
+    T* operator->() const { return get(); }
+    T& operator*() const { return *get(); }
+
+    // Makes the sandbox not go back to the pool, e.g. because it is in a bad
+    // state.
+    void Discard() { discard_ = true; }
+
+   private:
+    friend class SandboxPool;
+
+    Lease(SandboxPool* pool, std::unique_ptr<T> sandbox, uint64_t leases)
+        : pool_(pool), sandbox_(std::move(sandbox)), leases_(leases) {}
+
+    void Return() {
+      if (SandboxPool* pool = std::exchange(pool_, nullptr); pool != nullptr) {
+        pool->Release(std::move(sandbox_), leases_, discard_);
+      }
+    }
+
+    SandboxPool* pool_ = nullptr;
+    std::unique_ptr<T> sandbox_;
+    uint64_t leases_ = 0;
+    bool discard_ = false;
+  };
+
+  // `factory` may only be omitted if T is default constructible.
+  explicit SandboxPool(SandboxPoolOptions options, Factory factory = nullptr)
+      : options_(std::move(options)),
+        factory_(factory ? std::move(factory) : DefaultFactory()),
+        refill_thread_(&SandboxPool::RefillLoop, this) {}
+
+  SandboxPool(const SandboxPool&) = delete;
+  SandboxPool& operator=(const SandboxPool&) = delete;
+
+  // All leases must have been returned.
+  ~SandboxPool() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+    }
+    refill_thread_.join();
+    // So that they can exit gracefully.
+    for (Entry& entry : ready_) {
+      if (entry.frozen) {
+        entry.sandbox->Thaw().IgnoreError();
+      }
+    }
+  }
+
+  // Returns a lease on an initialized sandbox, waiting for one to become ready
+  // if necessary, also if the pool is empty. Fails with the error of
+  // initializing a sandbox if that fails while waiting.
+  absl::StatusOr<Lease> Acquire() {
+    Entry entry;
+    {
+      absl::MutexLock lock(&mutex_);
+      ++waiters_;
+      AcquireWaiter waiter = {this, init_failures_};
+      mutex_.Await(absl::Condition(&SandboxPool::CanAcquireLocked, &waiter));
+      --waiters_;
+      if (ready_.empty()) {
+        return init_status_;
+      }
+      entry = std::move(ready_.front());
+      ready_.pop_front();
+    }
+    return MakeLease(std::move(entry));
+  }
+
+  // Like Acquire(), but fails with UnavailableError instead of waiting if no
+  // sandbox is ready.
+  absl::StatusOr<Lease> TryAcquire() {
+    Entry entry;
+    {
+      absl::MutexLock lock(&mutex_);
+      if (ready_.empty()) {
+        return absl::UnavailableError("No sandbox is ready");
+      }
+      entry = std::move(ready_.front());
+      ready_.pop_front();
+    }
+    return MakeLease(std::move(entry));
+  }
+
+  // Returns the number of sandboxes ready to be leased.
+  size_t ready() const {
+    absl::MutexLock lock(&mutex_);
+    return ready_.size();
+  }
+
+  // Returns the number of ready sandboxes that are frozen, see
+  // SandboxPoolOptions::freeze_after_idle.
+  size_t frozen() const {
+    absl::MutexLock lock(&mutex_);
+    size_t frozen = 0;
+    for (const Entry& entry : ready_) {
+      frozen += entry.frozen ? 1 : 0;
+    }
+    return frozen;
+  }
+
+ private:
+  struct Entry {
+    std::unique_ptr<T> sandbox;
+    // Number of times the sandbox was leased so far.
+    uint64_t leases = 0;
+    // When the sandbox became ready.
+    absl::Time idle_since;
+    bool frozen = false;
+  };
+
+  static Factory DefaultFactory() {
+    if constexpr (std::is_default_constructible_v<T>) {
+      return [] { return std::make_unique<T>(); };
+    } else {
+      return nullptr;
+    }
+  }
+
+  // A caller blocked in Acquire().
+  struct AcquireWaiter {
+    const SandboxPool* pool;
+    // init_failures_ when it started waiting.
+    uint64_t init_failures;
+  };
+
+  static bool CanAcquireLocked(AcquireWaiter* waiter) {
+    waiter->pool->mutex_.AssertReaderHeld();
+    return !waiter->pool->ready_.empty() ||
+           waiter->pool->init_failures_ != waiter->init_failures;
+  }
+
+  bool NeedsRefillLocked() const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    return stopping_ || ready_.size() < options_.size ||
+           ready_.size() < waiters_;
+  }
+
+  // Returns when the next ready sandbox should be frozen. Sandboxes that
+  // become ready later are frozen after the returned time, at the earliest.
+  absl::Time NextFreezeLocked() const ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    if (options_.freeze_after_idle == absl::ZeroDuration()) {
+      return absl::InfiniteFuture();
+    }
+    absl::Time next = absl::Now() + options_.freeze_after_idle;
+    for (const Entry& entry : ready_) {
+      if (!entry.frozen) {
+        next = std::min(next, entry.idle_since + options_.freeze_after_idle);
+      }
+    }
+    return next;
+  }
+
+  // Freezes the ready sandboxes that were idle for long enough. They are
+  // taken out of the pool meanwhile, so that Acquire() doesn't hand out
+  // sandboxes that are being frozen.
+  void FreezeIdleLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    const absl::Time now = absl::Now();
+    for (auto it = ready_.begin(); it != ready_.end() && !stopping_;) {
+      if (it->frozen || now < it->idle_since + options_.freeze_after_idle) {
+        ++it;
+        continue;
+      }
+      Entry entry = std::move(*it);
+      ready_.erase(it);
+      mutex_.Unlock();
+      absl::Status status = entry.sandbox->Freeze(options_.page_out_frozen);
+      if (!status.ok()) {
+        LOG(WARNING) << "Freezing a pooled sandbox failed: " << status;
+        entry.sandbox.reset();
+      }
+      mutex_.Lock();
+      if (entry.sandbox) {
+        // Behind the sandboxes that were not frozen, which leases prefer.
+        entry.frozen = true;
+        ready_.push_back(std::move(entry));
+      }
+      it = ready_.begin();
+    }
+  }
+
+  // Hands out a sandbox taken from the pool, thawing it first if it is frozen.
+  Lease MakeLease(Entry entry) {
+    if (entry.frozen) {
+      metrics::ScopedLatency latency(metrics::kPoolThawLatency, "");
+      if (absl::Status status = entry.sandbox->Thaw(); !status.ok()) {
+        // The sandboxee is gone, which calls report like for any other
+        // sandbox that terminated while ready.
+        LOG(WARNING) << "Thawing a pooled sandbox failed: " << status;
+      }
+    }
+    return Lease(this, std::move(entry.sandbox), entry.leases + 1);
+  }
+
+  // Decides whether a sandbox returned by a lease can be leased again.
+  bool IsReusable(const T& sandbox, uint64_t leases) const {
+    if (!sandbox.is_active()) {
+      return false;
+    }
+    if (options_.max_leases != 0 && leases >= options_.max_leases) {
+      return false;
+    }
+    // The pid of a sandbox running in process is the host's.
+    if (options_.max_resident_bytes != 0 && !sandbox.is_in_process()) {
+      absl::StatusOr<uint64_t> resident = GetResidentMemoryBytes(sandbox.pid());
+      if (!resident.ok() || *resident > options_.max_resident_bytes) {
+        return false;
+      }
+    }
+    if (!options_.max_memory_growth.empty()) {
+      absl::StatusOr<bool> exceeds =
+          sandbox.ExceedsMemoryGrowth(options_.max_memory_growth);
+      if (!exceeds.ok() || *exceeds) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Release(std::unique_ptr<T> sandbox, uint64_t leases, bool discard) {
+    if (!discard && IsReusable(*sandbox, leases)) {
+      absl::MutexLock lock(&mutex_);
+      if (ready_.size() < options_.size || ready_.size() < waiters_) {
+        ready_.push_front({std::move(sandbox), leases, absl::Now()});
+      }
+    }
+    // Sandboxes that are not kept are terminated here, without holding the
+    // lock. The refill thread replaces them independently.
+  }
+
+  // Returns the placement of the sandboxes of a pool with a numa_node.
+  sandbox2::Placement GetPlacement() const {
+    sandbox2::Placement placement = {.numa_node = options_.numa_node};
+    absl::StatusOr<std::vector<int>> cpus =
+        sandbox2::util::GetNumaNodeCpus(*options_.numa_node);
+    if (cpus.ok()) {
+      placement.cpus = *std::move(cpus);
+    } else {
+      LOG(WARNING) << "Not pinning pooled sandboxes to CPUs: "
+                   << cpus.status();
+    }
+    return placement;
+  }
+
+  // Initializes new sandboxes whenever the pool runs low.
+  void RefillLoop() {
+    const std::optional<sandbox2::Placement> placement =
+        options_.numa_node ? std::make_optional(GetPlacement()) : std::nullopt;
+    absl::MutexLock lock(&mutex_);
+    while (true) {
+      if (!mutex_.AwaitWithDeadline(
+              absl::Condition(this, &SandboxPool::NeedsRefillLocked),
+              NextFreezeLocked())) {
+        FreezeIdleLocked();
+        continue;
+      }
+      if (stopping_) {
+        return;
+      }
+      mutex_.Unlock();
+      std::unique_ptr<T> sandbox = factory_();
+      if (placement) {
+        sandbox->SetPlacement(*placement);
+      }
+      absl::Status status = sandbox->Init();
+      if (!status.ok()) {
+        LOG(WARNING) << "Initializing a pooled sandbox failed: " << status;
+        sandbox.reset();
+      }
+      mutex_.Lock();
+      if (!status.ok()) {
+        // Waiting callers get the error, later ones wait for the retry.
+        init_status_ = std::move(status);
+        ++init_failures_;
+        mutex_.AwaitWithTimeout(absl::Condition(&stopping_),
+                                options_.init_retry_delay);
+        continue;
+      }
+      ready_.push_back({std::move(sandbox), 0, absl::Now()});
+    }
+  }
+
+  const SandboxPoolOptions options_;
+  const Factory factory_;
+
+  mutable absl::Mutex mutex_;
+  std::deque<Entry> ready_ ABSL_GUARDED_BY(mutex_);
+  // Number of callers blocked in Acquire().
+  size_t waiters_ ABSL_GUARDED_BY(mutex_) = 0;
+  // Error of the last failed attempt to initialize a sandbox.
+  absl::Status init_status_ ABSL_GUARDED_BY(mutex_);
+  // Number of failed attempts to initialize a sandbox.
+  uint64_t init_failures_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  // Started last, as it uses all of the above.
+  std::thread refill_thread_;
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_SANDBOX_POOL_H_
@@ -13,30 +13,74 @@
 // limitations under the License.
 
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
 #include <memory>
+#include <string>
 #include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "benchmark/benchmark.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/await_reactor.h"
+#include "sandboxed_api/call.h"
+#include "sandboxed_api/call_cache.h"
+#include "sandboxed_api/coroutine.h"
 #include "sandboxed_api/examples/stringop/sandbox.h"
 #include "sandboxed_api/examples/stringop/stringop-sapi.sapi.h"
 #include "sandboxed_api/examples/stringop/stringop_params.pb.h"
 #include "sandboxed_api/examples/sum/sandbox.h"
 #include "sandboxed_api/examples/sum/sum-sapi.sapi.h"
+#include "sandboxed_api/examples/sum/sum_flat_params.h"
+#include "sandboxed_api/flat_message.h"
+#include "sandboxed_api/generated_calls.h"
+#include "sandboxed_api/hedged_run.h"
+#include "sandboxed_api/output_channel.h"
+#include "sandboxed_api/parallel_map.h"
+#include "sandboxed_api/sandbox_pool.h"
 #include "sandboxed_api/testing.h"
 #include "sandboxed_api/transaction.h"
+#include "sandboxed_api/transaction_executor.h"
 #include "sandboxed_api/util/status_matchers.h"
+#include "sandboxed_api/var_deep_struct.h"
+#include "sandboxed_api/var_flat.h"
+#include "sandboxed_api/var_lazy_array.h"
+#include "sandboxed_api/var_remote.h"
 
 namespace sapi {
 namespace {
 
 using ::sapi::IsOk;
 using ::sapi::StatusIs;
+using ::testing::Contains;
+using ::testing::ElementsAre;
 using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::Gt;
 using ::testing::HasSubstr;
+using ::testing::IsNull;
+using ::testing::Key;
+using ::testing::Lt;
+using ::testing::Ne;
+using ::testing::NotNull;
 
 // Functions that will be used during the benchmarks:
 
@@ -102,6 +146,23 @@ void BenchmarkCallOverhead(benchmark::State& state) {
 }
 BENCHMARK(BenchmarkCallOverhead);
 
+// Sandbox talking to the sandboxee through shared memory.
+class SharedMemoryStringopSandbox : public StringopSandbox {
+ private:
+  size_t GetSharedMemoryRingSize() const override {
+    return sandbox2::Comms::kDefaultRingSize;
+  }
+};
+
+// Like BenchmarkCallOverhead, but using the shared memory transport.
+void BenchmarkCallOverheadSharedMemory(benchmark::State& state) {
+  BasicTransaction st(std::make_unique<SharedMemoryStringopSandbox>());
+  for (auto _ : state) {
+    EXPECT_THAT(st.Run(InvokeNop), IsOk());
+  }
+}
+BENCHMARK(BenchmarkCallOverheadSharedMemory);
+
 // Make use of protobufs.
 void BenchmarkProtobufHandling(benchmark::State& state) {
   BasicTransaction st(std::make_unique<StringopSandbox>());
@@ -214,6 +275,377 @@ TEST(SandboxTest, RestartTransactionSandboxFD) {
               IsOk());
 }
 
+// Later calls of a function reuse the handle returned by the sandboxee, which
+// must not survive a restart.
+TEST(SandboxTest, RepeatedCallsAcrossRestart) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  for (int i = 0; i < 3; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(i, 2));
+    EXPECT_THAT(result, Eq(i + 2));
+  }
+  ASSERT_THAT(sandbox.Restart(false), IsOk());
+  for (int i = 0; i < 3; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(i, 3));
+    EXPECT_THAT(result, Eq(i + 3));
+  }
+}
+
+// Vars that outlive their sandboxee skip freeing their remote memory, instead
+// of sending requests to a new sandboxee or to a destroyed channel.
+TEST(SandboxTest, VarsOutlivingTheSandboxee) {
+  auto sandbox = std::make_unique<SumSandbox>();
+  ASSERT_THAT(sandbox->Init(), IsOk());
+  auto before_restart = std::make_unique<sapi::v::Int>(1);
+  ASSERT_THAT(sandbox->Allocate(before_restart.get(), /*automatic_free=*/true),
+              IsOk());
+  ASSERT_THAT(sandbox->Restart(false), IsOk());
+  auto before_destruction = std::make_unique<sapi::v::Int>(2);
+  ASSERT_THAT(
+      sandbox->Allocate(before_destruction.get(), /*automatic_free=*/true),
+      IsOk());
+
+  before_restart.reset();
+  SumApi api(sandbox.get());
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+
+  sandbox.reset();
+  before_destruction.reset();
+}
+
+// Calls aren't limited to FuncCall::kArgsMax arguments.
+TEST(SandboxTest, CallWithManyArguments) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      long result,
+      api.sum16(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 1L << 40));
+  EXPECT_THAT(result, Eq(120 + (1L << 40)));
+}
+
+// Integer and pointer signatures bypass libffi, others still go through it.
+TEST(SandboxTest, RegisterAndFloatCalls) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(-5, 2));
+  EXPECT_THAT(result, Eq(-3));
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api.mul(-4, 6));
+  EXPECT_THAT(result, Eq(-24));
+
+  std::vector<int> data = {-1, 2, -3};
+  v::Array<int> array(data.data(), data.size());
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api.sumarr(array.PtrBefore(), 3));
+  EXPECT_THAT(result, Eq(-2));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(double product, api.muld(-1.5, 2.0f));
+  EXPECT_THAT(product, Eq(-3.0));
+}
+
+TEST(SandboxTest, CallBatch) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  v::Int a(1), b(2), c(3), d(4);
+  v::Int r1, r2, r3;
+  ASSERT_THAT(sandbox.CallBatch({{"sum", &r1, {&a, &b}},
+                                 {"sum", &r2, {&c, &d}},
+                                 {"sum", &r3, {&r1, &r2}}}),
+              IsOk());
+  EXPECT_THAT(r1.GetValue(), Eq(3));
+  EXPECT_THAT(r2.GetValue(), Eq(7));
+  // Arguments are transferred before the batch runs.
+  EXPECT_THAT(r3.GetValue(), Eq(0));
+
+  // The batch stops at the first failing call, keeping earlier results.
+  v::Int r4, r5;
+  EXPECT_THAT(sandbox.CallBatch({{"sum", &r4, {&c, &c}},
+                                 {"does_not_exist", &r5, {}},
+                                 {"sum", &r5, {&d, &d}}}),
+              StatusIs(absl::StatusCode::kUnavailable));
+  EXPECT_THAT(r4.GetValue(), Eq(6));
+  EXPECT_THAT(r5.GetValue(), Eq(0));
+
+  // The sandboxee is still fine afterwards.
+  SumApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+}
+
+TEST(SandboxTest, CallAsync) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  v::Int a(1), b(2), c(3), d(4);
+  v::Int r1, r2;
+  SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::AsyncCall call1,
+                            sandbox.CallAsync("sum", &r1, &a, &b));
+  SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::AsyncCall call2,
+                            sandbox.CallAsync("sum", &r2, &c, &d));
+  // Results can be waited for in any order.
+  ASSERT_THAT(call2.Wait(), IsOk());
+  EXPECT_THAT(r2.GetValue(), Eq(7));
+  ASSERT_THAT(call1.Wait(), IsOk());
+  EXPECT_THAT(r1.GetValue(), Eq(3));
+  EXPECT_THAT(call1.Wait(), StatusIs(absl::StatusCode::kFailedPrecondition));
+
+  // Synchronous calls collect outstanding results first.
+  v::Int r3;
+  SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::AsyncCall call3,
+                            sandbox.CallAsync("sum", &r3, &a, &d));
+  SumApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+  ASSERT_THAT(call3.Wait(), IsOk());
+  EXPECT_THAT(r3.GetValue(), Eq(5));
+
+  // Failures are reported by Wait().
+  v::Int r4;
+  SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::AsyncCall call4,
+                            sandbox.CallAsync("does_not_exist", &r4));
+  EXPECT_THAT(call4.Wait(), StatusIs(absl::StatusCode::kUnavailable));
+}
+
+TEST(SandboxTest, CallAsyncDroppedHandleIsWaitedFor) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  v::Int a(1), b(2);
+  v::Int r;
+  {
+    SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::AsyncCall call,
+                              sandbox.CallAsync("sum", &r, &a, &b));
+  }
+  // The destructor stored the result.
+  EXPECT_THAT(r.GetValue(), Eq(3));
+
+  // Assigning over a pending handle waits for its call as well.
+  v::Int r2, r3;
+  SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::AsyncCall call,
+                            sandbox.CallAsync("sum", &r2, &a, &a));
+  SAPI_ASSERT_OK_AND_ASSIGN(call, sandbox.CallAsync("sum", &r3, &b, &b));
+  EXPECT_THAT(r2.GetValue(), Eq(2));
+  ASSERT_THAT(call.Wait(), IsOk());
+  EXPECT_THAT(r3.GetValue(), Eq(4));
+}
+
+TEST(SandboxTest, CallAsyncOnReactor) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  v::Int a(1), b(2), r;
+  SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::AsyncCall call,
+                            sandbox.CallAsync("sum", &r, &a, &b));
+  PollAwaitReactor reactor;
+  std::promise<void> done;
+  std::function<void()> wait_for_result = [&] {
+    if (call.IsDone()) {
+      done.set_value();
+      return;
+    }
+    reactor.WhenReadable(call.readiness_fd(), [&] { wait_for_result(); });
+  };
+  wait_for_result();
+  done.get_future().wait();
+  ASSERT_THAT(call.Wait(), IsOk());
+  EXPECT_THAT(r.GetValue(), Eq(3));
+}
+
+#ifdef __cpp_impl_coroutine
+// Coroutine type that runs eagerly and is never awaited itself.
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+DetachedTask SumInSteps(SumApi* api, AwaitReactor* reactor,
+                        std::promise<absl::StatusOr<int>>* result) {
+  absl::StatusOr<int> sum = co_await Await(api->sumAsync(1, 2), reactor);
+  if (sum.ok()) {
+    sum = co_await Await(api->sumAsync(*sum, 3), reactor);
+  }
+  result->set_value(std::move(sum));
+}
+
+TEST(SandboxTest, AwaitCallsInCoroutine) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  PollAwaitReactor reactor;
+
+  std::promise<absl::StatusOr<int>> result;
+  SumInSteps(&api, &reactor, &result);
+  absl::StatusOr<int> sum = result.get_future().get();
+  ASSERT_THAT(sum, IsOk());
+  EXPECT_THAT(*sum, Eq(6));
+}
+#endif  // __cpp_impl_coroutine
+
+// Written like the Batch class emitted by the generator.
+class SumBatch : public BatchBuilder {
+ public:
+  using BatchBuilder::BatchBuilder;
+
+  BatchResult<int> sum(int a, int b) {
+    auto* v_ret = Own(std::make_unique<v::Int>());
+    auto* v_a = Own(std::make_unique<v::Int>(a));
+    auto* v_b = Own(std::make_unique<v::Int>(b));
+    return Add<int>("sum", v_ret, {v_a, v_b});
+  }
+};
+
+TEST(SandboxTest, GeneratedCallHelpers) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  // Written like the FooAsync() methods emitted by the generator.
+  auto sum_async = [&sandbox](int a, int b) -> absl::StatusOr<CallFuture<int>> {
+    CallFuture<int> future;
+    auto* v_ret = future.Own(std::make_unique<v::Int>());
+    auto* v_a = future.Own(std::make_unique<v::Int>(a));
+    auto* v_b = future.Own(std::make_unique<v::Int>(b));
+    SAPI_RETURN_IF_ERROR(future.Start(&sandbox, "sum", v_ret, {v_a, v_b}));
+    return future;
+  };
+  SAPI_ASSERT_OK_AND_ASSIGN(CallFuture<int> future1, sum_async(1, 2));
+  SAPI_ASSERT_OK_AND_ASSIGN(CallFuture<int> future2, sum_async(3, 4));
+  SAPI_ASSERT_OK_AND_ASSIGN(int result2, future2.Get());
+  EXPECT_THAT(result2, Eq(7));
+  SAPI_ASSERT_OK_AND_ASSIGN(int result1, future1.Get());
+  EXPECT_THAT(result1, Eq(3));
+  EXPECT_THAT(future1.Get(), StatusIs(absl::StatusCode::kFailedPrecondition));
+
+  SumBatch batch(&sandbox);
+  BatchResult<int> sum1 = batch.sum(1, 2);
+  BatchResult<int> sum2 = batch.sum(3, 4);
+  EXPECT_THAT(batch.size(), Eq(2));
+  ASSERT_THAT(batch.Run(), IsOk());
+  EXPECT_THAT(sum1.value(), Eq(3));
+  EXPECT_THAT(sum2.value(), Eq(7));
+  EXPECT_THAT(batch.Run(), StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(SandboxTest, CallWithDescriptor) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  // Written like the descriptors emitted by the generator.
+  static constexpr CallDescriptor::Arg kArgs[] = {
+      internal::kCallArg<v::Int>, internal::kCallArg<v::Int>};
+  static constexpr CallDescriptor kCall = {"sum", internal::kCallArg<v::Int>,
+                                           kArgs};
+  for (int i = 0; i < 3; ++i) {
+    v::Int a(i);
+    v::Int b(2);
+    v::Int ret;
+    ASSERT_THAT(sandbox.CallWithDescriptor(kCall, &ret, &a, &b), IsOk());
+    EXPECT_THAT(ret.GetValue(), Eq(i + 2));
+  }
+
+  v::Long a(1);
+  v::Int b(2);
+  v::Int ret;
+  EXPECT_THAT(sandbox.CallWithDescriptor(kCall, &ret, &a, &b),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+
+  // Nothing is transferred for mismatched arguments.
+  static constexpr CallDescriptor::Arg kSumArrArgs[] = {
+      internal::kCallArg<v::Ptr>, internal::kCallArg<v::ULong>};
+  static constexpr CallDescriptor kSumArr = {
+      "sumarr", internal::kCallArg<v::Int>, kSumArrArgs};
+  int data[] = {1, 2, 3};
+  v::Array<int> array(data, 3);
+  v::Int size(3);
+  EXPECT_THAT(
+      sandbox.CallWithDescriptor(kSumArr, &ret, array.PtrBefore(), &size),
+      StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(array.GetRemote(), IsNull());
+}
+
+TEST(CallCacheTest, AnswersRepeatedCallsOnTheHost) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  static constexpr CallDescriptor::Arg kSumArrArgs[] = {
+      internal::kCallArg<v::Ptr>, internal::kCallArg<v::ULong>};
+  static constexpr CallDescriptor kSumArr = {
+      "sumarr", internal::kCallArg<v::Int>, kSumArrArgs};
+  CallCache cache({.max_entries = 2});
+  auto sumarr = [&](std::vector<int> data) -> absl::StatusOr<int> {
+    v::Array<int> array(data.data(), data.size());
+    v::ULong size(data.size());
+    v::Int ret;
+    SAPI_RETURN_IF_ERROR(
+        cache.Call(&sandbox, kSumArr, &ret, {array.PtrBefore(), &size}));
+    return ret.GetValue();
+  };
+  for (int i = 0; i < 2; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, sumarr({1, 2, 3}));
+    EXPECT_THAT(result, Eq(6));
+  }
+  // Keyed by the data pointed to.
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, sumarr({1, 2, 4}));
+  EXPECT_THAT(result, Eq(7));
+  SAPI_ASSERT_OK_AND_ASSIGN(result, sumarr({1, 2, 5}));
+  EXPECT_THAT(result, Eq(8));
+  CallCacheStats stats = cache.stats();
+  EXPECT_THAT(stats.hits, Eq(1));
+  EXPECT_THAT(stats.misses, Eq(3));
+  EXPECT_THAT(stats.evictions, Eq(1));
+  EXPECT_THAT(stats.entries, Eq(2));
+
+  // Outputs are restored along with the return value.
+  static constexpr CallDescriptor::Arg kSumsArgs[] = {
+      internal::kCallArg<v::Ptr>};
+  static constexpr CallDescriptor kSums = {
+      "sums", internal::kCallArg<v::Void>, kSumsArgs};
+  v::Struct<sum_params> params;
+  params.mutable_data()->a = 1;
+  params.mutable_data()->b = 2;
+  v::Void ret;
+  ASSERT_THAT(cache.Call(&sandbox, kSums, &ret, {params.PtrBoth()}), IsOk());
+  EXPECT_THAT(params.data().ret, Eq(3));
+
+  // Cached results don't need the sandboxee.
+  sandbox.Terminate();
+  SAPI_ASSERT_OK_AND_ASSIGN(result, sumarr({1, 2, 5}));
+  EXPECT_THAT(result, Eq(8));
+  v::Struct<sum_params> same_params;
+  same_params.mutable_data()->a = 1;
+  same_params.mutable_data()->b = 2;
+  ASSERT_THAT(cache.Call(&sandbox, kSums, &ret, {same_params.PtrBoth()}),
+              IsOk());
+  EXPECT_THAT(same_params.data().ret, Eq(3));
+  EXPECT_THAT(sumarr({2, 2, 5}), StatusIs(absl::StatusCode::kUnavailable));
+}
+
+TEST(SandboxTest, SendMultipleFDs) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  int local_fds[3];
+  for (int& fd : local_fds) {
+    fd = open("/proc/self/exe", O_RDONLY);
+    ASSERT_THAT(fd, Ge(0));
+  }
+  std::vector<int> remote_fds;
+  ASSERT_THAT(sandbox.rpc_channel()->SendFDs(local_fds, &remote_fds), IsOk());
+  ASSERT_THAT(remote_fds.size(), Eq(3));
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_THAT(remote_fds[i], Ge(0));
+    EXPECT_THAT(sandbox.rpc_channel()->Close(remote_fds[i]), IsOk());
+    close(local_fds[i]);
+  }
+}
+
 // Make sure we can recover from a dying sandbox.
 TEST(SandboxTest, RestartSandboxAfterCrash) {
   SumSandbox sandbox;
@@ -253,6 +685,712 @@ TEST(SandboxTest, RestartSandboxAfterViolation) {
   EXPECT_THAT(result, Eq(3));
 }
 
+class SharedMemorySumSandbox : public SumSandbox {
+ private:
+  size_t GetSharedMemoryRingSize() const override { return 4096; }
+};
+
+TEST(SandboxTest, SharedMemoryTransport) {
+  SharedMemorySumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  EXPECT_TRUE(sandbox.comms()->IsUsingSharedMemory());
+  SumApi api(&sandbox);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+
+  // Transfers larger than the ring buffers still work, and so does passing
+  // file descriptors.
+  std::vector<int> data(10000, 1);
+  v::Array<int> array(data.data(), data.size());
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                            api.sumarr(array.PtrBefore(), data.size()));
+  EXPECT_THAT(sum, Eq(10000));
+  LeakFileDescriptor(&sandbox, "/proc/self/exe");
+
+  // The transport is set up again after a restart.
+  ASSERT_THAT(sandbox.Restart(false), IsOk());
+  EXPECT_TRUE(sandbox.comms()->IsUsingSharedMemory());
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api.sum(3, 4));
+  EXPECT_THAT(result, Eq(7));
+}
+
+class CommsTransferSumSandbox : public SumSandbox {
+ private:
+  bool TransferOverComms() const override { return true; }
+};
+
+TEST(SandboxTest, TransfersOverComms) {
+  CommsTransferSumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  // Large enough to need several chunks.
+  std::vector<int> data(300000, 1);
+  v::Array<int> array(data.data(), data.size());
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                            api.sumarr(array.PtrBefore(), data.size()));
+  EXPECT_THAT(sum, Eq(300000));
+
+  void* addr;
+  ASSERT_THAT(sandbox.Symbol("sumsymbol", &addr), IsOk());
+  v::Int sumsymbol;
+  sumsymbol.SetRemote(addr);
+  ASSERT_THAT(sandbox.TransferFromSandboxee(&sumsymbol), IsOk());
+  EXPECT_THAT(sumsymbol.GetValue(), Eq(5));
+  sumsymbol.SetValue(7);
+  ASSERT_THAT(sandbox.TransferToSandboxee(&sumsymbol), IsOk());
+  sumsymbol.SetValue(0);
+  ASSERT_THAT(sandbox.TransferFromSandboxee(&sumsymbol), IsOk());
+  EXPECT_THAT(sumsymbol.GetValue(), Eq(7));
+}
+
+class ThreadedSumSandbox : public SumSandbox {
+ private:
+  int GetNumCallChannels() const override { return 4; }
+
+  std::unique_ptr<sandbox2::Policy> ModifyPolicy(
+      sandbox2::PolicyBuilder* builder) override {
+    // Needed to start threads.
+    builder->AllowFork().AllowSyscalls(
+        {__NR_mprotect, __NR_madvise, __NR_set_robust_list});
+#ifdef __NR_rseq
+    builder->AllowSyscall(__NR_rseq);
+#endif
+#ifdef __NR_clone3
+    // Makes glibc fall back to clone().
+    builder->BlockSyscallWithErrno(__NR_clone3, ENOSYS);
+#endif
+    return builder->BuildOrDie();
+  }
+};
+
+TEST(SandboxTest, CallChannels) {
+  ThreadedSumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  // The calls run concurrently in the sandboxee.
+  const absl::Time start = absl::Now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&api] { EXPECT_THAT(api.sleep_for_sec(1), IsOk()); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_THAT(absl::Now() - start, Lt(absl::Seconds(3)));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+  ASSERT_THAT(sandbox.Restart(false), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api.sum(3, 4));
+  EXPECT_THAT(result, Eq(7));
+}
+
+class ResettableSumSandbox : public SumSandbox {
+ public:
+  absl::Status reinitialize_status = absl::OkStatus();
+
+ private:
+  absl::Status Reinitialize() override { return reinitialize_status; }
+};
+
+TEST(SandboxTest, Reset) {
+  ResettableSumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  const int pid = sandbox.pid();
+
+  // The sandboxee keeps running.
+  ASSERT_THAT(sandbox.Reset(), IsOk());
+  EXPECT_THAT(sandbox.pid(), Eq(pid));
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+
+  // It is restarted if it uses too much memory, or cannot be reinitialized.
+  ASSERT_THAT(sandbox.Reset(/*max_resident_bytes=*/1), IsOk());
+  EXPECT_THAT(sandbox.pid(), Ne(pid));
+  sandbox.reinitialize_status = absl::InternalError("reinitialize failed");
+  const int restarted_pid = sandbox.pid();
+  ASSERT_THAT(sandbox.Reset(), IsOk());
+  EXPECT_THAT(sandbox.pid(), Ne(restarted_pid));
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api.sum(3, 4));
+  EXPECT_THAT(result, Eq(7));
+}
+
+class SharedForkServerSumSandbox : public SumSandbox {
+ private:
+  bool ShareForkServer() const override { return true; }
+};
+
+TEST(SandboxTest, SharedForkServer) {
+  auto first = std::make_unique<SharedForkServerSumSandbox>();
+  SharedForkServerSumSandbox second;
+  ASSERT_THAT(first->Init(), IsOk());
+  ASSERT_THAT(second.Init(), IsOk());
+  EXPECT_THAT(first->pid(), Ne(second.pid()));
+
+  // The sandboxes are independent of each other, and of the sandbox that
+  // started the forkserver.
+  first.reset();
+  SumApi api(&second);
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+  ASSERT_THAT(second.Restart(false), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(result, api.sum(3, 4));
+  EXPECT_THAT(result, Eq(7));
+
+  SharedForkServerSumSandbox third;
+  ASSERT_THAT(third.Init(), IsOk());
+  SumApi third_api(&third);
+  SAPI_ASSERT_OK_AND_ASSIGN(result, third_api.sum(5, 6));
+  EXPECT_THAT(result, Eq(11));
+}
+
+TEST(SandboxTest, FusedTransfers) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  // The array is allocated and filled in a single round trip.
+  std::vector<int> data = {1, 2, 3, 4};
+  v::Array<int> array(data.data(), data.size());
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(array.PtrBefore(), 4));
+  EXPECT_THAT(sum, Eq(10));
+  ASSERT_THAT(array.GetRemote(), NotNull());
+
+  // Read back the data and free the remote copy at once.
+  data.assign(4, 0);
+  ASSERT_THAT(sandbox.TransferFromSandboxeeAndFree(&array), IsOk());
+  EXPECT_THAT(data, ElementsAre(1, 2, 3, 4));
+  EXPECT_THAT(array.GetRemote(), IsNull());
+
+  // Deferred frees are sent along with later messages.
+  for (int i = 0; i < 1000; ++i) {
+    v::Array<int> temp(data.data(), data.size());
+    SAPI_ASSERT_OK_AND_ASSIGN(sum, api.sumarr(temp.PtrBefore(), 4));
+    EXPECT_THAT(sum, Eq(10));
+  }
+}
+
+TEST(SandboxTest, RemoteArrayStaysInSandboxee) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data = {1, 2, 3, 4};
+  v::Array<int> array(data.data(), data.size());
+  ASSERT_THAT(sandbox.Allocate(&array, /*automatic_free=*/false), IsOk());
+  ASSERT_THAT(sandbox.TransferToSandboxee(&array), IsOk());
+
+  // The handle takes over the memory, no sync type makes it transfer data.
+  v::RemoteArray<int> remote(&sandbox, array.GetRemote(), data.size(),
+                             v::RemoteHandle::FreeWithFree(&sandbox));
+  data.assign(4, 0);
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                            api.sumarr(remote.PtrBoth(), remote.count()));
+  EXPECT_THAT(sum, Eq(10));
+  SAPI_ASSERT_OK_AND_ASSIGN(std::vector<int> fetched, remote.Fetch());
+  EXPECT_THAT(fetched, ElementsAre(1, 2, 3, 4));
+  EXPECT_THAT(data, ElementsAre(0, 0, 0, 0));
+}
+
+struct GraphNode {
+  int* values;
+  size_t num_values;
+};
+
+struct Graph {
+  GraphNode* nodes;
+  size_t num_nodes;
+  GraphNode* unused;
+};
+
+TEST(SandboxTest, DeepStructReadsNestedObjects) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+
+  // Builds a graph in the sandboxee: two nodes with two and three values.
+  std::vector<int> values1 = {1, 2};
+  std::vector<int> values2 = {3, 4, 5};
+  v::Array<int> array1(values1.data(), values1.size());
+  v::Array<int> array2(values2.data(), values2.size());
+  ASSERT_THAT(sandbox.Allocate(&array1, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.Allocate(&array2, /*automatic_free=*/true), IsOk());
+  std::vector<GraphNode> nodes = {
+      {static_cast<int*>(array1.GetRemote()), values1.size()},
+      {static_cast<int*>(array2.GetRemote()), values2.size()}};
+  v::Array<GraphNode> node_array(nodes.data(), nodes.size());
+  ASSERT_THAT(sandbox.Allocate(&node_array, /*automatic_free=*/true), IsOk());
+  v::Struct<Graph> remote_graph(
+      Graph{static_cast<GraphNode*>(node_array.GetRemote()), nodes.size(),
+            nullptr});
+  ASSERT_THAT(sandbox.Allocate(&remote_graph, /*automatic_free=*/true),
+              IsOk());
+  ASSERT_THAT(sandbox.TransferToSandboxee(
+                  {&array1, &array2, &node_array, &remote_graph}),
+              IsOk());
+
+  v::DeepStruct<Graph> graph(
+      {v::Follow<GraphNode, Graph>(
+           offsetof(Graph, nodes),
+           [](const Graph& graph) { return graph.num_nodes; },
+           {v::Follow<int, GraphNode>(
+               offsetof(GraphNode, values),
+               [](const GraphNode& node) { return node.num_values; })}),
+       v::Follow<GraphNode>(offsetof(Graph, unused))});
+  graph.SetRemote(remote_graph.GetRemote());
+  ASSERT_THAT(sandbox.TransferFromSandboxee(&graph), IsOk());
+  ASSERT_THAT(graph.data().num_nodes, Eq(2));
+  EXPECT_THAT(graph.data().unused, IsNull());
+  const GraphNode* fetched = graph.data().nodes;
+  EXPECT_THAT(std::vector<int>(fetched[0].values, fetched[0].values + 2),
+              ElementsAre(1, 2));
+  EXPECT_THAT(std::vector<int>(fetched[1].values, fetched[1].values + 3),
+              ElementsAre(3, 4, 5));
+
+  // Writing the graph back keeps the remote pointers.
+  graph.mutable_data()->num_nodes = 1;
+  ASSERT_THAT(sandbox.TransferToSandboxee(&graph), IsOk());
+  ASSERT_THAT(sandbox.TransferFromSandboxee(&remote_graph), IsOk());
+  EXPECT_THAT(remote_graph.data().nodes, Eq(node_array.GetRemote()));
+  EXPECT_THAT(remote_graph.data().num_nodes, Eq(1));
+  EXPECT_THAT(graph.data().nodes, Eq(fetched));
+
+  // The size limit applies to all nested objects.
+  v::DeepStruct<Graph> limited(
+      {v::Follow<GraphNode, Graph>(
+          offsetof(Graph, nodes),
+          [](const Graph& graph) { return graph.num_nodes; })},
+      /*max_bytes=*/sizeof(GraphNode) / 2);
+  limited.SetRemote(remote_graph.GetRemote());
+  EXPECT_THAT(sandbox.TransferFromSandboxee(&limited),
+              StatusIs(absl::StatusCode::kResourceExhausted));
+}
+
+TEST(SandboxTest, FlatMessageIsUsedInPlace) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  v::Flat<SumFlatParams> params(1, 2, 3);
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumflat(params.PtrBoth()));
+  EXPECT_THAT(sum, Eq(6));
+  EXPECT_THAT(params.message().sum, Eq(6));
+
+  params.mutable_message()->c = 10;
+  SAPI_ASSERT_OK_AND_ASSIGN(sum, api.sumflat(params.PtrBoth()));
+  EXPECT_THAT(sum, Eq(13));
+}
+
+TEST(FlatMessageTest, ToleratesOlderWriters) {
+  // Written with a SumFlatParams that had no `c` and `sum` yet.
+  FlatMessage<SumFlatParams> message = {{kFlatMessageMagic, 2 * sizeof(int)},
+                                        {1, 2, 99, 0}};
+  FlatMessageView<SumFlatParams> view(&message);
+  ASSERT_TRUE(view.ok());
+  EXPECT_THAT(view.Get(&SumFlatParams::b), Eq(2));
+  EXPECT_THAT(view.Get(&SumFlatParams::c, /*default_value=*/7), Eq(7));
+  EXPECT_FALSE(view.Set(&SumFlatParams::sum, 1));
+  EXPECT_THAT(view.payload(), IsNull());
+
+  message.header.magic = 0;
+  EXPECT_FALSE(view.ok());
+}
+
+TEST(SandboxTest, VectoredTransfers) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data1 = {1, 2, 3};
+  std::vector<int> data2 = {4, 5, 6};
+  v::Array<int> array1(data1.data(), data1.size());
+  v::Array<int> array2(data2.data(), data2.size());
+  v::Int value(7);
+  ASSERT_THAT(sandbox.Allocate(&array1, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.Allocate(&array2, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.Allocate(&value, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.TransferToSandboxee({&array1, &array2, &value}), IsOk());
+
+  // The sandboxee sees the transferred data.
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(array1.PtrNone(), 3));
+  EXPECT_THAT(sum, Eq(6));
+  SAPI_ASSERT_OK_AND_ASSIGN(sum, api.sumarr(array2.PtrNone(), 3));
+  EXPECT_THAT(sum, Eq(15));
+
+  data1.assign(3, 0);
+  data2.assign(3, 0);
+  value.SetValue(0);
+  ASSERT_THAT(sandbox.TransferFromSandboxee({&array1, &array2, &value}),
+              IsOk());
+  EXPECT_THAT(data1, ElementsAre(1, 2, 3));
+  EXPECT_THAT(data2, ElementsAre(4, 5, 6));
+  EXPECT_THAT(value.GetValue(), Eq(7));
+
+  // Vars that aren't allocated are reported.
+  v::Int unallocated;
+  EXPECT_THAT(sandbox.TransferToSandboxee({&array1, &unallocated}),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(SandboxTest, TrackModifications) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data = {1, 2, 3};
+  v::Array<int> array(data.data(), data.size());
+  array.SetTrackModifications(true);
+  ASSERT_THAT(sandbox.Allocate(&array, /*automatic_free=*/true), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(array.PtrBefore(), 3));
+  EXPECT_THAT(sum, Eq(6));
+
+  // Writes to the buffer are not detected, the sandboxee keeps the old data.
+  data[0] = 4;
+  SAPI_ASSERT_OK_AND_ASSIGN(sum, api.sumarr(array.PtrBefore(), 3));
+  EXPECT_THAT(sum, Eq(6));
+
+  array.MarkModified();
+  SAPI_ASSERT_OK_AND_ASSIGN(sum, api.sumarr(array.PtrBefore(), 3));
+  EXPECT_THAT(sum, Eq(9));
+
+  // Setters are detected.
+  v::Int value(1);
+  value.SetTrackModifications(true);
+  ASSERT_THAT(sandbox.Allocate(&value, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.TransferToSandboxee(&value), IsOk());
+  value.SetValue(2);
+  ASSERT_THAT(sandbox.TransferToSandboxee(&value), IsOk());
+  value.SetValue(0);
+  ASSERT_THAT(sandbox.TransferFromSandboxee(&value), IsOk());
+  EXPECT_THAT(value.GetValue(), Eq(2));
+}
+
+class SharedArraySumSandbox : public SumSandbox {
+ public:
+  bool UseSharedArrays() const override { return true; }
+};
+
+TEST(SandboxTest, SharedArray) {
+  SharedArraySumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  v::SharedArray<int> array(4);
+  for (int i = 0; i < 4; ++i) {
+    array[i] = i + 1;
+  }
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(array.PtrBefore(), 4));
+  EXPECT_THAT(sum, Eq(10));
+  EXPECT_THAT(array.GetRemote(), NotNull());
+
+  // Changes are visible to the sandboxee without any transfer.
+  array[0] = 5;
+  SAPI_ASSERT_OK_AND_ASSIGN(sum, api.sumarr(array.PtrNone(), 4));
+  EXPECT_THAT(sum, Eq(14));
+}
+
+TEST(SandboxTest, MappedFile) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  int fd = memfd_create("mapped_file", MFD_CLOEXEC);
+  ASSERT_THAT(fd, Ge(0));
+  const int data[] = {1, 2, 3, 4};
+  ASSERT_THAT(write(fd, data, sizeof(data)), Eq(ssize_t{sizeof(data)}));
+  SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<v::MappedFile> file,
+                            v::MappedFile::Create(fd));
+  EXPECT_THAT(file->GetSize(), Eq(sizeof(data)));
+  EXPECT_THAT(file->GetData()[0], Eq(1));
+
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(file->PtrBefore(), 4));
+  EXPECT_THAT(sum, Eq(10));
+  EXPECT_THAT(file->GetLenValStruct().data, Eq(file->GetRemote()));
+
+  // The sandboxee sees changes to the file without any transfer.
+  const int five = 5;
+  ASSERT_THAT(pwrite(fd, &five, sizeof(five), 0), Eq(ssize_t{sizeof(five)}));
+  SAPI_ASSERT_OK_AND_ASSIGN(sum, api.sumarr(file->PtrNone(), 4));
+  EXPECT_THAT(sum, Eq(14));
+  close(fd);
+}
+
+TEST(SandboxTest, MappedFileRejectsEmptyFiles) {
+  int fd = memfd_create("mapped_file", MFD_CLOEXEC);
+  ASSERT_THAT(fd, Ge(0));
+  EXPECT_THAT(v::MappedFile::Create(fd),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  close(fd);
+}
+
+class LazyArraySumSandbox : public SumSandbox {
+ public:
+  bool UseLazyArrays() const override { return true; }
+};
+
+TEST(SandboxTest, LazyArrayIsCopiedWithoutOptIn) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data(1 << 10, 1);
+  v::LazyArray array(data.data(), data.size() * sizeof(int));
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                            api.sumarr(array.PtrBefore(), data.size()));
+  EXPECT_THAT(sum, Eq(static_cast<int>(data.size())));
+  EXPECT_FALSE(array.is_lazy());
+}
+
+TEST(SandboxTest, LazyArrayCopiesOnlyPagesRead) {
+  LazyArraySumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  // Not a multiple of the page size, so that the last page is partial.
+  std::vector<int> data((1 << 18) + 3);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = i % 7;
+  }
+  v::LazyArray array(data.data(), data.size() * sizeof(int));
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(array.PtrBefore(), 4));
+  EXPECT_THAT(sum, Eq(0 + 1 + 2 + 3));
+  if (!array.is_lazy()) {
+    GTEST_SKIP() << "userfaultfd not available, the array was copied";
+  }
+  EXPECT_THAT(array.pages_copied(), Eq(1));
+
+  // Prefetching skips the page copied already.
+  ASSERT_THAT(array.Prefetch(0, array.GetSize()), IsOk());
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  EXPECT_THAT(array.pages_copied(),
+              Eq((array.GetSize() + page_size - 1) / page_size));
+  int expected = 0;
+  for (int value : data) {
+    expected += value;
+  }
+  SAPI_ASSERT_OK_AND_ASSIGN(sum,
+                            api.sumarr(array.PtrNone(), data.size()));
+  EXPECT_THAT(sum, Eq(expected));
+}
+
+TEST(SandboxTest, LazyArrayReadsAhead) {
+  LazyArraySumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data(1 << 16, 1);
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  v::LazyArray array(data.data(), data.size() * sizeof(int),
+                     /*readahead=*/4 * page_size);
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                            api.sumarr(array.PtrBefore(), data.size()));
+  EXPECT_THAT(sum, Eq(static_cast<int>(data.size())));
+  if (array.is_lazy()) {
+    EXPECT_THAT(array.pages_copied(), Eq(array.GetSize() / page_size));
+  }
+  EXPECT_THAT(array.Prefetch(array.GetSize(), 1),
+              StatusIs(absl::StatusCode::kOutOfRange));
+}
+
+TEST(SandboxTest, SharedDataIsMappedIntoSeveralSandboxees) {
+  const int data[] = {1, 2, 3, 4};
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::shared_ptr<const v::SharedData> shared,
+      v::SharedData::Create(absl::MakeConstSpan(
+          reinterpret_cast<const uint8_t*>(data), sizeof(data))));
+  EXPECT_THAT(shared->size(), Eq(sizeof(data)));
+  // Sealed, not even the host can change it anymore.
+  EXPECT_THAT(pwrite(shared->fd(), data, sizeof(int), 0), Eq(-1));
+
+  for (int i = 0; i < 2; ++i) {
+    SumSandbox sandbox;
+    ASSERT_THAT(sandbox.Init(), IsOk());
+    SumApi api(&sandbox);
+    SAPI_ASSERT_OK_AND_ASSIGN(std::unique_ptr<v::MappedFile> mapped,
+                              shared->Map());
+    SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(mapped->PtrBefore(), 4));
+    EXPECT_THAT(sum, Eq(10));
+  }
+}
+
+TEST(SandboxTest, RestartsOnMemoryGrowth) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  EXPECT_THAT(sandbox.initial_memory_usage().resident_bytes, Gt(0));
+  SAPI_ASSERT_OK_AND_ASSIGN(Sandbox::MemoryUsage usage,
+                            sandbox.GetMemoryUsage());
+  EXPECT_THAT(usage.heap_bytes, Ge(sandbox.initial_memory_usage().heap_bytes));
+
+  constexpr MemoryGrowthLimits kLimits = {.heap_bytes = 1 << 20};
+  SAPI_ASSERT_OK_AND_ASSIGN(bool restarted,
+                            sandbox.RestartIfMemoryGrew(kLimits));
+  EXPECT_FALSE(restarted);
+
+  // Leak some memory in the sandboxee.
+  const pid_t pid = sandbox.pid();
+  v::Array<uint8_t> leaked(4 << 20);
+  ASSERT_THAT(sandbox.Allocate(&leaked), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(bool exceeds, sandbox.ExceedsMemoryGrowth(kLimits));
+  EXPECT_TRUE(exceeds);
+  SAPI_ASSERT_OK_AND_ASSIGN(restarted, sandbox.RestartIfMemoryGrew(kLimits));
+  EXPECT_TRUE(restarted);
+  EXPECT_THAT(sandbox.pid(), Ne(pid));
+  SAPI_ASSERT_OK_AND_ASSIGN(exceeds, sandbox.ExceedsMemoryGrowth(kLimits));
+  EXPECT_FALSE(exceeds);
+}
+
+TEST(SandboxTest, RangedTransfers) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data = {1, 1, 1, 5};
+  v::Array<int> array(data.data(), data.size());
+  ASSERT_THAT(sandbox.Allocate(&array, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.TransferToSandboxee(&array), IsOk());
+
+  // Only the first two elements are sent.
+  data = {2, 2, 2, 2};
+  ASSERT_THAT(sandbox.TransferToSandboxee(&array, 0, 2 * sizeof(int)), IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum, api.sumarr(array.PtrNone(), 4));
+  EXPECT_THAT(sum, Eq(10));
+
+  data.assign(4, 0);
+  ASSERT_THAT(
+      sandbox.TransferFromSandboxee(&array, sizeof(int), 2 * sizeof(int)),
+      IsOk());
+  EXPECT_THAT(data, ElementsAre(0, 2, 1, 0));
+
+  EXPECT_THAT(
+      sandbox.TransferFromSandboxee(&array, sizeof(int), 4 * sizeof(int)),
+      StatusIs(absl::StatusCode::kOutOfRange));
+
+  // The return value of a call limits what is copied back: the sum of
+  // {2, 2, 2, 2} is 8 bytes, so only the first two elements come back.
+  data.assign(4, 2);
+  ASSERT_THAT(sandbox.TransferToSandboxee(&array), IsOk());
+  data.assign(4, 0);
+  v::Int ret;
+  v::ULong nelem(4);
+  array.SetValidLength(&ret);
+  ASSERT_THAT(sandbox.Call("sumarr", &ret, {array.PtrAfter(), &nelem}),
+              IsOk());
+  EXPECT_THAT(ret.GetValue(), Eq(8));
+  EXPECT_THAT(data, ElementsAre(2, 2, 0, 0));
+
+  // A negative length is an error, not an empty copy.
+  data = {-4, 0, 0, 0};
+  ASSERT_THAT(sandbox.TransferToSandboxee(&array), IsOk());
+  EXPECT_THAT(sandbox.Call("sumarr", &ret, {array.PtrAfter(), &nelem}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(SandboxTest, ParallelTransfers) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  // Large enough to be split between threads in both directions.
+  std::vector<int> data(4 * v::Var::kParallelTransferChunkSize / sizeof(int),
+                        1);
+  v::Array<int> array(data.data(), data.size());
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                            api.sumarr(array.PtrBefore(), data.size()));
+  EXPECT_THAT(sum, Eq(static_cast<int>(data.size())));
+
+  std::fill(data.begin(), data.end(), 2);
+  ASSERT_THAT(sandbox.TransferFromSandboxee(&array), IsOk());
+  EXPECT_TRUE(
+      std::all_of(data.begin(), data.end(), [](int v) { return v == 1; }));
+}
+
+class ArenaSumSandbox : public SumSandbox {
+ private:
+  size_t GetAllocationArenaSize() const override { return 4096; }
+};
+
+TEST(SandboxTest, AllocationArena) {
+  ArenaSumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data(100, 1);
+  v::Array<int> array1(data.data(), data.size());
+  v::Array<int> array2(data.data(), data.size());
+  ASSERT_THAT(sandbox.Allocate(&array1, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.Allocate(&array2, /*automatic_free=*/true), IsOk());
+  // Both come from the arena, one after the other.
+  EXPECT_THAT(reinterpret_cast<uintptr_t>(array2.GetRemote()) -
+                  reinterpret_cast<uintptr_t>(array1.GetRemote()),
+              Eq(data.size() * sizeof(int)));
+  SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                            api.sumarr(array2.PtrBefore(), data.size()));
+  EXPECT_THAT(sum, Eq(100));
+
+  // Allocations that don't fit anymore are served by the sandboxee.
+  std::vector<int> large_data(10000, 1);
+  v::Array<int> large_array(large_data.data(), large_data.size());
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      sum, api.sumarr(large_array.PtrBefore(), large_data.size()));
+  EXPECT_THAT(sum, Eq(10000));
+
+  // After a reset, the arena is reused from the start.
+  sandbox.ResetAllocationArena();
+  v::Array<int> array3(data.data(), data.size());
+  ASSERT_THAT(sandbox.Allocate(&array3), IsOk());
+  EXPECT_THAT(array3.GetRemote(), Eq(array1.GetRemote()));
+
+  // Zero-length allocations get addresses of their own.
+  v::Array<int> empty1(data.data(), 0);
+  v::Array<int> empty2(data.data(), 0);
+  ASSERT_THAT(sandbox.Allocate(&empty1, /*automatic_free=*/true), IsOk());
+  ASSERT_THAT(sandbox.Allocate(&empty2, /*automatic_free=*/true), IsOk());
+  EXPECT_THAT(empty1.GetRemote(), NotNull());
+  EXPECT_THAT(empty2.GetRemote(), Ne(empty1.GetRemote()));
+}
+
+TEST(SandboxTest, ZeroLengthAllocation) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  int data = 0;
+  v::Array<int> empty(&data, 0);
+  ASSERT_THAT(sandbox.Allocate(&empty), IsOk());
+  EXPECT_THAT(empty.GetRemote(), NotNull());
+  EXPECT_THAT(sandbox.Free(&empty), IsOk());
+}
+
+class ProfiledSumSandbox : public SumSandbox {
+ private:
+  int GetCallProfilingInterval() const override { return 2; }
+};
+
+TEST(SandboxTest, CallProfile) {
+  ProfiledSumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::vector<int> data(100, 1);
+  for (int i = 0; i < 4; ++i) {
+    v::Array<int> array(data.data(), data.size());
+    SAPI_ASSERT_OK_AND_ASSIGN(int sum,
+                              api.sumarr(array.PtrBefore(), data.size()));
+    EXPECT_THAT(sum, Eq(100));
+  }
+
+  // Every other call was profiled.
+  absl::flat_hash_map<std::string, CallStats> profile =
+      sandbox.GetCallProfile();
+  ASSERT_THAT(profile, Contains(Key("sumarr")));
+  const CallStats& stats = profile["sumarr"];
+  EXPECT_THAT(stats.samples, Eq(2));
+  EXPECT_THAT(stats.bytes_to_sandboxee, Eq(2 * data.size() * sizeof(int)));
+  EXPECT_THAT(stats.bytes_from_sandboxee, Eq(0));
+  EXPECT_THAT(stats.execution, Gt(absl::ZeroDuration()));
+  EXPECT_THAT(sandbox.GetCallProfileReport(), HasSubstr("sumarr"));
+}
+
 TEST(SandboxTest, NoRaceInAwaitResult) {
   StringopSandbox sandbox;
   ASSERT_THAT(sandbox.Init(), IsOk());
@@ -279,5 +1417,286 @@ TEST(SandboxTest, NoRaceInConcurrentTerminate) {
   EXPECT_THAT(result.final_status(), Eq(sandbox2::Result::EXTERNAL_KILL));
 }
 
+TEST(SandboxTest, CallTimeLimitInterruptsCall) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+  sandbox.SetCallTimeLimit(absl::Milliseconds(200));
+
+  // sleep() returns early with EINTR, the sandbox survives the call.
+  absl::Time start = absl::Now();
+  EXPECT_THAT(api.sleep_for_sec(10),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_THAT(absl::Now() - start, Lt(absl::Seconds(5)));
+  EXPECT_TRUE(sandbox.is_active());
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+
+  sandbox.SetCallTimeLimit(absl::ZeroDuration());
+  EXPECT_THAT(api.sleep_for_sec(1), IsOk());
+}
+
+TEST(SandboxPoolTest, HandsOutInitializedSandboxes) {
+  SandboxPool<SumSandbox> pool({.size = 2});
+  SAPI_ASSERT_OK_AND_ASSIGN(auto lease, pool.Acquire());
+  {
+    SAPI_ASSERT_OK_AND_ASSIGN(auto other_lease, pool.Acquire());
+    EXPECT_THAT(other_lease->pid(), Ne(lease->pid()));
+
+    // Crashed sandboxes don't go back to the pool.
+    SumApi api(other_lease.get());
+    EXPECT_THAT(api.crash(), StatusIs(absl::StatusCode::kUnavailable));
+  }
+
+  SumApi api(lease.get());
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+  for (int i = 0; i < 3; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(auto other_lease, pool.Acquire());
+    EXPECT_TRUE(other_lease->is_active());
+    SumApi other_api(other_lease.get());
+    SAPI_ASSERT_OK_AND_ASSIGN(result, other_api.sum(2, 3));
+    EXPECT_THAT(result, Eq(5));
+  }
+}
+
+TEST(SandboxPoolTest, EmptyPoolWaitsForSandbox) {
+  SandboxPool<SumSandbox> pool({.size = 0});
+  for (int i = 0; i < 2; ++i) {
+    // Initialized for the caller, and not kept once returned.
+    SAPI_ASSERT_OK_AND_ASSIGN(auto lease, pool.Acquire());
+    SumApi api(lease.get());
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(i, 2));
+    EXPECT_THAT(result, Eq(i + 2));
+  }
+  EXPECT_THAT(pool.ready(), Eq(0));
+  EXPECT_THAT(pool.TryAcquire(), StatusIs(absl::StatusCode::kUnavailable));
+}
+
+TEST(SandboxPoolTest, FreezesIdleSandboxes) {
+  SandboxPool<SumSandbox> pool(
+      {.size = 1, .freeze_after_idle = absl::Milliseconds(50)});
+  auto await_frozen = [&pool] {
+    absl::Time deadline = absl::Now() + absl::Seconds(10);
+    while (pool.frozen() == 0 && absl::Now() < deadline) {
+      absl::SleepFor(absl::Milliseconds(10));
+    }
+    return pool.frozen();
+  };
+  for (int i = 0; i < 2; ++i) {
+    // Frozen once idle, and thawed when leased.
+    ASSERT_THAT(await_frozen(), Eq(1));
+    SAPI_ASSERT_OK_AND_ASSIGN(auto lease, pool.Acquire());
+    EXPECT_THAT(pool.frozen(), Eq(0));
+    SumApi api(lease.get());
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(i, 2));
+    EXPECT_THAT(result, Eq(i + 2));
+  }
+}
+
+std::string Pattern(int size) {
+  std::string pattern(size, '\0');
+  for (int i = 0; i < size; ++i) {
+    pattern[i] = 'a' + i % 26;
+  }
+  return pattern;
+}
+
+TEST(OutputChannelTest, StreamsWritesToCallback) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  std::string output;
+  int chunks = 0;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<OutputChannel> channel,
+      OutputChannel::Create(
+          &sandbox,
+          [&](absl::Span<const uint8_t> data) {
+            output.append(data.begin(), data.end());
+            ++chunks;
+            return absl::OkStatus();
+          },
+          /*buffer_size=*/4096));
+  // More than fits into the socket buffer, so the host must read meanwhile.
+  constexpr int kSize = 1 << 20;
+  SAPI_ASSERT_OK_AND_ASSIGN(int written,
+                            api.write_pattern(channel->remote_fd(), kSize));
+  EXPECT_THAT(written, Eq(kSize));
+  EXPECT_THAT(channel->Finish(), IsOk());
+  EXPECT_THAT(output, Eq(Pattern(kSize)));
+  EXPECT_THAT(chunks, Gt(1));
+
+  // The sandboxee is still usable.
+  SAPI_ASSERT_OK_AND_ASSIGN(int result, api.sum(1, 2));
+  EXPECT_THAT(result, Eq(3));
+}
+
+TEST(OutputChannelTest, ReturnsCallbackError) {
+  SumSandbox sandbox;
+  ASSERT_THAT(sandbox.Init(), IsOk());
+  SumApi api(&sandbox);
+
+  int calls = 0;
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<OutputChannel> channel,
+      OutputChannel::Create(&sandbox, [&](absl::Span<const uint8_t>) {
+        ++calls;
+        return absl::CancelledError("stop");
+      }));
+  // The rest of the output is drained, so the write doesn't block.
+  SAPI_ASSERT_OK_AND_ASSIGN(int written,
+                            api.write_pattern(channel->remote_fd(), 1 << 20));
+  EXPECT_THAT(written, Eq(1 << 20));
+  EXPECT_THAT(channel->Finish(), StatusIs(absl::StatusCode::kCancelled));
+  EXPECT_THAT(calls, Eq(1));
+}
+
+TEST(TransactionExecutorTest, RunsTransactionsFromManyThreads) {
+  TransactionExecutor<SumSandbox> executor({.num_sandboxes = 2});
+  std::vector<std::thread> threads;
+  constexpr int kTransactions = 8;
+  std::vector<int> results(kTransactions);
+  for (int i = 0; i < kTransactions; ++i) {
+    threads.emplace_back([&executor, &results, i] {
+      absl::Status status = executor.Run([&results, i](SumSandbox* sandbox) {
+        SumApi api(sandbox);
+        SAPI_ASSIGN_OR_RETURN(results[i], api.sum(i, 1));
+        return absl::OkStatus();
+      });
+      EXPECT_THAT(status, IsOk());
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < kTransactions; ++i) {
+    EXPECT_THAT(results[i], Eq(i + 1));
+  }
+
+  // Failing transactions are retried on a restarted sandbox.
+  int tries = 0;
+  std::future<absl::Status> failed = executor.Submit([&tries](SumSandbox*) {
+    ++tries;
+    return absl::InternalError("transaction failed");
+  });
+  EXPECT_THAT(failed.get(), StatusIs(absl::StatusCode::kInternal));
+  EXPECT_THAT(tries, Eq(2));
+}
+
+TEST(TransactionExecutorTest, RoutesKeysToTheSameSandbox) {
+  TransactionExecutor<SumSandbox> executor(
+      {.num_sandboxes = 4, .max_affinity_imbalance = 0});
+  auto get_pid = [&executor](absl::string_view key) {
+    pid_t pid = -1;
+    EXPECT_THAT(executor.Run(key,
+                             [&pid](SumSandbox* sandbox) {
+                               pid = sandbox->pid();
+                               return absl::OkStatus();
+                             }),
+                IsOk());
+    return pid;
+  };
+  const pid_t pid = get_pid("en_US");
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_THAT(get_pid("en_US"), Eq(pid));
+  }
+
+  // Goes to another sandbox while the one for the key is busy.
+  std::promise<void> release;
+  std::future<absl::Status> busy = executor.Submit(
+      "en_US", [released = release.get_future().share()](SumSandbox*) {
+        released.wait();
+        return absl::OkStatus();
+      });
+  EXPECT_THAT(get_pid("en_US"), Ne(pid));
+  release.set_value();
+  EXPECT_THAT(busy.get(), IsOk());
+}
+
+TEST(HedgedRunTest, SecondTryWinsOverSlowOne) {
+  SandboxPool<SumSandbox> pool({.size = 2});
+  HedgePolicy policy({.min_samples = 4, .min_delay = absl::Milliseconds(200)});
+  auto sum = [](SumSandbox* sandbox) {
+    SumApi api(sandbox);
+    return api.sum(1, 2);
+  };
+  // Not hedged before enough run times were recorded.
+  EXPECT_THAT(policy.HedgeDelay(), Eq(absl::InfiniteDuration()));
+  for (int i = 0; i < 4; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, HedgedRun(pool, sum, policy));
+    EXPECT_THAT(result, Eq(3));
+  }
+  EXPECT_THAT(policy.HedgeDelay(), Eq(absl::Milliseconds(200)));
+
+  std::atomic<int> tries = 0;
+  absl::Time start = absl::Now();
+  SAPI_ASSERT_OK_AND_ASSIGN(
+      int result,
+      HedgedRun(
+          pool,
+          [&tries](SumSandbox* sandbox) -> absl::StatusOr<int> {
+            SumApi api(sandbox);
+            // The first try is slow, and is cancelled once the second one
+            // succeeded.
+            if (tries++ == 0) {
+              SAPI_RETURN_IF_ERROR(api.sleep_for_sec(10));
+            }
+            return api.sum(1, 2);
+          },
+          policy));
+  EXPECT_THAT(result, Eq(3));
+  EXPECT_THAT(absl::Now() - start, Lt(absl::Seconds(5)));
+  EXPECT_THAT(tries, Eq(2));
+  HedgeStats stats = policy.stats();
+  EXPECT_THAT(stats.runs, Eq(5));
+  EXPECT_THAT(stats.hedges, Eq(1));
+  EXPECT_THAT(stats.hedge_wins, Eq(1));
+}
+
+TEST(ParallelMapTest, ReturnsResultsInOrder) {
+  SandboxPool<SumSandbox> pool({.size = 2});
+  constexpr int kItems = 16;
+  std::vector<int> inputs(kItems);
+  for (int i = 0; i < kItems; ++i) {
+    inputs[i] = i;
+  }
+  std::atomic<bool> crashed = false;
+  std::vector<ParallelMapItemStats> stats;
+  std::vector<absl::StatusOr<int>> results = ParallelMap(
+      pool, absl::MakeConstSpan(inputs),
+      [&crashed](SumSandbox* sandbox, const int& input) -> absl::StatusOr<int> {
+        SumApi api(sandbox);
+        // The first try of one item crashes its sandbox.
+        if (input == 5 && !crashed.exchange(true)) {
+          SAPI_RETURN_IF_ERROR(api.crash());
+        }
+        return api.sum(input, 1);
+      },
+      {.concurrency = 3, .retry_count = 1}, &stats);
+  ASSERT_THAT(results.size(), Eq(inputs.size()));
+  ASSERT_THAT(stats.size(), Eq(inputs.size()));
+  for (int i = 0; i < kItems; ++i) {
+    SAPI_ASSERT_OK_AND_ASSIGN(int result, results[i]);
+    EXPECT_THAT(result, Eq(i + 1));
+    EXPECT_THAT(stats[i].tries, Eq(i == 5 ? 2 : 1));
+  }
+
+  // Without retries, a failing item only fails its own result.
+  std::vector<absl::Status> statuses = ParallelMap(
+      pool, absl::MakeConstSpan(inputs),
+      [](SumSandbox* sandbox, const int& input) {
+        SumApi api(sandbox);
+        return input == 3 ? api.crash() : api.sum(input, 1).status();
+      },
+      {.concurrency = 2});
+  ASSERT_THAT(statuses.size(), Eq(kItems));
+  for (int i = 0; i < kItems; ++i) {
+    EXPECT_THAT(statuses[i].code(), Eq(i == 3 ? absl::StatusCode::kUnavailable
+                                              : absl::StatusCode::kOk));
+  }
+}
+
 }  // namespace
 }  // namespace sapi
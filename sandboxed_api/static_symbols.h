@@ -0,0 +1,41 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_STATIC_SYMBOLS_H_
+#define SANDBOXED_API_STATIC_SYMBOLS_H_
+
+// Symbol table of sandboxees linked as static-PIE binaries, in which dlsym()
+// cannot find the functions of the sandboxed library. sapi_library() and
+// add_sapi_library() generate it from their list of functions when building
+// a static sandboxee. In C, as the generated table is.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct SapiStaticSymbol {
+  const char* name;
+  void* address;
+};
+
+// Terminated by an entry with a null name. Weak, so that dynamically linked
+// sandboxees, which don't define it, look up symbols with dlsym() instead.
+extern const struct SapiStaticSymbol sapi_static_symbols[]
+    __attribute__((weak));
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#endif  // SANDBOXED_API_STATIC_SYMBOLS_H_
@@ -0,0 +1,113 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/tools/clang_generator/annotations.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+
+namespace sapi {
+namespace {
+
+// Results kept for memoized functions without an "entries=" option.
+constexpr size_t kDefaultMemoizedEntries = 1024;
+
+}  // namespace
+
+absl::StatusOr<Annotations> ParseAnnotations(absl::string_view contents) {
+  Annotations annotations;
+  int line_number = 0;
+  for (absl::string_view line : absl::StrSplit(contents, '\n')) {
+    ++line_number;
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || absl::StartsWith(line, "#")) {
+      continue;
+    }
+    auto error = [line_number](absl::string_view message) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("annotations:", line_number, ": ", message));
+    };
+    std::vector<absl::string_view> fields =
+        absl::StrSplit(line, absl::ByAnyChar(" \t"), absl::SkipEmpty());
+    // Parameter annotations always have a direction as third field.
+    if (fields.size() >= 2 && fields[1] == "memoize" &&
+        (fields.size() == 2 || (fields.size() == 3 &&
+                                absl::StartsWith(fields[2], "entries=")))) {
+      size_t entries = kDefaultMemoizedEntries;
+      if (fields.size() == 3 &&
+          (!absl::SimpleAtoi(absl::StripPrefix(fields[2], "entries="),
+                             &entries) ||
+           entries == 0)) {
+        return error(absl::StrCat("invalid option '", fields[2], "'"));
+      }
+      if (!annotations.memoized.emplace(fields[0], entries).second) {
+        return error(
+            absl::StrCat("'", fields[0], "' annotated as memoized twice"));
+      }
+      continue;
+    }
+    if (fields.size() < 3 || fields.size() > 5) {
+      return error(
+          "expected '<function> <parameter> <direction> [size=...] "
+          "[valid=...]'");
+    }
+    ParameterAnnotation annotation;
+    if (fields[2] == "in") {
+      annotation.direction = PointerDirection::kIn;
+    } else if (fields[2] == "out") {
+      annotation.direction = PointerDirection::kOut;
+    } else if (fields[2] == "inout") {
+      annotation.direction = PointerDirection::kInOut;
+    } else {
+      return error(absl::StrCat("unknown direction '", fields[2], "'"));
+    }
+    for (size_t i = 3; i < fields.size(); ++i) {
+      absl::string_view option = fields[i];
+      std::string* value;
+      if (absl::ConsumePrefix(&option, "size=")) {
+        value = &annotation.size_parameter;
+      } else if (absl::ConsumePrefix(&option, "valid=")) {
+        value = &annotation.valid_length;
+      } else {
+        return error(absl::StrCat(
+            "expected 'size=<parameter>' or 'valid=<length>', got '",
+            fields[i], "'"));
+      }
+      if (option.empty() || !value->empty()) {
+        return error(absl::StrCat("invalid option '", fields[i], "'"));
+      }
+      *value = std::string(option);
+    }
+    if (!annotations.parameters[fields[0]]
+             .emplace(fields[1], annotation)
+             .second) {
+      return error(absl::StrCat("parameter '", fields[1], "' of '", fields[0],
+                                "' annotated twice"));
+    }
+  }
+  return annotations;
+}
+
+}  // namespace sapi
@@ -0,0 +1,76 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_TOOLS_CLANG_GENERATOR_ANNOTATIONS_H_
+#define SANDBOXED_API_TOOLS_CLANG_GENERATOR_ANNOTATIONS_H_
+
+#include <cstddef>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace sapi {
+
+// Direction in which the data behind a pointer parameter flows.
+enum class PointerDirection {
+  // Derived from the parameter type: pointers to const are only synchronized
+  // before the call, other pointers before and after it.
+  kDefault,
+  // Only read by the function, synchronized before the call.
+  kIn,
+  // Only written by the function, synchronized after the call.
+  kOut,
+  // Read and written, synchronized before and after the call.
+  kInOut,
+};
+
+struct ParameterAnnotation {
+  PointerDirection direction = PointerDirection::kDefault;
+  // Name of the parameter that receives the size in bytes of the data behind
+  // this pointer parameter, if any.
+  std::string size_parameter;
+  // Name of the parameter, or "return" for the return value, that holds the
+  // number of bytes written by the function, if any. Only that many bytes are
+  // copied back into spans, see ::sapi::v::Var::SetValidLength().
+  std::string valid_length;
+};
+
+struct Annotations {
+  // Annotations of the pointer parameters of functions, by function name,
+  // then parameter name.
+  absl::flat_hash_map<std::string,
+                      absl::flat_hash_map<std::string, ParameterAnnotation>>
+      parameters;
+  // Pure functions whose results are memoized, with the number of results
+  // kept, see ::sapi::CallCache.
+  absl::flat_hash_map<std::string, size_t> memoized;
+};
+
+// Parses the contents of an annotation file. Each line annotates a single
+// parameter:
+//   <function> <parameter> <in|out|inout> [size=<parameter>] [valid=<length>]
+// or makes the results of a function be memoized:
+//   <function> memoize [entries=<count>]
+// Empty lines and lines starting with '#' are ignored. For example:
+//   # int read_data(void* buf, size_t len);
+//   read_data buf out size=len valid=return
+//   # int checksum(const void* data, size_t len);
+//   checksum memoize entries=4096
+absl::StatusOr<Annotations> ParseAnnotations(absl::string_view contents);
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_TOOLS_CLANG_GENERATOR_ANNOTATIONS_H_
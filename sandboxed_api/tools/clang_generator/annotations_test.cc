@@ -0,0 +1,89 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/tools/clang_generator/annotations.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sapi {
+namespace {
+
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::SizeIs;
+
+TEST(AnnotationsTest, ParsesDirectionsAndSizes) {
+  SAPI_ASSERT_OK_AND_ASSIGN(Annotations annotations, ParseAnnotations(R"(
+      # int read_data(void* buf, size_t len, const char* name);
+      read_data	buf out size=len valid=return
+      read_data name in
+
+      update state inout
+  )"));
+  ASSERT_THAT(annotations.parameters, SizeIs(2));
+  EXPECT_THAT(annotations.memoized, IsEmpty());
+  const auto& read_data = annotations.parameters["read_data"];
+  ASSERT_THAT(read_data, SizeIs(2));
+  EXPECT_THAT(read_data.at("buf").direction, Eq(PointerDirection::kOut));
+  EXPECT_THAT(read_data.at("buf").size_parameter, Eq("len"));
+  EXPECT_THAT(read_data.at("buf").valid_length, Eq("return"));
+  EXPECT_THAT(read_data.at("name").direction, Eq(PointerDirection::kIn));
+  EXPECT_THAT(read_data.at("name").size_parameter, IsEmpty());
+  EXPECT_THAT(annotations.parameters["update"].at("state").direction,
+              Eq(PointerDirection::kInOut));
+}
+
+TEST(AnnotationsTest, ParsesMemoizedFunctions) {
+  SAPI_ASSERT_OK_AND_ASSIGN(Annotations annotations, ParseAnnotations(R"(
+      checksum memoize
+      parse_uri memoize entries=16
+      parse_uri uri in
+      # A parameter named like the option.
+      update memoize inout
+  )"));
+  EXPECT_THAT(annotations.memoized, SizeIs(2));
+  EXPECT_THAT(annotations.memoized["checksum"], Eq(1024));
+  EXPECT_THAT(annotations.memoized["parse_uri"], Eq(16));
+  EXPECT_THAT(annotations.parameters["parse_uri"], SizeIs(1));
+  EXPECT_THAT(annotations.parameters["update"].at("memoize").direction,
+              Eq(PointerDirection::kInOut));
+}
+
+TEST(AnnotationsTest, RejectsMalformedLines) {
+  EXPECT_THAT(ParseAnnotations("read_data buf").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("read_data buf sideways").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("read_data buf out len").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("read_data buf out size=len size=n").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("read_data buf out valid=").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("read_data buf out\nread_data buf in").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("checksum memoize entries=0").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("checksum memoize entries=x").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseAnnotations("checksum memoize\nchecksum memoize").status(),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+}  // namespace
+}  // namespace sapi
@@ -14,6 +14,7 @@
 
 #include "sandboxed_api/tools/clang_generator/emitter.h"
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/random/random.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/ascii.h"
@@ -32,6 +33,7 @@
 #include "clang/AST/QualTypeNames.h"
 #include "clang/AST/Type.h"
 #include "clang/Format/Format.h"
+#include "sandboxed_api/tools/clang_generator/annotations.h"
 #include "sandboxed_api/tools/clang_generator/diagnostics.h"
 #include "sandboxed_api/tools/clang_generator/generator.h"
 #include "sandboxed_api/tools/clang_generator/types.h"
@@ -52,11 +54,15 @@ constexpr absl::string_view kHeaderProlog =
 #define %1$s
 
 #include <cstdint>
+#include <memory>
 #include <type_traits>
 
 #include "absl/base/macros.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/call_cache.h"
+#include "sandboxed_api/generated_calls.h"
 #include "sandboxed_api/sandbox.h"
 #include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/vars.h"
@@ -92,10 +98,32 @@ constexpr absl::string_view kEmbedClassTemplate = R"(
 class %1$s : public ::sapi::Sandbox {
  public:
   %1$s() : ::sapi::Sandbox(%2$s_embed_create()) {}
+%3$s};
+
+)";
+
+// Text template arguments:
+//   1. Class name
+//   2. Base class name
+constexpr absl::string_view kPassthroughClassTemplate = R"(
+// Calls the library in the host process instead, without any isolation, see
+// ::sapi::Sandbox::RunInProcess(). Needs the _passthrough target.
+class %1$s : public %2$s {
+ private:
+  bool RunInProcess() const override { return true; }
 };
 
 )";
 
+// Text template arguments:
+//   1. Enumerator of ::sapi::Sandbox::SandboxeeMalloc
+constexpr absl::string_view kEmbedMallocTemplate = R"(
+ private:
+  SandboxeeMalloc GetSandboxeeMalloc() const override {
+    return SandboxeeMalloc::%1$s;
+  }
+)";
+
 // Text template arguments:
 //   1. Class name
 constexpr absl::string_view kClassHeaderTemplate = R"(
@@ -109,6 +137,20 @@ class %1$s {
   ::sapi::Sandbox* sandbox() const { return sandbox_; }
 )";
 
+// Text template arguments:
+//   1. Batch methods
+constexpr absl::string_view kBatchClassTemplate = R"(
+  // Queues calls to be made in a single round trip to the sandboxee with
+  // Run(). Results can be read after Run() succeeded.
+  class Batch : public ::sapi::BatchBuilder {
+   public:
+    using ::sapi::BatchBuilder::BatchBuilder;
+%1$s
+  };
+
+  Batch NewBatch() const { return Batch(sandbox_); }
+)";
+
 constexpr absl::string_view kClassFooterTemplate = R"(
  private:
   ::sapi::Sandbox* sandbox_;
@@ -264,6 +306,16 @@ std::string GetParamName(const clang::ParmVarDecl* decl, int index) {
   return absl::StrCat("unnamed", index, "_");
 }
 
+// The methods emitted for each function.
+enum class FunctionFlavor {
+  // Foo(), making the call and returning its result.
+  kSync,
+  // FooAsync(), starting the call and returning a CallFuture.
+  kAsync,
+  // Batch::Foo(), queuing the call and returning a BatchResult.
+  kBatch,
+};
+
 absl::StatusOr<std::string> PrintFunctionPrototypeComment(
     const clang::FunctionDecl* decl) {
   const clang::ASTContext& context = decl->getASTContext();
@@ -296,7 +348,73 @@ absl::StatusOr<std::string> PrintFunctionPrototypeComment(
   return out;
 }
 
-absl::StatusOr<std::string> EmitFunction(const clang::FunctionDecl* decl) {
+// Emits the definition of a function-local CallDescriptor named kCall, for
+// use with ::sapi::Sandbox::CallWithDescriptor().
+std::string EmitCallDescriptor(const clang::FunctionDecl* decl) {
+  const clang::ASTContext& context = decl->getASTContext();
+  auto describe = [&context](clang::QualType qual, bool is_return) {
+    return absl::StrCat("::sapi::internal::kCallArg<",
+                        !is_return && IsPointerOrReference(qual)
+                            ? "::sapi::v::Ptr"
+                            : MapQualType(context, qual),
+                        ">");
+  };
+  std::vector<std::string> args;
+  for (const clang::ParmVarDecl* param : decl->parameters()) {
+    args.push_back(describe(param->getType(), /*is_return=*/false));
+  }
+  std::string out;
+  if (!args.empty()) {
+    absl::StrAppend(&out,
+                    "static constexpr ::sapi::CallDescriptor::Arg kArgs[] = {",
+                    absl::StrJoin(args, ", "), "};\n");
+  }
+  absl::StrAppend(&out, "static constexpr ::sapi::CallDescriptor kCall = {\"",
+                  ToStringView(decl->getName()), "\", ",
+                  describe(decl->getDeclaredReturnType(), /*is_return=*/true),
+                  ", ", args.empty() ? "{}" : "kArgs", "};\n");
+  return out;
+}
+
+// Returns the name of the static method returning the CallCache of a
+// memoized function.
+std::string GetCallCacheName(absl::string_view function_name) {
+  return absl::StrCat(function_name, "_cache");
+}
+
+// Emits the statement calling a function from a synchronous method, through
+// its CallCache if it is memoized. `args` follows the return value.
+std::string EmitCallStatement(absl::string_view function_name, bool memoized,
+                              const std::vector<std::string>& args) {
+  if (!memoized) {
+    std::string out =
+        "\nSAPI_RETURN_IF_ERROR(sandbox_->CallWithDescriptor(kCall, &v_ret_";
+    for (const std::string& arg : args) {
+      absl::StrAppend(&out, ", ", arg);
+    }
+    absl::StrAppend(&out, "));\n");
+    return out;
+  }
+  return absl::StrCat("\nSAPI_RETURN_IF_ERROR(",
+                      GetCallCacheName(function_name),
+                      "().Call(sandbox_, kCall, &v_ret_, {",
+                      absl::StrJoin(args, ", "), "}));\n");
+}
+
+// Emits the static method returning the CallCache of a memoized function.
+std::string EmitCallCache(absl::string_view function_name, size_t entries) {
+  return absl::StrFormat(
+      "\n// Repeated calls of %1$s() with the same arguments are answered by\n"
+      "// this cache, without calling into the sandboxee.\n"
+      "static ::sapi::CallCache& %2$s() {\n"
+      "static auto* cache = new ::sapi::CallCache({.max_entries = %3$d});\n"
+      "return *cache;\n}\n",
+      function_name, GetCallCacheName(function_name), entries);
+}
+
+absl::StatusOr<std::string> EmitFunction(const clang::FunctionDecl* decl,
+                                         FunctionFlavor flavor,
+                                         bool memoized = false) {
   const clang::QualType return_type = decl->getDeclaredReturnType();
   if (return_type->isRecordType()) {
     return MakeStatusWithDiagnostic(
@@ -313,10 +431,29 @@ absl::StatusOr<std::string> EmitFunction(const clang::FunctionDecl* decl) {
   const bool returns_void = return_type->isVoidType();
 
   const clang::ASTContext& context = decl->getASTContext();
-
-  // "Status<OptionalReturn> FunctionName("
-  absl::StrAppend(&out, MapQualTypeReturn(context, return_type), " ",
-                  function_name, "(");
+  const std::string return_value_type =
+      MapQualTypeReturnValue(context, return_type);
+
+  switch (flavor) {
+    case FunctionFlavor::kSync:
+      // "Status<OptionalReturn> FunctionName("
+      absl::StrAppend(&out, MapQualTypeReturn(context, return_type), " ",
+                      function_name, "(");
+      break;
+    case FunctionFlavor::kAsync:
+      // "StatusOr<CallFuture<OptionalReturn>> FunctionNameAsync("
+      absl::StrAppend(&out, "::absl::StatusOr<::sapi::CallFuture<",
+                      return_value_type, ">> ", function_name, "Async(");
+      break;
+    case FunctionFlavor::kBatch:
+      // "BatchResult<OptionalReturn> FunctionName("
+      absl::StrAppend(&out,
+                      returns_void ? "void"
+                                   : absl::StrCat("::sapi::BatchResult<",
+                                                  return_value_type, ">"),
+                      " ", function_name, "(");
+      break;
+  }
 
   struct ParameterInfo {
     clang::QualType qual;
@@ -346,26 +483,286 @@ absl::StatusOr<std::string> EmitFunction(const clang::FunctionDecl* decl) {
   }
 
   absl::StrAppend(&out, ") {\n");
-  absl::StrAppend(&out, MapQualType(context, return_type), " v_ret_;\n");
+  if (flavor == FunctionFlavor::kSync) {
+    absl::StrAppend(&out, MapQualType(context, return_type), " v_ret_;\n");
+    for (const auto& [qual, name] : params) {
+      if (!IsPointerOrReference(qual)) {
+        absl::StrAppend(&out, MapQualType(context, qual), " v_", name, "(",
+                        name, ");\n");
+      }
+    }
+    std::vector<std::string> args;
+    for (const auto& [qual, name] : params) {
+      args.push_back(
+          absl::StrCat(IsPointerOrReference(qual) ? "" : "&v_", name));
+    }
+    absl::StrAppend(&out, EmitCallDescriptor(decl),
+                    EmitCallStatement(function_name, memoized, args));
+    absl::StrAppend(
+        &out, "return ",
+        (returns_void ? "::absl::OkStatus()" : "v_ret_.GetValue()"), ";\n}\n");
+    return out;
+  }
+
+  // The other flavors return before the call finishes, so the variables are
+  // owned by the future or the batch. Batch methods are qualified, as they may
+  // be hidden by methods generated for functions of the same name.
+  std::string owner = "::sapi::BatchBuilder::";
+  if (flavor == FunctionFlavor::kAsync) {
+    absl::StrAppend(&out, "::sapi::CallFuture<", return_value_type,
+                    "> future;\n");
+    owner = "future.";
+  }
+  absl::StrAppend(&out, "auto* v_ret_ = ", owner, "Own(std::make_unique<",
+                  MapQualType(context, return_type), ">());\n");
   for (const auto& [qual, name] : params) {
     if (!IsPointerOrReference(qual)) {
-      absl::StrAppend(&out, MapQualType(context, qual), " v_", name, "(", name,
-                      ");\n");
+      absl::StrAppend(&out, "auto* v_", name, " = ", owner,
+                      "Own(std::make_unique<", MapQualType(context, qual), ">(",
+                      name, "));\n");
     }
   }
-  absl::StrAppend(&out, "\nSAPI_RETURN_IF_ERROR(sandbox_->Call(\"",
-                  function_name, "\", &v_ret_");
+  std::string args;
   for (const auto& [qual, name] : params) {
-    absl::StrAppend(&out, ", ", IsPointerOrReference(qual) ? "" : "&v_", name);
+    absl::StrAppend(&args, args.empty() ? "" : ", ",
+                    IsPointerOrReference(qual) ? "" : "v_", name);
+  }
+  if (flavor == FunctionFlavor::kAsync) {
+    absl::StrAppend(&out, "SAPI_RETURN_IF_ERROR(future.Start(sandbox_, \"",
+                    function_name, "\", v_ret_, {", args,
+                    "}));\nreturn future;\n}\n");
+  } else {
+    absl::StrAppend(&out, returns_void ? "" : "return ", owner, "Add");
+    if (!returns_void) {
+      absl::StrAppend(&out, "<", return_value_type, ">");
+    }
+    absl::StrAppend(&out, "(\"", function_name, "\", v_ret_, {", args,
+                    "});\n}\n");
   }
-  absl::StrAppend(&out, "));\nreturn ",
-                  (returns_void ? "::absl::OkStatus()" : "v_ret_.GetValue()"),
+  return out;
+}
+
+// Returns the sync type of a pointer parameter, derived from its annotation
+// and from its type.
+absl::string_view GetSyncType(clang::QualType qual,
+                              const ParameterAnnotation* annotation) {
+  switch (annotation ? annotation->direction : PointerDirection::kDefault) {
+    case PointerDirection::kIn:
+      return "::sapi::v::Var::kSyncBefore";
+    case PointerDirection::kOut:
+      return "::sapi::v::Var::kSyncAfter";
+    case PointerDirection::kInOut:
+      return "::sapi::v::Var::kSyncBoth";
+    case PointerDirection::kDefault:
+      break;
+  }
+  return qual->getPointeeType().isConstQualified()
+             ? "::sapi::v::Var::kSyncBefore"
+             : "::sapi::v::Var::kSyncBoth";
+}
+
+// The overloads of the synchronous method emitted for functions with pointer
+// parameters.
+enum class TypedFlavor {
+  // Takes references to the variables pointed to, instead of ::sapi::v::Ptr
+  // objects. Taking references keeps calls passing nullptr unambiguous.
+  kVars,
+  // Like kVars, but takes an absl::Span for each pointer parameter that has an
+  // annotated size parameter. The span's memory is used directly, without
+  // copies on the host.
+  kSpans,
+};
+
+// Returns the element type of the span passed for a pointer parameter, or an
+// empty string if the pointee cannot be passed as a span.
+std::string GetSpanElementType(const clang::ASTContext& context,
+                               clang::QualType qual) {
+  const clang::QualType pointee = qual->getPointeeType();
+  if (pointee->isPointerType() || pointee->isReferenceType() ||
+      pointee->isFunctionType() ||
+      (pointee->isIncompleteType() && !pointee->isVoidType())) {
+    return "";
+  }
+  std::string element = pointee->isVoidType()
+                            ? "uint8_t"
+                            : MapQualTypeParameterForCxx(
+                                  context, pointee.getUnqualifiedType());
+  return pointee.isConstQualified() ? absl::StrCat("const ", element)
+                                    : element;
+}
+
+// Emits an overload of the synchronous method, see TypedFlavor. Returns an
+// empty string if the function has no parameters the flavor applies to.
+absl::StatusOr<std::string> EmitTypedFunction(
+    const clang::FunctionDecl* decl, const Annotations& all_annotations,
+    TypedFlavor flavor) {
+  const clang::ASTContext& context = decl->getASTContext();
+  auto function_name = ToStringView(decl->getName());
+  const absl::flat_hash_map<std::string, ParameterAnnotation>* annotations =
+      nullptr;
+  if (auto it = all_annotations.parameters.find(function_name);
+      it != all_annotations.parameters.end()) {
+    annotations = &it->second;
+  }
+
+  struct ParameterInfo {
+    clang::QualType qual;
+    std::string name;
+    const ParameterAnnotation* annotation = nullptr;
+    // The pointer parameter whose size this parameter receives, if any.
+    const ParameterInfo* size_of = nullptr;
+    // Element type if this parameter is passed as a span.
+    std::string span_element;
+  };
+  std::vector<ParameterInfo> params(decl->getNumParams());
+  absl::flat_hash_map<std::string, ParameterInfo*> params_by_name;
+  bool has_pointers = false;
+  for (int i = 0; i < decl->getNumParams(); ++i) {
+    const clang::ParmVarDecl* param = decl->getParamDecl(i);
+    params[i].qual = param->getType();
+    params[i].name = GetParamName(param, i);
+    params_by_name[param->getName().str()] = &params[i];
+    has_pointers = has_pointers || IsPointerOrReference(params[i].qual);
+  }
+  if (!has_pointers) {
+    return "";
+  }
+  const clang::QualType return_type = decl->getDeclaredReturnType();
+  bool has_spans = false;
+  if (annotations != nullptr) {
+    for (const auto& [name, annotation] : *annotations) {
+      auto it = params_by_name.find(name);
+      if (it == params_by_name.end() ||
+          !IsPointerOrReference(it->second->qual)) {
+        return MakeStatusWithDiagnostic(
+            decl->getBeginLoc(), absl::StatusCode::kInvalidArgument,
+            absl::StrCat("annotated parameter '", name,
+                         "' is not a pointer parameter"));
+      }
+      ParameterInfo& param = *it->second;
+      param.annotation = &annotation;
+      if (!annotation.valid_length.empty() &&
+          (annotation.valid_length == "return"
+               ? !return_type->isIntegerType()
+               : !params_by_name.contains(annotation.valid_length))) {
+        return MakeStatusWithDiagnostic(
+            decl->getBeginLoc(), absl::StatusCode::kInvalidArgument,
+            absl::StrCat("valid length '", annotation.valid_length, "' of '",
+                         name, "' is neither a parameter nor an integer "
+                         "return value"));
+      }
+      if (annotation.size_parameter.empty()) {
+        continue;
+      }
+      auto size_it = params_by_name.find(annotation.size_parameter);
+      if (size_it == params_by_name.end() ||
+          IsPointerOrReference(size_it->second->qual) ||
+          size_it->second->size_of != nullptr) {
+        return MakeStatusWithDiagnostic(
+            decl->getBeginLoc(), absl::StatusCode::kInvalidArgument,
+            absl::StrCat("size parameter '", annotation.size_parameter,
+                         "' of '", name, "' is not a non-pointer parameter"));
+      }
+      size_it->second->size_of = &param;
+      if (flavor == TypedFlavor::kSpans) {
+        param.span_element = GetSpanElementType(context, param.qual);
+        has_spans = has_spans || !param.span_element.empty();
+      }
+    }
+  }
+  if (flavor == TypedFlavor::kSpans && !has_spans) {
+    return "";
+  }
+
+  std::string out =
+      flavor == TypedFlavor::kVars
+          ? "\n// Same as above, but takes the variables pointed to. Pointers "
+            "to const\n// are only synchronized before the call.\n"
+          : "\n// Same as above, but takes spans for sized buffers, which are "
+            "used\n// without copies on the host.\n";
+  absl::StrAppend(&out, MapQualTypeReturn(context, return_type), " ",
+                  function_name, "(");
+  std::string print_separator;
+  for (const ParameterInfo& param : params) {
+    if (param.size_of != nullptr) {
+      continue;  // Derived from the variable
+    }
+    std::string type;
+    if (!param.span_element.empty()) {
+      type = absl::StrCat("::absl::Span<", param.span_element, ">");
+    } else if (IsPointerOrReference(param.qual)) {
+      type = "::sapi::v::Var&";
+    } else {
+      type = MapQualTypeParameter(context, param.qual);
+    }
+    absl::StrAppend(&out, print_separator, type, " ", param.name);
+    print_separator = ", ";
+  }
+  absl::StrAppend(&out, ") {\n");
+  absl::StrAppend(&out, MapQualType(context, return_type), " v_ret_;\n");
+  auto var_name = [](const ParameterInfo& param) {
+    return param.span_element.empty() ? param.name
+                                      : absl::StrCat("v_", param.name);
+  };
+  for (const ParameterInfo& param : params) {
+    if (!param.span_element.empty()) {
+      absl::StrAppend(&out, "::sapi::v::Array<", param.span_element, "> v_",
+                      param.name, "(", param.name, ".data(), ", param.name,
+                      ".size());\n");
+    }
+  }
+  for (const ParameterInfo& param : params) {
+    if (param.size_of != nullptr) {
+      absl::StrAppend(&out, MapQualType(context, param.qual), " v_",
+                      param.name, "(", var_name(*param.size_of),
+                      ".GetSize());\n");
+    } else if (!IsPointerOrReference(param.qual)) {
+      absl::StrAppend(&out, MapQualType(context, param.qual), " v_",
+                      param.name, "(", param.name, ");\n");
+    }
+  }
+  for (const ParameterInfo& param : params) {
+    if (param.span_element.empty() || param.annotation->valid_length.empty()) {
+      continue;
+    }
+    std::string length = "&v_ret_";
+    if (param.annotation->valid_length != "return") {
+      const ParameterInfo& length_param =
+          *params_by_name.at(param.annotation->valid_length);
+      length = IsPointerOrReference(length_param.qual)
+                   ? absl::StrCat("::sapi::internal::PointedCallable(&",
+                                  var_name(length_param), ")")
+                   : absl::StrCat("&v_", length_param.name);
+    }
+    absl::StrAppend(&out, "v_", param.name, ".SetValidLength(", length,
+                    ");\n");
+  }
+  std::vector<std::string> args;
+  for (const ParameterInfo& param : params) {
+    if (IsPointerOrReference(param.qual)) {
+      args.push_back(absl::StrCat("::sapi::internal::SyncedPtr(&",
+                                  var_name(param), ", ",
+                                  GetSyncType(param.qual, param.annotation),
+                                  ")"));
+    } else {
+      args.push_back(absl::StrCat("&v_", param.name));
+    }
+  }
+  absl::StrAppend(
+      &out, EmitCallDescriptor(decl),
+      EmitCallStatement(function_name,
+                        all_annotations.memoized.contains(function_name),
+                        args));
+  absl::StrAppend(&out, "return ",
+                  return_type->isVoidType() ? "::absl::OkStatus()"
+                                            : "v_ret_.GetValue()",
                   ";\n}\n");
   return out;
 }
 
 absl::StatusOr<std::string> EmitHeader(
     const std::vector<std::string>& function_definitions,
+    const std::vector<std::string>& batch_definitions,
     const std::vector<const RenderedType*>& rendered_types,
     const GeneratorOptions& options) {
   std::string out;
@@ -415,10 +812,24 @@ absl::StatusOr<std::string> EmitHeader(
 
   // Optionally emit a default sandbox that instantiates an embedded sandboxee
   if (!options.embed_name.empty()) {
+    std::string malloc_override;
+    if (options.sandboxee_malloc == "tcmalloc") {
+      malloc_override = absl::StrFormat(kEmbedMallocTemplate, "kTcMalloc");
+    } else if (options.sandboxee_malloc == "scudo") {
+      malloc_override = absl::StrFormat(kEmbedMallocTemplate, "kScudo");
+    } else if (!options.sandboxee_malloc.empty() &&
+               options.sandboxee_malloc != "system") {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "unknown sandboxee malloc '", options.sandboxee_malloc, "'"));
+    }
     // TODO(cblichmann): Make the "Sandbox" suffix configurable.
     absl::StrAppendFormat(
         &out, kEmbedClassTemplate, absl::StrCat(options.name, "Sandbox"),
-        absl::StrReplaceAll(options.embed_name, {{"-", "_"}}));
+        absl::StrReplaceAll(options.embed_name, {{"-", "_"}}),
+        malloc_override);
+    absl::StrAppendFormat(&out, kPassthroughClassTemplate,
+                          absl::StrCat(options.name, "PassthroughSandbox"),
+                          absl::StrCat(options.name, "Sandbox"));
   }
 
   // Emit the actual Sandboxed API
@@ -426,6 +837,8 @@ absl::StatusOr<std::string> EmitHeader(
   absl::StrAppendFormat(&out, kClassHeaderTemplate,
                         absl::StrCat(options.name, "Api"));
   absl::StrAppend(&out, absl::StrJoin(function_definitions, "\n"));
+  absl::StrAppendFormat(&out, kBatchClassTemplate,
+                        absl::StrJoin(batch_definitions, "\n"));
   absl::StrAppend(&out, kClassFooterTemplate);
 
   // Close out the header: close namespace (if needed) and end include guard
@@ -492,10 +905,37 @@ void Emitter::AddTypeDeclarations(
   }
 }
 
-absl::Status Emitter::AddFunction(clang::FunctionDecl* decl) {
+absl::Status Emitter::AddFunction(clang::FunctionDecl* decl,
+                                  const Annotations& annotations) {
   if (rendered_functions_.insert(decl->getQualifiedNameAsString()).second) {
-    SAPI_ASSIGN_OR_RETURN(std::string function, EmitFunction(decl));
-    rendered_functions_ordered_.push_back(function);
+    // Only the synchronous methods are memoized.
+    std::string call_cache;
+    const std::string function_name = decl->getName().str();
+    if (auto it = annotations.memoized.find(function_name);
+        it != annotations.memoized.end()) {
+      if (decl->getDeclaredReturnType()->isPointerType()) {
+        return MakeStatusWithDiagnostic(
+            decl->getBeginLoc(), absl::StatusCode::kInvalidArgument,
+            "memoized function returns a pointer into the sandboxee");
+      }
+      call_cache = EmitCallCache(function_name, it->second);
+    }
+    SAPI_ASSIGN_OR_RETURN(
+        std::string function,
+        EmitFunction(decl, FunctionFlavor::kSync, !call_cache.empty()));
+    SAPI_ASSIGN_OR_RETURN(
+        std::string typed_function,
+        EmitTypedFunction(decl, annotations, TypedFlavor::kVars));
+    SAPI_ASSIGN_OR_RETURN(
+        std::string span_function,
+        EmitTypedFunction(decl, annotations, TypedFlavor::kSpans));
+    SAPI_ASSIGN_OR_RETURN(std::string async_function,
+                          EmitFunction(decl, FunctionFlavor::kAsync));
+    SAPI_ASSIGN_OR_RETURN(std::string batch_function,
+                          EmitFunction(decl, FunctionFlavor::kBatch));
+    rendered_functions_ordered_.push_back(absl::StrCat(
+        call_cache, function, typed_function, span_function, async_function));
+    rendered_batch_functions_ordered_.push_back(batch_function);
   }
   return absl::OkStatus();
 }
@@ -504,6 +944,7 @@ absl::StatusOr<std::string> Emitter::EmitHeader(
     const GeneratorOptions& options) {
   SAPI_ASSIGN_OR_RETURN(const std::string header,
                         ::sapi::EmitHeader(rendered_functions_ordered_,
+                                           rendered_batch_functions_ordered_,
                                            rendered_types_ordered_, options));
   return internal::ReformatGoogleStyle(options.out_file, header);
 }
@@ -25,6 +25,7 @@
 #include "absl/strings/string_view.h"
 #include "clang/AST/Decl.h"
 #include "clang/AST/Type.h"
+#include "sandboxed_api/tools/clang_generator/annotations.h"
 #include "sandboxed_api/tools/clang_generator/types.h"
 
 namespace sapi {
@@ -68,7 +69,10 @@ class Emitter {
   // including the correct headers in the emitted header.
   void AddTypeDeclarations(const std::vector<clang::TypeDecl*>& type_decls);
 
-  absl::Status AddFunction(clang::FunctionDecl* decl);
+  // Adds a function to the emitter. The annotations determine how the data
+  // behind its pointer parameters is synchronized.
+  absl::Status AddFunction(clang::FunctionDecl* decl,
+                           const Annotations& annotations = Annotations());
 
   // Outputs a formatted header for a list of functions and their related types.
   absl::StatusOr<std::string> EmitHeader(const GeneratorOptions& options);
@@ -92,6 +96,9 @@ class Emitter {
   // Rendered function bodies, as a vector to preserve source order. This is
   // not strictly necessary, but makes the output look less surprising.
   std::vector<std::string> rendered_functions_ordered_;
+
+  // Rendered methods of the Batch class, in the same order.
+  std::vector<std::string> rendered_batch_functions_ordered_;
 };
 
 // Constructs an include guard name for the given filename. The name is of the
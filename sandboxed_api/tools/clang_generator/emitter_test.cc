@@ -16,11 +16,13 @@
 
 #include <initializer_list>
 #include <memory>
+#include <string>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "sandboxed_api/tools/clang_generator/annotations.h"
 #include "sandboxed_api/tools/clang_generator/frontend_action_test_util.h"
 #include "sandboxed_api/tools/clang_generator/generator.h"
 #include "sandboxed_api/util/status_matchers.h"
@@ -29,8 +31,10 @@ namespace sapi {
 namespace {
 
 using ::testing::ElementsAre;
+using ::testing::HasSubstr;
 using ::testing::IsEmpty;
 using ::testing::MatchesRegex;
+using ::testing::Not;
 using ::testing::SizeIs;
 using ::testing::StrEq;
 using ::testing::StrNe;
@@ -50,6 +54,10 @@ class EmitterForTesting : public Emitter {
   const std::vector<std::string>& GetRenderedFunctions() {
     return rendered_functions_ordered_;
   }
+
+  const std::vector<std::string>& GetRenderedBatchFunctions() {
+    return rendered_batch_functions_ordered_;
+  }
 };
 
 class EmitterTest : public FrontendActionTest {};
@@ -70,6 +78,193 @@ TEST_F(EmitterTest, BasicFunctionality) {
   EXPECT_THAT(header, IsOk());
 }
 
+TEST_F(EmitterTest, EmbeddedSandboxMalloc) {
+  GeneratorOptions options;
+  options.name = "Test";
+  options.embed_name = "test-sapi";
+  options.sandboxee_malloc = "tcmalloc";
+
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(R"(extern "C" void ExposedFunction() {})",
+                        std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+  SAPI_ASSERT_OK_AND_ASSIGN(std::string header, emitter.EmitHeader(options));
+  EXPECT_THAT(header, HasSubstr("class TestSandbox : public ::sapi::Sandbox {"));
+  EXPECT_THAT(header, HasSubstr("return SandboxeeMalloc::kTcMalloc;"));
+  EXPECT_THAT(header,
+              HasSubstr("class TestPassthroughSandbox : public TestSandbox {"));
+
+  options.sandboxee_malloc = "jemalloc";
+  EXPECT_THAT(emitter.EmitHeader(options), Not(IsOk()));
+}
+
+TEST_F(EmitterTest, AsyncAndBatchVariants) {
+  GeneratorOptions options;
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(R"(extern "C" int Sum(int a, int* b);
+                           extern "C" void Reset(int* a);)",
+                        std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(2));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr("::absl::StatusOr<::sapi::CallFuture<int>> SumAsync("
+                        "int a_, ::sapi::v::Ptr* b_) {"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr("SAPI_RETURN_IF_ERROR(future.Start(sandbox_, \"Sum\", "
+                        "v_ret_, {v_a_, b_}));"));
+  ASSERT_THAT(emitter.GetRenderedBatchFunctions(), SizeIs(2));
+  EXPECT_THAT(emitter.GetRenderedBatchFunctions()[0],
+              HasSubstr("::sapi::BatchResult<int> Sum(int a_, "
+                        "::sapi::v::Ptr* b_) {"));
+  EXPECT_THAT(emitter.GetRenderedBatchFunctions()[0],
+              HasSubstr("return ::sapi::BatchBuilder::Add<int>(\"Sum\", "
+                        "v_ret_, {v_a_, b_});"));
+  EXPECT_THAT(emitter.GetRenderedBatchFunctions()[1],
+              HasSubstr("void Reset(::sapi::v::Ptr* a_) {"));
+
+  absl::StatusOr<std::string> header = emitter.EmitHeader(options);
+  ASSERT_THAT(header, IsOk());
+  EXPECT_THAT(*header,
+              HasSubstr("class Batch : public ::sapi::BatchBuilder {"));
+  EXPECT_THAT(*header, HasSubstr("Batch NewBatch() const"));
+}
+
+TEST_F(EmitterTest, CallDescriptors) {
+  GeneratorOptions options;
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(R"(extern "C" double Scale(double a, int* b);
+                           extern "C" void Tick();)",
+                        std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(2));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr("static constexpr ::sapi::CallDescriptor::Arg kArgs[] "
+                        "= {::sapi::internal::kCallArg<::sapi::v::Reg<double>>"
+                        ", ::sapi::internal::kCallArg<::sapi::v::Ptr>};"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr("static constexpr ::sapi::CallDescriptor kCall = {"
+                        "\"Scale\", ::sapi::internal::kCallArg<"
+                        "::sapi::v::Reg<double>>, kArgs};"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[0],
+              HasSubstr("SAPI_RETURN_IF_ERROR(sandbox_->CallWithDescriptor("
+                        "kCall, &v_ret_, &v_a_, b_));"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[1],
+              HasSubstr("static constexpr ::sapi::CallDescriptor kCall = {"
+                        "\"Tick\", ::sapi::internal::kCallArg<"
+                        "::sapi::v::Void>, {}};"));
+}
+
+TEST_F(EmitterTest, TypedOverloadSyncDirections) {
+  GeneratorOptions options;
+  SAPI_ASSERT_OK_AND_ASSIGN(options.annotations,
+                            ParseAnnotations("ReadData buf out size=len"));
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(extern "C" int ReadData(const char* name, void* buf, int len);
+             extern "C" int Sum(int a, int b);)",
+          std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(2));
+  const std::string& read_data = emitter.GetRenderedFunctions()[0];
+  EXPECT_THAT(read_data, HasSubstr("::absl::StatusOr<int> ReadData("
+                                   "::sapi::v::Var& name_, "
+                                   "::sapi::v::Var& buf_) {"));
+  EXPECT_THAT(read_data, HasSubstr("::sapi::v::Int v_len_(buf_.GetSize());"));
+  EXPECT_THAT(read_data,
+              HasSubstr("SAPI_RETURN_IF_ERROR(sandbox_->CallWithDescriptor("
+                        "kCall, &v_ret_, ::sapi::internal::SyncedPtr(&name_, "
+                        "::sapi::v::Var::kSyncBefore), "
+                        "::sapi::internal::SyncedPtr(&buf_, "
+                        "::sapi::v::Var::kSyncAfter), &v_len_));"));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[1],
+              Not(HasSubstr("::sapi::v::Var&")));
+}
+
+TEST_F(EmitterTest, SpanOverload) {
+  GeneratorOptions options;
+  SAPI_ASSERT_OK_AND_ASSIGN(options.annotations, ParseAnnotations(R"(
+      Compress dst out size=dst_cap valid=dst_len
+      Compress src in size=src_len
+  )"));
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(extern "C" int Compress(unsigned char* dst, unsigned long dst_cap,
+                                     unsigned long* dst_len, const void* src,
+                                     unsigned long src_len);)",
+          std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(1));
+  const std::string& compress = emitter.GetRenderedFunctions()[0];
+  EXPECT_THAT(compress, HasSubstr("::absl::StatusOr<int> Compress("
+                                  "::absl::Span<unsigned char> dst_, "
+                                  "::sapi::v::Var& dst_len_, "
+                                  "::absl::Span<const uint8_t> src_) {"));
+  EXPECT_THAT(compress,
+              HasSubstr("::sapi::v::Array<const uint8_t> v_src_(src_.data(), "
+                        "src_.size());"));
+  EXPECT_THAT(compress, HasSubstr("v_dst_.SetValidLength(::sapi::internal::"
+                                  "PointedCallable(&dst_len_));"));
+  EXPECT_THAT(compress,
+              HasSubstr("::sapi::internal::SyncedPtr(&v_dst_, "
+                        "::sapi::v::Var::kSyncAfter), &v_dst_cap_, "
+                        "::sapi::internal::SyncedPtr(&dst_len_, "
+                        "::sapi::v::Var::kSyncBoth), "
+                        "::sapi::internal::SyncedPtr(&v_src_, "
+                        "::sapi::v::Var::kSyncBefore), &v_src_len_));"));
+}
+
+TEST_F(EmitterTest, MemoizedFunction) {
+  GeneratorOptions options;
+  SAPI_ASSERT_OK_AND_ASSIGN(options.annotations, ParseAnnotations(R"(
+      Checksum memoize entries=64
+      Checksum data in
+  )"));
+  EmitterForTesting emitter;
+  ASSERT_THAT(
+      RunFrontendAction(
+          R"(extern "C" int Checksum(const char* data, int len);
+             extern "C" int Sum(int a, int b);)",
+          std::make_unique<GeneratorAction>(emitter, options)),
+      IsOk());
+
+  ASSERT_THAT(emitter.GetRenderedFunctions(), SizeIs(2));
+  const std::string& checksum = emitter.GetRenderedFunctions()[0];
+  EXPECT_THAT(checksum,
+              HasSubstr("static ::sapi::CallCache& Checksum_cache() {\n"
+                        "static auto* cache = new ::sapi::CallCache("
+                        "{.max_entries = 64});"));
+  EXPECT_THAT(checksum,
+              HasSubstr("SAPI_RETURN_IF_ERROR(Checksum_cache().Call(sandbox_, "
+                        "kCall, &v_ret_, {data_, &v_len_}));"));
+  EXPECT_THAT(checksum,
+              HasSubstr("SAPI_RETURN_IF_ERROR(Checksum_cache().Call(sandbox_, "
+                        "kCall, &v_ret_, {::sapi::internal::SyncedPtr(&data_, "
+                        "::sapi::v::Var::kSyncBefore), &v_len_}));"));
+  // Asynchronous and batched calls are not memoized.
+  EXPECT_THAT(checksum, HasSubstr("future.Start(sandbox_, \"Checksum\""));
+  EXPECT_THAT(emitter.GetRenderedFunctions()[1], Not(HasSubstr("_cache")));
+}
+
+TEST_F(EmitterTest, RejectsAnnotationsOfNonPointers) {
+  GeneratorOptions options;
+  SAPI_ASSERT_OK_AND_ASSIGN(options.annotations,
+                            ParseAnnotations("ReadData len out"));
+  EmitterForTesting emitter;
+  EXPECT_THAT(
+      RunFrontendAction(R"(extern "C" int ReadData(void* buf, int len);)",
+                        std::make_unique<GeneratorAction>(emitter, options)),
+      Not(IsOk()));
+}
+
 TEST_F(EmitterTest, RelatedTypes) {
   EmitterForTesting emitter;
   ASSERT_THAT(
@@ -117,7 +117,7 @@ void GeneratorASTConsumer::HandleTranslationUnit(clang::ASTContext& context) {
   // TODO(cblichmann): Move below to emit all functions after traversing TUs.
   emitter_.AddTypeDeclarations(visitor_.collector().GetTypeDeclarations());
   for (clang::FunctionDecl* func : visitor_.functions()) {
-    absl::Status status = emitter_.AddFunction(func);
+    absl::Status status = emitter_.AddFunction(func, options_.annotations);
     if (!status.ok()) {
       clang::SourceLocation loc =
           GetDiagnosticLocationFromStatus(status).value_or(func->getBeginLoc());
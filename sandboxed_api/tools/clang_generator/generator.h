@@ -27,6 +27,7 @@
 #include "clang/Frontend/CompilerInvocation.h"
 #include "clang/Frontend/FrontendAction.h"
 #include "clang/Tooling/Tooling.h"
+#include "sandboxed_api/tools/clang_generator/annotations.h"
 #include "sandboxed_api/tools/clang_generator/emitter.h"
 #include "sandboxed_api/tools/clang_generator/types.h"
 
@@ -57,6 +58,8 @@ struct GeneratorOptions {
   absl::flat_hash_set<std::string> function_names;
   absl::flat_hash_set<std::string> in_files;
   bool limit_scan_depth = false;
+  // Annotations of pointer parameters, see ParseAnnotations().
+  Annotations annotations;
 
   // Output options
   std::string work_dir;
@@ -67,6 +70,9 @@ struct GeneratorOptions {
   std::string out_file = "out_file.cc";
   std::string embed_dir;   // Directory with embedded includes
   std::string embed_name;  // Identifier of the embed object
+  // Allocator the embedded sandboxee is linked against: "system", "tcmalloc"
+  // or "scudo". Empty means "system".
+  std::string sandboxee_malloc;
 };
 
 class GeneratorASTVisitor
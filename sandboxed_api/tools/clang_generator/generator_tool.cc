@@ -18,6 +18,7 @@
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_format.h"
 #include "clang/Tooling/CommonOptionsParser.h"
@@ -44,6 +45,12 @@ static auto* g_extra_help = new llvm::cl::extrahelp(
     "Report bugs to <https://github.com/google/sandboxed-api/issues>\n");
 
 // Command line options
+static auto* g_sapi_annotations = new llvm::cl::opt<std::string>(
+    "sapi_annotations",
+    llvm::cl::desc("File with annotations of pointer parameters, one "
+                   "'<function> <parameter> <in|out|inout> [size=<parameter>]' "
+                   "or '<function> memoize [entries=<count>]' per line"),
+    llvm::cl::cat(*g_tool_category));
 static auto* g_sapi_embed_dir = new llvm::cl::opt<std::string>(
     "sapi_embed_dir", llvm::cl::desc("Directory with embedded includes"),
     llvm::cl::cat(*g_tool_category));
@@ -69,6 +76,11 @@ static auto* g_sapi_limit_scan_depth = new llvm::cl::opt<bool>(
     llvm::cl::desc(
         "Whether to only scan for functions in the top-most translation unit"),
     llvm::cl::cat(*g_tool_category));
+static auto* g_sapi_malloc = new llvm::cl::opt<std::string>(
+    "sapi_malloc",
+    llvm::cl::desc("Allocator the embedded sandboxee is linked against "
+                   "(system, tcmalloc or scudo)"),
+    llvm::cl::cat(*g_tool_category));
 static auto* g_sapi_name = new llvm::cl::opt<std::string>(
     "sapi_name", llvm::cl::desc("Name of the Sandboxed API library"),
     llvm::cl::cat(*g_tool_category));
@@ -84,7 +96,7 @@ static auto* g_sapi_out = new llvm::cl::opt<std::string>(
 
 }  // namespace
 
-GeneratorOptions GeneratorOptionsFromFlags(
+absl::StatusOr<GeneratorOptions> GeneratorOptionsFromFlags(
     const std::vector<std::string>& sources) {
   GeneratorOptions options;
   options.work_dir = sapi::file_util::fileops::GetCWD();
@@ -103,6 +115,13 @@ GeneratorOptions GeneratorOptionsFromFlags(
       !g_sapi_out->empty() ? *g_sapi_out : GetOutputFilename(sources.front());
   options.embed_dir = *g_sapi_embed_dir;
   options.embed_name = *g_sapi_embed_name;
+  options.sandboxee_malloc = *g_sapi_malloc;
+  if (!g_sapi_annotations->empty()) {
+    std::string contents;
+    SAPI_RETURN_IF_ERROR(sapi::file::GetContents(*g_sapi_annotations, &contents,
+                                                 sapi::file::Defaults()));
+    SAPI_ASSIGN_OR_RETURN(options.annotations, ParseAnnotations(contents));
+  }
   return options;
 }
 
@@ -124,7 +143,8 @@ absl::Status GeneratorMain(int argc, char* argv[]) {
     return absl::InvalidArgumentError("error: no input files");
   }
 
-  auto options = sapi::GeneratorOptionsFromFlags(sources);
+  SAPI_ASSIGN_OR_RETURN(GeneratorOptions options,
+                        sapi::GeneratorOptionsFromFlags(sources));
   sapi::Emitter emitter;
 
   std::unique_ptr<clang::tooling::CompilationDatabase> db =
@@ -328,13 +328,19 @@ std::string MapQualTypeReturn(const clang::ASTContext& context,
   if (qual->isVoidType()) {
     return "::absl::Status";
   }
+  return absl::StrCat("::absl::StatusOr<",
+                      MapQualTypeReturnValue(context, qual), ">");
+}
+
+std::string MapQualTypeReturnValue(const clang::ASTContext& context,
+                                   clang::QualType qual) {
+  if (qual->isVoidType()) {
+    return "void";
+  }
   // Remove const qualifier like in MapQualType().
   // TODO(cblichmann): We should return pointers differently, as they point to
   //                   the sandboxee's address space.
-  return absl::StrCat(
-      "::absl::StatusOr<",
-      MapQualTypeParameterForCxx(context, MaybeRemoveConst(context, qual)),
-      ">");
+  return MapQualTypeParameterForCxx(context, MaybeRemoveConst(context, qual));
 }
 
 }  // namespace sapi
@@ -96,6 +96,12 @@ std::string MapQualTypeParameter(const clang::ASTContext& context,
 std::string MapQualTypeReturn(const clang::ASTContext& context,
                               clang::QualType qual);
 
+// Maps a qualified type used as a function return type to the C++ type of the
+// value returned by the generated Sandboxed API, i.e. the type wrapped by
+// MapQualTypeReturn(). Returns "void" if qual is void.
+std::string MapQualTypeReturnValue(const clang::ASTContext& context,
+                                   clang::QualType qual);
+
 }  // namespace sapi
 
 #endif  // SANDBOXED_API_TOOLS_CLANG_GENERATOR_TYPES_H_
@@ -705,7 +705,24 @@ class Generator(object):
   EMBED_CLASS = ('class {0}Sandbox : public ::sapi::Sandbox {{\n'
                  ' public:\n'
                  '  {0}Sandbox() : ::sapi::Sandbox({1}_embed_create()) {{}}\n'
+                 '{2}'
                  '}};')
+  EMBED_MALLOC = (' private:\n'
+                  '  SandboxeeMalloc GetSandboxeeMalloc() const override {{\n'
+                  '    return SandboxeeMalloc::{};\n'
+                  '  }}\n')
+  PASSTHROUGH_CLASS = ('// Calls the library in the host process instead, '
+                       'without any isolation,\n'
+                       '// see ::sapi::Sandbox::RunInProcess(). Needs the '
+                       '_passthrough target.\n'
+                       'class {0}PassthroughSandbox : public {0}Sandbox {{\n'
+                       ' private:\n'
+                       '  bool RunInProcess() const override {{\n'
+                       '    return true;\n'
+                       '  }}\n'
+                       '}};')
+  # Enumerators of ::sapi::Sandbox::SandboxeeMalloc by allocator name.
+  SANDBOXEE_MALLOC = {'tcmalloc': 'kTcMalloc', 'scudo': 'kScudo'}
 
   def __init__(self, translation_units):
     # type: (List[cindex.TranslationUnit]) -> None
@@ -726,9 +743,10 @@ class Generator(object):
                namespace=None,
                output_file=None,
                embed_dir=None,
-               embed_name=None):
+               embed_name=None,
+               sandboxee_malloc=None):
     # pylint: disable=line-too-long
-    # type: (Text, List[Text], Optional[Text], Optional[Text], Optional[Text], Optional[Text]) -> Text
+    # type: (Text, List[Text], Optional[Text], Optional[Text], Optional[Text], Optional[Text], Optional[Text]) -> Text
     """Generates structures, functions and typedefs.
 
     Args:
@@ -740,10 +758,15 @@ class Generator(object):
         defaults to None that causes to emit the whole file path
       embed_dir: path to directory with embed includes
       embed_name: name of the embed object
+      sandboxee_malloc: allocator the embedded sandboxee is linked against,
+        'system', 'tcmalloc' or 'scudo'; defaults to None, meaning 'system'
 
     Returns:
       generated interface as a string
     """
+    if sandboxee_malloc not in (None, '', 'system',
+                                *Generator.SANDBOXEE_MALLOC):
+      raise ValueError('Unknown sandboxee malloc: {}'.format(sandboxee_malloc))
     related_types = self._get_related_types(function_names)
     forward_decls = self._get_forward_decls(related_types)
     functions = self._get_functions(function_names)
@@ -757,6 +780,7 @@ class Generator(object):
         'namespaces': namespace.split('::') if namespace else [],
         'embed_dir': embed_dir,
         'embed_name': embed_name,
+        'sandboxee_malloc': sandboxee_malloc,
         'output_file': output_file
     }
     return self.format_template(**api)
@@ -897,9 +921,10 @@ class Generator(object):
     return '\n'.join(result)
 
   def format_template(self, name, functions, related_types, namespaces,
-                      embed_dir, embed_name, output_file):
+                      embed_dir, embed_name, output_file,
+                      sandboxee_malloc=None):
     # pylint: disable=line-too-long
-    # type: (Text, List[Function], List[Text], List[Text], Text, Text, Text) -> Text
+    # type: (Text, List[Function], List[Text], List[Text], Text, Text, Text, Optional[Text]) -> Text
     # pylint: enable=line-too-long
     """Formats arguments into proper interface header file.
 
@@ -911,6 +936,7 @@ class Generator(object):
       embed_dir: directory where the embedded library lives
       embed_name: name of embedded library
       output_file: interface output path - used in header guard generation
+      sandboxee_malloc: allocator the embedded sandboxee is linked against
 
     Returns:
       generated header file text
@@ -947,8 +973,16 @@ class Generator(object):
     result.append('')
 
     if embed_name:
+      malloc_override = ''
+      if sandboxee_malloc in Generator.SANDBOXEE_MALLOC:
+        malloc_override = Generator.EMBED_MALLOC.format(
+            Generator.SANDBOXEE_MALLOC[sandboxee_malloc])
       result.append(
-          Generator.EMBED_CLASS.format(name, embed_name.replace('-', '_')))
+          Generator.EMBED_CLASS.format(name, embed_name.replace('-', '_'),
+                                       malloc_override))
+      result.append('')
+      result.append(Generator.PASSTHROUGH_CLASS.format(name))
+      result.append('')
 
     result.append('class {}Api {{'.format(name))
     result.append(' public:')
@@ -186,6 +186,18 @@ class CodeAnalysisTest(parameterized.TestCase):
     for t in functions[0].argument_types:
       self.assertIn(t.name, names)
 
+  def testEmbeddedSandboxMalloc(self):
+    body = 'extern "C" int function_a(int x);'
+    generator = code.Generator([analyze_string(body)])
+    result = generator.generate('Test', [], 'sapi::Tests', None, None,
+                                'test-sapi', 'tcmalloc')
+    self.assertIn('class TestSandbox : public ::sapi::Sandbox {', result)
+    self.assertIn('return SandboxeeMalloc::kTcMalloc;', result)
+    self.assertIn('class TestPassthroughSandbox : public TestSandbox {', result)
+    with self.assertRaises(ValueError):
+      generator.generate('Test', [], 'sapi::Tests', None, None, 'test-sapi',
+                         'jemalloc')
+
   def testStaticFunctions(self):
     body = 'static int function() { return 7; };'
     generator = code.Generator([analyze_string(body)])
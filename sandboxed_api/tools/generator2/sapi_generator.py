@@ -33,6 +33,9 @@ flags.DEFINE_list('sapi_functions', [], 'function list to analyze')
 flags.DEFINE_list('sapi_in', None, 'input files to analyze')
 flags.DEFINE_string('sapi_embed_dir', '', 'directory with embed includes')
 flags.DEFINE_string('sapi_embed_name', '', 'name of the embed object')
+flags.DEFINE_string('sapi_malloc', '',
+                    'allocator of the embedded sandboxee (system, tcmalloc '
+                    'or scudo)')
 flags.DEFINE_bool(
     'sapi_limit_scan_depth', False,
     'scan only functions from top level file in compilation unit')
@@ -59,7 +62,8 @@ def main(c_flags):
   generator = code.Generator(tus)
   result = generator.generate(FLAGS.sapi_name, FLAGS.sapi_functions,
                               FLAGS.sapi_ns, FLAGS.sapi_out,
-                              FLAGS.sapi_embed_dir, FLAGS.sapi_embed_name)
+                              FLAGS.sapi_embed_dir, FLAGS.sapi_embed_name,
+                              FLAGS.sapi_malloc)
 
   if FLAGS.sapi_out:
     with open(FLAGS.sapi_out, 'w') as out_file:
@@ -14,6 +14,9 @@
 
 #include "sandboxed_api/transaction.h"
 
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "sandboxed_api/util/status_macros.h"
 
 namespace sapi {
@@ -44,6 +47,25 @@ absl::Status TransactionBase::RunTransactionFunctionInSandbox(
   return f();
 }
 
+void TransactionBase::TerminateIfMemoryGrew() {
+  if (memory_growth_limits_.empty()) {
+    return;
+  }
+  absl::StatusOr<bool> exceeds =
+      sandbox_->ExceedsMemoryGrowth(memory_growth_limits_);
+  if (exceeds.ok() && !*exceeds) {
+    return;
+  }
+  VLOG(1) << "Terminating the sandbox: "
+          << (exceeds.ok() ? "memory usage grew too much"
+                           : exceeds.status().ToString());
+  if (initialized_) {
+    Finish().IgnoreError();
+    initialized_ = false;
+  }
+  sandbox_->Terminate();
+}
+
 absl::Status TransactionBase::RunTransactionLoop(
     const std::function<absl::Status()>& f) {
   // Try to run Main() for a few times, return error if none of the tries
@@ -52,6 +74,7 @@ absl::Status TransactionBase::RunTransactionLoop(
   for (int i = 0; i <= retry_count_; ++i) {
     status = RunTransactionFunctionInSandbox(f);
     if (status.ok()) {
+      TerminateIfMemoryGrew();
       return status;
     }
     sandbox_->Terminate();
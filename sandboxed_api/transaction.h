@@ -15,6 +15,7 @@
 #ifndef SANDBOXED_API_TRANSACTION_H_
 #define SANDBOXED_API_TRANSACTION_H_
 
+#include <cstdint>
 #include <memory>
 
 #include "absl/log/log.h"
@@ -66,6 +67,16 @@ class TransactionBase {
     time_limit_ = absl::ToTimeT(absl::UnixEpoch() + time_limit);
   }
 
+  // Getter/Setter for memory_growth_limits_. With limits set, the sandbox is
+  // restarted before the next run once a successful run left its memory usage
+  // grown beyond them, see Sandbox::ExceedsMemoryGrowth().
+  const MemoryGrowthLimits& memory_growth_limits() const {
+    return memory_growth_limits_;
+  }
+  void set_memory_growth_limits(const MemoryGrowthLimits& limits) {
+    memory_growth_limits_ = limits;
+  }
+
   bool IsInitialized() const { return initialized_; }
 
   // Getter for the sandbox_.
@@ -83,6 +94,16 @@ class TransactionBase {
     return sandbox_->Restart(true);
   }
 
+  // Like Restart(), but uses Sandbox::Reset(), which keeps the sandboxee
+  // running if possible. The same warning applies.
+  absl::Status Reset(uint64_t max_resident_bytes = 0) {
+    if (initialized_) {
+      Finish().IgnoreError();
+      initialized_ = false;
+    }
+    return sandbox_->Reset(max_resident_bytes);
+  }
+
  protected:
   explicit TransactionBase(std::unique_ptr<Sandbox> sandbox)
       : time_limit_(absl::ToTimeT(absl::UnixEpoch() + kDefaultTimeLimit)),
@@ -103,6 +124,10 @@ class TransactionBase {
   absl::Status RunTransactionFunctionInSandbox(
       const std::function<absl::Status()>& f);
 
+  // Terminates the sandbox if its memory usage grew beyond
+  // memory_growth_limits_, so that the next run starts a fresh one.
+  void TerminateIfMemoryGrew();
+
   // Initialization routine of the sandboxed process that will be called only
   // once upon sandboxee startup.
   virtual absl::Status Init() { return absl::OkStatus(); }
@@ -118,6 +143,9 @@ class TransactionBase {
   // wall-time limit.
   time_t time_limit_;
 
+  // Limits on the memory growth of the sandboxee, empty if unlimited.
+  MemoryGrowthLimits memory_growth_limits_;
+
   // Has Init() finished with success?
   bool initialized_ = false;
 
@@ -0,0 +1,269 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_TRANSACTION_EXECUTOR_H_
+#define SANDBOXED_API_TRANSACTION_EXECUTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>  // NOLINT(build/c++11)
+#include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/hash/hash.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/transaction.h"
+
+namespace sapi {
+
+struct TransactionExecutorOptions {
+  // Number of sandboxes, each of which runs one transaction at a time.
+  size_t num_sandboxes = 1;
+  // Number of times a failed transaction is retried, see
+  // TransactionBase::set_retry_count().
+  int retry_count = 1;
+  // Wall-time limit for a single try of a transaction.
+  absl::Duration time_limit = absl::Seconds(60);
+  // A sandbox is restarted after running this many transactions, so that they
+  // cannot leave too much state behind. 0 means never.
+  uint64_t transactions_per_sandbox = 0;
+  // A sandbox is restarted once its memory usage grew by more than this, see
+  // TransactionBase::set_memory_growth_limits(). This only restarts sandboxes
+  // that actually leak, unlike transactions_per_sandbox.
+  MemoryGrowthLimits memory_growth_limits;
+  // Transactions submitted with a key run on the sandbox the key hashes to,
+  // unless that one has more than this many transactions queued or running
+  // beyond the least loaded sandbox, which gets them instead.
+  size_t max_affinity_imbalance = 2;
+};
+
+// Runs transactions submitted from any thread on a fixed set of sandboxes of
+// type T. Each sandbox is driven by its own thread, which takes the oldest
+// submitted transaction whenever its sandbox becomes idle. Failed transactions
+// are retried like with BasicTransaction, after restarting the sandbox.
+// Transactions can also be submitted with a key, e.g. a language or a host,
+// to run them on the same sandbox as earlier ones with that key, so that they
+// find the state those left in the sandboxed library (a loaded dictionary, an
+// open connection, ...). Such state must still only be used as a cache, as
+// sandboxes are restarted and keys move under imbalance.
+//
+// Example:
+//   TransactionExecutor<SumSandbox> executor({.num_sandboxes = 4});
+//   std::future<absl::Status> done = executor.Submit([](SumSandbox* sandbox) {
+//     SumApi api(sandbox);
+//     return api.sum(1, 2).status();
+//   });
+//   SAPI_RETURN_IF_ERROR(done.get());
+template <typename T>
+class TransactionExecutor {
+ public:
+  static_assert(std::is_base_of_v<Sandbox, T>,
+                "Template argument must be a sapi::Sandbox");
+
+  using Factory = std::function<std::unique_ptr<T>()>;
+  // The body of a transaction. It may run several times, see retry_count.
+  using Function = std::function<absl::Status(T*)>;
+
+  explicit TransactionExecutor(TransactionExecutorOptions options,
+                               Factory factory = nullptr)
+      : options_(std::move(options)),
+        factory_(factory ? std::move(factory)
+                         : Factory([] { return std::make_unique<T>(); })) {
+    CHECK_GT(options_.num_sandboxes, 0);
+    // Not resized later, the workers refer to their entries.
+    workers_.resize(options_.num_sandboxes);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      workers_[i].thread =
+          std::thread(&TransactionExecutor::WorkerLoop, this, i);
+    }
+  }
+
+  TransactionExecutor(const TransactionExecutor&) = delete;
+  TransactionExecutor& operator=(const TransactionExecutor&) = delete;
+
+  // Finishes all submitted transactions before returning.
+  ~TransactionExecutor() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+    }
+    for (Worker& worker : workers_) {
+      worker.thread.join();
+    }
+  }
+
+  // Queues a transaction. The returned future becomes ready once it
+  // succeeded, or failed on its last try.
+  std::future<absl::Status> Submit(Function function) {
+    Task task{std::move(function), std::promise<absl::Status>()};
+    std::future<absl::Status> result = task.result.get_future();
+    absl::MutexLock lock(&mutex_);
+    task.sequence = next_sequence_++;
+    queue_.push_back(std::move(task));
+    return result;
+  }
+
+  // Like Submit(), but runs the transaction on the sandbox for `key`, see
+  // TransactionExecutorOptions::max_affinity_imbalance.
+  std::future<absl::Status> Submit(absl::string_view key, Function function) {
+    Task task{std::move(function), std::promise<absl::Status>()};
+    std::future<absl::Status> result = task.result.get_future();
+    absl::MutexLock lock(&mutex_);
+    task.sequence = next_sequence_++;
+    Worker& worker = workers_[PickWorkerLocked(key)];
+    worker.queue.push_back(std::move(task));
+    return result;
+  }
+
+  // Runs a transaction and waits for it to finish.
+  absl::Status Run(Function function) {
+    return Submit(std::move(function)).get();
+  }
+
+  // Runs a transaction on the sandbox for `key` and waits for it to finish.
+  absl::Status Run(absl::string_view key, Function function) {
+    return Submit(key, std::move(function)).get();
+  }
+
+ private:
+  struct Task {
+    Function function;
+    std::promise<absl::Status> result;
+    // Order of submission, so that workers take their own and the shared
+    // transactions first come, first served.
+    uint64_t sequence = 0;
+  };
+
+  struct Worker {
+    // Transactions submitted with a key for this worker.
+    std::deque<Task> queue;
+    bool busy = false;
+    std::thread thread;
+  };
+
+  size_t LoadLocked(const Worker& worker) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    return worker.queue.size() + (worker.busy ? 1 : 0);
+  }
+
+  // Returns the worker for transactions with `key`. The preferred one is
+  // chosen by rendezvous hashing, which spreads keys evenly and doesn't
+  // depend on the order of the workers.
+  size_t PickWorkerLocked(absl::string_view key) const
+      ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    size_t preferred = 0;
+    size_t least_loaded = 0;
+    size_t best_score = 0;
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      const size_t score = absl::HashOf(key, i);
+      if (i == 0 || score > best_score) {
+        best_score = score;
+        preferred = i;
+      }
+      if (LoadLocked(workers_[i]) < LoadLocked(workers_[least_loaded])) {
+        least_loaded = i;
+      }
+    }
+    if (LoadLocked(workers_[preferred]) >
+        LoadLocked(workers_[least_loaded]) + options_.max_affinity_imbalance) {
+      return least_loaded;
+    }
+    return preferred;
+  }
+
+  // Takes the oldest transaction of `worker` and the shared queue.
+  bool TakeTaskLocked(Worker& worker, Task* task)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    std::deque<Task>* from = nullptr;
+    if (!worker.queue.empty()) {
+      from = &worker.queue;
+    }
+    if (!queue_.empty() &&
+        (from == nullptr || queue_.front().sequence < from->front().sequence)) {
+      from = &queue_;
+    }
+    if (from == nullptr) {
+      return false;
+    }
+    *task = std::move(from->front());
+    from->pop_front();
+    return true;
+  }
+
+  void WorkerLoop(size_t index) {
+    BasicTransaction transaction(factory_());
+    transaction.set_retry_count(options_.retry_count);
+    transaction.SetTimeLimit(options_.time_limit);
+    transaction.set_memory_growth_limits(options_.memory_growth_limits);
+    uint64_t transactions = 0;
+    while (true) {
+      Task task;
+      {
+        absl::MutexLock lock(&mutex_);
+        Worker& worker = workers_[index];
+        worker.busy = false;
+        auto has_work = [this, &worker]() ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+          return stopping_ || !queue_.empty() || !worker.queue.empty();
+        };
+        mutex_.Await(absl::Condition(&has_work));
+        if (!TakeTaskLocked(worker, &task)) {
+          return;
+        }
+        worker.busy = true;
+      }
+      if (options_.transactions_per_sandbox != 0 &&
+          transactions == options_.transactions_per_sandbox) {
+        // Also has the transaction run its Init() again on the new sandboxee.
+        if (absl::Status status = transaction.Restart(); !status.ok()) {
+          LOG(WARNING) << "Restarting sandbox " << index
+                       << " failed, retrying on next use: " << status;
+        }
+        transactions = 0;
+      }
+      ++transactions;
+      task.result.set_value(transaction.Run([&task](Sandbox* sandbox) {
+        return task.function(static_cast<T*>(sandbox));
+      }));
+    }
+  }
+
+  const TransactionExecutorOptions options_;
+  const Factory factory_;
+
+  absl::Mutex mutex_;
+  // Transactions submitted without a key, for any worker.
+  std::deque<Task> queue_ ABSL_GUARDED_BY(mutex_);
+  uint64_t next_sequence_ ABSL_GUARDED_BY(mutex_) = 0;
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  // Started last, as they use all of the above. The queues and states of the
+  // workers are guarded by mutex_.
+  std::vector<Worker> workers_;
+};
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_TRANSACTION_EXECUTOR_H_
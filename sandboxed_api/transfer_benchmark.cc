@@ -0,0 +1,134 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures the bandwidth of TransferToSandboxee() and TransferFromSandboxee()
+// for buffers from 64 B to 4 GiB. "Cold" runs transfer into freshly allocated
+// sandboxee memory on every iteration, "warm" runs reuse the same allocation.
+// v::SharedArray is measured for comparison: its transfers are no-ops, so its
+// runs show what is left of a transfer once the memory is shared, and its cold
+// runs include mapping the memory into the sandboxee.
+// Needs about twice the largest size in free memory. Run with
+// `bazel run -c opt -- --benchmark_filter=...` to select a subset.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "benchmark/benchmark.h"
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "sandboxed_api/examples/stringop/sandbox.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/var_array.h"
+#include "sandboxed_api/var_lenval.h"
+#include "sandboxed_api/var_shared_array.h"
+
+namespace sapi {
+namespace {
+
+enum VarKind : int64_t {
+  kArray = 0,
+  kLenVal = 1,
+  kSharedArray = 2,
+};
+
+enum Direction : int64_t {
+  kToSandboxee = 0,
+  kFromSandboxee = 1,
+};
+
+constexpr int64_t kMinSize = 64;
+constexpr int64_t kMaxSize = int64_t{4} << 30;
+// Multi-threaded runs stop here, each thread has its own buffer.
+constexpr int64_t kMaxThreadedSize = 64 << 20;
+
+class TransferSandbox : public StringopSandbox {
+ public:
+  bool UseSharedArrays() const override { return true; }
+};
+
+// Shared by all benchmarks and threads, so that only the transfers are
+// measured.
+Sandbox* GetSandbox() {
+  static Sandbox* sandbox = [] {
+    auto* sandbox = new TransferSandbox();
+    CHECK_OK(sandbox->Init());
+    return sandbox;
+  }();
+  return sandbox;
+}
+
+std::unique_ptr<v::Var> CreateVar(int64_t kind, size_t size) {
+  if (kind == kLenVal) {
+    return std::make_unique<v::LenVal>(size);
+  }
+  if (kind == kSharedArray) {
+    return std::make_unique<v::SharedArray<uint8_t>>(size);
+  }
+  return std::make_unique<v::Array<uint8_t>>(size);
+}
+
+// Args: size, var kind, direction, cold (0/1).
+void BM_Transfer(benchmark::State& state) {
+  const size_t size = state.range(0);
+  const bool to_sandboxee = state.range(2) == kToSandboxee;
+  const bool cold = state.range(3);
+  Sandbox* sandbox = GetSandbox();
+  std::unique_ptr<v::Var> var = CreateVar(state.range(1), size);
+  CHECK_OK(sandbox->Allocate(var.get()));
+  for (auto _ : state) {
+    if (cold) {
+      state.PauseTiming();
+      CHECK_OK(sandbox->Free(var.get()));
+      CHECK_OK(sandbox->Allocate(var.get()));
+      state.ResumeTiming();
+    }
+    CHECK_OK(to_sandboxee ? sandbox->TransferToSandboxee(var.get())
+                          : sandbox->TransferFromSandboxee(var.get()));
+  }
+  CHECK_OK(sandbox->Free(var.get()));
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+void TransferArgs(benchmark::internal::Benchmark* b, int64_t max_size) {
+  b->ArgNames({"size", "var", "direction", "cold"});
+  for (int64_t size = kMinSize;; size = std::min(size * 64, max_size)) {
+    for (int64_t kind : {kArray, kLenVal, kSharedArray}) {
+      for (int64_t direction : {kToSandboxee, kFromSandboxee}) {
+        for (int64_t cold : {0, 1}) {
+          b->Args({size, kind, direction, cold});
+        }
+      }
+    }
+    if (size == max_size) {
+      break;
+    }
+  }
+}
+
+BENCHMARK(BM_Transfer)
+    ->Apply([](benchmark::internal::Benchmark* b) {
+      TransferArgs(b, kMaxSize);
+    })
+    ->UseRealTime();
+BENCHMARK(BM_Transfer)
+    ->Apply([](benchmark::internal::Benchmark* b) {
+      TransferArgs(b, kMaxThreadedSize);
+    })
+    ->ThreadRange(2, 8)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace sapi
@@ -15,17 +15,30 @@
 #include "sandboxed_api/util/fileops.h"
 
 #include <dirent.h>    // DIR
+#include <fcntl.h>
 #include <limits.h>    // PATH_MAX
+#include <linux/fs.h>  // FICLONE
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>  // stat64
+#include <sys/syscall.h>
 #include <unistd.h>
 
-#include <fstream>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
 #include "absl/strings/strip.h"
 #include "sandboxed_api/util/strerror.h"
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
 namespace sapi::file_util::fileops {
 
 FDCloser::~FDCloser() { Close(); }
@@ -220,6 +233,42 @@ bool ListDirectoryEntries(const std::string& directory,
   return true;
 }
 
+bool ForEachDirectoryEntry(int dirfd,
+                           absl::FunctionRef<bool(const char* name)> callback) {
+  // Layout of the records returned by getdents64(), which glibc only declares
+  // as struct dirent64 with _LARGEFILE64_SOURCE.
+  struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;  // NOLINT(runtime/int)
+    unsigned char d_type;
+    char d_name[];
+  };
+  alignas(LinuxDirent64) char buffer[4096];
+  while (true) {
+    ssize_t n = syscall(__NR_getdents64, dirfd, buffer, sizeof(buffer));
+    if (n == 0) {
+      return true;
+    }
+    if (n < 0) {
+      return false;
+    }
+    for (ssize_t offset = 0; offset < n;) {
+      const auto* entry =
+          reinterpret_cast<const LinuxDirent64*>(&buffer[offset]);
+      offset += entry->d_reclen;
+      const char* name = entry->d_name;
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        continue;
+      }
+      if (!callback(name)) {
+        return true;
+      }
+    }
+  }
+}
+
 bool CreateDirectoryRecursively(const std::string& path, int mode) {
   if (mkdir(path.c_str(), mode) == 0 || errno == EEXIST) {
     return true;
@@ -244,64 +293,145 @@ bool CreateDirectoryRecursively(const std::string& path, int mode) {
   return mkdir(path.c_str(), mode) == 0;
 }
 
+namespace {
+
+// Removes name relative to dirfd if it is not a directory or an empty one.
+// Sets *non_empty for a directory that still has entries instead.
+bool RemoveAt(int dirfd, const char* name, bool* non_empty) {
+  *non_empty = false;
+  if (unlinkat(dirfd, name, 0) == 0 || errno == ENOENT) {
+    return true;
+  }
+  if (errno != EISDIR) {
+    return false;
+  }
+  if (unlinkat(dirfd, name, AT_REMOVEDIR) == 0 || errno == ENOENT) {
+    return true;
+  }
+  if (errno != ENOTEMPTY && errno != EEXIST) {
+    return false;
+  }
+  *non_empty = true;
+  return true;
+}
+
+}  // namespace
+
 bool DeleteRecursively(const std::string& filename) {
-  std::vector<std::string> to_delete;
-  to_delete.push_back(filename);
-
-  while (!to_delete.empty()) {
-    const std::string delfile = to_delete.back();
-
-    struct stat64 st;
-    if (lstat64(delfile.c_str(), &st) == -1) {
-      if (errno == ENOENT) {
-        // Most likely the first file. Either that or someone is deleting the
-        // files out from under us.
-        to_delete.pop_back();
-        continue;
-      }
-      return false;
-    }
+  bool non_empty;
+  if (!RemoveAt(AT_FDCWD, filename.c_str(), &non_empty)) {
+    return false;
+  }
+  if (!non_empty) {
+    return true;
+  }
 
-    if (S_ISDIR(st.st_mode)) {
-      if (rmdir(delfile.c_str()) != 0 && errno != ENOENT) {
-        if (errno == ENOTEMPTY) {
-          std::string error;
-          std::vector<std::string> entries;
-          if (!ListDirectoryEntries(delfile, &entries, &error)) {
+  // Directories are walked with fd-relative calls, so that no paths are built
+  // and the recursion does not grow the call stack. Whenever a directory that
+  // still has entries is found, it is descended into and its parent is
+  // listed again once it has been emptied.
+  std::vector<FDCloser> dirs;
+  dirs.emplace_back(
+      open(filename.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+  if (dirs.back().get() == -1) {
+    return false;
+  }
+  std::string sub_dir;
+  while (!dirs.empty()) {
+    const int dirfd = dirs.back().get();
+    bool failed = false;
+    sub_dir.clear();
+    if (lseek(dirfd, 0, SEEK_SET) == -1 ||
+        !ForEachDirectoryEntry(dirfd, [&](const char* name) {
+          bool non_empty;
+          if (!RemoveAt(dirfd, name, &non_empty)) {
+            failed = true;
             return false;
           }
-          for (const auto& entry : entries) {
-            to_delete.push_back(delfile + "/" + entry);
+          if (non_empty) {
+            sub_dir = name;
+            return false;
           }
-        } else {
-          return false;
-        }
-      } else {
-        to_delete.pop_back();
+          return true;
+        }) ||
+        failed) {
+      return false;
+    }
+    if (sub_dir.empty()) {
+      // Empty now, it is removed when listing its parent again.
+      dirs.pop_back();
+      continue;
+    }
+    dirs.emplace_back(openat(dirfd, sub_dir.c_str(),
+                             O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (dirs.back().get() == -1) {
+      return false;
+    }
+  }
+  return rmdir(filename.c_str()) == 0 || errno == ENOENT;
+}
+
+namespace {
+
+// Copies the rest of in to out, starting at their current offsets.
+bool CopyFileContents(int in, int out) {
+  struct stat64 st;
+  if (fstat64(in, &st) == -1) {
+    return false;
+  }
+  // Files in /proc and /sys report a size of 0 and do not support the
+  // in-kernel copies reliably, those are only read.
+  if (S_ISREG(st.st_mode) && st.st_size > 0) {
+    // Shares the extents of the file on filesystems supporting it.
+    if (ioctl(out, FICLONE, in) == 0) {
+      return true;
+    }
+    off64_t copied = 0;
+    while (copied < st.st_size) {
+      ssize_t n = copy_file_range(in, nullptr, out, nullptr,
+                                  st.st_size - copied, /*flags=*/0);
+      if (n <= 0) {
+        break;
       }
-    } else {
-      if (unlink(delfile.c_str()) != 0 && errno != ENOENT) {
-        return false;
+      copied += n;
+    }
+    // Unsupported for this pair of files, e.g. on older kernels.
+    while (copied < st.st_size) {
+      ssize_t n = sendfile(out, in, nullptr, st.st_size - copied);
+      if (n <= 0) {
+        break;
       }
-      to_delete.pop_back();
+      copied += n;
+    }
+  }
+  // Copies what is left, also if the file grew in the meantime.
+  char buffer[16 << 10];
+  while (true) {
+    ssize_t n = TEMP_FAILURE_RETRY(read(in, buffer, sizeof(buffer)));
+    if (n == 0) {
+      return true;
+    }
+    if (n < 0 || !WriteToFD(out, buffer, n)) {
+      return false;
     }
   }
-  return true;
 }
 
+}  // namespace
+
 bool CopyFile(const std::string& old_path, const std::string& new_path,
               int new_mode) {
-  {
-    std::ifstream input(old_path, std::ios_base::binary);
-    std::ofstream output(new_path,
-                         std::ios_base::trunc | std::ios_base::binary);
-    output << input.rdbuf();
-    output.close();
-    if (!input || !output) {
-      return false;
-    }
+  FDCloser input(open(old_path.c_str(), O_RDONLY | O_CLOEXEC));
+  if (input.get() == -1) {
+    return false;
+  }
+  FDCloser output(open(new_path.c_str(),
+                       O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+  if (output.get() == -1) {
+    return false;
   }
-  return chmod(new_path.c_str(), new_mode) == 0;
+  return CopyFileContents(input.get(), output.get()) &&
+         fchmod(output.get(), new_mode) == 0;
 }
 
 bool WriteToFD(int fd, const char* data, size_t size) {
@@ -19,6 +19,7 @@
 #include <utility>
 #include <vector>
 
+#include "absl/functional/function_ref.h"
 #include "absl/strings/string_view.h"
 
 namespace sapi::file_util::fileops {
@@ -89,6 +90,13 @@ bool ListDirectoryEntries(const std::string& directory,
                           std::vector<std::string>* entries,
                           std::string* error);
 
+// Calls callback with the basename of every file in the directory opened as
+// dirfd, reading them with getdents64() into a buffer on the stack. Unlike
+// ListDirectoryEntries(), nothing is allocated. Stops early if callback
+// returns false. On error, false is returned and errno is set.
+bool ForEachDirectoryEntry(int dirfd,
+                           absl::FunctionRef<bool(const char* name)> callback);
+
 // Recursively creates a directory, skipping segments that already exist.
 bool CreateDirectoryRecursively(const std::string& path, int mode);
 
@@ -98,6 +106,7 @@ bool DeleteRecursively(const std::string& filename);
 // Copies a file from one location to another. The file will be overwritten  if
 // it already exists. If it does not exist, its mode will be new_mode. Returns
 // true on success. On failure, a partial copy of the file may remain.
+// Regular files are cloned or copied in the kernel where possible.
 bool CopyFile(const std::string& old_path, const std::string& new_path,
               int new_mode);
 
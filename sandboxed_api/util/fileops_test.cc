@@ -52,8 +52,10 @@ using ::testing::IsEmpty;
 using ::testing::IsFalse;
 using ::testing::IsTrue;
 using ::testing::Ne;
+using ::testing::Not;
 using ::testing::SizeIs;
 using ::testing::StrEq;
+using ::testing::UnorderedElementsAreArray;
 
 class FileOpsTest : public testing::Test {
  protected:
@@ -193,6 +195,62 @@ TEST_F(FileOpsTest, ListDirectoryEntriesTest) {
   }
 }
 
+TEST_F(FileOpsTest, ForEachDirectoryEntryTest) {
+  ASSERT_THAT(mkdir("new_dir", 0700), Eq(0));
+  // Enough entries to need several getdents64() calls.
+  constexpr int kNumFiles = 500;
+  for (int i = 0; i < kNumFiles; ++i) {
+    ASSERT_THAT(file::SetContents(absl::StrCat("new_dir/file", i), "",
+                                  file::Defaults()),
+                IsOk());
+  }
+
+  fileops::FDCloser dirfd(open("new_dir", O_RDONLY | O_DIRECTORY));
+  ASSERT_THAT(dirfd.get(), Ne(-1));
+  std::vector<std::string> files;
+  EXPECT_THAT(fileops::ForEachDirectoryEntry(dirfd.get(),
+                                             [&files](const char* name) {
+                                               files.push_back(name);
+                                               return true;
+                                             }),
+              IsTrue());
+
+  fileops::DeleteRecursively("new_dir");
+
+  std::vector<std::string> expected;
+  for (int i = 0; i < kNumFiles; ++i) {
+    expected.push_back(absl::StrCat("file", i));
+  }
+  EXPECT_THAT(files, UnorderedElementsAreArray(expected));
+}
+
+TEST_F(FileOpsTest, ForEachDirectoryEntryStopsEarlyTest) {
+  ASSERT_THAT(mkdir("new_dir", 0700), Eq(0));
+  ASSERT_THAT(file::SetContents("new_dir/first", "", file::Defaults()), IsOk());
+  ASSERT_THAT(file::SetContents("new_dir/second", "", file::Defaults()),
+              IsOk());
+
+  fileops::FDCloser dirfd(open("new_dir", O_RDONLY | O_DIRECTORY));
+  ASSERT_THAT(dirfd.get(), Ne(-1));
+  int calls = 0;
+  EXPECT_THAT(fileops::ForEachDirectoryEntry(dirfd.get(),
+                                             [&calls](const char* name) {
+                                               ++calls;
+                                               return false;
+                                             }),
+              IsTrue());
+  EXPECT_THAT(calls, Eq(1));
+
+  fileops::DeleteRecursively("new_dir");
+}
+
+TEST_F(FileOpsTest, ForEachDirectoryEntryFailTest) {
+  EXPECT_THAT(fileops::ForEachDirectoryEntry(
+                  -1, [](const char* name) { return true; }),
+              IsFalse());
+  EXPECT_THAT(errno, Eq(EBADF));
+}
+
 TEST_F(FileOpsTest, RemoveLastPathComponentTest) {
   std::string result;
 
@@ -382,6 +440,27 @@ TEST_F(FileOpsTest, DeleteRecursivelyTest) {
   EXPECT_THAT(fileops::DeleteRecursively("foo"), IsTrue());
 }
 
+TEST_F(FileOpsTest, DeleteRecursivelyTreeTest) {
+  ASSERT_THAT(chdir(GetTestTempPath().c_str()), Eq(0));
+  std::string path = "tree";
+  for (int depth = 0; depth < 20; ++depth) {
+    ASSERT_THAT(mkdir(path.c_str(), 0700), Eq(0));
+    for (int i = 0; i < 50; ++i) {
+      ASSERT_THAT(file::SetContents(absl::StrCat(path, "/file", i), "",
+                                    file::Defaults()),
+                  IsOk());
+    }
+    ASSERT_THAT(symlink("/", absl::StrCat(path, "/link").c_str()), Eq(0));
+    ASSERT_THAT(mkdir(absl::StrCat(path, "/empty").c_str(), 0700), Eq(0));
+    absl::StrAppend(&path, "/sub");
+  }
+
+  EXPECT_THAT(fileops::DeleteRecursively("tree"), IsTrue());
+  struct stat64 st;
+  EXPECT_THAT(lstat64("tree", &st), Ne(0));
+  EXPECT_THAT(errno, Eq(ENOENT));
+}
+
 TEST_F(FileOpsTest, ReadLinkAbsoluteTest) {
   const auto tmp_dir = GetTestTempPath();
   ASSERT_THAT(chdir(tmp_dir.c_str()), Eq(0));
@@ -433,5 +512,41 @@ TEST_F(FileOpsTest, CopyFileTest) {
   unlink((absl::StrCat(tmp_dir, "/test2")).c_str());
 }
 
+TEST_F(FileOpsTest, CopyFileLargeTest) {
+  const auto tmp_dir = GetTestTempPath();
+  const std::string source = absl::StrCat(tmp_dir, "/large");
+  const std::string target = absl::StrCat(tmp_dir, "/large2");
+  std::string contents;
+  for (int i = 0; contents.size() < (4 << 20); ++i) {
+    absl::StrAppend(&contents, i, "\n");
+  }
+  ASSERT_THAT(file::SetContents(source, contents, file::Defaults()), IsOk());
+  // Overwrites a longer existing file.
+  ASSERT_THAT(file::SetContents(target, contents + contents, file::Defaults()),
+              IsOk());
+  EXPECT_THAT(fileops::CopyFile(source, target, 0600), IsTrue());
+
+  std::string text;
+  EXPECT_THAT(file::GetContents(target, &text, file::Defaults()), IsOk());
+  EXPECT_THAT(text == contents, IsTrue());
+  struct stat64 st;
+  ASSERT_THAT(stat64(target.c_str(), &st), Eq(0));
+  EXPECT_THAT(st.st_mode & 0777, Eq(0600));
+
+  unlink(source.c_str());
+  unlink(target.c_str());
+}
+
+TEST_F(FileOpsTest, CopyFileFromProcTest) {
+  const std::string target = absl::StrCat(GetTestTempPath(), "/maps");
+  EXPECT_THAT(fileops::CopyFile("/proc/self/maps", target, 0600), IsTrue());
+
+  std::string text;
+  EXPECT_THAT(file::GetContents(target, &text, file::Defaults()), IsOk());
+  EXPECT_THAT(text, Not(IsEmpty()));
+
+  unlink(target.c_str());
+}
+
 }  // namespace
 }  // namespace sapi::file_util
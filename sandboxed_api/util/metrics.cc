@@ -0,0 +1,64 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/util/metrics.h"
+
+#include <atomic>
+#include <cstdint>
+
+#include "absl/base/attributes.h"
+#include "absl/strings/string_view.h"
+
+namespace sapi {
+namespace {
+
+ABSL_CONST_INIT std::atomic<MetricsSink*> metrics_sink = nullptr;
+
+MetricsSink* GetSink() {
+  return metrics_sink.load(std::memory_order_acquire);
+}
+
+}  // namespace
+
+void SetMetricsSink(MetricsSink* sink) {
+  metrics_sink.store(sink, std::memory_order_release);
+}
+
+namespace metrics {
+
+bool Enabled() { return GetSink() != nullptr; }
+
+void IncrementCounter(absl::string_view name, absl::string_view label,
+                      int64_t delta) {
+  if (MetricsSink* sink = GetSink(); sink != nullptr) {
+    sink->IncrementCounter(name, label, delta);
+  }
+}
+
+void AddToGauge(absl::string_view name, absl::string_view label,
+                int64_t delta) {
+  if (MetricsSink* sink = GetSink(); sink != nullptr) {
+    sink->AddToGauge(name, label, delta);
+  }
+}
+
+void RecordDistribution(absl::string_view name, absl::string_view label,
+                        double value) {
+  if (MetricsSink* sink = GetSink(); sink != nullptr) {
+    sink->RecordDistribution(name, label, value);
+  }
+}
+
+}  // namespace metrics
+}  // namespace sapi
@@ -0,0 +1,123 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Process-wide metrics of Sandbox2 and SAPI, for exporting to a monitoring
+// system. Nothing is recorded until a sink is installed with SetMetricsSink().
+
+#ifndef SANDBOXED_API_UTIL_METRICS_H_
+#define SANDBOXED_API_UTIL_METRICS_H_
+
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace sapi {
+
+// Receives the metrics, to be implemented on top of e.g. Prometheus or
+// OpenTelemetry. Metrics are identified by name and a single label, which is
+// empty for metrics without one. All methods may be called concurrently from
+// any thread, including monitor threads, so they should be cheap.
+class MetricsSink {
+ public:
+  virtual ~MetricsSink() = default;
+
+  // Adds delta (> 0) to a monotonic counter.
+  virtual void IncrementCounter(absl::string_view name, absl::string_view label,
+                                int64_t delta) = 0;
+
+  // Adds delta to a gauge, which goes up and down.
+  virtual void AddToGauge(absl::string_view name, absl::string_view label,
+                          int64_t delta) = 0;
+
+  // Records a sample of a distribution, e.g. a latency, for a histogram.
+  virtual void RecordDistribution(absl::string_view name,
+                                  absl::string_view label, double value) = 0;
+};
+
+// Installs the process-wide sink, which must outlive all sandboxes, or
+// removes it with nullptr. Not owned.
+void SetMetricsSink(MetricsSink* sink);
+
+namespace metrics {
+
+// Gauge of the sandboxees being monitored, by monitor ("ptrace", "unotify").
+constexpr absl::string_view kActiveSandboxes = "sandbox2/active_sandboxes";
+// Seconds from launching a sandboxee until it runs sandboxed, by monitor.
+constexpr absl::string_view kSpawnLatency = "sandbox2/spawn_latency";
+// Sandboxees that finished, by Result::StatusEnumToString().
+constexpr absl::string_view kSandboxResults = "sandbox2/results";
+// Policy violations, by syscall name, or "network" for network violations.
+constexpr absl::string_view kViolations = "sandbox2/violations";
+// Requests sent to forkservers, and their latency in seconds.
+constexpr absl::string_view kForkRequests = "sandbox2/fork_requests";
+constexpr absl::string_view kForkRequestLatency =
+    "sandbox2/fork_request_latency";
+// Starts of the global forkserver, including restarts.
+constexpr absl::string_view kGlobalForkServerStarts =
+    "sandbox2/global_forkserver_starts";
+// Calls into SAPI libraries by function name, their latency in seconds, and
+// the number that failed.
+constexpr absl::string_view kRpcCalls = "sapi/rpc_calls";
+constexpr absl::string_view kRpcLatency = "sapi/rpc_latency";
+constexpr absl::string_view kRpcErrors = "sapi/rpc_errors";
+// Bytes copied into and out of sandboxees, by direction ("to_sandboxee",
+// "from_sandboxee").
+constexpr absl::string_view kBytesTransferred = "sapi/bytes_transferred";
+// Restarts of SAPI sandboxes.
+constexpr absl::string_view kRestarts = "sapi/restarts";
+// Calls answered by a CallCache, and those that were not, by function name.
+constexpr absl::string_view kCallCacheHits = "sapi/call_cache_hits";
+constexpr absl::string_view kCallCacheMisses = "sapi/call_cache_misses";
+// Seconds to thaw frozen sandboxes leased from a SandboxPool.
+constexpr absl::string_view kPoolThawLatency = "sapi/pool_thaw_latency";
+
+// Returns whether a sink is installed, to skip work only done for metrics.
+bool Enabled();
+
+void IncrementCounter(absl::string_view name, absl::string_view label = "",
+                      int64_t delta = 1);
+void AddToGauge(absl::string_view name, absl::string_view label,
+                int64_t delta);
+void RecordDistribution(absl::string_view name, absl::string_view label,
+                        double value);
+
+// Records the time between construction and destruction as a distribution, in
+// seconds.
+class ScopedLatency {
+ public:
+  ScopedLatency(absl::string_view name, absl::string_view label)
+      : name_(name),
+        label_(label),
+        start_(Enabled() ? absl::Now() : absl::InfinitePast()) {}
+  ScopedLatency(const ScopedLatency&) = delete;
+  ScopedLatency& operator=(const ScopedLatency&) = delete;
+  ~ScopedLatency() {
+    if (start_ != absl::InfinitePast()) {
+      RecordDistribution(name_, label_,
+                         absl::ToDoubleSeconds(absl::Now() - start_));
+    }
+  }
+
+ private:
+  absl::string_view name_;
+  absl::string_view label_;
+  absl::Time start_;
+};
+
+}  // namespace metrics
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_UTIL_METRICS_H_
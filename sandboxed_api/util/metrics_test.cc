@@ -0,0 +1,82 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/util/metrics.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/strings/string_view.h"
+
+namespace sapi {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using ::testing::SizeIs;
+
+class FakeSink : public MetricsSink {
+ public:
+  void IncrementCounter(absl::string_view name, absl::string_view label,
+                        int64_t delta) override {
+    counters[{std::string(name), std::string(label)}] += delta;
+  }
+  void AddToGauge(absl::string_view name, absl::string_view label,
+                  int64_t delta) override {
+    gauges[{std::string(name), std::string(label)}] += delta;
+  }
+  void RecordDistribution(absl::string_view name, absl::string_view label,
+                          double value) override {
+    distributions[{std::string(name), std::string(label)}].push_back(value);
+  }
+
+  using Key = std::pair<std::string, std::string>;
+  std::map<Key, int64_t> counters;
+  std::map<Key, int64_t> gauges;
+  std::map<Key, std::vector<double>> distributions;
+};
+
+TEST(MetricsTest, NothingIsRecordedWithoutSink) {
+  EXPECT_FALSE(metrics::Enabled());
+  metrics::IncrementCounter(metrics::kRpcCalls, "fn");
+  { metrics::ScopedLatency latency(metrics::kRpcLatency, "fn"); }
+}
+
+TEST(MetricsTest, ForwardsToSink) {
+  FakeSink sink;
+  SetMetricsSink(&sink);
+  EXPECT_TRUE(metrics::Enabled());
+  metrics::IncrementCounter(metrics::kRpcCalls, "fn");
+  metrics::IncrementCounter(metrics::kRpcCalls, "fn", 2);
+  metrics::AddToGauge(metrics::kActiveSandboxes, "ptrace", 1);
+  metrics::AddToGauge(metrics::kActiveSandboxes, "ptrace", -1);
+  { metrics::ScopedLatency latency(metrics::kRpcLatency, "fn"); }
+  SetMetricsSink(nullptr);
+  metrics::IncrementCounter(metrics::kRpcCalls, "fn");
+
+  EXPECT_THAT(sink.counters,
+              ElementsAre(Pair(Pair("sapi/rpc_calls", "fn"), 3)));
+  EXPECT_THAT(sink.gauges,
+              ElementsAre(Pair(Pair("sandbox2/active_sandboxes", "ptrace"), 0)));
+  EXPECT_THAT(sink.distributions,
+              ElementsAre(Pair(Pair("sapi/rpc_latency", "fn"), SizeIs(1))));
+}
+
+}  // namespace
+}  // namespace sapi
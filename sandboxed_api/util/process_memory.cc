@@ -0,0 +1,59 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/util/process_memory.h"
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "sandboxed_api/util/file_helpers.h"
+
+namespace sapi {
+
+absl::StatusOr<uint64_t> GetResidentMemoryBytes(pid_t pid) {
+  std::string status;
+  if (absl::Status read = file::GetContents(
+          absl::StrCat("/proc/", pid, "/status"), &status, file::Defaults());
+      !read.ok()) {
+    return read;
+  }
+  for (absl::string_view line : absl::StrSplit(status, '\n')) {
+    if (!absl::ConsumePrefix(&line, "VmRSS:")) {
+      continue;
+    }
+    // The value is given in kB, e.g. "   1234 kB".
+    std::vector<absl::string_view> parts =
+        absl::StrSplit(line, absl::ByAnyChar(" \t"), absl::SkipEmpty());
+    uint64_t kib;
+    if (parts.size() != 2 || parts[1] != "kB" ||
+        !absl::SimpleAtoi(parts[0], &kib)) {
+      break;
+    }
+    return kib * 1024;
+  }
+  return absl::InternalError(
+      absl::StrCat("Could not get resident memory of pid ", pid));
+}
+
+}  // namespace sapi
@@ -0,0 +1,31 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_UTIL_PROCESS_MEMORY_H_
+#define SANDBOXED_API_UTIL_PROCESS_MEMORY_H_
+
+#include <sys/types.h>
+
+#include <cstdint>
+
+#include "absl/status/statusor.h"
+
+namespace sapi {
+
+// Returns the resident memory of the process with the given pid, in bytes.
+absl::StatusOr<uint64_t> GetResidentMemoryBytes(pid_t pid);
+
+}  // namespace sapi
+
+#endif  // SANDBOXED_API_UTIL_PROCESS_MEMORY_H_
@@ -0,0 +1,44 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/util/process_memory.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "sandboxed_api/util/status_matchers.h"
+
+namespace sapi {
+namespace {
+
+using ::sapi::IsOk;
+using ::testing::Gt;
+using ::testing::Not;
+
+TEST(ProcessMemoryTest, ReturnsResidentMemoryOfSelf) {
+  absl::StatusOr<uint64_t> resident = GetResidentMemoryBytes(getpid());
+  ASSERT_THAT(resident, IsOk());
+  EXPECT_THAT(*resident, Gt(0));
+}
+
+TEST(ProcessMemoryTest, FailsForMissingProcess) {
+  EXPECT_THAT(GetResidentMemoryBytes(-1), Not(IsOk()));
+}
+
+}  // namespace
+}  // namespace sapi
@@ -18,23 +18,145 @@
 
 #include <sys/uio.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
 
 #include "absl/log/log.h"
+#include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/util/metrics.h"
 #include "sandboxed_api/util/raw_logging.h"
 #include "sandboxed_api/util/status_macros.h"
 #include "sandboxed_api/var_ptr.h"
 
 namespace sapi::v {
+namespace {
+
+constexpr size_t kMaxTransferThreads = 4;
+
+// Copies `size` bytes between local and remote memory with a single
+// process_vm_writev() or process_vm_readv(), depending on `to_sandboxee`.
+ssize_t TransferChunk(pid_t pid, void* local, void* remote, size_t size,
+                      bool to_sandboxee) {
+  struct iovec local_iov = {.iov_base = local, .iov_len = size};
+  struct iovec remote_iov = {.iov_base = remote, .iov_len = size};
+  return to_sandboxee
+             ? process_vm_writev(pid, &local_iov, 1, &remote_iov, 1, 0)
+             : process_vm_readv(pid, &local_iov, 1, &remote_iov, 1, 0);
+}
+
+void RecordTransferredBytes(ssize_t bytes, bool to_sandboxee) {
+  if (bytes > 0) {
+    sapi::metrics::IncrementCounter(
+        sapi::metrics::kBytesTransferred,
+        to_sandboxee ? "to_sandboxee" : "from_sandboxee", bytes);
+  }
+}
+
+// Like TransferChunk(), but splits large transfers between threads. Returns
+// what a single syscall would: -1 with errno set if any part failed,
+// otherwise the number of bytes transferred up to the first short part.
+// Goes through `rpc_channel` instead if it is set up to transfer memory, or
+// copies directly if it is served in process.
+ssize_t TransferMemory(RPCChannel* rpc_channel, pid_t pid, void* local,
+                       void* remote, size_t size, bool to_sandboxee) {
+  if (rpc_channel != nullptr && rpc_channel->in_process()) {
+    if (to_sandboxee) {
+      memcpy(remote, local, size);
+    } else {
+      memcpy(local, remote, size);
+    }
+    RecordTransferredBytes(size, to_sandboxee);
+    return size;
+  }
+  if (rpc_channel != nullptr && rpc_channel->transfer_over_comms()) {
+    absl::Status status =
+        to_sandboxee ? rpc_channel->WriteMemory(remote, local, size)
+                     : rpc_channel->ReadMemory(remote, local, size);
+    if (!status.ok()) {
+      LOG(WARNING) << "Transfer through the RPC channel failed: " << status;
+      errno = EIO;
+      return -1;
+    }
+    RecordTransferredBytes(size, to_sandboxee);
+    return size;
+  }
+  const size_t num_chunks = std::min<size_t>(
+      {size / Var::kParallelTransferChunkSize, kMaxTransferThreads,
+       std::max(std::thread::hardware_concurrency(), 1u)});
+  if (num_chunks <= 1) {
+    ssize_t ret = TransferChunk(pid, local, remote, size, to_sandboxee);
+    RecordTransferredBytes(ret, to_sandboxee);
+    return ret;
+  }
+
+  const size_t chunk_size = (size + num_chunks - 1) / num_chunks;
+  std::vector<ssize_t> results(num_chunks);
+  std::vector<int> errnos(num_chunks);
+  auto transfer = [&](size_t i) {
+    const size_t offset = i * chunk_size;
+    results[i] = TransferChunk(
+        pid, static_cast<uint8_t*>(local) + offset,
+        static_cast<uint8_t*>(remote) + offset,
+        std::min(chunk_size, size - offset), to_sandboxee);
+    errnos[i] = errno;
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_chunks - 1);
+  for (size_t i = 1; i < num_chunks; ++i) {
+    threads.emplace_back(transfer, i);
+  }
+  transfer(0);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < num_chunks; ++i) {
+    if (results[i] == -1) {
+      errno = errnos[i];
+      return -1;
+    }
+  }
+  ssize_t total = 0;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    total += results[i];
+    if (results[i] != std::min(chunk_size, size - i * chunk_size)) {
+      break;
+    }
+  }
+  RecordTransferredBytes(total, to_sandboxee);
+  return total;
+}
+
+}  // namespace
+
 
 Var::~Var() {
-  if (free_rpc_channel_ && GetRemote()) {
-    this->Free(free_rpc_channel_).IgnoreError();
+  if (RPCChannel* rpc_channel = GetFreeRPCChannel();
+      rpc_channel && GetRemote()) {
+    this->Free(rpc_channel).IgnoreError();
   }
 }
 
+void Var::SetFreeRPCChannel(RPCChannel* rpc_channel) {
+  free_rpc_channel_ = rpc_channel;
+  free_rpc_channel_generation_ = rpc_channel ? rpc_channel->generation() : 0;
+}
+
+RPCChannel* Var::GetFreeRPCChannel() const {
+  if (free_rpc_channel_ == nullptr ||
+      !RPCChannel::IsLive(free_rpc_channel_generation_)) {
+    return nullptr;
+  }
+  return free_rpc_channel_;
+}
+
 void Var::PtrDeleter::operator()(Ptr* p) { delete p; }
 
 Ptr* Var::PtrNone() {
@@ -99,17 +221,13 @@ absl::Status Var::TransferToSandboxee(RPCChannel* rpc_channel, pid_t pid) {
     return absl::FailedPreconditionError(
         absl::StrCat("Object: ", GetType(), " has no remote object set"));
   }
+  if (!NeedsTransferToSandboxee(pid)) {
+    VLOG(3) << "TransferToSandboxee: unmodified, skipping";
+    return absl::OkStatus();
+  }
 
-  struct iovec local = {
-      .iov_base = GetLocal(),
-      .iov_len = GetSize(),
-  };
-  struct iovec remote = {
-      .iov_base = GetRemote(),
-      .iov_len = GetSize(),
-  };
-
-  ssize_t ret = process_vm_writev(pid, &local, 1, &remote, 1, 0);
+  ssize_t ret = TransferMemory(rpc_channel, pid, GetLocal(), GetRemote(),
+                               GetSize(), /*to_sandboxee=*/true);
   if (ret == -1) {
     PLOG(WARNING) << "process_vm_writev(pid: " << pid
                   << " laddr: " << GetLocal() << " raddr: " << GetRemote()
@@ -123,6 +241,7 @@ absl::Status Var::TransferToSandboxee(RPCChannel* rpc_channel, pid_t pid) {
     return absl::UnavailableError("process_vm_writev: partial success");
   }
 
+  MarkSynchronized(pid);
   return absl::OkStatus();
 }
 
@@ -136,16 +255,8 @@ absl::Status Var::TransferFromSandboxee(RPCChannel* rpc_channel, pid_t pid) {
         absl::StrCat("Object: ", GetType(), " has no local storage set"));
   }
 
-  struct iovec local = {
-      .iov_base = GetLocal(),
-      .iov_len = GetSize(),
-  };
-  struct iovec remote = {
-      .iov_base = GetRemote(),
-      .iov_len = GetSize(),
-  };
-
-  ssize_t ret = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+  ssize_t ret = TransferMemory(rpc_channel, pid, GetLocal(), GetRemote(),
+                               GetSize(), /*to_sandboxee=*/false);
   if (ret == -1) {
     PLOG(WARNING) << "process_vm_readv(pid: " << pid << " laddr: " << GetLocal()
                   << " raddr: " << GetRemote() << " size: " << GetSize() << ")";
@@ -158,6 +269,144 @@ absl::Status Var::TransferFromSandboxee(RPCChannel* rpc_channel, pid_t pid) {
     return absl::UnavailableError("process_vm_readv succeeded partially");
   }
 
+  MarkSynchronized(pid);
+  return absl::OkStatus();
+}
+
+absl::Status Var::TransferRangeToSandboxee(RPCChannel* rpc_channel,
+                                          pid_t pid, size_t offset,
+                                          size_t length) {
+  VLOG(3) << "TransferRangeToSandboxee for: " << ToString()
+          << ", offset: " << offset << ", length: " << length;
+
+  struct iovec local;
+  struct iovec remote;
+  SAPI_RETURN_IF_ERROR(GetTransferRange(offset, length, &local, &remote));
+  if (length == 0) {
+    return absl::OkStatus();
+  }
+  ssize_t ret = TransferMemory(rpc_channel, pid, local.iov_base,
+                               remote.iov_base, length, /*to_sandboxee=*/true);
+  if (ret == -1) {
+    PLOG(WARNING) << "process_vm_writev(pid: " << pid
+                  << " laddr: " << local.iov_base
+                  << " raddr: " << remote.iov_base << " size: " << length
+                  << ")";
+    return absl::UnavailableError("process_vm_writev failed");
+  }
+  if (ret != length) {
+    LOG(WARNING) << "process_vm_writev(pid: " << pid
+                 << " laddr: " << local.iov_base
+                 << " raddr: " << remote.iov_base << " size: " << length
+                 << ")" << " transferred " << ret << " bytes";
+    return absl::UnavailableError("process_vm_writev: partial success");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Var::TransferRangeFromSandboxee(RPCChannel* rpc_channel,
+                                            pid_t pid, size_t offset,
+                                            size_t length) {
+  VLOG(3) << "TransferRangeFromSandboxee for: " << ToString()
+          << ", offset: " << offset << ", length: " << length;
+
+  struct iovec local;
+  struct iovec remote;
+  SAPI_RETURN_IF_ERROR(GetTransferRange(offset, length, &local, &remote));
+  if (length == 0) {
+    return absl::OkStatus();
+  }
+  ssize_t ret = TransferMemory(rpc_channel, pid, local.iov_base,
+                               remote.iov_base, length,
+                               /*to_sandboxee=*/false);
+  if (ret == -1) {
+    PLOG(WARNING) << "process_vm_readv(pid: " << pid
+                  << " laddr: " << local.iov_base
+                  << " raddr: " << remote.iov_base << " size: " << length
+                  << ")";
+    return absl::UnavailableError("process_vm_readv failed");
+  }
+  if (ret != length) {
+    LOG(WARNING) << "process_vm_readv(pid: " << pid
+                 << " laddr: " << local.iov_base
+                 << " raddr: " << remote.iov_base << " size: " << length
+                 << ")" << " transferred " << ret << " bytes";
+    return absl::UnavailableError("process_vm_readv succeeded partially");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Var::GetTransferRange(size_t offset, size_t length,
+                                   struct iovec* local,
+                                   struct iovec* remote) const {
+  if (!GetTransferRegion(local, remote)) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Object: ", GetType(),
+                     " has no storage set or can't be transferred in parts"));
+  }
+  if (offset > local->iov_len || length > local->iov_len - offset) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Range [", offset, ", ", offset, " + ", length,
+                     ") exceeds object size ", local->iov_len));
+  }
+  *local = {.iov_base = static_cast<uint8_t*>(local->iov_base) + offset,
+            .iov_len = length};
+  *remote = {.iov_base = static_cast<uint8_t*>(remote->iov_base) + offset,
+             .iov_len = length};
+  return absl::OkStatus();
+}
+
+bool Var::GetTransferRegion(struct iovec* local, struct iovec* remote) const {
+  // Leave reporting of missing storage to the individual transfer.
+  if (local_ == nullptr || remote_ == nullptr) {
+    return false;
+  }
+  *local = {.iov_base = GetLocal(), .iov_len = GetSize()};
+  *remote = {.iov_base = GetRemote(), .iov_len = GetSize()};
+  return true;
+}
+
+absl::Status Var::AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                                  pid_t pid) {
+  // Memory from the arena, and large variables, are better served by a single
+  // process_vm_writev().
+  if (GetSize() > RPCChannel::kMaxFusedTransferSize ||
+      rpc_channel->CanAllocateLocally(GetSize())) {
+    SAPI_RETURN_IF_ERROR(Allocate(rpc_channel, /*automatic_free=*/true));
+    return TransferToSandboxee(rpc_channel, pid);
+  }
+
+  void* addr;
+  SAPI_RETURN_IF_ERROR(
+      rpc_channel->AllocateAndFill(GetLocal(), GetSize(), &addr));
+  if (!addr) {
+    LOG(ERROR) << "AllocateAndFill: returned nullptr";
+    return absl::UnavailableError("Allocating memory failed");
+  }
+  SetRemote(addr);
+  SetFreeRPCChannel(rpc_channel);
+  MarkSynchronized(pid);
+  return absl::OkStatus();
+}
+
+absl::Status Var::TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                               pid_t pid) {
+  if (GetSize() > RPCChannel::kMaxFusedTransferSize) {
+    SAPI_RETURN_IF_ERROR(TransferFromSandboxee(rpc_channel, pid));
+    return Free(rpc_channel);
+  }
+
+  if (local_ == nullptr) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Object: ", GetType(), " has no local storage set"));
+  }
+  if (remote_ == nullptr) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Object: ", GetType(), " has no remote object set"));
+  }
+  SAPI_RETURN_IF_ERROR(
+      rpc_channel->ReadAndFree(GetRemote(), GetLocal(), GetSize()));
+  SetRemote(nullptr);
   return absl::OkStatus();
 }
 
@@ -15,6 +15,9 @@
 #ifndef SANDBOXED_API_VAR_ABSTRACT_H_
 #define SANDBOXED_API_VAR_ABSTRACT_H_
 
+#include <sys/uio.h>
+
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <type_traits>
@@ -35,6 +38,7 @@ class RPCChannel;
 
 namespace sapi::v {
 
+class Callable;
 class Ptr;
 
 class ABSL_DEPRECATED(
@@ -70,7 +74,10 @@ class Var : public Pointable {
   virtual void* GetRemote() const { return remote_; }
 
   // Sets the address of the remote storage.
-  virtual void SetRemote(void* remote) { remote_ = remote; }
+  virtual void SetRemote(void* remote) {
+    remote_ = remote;
+    MarkModified();
+  }
 
   // Returns the address of the storage (local side).
   virtual void* GetLocal() const { return local_; }
@@ -93,19 +100,64 @@ class Var : public Pointable {
   Ptr* PtrBefore();
   Ptr* PtrAfter();
 
+  // Enables skipping transfers to the sandboxee while the variable is known to
+  // hold the same data on both sides, e.g. for large lookup tables passed to
+  // every call. Changes made through the setters of this class are detected,
+  // writes to the local memory from the outside (like to the buffer of an
+  // Array) must be announced with MarkModified(). As changes made by the
+  // sandboxee are not detected, only enable this for variables which the
+  // sandboxee does not write to.
+  void SetTrackModifications(bool track) {
+    track_modifications_ = track;
+    MarkModified();
+  }
+
+  // Makes the next transfer to the sandboxee happen, even if modifications are
+  // tracked.
+  void MarkModified() { synchronized_pid_ = -1; }
+
+  // Makes synchronization after a call copy back only the first `length`
+  // bytes of the variable, where `length` is another argument or the return
+  // value of the same call, e.g. the number of bytes a function wrote. It is
+  // read after it has been synchronized itself, and clamped to the size of
+  // the variable. `length` must be an integer and outlive the calls; a
+  // negative value fails the call with an InvalidArgument error. Passing
+  // nullptr makes the whole variable synchronized again.
+  void SetValidLength(Callable* length) { valid_length_ = length; }
+
+  // Transfers of at least twice this size are split between several threads,
+  // as a single one is limited by memory copy bandwidth.
+  static constexpr size_t kParallelTransferChunkSize = 16 << 20;
+
  protected:
   Var() = default;
 
   // Set pointer to local storage class.
-  void SetLocal(void* local) { local_ = local; }
+  void SetLocal(void* local) {
+    local_ = local;
+    MarkModified();
+  }
+
+  // Returns whether TransferToSandboxee() has any work to do, i.e. whether the
+  // variable possibly changed since it was last transferred to or from the
+  // sandboxee with the given pid.
+  bool NeedsTransferToSandboxee(pid_t pid) const {
+    return !track_modifications_ || synchronized_pid_ != pid ||
+           synchronized_size_ != GetSize();
+  }
+
+  // Records that the local and remote storage hold the same data.
+  void MarkSynchronized(pid_t pid) {
+    synchronized_pid_ = pid;
+    synchronized_size_ = GetSize();
+  }
 
   // Setter/Getter for the address of a Comms object which can be used to
   // remotely free allocated memory backing up this variable, upon this
-  // object's end of life-time
-  void SetFreeRPCChannel(RPCChannel* rpc_channel) {
-    free_rpc_channel_ = rpc_channel;
-  }
-  RPCChannel* GetFreeRPCChannel() { return free_rpc_channel_; }
+  // object's end of life-time. The getter returns nullptr once the sandboxee
+  // was terminated or restarted, as the memory is gone with it then.
+  void SetFreeRPCChannel(RPCChannel* rpc_channel);
+  RPCChannel* GetFreeRPCChannel() const;
 
   // Allocates the local variable on the remote side. The 'automatic_free'
   // argument dictates whether the remote memory should be freed upon end of
@@ -123,12 +175,49 @@ class Var : public Pointable {
   virtual absl::Status TransferFromSandboxee(RPCChannel* rpc_channel,
                                              pid_t pid);
 
+  // Like TransferToSandboxee() and TransferFromSandboxee(), but only copy the
+  // `length` bytes starting at `offset`. Classes that override
+  // TransferToSandboxee() or TransferFromSandboxee() must override these as
+  // well, unless their GetTransferRegion() returns false anyway.
+  virtual absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel,
+                                                pid_t pid, size_t offset,
+                                                size_t length);
+  virtual absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel,
+                                                  pid_t pid, size_t offset,
+                                                  size_t length);
+
+  // Returns the local and remote memory that TransferToSandboxee() and
+  // TransferFromSandboxee() copy, so that several vars can be transferred
+  // with a single vectored syscall. Returns false if the var needs to be
+  // transferred on its own. Classes that override TransferToSandboxee() or
+  // TransferFromSandboxee() must override this as well.
+  virtual bool GetTransferRegion(struct iovec* local,
+                                 struct iovec* remote) const;
+
+  // Like Allocate() with automatic_free followed by TransferToSandboxee(),
+  // but small variables are sent along with the allocation request. Classes
+  // that override Allocate() or TransferToSandboxee() must override this as
+  // well.
+  virtual absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                                      pid_t pid);
+
+  // Like TransferFromSandboxee() followed by Free(), but small variables are
+  // received in reply to the free request. Classes that override Free() or
+  // TransferFromSandboxee() must override this as well.
+  virtual absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                                    pid_t pid);
+
  private:
   // Needed so that we can use unique_ptr with incomplete type.
   struct PtrDeleter {
     void operator()(Ptr* p);
   };
 
+  // Returns the part of the transfer region with `length` bytes at `offset`.
+  absl::Status GetTransferRange(size_t offset, size_t length,
+                                struct iovec* local,
+                                struct iovec* remote) const;
+
   // Invokes Allocate()/Free()/Transfer*Sandboxee().
   friend class ::sapi::Sandbox;
 
@@ -145,6 +234,18 @@ class Var : public Pointable {
   // Comms which can be used to free resources allocated in the sandboxer upon
   // this process' end of lifetime.
   RPCChannel* free_rpc_channel_ = nullptr;
+  // RPCChannel::generation() of free_rpc_channel_.
+  uint64_t free_rpc_channel_generation_ = 0;
+
+  // See SetTrackModifications().
+  bool track_modifications_ = false;
+  // The sandboxee the variable was last synchronized with, and its size at
+  // that point. A pid of -1 means the variable is possibly modified.
+  pid_t synchronized_pid_ = -1;
+  size_t synchronized_size_ = 0;
+
+  // See SetValidLength().
+  Callable* valid_length_ = nullptr;
 };
 
 }  // namespace sapi::v
@@ -41,13 +41,17 @@ class Array : public Var {
       : arr_(arr),
         nelem_(nelem),
         total_size_(nelem_ * sizeof(T)),
+        capacity_(total_size_),
         buffer_owned_(false) {
     SetLocal(const_cast<std::remove_const_t<T>*>(arr_));
   }
 
   // The array is allocated and owned by this object.
   explicit Array(size_t nelem)
-      : nelem_(nelem), total_size_(nelem_ * sizeof(T)), buffer_owned_(true) {
+      : nelem_(nelem),
+        total_size_(nelem_ * sizeof(T)),
+        capacity_(total_size_),
+        buffer_owned_(true) {
     void* storage = malloc(sizeof(T) * nelem);
     CHECK(storage != nullptr);
     SetLocal(storage);
@@ -102,9 +106,11 @@ class Array : public Var {
       return absl::FailedPreconditionError(
           "Array size not a multiple of the item size");
     }
-    // Do not (re-)allocate memory if the new size matches our size - except
-    // when we don't own that buffer.
-    if (size == total_size_ && buffer_owned_) {
+    // Do not (re-)allocate memory if the new size fits into our buffer -
+    // except when we don't own that buffer.
+    if (size <= capacity_ && buffer_owned_) {
+      total_size_ = size;
+      nelem_ = size / sizeof(T);
       return absl::OkStatus();
     }
     void* new_addr = nullptr;
@@ -123,6 +129,7 @@ class Array : public Var {
 
     arr_ = static_cast<T*>(new_addr);
     total_size_ = size;
+    capacity_ = size;
     nelem_ = size / sizeof(T);
     SetLocal(new_addr);
     return absl::OkStatus();
@@ -132,6 +139,7 @@ class Array : public Var {
   T* arr_;
   size_t nelem_;       // Number of elements
   size_t total_size_;  // Total size in bytes
+  size_t capacity_;    // Size of the buffer in bytes
   bool buffer_owned_;  // Whether we own the buffer
 };
 
@@ -0,0 +1,146 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/var_deep_struct.h"
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/util/metrics.h"
+
+namespace sapi::v::internal {
+namespace {
+
+// An object whose pointer members remain to be followed.
+struct Holder {
+  char* host;
+  const std::vector<PointerMember>* members;
+};
+
+// The objects behind a single pointer.
+struct Region {
+  char* pointer;  // Host address of the pointer.
+  const PointerMember* member;
+  void* remote;
+  size_t count;
+  size_t offset;  // Into the block of the level.
+};
+
+}  // namespace
+
+absl::Status ReadPointerGraph(
+    pid_t pid, void* root, const std::vector<PointerMember>& members,
+    size_t max_bytes, std::vector<std::unique_ptr<char[]>>* arena,
+    std::vector<std::pair<size_t, void*>>* root_fixups) {
+  std::vector<Holder> level = {{static_cast<char*>(root), &members}};
+  size_t total = 0;
+  for (bool is_root = true; !level.empty(); is_root = false) {
+    std::vector<Region> regions;
+    size_t level_size = 0;
+    for (const Holder& holder : level) {
+      for (const PointerMember& member : *holder.members) {
+        Region region = {.pointer = holder.host + member.offset,
+                         .member = &member};
+        memcpy(&region.remote, region.pointer, sizeof(void*));
+        if (is_root) {
+          root_fixups->push_back({member.offset, region.remote});
+        }
+        region.count = region.remote != nullptr && member.element_size != 0
+                           ? member.count(holder.host)
+                           : 0;
+        if (region.count == 0) {
+          // Never leave a remote address behind in the host copy.
+          memset(region.pointer, 0, sizeof(void*));
+          continue;
+        }
+        if (region.count > (max_bytes - total) / member.element_size) {
+          return absl::ResourceExhaustedError(
+              absl::StrCat("Nested objects exceed ", max_bytes, " bytes"));
+        }
+        const size_t size = region.count * member.element_size;
+        // Keep every region aligned for any type.
+        level_size = (level_size + alignof(std::max_align_t) - 1) &
+                     ~(alignof(std::max_align_t) - 1);
+        region.offset = level_size;
+        level_size += size;
+        total += size;
+        regions.push_back(region);
+      }
+    }
+    if (regions.empty()) {
+      break;
+    }
+
+    // Owned by the arena right away, the pointers refer to it even if reading
+    // fails.
+    arena->push_back(std::make_unique<char[]>(level_size));
+    char* block = arena->back().get();
+    std::vector<struct iovec> local;
+    std::vector<struct iovec> remote;
+    local.reserve(regions.size());
+    remote.reserve(regions.size());
+    for (const Region& region : regions) {
+      char* host = block + region.offset;
+      const size_t size = region.count * region.member->element_size;
+      local.push_back({.iov_base = host, .iov_len = size});
+      remote.push_back({.iov_base = region.remote, .iov_len = size});
+      memcpy(region.pointer, &host, sizeof(void*));
+    }
+    for (size_t start = 0; start < local.size(); start += IOV_MAX) {
+      const size_t count = std::min<size_t>(local.size() - start, IOV_MAX);
+      ssize_t expected = 0;
+      for (size_t i = start; i < start + count; ++i) {
+        expected += local[i].iov_len;
+      }
+      const ssize_t ret = process_vm_readv(pid, &local[start], count,
+                                           &remote[start], count, 0);
+      if (ret != expected) {
+        PLOG(WARNING) << "process_vm_readv(pid: " << pid << ", " << count
+                      << " regions, size: " << expected << ") transferred "
+                      << ret << " bytes";
+        return absl::UnavailableError("Reading nested objects failed");
+      }
+      metrics::IncrementCounter(metrics::kBytesTransferred, "from_sandboxee",
+                                ret);
+    }
+
+    std::vector<Holder> next;
+    for (const Region& region : regions) {
+      if (region.member->members.empty()) {
+        continue;
+      }
+      for (size_t i = 0; i < region.count; ++i) {
+        next.push_back(
+            {block + region.offset + i * region.member->element_size,
+             &region.member->members});
+      }
+    }
+    level = std::move(next);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace sapi::v::internal
@@ -0,0 +1,187 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_VAR_DEEP_STRUCT_H_
+#define SANDBOXED_API_VAR_DEEP_STRUCT_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_abstract.h"
+#include "sandboxed_api/var_struct.h"
+
+namespace sapi::v {
+
+// Describes a pointer member that is followed when a DeepStruct is
+// transferred from the sandboxee. Use Follow() to create one.
+struct PointerMember {
+  // Offset of the pointer within the object holding it.
+  size_t offset;
+  // Size of a single object pointed to.
+  size_t element_size;
+  // Returns the number of objects pointed to, given the host copy of the
+  // object holding the pointer.
+  std::function<size_t(const void* holder)> count;
+  // Pointer members of every object pointed to.
+  std::vector<PointerMember> members;
+};
+
+// Describes a Pointee* at `offset` in a Holder, pointing to `count(holder)`
+// objects.
+//
+// Example:
+//   v::Follow<opj_image_comp_t, opj_image_t>(
+//       offsetof(opj_image_t, comps),
+//       [](const opj_image_t& image) { return image.numcomps; })
+template <typename Pointee, typename Holder>
+PointerMember Follow(size_t offset,
+                     std::function<size_t(const Holder&)> count,
+                     std::vector<PointerMember> members = {}) {
+  return {offset, sizeof(Pointee),
+          [count = std::move(count)](const void* holder) {
+            return count(*static_cast<const Holder*>(holder));
+          },
+          std::move(members)};
+}
+
+// Describes a Pointee* at `offset` pointing to a fixed number of objects.
+template <typename Pointee>
+PointerMember Follow(size_t offset, size_t count = 1,
+                     std::vector<PointerMember> members = {}) {
+  return {offset, sizeof(Pointee), [count](const void*) { return count; },
+          std::move(members)};
+}
+
+namespace internal {
+
+// Reads the objects that the pointer members of `root` point to, recursively.
+// All objects at the same depth are read with a single vectored syscall into
+// one block, which is appended to `arena`. Pointers in the host copies are
+// replaced with their host addresses; null pointers and those to no objects
+// become nullptr. The remote values of the pointers in `root` are appended to
+// `root_fixups`, along with their offsets.
+absl::Status ReadPointerGraph(
+    pid_t pid, void* root, const std::vector<PointerMember>& members,
+    size_t max_bytes, std::vector<std::unique_ptr<char[]>>* arena,
+    std::vector<std::pair<size_t, void*>>* root_fixups);
+
+}  // namespace internal
+
+// A structure whose pointer members are transferred from the sandboxee along
+// with it, e.g. a result struct with buffers that a sandboxed function filled.
+// Instead of one transfer per nested object, each level of the graph of
+// objects is read with a single vectored syscall, so reading a struct with
+// arrays of structs with arrays takes three. The host copies of the nested
+// objects live in an arena owned by the DeepStruct, until the next transfer.
+//
+// Transferring a DeepStruct to the sandboxee only writes the top-level
+// struct, with its pointers set to their remote values again. Nested objects
+// are never written back. Lists and other cycles cannot be described, as
+// the number of objects behind each pointer must be known from its holder.
+//
+// Example:
+//   v::DeepStruct<opj_image_t> image(
+//       {v::Follow<opj_image_comp_t, opj_image_t>(
+//           offsetof(opj_image_t, comps),
+//           [](const opj_image_t& image) { return image.numcomps; })});
+//   image.SetRemote(remote_image);
+//   SAPI_RETURN_IF_ERROR(sandbox.TransferFromSandboxee(&image));
+//   const opj_image_comp_t& comp = image.data().comps[0];
+template <class T>
+class DeepStruct : public Struct<T> {
+ public:
+  // Transfers are refused if the nested objects exceed this size in total.
+  static constexpr size_t kDefaultMaxBytes = 256 << 20;
+
+  explicit DeepStruct(std::vector<PointerMember> members,
+                      size_t max_bytes = kDefaultMaxBytes)
+      : members_(std::move(members)), max_bytes_(max_bytes) {}
+
+ protected:
+  absl::Status TransferToSandboxee(RPCChannel* rpc_channel,
+                                   pid_t pid) override {
+    // The host pointers must not end up in the sandboxee.
+    std::vector<void*> host(root_fixups_.size());
+    for (size_t i = 0; i < root_fixups_.size(); ++i) {
+      char* member = reinterpret_cast<char*>(&this->struct_) +
+                     root_fixups_[i].first;
+      memcpy(&host[i], member, sizeof(void*));
+      memcpy(member, &root_fixups_[i].second, sizeof(void*));
+    }
+    absl::Status status = Var::TransferToSandboxee(rpc_channel, pid);
+    for (size_t i = 0; i < root_fixups_.size(); ++i) {
+      memcpy(reinterpret_cast<char*>(&this->struct_) + root_fixups_[i].first,
+             &host[i], sizeof(void*));
+    }
+    return status;
+  }
+
+  absl::Status TransferFromSandboxee(RPCChannel* rpc_channel,
+                                     pid_t pid) override {
+    SAPI_RETURN_IF_ERROR(Var::TransferFromSandboxee(rpc_channel, pid));
+    arena_.clear();
+    root_fixups_.clear();
+    return internal::ReadPointerGraph(pid, &this->struct_, members_,
+                                      max_bytes_, &arena_, &root_fixups_);
+  }
+
+  // Partial transfers would leave the pointers inconsistent, transfer all of
+  // it instead.
+  absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                        size_t offset, size_t length) override {
+    return TransferToSandboxee(rpc_channel, pid);
+  }
+  absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                          size_t offset,
+                                          size_t length) override {
+    return TransferFromSandboxee(rpc_channel, pid);
+  }
+
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override {
+    return false;
+  }
+
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override {
+    SAPI_RETURN_IF_ERROR(Var::Allocate(rpc_channel, /*automatic_free=*/true));
+    return TransferToSandboxee(rpc_channel, pid);
+  }
+
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override {
+    SAPI_RETURN_IF_ERROR(TransferFromSandboxee(rpc_channel, pid));
+    return Var::Free(rpc_channel);
+  }
+
+ private:
+  std::vector<PointerMember> members_;
+  size_t max_bytes_;
+  std::vector<std::unique_ptr<char[]>> arena_;
+  std::vector<std::pair<size_t, void*>> root_fixups_;
+};
+
+}  // namespace sapi::v
+
+#endif  // SANDBOXED_API_VAR_DEEP_STRUCT_H_
@@ -0,0 +1,54 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_VAR_FLAT_H_
+#define SANDBOXED_API_VAR_FLAT_H_
+
+#include <utility>
+
+#include "sandboxed_api/flat_message.h"
+#include "sandboxed_api/var_struct.h"
+
+namespace sapi::v {
+
+// A plain struct passed to the sandboxee as a FlatMessage<T>, which it reads
+// and writes in place with FlatMessageView<T>. Unlike v::Proto, it is
+// transferred as is, without serialization, parsing or allocations on either
+// side, while still allowing fields to be added to T over time.
+//
+// Example:
+//   v::Flat<Params> params(/*level=*/9);
+//   SAPI_ASSIGN_OR_RETURN(int rv, api.process(params.PtrBoth()));
+//   int result = params.message().result;
+template <class T>
+class Flat : public Struct<FlatMessage<T>> {
+ public:
+  // Initializes the fields of T from `args`.
+  template <typename... Args>
+  explicit Flat(Args&&... args)
+      : Struct<FlatMessage<T>>(FlatMessage<T>{
+            {kFlatMessageMagic, sizeof(T)}, T{std::forward<Args>(args)...}}) {}
+
+  const T& message() const { return this->data().payload; }
+  T* mutable_message() {
+    FlatMessage<T>* flat = this->mutable_data();
+    // The sandboxee may have overwritten it.
+    flat->header = {kFlatMessageMagic, sizeof(T)};
+    return &flat->payload;
+  }
+};
+
+}  // namespace sapi::v
+
+#endif  // SANDBOXED_API_VAR_FLAT_H_
@@ -92,4 +92,16 @@ absl::Status Fd::TransferFromSandboxee(RPCChannel* rpc_channel,
   return absl::OkStatus();
 }
 
+absl::Status Fd::AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                                 pid_t pid) {
+  SAPI_RETURN_IF_ERROR(Allocate(rpc_channel, /*automatic_free=*/true));
+  return TransferToSandboxee(rpc_channel, pid);
+}
+
+absl::Status Fd::TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                              pid_t pid) {
+  SAPI_RETURN_IF_ERROR(TransferFromSandboxee(rpc_channel, pid));
+  return Free(rpc_channel);
+}
+
 }  // namespace sapi::v
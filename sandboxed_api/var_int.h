@@ -86,6 +86,16 @@ class Fd : public Int {
   // Retrieves remote file descriptor, does not own fd.
   absl::Status TransferToSandboxee(RPCChannel* rpc_channel, pid_t pid) override;
 
+  // File descriptors are not transferred as memory.
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override {
+    return false;
+  }
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override;
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override;
+
  private:
   int remote_fd_ = -1;
   bool own_local_ = true;
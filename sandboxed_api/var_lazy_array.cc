@@ -0,0 +1,303 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/var_lazy_array.h"
+
+#include <linux/userfaultfd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/util/metrics.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sapi::v {
+
+LazyArray::LazyArray(const void* data, size_t size, size_t readahead)
+    : data_(static_cast<const uint8_t*>(data)),
+      size_(size),
+      readahead_(readahead),
+      page_size_(sysconf(_SC_PAGESIZE)),
+      mapped_size_((size + page_size_ - 1) & ~(page_size_ - 1)) {
+  SetLocal(const_cast<uint8_t*>(data_));
+}
+
+LazyArray::~LazyArray() {
+  if (lazy_) {
+    if (GetFreeRPCChannel() && GetRemote()) {
+      Free(GetFreeRPCChannel()).IgnoreError();
+    }
+    StopServing();
+    // Even if that failed, ~Var() must not pass the mapping to free().
+    SetRemote(nullptr);
+  }
+}
+
+std::string LazyArray::ToString() const {
+  return absl::StrCat("LazyArray, size: ", size_, " B., pages copied: ",
+                      pages_copied());
+}
+
+absl::Status LazyArray::Allocate(RPCChannel* rpc_channel,
+                                 bool automatic_free) {
+  // E.g. left over from a sandboxee that was restarted.
+  StopServing();
+  lazy_ = false;
+  if (size_ == 0) {
+    return Var::Allocate(rpc_channel, automatic_free);
+  }
+  void* addr;
+  int uffd;
+  if (absl::Status status =
+          rpc_channel->MapLazyBuffer(mapped_size_, &addr, &uffd);
+      !status.ok()) {
+    VLOG(1) << "Copying the LazyArray as a whole: " << status;
+    return Var::Allocate(rpc_channel, automatic_free);
+  }
+  stop_fd_ = eventfd(0, EFD_CLOEXEC);
+  if (stop_fd_ == -1) {
+    absl::Status status = absl::ErrnoToStatus(errno, "eventfd()");
+    close(uffd);
+    rpc_channel->UnmapBuffer(addr, mapped_size_).IgnoreError();
+    return status;
+  }
+  uffd_ = uffd;
+  lazy_ = true;
+  SetRemote(addr);
+  if (automatic_free) {
+    SetFreeRPCChannel(rpc_channel);
+  }
+  thread_ = std::thread(&LazyArray::ServeFaults, this,
+                        reinterpret_cast<uintptr_t>(addr));
+  return absl::OkStatus();
+}
+
+absl::Status LazyArray::Free(RPCChannel* rpc_channel) {
+  if (!lazy_) {
+    return Var::Free(rpc_channel);
+  }
+  // Faults on the way are resolved with zeroed pages once the userfaultfd is
+  // closed, so the sandboxee can't be left waiting.
+  StopServing();
+  SAPI_RETURN_IF_ERROR(rpc_channel->UnmapBuffer(GetRemote(), mapped_size_));
+  lazy_ = false;
+  SetRemote(nullptr);
+  return absl::OkStatus();
+}
+
+absl::Status LazyArray::Prefetch(size_t offset, size_t length) {
+  if (GetRemote() == nullptr) {
+    return absl::FailedPreconditionError("LazyArray is not allocated");
+  }
+  if (offset > size_ || length > size_ - offset) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Range [", offset, ", ", offset, " + ", length,
+                     ") exceeds array size ", size_));
+  }
+  if (!lazy_ || length == 0) {
+    return absl::OkStatus();
+  }
+  bool skipped = false;
+  if (!CopyPages(reinterpret_cast<uintptr_t>(GetRemote()), offset, length,
+                 &skipped)) {
+    return absl::UnavailableError("Copying pages to the sandboxee failed");
+  }
+  return absl::OkStatus();
+}
+
+void LazyArray::ServeFaults(uintptr_t remote) {
+  pollfd fds[] = {
+      {.fd = uffd_, .events = POLLIN, .revents = 0},
+      {.fd = stop_fd_, .events = POLLIN, .revents = 0},
+  };
+  const size_t fault_size = std::max(readahead_, page_size_);
+  while (true) {
+    if (poll(fds, 2, /*timeout=*/-1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(ERROR) << "poll() on a userfaultfd failed";
+      return;
+    }
+    if (fds[1].revents != 0 || (fds[0].revents & (POLLERR | POLLHUP)) != 0) {
+      return;
+    }
+    uffd_msg msg;
+    const ssize_t n = read(uffd_, &msg, sizeof(msg));
+    if (n != sizeof(msg)) {
+      if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+        continue;
+      }
+      return;
+    }
+    if (msg.event != UFFD_EVENT_PAGEFAULT) {
+      continue;
+    }
+    const size_t offset =
+        (msg.arg.pagefault.address - remote) & ~(page_size_ - 1);
+    bool skipped = false;
+    if (!CopyPages(remote, offset, fault_size, &skipped)) {
+      return;
+    }
+    if (skipped) {
+      // The page was copied by Prefetch() meanwhile, which only wakes the
+      // threads that faulted on it before.
+      uffdio_range range = {.start = remote + offset, .len = page_size_};
+      ioctl(uffd_, UFFDIO_WAKE, &range);
+    }
+  }
+}
+
+void LazyArray::StopServing() {
+  if (thread_.joinable()) {
+    const uint64_t one = 1;
+    if (write(stop_fd_, &one, sizeof(one)) != sizeof(one)) {
+      PLOG(ERROR) << "Stopping the LazyArray fault handler failed";
+    }
+    thread_.join();
+  }
+  if (stop_fd_ != -1) {
+    close(stop_fd_);
+    stop_fd_ = -1;
+  }
+  if (uffd_ != -1) {
+    close(uffd_);
+    uffd_ = -1;
+  }
+}
+
+bool LazyArray::CopyPages(uintptr_t remote, size_t offset, size_t length,
+                          bool* skipped) {
+  const size_t begin = offset & ~(page_size_ - 1);
+  const size_t end = std::min(
+      mapped_size_, (offset + length + page_size_ - 1) & ~(page_size_ - 1));
+  // Pages entirely backed by data_ are copied from it directly.
+  const size_t full_end = std::min(end, size_ & ~(page_size_ - 1));
+  if (begin < full_end && !CopyToRemote(remote + begin, data_ + begin,
+                                        full_end - begin, skipped)) {
+    return false;
+  }
+  if (end <= full_end) {
+    return true;
+  }
+  // The last page is only partially backed by data_, the rest is zeroed.
+  std::vector<uint8_t> page(page_size_);
+  memcpy(page.data(), data_ + full_end, size_ - full_end);
+  return CopyToRemote(remote + full_end, page.data(), page_size_, skipped);
+}
+
+bool LazyArray::CopyToRemote(uintptr_t dst, const uint8_t* src,
+                             size_t length, bool* skipped) {
+  while (length > 0) {
+    uffdio_copy copy = {
+        .dst = dst,
+        .src = reinterpret_cast<uintptr_t>(src),
+        .len = length,
+        .mode = 0,
+        .copy = 0,
+    };
+    const bool ok = ioctl(uffd_, UFFDIO_COPY, &copy) == 0;
+    // Set to the bytes copied, even if the ioctl failed part way through.
+    size_t done = ok ? length : std::max<int64_t>(copy.copy, 0);
+    pages_copied_.fetch_add(done / page_size_, std::memory_order_relaxed);
+    sapi::metrics::IncrementCounter(sapi::metrics::kBytesTransferred,
+                                    "to_sandboxee", done);
+    if (ok) {
+      return true;
+    }
+    if (errno == EEXIST) {
+      // Already copied by another fault or Prefetch().
+      *skipped = true;
+      done += page_size_;
+    } else if (errno != EAGAIN) {
+      // With ESRCH and ENOENT, the sandboxee exited or is exiting.
+      if (errno != ESRCH && errno != ENOENT) {
+        PLOG(WARNING) << "UFFDIO_COPY to the sandboxee failed";
+      }
+      return false;
+    }
+    done = std::min(done, length);
+    dst += done;
+    src += done;
+    length -= done;
+  }
+  return true;
+}
+
+absl::Status LazyArray::TransferToSandboxee(RPCChannel* rpc_channel,
+                                            pid_t pid) {
+  return lazy_ ? absl::OkStatus() : Var::TransferToSandboxee(rpc_channel, pid);
+}
+
+absl::Status LazyArray::TransferFromSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) {
+  return lazy_ ? absl::OkStatus()
+               : Var::TransferFromSandboxee(rpc_channel, pid);
+}
+
+absl::Status LazyArray::TransferRangeToSandboxee(RPCChannel* rpc_channel,
+                                                 pid_t pid, size_t offset,
+                                                 size_t length) {
+  if (!lazy_) {
+    return Var::TransferRangeToSandboxee(rpc_channel, pid, offset, length);
+  }
+  if (offset > size_ || length > size_ - offset) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Range [", offset, ", ", offset, " + ", length,
+                     ") exceeds array size ", size_));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status LazyArray::TransferRangeFromSandboxee(RPCChannel* rpc_channel,
+                                                   pid_t pid, size_t offset,
+                                                   size_t length) {
+  if (!lazy_) {
+    return Var::TransferRangeFromSandboxee(rpc_channel, pid, offset, length);
+  }
+  return TransferRangeToSandboxee(rpc_channel, pid, offset, length);
+}
+
+bool LazyArray::GetTransferRegion(struct iovec* local,
+                                  struct iovec* remote) const {
+  return !lazy_ && Var::GetTransferRegion(local, remote);
+}
+
+absl::Status LazyArray::AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                                       pid_t pid) {
+  SAPI_RETURN_IF_ERROR(Allocate(rpc_channel, /*automatic_free=*/true));
+  return TransferToSandboxee(rpc_channel, pid);
+}
+
+absl::Status LazyArray::TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                                     pid_t pid) {
+  return lazy_ ? Free(rpc_channel)
+               : Var::TransferFromSandboxeeAndFree(rpc_channel, pid);
+}
+
+}  // namespace sapi::v
@@ -0,0 +1,145 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_VAR_LAZY_ARRAY_H_
+#define SANDBOXED_API_VAR_LAZY_ARRAY_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+
+#include "absl/status/status.h"
+#include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/var_abstract.h"
+
+namespace sapi::v {
+
+// Class representing a large input buffer of which the sandboxee only reads
+// parts, e.g. the headers of a media file. Instead of copying all of it when
+// transferred, the memory in the sandboxee is registered with a userfaultfd,
+// and the pages are copied from the host when the sandboxee first reads them.
+// A thread of the host serves the faults while the array is allocated.
+//
+// The buffer is not owned and must neither go away nor change while the array
+// is allocated, pages copied already are not updated. Data flows to the
+// sandboxee only: changes it makes are not transferred back. Pages that were
+// not read or prefetched yet appear as unreadable to syscalls of the
+// sandboxee, e.g. write(fd, buf, len) fails with EFAULT, use Prefetch() for
+// memory passed to syscalls.
+//
+// Falls back to copying the whole buffer unless the sandbox opts in with
+// Sandbox::UseLazyArrays(), or if the sandboxee can't set up a userfaultfd,
+// e.g. with kernels before 5.11. The default policy then allows userfaultfds,
+// custom ones need PolicyBuilder::AllowUserfaultfd().
+//
+// Example:
+//   v::LazyArray file(contents.data(), contents.size(),
+//                     /*readahead=*/64 << 10);
+//   SAPI_ASSIGN_OR_RETURN(int width,
+//                         api.parse_header(file.PtrBefore(), file.GetSize()));
+class LazyArray : public Var {
+ public:
+  // Copies `readahead` bytes, rounded up to whole pages, starting with the
+  // faulting page whenever the sandboxee reads a missing page. Larger values
+  // save round trips for sequential reads.
+  LazyArray(const void* data, size_t size, size_t readahead = 0);
+
+  ~LazyArray() override;
+
+  const uint8_t* GetData() const { return data_; }
+
+  // Copies the `length` bytes at `offset` to the sandboxee ahead of time,
+  // except for pages copied already. Only valid once allocated.
+  absl::Status Prefetch(size_t offset, size_t length);
+
+  // Returns whether pages are copied on demand, false if the array was
+  // copied as a whole or is not allocated.
+  bool is_lazy() const { return lazy_; }
+
+  // Returns the number of pages copied to the sandboxee on demand or by
+  // Prefetch() so far.
+  size_t pages_copied() const {
+    return pages_copied_.load(std::memory_order_relaxed);
+  }
+
+  size_t GetSize() const final { return size_; }
+  Type GetType() const final { return Type::kArray; }
+  std::string GetTypeString() const final { return "LazyArray"; }
+  std::string ToString() const final;
+
+ protected:
+  // Maps the memory into the sandboxee and starts serving its faults.
+  absl::Status Allocate(RPCChannel* rpc_channel, bool automatic_free) override;
+  absl::Status Free(RPCChannel* rpc_channel) override;
+
+  // With a userfaultfd, pages are copied on demand and never back.
+  absl::Status TransferToSandboxee(RPCChannel* rpc_channel,
+                                   pid_t pid) override;
+  absl::Status TransferFromSandboxee(RPCChannel* rpc_channel,
+                                     pid_t pid) override;
+  absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                        size_t offset, size_t length) override;
+  absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                          size_t offset,
+                                          size_t length) override;
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override;
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override;
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override;
+
+ private:
+  // Serves faults on uffd_ for the mapping at `remote` until stop_fd_
+  // becomes readable.
+  void ServeFaults(uintptr_t remote);
+
+  // Stops serving faults and closes the userfaultfd.
+  void StopServing();
+
+  // Copies the pages overlapping the `length` bytes at `offset` to the
+  // mapping at `remote`, skipping those present already, in which case
+  // `skipped` is set. Returns false if the sandboxee is gone.
+  bool CopyPages(uintptr_t remote, size_t offset, size_t length,
+                 bool* skipped);
+
+  // Copies `length` bytes from `src` to the page aligned address `dst` in the
+  // sandboxee, like CopyPages().
+  bool CopyToRemote(uintptr_t dst, const uint8_t* src, size_t length,
+                    bool* skipped);
+
+  const uint8_t* data_;
+  size_t size_;
+  size_t readahead_;
+  size_t page_size_;
+  // The size of the mapping in the sandboxee, size_ rounded up to pages.
+  size_t mapped_size_;
+
+  // Whether the array is allocated with a userfaultfd.
+  bool lazy_ = false;
+  int uffd_ = -1;
+  // An eventfd to stop thread_.
+  int stop_fd_ = -1;
+  std::thread thread_;
+  std::atomic<size_t> pages_copied_ = 0;
+};
+
+}  // namespace sapi::v
+
+#endif  // SANDBOXED_API_VAR_LAZY_ARRAY_H_
@@ -38,26 +38,125 @@ absl::Status LenVal::Free(RPCChannel* rpc_channel) {
 }
 
 absl::Status LenVal::TransferToSandboxee(RPCChannel* rpc_channel, pid_t pid) {
-  // Sync the structure and the underlying array.
-  SAPI_RETURN_IF_ERROR(struct_.TransferToSandboxee(rpc_channel, pid));
-  SAPI_RETURN_IF_ERROR(array_.TransferToSandboxee(rpc_channel, pid));
+  // Sync the structure and the underlying array, with a single syscall if
+  // both are in place.
+  struct iovec local[2];
+  struct iovec remote[2];
+  if (rpc_channel->transfer_over_comms() ||
+      !struct_.GetTransferRegion(&local[0], &remote[0]) ||
+      !array_.GetTransferRegion(&local[1], &remote[1])) {
+    SAPI_RETURN_IF_ERROR(struct_.TransferToSandboxee(rpc_channel, pid));
+    return array_.TransferToSandboxee(rpc_channel, pid);
+  }
+  const ssize_t expected = local[0].iov_len + local[1].iov_len;
+  ssize_t ret = process_vm_writev(pid, local, 2, remote, 2, 0);
+  if (ret == -1) {
+    PLOG(WARNING) << "process_vm_writev(pid: " << pid
+                  << " raddr: " << remote[0].iov_base << " size: " << expected
+                  << ")";
+    return absl::UnavailableError("process_vm_writev failed");
+  }
+  if (ret != expected) {
+    LOG(WARNING) << "process_vm_writev(pid: " << pid
+                 << " raddr: " << remote[0].iov_base << " size: " << expected
+                 << ")" << " transferred " << ret << " bytes";
+    return absl::UnavailableError("process_vm_writev: partial success");
+  }
   return absl::OkStatus();
 }
 
 absl::Status LenVal::TransferFromSandboxee(RPCChannel* rpc_channel, pid_t pid) {
-  // Sync the structure back.
-  SAPI_RETURN_IF_ERROR(struct_.TransferFromSandboxee(rpc_channel, pid));
+  // Read the data along with the structure, speculating that it is still at
+  // the same address and fits into the local buffer. Only if the sandboxee
+  // moved or grew it, a second read is needed. The speculation is limited to
+  // buffers we own, as only those are known to be writable.
+  struct iovec local[2];
+  struct iovec remote[2];
+  if (rpc_channel->transfer_over_comms()) {
+    // Speculating could make the sandboxee read past the end of its memory.
+    SAPI_RETURN_IF_ERROR(struct_.TransferFromSandboxee(rpc_channel, pid));
+    SAPI_RETURN_IF_ERROR(array_.EnsureOwnedLocalBuffer(struct_.data().size));
+    array_.SetRemote(struct_.data().data);
+    return array_.TransferFromSandboxee(rpc_channel, pid);
+  }
+  if (!struct_.GetTransferRegion(&local[0], &remote[0])) {
+    return struct_.TransferFromSandboxee(rpc_channel, pid);
+  }
+  int iovcnt = 1;
+  void* const speculated_data = array_.GetRemote();
+  if (array_.buffer_owned_ && speculated_data != nullptr &&
+      array_.capacity_ > 0) {
+    local[1] = {.iov_base = array_.GetData(), .iov_len = array_.capacity_};
+    remote[1] = {.iov_base = speculated_data, .iov_len = array_.capacity_};
+    iovcnt = 2;
+  }
+  ssize_t ret = process_vm_readv(pid, local, iovcnt, remote, iovcnt, 0);
+  if (ret == -1) {
+    PLOG(WARNING) << "process_vm_readv(pid: " << pid
+                  << " raddr: " << remote[0].iov_base << ")";
+    return absl::UnavailableError("process_vm_readv failed");
+  }
+  // The data needn't be readable in full, the structure must be.
+  if (ret < static_cast<ssize_t>(sizeof(LenValStruct))) {
+    LOG(WARNING) << "process_vm_readv(pid: " << pid
+                 << " raddr: " << remote[0].iov_base << ")"
+                 << " transferred " << ret << " bytes";
+    return absl::UnavailableError("process_vm_readv succeeded partially");
+  }
 
   // Resize the local array if required. Also make sure we own the buffer, this
   // is the only way we can be sure that the buffer is writable.
-  size_t new_size = struct_.data().size;
+  const size_t new_size = struct_.data().size;
+  void* const new_data = struct_.data().data;
+  const bool speculation_hit = iovcnt == 2 && new_data == speculated_data &&
+                               new_size <= ret - sizeof(LenValStruct);
   SAPI_RETURN_IF_ERROR(array_.EnsureOwnedLocalBuffer(new_size));
 
   // Remote pointer might have changed, update it.
-  array_.SetRemote(struct_.data().data);
+  array_.SetRemote(new_data);
+  if (speculation_hit) {
+    return absl::OkStatus();
+  }
   return array_.TransferFromSandboxee(rpc_channel, pid);
 }
 
+absl::Status LenVal::TransferRangeToSandboxee(RPCChannel* rpc_channel,
+                                             pid_t pid, size_t offset,
+                                             size_t length) {
+  SAPI_RETURN_IF_ERROR(struct_.TransferToSandboxee(rpc_channel, pid));
+  return array_.TransferRangeToSandboxee(rpc_channel, pid, offset, length);
+}
+
+absl::Status LenVal::TransferRangeFromSandboxee(RPCChannel* rpc_channel,
+                                               pid_t pid, size_t offset,
+                                               size_t length) {
+  // See TransferFromSandboxee().
+  SAPI_RETURN_IF_ERROR(struct_.TransferFromSandboxee(rpc_channel, pid));
+  size_t new_size = struct_.data().size;
+  SAPI_RETURN_IF_ERROR(array_.EnsureOwnedLocalBuffer(new_size));
+  array_.SetRemote(struct_.data().data);
+  return array_.TransferRangeFromSandboxee(rpc_channel, pid, offset, length);
+}
+
+absl::Status LenVal::AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                                     pid_t pid) {
+  // The structure has to point to the array before it is sent.
+  SAPI_RETURN_IF_ERROR(array_.AllocateAndTransferToSandboxee(rpc_channel, pid));
+  struct_.mutable_data()->data = array_.GetRemote();
+  return struct_.AllocateAndTransferToSandboxee(rpc_channel, pid);
+}
+
+absl::Status LenVal::TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                                  pid_t pid) {
+  SAPI_RETURN_IF_ERROR(struct_.TransferFromSandboxeeAndFree(rpc_channel, pid));
+
+  // See TransferFromSandboxee().
+  size_t new_size = struct_.data().size;
+  SAPI_RETURN_IF_ERROR(array_.EnsureOwnedLocalBuffer(new_size));
+  array_.SetRemote(struct_.data().data);
+  return array_.TransferFromSandboxeeAndFree(rpc_channel, pid);
+}
+
 absl::Status LenVal::ResizeData(RPCChannel* rpc_channel, size_t size) {
   SAPI_RETURN_IF_ERROR(array_.Resize(rpc_channel, size));
   auto* struct_data = struct_.mutable_data();
@@ -66,6 +66,20 @@ class LenVal : public Var {
   absl::Status TransferToSandboxee(RPCChannel* rpc_channel, pid_t pid) override;
   absl::Status TransferFromSandboxee(RPCChannel* rpc_channel,
                                      pid_t pid) override;
+  // The range refers to the data.
+  absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                        size_t offset, size_t length) override;
+  absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                          size_t offset,
+                                          size_t length) override;
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override {
+    return false;
+  }
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override;
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override;
 
   Array<uint8_t> array_;
   Struct<LenValStruct> struct_;
@@ -0,0 +1,157 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sandboxed_api/var_mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/util/status_macros.h"
+
+namespace sapi::v {
+
+absl::StatusOr<std::unique_ptr<MappedFile>> MappedFile::Create(int fd) {
+  // A new read-only file description, whatever the access mode of `fd`.
+  int ro_fd =
+      open(absl::StrCat("/proc/self/fd/", fd).c_str(), O_RDONLY | O_CLOEXEC);
+  if (ro_fd == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("Reopening fd ", fd));
+  }
+  return Map(ro_fd);
+}
+
+absl::StatusOr<std::unique_ptr<MappedFile>> MappedFile::Open(
+    const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  return Map(fd);
+}
+
+absl::StatusOr<std::unique_ptr<MappedFile>> MappedFile::Map(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    absl::Status status = absl::ErrnoToStatus(errno, "fstat()");
+    close(fd);
+    return status;
+  }
+  if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+    close(fd);
+    return absl::InvalidArgumentError(
+        "Only regular, non-empty files can be mapped");
+  }
+  size_t size = st.st_size;
+  void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, /*offset=*/0);
+  if (data == MAP_FAILED) {
+    absl::Status status = absl::ErrnoToStatus(errno, "mmap()");
+    close(fd);
+    return status;
+  }
+  return std::unique_ptr<MappedFile>(
+      new MappedFile(fd, static_cast<uint8_t*>(data), size));
+}
+
+MappedFile::MappedFile(int fd, uint8_t* data, size_t size)
+    : fd_(fd), data_(data), size_(size) {
+  SetLocal(data_);
+}
+
+MappedFile::~MappedFile() {
+  if (GetFreeRPCChannel() && GetRemote()) {
+    Free(GetFreeRPCChannel()).IgnoreError();
+    // Even if that failed, ~Var() must not pass the mapping to free().
+    SetRemote(nullptr);
+  }
+  munmap(data_, size_);
+  close(fd_);
+}
+
+std::string MappedFile::ToString() const {
+  return absl::StrCat("MappedFile, size: ", size_, " B.");
+}
+
+absl::Status MappedFile::Allocate(RPCChannel* rpc_channel,
+                                  bool automatic_free) {
+  void* addr;
+  SAPI_RETURN_IF_ERROR(rpc_channel->MapFile(fd_, size_, &addr));
+  SetRemote(addr);
+  if (automatic_free) {
+    SetFreeRPCChannel(rpc_channel);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MappedFile::Free(RPCChannel* rpc_channel) {
+  SAPI_RETURN_IF_ERROR(rpc_channel->UnmapBuffer(GetRemote(), size_));
+  SetRemote(nullptr);
+  return absl::OkStatus();
+}
+
+absl::Status MappedFile::CheckRange(size_t offset, size_t length) const {
+  if (offset > size_ || length > size_ - offset) {
+    return absl::OutOfRangeError(
+        absl::StrCat("Range [", offset, ", ", offset, " + ", length,
+                     ") exceeds file size ", size_));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::shared_ptr<const SharedData>> SharedData::Create(
+    absl::Span<const uint8_t> data, const std::string& name) {
+  if (data.empty()) {
+    return absl::InvalidArgumentError("Shared data must not be empty");
+  }
+  int fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd == -1) {
+    return absl::ErrnoToStatus(errno, "memfd_create()");
+  }
+  auto shared =
+      std::shared_ptr<const SharedData>(new SharedData(fd, data.size()));
+  for (size_t written = 0; written < data.size();) {
+    ssize_t n = write(fd, data.data() + written, data.size() - written);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return absl::ErrnoToStatus(errno, "Writing shared data");
+    }
+    written += n;
+  }
+  // There are no mappings yet, so F_SEAL_WRITE can't fail with EBUSY. Unlike
+  // the read-only reopening in MappedFile::Create(), the seals also keep the
+  // host from changing the data behind the sandboxees' backs.
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE) == -1) {
+    return absl::ErrnoToStatus(errno, "Sealing shared data");
+  }
+  return shared;
+}
+
+SharedData::~SharedData() { close(fd_); }
+
+}  // namespace sapi::v
@@ -0,0 +1,165 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_VAR_MAPPED_FILE_H_
+#define SANDBOXED_API_VAR_MAPPED_FILE_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "sandboxed_api/lenval_core.h"
+#include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/var_abstract.h"
+
+namespace sapi::v {
+
+// Class representing a host file mapped read-only into the sandboxee, so that
+// functions taking a buffer can read it without copies or read() loops.
+// Allocating it in the sandboxee maps the file there, passing PtrNone() and
+// GetSize() then hands the mapping to a sandboxed function. The host maps the
+// file too, GetData() returns its contents. The default policy allows the
+// read-only shared mappings this needs, custom ones must allow them as well.
+// The file must not be truncated while mapped: accessing pages beyond its end
+// raises SIGBUS on both sides.
+class MappedFile : public Var {
+ public:
+  // Maps the regular, non-empty file open as `fd`, which is not taken over.
+  // The file is reopened read-only, so the sandboxee can't write to it even if
+  // `fd` allows that.
+  static absl::StatusOr<std::unique_ptr<MappedFile>> Create(int fd);
+
+  // Maps the regular, non-empty file at `path`.
+  static absl::StatusOr<std::unique_ptr<MappedFile>> Open(
+      const std::string& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile() override;
+
+  const uint8_t* GetData() const { return data_; }
+
+  // Describes the mapping in the sandboxee, e.g. to set up a
+  // v::Struct<LenValStruct> for functions taking one. Only valid once
+  // allocated.
+  LenValStruct GetLenValStruct() const {
+    return LenValStruct(size_, GetRemote());
+  }
+
+  size_t GetSize() const final { return size_; }
+  Type GetType() const final { return Type::kArray; }
+  std::string GetTypeString() const final { return "MappedFile"; }
+  std::string ToString() const final;
+
+ protected:
+  // Maps the file into the sandboxee.
+  absl::Status Allocate(RPCChannel* rpc_channel, bool automatic_free) override;
+  absl::Status Free(RPCChannel* rpc_channel) override;
+
+  // There is nothing to transfer, the sandboxee reads the file itself. Changes
+  // on its side are impossible with a read-only mapping.
+  absl::Status TransferToSandboxee(RPCChannel* rpc_channel,
+                                   pid_t pid) override {
+    return absl::OkStatus();
+  }
+  absl::Status TransferFromSandboxee(RPCChannel* rpc_channel,
+                                     pid_t pid) override {
+    return absl::OkStatus();
+  }
+  absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                        size_t offset, size_t length) override {
+    return CheckRange(offset, length);
+  }
+  absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                          size_t offset,
+                                          size_t length) override {
+    return CheckRange(offset, length);
+  }
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override {
+    return false;
+  }
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override {
+    return Allocate(rpc_channel, /*automatic_free=*/true);
+  }
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override {
+    return Free(rpc_channel);
+  }
+
+ private:
+  // Maps the read-only `fd`, taking ownership of it.
+  static absl::StatusOr<std::unique_ptr<MappedFile>> Map(int fd);
+
+  MappedFile(int fd, uint8_t* data, size_t size);
+
+  absl::Status CheckRange(size_t offset, size_t length) const;
+
+  int fd_;
+  uint8_t* data_;
+  size_t size_;
+};
+
+// Read-mostly data, e.g. a dictionary or a model, loaded once into a sealed
+// memfd so that any number of sandboxees can map it with Map(). All mappings,
+// the host's included, share the same physical pages, so each additional
+// sandboxee costs only its page tables instead of a private copy. The data can
+// no longer be changed once loaded. Usually held in a shared_ptr next to a
+// SandboxPool, and mapped by each sandbox as it is set up.
+//
+// Example:
+//   SAPI_ASSIGN_OR_RETURN(std::shared_ptr<const v::SharedData> model,
+//                         v::SharedData::Create(model_bytes));
+//   ...
+//   SAPI_ASSIGN_OR_RETURN(std::unique_ptr<v::MappedFile> mapped,
+//                         model->Map());
+//   SAPI_RETURN_IF_ERROR(sandbox->Allocate(mapped.get(), true));
+//   SAPI_RETURN_IF_ERROR(api.load_model(mapped->PtrNone(), mapped->GetSize()));
+class SharedData {
+ public:
+  // Copies the non-empty `data` into a new sealed memfd, named `name` for
+  // /proc/<pid>/maps.
+  static absl::StatusOr<std::shared_ptr<const SharedData>> Create(
+      absl::Span<const uint8_t> data, const std::string& name = "shared_data");
+
+  SharedData(const SharedData&) = delete;
+  SharedData& operator=(const SharedData&) = delete;
+  ~SharedData();
+
+  // Maps the data read-only, for a single sandboxee.
+  absl::StatusOr<std::unique_ptr<MappedFile>> Map() const {
+    return MappedFile::Create(fd_);
+  }
+
+  int fd() const { return fd_; }
+  size_t size() const { return size_; }
+
+ private:
+  SharedData(int fd, size_t size) : fd_(fd), size_(size) {}
+
+  int fd_;
+  size_t size_;
+};
+
+}  // namespace sapi::v
+
+#endif  // SANDBOXED_API_VAR_MAPPED_FILE_H_
@@ -22,6 +22,7 @@
 #include <memory>
 #include <vector>
 
+#include "google/protobuf/arena.h"
 #include "absl/base/macros.h"
 #include "absl/status/statusor.h"
 #include "absl/utility/utility.h"
@@ -62,6 +63,14 @@ class Proto : public Var {
         wrapped_var_.GetDataSize());
   }
 
+  // Returns a copy of the stored protobuf object, allocated on `arena`. The
+  // arena retains ownership, unless it is nullptr.
+  absl::StatusOr<T*> GetMessage(google::protobuf::Arena* arena) const {
+    return DeserializeProto<T>(
+        reinterpret_cast<const char*>(wrapped_var_.GetData()),
+        wrapped_var_.GetDataSize(), arena);
+  }
+
   ABSL_DEPRECATED("Use GetMessage() instead")
   std::unique_ptr<T> GetProtoCopy() const {
     if (auto proto = GetMessage(); proto.ok()) {
@@ -97,6 +106,34 @@ class Proto : public Var {
     return wrapped_var_.TransferFromSandboxee(rpc_channel, pid);
   }
 
+  absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                        size_t offset, size_t length) override {
+    return wrapped_var_.TransferRangeToSandboxee(rpc_channel, pid, offset,
+                                                 length);
+  }
+
+  absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                          size_t offset,
+                                          size_t length) override {
+    return wrapped_var_.TransferRangeFromSandboxee(rpc_channel, pid, offset,
+                                                   length);
+  }
+
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override {
+    return false;
+  }
+
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override {
+    return wrapped_var_.AllocateAndTransferToSandboxee(rpc_channel, pid);
+  }
+
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override {
+    return wrapped_var_.TransferFromSandboxeeAndFree(rpc_channel, pid);
+  }
+
  private:
   friend class absl::StatusOr<Proto<T>>;
 
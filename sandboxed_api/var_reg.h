@@ -34,6 +34,9 @@ class Callable : public Var {
   // Set internal data from ptr.
   virtual void SetDataFromPtr(const void* ptr, size_t max_sz) = 0;
 
+  // Whether the stored data is a signed integer.
+  virtual bool IsSigned() const { return false; }
+
   // Get data from internal ptr.
   void GetDataFromPtr(void* ptr, size_t max_sz) {
     size_t min_sz = std::min<size_t>(GetSize(), max_sz);
@@ -60,19 +63,25 @@ class Reg : public Callable {
 
   // Getter/Setter for the stored value.
   virtual T GetValue() const { return value_; }
-  virtual void SetValue(T value) { value_ = value; }
+  virtual void SetValue(T value) {
+    value_ = value;
+    MarkModified();
+  }
 
   const void* GetDataPtr() override {
     return reinterpret_cast<const void*>(&value_);
   }
   void SetDataFromPtr(const void* ptr, size_t max_sz) override {
     memcpy(&value_, ptr, std::min(GetSize(), max_sz));
+    MarkModified();
   }
 
   size_t GetSize() const override { return sizeof(T); }
 
   Type GetType() const override;
 
+  bool IsSigned() const override;
+
   std::string GetTypeString() const override;
 
   std::string ToString() const override;
@@ -96,6 +105,14 @@ Type Reg<T>::GetType() const {
   // Not reached
 }
 
+template <typename T>
+bool Reg<T>::IsSigned() const {
+  if constexpr (std::is_enum_v<T>) {
+    return std::is_signed_v<std::underlying_type_t<T>>;
+  }
+  return std::is_signed_v<T>;
+}
+
 template <typename T>
 std::string Reg<T>::GetTypeString() const {
   if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
@@ -0,0 +1,197 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_VAR_REMOTE_H_
+#define SANDBOXED_API_VAR_REMOTE_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/any_invocable.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/sandbox.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_abstract.h"
+#include "sandboxed_api/var_array.h"
+#include "sandboxed_api/var_ptr.h"
+
+namespace sapi::v {
+
+// Base class of handles to memory that exists only in the sandboxee, e.g.
+// results of a sandboxed function that are only passed on to later ones.
+// Pointers to a handle (PtrNone(), or any other sync type) pass the remote
+// address to generated functions without copying anything, the data reaches
+// the host only through an explicit Fetch().
+class RemoteHandle : public Var {
+ public:
+  // Called with the remote address when an owning handle is destroyed.
+  using FreeFunction = absl::AnyInvocable<void(void* remote)>;
+
+  RemoteHandle(const RemoteHandle&) = delete;
+  RemoteHandle& operator=(const RemoteHandle&) = delete;
+
+  ~RemoteHandle() override {
+    if (free_ && GetRemote() != nullptr) {
+      free_(GetRemote());
+    }
+  }
+
+  // Returns a FreeFunction that releases the memory with free() in the
+  // sandboxee, for memory that a sandboxed function allocated with malloc().
+  static FreeFunction FreeWithFree(Sandbox* sandbox) {
+    return [sandbox](void* remote) {
+      if (sandbox->is_active()) {
+        sandbox->rpc_channel()->Free(remote).IgnoreError();
+      }
+    };
+  }
+
+  // Gives up ownership of the remote memory, and returns its address.
+  void* Release() {
+    free_ = nullptr;
+    return GetRemote();
+  }
+
+ protected:
+  RemoteHandle(Sandbox* sandbox, void* remote, FreeFunction free)
+      : sandbox_(sandbox), free_(std::move(free)) {
+    SetRemote(remote);
+  }
+
+  Sandbox* sandbox() const { return sandbox_; }
+
+  // The memory already exists in the sandboxee and is never transferred
+  // implicitly.
+  absl::Status Allocate(RPCChannel* rpc_channel, bool automatic_free) override {
+    return absl::FailedPreconditionError(
+        "Remote handles refer to existing memory");
+  }
+  absl::Status Free(RPCChannel* rpc_channel) override {
+    return absl::FailedPreconditionError(
+        "Remote handles are freed by their FreeFunction");
+  }
+  absl::Status TransferToSandboxee(RPCChannel* rpc_channel,
+                                   pid_t pid) override {
+    return absl::OkStatus();
+  }
+  absl::Status TransferFromSandboxee(RPCChannel* rpc_channel,
+                                     pid_t pid) override {
+    return absl::OkStatus();
+  }
+  absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                        size_t offset, size_t length) override {
+    return absl::OkStatus();
+  }
+  absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                          size_t offset,
+                                          size_t length) override {
+    return absl::OkStatus();
+  }
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override {
+    return false;
+  }
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override {
+    return Allocate(rpc_channel, /*automatic_free=*/true);
+  }
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override {
+    return Free(rpc_channel);
+  }
+
+ private:
+  Sandbox* sandbox_;
+  FreeFunction free_;
+};
+
+// Handle to an array of `count` elements of type T in the sandboxee.
+//
+// Example:
+//   SAPI_ASSIGN_OR_RETURN(int* values, api.make_values(&count));
+//   v::RemoteArray<int> remote(&sandbox, values, count.GetValue(),
+//                              v::RemoteHandle::FreeWithFree(&sandbox));
+//   SAPI_RETURN_IF_ERROR(api.transform(remote.PtrNone(), remote.count()));
+//   SAPI_ASSIGN_OR_RETURN(std::vector<int> result, remote.Fetch());
+template <typename T>
+class RemoteArray : public RemoteHandle {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>,
+                "Only trivially copyable types can be fetched");
+
+  // Refers to the elements without owning them, unless `free` is set.
+  RemoteArray(Sandbox* sandbox, void* remote, size_t count,
+              FreeFunction free = nullptr)
+      : RemoteHandle(sandbox, remote, std::move(free)), count_(count) {}
+
+  size_t count() const { return count_; }
+
+  // Copies the elements to the host.
+  absl::StatusOr<std::vector<T>> Fetch() const {
+    std::vector<T> data(count_);
+    if (count_ == 0) {
+      return data;
+    }
+    Array<T> local(data.data(), count_);
+    local.SetRemote(GetRemote());
+    SAPI_RETURN_IF_ERROR(sandbox()->TransferFromSandboxee(&local));
+    return data;
+  }
+
+  size_t GetSize() const final { return count_ * sizeof(T); }
+  Type GetType() const final { return Type::kArray; }
+  std::string GetTypeString() const final { return "RemoteArray"; }
+  std::string ToString() const final {
+    return absl::StrFormat("RemoteArray, remote: %p, count: %d", GetRemote(),
+                           count_);
+  }
+
+ private:
+  size_t count_;
+};
+
+// Handle to a null-terminated string in the sandboxee, whose length is only
+// determined by Fetch().
+class RemoteString : public RemoteHandle {
+ public:
+  // Refers to the string without owning it, unless `free` is set.
+  RemoteString(Sandbox* sandbox, void* remote, FreeFunction free = nullptr)
+      : RemoteHandle(sandbox, remote, std::move(free)) {}
+
+  // Copies the string to the host, see Sandbox::GetCString().
+  absl::StatusOr<std::string> Fetch() const {
+    return sandbox()->GetCString(RemotePtr(GetRemote()));
+  }
+
+  // The size is not known without asking the sandboxee.
+  size_t GetSize() const final { return 0; }
+  Type GetType() const final { return Type::kArray; }
+  std::string GetTypeString() const final { return "RemoteString"; }
+  std::string ToString() const final {
+    return absl::StrFormat("RemoteString, remote: %p", GetRemote());
+  }
+};
+
+}  // namespace sapi::v
+
+#endif  // SANDBOXED_API_VAR_REMOTE_H_
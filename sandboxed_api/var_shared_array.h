@@ -0,0 +1,147 @@
+// Copyright 2026 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SANDBOXED_API_VAR_SHARED_ARRAY_H_
+#define SANDBOXED_API_VAR_SHARED_ARRAY_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "sandboxed_api/rpcchannel.h"
+#include "sandboxed_api/sandbox2/buffer.h"
+#include "sandboxed_api/util/status_macros.h"
+#include "sandboxed_api/var_abstract.h"
+
+namespace sapi::v {
+
+// Class representing an array that lives in memory shared with the sandboxee,
+// so that it never needs to be transferred. Allocating it in the sandboxee
+// maps the memory there, and sandboxed functions get a pointer into that
+// mapping. Writes on either side are immediately visible on the other.
+// The default policy allows the mmap() this needs if the sandbox overrides
+// Sandbox::UseSharedArrays(), custom ones must allow shared read-write
+// mappings.
+// As the sandboxee can change the contents at any time, they must be treated
+// as untrusted, even while no sandboxed function is running.
+template <class T>
+class SharedArray : public Var {
+ public:
+  // The array is zero-initialized and owned by this object.
+  explicit SharedArray(size_t nelem)
+      : nelem_(nelem), total_size_(nelem_ * sizeof(T)) {
+    CHECK_GT(total_size_, 0);
+    // The sandboxee must not be able to truncate the memory under us.
+    auto buffer =
+        sandbox2::Buffer::CreateWithSize(total_size_, {.seal_size = true});
+    CHECK_OK(buffer.status());
+    buffer_ = *std::move(buffer);
+    SetLocal(buffer_->data());
+  }
+
+  ~SharedArray() override {
+    if (GetFreeRPCChannel() && GetRemote()) {
+      Free(GetFreeRPCChannel()).IgnoreError();
+      // Even if that failed, ~Var() must not pass the mapping to free().
+      SetRemote(nullptr);
+    }
+  }
+
+  T& operator[](size_t v) const { return GetData()[v]; }
+  T* GetData() const { return reinterpret_cast<T*>(buffer_->data()); }
+
+  size_t GetNElem() const { return nelem_; }
+  size_t GetSize() const final { return total_size_; }
+  Type GetType() const final { return Type::kArray; }
+  std::string GetTypeString() const final { return "SharedArray"; }
+  std::string ToString() const final {
+    return absl::StrCat("SharedArray, elem size: ", sizeof(T),
+                        " B., total size: ", total_size_,
+                        " B., nelems: ", GetNElem());
+  }
+
+ protected:
+  // Maps the shared memory into the sandboxee.
+  absl::Status Allocate(RPCChannel* rpc_channel, bool automatic_free) override {
+    void* addr;
+    SAPI_RETURN_IF_ERROR(
+        rpc_channel->MapBuffer(buffer_->fd(), GetSize(), &addr));
+    SetRemote(addr);
+    if (automatic_free) {
+      SetFreeRPCChannel(rpc_channel);
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status Free(RPCChannel* rpc_channel) override {
+    SAPI_RETURN_IF_ERROR(rpc_channel->UnmapBuffer(GetRemote(), GetSize()));
+    SetRemote(nullptr);
+    return absl::OkStatus();
+  }
+
+  // Both sides see the same memory, there is nothing to transfer.
+  absl::Status TransferToSandboxee(RPCChannel* rpc_channel,
+                                   pid_t pid) override {
+    return absl::OkStatus();
+  }
+  absl::Status TransferFromSandboxee(RPCChannel* rpc_channel,
+                                     pid_t pid) override {
+    return absl::OkStatus();
+  }
+  absl::Status TransferRangeToSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                        size_t offset, size_t length) override {
+    return CheckRange(offset, length);
+  }
+  absl::Status TransferRangeFromSandboxee(RPCChannel* rpc_channel, pid_t pid,
+                                          size_t offset,
+                                          size_t length) override {
+    return CheckRange(offset, length);
+  }
+  bool GetTransferRegion(struct iovec* local,
+                         struct iovec* remote) const override {
+    return false;
+  }
+  absl::Status AllocateAndTransferToSandboxee(RPCChannel* rpc_channel,
+                                              pid_t pid) override {
+    return Allocate(rpc_channel, /*automatic_free=*/true);
+  }
+  absl::Status TransferFromSandboxeeAndFree(RPCChannel* rpc_channel,
+                                            pid_t pid) override {
+    return Free(rpc_channel);
+  }
+
+ private:
+  absl::Status CheckRange(size_t offset, size_t length) const {
+    if (offset > total_size_ || length > total_size_ - offset) {
+      return absl::OutOfRangeError(
+          absl::StrCat("Range [", offset, ", ", offset, " + ", length,
+                       ") exceeds object size ", total_size_));
+    }
+    return absl::OkStatus();
+  }
+
+  std::unique_ptr<sandbox2::Buffer> buffer_;
+  size_t nelem_;       // Number of elements
+  size_t total_size_;  // Total size in bytes
+};
+
+}  // namespace sapi::v
+
+#endif  // SANDBOXED_API_VAR_SHARED_ARRAY_H_
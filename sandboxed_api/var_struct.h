@@ -41,7 +41,10 @@ class Struct : public Var {
   }
 
   const T& data() const { return struct_; }
-  T* mutable_data() { return &struct_; }
+  T* mutable_data() {
+    MarkModified();
+    return &struct_;
+  }
 
  protected:
   friend class LenVal;
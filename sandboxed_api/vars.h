@@ -16,10 +16,15 @@
 #define SANDBOXED_API_VARS_H_
 
 #include "sandboxed_api/var_array.h"
+#include "sandboxed_api/var_deep_struct.h"
+#include "sandboxed_api/var_flat.h"
 #include "sandboxed_api/var_int.h"
+#include "sandboxed_api/var_lazy_array.h"
 #include "sandboxed_api/var_lenval.h"
+#include "sandboxed_api/var_mapped_file.h"
 #include "sandboxed_api/var_proto.h"
 #include "sandboxed_api/var_ptr.h"
+#include "sandboxed_api/var_shared_array.h"
 #include "sandboxed_api/var_struct.h"
 #include "sandboxed_api/var_void.h"
 